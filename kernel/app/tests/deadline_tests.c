@@ -0,0 +1,118 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <err.h>
+#include <kernel/thread.h>
+#include <unittest.h>
+
+// The tests reserve time on cpu 0, and expect nothing else to have reserved
+// more than 10% of it.
+#define TEST_CPU 0
+#define TEST_DEADLINE LK_MSEC(10)
+
+static int deadline_test_thread(void* arg)
+{
+    return 0;
+}
+
+static thread_t* deadline_test_create(void)
+{
+    thread_t* t = thread_create("deadline tester", &deadline_test_thread, NULL,
+                                DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
+    if (t)
+        thread_set_pinned_cpu(t, TEST_CPU);
+    return t;
+}
+
+static void deadline_test_destroy(thread_t* t)
+{
+    if (!t)
+        return;
+    thread_set_deadline(t, 0, 0, 0);
+    thread_resume(t);
+    thread_join(t, NULL, INFINITE_TIME);
+}
+
+// Sets a reservation of |percent| of TEST_DEADLINE, every TEST_DEADLINE.
+static status_t deadline_test_reserve(thread_t* t, uint percent)
+{
+    lk_time_t runtime = TEST_DEADLINE * percent / 100;
+    return thread_set_deadline(t, runtime, TEST_DEADLINE, TEST_DEADLINE);
+}
+
+static bool deadline_invalid_args(void* context)
+{
+    BEGIN_TEST;
+
+    thread_t* t = deadline_test_create();
+    REQUIRE_NONNULL(t, "");
+
+    // too short a runtime
+    EXPECT_EQ(MX_ERR_INVALID_ARGS,
+              thread_set_deadline(t, LK_USEC(1), TEST_DEADLINE, TEST_DEADLINE), "");
+    // more runtime than fits before the deadline
+    EXPECT_EQ(MX_ERR_INVALID_ARGS,
+              thread_set_deadline(t, TEST_DEADLINE + 1, TEST_DEADLINE, TEST_DEADLINE), "");
+    // a deadline past the end of the period
+    EXPECT_EQ(MX_ERR_INVALID_ARGS,
+              thread_set_deadline(t, LK_MSEC(1), TEST_DEADLINE, TEST_DEADLINE - 1), "");
+    // too long a period
+    EXPECT_EQ(MX_ERR_INVALID_ARGS,
+              thread_set_deadline(t, LK_MSEC(1), TEST_DEADLINE, LK_SEC(11)), "");
+    EXPECT_FALSE(thread_is_deadline(t), "");
+
+    deadline_test_destroy(t);
+    END_TEST;
+}
+
+static bool deadline_admission(void* context)
+{
+    BEGIN_TEST;
+
+    thread_t* t1 = deadline_test_create();
+    thread_t* t2 = deadline_test_create();
+    REQUIRE_NONNULL(t1, "");
+    REQUIRE_NONNULL(t2, "");
+
+    // no cpu can give up more than 90% of its time
+    EXPECT_EQ(MX_ERR_NO_RESOURCES, deadline_test_reserve(t1, 95), "");
+    EXPECT_FALSE(thread_is_deadline(t1), "");
+
+    EXPECT_EQ(MX_OK, deadline_test_reserve(t1, 50), "");
+    EXPECT_TRUE(thread_is_deadline(t1), "");
+
+    // the second doesn't fit next to the first, and is refused outright
+    EXPECT_EQ(MX_ERR_NO_RESOURCES, deadline_test_reserve(t2, 50), "");
+    EXPECT_FALSE(thread_is_deadline(t2), "");
+
+    // a thread changing its own reservation isn't charged for the old one
+    EXPECT_EQ(MX_OK, deadline_test_reserve(t1, 60), "");
+    EXPECT_EQ(MX_OK, deadline_test_reserve(t1, 30), "");
+
+    // and a refused change leaves the old reservation in place
+    EXPECT_EQ(MX_ERR_NO_RESOURCES, deadline_test_reserve(t1, 95), "");
+    EXPECT_TRUE(thread_is_deadline(t1), "");
+    EXPECT_EQ(TEST_DEADLINE * 30 / 100, t1->deadline.runtime, "");
+
+    // what the first leaves is enough, and no more
+    EXPECT_EQ(MX_ERR_NO_RESOURCES, deadline_test_reserve(t2, 70), "");
+    EXPECT_EQ(MX_OK, deadline_test_reserve(t2, 50), "");
+
+    // giving a reservation up makes room for others
+    EXPECT_EQ(MX_OK, thread_set_deadline(t1, 0, 0, 0), "");
+    EXPECT_FALSE(thread_is_deadline(t1), "");
+    EXPECT_EQ(MX_OK, deadline_test_reserve(t2, 80), "");
+
+    deadline_test_destroy(t1);
+    deadline_test_destroy(t2);
+    END_TEST;
+}
+
+UNITTEST_START_TESTCASE(deadline_tests)
+UNITTEST("deadline invalid args", deadline_invalid_args)
+UNITTEST("deadline admission", deadline_admission)
+UNITTEST_END_TESTCASE(deadline_tests, "deadline", "Tests of deadline scheduling admission",
+                      NULL, NULL);
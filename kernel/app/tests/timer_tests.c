@@ -9,6 +9,7 @@
 #include <stdio.h>
 #include <err.h>
 #include <inttypes.h>
+#include <arch/ops.h>
 #include <kernel/timer.h>
 #include <kernel/event.h>
 #include <kernel/thread.h>
@@ -70,8 +71,148 @@ static void timer_test_all_cpus(void)
     printf("%u threads created, %u threads joined\n", max, joined);
 }
 
+#define ORDER_TEST_TIMERS 64
+
+struct order_test_timer {
+    timer_t timer;
+    lk_time_t deadline;
+    lk_time_t fired;
+    int order;
+};
+
+static int order_test_count;
+
+static enum handler_return order_test_cb(struct timer* timer, lk_time_t now, void* arg)
+{
+    struct order_test_timer* t = (struct order_test_timer*)arg;
+    t->fired = now;
+    t->order = order_test_count++;
+
+    return INT_NO_RESCHEDULE;
+}
+
+static struct order_test_timer order_test_timers[ORDER_TEST_TIMERS];
+
+static void timer_test_order(void)
+{
+    int failures = 0;
+
+    order_test_count = 0;
+
+    // queue all of the timers on the same cpu, spread across several levels
+    // of the timer wheel, then cancel a quarter of them
+    arch_disable_ints();
+    lk_time_t start = current_time();
+    for (uint i = 0; i < ORDER_TEST_TIMERS; i++) {
+        struct order_test_timer* t = &order_test_timers[i];
+        timer_initialize(&t->timer);
+        t->deadline = start + LK_MSEC(1) + ((i * 37) % ORDER_TEST_TIMERS) * LK_MSEC(3);
+        t->fired = 0;
+        t->order = -1;
+        timer_set_oneshot(&t->timer, t->deadline, order_test_cb, t);
+    }
+    for (uint i = 0; i < ORDER_TEST_TIMERS; i += 4)
+        timer_cancel(&order_test_timers[i].timer);
+    arch_enable_ints();
+
+    thread_sleep(start + LK_MSEC(250));
+
+    for (uint i = 0; i < ORDER_TEST_TIMERS; i++) {
+        struct order_test_timer* t = &order_test_timers[i];
+        if (i % 4 == 0) {
+            if (t->order >= 0) {
+                printf("canceled timer %u fired\n", i);
+                failures++;
+            }
+            continue;
+        }
+        if (t->order < 0) {
+            printf("timer %u never fired\n", i);
+            failures++;
+            continue;
+        }
+        if (t->fired < t->deadline) {
+            printf("timer %u fired early, %" PRIu64 " < %" PRIu64 "\n", i, t->fired, t->deadline);
+            failures++;
+        }
+        for (uint j = 0; j < ORDER_TEST_TIMERS; j++) {
+            struct order_test_timer* u = &order_test_timers[j];
+            if (u->order >= 0 && u->deadline < t->deadline && u->order > t->order) {
+                printf("timer %u fired after timer %u\n", j, i);
+                failures++;
+            }
+        }
+    }
+
+    // timers with enough slack are coalesced onto a few interrupts
+    start = current_time();
+    arch_disable_ints();
+    for (uint i = 0; i < 8; i++) {
+        struct order_test_timer* t = &order_test_timers[i];
+        t->deadline = start + LK_MSEC(20) + i * LK_USEC(100);
+        t->order = -1;
+        timer_set_oneshot_etc(&t->timer, t->deadline, LK_MSEC(2), order_test_cb, t);
+    }
+    arch_enable_ints();
+
+    thread_sleep(start + LK_MSEC(50));
+
+    uint interrupts = 0;
+    for (uint i = 0; i < 8; i++) {
+        struct order_test_timer* t = &order_test_timers[i];
+        if (t->order < 0) {
+            printf("slack timer %u never fired\n", i);
+            failures++;
+            continue;
+        }
+        if (t->fired < t->deadline) {
+            printf("slack timer %u fired early\n", i);
+            failures++;
+        }
+        bool seen = false;
+        for (uint j = 0; j < i; j++) {
+            if (order_test_timers[j].fired == t->fired)
+                seen = true;
+        }
+        if (!seen)
+            interrupts++;
+    }
+    if (interrupts > 2) {
+        printf("slack timers fired over %u interrupts\n", interrupts);
+        failures++;
+    }
+
+    // timers sharing a slot of the wheel, queued latest first, still fire
+    // in deadline order
+    order_test_count = 0;
+    start = current_time();
+    arch_disable_ints();
+    for (uint i = 0; i < 16; i++) {
+        struct order_test_timer* t = &order_test_timers[i];
+        t->deadline = start + LK_MSEC(10) + (15 - i) * LK_USEC(2);
+        t->order = -1;
+        timer_set_oneshot(&t->timer, t->deadline, order_test_cb, t);
+    }
+    arch_enable_ints();
+
+    thread_sleep(start + LK_MSEC(30));
+
+    for (uint i = 0; i < 16; i++) {
+        struct order_test_timer* t = &order_test_timers[i];
+        if (t->order != (int)(15 - i)) {
+            printf("same slot timer %u fired %d, expected %u\n", i, t->order, 15 - i);
+            failures++;
+        }
+    }
+
+    printf("timer order test: %s\n", failures ? "FAILED" : "PASSED");
+}
+
 void timer_tests(void)
 {
     // timer fires on all cpus
     timer_test_all_cpus();
+
+    // timers fire in order and canceled timers don't fire
+    timer_test_order();
 }
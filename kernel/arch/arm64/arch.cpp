@@ -307,6 +307,22 @@ void arch_idle(void)
     __asm__ volatile("wfi");
 }
 
+bool arch_idle_can_poll(lk_time_t expected_idle)
+{
+    return true;
+}
+
+void arch_idle_poll(volatile uint32_t *wake, lk_time_t expected_idle)
+{
+    // Arm the exclusive monitor on the wake word. A store to it from another
+    // cpu clears the monitor, which is a wake up event for wfe, so no sev is
+    // needed. There are no deeper states to pick between.
+    uint32_t val;
+    __asm__ volatile("ldaxr %w0, [%1]" : "=r"(val) : "r"(wake) : "memory");
+    if (val == 0)
+        __asm__ volatile("wfe" ::: "memory");
+}
+
 void arch_chain_load(void *entry, ulong arg0, ulong arg1, ulong arg2, ulong arg3)
 {
     PANIC_UNIMPLEMENTED;
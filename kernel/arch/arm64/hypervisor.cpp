@@ -17,7 +17,12 @@ status_t arch_guest_create(mxtl::RefPtr<VmObject> phys_mem,
     return MX_ERR_NOT_SUPPORTED;
 }
 
-status_t arch_guest_enter(const mxtl::unique_ptr<GuestContext>& context) {
+status_t arch_guest_create_vcpu(const mxtl::unique_ptr<GuestContext>& context,
+                                mxtl::RefPtr<FifoDispatcher> ctl_fifo, uint32_t* vcpu) {
+    return MX_ERR_NOT_SUPPORTED;
+}
+
+status_t arch_guest_enter(const mxtl::unique_ptr<GuestContext>& context, uint32_t vcpu) {
     return MX_ERR_NOT_SUPPORTED;
 }
 
@@ -26,20 +31,22 @@ status_t arch_guest_mem_trap(const mxtl::unique_ptr<GuestContext>& context, vadd
     return MX_ERR_NOT_SUPPORTED;
 }
 
-status_t arch_guest_interrupt(const mxtl::unique_ptr<GuestContext>& context, uint8_t interrupt) {
+status_t arch_guest_interrupt(const mxtl::unique_ptr<GuestContext>& context, uint32_t vcpu,
+                              uint8_t interrupt) {
     return MX_ERR_NOT_SUPPORTED;
 }
 
-status_t arch_guest_set_gpr(const mxtl::unique_ptr<GuestContext>& context,
+status_t arch_guest_set_gpr(const mxtl::unique_ptr<GuestContext>& context, uint32_t vcpu,
                             const mx_guest_gpr_t& guest_gpr) {
     return MX_ERR_NOT_SUPPORTED;
 }
 
-status_t arch_guest_get_gpr(const mxtl::unique_ptr<GuestContext>& context,
+status_t arch_guest_get_gpr(const mxtl::unique_ptr<GuestContext>& context, uint32_t vcpu,
                             mx_guest_gpr_t* guest_gpr) {
     return MX_ERR_NOT_SUPPORTED;
 }
 
-status_t arch_guest_set_ip(const mxtl::unique_ptr<GuestContext>& context, uintptr_t guest_ip) {
+status_t arch_guest_set_ip(const mxtl::unique_ptr<GuestContext>& context, uint32_t vcpu,
+                           uintptr_t guest_ip) {
     return MX_ERR_NOT_SUPPORTED;
 }
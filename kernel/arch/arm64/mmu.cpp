@@ -7,6 +7,7 @@
 
 #include <arch/arm64/mmu.h>
 #include <assert.h>
+#include <bits.h>
 #include <debug.h>
 #include <err.h>
 #include <inttypes.h>
@@ -14,7 +15,6 @@
 #include <kernel/vm.h>
 #include <kernel/vm/pmm.h>
 #include <lib/heap.h>
-#include <rand.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
@@ -28,8 +28,10 @@ static_assert(((long)KERNEL_ASPACE_BASE >> MMU_KERNEL_SIZE_SHIFT) == -1, "");
 static_assert(MMU_KERNEL_SIZE_SHIFT <= 48, "");
 static_assert(MMU_KERNEL_SIZE_SHIFT >= 25, "");
 
-static uint64_t asid_pool[(1 << MMU_ARM64_ASID_BITS) / 64];
+static unsigned long asid_pool[BITMAP_NUM_WORDS(1 << MMU_ARM64_ASID_BITS)];
 static mutex_t asid_lock = MUTEX_INITIAL_VALUE(asid_lock);
+// where the next asid search starts, asid 0 is never handed out
+static int asid_next = 1;
 
 uint32_t arm64_zva_shift;
 
@@ -39,24 +41,32 @@ pte_t arm64_kernel_translation_table[MMU_KERNEL_PAGE_TABLE_ENTRIES_TOP] __ALIGNE
 
 static status_t arm64_mmu_alloc_asid(uint16_t* asid) {
 
-    uint16_t new_asid;
-    uint32_t retry = 1 << MMU_ARM64_ASID_BITS;
-
     mutex_acquire(&asid_lock);
-    do {
-        new_asid = static_cast<uint16_t>(rand()) & ~(-(1 << MMU_ARM64_ASID_BITS));
-        retry--;
-        if (retry == 0) {
-            mutex_release(&asid_lock);
-            return MX_ERR_NO_MEMORY;
+
+    int new_asid = -1;
+    for (int pass = 0; pass < 2 && new_asid < 0; pass++) {
+        for (int i = asid_next; i < (1 << MMU_ARM64_ASID_BITS); i++) {
+            if (!bitmap_test(asid_pool, i)) {
+                new_asid = i;
+                break;
+            }
         }
-    } while ((asid_pool[new_asid >> 6] & (1 << (new_asid % 64))) || (new_asid == 0));
+        asid_next = 1;
+    }
+    if (new_asid < 0) {
+        mutex_release(&asid_lock);
+        return MX_ERR_NO_MEMORY;
+    }
 
-    asid_pool[new_asid >> 6] = asid_pool[new_asid >> 6] | (1 << (new_asid % 64));
+    bitmap_set(asid_pool, new_asid, 1);
+
+    // hand out asids round robin so a freed one (whose TLB entries have
+    // already been dropped) sits idle for as long as possible
+    asid_next = new_asid + 1;
 
     mutex_release(&asid_lock);
 
-    *asid = new_asid;
+    *asid = static_cast<uint16_t>(new_asid);
 
     return MX_OK;
 }
@@ -65,7 +75,7 @@ static status_t arm64_mmu_free_asid(uint16_t asid) {
 
     mutex_acquire(&asid_lock);
 
-    asid_pool[asid >> 6] = asid_pool[asid >> 6] & ~(1 << (asid % 64));
+    bitmap_clear(asid_pool, asid, 1);
 
     mutex_release(&asid_lock);
 
@@ -325,6 +335,58 @@ static volatile pte_t* arm64_mmu_get_page_table(vaddr_t index, uint page_size_sh
     }
 }
 
+// Replace the block mapping at page_table[index] with a next level table
+// mapping the same range with the same attributes, so that part of it can be
+// unmapped or have its permissions changed.
+static status_t arm64_mmu_split_block(vaddr_t vaddr, vaddr_t index,
+                                      uint index_shift, uint page_size_shift,
+                                      volatile pte_t* page_table, uint asid) {
+    pte_t pte = page_table[index];
+    DEBUG_ASSERT(index_shift > page_size_shift);
+    DEBUG_ASSERT((pte & MMU_PTE_DESCRIPTOR_MASK) == MMU_PTE_L012_DESCRIPTOR_BLOCK);
+
+    paddr_t table_paddr;
+    status_t ret = alloc_page_table(&table_paddr, page_size_shift);
+    if (ret) {
+        TRACEF("failed to allocate page table for split\n");
+        return MX_ERR_NO_MEMORY;
+    }
+
+    const uint next_shift = index_shift - (page_size_shift - 3);
+    const size_t next_size = 1UL << next_shift;
+    const size_t count = 1UL << (page_size_shift - 3);
+    const paddr_t block_paddr = pte & MMU_PTE_OUTPUT_ADDR_MASK;
+    const pte_t attrs = pte & ~(MMU_PTE_OUTPUT_ADDR_MASK | MMU_PTE_DESCRIPTOR_MASK);
+    const pte_t desc = (next_shift > page_size_shift) ? MMU_PTE_L012_DESCRIPTOR_BLOCK
+                                                      : MMU_PTE_L3_DESCRIPTOR_PAGE;
+
+    volatile pte_t* table = static_cast<volatile pte_t*>(paddr_to_kvaddr(table_paddr));
+    for (size_t i = 0; i < count; i++) {
+        table[i] = (block_paddr + i * next_size) | attrs | desc;
+    }
+
+    LTRACEF("splitting block pte %p[%#" PRIxPTR "] %#" PRIx64 " into table %#" PRIxPTR "\n",
+            page_table, index, pte, table_paddr);
+
+    // break before make: the block has to be invalid and flushed before the
+    // table may take its place
+    page_table[index] = MMU_PTE_DESCRIPTOR_INVALID;
+    CF;
+    for (size_t i = 0; i < count; i++) {
+        vaddr_t va = vaddr + i * next_size;
+        if (asid == MMU_ARM64_GLOBAL_ASID)
+            ARM64_TLBI(vaae1is, va >> 12);
+        else
+            ARM64_TLBI(vae1is, va >> 12 | (vaddr_t)asid << 48);
+    }
+    DSB;
+
+    page_table[index] = table_paddr | MMU_PTE_L012_DESCRIPTOR_TABLE;
+    __asm__ volatile("dmb ishst" ::
+                         : "memory");
+    return MX_OK;
+}
+
 static bool page_table_is_clear(volatile pte_t* page_table, uint page_size_shift) {
     int i;
     int count = 1U << (page_size_shift - 3);
@@ -370,6 +432,16 @@ static ssize_t arm64_mmu_unmap_pt(vaddr_t vaddr, vaddr_t vaddr_rel,
 
         pte = page_table[index];
 
+        // unmapping part of a block, break it up first. If that fails the
+        // whole block goes, which only costs the caller some refaults.
+        if (index_shift > page_size_shift && chunk_size != block_size &&
+            (pte & MMU_PTE_DESCRIPTOR_MASK) == MMU_PTE_L012_DESCRIPTOR_BLOCK) {
+            if (arm64_mmu_split_block(vaddr - vaddr_rem, index, index_shift, page_size_shift,
+                                      page_table, asid) == MX_OK) {
+                pte = page_table[index];
+            }
+        }
+
         if (index_shift > page_size_shift &&
             (pte & MMU_PTE_DESCRIPTOR_MASK) == MMU_PTE_L012_DESCRIPTOR_TABLE) {
             page_table_paddr = pte & MMU_PTE_OUTPUT_ADDR_MASK;
@@ -528,6 +600,17 @@ static int arm64_mmu_protect_pt(vaddr_t vaddr_in, vaddr_t vaddr_rel_in,
         index = vaddr_rel >> index_shift;
         pte = page_table[index];
 
+        // changing part of a block, break it up first
+        if (index_shift > page_size_shift && chunk_size != block_size &&
+            (pte & MMU_PTE_DESCRIPTOR_MASK) == MMU_PTE_L012_DESCRIPTOR_BLOCK) {
+            ret = arm64_mmu_split_block(vaddr - vaddr_rem, index, index_shift, page_size_shift,
+                                        page_table, asid);
+            if (ret != 0) {
+                goto err;
+            }
+            pte = page_table[index];
+        }
+
         if (index_shift > page_size_shift &&
             (pte & MMU_PTE_DESCRIPTOR_MASK) == MMU_PTE_L012_DESCRIPTOR_TABLE) {
             page_table_paddr = pte & MMU_PTE_OUTPUT_ADDR_MASK;
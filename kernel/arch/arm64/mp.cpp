@@ -12,6 +12,7 @@
 #include <err.h>
 #include <dev/interrupt.h>
 #include <arch/ops.h>
+#include <kernel/mp.h>
 
 #define LOCAL_TRACE 0
 
@@ -34,6 +35,9 @@ void arch_init_cpu_map(uint cluster_count, uint* cluster_cpus) {
             arm64_cpu_map[cluster][cpu] = cpu_id;
             arm64_cpu_cluster_ids[cpu_id] = cluster;
             arm64_cpu_cpu_ids[cpu_id] = cpu_id;
+
+            // cpus in a cluster share its L2, and there are no hyperthreads
+            mp_set_cpu_topology(cpu_id, 0, cluster, cpu_id);
             cpu_id++;
         }
     }
@@ -25,11 +25,17 @@ static uint32_t core_shift = 0;
 static uint32_t package_mask = ~0;
 static uint32_t package_shift = 0;
 
+// The apic id bits above this shift identify the last level cache. Without
+// cache information the whole package is assumed to share it.
+static uint32_t cache_shift = 0;
+static bool cache_shift_valid = false;
+
 static int initialized;
 
 static void legacy_topology_init(void);
 static void modern_intel_topology_init(void);
 static void extended_amd_topology_init(void);
+static void cache_topology_init(void);
 
 void x86_cpu_topology_init(void)
 {
@@ -44,6 +50,46 @@ void x86_cpu_topology_init(void)
     } else {
         legacy_topology_init();
     }
+
+    cache_topology_init();
+}
+
+static void cache_topology_init(void)
+{
+    // Intel's deterministic cache parameters leaf and AMD's cache topology
+    // leaf share a layout: one subleaf per cache, until a null cache type.
+    enum x86_cpuid_leaf_num leaf_num;
+    if (x86_vendor == X86_VENDOR_INTEL) {
+        leaf_num = X86_CPUID_CACHE_V2;
+    } else if (x86_vendor == X86_VENDOR_AMD && x86_feature_test(X86_FEATURE_AMD_TOPO)) {
+        leaf_num = X86_CPUID_AMD_CACHE;
+    } else {
+        return;
+    }
+
+    uint32_t highest_level = 0;
+    for (uint32_t subleaf = 0; subleaf < 16; subleaf++) {
+        struct cpuid_leaf leaf;
+        if (!x86_get_cpuid_subleaf(leaf_num, subleaf, &leaf)) {
+            return;
+        }
+
+        uint32_t type = BITS(leaf.a, 4, 0);
+        if (type == 0) {
+            break;
+        }
+
+        uint32_t level = BITS_SHIFT(leaf.a, 7, 5);
+        if (level > highest_level) {
+            // maximum number of addressable ids sharing this cache
+            uint32_t sharing = BITS_SHIFT(leaf.a, 25, 14) + 1;
+            highest_level = level;
+            cache_shift = log2_uint_ceil(sharing);
+            cache_shift_valid = true;
+        }
+    }
+
+    LTRACEF("last level cache L%u, cache_shift %u\n", highest_level, cache_shift);
 }
 
 static void modern_intel_topology_init(void)
@@ -153,4 +199,5 @@ void x86_cpu_topology_decode(uint32_t apic_id, x86_cpu_topology_t *topo) {
     topo->package_id = (apic_id & package_mask) >> package_shift;
     topo->core_id = (apic_id & core_mask) >> core_shift;
     topo->smt_id = apic_id & smt_mask;
+    topo->cache_id = cache_shift_valid ? (apic_id >> cache_shift) : 0;
 }
@@ -13,6 +13,7 @@
 #include <arch/x86/feature.h>
 #include <arch/x86/interrupts.h>
 #include <arch/x86/descriptor.h>
+#include <arch/x86/perfmon.h>
 #include <kernel/thread.h>
 #include <kernel/stats.h>
 #include <kernel/vm/fault.h>
@@ -425,6 +426,17 @@ void x86_exception_handler(x86_iframe_t *frame)
             /* no return */
             break;
         }
+        case X86_INT_APIC_PMI: {
+            ret = x86_perfmon_interrupt_handler(frame);
+            apic_issue_eoi();
+            break;
+        }
+        /* a guest takes posted interrupts on its next VM entry if the
+         * notification arrives after it has exited, so nothing to do */
+        case X86_INT_POSTED_INTERRUPT: {
+            apic_issue_eoi();
+            break;
+        }
         /* pass all other non-Intel defined irq vectors to the platform */
         case X86_INT_PLATFORM_BASE  ... X86_INT_PLATFORM_MAX: {
             CPU_STATS_INC(interrupts);
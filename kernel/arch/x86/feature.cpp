@@ -189,6 +189,7 @@ void x86_feature_debug(void)
         { X86_FEATURE_SSE2, "sse2" },
         { X86_FEATURE_SSE3, "sse3" },
         { X86_FEATURE_SSSE3, "ssse3" },
+        { X86_FEATURE_PDCM, "pdcm" },
         { X86_FEATURE_SSE4_1, "sse4.1" },
         { X86_FEATURE_SSE4_2, "sse4.2" },
         { X86_FEATURE_MMX, "mmx" },
@@ -201,6 +202,9 @@ void x86_feature_debug(void)
         { X86_FEATURE_TSC_ADJUST, "tsc_adj" },
         { X86_FEATURE_SMEP, "smep" },
         { X86_FEATURE_SMAP, "smap" },
+        { X86_FEATURE_ERMS, "erms" },
+        { X86_FEATURE_INVPCID, "invpcid" },
+        { X86_FEATURE_FSRM, "fsrm" },
         { X86_FEATURE_RDRAND, "rdrand" },
         { X86_FEATURE_RDSEED, "rdseed" },
         { X86_FEATURE_PKU, "pku" },
@@ -214,6 +218,7 @@ void x86_feature_debug(void)
         { X86_FEATURE_HYPERVISOR, "hypervisor" },
         { X86_FEATURE_PT, "pt" },
         { X86_FEATURE_HWP, "hwp" },
+        { X86_FEATURE_ARAT, "arat" },
     };
 
     const char *vendor_string = NULL;
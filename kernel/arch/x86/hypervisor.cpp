@@ -12,6 +12,7 @@
 #include <arch/x86/descriptor.h>
 #include <arch/x86/feature.h>
 #include <kernel/auto_lock.h>
+#include <kernel/mp.h>
 #include <kernel/vm/fault.h>
 #include <kernel/vm/pmm.h>
 #include <hypervisor/guest_physical_address_space.h>
@@ -19,9 +20,13 @@
 #include <mxalloc/new.h>
 
 #if WITH_LIB_MAGENTA
+#include <magenta/event_dispatcher.h>
 #include <magenta/fifo_dispatcher.h>
+#include <magenta/state_observer.h>
 #else
+class EventDispatcher : public mxtl::RefCounted<EventDispatcher> {};
 class FifoDispatcher : public mxtl::RefCounted<FifoDispatcher> {};
+class GuestInterruptObserver {};
 #endif // WITH_LIB_MAGENTA
 
 #include "hypervisor_priv.h"
@@ -87,6 +92,23 @@ static status_t vmclear(paddr_t pa) {
     return err ? MX_ERR_INTERNAL : MX_OK;
 }
 
+enum class InvEpt : uint64_t {
+    SINGLE_CONTEXT = 1,
+};
+
+static void invept(InvEpt invalidation, uint64_t eptp) {
+    uint8_t err;
+    uint64_t descriptor[] = { eptp, 0 };
+
+    __asm__ volatile(
+        "invept %[descriptor], %[invalidation];" VMX_ERR_CHECK(err)
+        : [err] "=r"(err)
+        : [descriptor] "m"(descriptor), [invalidation] "r"(invalidation)
+        : "cc");
+
+    DEBUG_ASSERT(err == 0);
+}
+
 static uint64_t vmread(uint64_t field) {
     uint8_t err;
     uint64_t val;
@@ -147,14 +169,12 @@ void vmcs_write(VmcsFieldXX field, uint64_t val) {
     vmwrite(static_cast<uint64_t>(field), val);
 }
 
-// TODO(abdulla): Update this to execute on every CPU. For development, it is
-// convenient to only consider a single CPU for now.
-static status_t percpu_exec(thread_start_routine entry, void* arg) {
+static status_t percpu_exec(uint cpu_num, thread_start_routine entry, void* arg) {
     thread_t *t = thread_create("vmx", entry, arg, HIGH_PRIORITY, DEFAULT_STACK_SIZE);
     if (!t)
         return MX_ERR_NO_MEMORY;
 
-    thread_set_pinned_cpu(t, 0);
+    thread_set_pinned_cpu(t, cpu_num);
     status_t status = thread_resume(t);
     if (status != MX_OK)
         return status;
@@ -382,9 +402,14 @@ status_t VmxonContext::Create(mxtl::unique_ptr<VmxonContext>* context) {
     if (status != MX_OK)
         return status;
 
-    status = percpu_exec(vmx_enable, ctx.get());
-    if (status != MX_OK)
-        return status;
+    // Each VCPU runs on its own CPU, so we enable VMX on all of them.
+    for (uint cpu_num = 0; cpu_num < num_cpus; cpu_num++) {
+        if (!mp_is_cpu_online(cpu_num))
+            continue;
+        status = percpu_exec(cpu_num, vmx_enable, ctx.get());
+        if (status != MX_OK)
+            return status;
+    }
 
     *context = mxtl::move(ctx);
     return MX_OK;
@@ -408,8 +433,12 @@ static int vmx_disable(void* arg) {
 }
 
 VmxonContext::~VmxonContext() {
-    __UNUSED status_t status = percpu_exec(vmx_disable, this);
-    DEBUG_ASSERT(status == MX_OK);
+    for (uint cpu_num = 0; cpu_num < per_cpus_.size(); cpu_num++) {
+        if (!per_cpus_[cpu_num].IsOn())
+            continue;
+        __UNUSED status_t status = percpu_exec(cpu_num, vmx_disable, this);
+        DEBUG_ASSERT(status == MX_OK);
+    }
 }
 
 VmxonPerCpu* VmxonContext::PerCpu() {
@@ -429,10 +458,16 @@ status_t VmcsPerCpu::Init(const VmxInfo& vmx_info) {
     if (status != MX_OK)
         return status;
 
+    status = pi_desc_page_.Alloc(vmx_info, 0);
+    if (status != MX_OK)
+        return status;
+
     memset(&vmx_state_, 0, sizeof(vmx_state_));
+    memset(&exit_stats_, 0, sizeof(exit_stats_));
     timer_initialize(&local_apic_state_.timer);
     event_init(&local_apic_state_.event, false, EVENT_FLAG_AUTOUNSIGNAL);
     local_apic_state_.apic_addr = nullptr;
+    local_apic_state_.pi_desc = nullptr;
 
     AutoSpinLock lock(local_apic_state_.interrupt_lock);
     return local_apic_state_.interrupt_bitmap.Reset(kNumInterrupts);
@@ -533,10 +568,26 @@ status_t VmcsPerCpu::Setup(paddr_t pml4_address, paddr_t apic_access_address,
 
     AutoVmcsLoad vmcs_load(&page_);
 
+    // From Volume 3, Section 29.6: Posted-interrupt processing requires
+    // virtual-interrupt delivery, and acknowledging interrupts on VM exit. If
+    // we have all three, interrupts can be delivered to a running guest
+    // without a VM exit. Otherwise, we fall back to injecting them.
+    uint64_t procbased_ctls2 = read_msr(X86_MSR_IA32_VMX_PROCBASED_CTLS2);
+    uint64_t pinbased_ctls = read_msr(X86_MSR_IA32_VMX_TRUE_PINBASED_CTLS);
+    uint64_t exit_ctls = read_msr(X86_MSR_IA32_VMX_TRUE_EXIT_CTLS);
+    bool posted_interrupts =
+        BIT_SHIFT(procbased_ctls2, 32 + 9) &&
+        BIT_SHIFT(pinbased_ctls, 32 + 7) &&
+        BIT_SHIFT(exit_ctls, 32 + 15);
+    local_apic_state_.pi_desc = posted_interrupts ?
+        pi_desc_page_.VirtualAddress<PostedInterruptDescriptor>() : nullptr;
+
     // Setup secondary processor-based VMCS controls.
     status = set_vmcs_control(VmcsField32::PROCBASED_CTLS2,
-                              read_msr(X86_MSR_IA32_VMX_PROCBASED_CTLS2),
+                              procbased_ctls2,
                               0,
+                              // Enable virtual-interrupt delivery.
+                              (posted_interrupts ? PROCBASED_CTLS2_INT_DELIVERY : 0) |
                               // Enable APIC access virtualization.
                               PROCBASED_CTLS2_APIC_ACCESS |
                               // Enable use of extended page tables.
@@ -554,8 +605,10 @@ status_t VmcsPerCpu::Setup(paddr_t pml4_address, paddr_t apic_access_address,
 
     // Setup pin-based VMCS controls.
     status = set_vmcs_control(VmcsField32::PINBASED_CTLS,
-                              read_msr(X86_MSR_IA32_VMX_TRUE_PINBASED_CTLS),
+                              pinbased_ctls,
                               read_msr(X86_MSR_IA32_VMX_PINBASED_CTLS),
+                              // Process posted interrupts.
+                              (posted_interrupts ? PINBASED_CTLS_POSTED_INTERRUPTS : 0) |
                               // External interrupts cause a VM exit.
                               PINBASED_CTLS_EXT_INT_EXITING |
                               // Non-maskable interrupts cause a VM exit.
@@ -597,8 +650,11 @@ status_t VmcsPerCpu::Setup(paddr_t pml4_address, paddr_t apic_access_address,
 
     // Setup VM-exit VMCS controls.
     status = set_vmcs_control(VmcsField32::EXIT_CTLS,
-                              read_msr(X86_MSR_IA32_VMX_TRUE_EXIT_CTLS),
+                              exit_ctls,
                               read_msr(X86_MSR_IA32_VMX_EXIT_CTLS),
+                              // Acknowledge external interrupts on exit, and
+                              // store their vector in the exit information.
+                              (posted_interrupts ? EXIT_CTLS_ACK_INT_ON_EXIT : 0) |
                               // Logical processor is in 64-bit mode after VM
                               // exit. On VM exit CS.L, IA32_EFER.LME, and
                               // IA32_EFER.LMA is set to true.
@@ -678,10 +734,25 @@ status_t VmcsPerCpu::Setup(paddr_t pml4_address, paddr_t apic_access_address,
     // translated by traversing a set of EPT paging structures to produce
     // physical addresses that are used to access memory.
     vmcs_write(VmcsField64::EPT_POINTER, ept_pointer(pml4_address));
+    // This CPU may still have translations cached for an earlier guest whose
+    // EPT was rooted at the same page.
+    invept(InvEpt::SINGLE_CONTEXT, ept_pointer(pml4_address));
 
-    // Setup APIC handling.
+    // Setup APIC handling. The virtual-APIC address is set on first entry,
+    // once the APIC memory has been provided.
     vmcs_write(VmcsField64::APIC_ACCESS_ADDRESS, apic_access_address);
-    vmcs_write(VmcsField64::VIRTUAL_APIC_ADDRESS, vaddr_to_paddr(local_apic_state_.apic_addr));
+    local_apic_state_.host_apic_id = percpu->apic_id;
+    cpu_num_ = percpu->cpu_num;
+    if (posted_interrupts) {
+        // Handle EOIs in the virtual APIC, without a VM exit.
+        vmcs_write(VmcsField64::EOI_EXIT_BITMAP_0, 0);
+        vmcs_write(VmcsField64::EOI_EXIT_BITMAP_1, 0);
+        vmcs_write(VmcsField64::EOI_EXIT_BITMAP_2, 0);
+        vmcs_write(VmcsField64::EOI_EXIT_BITMAP_3, 0);
+        vmcs_write(VmcsField16::GUEST_INTERRUPT_STATUS, 0);
+        vmcs_write(VmcsField16::POSTED_INTERRUPT_VECTOR, X86_INT_POSTED_INTERRUPT);
+        vmcs_write(VmcsField64::POSTED_INTERRUPT_DESC_ADDRESS, pi_desc_page_.PhysicalAddress());
+    }
 
     // Setup MSR handling.
     vmcs_write(VmcsField64::MSR_BITMAPS_ADDRESS, msr_bitmaps_address);
@@ -831,8 +902,7 @@ void vmx_exit(VmxState* vmx_state) {
     }
 }
 
-status_t VmcsPerCpu::Enter(const VmcsContext& context, GuestPhysicalAddressSpace* gpas,
-                           FifoDispatcher* ctl_fifo) {
+status_t VmcsPerCpu::Enter(GuestPhysicalAddressSpace* gpas, GuestBells* bells) {
     AutoVmcsLoad vmcs_load(&page_);
     // FS is used for thread-local storage — save for this thread.
     vmcs_write(VmcsFieldXX::HOST_FS_BASE, read_msr(X86_MSR_IA32_FS_BASE));
@@ -850,10 +920,17 @@ status_t VmcsPerCpu::Enter(const VmcsContext& context, GuestPhysicalAddressSpace
     }
 
     if (!vmx_state_.resume) {
-        vmcs_write(VmcsFieldXX::GUEST_RIP, context.ip());
-        vmcs_write(VmcsFieldXX::GUEST_CR3, context.cr3());
+        vmcs_write(VmcsFieldXX::GUEST_RIP, ip_);
+        vmcs_write(VmcsFieldXX::GUEST_CR3, cr3_);
+        vmcs_write(VmcsField64::VIRTUAL_APIC_ADDRESS,
+                   vaddr_to_paddr(local_apic_state_.apic_addr));
     }
 
+    // Interrupts posted while we were outside of the guest are only picked up
+    // by the processor when it receives a notification, so collect them here.
+    if (local_apic_state_.pi_desc != nullptr)
+        local_apic_sync_posted(&local_apic_state_);
+
     status_t status = vmx_enter(&vmx_state_);
     if (status != MX_OK) {
         uint64_t error = vmcs_read(VmcsField32::INSTRUCTION_ERROR);
@@ -861,16 +938,27 @@ status_t VmcsPerCpu::Enter(const VmcsContext& context, GuestPhysicalAddressSpace
     } else {
         vmx_state_.resume = true;
         status = vmexit_handler(&vmcs_load, &vmx_state_.guest_state, &local_apic_state_, gpas,
-                                ctl_fifo);
+                                bells, ctl_fifo_.get(), &exit_stats_);
     }
     return status;
 }
 
 status_t VmcsPerCpu::Interrupt(uint8_t interrupt) {
+    if (local_apic_state_.pi_desc != nullptr) {
+        bool notify = local_apic_post_interrupt(&local_apic_state_, interrupt);
+        // If the VCPU is running, the notification has the processor deliver
+        // the interrupt to the guest without a VM exit. If we did not set the
+        // outstanding notification bit, a notification has already been sent.
+        if (event_signal(&local_apic_state_.event, true) == 0 && notify) {
+            apic_send_ipi(X86_INT_POSTED_INTERRUPT, local_apic_state_.host_apic_id,
+                          DELIVERY_MODE_FIXED);
+        }
+        return MX_OK;
+    }
     if (!local_apic_signal_interrupt(&local_apic_state_, interrupt, true)) {
         // If we did not signal the VCPU, it means it is currently running,
         // therefore we should issue an IPI to force a VM exit.
-        mp_reschedule(1u << 0, MP_IPI_RESCHEDULE);
+        mp_reschedule(1u << cpu_num_, MP_IPI_RESCHEDULE);
     }
     return MX_OK;
 }
@@ -924,6 +1012,118 @@ status_t VmcsPerCpu::SetApicMem(mxtl::RefPtr<VmObject> apic_mem) {
                                               &local_apic_state_.apic_addr);
 }
 
+void VmcsPerCpu::GetExitStats(mx_guest_exit_stats_t* exit_stats) const {
+    // The VCPU may be running, in which case this is a snapshot that can be
+    // an exit or so behind.
+    *exit_stats = exit_stats_;
+}
+
+status_t GuestBells::Set(uint32_t kind, uint64_t addr, uint64_t len,
+                         mxtl::RefPtr<EventDispatcher> event) {
+    if (kind != MX_GUEST_BELL_PORT_OUT && kind != MX_GUEST_BELL_MEM_WRITE)
+        return MX_ERR_INVALID_ARGS;
+    if (event) {
+        if (len == 0 || addr + len < addr)
+            return MX_ERR_INVALID_ARGS;
+        if (kind == MX_GUEST_BELL_PORT_OUT && addr + len > UINT16_MAX + 1u)
+            return MX_ERR_OUT_OF_RANGE;
+    }
+
+    // The old event, if any, is released once the lock is dropped.
+    mxtl::RefPtr<EventDispatcher> old_event;
+    AutoSpinLock lock(lock_);
+    Bell* free_bell = nullptr;
+    for (auto& bell : bells_) {
+        if (!bell.event) {
+            if (free_bell == nullptr)
+                free_bell = &bell;
+            continue;
+        }
+        if (bell.kind != kind)
+            continue;
+        if (bell.addr == addr) {
+            old_event = mxtl::move(bell.event);
+            bell.len = len;
+            bell.event = mxtl::move(event);
+            return MX_OK;
+        }
+        if (event && addr < bell.addr + bell.len && bell.addr < addr + len)
+            return MX_ERR_ALREADY_EXISTS;
+    }
+    if (!event)
+        return MX_ERR_NOT_FOUND;
+    if (free_bell == nullptr)
+        return MX_ERR_NO_RESOURCES;
+    free_bell->kind = kind;
+    free_bell->addr = addr;
+    free_bell->len = len;
+    free_bell->event = mxtl::move(event);
+    return MX_OK;
+}
+
+bool GuestBells::Ring(uint32_t kind, uint64_t addr) {
+    mxtl::RefPtr<EventDispatcher> event;
+    {
+        AutoSpinLock lock(lock_);
+        for (auto& bell : bells_) {
+            if (bell.event && bell.kind == kind && addr - bell.addr < bell.len) {
+                event = bell.event;
+                break;
+            }
+        }
+    }
+    if (!event)
+        return false;
+#if WITH_LIB_MAGENTA
+    event->user_signal(0, MX_EVENT_SIGNALED, false);
+#endif // WITH_LIB_MAGENTA
+    return true;
+}
+
+#if WITH_LIB_MAGENTA
+/* Sends an interrupt to the guest on each rising edge of MX_EVENT_SIGNALED,
+ * so that a host-side device can interrupt the guest without a syscall.
+ */
+class GuestInterruptObserver final : public StateObserver {
+public:
+    GuestInterruptObserver(VmcsContext* context, uint8_t interrupt,
+                           mxtl::RefPtr<EventDispatcher> event)
+        : context_(context), interrupt_(interrupt), event_(mxtl::move(event)) {
+        set_signal_interest(MX_EVENT_SIGNALED);
+    }
+
+    ~GuestInterruptObserver() {
+        // Once this returns, OnStateChange() is not running and won't be.
+        event_->get_state_tracker()->RemoveObserver(this);
+    }
+
+    void Start() { event_->get_state_tracker()->AddObserver(this, nullptr); }
+    const EventDispatcher* event() const { return event_.get(); }
+
+private:
+    Flags OnInitialize(mx_signals_t initial_state, const CountInfo* cinfo) final {
+        signaled_ = initial_state & MX_EVENT_SIGNALED;
+        return 0;
+    }
+
+    Flags OnStateChange(mx_signals_t new_state) final {
+        bool signaled = new_state & MX_EVENT_SIGNALED;
+        // Like the IO APIC, we send device interrupts to the first VCPU.
+        if (signaled && !signaled_)
+            context_->Interrupt(0, interrupt_);
+        signaled_ = signaled;
+        return 0;
+    }
+
+    Flags OnCancel(Handle* handle) final { return 0; }
+
+    VmcsContext* context_;
+    uint8_t interrupt_;
+    mxtl::RefPtr<EventDispatcher> event_;
+    bool signaled_ = false;
+};
+#endif // WITH_LIB_MAGENTA
+
 static int vmcs_setup(void* arg) {
     VmcsContext* context = static_cast<VmcsContext*>(arg);
     VmcsPerCpu* per_cpu = context->PerCpu();
@@ -943,7 +1143,7 @@ status_t VmcsContext::Create(mxtl::RefPtr<VmObject> phys_mem,
         return MX_ERR_NO_MEMORY;
 
     mxtl::Array<VmcsPerCpu> cpu_ctxs(ctxs, num_cpus);
-    mxtl::unique_ptr<VmcsContext> ctx(new (&ac) VmcsContext(ctl_fifo, mxtl::move(cpu_ctxs)));
+    mxtl::unique_ptr<VmcsContext> ctx(new (&ac) VmcsContext(mxtl::move(cpu_ctxs)));
     if (!ac.check())
         return MX_ERR_NO_MEMORY;
 
@@ -987,16 +1187,19 @@ status_t VmcsContext::Create(mxtl::RefPtr<VmObject> phys_mem,
     if (status != MX_OK)
         return status;
 
-    status = percpu_exec(vmcs_setup, ctx.get());
+    // Setup the first VCPU.
+    uint32_t vcpu;
+    status = ctx->CreateVcpu(ctl_fifo, &vcpu);
     if (status != MX_OK)
         return status;
+    DEBUG_ASSERT(vcpu == 0);
 
     *context = mxtl::move(ctx);
     return MX_OK;
 }
 
-VmcsContext::VmcsContext(mxtl::RefPtr<FifoDispatcher> ctl_fifo, mxtl::Array<VmcsPerCpu> per_cpus)
-    : ctl_fifo_(ctl_fifo), per_cpus_(mxtl::move(per_cpus)) {}
+VmcsContext::VmcsContext(mxtl::Array<VmcsPerCpu> per_cpus)
+    : per_cpus_(mxtl::move(per_cpus)) {}
 
 static int vmcs_clear(void* arg) {
     VmcsContext* context = static_cast<VmcsContext*>(arg);
@@ -1005,9 +1208,14 @@ static int vmcs_clear(void* arg) {
 }
 
 VmcsContext::~VmcsContext() {
-    __UNUSED status_t status = percpu_exec(vmcs_clear, this);
-    DEBUG_ASSERT(status == MX_OK);
-    status = gpas_->UnmapRange(APIC_PHYS_BASE, PAGE_SIZE);
+    // The observers interrupt through the per-CPU contexts, so they go first.
+    for (auto& observer : interrupt_events_)
+        observer.reset();
+    for (uint32_t vcpu = 0; vcpu < num_vcpus_; vcpu++) {
+        __UNUSED status_t status = percpu_exec(vcpu, vmcs_clear, this);
+        DEBUG_ASSERT(status == MX_OK);
+    }
+    __UNUSED status_t status = gpas_->UnmapRange(APIC_PHYS_BASE, PAGE_SIZE);
     DEBUG_ASSERT(status == MX_OK);
 }
 
@@ -1027,35 +1235,77 @@ VmcsPerCpu* VmcsContext::PerCpu() {
     return &per_cpus_[arch_curr_cpu_num()];
 }
 
+VmcsPerCpu* VmcsContext::Vcpu(uint32_t vcpu) {
+    AutoLock lock(&vcpus_lock_);
+    return vcpu < num_vcpus_ ? &per_cpus_[vcpu] : nullptr;
+}
+
+status_t VmcsContext::CreateVcpu(mxtl::RefPtr<FifoDispatcher> ctl_fifo, uint32_t* vcpu) {
+    AutoLock lock(&vcpus_lock_);
+    // VCPU i runs on CPU i, so we can have as many VCPUs as there are CPUs.
+    uint32_t next = num_vcpus_;
+    if (next >= per_cpus_.size() || !mp_is_cpu_online(next))
+        return MX_ERR_NO_RESOURCES;
+
+    per_cpus_[next].set_ctl_fifo(mxtl::move(ctl_fifo));
+    status_t status = percpu_exec(next, vmcs_setup, this);
+    if (status != MX_OK)
+        return status;
+
+    num_vcpus_ = next + 1;
+    *vcpu = next;
+    return MX_OK;
+}
+
 static int vmcs_enter(void* arg) {
     VmcsContext* context = static_cast<VmcsContext*>(arg);
     VmcsPerCpu* per_cpu = context->PerCpu();
     if (per_cpu->ShouldResume())
         return MX_ERR_UNAVAILABLE;
+    if (!per_cpu->HasEntry())
+        return MX_ERR_BAD_STATE;
     if (!per_cpu->HasApicMem())
         return MX_ERR_BAD_STATE;
     status_t status;
     do {
-        status = per_cpu->Enter(*context, context->gpas(), context->ctl_fifo());
+        status = per_cpu->Enter(context->gpas(), context->bells());
     } while (status == MX_OK);
     return status;
 }
 
-status_t VmcsContext::Enter() {
-    if (ip_ == UINTPTR_MAX)
-        return MX_ERR_BAD_STATE;
-    if (cr3_ == UINTPTR_MAX)
-        return MX_ERR_BAD_STATE;
-    return percpu_exec(vmcs_enter, this);
+status_t VmcsContext::Enter(uint32_t vcpu) {
+    if (Vcpu(vcpu) == nullptr)
+        return MX_ERR_INVALID_ARGS;
+    return percpu_exec(vcpu, vmcs_enter, this);
+}
+
+static void invept_task(void* arg) {
+    invept(InvEpt::SINGLE_CONTEXT, ept_pointer(*static_cast<paddr_t*>(arg)));
 }
 
 status_t VmcsContext::MemTrap(vaddr_t guest_paddr, size_t size) {
-    return gpas_->UnmapRange(guest_paddr, size);
+    status_t status = gpas_->UnmapRange(guest_paddr, size);
+    if (status != MX_OK)
+        return status;
+
+    // The VCPUs share the EPT, and may be running, so every CPU that a VCPU
+    // runs on must drop the translations it has cached for the range.
+    mp_cpu_mask_t vcpu_mask;
+    {
+        AutoLock lock(&vcpus_lock_);
+        // Shifted as 64 bits, so that a VCPU on each of 32 CPUs still fits.
+        vcpu_mask = static_cast<mp_cpu_mask_t>((1ull << num_vcpus_) - 1);
+    }
+    paddr_t pml4_address = Pml4Address();
+    mp_sync_exec(vcpu_mask, invept_task, &pml4_address);
+    return MX_OK;
 }
 
-status_t VmcsContext::Interrupt(uint8_t interrupt) {
-    // TODO(abdulla): Update this when we move to an external VCPU model.
-    return per_cpus_[0].Interrupt(interrupt);
+status_t VmcsContext::Interrupt(uint32_t vcpu, uint8_t interrupt) {
+    VmcsPerCpu* per_cpu = Vcpu(vcpu);
+    if (per_cpu == nullptr)
+        return MX_ERR_INVALID_ARGS;
+    return per_cpu->Interrupt(interrupt);
 }
 
 struct gpr_args {
@@ -1068,9 +1318,11 @@ static int vmcs_setgpr(void* arg) {
     return args->context->PerCpu()->SetGpr(*args->guest_gpr);
 }
 
-status_t VmcsContext::SetGpr(const mx_guest_gpr_t& guest_gpr) {
+status_t VmcsContext::SetGpr(uint32_t vcpu, const mx_guest_gpr_t& guest_gpr) {
+    if (Vcpu(vcpu) == nullptr)
+        return MX_ERR_INVALID_ARGS;
     gpr_args args = { this, const_cast<mx_guest_gpr_t*>(&guest_gpr) };
-    return percpu_exec(vmcs_setgpr, &args);
+    return percpu_exec(vcpu, vmcs_setgpr, &args);
 }
 
 static int vmcs_getgpr(void* arg) {
@@ -1078,27 +1330,79 @@ static int vmcs_getgpr(void* arg) {
     return args->context->PerCpu()->GetGpr(args->guest_gpr);
 }
 
-status_t VmcsContext::GetGpr(mx_guest_gpr_t* guest_gpr) const {
-    gpr_args args = { const_cast<VmcsContext*>(this), guest_gpr };
-    return percpu_exec(vmcs_getgpr, &args);
+status_t VmcsContext::GetGpr(uint32_t vcpu, mx_guest_gpr_t* guest_gpr) const {
+    VmcsContext* context = const_cast<VmcsContext*>(this);
+    if (context->Vcpu(vcpu) == nullptr)
+        return MX_ERR_INVALID_ARGS;
+    gpr_args args = { context, guest_gpr };
+    return percpu_exec(vcpu, vmcs_getgpr, &args);
 }
 
-status_t VmcsContext::SetApicMem(mxtl::RefPtr<VmObject> apic_mem) {
-    // TODO(abdulla): Update this when we move to an external VCPU model.
-    return per_cpus_[0].SetApicMem(apic_mem);
+status_t VmcsContext::SetApicMem(uint32_t vcpu, mxtl::RefPtr<VmObject> apic_mem) {
+    VmcsPerCpu* per_cpu = Vcpu(vcpu);
+    if (per_cpu == nullptr)
+        return MX_ERR_INVALID_ARGS;
+    return per_cpu->SetApicMem(apic_mem);
 }
 
-status_t VmcsContext::set_ip(uintptr_t guest_ip) {
+status_t VmcsContext::GetExitStats(uint32_t vcpu, mx_guest_exit_stats_t* exit_stats) {
+    VmcsPerCpu* per_cpu = Vcpu(vcpu);
+    if (per_cpu == nullptr)
+        return MX_ERR_INVALID_ARGS;
+    per_cpu->GetExitStats(exit_stats);
+    return MX_OK;
+}
+
+status_t VmcsContext::SetBell(uint32_t kind, uint64_t addr, uint64_t len,
+                              mxtl::RefPtr<EventDispatcher> event) {
+    return bells_.Set(kind, addr, len, mxtl::move(event));
+}
+
+status_t VmcsContext::SetInterruptEvent(uint8_t interrupt, mxtl::RefPtr<EventDispatcher> event) {
+#if WITH_LIB_MAGENTA
+    AutoLock lock(&interrupt_events_lock_);
+    mxtl::unique_ptr<GuestInterruptObserver>* free_slot = nullptr;
+    for (auto& observer : interrupt_events_) {
+        if (!observer) {
+            if (free_slot == nullptr)
+                free_slot = &observer;
+        } else if (observer->event() == event.get()) {
+            return MX_ERR_ALREADY_EXISTS;
+        }
+    }
+    if (free_slot == nullptr)
+        return MX_ERR_NO_RESOURCES;
+
+    AllocChecker ac;
+    mxtl::unique_ptr<GuestInterruptObserver> observer(
+        new (&ac) GuestInterruptObserver(this, interrupt, mxtl::move(event)));
+    if (!ac.check())
+        return MX_ERR_NO_MEMORY;
+    observer->Start();
+    *free_slot = mxtl::move(observer);
+    return MX_OK;
+#else // WITH_LIB_MAGENTA
+    return MX_ERR_NOT_SUPPORTED;
+#endif // WITH_LIB_MAGENTA
+}
+
+status_t VmcsContext::set_ip(uint32_t vcpu, uintptr_t guest_ip) {
     if (guest_ip >= gpas_->size())
         return MX_ERR_INVALID_ARGS;
-    ip_ = guest_ip;
+    VmcsPerCpu* per_cpu = Vcpu(vcpu);
+    if (per_cpu == nullptr)
+        return MX_ERR_INVALID_ARGS;
+    per_cpu->set_ip(guest_ip);
     return MX_OK;
 }
 
-status_t VmcsContext::set_cr3(uintptr_t guest_cr3) {
+status_t VmcsContext::set_cr3(uint32_t vcpu, uintptr_t guest_cr3) {
     if (guest_cr3 >= gpas_->size() - PAGE_SIZE)
         return MX_ERR_INVALID_ARGS;
-    cr3_ = guest_cr3;
+    VmcsPerCpu* per_cpu = Vcpu(vcpu);
+    if (per_cpu == nullptr)
+        return MX_ERR_INVALID_ARGS;
+    per_cpu->set_cr3(guest_cr3);
     return MX_OK;
 }
 
@@ -1116,8 +1420,13 @@ status_t arch_guest_create(mxtl::RefPtr<VmObject> phys_mem,
     return VmcsContext::Create(phys_mem, ctl_fifo, context);
 }
 
-status_t arch_guest_enter(const mxtl::unique_ptr<GuestContext>& context) {
-    return context->Enter();
+status_t arch_guest_create_vcpu(const mxtl::unique_ptr<GuestContext>& context,
+                                mxtl::RefPtr<FifoDispatcher> ctl_fifo, uint32_t* vcpu) {
+    return context->CreateVcpu(ctl_fifo, vcpu);
+}
+
+status_t arch_guest_enter(const mxtl::unique_ptr<GuestContext>& context, uint32_t vcpu) {
+    return context->Enter(vcpu);
 }
 
 status_t arch_guest_mem_trap(const mxtl::unique_ptr<GuestContext>& context, vaddr_t guest_paddr,
@@ -1125,29 +1434,47 @@ status_t arch_guest_mem_trap(const mxtl::unique_ptr<GuestContext>& context, vadd
     return context->MemTrap(guest_paddr, size);
 }
 
-status_t arch_guest_interrupt(const mxtl::unique_ptr<GuestContext>& context, uint8_t interrupt) {
-    return context->Interrupt(interrupt);
+status_t arch_guest_interrupt(const mxtl::unique_ptr<GuestContext>& context, uint32_t vcpu,
+                              uint8_t interrupt) {
+    return context->Interrupt(vcpu, interrupt);
 }
 
-status_t arch_guest_set_gpr(const mxtl::unique_ptr<GuestContext>& context,
+status_t arch_guest_set_gpr(const mxtl::unique_ptr<GuestContext>& context, uint32_t vcpu,
                             const mx_guest_gpr_t& guest_gpr) {
-    return context->SetGpr(guest_gpr);
+    return context->SetGpr(vcpu, guest_gpr);
 }
 
-status_t arch_guest_get_gpr(const mxtl::unique_ptr<GuestContext>& context,
+status_t arch_guest_get_gpr(const mxtl::unique_ptr<GuestContext>& context, uint32_t vcpu,
                             mx_guest_gpr_t* guest_gpr) {
-    return context->GetGpr(guest_gpr);
+    return context->GetGpr(vcpu, guest_gpr);
 }
 
-status_t x86_guest_set_apic_mem(const mxtl::unique_ptr<GuestContext>& context,
+status_t x86_guest_set_apic_mem(const mxtl::unique_ptr<GuestContext>& context, uint32_t vcpu,
                                 mxtl::RefPtr<VmObject> apic_mem) {
-    return context->SetApicMem(apic_mem);
+    return context->SetApicMem(vcpu, apic_mem);
+}
+
+status_t arch_guest_set_ip(const mxtl::unique_ptr<GuestContext>& context, uint32_t vcpu,
+                           uintptr_t guest_ip) {
+    return context->set_ip(vcpu, guest_ip);
+}
+
+status_t x86_guest_set_cr3(const mxtl::unique_ptr<GuestContext>& context, uint32_t vcpu,
+                           uintptr_t guest_cr3) {
+    return context->set_cr3(vcpu, guest_cr3);
+}
+
+status_t x86_guest_set_bell(const mxtl::unique_ptr<GuestContext>& context, uint32_t kind,
+                            uint64_t addr, uint64_t len, mxtl::RefPtr<EventDispatcher> event) {
+    return context->SetBell(kind, addr, len, mxtl::move(event));
 }
 
-status_t arch_guest_set_ip(const mxtl::unique_ptr<GuestContext>& context, uintptr_t guest_ip) {
-    return context->set_ip(guest_ip);
+status_t x86_guest_set_interrupt_event(const mxtl::unique_ptr<GuestContext>& context,
+                                       uint8_t interrupt, mxtl::RefPtr<EventDispatcher> event) {
+    return context->SetInterruptEvent(interrupt, mxtl::move(event));
 }
 
-status_t x86_guest_set_cr3(const mxtl::unique_ptr<GuestContext>& context, uintptr_t guest_cr3) {
-    return context->set_cr3(guest_cr3);
+status_t x86_guest_get_exit_stats(const mxtl::unique_ptr<GuestContext>& context, uint32_t vcpu,
+                                  mx_guest_exit_stats_t* exit_stats) {
+    return context->GetExitStats(vcpu, exit_stats);
 }
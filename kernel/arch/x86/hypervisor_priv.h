@@ -15,15 +15,13 @@
 #include <bitmap/storage.h>
 #include <kernel/event.h>
 #include <kernel/timer.h>
-
-typedef struct mx_guest_gpr mx_guest_gpr_t;
+#include <magenta/syscalls/hypervisor.h>
 
 static const uint16_t kNumInterrupts = X86_MAX_INT + 1;
 
 #define X86_MSR_IA32_FEATURE_CONTROL                0x003a      /* Feature control */
 #define X86_MSR_IA32_VMX_BASIC                      0x0480      /* Basic info */
 #define X86_MSR_IA32_VMX_PINBASED_CTLS              0x0481      /* Pin-based controls */
-#define X86_MSR_IA32_VMX_PROCBASED_CTLS             0x0482      /* Primary processor-based controls */
 #define X86_MSR_IA32_VMX_EXIT_CTLS                  0x0483      /* VM-exit controls */
 #define X86_MSR_IA32_VMX_ENTRY_CTLS                 0x0484      /* VM-entry controls */
 #define X86_MSR_IA32_VMX_MISC                       0x0485      /* Miscellaneous info */
@@ -31,8 +29,6 @@ static const uint16_t kNumInterrupts = X86_MAX_INT + 1;
 #define X86_MSR_IA32_VMX_CR0_FIXED1                 0x0487      /* CR0 bits that must be 1 to enter VMX */
 #define X86_MSR_IA32_VMX_CR4_FIXED0                 0x0488      /* CR4 bits that must be 0 to enter VMX */
 #define X86_MSR_IA32_VMX_CR4_FIXED1                 0x0489      /* CR4 bits that must be 1 to enter VMX */
-#define X86_MSR_IA32_VMX_PROCBASED_CTLS2            0x048b      /* Secondary processor-based controls */
-#define X86_MSR_IA32_VMX_EPT_VPID_CAP               0x048c      /* VPID and EPT Capabilities */
 #define X86_MSR_IA32_VMX_TRUE_PINBASED_CTLS         0x048d      /* True pin-based controls */
 #define X86_MSR_IA32_VMX_TRUE_PROCBASED_CTLS        0x048e      /* True primary processor-based controls */
 #define X86_MSR_IA32_VMX_TRUE_EXIT_CTLS             0x048f      /* True VM-exit controls */
@@ -48,8 +44,10 @@ static const uint16_t kNumInterrupts = X86_MAX_INT + 1;
 /* VMCS fields */
 enum class VmcsField16 : uint64_t {
     VPID                            = 0x0000,   /* Virtual processor ID */
+    POSTED_INTERRUPT_VECTOR         = 0x0002,   /* Posted-interrupt notification vector */
     GUEST_CS_SELECTOR               = 0x0802,   /* Guest CS selector */
     GUEST_TR_SELECTOR               = 0x080e,   /* Guest TR selector */
+    GUEST_INTERRUPT_STATUS          = 0x0810,   /* Guest interrupt status */
     HOST_ES_SELECTOR                = 0x0c00,   /* Host ES selector */
     HOST_CS_SELECTOR                = 0x0c02,   /* Host CS selector */
     HOST_SS_SELECTOR                = 0x0c04,   /* Host SS selector */
@@ -66,7 +64,12 @@ enum class VmcsField64 : uint64_t {
     ENTRY_MSR_LOAD_ADDRESS          = 0x200a,   /* VM-entry MSR-load address */
     VIRTUAL_APIC_ADDRESS            = 0x2012,   /* Virtual-APIC address */
     APIC_ACCESS_ADDRESS             = 0x2014,   /* APIC-access address */
+    POSTED_INTERRUPT_DESC_ADDRESS   = 0x2016,   /* Posted-interrupt descriptor address */
     EPT_POINTER                     = 0x201a,   /* EPT pointer */
+    EOI_EXIT_BITMAP_0               = 0x201c,   /* EOI-exit bitmap 0 */
+    EOI_EXIT_BITMAP_1               = 0x201e,   /* EOI-exit bitmap 1 */
+    EOI_EXIT_BITMAP_2               = 0x2020,   /* EOI-exit bitmap 2 */
+    EOI_EXIT_BITMAP_3               = 0x2022,   /* EOI-exit bitmap 3 */
     GUEST_PHYSICAL_ADDRESS          = 0x2400,   /* Guest physical address */
     LINK_POINTER                    = 0x2800,   /* VMCS link pointer */
     GUEST_IA32_PAT                  = 0x2804,   /* Guest PAT */
@@ -146,6 +149,7 @@ enum class VmcsFieldXX : uint64_t {
 #define PROCBASED_CTLS2_EPT                 (1u << 1)
 #define PROCBASED_CTLS2_RDTSCP              (1u << 3)
 #define PROCBASED_CTLS2_VPID                (1u << 5)
+#define PROCBASED_CTLS2_INT_DELIVERY        (1u << 9)
 #define PROCBASED_CTLS2_INVPCID            (1u << 12)
 
 /* PROCBASED_CTLS flags */
@@ -163,9 +167,11 @@ enum class VmcsFieldXX : uint64_t {
 /* PINBASED_CTLS flags */
 #define PINBASED_CTLS_EXT_INT_EXITING       (1u << 0)
 #define PINBASED_CTLS_NMI_EXITING           (1u << 3)
+#define PINBASED_CTLS_POSTED_INTERRUPTS     (1u << 7)
 
 /* EXIT_CTLS flags */
 #define EXIT_CTLS_64BIT_MODE                (1u << 9)
+#define EXIT_CTLS_ACK_INT_ON_EXIT           (1u << 15)
 #define EXIT_CTLS_SAVE_IA32_PAT             (1u << 18)
 #define EXIT_CTLS_LOAD_IA32_PAT             (1u << 19)
 #define EXIT_CTLS_SAVE_IA32_EFER            (1u << 20)
@@ -247,6 +253,8 @@ public:
     status_t VmxOn();
     status_t VmxOff();
 
+    bool IsOn() const { return is_on_; }
+
 private:
     bool is_on_ = false;
 };
@@ -262,6 +270,15 @@ private:
     const VmxPage* page_;
 };
 
+/* Posted-interrupt descriptor, from Volume 3, Section 29.6. */
+struct PostedInterruptDescriptor {
+    // Posted-interrupt requests, one bit for each vector.
+    uint64_t pir[4];
+    // Outstanding notification, in bit 0.
+    uint64_t control;
+    uint64_t reserved[3];
+} __ALIGNED(64);
+
 /* Stores the local APIC state across VM exits. */
 struct LocalApicState {
     // Timer for APIC timer.
@@ -276,6 +293,11 @@ struct LocalApicState {
     void* apic_addr;
     // Virtual local APIC memory.
     mxtl::RefPtr<VmObject> apic_mem;
+    // Posted-interrupt descriptor, if virtual-interrupt delivery is in use.
+    // Otherwise, interrupts are taken from the interrupt bitmap and injected.
+    PostedInterruptDescriptor* pi_desc;
+    // APIC ID of the CPU the VCPU runs on, for posted-interrupt notifications.
+    uint32_t host_apic_id;
 };
 
 /* Creates a VMCS CPU context to initialize a VM. */
@@ -285,21 +307,32 @@ public:
     status_t Clear();
     status_t Setup(paddr_t pml4_address, paddr_t apic_access_address,
                    paddr_t msr_bitmaps_address);
-    status_t Enter(const VmcsContext& context, GuestPhysicalAddressSpace* gpas,
-                   FifoDispatcher* ctl_fifo);
+    status_t Enter(GuestPhysicalAddressSpace* gpas, GuestBells* bells);
     status_t Interrupt(uint8_t interrupt);
     status_t SetGpr(const mx_guest_gpr_t& guest_gpr);
     status_t GetGpr(mx_guest_gpr_t* guest_gpr) const;
     status_t SetApicMem(mxtl::RefPtr<VmObject> apic_mem);
+    void GetExitStats(mx_guest_exit_stats_t* exit_stats) const;
 
     bool ShouldResume() const { return vmx_state_.resume; }
     bool HasApicMem() const { return local_apic_state_.apic_addr != nullptr; }
+    bool HasEntry() const { return ip_ != UINTPTR_MAX && cr3_ != UINTPTR_MAX; }
+
+    void set_ctl_fifo(mxtl::RefPtr<FifoDispatcher> ctl_fifo) { ctl_fifo_ = mxtl::move(ctl_fifo); }
+    void set_ip(uintptr_t guest_ip) { ip_ = guest_ip; }
+    void set_cr3(uintptr_t guest_cr3) { cr3_ = guest_cr3; }
 
 private:
+    uint cpu_num_ = 0;
+    uintptr_t ip_ = UINTPTR_MAX;
+    uintptr_t cr3_ = UINTPTR_MAX;
+    mxtl::RefPtr<FifoDispatcher> ctl_fifo_;
     VmxPage host_msr_page_;
     VmxPage guest_msr_page_;
+    VmxPage pi_desc_page_;
     VmxState vmx_state_;
     LocalApicState local_apic_state_;
+    mx_guest_exit_stats_t exit_stats_;
 };
 
 uint16_t vmcs_read(VmcsField16 field);
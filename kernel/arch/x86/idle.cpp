@@ -0,0 +1,91 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <magenta/compiler.h>
+#include <arch/ops.h>
+#include <arch/x86/feature.h>
+#include <inttypes.h>
+#include <lk/init.h>
+#include <trace.h>
+
+#define LOCAL_TRACE 0
+
+// The c-states mwait can enter, from shallowest to deepest. The minimum idle
+// time a state is worth entering for would come from the ACPI _CST tables,
+// which we don't parse, so they are guesses at the usual exit latencies scaled
+// up a few times.
+struct mwait_cstate {
+    uint32_t hint;
+    lk_time_t min_idle;
+};
+
+#define MAX_CSTATES 8
+
+static mwait_cstate cstates[MAX_CSTATES];
+static uint num_cstates;
+
+static lk_time_t cstate_min_idle(uint n)
+{
+    switch (n) {
+    case 1: return 0;
+    case 2: return LK_USEC(50);
+    case 3: return LK_USEC(200);
+    default: return LK_MSEC(1);
+    }
+}
+
+static void x86_idle_init(uint level)
+{
+    if (!x86_feature_test(X86_FEATURE_MON))
+        return;
+
+    const struct cpuid_leaf* leaf = x86_get_cpuid_leaf(X86_CPUID_MWAIT);
+    if (!leaf)
+        return;
+
+    // the local apic timer stops in c-states deeper than c1 unless it is
+    // always running, and nothing would wake the cpu for its next timer
+    const uint max_cstate = x86_feature_test(X86_FEATURE_ARAT) ? MAX_CSTATES : 2;
+
+    // edx holds the number of sub states of each c-state in 4 bit fields, c0
+    // first. use the first sub state of each c-state that has one
+    for (uint n = 1; n < max_cstate; n++) {
+        if (((leaf->d >> (n * 4)) & 0xf) == 0)
+            continue;
+
+        cstates[num_cstates].hint = (n - 1) << 4;
+        cstates[num_cstates].min_idle = cstate_min_idle(n);
+        LTRACEF("C%u hint %#x min idle %" PRIu64 "\n", n, cstates[num_cstates].hint,
+                cstates[num_cstates].min_idle);
+        num_cstates++;
+    }
+
+    // mwait always has c1, even when cpuid doesn't list it
+    if (num_cstates == 0) {
+        cstates[0].hint = 0;
+        cstates[0].min_idle = 0;
+        num_cstates = 1;
+    }
+}
+
+LK_INIT_HOOK(x86_idle, x86_idle_init, LK_INIT_LEVEL_ARCH);
+
+bool arch_idle_can_poll(lk_time_t expected_idle)
+{
+    return num_cstates > 0;
+}
+
+void arch_idle_poll(volatile uint32_t* wake, lk_time_t expected_idle)
+{
+    uint32_t hint = cstates[0].hint;
+    for (uint i = 1; i < num_cstates && cstates[i].min_idle <= expected_idle; i++)
+        hint = cstates[i].hint;
+
+    __asm__ volatile("monitor" ::"a"(wake), "c"(0), "d"(0) : "memory");
+    if (*wake)
+        return;
+    __asm__ volatile("mwait" ::"a"(hint), "c"(0) : "memory");
+}
@@ -15,6 +15,19 @@
 
 __BEGIN_CDECLS
 
+#define X86_PERFMON_MAX_PROGRAMMABLE 4
+#define X86_PERFMON_MAX_FIXED 3
+
+/* performance counters of a thread counting its own events, see perfmon.cpp */
+struct x86_perfmon_thread_state {
+    /* the state is only live while this matches the current generation */
+    uint32_t generation;
+    uint32_t fixed_ctrl;
+    uint32_t evtsel[X86_PERFMON_MAX_PROGRAMMABLE];
+    uint64_t programmable[X86_PERFMON_MAX_PROGRAMMABLE];
+    uint64_t fixed[X86_PERFMON_MAX_FIXED];
+};
+
 struct arch_thread {
     vaddr_t sp;
 #if __has_feature(safe_stack)
@@ -45,6 +58,8 @@ struct arch_thread {
 
     /* if non-NULL, address to return to on page fault */
     void *page_fault_resume;
+
+    struct x86_perfmon_thread_state perfmon;
 };
 
 static inline void x86_set_suspended_general_regs(struct arch_thread *thread,
@@ -33,6 +33,15 @@ struct arch_aspace {
      * actually an mp_cpu_mask_t, but header dependencies. */
     volatile int active_cpus;
 
+    /* hardware TLB tag for this aspace, 0 if it has none and must be
+     * flushed on every switch */
+    uint16_t pcid;
+
+    /* cpus that may hold stale TLB entries tagged with pcid and must flush
+     * them the next time they switch to this aspace.
+     * actually an mp_cpu_mask_t, but header dependencies. */
+    volatile int pcid_stale_cpus;
+
     /* Pointer to a bitmap::RleBitmap representing the range of ports
      * enabled in this aspace. */
     void *io_bitmap;
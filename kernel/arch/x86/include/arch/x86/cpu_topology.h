@@ -16,6 +16,8 @@ typedef struct {
     uint32_t package_id;
     uint32_t core_id;
     uint32_t smt_id;
+    // cpus in a package with the same cache_id share the last level cache
+    uint32_t cache_id;
 } x86_cpu_topology_t;
 
 void x86_cpu_topology_init(void);
@@ -6,15 +6,20 @@
 
 #pragma once
 
+#include <kernel/mutex.h>
+#include <kernel/spinlock.h>
 #include <magenta/types.h>
 #include <mxtl/array.h>
 #include <mxtl/ref_ptr.h>
 #include <mxtl/unique_ptr.h>
 
+typedef struct mx_guest_exit_stats mx_guest_exit_stats_t;
 typedef struct mx_guest_gpr mx_guest_gpr_t;
 typedef struct vm_page vm_page_t;
 
+class EventDispatcher;
 class FifoDispatcher;
+class GuestInterruptObserver;
 class VmObject;
 struct VmxInfo;
 class VmxonPerCpu;
@@ -54,6 +59,34 @@ private:
     explicit VmxonContext(mxtl::Array<VmxonPerCpu> per_cpus);
 };
 
+/* Guest writes to a port or to trapped memory that signal an event from
+ * within the kernel, rather than going out to user space over the control
+ * FIFO.
+ */
+class GuestBells {
+public:
+    static const size_t kMaxBells = 32;
+
+    status_t Set(uint32_t kind, uint64_t addr, uint64_t len, mxtl::RefPtr<EventDispatcher> event);
+
+    /* Signals the bell covering |addr|, returning whether there was one. */
+    bool Ring(uint32_t kind, uint64_t addr);
+
+private:
+    struct Bell {
+        uint32_t kind = 0;
+        uint64_t addr = 0;
+        uint64_t len = 0;
+        mxtl::RefPtr<EventDispatcher> event;
+    };
+
+    SpinLock lock_;
+    Bell bells_[kMaxBells];
+};
+
+/* A guest, and the VCPUs within it. VCPU i runs on CPU i, which lets each
+ * VCPU keep its VMCS loaded on one CPU, and lets VCPUs run in parallel.
+ */
 class VmcsContext {
 public:
     static status_t Create(mxtl::RefPtr<VmObject> phys_mem,
@@ -67,41 +100,70 @@ public:
     paddr_t MsrBitmapsAddress();
     VmcsPerCpu* PerCpu();
 
-    status_t Enter();
+    status_t CreateVcpu(mxtl::RefPtr<FifoDispatcher> ctl_fifo, uint32_t* vcpu);
+    status_t Enter(uint32_t vcpu);
     status_t MemTrap(vaddr_t guest_paddr, size_t size);
-    status_t Interrupt(uint8_t interrupt);
-    status_t SetGpr(const mx_guest_gpr_t& guest_gpr);
-    status_t GetGpr(mx_guest_gpr_t* guest_gpr) const;
-    status_t SetApicMem(mxtl::RefPtr<VmObject> apic_mem);
-
-    status_t set_ip(uintptr_t guest_ip);
-    uintptr_t ip() const {  return ip_; }
-    status_t set_cr3(uintptr_t guest_cr3);
-    uintptr_t cr3() const { return cr3_; }
+    status_t Interrupt(uint32_t vcpu, uint8_t interrupt);
+    status_t SetGpr(uint32_t vcpu, const mx_guest_gpr_t& guest_gpr);
+    status_t GetGpr(uint32_t vcpu, mx_guest_gpr_t* guest_gpr) const;
+    status_t SetApicMem(uint32_t vcpu, mxtl::RefPtr<VmObject> apic_mem);
+    status_t GetExitStats(uint32_t vcpu, mx_guest_exit_stats_t* exit_stats);
+    status_t SetBell(uint32_t kind, uint64_t addr, uint64_t len,
+                     mxtl::RefPtr<EventDispatcher> event);
+    status_t SetInterruptEvent(uint8_t interrupt, mxtl::RefPtr<EventDispatcher> event);
+
+    status_t set_ip(uint32_t vcpu, uintptr_t guest_ip);
+    status_t set_cr3(uint32_t vcpu, uintptr_t guest_cr3);
     GuestPhysicalAddressSpace* gpas() const { return gpas_.get(); }
-    FifoDispatcher* ctl_fifo() const { return ctl_fifo_.get(); }
+    GuestBells* bells() { return &bells_; }
 
 private:
-    uintptr_t ip_ = UINTPTR_MAX;
-    uintptr_t cr3_ = UINTPTR_MAX;
     mxtl::unique_ptr<GuestPhysicalAddressSpace> gpas_;
-    mxtl::RefPtr<FifoDispatcher> ctl_fifo_;
+    GuestBells bells_;
+
+    static const size_t kMaxInterruptEvents = 32;
+    Mutex interrupt_events_lock_;
+    mxtl::unique_ptr<GuestInterruptObserver> interrupt_events_[kMaxInterruptEvents];
 
     VmxPage msr_bitmaps_page_;
     VmxPage apic_address_page_;
+
+    // VCPUs are only ever added, so those below |num_vcpus_| stay valid.
+    Mutex vcpus_lock_;
+    uint32_t num_vcpus_ = 0;
     mxtl::Array<VmcsPerCpu> per_cpus_;
 
-    explicit VmcsContext(mxtl::RefPtr<FifoDispatcher> ctl_fifo, mxtl::Array<VmcsPerCpu> per_cpus);
+    explicit VmcsContext(mxtl::Array<VmcsPerCpu> per_cpus);
+
+    VmcsPerCpu* Vcpu(uint32_t vcpu);
+    status_t SetupVcpu(uint32_t vcpu, mxtl::RefPtr<FifoDispatcher> ctl_fifo);
 };
 
 using HypervisorContext = VmxonContext;
 using GuestContext = VmcsContext;
 
-/* Set the local APIC memory of the guest context.
+/* Set the local APIC memory of a VCPU of the guest context.
  */
-status_t x86_guest_set_apic_mem(const mxtl::unique_ptr<GuestContext>& context,
+status_t x86_guest_set_apic_mem(const mxtl::unique_ptr<GuestContext>& context, uint32_t vcpu,
                                 mxtl::RefPtr<VmObject> apic_mem);
 
-/* Set the initial CR3 of the guest context.
+/* Set the initial CR3 of a VCPU of the guest context.
+ */
+status_t x86_guest_set_cr3(const mxtl::unique_ptr<GuestContext>& context, uint32_t vcpu,
+                           uintptr_t guest_cr3);
+
+/* Set a bell in the guest context, which a guest write to the given port or
+ * memory range rings by signaling |event|.
+ */
+status_t x86_guest_set_bell(const mxtl::unique_ptr<GuestContext>& context, uint32_t kind,
+                            uint64_t addr, uint64_t len, mxtl::RefPtr<EventDispatcher> event);
+
+/* Send |interrupt| to the guest context each time |event| is signaled.
+ */
+status_t x86_guest_set_interrupt_event(const mxtl::unique_ptr<GuestContext>& context,
+                                       uint8_t interrupt, mxtl::RefPtr<EventDispatcher> event);
+
+/* Get the VM exit statistics of a VCPU of the guest context.
  */
-status_t x86_guest_set_cr3(const mxtl::unique_ptr<GuestContext>& context, uintptr_t guest_cr3);
+status_t x86_guest_get_exit_stats(const mxtl::unique_ptr<GuestContext>& context, uint32_t vcpu,
+                                  mx_guest_exit_stats_t* exit_stats);
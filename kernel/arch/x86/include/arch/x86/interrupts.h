@@ -42,6 +42,8 @@ enum x86_interrupt_vector {
     X86_INT_IPI_GENERIC,
     X86_INT_IPI_RESCHEDULE,
     X86_INT_IPI_HALT,
+    X86_INT_APIC_PMI,
+    X86_INT_POSTED_INTERRUPT,
 
     X86_MAX_INT = 0xff,
 };
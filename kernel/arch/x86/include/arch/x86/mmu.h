@@ -112,10 +112,16 @@
 #define X86_HUGE_PAGE_FRAME     (0x000fffffc0000000ul)
 #define X86_LARGE_PAGE_FRAME    (0x000fffffffe00000ul)
 #define X86_PG_FRAME            (0x000ffffffffff000ul)
+
 #define PAGE_OFFSET_MASK_4KB    ((1ul << PT_SHIFT) - 1)
 #define PAGE_OFFSET_MASK_LARGE  ((1ul << PD_SHIFT) - 1)
 #define PAGE_OFFSET_MASK_HUGE   ((1ul << PDP_SHIFT) - 1)
 
+/* CR3 fields when CR4.PCIDE is set */
+#define X86_CR3_PCID_MASK       (0x0000000000000ffful)
+#define X86_CR3_NOFLUSH         (1ul << 63)
+#define X86_NUM_PCIDS           (1u << 12)
+
 #define VADDR_TO_PML4_INDEX(vaddr) ((vaddr) >> PML4_SHIFT) & ((1ul << ADDR_OFFSET) - 1)
 #define VADDR_TO_PDP_INDEX(vaddr)  ((vaddr) >> PDP_SHIFT) & ((1ul << ADDR_OFFSET) - 1)
 
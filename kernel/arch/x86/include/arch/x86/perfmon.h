@@ -0,0 +1,49 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <arch/x86.h>
+#include <err.h>
+#include <magenta/compiler.h>
+#include <stdint.h>
+
+__BEGIN_CDECLS
+
+void x86_perfmon_init(void);
+
+// Called from the performance monitoring interrupt.
+enum handler_return x86_perfmon_interrupt_handler(x86_iframe_t* frame);
+
+// Save and restore the counters of threads counting their own events.
+// Only called when either thread has ever done so.
+void x86_perfmon_context_switch(struct thread* oldthread, struct thread* newthread);
+
+__END_CDECLS
+
+#ifdef __cplusplus
+
+#include <kernel/vm/vm_object.h>
+#include <magenta/device/cpu-counters.h>
+#include <mxtl/ref_ptr.h>
+
+// Start sampling on every cpu, one sample each |period| occurrences of
+// |event| (MX_CPU_PROFILE_EVENT_*), written to |vmo|.
+status_t x86_perfmon_profile_start(mxtl::RefPtr<VmObject> vmo, uint32_t event, uint64_t period);
+
+status_t x86_perfmon_profile_stop();
+
+// Count |config|'s events on every cpu, or while the calling thread runs.
+status_t x86_perfmon_counters_start_cpus(const mx_cpu_counters_config_t* config);
+status_t x86_perfmon_counters_start_thread(const mx_cpu_counters_config_t* config);
+
+status_t x86_perfmon_counters_read_cpu(uint cpu, mx_cpu_counters_t* counters);
+status_t x86_perfmon_counters_read_thread(mx_cpu_counters_t* counters);
+
+// Stop counting on every cpu and for every thread.
+status_t x86_perfmon_counters_stop();
+
+#endif // __cplusplus
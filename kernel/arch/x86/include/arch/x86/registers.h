@@ -18,10 +18,12 @@
 #define X86_CR0_PG                      0x80000000 /* enable paging */
 #define X86_CR4_PAE                     0x00000020 /* PAE paging */
 #define X86_CR4_PGE                     0x00000080 /* page global enable */
+#define X86_CR4_PCE                     0x00000100 /* user rdpmc enable */
 #define X86_CR4_OSFXSR                  0x00000200 /* os supports fxsave */
 #define X86_CR4_OSXMMEXPT               0x00000400 /* os supports xmm exception */
 #define X86_CR4_VMXE                    0x00002000 /* enable vmx */
 #define X86_CR4_FSGSBASE                0x00010000 /* enable {rd,wr}{fs,gs}base */
+#define X86_CR4_PCIDE                   0x00020000 /* process context ids enable */
 #define X86_CR4_OSXSAVE                 0x00040000 /* os supports xsave */
 #define X86_CR4_SMEP                    0x00100000 /* SMEP protection enabling */
 #define X86_CR4_SMAP                    0x00200000 /* SMAP protection enabling */
@@ -33,7 +35,9 @@
 #define X86_MSR_IA32_APIC_BASE          0x0000001b /* APIC base physical address */
 #define X86_MSR_IA32_TSC_ADJUST         0x0000003b /* TSC adjust */
 #define X86_MSR_IA32_BIOS_SIGN_ID       0x0000008b /* BIOS update signature */
+#define X86_MSR_IA32_PMC0               0x000000c1 /* general purpose performance counter 0 */
 #define X86_MSR_IA32_MTRRCAP            0x000000fe /* MTRR capability */
+#define X86_MSR_IA32_PERFEVTSEL0        0x00000186 /* performance event select 0 */
 #define X86_MSR_IA32_MISC_ENABLE        0x000001a0 /* enable/disable misc processor features */
 #define X86_MSR_IA32_MTRR_PHYSBASE0     0x00000200 /* MTRR PhysBase0 */
 #define X86_MSR_IA32_MTRR_PHYSMASK0     0x00000201 /* MTRR PhysMask0 */
@@ -45,6 +49,16 @@
 #define X86_MSR_IA32_MTRR_FIX4K_C0000   0x00000268 /* MTRR FIX4K_C0000 */
 #define X86_MSR_IA32_MTRR_FIX4K_F8000   0x0000026f /* MTRR FIX4K_F8000 */
 #define X86_MSR_IA32_PAT                0x00000277 /* PAT */
+#define X86_MSR_IA32_FIXED_CTR0         0x00000309 /* fixed function performance counter 0 */
+#define X86_MSR_IA32_PERF_CAPABILITIES  0x00000345 /* performance monitoring features */
+#define X86_MSR_IA32_FIXED_CTR_CTRL     0x0000038d /* fixed function counter control */
+#define X86_MSR_IA32_PERF_GLOBAL_STATUS 0x0000038e /* performance counter overflow status */
+#define X86_MSR_IA32_PERF_GLOBAL_CTRL   0x0000038f /* performance counter enables */
+#define X86_MSR_IA32_PERF_GLOBAL_OVF_CTRL 0x00000390 /* performance counter overflow clear */
+#define X86_MSR_IA32_VMX_PROCBASED_CTLS 0x00000482 /* primary processor-based VM controls */
+#define X86_MSR_IA32_VMX_PROCBASED_CTLS2 0x0000048b /* secondary processor-based VM controls */
+#define X86_MSR_IA32_VMX_EPT_VPID_CAP   0x0000048c /* VPID and EPT capabilities */
+#define X86_MSR_IA32_A_PMC0             0x000004c1 /* full width write alias of PMC0 */
 #define X86_MSR_IA32_TSC_DEADLINE       0x000006e0 /* TSC deadline */
 #define X86_MSR_IA32_EFER               0xc0000080 /* EFER */
 #define X86_MSR_IA32_STAR               0xc0000081 /* system call address */
@@ -53,6 +67,7 @@
 #define X86_MSR_IA32_FS_BASE            0xc0000100 /* fs base address */
 #define X86_MSR_IA32_GS_BASE            0xc0000101 /* gs base address */
 #define X86_MSR_IA32_KERNEL_GS_BASE     0xc0000102 /* kernel gs base */
+#define X86_MSR_IA32_TSC_AUX            0xc0000103 /* TSC aux */
 #define X86_MSR_IA32_PM_ENABLE          0x00000770 /* enable/disable HWP */
 #define X86_MSR_IA32_HWP_CAPABILITIES   0x00000771 /* HWP performance range enumeration */
 #define X86_MSR_IA32_HWP_REQUEST        0x00000774 /* power manage control hints */
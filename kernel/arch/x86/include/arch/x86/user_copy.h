@@ -7,6 +7,19 @@
 #pragma once
 #include <magenta/compiler.h>
 
+/* flags telling the usercopy routines what the cpu supports */
+#define X86_USER_COPY_SMAP (1u << 0)
+/* rep movsb is the fastest way to do a long copy (ERMS) */
+#define X86_USER_COPY_ERMS (1u << 1)
+/* rep movsb is also the fastest way to do a short copy (FSRM) */
+#define X86_USER_COPY_FSRM (1u << 2)
+
+/* copies shorter than this are done with plain moves unless the cpu has
+ * FSRM, the startup cost of a string instruction outweighs the copy */
+#define X86_USER_COPY_SHORT (64)
+
+#ifndef ASSEMBLY
+
 __BEGIN_CDECLS
 
 /* These functions are identical to arch_copy_from_user, except they take an
@@ -18,14 +31,16 @@ status_t _x86_copy_from_user(
         void *dst,
         const void *src,
         size_t len,
-        bool smap_avail,
+        uint32_t flags,
         void **fault_return);
 
 status_t _x86_copy_to_user(
         void *dst,
         const void *src,
         size_t len,
-        bool smap_avail,
+        uint32_t flags,
         void **fault_return);
 
 __END_CDECLS
+
+#endif // ASSEMBLY
@@ -125,6 +125,7 @@ void apic_local_init(void)
 
     apic_error_init();
     apic_timer_init();
+    apic_pmi_mask();
 }
 
 uint8_t apic_local_id(void)
@@ -323,6 +324,16 @@ enum handler_return apic_timer_interrupt_handler(void) {
     return platform_handle_apic_timer_tick();
 }
 
+// The performance counter interrupt masks itself each time it is delivered,
+// the handler unmasks it again once it has reloaded the counters.
+void apic_pmi_mask(void) {
+    *LVT_PERF_ADDR = LVT_VECTOR(X86_INT_APIC_PMI) | LVT_MASKED;
+}
+
+void apic_pmi_unmask(void) {
+    *LVT_PERF_ADDR = LVT_VECTOR(X86_INT_APIC_PMI);
+}
+
 static void apic_error_init(void) {
     *LVT_ERROR_ADDR = LVT_VECTOR(X86_INT_APIC_ERROR);
     // Re-arm the error interrupt triggering mechanism
@@ -5,6 +5,7 @@
 // https://opensource.org/licenses/MIT
 
 #include <assert.h>
+#include <bits.h>
 #include <err.h>
 #include <string.h>
 #include <trace.h>
@@ -18,6 +19,7 @@
 #include <arch/x86/mmu.h>
 #include <arch/x86/mmu_mem_types.h>
 #include <kernel/mp.h>
+#include <kernel/mutex.h>
 #include <kernel/vm.h>
 #include <kernel/vm/pmm.h>
 
@@ -33,6 +35,22 @@ uint8_t g_paddr_width = 32;
 /* True if the system supports 1GB pages */
 static bool supports_huge_pages = false;
 
+/* True if EPT supports 2MB and 1GB pages, which VMX reports apart from CPUID */
+static bool ept_supports_large_pages = false;
+static bool ept_supports_huge_pages = false;
+
+/* True if user aspaces are tagged with PCIDs */
+static bool use_pcid = false;
+
+/* PCIDs handed out to user aspaces. PCID 0 belongs to the kernel and to any
+ * aspace that could not get one of its own, so it starts out taken. */
+static unsigned long pcid_bitmap[BITMAP_NUM_WORDS(X86_NUM_PCIDS)] = { 1ul };
+static mutex_t pcid_lock = MUTEX_INITIAL_VALUE(pcid_lock);
+
+/* Set on a cpu while PCID 0 may hold entries of an untagged user aspace,
+ * which have to be flushed before the kernel runs on PCID 0 again. */
+static bool pcid0_dirty[SMP_MAX_CPUS];
+
 /* top level kernel page tables, initialized in start.S */
 volatile pt_entry_t pml4[NO_OF_PT_ENTRIES] __ALIGNED(PAGE_SIZE);
 volatile pt_entry_t pdp[NO_OF_PT_ENTRIES] __ALIGNED(PAGE_SIZE); /* temporary */
@@ -124,69 +142,180 @@ static void x86_tlb_global_invalidate() {
     }
 }
 
-/* Task used for invalidating a TLB entry on each CPU */
+static uint16_t x86_alloc_pcid() {
+    mutex_acquire(&pcid_lock);
+    int pcid = bitmap_ffz(pcid_bitmap, X86_NUM_PCIDS);
+    if (pcid > 0) {
+        bitmap_set(pcid_bitmap, pcid, 1);
+    } else {
+        /* out of tags, fall back to flushing on every switch */
+        pcid = 0;
+    }
+    mutex_release(&pcid_lock);
+
+    return static_cast<uint16_t>(pcid);
+}
+
+static void x86_invalidate_pcid_task(void* context) {
+    uint16_t pcid = *static_cast<uint16_t*>(context);
+    if (x86_feature_test(X86_FEATURE_INVPCID)) {
+        /* single-context: every non-global entry tagged with the PCID */
+        struct {
+            uint64_t pcid;
+            uint64_t addr;
+        } desc = {pcid, 0};
+        __asm__ volatile("invpcid %0, %1" ::"m"(desc), "r"(1ul) : "memory");
+    } else {
+        x86_tlb_global_invalidate();
+    }
+}
+
+static void x86_free_pcid(uint16_t pcid) {
+    DEBUG_ASSERT(pcid != 0 && pcid < X86_NUM_PCIDS);
+
+    /* Don't let entries of the dead aspace outlive its PCID on any cpu, so
+     * the next aspace to be given it starts out with none. */
+    mp_sync_exec(MP_CPU_ALL, x86_invalidate_pcid_task, &pcid);
+
+    mutex_acquire(&pcid_lock);
+    bitmap_clear(pcid_bitmap, pcid, 1);
+    mutex_release(&pcid_lock);
+}
+
+/**
+ * @brief A batch of TLB invalidations built up during a single page table operation
+ *
+ * Rather than interrupting every cpu in the aspace for each entry that is
+ * changed, the page table walkers queue the entries here and the operation
+ * sends them out with a single mp_sync_exec once it is done. Page tables that
+ * were unlinked along the way are only freed after that, since other cpus may
+ * still be walking them through stale paging-structure cache entries.
+ */
+struct PendingTlbInvalidation {
+    /* Past this many entries it is cheaper to flush the whole TLB */
+    static constexpr size_t kMaxPages = 32;
+
+    PendingTlbInvalidation() { list_initialize(&freed_tables); }
+    ~PendingTlbInvalidation() {
+        DEBUG_ASSERT(count == 0 && !full_shootdown);
+        DEBUG_ASSERT(list_is_empty(&freed_tables));
+    }
+
+    /* Queue an invalidation of the entry mapping vaddr at the given level */
+    void enqueue(vaddr_t vaddr, enum page_table_levels level, bool is_global_page) {
+        if (is_global_page)
+            contains_global = true;
+        if (level == PML4_L) {
+            /* Matches what a single top level invalidation has always done */
+            full_shootdown = true;
+            flush_global = true;
+            return;
+        }
+        if (full_shootdown)
+            return;
+        if (count == kMaxPages) {
+            full_shootdown = true;
+            return;
+        }
+        items[count++] = vaddr;
+    }
+
+    /* Hold on to a page table page until the invalidations have been sent */
+    void free_table(vm_page_t* page) {
+        list_add_tail(&freed_tables, &page->free.node);
+    }
+
+    void clear() {
+        count = 0;
+        full_shootdown = false;
+        flush_global = false;
+        contains_global = false;
+    }
+
+    vaddr_t items[kMaxPages];
+    size_t count = 0;
+    bool full_shootdown = false;
+    bool flush_global = false;
+    bool contains_global = false;
+    struct list_node freed_tables;
+};
+
+/* Task used for invalidating a batch of TLB entries on each CPU */
 struct tlb_invalidate_page_context {
     ulong target_cr3;
-    vaddr_t vaddr;
-    enum page_table_levels level;
-    bool global_page;
+    const PendingTlbInvalidation* pending;
 };
 static void tlb_invalidate_page_task(void* raw_context) {
     DEBUG_ASSERT(arch_ints_disabled());
     tlb_invalidate_page_context* context = (tlb_invalidate_page_context*)raw_context;
+    const PendingTlbInvalidation* pending = context->pending;
 
     ulong cr3 = x86_get_cr3();
-    if (context->target_cr3 != cr3 && !context->global_page) {
+    if (context->target_cr3 != (cr3 & X86_PG_FRAME) && !pending->contains_global) {
         /* This invalidation doesn't apply to this CPU, ignore it */
         return;
     }
 
-    switch (context->level) {
-    case PML4_L:
-        x86_tlb_global_invalidate();
-        break;
-    case PDP_L:
-    case PD_L:
-    case PT_L:
-        __asm__ volatile("invlpg %0" ::"m"(*(uint8_t*)context->vaddr));
-        break;
+    if (pending->full_shootdown) {
+        if (pending->contains_global || pending->flush_global) {
+            x86_tlb_global_invalidate();
+        } else {
+            x86_set_cr3(cr3);
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < pending->count; ++i) {
+        __asm__ volatile("invlpg %0" ::"m"(*(uint8_t*)pending->items[i]));
     }
 }
 
 /**
- * @brief Invalidate a single page at a given page table level
+ * @brief Execute a batch of queued TLB invalidations
  *
- * @param aspace The aspace we're invalidating for (if NULL, assume for current one)
- * @param vaddr The virtual address we are invalidating the TLB entry for
- * @param level The page table level that maps this vaddr
- * @param global_page True if we are invalidating a global mapping
+ * Sends the batch to every CPU the aspace is active on (or all of them if
+ * global pages are involved), frees any page tables that were waiting on it
+ * and resets the batch.
  *
- * TODO(teisenbe): Optimize this.  This is horribly inefficient.
- * We should also change this to pool invalidations from a single
- * "transaction" and then only execute a single mp_sync_exec for that
- * transaction, rather than one per page.
+ * @param aspace The aspace we're invalidating for (if NULL, assume for current one)
+ * @param pending The batch of invalidations
  */
-void x86_tlb_invalidate_page(arch_aspace_t* aspace, vaddr_t vaddr, enum page_table_levels level,
-                             bool global_page) {
-    ulong cr3 = aspace ? aspace->pt_phys : x86_get_cr3();
-    struct tlb_invalidate_page_context task_context = {
-        .target_cr3 = cr3, .vaddr = vaddr, .level = level, .global_page = global_page,
-    };
+static void x86_tlb_invalidate(arch_aspace_t* aspace, PendingTlbInvalidation* pending) {
+    if (pending->count > 0 || pending->full_shootdown) {
+        ulong cr3 = aspace ? aspace->pt_phys : (x86_get_cr3() & X86_PG_FRAME);
+        struct tlb_invalidate_page_context task_context = {
+            .target_cr3 = cr3, .pending = pending,
+        };
+
+        /* CPUs that are not running in the aspace won't be sent the batch,
+         * but may still hold entries tagged with its PCID from an earlier
+         * visit.  Have them flush on their way back in.  This must be
+         * published before active_cpus is sampled below; see
+         * arch_mmu_context_switch for the other half. */
+        if (aspace && aspace->pcid != 0) {
+            atomic_or(&aspace->pcid_stale_cpus, ~0);
+        }
 
-    /* Target only CPUs this aspace is active on.  It may be the case that some
-     * other CPU will become active in it after this load, or will have left it
-     * just before this load.  In the former case, it is becoming active after
-     * the write to the page table, so it will see the change.  In the latter
-     * case, it will get a spurious request to flush. */
-    mp_cpu_mask_t targets;
-    if (global_page || aspace == nullptr) {
-        targets = MP_CPU_ALL;
-    } else {
-        targets = atomic_load(&aspace->active_cpus);
-        static_assert(sizeof(mp_cpu_mask_t) == sizeof(aspace->active_cpus), "err");
+        /* Target only CPUs this aspace is active on.  It may be the case that some
+         * other CPU will become active in it after this load, or will have left it
+         * just before this load.  In the former case, it is becoming active after
+         * the write to the page table, so it will see the change.  In the latter
+         * case, it will get a spurious request to flush. */
+        mp_cpu_mask_t targets;
+        if (pending->contains_global || aspace == nullptr) {
+            targets = MP_CPU_ALL;
+        } else {
+            targets = atomic_load(&aspace->active_cpus);
+            static_assert(sizeof(mp_cpu_mask_t) == sizeof(aspace->active_cpus), "err");
+        }
+
+        mp_sync_exec(targets, tlb_invalidate_page_task, &task_context);
     }
 
-    mp_sync_exec(targets, tlb_invalidate_page_task, &task_context);
+    if (!list_is_empty(&pending->freed_tables)) {
+        pmm_free(&pending->freed_tables);
+    }
+    pending->clear();
 }
 
 template <int Level>
@@ -374,10 +503,11 @@ struct PageTable : PageTableBase<Level> {
     }
 
     /**
-     * @brief Invalidate a single page at a given page table level
+     * @brief Queue an invalidation of a single page at a given page table level
      */
-    static void tlb_invalidate_page(arch_aspace_t* aspace, vaddr_t vaddr, bool global_page) {
-        x86_tlb_invalidate_page(aspace, vaddr, Base::level, global_page);
+    static void tlb_invalidate_page(PendingTlbInvalidation* pending, vaddr_t vaddr,
+                                    bool global_page) {
+        pending->enqueue(vaddr, Base::level, global_page);
     }
 };
 
@@ -393,6 +523,23 @@ struct ExtendedPageTable : PageTableBase<Level> {
         return X86_EPT_R | X86_EPT_W | X86_EPT_X;
     }
 
+    /**
+     * @brief Whether EPT supports the page size of this level
+     */
+    static bool supports_page_size() {
+        DEBUG_ASSERT(Level != PT_L);
+        switch (Level) {
+        case PD_L:
+            return ept_supports_large_pages;
+        case PDP_L:
+            return ept_supports_huge_pages;
+        case PML4_L:
+            return false;
+        default:
+            panic("Unreachable case in supports_page_size\n");
+        }
+    }
+
     /**
      * @brief Return EPT arch flags from generic MMU flags
      *
@@ -420,14 +567,19 @@ struct ExtendedPageTable : PageTableBase<Level> {
     static arch_flags_t split_arch_flags(arch_flags_t arch_flags) {
         static_assert(Level != PT_L, "tried to split PT_L");
         DEBUG_ASSERT(Level != PML4_L);
-        // We don't need to relocate any flags on split for EPT.
+        DEBUG_ASSERT(arch_flags & X86_MMU_PG_PS);
+        // We don't need to relocate any flags on split for EPT, but a PTE
+        // has no page size bit, so drop it when splitting down to one.
+        if (Level == PD_L)
+            arch_flags &= ~X86_MMU_PG_PS;
         return arch_flags;
     }
 
     /**
-     * @brief Invalidate a single page at a given page table level
+     * @brief Queue an invalidation of a single page at a given page table level
      */
-    static void tlb_invalidate_page(arch_aspace_t* aspace, vaddr_t vaddr, bool global_page) {
+    static void tlb_invalidate_page(PendingTlbInvalidation* pending, vaddr_t vaddr,
+                                    bool global_page) {
         // TODO(abdulla): Implement this.
     }
 };
@@ -505,7 +657,7 @@ struct MappingCursor {
 };
 
 template <typename PageTable>
-static void update_entry(arch_aspace_t* aspace, vaddr_t vaddr, volatile pt_entry_t* pte,
+static void update_entry(PendingTlbInvalidation* pending, vaddr_t vaddr, volatile pt_entry_t* pte,
                          paddr_t paddr, arch_flags_t flags) {
     DEBUG_ASSERT(pte);
     DEBUG_ASSERT(IS_PAGE_ALIGNED(paddr));
@@ -517,12 +669,12 @@ static void update_entry(arch_aspace_t* aspace, vaddr_t vaddr, volatile pt_entry
 
     /* attempt to invalidate the page */
     if (IS_PAGE_PRESENT(olde)) {
-        PageTable::tlb_invalidate_page(aspace, vaddr, is_kernel_address(vaddr));
+        PageTable::tlb_invalidate_page(pending, vaddr, is_kernel_address(vaddr));
     }
 }
 
 template <typename PageTable>
-static void unmap_entry(arch_aspace_t* aspace, vaddr_t vaddr, volatile pt_entry_t* pte) {
+static void unmap_entry(PendingTlbInvalidation* pending, vaddr_t vaddr, volatile pt_entry_t* pte) {
     DEBUG_ASSERT(pte);
 
     pt_entry_t olde = *pte;
@@ -531,7 +683,7 @@ static void unmap_entry(arch_aspace_t* aspace, vaddr_t vaddr, volatile pt_entry_
 
     /* attempt to invalidate the page */
     if (IS_PAGE_PRESENT(olde)) {
-        PageTable::tlb_invalidate_page(aspace, vaddr, is_kernel_address(vaddr));
+        PageTable::tlb_invalidate_page(pending, vaddr, is_kernel_address(vaddr));
     }
 }
 
@@ -555,7 +707,8 @@ static volatile pt_entry_t* _map_alloc_page(void) {
  * @brief Split the given large page into smaller pages
  */
 template <typename PageTable>
-static status_t x86_mmu_split(arch_aspace_t* aspace, vaddr_t vaddr, volatile pt_entry_t* pte) {
+static status_t x86_mmu_split(arch_aspace_t* aspace, vaddr_t vaddr, volatile pt_entry_t* pte,
+                              PendingTlbInvalidation* pending) {
     static_assert(PageTable::level != PT_L, "tried splitting PT_L");
     LTRACEF_LEVEL(2, "splitting table %p at level %d\n", pte, PageTable::level);
 
@@ -576,14 +729,14 @@ static status_t x86_mmu_split(arch_aspace_t* aspace, vaddr_t vaddr, volatile pt_
         volatile pt_entry_t* e = m + i;
         // If this is a PDP_L (i.e. huge page), flags will include the
         // PS bit still, so the new PD entries will be large pages.
-        update_entry<typename PageTable::LowerTable>(aspace, new_vaddr, e, new_paddr, flags);
+        update_entry<typename PageTable::LowerTable>(pending, new_vaddr, e, new_paddr, flags);
         new_vaddr += ps;
         new_paddr += ps;
     }
     DEBUG_ASSERT(new_vaddr == vaddr + PageTable::page_size());
 
     flags = PageTable::intermediate_arch_flags();
-    update_entry<PageTable>(aspace, vaddr, pte, X86_VIRT_TO_PHYS(m), flags);
+    update_entry<PageTable>(pending, vaddr, pte, X86_VIRT_TO_PHYS(m), flags);
     return MX_OK;
 }
 
@@ -700,7 +853,8 @@ static void x86_skip_entry(MappingCursor* cursor) {
  */
 template <typename PageTable>
 static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, volatile pt_entry_t* table,
-                                   const MappingCursor& start_cursor, MappingCursor* new_cursor) {
+                                   const MappingCursor& start_cursor, MappingCursor* new_cursor,
+                                   PendingTlbInvalidation* pending) {
     DEBUG_ASSERT(table);
     LTRACEF("L: %d, %016" PRIxPTR " %016zx\n", PageTable::level, start_cursor.vaddr,
             start_cursor.size);
@@ -725,7 +879,7 @@ static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, volatile pt_entry_t* t
             bool vaddr_level_aligned = PageTable::page_aligned(new_cursor->vaddr);
             // If the request covers the entire large page, just unmap it
             if (vaddr_level_aligned && new_cursor->size >= ps) {
-                unmap_entry<PageTable>(aspace, new_cursor->vaddr, e);
+                unmap_entry<PageTable>(pending, new_cursor->vaddr, e);
                 unmapped = true;
 
                 new_cursor->vaddr += ps;
@@ -735,11 +889,11 @@ static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, volatile pt_entry_t* t
             }
             // Otherwise, we need to split it
             vaddr_t page_vaddr = new_cursor->vaddr & ~(ps - 1);
-            status_t status = x86_mmu_split<PageTable>(aspace, page_vaddr, e);
+            status_t status = x86_mmu_split<PageTable>(aspace, page_vaddr, e, pending);
             if (status != MX_OK) {
                 // If split fails, just unmap the whole thing, and let a
                 // subsequent page fault clean it up.
-                unmap_entry<PageTable>(aspace, new_cursor->vaddr, e);
+                unmap_entry<PageTable>(pending, new_cursor->vaddr, e);
                 unmapped = true;
 
                 x86_skip_entry<PageTable>(new_cursor);
@@ -751,7 +905,7 @@ static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, volatile pt_entry_t* t
         MappingCursor cursor;
         volatile pt_entry_t* next_table = get_next_table_from_entry(pt_val);
         bool lower_unmapped = x86_mmu_remove_mapping<typename PageTable::LowerTable>(
-            aspace, next_table, *new_cursor, &cursor);
+            aspace, next_table, *new_cursor, &cursor, pending);
 
         // If we were requesting to unmap everything in the lower page table,
         // we know we can unmap the lower level page table.  Otherwise, if
@@ -771,8 +925,8 @@ static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, volatile pt_entry_t* t
             }
         }
         if (unmap_page_table) {
-            unmap_entry<PageTable>(aspace, new_cursor->vaddr, e);
-            pmm_free_page(paddr_to_vm_page(X86_VIRT_TO_PHYS(next_table)));
+            unmap_entry<PageTable>(pending, new_cursor->vaddr, e);
+            pending->free_table(paddr_to_vm_page(X86_VIRT_TO_PHYS(next_table)));
             unmapped = true;
         }
         *new_cursor = cursor;
@@ -788,7 +942,8 @@ static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, volatile pt_entry_t* t
 template <typename PageTable>
 static bool x86_mmu_remove_mapping_l0(arch_aspace_t* aspace, volatile pt_entry_t* table,
                                       const MappingCursor& start_cursor,
-                                      MappingCursor* new_cursor) {
+                                      MappingCursor* new_cursor,
+                                      PendingTlbInvalidation* pending) {
     static_assert(PageTable::level == PT_L, "x86_mmu_remove_mapping_l0 used with wrong level");
     LTRACEF("%016" PRIxPTR " %016zx\n", start_cursor.vaddr, start_cursor.size);
     DEBUG_ASSERT(IS_PAGE_ALIGNED(start_cursor.size));
@@ -800,7 +955,7 @@ static bool x86_mmu_remove_mapping_l0(arch_aspace_t* aspace, volatile pt_entry_t
     for (; index != NO_OF_PT_ENTRIES && new_cursor->size != 0; ++index) {
         volatile pt_entry_t* e = table + index;
         if (IS_PAGE_PRESENT(*e)) {
-            unmap_entry<PageTable>(aspace, new_cursor->vaddr, e);
+            unmap_entry<PageTable>(pending, new_cursor->vaddr, e);
             unmapped = true;
         }
 
@@ -814,17 +969,20 @@ static bool x86_mmu_remove_mapping_l0(arch_aspace_t* aspace, volatile pt_entry_t
 template <>
 bool x86_mmu_remove_mapping<PageTable<PT_L>>(arch_aspace_t* aspace, volatile pt_entry_t* table,
                                              const MappingCursor& start_cursor,
-                                             MappingCursor* new_cursor) {
-    return x86_mmu_remove_mapping_l0<PageTable<PT_L>>(aspace, table, start_cursor, new_cursor);
+                                             MappingCursor* new_cursor,
+                                             PendingTlbInvalidation* pending) {
+    return x86_mmu_remove_mapping_l0<PageTable<PT_L>>(aspace, table, start_cursor, new_cursor,
+                                                      pending);
 }
 
 template <>
 bool x86_mmu_remove_mapping<ExtendedPageTable<PT_L>>(arch_aspace_t* aspace,
                                                      volatile pt_entry_t* table,
                                                      const MappingCursor& start_cursor,
-                                                     MappingCursor* new_cursor) {
+                                                     MappingCursor* new_cursor,
+                                                     PendingTlbInvalidation* pending) {
     return x86_mmu_remove_mapping_l0<ExtendedPageTable<PT_L>>(aspace, table, start_cursor,
-                                                              new_cursor);
+                                                              new_cursor, pending);
 }
 
 /**
@@ -846,7 +1004,8 @@ bool x86_mmu_remove_mapping<ExtendedPageTable<PT_L>>(arch_aspace_t* aspace,
 template <typename PageTable>
 static status_t x86_mmu_add_mapping(arch_aspace_t* aspace, volatile pt_entry_t* table,
                                     uint mmu_flags,
-                                    const MappingCursor& start_cursor, MappingCursor* new_cursor) {
+                                    const MappingCursor& start_cursor, MappingCursor* new_cursor,
+                                    PendingTlbInvalidation* pending) {
     DEBUG_ASSERT(table);
     DEBUG_ASSERT(x86_mmu_check_vaddr(start_cursor.vaddr));
     DEBUG_ASSERT(x86_mmu_check_paddr(start_cursor.paddr));
@@ -875,7 +1034,7 @@ static status_t x86_mmu_add_mapping(arch_aspace_t* aspace, volatile pt_entry_t*
         if (level_supports_large_pages && !IS_PAGE_PRESENT(pt_val) && level_valigned &&
             level_paligned && new_cursor->size >= ps) {
 
-            update_entry<PageTable>(aspace, new_cursor->vaddr, table + index, new_cursor->paddr,
+            update_entry<PageTable>(pending, new_cursor->vaddr, table + index, new_cursor->paddr,
                                     arch_flags | X86_MMU_PG_PS);
 
             new_cursor->paddr += ps;
@@ -893,14 +1052,15 @@ static status_t x86_mmu_add_mapping(arch_aspace_t* aspace, volatile pt_entry_t*
 
                 LTRACEF_LEVEL(2, "new table %p at level %d\n", m, PageTable::level);
 
-                update_entry<PageTable>(aspace, new_cursor->vaddr, e, X86_VIRT_TO_PHYS(m),
+                update_entry<PageTable>(pending, new_cursor->vaddr, e, X86_VIRT_TO_PHYS(m),
                                         interm_arch_flags);
                 pt_val = *e;
             }
 
             MappingCursor cursor;
             ret = x86_mmu_add_mapping<typename PageTable::LowerTable>(
-                aspace, get_next_table_from_entry(pt_val), mmu_flags, *new_cursor, &cursor);
+                aspace, get_next_table_from_entry(pt_val), mmu_flags, *new_cursor, &cursor,
+                pending);
             *new_cursor = cursor;
             DEBUG_ASSERT(new_cursor->size <= start_cursor.size);
             if (ret != MX_OK) {
@@ -916,7 +1076,8 @@ err:
         // new_cursor->size should be how much is left to be mapped still
         cursor.size -= new_cursor->size;
         if (cursor.size > 0) {
-            x86_mmu_remove_mapping<typename PageTable::TopTable>(aspace, table, cursor, &result);
+            x86_mmu_remove_mapping<typename PageTable::TopTable>(aspace, table, cursor, &result,
+                                                                 pending);
             DEBUG_ASSERT(result.size == 0);
         }
     }
@@ -927,7 +1088,8 @@ err:
 template <typename PageTable>
 static status_t x86_mmu_add_mapping_l0(arch_aspace_t* aspace, volatile pt_entry_t* table,
                                        uint mmu_flags, const MappingCursor& start_cursor,
-                                       MappingCursor* new_cursor) {
+                                       MappingCursor* new_cursor,
+                                       PendingTlbInvalidation* pending) {
     static_assert(PageTable::level == PT_L, "x86_mmu_remove_mapping_l0 used with wrong level");
     DEBUG_ASSERT(IS_PAGE_ALIGNED(start_cursor.size));
 
@@ -942,7 +1104,7 @@ static status_t x86_mmu_add_mapping_l0(arch_aspace_t* aspace, volatile pt_entry_
             return MX_ERR_ALREADY_EXISTS;
         }
 
-        update_entry<PageTable>(aspace, new_cursor->vaddr, e, new_cursor->paddr, arch_flags);
+        update_entry<PageTable>(pending, new_cursor->vaddr, e, new_cursor->paddr, arch_flags);
 
         new_cursor->paddr += PAGE_SIZE;
         new_cursor->vaddr += PAGE_SIZE;
@@ -956,9 +1118,10 @@ static status_t x86_mmu_add_mapping_l0(arch_aspace_t* aspace, volatile pt_entry_
 template <>
 status_t x86_mmu_add_mapping<PageTable<PT_L>>(arch_aspace_t* aspace, volatile pt_entry_t* table,
                                               uint mmu_flags, const MappingCursor& start_cursor,
-                                              MappingCursor* new_cursor) {
+                                              MappingCursor* new_cursor,
+                                              PendingTlbInvalidation* pending) {
     return x86_mmu_add_mapping_l0<PageTable<PT_L>>(aspace, table, mmu_flags, start_cursor,
-                                                   new_cursor);
+                                                   new_cursor, pending);
 }
 
 template <>
@@ -966,9 +1129,10 @@ status_t x86_mmu_add_mapping<ExtendedPageTable<PT_L>>(arch_aspace_t* aspace,
                                                       volatile pt_entry_t* table,
                                                       uint mmu_flags,
                                                       const MappingCursor& start_cursor,
-                                                      MappingCursor* new_cursor) {
+                                                      MappingCursor* new_cursor,
+                                                      PendingTlbInvalidation* pending) {
     return x86_mmu_add_mapping_l0<ExtendedPageTable<PT_L>>(aspace, table, mmu_flags, start_cursor,
-                                                           new_cursor);
+                                                           new_cursor, pending);
 }
 
 /**
@@ -987,7 +1151,8 @@ template <typename PageTable>
 static status_t x86_mmu_update_mapping(arch_aspace_t* aspace, volatile pt_entry_t* table,
                                        uint mmu_flags,
                                        const MappingCursor& start_cursor,
-                                       MappingCursor* new_cursor) {
+                                       MappingCursor* new_cursor,
+                                       PendingTlbInvalidation* pending) {
     DEBUG_ASSERT(table);
     LTRACEF("L: %d, %016" PRIxPTR " %016zx\n", PageTable::level, start_cursor.vaddr,
             start_cursor.size);
@@ -1014,7 +1179,7 @@ static status_t x86_mmu_update_mapping(arch_aspace_t* aspace, volatile pt_entry_
             // If the request covers the entire large page, just change the
             // permissions
             if (vaddr_level_aligned && new_cursor->size >= ps) {
-                update_entry<PageTable>(aspace, new_cursor->vaddr, e,
+                update_entry<PageTable>(pending, new_cursor->vaddr, e,
                                         PageTable::paddr_from_pte(pt_val),
                                         arch_flags | X86_MMU_PG_PS);
 
@@ -1025,7 +1190,7 @@ static status_t x86_mmu_update_mapping(arch_aspace_t* aspace, volatile pt_entry_
             }
             // Otherwise, we need to split it
             vaddr_t page_vaddr = new_cursor->vaddr & ~(ps - 1);
-            ret = x86_mmu_split<PageTable>(aspace, page_vaddr, e);
+            ret = x86_mmu_split<PageTable>(aspace, page_vaddr, e, pending);
             if (ret != MX_OK) {
                 // If we failed to split the table, just unmap it.  Subsequent
                 // page faults will bring it back in.
@@ -1034,7 +1199,7 @@ static status_t x86_mmu_update_mapping(arch_aspace_t* aspace, volatile pt_entry_
                 cursor.size = ps;
 
                 MappingCursor tmp_cursor;
-                x86_mmu_remove_mapping<PageTable>(aspace, table, cursor, &tmp_cursor);
+                x86_mmu_remove_mapping<PageTable>(aspace, table, cursor, &tmp_cursor, pending);
 
                 x86_skip_entry<PageTable>(new_cursor);
             }
@@ -1044,7 +1209,8 @@ static status_t x86_mmu_update_mapping(arch_aspace_t* aspace, volatile pt_entry_
         MappingCursor cursor;
         volatile pt_entry_t* next_table = get_next_table_from_entry(pt_val);
         ret = x86_mmu_update_mapping<typename PageTable::LowerTable>(aspace, next_table, mmu_flags,
-                                                                     *new_cursor, &cursor);
+                                                                     *new_cursor, &cursor,
+                                                                     pending);
         *new_cursor = cursor;
         if (ret != MX_OK) {
             // Currently this can't happen
@@ -1065,7 +1231,8 @@ err:
 template <typename PageTable>
 static status_t x86_mmu_update_mapping_l0(arch_aspace_t* aspace, volatile pt_entry_t* table,
                                           uint mmu_flags, const MappingCursor& start_cursor,
-                                          MappingCursor* new_cursor) {
+                                          MappingCursor* new_cursor,
+                                          PendingTlbInvalidation* pending) {
     static_assert(PageTable::level == PT_L, "x86_mmu_update_mapping_l0 used with wrong level");
     LTRACEF("%016" PRIxPTR " %016zx\n", start_cursor.vaddr, start_cursor.size);
     DEBUG_ASSERT(IS_PAGE_ALIGNED(start_cursor.size));
@@ -1080,8 +1247,8 @@ static status_t x86_mmu_update_mapping_l0(arch_aspace_t* aspace, volatile pt_ent
         pt_entry_t pt_val = *e;
         // Skip unmapped pages (we may encounter these due to demand paging)
         if (IS_PAGE_PRESENT(pt_val)) {
-            update_entry<PageTable>(aspace, new_cursor->vaddr, e, PageTable::paddr_from_pte(pt_val),
-                                    arch_flags);
+            update_entry<PageTable>(pending, new_cursor->vaddr, e,
+                                    PageTable::paddr_from_pte(pt_val), arch_flags);
         }
 
         new_cursor->vaddr += PAGE_SIZE;
@@ -1095,18 +1262,20 @@ static status_t x86_mmu_update_mapping_l0(arch_aspace_t* aspace, volatile pt_ent
 template <>
 status_t x86_mmu_update_mapping<PageTable<PT_L>>(arch_aspace_t* aspace, volatile pt_entry_t* table,
                                                  uint mmu_flags, const MappingCursor& start_cursor,
-                                                 MappingCursor* new_cursor) {
+                                                 MappingCursor* new_cursor,
+                                                 PendingTlbInvalidation* pending) {
     return x86_mmu_update_mapping_l0<PageTable<PT_L>>(aspace, table, mmu_flags, start_cursor,
-                                                      new_cursor);
+                                                      new_cursor, pending);
 }
 
 template <>
 status_t x86_mmu_update_mapping<ExtendedPageTable<PT_L>>(arch_aspace_t* aspace,
                                                          volatile pt_entry_t* table, uint mmu_flags,
                                                          const MappingCursor& start_cursor,
-                                                         MappingCursor* new_cursor) {
+                                                         MappingCursor* new_cursor,
+                                                         PendingTlbInvalidation* pending) {
     return x86_mmu_update_mapping_l0<ExtendedPageTable<PT_L>>(aspace, table, mmu_flags,
-                                                              start_cursor, new_cursor);
+                                                              start_cursor, new_cursor, pending);
 }
 
 template <template <int> class PageTable>
@@ -1131,7 +1300,10 @@ static status_t mmu_unmap(arch_aspace_t* aspace, vaddr_t vaddr, const size_t cou
     };
 
     MappingCursor result;
-    x86_mmu_remove_mapping<PageTable<MAX_PAGING_LEVEL>>(aspace, aspace->pt_virt, start, &result);
+    PendingTlbInvalidation pending;
+    x86_mmu_remove_mapping<PageTable<MAX_PAGING_LEVEL>>(aspace, aspace->pt_virt, start, &result,
+                                                        &pending);
+    x86_tlb_invalidate(aspace, &pending);
     DEBUG_ASSERT(result.size == 0);
 
     if (unmapped)
@@ -1177,8 +1349,11 @@ static status_t mmu_map(arch_aspace_t* aspace, vaddr_t vaddr, paddr_t paddr, con
         .paddr = paddr, .vaddr = vaddr, .size = count * PAGE_SIZE,
     };
     MappingCursor result;
+    PendingTlbInvalidation pending;
     status_t status = x86_mmu_add_mapping<PageTable<MAX_PAGING_LEVEL>>(aspace, aspace->pt_virt,
-                                                                       mmu_flags, start, &result);
+                                                                       mmu_flags, start, &result,
+                                                                       &pending);
+    x86_tlb_invalidate(aspace, &pending);
     if (status != MX_OK) {
         dprintf(SPEW, "Add mapping failed with err=%d\n", status);
         return status;
@@ -1225,8 +1400,10 @@ static status_t mmu_protect(arch_aspace_t* aspace, vaddr_t vaddr, size_t count,
         .paddr = 0, .vaddr = vaddr, .size = count * PAGE_SIZE,
     };
     MappingCursor result;
+    PendingTlbInvalidation pending;
     status_t status = x86_mmu_update_mapping<PageTable<MAX_PAGING_LEVEL>>(
-        aspace, aspace->pt_virt, mmu_flags, start, &result);
+        aspace, aspace->pt_virt, mmu_flags, start, &result, &pending);
+    x86_tlb_invalidate(aspace, &pending);
     if (status != MX_OK) {
         return status;
     }
@@ -1249,7 +1426,9 @@ void x86_mmu_early_init() {
     x86_mmu_percpu_init();
 
     /* unmap the lower identity mapping */
-    unmap_entry<PageTable<PML4_L>>(nullptr, 0, &pml4[0]);
+    PendingTlbInvalidation pending;
+    unmap_entry<PageTable<PML4_L>>(&pending, 0, &pml4[0]);
+    x86_tlb_invalidate(nullptr, &pending);
 
     /* get the address width from the CPU */
     uint8_t vaddr_width = x86_linear_address_width();
@@ -1257,6 +1436,19 @@ void x86_mmu_early_init() {
 
     supports_huge_pages = x86_feature_test(X86_FEATURE_HUGE_PAGE);
 
+    /* the VMX capability MSRs may only be read if VMX is present, and the
+     * EPT and VPID capabilities only if the secondary controls can be
+     * activated (bit 63 of the primary controls) and can enable EPT (bit 33)
+     * or VPID (bit 37) */
+    if (x86_feature_test(X86_FEATURE_VMX) &&
+        BIT_SHIFT(read_msr(X86_MSR_IA32_VMX_PROCBASED_CTLS), 63) &&
+        (BIT_SHIFT(read_msr(X86_MSR_IA32_VMX_PROCBASED_CTLS2), 33) ||
+         BIT_SHIFT(read_msr(X86_MSR_IA32_VMX_PROCBASED_CTLS2), 37))) {
+        uint64_t ept_cap = read_msr(X86_MSR_IA32_VMX_EPT_VPID_CAP);
+        ept_supports_large_pages = BIT_SHIFT(ept_cap, 16);
+        ept_supports_huge_pages = BIT_SHIFT(ept_cap, 17);
+    }
+
     /* if we got something meaningful, override the defaults.
      * some combinations of cpu on certain emulators seems to return
      * nonsense paddr widths (1), so trim it. */
@@ -1314,6 +1506,13 @@ status_t arch_mmu_init_aspace(arch_aspace_t* aspace, vaddr_t base, size_t size,
     }
     aspace->io_bitmap = nullptr;
     aspace->active_cpus = 0;
+    aspace->pcid = 0;
+    aspace->pcid_stale_cpus = 0;
+    if (use_pcid && !(mmu_flags & ARCH_ASPACE_FLAG_KERNEL)) {
+        aspace->pcid = x86_alloc_pcid();
+        /* the PCID may have been used by a previous aspace */
+        aspace->pcid_stale_cpus = ~0;
+    }
     spin_lock_init(&aspace->io_bitmap_lock);
 
     return MX_OK;
@@ -1339,6 +1538,8 @@ status_t guest_mmu_init_paspace(guest_paspace_t* paspace, size_t size) {
     paspace->base = 0;
     paspace->size = size;
     paspace->active_cpus = 0;
+    paspace->pcid = 0;
+    paspace->pcid_stale_cpus = 0;
     paspace->io_bitmap = nullptr;
     spin_lock_init(&paspace->io_bitmap_lock);
 
@@ -1375,6 +1576,11 @@ status_t mmu_destroy_aspace(arch_aspace_t* aspace) {
 
     pmm_free_page(paddr_to_vm_page(aspace->pt_phys));
 
+    if (aspace->pcid != 0) {
+        x86_free_pcid(aspace->pcid);
+        aspace->pcid = 0;
+    }
+
     aspace->magic = 0;
 
     return MX_OK;
@@ -1393,15 +1599,37 @@ void arch_mmu_context_switch(arch_aspace_t* old_aspace, arch_aspace_t* aspace) {
     if (aspace != nullptr) {
         DEBUG_ASSERT(aspace->magic == ARCH_ASPACE_MAGIC);
         LTRACEF_LEVEL(3, "switching to aspace %p, pt %#" PRIXPTR "\n", aspace, aspace->pt_phys);
-        x86_set_cr3(aspace->pt_phys);
+
+        /* Mark ourselves active before looking at the stale mask, so that
+         * a concurrent TLB shootdown either sends us its batch or leaves a
+         * stale mark that we see below. */
+        atomic_or(&aspace->active_cpus, cpu_bit);
+
+        ulong cr3 = aspace->pt_phys;
+        if (aspace->pcid != 0) {
+            cr3 |= aspace->pcid;
+            /* keep the TLB entries for this PCID unless they may be stale */
+            if (!(atomic_and(&aspace->pcid_stale_cpus, ~cpu_bit) & cpu_bit)) {
+                cr3 |= X86_CR3_NOFLUSH;
+            }
+        } else {
+            pcid0_dirty[arch_curr_cpu_num()] = true;
+        }
+        x86_set_cr3(cr3);
 
         if (old_aspace != nullptr) {
             atomic_and(&old_aspace->active_cpus, ~cpu_bit);
         }
-        atomic_or(&aspace->active_cpus, cpu_bit);
     } else {
         LTRACEF_LEVEL(3, "switching to kernel aspace, pt %#" PRIxPTR "\n", kernel_pt_phys);
-        x86_set_cr3(kernel_pt_phys);
+        /* The kernel shares PCID 0 with untagged user aspaces, whose entries
+         * have to go if any may be left. */
+        ulong cr3 = kernel_pt_phys;
+        if (use_pcid && !pcid0_dirty[arch_curr_cpu_num()]) {
+            cr3 |= X86_CR3_NOFLUSH;
+        }
+        pcid0_dirty[arch_curr_cpu_num()] = false;
+        x86_set_cr3(cr3);
         if (old_aspace != nullptr) {
             atomic_and(&old_aspace->active_cpus, ~cpu_bit);
         }
@@ -1499,6 +1727,13 @@ void x86_mmu_percpu_init(void) {
         cr4 |= X86_CR4_SMEP;
     if (x86_feature_test(X86_FEATURE_SMAP))
         cr4 |= X86_CR4_SMAP;
+    /* Tag user aspaces so context switches don't have to flush the TLB.
+     * The current CR3 must have a PCID of 0 when this is turned on. */
+    if (x86_feature_test(X86_FEATURE_PCID)) {
+        DEBUG_ASSERT((x86_get_cr3() & X86_CR3_PCID_MASK) == 0);
+        cr4 |= X86_CR4_PCIDE;
+        use_pcid = true;
+    }
     x86_set_cr4(cr4);
 
     /* Set NXE bit in X86_MSR_IA32_EFER*/
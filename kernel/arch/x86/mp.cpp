@@ -159,6 +159,11 @@ void x86_init_percpu(uint cpu_num)
         x86_set_cr4(x86_get_cr4() | X86_CR4_FSGSBASE);
     }
 
+    // rdtscp hands user mode this cpu's number, for mx_system_get_cpu_hint.
+    if (x86_feature_test(X86_FEATURE_RDTSCP)) {
+        write_msr(X86_MSR_IA32_TSC_AUX, cpu_num);
+    }
+
     // These intel cpus support auto-entering C1E state when all cores are at C1. In
     // C1E state the voltage is reduced on all cores as well as clock gated. There is
     // a latency associated with ramping the voltage on wake. Disable this feature here
@@ -0,0 +1,506 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+// Sampling profiler on the architectural performance monitoring counters.
+// General purpose counter 0 counts the chosen event and interrupts when it
+// overflows. The interrupt handler records where the cpu was and reloads the
+// counter, so a sample is taken every |period| events.
+//
+// The counters can instead be left counting, either on every cpu or only
+// while particular threads run, and read with rdpmc from user space. Only one
+// of these uses of the counters can be active at once.
+
+#include <arch/ops.h>
+#include <arch/x86.h>
+#include <arch/x86/apic.h>
+#include <arch/x86/descriptor.h>
+#include <arch/x86/feature.h>
+#include <arch/x86/perfmon.h>
+#include <err.h>
+#include <kernel/mp.h>
+#include <kernel/mutex.h>
+#include <kernel/thread.h>
+#include <kernel/vm.h>
+#include <kernel/vm/vm_aspace.h>
+#include <magenta/device/cpu-counters.h>
+#include <magenta/device/cpu-profile.h>
+#include <magenta/thread_annotations.h>
+#include <mxtl/auto_lock.h>
+#include <platform.h>
+#include <stdlib.h>
+#include <string.h>
+#include <trace.h>
+
+#define LOCAL_TRACE 0
+
+// IA32_PERFEVTSELx bits
+#define PERFEVTSEL_USR (1u << 16)
+#define PERFEVTSEL_OS (1u << 17)
+#define PERFEVTSEL_INT (1u << 20)
+#define PERFEVTSEL_EN (1u << 22)
+#define PERFEVTSEL_EVENT(event, umask) ((event) | ((umask) << 8))
+
+// Counter 0 in IA32_PERF_GLOBAL_CTRL/STATUS/OVF_CTRL.
+#define PERF_GLOBAL_PMC0 (1ull << 0)
+
+// The architectural events, indexed by MX_CPU_PROFILE_EVENT_*. |unavailable|
+// is the bit in CPUID.0AH:EBX that is set when the cpu can't count the event.
+static const struct {
+    uint32_t evtsel;
+    uint32_t unavailable;
+} perfmon_events[] = {
+    { PERFEVTSEL_EVENT(0x3c, 0x00), 1u << 0 }, // unhalted core cycles
+    { PERFEVTSEL_EVENT(0xc0, 0x00), 1u << 1 }, // instructions retired
+    { PERFEVTSEL_EVENT(0x2e, 0x41), 1u << 4 }, // last level cache misses
+    { PERFEVTSEL_EVENT(0xc5, 0x00), 1u << 6 }, // branch mispredicts retired
+};
+
+static_assert(X86_PERFMON_MAX_PROGRAMMABLE == MX_CPU_COUNTERS_MAX_PROGRAMMABLE, "");
+static_assert(X86_PERFMON_MAX_FIXED == MX_CPU_COUNTERS_NUM_FIXED, "");
+
+static bool supports_perfmon = false;
+static uint32_t perfmon_unavailable_events;
+static uint32_t perfmon_num_programmable;
+static uint32_t perfmon_num_fixed;
+// Programmable counters can be written with all their bits through the
+// IA32_A_PMCx aliases, rather than sign extended from 32 bits.
+static bool perfmon_full_width_writes = false;
+
+enum perfmon_mode {
+    PERFMON_IDLE,
+    PERFMON_PROFILE,
+    PERFMON_COUNT_CPUS,
+    PERFMON_COUNT_THREADS,
+};
+
+struct perfmon_cpu_state {
+    mx_cpu_profile_header_t* header; // null while not sampling
+    uint8_t* samples;
+    size_t capacity;
+    // The header lives in memory userspace can write, so where the next
+    // sample goes and how many were dropped are kept here, and only ever
+    // copied out to the header.
+    size_t size;
+    uint64_t dropped;
+};
+
+// Written with every cpu's counter stopped, read by the interrupt handler.
+static perfmon_cpu_state perfmon_cpu[SMP_MAX_CPUS];
+static uint64_t perfmon_period;
+static uint32_t perfmon_evtsel;
+
+static Mutex perfmon_lock;
+static perfmon_mode perfmon_current_mode TA_GUARDED(perfmon_lock) = PERFMON_IDLE;
+static mxtl::RefPtr<VmObject> perfmon_vmo TA_GUARDED(perfmon_lock);
+static size_t perfmon_vmo_size TA_GUARDED(perfmon_lock);
+static mxtl::RefPtr<VmMapping> perfmon_mapping TA_GUARDED(perfmon_lock);
+
+// What every cpu counts in PERFMON_COUNT_CPUS mode.
+static x86_perfmon_thread_state perfmon_cpus_state;
+
+// Threads whose state carries this generation have live counters. Zero
+// unless counting threads, and new each time thread counting starts so that
+// state left in threads by an earlier run is ignored.
+static volatile uint32_t perfmon_generation;
+static uint32_t perfmon_last_generation TA_GUARDED(perfmon_lock);
+
+void x86_perfmon_init(void) {
+    const struct cpuid_leaf* leaf = x86_get_cpuid_leaf(X86_CPUID_PERFMON);
+    if (!leaf)
+        return;
+
+    // Version 2 is the first with the global control and status msrs.
+    uint32_t version = leaf->a & 0xff;
+    uint32_t num_counters = (leaf->a >> 8) & 0xff;
+    uint32_t ebx_length = (leaf->a >> 24) & 0xff;
+    if (version < 2 || num_counters == 0)
+        return;
+
+    // Events past the length of the EBX bit vector aren't available either.
+    perfmon_unavailable_events = leaf->b;
+    if (ebx_length < 32)
+        perfmon_unavailable_events |= ~((1u << ebx_length) - 1);
+
+    perfmon_num_programmable = MIN(num_counters, X86_PERFMON_MAX_PROGRAMMABLE);
+    perfmon_num_fixed = MIN(leaf->d & 0x1f, X86_PERFMON_MAX_FIXED);
+    if (x86_feature_test(X86_FEATURE_PDCM))
+        perfmon_full_width_writes = (read_msr(X86_MSR_IA32_PERF_CAPABILITIES) >> 13) & 1;
+
+    supports_perfmon = true;
+    LTRACEF("perfmon version %u, %u counters, %u fixed, unavailable events %#x\n",
+            version, num_counters, perfmon_num_fixed, perfmon_unavailable_events);
+}
+
+static void perfmon_start_task(void* context) {
+    write_msr(X86_MSR_IA32_PERFEVTSEL0, 0);
+    write_msr(X86_MSR_IA32_PMC0, -perfmon_period);
+    write_msr(X86_MSR_IA32_PERF_GLOBAL_OVF_CTRL, PERF_GLOBAL_PMC0);
+    apic_pmi_unmask();
+    write_msr(X86_MSR_IA32_PERFEVTSEL0, perfmon_evtsel);
+    write_msr(X86_MSR_IA32_PERF_GLOBAL_CTRL,
+              read_msr(X86_MSR_IA32_PERF_GLOBAL_CTRL) | PERF_GLOBAL_PMC0);
+}
+
+static void perfmon_stop_task(void* context) {
+    write_msr(X86_MSR_IA32_PERF_GLOBAL_CTRL,
+              read_msr(X86_MSR_IA32_PERF_GLOBAL_CTRL) & ~PERF_GLOBAL_PMC0);
+    write_msr(X86_MSR_IA32_PERFEVTSEL0, 0);
+    apic_pmi_mask();
+    write_msr(X86_MSR_IA32_PERF_GLOBAL_OVF_CTRL, PERF_GLOBAL_PMC0);
+
+    // An interrupt already raised may still be delivered once interrupts are
+    // back on, it finds no header and records nothing.
+    perfmon_cpu[arch_curr_cpu_num()].header = nullptr;
+}
+
+status_t x86_perfmon_profile_start(mxtl::RefPtr<VmObject> vmo, uint32_t event, uint64_t period) {
+    if (!supports_perfmon)
+        return MX_ERR_NOT_SUPPORTED;
+    if (event >= countof(perfmon_events))
+        return MX_ERR_INVALID_ARGS;
+    if (perfmon_unavailable_events & perfmon_events[event].unavailable)
+        return MX_ERR_NOT_SUPPORTED;
+    // The counter is loaded through the 32 bit alias, which sign extends.
+    if (period == 0 || period > MX_CPU_PROFILE_MAX_PERIOD)
+        return MX_ERR_INVALID_ARGS;
+
+    AutoLock al(&perfmon_lock);
+
+    if (perfmon_current_mode != PERFMON_IDLE)
+        return MX_ERR_BAD_STATE;
+
+    // Every cpu gets an equal share, which must hold at least its header and
+    // one sample of the largest size.
+    const size_t size = vmo->size();
+    const uint num_cpus = arch_max_num_cpus();
+    const size_t per_cpu = ROUNDDOWN(size / num_cpus, sizeof(uint64_t));
+    if (per_cpu < sizeof(mx_cpu_profile_header_t) + sizeof(mx_cpu_profile_sample_t) +
+                  MX_CPU_PROFILE_MAX_PCS * sizeof(uint64_t))
+        return MX_ERR_BUFFER_TOO_SMALL;
+
+    // The interrupt handler can't take page faults, and the owner of the vmo
+    // could otherwise decommit it or let it be reclaimed while sampling, so
+    // pin it all now and map it into the kernel.
+    status_t status = vmo->Pin(0, size);
+    if (status != MX_OK)
+        return status;
+
+    mxtl::RefPtr<VmMapping> mapping;
+    status = VmAspace::kernel_aspace()->RootVmar()->CreateVmMapping(
+            0 /* ignored */, size, 0 /* align pow2 */, 0 /* vmar flags */,
+            vmo, 0, ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE,
+            "cpu_profile", &mapping);
+    if (status != MX_OK) {
+        vmo->Unpin(0, size);
+        return status;
+    }
+
+    status = mapping->MapRange(0, size, true);
+    if (status != MX_OK) {
+        mapping->Destroy();
+        vmo->Unpin(0, size);
+        return status;
+    }
+
+    uint8_t* base = reinterpret_cast<uint8_t*>(mapping->base());
+    for (uint cpu = 0; cpu < num_cpus; cpu++) {
+        perfmon_cpu_state* state = &perfmon_cpu[cpu];
+        state->header = reinterpret_cast<mx_cpu_profile_header_t*>(base + cpu * per_cpu);
+        state->size = 0;
+        state->dropped = 0;
+        state->header->size = 0;
+        state->header->dropped = 0;
+        state->samples = reinterpret_cast<uint8_t*>(state->header + 1);
+        state->capacity = per_cpu - sizeof(mx_cpu_profile_header_t);
+    }
+    perfmon_period = period;
+    perfmon_evtsel = perfmon_events[event].evtsel |
+                     PERFEVTSEL_USR | PERFEVTSEL_OS | PERFEVTSEL_INT | PERFEVTSEL_EN;
+    perfmon_vmo = mxtl::move(vmo);
+    perfmon_vmo_size = size;
+    perfmon_mapping = mxtl::move(mapping);
+    perfmon_current_mode = PERFMON_PROFILE;
+
+    mp_sync_exec(MP_CPU_ALL, perfmon_start_task, nullptr);
+    return MX_OK;
+}
+
+status_t x86_perfmon_profile_stop() {
+    AutoLock al(&perfmon_lock);
+
+    if (perfmon_current_mode != PERFMON_PROFILE)
+        return MX_ERR_BAD_STATE;
+
+    mp_sync_exec(MP_CPU_ALL, perfmon_stop_task, nullptr);
+
+    perfmon_mapping->Destroy();
+    perfmon_mapping.reset();
+    perfmon_vmo->Unpin(0, perfmon_vmo_size);
+    perfmon_vmo.reset();
+    perfmon_current_mode = PERFMON_IDLE;
+    return MX_OK;
+}
+
+// Load this cpu's counters from |state| and start them, the counters must be
+// stopped. User code may read them with rdpmc until they are stopped again.
+static void perfmon_start_counting(const x86_perfmon_thread_state* state) {
+    uint64_t enable = 0;
+
+    write_msr(X86_MSR_IA32_FIXED_CTR_CTRL, state->fixed_ctrl);
+    for (uint i = 0; i < perfmon_num_fixed; i++) {
+        write_msr(X86_MSR_IA32_FIXED_CTR0 + i, state->fixed[i]);
+        if (state->fixed_ctrl & (0xfu << (i * 4)))
+            enable |= 1ull << (32 + i);
+    }
+
+    const uint32_t pmc = perfmon_full_width_writes ? X86_MSR_IA32_A_PMC0 : X86_MSR_IA32_PMC0;
+    for (uint i = 0; i < perfmon_num_programmable; i++) {
+        write_msr(X86_MSR_IA32_PERFEVTSEL0 + i,
+                  state->evtsel[i] ? state->evtsel[i] | PERFEVTSEL_EN : 0);
+        write_msr(pmc + i, state->programmable[i]);
+        if (state->evtsel[i])
+            enable |= 1ull << i;
+    }
+
+    write_msr(X86_MSR_IA32_PERF_GLOBAL_CTRL, enable);
+    x86_set_cr4(x86_get_cr4() | X86_CR4_PCE);
+}
+
+static void perfmon_read_counters(uint64_t* programmable, uint64_t* fixed) {
+    for (uint i = 0; i < perfmon_num_programmable; i++)
+        programmable[i] = read_msr(X86_MSR_IA32_PMC0 + i);
+    for (uint i = 0; i < perfmon_num_fixed; i++)
+        fixed[i] = read_msr(X86_MSR_IA32_FIXED_CTR0 + i);
+}
+
+// Stop this cpu's counters, saving their values in |state| if it's not null.
+static void perfmon_stop_counting(x86_perfmon_thread_state* state) {
+    write_msr(X86_MSR_IA32_PERF_GLOBAL_CTRL, 0);
+    if (state)
+        perfmon_read_counters(state->programmable, state->fixed);
+
+    write_msr(X86_MSR_IA32_FIXED_CTR_CTRL, 0);
+    for (uint i = 0; i < perfmon_num_programmable; i++)
+        write_msr(X86_MSR_IA32_PERFEVTSEL0 + i, 0);
+    x86_set_cr4(x86_get_cr4() & ~X86_CR4_PCE);
+}
+
+void x86_perfmon_context_switch(thread_t* oldthread, thread_t* newthread) {
+    uint32_t generation = perfmon_generation;
+    if (generation == 0)
+        return;
+
+    if (oldthread->arch.perfmon.generation == generation)
+        perfmon_stop_counting(&oldthread->arch.perfmon);
+    if (newthread->arch.perfmon.generation == generation)
+        perfmon_start_counting(&newthread->arch.perfmon);
+}
+
+static status_t perfmon_check_config(const mx_cpu_counters_config_t* config) {
+    if (!supports_perfmon)
+        return MX_ERR_NOT_SUPPORTED;
+    if (config->reserved != 0 || (config->fixed_ctrl & ~MX_CPU_COUNTERS_FIXED_MASK))
+        return MX_ERR_INVALID_ARGS;
+
+    for (uint i = 0; i < MX_CPU_COUNTERS_MAX_PROGRAMMABLE; i++) {
+        uint32_t evtsel = config->evtsel[i];
+        if (evtsel == 0)
+            continue;
+        if ((evtsel & ~MX_CPU_COUNTERS_EVTSEL_MASK) ||
+            !(evtsel & (MX_CPU_COUNTERS_EVTSEL_USR | MX_CPU_COUNTERS_EVTSEL_OS)))
+            return MX_ERR_INVALID_ARGS;
+        if (i >= perfmon_num_programmable)
+            return MX_ERR_NOT_SUPPORTED;
+    }
+    for (uint i = perfmon_num_fixed; i < MX_CPU_COUNTERS_NUM_FIXED; i++) {
+        if (config->fixed_ctrl & (0xfu << (i * 4)))
+            return MX_ERR_NOT_SUPPORTED;
+    }
+    return MX_OK;
+}
+
+static void perfmon_init_state(x86_perfmon_thread_state* state,
+                               const mx_cpu_counters_config_t* config) {
+    memset(state, 0, sizeof(*state));
+    state->fixed_ctrl = config->fixed_ctrl;
+    memcpy(state->evtsel, config->evtsel, sizeof(state->evtsel));
+}
+
+static void perfmon_start_cpus_task(void* context) {
+    perfmon_start_counting(&perfmon_cpus_state);
+}
+
+static void perfmon_stop_counters_task(void* context) {
+    perfmon_stop_counting(nullptr);
+}
+
+static void perfmon_read_cpu_task(void* context) {
+    auto counters = static_cast<mx_cpu_counters_t*>(context);
+    perfmon_read_counters(counters->programmable, counters->fixed);
+}
+
+status_t x86_perfmon_counters_start_cpus(const mx_cpu_counters_config_t* config) {
+    status_t status = perfmon_check_config(config);
+    if (status != MX_OK)
+        return status;
+
+    AutoLock al(&perfmon_lock);
+
+    if (perfmon_current_mode != PERFMON_IDLE)
+        return MX_ERR_BAD_STATE;
+
+    perfmon_init_state(&perfmon_cpus_state, config);
+    perfmon_current_mode = PERFMON_COUNT_CPUS;
+    mp_sync_exec(MP_CPU_ALL, perfmon_start_cpus_task, nullptr);
+    return MX_OK;
+}
+
+status_t x86_perfmon_counters_start_thread(const mx_cpu_counters_config_t* config) {
+    status_t status = perfmon_check_config(config);
+    if (status != MX_OK)
+        return status;
+
+    // Switching threads saves and restores the programmable counters, which
+    // would lose all but 31 bits without full width writes.
+    for (uint i = 0; i < MX_CPU_COUNTERS_MAX_PROGRAMMABLE; i++) {
+        if (config->evtsel[i] && !perfmon_full_width_writes)
+            return MX_ERR_NOT_SUPPORTED;
+    }
+
+    AutoLock al(&perfmon_lock);
+
+    if (perfmon_current_mode == PERFMON_IDLE) {
+        if (++perfmon_last_generation == 0)
+            ++perfmon_last_generation;
+        perfmon_generation = perfmon_last_generation;
+        perfmon_current_mode = PERFMON_COUNT_THREADS;
+    } else if (perfmon_current_mode != PERFMON_COUNT_THREADS) {
+        return MX_ERR_BAD_STATE;
+    }
+
+    // Start as though the thread had just been switched to.
+    thread_t* t = get_current_thread();
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, 0);
+    if (t->arch.perfmon.generation == perfmon_generation)
+        perfmon_stop_counting(nullptr);
+    perfmon_init_state(&t->arch.perfmon, config);
+    t->arch.perfmon.generation = perfmon_generation;
+    perfmon_start_counting(&t->arch.perfmon);
+    arch_interrupt_restore(state, 0);
+    return MX_OK;
+}
+
+status_t x86_perfmon_counters_read_thread(mx_cpu_counters_t* counters) {
+    memset(counters, 0, sizeof(*counters));
+
+    thread_t* t = get_current_thread();
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, 0);
+    uint32_t generation = perfmon_generation;
+    bool live = generation != 0 && t->arch.perfmon.generation == generation;
+    if (live)
+        perfmon_read_counters(counters->programmable, counters->fixed);
+    arch_interrupt_restore(state, 0);
+
+    return live ? MX_OK : MX_ERR_BAD_STATE;
+}
+
+status_t x86_perfmon_counters_read_cpu(uint cpu, mx_cpu_counters_t* counters) {
+    memset(counters, 0, sizeof(*counters));
+
+    AutoLock al(&perfmon_lock);
+
+    if (perfmon_current_mode != PERFMON_COUNT_CPUS)
+        return MX_ERR_BAD_STATE;
+    if (cpu >= arch_max_num_cpus() || !mp_is_cpu_online(cpu))
+        return MX_ERR_INVALID_ARGS;
+
+    mp_sync_exec(1u << cpu, perfmon_read_cpu_task, counters);
+    return MX_OK;
+}
+
+status_t x86_perfmon_counters_stop() {
+    AutoLock al(&perfmon_lock);
+
+    if (perfmon_current_mode != PERFMON_COUNT_CPUS &&
+        perfmon_current_mode != PERFMON_COUNT_THREADS)
+        return MX_ERR_BAD_STATE;
+
+    // Once the generation is cleared no thread starts counting when switched
+    // to, then the counters still running anywhere are stopped.
+    perfmon_generation = 0;
+    mp_sync_exec(MP_CPU_ALL, perfmon_stop_counters_task, nullptr);
+    perfmon_current_mode = PERFMON_IDLE;
+    return MX_OK;
+}
+
+// Collect the interrupted pc and, in the kernel, its callers by following
+// frame pointers within the current thread's stack.
+static uint32_t perfmon_get_pcs(const x86_iframe_t* frame, bool user, uint64_t* pcs) {
+    uint32_t n = 0;
+    pcs[n++] = frame->ip;
+    if (user)
+        return n;
+
+    thread_t* t = get_current_thread();
+    uintptr_t stack = reinterpret_cast<uintptr_t>(t->stack);
+    uintptr_t stack_end = stack + t->stack_size;
+    uintptr_t fp = frame->rbp;
+    while (n < MX_CPU_PROFILE_MAX_PCS) {
+        if (fp < stack || fp + 2 * sizeof(uintptr_t) > stack_end || (fp & 7))
+            break;
+        const uintptr_t* f = reinterpret_cast<const uintptr_t*>(fp);
+        pcs[n++] = f[1];
+        // Frames only ever move up the stack.
+        if (f[0] <= fp)
+            break;
+        fp = f[0];
+    }
+    return n;
+}
+
+static void perfmon_record_sample(const x86_iframe_t* frame) {
+    perfmon_cpu_state* state = &perfmon_cpu[arch_curr_cpu_num()];
+    mx_cpu_profile_header_t* header = state->header;
+    if (!header)
+        return;
+
+    const bool user = SELECTOR_PL(frame->cs) != 0;
+    uint64_t pcs[MX_CPU_PROFILE_MAX_PCS];
+    uint32_t num_pcs = perfmon_get_pcs(frame, user, pcs);
+
+    const size_t len = sizeof(mx_cpu_profile_sample_t) + num_pcs * sizeof(uint64_t);
+    if (len > state->capacity - state->size) {
+        header->dropped = ++state->dropped;
+        return;
+    }
+
+    thread_t* t = get_current_thread();
+    auto sample = reinterpret_cast<mx_cpu_profile_sample_t*>(state->samples + state->size);
+    sample->time = current_time();
+    sample->pid = t->user_pid;
+    sample->tid = t->user_tid;
+    sample->flags = user ? MX_CPU_PROFILE_SAMPLE_USER : 0;
+    sample->num_pcs = num_pcs;
+    memcpy(sample + 1, pcs, num_pcs * sizeof(uint64_t));
+    state->size += len;
+    header->size = state->size;
+}
+
+enum handler_return x86_perfmon_interrupt_handler(x86_iframe_t* frame) {
+    uint64_t status = read_msr(X86_MSR_IA32_PERF_GLOBAL_STATUS);
+    if (status & PERF_GLOBAL_PMC0) {
+        perfmon_record_sample(frame);
+        write_msr(X86_MSR_IA32_PMC0, -perfmon_period);
+    }
+    write_msr(X86_MSR_IA32_PERF_GLOBAL_OVF_CTRL, status);
+
+    // The local apic masks the vector each time it delivers it.
+    if (perfmon_cpu[arch_curr_cpu_num()].header)
+        apic_pmi_unmask();
+    return INT_NO_RESCHEDULE;
+}
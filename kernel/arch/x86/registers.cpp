@@ -330,13 +330,49 @@ void x86_extended_register_restore_state(void *register_state)
     }
 }
 
+/* Which state components to restore when switching to |register_state|.
+ *
+ * A component that is in its init state both in the registers and in
+ * |register_state| can be left alone, which spares integer-only threads
+ * the cost of reloading AVX and AVX-512 state that nobody is using.
+ * XGETBV(1) only reports the user components in XCR0, and leaves MXCSR out
+ * of the SSE bit, so the x87 and SSE components and anything outside XCR0
+ * are always restored. */
+static uint64_t restore_feature_mask(void *register_state)
+{
+    if (!xgetbv_1_supported) {
+        return ~0ULL;
+    }
+
+    struct xsave_area *area = (struct xsave_area *)register_state;
+    return x86_xgetbv(1) | area->xstate_bv |
+           X86_XSAVE_STATE_X87 | X86_XSAVE_STATE_SSE | ~xcr0_component_bitmap;
+}
+
 void x86_extended_register_context_switch(
         thread_t *old_thread, thread_t *new_thread)
 {
     if (likely(old_thread)) {
         x86_extended_register_save_state(old_thread->arch.extended_register_state);
     }
-    x86_extended_register_restore_state(new_thread->arch.extended_register_state);
+
+    void *register_state = new_thread->arch.extended_register_state;
+    /* The idle threads have no extended register state */
+    if (unlikely(!register_state)) {
+        return;
+    }
+
+    /* XSAVEOPT and XSAVES already skip writing components that are in their
+     * init state, or that have not been modified since this buffer was
+     * restored; on the way in, skip the components that are unused on both
+     * sides. */
+    if (xsaves_supported) {
+        xrstors(register_state, restore_feature_mask(register_state));
+    } else if (xsave_supported) {
+        xrstor(register_state, restore_feature_mask(register_state));
+    } else if (fxsave_supported) {
+        fxrstor(register_state);
+    }
 }
 
 static void read_xsave_state_info(void)
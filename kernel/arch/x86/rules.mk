@@ -64,6 +64,7 @@ MODULE_SRCS += \
 	$(LOCAL_DIR)/header.S \
 	$(LOCAL_DIR)/hwp.cpp \
 	$(LOCAL_DIR)/hypervisor.cpp \
+	$(LOCAL_DIR)/idle.cpp \
 	$(LOCAL_DIR)/idt.cpp \
 	$(LOCAL_DIR)/ioapic.cpp \
 	$(LOCAL_DIR)/ioport.cpp \
@@ -72,6 +73,7 @@ MODULE_SRCS += \
 	$(LOCAL_DIR)/mmu_mem_types.cpp \
 	$(LOCAL_DIR)/mmu_tests.cpp \
 	$(LOCAL_DIR)/mp.cpp \
+	$(LOCAL_DIR)/perfmon.cpp \
 	$(LOCAL_DIR)/proc_trace.cpp \
 	$(LOCAL_DIR)/registers.cpp \
 	$(LOCAL_DIR)/thread.cpp \
@@ -133,6 +135,15 @@ endif
 GLOBAL_COMPILEFLAGS += --target=$(ARCH_x86_64_CLANG_TARGET)
 endif
 
+# Have position-independent code reach thread_local variables through TLS
+# descriptors, which the dynamic linker resolves to an offset from the thread
+# pointer when the variable is in static TLS, rather than calling
+# __tls_get_addr on every access.  arm64 does this by default; Clang doesn't
+# support it for x86-64 yet.
+ifeq ($(call TOBOOL,$(USE_CLANG)),false)
+USER_COMPILEFLAGS += -mtls-dialect=gnu2
+endif
+
 KERNEL_COMPILEFLAGS += -mcmodel=kernel
 KERNEL_COMPILEFLAGS += -mno-red-zone
 
@@ -17,6 +17,7 @@
 #include <arch/x86.h>
 #include <arch/x86/descriptor.h>
 #include <arch/x86/mp.h>
+#include <arch/x86/perfmon.h>
 #include <arch/x86/registers.h>
 
 void arch_thread_initialize(thread_t *t, vaddr_t entry_point)
@@ -64,6 +65,8 @@ void arch_thread_initialize(thread_t *t, vaddr_t entry_point)
     // initialize the fs, gs and kernel bases to 0.
     t->arch.fs_base = 0;
     t->arch.gs_base = 0;
+
+    memset(&t->arch.perfmon, 0, sizeof(t->arch.perfmon));
 }
 
 void arch_thread_construct_first(thread_t *t)
@@ -83,6 +86,9 @@ void arch_context_switch(thread_t *oldthread, thread_t *newthread)
 {
     x86_extended_register_context_switch(oldthread, newthread);
 
+    if (unlikely(oldthread->arch.perfmon.generation | newthread->arch.perfmon.generation))
+        x86_perfmon_context_switch(oldthread, newthread);
+
     //printf("cs 0x%llx\n", kstack_top);
 
     /* set the tss SP0 value to point at the top of our stack */
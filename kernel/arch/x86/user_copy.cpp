@@ -26,13 +26,24 @@ static inline bool ac_flag(void)
     return x86_save_flags() & X86_FLAGS_AC;
 }
 
+static inline uint32_t usercopy_flags(void)
+{
+    uint32_t flags = 0;
+    if (x86_feature_test(X86_FEATURE_SMAP))
+        flags |= X86_USER_COPY_SMAP;
+    if (x86_feature_test(X86_FEATURE_ERMS))
+        flags |= X86_USER_COPY_ERMS;
+    if (x86_feature_test(X86_FEATURE_FSRM))
+        flags |= X86_USER_COPY_FSRM;
+    return flags;
+}
+
 status_t arch_copy_from_user(void *dst, const void *src, size_t len)
 {
     DEBUG_ASSERT(!ac_flag());
 
-    bool smap_avail = x86_feature_test(X86_FEATURE_SMAP);
     thread_t *thr = get_current_thread();
-    status_t status = _x86_copy_from_user(dst, src, len, smap_avail,
+    status_t status = _x86_copy_from_user(dst, src, len, usercopy_flags(),
                                           &thr->arch.page_fault_resume);
 
     DEBUG_ASSERT(!ac_flag());
@@ -43,9 +54,8 @@ status_t arch_copy_to_user(void *dst, const void *src, size_t len)
 {
     DEBUG_ASSERT(!ac_flag());
 
-    bool smap_avail = x86_feature_test(X86_FEATURE_SMAP);
     thread_t *thr = get_current_thread();
-    status_t status = _x86_copy_to_user(dst, src, len, smap_avail,
+    status_t status = _x86_copy_to_user(dst, src, len, usercopy_flags(),
                                         &thr->arch.page_fault_resume);
 
     DEBUG_ASSERT(!ac_flag());
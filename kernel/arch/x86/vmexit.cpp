@@ -9,7 +9,9 @@
 #include <string.h>
 #include <trace.h>
 
+#include <arch/x86.h>
 #include <arch/x86/apic.h>
+#include <arch/x86/descriptor.h>
 #include <arch/x86/feature.h>
 #include <arch/x86/interrupts.h>
 #include <arch/x86/mmu.h>
@@ -17,6 +19,7 @@
 #include <kernel/sched.h>
 #include <kernel/timer.h>
 #include <kernel/vm/pmm.h>
+#include <lib/ktrace.h>
 #include <mxtl/algorithm.h>
 #include <platform/pc/timer.h>
 
@@ -28,16 +31,21 @@
 #include <magenta/syscalls/hypervisor.h>
 
 static const uint16_t kLocalApicEoi = 0x00b0;
+static const uint64_t kEptViolationWrite = 1u << 1;
 #endif // WITH_LIB_MAGENTA
 
 #define LOCAL_TRACE 0
 
 static const uint64_t kLocalApicPhysBase =
     APIC_PHYS_BASE | IA32_APIC_BASE_BSP | IA32_APIC_BASE_XAPIC_ENABLE;
+static const uint16_t kLocalApicTpr = 0x080;
+static const uint16_t kLocalApicIrr = 0x200;
 static const uint16_t kLocalApicLvtTimer = 0x320;
 
 static const uint64_t kMiscEnableFastStrings = 1u << 0;
 
+static const uint64_t kPostedInterruptOn = 1u << 0;
+
 static const uint32_t kInterruptInfoDeliverErrorCode = 1u << 11;
 static const uint32_t kInterruptInfoValid = 1u << 31;
 static const uint64_t kInvalidErrorCode = UINT64_MAX;
@@ -90,6 +98,11 @@ static void issue_interrupt(uint16_t interrupt, uint64_t error_code, Interruptio
     vmcs_write(VmcsField32::ENTRY_INTERRUPTION_INFORMATION, interrupt_info);
 }
 
+static uint32_t* apic_reg(LocalApicState* local_apic_state, uint16_t reg) {
+    uintptr_t addr = reinterpret_cast<uintptr_t>(local_apic_state->apic_addr);
+    return reinterpret_cast<uint32_t*>(addr + reg);
+}
+
 /* Removes the highest priority interrupt from the bitmap, and returns it. */
 static uint16_t local_apic_pop_interrupt(LocalApicState* local_apic_state) {
     // TODO(abdulla): Handle interrupt masking.
@@ -133,12 +146,63 @@ static void local_apic_maybe_interrupt(LocalApicState* local_apic_state) {
     }
 }
 
+/* Posts the given interrupt to the posted-interrupt descriptor, returning true
+ * if we set the outstanding notification bit, and should send a notification.
+ */
+bool local_apic_post_interrupt(LocalApicState* local_apic_state, uint8_t interrupt) {
+    PostedInterruptDescriptor* pi_desc = local_apic_state->pi_desc;
+    atomic_or_u64(&pi_desc->pir[interrupt / 64], 1ul << (interrupt % 64));
+    return !(atomic_or_u64(&pi_desc->control, kPostedInterruptOn) & kPostedInterruptOn);
+}
+
+/* Moves posted interrupts into the virtual APIC. The VMCS must be loaded. */
+void local_apic_sync_posted(LocalApicState* local_apic_state) {
+    PostedInterruptDescriptor* pi_desc = local_apic_state->pi_desc;
+    if (!(atomic_and_u64(&pi_desc->control, ~kPostedInterruptOn) & kPostedInterruptOn))
+        return;
+
+    // From Volume 3, Section 29.6: Move the requests into the virtual APIC's
+    // IRR, and raise RVI, the low byte of the guest interrupt status, to the
+    // highest of them.
+    uint16_t status = vmcs_read(VmcsField16::GUEST_INTERRUPT_STATUS);
+    uint8_t rvi = status & UINT8_MAX;
+    for (uint i = 0; i < countof(pi_desc->pir); i++) {
+        uint64_t pir = atomic_swap_u64(&pi_desc->pir[i], 0);
+        if (pir == 0)
+            continue;
+        // Each 32-bit IRR register is 16-byte aligned.
+        *apic_reg(local_apic_state, static_cast<uint16_t>(kLocalApicIrr + i * 0x20)) |=
+            static_cast<uint32_t>(pir);
+        *apic_reg(local_apic_state, static_cast<uint16_t>(kLocalApicIrr + i * 0x20 + 0x10)) |=
+            static_cast<uint32_t>(pir >> 32);
+        rvi = mxtl::max(rvi, static_cast<uint8_t>(i * 64 + 63 - __builtin_clzl(pir)));
+    }
+    vmcs_write(VmcsField16::GUEST_INTERRUPT_STATUS,
+               static_cast<uint16_t>((status & ~UINT8_MAX) | rvi));
+}
+
+/* Returns whether the processor would deliver a virtual interrupt to the guest,
+ * based on the priority of RVI, from Volume 3, Section 29.2.1.
+ */
+static bool local_apic_deliverable(LocalApicState* local_apic_state) {
+    uint16_t status = vmcs_read(VmcsField16::GUEST_INTERRUPT_STATUS);
+    uint8_t rvi = status & UINT8_MAX;
+    uint8_t svi = static_cast<uint8_t>(status >> 8);
+    uint8_t tpr = *apic_reg(local_apic_state, kLocalApicTpr) & UINT8_MAX;
+    uint8_t ppr = mxtl::max<uint8_t>(tpr & 0xf0, svi & 0xf0);
+    return (rvi & 0xf0) > ppr;
+}
+
 /* Sets the given interrupt in the bitmap and signals waiters, returning true if
  * a waiter was signaled.
  */
 bool local_apic_signal_interrupt(LocalApicState* local_apic_state, uint8_t interrupt,
                                  bool reschedule) {
-    local_apic_pending_interrupt(local_apic_state, interrupt);
+    if (local_apic_state->pi_desc != nullptr) {
+        local_apic_post_interrupt(local_apic_state, interrupt);
+    } else {
+        local_apic_pending_interrupt(local_apic_state, interrupt);
+    }
     // TODO(abdulla): We can skip this check if an interrupt is pending, as we
     // would have already signaled. However, we should be careful with locking.
     return event_signal(&local_apic_state->event, reschedule) > 0;
@@ -156,6 +220,18 @@ void interrupt_window_exiting(bool enable) {
 
 static status_t handle_external_interrupt(AutoVmcsLoad* vmcs_load,
                                           LocalApicState* local_apic_state) {
+    if (local_apic_state->pi_desc != nullptr) {
+        // The interrupt was acknowledged on VM exit, so enabling interrupts
+        // will not deliver it. Instead, dispatch it as if it had been.
+        x86_iframe_t frame = {};
+        frame.vector = vmcs_read(VmcsField32::EXIT_INTERRUPTION_INFORMATION) & X86_MAX_INT;
+        frame.cs = CODE_64_SELECTOR;
+        frame.flags = X86_FLAGS_RESERVED_ONES;
+        x86_exception_handler(&frame);
+        // Pending interrupts are collected from the descriptor on VM entry.
+        vmcs_load->reload();
+        return MX_OK;
+    }
     vmcs_load->reload();
     local_apic_maybe_interrupt(local_apic_state);
     return MX_OK;
@@ -207,6 +283,16 @@ static status_t handle_hlt(const ExitInfo& exit_info, LocalApicState* local_apic
     // TODO(abdulla): Use an interruptible sleep here, so that we can:
     // a) Continue to deliver interrupts to the guest.
     // b) Kill the hypervisor while a guest is halted.
+    if (local_apic_state->pi_desc != nullptr) {
+        // The processor delivers the interrupt on VM entry, once it is pending.
+        local_apic_sync_posted(local_apic_state);
+        while (!local_apic_deliverable(local_apic_state)) {
+            event_wait(&local_apic_state->event);
+            local_apic_sync_posted(local_apic_state);
+        }
+        next_rip(exit_info);
+        return MX_OK;
+    }
     do {
         event_wait(&local_apic_state->event);
     } while (!local_apic_issue_interrupt(local_apic_state));
@@ -220,6 +306,7 @@ public:
     FifoStateObserver(mx_signals_t watched_signals)
         : watched_signals_(watched_signals) {
         event_init(&event_, false, 0);
+        set_signal_interest(watched_signals_);
     }
     status_t Wait(StateTracker* state_tracker) {
         state_tracker->AddObserver(this, nullptr);
@@ -280,12 +367,14 @@ static status_t packet_read(FifoDispatcher* ctl_fifo, mx_guest_packet_t* packet)
 #endif // WITH_LIB_MAGENTA
 
 static status_t handle_io_instruction(const ExitInfo& exit_info, GuestState* guest_state,
-                                      FifoDispatcher* ctl_fifo) {
+                                      GuestBells* bells, FifoDispatcher* ctl_fifo) {
     next_rip(exit_info);
 #if WITH_LIB_MAGENTA
     IoInfo io_info(exit_info.exit_qualification);
     if (io_info.string || io_info.repeat)
         return MX_ERR_NOT_SUPPORTED;
+    if (!io_info.input && bells->Ring(MX_GUEST_BELL_PORT_OUT, io_info.port))
+        return MX_OK;
     mx_guest_packet_t packet;
     memset(&packet, 0, sizeof(packet));
     if (!io_info.input) {
@@ -354,11 +443,6 @@ static status_t handle_rdmsr(const ExitInfo& exit_info, GuestState* guest_state)
     }
 }
 
-static uint32_t* apic_reg(LocalApicState* local_apic_state, uint16_t reg) {
-    uintptr_t addr = reinterpret_cast<uintptr_t>(local_apic_state->apic_addr);
-    return reinterpret_cast<uint32_t*>(addr + reg);
-}
-
 static handler_return deadline_callback(timer_t* timer, lk_time_t now, void* arg) {
     LocalApicState* local_apic_state = static_cast<LocalApicState*>(arg);
     uint32_t* lvt_timer = apic_reg(local_apic_state, kLocalApicLvtTimer);
@@ -519,9 +603,18 @@ static status_t handle_apic_access(const ExitInfo& exit_info, LocalApicState* lo
 }
 
 static status_t handle_ept_violation(const ExitInfo& exit_info, GuestPhysicalAddressSpace* gpas,
-                                     FifoDispatcher* ctl_fifo) {
+                                     GuestBells* bells, FifoDispatcher* ctl_fifo) {
 #if WITH_LIB_MAGENTA
     vaddr_t guest_paddr = exit_info.guest_physical_address;
+    // A write to a bell only needs to be stepped over, so it does not need
+    // to be decoded in user space.
+    if ((exit_info.exit_qualification & kEptViolationWrite) &&
+        bells->Ring(MX_GUEST_BELL_MEM_WRITE, guest_paddr)) {
+        if (exit_info.instruction_length > X86_MAX_INST_LEN)
+            return MX_ERR_INTERNAL;
+        next_rip(exit_info);
+        return MX_OK;
+    }
     return handle_mem_trap(exit_info, guest_paddr, gpas, ctl_fifo);
 #else // WITH_LIB_MAGENTA
     return MX_ERR_NOT_SUPPORTED;
@@ -556,11 +649,10 @@ static status_t handle_xsetbv(const ExitInfo& exit_info, GuestState* guest_state
     return MX_OK;
 }
 
-status_t vmexit_handler(AutoVmcsLoad* vmcs_load, GuestState* guest_state,
-                        LocalApicState* local_apic_state, GuestPhysicalAddressSpace* gpas,
-                        FifoDispatcher* ctl_fifo) {
-    ExitInfo exit_info;
-
+static status_t handle_exit(const ExitInfo& exit_info, AutoVmcsLoad* vmcs_load,
+                            GuestState* guest_state, LocalApicState* local_apic_state,
+                            GuestPhysicalAddressSpace* gpas, GuestBells* bells,
+                            FifoDispatcher* ctl_fifo) {
     switch (exit_info.exit_reason) {
     case ExitReason::EXTERNAL_INTERRUPT:
         return handle_external_interrupt(vmcs_load, local_apic_state);
@@ -577,7 +669,7 @@ status_t vmexit_handler(AutoVmcsLoad* vmcs_load, GuestState* guest_state,
         LTRACEF("handling VMCALL instruction\n\n");
         return MX_ERR_STOP;
     case ExitReason::IO_INSTRUCTION:
-        return handle_io_instruction(exit_info, guest_state, ctl_fifo);
+        return handle_io_instruction(exit_info, guest_state, bells, ctl_fifo);
     case ExitReason::RDMSR:
         LTRACEF("handling RDMSR instruction %#" PRIx64 "\n\n", guest_state->rcx);
         return handle_rdmsr(exit_info, guest_state);
@@ -593,7 +685,7 @@ status_t vmexit_handler(AutoVmcsLoad* vmcs_load, GuestState* guest_state,
         return handle_apic_access(exit_info, local_apic_state, gpas, ctl_fifo);
     case ExitReason::EPT_VIOLATION:
         LTRACEF("handling EPT violation\n\n");
-        return handle_ept_violation(exit_info, gpas, ctl_fifo);
+        return handle_ept_violation(exit_info, gpas, bells, ctl_fifo);
     case ExitReason::XSETBV:
         LTRACEF("handling XSETBV instruction\n\n");
         return handle_xsetbv(exit_info, guest_state);
@@ -602,3 +694,47 @@ status_t vmexit_handler(AutoVmcsLoad* vmcs_load, GuestState* guest_state,
         return MX_ERR_NOT_SUPPORTED;
     }
 }
+
+static uint32_t exit_kind(ExitReason exit_reason) {
+    switch (exit_reason) {
+    case ExitReason::EXTERNAL_INTERRUPT:
+        return MX_GUEST_EXIT_EXTERNAL_INTERRUPT;
+    case ExitReason::INTERRUPT_WINDOW:
+        return MX_GUEST_EXIT_INTERRUPT_WINDOW;
+    case ExitReason::CPUID:
+        return MX_GUEST_EXIT_CPUID;
+    case ExitReason::HLT:
+        return MX_GUEST_EXIT_HLT;
+    case ExitReason::IO_INSTRUCTION:
+        return MX_GUEST_EXIT_IO;
+    case ExitReason::RDMSR:
+    case ExitReason::WRMSR:
+        return MX_GUEST_EXIT_MSR;
+    case ExitReason::APIC_ACCESS:
+        return MX_GUEST_EXIT_APIC_ACCESS;
+    case ExitReason::EPT_VIOLATION:
+        return MX_GUEST_EXIT_EPT_VIOLATION;
+    default:
+        return MX_GUEST_EXIT_OTHER;
+    }
+}
+
+status_t vmexit_handler(AutoVmcsLoad* vmcs_load, GuestState* guest_state,
+                        LocalApicState* local_apic_state, GuestPhysicalAddressSpace* gpas,
+                        GuestBells* bells, FifoDispatcher* ctl_fifo,
+                        mx_guest_exit_stats_t* exit_stats) {
+    lk_time_t start = current_time();
+    ExitInfo exit_info;
+    status_t status = handle_exit(exit_info, vmcs_load, guest_state, local_apic_state, gpas,
+                                  bells, ctl_fifo);
+    lk_time_t duration = current_time() - start;
+
+    auto exit = &exit_stats->exits[exit_kind(exit_info.exit_reason)];
+    exit->count++;
+    exit->time += duration;
+    ktrace(TAG_VCPU_EXIT, static_cast<uint32_t>(exit_info.exit_reason),
+           static_cast<uint32_t>(exit_info.guest_rip),
+           static_cast<uint32_t>(exit_info.guest_rip >> 32),
+           static_cast<uint32_t>(mxtl::min<lk_time_t>(duration, UINT32_MAX)));
+    return status;
+}
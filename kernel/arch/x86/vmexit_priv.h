@@ -10,11 +10,13 @@
 
 class AutoVmcsLoad;
 class FifoDispatcher;
+class GuestBells;
 class GuestPhysicalAddressSpace;
 struct GuestState;
 struct IoApicState;
 struct LocalApicState;
 struct VmxState;
+typedef struct mx_guest_exit_stats mx_guest_exit_stats_t;
 
 /* VM exit reasons. */
 enum class ExitReason : uint32_t {
@@ -81,7 +83,10 @@ enum class InterruptionType : uint32_t {
 
 bool local_apic_signal_interrupt(LocalApicState* local_apic_state, uint8_t interrupt,
                                  bool reschedule);
+bool local_apic_post_interrupt(LocalApicState* local_apic_state, uint8_t interrupt);
+void local_apic_sync_posted(LocalApicState* local_apic_state);
 void interrupt_window_exiting(bool enable);
 status_t vmexit_handler(AutoVmcsLoad* vmcs_load, GuestState* guest_state,
                         LocalApicState* local_apic_state, GuestPhysicalAddressSpace* gpas,
-                        FifoDispatcher* ctl_fifo);
+                        GuestBells* bells, FifoDispatcher* ctl_fifo,
+                        mx_guest_exit_stats_t* exit_stats);
@@ -57,6 +57,17 @@ constexpr uint8_t PCIE_CAP_ID_ENHANCED_ALLOCATION      = 0x14;
 
 #define PCIE_CAP_MSI_CTRL_SET_MME(val, ctrl)    (uint16_t)((ctrl & ~0x0070) | ((val & 0x7) << 4))
 #define PCIE_CAP_MSI_CTRL_SET_ENB(val, ctrl)    (uint16_t)((ctrl & ~0x0001) | (!!val))
+
+/**
+ * Structure definitions for capability PCIE_CAP_ID_MSIX
+ *
+ * @see The PCI Local Bus specificiaion v3.0 Section 6.8.2
+ */
+#define PCIE_CAP_MSIX_CTRL_GET_TABLE_SIZE(ctrl)     ((uint)(ctrl & 0x07FF) + 1u)
+#define PCIE_CAP_MSIX_CTRL_SET_FUNC_MASK(val, ctrl) (uint16_t)((ctrl & ~0x4000) | ((!!val) << 14))
+#define PCIE_CAP_MSIX_CTRL_SET_ENB(val, ctrl)       (uint16_t)((ctrl & ~0x8000) | ((!!val) << 15))
+#define PCIE_CAP_MSIX_GET_BIR(val)                  ((uint)(val & 0x7))
+#define PCIE_CAP_MSIX_GET_OFFSET(val)               ((uint32_t)(val & ~0x7u))
 #define PCS_CAPS_V1_ENDPOINT_SIZE        ((uint)offsetof(pcie_capabilities_t, link))
 #define PCS_CAPS_V1_UPSTREAM_PORT_SIZE   ((uint)offsetof(pcie_capabilities_t, slot))
 #define PCS_CAPS_V1_DOWNSTREAM_PORT_SIZE ((uint)offsetof(pcie_capabilities_t, root))
@@ -227,7 +238,7 @@ public:
     // Accessors
     bool is64Bit() const { return is_64_bit_; }
     bool has_pvm() const { return has_pvm_; }
-    bool max_irqs() const { return max_irqs_; }
+    uint max_irqs() const { return max_irqs_; }
     PciReg16 ctrl_reg() const { return ctrl_; }
     PciReg32 addr_reg() const { return addr_; }
     PciReg32 addr_upper_reg() const { return addr_upper_; }
@@ -255,6 +266,55 @@ private:
     PciReg32 pending_bits_;
 };
 
+/* MSI-X Interrupts.
+ * @see PCI Local Bus Spec v3.0 section 6.8.2.
+ */
+class PciCapMsix : public PciStdCapability {
+public:
+    static constexpr uint16_t kControlOffset = 0x02;
+    static constexpr uint16_t kTableOffset   = 0x04;
+    static constexpr uint16_t kPbaOffset     = 0x08;
+    static constexpr uint16_t kSize          = 0x0C;
+
+    // Layout of the entries of the vector table, which lives in one of the
+    // device's MMIO BARs rather than in config space.
+    static constexpr uint32_t kEntrySize             = 0x10;
+    static constexpr uint32_t kEntryAddrOffset       = 0x00;
+    static constexpr uint32_t kEntryAddrUpperOffset  = 0x04;
+    static constexpr uint32_t kEntryDataOffset       = 0x08;
+    static constexpr uint32_t kEntryVectorCtrlOffset = 0x0C;
+    static constexpr uint32_t kEntryVectorCtrlMasked = 0x01;
+
+    PciCapMsix(const PcieDevice& dev, uint16_t base, uint8_t id);
+    ~PciCapMsix() {}
+
+    // Accessors
+    uint max_irqs() const { return max_irqs_; }
+    uint table_bar() const { return table_bar_; }
+    uint32_t table_offset() const { return table_offset_; }
+    PciReg16 ctrl_reg() const { return ctrl_; }
+    pcie_msi_block_t irq_block() const { return irq_block_; }
+
+private:
+    // Like PciCapMsi, the block and the mapping of the vector table are set up
+    // by PcieDevice when the device enters MSI-X mode.
+    friend class PcieDevice;
+    unsigned int max_irqs_ = 0;
+    uint table_bar_;
+    uint32_t table_offset_;
+    pcie_msi_block_t irq_block_;
+
+    // Kernel mapping of the pages holding the vector table, and where in it
+    // the table starts.
+    void* table_mapping_ = nullptr;
+    volatile uint8_t* table_ = nullptr;
+
+    // Cached registers
+    PciReg16 ctrl_;
+    PciReg32 table_reg_;
+    PciReg32 pba_reg_;
+};
+
 /* PCI Express Capability classes */
 
 class PciCapPcie : public PciStdCapability {
@@ -282,6 +282,28 @@ public:
      */
     status_t MaskUnmaskIrq(uint irq_id, bool mask);
 
+    /**
+     * Steer the specified IRQ to a particular CPU.
+     *
+     * @param irq_id The ID of the IRQ to steer.
+     * @param cpu_num The CPU which should take the IRQ from now on.
+     *
+     * @return A status_t indicating the success or failure of the operation.
+     * Status codes may include (but are not limited to)...
+     *
+     * ++ MX_ERR_UNAVAILABLE
+     *    The device has become unplugged and is waiting to be released.
+     * ++ MX_ERR_BAD_STATE
+     *    The device is in DISABLED IRQ mode.
+     * ++ MX_ERR_INVALID_ARGS
+     *    The irq_id parameter is out of range for the currently configured
+     *    mode, or cpu_num is not an online CPU.
+     * ++ MX_ERR_NOT_SUPPORTED
+     *    The device is not operating in MSI-X mode (legacy and MSI vectors
+     *    share a single target), or the platform cannot target the CPU.
+     */
+    status_t SetIrqAffinity(uint irq_id, uint cpu_num);
+
     void SetQuirksDone() { quirks_done_ = true; }
 
     /**
@@ -399,6 +421,7 @@ private:
     status_t SetIrqModeLocked(pcie_irq_mode_t mode, uint requested_irqs);
     status_t RegisterIrqHandlerLocked(uint irq_id, pcie_irq_handler_fn_t handler, void* ctx);
     status_t MaskUnmaskIrqLocked(uint irq_id, bool mask);
+    status_t SetIrqAffinityLocked(uint irq_id, uint cpu_num);
 
     // Internal Legacy IRQ support.
     status_t MaskUnmaskLegacyIrq(bool mask);
@@ -413,15 +436,47 @@ private:
                 PCIE_CAP_MSI_CTRL_SET_ENB(enb, cfg_->Read(irq_.msi->ctrl_reg())));
     }
 
+    // MSI-X vectors can always be masked at the device, MSI vectors only if
+    // the device implements per vector masking.
+    bool msi_has_pvm() const {
+        return (irq_.mode == PCIE_IRQ_MODE_MSI_X) || irq_.msi->has_pvm();
+    }
+
+    const pcie_msi_block_t& msi_irq_block() const {
+        return (irq_.mode == PCIE_IRQ_MODE_MSI_X) ? irq_.msix->irq_block_ : irq_.msi->irq_block_;
+    }
+
     bool     MaskUnmaskMsiIrqLocked(uint irq_id, bool mask);
     status_t MaskUnmaskMsiIrq(uint irq_id, bool mask);
     void     MaskAllMsiVectors();
     void     SetMsiTarget(uint64_t tgt_addr, uint32_t tgt_data);
-    void     FreeMsiBlock();
+    void     FreeMsiBlock(pcie_msi_block_t* block);
     void     SetMsiMultiMessageEnb(uint requested_irqs);
     void     LeaveMsiIrqMode();
     status_t EnterMsiIrqMode(uint requested_irqs);
 
+    // Internal MSI-X IRQ support.  MSI-X mode shares the MSI masking and
+    // dispatch code above.
+    void SetMsixCtrl(bool enb, bool func_mask) {
+        DEBUG_ASSERT(irq_.msix);
+        DEBUG_ASSERT(irq_.msix->is_valid());
+        cfg_->Write(irq_.msix->ctrl_reg(),
+                PCIE_CAP_MSIX_CTRL_SET_FUNC_MASK(func_mask,
+                PCIE_CAP_MSIX_CTRL_SET_ENB(enb, cfg_->Read(irq_.msix->ctrl_reg()))));
+    }
+
+    volatile uint8_t* MsixEntry(uint irq_id) const {
+        DEBUG_ASSERT(irq_.msix && irq_.msix->table_);
+        return irq_.msix->table_ + (irq_id * PciCapMsix::kEntrySize);
+    }
+
+    void     MaskUnmaskMsixEntry(uint irq_id, bool mask);
+    void     SetMsixEntryTarget(uint irq_id, uint64_t tgt_addr, uint32_t tgt_data);
+    status_t MapMsixTable(uint requested_irqs);
+    void     UnmapMsixTable();
+    void     LeaveMsixIrqMode();
+    status_t EnterMsixIrqMode(uint requested_irqs);
+
     enum handler_return        MsiIrqHandler(pcie_irq_handler_state_t& hstate);
     static enum handler_return MsiIrqHandlerThunk(void *arg);
 
@@ -458,8 +513,7 @@ private:
             mxtl::RefPtr<SharedLegacyIrqHandler> shared_handler;
         } legacy;
 
-        PciCapMsi* msi = nullptr;
-        /* TODO(johngro) : Add MSI-X state */
-        struct { } msi_x;
+        PciCapMsi*  msi  = nullptr;
+        PciCapMsix* msix = nullptr;
     } irq_;
 };
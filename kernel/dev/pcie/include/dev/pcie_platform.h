@@ -146,6 +146,28 @@ public:
         DEBUG_ASSERT(false);
     }
 
+    /**
+     * Method used to steer an MSI-X vector to a particular CPU.  MSI-X vectors
+     * each have their own target address and data, so this computes what the
+     * device should write to deliver vector |msi_id| of |block| to |cpu_num|.
+     *
+     * @param block A pointer to a block of MSIs allocated using AllocMsiBlock.
+     * @param msi_id The ID (indexed from 0) within the block of MSIs.
+     * @param cpu_num The CPU which should take the interrupt.
+     * @param out_tgt_addr The target write transaction physical address.
+     * @param out_tgt_data The data the device should write.
+     *
+     * @return MX_ERR_NOT_SUPPORTED if the platform cannot target individual
+     * CPUs, MX_ERR_INVALID_ARGS if |cpu_num| is not a valid target.
+     */
+    virtual status_t GetMsiTarget(const pcie_msi_block_t* block,
+                                  uint                    msi_id,
+                                  uint                    cpu_num,
+                                  uint64_t*               out_tgt_addr,
+                                  uint32_t*               out_tgt_data) {
+        return MX_ERR_NOT_SUPPORTED;
+    }
+
 protected:
     enum class MsiSupportLevel { NONE, MSI, MSI_WITH_MASKING };
     explicit PciePlatformInterface(MsiSupportLevel msi_support)
@@ -255,6 +255,57 @@ PciCapMsi::PciCapMsi(const PcieDevice& dev, uint16_t base, uint8_t id)
     is_valid_ = true;
 }
 
+/*
+ * @see PCI Local Bus Specification 3.0 Section 6.8.2
+ */
+PciCapMsix::PciCapMsix(const PcieDevice& dev, uint16_t base, uint8_t id)
+    : PciStdCapability(dev, base, id) {
+    DEBUG_ASSERT(id == PCIE_CAP_ID_MSIX);
+    auto cfg = dev.config();
+
+    ctrl_      = PciReg16(static_cast<uint16_t>(base_ + kControlOffset));
+    table_reg_ = PciReg32(static_cast<uint16_t>(base_ + kTableOffset));
+    pba_reg_   = PciReg32(static_cast<uint16_t>(base_ + kPbaOffset));
+
+    memset(&irq_block_, 0, sizeof(irq_block_));
+    uint16_t msix_end = static_cast<uint16_t>(base_ + kSize);
+    uint16_t cfgend = PCIE_BASE_CONFIG_SIZE;
+
+    if (msix_end > cfgend) {
+        TRACEF("Device %02x:%02x.%01x (%04hx:%04hx) has illegally positioned MSI-X "
+               "capability structure.  The structure ends at %u, %u bytes past the "
+               "end of config space\n",
+               dev.bus_id(), dev.dev_id(), dev.func_id(),
+               dev.vendor_id(), dev.device_id(),
+               msix_end, static_cast<unsigned int>(msix_end - cfgend));
+        return;
+    }
+
+    uint16_t ctrl = cfg->Read(ctrl_reg());
+    uint32_t table = cfg->Read(table_reg_);
+    max_irqs_     = PCIE_CAP_MSIX_CTRL_GET_TABLE_SIZE(ctrl);
+    table_bar_    = PCIE_CAP_MSIX_GET_BIR(table);
+    table_offset_ = PCIE_CAP_MSIX_GET_OFFSET(table);
+
+    if (table_bar_ >= PCIE_MAX_BAR_REGS) {
+        TRACEF("Device %02x:%02x.%01x (%04hx:%04hx) has an MSI-X vector table in "
+               "invalid BAR %u\n",
+               dev.bus_id(), dev.dev_id(), dev.func_id(),
+               dev.vendor_id(), dev.device_id(), table_bar_);
+        return;
+    }
+
+    /* Success!
+     *
+     * Make sure that MSI-X is disabled, with the function masked, until a
+     * driver asks for MSI-X mode.
+     */
+    cfg->Write(ctrl_reg(), PCIE_CAP_MSIX_CTRL_SET_FUNC_MASK(1,
+                           PCIE_CAP_MSIX_CTRL_SET_ENB(0, ctrl)));
+
+    is_valid_ = true;
+}
+
 /* Catch quirks and invalid capability offsets we may see */
 inline status_t validate_capability_offset(uint8_t offset) {
     if (offset == 0xFF
@@ -315,6 +366,8 @@ status_t PcieDevice::ParseStdCapabilitiesLocked() {
         switch(id) {
             case PCIE_CAP_ID_MSI:
                 cap = irq_.msi = new (&ac) PciCapMsi(*this, cap_offset, id); break;
+            case PCIE_CAP_ID_MSIX:
+                cap = irq_.msix = new (&ac) PciCapMsix(*this, cap_offset, id); break;
             case PCIE_CAP_ID_PCI_EXPRESS:
                 cap = pcie_ = new (&ac) PciCapPcie(*this, cap_offset, id); break;
             case PCIE_CAP_ID_ADVANCED_FEATURES:
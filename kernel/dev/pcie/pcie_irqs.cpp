@@ -15,8 +15,11 @@
 #include <kernel/mutex.h>
 #include <kernel/spinlock.h>
 #include <kernel/vm.h>
+#include <kernel/vm/vm_aspace.h>
 #include <list.h>
+#include <mxtl/algorithm.h>
 #include <pow2.h>
+#include <reg.h>
 #include <string.h>
 #include <trace.h>
 
@@ -276,7 +279,7 @@ void PcieDevice::LeaveLegacyIrqMode() {
  *
  ******************************************************************************/
 bool PcieDevice::MaskUnmaskMsiIrqLocked(uint irq_id, bool mask) {
-    DEBUG_ASSERT(irq_.mode == PCIE_IRQ_MODE_MSI);
+    DEBUG_ASSERT((irq_.mode == PCIE_IRQ_MODE_MSI) || (irq_.mode == PCIE_IRQ_MODE_MSI_X));
     DEBUG_ASSERT(irq_id < irq_.handler_count);
     DEBUG_ASSERT(irq_.handlers);
 
@@ -287,10 +290,12 @@ bool PcieDevice::MaskUnmaskMsiIrqLocked(uint irq_id, bool mask) {
      * the interrupt, but it is not possible to do so. */
     DEBUG_ASSERT(!mask ||
                  bus_drv_.platform().supports_msi_masking() ||
-                 irq_.msi->has_pvm());
+                 msi_has_pvm());
 
     /* If we can mask at the PCI device level, do so. */
-    if (irq_.msi->has_pvm()) {
+    if (irq_.mode == PCIE_IRQ_MODE_MSI_X) {
+        MaskUnmaskMsixEntry(irq_id, mask);
+    } else if (irq_.msi->has_pvm()) {
         DEBUG_ASSERT(irq_id < PCIE_MAX_MSI_IRQS);
         uint32_t  val  = cfg_->Read(irq_.msi->mask_bits_reg());
         if (mask) val |=  (static_cast<uint32_t>(1u) << irq_id);
@@ -299,10 +304,11 @@ bool PcieDevice::MaskUnmaskMsiIrqLocked(uint irq_id, bool mask) {
     }
 
     /* If we can mask at the platform interrupt controller level, do so. */
-    DEBUG_ASSERT(irq_.msi->irq_block_.allocated);
-    DEBUG_ASSERT(irq_id < irq_.msi->irq_block_.num_irq);
+    const pcie_msi_block_t& block = msi_irq_block();
+    DEBUG_ASSERT(block.allocated);
+    DEBUG_ASSERT(irq_id < block.num_irq);
     if (bus_drv_.platform().supports_msi_masking())
-        bus_drv_.platform().MaskUnmaskMsi(&irq_.msi->irq_block_, irq_id, mask);
+        bus_drv_.platform().MaskUnmaskMsi(&block, irq_id, mask);
 
     bool ret = hstate.masked;
     hstate.masked = mask;
@@ -316,7 +322,7 @@ status_t PcieDevice::MaskUnmaskMsiIrq(uint irq_id, bool mask) {
     /* If a mask is being requested, and we cannot mask at either the platform
      * interrupt controller or the PCI device level, tell the caller that the
      * operation is unsupported. */
-    if (mask && !bus_drv_.platform().supports_msi_masking() && !irq_.msi->has_pvm())
+    if (mask && !bus_drv_.platform().supports_msi_masking() && !msi_has_pvm())
         return MX_ERR_NOT_SUPPORTED;
 
     DEBUG_ASSERT(irq_.handlers);
@@ -364,26 +370,25 @@ void PcieDevice::SetMsiTarget(uint64_t tgt_addr, uint32_t tgt_data) {
     cfg_->Write(irq_.msi->data_reg(), static_cast<uint16_t>(tgt_data & 0xFFFF));
 }
 
-void PcieDevice::FreeMsiBlock() {
+void PcieDevice::FreeMsiBlock(pcie_msi_block_t* block) {
     /* If no block has been allocated, there is nothing to do */
-    if (!irq_.msi->irq_block_.allocated)
+    if (!block->allocated)
         return;
 
     DEBUG_ASSERT(bus_drv_.platform().supports_msi());
 
     /* Mask the IRQ at the platform interrupt controller level if we can, and
      * unregister any registered handler. */
-    const pcie_msi_block_t* b = &irq_.msi->irq_block_;
-    for (uint i = 0; i < b->num_irq; i++) {
+    for (uint i = 0; i < block->num_irq; i++) {
         if (bus_drv_.platform().supports_msi_masking()) {
-            bus_drv_.platform().MaskUnmaskMsi(b, i, true);
+            bus_drv_.platform().MaskUnmaskMsi(block, i, true);
         }
-        bus_drv_.platform().RegisterMsiHandler(b, i, nullptr, nullptr);
+        bus_drv_.platform().RegisterMsiHandler(block, i, nullptr, nullptr);
     }
 
     /* Give the block of IRQs back to the plaform */
-    bus_drv_.platform().FreeMsiBlock(&irq_.msi->irq_block_);
-    DEBUG_ASSERT(!irq_.msi->irq_block_.allocated);
+    bus_drv_.platform().FreeMsiBlock(block);
+    DEBUG_ASSERT(!block->allocated);
 }
 
 void PcieDevice::SetMsiMultiMessageEnb(uint requested_irqs) {
@@ -408,7 +413,7 @@ void PcieDevice::LeaveMsiIrqMode() {
     /* Return any allocated irq_ block to the platform, unregistering with
      * the interrupt controller and synchronizing with the dispatchers in
      * the process. */
-    FreeMsiBlock();
+    FreeMsiBlock(&irq_.msi->irq_block_);
 
     /* Reset our common state, free any allocated handlers */
     ResetCommonIrqBookkeeping();
@@ -494,13 +499,13 @@ bailout:
 }
 
 enum handler_return PcieDevice::MsiIrqHandler(pcie_irq_handler_state_t& hstate) {
-    DEBUG_ASSERT(irq_.msi);
+    DEBUG_ASSERT(irq_.msi || irq_.msix);
     /* No need to save IRQ state; we are in an IRQ handler at the moment. */
     AutoSpinLock handler_lock(hstate.lock);
 
     /* Mask our IRQ if we can. */
     bool was_masked;
-    if (bus_drv_.platform().supports_msi_masking() || irq_.msi->has_pvm()) {
+    if (bus_drv_.platform().supports_msi_masking() || msi_has_pvm()) {
         was_masked = MaskUnmaskMsiIrqLocked(hstate.pci_irq_id, true);
     } else {
         DEBUG_ASSERT(!hstate.masked);
@@ -530,6 +535,169 @@ enum handler_return PcieDevice::MsiIrqHandlerThunk(void *arg) {
     return hstate.dev->MsiIrqHandler(hstate);
 }
 
+/******************************************************************************
+ *
+ * MSI-X IRQ mode routines.
+ *
+ ******************************************************************************/
+void PcieDevice::MaskUnmaskMsixEntry(uint irq_id, bool mask) {
+    volatile uint8_t* entry = MsixEntry(irq_id);
+    uint32_t ctrl = readl(entry + PciCapMsix::kEntryVectorCtrlOffset);
+    if (mask) ctrl |=  PciCapMsix::kEntryVectorCtrlMasked;
+    else      ctrl &= ~PciCapMsix::kEntryVectorCtrlMasked;
+    writel(ctrl, entry + PciCapMsix::kEntryVectorCtrlOffset);
+}
+
+void PcieDevice::SetMsixEntryTarget(uint irq_id, uint64_t tgt_addr, uint32_t tgt_data) {
+    /* The spec leaves what happens undefined if an entry changes while it is
+     * unmasked, so callers must mask it first. */
+    volatile uint8_t* entry = MsixEntry(irq_id);
+    DEBUG_ASSERT(readl(entry + PciCapMsix::kEntryVectorCtrlOffset) &
+                 PciCapMsix::kEntryVectorCtrlMasked);
+    writel(static_cast<uint32_t>(tgt_addr & 0xFFFFFFFF), entry + PciCapMsix::kEntryAddrOffset);
+    writel(static_cast<uint32_t>(tgt_addr >> 32), entry + PciCapMsix::kEntryAddrUpperOffset);
+    writel(tgt_data, entry + PciCapMsix::kEntryDataOffset);
+}
+
+status_t PcieDevice::MapMsixTable(uint requested_irqs) {
+    DEBUG_ASSERT(irq_.msix);
+    DEBUG_ASSERT(!irq_.msix->table_mapping_);
+
+    /* The vector table lives in one of our MMIO BARs, which must have been
+     * allocated by now. */
+    const pcie_bar_info_t* bar = GetBarInfo(irq_.msix->table_bar());
+    uint64_t table_size = static_cast<uint64_t>(requested_irqs) * PciCapMsix::kEntrySize;
+    if (!bar || !bar->is_mmio || ((irq_.msix->table_offset() + table_size) > bar->size)) {
+        TRACEF("MSI-X vector table of device %02x:%02x.%01x (BAR %u offset %#x) "
+               "is not in an allocated MMIO BAR\n",
+               bus_id_, dev_id_, func_id_,
+               irq_.msix->table_bar(), irq_.msix->table_offset());
+        return MX_ERR_BAD_STATE;
+    }
+
+    paddr_t table_phys = bar->bus_addr + irq_.msix->table_offset();
+    paddr_t map_base   = ROUNDDOWN(table_phys, PAGE_SIZE);
+    size_t  map_size   = ROUNDUP(table_phys + table_size, PAGE_SIZE) - map_base;
+
+    char name_buf[32];
+    snprintf(name_buf, sizeof(name_buf), "pcie_msix_%02x_%02x_%01x", bus_id_, dev_id_, func_id_);
+
+    status_t res = VmAspace::kernel_aspace()->AllocPhysical(
+            name_buf,
+            map_size,
+            &irq_.msix->table_mapping_,
+            PAGE_SIZE_SHIFT,
+            map_base,
+            0 /* vmm flags */,
+            ARCH_MMU_FLAG_UNCACHED_DEVICE |
+            ARCH_MMU_FLAG_PERM_READ |
+            ARCH_MMU_FLAG_PERM_WRITE);
+    if (res != MX_OK) {
+        irq_.msix->table_mapping_ = nullptr;
+        return res;
+    }
+
+    irq_.msix->table_ = static_cast<volatile uint8_t*>(irq_.msix->table_mapping_) +
+                        (table_phys - map_base);
+    return MX_OK;
+}
+
+void PcieDevice::UnmapMsixTable() {
+    if (!irq_.msix->table_mapping_)
+        return;
+
+    VmAspace::kernel_aspace()->FreeRegion(reinterpret_cast<vaddr_t>(irq_.msix->table_mapping_));
+    irq_.msix->table_mapping_ = nullptr;
+    irq_.msix->table_ = nullptr;
+}
+
+void PcieDevice::LeaveMsixIrqMode() {
+    /* Mask each vector, synchronizing with its dispatcher, then mask the
+     * function as a whole and turn MSI-X off. */
+    for (uint i = 0; i < irq_.handler_count; i++)
+        MaskUnmaskMsiIrq(i, true);
+    SetMsixCtrl(false, true);
+
+    /* Return any allocated irq_ block to the platform, and unmap the table */
+    FreeMsiBlock(&irq_.msix->irq_block_);
+    UnmapMsixTable();
+
+    /* Reset our common state, free any allocated handlers */
+    ResetCommonIrqBookkeeping();
+}
+
+status_t PcieDevice::EnterMsixIrqMode(uint requested_irqs) {
+    DEBUG_ASSERT(requested_irqs);
+
+    status_t res = MX_OK;
+
+    // We cannot go into MSI-X mode if we don't support MSI-X at all, or we
+    // don't support the number of IRQs requested
+    if (!irq_.msix                            ||
+        !irq_.msix->is_valid()                ||
+        !bus_drv_.platform().supports_msi()   ||
+        (requested_irqs > irq_.msix->max_irqs()))
+        return MX_ERR_NOT_SUPPORTED;
+
+    // Map the vector table, and make sure that the BAR holding it is decoded.
+    res = MapMsixTable(requested_irqs);
+    if (res != MX_OK)
+        return res;
+    ModifyCmdLocked(0, PCI_COMMAND_MEM_EN);
+
+    // Turn MSI-X on with the function masked.  Some devices only let the
+    // table be written once MSI-X is enabled, and nothing is delivered until
+    // the function is unmasked below.
+    SetMsixCtrl(true, true);
+
+    /* Ask the platform for a chunk of MSI-X compatible IRQs */
+    DEBUG_ASSERT(!irq_.msix->irq_block_.allocated);
+    res = bus_drv_.platform().AllocMsiBlock(requested_irqs,
+                                            true,  /* can_target_64bit */
+                                            true,  /* is_msix == true */
+                                            &irq_.msix->irq_block_);
+    if (res != MX_OK) {
+        LTRACEF("Failed to allocate a block of %u MSI-X IRQs for device "
+                "%02x:%02x.%01x (res %d)\n",
+                requested_irqs, bus_id_, dev_id_, func_id_, res);
+        goto bailout;
+    }
+
+    /* Allocate our handler table.  Every vector starts out masked. */
+    res = AllocIrqHandlers(requested_irqs, true);
+    if (res != MX_OK)
+        goto bailout;
+
+    /* Record our new IRQ mode */
+    irq_.mode = PCIE_IRQ_MODE_MSI_X;
+
+    /* Point each vector at the block's default target and register it with
+     * the dispatcher.  Drivers can steer vectors to other CPUs later on with
+     * SetIrqAffinity. */
+    {
+        const pcie_msi_block_t& block = irq_.msix->irq_block_;
+        DEBUG_ASSERT(irq_.handler_count <= block.num_irq);
+        for (uint i = 0; i < irq_.handler_count; ++i) {
+            MaskUnmaskMsixEntry(i, true);
+            SetMsixEntryTarget(i, block.tgt_addr, block.tgt_data + i);
+            bus_drv_.platform().RegisterMsiHandler(&block,
+                                                   i,
+                                                   PcieDevice::MsiIrqHandlerThunk,
+                                                   irq_.handlers + i);
+        }
+    }
+
+    /* Unmask the function.  The vectors stay masked until they are unmasked
+     * through MaskUnmaskIrq. */
+    SetMsixCtrl(true, false);
+
+bailout:
+    if (res != MX_OK)
+        LeaveMsixIrqMode();
+
+    return res;
+}
+
 /******************************************************************************
  *
  * Internal implementation of the Kernel facing API.
@@ -583,8 +751,15 @@ status_t PcieDevice::QueryIrqModeCapabilitiesLocked(pcie_irq_mode_t mode,
         if (!bus_drv_.platform().supports_msi())
             return MX_ERR_NOT_SUPPORTED;
 
-        /* TODO(johngro) : finish MSI-X implementation. */
-        return MX_ERR_NOT_SUPPORTED;
+        if (!irq_.msix || !irq_.msix->is_valid())
+            return MX_ERR_NOT_SUPPORTED;
+
+        /* MSI-X vectors can always be masked at the device.  The platform
+         * hands out at most PCIE_MAX_MSI_IRQS vectors in a block, however
+         * large the device's table is. */
+        out_caps->max_irqs = mxtl::min(irq_.msix->max_irqs(), PCIE_MAX_MSI_IRQS);
+        out_caps->per_vector_masking_supported = true;
+        break;
 
     default:
         return MX_ERR_INVALID_ARGS;
@@ -640,10 +815,15 @@ status_t PcieDevice::SetIrqModeLocked(pcie_irq_mode_t mode, uint requested_irqs)
             DEBUG_ASSERT(!irq_.registered_handler_count);
             return MX_OK;
 
-        /* Right now, there should be no way to get into MSI-X mode */
         case PCIE_IRQ_MODE_MSI_X:
-            DEBUG_ASSERT(false);
-            return MX_ERR_NOT_SUPPORTED;
+            DEBUG_ASSERT(irq_.msix);
+            DEBUG_ASSERT(irq_.msix->is_valid());
+            DEBUG_ASSERT(irq_.msix->irq_block_.allocated);
+
+            LeaveMsixIrqMode();
+
+            DEBUG_ASSERT(!irq_.registered_handler_count);
+            return MX_OK;
 
         default:
             /* mode is not one of the valid enum values, this should be impossible */
@@ -664,7 +844,7 @@ status_t PcieDevice::SetIrqModeLocked(pcie_irq_mode_t mode, uint requested_irqs)
     switch (mode) {
     case PCIE_IRQ_MODE_LEGACY: return EnterLegacyIrqMode(requested_irqs);
     case PCIE_IRQ_MODE_MSI:    return EnterMsiIrqMode   (requested_irqs);
-    case PCIE_IRQ_MODE_MSI_X:  return MX_ERR_NOT_SUPPORTED;
+    case PCIE_IRQ_MODE_MSI_X:  return EnterMsixIrqMode  (requested_irqs);
     default:                   return MX_ERR_INVALID_ARGS;
     }
 }
@@ -735,7 +915,7 @@ status_t PcieDevice::MaskUnmaskIrqLocked(uint irq_id, bool mask) {
     switch (irq_.mode) {
     case PCIE_IRQ_MODE_LEGACY: return MaskUnmaskLegacyIrq(mask);
     case PCIE_IRQ_MODE_MSI:    return MaskUnmaskMsiIrq(irq_id, mask);
-    case PCIE_IRQ_MODE_MSI_X:  return MX_ERR_NOT_SUPPORTED;
+    case PCIE_IRQ_MODE_MSI_X:  return MaskUnmaskMsiIrq(irq_id, mask);
     default:
         DEBUG_ASSERT(false); /* This should be un-possible! */
         return MX_ERR_INTERNAL;
@@ -744,6 +924,45 @@ status_t PcieDevice::MaskUnmaskIrqLocked(uint irq_id, bool mask) {
     return MX_OK;
 }
 
+status_t PcieDevice::SetIrqAffinityLocked(uint irq_id, uint cpu_num) {
+    DEBUG_ASSERT(plugged_in_);
+    DEBUG_ASSERT(dev_lock_.IsHeld());
+
+    /* Cannot steer IRQs while in the DISABLED state */
+    if (irq_.mode == PCIE_IRQ_MODE_DISABLED)
+        return MX_ERR_BAD_STATE;
+
+    /* Make sure that the IRQ ID is within range */
+    if (irq_id >= irq_.handler_count)
+        return MX_ERR_INVALID_ARGS;
+
+    /* Legacy IRQs are shared, and MSI vectors all share one target address,
+     * so only MSI-X vectors can be steered one at a time. */
+    if (irq_.mode != PCIE_IRQ_MODE_MSI_X)
+        return MX_ERR_NOT_SUPPORTED;
+
+    uint64_t tgt_addr;
+    uint32_t tgt_data;
+    status_t res = bus_drv_.platform().GetMsiTarget(&irq_.msix->irq_block_, irq_id, cpu_num,
+                                                    &tgt_addr, &tgt_data);
+    if (res != MX_OK)
+        return res;
+
+    /* The entry has to be masked while its target changes.  Hold the handler
+     * lock so that dispatch cannot unmask it in the meantime, then put back
+     * the mask state it had. */
+    pcie_irq_handler_state_t& hstate = irq_.handlers[irq_id];
+    {
+        AutoSpinLockIrqSave handler_lock(hstate.lock);
+        MaskUnmaskMsixEntry(irq_id, true);
+        SetMsixEntryTarget(irq_id, tgt_addr, tgt_data);
+        if (!hstate.masked)
+            MaskUnmaskMsixEntry(irq_id, false);
+    }
+
+    return MX_OK;
+}
+
 /******************************************************************************
  *
  * Kernel API; prototypes in dev/pcie_irqs.h
@@ -796,6 +1015,14 @@ status_t PcieDevice::MaskUnmaskIrq(uint irq_id, bool mask) {
         : MX_ERR_BAD_STATE;
 }
 
+status_t PcieDevice::SetIrqAffinity(uint irq_id, uint cpu_num) {
+    AutoLock dev_lock(&dev_lock_);
+
+    return (plugged_in_ && !disabled_)
+        ? SetIrqAffinityLocked(irq_id, cpu_num)
+        : MX_ERR_BAD_STATE;
+}
+
 
 // Map from a device's interrupt pin ID to the proper system IRQ ID.  Follow the
 // PCIe graph up to the root, swizzling as we traverse PCIe switches,
@@ -36,29 +36,37 @@ status_t arch_guest_create(mxtl::RefPtr<VmObject> phys_mem,
                            mxtl::RefPtr<FifoDispatcher> ctl_fifo,
                            mxtl::unique_ptr<GuestContext>* context);
 
-/* Enter a guest context.
+/* Create a VCPU within a guest context.
+ * The first VCPU is created along with the guest context, and is VCPU 0.
  */
-status_t arch_guest_enter(const mxtl::unique_ptr<GuestContext>& context);
+status_t arch_guest_create_vcpu(const mxtl::unique_ptr<GuestContext>& context,
+                                mxtl::RefPtr<FifoDispatcher> ctl_fifo, uint32_t* vcpu);
 
-/* Create a guest context.
+/* Enter a VCPU of a guest context.
+ */
+status_t arch_guest_enter(const mxtl::unique_ptr<GuestContext>& context, uint32_t vcpu);
+
+/* Trap accesses to guest physical memory of a guest context.
  */
 status_t arch_guest_mem_trap(const mxtl::unique_ptr<GuestContext>& context, vaddr_t guest_paddr,
                              size_t size);
 
-/* Interrupt a guest context.
+/* Interrupt a VCPU of a guest context.
  */
-status_t arch_guest_interrupt(const mxtl::unique_ptr<GuestContext>& context, uint8_t interrupt);
+status_t arch_guest_interrupt(const mxtl::unique_ptr<GuestContext>& context, uint32_t vcpu,
+                              uint8_t interrupt);
 
-/* Set general purpose registers of a guest context.
+/* Set general purpose registers of a VCPU of a guest context.
  */
-status_t arch_guest_set_gpr(const mxtl::unique_ptr<GuestContext>& context,
+status_t arch_guest_set_gpr(const mxtl::unique_ptr<GuestContext>& context, uint32_t vcpu,
                             const mx_guest_gpr_t& guest_gpr);
 
-/* Get general purpose registers of a guest context.
+/* Get general purpose registers of a VCPU of a guest context.
  */
-status_t arch_guest_get_gpr(const mxtl::unique_ptr<GuestContext>& context,
+status_t arch_guest_get_gpr(const mxtl::unique_ptr<GuestContext>& context, uint32_t vcpu,
                             mx_guest_gpr_t* guest_gpr);
 
-/* Set the instruction pointer of a guest context.
+/* Set the instruction pointer of a VCPU of a guest context.
  */
-status_t arch_guest_set_ip(const mxtl::unique_ptr<GuestContext>& context, uintptr_t guest_ip);
+status_t arch_guest_set_ip(const mxtl::unique_ptr<GuestContext>& context, uint32_t vcpu,
+                           uintptr_t guest_ip);
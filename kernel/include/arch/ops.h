@@ -56,6 +56,15 @@ void arch_flush_state_and_halt(event_t *flush_done) __NO_RETURN;
 
 void arch_idle(void);
 
+/* can this cpu wait in arch_idle_poll() for about expected_idle, the time until
+ * its next timer, instead of halting in arch_idle() */
+bool arch_idle_can_poll(lk_time_t expected_idle);
+
+/* wait in a low power state until another cpu writes *wake, or an interrupt
+ * arrives, choosing how deep to go by how long the cpu is expected to be idle.
+ * may also return for no reason at all */
+void arch_idle_poll(volatile uint32_t *wake, lk_time_t expected_idle);
+
 /* function to call in spinloops to idle */
 static void arch_spinloop_pause(void);
 /* function to call when an event happens that may trigger the exit from
@@ -0,0 +1,49 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <magenta/compiler.h>
+#include <arch/spinlock.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+__BEGIN_CDECLS
+
+/* Lock contention statistics, built in with ENABLE_LOCK_STATS=true.
+ *
+ * Locks are counted by class, a class being the place in the code the lock is
+ * acquired from. Every mutex taken by one function or one AutoLock counts
+ * together, however many instances of the lock there are. Contended
+ * acquisitions are also written out as ktrace records in KTRACE_GRP_LOCKS.
+ */
+
+#define LOCKSTAT_KIND_SPIN_LOCK (0u)
+#define LOCKSTAT_KIND_MUTEX     (1u)
+
+struct lockstat_class;
+
+#if WITH_LOCK_STATS
+
+/* find or make the class for the code at site acquiring lock */
+struct lockstat_class *lockstat_class_for(uintptr_t site, const void *lock, uint kind);
+
+/* account for one acquisition, wait being how long it took to get the lock */
+void lockstat_record_acquire(struct lockstat_class *c, const void *lock, lk_time_t wait,
+                             bool contended);
+
+/* account for how long a lock acquired through the class was held */
+void lockstat_record_release(struct lockstat_class *c, lk_time_t hold);
+
+/* instrumented versions of the arch spin lock routines, counting against
+ * their caller. interrupts must be disabled */
+void lockstat_spin_lock(spin_lock_t *lock);
+int lockstat_spin_trylock(spin_lock_t *lock);
+void lockstat_spin_unlock(spin_lock_t *lock);
+
+#endif
+
+__END_CDECLS
@@ -47,6 +47,15 @@ void mp_set_curr_cpu_active(bool active);
 status_t mp_hotplug_cpu(uint cpu_id);
 status_t mp_unplug_cpu(uint cpu_id);
 
+/* describe where a cpu sits in the system, called by platform code as cpus
+ * are discovered. cpus with the same package and core id are hyperthreads of
+ * one core, and cpus with the same package and cache id share a last level
+ * cache. may be called before mp_init() */
+void mp_set_cpu_topology(uint cpu, uint package_id, uint cache_id, uint core_id);
+
+/* run by the idle thread to wait for something to do */
+void mp_idle(void);
+
 /* called from arch code during reschedule irq */
 enum handler_return mp_mbx_reschedule_irq(void);
 /* called from arch code during generic task irq */
@@ -71,6 +80,13 @@ struct mp_state {
     mp_cpu_mask_t idle_cpus;
     mp_cpu_mask_t realtime_cpus;
 
+    /* cpus that have been asked to reschedule and have not done so yet */
+    volatile mp_cpu_mask_t reschedule_in_flight;
+
+    /* idle cpus that are woken by writing their idle_wake word rather than by
+     * an ipi */
+    volatile mp_cpu_mask_t polling_cpus;
+
     spin_lock_t ipi_task_lock;
     /* list of outstanding tasks for CPUs to execute.  Should only be
      * accessed with the ipi_task_lock held */
@@ -78,6 +94,11 @@ struct mp_state {
 
     /* lock for serializing CPU hotplug/unplug operations */
     mutex_t hotplug_lock;
+
+    /* for each cpu, the cpus it shares a core and a last level cache with,
+     * including itself. zero if the platform never described the cpu */
+    mp_cpu_mask_t smt_siblings[SMP_MAX_CPUS];
+    mp_cpu_mask_t cache_siblings[SMP_MAX_CPUS];
 };
 
 extern struct mp_state mp;
@@ -106,6 +127,16 @@ static inline void mp_set_cpu_idle(uint cpu)
 static inline void mp_set_cpu_busy(uint cpu)
 {
     mp.idle_cpus &= ~(1U << cpu);
+
+    /* the idle thread may have been switched out in the middle of polling */
+    atomic_and((int *)&mp.polling_cpus, ~(1U << cpu));
+}
+
+/* called by the scheduler with the thread lock held before it picks what to
+ * run next, which catches up on any reschedule the cpu was asked for */
+static inline void mp_reschedule_begin(uint cpu)
+{
+    atomic_and((int *)&mp.reschedule_in_flight, ~(1U << cpu));
 }
 
 static inline mp_cpu_mask_t mp_get_idle_mask(void)
@@ -138,4 +169,20 @@ static inline mp_cpu_mask_t mp_get_realtime_mask(void)
     return mp.realtime_cpus;
 }
 
+/* cpus sharing a core with the given cpu, without any topology information
+ * every cpu is its own core */
+static inline mp_cpu_mask_t mp_get_smt_siblings(uint cpu)
+{
+    mp_cpu_mask_t mask = mp.smt_siblings[cpu];
+    return mask ? mask : (1U << cpu);
+}
+
+/* cpus sharing a last level cache with the given cpu, without any topology
+ * information all cpus are assumed to */
+static inline mp_cpu_mask_t mp_get_cache_siblings(uint cpu)
+{
+    mp_cpu_mask_t mask = mp.cache_siblings[cpu];
+    return mask ? mask : MP_CPU_ALL_BUT_LOCAL;
+}
+
 __END_CDECLS;
@@ -25,11 +25,22 @@ __BEGIN_CDECLS
  * The val field holds either 0 or a pointer to the thread_t holding the mutex.
  * If one or more threads are blocking and queued up, MUTEX_FLAG_QUEUED is ORed in as well.
  * NOTE: MUTEX_FLAG_QUEUED is only manipulated under the THREAD_LOCK.
+ * The owner_cpu field is the cpu the holder was on when it took the mutex. It is
+ * only a hint for waiters deciding whether to spin and may be stale.
+ * The holder owns the wait queue, so it runs at the priority of its highest
+ * priority waiter until it releases the mutex.
+ * With lock stats built in, the holder also keeps the class it acquired the
+ * mutex through and when, see kernel/lockstat.h.
  */
 typedef struct TA_CAP("mutex") mutex {
     uint32_t magic;
+    volatile uint32_t owner_cpu;
     uintptr_t val;
-    wait_queue_t wait;
+    owned_wait_queue_t wait;
+#if WITH_LOCK_STATS
+    struct lockstat_class *stats_class;
+    lk_time_t stats_acquired;
+#endif
 } mutex_t;
 
 #define MUTEX_FLAG_QUEUED ((uintptr_t)1)
@@ -48,8 +59,9 @@ static inline thread_t *mutex_holder(const mutex_t *m) {
 #define MUTEX_INITIAL_VALUE(m) \
 { \
     .magic = MUTEX_MAGIC, \
+    .owner_cpu = 0, \
     .val = 0, \
-    .wait = WAIT_QUEUE_INITIAL_VALUE((m).wait), \
+    .wait = OWNED_WAIT_QUEUE_INITIAL_VALUE((m).wait), \
 }
 
 /* Rules for Mutexes:
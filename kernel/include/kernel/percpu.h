@@ -17,16 +17,62 @@ __BEGIN_CDECLS
 
 struct percpu {
     /* per cpu timer queue */
-    struct list_node timer_queue;
+    struct timer_wheel timer_wheel;
 
-    /* per cpu preemption timer */
+    /* per cpu preemption timer, and whether it is armed for the end of the
+     * running thread's quantum. protected by thread_lock */
     timer_t preempt_timer;
+    bool preempt_armed;
 
     /* thread/cpu level statistics */
     struct cpu_stats stats;
 
     /* per cpu idle thread */
     thread_t idle_thread;
+
+    /* thread running on this cpu, written with thread_lock held but read
+     * without it by spinning mutex waiters */
+    thread_t * volatile curr_thread;
+
+    /* cpus to send a reschedule ipi to once this cpu drops the thread lock */
+    uint32_t reschedule_deferred;
+
+    /* written by other cpus to wake this one while it polls in idle, on a
+     * line of its own so that nothing else wakes it */
+    volatile uint32_t idle_wake __CPU_ALIGN;
+
+    /* per cpu run queue and bitmap of which priority levels have threads in it,
+     * protected by thread_lock */
+    struct list_node run_queue[NUM_PRIORITIES];
+    uint32_t run_queue_bitmap;
+
+    /* number of threads in the run queue */
+    uint run_queue_len;
+
+    /* a thread in the run queue woken synchronously by handoff_from, which
+     * it takes over from if handoff_from blocks next. protected by thread_lock */
+    thread_t *handoff_to;
+    thread_t *handoff_from;
+
+    /* earliest time this cpu will next try to pull work from a busier cpu */
+    lk_time_t next_balance;
+
+    /* deadline threads admitted on this cpu that are ready to run, earliest
+     * deadline first, and the ones that used up their budget and are waiting
+     * for their next period. protected by thread_lock */
+    struct list_node deadline_queue;
+    struct list_node deadline_throttled;
+
+    /* sum of the densities of the deadline threads admitted on this cpu */
+    uint32_t deadline_density;
+
+    /* fires when the running deadline thread runs out of budget */
+    timer_t deadline_budget_timer;
+    bool deadline_budget_timer_armed;
+
+    /* fires when the next throttled deadline thread gets its budget back */
+    timer_t deadline_replenish_timer;
+    lk_time_t deadline_replenish_time;
 } __CPU_MAX_ALIGN;
 
 /* the kernel per-cpu structure */
@@ -0,0 +1,168 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <arch/ops.h>
+#include <kernel/auto_lock.h>
+#include <kernel/spinlock.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Per-cpu caches of free blocks of memory in front of a shared allocator.
+//
+// Each cpu keeps a stack of up to kCapacity free blocks under a lock of its
+// own, so most allocations and frees touch nothing another cpu is using. A cpu
+// that runs dry or fills up moves half a stack's worth of blocks from or to
+// the shared allocator in one call, keeping the most recently freed, and so
+// most likely cache hot, blocks for itself. Moving cpus part way through only
+// means using another cpu's stack, which is locked all the same.
+//
+// |Source| is the shared allocator, and is called with none of the cache's
+// locks held:
+//
+//     // Fills |blocks| with up to |count| free blocks, returning how many.
+//     size_t Get(void** blocks, size_t count);
+//
+//     // Takes back |count| blocks.
+//     void Put(void* const* blocks, size_t count);
+template <size_t kCapacity, typename Source>
+class PerCpuCache {
+public:
+    static_assert(kCapacity >= 2, "");
+    static constexpr size_t kBatch = kCapacity / 2;
+
+    // Summed over all cpus. |outstanding| is the blocks handed out by Alloc()
+    // and Steal() less those given back to Free().
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t frees;
+        size_t cached;
+        int64_t outstanding;
+    };
+
+    explicit PerCpuCache(Source* source) : source_(source) {}
+
+    // Returns a free block, or nullptr if neither this cpu nor the source has
+    // one.
+    void* Alloc() {
+        CpuCache& cpu = LocalCpu();
+        {
+            AutoSpinLockIrqSave guard(cpu.lock);
+            if (cpu.count > 0) {
+                cpu.hits++;
+                cpu.outstanding++;
+                return cpu.blocks[--cpu.count];
+            }
+            cpu.misses++;
+        }
+        return Refill();
+    }
+
+    void Free(void* block) {
+        CpuCache& cpu = LocalCpu();
+        void* batch[kBatch];
+        {
+            AutoSpinLockIrqSave guard(cpu.lock);
+            cpu.frees++;
+            cpu.outstanding--;
+            if (cpu.count < kCapacity) {
+                cpu.blocks[cpu.count++] = block;
+                return;
+            }
+
+            // Full; pass the coldest half on to the source.
+            memcpy(batch, cpu.blocks, sizeof(batch));
+            memmove(cpu.blocks, cpu.blocks + kBatch, (kCapacity - kBatch) * sizeof(cpu.blocks[0]));
+            cpu.count -= kBatch;
+            cpu.blocks[cpu.count++] = block;
+        }
+        source_->Put(batch, kBatch);
+    }
+
+    // Takes a free block from whichever cpu has one, for when the source has
+    // run dry.
+    void* Steal() {
+        for (auto& cpu : cpus_) {
+            AutoSpinLockIrqSave guard(cpu.lock);
+            if (cpu.count > 0) {
+                cpu.outstanding++;
+                return cpu.blocks[--cpu.count];
+            }
+        }
+        return nullptr;
+    }
+
+    // Gives every block the cpus hold back to the source.
+    void Drain() {
+        for (auto& cpu : cpus_) {
+            void* blocks[kCapacity];
+            size_t n;
+            {
+                AutoSpinLockIrqSave guard(cpu.lock);
+                n = cpu.count;
+                memcpy(blocks, cpu.blocks, n * sizeof(blocks[0]));
+                cpu.count = 0;
+            }
+            if (n > 0)
+                source_->Put(blocks, n);
+        }
+    }
+
+    void GetStats(Stats* stats) {
+        *stats = {};
+        for (auto& cpu : cpus_) {
+            AutoSpinLockIrqSave guard(cpu.lock);
+            stats->hits += cpu.hits;
+            stats->misses += cpu.misses;
+            stats->frees += cpu.frees;
+            stats->cached += cpu.count;
+            stats->outstanding += cpu.outstanding;
+        }
+    }
+
+private:
+    struct CpuCache {
+        SpinLock lock;
+
+        // Guarded by |lock|.
+        size_t count = 0;
+        void* blocks[kCapacity];
+        int64_t outstanding = 0;
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t frees = 0;
+    } __CPU_ALIGN;
+
+    CpuCache& LocalCpu() { return cpus_[arch_curr_cpu_num()]; }
+
+    // Takes a batch from the source for a cpu with none left, keeping the
+    // first block for the allocation that found it empty.
+    void* Refill() {
+        void* batch[kBatch];
+        size_t n = source_->Get(batch, kBatch);
+        if (n == 0)
+            return nullptr;
+
+        // We may have moved cpus, or another thread may have refilled this
+        // one first. Whatever doesn't fit goes back.
+        CpuCache& cpu = LocalCpu();
+        {
+            AutoSpinLockIrqSave guard(cpu.lock);
+            cpu.outstanding++;
+            while (n > 1 && cpu.count < kCapacity)
+                cpu.blocks[cpu.count++] = batch[--n];
+        }
+        if (n > 1)
+            source_->Put(batch + 1, n - 1);
+        return batch[0];
+    }
+
+    Source* const source_;
+    CpuCache cpus_[SMP_MAX_CPUS];
+};
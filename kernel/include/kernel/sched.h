@@ -25,3 +25,18 @@ void sched_reschedule(void);
 void _thread_resched_internal(void);
 
 thread_t *sched_get_top_thread(uint cpu);
+
+/* send a thread queued here by a sync wakeup of the current thread, which
+ * hasn't blocked after all, to wherever it would have gone otherwise */
+void sched_sync_wakeup_cancel(void);
+
+/* change a thread's deadline parameters, see thread_set_deadline() */
+status_t sched_set_deadline(thread_t *t, lk_time_t runtime, lk_time_t relative_deadline,
+                            lk_time_t period);
+
+/* recompute the priority a thread inherits from the threads waiting on the
+ * owned wait queues it owns */
+void sched_update_inherited_priority(thread_t *t);
+
+/* move the threads waiting on a cpu's run queue elsewhere before it goes offline */
+void sched_transition_off_cpu(uint old_cpu);
@@ -18,17 +18,28 @@ struct cpu_stats {
     ulong irq_preempts;
     ulong preempts;
     ulong yields;
+    ulong steals; /* threads taken from another cpu's run queue while idle */
+    ulong balances; /* threads pulled from a busier cpu's run queue */
+    ulong handoffs; /* threads run directly in place of the thread that woke them */
+    ulong migrations; /* threads switched in on a cpu other than the one they last ran on */
+
+    /* contended mutex acquisitions */
+    ulong mutex_spins; /* mutexes acquired by spinning on a running holder */
+    ulong mutex_blocks; /* mutexes that had to be waited for in their wait queue */
+    lk_time_t mutex_spin_time; /* time spent spinning, whether it paid off or not */
 
     /* cpu level interrupts and exceptions */
     ulong interrupts; /* hardware interrupts, minus timer interrupts or inter-processor interrupts */
     ulong timer_ints; /* timer interrupts */
     ulong timers; /* timer callbacks */
     ulong page_faults; /* page faults */
+    ulong fault_around_pages; /* pages mapped ahead of a fault, each one a fault avoided */
     ulong exceptions; /* exceptions such as undefined opcode */
     ulong syscalls;
 
     /* inter-processor interrupts */
     ulong reschedule_ipis;
+    ulong reschedule_polls; /* reschedules asked for by writing the idle wake word instead */
     ulong generic_ipis;
 };
 
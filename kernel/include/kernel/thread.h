@@ -56,6 +56,7 @@ typedef void (*thread_user_callback_t)(enum thread_user_state_change new_state,
 #define THREAD_FLAG_REAL_TIME                 (1<<3)
 #define THREAD_FLAG_IDLE                      (1<<4)
 #define THREAD_FLAG_DEBUG_STACK_BOUNDS_CHECK  (1<<5)
+#define THREAD_FLAG_DEADLINE                  (1<<6)
 
 #define THREAD_SIGNAL_KILL                    (1<<0)
 #define THREAD_SIGNAL_SUSPEND                 (1<<1)
@@ -83,9 +84,31 @@ typedef struct thread {
 
     int base_priority;
     int priority_boost;
+    int inherited_priority; /* from threads blocked on what we own, or -1 */
+
+    /* owned wait queues this thread is the owner of */
+    struct list_node owned_wait_queues;
 
     uint last_cpu; /* last/current cpu the thread is running on */
     int pinned_cpu; /* only run on pinned_cpu if >= 0 */
+    uint run_queue_cpu; /* cpu whose run queue holds the thread while it is ready */
+    bool sync_wakeup; /* threads it wakes are handed its cpu, see thread_sync_wakeup_begin() */
+    bool batch_wakeup; /* reschedule ipis are held back, see thread_batch_wakeup_begin() */
+    uint32_t reschedule_deferred; /* cpus owed a reschedule ipi while batch_wakeup is set */
+
+    /* deadline scheduling state, only valid if THREAD_FLAG_DEADLINE is set */
+    struct {
+        lk_time_t runtime; /* cpu time guaranteed each period */
+        lk_time_t relative_deadline; /* ... within this long of the period starting */
+        lk_time_t period;
+
+        lk_time_t absolute_deadline; /* deadline of the current period */
+        lk_time_t budget; /* runtime left in the current period */
+        lk_time_t charged_until; /* time up to which the budget has been charged */
+
+        uint cpu; /* cpu the thread was admitted on, it only runs there */
+        uint32_t density; /* runtime / relative_deadline, in parts per million */
+    } deadline;
 
     /* pointer to the kernel address space this thread is associated with */
     vmm_aspace_t *aspace;
@@ -189,12 +212,35 @@ status_t thread_join(thread_t *t, int *retcode, lk_time_t deadline);
 status_t thread_detach_and_resume(thread_t *t);
 status_t thread_set_real_time(thread_t *t);
 
+/* guarantee the thread runtime ns of cpu time within relative_deadline ns of
+ * the start of every period ns, scheduled earliest deadline first ahead of
+ * all priority based threads. fails with MX_ERR_NO_RESOURCES if no cpu has
+ * room for it. a runtime of 0 returns the thread to priority scheduling */
+status_t thread_set_deadline(thread_t *t, lk_time_t runtime, lk_time_t relative_deadline,
+                             lk_time_t period);
+
 /* scheduler routines to be used by regular kernel code */
 void thread_yield(void);      /* give up the cpu and time slice voluntarily */
 void thread_preempt(void);    /* get preempted at irq time */
 void thread_reschedule(void); /* revaluate the run queue on the current cpu,
                                  can be used after waking up threads */
 
+/* until the matching end, a thread woken by the current thread is one it is
+ * about to wait on, as in a channel call. the woken thread is queued on this
+ * cpu rather than sent to another one, and runs as soon as the current thread
+ * blocks, on what is left of its time slice. the end should come after the
+ * wait: if the current thread gets there without having blocked, the woken
+ * thread is sent off to another cpu like any other wakeup */
+void thread_sync_wakeup_begin(void);
+void thread_sync_wakeup_end(void);
+
+/* until the matching end, the reschedule ipis for threads woken by the
+ * current thread are held back, and the end sends each cpu one ipi for the
+ * lot. for a thread about to wake many others in a row. should the thread
+ * block or be preempted first, the ipis go out as it is switched out */
+void thread_batch_wakeup_begin(void);
+void thread_batch_wakeup_end(void);
+
 void thread_owner_name(thread_t *t, char out_name[THREAD_NAME_LENGTH]);
 
 #define THREAD_BACKTRACE_DEPTH 10
@@ -254,12 +300,19 @@ static inline bool thread_is_idle(thread_t *t)
     return !!(t->flags & THREAD_FLAG_IDLE);
 }
 
+static inline bool thread_is_deadline(const thread_t *t)
+{
+    return !!(t->flags & THREAD_FLAG_DEADLINE);
+}
+
+/* threads that don't run off of a time slice. deadline threads are held to
+ * their budget by the scheduler instead */
 static inline bool thread_is_real_time_or_idle(thread_t *t)
 {
-    return !!(t->flags & (THREAD_FLAG_REAL_TIME | THREAD_FLAG_IDLE));
+    return !!(t->flags & (THREAD_FLAG_REAL_TIME | THREAD_FLAG_IDLE | THREAD_FLAG_DEADLINE));
 }
 
-/* called on every timer tick for the scheduler to do quantum expiration */
+/* called by the preemption timer when the current thread's quantum expires */
 enum handler_return thread_timer_tick(void);
 
 /* the current thread */
@@ -270,8 +323,19 @@ void set_current_thread(thread_t *);
 /* scheduler lock */
 extern spin_lock_t thread_lock;
 
+/* send the reschedule ipis mp_reschedule() held back while this cpu held the
+ * thread lock. interrupts must be disabled */
+void mp_reschedule_flush(void);
+
+static inline void thread_unlock_irqrestore(spin_lock_saved_state_t state)
+{
+    spin_unlock(&thread_lock);
+    mp_reschedule_flush();
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+}
+
 #define THREAD_LOCK(state) spin_lock_saved_state_t state; spin_lock_irqsave(&thread_lock, state)
-#define THREAD_UNLOCK(state) spin_unlock_irqrestore(&thread_lock, state)
+#define THREAD_UNLOCK(state) thread_unlock_irqrestore(state)
 
 static inline bool thread_lock_held(void)
 {
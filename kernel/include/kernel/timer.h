@@ -36,6 +36,23 @@ typedef struct timer {
     volatile bool cancel;    // true if cancel is pending
 } timer_t;
 
+/* per cpu queue of pending timers, a hierarchical timing wheel. level 0 slots
+ * cover 2^TIMER_WHEEL_SHIFT ns each and every level above is
+ * TIMER_WHEEL_SLOTS times coarser. each slot is sorted by deadline. only
+ * touched by kernel/timer.c */
+#define TIMER_WHEEL_LEVELS (5)
+#define TIMER_WHEEL_SLOT_BITS (6)
+#define TIMER_WHEEL_SLOTS (1u << TIMER_WHEEL_SLOT_BITS)
+#define TIMER_WHEEL_SHIFT (16) // ~65us
+
+struct timer_wheel {
+    lk_time_t base;  // start of the current level 0 slot
+    lk_time_t next;  // deadline the hardware timer is set for, INFINITE_TIME if none
+    uint64_t bitmap[TIMER_WHEEL_LEVELS]; // slots that may have timers in them
+    struct list_node slot[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    struct list_node overflow; // beyond the reach of the top level
+};
+
 #define TIMER_INITIAL_VALUE(t) \
 { \
     .magic = TIMER_MAGIC, \
@@ -57,6 +74,10 @@ typedef struct timer {
 */
 void timer_initialize(timer_t *);
 void timer_set_oneshot(timer_t *, lk_time_t deadline, timer_callback, void *arg);
+/* like timer_set_oneshot(), but the timer may fire up to slack ns late so that
+ * it can be coalesced with other timers into one interrupt */
+void timer_set_oneshot_etc(timer_t *, lk_time_t deadline, lk_time_t slack,
+                           timer_callback, void *arg);
 void timer_set_periodic(timer_t *, lk_time_t period, timer_callback, void *arg);
 bool timer_cancel(timer_t *);
 
@@ -22,6 +22,9 @@ typedef struct vm_page {
     struct {
         uint32_t flags : 8;
         uint32_t state : 3;
+        // number of reclaim passes that have seen this page without it being
+        // looked up, saturating at VM_PAGE_AGE_MAX
+        uint32_t age : 3;
     };
     uint32_t map_count;
 
@@ -35,6 +38,9 @@ typedef struct vm_page {
             // attached to a vm object
             uint64_t offset;
             VmObject* obj;
+            // number of outstanding pins; the page can't leave the object
+            // while this is nonzero
+            uint32_t pin_count;
         } object;
 #endif
 
@@ -42,6 +48,9 @@ typedef struct vm_page {
     };
 } vm_page_t;
 
+// vm_page.age
+#define VM_PAGE_AGE_MAX (7u)
+
 // pmm will maintain pages of this size
 #define VM_PAGE_STRUCT_SIZE (sizeof(vm_page_t))
 static_assert(sizeof(vm_page_t) == 32, "");
@@ -29,9 +29,32 @@ typedef struct pmm_arena_info {
 // Add a pre-filled memory arena to the physical allocator.
 status_t pmm_add_arena(const pmm_arena_info_t* arena) __NONNULL((1));
 
+// Memory proximity domains. Arenas and cpus default to node 0 until the
+// platform tells us otherwise.
+#define PMM_MAX_NODES (8)
+
+// Tag every arena whose base address lies within [base, base + size) as local
+// to |node|.
+void pmm_set_arena_node(paddr_t base, size_t size, uint node);
+
+// Record that |cpu_num| is local to memory in |node|.
+void pmm_set_cpu_node(uint cpu_num, uint node);
+
+// Return the memory node the given cpu is local to.
+uint pmm_cpu_node(uint cpu_num);
+
 // flags for allocation routines below
 #define PMM_ALLOC_FLAG_ANY (0x0)  // no restrictions on which arena to allocate from
 #define PMM_ALLOC_FLAG_KMAP (0x1) // allocate only from arenas marked KMAP
+#define PMM_ALLOC_FLAG_NODE_VALID (0x2) // prefer the node in PMM_ALLOC_FLAG_NODE_MASK over the local one
+#define PMM_ALLOC_FLAG_ZEROED (0x4) // returned pages are zero filled, preferably from the pre-zeroed pool
+
+// Prefer arenas in |node| instead of the ones local to the current cpu. Other
+// nodes are still used once the preferred node is exhausted.
+#define PMM_ALLOC_NODE_SHIFT (8)
+#define PMM_ALLOC_FLAG_NODE_MASK (0xffu << PMM_ALLOC_NODE_SHIFT)
+#define PMM_ALLOC_FLAG_NODE(node) \
+    (PMM_ALLOC_FLAG_NODE_VALID | (((uint)(node) << PMM_ALLOC_NODE_SHIFT) & PMM_ALLOC_FLAG_NODE_MASK))
 
 // Allocate count pages of physical memory, adding to the tail of the passed list.
 // The list must be initialized.
@@ -61,6 +84,23 @@ size_t pmm_free_page(vm_page_t* page) __NONNULL((1));
 // Return count of unallocated physical pages in system
 size_t pmm_count_free_pages(void);
 
+// Statistics for the background zeroed page pool.
+typedef struct pmm_zero_pool_stats {
+    size_t depth;     // pages currently zeroed and waiting in the pool
+    size_t target;    // depth the zeroing thread tries to maintain
+    uint64_t zeroed;  // pages zeroed by the background thread
+    uint64_t hits;    // PMM_ALLOC_FLAG_ZEROED pages served from the pool
+    uint64_t misses;  // PMM_ALLOC_FLAG_ZEROED pages that had to be zeroed inline
+} pmm_zero_pool_stats_t;
+
+void pmm_get_zero_pool_stats(pmm_zero_pool_stats_t* stats);
+
+// Ask for |callback| to be called whenever an allocation leaves fewer than
+// |low_pages| pages free in the arenas. It runs with the pmm lock held on the
+// allocating thread, so it must not allocate or block; signalling an event is
+// fine. Passing a null callback turns the notification off.
+void pmm_set_low_memory_callback(size_t low_pages, void (*callback)(void));
+
 // Return amount of physical memory in system, in bytes.
 size_t pmm_count_total_bytes(void);
 
@@ -194,8 +194,41 @@ protected:
         }
     };
 
+    // Summary of the parent's children in the subtree of the child list rooted
+    // at this node, so the parent can find free space without visiting every
+    // child. Gaps are the unused ranges between two children of the subtree.
+    struct SubtreeGaps {
+        vaddr_t first;    // base of the lowest child
+        vaddr_t last;     // last byte of the highest child
+        size_t max_gap;   // size of the largest gap
+        size_t gap_bytes; // total size of all gaps
+        size_t gap_count; // number of gaps
+    };
+
+    // keeps |subtree_gaps_| up to date as the child list changes shape
+    struct WAVLTreeGapObserver : public mxtl::tests::intrusive_containers::DefaultWAVLTreeObserver {
+        template <typename TreeType>
+        static void RecordSubtreeChanged(typename TreeType::RawPtrType node) {
+            node->UpdateSubtreeGaps();
+        }
+    };
+
+    // children of this node in the parent's child list, or nullptr
+    VmAddressRegionOrMapping* subtree_left() const;
+    VmAddressRegionOrMapping* subtree_right() const;
+
+    // recompute |subtree_gaps_| from our own range and our children's
+    void UpdateSubtreeGaps();
+
+    // must be called after changing the size of a region in place, to refresh
+    // the gap information held by it and everything above it in the parent's
+    // child list
+    void UpdateSubtreeGapsToRootLocked();
+
     // node for element in list of parent's children.
     mxtl::WAVLTreeNodeState<mxtl::RefPtr<VmAddressRegionOrMapping>, bool> subregion_list_node_;
+
+    SubtreeGaps subtree_gaps_ = {};
 };
 
 // A representation of a contiguous range of virtual address space
@@ -258,7 +291,7 @@ protected:
 private:
     using ChildList = mxtl::WAVLTree<vaddr_t, mxtl::RefPtr<VmAddressRegionOrMapping>,
                                      mxtl::DefaultKeyedObjectTraits<vaddr_t, VmAddressRegionOrMapping>,
-                                     WAVLTreeTraits>;
+                                     WAVLTreeTraits, WAVLTreeGapObserver>;
 
     DISALLOW_COPY_ASSIGN_AND_MOVE(VmAddressRegion);
 
@@ -321,9 +354,24 @@ private:
     // Utility for allocators for iterating over gaps between allocations
     // F should have a signature of bool func(vaddr_t gap_base, size_t gap_size).
     // If func returns false, the iteration stops.  gap_base will be aligned in
-    // accordance with align_pow2.
+    // accordance with align_pow2.  Gaps smaller than |min_gap| may be skipped,
+    // which lets whole subtrees of children without a big enough gap be
+    // passed over.
     template <typename F>
-    void ForEachGap(F func, uint8_t align_pow2);
+    void ForEachGap(F func, uint8_t align_pow2, size_t min_gap = 0);
+
+    // Helpers for ForEachGap().
+    template <typename F>
+    bool ForEachGapInSubtree(const VmAddressRegionOrMapping* node, F& func, vaddr_t align,
+                             size_t min_gap);
+    template <typename F>
+    static bool ReportGap(vaddr_t prev_end, vaddr_t next_base, F& func, vaddr_t align);
+
+    // Pick one of the aligned spots that can hold |size| bytes uniformly at
+    // random in O(log n) expected time, using the gap totals kept in the child
+    // list. Returns false if it gave up, in which case the caller should fall
+    // back to enumerating all the gaps.
+    bool PickRandomSpotLocked(size_t size, uint8_t align_pow2, vaddr_t* spot);
 
     // list of subregions, indexed by base address
     ChildList subregions_;
@@ -409,6 +457,12 @@ public:
     uint64_t object_offset() const { return object_offset_; }
     mxtl::RefPtr<VmObject> vmo() const { return object_; };
 
+    // Number of pages around a faulting address that may be mapped in along
+    // with it if they are already committed in the vmo. 0 or 1 disables
+    // fault-around for this mapping. Must be a power of two.
+    uint fault_around_pages() const { return fault_around_pages_; }
+    status_t SetFaultAroundPages(uint pages);
+
     // Convenience wrapper for vmo()->DecommitRange() with the necessary
     // offset modification and locking.
     status_t DecommitRange(size_t offset, size_t len, size_t* decommitted);
@@ -443,6 +497,9 @@ protected:
     // unmap any pages that map the passed in vmo range. May not intersect with this range
     status_t UnmapVmoRangeLocked(uint64_t start, uint64_t size) const;
 
+    // returns true if the page at the passed in vmo offset is mapped by this region
+    bool IsVmoPageMappedLocked(uint64_t offset) const;
+
 private:
     DISALLOW_COPY_ASSIGN_AND_MOVE(VmMapping);
 
@@ -466,6 +523,18 @@ private:
     // Implementation for Protect().  This does not acquire the aspace lock.
     status_t ProtectLocked(vaddr_t base, size_t size, uint new_arch_mmu_flags);
 
+    // Called on a fault at |va| that resolved to |pa|: if the whole large page
+    // sized window around |va| is committed, physically contiguous and suitably
+    // aligned, map it in one go so the arch layer can use a single large page
+    // entry. Returns false if the window does not qualify.
+    bool TryMapLargePageLocked(vaddr_t va, paddr_t pa, uint mmu_flags);
+
+    // Called after a fault at |va| mapped a single page: maps any pages in the
+    // fault-around window that are already resident in the vmo but not yet
+    // mapped, so that nearby accesses don't fault. Returns the number of
+    // pages mapped.
+    size_t FaultAroundLocked(vaddr_t va);
+
     // Version of AllocatedPages() that does not acquire the aspace lock
     size_t AllocatedPagesLocked() const override;
 
@@ -483,6 +552,9 @@ private:
     // cached mapping flags (read/write/user/etc)
     uint arch_mmu_flags_;
 
+    // size of the fault-around window in pages
+    uint fault_around_pages_;
+
     // used to detect recursions through the vmo fault path
     bool currently_faulting_ = false;
 };
@@ -25,6 +25,7 @@
 class VmMapping;
 
 typedef status_t (*vmo_lookup_fn_t)(void* context, size_t offset, size_t index, paddr_t pa);
+typedef void (*vmo_commit_done_fn_t)(void* context, status_t status);
 
 // The base vm object that holds a range of bytes of data
 //
@@ -141,6 +142,47 @@ public:
         return MX_ERR_NOT_SUPPORTED;
     }
 
+    // set the memory node future page allocations should prefer, or
+    // MX_VMO_NUMA_NODE_LOCAL to prefer the node local to the faulting cpu
+    virtual status_t SetPreferredNode(uint32_t node) {
+        return MX_ERR_NOT_SUPPORTED;
+    }
+
+    // commit the pages in the range and keep them at their physical addresses
+    // until a matching Unpin(); pinned pages can't be decommitted or resized away
+    virtual status_t Pin(uint64_t offset, uint64_t len) {
+        return MX_ERR_NOT_SUPPORTED;
+    }
+    virtual status_t Unpin(uint64_t offset, uint64_t len) {
+        return MX_ERR_NOT_SUPPORTED;
+    }
+
+    // allow the kernel to compress pages of this object that have not been
+    // touched in a while when memory runs low; they are brought back on access
+    virtual status_t EnableReclaim() {
+        return MX_ERR_NOT_SUPPORTED;
+    }
+
+    // let the reclaim thread take the resident pages in the range ahead of
+    // any others; unlike DecommitRange() their contents are kept
+    virtual status_t MarkReclaimable(uint64_t offset, uint64_t len) {
+        return MX_ERR_NOT_SUPPORTED;
+    }
+
+    // like CommitRange() but done later by a prefetch thread, which calls
+    // |done_fn| with the result once it is. The object is kept alive until then.
+    // Fails with MX_ERR_SHOULD_WAIT while too many ranges are already waiting.
+    virtual status_t CommitRangeAsync(uint64_t offset, uint64_t len,
+                                      vmo_commit_done_fn_t done_fn, void* context) {
+        return MX_ERR_NOT_SUPPORTED;
+    }
+
+    // how the pages of the object are expected to be touched, which decides
+    // how much of it its mappings map ahead of a fault
+    enum class AccessHint { NORMAL, SEQUENTIAL, RANDOM };
+    void set_access_hint(AccessHint hint);
+    AccessHint access_hint_locked() const TA_REQ(lock_) { return access_hint_; }
+
     // create a copy-on-write clone vmo at the page-aligned offset and length
     // note: it's okay to start or extend past the size of the parent
     virtual status_t CloneCOW(uint64_t offset, uint64_t size, bool copy_name,
@@ -152,6 +194,7 @@ public:
     // TODO: If more types of clones appear, replace this with a method that
     // returns an enum rather than adding a new method for each clone type.
     bool is_cow_clone() const;
+    bool is_cow_clone_locked() const TA_REQ(lock_) { return parent_ != nullptr; }
 
     // get a pointer to the page structure and/or physical address at the specified offset.
     // valid flags are VMM_PF_FLAG_*
@@ -160,6 +203,13 @@ public:
         return MX_ERR_NOT_SUPPORTED;
     }
 
+    // look up the physical address of the page at the specified offset without
+    // committing anything: pages that aren't resident as they stand, including
+    // ones that would have to be brought back, are not found.
+    virtual status_t LookupPageLocked(uint64_t offset, paddr_t* pa) TA_REQ(lock_) {
+        return GetPageLocked(offset, 0, nullptr, pa);
+    }
+
     Mutex* lock() TA_RET_CAP(lock_) { return &lock_; }
     Mutex& lock_ref() TA_RET_CAP(lock_) { return lock_; }
 
@@ -214,6 +264,15 @@ protected:
         // Called under the parent's lock, which confuses analysis.
         TA_NO_THREAD_SAFETY_ANALYSIS { RangeChangeUpdateLocked(offset, len); }
 
+    // returns true if any mapping of this vmo, or of a child that sees the
+    // page through us, has the page at offset mapped
+    bool IsPageMappedLocked(uint64_t offset) TA_REQ(lock_);
+
+    // above call but called from a parent
+    virtual bool IsPageMappedFromParentLocked(uint64_t offset)
+        // Called under the parent's lock, which confuses analysis.
+        TA_NO_THREAD_SAFETY_ANALYSIS { return IsPageMappedLocked(offset); }
+
     // magic value
     mxtl::Canary<mxtl::magic("VMO_")> canary_;
 
@@ -242,6 +301,8 @@ protected:
 
     uint64_t user_id_ TA_GUARDED(lock_) = 0;
 
+    AccessHint access_hint_ TA_GUARDED(lock_) = AccessHint::NORMAL;
+
     // The user-friendly VMO name. For debug purposes only. That
     // is, there is no mechanism to get access to a VMO via this name.
     mxtl::Name<MX_MAX_NAME_LEN> name_;
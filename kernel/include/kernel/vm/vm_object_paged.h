@@ -12,6 +12,7 @@
 #include <kernel/vm/pmm.h>
 #include <kernel/vm/vm_object.h>
 #include <kernel/vm/vm_page_list.h>
+#include <kernel/vm/vm_reclaim.h>
 #include <lib/user_copy/user_ptr.h>
 #include <list.h>
 #include <magenta/thread_annotations.h>
@@ -65,10 +66,34 @@ public:
     status_t CleanInvalidateCache(const uint64_t offset, const uint64_t len) override;
     status_t SyncCache(const uint64_t offset, const uint64_t len) override;
 
+    status_t SetPreferredNode(uint32_t node) override;
+
+    status_t Pin(uint64_t offset, uint64_t len) override;
+    status_t Unpin(uint64_t offset, uint64_t len) override;
+
+    status_t EnableReclaim() override;
+    status_t MarkReclaimable(uint64_t offset, uint64_t len) override;
+
+    status_t CommitRangeAsync(uint64_t offset, uint64_t len,
+                              vmo_commit_done_fn_t done_fn, void* context) override;
+
+    // Age the resident pages of the object, compressing up to |max_pages| of
+    // the ones that have not been looked up for |min_age| passes. Returns the
+    // number of physical pages given back.
+    size_t ReclaimPages(uint min_age, size_t max_pages);
+
+    // Run ReclaimPages() over every object that has reclaim enabled until
+    // |target| pages have been given back.
+    static size_t ReclaimAll(uint min_age, size_t target);
+
     status_t GetPageLocked(uint64_t offset, uint pf_flags, vm_page_t**, paddr_t*) override
         // Calls a Locked method of the parent, which confuses analysis.
         TA_NO_THREAD_SAFETY_ANALYSIS;
 
+    status_t LookupPageLocked(uint64_t offset, paddr_t* pa) override
+        // Calls a Locked method of the parent, which confuses analysis.
+        TA_NO_THREAD_SAFETY_ANALYSIS;
+
     status_t CloneCOW(uint64_t offset, uint64_t size, bool copy_name,
                       mxtl::RefPtr<VmObject>* clone_vmo) override
         // Calls a Locked method of the child, which confuses analysis.
@@ -78,6 +103,10 @@ public:
         // Called under the parent's lock, which confuses analysis.
         TA_NO_THREAD_SAFETY_ANALYSIS;
 
+    bool IsPageMappedFromParentLocked(uint64_t offset) override
+        // Called under the parent's lock, which confuses analysis.
+        TA_NO_THREAD_SAFETY_ANALYSIS;
+
 private:
     // private constructor (use Create())
     explicit VmObjectPaged(uint32_t pmm_alloc_flags, mxtl::RefPtr<VmObject> parent);
@@ -107,9 +136,24 @@ private:
     status_t ReadWriteInternal(uint64_t offset, size_t len, size_t* bytes_copied, bool write,
                                T copyfunc);
 
+    // drop a pin from every page in [start_offset, end_offset), all of which
+    // must be pinned
+    void UnpinLocked(uint64_t start_offset, uint64_t end_offset) TA_REQ(lock_);
+
+    // whether any page in [start_offset, end_offset) is pinned
+    bool AnyPagesPinnedLocked(uint64_t start_offset, uint64_t end_offset) TA_REQ(lock_);
+
     // set our offset within our parent
     status_t SetParentOffsetLocked(uint64_t o) TA_REQ(lock_);
 
+    // if the page at |offset| was compressed by reclaim, decompress it into |p|
+    // and drop the compressed copy. Returns false if there was nothing to restore.
+    bool RestoreCompressedPageLocked(uint64_t offset, vm_page_t* p) TA_REQ(lock_);
+
+    // drop the compressed copies of pages in [start_offset, end_offset)
+    void FreeCompressedPagesInRangeLocked(uint64_t start_offset, uint64_t end_offset)
+        TA_REQ(lock_);
+
     // maximum size of a VMO is one page less than the full 64bit range
     static const uint64_t MAX_SIZE = ROUNDDOWN(UINT64_MAX, PAGE_SIZE);
 
@@ -120,4 +164,25 @@ private:
 
     // a tree of pages
     VmPageList page_list_ TA_GUARDED(lock_);
+
+    // pages the reclaim thread compressed out of page_list_. Cleared once the
+    // object has handed out physical addresses that may be used behind its back.
+    bool reclaimable_ TA_GUARDED(lock_) = false;
+    VmCompressedPageTree compressed_pages_ TA_GUARDED(lock_);
+
+    // The list of objects the reclaim thread walks. Its lock is taken before
+    // any object lock, and the list holds plain pointers: an object takes itself
+    // out in its destructor, which waits for a pass that is using it to finish.
+    using ReclaimNodeState = mxtl::DoublyLinkedListNodeState<VmObjectPaged*>;
+    ReclaimNodeState reclaim_list_state_;
+
+    struct ReclaimListTraits {
+        static ReclaimNodeState& node_state(VmObjectPaged& vmo) {
+            return vmo.reclaim_list_state_;
+        }
+    };
+    using ReclaimList = mxtl::DoublyLinkedList<VmObjectPaged*, ReclaimListTraits>;
+    static Mutex reclaim_list_lock_;
+    static ReclaimList reclaim_list_ TA_GUARDED(reclaim_list_lock_);
+    bool reclaim_registered_ TA_GUARDED(reclaim_list_lock_) = false;
 };
@@ -10,6 +10,7 @@
 #include <mxtl/intrusive_wavl_tree.h>
 #include <mxtl/macros.h>
 #include <mxtl/unique_ptr.h>
+#include <stdlib.h>
 
 struct vm_page;
 
@@ -46,6 +47,32 @@ public:
         }
     }
 
+    // for every valid page in the node within [start_offset, end_offset)
+    // call the passed in function
+    template <typename T>
+    void ForEveryPageInRange(T func, uint64_t start_offset, uint64_t end_offset) {
+        size_t start = 0;
+        size_t end = kPageFanOut;
+        ClampRange(start_offset, end_offset, &start, &end);
+        for (size_t i = start; i < end; i++) {
+            if (pages_[i]) {
+                func(pages_[i], obj_offset_ + i * PAGE_SIZE);
+            }
+        }
+    }
+
+    template <typename T>
+    void ForEveryPageInRange(T func, uint64_t start_offset, uint64_t end_offset) const {
+        size_t start = 0;
+        size_t end = kPageFanOut;
+        ClampRange(start_offset, end_offset, &start, &end);
+        for (size_t i = start; i < end; i++) {
+            if (pages_[i]) {
+                func(pages_[i], obj_offset_ + i * PAGE_SIZE);
+            }
+        }
+    }
+
     vm_page* GetPage(size_t index);
     vm_page* RemovePage(size_t index);
     status_t AddPage(vm_page* p, size_t index);
@@ -59,6 +86,14 @@ public:
     }
 
 private:
+    // convert an object offset range into the range of page indexes it covers in this node
+    void ClampRange(uint64_t start_offset, uint64_t end_offset, size_t* start, size_t* end) const {
+        if (start_offset > obj_offset_)
+            *start = MIN((start_offset - obj_offset_ + PAGE_SIZE - 1) / PAGE_SIZE, kPageFanOut);
+        if (end_offset < obj_offset_ + kPageFanOut * PAGE_SIZE)
+            *end = end_offset > obj_offset_ ? (end_offset - obj_offset_ + PAGE_SIZE - 1) / PAGE_SIZE : 0;
+    }
+
     mxtl::Canary<mxtl::magic("PLST")> canary_;
 
     uint64_t obj_offset_ = 0;
@@ -88,11 +123,48 @@ public:
         }
     }
 
+    // walk the page tree, calling the passed in function on every page with
+    // an offset in [start_offset, end_offset). Only the tree nodes that overlap
+    // the range are visited.
+    template <typename T>
+    void ForEveryPageInRange(T per_page_func, uint64_t start_offset, uint64_t end_offset) {
+        auto pl = list_.lower_bound(NodeOffset(start_offset));
+        for (; pl.IsValid() && pl->offset() < end_offset; ++pl) {
+            pl->ForEveryPageInRange(per_page_func, start_offset, end_offset);
+        }
+    }
+
+    template <typename T>
+    void ForEveryPageInRange(T per_page_func, uint64_t start_offset, uint64_t end_offset) const {
+        auto pl = list_.lower_bound(NodeOffset(start_offset));
+        for (; pl.IsValid() && pl->offset() < end_offset; ++pl) {
+            pl->ForEveryPageInRange(per_page_func, start_offset, end_offset);
+        }
+    }
+
     status_t AddPage(vm_page*, uint64_t offset);
     vm_page* GetPage(uint64_t offset);
     status_t FreePage(uint64_t offset);
     size_t FreeAllPages();
 
+    // free all of the pages with an offset in [start_offset, end_offset),
+    // returning the number of pages freed
+    size_t FreePagesInRange(uint64_t start_offset, uint64_t end_offset);
+
+    // number of pages with an offset in [start_offset, end_offset)
+    size_t CountPagesInRange(uint64_t start_offset, uint64_t end_offset) const;
+
 private:
+    static uint64_t NodeOffset(uint64_t offset) {
+        return ROUNDDOWN(offset, PAGE_SIZE * VmPageListNode::kPageFanOut);
+    }
+
+    // find the tree node holding the page at offset, or nullptr
+    VmPageListNode* FindNode(uint64_t node_offset);
+
     mxtl::WAVLTree<uint64_t, mxtl::unique_ptr<VmPageListNode>> list_;
+
+    // the node found by the last lookup, so that runs of accesses to
+    // neighbouring pages don't each have to walk the tree
+    VmPageListNode* last_node_ = nullptr;
 };
@@ -0,0 +1,64 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <magenta/types.h>
+#include <mxtl/intrusive_wavl_tree.h>
+#include <mxtl/macros.h>
+#include <mxtl/unique_ptr.h>
+#include <stdint.h>
+
+// Pages that have gone untouched for this many reclaim passes are compressed.
+#define VM_RECLAIM_MIN_AGE (2u)
+
+// The contents of one page of a VmObjectPaged, compressed out of memory by the
+// reclaim thread and keyed by the offset it came from.
+class VmCompressedPage final
+    : public mxtl::WAVLTreeContainable<mxtl::unique_ptr<VmCompressedPage>> {
+public:
+    // Compress the page at |src|. Returns nullptr if the page does not shrink
+    // enough to be worth keeping or if the space for it could not be allocated.
+    static mxtl::unique_ptr<VmCompressedPage> Create(uint64_t offset, const void* src);
+
+    ~VmCompressedPage();
+
+    DISALLOW_COPY_ASSIGN_AND_MOVE(VmCompressedPage);
+
+    uint64_t GetKey() const { return offset_; }
+    size_t size() const { return size_; }
+
+    // Decompress the data back into the page at |dst|.
+    void Decompress(void* dst) const;
+
+private:
+    VmCompressedPage(uint64_t offset, mxtl::unique_ptr<uint8_t[]> data, size_t size);
+
+    const uint64_t offset_;
+    const mxtl::unique_ptr<uint8_t[]> data_;
+    const size_t size_;
+};
+
+using VmCompressedPageTree = mxtl::WAVLTree<uint64_t, mxtl::unique_ptr<VmCompressedPage>>;
+
+// Returns true if every byte of the page at |ptr| is zero.
+bool vm_page_is_zero(const void* ptr);
+
+struct vm_reclaim_stats {
+    size_t stored_pages;    // pages currently held compressed
+    size_t stored_bytes;    // heap bytes holding them
+    uint64_t compressed;    // pages compressed since boot
+    uint64_t zero_dropped;  // zero filled pages released without being stored
+    uint64_t rejected;      // pages that did not compress well enough
+    uint64_t decompressed;  // pages brought back in
+    uint64_t passes;        // reclaim passes run
+};
+
+void vm_reclaim_get_stats(vm_reclaim_stats* stats);
+
+// Counters updated by VmObjectPaged as it reclaims and restores pages.
+void vm_reclaim_count_zero_dropped();
+void vm_reclaim_count_decompressed();
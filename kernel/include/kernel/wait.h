@@ -20,8 +20,12 @@ __BEGIN_CDECLS;
 /* wait queue stuff */
 #define WAIT_QUEUE_MAGIC (0x77616974) // 'wait'
 
+/* the wait queue is the start of an owned_wait_queue_t */
+#define WAIT_QUEUE_FLAG_OWNED (1u << 0)
+
 typedef struct wait_queue {
     int magic;
+    uint32_t flags;
     struct list_node list;
     int count;
 } wait_queue_t;
@@ -29,10 +33,33 @@ typedef struct wait_queue {
 #define WAIT_QUEUE_INITIAL_VALUE(q) \
 { \
     .magic = WAIT_QUEUE_MAGIC, \
+    .flags = 0, \
     .list = LIST_INITIAL_VALUE((q).list), \
     .count = 0 \
 }
 
+/* a wait queue whose waiters are waiting on one thread, its owner, to
+ * release something. the owner inherits the priority of the highest priority
+ * waiter for as long as it owns the queue, and passes it on to the owner of
+ * any owned queue it blocks on in turn */
+typedef struct owned_wait_queue {
+    wait_queue_t wait;
+    struct thread *owner;
+    struct list_node owner_node; /* in the owner's owned_wait_queues list */
+} owned_wait_queue_t;
+
+#define OWNED_WAIT_QUEUE_INITIAL_VALUE(q) \
+{ \
+    .wait = { \
+        .magic = WAIT_QUEUE_MAGIC, \
+        .flags = WAIT_QUEUE_FLAG_OWNED, \
+        .list = LIST_INITIAL_VALUE((q).wait.list), \
+        .count = 0 \
+    }, \
+    .owner = NULL, \
+    .owner_node = LIST_INITIAL_CLEARED_VALUE \
+}
+
 /* wait queue primitive */
 /* NOTE: must be inside critical section when using these */
 void wait_queue_init(wait_queue_t *wait);
@@ -65,6 +92,22 @@ status_t thread_unblock_from_wait_queue(struct thread *t, status_t wait_queue_er
 /* is the wait queue currently empty */
 bool wait_queue_is_empty(wait_queue_t *);
 
+/* owned wait queues, used like regular wait queues through their wait member.
+ * NOTE: must be inside critical section when using these */
+void owned_wait_queue_init(owned_wait_queue_t *);
+void owned_wait_queue_destroy(owned_wait_queue_t *);
+
+/* make owner, which may be NULL, the owner of the queue. the previous owner
+ * stops inheriting priority from the queue's waiters */
+void owned_wait_queue_set_owner(owned_wait_queue_t *, struct thread *owner);
+
+/* block on the queue after making owner its owner */
+status_t owned_wait_queue_block(owned_wait_queue_t *, struct thread *owner, lk_time_t deadline);
+
+/* take the first thread off of the queue, like wait_queue_dequeue_one(), and
+ * make it the new owner if any waiters are left behind it */
+struct thread *owned_wait_queue_dequeue_one(owned_wait_queue_t *, status_t wait_queue_error);
+
 __END_CDECLS;
 
 #endif
@@ -9,9 +9,27 @@
 #include <err.h>
 #include <magenta/compiler.h>
 #include <magenta/ktrace.h>
+#include <platform.h>
+#include <stdbool.h>
+
+#if __x86_64__
+#include <arch/x86.h>
+#endif
 
 __BEGIN_CDECLS
 
+// the clock records are stamped with
+static inline uint64_t ktrace_timestamp(void) {
+#if __x86_64__
+    return rdtsc();
+#else
+    return current_time();
+#endif
+}
+
+// the probe starts out switched off
+#define KTRACE_PROBE_OFF (1u << 0)
+
 #if WITH_LIB_KTRACE
 
 typedef struct ktrace_probe_info ktrace_probe_info_t;
@@ -20,39 +38,58 @@ struct ktrace_probe_info {
     ktrace_probe_info_t* next;
     const char* name;
     uint32_t num;
+    uint32_t flags;
 } __ALIGNED(16); // align on multiple of 16 to match linker packing of the ktrace_probe section
 
-void* ktrace_open(uint32_t tag);
+// probe numbers fit in the 11 bits TAG_PROBE_* leave for them
+#define KTRACE_MAX_PROBES (0x800u)
+
+// one bit per probe number, set while the probe is switched on
+extern uint32_t ktrace_probe_enabled[KTRACE_MAX_PROBES / 32];
+
+static inline bool ktrace_probe_is_enabled(uint32_t num) {
+    return ktrace_probe_enabled[(num / 32) % (KTRACE_MAX_PROBES / 32)] & (1u << (num % 32));
+}
+
+// write a record of KTRACE_LEN(tag) bytes, the header followed by as many
+// of a-d as fit. returns false if the record was filtered out or dropped
+bool ktrace_record(uint32_t tag, uint32_t a, uint32_t b, uint32_t c, uint32_t d);
 void ktrace_tiny(uint32_t tag, uint32_t arg);
 static inline void ktrace(uint32_t tag, uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
-    uint32_t* data = (uint32_t*) ktrace_open(tag);
-    if (data) {
-        data[0] = a; data[1] = b; data[2] = c; data[3] = d;
-    }
+    ktrace_record(tag, a, b, c, d);
 }
-#define ktrace_probe0(_name) {                                  \
-    __USED __SECTION("ktrace_probe")                            \
-    static ktrace_probe_info_t info = { .name = _name };        \
-    ktrace_open(TAG_PROBE_16(info.num));                        \
+// a probe costs a single branch while it is switched off
+#define ktrace_probe0_etc(_name,_flags) {                                   \
+    __USED __SECTION("ktrace_probe")                                        \
+    static ktrace_probe_info_t info = { .name = _name, .flags = (_flags) }; \
+    if (unlikely(ktrace_probe_is_enabled(info.num)))                        \
+        ktrace_record(TAG_PROBE_16(info.num), 0, 0, 0, 0);                  \
 }
-#define ktrace_probe2(_name,arg0,arg1) {                     \
-    __USED __SECTION("ktrace_probe")                         \
-    static ktrace_probe_info_t info = { .name = _name };     \
-    uint32_t* args = ktrace_open(TAG_PROBE_24(info.num));    \
-    if (args) {                                              \
-      args[0] = arg0;                                        \
-      args[1] = arg1;                                        \
-    }                                                        \
+#define ktrace_probe2_etc(_name,_flags,arg0,arg1) {                         \
+    __USED __SECTION("ktrace_probe")                                        \
+    static ktrace_probe_info_t info = { .name = _name, .flags = (_flags) }; \
+    if (unlikely(ktrace_probe_is_enabled(info.num)))                        \
+        ktrace_record(TAG_PROBE_24(info.num), (arg0), (arg1), 0, 0);        \
 }
+#define ktrace_probe0(_name) ktrace_probe0_etc(_name, 0)
+#define ktrace_probe2(_name,arg0,arg1) ktrace_probe2_etc(_name, 0, arg0, arg1)
 void ktrace_name(uint32_t tag, uint32_t id, uint32_t arg, const char* name);
 int ktrace_read_user(void* ptr, uint32_t off, uint32_t len);
 status_t ktrace_control(uint32_t action, uint32_t options, void* ptr);
 #else
-static inline void* ktrace_open(uint32_t tag) { return NULL; }
+static inline bool ktrace_record(uint32_t tag, uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
+    return false;
+}
 static inline void ktrace_tiny(uint32_t tag, uint32_t arg) {}
+static inline bool ktrace_probe_is_enabled(uint32_t num) {
+    return false;
+}
 static inline void ktrace(uint32_t tag, uint32_t a, uint32_t b, uint32_t c, uint32_t d) {}
 static inline void ktrace_probe0(const char* name) {}
 static inline void ktrace_probe2(const char* name, uint32_t arg0, uint32_t arg1) {}
+static inline void ktrace_probe0_etc(const char* name, uint32_t flags) {}
+static inline void ktrace_probe2_etc(const char* name, uint32_t flags,
+                                     uint32_t arg0, uint32_t arg1) {}
 static inline void ktrace_name(uint32_t tag, uint32_t id, uint32_t arg, const char* name) {}
 static inline ssize_t ktrace_read_user(void* ptr, uint32_t off, uint32_t len) {
     if ((len == 0) && (off == 0)) {
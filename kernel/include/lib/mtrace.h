@@ -22,4 +22,8 @@ status_t mtrace_control(uint32_t kind, uint32_t action, uint32_t options,
 #ifdef __x86_64__
 status_t mtrace_ipt_control(uint32_t action, uint32_t options,
                             void* arg, uint32_t size);
+status_t mtrace_profile_control(uint32_t action, uint32_t options,
+                                void* arg, uint32_t size);
+status_t mtrace_counters_control(uint32_t action, uint32_t options,
+                                 void* arg, uint32_t size);
 #endif
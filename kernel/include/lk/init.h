@@ -63,6 +63,17 @@ struct lk_init_struct {
     const char *name;
 };
 
+// When a hook called on the primary cpu ran, on the clock ktrace stamps its
+// records with, so that the boot timeline can show kernel init too.
+struct lk_init_timing {
+    const struct lk_init_struct *hook;
+    uint64_t start;
+    uint64_t end;
+};
+
+// Returns how many hooks have been timed so far, oldest first.
+size_t lk_init_timings(const struct lk_init_timing **timings);
+
 #define LK_INIT_HOOK_FLAGS(_name, _hook, _level, _flags)        \
     __ALIGNED(sizeof(void *)) __USED __SECTION("lk_init")       \
     static const struct lk_init_struct _init_struct_##_name = { \
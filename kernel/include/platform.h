@@ -8,6 +8,7 @@
 #ifndef __PLATFORM_H
 #define __PLATFORM_H
 
+#include <stdbool.h>
 #include <sys/types.h>
 #include <magenta/compiler.h>
 
@@ -39,6 +40,12 @@ lk_time_t current_time(void);
 /* high-precision timer ticks per second */
 uint64_t ticks_per_second(void);
 
+/* if current_time() is the counter user mode reads with mx_ticks_get() times
+ * a constant factor, return true with the factor in ns_per_tick. the vDSO can
+ * then tell the time without entering the kernel */
+struct fp_32_64;
+bool platform_get_user_clock(struct fp_32_64 *ns_per_tick);
+
 /* super early platform initialization, before almost everything */
 void platform_early_init(void);
 
@@ -90,9 +90,17 @@ static int cmd_threadstats(int argc, const cmd_args *argv, uint32_t flags)
                current_time() - percpu[i].stats.idle_time);
         printf("\treschedules: %lu\n", percpu[i].stats.reschedules);
         printf("\treschedule_ipis: %lu\n", percpu[i].stats.reschedule_ipis);
+        printf("\treschedule_polls: %lu\n", percpu[i].stats.reschedule_polls);
         printf("\tcontext_switches: %lu\n", percpu[i].stats.context_switches);
         printf("\tpreempts: %lu\n", percpu[i].stats.preempts);
         printf("\tyields: %lu\n", percpu[i].stats.yields);
+        printf("\tsteals: %lu\n", percpu[i].stats.steals);
+        printf("\tbalances: %lu\n", percpu[i].stats.balances);
+        printf("\thandoffs: %lu\n", percpu[i].stats.handoffs);
+        printf("\tmigrations: %lu\n", percpu[i].stats.migrations);
+        printf("\tmutex spins: %lu\n", percpu[i].stats.mutex_spins);
+        printf("\tmutex blocks: %lu\n", percpu[i].stats.mutex_blocks);
+        printf("\tmutex spin time: %" PRIu64 "\n", percpu[i].stats.mutex_spin_time);
         printf("\tinterrupts: %lu\n", percpu[i].stats.interrupts);
         printf("\ttimer interrupts: %lu\n", percpu[i].stats.timer_ints);
         printf("\ttimers: %lu\n", percpu[i].stats.timers);
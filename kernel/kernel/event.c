@@ -148,7 +148,7 @@ static int event_signal_internal(event_t *e, bool reschedule, status_t wait_resu
 
     // conditionally THREAD_UNLOCK
     if (!thread_lock_held)
-        spin_unlock_irqrestore(&thread_lock, state);
+        THREAD_UNLOCK(state);
 
     return wake_count;
 }
@@ -0,0 +1,265 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+/**
+ * @file
+ * @brief  Lock contention statistics
+ *
+ * Only built with ENABLE_LOCK_STATS=true, see kernel/lockstat.h.
+ */
+
+#include <kernel/lockstat.h>
+
+#include <arch/ops.h>
+#include <debug.h>
+#include <err.h>
+#include <inttypes.h>
+#include <lib/ktrace.h>
+#include <platform.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* number of classes that can be told apart, a power of two */
+#define LOCKSTAT_CLASSES (1024u)
+
+/* how far to probe for a free slot before giving up on a new class */
+#define LOCKSTAT_MAX_PROBE (16u)
+
+/* spin locks a cpu can hold at once and still have their hold time counted */
+#define LOCKSTAT_MAX_HELD (8u)
+
+struct lockstat_class {
+    uintptr_t site;     /* 0 while the slot is free */
+    const void *lock;   /* last lock taken from here */
+    uint kind;
+    uint64_t acquires;
+    uint64_t contended;
+    uint64_t wait_time;
+    uint64_t max_wait_time;
+    uint64_t hold_time;
+    uint64_t max_hold_time;
+};
+
+static struct lockstat_class classes[LOCKSTAT_CLASSES];
+
+/* acquisitions there was no room left in the table for */
+static uint64_t dropped;
+
+/* the spin locks each cpu holds, innermost last. spin locks are only held
+ * with interrupts disabled, so only the local cpu touches its entry */
+struct lockstat_held {
+    spin_lock_t *lock;
+    struct lockstat_class *c;
+    lk_time_t acquired;
+};
+
+static struct {
+    uint count;
+    struct lockstat_held held[LOCKSTAT_MAX_HELD];
+} held_spin_locks[SMP_MAX_CPUS];
+
+static void atomic_max_u64(uint64_t *p, uint64_t val)
+{
+    uint64_t old = __atomic_load_n(p, __ATOMIC_RELAXED);
+    while (val > old &&
+           !__atomic_compare_exchange_n(p, &old, val, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+struct lockstat_class *lockstat_class_for(uintptr_t site, const void *lock, uint kind)
+{
+    uint32_t hash = (uint32_t)((site >> 2) * 0x9e3779b97f4a7c15ull >> 32);
+
+    for (uint i = 0; i < LOCKSTAT_MAX_PROBE; i++) {
+        struct lockstat_class *c = &classes[(hash + i) & (LOCKSTAT_CLASSES - 1)];
+
+        uintptr_t cur = __atomic_load_n(&c->site, __ATOMIC_RELAXED);
+        if (cur == 0) {
+            if (__atomic_compare_exchange_n(&c->site, &cur, site, false,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                c->kind = kind;
+                return c;
+            }
+            /* someone else took the slot first, it may have been for us */
+        }
+        if (cur == site)
+            return c;
+    }
+
+    __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+void lockstat_record_acquire(struct lockstat_class *c, const void *lock, lk_time_t wait,
+                             bool contended)
+{
+    if (!c)
+        return;
+
+    c->lock = lock;
+    __atomic_fetch_add(&c->acquires, 1, __ATOMIC_RELAXED);
+    if (!contended)
+        return;
+
+    __atomic_fetch_add(&c->contended, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&c->wait_time, wait, __ATOMIC_RELAXED);
+    atomic_max_u64(&c->max_wait_time, wait);
+
+    ktrace(TAG_LOCK_CONTENDED, (uint32_t)c->site, (uint32_t)((uint64_t)c->site >> 32),
+           wait > UINT32_MAX ? UINT32_MAX : (uint32_t)wait, (uint32_t)(uintptr_t)lock);
+}
+
+void lockstat_record_release(struct lockstat_class *c, lk_time_t hold)
+{
+    if (!c)
+        return;
+
+    __atomic_fetch_add(&c->hold_time, hold, __ATOMIC_RELAXED);
+    atomic_max_u64(&c->max_hold_time, hold);
+}
+
+static void push_held_spin_lock(spin_lock_t *lock, struct lockstat_class *c, lk_time_t now)
+{
+    DEBUG_ASSERT(arch_ints_disabled());
+
+    uint cpu = arch_curr_cpu_num();
+    if (held_spin_locks[cpu].count == LOCKSTAT_MAX_HELD)
+        return;
+
+    struct lockstat_held *h = &held_spin_locks[cpu].held[held_spin_locks[cpu].count++];
+    h->lock = lock;
+    h->c = c;
+    h->acquired = now;
+}
+
+void lockstat_spin_lock(spin_lock_t *lock)
+{
+    uintptr_t site = (uintptr_t)__GET_CALLER();
+    lk_time_t wait = 0;
+    lk_time_t now;
+
+    bool contended = arch_spin_trylock(lock) != 0;
+    if (contended) {
+        lk_time_t start = current_time();
+        arch_spin_lock(lock);
+        now = current_time();
+        wait = now - start;
+    } else {
+        now = current_time();
+    }
+
+    struct lockstat_class *c = lockstat_class_for(site, lock, LOCKSTAT_KIND_SPIN_LOCK);
+    lockstat_record_acquire(c, lock, wait, contended);
+    push_held_spin_lock(lock, c, now);
+}
+
+int lockstat_spin_trylock(spin_lock_t *lock)
+{
+    uintptr_t site = (uintptr_t)__GET_CALLER();
+
+    int ret = arch_spin_trylock(lock);
+    if (ret == 0) {
+        struct lockstat_class *c = lockstat_class_for(site, lock, LOCKSTAT_KIND_SPIN_LOCK);
+        lockstat_record_acquire(c, lock, 0, false);
+        push_held_spin_lock(lock, c, current_time());
+    }
+
+    return ret;
+}
+
+void lockstat_spin_unlock(spin_lock_t *lock)
+{
+    DEBUG_ASSERT(arch_ints_disabled());
+
+    /* locks are normally dropped in the reverse order they were taken, but
+     * don't have to be. one the table had no room for isn't found at all */
+    uint cpu = arch_curr_cpu_num();
+    uint count = held_spin_locks[cpu].count;
+    struct lockstat_held *held = held_spin_locks[cpu].held;
+    for (uint i = count; i-- > 0; ) {
+        if (held[i].lock != lock)
+            continue;
+
+        lockstat_record_release(held[i].c, current_time() - held[i].acquired);
+        memmove(&held[i], &held[i + 1], (count - i - 1) * sizeof(held[0]));
+        held_spin_locks[cpu].count--;
+        break;
+    }
+
+    arch_spin_unlock(lock);
+}
+
+#if WITH_LIB_CONSOLE
+#include <lib/console.h>
+
+static int compare_wait_time(const void *a, const void *b)
+{
+    const struct lockstat_class *ca = *(const struct lockstat_class * const *)a;
+    const struct lockstat_class *cb = *(const struct lockstat_class * const *)b;
+
+    if (ca->wait_time != cb->wait_time)
+        return ca->wait_time < cb->wait_time ? 1 : -1;
+    return ca->contended < cb->contended ? 1 : (ca->contended > cb->contended ? -1 : 0);
+}
+
+static int cmd_lockstat(int argc, const cmd_args *argv, uint32_t flags)
+{
+    static struct lockstat_class *sorted[LOCKSTAT_CLASSES];
+
+    if (argc > 2) {
+    usage:
+        printf("usage:\n");
+        printf("%s [count]  : show the lock classes waited on the longest\n", argv[0].str);
+        printf("%s reset    : clear all counters\n", argv[0].str);
+        return MX_ERR_INTERNAL;
+    }
+
+    if (argc == 2 && !strcmp(argv[1].str, "reset")) {
+        for (uint i = 0; i < LOCKSTAT_CLASSES; i++) {
+            struct lockstat_class *c = &classes[i];
+            c->acquires = c->contended = 0;
+            c->wait_time = c->max_wait_time = 0;
+            c->hold_time = c->max_hold_time = 0;
+        }
+        dropped = 0;
+        return MX_OK;
+    }
+
+    uint max = 20;
+    if (argc == 2) {
+        if (argv[1].u == 0)
+            goto usage;
+        max = (uint)argv[1].u;
+    }
+
+    uint n = 0;
+    for (uint i = 0; i < LOCKSTAT_CLASSES; i++) {
+        if (classes[i].site && classes[i].acquires)
+            sorted[n++] = &classes[i];
+    }
+    qsort(sorted, n, sizeof(sorted[0]), compare_wait_time);
+
+    printf("%18s %4s %18s %10s %10s %10s %8s %10s %8s\n", "site", "kind", "lock", "acquires",
+           "contended", "wait us", "max", "hold us", "max");
+    for (uint i = 0; i < n && i < max; i++) {
+        const struct lockstat_class *c = sorted[i];
+        printf("%#18" PRIxPTR " %4s %18p %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %8" PRIu64
+               " %10" PRIu64 " %8" PRIu64 "\n",
+               c->site, c->kind == LOCKSTAT_KIND_MUTEX ? "mtx" : "spin", c->lock,
+               c->acquires, c->contended, c->wait_time / 1000, c->max_wait_time / 1000,
+               c->hold_time / 1000, c->max_hold_time / 1000);
+    }
+    printf("%u classes, %" PRIu64 " acquisitions not counted\n", n, dropped);
+
+    return MX_OK;
+}
+
+STATIC_COMMAND_START
+STATIC_COMMAND("lockstat", "kernel lock contention statistics", &cmd_lockstat)
+STATIC_COMMAND_END(lockstat);
+
+#endif // WITH_LIB_CONSOLE
@@ -15,9 +15,12 @@
 #include <trace.h>
 #include <arch/mp.h>
 #include <arch/ops.h>
+#include <kernel/cmdline.h>
 #include <kernel/event.h>
 #include <kernel/mp.h>
 #include <kernel/mutex.h>
+#include <kernel/percpu.h>
+#include <kernel/sched.h>
 #include <kernel/spinlock.h>
 #include <kernel/stats.h>
 #include <kernel/timer.h>
@@ -42,6 +45,62 @@ void mp_init(void)
     }
 }
 
+void mp_set_cpu_topology(uint cpu, uint package_id, uint cache_id, uint core_id)
+{
+    static struct {
+        uint package_id;
+        uint cache_id;
+        uint core_id;
+    } topology[SMP_MAX_CPUS];
+    static mp_cpu_mask_t described;
+
+    DEBUG_ASSERT(cpu < SMP_MAX_CPUS);
+
+    LTRACEF("cpu %u: package %u cache %u core %u\n", cpu, package_id, cache_id, core_id);
+
+    topology[cpu].package_id = package_id;
+    topology[cpu].cache_id = cache_id;
+    topology[cpu].core_id = core_id;
+    described |= 1U << cpu;
+
+    /* recompute the sibling masks of everything described so far */
+    mp.smt_siblings[cpu] = 0;
+    mp.cache_siblings[cpu] = 0;
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        if (!(described & (1U << i)) || topology[i].package_id != package_id)
+            continue;
+
+        if (topology[i].core_id == core_id) {
+            mp.smt_siblings[cpu] |= 1U << i;
+            mp.smt_siblings[i] |= 1U << cpu;
+        }
+        if (topology[i].cache_id == cache_id) {
+            mp.cache_siblings[cpu] |= 1U << i;
+            mp.cache_siblings[i] |= 1U << cpu;
+        }
+    }
+}
+
+/* send a reschedule ipi to the cpus in target that haven't already been asked
+ * to reschedule. a cpu that has yet to do so will reschedule after whatever
+ * queued work for it, which has to hold the thread lock it reschedules under.
+ * idle cpus that are polling only need their wake word written */
+static void mp_send_reschedule_ipi(mp_cpu_mask_t target)
+{
+    target &= ~(mp_cpu_mask_t)atomic_or((int *)&mp.reschedule_in_flight, target);
+
+    mp_cpu_mask_t polling = target & mp.polling_cpus;
+    target &= ~polling;
+    while (polling) {
+        uint cpu = __builtin_ctz(polling);
+        polling &= polling - 1;
+        atomic_store((int *)&percpu[cpu].idle_wake, 1);
+    }
+
+    if (target)
+        arch_mp_send_ipi(target, MP_IPI_RESCHEDULE);
+}
+
 void mp_reschedule(mp_cpu_mask_t target, uint flags)
 {
     if (target == 0)
@@ -66,7 +125,65 @@ void mp_reschedule(mp_cpu_mask_t target, uint flags)
 
     LTRACEF("local %u, post mask target now 0x%x\n", local_cpu, target);
 
-    arch_mp_send_ipi(target, MP_IPI_RESCHEDULE);
+    if (target == 0)
+        return;
+
+    /* a thread waking a batch of others sends the ipis once it is done */
+    thread_t *current_thread = get_current_thread();
+    if (current_thread->batch_wakeup && !arch_in_int_handler()) {
+        current_thread->reschedule_deferred |= target;
+        return;
+    }
+
+    /* wakeups are made with the thread lock held, so hold the ipis back until
+     * it is dropped. waking a queue full of threads then costs each cpu one ipi */
+    if (arch_ints_disabled() && spin_lock_holder_cpu(&thread_lock) == local_cpu) {
+        percpu[local_cpu].reschedule_deferred |= target;
+        return;
+    }
+
+    mp_send_reschedule_ipi(target);
+}
+
+void mp_idle(void)
+{
+    static int idle_poll = -1;
+    if (unlikely(idle_poll < 0))
+        idle_poll = cmdline_get_bool("kernel.idle-poll", true);
+
+    uint cpu = arch_curr_cpu_num();
+    struct percpu *c = &percpu[cpu];
+
+    lk_time_t now = current_time();
+    lk_time_t next_timer = c->timer_wheel.next;
+    lk_time_t expected_idle = next_timer > now ? next_timer - now : 0;
+
+    if (!idle_poll || !arch_idle_can_poll(expected_idle)) {
+        arch_idle();
+        return;
+    }
+
+    atomic_or((int *)&mp.polling_cpus, 1U << cpu);
+    arch_idle_poll(&c->idle_wake, expected_idle);
+    atomic_and((int *)&mp.polling_cpus, ~(1U << cpu));
+
+    /* woken the way an ipi would have */
+    if (atomic_swap((int *)&c->idle_wake, 0)) {
+        CPU_STATS_INC(reschedule_polls);
+        thread_preempt();
+    }
+}
+
+void mp_reschedule_flush(void)
+{
+    DEBUG_ASSERT(arch_ints_disabled());
+
+    struct percpu *c = get_local_percpu();
+    mp_cpu_mask_t target = c->reschedule_deferred;
+    if (target) {
+        c->reschedule_deferred = 0;
+        mp_send_reschedule_ipi(target);
+    }
 }
 
 struct mp_sync_context {
@@ -201,8 +318,14 @@ void mp_sync_exec(mp_cpu_mask_t target, mp_sync_task_t task, void *context)
 
 static void mp_unplug_trampoline(void) __NO_RETURN;
 static void mp_unplug_trampoline(void) {
+    /* stop new threads from being queued here, and hand everything still
+     * waiting to run here to the other cpus */
+    mp_set_curr_cpu_active(false);
+    sched_transition_off_cpu(arch_curr_cpu_num());
+
     /* release the thread lock that was implicitly held across the reschedule */
     spin_unlock(&thread_lock);
+    mp_reschedule_flush();
 
     /* do *not* enable interrupts, we want this CPU to never receive another
      * interrupt */
@@ -210,8 +333,6 @@ static void mp_unplug_trampoline(void) {
     thread_t *ct = get_current_thread();
     event_t *unplug_done = ct->arg;
 
-    mp_set_curr_cpu_active(false);
-
     /* Note that before this invocation, but after we stopped accepting
      * interrupts, we may have received a synchronous task to perform.
      * Clearing this flag will cause the mp_sync_exec caller to consider
@@ -343,6 +464,8 @@ void mp_set_curr_cpu_online(bool online)
 void mp_set_curr_cpu_active(bool active)
 {
     if (active) {
+        /* an ipi sent while we were away was never taken */
+        atomic_and((volatile int *)&mp.reschedule_in_flight, ~(1U << arch_curr_cpu_num()));
         atomic_or((volatile int *)&mp.active_cpus, 1U << arch_curr_cpu_num());
     } else {
         atomic_and((volatile int *)&mp.active_cpus, ~(1U << arch_curr_cpu_num()));
@@ -376,6 +499,7 @@ enum handler_return mp_mbx_reschedule_irq(void)
 
     LTRACEF("cpu %u\n", cpu);
 
+    atomic_and((int *)&mp.reschedule_in_flight, ~(1U << cpu));
     CPU_STATS_INC(reschedule_ipis);
 
     return (mp.active_cpus & (1U << cpu)) ? INT_RESCHEDULE : INT_NO_RESCHEDULE;
@@ -22,11 +22,19 @@
 #include <err.h>
 #include <inttypes.h>
 #include <kernel/thread.h>
+#include <kernel/lockstat.h>
+#include <kernel/percpu.h>
 #include <kernel/sched.h>
+#include <kernel/stats.h>
+#include <platform.h>
 #include <trace.h>
 
 #define LOCAL_TRACE 0
 
+/* longest a waiter spins on a running holder before blocking, a little more
+ * than a block and wakeup costs */
+#define MUTEX_SPIN_MAX_DURATION LK_USEC(50)
+
 /**
  * @brief  Initialize a mutex_t
  */
@@ -58,14 +66,56 @@ void mutex_destroy(mutex_t *m)
 #endif
     m->magic = 0;
     m->val = 0;
-    wait_queue_destroy(&m->wait);
+    owned_wait_queue_destroy(&m->wait);
     THREAD_UNLOCK(state);
 }
 
-/**
- * @brief  Acquire the mutex
- */
-void mutex_acquire(mutex_t *m) TA_NO_THREAD_SAFETY_ANALYSIS
+/* spin for a bit while the mutex is held by a thread running on another
+ * cpu, on the bet that it will be released sooner than we could block and be
+ * woken up. returns true if the mutex was acquired. */
+static bool mutex_spin(mutex_t *m, thread_t *ct)
+{
+    lk_time_t start = current_time();
+    lk_time_t now = start;
+    bool acquired = false;
+
+    for (;;) {
+        uintptr_t oldval = mutex_val(m);
+        if (oldval == 0) {
+            if (atomic_cmpxchg_u64(&m->val, &oldval, (uintptr_t)ct)) {
+                acquired = true;
+                break;
+            }
+            continue;
+        }
+
+        // queued waiters are handed the mutex directly on release, so there
+        // is nothing to wait for
+        if (oldval & MUTEX_FLAG_QUEUED)
+            break;
+
+        // only worth it while the holder is running. the holder pointer is
+        // never followed, it may be exiting by now
+        uint cpu = m->owner_cpu;
+        if (cpu >= SMP_MAX_CPUS || percpu[cpu].curr_thread != (thread_t *)oldval)
+            break;
+
+        now = current_time();
+        if (now - start > MUTEX_SPIN_MAX_DURATION)
+            break;
+
+        arch_spinloop_pause();
+    }
+
+    __atomic_fetch_add(&get_local_percpu()->stats.mutex_spin_time, now - start, __ATOMIC_RELAXED);
+    if (acquired)
+        CPU_STATS_INC(mutex_spins);
+
+    return acquired;
+}
+
+// shared implementation of acquire, returns true if it had to wait
+static inline bool mutex_acquire_internal(mutex_t *m) TA_NO_THREAD_SAFETY_ANALYSIS
 {
     DEBUG_ASSERT(m->magic == MUTEX_MAGIC);
     DEBUG_ASSERT(!arch_in_int_handler());
@@ -78,7 +128,8 @@ retry:
     oldval = 0;
     if (likely(atomic_cmpxchg_u64(&m->val, &oldval, (uintptr_t)ct))) {
         // acquired it cleanly
-        return;
+        m->owner_cpu = arch_curr_cpu_num();
+        return false;
     }
 
 #if LK_DEBUGLEVEL > 0
@@ -87,6 +138,11 @@ retry:
               ct, ct->name, m);
 #endif
 
+    if (mutex_spin(m, ct)) {
+        m->owner_cpu = arch_curr_cpu_num();
+        return true;
+    }
+
     // we contended with someone else, will probably need to block
     THREAD_LOCK(state);
 
@@ -105,7 +161,8 @@ retry:
     }
 
     // we have signalled that we're blocking, so drop into the wait queue
-    status_t ret = wait_queue_block(&m->wait, INFINITE_TIME);
+    CPU_STATS_INC(mutex_blocks);
+    status_t ret = owned_wait_queue_block(&m->wait, mutex_holder(m), INFINITE_TIME);
     if (unlikely(ret < MX_OK)) {
         // mutexes are not interruptable and cannot time out, so it
         // is illegal to return with any error state.
@@ -115,8 +172,28 @@ retry:
 
     // someone must have woken us up, we should own the mutex now
     DEBUG_ASSERT(ct == mutex_holder(m));
+    m->owner_cpu = arch_curr_cpu_num();
 
     THREAD_UNLOCK(state);
+    return true;
+}
+
+/**
+ * @brief  Acquire the mutex
+ */
+void mutex_acquire(mutex_t *m) TA_NO_THREAD_SAFETY_ANALYSIS
+{
+#if WITH_LOCK_STATS
+    lk_time_t start = current_time();
+    bool contended = mutex_acquire_internal(m);
+    lk_time_t now = current_time();
+
+    m->stats_class = lockstat_class_for((uintptr_t)__GET_CALLER(), m, LOCKSTAT_KIND_MUTEX);
+    m->stats_acquired = now;
+    lockstat_record_acquire(m->stats_class, m, contended ? now - start : 0, contended);
+#else
+    mutex_acquire_internal(m);
+#endif
 }
 
 // shared implementation of release
@@ -126,6 +203,11 @@ static inline void mutex_release_internal(mutex_t *m, bool reschedule, bool thre
     thread_t *ct = get_current_thread();
     uintptr_t oldval;
 
+#if WITH_LOCK_STATS
+    // the next holder overwrites these as soon as we let go
+    lockstat_record_release(m->stats_class, current_time() - m->stats_acquired);
+#endif
+
     // in case there's no contention, try the fast path
     oldval = (uintptr_t)ct;
     if (likely(atomic_cmpxchg_u64(&m->val, &oldval, 0))) {
@@ -150,12 +232,12 @@ static inline void mutex_release_internal(mutex_t *m, bool reschedule, bool thre
     if (!thread_lock_held)
         spin_lock_irqsave(&thread_lock, state);
 
-    // release a thread in the wait queue
-    thread_t *t = wait_queue_dequeue_one(&m->wait, MX_OK);
+    // release a thread in the wait queue, it takes over the queue along with the mutex
+    thread_t *t = owned_wait_queue_dequeue_one(&m->wait, MX_OK);
     DEBUG_ASSERT_MSG(t, "mutex_release: wait queue didn't have anything, but m->val = %#" PRIxPTR "\n", mutex_val(m));
 
     // we woke up a thread, mark the mutex owned by that thread
-    uintptr_t newval = (uintptr_t)t | (wait_queue_is_empty(&m->wait) ? 0 : MUTEX_FLAG_QUEUED);
+    uintptr_t newval = (uintptr_t)t | (wait_queue_is_empty(&m->wait.wait) ? 0 : MUTEX_FLAG_QUEUED);
 
     oldval = (uintptr_t)ct | MUTEX_FLAG_QUEUED;
     if (!atomic_cmpxchg_u64(&m->val, &oldval, newval)) {
@@ -169,7 +251,7 @@ static inline void mutex_release_internal(mutex_t *m, bool reschedule, bool thre
 
     // conditionally THREAD_UNLOCK
     if (!thread_lock_held)
-        spin_unlock_irqrestore(&thread_lock, state);
+        THREAD_UNLOCK(state);
 }
 
 void mutex_release(mutex_t *m) TA_NO_THREAD_SAFETY_ANALYSIS
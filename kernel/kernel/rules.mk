@@ -29,6 +29,10 @@ MODULE_SRCS := \
 	$(LOCAL_DIR)/mp.c \
 	$(LOCAL_DIR)/cmdline.c \
 
+ifeq ($(call TOBOOL,$(ENABLE_LOCK_STATS)),true)
+MODULE_SRCS += $(LOCAL_DIR)/lockstat.c
+endif
+
 MODULE_DEPS += kernel/kernel/vm
 
 include make/module.mk
@@ -16,38 +16,40 @@
 #include <lib/ktrace.h>
 #include <kernel/mp.h>
 #include <kernel/percpu.h>
+#include <kernel/stats.h>
 #include <kernel/thread.h>
-
-/* legacy implementation that just broadcast ipis for every reschedule */
-#define BROADCAST_RESCHEDULE 0
+#include <kernel/timer.h>
+#include <platform.h>
 
 /* disable priority boosting */
 #define NO_BOOST 0
 
 #define MAX_PRIORITY_ADJ 4 /* +/- priority levels from the base priority */
 
-/* ktraces just local to this file */
-#define LOCAL_KTRACE 0
+/* ktraces just local to this file, off until switched on through the ktrace
+ * device (sched_*) */
+#define LOCAL_KTRACE0(probe) ktrace_probe0_etc(probe, KTRACE_PROBE_OFF)
+#define LOCAL_KTRACE2(probe, x, y) ktrace_probe2_etc(probe, KTRACE_PROBE_OFF, x, y)
+
+/* how often a busy cpu looks for a more loaded cpu to pull a thread from */
+#define BALANCE_INTERVAL LK_MSEC(20)
 
-#if LOCAL_KTRACE
-#define LOCAL_KTRACE0(probe) ktrace_probe0(probe)
-#define LOCAL_KTRACE2(probe, x, y) ktrace_probe2(probe, x, y)
-#else
-#define LOCAL_KTRACE0(probe)
-#define LOCAL_KTRACE2(probe, x, y)
-#endif
+/* limits on deadline thread parameters */
+#define DEADLINE_MIN_RUNTIME LK_USEC(10)
+#define DEADLINE_MAX_PERIOD LK_SEC(10)
 
-/* the run queue */
-static struct list_node run_queue[NUM_PRIORITIES];
-static uint32_t run_queue_bitmap;
+/* share of each cpu, in parts per million, that deadline threads can be
+ * admitted for. the rest is left for everything else */
+#define DEADLINE_MAX_DENSITY (900000u)
 
 /* make sure the bitmap is large enough to cover our number of priorities */
-static_assert(NUM_PRIORITIES <= sizeof(run_queue_bitmap) * CHAR_BIT, "");
+static_assert(NUM_PRIORITIES <= sizeof(((struct percpu *)0)->run_queue_bitmap) * CHAR_BIT, "");
 
-/* compute the effective priority of a thread */
+/* compute the effective priority of a thread, including any it inherits
+ * from the threads waiting on it */
 static int effec_priority(const thread_t *t)
 {
-    int ep = t->base_priority + t->priority_boost;
+    int ep = MAX(t->base_priority + t->priority_boost, t->inherited_priority);
     DEBUG_ASSERT(ep >= LOWEST_PRIORITY && ep <= HIGHEST_PRIORITY);
     return ep;
 }
@@ -64,6 +66,7 @@ static void boost_thread(thread_t *t)
     if (t->priority_boost < MAX_PRIORITY_ADJ &&
         likely((t->base_priority + t->priority_boost) < HIGHEST_PRIORITY)) {
         t->priority_boost++;
+        LOCAL_KTRACE2("sched_boost", (uint32_t)t->user_tid, t->priority_boost);
     }
 }
 
@@ -99,6 +102,7 @@ static void deboost_thread(thread_t *t, bool quantum_expiration)
 
     /* drop a level */
     t->priority_boost--;
+    LOCAL_KTRACE2("sched_deboost", (uint32_t)t->user_tid, t->priority_boost);
 }
 
 /* pick a 'random' cpu */
@@ -128,96 +132,724 @@ static mp_cpu_mask_t rand_cpu(const mp_cpu_mask_t mask)
     }
 }
 
-/* find a cpu to wake up */
-static mp_cpu_mask_t find_cpu(thread_t *t)
+/* can the thread run on the given cpu */
+static bool thread_can_run_on(const thread_t *t, uint cpu)
+{
+    return likely(t->pinned_cpu < 0) || (uint)t->pinned_cpu == cpu;
+}
+
+/* the cpus in mask whose core has no busy hyperthread */
+static mp_cpu_mask_t idle_core_cpus(mp_cpu_mask_t mask, mp_cpu_mask_t idle)
+{
+    mp_cpu_mask_t result = 0;
+    for (mp_cpu_mask_t m = mask; m; m &= m - 1) {
+        uint cpu = __builtin_ctz(m);
+        if ((mp_get_smt_siblings(cpu) & ~idle) == 0)
+            result |= 1u << cpu;
+    }
+    return result;
+}
+
+/* pick a cpu out of mask, out of the preferred ones if there are any */
+static mp_cpu_mask_t rand_cpu_prefer(mp_cpu_mask_t mask, mp_cpu_mask_t preferred)
 {
-    if (BROADCAST_RESCHEDULE)
-        return MP_CPU_ALL_BUT_LOCAL;
+    if (mask & preferred)
+        return rand_cpu(mask & preferred);
+    return rand_cpu(mask);
+}
+
+/* find a cpu to run a thread that is being woken up */
+static uint find_cpu(thread_t *t)
+{
+    uint curr_cpu = arch_curr_cpu_num();
+
+    /* deadline and pinned threads only have one place to go */
+    if (unlikely(thread_is_deadline(t)))
+        return t->deadline.cpu;
+    if (unlikely(t->pinned_cpu >= 0))
+        return t->pinned_cpu;
+
+    /* don't queue on cpus that are running realtime code, they won't look at
+     * their run queue until the realtime thread gives up the cpu */
+    mp_cpu_mask_t candidates = mp_get_active_mask() & ~mp_get_realtime_mask();
 
     /* get the last cpu the thread ran on */
-    mp_cpu_mask_t last_ran_cpu_mask = (1u << thread_last_cpu(t));
+    mp_cpu_mask_t last_ran_cpu_mask = (1u << thread_last_cpu(t)) & candidates;
 
     /* the current cpu */
-    mp_cpu_mask_t curr_cpu_mask = (1u << arch_curr_cpu_num());
+    mp_cpu_mask_t curr_cpu_mask = (1u << curr_cpu);
 
     /* get a list of idle cpus */
-    mp_cpu_mask_t idle_cpu_mask = mp_get_idle_mask();
+    mp_cpu_mask_t idle_cpu_mask = mp_get_idle_mask() & candidates;
+    /* cpus sharing a cache with us, a thread we just woke is likely to be
+     * talking to us and will find the data it needs nearby */
+    mp_cpu_mask_t near = mp_get_cache_siblings(curr_cpu);
+
+    mp_cpu_mask_t target;
     if (idle_cpu_mask != 0) {
+        /* idle cpus whose hyperthread siblings are idle too, a whole core
+         * beats half of a busy one */
+        mp_cpu_mask_t idle_cores = idle_core_cpus(idle_cpu_mask, mp_get_idle_mask());
+
         if (idle_cpu_mask & curr_cpu_mask) {
             /* the current cpu is idle, so run it here */
-            return 0;
-        }
-
-        if (last_ran_cpu_mask & idle_cpu_mask) {
+            target = curr_cpu_mask;
+        } else if (last_ran_cpu_mask & idle_cores) {
             /* the last core it ran on is idle and isn't the current cpu */
-            return last_ran_cpu_mask;
+            target = last_ran_cpu_mask;
+        } else if (idle_cores) {
+            /* pick an idle core */
+            target = rand_cpu_prefer(idle_cores, near);
+        } else if (last_ran_cpu_mask & idle_cpu_mask) {
+            /* only idle hyperthreads left, the last one it ran on is warmest */
+            target = last_ran_cpu_mask;
+        } else {
+            /* pick an idle_cpu */
+            target = rand_cpu_prefer(idle_cpu_mask, near);
         }
+    } else if (last_ran_cpu_mask != 0 && last_ran_cpu_mask != curr_cpu_mask) {
+        /* no idle cpus, pick the last cpu it ran on */
+        target = last_ran_cpu_mask;
+    } else {
+        /* the last cpu it ran on is us (or is gone) */
+        /* pick a random cpu that isn't the current one, one nearby if possible */
+        target = rand_cpu_prefer(candidates & ~curr_cpu_mask, near);
+    }
+
+    /* fall back to the current cpu if nothing else will do */
+    if (target == 0)
+        return curr_cpu;
+
+    return __builtin_ctz(target);
+}
+
+/* the cpu a thread that was running here goes back to when it stops running */
+static uint local_queue_cpu(const thread_t *t)
+{
+    if (unlikely(thread_is_deadline(t)))
+        return t->deadline.cpu;
+    if (unlikely(t->pinned_cpu >= 0))
+        return t->pinned_cpu;
+
+    return arch_curr_cpu_num();
+}
 
-        /* pick an idle_cpu */
-        return rand_cpu(idle_cpu_mask);
+/* the time a throttled deadline thread gets its budget back */
+static lk_time_t deadline_replenish_time(const thread_t *t)
+{
+    return t->deadline.absolute_deadline - t->deadline.relative_deadline + t->deadline.period;
+}
+
+/* deadline threads go in their cpu's queue in deadline order, or wait out the
+ * rest of their period if they have no budget left */
+static void insert_in_deadline_queue(thread_t *t)
+{
+    DEBUG_ASSERT(!list_in_list(&t->queue_node));
+
+    struct percpu *c = &percpu[t->deadline.cpu];
+    t->run_queue_cpu = t->deadline.cpu;
+
+    if (t->deadline.budget == 0) {
+        list_add_tail(&c->deadline_throttled, &t->queue_node);
+        return;
     }
 
-    /* no idle cpus */
-    if (last_ran_cpu_mask == curr_cpu_mask) {
-        /* the last cpu it ran on is us */
-        /* pick a random cpu that isn't the current one */
-        return rand_cpu(mp_get_online_mask() & ~(curr_cpu_mask));
-    } else {
-        /* pick the last cpu it ran on */
-        return last_ran_cpu_mask;
+    thread_t *entry;
+    list_for_every_entry(&c->deadline_queue, entry, thread_t, queue_node) {
+        if (entry->deadline.absolute_deadline > t->deadline.absolute_deadline) {
+            list_add_before(&entry->queue_node, &t->queue_node);
+            return;
+        }
     }
+    list_add_tail(&c->deadline_queue, &t->queue_node);
 }
 
 /* run queue manipulation */
-static void insert_in_run_queue_head(thread_t *t)
+static void insert_in_run_queue_head(uint cpu, thread_t *t)
 {
     DEBUG_ASSERT(!list_in_list(&t->queue_node));
 
+    if (unlikely(thread_is_deadline(t))) {
+        insert_in_deadline_queue(t);
+        return;
+    }
+
+    struct percpu *c = &percpu[cpu];
     int ep = effec_priority(t);
 
-    list_add_head(&run_queue[ep], &t->queue_node);
-    run_queue_bitmap |= (1u << ep);
+    t->run_queue_cpu = cpu;
+    list_add_head(&c->run_queue[ep], &t->queue_node);
+    c->run_queue_bitmap |= (1u << ep);
+    c->run_queue_len++;
 }
 
-static void insert_in_run_queue_tail(thread_t *t)
+static void insert_in_run_queue_tail(uint cpu, thread_t *t)
 {
     DEBUG_ASSERT(!list_in_list(&t->queue_node));
 
+    if (unlikely(thread_is_deadline(t))) {
+        insert_in_deadline_queue(t);
+        return;
+    }
+
+    struct percpu *c = &percpu[cpu];
     int ep = effec_priority(t);
 
-    list_add_tail(&run_queue[ep], &t->queue_node);
-    run_queue_bitmap |= (1u << ep);
+    t->run_queue_cpu = cpu;
+    list_add_tail(&c->run_queue[ep], &t->queue_node);
+    c->run_queue_bitmap |= (1u << ep);
+    c->run_queue_len++;
 }
 
-thread_t *sched_get_top_thread(uint cpu)
+static void remove_from_run_queue(uint cpu, thread_t *t)
+{
+    DEBUG_ASSERT(list_in_list(&t->queue_node));
+
+    struct percpu *c = &percpu[cpu];
+    int ep = effec_priority(t);
+
+    list_delete(&t->queue_node);
+    if (list_is_empty(&c->run_queue[ep]))
+        c->run_queue_bitmap &= ~(1u << ep);
+    c->run_queue_len--;
+
+    /* it is running or moving somewhere else, the handoff is off */
+    if (unlikely(c->handoff_to == t))
+        c->handoff_to = c->handoff_from = NULL;
+}
+
+/* take a ready thread off of whichever queue it is on */
+static void remove_ready_thread(thread_t *t)
+{
+    DEBUG_ASSERT(t->state == THREAD_READY);
+
+    if (thread_is_deadline(t)) {
+        list_delete(&t->queue_node);
+    } else {
+        remove_from_run_queue(t->run_queue_cpu, t);
+    }
+}
+
+/* put the thread that was running on this cpu back on its queue, and poke
+ * the cpu that queue belongs to if it isn't this one */
+static void requeue_current_thread(thread_t *t, bool head)
+{
+    uint cpu = local_queue_cpu(t);
+    if (head) {
+        insert_in_run_queue_head(cpu, t);
+    } else {
+        insert_in_run_queue_tail(cpu, t);
+    }
+
+    if (unlikely(cpu != arch_curr_cpu_num()))
+        mp_reschedule(1u << cpu, thread_is_deadline(t) ? MP_RESCHEDULE_FLAG_REALTIME : 0);
+}
+
+/* the highest effective priority of any thread waiting on a queue the thread
+ * owns, or -1 if there are none */
+static int highest_waiter_priority(const thread_t *t)
+{
+    int pri = -1;
+
+    owned_wait_queue_t *q;
+    list_for_every_entry(&t->owned_wait_queues, q, owned_wait_queue_t, owner_node) {
+        thread_t *waiter;
+        list_for_every_entry(&q->wait.list, waiter, thread_t, queue_node) {
+            pri = MAX(pri, effec_priority(waiter));
+        }
+    }
+
+    return pri;
+}
+
+/* recompute the priority a thread inherits after the set of threads waiting
+ * on it changed, and pass the change along the chain of owners it is in turn
+ * blocked on. a ready thread is moved to the run queue of its new priority */
+void sched_update_inherited_priority(thread_t *t)
+{
+    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+
+    while (t) {
+        DEBUG_ASSERT(t->magic == THREAD_MAGIC);
+
+        int inherited = highest_waiter_priority(t);
+        if (inherited == t->inherited_priority)
+            return;
+
+        int old_ep = effec_priority(t);
+        if (t->state == THREAD_READY && !thread_is_deadline(t)) {
+            /* the run queue a thread is on is picked by its priority */
+            uint cpu = t->run_queue_cpu;
+            remove_from_run_queue(cpu, t);
+            t->inherited_priority = inherited;
+            insert_in_run_queue_tail(cpu, t);
+
+            if (cpu != arch_curr_cpu_num())
+                mp_reschedule(1u << cpu, 0);
+        } else {
+            t->inherited_priority = inherited;
+
+            /* a thread running elsewhere that lost priority may need to make
+             * way for something already queued there */
+            if (t->state == THREAD_RUNNING && t->last_cpu != arch_curr_cpu_num() &&
+                effec_priority(t) < old_ep)
+                mp_reschedule(1u << t->last_cpu, 0);
+        }
+
+        LOCAL_KTRACE2("sched_inherit", old_ep, effec_priority(t));
+
+        if (effec_priority(t) == old_ep)
+            return;
+
+        /* the owner of whatever we are blocked on inherits from us in turn. a
+         * cycle of owners settles once the priorities stop changing */
+        wait_queue_t *wait = t->blocking_wait_queue;
+        if (t->state != THREAD_BLOCKED || !wait || !(wait->flags & WAIT_QUEUE_FLAG_OWNED))
+            return;
+        t = containerof(wait, owned_wait_queue_t, wait)->owner;
+    }
+}
+
+/* charge a deadline thread for the time it has run since it was last charged */
+static void deadline_charge(thread_t *t, lk_time_t now)
+{
+    lk_time_t start = MAX(t->deadline.charged_until, t->last_started_running);
+    if (now > start)
+        t->deadline.budget -= MIN(now - start, t->deadline.budget);
+    t->deadline.charged_until = now;
+
+    /* it was put back in the queue before we knew it had run dry */
+    if (t->deadline.budget == 0 && t->state == THREAD_READY) {
+        list_delete(&t->queue_node);
+        insert_in_deadline_queue(t);
+    }
+}
+
+/* a deadline thread waking up keeps what is left of its budget and deadline,
+ * unless running out the budget by the deadline would take more than its
+ * share of the cpu, in which case it starts a new period now */
+static void deadline_wakeup(thread_t *t, lk_time_t now)
+{
+    if (now >= t->deadline.absolute_deadline ||
+        (t->deadline.budget * 1000000u) / (t->deadline.absolute_deadline - now) >
+            t->deadline.density) {
+        t->deadline.absolute_deadline = now + t->deadline.relative_deadline;
+        t->deadline.budget = t->deadline.runtime;
+    }
+    t->deadline.charged_until = now;
+}
+
+/* both deadline timers just get the cpu to come back through the scheduler */
+static enum handler_return deadline_timer_expired(timer_t *timer, lk_time_t now, void *arg)
+{
+    return INT_RESCHEDULE;
+}
+
+/* give threads that have waited out their period their budget back, and
+ * make sure the replenish timer will fire for the next one. must be called
+ * on cpu itself, since that is where the timer lives */
+static void deadline_replenish(uint cpu, lk_time_t now)
 {
-    thread_t *newthread;
-    uint32_t local_run_queue_bitmap = run_queue_bitmap;
+    struct percpu *c = &percpu[cpu];
 
-    while (local_run_queue_bitmap) {
-        /* find the first (remaining) queue with a thread in it */
-        uint next_queue = HIGHEST_PRIORITY - __builtin_clz(local_run_queue_bitmap)
-                          - (sizeof(run_queue_bitmap) * CHAR_BIT - NUM_PRIORITIES);
+    lk_time_t next = 0;
+    thread_t *t;
+    thread_t *temp;
+    list_for_every_entry_safe(&c->deadline_throttled, t, temp, thread_t, queue_node) {
+        lk_time_t replenish = deadline_replenish_time(t);
+        if (replenish <= now) {
+            list_delete(&t->queue_node);
+            t->deadline.absolute_deadline = replenish + t->deadline.relative_deadline;
+            t->deadline.budget = t->deadline.runtime;
+            insert_in_deadline_queue(t);
+        } else if (next == 0 || replenish < next) {
+            next = replenish;
+        }
+    }
+
+    if (next == c->deadline_replenish_time)
+        return;
+
+    if (c->deadline_replenish_time != 0)
+        timer_cancel(&c->deadline_replenish_timer);
+    if (next != 0)
+        timer_set_oneshot(&c->deadline_replenish_timer, next, deadline_timer_expired, NULL);
+    c->deadline_replenish_time = next;
+}
 
-        list_for_every_entry(&run_queue[next_queue], newthread, thread_t, queue_node) {
-            if (likely(newthread->pinned_cpu < 0) || (uint)newthread->pinned_cpu == cpu) {
-                list_delete(&newthread->queue_node);
+/* pick the deadline thread with the earliest deadline and set the budget
+ * timer to take the cpu back when it runs out */
+static thread_t *deadline_pick(uint cpu, lk_time_t now)
+{
+    struct percpu *c = &percpu[cpu];
+
+    thread_t *t = list_remove_head_type(&c->deadline_queue, thread_t, queue_node);
 
-                if (list_is_empty(&run_queue[next_queue]))
-                    run_queue_bitmap &= ~(1<<next_queue);
+    if (c->deadline_budget_timer_armed) {
+        timer_cancel(&c->deadline_budget_timer);
+        c->deadline_budget_timer_armed = false;
+    }
+    if (t) {
+        timer_set_oneshot(&c->deadline_budget_timer, now + t->deadline.budget,
+                          deadline_timer_expired, NULL);
+        c->deadline_budget_timer_armed = true;
+    }
 
-                LOCAL_KTRACE2("sched_get_top", newthread->priority_boost, newthread->base_priority);
+    return t;
+}
+
+/* room left on a cpu for deadline threads, not counting what t holds there already */
+static uint32_t deadline_room(const thread_t *t, uint cpu)
+{
+    uint32_t used = percpu[cpu].deadline_density;
+    if (thread_is_deadline(t) && t->deadline.cpu == cpu)
+        used -= t->deadline.density;
 
-                return newthread;
+    return DEADLINE_MAX_DENSITY - MIN(used, DEADLINE_MAX_DENSITY);
+}
+
+/* admission control, find a cpu that can fit another density worth of
+ * deadline threads. deadline threads are never migrated, so each cpu's
+ * threads only need to fit on that cpu */
+static bool deadline_find_cpu(const thread_t *t, uint32_t density, uint *cpu_out)
+{
+    mp_cpu_mask_t active = mp_get_active_mask() | (1u << arch_curr_cpu_num());
+    if (t->pinned_cpu >= 0) {
+        *cpu_out = t->pinned_cpu;
+        return (active & (1u << t->pinned_cpu)) && deadline_room(t, t->pinned_cpu) >= density;
+    }
+
+    /* stay where the thread is if it fits, otherwise the first cpu it fits on */
+    uint preferred = thread_is_deadline(t) ? t->deadline.cpu : thread_last_cpu(t);
+    if ((active & (1u << preferred)) && deadline_room(t, preferred) >= density) {
+        *cpu_out = preferred;
+        return true;
+    }
+
+    for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        if ((active & (1u << cpu)) && deadline_room(t, cpu) >= density) {
+            *cpu_out = cpu;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* highest priority level with a thread in the bitmap, or -1 */
+static int highest_queue(uint32_t bitmap)
+{
+    if (bitmap == 0)
+        return -1;
+
+    return HIGHEST_PRIORITY - __builtin_clz(bitmap)
+           - (sizeof(bitmap) * CHAR_BIT - NUM_PRIORITIES);
+}
+
+/* find the highest priority thread in queue_cpu's run queue that may run on cpu,
+ * ignoring anything below min_priority */
+static thread_t *find_thread_in_queue(uint queue_cpu, uint cpu, int min_priority)
+{
+    struct percpu *c = &percpu[queue_cpu];
+    uint32_t local_run_queue_bitmap = c->run_queue_bitmap;
+
+    int next_queue;
+    while ((next_queue = highest_queue(local_run_queue_bitmap)) >= min_priority) {
+        thread_t *t;
+        list_for_every_entry(&c->run_queue[next_queue], t, thread_t, queue_node) {
+            if (thread_can_run_on(t, cpu))
+                return t;
+        }
+
+        local_run_queue_bitmap &= ~(1u << next_queue);
+    }
+
+    return NULL;
+}
+
+/* take the highest priority thread that can run here off of any other cpu's
+ * run queue, called when this cpu has nothing of its own to run */
+static thread_t *steal_thread(uint cpu)
+{
+    thread_t *best = NULL;
+    uint best_cpu = 0;
+
+    /* look at the cpus sharing a cache with this one first, so that they
+     * win ties and the stolen thread finds some of its data still around */
+    mp_cpu_mask_t near = mp_get_cache_siblings(cpu);
+    for (uint pass = 0; pass < 2; pass++) {
+        for (uint i = 1; i < SMP_MAX_CPUS; i++) {
+            uint victim = (cpu + i) % SMP_MAX_CPUS;
+
+            if (!!(near & (1u << victim)) != (pass == 0))
+                continue;
+            if (percpu[victim].run_queue_len == 0)
+                continue;
+
+            thread_t *t = find_thread_in_queue(victim, cpu,
+                                               best ? effec_priority(best) + 1 : LOWEST_PRIORITY);
+            if (t) {
+                best = t;
+                best_cpu = victim;
             }
         }
+    }
+
+    if (best) {
+        remove_from_run_queue(best_cpu, best);
+        CPU_STATS_INC(steals);
+        LOCAL_KTRACE2("sched_steal", best_cpu, cpu);
+    }
+
+    return best;
+}
+
+/* every so often pull a thread over from the most loaded cpu, if it has at
+ * least two more threads waiting than this one */
+static void balance_run_queues(uint cpu, lk_time_t now)
+{
+    struct percpu *c = &percpu[cpu];
 
-        local_run_queue_bitmap &= ~(1<<next_queue);
+    if (now < c->next_balance)
+        return;
+    c->next_balance = now + BALANCE_INTERVAL;
+
+    uint busiest_cpu = cpu;
+    uint busiest_len = c->run_queue_len + 1;
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        if (percpu[i].run_queue_len > busiest_len) {
+            busiest_cpu = i;
+            busiest_len = percpu[i].run_queue_len;
+        }
     }
+    if (busiest_cpu == cpu)
+        return;
+
+    thread_t *t = find_thread_in_queue(busiest_cpu, cpu, LOWEST_PRIORITY);
+    if (!t)
+        return;
+
+    remove_from_run_queue(busiest_cpu, t);
+    insert_in_run_queue_tail(cpu, t);
+
+    CPU_STATS_INC(balances);
+    LOCAL_KTRACE2("sched_balance", busiest_cpu, cpu);
+}
+
+/* queue a thread the current thread is waking synchronously on this cpu, to
+ * be run in its place the next time it blocks. returns false if t should go
+ * through find_cpu() like any other wakeup */
+static bool sync_wakeup(thread_t *t)
+{
+    thread_t *current_thread = get_current_thread();
+    uint cpu = arch_curr_cpu_num();
+    struct percpu *c = &percpu[cpu];
+
+    if (likely(!current_thread->sync_wakeup) || arch_in_int_handler())
+        return false;
+    if (thread_is_deadline(t) || !thread_can_run_on(t, cpu) || !mp_is_cpu_active(cpu))
+        return false;
+    /* only the first thread woken gets the cpu, the rest spread out as usual */
+    if (c->handoff_to)
+        return false;
+
+    insert_in_run_queue_head(cpu, t);
+    c->handoff_to = t;
+    c->handoff_from = current_thread;
+
+    LOCAL_KTRACE2("sched_sync_wakeup", (uint32_t)t->user_tid, cpu);
+    return true;
+}
+
+void sched_sync_wakeup_cancel(void)
+{
+    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+
+    uint cpu = arch_curr_cpu_num();
+    struct percpu *c = &percpu[cpu];
+    thread_t *t = c->handoff_to;
+    if (!t || c->handoff_from != get_current_thread())
+        return;
+
+    /* clears the handoff */
+    remove_from_run_queue(cpu, t);
+
+    uint target = find_cpu(t);
+    insert_in_run_queue_head(target, t);
+
+    LOCAL_KTRACE2("sched_sync_wakeup_cancel", (uint32_t)t->user_tid, target);
+    mp_reschedule(1u << target, 0);
+}
+
+/* give what is left of the blocking thread's quantum to the thread it handed
+ * its cpu to, so that a call and its reply run on one time slice */
+static void donate_time_slice(thread_t *from, thread_t *to, lk_time_t now)
+{
+    if (thread_is_real_time_or_idle(from) || thread_is_real_time_or_idle(to))
+        return;
+
+    lk_time_t ran = now - from->last_started_running;
+    lk_time_t left = from->remaining_time_slice - MIN(ran, from->remaining_time_slice);
+    if (left == 0)
+        return;
+
+    to->remaining_time_slice = left;
+    from->remaining_time_slice = 0;
+}
+
+thread_t *sched_get_top_thread(uint cpu)
+{
+    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+
+    lk_time_t now = current_time();
+    struct percpu *c = &percpu[cpu];
+
+    /* a handoff is only good for the reschedule right after the wakeup, and
+     * only if the thread that made it is the one giving up the cpu */
+    thread_t *current_thread = get_current_thread();
+    thread_t *handoff = NULL;
+    if (c->handoff_to) {
+        if (c->handoff_from == current_thread)
+            handoff = c->handoff_to;
+        c->handoff_to = c->handoff_from = NULL;
+    }
+
+    /* settle up with the deadline thread that was running here, if any */
+    if (unlikely(thread_is_deadline(current_thread)))
+        deadline_charge(current_thread, now);
+
+    /* deadline threads run ahead of everything else */
+    deadline_replenish(cpu, now);
+    thread_t *newthread = deadline_pick(cpu, now);
+    if (newthread) {
+        LOCAL_KTRACE2("sched_get_top_deadline", (uint32_t)newthread->deadline.budget, cpu);
+        return newthread;
+    }
+
+    /* run the synchronously woken thread directly unless something more
+     * important has turned up since it was queued */
+    if (handoff && effec_priority(handoff) >= highest_queue(c->run_queue_bitmap)) {
+        DEBUG_ASSERT(handoff->state == THREAD_READY && handoff->run_queue_cpu == cpu);
+
+        remove_from_run_queue(cpu, handoff);
+        if (current_thread->state != THREAD_READY)
+            donate_time_slice(current_thread, handoff, now);
+
+        CPU_STATS_INC(handoffs);
+        LOCAL_KTRACE2("sched_handoff", (uint32_t)handoff->remaining_time_slice, cpu);
+        return handoff;
+    }
+
+    balance_run_queues(cpu, now);
+
+    newthread = find_thread_in_queue(cpu, cpu, LOWEST_PRIORITY);
+    if (likely(newthread)) {
+        remove_from_run_queue(cpu, newthread);
+    } else {
+        newthread = steal_thread(cpu);
+    }
+
+    if (newthread) {
+        LOCAL_KTRACE2("sched_get_top", newthread->priority_boost, newthread->base_priority);
+        return newthread;
+    }
+
     /* no threads to run, select the idle thread for this cpu */
     return &percpu[cpu].idle_thread;
 }
 
+/* move the threads queued on a cpu that is going offline to the other cpus */
+void sched_transition_off_cpu(uint old_cpu)
+{
+    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+
+    mp_cpu_mask_t others = mp_get_active_mask() & ~(1u << old_cpu);
+    if (others == 0)
+        return;
+
+    struct percpu *c = &percpu[old_cpu];
+    for (uint i = 0; i < NUM_PRIORITIES; i++) {
+        thread_t *t;
+        thread_t *temp;
+        list_for_every_entry_safe(&c->run_queue[i], t, temp, thread_t, queue_node) {
+            /* threads pinned here have nowhere else to go */
+            if (t->pinned_cpu >= 0)
+                continue;
+
+            mp_cpu_mask_t target = rand_cpu(others);
+            if (target == 0)
+                return;
+
+            uint cpu = __builtin_ctz(target);
+            remove_from_run_queue(old_cpu, t);
+            insert_in_run_queue_tail(cpu, t);
+            mp_reschedule(target, 0);
+        }
+    }
+}
+
+status_t sched_set_deadline(thread_t *t, lk_time_t runtime, lk_time_t relative_deadline,
+                            lk_time_t period)
+{
+    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+
+    if (runtime != 0 &&
+        (runtime < DEADLINE_MIN_RUNTIME || runtime > relative_deadline ||
+         relative_deadline > period || period > DEADLINE_MAX_PERIOD))
+        return MX_ERR_INVALID_ARGS;
+
+    if (thread_is_idle(t) || t->state == THREAD_DEATH)
+        return MX_ERR_BAD_STATE;
+
+    /* admission control. the density is rounded up, so that the densities
+     * admitted on a cpu never add up to less than they really need. a request
+     * which doesn't fit changes nothing */
+    uint32_t density = 0;
+    uint cpu = 0;
+    if (runtime != 0) {
+        density = (uint32_t)((runtime * 1000000u + relative_deadline - 1) / relative_deadline);
+        if (!deadline_find_cpu(t, density, &cpu))
+            return MX_ERR_NO_RESOURCES;
+    }
+
+    bool queued = (t->state == THREAD_READY);
+    if (queued)
+        remove_ready_thread(t);
+
+    if (thread_is_deadline(t))
+        percpu[t->deadline.cpu].deadline_density -= t->deadline.density;
+
+    if (runtime != 0) {
+        lk_time_t now = current_time();
+
+        percpu[cpu].deadline_density += density;
+        t->deadline.runtime = runtime;
+        t->deadline.relative_deadline = relative_deadline;
+        t->deadline.period = period;
+        t->deadline.absolute_deadline = now + relative_deadline;
+        t->deadline.budget = runtime;
+        t->deadline.charged_until = now;
+        t->deadline.cpu = cpu;
+        t->deadline.density = density;
+        t->flags |= THREAD_FLAG_DEADLINE;
+    } else {
+        t->flags &= ~THREAD_FLAG_DEADLINE;
+    }
+
+    LOCAL_KTRACE2("sched_set_deadline", (uint32_t)runtime, density);
+
+    if (queued) {
+        cpu = find_cpu(t);
+        insert_in_run_queue_head(cpu, t);
+        mp_reschedule(1u << cpu, MP_RESCHEDULE_FLAG_REALTIME);
+    } else if (t->state == THREAD_RUNNING) {
+        /* get it to move to its new queue */
+        mp_reschedule(1u << thread_last_cpu(t), MP_RESCHEDULE_FLAG_REALTIME);
+    }
+
+    return MX_OK;
+}
+
 void sched_block(void)
 {
     DEBUG_ASSERT(spin_lock_held(&thread_lock));
@@ -244,11 +876,20 @@ void sched_unblock(thread_t *t)
     /* thread is being woken up, boost its priority */
     boost_thread(t);
 
+    if (unlikely(thread_is_deadline(t)))
+        deadline_wakeup(t, current_time());
+
     /* stuff the new thread in the run queue */
     t->state = THREAD_READY;
-    insert_in_run_queue_head(t);
 
-    mp_reschedule(find_cpu(t), 0);
+    /* the waker is about to block on it, no other cpu needs bothering */
+    if (sync_wakeup(t))
+        return;
+
+    uint cpu = find_cpu(t);
+    insert_in_run_queue_head(cpu, t);
+
+    mp_reschedule(1u << cpu, thread_is_deadline(t) ? MP_RESCHEDULE_FLAG_REALTIME : 0);
 }
 
 void sched_unblock_list(struct list_node *list)
@@ -267,11 +908,15 @@ void sched_unblock_list(struct list_node *list)
         /* thread is being woken up, boost its priority */
         boost_thread(t);
 
+        if (unlikely(thread_is_deadline(t)))
+            deadline_wakeup(t, current_time());
+
         /* stuff the new thread in the run queue */
         t->state = THREAD_READY;
-        insert_in_run_queue_head(t);
+        uint cpu = find_cpu(t);
+        insert_in_run_queue_head(cpu, t);
 
-        mp_reschedule(find_cpu(t), 0);
+        mp_reschedule(1u << cpu, thread_is_deadline(t) ? MP_RESCHEDULE_FLAG_REALTIME : 0);
     }
 }
 
@@ -289,7 +934,12 @@ void sched_yield(void)
     /* consume the rest of the time slice, deboost ourself, and go to the end of the queue */
     current_thread->remaining_time_slice = 0;
     deboost_thread(current_thread, false);
-    insert_in_run_queue_tail(current_thread);
+
+    /* deadline threads give up the rest of this period's budget */
+    if (unlikely(thread_is_deadline(current_thread)))
+        current_thread->deadline.budget = 0;
+
+    requeue_current_thread(current_thread, false);
 
     _thread_resched_internal();
 }
@@ -308,11 +958,11 @@ void sched_preempt(void)
     /* idle thread doesn't go in the run queue */
     if (likely(!thread_is_idle(current_thread))) {
         if (current_thread->remaining_time_slice > 0) {
-            insert_in_run_queue_head(current_thread);
+            requeue_current_thread(current_thread, true);
         } else {
             /* if we're out of quantum, deboost the thread and put it at the tail of the queue */
             deboost_thread(current_thread, true);
-            insert_in_run_queue_tail(current_thread);
+            requeue_current_thread(current_thread, false);
         }
     }
 
@@ -337,9 +987,9 @@ void sched_reschedule(void)
         deboost_thread(current_thread, false);
 
         if (current_thread->remaining_time_slice > 0) {
-            insert_in_run_queue_head(current_thread);
+            requeue_current_thread(current_thread, true);
         } else {
-            insert_in_run_queue_tail(current_thread);
+            requeue_current_thread(current_thread, false);
         }
     }
 
@@ -349,7 +999,13 @@ void sched_reschedule(void)
 void sched_init_early(void)
 {
     /* initialize the run queues */
-    for (unsigned int i=0; i < NUM_PRIORITIES; i++)
-        list_initialize(&run_queue[i]);
+    for (unsigned int cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        for (unsigned int i = 0; i < NUM_PRIORITIES; i++)
+            list_initialize(&percpu[cpu].run_queue[i]);
+        list_initialize(&percpu[cpu].deadline_queue);
+        list_initialize(&percpu[cpu].deadline_throttled);
+        timer_initialize(&percpu[cpu].deadline_budget_timer);
+        timer_initialize(&percpu[cpu].deadline_replenish_timer);
+    }
 }
 
@@ -50,7 +50,6 @@
     do { if (DEBUG_THREAD_CONTEXT_SWITCH) printf("CS " str, ## x); } while (0)
 
 #define THREAD_INITIAL_TIME_SLICE LK_MSEC(50)
-#define THREAD_TICK_RATE          LK_MSEC(10)
 
 /* global thread list */
 static struct list_node thread_list = LIST_INITIAL_VALUE(thread_list);
@@ -70,6 +69,8 @@ static void init_thread_struct(thread_t *t, const char *name)
     thread_set_pinned_cpu(t, -1);
     strlcpy(t->name, name, sizeof(t->name));
     wait_queue_init(&t->retcode_wait_queue);
+    t->inherited_priority = -1;
+    list_initialize(&t->owned_wait_queues);
 }
 
 static void initial_thread_func(void) __NO_RETURN;
@@ -127,7 +128,7 @@ thread_t *thread_create_etc(
     unsigned int flags = 0;
 
     if (!t) {
-        t = malloc(sizeof(thread_t));
+        t = malloc_tagged(sizeof(thread_t), HEAP_TAG_THREAD);
         if (!t)
             return NULL;
         flags |= THREAD_FLAG_FREE_STRUCT;
@@ -155,7 +156,7 @@ thread_t *thread_create_etc(
         stack_size += THREAD_STACK_PADDING_SIZE;
         flags |= THREAD_FLAG_DEBUG_STACK_BOUNDS_CHECK;
 #endif
-        t->stack = malloc(stack_size);
+        t->stack = malloc_tagged(stack_size, HEAP_TAG_THREAD);
         if (!t->stack) {
             if (flags & THREAD_FLAG_FREE_STRUCT)
                 free(t);
@@ -173,7 +174,7 @@ thread_t *thread_create_etc(
     if (!unsafe_stack) {
         DEBUG_ASSERT(!stack);
         DEBUG_ASSERT(flags & THREAD_FLAG_FREE_STACK);
-        t->unsafe_stack = malloc(stack_size);
+        t->unsafe_stack = malloc_tagged(stack_size, HEAP_TAG_THREAD);
         if (!t->unsafe_stack) {
             free(t->stack);
             if (flags & THREAD_FLAG_FREE_STRUCT)
@@ -252,6 +253,7 @@ status_t thread_set_real_time(thread_t *t)
     if (t == get_current_thread()) {
         /* if we're currently running, cancel the preemption timer. */
         timer_cancel(&percpu[arch_curr_cpu_num()].preempt_timer);
+        percpu[arch_curr_cpu_num()].preempt_armed = false;
     }
     t->flags |= THREAD_FLAG_REAL_TIME;
     THREAD_UNLOCK(state);
@@ -259,6 +261,42 @@ status_t thread_set_real_time(thread_t *t)
     return MX_OK;
 }
 
+/**
+ * @brief  Move a thread into or out of the deadline scheduling class
+ *
+ * Deadline threads are guaranteed runtime ns of cpu time within
+ * relative_deadline ns of the start of each period, and are scheduled
+ * earliest deadline first ahead of all other threads.  A thread that uses up
+ * its runtime waits for its next period.
+ *
+ * @param t Thread to change
+ * @param runtime Budget per period, or 0 to return to priority scheduling
+ * @param relative_deadline Deadline within each period
+ * @param period Length of the period
+ *
+ * @return MX_OK on success, MX_ERR_NO_RESOURCES if no cpu has enough spare
+ * capacity to admit the thread.
+ */
+status_t thread_set_deadline(thread_t *t, lk_time_t runtime, lk_time_t relative_deadline,
+                             lk_time_t period)
+{
+    if (!t)
+        return MX_ERR_INVALID_ARGS;
+
+    DEBUG_ASSERT(t->magic == THREAD_MAGIC);
+
+    THREAD_LOCK(state);
+    status_t status = sched_set_deadline(t, runtime, relative_deadline, period);
+    THREAD_UNLOCK(state);
+
+    /* if we changed ourselves we may need to move to another cpu, or be
+     * the earliest deadline here */
+    if (status == MX_OK && t == get_current_thread())
+        thread_reschedule();
+
+    return status;
+}
+
 /**
  * @brief  Make a suspended thread executable.
  *
@@ -472,6 +510,18 @@ __NO_RETURN static void thread_exit_locked(thread_t *current_thread, int retcode
      */
     dpc_t free_dpc;
 
+    /* give back any cpu time reserved for us */
+    if (thread_is_deadline(current_thread))
+        sched_set_deadline(current_thread, 0, 0, 0);
+
+    /* whatever we still own is left without an owner */
+    owned_wait_queue_t *q;
+    while ((q = list_remove_head_type(&current_thread->owned_wait_queues, owned_wait_queue_t,
+                                      owner_node))) {
+        q->owner = NULL;
+    }
+    current_thread->inherited_priority = -1;
+
     /* enter the dead state */
     current_thread->state = THREAD_DEATH;
     current_thread->retcode = retcode;
@@ -720,7 +770,7 @@ void thread_process_pending_signals(void)
 __NO_RETURN static int idle_thread_routine(void *arg)
 {
     for (;;)
-        arch_idle();
+        mp_idle();
 }
 
 // On ARM64 with safe-stack, it's no longer possible to use the unsafe-sp
@@ -754,6 +804,7 @@ void _thread_resched_internal(void)
     DEBUG_ASSERT(!arch_in_int_handler());
 
     CPU_STATS_INC(reschedules);
+    mp_reschedule_begin(cpu);
 
     /* pick a new thread to run */
     thread_t *newthread = sched_get_top_thread(cpu);
@@ -765,20 +816,64 @@ void _thread_resched_internal(void)
     thread_t *oldthread = current_thread;
 
     /* if it's the same thread as we're already running, exit */
-    if (newthread == oldthread)
+    if (newthread == oldthread) {
+        /* its preemption timer is still good unless the quantum ran out or
+         * was given up, or the thread changed class while it ran and the
+         * timer was armed for the other one */
+        bool wants_quantum = !thread_is_real_time_or_idle(newthread);
+        bool changed_class = wants_quantum != percpu[cpu].preempt_armed;
+        if (changed_class || (wants_quantum && newthread->remaining_time_slice == 0)) {
+            timer_cancel(&percpu[cpu].preempt_timer);
+            percpu[cpu].preempt_armed = false;
+
+            lk_time_t now = current_time();
+            newthread->runtime_ns += now - newthread->last_started_running;
+            newthread->last_started_running = now;
+
+            /* what was left of a quantum doesn't carry across classes */
+            newthread->remaining_time_slice = THREAD_INITIAL_TIME_SLICE;
+            if (wants_quantum) {
+                timer_set_oneshot(&percpu[cpu].preempt_timer, now + newthread->remaining_time_slice,
+                                  (timer_callback)thread_timer_tick, NULL);
+                percpu[cpu].preempt_armed = true;
+            }
+        }
         return;
+    }
+
+    /* a thread batching wakeups that blocks or is preempted part way through
+     * sends what it held back now, along with the ipis below, rather than
+     * leave the threads it woke waiting for it to run again */
+    if (oldthread->reschedule_deferred) {
+        percpu[cpu].reschedule_deferred |= oldthread->reschedule_deferred;
+        oldthread->reschedule_deferred = 0;
+    }
 
     lk_time_t now = current_time();
     oldthread->runtime_ns += now - oldthread->last_started_running;
-    newthread->last_started_running = now;
+
+    /* charge the old thread for the part of its quantum it used */
+    if (!thread_is_real_time_or_idle(oldthread)) {
+        lk_time_t ran = now - oldthread->last_started_running;
+        oldthread->remaining_time_slice -= MIN(ran, oldthread->remaining_time_slice);
+    }
 
     /* set up quantum for the new thread if it was consumed */
     if (newthread->remaining_time_slice == 0) {
         newthread->remaining_time_slice = THREAD_INITIAL_TIME_SLICE;
     }
 
+    /* a thread that has run before and last ran elsewhere has migrated */
+    if (newthread->last_started_running != 0 && thread_last_cpu(newthread) != cpu &&
+        !thread_is_idle(newthread)) {
+        CPU_STATS_INC(migrations);
+    }
+
+    newthread->last_started_running = now;
+
     /* mark the cpu ownership of the threads */
     thread_set_last_cpu(newthread, cpu);
+    percpu[cpu].curr_thread = newthread;
 
     /* set the cpu state based on the new thread we've picked */
     if (thread_is_idle(newthread)) {
@@ -802,20 +897,24 @@ void _thread_resched_internal(void)
     ktrace(TAG_CONTEXT_SWITCH, (uint32_t)newthread->user_tid, cpu | (oldthread->state << 16),
            (uint32_t)(uintptr_t)oldthread, (uint32_t)(uintptr_t)newthread);
 
-    if (thread_is_real_time_or_idle(newthread)) {
-        if (!thread_is_real_time_or_idle(oldthread)) {
-            /* if we're switching from a non real time to a real time, cancel
-             * the preemption timer. */
-            TRACE_CONTEXT_SWITCH("stop preempt, cpu %u, old %p (%s), new %p (%s)\n",
-                    cpu, oldthread, oldthread->name, newthread, newthread->name);
-            timer_cancel(&percpu[cpu].preempt_timer);
-        }
-    } else if (thread_is_real_time_or_idle(oldthread)) {
-        /* if we're switching from a real time (or idle thread) to a regular one,
-         * set up a periodic timer to run our preemption tick. */
+    /* there is no periodic tick, the preemption timer is a one shot armed for
+     * the end of the new thread's quantum. real time, deadline and idle threads
+     * aren't preempted off of a quantum, so the cpu takes no timer interrupts
+     * for them beyond the timers that are actually due. the old thread may
+     * have changed class while its timer was armed, so cancel whenever a
+     * regular thread is involved. */
+    if (!thread_is_real_time_or_idle(oldthread) || !thread_is_real_time_or_idle(newthread)) {
+        TRACE_CONTEXT_SWITCH("stop preempt, cpu %u, old %p (%s), new %p (%s)\n",
+                cpu, oldthread, oldthread->name, newthread, newthread->name);
+        timer_cancel(&percpu[cpu].preempt_timer);
+        percpu[cpu].preempt_armed = false;
+    }
+    if (!thread_is_real_time_or_idle(newthread)) {
         TRACE_CONTEXT_SWITCH("start preempt, cpu %u, old %p (%s), new %p (%s)\n",
                 cpu, oldthread, oldthread->name, newthread, newthread->name);
-        timer_set_periodic(&percpu[cpu].preempt_timer, THREAD_TICK_RATE, (timer_callback)thread_timer_tick, NULL);
+        timer_set_oneshot(&percpu[cpu].preempt_timer, now + newthread->remaining_time_slice,
+                          (timer_callback)thread_timer_tick, NULL);
+        percpu[cpu].preempt_armed = true;
     }
 
     /* set some optional target debug leds */
@@ -857,6 +956,10 @@ void _thread_resched_internal(void)
         vmm_context_switch(oldthread->aspace, newthread->aspace);
     }
 
+    /* the thread lock is handed to the new thread rather than dropped, so
+     * send whatever ipis this cpu held back now */
+    mp_reschedule_flush();
+
     /* do the low level context switch */
     final_context_switch(oldthread, newthread);
 }
@@ -935,22 +1038,69 @@ void thread_reschedule(void)
     THREAD_UNLOCK(state);
 }
 
+/* only read by the scheduler on this cpu while this thread is running, so
+ * no lock is needed. wakeups from interrupt handlers don't count */
+void thread_sync_wakeup_begin(void)
+{
+    DEBUG_ASSERT(!arch_in_int_handler());
+
+    get_current_thread()->sync_wakeup = true;
+}
+
+void thread_sync_wakeup_end(void)
+{
+    thread_t *current_thread = get_current_thread();
+
+    current_thread->sync_wakeup = false;
+
+    /* a handoff still pending means the thread never blocked, and the thread
+     * it woke shouldn't be left waiting for it. only this cpu's current thread
+     * makes handoffs here, so a stale read just finds none of ours */
+    if (likely(get_local_percpu()->handoff_from != current_thread))
+        return;
+
+    THREAD_LOCK(state);
+    sched_sync_wakeup_cancel();
+    THREAD_UNLOCK(state);
+}
+
+/* like sync_wakeup, only touched by the thread itself, by mp_reschedule()
+ * on the cpu it is running on, and by thread_resched() as it is switched out */
+void thread_batch_wakeup_begin(void)
+{
+    DEBUG_ASSERT(!arch_in_int_handler());
+
+    get_current_thread()->batch_wakeup = true;
+}
+
+void thread_batch_wakeup_end(void)
+{
+    thread_t *current_thread = get_current_thread();
+
+    current_thread->batch_wakeup = false;
+    mp_cpu_mask_t target = current_thread->reschedule_deferred;
+    current_thread->reschedule_deferred = 0;
+
+    /* realtime cpus were already masked out when the ipis were held back */
+    mp_reschedule(target, MP_RESCHEDULE_FLAG_REALTIME);
+}
+
 enum handler_return thread_timer_tick(void)
 {
     thread_t *current_thread = get_current_thread();
 
+    /* it was a one shot */
+    percpu[arch_curr_cpu_num()].preempt_armed = false;
+
     if (thread_is_real_time_or_idle(current_thread))
         return INT_NO_RESCHEDULE;
 
-    current_thread->remaining_time_slice -= MIN(THREAD_TICK_RATE, current_thread->remaining_time_slice);
+    /* the timer was armed for the end of the quantum */
+    current_thread->remaining_time_slice = 0;
 
     ktrace_probe2("timer_tick", (uint32_t)current_thread->user_tid, current_thread->remaining_time_slice);
 
-    if (current_thread->remaining_time_slice == 0) {
-        return INT_RESCHEDULE;
-    } else {
-        return INT_NO_RESCHEDULE;
-    }
+    return INT_RESCHEDULE;
 }
 
 /* timer callback to wake up a sleeping thread */
@@ -977,6 +1127,7 @@ static enum handler_return thread_sleep_handler(timer_t *timer, lk_time_t now, v
     sched_unblock(t);
 
     spin_unlock(&thread_lock);
+    mp_reschedule_flush();
 
     return INT_RESCHEDULE;
 }
@@ -1318,15 +1469,24 @@ void dump_thread(thread_t *t, bool full_dump)
         dprintf(INFO, "\truntime_ns %" PRIu64 ", runtime_s %" PRIu64 "\n",
                 runtime, runtime / 1000000000);
         dprintf(INFO, "\tstack %p, stack_size %zu\n", t->stack, t->stack_size);
-        dprintf(INFO, "\tentry %p, arg %p, flags 0x%x %s%s%s%s%s%s\n", t->entry, t->arg, t->flags,
+        dprintf(INFO, "\tentry %p, arg %p, flags 0x%x %s%s%s%s%s%s%s\n", t->entry, t->arg, t->flags,
                 (t->flags & THREAD_FLAG_DETACHED) ? "Dt" :"",
                 (t->flags & THREAD_FLAG_FREE_STACK) ? "Fs" :"",
                 (t->flags & THREAD_FLAG_FREE_STRUCT) ? "Ft" :"",
                 (t->flags & THREAD_FLAG_REAL_TIME) ? "Rt" :"",
                 (t->flags & THREAD_FLAG_IDLE) ? "Id" :"",
-                (t->flags & THREAD_FLAG_DEBUG_STACK_BOUNDS_CHECK) ? "Sc" :"");
-        dprintf(INFO, "\twait queue %p, blocked_status %d, interruptable %d\n",
-                t->blocking_wait_queue, t->blocked_status, t->interruptable);
+                (t->flags & THREAD_FLAG_DEBUG_STACK_BOUNDS_CHECK) ? "Sc" :"",
+                (t->flags & THREAD_FLAG_DEADLINE) ? "Dl" :"");
+        if (t->flags & THREAD_FLAG_DEADLINE) {
+            dprintf(INFO, "\tdeadline cpu %u, runtime %" PRIu64 " deadline %" PRIu64
+                    " period %" PRIu64 ", budget %" PRIu64 " until %" PRIu64 "\n",
+                    t->deadline.cpu, t->deadline.runtime, t->deadline.relative_deadline,
+                    t->deadline.period, t->deadline.budget, t->deadline.absolute_deadline);
+        }
+        dprintf(INFO, "\twait queue %p, blocked_status %d, interruptable %d, "
+                "inherited priority %d\n",
+                t->blocking_wait_queue, t->blocked_status, t->interruptable,
+                t->inherited_priority);
         dprintf(INFO, "\taspace %p\n", t->aspace);
         dprintf(INFO, "\tuser_thread %p, pid %" PRIu64 ", tid %" PRIu64 "\n",
                 t->user_thread, t->user_pid, t->user_tid);
@@ -1387,6 +1547,18 @@ void wait_queue_init(wait_queue_t *wait)
     *wait = (wait_queue_t)WAIT_QUEUE_INITIAL_VALUE(*wait);
 }
 
+/* the owner of an owned wait queue inherits from its waiters, so it has to be
+ * looked at again whenever they come or go */
+static void wait_queue_waiters_changed(wait_queue_t *wait)
+{
+    if (likely(!(wait->flags & WAIT_QUEUE_FLAG_OWNED)))
+        return;
+
+    owned_wait_queue_t *q = containerof(wait, owned_wait_queue_t, wait);
+    if (q->owner)
+        sched_update_inherited_priority(q->owner);
+}
+
 static enum handler_return wait_queue_timeout_handler(timer_t *timer, lk_time_t now, void *arg)
 {
     thread_t *thread = (thread_t *)arg;
@@ -1406,6 +1578,7 @@ static enum handler_return wait_queue_timeout_handler(timer_t *timer, lk_time_t
     }
 
     spin_unlock(&thread_lock);
+    mp_reschedule_flush();
 
     return ret;
 }
@@ -1455,6 +1628,7 @@ status_t wait_queue_block(wait_queue_t *wait, lk_time_t deadline)
     current_thread->state = THREAD_BLOCKED;
     current_thread->blocking_wait_queue = wait;
     current_thread->blocked_status = MX_OK;
+    wait_queue_waiters_changed(wait);
 
     /* if the deadline is nonzero or noninfinite, set a callback to yank us out of the queue */
     if (deadline != INFINITE_TIME) {
@@ -1501,6 +1675,7 @@ int wait_queue_wake_one(wait_queue_t *wait, bool reschedule, status_t wait_queue
         DEBUG_ASSERT(t->state == THREAD_BLOCKED);
         t->blocked_status = wait_queue_error;
         t->blocking_wait_queue = NULL;
+        wait_queue_waiters_changed(wait);
 
         sched_unblock(t);
         if (reschedule)
@@ -1526,6 +1701,7 @@ thread_t *wait_queue_dequeue_one(wait_queue_t *wait, status_t wait_queue_error)
         DEBUG_ASSERT(t->state == THREAD_BLOCKED);
         t->blocked_status = wait_queue_error;
         t->blocking_wait_queue = NULL;
+        wait_queue_waiters_changed(wait);
     }
 
     return t;
@@ -1575,6 +1751,7 @@ int wait_queue_wake_all(wait_queue_t *wait, bool reschedule, status_t wait_queue
     DEBUG_ASSERT(ret > 0);
     DEBUG_ASSERT(wait->count == 0);
 
+    wait_queue_waiters_changed(wait);
     sched_unblock_list(&list);
     if (reschedule)
         sched_reschedule();
@@ -1613,6 +1790,87 @@ void wait_queue_destroy(wait_queue_t *wait)
     wait->magic = 0;
 }
 
+void owned_wait_queue_init(owned_wait_queue_t *q)
+{
+    *q = (owned_wait_queue_t)OWNED_WAIT_QUEUE_INITIAL_VALUE(*q);
+}
+
+void owned_wait_queue_destroy(owned_wait_queue_t *q)
+{
+    DEBUG_ASSERT(arch_ints_disabled());
+    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+
+    owned_wait_queue_set_owner(q, NULL);
+    wait_queue_destroy(&q->wait);
+}
+
+/**
+ * @brief  Change the owner of an owned wait queue
+ *
+ * The old owner stops inheriting priority from the threads waiting on the
+ * queue and the new one starts to. A thread that has exited cannot own
+ * anything, the queue is left without an owner instead.
+ *
+ * @param q  The queue
+ * @param owner  The new owner, or NULL
+ */
+void owned_wait_queue_set_owner(owned_wait_queue_t *q, thread_t *owner)
+{
+    DEBUG_ASSERT(q->wait.magic == WAIT_QUEUE_MAGIC);
+    DEBUG_ASSERT(q->wait.flags & WAIT_QUEUE_FLAG_OWNED);
+    DEBUG_ASSERT(arch_ints_disabled());
+    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+
+    if (owner && (owner->state == THREAD_INITIAL || owner->state == THREAD_DEATH))
+        owner = NULL;
+
+    thread_t *old_owner = q->owner;
+    if (old_owner == owner)
+        return;
+
+    if (old_owner) {
+        list_delete(&q->owner_node);
+        q->owner = NULL;
+        sched_update_inherited_priority(old_owner);
+    }
+
+    if (owner) {
+        list_add_tail(&owner->owned_wait_queues, &q->owner_node);
+        q->owner = owner;
+        sched_update_inherited_priority(owner);
+    }
+}
+
+/**
+ * @brief  Block on an owned wait queue
+ *
+ * Like wait_queue_block(), after making owner the owner of the queue so that
+ * it runs with at least our priority until it gives the queue up.
+ */
+status_t owned_wait_queue_block(owned_wait_queue_t *q, thread_t *owner, lk_time_t deadline)
+{
+    DEBUG_ASSERT(owner != get_current_thread());
+
+    owned_wait_queue_set_owner(q, owner);
+    return wait_queue_block(&q->wait, deadline);
+}
+
+/**
+ * @brief  Take the first thread off of an owned wait queue
+ *
+ * Like wait_queue_dequeue_one(). The thread taken off becomes the new owner
+ * if there are other threads still waiting, otherwise the queue is left
+ * without an owner.
+ *
+ * @return  The thread, which is still blocked, or NULL if the queue was empty
+ */
+thread_t *owned_wait_queue_dequeue_one(owned_wait_queue_t *q, status_t wait_queue_error)
+{
+    thread_t *t = wait_queue_dequeue_one(&q->wait, wait_queue_error);
+    owned_wait_queue_set_owner(q, (t && !list_is_empty(&q->wait.list)) ? t : NULL);
+    return t;
+}
+
 /**
  * @brief  Wake a specific thread in a wait queue
  *
@@ -1638,10 +1896,12 @@ status_t thread_unblock_from_wait_queue(thread_t *t, status_t wait_queue_error)
     DEBUG_ASSERT(t->blocking_wait_queue->magic == WAIT_QUEUE_MAGIC);
     DEBUG_ASSERT(list_in_list(&t->queue_node));
 
+    wait_queue_t *wait = t->blocking_wait_queue;
     list_delete(&t->queue_node);
-    t->blocking_wait_queue->count--;
+    wait->count--;
     t->blocking_wait_queue = NULL;
     t->blocked_status = wait_queue_error;
+    wait_queue_waiters_changed(wait);
 
     sched_unblock(t);
 
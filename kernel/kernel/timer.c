@@ -17,6 +17,14 @@
  *
  * Timer callback functions are called in interrupt context.
  *
+ * Each cpu keeps its pending timers in a hierarchical timing wheel. A timer is
+ * filed in the lowest level whose window, measured from the wheel's base,
+ * reaches its deadline, which makes setting and canceling a timer O(1). As the
+ * base advances the slots of the coarser levels that come due are cascaded
+ * down. Timers still fire at their exact deadline: the hardware timer is set
+ * for the earliest timer in the wheel, which is found in the first occupied
+ * slot of one of the levels.
+ *
  * @{
  */
 #include <assert.h>
@@ -31,10 +39,15 @@
 #include <list.h>
 #include <platform.h>
 #include <platform/timer.h>
+#include <pow2.h>
 #include <trace.h>
 
 #define LOCAL_TRACE 0
 
+#define TIMER_WHEEL_SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+
+static_assert(TIMER_WHEEL_SLOTS == 64, "slot bitmaps are a uint64_t");
+
 static spin_lock_t timer_lock;
 
 static enum handler_return timer_tick(void *arg, lk_time_t now);
@@ -47,28 +60,224 @@ void timer_initialize(timer_t *timer)
     *timer = (timer_t)TIMER_INITIAL_VALUE(*timer);
 }
 
+static inline uint wheel_shift(uint level)
+{
+    return TIMER_WHEEL_SHIFT + level * TIMER_WHEEL_SLOT_BITS;
+}
+
+static inline uint64_t rotl64(uint64_t x, uint r)
+{
+    return r ? (x << r) | (x >> (64 - r)) : x;
+}
+
+static inline uint64_t rotr64(uint64_t x, uint r)
+{
+    return r ? (x >> r) | (x << (64 - r)) : x;
+}
+
+/* bitmap of count slots starting with first, wrapping around the wheel */
+static inline uint64_t slot_range(uint first, uint64_t count)
+{
+    if (count >= TIMER_WHEEL_SLOTS)
+        return ~0ull;
+    return rotl64((1ull << count) - 1, first);
+}
+
+/* move all of the timers in list in front of the node before */
+static void splice_timer_list(struct list_node *list, struct list_node *before)
+{
+    if (list_is_empty(list))
+        return;
+
+    list->next->prev = before->prev;
+    before->prev->next = list->next;
+    list->prev->next = before;
+    before->prev = list->prev;
+    list_initialize(list);
+}
+
+/* slots and the overflow list are kept sorted by deadline, with the timers
+ * that were already due when they were filed at the front, so the earliest
+ * timer in a list is its head */
+static void add_timer_sorted(struct list_node *list, timer_t *timer, bool due)
+{
+    if (due) {
+        list_add_head(list, &timer->node);
+        return;
+    }
+
+    /* new timers mostly go after, or are coalesced with, the ones already
+     * there, so look from the back */
+    struct list_node *node = list->prev;
+    while (node != list &&
+           containerof(node, timer_t, node)->scheduled_time > timer->scheduled_time)
+        node = node->prev;
+    list_add_after(node, &timer->node);
+}
+
 static void insert_timer_in_queue(uint cpu, timer_t *timer)
 {
-    timer_t *entry;
+    struct timer_wheel *w = &percpu[cpu].timer_wheel;
 
     DEBUG_ASSERT(arch_ints_disabled());
 
     LTRACEF("timer %p, cpu %u, scheduled %" PRIu64 ", periodic %" PRIu64 "\n", timer, cpu, timer->scheduled_time, timer->period);
 
-    list_for_every_entry(&percpu[cpu].timer_queue, entry, timer_t, node) {
-        if (TIME_GT(entry->scheduled_time, timer->scheduled_time)) {
-            list_add_before(&entry->node, &timer->node);
+    /* timers that are already due go in the current slot */
+    bool due = timer->scheduled_time < w->base;
+    lk_time_t t = due ? w->base : timer->scheduled_time;
+
+    for (uint level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        uint shift = wheel_shift(level);
+        if ((t >> shift) - (w->base >> shift) < TIMER_WHEEL_SLOTS) {
+            uint slot = (t >> shift) & TIMER_WHEEL_SLOT_MASK;
+            add_timer_sorted(&w->slot[level][slot], timer, due);
+            w->bitmap[level] |= 1ull << slot;
             return;
         }
     }
 
-    /* walked off the end of the list */
-    list_add_tail(&percpu[cpu].timer_queue, &timer->node);
+    /* too far out for the top level, it is refiled when the top level turns */
+    add_timer_sorted(&w->overflow, timer, false);
+}
+
+/* refile all of the timers in list in the given cpu's wheel */
+static void reinsert_timer_list(uint cpu, struct list_node *list)
+{
+    struct list_node tmp = LIST_INITIAL_VALUE(tmp);
+    timer_t *timer;
+
+    list_move(list, &tmp);
+    while ((timer = list_remove_head_type(&tmp, timer_t, node)) != NULL)
+        insert_timer_in_queue(cpu, timer);
 }
 
-static void timer_set(timer_t *timer, lk_time_t deadline, lk_time_t period, timer_callback callback, void *arg)
+/* move the wheel's base up to now, cascading the slots that come due */
+static void advance_timer_queue(uint cpu, lk_time_t now)
 {
-    LTRACEF("timer %p, deadline %" PRIu64 ", period %" PRIu64 ", callback %p, arg %p\n", timer, deadline, period, callback, arg);
+    struct timer_wheel *w = &percpu[cpu].timer_wheel;
+
+    lk_time_t base = now & ~((1ull << TIMER_WHEEL_SHIFT) - 1);
+    if (base <= w->base)
+        return;
+
+    lk_time_t old = w->base;
+    w->base = base;
+
+    /* the level 0 slots we moved past only hold timers that are due, fold
+     * them into the front of the new current slot before anything else is
+     * filed */
+    uint64_t from = old >> TIMER_WHEEL_SHIFT;
+    uint64_t to = base >> TIMER_WHEEL_SHIFT;
+    uint cur = to & TIMER_WHEEL_SLOT_MASK;
+    uint64_t passed = w->bitmap[0] & slot_range(from & TIMER_WHEEL_SLOT_MASK, to - from) &
+                      ~(1ull << cur);
+    if (passed) {
+        w->bitmap[0] = (w->bitmap[0] & ~passed) | (1ull << cur);
+        do {
+            uint slot = __builtin_ctzll(passed);
+            passed &= passed - 1;
+            splice_timer_list(&w->slot[0][slot], w->slot[0][cur].next);
+        } while (passed);
+    }
+
+    /* refile the timers of every coarser slot we reached, they land in a
+     * finer level */
+    uint level;
+    for (level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+        uint shift = wheel_shift(level);
+        from = old >> shift;
+        to = base >> shift;
+        if (from == to)
+            break;
+
+        uint64_t due = w->bitmap[level] &
+                       slot_range((from + 1) & TIMER_WHEEL_SLOT_MASK, to - from);
+        w->bitmap[level] &= ~due;
+        while (due) {
+            uint slot = __builtin_ctzll(due);
+            due &= due - 1;
+            reinsert_timer_list(cpu, &w->slot[level][slot]);
+        }
+    }
+
+    if (level == TIMER_WHEEL_LEVELS)
+        reinsert_timer_list(cpu, &w->overflow);
+}
+
+/* find the pending timer with the earliest deadline on the given cpu */
+static timer_t *peek_timer_queue(uint cpu)
+{
+    struct timer_wheel *w = &percpu[cpu].timer_wheel;
+    timer_t *earliest = NULL;
+
+    /* slots only hold deadlines within their range, so the earliest timer of
+     * each level is in its first occupied slot. levels can overlap as the base
+     * moves between cascades, so all of them have to be looked at */
+    for (uint level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        uint shift = wheel_shift(level);
+        uint cur = (w->base >> shift) & TIMER_WHEEL_SLOT_MASK;
+        uint64_t bits = rotr64(w->bitmap[level], cur);
+
+        while (bits) {
+            uint i = __builtin_ctzll(bits);
+            uint slot = (cur + i) & TIMER_WHEEL_SLOT_MASK;
+
+            /* nothing in this slot or the ones after it can be earlier */
+            lk_time_t start = ((w->base >> shift) + i) << shift;
+            if (earliest && start >= earliest->scheduled_time)
+                break;
+
+            timer_t *timer = list_peek_head_type(&w->slot[level][slot], timer_t, node);
+            if (timer) {
+                if (!earliest || timer->scheduled_time < earliest->scheduled_time)
+                    earliest = timer;
+                break;
+            }
+
+            /* emptied by a timer_cancel() on another cpu */
+            w->bitmap[level] &= ~(1ull << slot);
+            bits &= ~(1ull << i);
+        }
+    }
+
+    if (!earliest)
+        earliest = list_peek_head_type(&w->overflow, timer_t, node);
+
+    return earliest;
+}
+
+/* point the hardware timer at the earliest timer on this cpu */
+static void update_platform_timer(uint cpu)
+{
+    struct timer_wheel *w = &percpu[cpu].timer_wheel;
+
+    timer_t *timer = peek_timer_queue(cpu);
+    if (timer == NULL) {
+        LTRACEF("clearing old hw timer, nothing in the queue\n");
+        w->next = INFINITE_TIME;
+        platform_stop_timer();
+    } else if (timer->scheduled_time != w->next) {
+        LTRACEF("setting new timer to %" PRIu64 "\n", timer->scheduled_time);
+        w->next = timer->scheduled_time;
+        platform_set_oneshot_timer(timer_tick, NULL, timer->scheduled_time);
+    }
+}
+
+static void timer_set(timer_t *timer, lk_time_t deadline, lk_time_t period, lk_time_t slack,
+                      timer_callback callback, void *arg)
+{
+    LTRACEF("timer %p, deadline %" PRIu64 ", period %" PRIu64 ", slack %" PRIu64 ", callback %p, arg %p\n",
+            timer, deadline, period, slack, callback, arg);
+
+    /* push the deadline out to the coarsest boundary the slack allows, timers
+     * with similar slack then end up firing together */
+    if (slack > 0) {
+        lk_time_t align = 1ull << log2_ulong_floor(slack);
+        lk_time_t rounded = (deadline + align - 1) & ~(align - 1);
+        if (rounded >= deadline)
+            deadline = rounded;
+    }
 
     DEBUG_ASSERT(timer->magic == TIMER_MAGIC);
 
@@ -99,11 +308,13 @@ static void timer_set(timer_t *timer, lk_time_t deadline, lk_time_t period, time
 
     LTRACEF("scheduled time %" PRIu64 "\n", timer->scheduled_time);
 
+    advance_timer_queue(cpu, current_time());
     insert_timer_in_queue(cpu, timer);
 
-    if (list_peek_head_type(&percpu[cpu].timer_queue, timer_t, node) == timer) {
-        /* we just modified the head of the timer queue */
+    if (deadline < percpu[cpu].timer_wheel.next) {
+        /* we are now the first timer due on this cpu */
         LTRACEF("setting new timer for %" PRIu64 " nsecs\n", deadline);
+        percpu[cpu].timer_wheel.next = deadline;
         platform_set_oneshot_timer(timer_tick, NULL, deadline);
     }
 
@@ -127,7 +338,25 @@ out:
  */
 void timer_set_oneshot(timer_t *timer, lk_time_t deadline, timer_callback callback, void *arg)
 {
-    timer_set(timer, deadline, 0, callback, arg);
+    timer_set(timer, deadline, 0, 0, callback, arg);
+}
+
+/**
+ * @brief  Set up a timer that executes once, with some leeway
+ *
+ * Like timer_set_oneshot(), but the timer may fire up to slack ns after the
+ * deadline so that it can share an interrupt with other timers.
+ *
+ * @param  timer The timer to use
+ * @param  deadline The deadline, in ns, after which the timer is executed
+ * @param  slack How late, in ns, the timer is allowed to fire
+ * @param  callback  The function to call when the timer expires
+ * @param  arg  The argument to pass to the callback
+ */
+void timer_set_oneshot_etc(timer_t *timer, lk_time_t deadline, lk_time_t slack,
+                           timer_callback callback, void *arg)
+{
+    timer_set(timer, deadline, 0, slack, callback, arg);
 }
 
 /**
@@ -148,7 +377,7 @@ void timer_set_periodic(timer_t *timer, lk_time_t period, timer_callback callbac
 {
     if (period == 0)
         period = 1;
-    timer_set(timer, current_time() + period, period, callback, arg);
+    timer_set(timer, current_time() + period, period, 0, callback, arg);
 }
 
 /**
@@ -193,21 +422,13 @@ bool timer_cancel(timer_t *timer)
     if (list_in_list(&timer->node)) {
         callback_not_running = true;
 
-        timer_t *oldhead = list_peek_head_type(&percpu[cpu].timer_queue, timer_t, node);
-
-        /* remove it from the queue */
+        /* remove it from the queue, the slot's bitmap bit is cleared lazily */
         list_delete(&timer->node);
 
-        /* see if we've just modified the head of this cpu's timer queue */
+        /* see if we've just removed the next timer due on this cpu */
         /* if we modified another cpu's queue, we'll just let it fire and sort itself out */
-        timer_t *newhead = list_peek_head_type(&percpu[cpu].timer_queue, timer_t, node);
-        if (newhead == NULL) {
-            LTRACEF("clearing old hw timer, nothing in the queue\n");
-            platform_stop_timer();
-        } else if (newhead != oldhead) {
-            LTRACEF("setting new timer to %" PRIu64 "\n", newhead->scheduled_time);
-            platform_set_oneshot_timer(timer_tick, NULL, newhead->scheduled_time);
-        }
+        if (timer->scheduled_time == percpu[cpu].timer_wheel.next)
+            update_platform_timer(cpu);
     } else {
         callback_not_running = false;
     }
@@ -243,13 +464,15 @@ static enum handler_return timer_tick(void *arg, lk_time_t now)
 
     spin_lock(&timer_lock);
 
+    advance_timer_queue(cpu, now);
+
     for (;;) {
         /* see if there's an event to process */
-        timer = list_peek_head_type(&percpu[cpu].timer_queue, timer_t, node);
+        timer = peek_timer_queue(cpu);
         if (likely(timer == 0))
             break;
         LTRACEF("next item on timer queue %p at %" PRIu64 " now %" PRIu64 " (%p, arg %p)\n", timer, timer->scheduled_time, now, timer->callback, timer->arg);
-        if (likely(TIME_LT(now, timer->scheduled_time)))
+        if (likely(now < timer->scheduled_time))
             break;
 
         /* process it */
@@ -302,14 +525,18 @@ static enum handler_return timer_tick(void *arg, lk_time_t now)
     }
 
     /* reset the timer to the next event */
-    timer = list_peek_head_type(&percpu[cpu].timer_queue, timer_t, node);
+    struct timer_wheel *w = &percpu[cpu].timer_wheel;
+    timer = peek_timer_queue(cpu);
     if (timer) {
         /* has to be the case or it would have fired already */
-        DEBUG_ASSERT(TIME_GT(timer->scheduled_time, now));
+        DEBUG_ASSERT(timer->scheduled_time > now);
 
         LTRACEF("setting new timer for %" PRIu64 " nsecs for event %p\n", timer->scheduled_time,
                 timer);
+        w->next = timer->scheduled_time;
         platform_set_oneshot_timer(timer_tick, NULL, timer->scheduled_time);
+    } else {
+        w->next = INFINITE_TIME;
     }
 
     /* we're done manipulating the timer queue */
@@ -341,20 +568,24 @@ void timer_transition_off_cpu(uint old_cpu)
     spin_lock_saved_state_t state;
     spin_lock_irqsave(&timer_lock, state);
     uint cpu = arch_curr_cpu_num();
+    struct timer_wheel *old_wheel = &percpu[old_cpu].timer_wheel;
 
-    timer_t *old_head = list_peek_head_type(&percpu[old_cpu].timer_queue, timer_t, node);
+    advance_timer_queue(cpu, current_time());
 
-    timer_t *entry = NULL, *tmp_entry = NULL;
     /* Move all timers from old_cpu to this cpu */
-    list_for_every_entry_safe(&percpu[old_cpu].timer_queue, entry, tmp_entry, timer_t, node) {
-        list_delete(&entry->node);
-        insert_timer_in_queue(cpu, entry);
+    for (uint level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        for (uint slot = 0; slot < TIMER_WHEEL_SLOTS; slot++)
+            reinsert_timer_list(cpu, &old_wheel->slot[level][slot]);
+        old_wheel->bitmap[level] = 0;
     }
+    reinsert_timer_list(cpu, &old_wheel->overflow);
+    old_wheel->next = INFINITE_TIME;
 
-    timer_t *new_head = list_peek_head_type(&percpu[cpu].timer_queue, timer_t, node);
-    if (new_head != NULL && new_head != old_head) {
+    timer_t *new_head = peek_timer_queue(cpu);
+    if (new_head != NULL && new_head->scheduled_time < percpu[cpu].timer_wheel.next) {
         /* we just modified the head of the timer queue */
         LTRACEF("setting new timer for %" PRIu64 " nsecs\n", new_head->scheduled_time);
+        percpu[cpu].timer_wheel.next = new_head->scheduled_time;
         platform_set_oneshot_timer(timer_tick, NULL, new_head->scheduled_time);
     }
 
@@ -370,9 +601,10 @@ void timer_thaw_percpu(void)
 
     uint cpu = arch_curr_cpu_num();
 
-    timer_t *t = list_peek_head_type(&percpu[cpu].timer_queue, timer_t, node);
+    timer_t *t = peek_timer_queue(cpu);
     if (t) {
         LTRACEF("rescheduling timer for %" PRIu64 " nsecs\n", t->scheduled_time);
+        percpu[cpu].timer_wheel.next = t->scheduled_time;
         platform_set_oneshot_timer(timer_tick, NULL, t->scheduled_time);
     }
 
@@ -383,6 +615,15 @@ void timer_init(void)
 {
     timer_lock = SPIN_LOCK_INITIAL_VALUE;
     for (uint i = 0; i < SMP_MAX_CPUS; i++) {
-        list_initialize(&percpu[i].timer_queue);
+        struct timer_wheel *w = &percpu[i].timer_wheel;
+
+        w->base = 0;
+        w->next = INFINITE_TIME;
+        for (uint level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+            w->bitmap[level] = 0;
+            for (uint slot = 0; slot < TIMER_WHEEL_SLOTS; slot++)
+                list_initialize(&w->slot[level][slot]);
+        }
+        list_initialize(&w->overflow);
     }
 }
@@ -11,14 +11,20 @@
 #include <err.h>
 #include <inttypes.h>
 #include <kernel/auto_lock.h>
+#include <kernel/cmdline.h>
+#include <kernel/event.h>
 #include <kernel/mp.h>
 #include <kernel/mutex.h>
+#include <kernel/spinlock.h>
+#include <kernel/thread.h>
 #include <kernel/timer.h>
 #include <kernel/vm.h>
 #include <lib/console.h>
 #include <list.h>
 #include <lk/init.h>
+#include <platform.h>
 #include <pow2.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <trace.h>
@@ -37,6 +43,431 @@ static Mutex arena_lock;
 static mxtl::DoublyLinkedList<PmmArena*> arena_list TA_GUARDED(arena_lock);
 static size_t arena_cumulative_size TA_GUARDED(arena_lock);
 
+// Per-cpu magazines of free pages sitting in front of the arenas, so that
+// single page allocations and frees usually avoid |arena_lock|. Pages in a
+// cache have already been pulled out of their arena (and are marked
+// VM_PAGE_STATE_ALLOC there), but are still counted as free.
+#define PMM_PCPU_CACHE_BATCH 32u
+#define PMM_PCPU_CACHE_MAX (PMM_PCPU_CACHE_BATCH * 2u)
+
+struct pmm_pcpu_cache {
+    spin_lock_t lock;
+    list_node free_list;
+    size_t free_count;
+
+    // pages already zeroed by this cpu's zeroing thread, see below
+    list_node zeroed_list;
+    size_t zeroed_count;
+    size_t zeroed_target;
+    event_t zero_event;
+
+    // statistics
+    uint64_t alloc_hits;
+    uint64_t alloc_misses;
+    uint64_t free_hits;
+    uint64_t drains;
+    uint64_t zeroed;
+    uint64_t zero_hits;
+    uint64_t zero_misses;
+} __CPU_ALIGN;
+
+static pmm_pcpu_cache pcpu_cache[SMP_MAX_CPUS];
+static bool pcpu_cache_enabled;
+
+// Low watermark below which allocations poke the reclaim code. Pages sitting
+// in the per-cpu caches are not counted, which only makes it fire a little
+// early.
+static size_t low_memory_pages TA_GUARDED(arena_lock);
+static void (*low_memory_callback)(void) TA_GUARDED(arena_lock);
+
+static size_t pmm_count_free_pages_locked() TA_REQ(arena_lock);
+static size_t pmm_free_locked(list_node* list) TA_REQ(arena_lock);
+static size_t pmm_alloc_pages_locked(size_t count, uint alloc_flags, list_node* list)
+    TA_REQ(arena_lock);
+
+static void pmm_check_low_memory_locked() TA_REQ(arena_lock) {
+    if (low_memory_callback && pmm_count_free_pages_locked() < low_memory_pages)
+        low_memory_callback();
+}
+
+static void pmm_pcpu_cache_init(uint level) {
+    for (auto& c : pcpu_cache) {
+        c.lock = SPIN_LOCK_INITIAL_VALUE;
+        list_initialize(&c.free_list);
+        list_initialize(&c.zeroed_list);
+        event_init(&c.zero_event, false, EVENT_FLAG_AUTOUNSIGNAL);
+    }
+    pcpu_cache_enabled = true;
+}
+LK_INIT_HOOK(pmm_pcpu_cache, &pmm_pcpu_cache_init, LK_INIT_LEVEL_VM);
+
+// Returns the cache of the current cpu with its lock held and interrupts
+// disabled. The thread may have migrated by the time the lock is taken, which
+// is harmless: every cache is protected by its own lock.
+static pmm_pcpu_cache* pmm_pcpu_cache_acquire(spin_lock_saved_state_t* state) {
+    pmm_pcpu_cache* c = &pcpu_cache[arch_curr_cpu_num()];
+    spin_lock_irqsave(&c->lock, *state);
+    return c;
+}
+
+static void pmm_pcpu_cache_release(pmm_pcpu_cache* c, spin_lock_saved_state_t state) {
+    spin_unlock_irqrestore(&c->lock, state);
+}
+
+// Moves up to |count| pages off the head of |from| onto the tail of |to|.
+static size_t pmm_move_pages(list_node* from, size_t count, list_node* to) {
+    size_t moved = 0;
+    while (moved < count) {
+        vm_page_t* page = list_remove_head_type(from, vm_page_t, free.node);
+        if (!page)
+            break;
+        list_add_tail(to, &page->free.node);
+        moved++;
+    }
+    return moved;
+}
+
+// Moves up to |count| pages out of |c| onto the tail of |list|.
+static size_t pmm_pcpu_cache_take(pmm_pcpu_cache* c, size_t count, list_node* list) {
+    size_t taken = pmm_move_pages(&c->free_list, count, list);
+    DEBUG_ASSERT(c->free_count >= taken);
+    c->free_count -= taken;
+    return taken;
+}
+
+// Memory node each cpu is local to, filled in by the platform.
+static uint8_t cpu_node[SMP_MAX_CPUS];
+
+void pmm_set_cpu_node(uint cpu_num, uint node) {
+    DEBUG_ASSERT(cpu_num < SMP_MAX_CPUS);
+    DEBUG_ASSERT(node < PMM_MAX_NODES);
+    cpu_node[cpu_num] = static_cast<uint8_t>(node);
+}
+
+uint pmm_cpu_node(uint cpu_num) {
+    DEBUG_ASSERT(cpu_num < SMP_MAX_CPUS);
+    return cpu_node[cpu_num];
+}
+
+void pmm_set_arena_node(paddr_t base, size_t size, uint node) {
+    DEBUG_ASSERT(node < PMM_MAX_NODES);
+
+    AutoLock al(&arena_lock);
+    for (auto& a : arena_list) {
+        // Arenas are not split along node boundaries, an arena straddling two
+        // nodes belongs to the one its base is in.
+        if (a.base() >= base && a.base() - base < size) {
+            LTRACEF("arena '%s' base %#" PRIxPTR " -> node %u\n", a.name(), a.base(), node);
+            a.set_node(node);
+        }
+    }
+}
+
+static uint pmm_preferred_node(uint alloc_flags) {
+    if (alloc_flags & PMM_ALLOC_FLAG_NODE_VALID)
+        return (alloc_flags & PMM_ALLOC_FLAG_NODE_MASK) >> PMM_ALLOC_NODE_SHIFT;
+    return cpu_node[arch_curr_cpu_num()];
+}
+
+// Call |func| on every arena usable for |alloc_flags| until it returns true.
+// Arenas in the preferred node are visited first, in priority order, followed
+// by all the remote ones.
+template <typename F>
+static void pmm_for_each_arena(uint alloc_flags, F func) TA_REQ(arena_lock) {
+    const uint node = pmm_preferred_node(alloc_flags);
+
+    for (int pass = 0; pass < 2; pass++) {
+        const bool want_local = (pass == 0);
+        for (auto& a : arena_list) {
+            /* skip the arena if it's not KMAP and the KMAP only allocation flag was passed */
+            if (alloc_flags & PMM_ALLOC_FLAG_KMAP) {
+                if ((a.flags() & PMM_ARENA_FLAG_KMAP) == 0)
+                    continue;
+            }
+
+            if ((a.node() == node) != want_local)
+                continue;
+
+            if (func(a))
+                return;
+        }
+    }
+}
+
+// Background zeroed page pool. Each cpu's cache keeps a second list of pages
+// that a low priority thread pinned to that cpu has zeroed ahead of time, which
+// PMM_ALLOC_FLAG_ZEROED allocations take from first without going near the
+// arena lock. Like the rest of the cache, the pages have been pulled out of
+// their arena and are still counted as free.
+#define PMM_ZERO_POOL_DEFAULT_PAGES (4096u) // 16MB with 4K pages, over all cpus
+#define PMM_ZERO_POOL_BATCH (16u)
+
+static void zero_free_page(vm_page_t* page) {
+    void* ptr = paddr_to_kvaddr(vm_page_to_paddr(page));
+    DEBUG_ASSERT(ptr);
+    arch_zero_page(ptr);
+}
+
+// Move up to |count| zeroed pages out of the local cache onto the tail of
+// |list|, waking the local zeroing thread once the cache has drained to half
+// its target. Only unrestricted allocations can use the cache.
+static size_t zero_pool_take(uint alloc_flags, size_t count, list_node* list) {
+    if (!pcpu_cache_enabled)
+        return 0;
+
+    spin_lock_saved_state_t state;
+    pmm_pcpu_cache* c = pmm_pcpu_cache_acquire(&state);
+    size_t taken = 0;
+    if (alloc_flags == PMM_ALLOC_FLAG_ANY) {
+        taken = pmm_move_pages(&c->zeroed_list, count, list);
+        DEBUG_ASSERT(c->zeroed_count >= taken);
+        c->zeroed_count -= taken;
+    }
+    c->zero_hits += taken;
+    c->zero_misses += count - taken;
+    const bool wake = c->zeroed_count < c->zeroed_target / 2;
+    pmm_pcpu_cache_release(c, state);
+
+    if (wake)
+        event_signal(&c->zero_event, false);
+    return taken;
+}
+
+static int zero_pool_thread(void* arg) {
+    pmm_pcpu_cache* c = static_cast<pmm_pcpu_cache*>(arg);
+    for (;;) {
+        // dirty pages already in the cache are zeroed first, then more are
+        // pulled out of the arenas as long as memory isn't running low
+        list_node batch = LIST_INITIAL_VALUE(batch);
+        size_t want = 0;
+        size_t count = 0;
+        spin_lock_saved_state_t state;
+        spin_lock_irqsave(&c->lock, state);
+        if (c->zeroed_count < c->zeroed_target) {
+            want = MIN(PMM_ZERO_POOL_BATCH, c->zeroed_target - c->zeroed_count);
+            count = pmm_pcpu_cache_take(c, want, &batch);
+        }
+        spin_unlock_irqrestore(&c->lock, state);
+
+        if (count < want) {
+            AutoLock al(&arena_lock);
+            if (pmm_count_free_pages_locked() > low_memory_pages + want - count)
+                count += pmm_alloc_pages_locked(want - count, PMM_ALLOC_FLAG_ANY, &batch);
+        }
+
+        if (count == 0) {
+            // either the pool is full, or there is nothing left to zero; in the
+            // latter case poll again later since frees don't wake us up
+            event_wait_deadline(&c->zero_event, current_time() + LK_SEC(1), false);
+            continue;
+        }
+
+        vm_page_t* page;
+        list_for_every_entry (&batch, page, vm_page_t, free.node) {
+            zero_free_page(page);
+        }
+
+        spin_lock_irqsave(&c->lock, state);
+        pmm_move_pages(&batch, count, &c->zeroed_list);
+        c->zeroed_count += count;
+        c->zeroed += count;
+        spin_unlock_irqrestore(&c->lock, state);
+    }
+
+    return 0;
+}
+
+// Runs on each cpu as it comes up, the boot cpu first, and starts its thread.
+static void pmm_zero_pool_init(uint level) {
+#if !PMM_ENABLE_FREE_FILL
+    size_t total = cmdline_get_uint32("kernel.pmm-zero-pool-pages", PMM_ZERO_POOL_DEFAULT_PAGES);
+    if (total == 0 || !pcpu_cache_enabled)
+        return;
+
+    const uint cpu = arch_curr_cpu_num();
+    pmm_pcpu_cache* c = &pcpu_cache[cpu];
+
+    char name[THREAD_NAME_LENGTH];
+    snprintf(name, sizeof(name), "pmm zero pool-%u", cpu);
+    thread_t* t = thread_create(name, &zero_pool_thread, c, LOW_PRIORITY, DEFAULT_STACK_SIZE);
+    if (!t)
+        return;
+    thread_set_pinned_cpu(t, cpu);
+
+    // the thread idles until pmm_zero_pool_set_targets() gives it a target
+    thread_detach_and_resume(t);
+#endif
+}
+LK_INIT_HOOK_FLAGS(pmm_zero_pool, &pmm_zero_pool_init, LK_INIT_LEVEL_THREADING,
+                   LK_INIT_FLAG_ALL_CPUS);
+
+// The pool is split evenly between the cpus, so the targets are only set once
+// every cpu has been brought up and their number is final.
+static void pmm_zero_pool_set_targets(uint level) {
+#if !PMM_ENABLE_FREE_FILL
+    size_t total = cmdline_get_uint32("kernel.pmm-zero-pool-pages", PMM_ZERO_POOL_DEFAULT_PAGES);
+    if (total == 0 || !pcpu_cache_enabled)
+        return;
+
+    const uint num_cpus = arch_max_num_cpus();
+    const size_t target = MAX(total / num_cpus, PMM_ZERO_POOL_BATCH);
+    for (uint cpu = 0; cpu < num_cpus; cpu++) {
+        pmm_pcpu_cache* c = &pcpu_cache[cpu];
+        spin_lock_saved_state_t state;
+        spin_lock_irqsave(&c->lock, state);
+        c->zeroed_target = target;
+        spin_unlock_irqrestore(&c->lock, state);
+        event_signal(&c->zero_event, false);
+    }
+#endif
+}
+LK_INIT_HOOK(pmm_zero_pool_targets, &pmm_zero_pool_set_targets, LK_INIT_LEVEL_LAST);
+
+void pmm_get_zero_pool_stats(pmm_zero_pool_stats_t* stats) {
+    memset(stats, 0, sizeof(*stats));
+    if (!pcpu_cache_enabled)
+        return;
+
+    for (auto& c : pcpu_cache) {
+        spin_lock_saved_state_t state;
+        spin_lock_irqsave(&c.lock, state);
+        stats->depth += c.zeroed_count;
+        stats->target += c.zeroed_target;
+        stats->zeroed += c.zeroed;
+        stats->hits += c.zero_hits;
+        stats->misses += c.zero_misses;
+        spin_unlock_irqrestore(&c.lock, state);
+    }
+}
+
+void pmm_set_low_memory_callback(size_t low_pages, void (*callback)(void)) {
+    AutoLock al(&arena_lock);
+    low_memory_pages = low_pages;
+    low_memory_callback = callback;
+}
+
+
+// Return the contents of every cpu's cache to the arenas, for allocations that
+// need pages from a specific place (contiguous runs, specific addresses), or
+// that have found the arenas empty.
+static void pmm_pcpu_cache_drain_all() {
+    if (!pcpu_cache_enabled)
+        return;
+
+    list_node drain = LIST_INITIAL_VALUE(drain);
+    for (auto& c : pcpu_cache) {
+        spin_lock_saved_state_t state;
+        spin_lock_irqsave(&c.lock, state);
+        pmm_pcpu_cache_take(&c, c.free_count, &drain);
+        pmm_move_pages(&c.zeroed_list, c.zeroed_count, &drain);
+        c.zeroed_count = 0;
+        spin_unlock_irqrestore(&c.lock, state);
+    }
+
+    if (!list_is_empty(&drain)) {
+        AutoLock al(&arena_lock);
+        pmm_free_locked(&drain);
+    }
+}
+
+// Try to satisfy a single page allocation out of the local cache, refilling it
+// from the arenas in one batch if it is empty.
+static vm_page_t* pmm_pcpu_cache_alloc_page() {
+    spin_lock_saved_state_t state;
+    pmm_pcpu_cache* c = pmm_pcpu_cache_acquire(&state);
+    vm_page_t* page = list_remove_head_type(&c->free_list, vm_page_t, free.node);
+    if (page) {
+        c->free_count--;
+        c->alloc_hits++;
+        pmm_pcpu_cache_release(c, state);
+        return page;
+    }
+    c->alloc_misses++;
+    pmm_pcpu_cache_release(c, state);
+
+    // the arena lock is a mutex, so the refill happens without the cache lock
+    list_node batch = LIST_INITIAL_VALUE(batch);
+    size_t count = 0;
+    for (int pass = 0; pass < 2 && count == 0; pass++) {
+        // the arenas may only look empty because the free pages are sitting
+        // in other cpus' caches, give them back and try once more
+        if (pass > 0)
+            pmm_pcpu_cache_drain_all();
+
+        AutoLock al(&arena_lock);
+        count = pmm_alloc_pages_locked(PMM_PCPU_CACHE_BATCH, PMM_ALLOC_FLAG_ANY, &batch);
+    }
+    if (count == 0)
+        return nullptr;
+
+    page = list_remove_head_type(&batch, vm_page_t, free.node);
+    count--;
+    if (count > 0) {
+        c = pmm_pcpu_cache_acquire(&state);
+        list_node* node;
+        while ((node = list_remove_head(&batch))) {
+            list_add_tail(&c->free_list, node);
+        }
+        c->free_count += count;
+        pmm_pcpu_cache_release(c, state);
+    }
+    return page;
+}
+
+// Put a single page in the local cache, draining a batch back to the arenas if
+// the cache has grown past its limit.
+static void pmm_pcpu_cache_free_page(vm_page_t* page) {
+    list_node drain = LIST_INITIAL_VALUE(drain);
+    size_t drained = 0;
+
+    page->state = VM_PAGE_STATE_ALLOC;
+    page->age = 0;
+
+    spin_lock_saved_state_t state;
+    pmm_pcpu_cache* c = pmm_pcpu_cache_acquire(&state);
+    list_add_head(&c->free_list, &page->free.node);
+    c->free_count++;
+    c->free_hits++;
+    if (c->free_count > PMM_PCPU_CACHE_MAX) {
+        drained = pmm_pcpu_cache_take(c, PMM_PCPU_CACHE_BATCH, &drain);
+        c->drains++;
+    }
+    pmm_pcpu_cache_release(c, state);
+
+    if (drained > 0) {
+        AutoLock al(&arena_lock);
+        pmm_free_locked(&drain);
+    }
+}
+
+static size_t pmm_pcpu_cache_count_free() {
+    if (!pcpu_cache_enabled)
+        return 0;
+
+    size_t free = 0;
+    for (const auto& c : pcpu_cache) {
+        free += __atomic_load_n(&c.free_count, __ATOMIC_RELAXED);
+        free += __atomic_load_n(&c.zeroed_count, __ATOMIC_RELAXED);
+    }
+    return free;
+}
+
+static void pmm_pcpu_cache_dump() {
+    if (!pcpu_cache_enabled) {
+        printf("per-cpu page caches not initialized\n");
+        return;
+    }
+
+    for (uint i = 0; i < arch_max_num_cpus(); i++) {
+        const auto& c = pcpu_cache[i];
+        uint64_t allocs = c.alloc_hits + c.alloc_misses;
+        printf("cpu %u: cached %zu zeroed %zu alloc hits %" PRIu64 " misses %" PRIu64 " (%" PRIu64
+               "%% hit) frees %" PRIu64 " drains %" PRIu64 "\n",
+               i, c.free_count, c.zeroed_count, c.alloc_hits, c.alloc_misses,
+               allocs ? (c.alloc_hits * 100) / allocs : 0, c.free_hits, c.drains);
+    }
+}
+
 #if PMM_ENABLE_FREE_FILL
 static void pmm_enforce_fill(uint level) {
     for (auto& a : arena_list) {
@@ -107,27 +538,83 @@ done_add:
     return MX_OK;
 }
 
-vm_page_t* pmm_alloc_page(uint alloc_flags, paddr_t* pa) {
-    AutoLock al(&arena_lock);
+static vm_page_t* pmm_alloc_page_etc(uint alloc_flags, paddr_t* pa) {
+    if (pcpu_cache_enabled && alloc_flags == PMM_ALLOC_FLAG_ANY) {
+        vm_page_t* page = pmm_pcpu_cache_alloc_page();
+        if (page) {
+            if (pa)
+                *pa = vm_page_to_paddr(page);
+            return page;
+        }
+        // the cache could not be refilled even with every cache drained, so
+        // the arenas are empty
+        LTRACEF("failed to allocate page\n");
+        return nullptr;
+    }
 
-    /* walk the arenas in order until we find one with a free page */
-    for (auto& a : arena_list) {
-        /* skip the arena if it's not KMAP and the KMAP only allocation flag was passed */
-        if (alloc_flags & PMM_ALLOC_FLAG_KMAP) {
-            if ((a.flags() & PMM_ARENA_FLAG_KMAP) == 0)
-                continue;
+    for (int pass = 0; pass < 2; pass++) {
+        {
+            AutoLock al(&arena_lock);
+
+            /* walk the arenas in order until we find one with a free page */
+            vm_page_t* page = nullptr;
+            pmm_for_each_arena(alloc_flags, [&page, pa](PmmArena& a) {
+                // try to allocate the page out of the arena
+                page = a.AllocPage(pa);
+                return page != nullptr;
+            });
+            if (page) {
+                pmm_check_low_memory_locked();
+                return page;
+            }
         }
 
-        // try to allocate the page out of the arena
-        vm_page_t* page = a.AllocPage(pa);
-        if (page)
-            return page;
+        // the pages this allocation could use may be sitting in the per-cpu
+        // caches, give them back to the arenas and try once more
+        pmm_pcpu_cache_drain_all();
     }
 
     LTRACEF("failed to allocate page\n");
     return nullptr;
 }
 
+vm_page_t* pmm_alloc_page(uint alloc_flags, paddr_t* pa) {
+    if (!(alloc_flags & PMM_ALLOC_FLAG_ZEROED))
+        return pmm_alloc_page_etc(alloc_flags, pa);
+    alloc_flags &= ~PMM_ALLOC_FLAG_ZEROED;
+
+    list_node list = LIST_INITIAL_VALUE(list);
+    if (zero_pool_take(alloc_flags, 1, &list) > 0) {
+        vm_page_t* page = list_remove_head_type(&list, vm_page_t, free.node);
+        if (pa)
+            *pa = vm_page_to_paddr(page);
+        return page;
+    }
+
+    vm_page_t* page = pmm_alloc_page_etc(alloc_flags, pa);
+    if (page)
+        zero_free_page(page);
+    return page;
+}
+
+static size_t pmm_alloc_pages_locked(size_t count, uint alloc_flags, list_node* list) {
+    /* walk the arenas in order, allocating as many pages as we can from each */
+    size_t allocated = 0;
+    pmm_for_each_arena(alloc_flags, [&allocated, count, list](PmmArena& a) {
+        DEBUG_ASSERT(count > allocated);
+
+        // ask the arena to allocate some pages
+        allocated += a.AllocPages(count - allocated, list);
+        DEBUG_ASSERT(allocated <= count);
+        return allocated == count;
+    });
+
+    if (allocated > 0)
+        pmm_check_low_memory_locked();
+
+    return allocated;
+}
+
 size_t pmm_alloc_pages(size_t count, uint alloc_flags, struct list_node* list) {
     LTRACEF("count %zu\n", count);
 
@@ -137,24 +624,45 @@ size_t pmm_alloc_pages(size_t count, uint alloc_flags, struct list_node* list) {
     if (count == 0)
         return 0;
 
-    AutoLock al(&arena_lock);
-
-    /* walk the arenas in order, allocating as many pages as we can from each */
-    size_t allocated = 0;
-    for (auto& a : arena_list) {
-        DEBUG_ASSERT(count > allocated);
+    if (!(alloc_flags & PMM_ALLOC_FLAG_ZEROED)) {
+        size_t allocated;
+        {
+            AutoLock al(&arena_lock);
+            allocated = pmm_alloc_pages_locked(count, alloc_flags, list);
+        }
+        if (allocated < count) {
+            // the rest may be sitting in the per-cpu caches, give them back to
+            // the arenas and try once more
+            pmm_pcpu_cache_drain_all();
 
-        /* skip the arena if it's not KMAP and the KMAP only allocation flag was passed */
-        if (alloc_flags & PMM_ALLOC_FLAG_KMAP) {
-            if ((a.flags() & PMM_ARENA_FLAG_KMAP) == 0)
-                continue;
+            AutoLock al(&arena_lock);
+            allocated += pmm_alloc_pages_locked(count - allocated, alloc_flags, list);
+        }
+        return allocated;
+    }
+    alloc_flags &= ~PMM_ALLOC_FLAG_ZEROED;
+
+    // use up what the local cache has zeroed, then zero the rest ourselves
+    // after dropping the lock
+    size_t allocated = zero_pool_take(alloc_flags, count, list);
+    if (allocated < count) {
+        list_node dirty = LIST_INITIAL_VALUE(dirty);
+        for (int pass = 0; pass < 2 && allocated < count; pass++) {
+            // what the other cpus have cached, zeroed or not, goes back to the
+            // arenas before giving up; zeroed pages get zeroed again, which
+            // only matters when memory is about to run out anyway
+            if (pass > 0)
+                pmm_pcpu_cache_drain_all();
+
+            AutoLock al(&arena_lock);
+            allocated += pmm_alloc_pages_locked(count - allocated, alloc_flags, &dirty);
         }
 
-        // ask the arena to allocate some pages
-        allocated += a.AllocPages(count - allocated, list);
-        DEBUG_ASSERT(allocated <= count);
-        if (allocated == count)
-            break;
+        vm_page_t* page;
+        while ((page = list_remove_head_type(&dirty, vm_page_t, free.node))) {
+            zero_free_page(page);
+            list_add_tail(list, &page->free.node);
+        }
     }
 
     return allocated;
@@ -169,6 +677,9 @@ size_t pmm_alloc_range(paddr_t address, size_t count, struct list_node* list) {
 
     address = ROUNDDOWN(address, PAGE_SIZE);
 
+    // the requested pages may be sitting in a per-cpu cache
+    pmm_pcpu_cache_drain_all();
+
     AutoLock al(&arena_lock);
 
     /* walk through the arenas, looking to see if the physical page belongs to it */
@@ -201,20 +712,25 @@ size_t pmm_alloc_contiguous(size_t count, uint alloc_flags, uint8_t alignment_lo
     if (alignment_log2 < PAGE_SIZE_SHIFT)
         alignment_log2 = PAGE_SIZE_SHIFT;
 
-    AutoLock al(&arena_lock);
-
-    for (auto& a : arena_list) {
-        /* skip the arena if it's not KMAP and the KMAP only allocation flag was passed */
-        if (alloc_flags & PMM_ALLOC_FLAG_KMAP) {
-            if ((a.flags() & PMM_ARENA_FLAG_KMAP) == 0)
-                continue;
+    for (int pass = 0; pass < 2; pass++) {
+        {
+            AutoLock al(&arena_lock);
+
+            size_t allocated = 0;
+            pmm_for_each_arena(alloc_flags, [&](PmmArena& a) {
+                allocated = a.AllocContiguous(count, alignment_log2, pa, list);
+                return allocated > 0;
+            });
+            if (allocated > 0) {
+                DEBUG_ASSERT(allocated == count);
+                pmm_check_low_memory_locked();
+                return allocated;
+            }
         }
 
-        size_t allocated = a.AllocContiguous(count, alignment_log2, pa, list);
-        if (allocated > 0) {
-            DEBUG_ASSERT(allocated == count);
-            return allocated;
-        }
+        // pages held in the per-cpu caches may be breaking up a run, give them
+        // back to the arenas and try once more
+        pmm_pcpu_cache_drain_all();
     }
 
     LTRACEF("couldn't find run\n");
@@ -290,13 +806,7 @@ size_t pmm_free_kpages(void* _ptr, size_t count) {
     return pmm_free(&list);
 }
 
-size_t pmm_free(struct list_node* list) {
-    LTRACEF("list %p\n", list);
-
-    DEBUG_ASSERT(list);
-
-    AutoLock al(&arena_lock);
-
+static size_t pmm_free_locked(list_node* list) {
     uint count = 0;
     while (!list_is_empty(list)) {
         vm_page_t* page = list_remove_head_type(list, vm_page_t, free.node);
@@ -317,7 +827,22 @@ size_t pmm_free(struct list_node* list) {
     return count;
 }
 
+size_t pmm_free(struct list_node* list) {
+    LTRACEF("list %p\n", list);
+
+    DEBUG_ASSERT(list);
+
+    AutoLock al(&arena_lock);
+    return pmm_free_locked(list);
+}
+
 size_t pmm_free_page(vm_page_t* page) {
+    if (pcpu_cache_enabled) {
+        DEBUG_ASSERT(!page_is_free(page));
+        pmm_pcpu_cache_free_page(page);
+        return 1;
+    }
+
     struct list_node list;
     list_initialize(&list);
 
@@ -336,11 +861,11 @@ static size_t pmm_count_free_pages_locked() TA_REQ(arena_lock) {
 
 size_t pmm_count_free_pages() {
     AutoLock al(&arena_lock);
-    return pmm_count_free_pages_locked();
+    return pmm_count_free_pages_locked() + pmm_pcpu_cache_count_free();
 }
 
 static void pmm_dump_free() TA_REQ(arena_lock) {
-    auto megabytes_free = pmm_count_free_pages_locked() / 256u;
+    auto megabytes_free = (pmm_count_free_pages_locked() + pmm_pcpu_cache_count_free()) / 256u;
     printf(" %zu free MBs\n", megabytes_free);
 }
 
@@ -390,6 +915,9 @@ static int cmd_pmm(int argc, const cmd_args* argv, uint32_t flags) {
         printf("usage:\n");
         printf("%s arenas\n", argv[0].str);
         if (!is_panic) {
+            printf("%s caches\n", argv[0].str);
+            printf("%s drain_caches\n", argv[0].str);
+            printf("%s zero_pool\n", argv[0].str);
             printf("%s alloc <count>\n", argv[0].str);
             printf("%s alloc_range <address> <count>\n", argv[0].str);
             printf("%s alloc_kpages <count>\n", argv[0].str);
@@ -409,6 +937,15 @@ static int cmd_pmm(int argc, const cmd_args* argv, uint32_t flags) {
         // No other operations will work during a panic.
         printf("Only the \"arenas\" command is available during a panic.\n");
         goto usage;
+    } else if (!strcmp(argv[1].str, "caches")) {
+        pmm_pcpu_cache_dump();
+    } else if (!strcmp(argv[1].str, "drain_caches")) {
+        pmm_pcpu_cache_drain_all();
+    } else if (!strcmp(argv[1].str, "zero_pool")) {
+        pmm_zero_pool_stats_t stats;
+        pmm_get_zero_pool_stats(&stats);
+        printf("zero pool: depth %zu target %zu zeroed %" PRIu64 " hits %" PRIu64 " misses %" PRIu64 "\n",
+               stats.depth, stats.target, stats.zeroed, stats.hits, stats.misses);
     } else if (!strcmp(argv[1].str, "free")) {
         static bool show_mem = false;
         static timer_t timer;
@@ -70,18 +70,22 @@ void PmmArena::BootAllocArray() {
     free_count_ += page_count;
 }
 
-vm_page_t* PmmArena::AllocPage(paddr_t* pa) {
-    vm_page_t* page = list_remove_head_type(&free_list_, vm_page_t, free.node);
-    if (!page)
-        return nullptr;
-
+void PmmArena::RemoveFreePage(vm_page_t* page) {
+    DEBUG_ASSERT(page_is_free(page));
     DEBUG_ASSERT(free_count_ > 0);
 
     free_count_--;
 
-    DEBUG_ASSERT(page_is_free(page));
-
     page->state = VM_PAGE_STATE_ALLOC;
+    page->age = 0;
+}
+
+vm_page_t* PmmArena::AllocPage(paddr_t* pa) {
+    vm_page_t* page = list_remove_head_type(&free_list_, vm_page_t, free.node);
+    if (!page)
+        return nullptr;
+
+    RemoveFreePage(page);
 #if PMM_ENABLE_FREE_FILL
     CheckFreeFill(page);
 #endif
@@ -112,12 +116,7 @@ vm_page_t* PmmArena::AllocSpecific(paddr_t pa) {
     }
 
     list_delete(&page->free.node);
-
-    page->state = VM_PAGE_STATE_ALLOC;
-
-    DEBUG_ASSERT(free_count_ > 0);
-
-    free_count_--;
+    RemoveFreePage(page);
 
     return page;
 }
@@ -132,16 +131,11 @@ size_t PmmArena::AllocPages(size_t count, list_node* list) {
 
         LTRACEF("allocating page %p, pa %#" PRIxPTR "\n", page, page_address_from_arena(page));
 
-        DEBUG_ASSERT(free_count_ > 0);
-
-        free_count_--;
-
-        DEBUG_ASSERT(page_is_free(page));
+        RemoveFreePage(page);
 #if PMM_ENABLE_FREE_FILL
         CheckFreeFill(page);
 #endif
 
-        page->state = VM_PAGE_STATE_ALLOC;
         list_add_tail(list, &page->free.node);
 
         allocated++;
@@ -192,11 +186,7 @@ retry:
             DEBUG_ASSERT(list_in_list(&p->free.node));
 
             list_delete(&p->free.node);
-            p->state = VM_PAGE_STATE_ALLOC;
-
-            DEBUG_ASSERT(free_count_ > 0);
-
-            free_count_--;
+            RemoveFreePage(p);
 
 #if PMM_ENABLE_FREE_FILL
             CheckFreeFill(p);
@@ -239,8 +229,8 @@ void PmmArena::CountStates(size_t state_count[_VM_PAGE_STATE_COUNT]) const {
 
 void PmmArena::Dump(bool dump_pages, bool dump_free_ranges) {
     char pbuf[16];
-    printf("arena %p: name '%s' base %#" PRIxPTR " size %s (0x%zx) priority %u flags 0x%x\n", this, name(), base(),
-           format_size(pbuf, sizeof(pbuf), size()), size(), priority(), flags());
+    printf("arena %p: name '%s' base %#" PRIxPTR " size %s (0x%zx) priority %u flags 0x%x node %u\n", this,
+           name(), base(), format_size(pbuf, sizeof(pbuf), size()), size(), priority(), flags(), node());
     printf("\tpage_array %p, free_count %zu\n", page_array_, free_count_);
 
     /* dump all of the pages */
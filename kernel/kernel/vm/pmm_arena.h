@@ -38,6 +38,8 @@ public:
     unsigned int flags() const { return info_.flags; }
     unsigned int priority() const { return info_.priority; }
     size_t free_count() const { return free_count_; };
+    uint node() const { return node_; }
+    void set_node(uint node) { node_ = node; }
 
     // Counts the number of pages in every state. For each page in the arena,
     // increments the corresponding VM_PAGE_STATE_*-indexed entry of
@@ -74,6 +76,9 @@ public:
     }
 
 private:
+    // account for a free page being pulled off the free list
+    void RemoveFreePage(vm_page_t* page);
+
 #if PMM_ENABLE_FREE_FILL
     void FreeFill(vm_page_t* page);
     void CheckFreeFill(vm_page_t* page);
@@ -83,6 +88,7 @@ private:
     vm_page_t* page_array_ = nullptr;
 
     size_t free_count_ = 0;
+    uint node_ = 0;
     list_node free_list_ = LIST_INITIAL_VALUE(free_list_);
 
 #if PMM_ENABLE_FREE_FILL
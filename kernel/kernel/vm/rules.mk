@@ -13,7 +13,8 @@ MODULE_DEPS += \
     kernel/lib/mxtl \
     kernel/lib/pretty \
     kernel/lib/user_copy \
-    third_party/lib/cryptolib
+    third_party/lib/cryptolib \
+    third_party/lib/lz4
 
 MODULE_SRCS += \
     $(LOCAL_DIR)/bootalloc.cpp \
@@ -29,6 +30,8 @@ MODULE_SRCS += \
     $(LOCAL_DIR)/vm_object_paged.cpp \
     $(LOCAL_DIR)/vm_object_physical.cpp \
     $(LOCAL_DIR)/vm_page_list.cpp \
+    $(LOCAL_DIR)/vm_prefetch.cpp \
+    $(LOCAL_DIR)/vm_reclaim.cpp \
     $(LOCAL_DIR)/vm_unittest.cpp \
     $(LOCAL_DIR)/vmm.cpp \
 
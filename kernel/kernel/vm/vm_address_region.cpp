@@ -13,6 +13,7 @@
 #include <kernel/vm.h>
 #include <kernel/vm/vm_aspace.h>
 #include <kernel/vm/vm_object.h>
+#include <lib/heap.h>
 #include <mxalloc/new.h>
 #include <mxtl/auto_lock.h>
 #include <pow2.h>
@@ -65,7 +66,8 @@ status_t VmAddressRegion::CreateRoot(VmAspace& aspace, uint32_t vmar_flags,
     DEBUG_ASSERT(out);
 
     AllocChecker ac;
-    auto vmar = new (&ac) VmAddressRegion(aspace, aspace.base(), aspace.size(), vmar_flags);
+    auto vmar = new (HEAP_TAG_VM, &ac) VmAddressRegion(aspace, aspace.base(), aspace.size(),
+                                                       vmar_flags);
     if (!ac.check()) {
         return MX_ERR_NO_MEMORY;
     }
@@ -171,11 +173,11 @@ status_t VmAddressRegion::CreateSubVmarInternal(size_t offset, size_t size, uint
     AllocChecker ac;
     mxtl::RefPtr<VmAddressRegionOrMapping> vmar;
     if (vmo) {
-        vmar = mxtl::AdoptRef(new (&ac)
+        vmar = mxtl::AdoptRef(new (HEAP_TAG_VM, &ac)
                                   VmMapping(*this, new_base, size, vmar_flags,
                                             mxtl::move(vmo), vmo_offset, arch_mmu_flags));
     } else {
-        vmar = mxtl::AdoptRef(new (&ac)
+        vmar = mxtl::AdoptRef(new (HEAP_TAG_VM, &ac)
                                   VmAddressRegion(*this, new_base, size, vmar_flags, name));
     }
 
@@ -288,7 +290,7 @@ status_t VmAddressRegion::OverwriteVmMapping(
 
     AllocChecker ac;
     mxtl::RefPtr<VmAddressRegionOrMapping> vmar;
-    vmar = mxtl::AdoptRef(new (&ac)
+    vmar = mxtl::AdoptRef(new (HEAP_TAG_VM, &ac)
                               VmMapping(*this, base, size, vmar_flags,
                                         mxtl::move(vmo), vmo_offset, arch_mmu_flags));
     if (!ac.check()) {
@@ -757,53 +759,99 @@ status_t VmAddressRegion::LinearRegionAllocatorLocked(size_t size, uint8_t align
                                                      uint arch_mmu_flags, vaddr_t* spot) {
     DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
 
-    const vaddr_t base = 0;
-
     if (align_pow2 < PAGE_SIZE_SHIFT)
         align_pow2 = PAGE_SIZE_SHIFT;
     const vaddr_t align = 1UL << align_pow2;
 
     // Find the first gap in the address space which can contain a region of the
-    // requested size.
-    auto before_iter = subregions_.end();
-    auto after_iter = subregions_.begin();
+    // requested size.  Only gaps that are at least that big are looked at.
+    status_t status = MX_ERR_NO_MEMORY;
+    ForEachGap([&](vaddr_t gap_base, size_t gap_len) -> bool {
+        if (gap_len < size) {
+            return true;
+        }
 
-    do {
-        if (CheckGapLocked(before_iter, after_iter, spot, base, align, size, 0, arch_mmu_flags)) {
-            if (*spot != static_cast<vaddr_t>(-1)) {
-                return MX_OK;
-            } else {
-                return MX_ERR_NO_MEMORY;
-            }
+        auto after_iter = subregions_.upper_bound(gap_base);
+        auto before_iter = after_iter;
+        if (after_iter == subregions_.begin()) {
+            before_iter = subregions_.end();
+        } else {
+            --before_iter;
         }
 
-        before_iter = after_iter++;
-    } while (before_iter.IsValid());
+        if (!CheckGapLocked(before_iter, after_iter, spot, gap_base, align, size, 0,
+                            arch_mmu_flags)) {
+            return true;
+        }
+        if (*spot != static_cast<vaddr_t>(-1)) {
+            status = MX_OK;
+        }
+        return false;
+    },
+               align_pow2, size);
 
-    // couldn't find anything
-    return MX_ERR_NO_MEMORY;
+    return status;
+}
+
+template <typename F>
+bool VmAddressRegion::ReportGap(vaddr_t prev_end, vaddr_t next_base, F& func, vaddr_t align) {
+    // We round up the end of the previous region to the requested alignment,
+    // so all gaps reported will be for aligned ranges.
+    const vaddr_t gap_base = ROUNDUP(prev_end, align);
+    if (next_base > gap_base) {
+        return func(gap_base, next_base - gap_base);
+    }
+    return true;
 }
 
+// Visit the gaps between the children in the subtree rooted at |node| in
+// address order, skipping any part of the subtree that has no gap of at least
+// |min_gap| bytes.
 template <typename F>
-void VmAddressRegion::ForEachGap(F func, uint8_t align_pow2) {
+bool VmAddressRegion::ForEachGapInSubtree(const VmAddressRegionOrMapping* node, F& func,
+                                          vaddr_t align, size_t min_gap) {
+    if (node->subtree_gaps_.max_gap < min_gap || node->subtree_gaps_.gap_count == 0) {
+        return true;
+    }
+
+    if (const VmAddressRegionOrMapping* left = node->subtree_left()) {
+        if (!ForEachGapInSubtree(left, func, align, min_gap)) {
+            return false;
+        }
+        if (!ReportGap(left->subtree_gaps_.last + 1, node->base(), func, align)) {
+            return false;
+        }
+    }
+    if (const VmAddressRegionOrMapping* right = node->subtree_right()) {
+        if (!ReportGap(node->base() + node->size(), right->subtree_gaps_.first, func, align)) {
+            return false;
+        }
+        return ForEachGapInSubtree(right, func, align, min_gap);
+    }
+    return true;
+}
+
+template <typename F>
+void VmAddressRegion::ForEachGap(F func, uint8_t align_pow2, size_t min_gap) {
     const vaddr_t align = 1UL << align_pow2;
 
-    // Scan the regions list to find the gap to the left of each region.  We
-    // round up the end of the previous region to the requested alignment, so
-    // all gaps reported will be for aligned ranges.
-    vaddr_t prev_region_end = ROUNDUP(base_, align);
-    for (const auto& region : subregions_) {
-        if (region.base() > prev_region_end) {
-            const size_t gap = region.base() - prev_region_end;
-            if (!func(prev_region_end, gap)) {
-                return;
-            }
+    const VmAddressRegionOrMapping* root = subregions_.root();
+    vaddr_t prev_region_end = base_;
+    if (root) {
+        // The gap to the left of the first region, then the ones between
+        // regions, found by descending the child list.
+        if (!ReportGap(base_, root->subtree_gaps_.first, func, align)) {
+            return;
+        }
+        if (!ForEachGapInSubtree(root, func, align, min_gap)) {
+            return;
         }
-        prev_region_end = ROUNDUP(region.base() + region.size(), align);
+        prev_region_end = root->subtree_gaps_.last + 1;
     }
 
     // Grab the gap to the right of the last region (note that if there are no
     // regions, this handles reporting the VMAR's whole span as a gap).
+    prev_region_end = ROUNDUP(prev_region_end, align);
     const vaddr_t end = base_ + size_;
     if (end > prev_region_end) {
         const size_t gap = end - prev_region_end;
@@ -819,8 +867,116 @@ constexpr size_t AllocationSpotsInRange(size_t range_size, size_t alloc_size, ui
     return ((range_size - alloc_size) >> align_pow2) + 1;
 }
 
+// Number of times PickRandomSpotLocked() draws before giving up on a VMAR
+// whose gaps are mostly too small for the allocation.
+constexpr int kRandomSpotTries = 8;
+
 } // namespace {}
 
+// Choose an allocation spot uniformly at random using the gap information in
+// the child list, without visiting every gap.  Every gap of |len| bytes is
+// given |len| + |align| draws, which is at least as many as the spots it has
+// times |align|; a draw picks a spot if it lands on one of the |align| draws
+// that belong to it, and is retried otherwise.  Since every spot owns the same
+// number of draws, the result is uniform over all spots.  Returns false if no
+// spot was found within a few draws.
+bool VmAddressRegion::PickRandomSpotLocked(size_t size, uint8_t align_pow2, vaddr_t* spot) {
+    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+
+    const VmAddressRegionOrMapping* root = subregions_.root();
+    if (!root) {
+        return false;
+    }
+
+    const vaddr_t align = 1UL << align_pow2;
+    auto gap_weight = [align](size_t gap) -> size_t {
+        return gap ? gap + align : 0;
+    };
+    auto subtree_weight = [align](const VmAddressRegionOrMapping* node) -> size_t {
+        return node->subtree_gaps_.gap_bytes + node->subtree_gaps_.gap_count * align;
+    };
+
+    const size_t leading_gap = root->subtree_gaps_.first - base_;
+    const size_t trailing_gap = base_ + size_ - 1 - root->subtree_gaps_.last;
+
+    safeint::CheckedNumeric<size_t> total = root->subtree_gaps_.gap_count;
+    total *= align;
+    total += root->subtree_gaps_.gap_bytes;
+    const size_t interior_weight = total.ValueOrDefault(0);
+    total += gap_weight(leading_gap);
+    total += gap_weight(trailing_gap);
+    if (!total.IsValid() || total.ValueOrDie() == 0) {
+        return false;
+    }
+
+    for (int tries = 0; tries < kRandomSpotTries; tries++) {
+        size_t r = aspace_->AslrPrng().RandInt(total.ValueOrDie());
+
+        // Find the gap the draw landed in, leaving |r| as the offset into
+        // that gap's draws.
+        vaddr_t gap_base;
+        size_t gap_len;
+        if (r < gap_weight(leading_gap)) {
+            gap_base = base_;
+            gap_len = leading_gap;
+        } else if ((r -= gap_weight(leading_gap)) >= interior_weight) {
+            r -= interior_weight;
+            gap_base = root->subtree_gaps_.last + 1;
+            gap_len = trailing_gap;
+        } else {
+            const VmAddressRegionOrMapping* node = root;
+            for (;;) {
+                const VmAddressRegionOrMapping* left = node->subtree_left();
+                if (left) {
+                    if (r < subtree_weight(left)) {
+                        node = left;
+                        continue;
+                    }
+                    r -= subtree_weight(left);
+
+                    const size_t gap = node->base() - left->subtree_gaps_.last - 1;
+                    if (r < gap_weight(gap)) {
+                        gap_base = left->subtree_gaps_.last + 1;
+                        gap_len = gap;
+                        break;
+                    }
+                    r -= gap_weight(gap);
+                }
+
+                const VmAddressRegionOrMapping* right = node->subtree_right();
+                DEBUG_ASSERT(right);
+                const size_t gap = right->subtree_gaps_.first - (node->base() + node->size());
+                if (r < gap_weight(gap)) {
+                    gap_base = node->base() + node->size();
+                    gap_len = gap;
+                    break;
+                }
+                r -= gap_weight(gap);
+                node = right;
+            }
+        }
+        DEBUG_ASSERT(r < gap_len + align);
+
+        // Only the aligned part of the gap can hold the allocation.
+        const vaddr_t aligned_base = ROUNDUP(gap_base, align);
+        if (aligned_base - gap_base >= gap_len) {
+            continue;
+        }
+        const size_t aligned_len = gap_len - (aligned_base - gap_base);
+        if (aligned_len < size) {
+            continue;
+        }
+
+        const size_t spots = AllocationSpotsInRange(aligned_len, size, align_pow2);
+        if (r < (spots << align_pow2)) {
+            *spot = aligned_base + ((r >> align_pow2) << align_pow2);
+            return true;
+        }
+    }
+
+    return false;
+}
+
 // Perform allocations for VMARs that aren't using the COMPACT policy.  This
 // allocator works by choosing uniformly at random from the set of positions
 // that could satisfy the allocation.
@@ -833,42 +989,46 @@ status_t VmAddressRegion::NonCompactRandomizedRegionAllocatorLocked(size_t size,
     align_pow2 = mxtl::max(align_pow2, static_cast<uint8_t>(PAGE_SIZE_SHIFT));
     const vaddr_t align = 1UL << align_pow2;
 
-    // Calculate the number of spaces that we can fit this allocation in.
-    size_t candidate_spaces = 0;
-    ForEachGap([align, align_pow2, size, &candidate_spaces](vaddr_t gap_base, size_t gap_len) -> bool {
-        DEBUG_ASSERT(IS_ALIGNED(gap_base, align));
-        if (gap_len >= size) {
-            candidate_spaces += AllocationSpotsInRange(gap_len, size, align_pow2);
+    vaddr_t alloc_spot = static_cast<vaddr_t>(-1);
+    if (!PickRandomSpotLocked(size, align_pow2, &alloc_spot)) {
+        // The quick pick missed, so count every spot that could fit this
+        // allocation and choose among them exactly.
+        size_t candidate_spaces = 0;
+        ForEachGap([align, align_pow2, size, &candidate_spaces](vaddr_t gap_base, size_t gap_len) -> bool {
+            DEBUG_ASSERT(IS_ALIGNED(gap_base, align));
+            if (gap_len >= size) {
+                candidate_spaces += AllocationSpotsInRange(gap_len, size, align_pow2);
+            }
+            return true;
+        },
+                   align_pow2, size);
+
+        if (candidate_spaces == 0) {
+            return MX_ERR_NO_MEMORY;
         }
-        return true;
-    },
-               align_pow2);
 
-    if (candidate_spaces == 0) {
-        return MX_ERR_NO_MEMORY;
-    }
+        // Choose the index of the allocation to use.
+        size_t selected_index = aspace_->AslrPrng().RandInt(candidate_spaces);
+        DEBUG_ASSERT(selected_index < candidate_spaces);
 
-    // Choose the index of the allocation to use.
-    size_t selected_index = aspace_->AslrPrng().RandInt(candidate_spaces);
-    DEBUG_ASSERT(selected_index < candidate_spaces);
+        // Find which allocation we picked.
+        ForEachGap([align_pow2, size, &alloc_spot, &selected_index](vaddr_t gap_base,
+                                                                    size_t gap_len) -> bool {
+            if (gap_len < size) {
+                return true;
+            }
 
-    // Find which allocation we picked.
-    vaddr_t alloc_spot = static_cast<vaddr_t>(-1);
-    ForEachGap([align_pow2, size, &alloc_spot, &selected_index](vaddr_t gap_base,
-                                                                size_t gap_len) -> bool {
-        if (gap_len < size) {
+            const size_t spots = AllocationSpotsInRange(gap_len, size, align_pow2);
+            if (selected_index < spots) {
+                alloc_spot = gap_base + (selected_index << align_pow2);
+                return false;
+            }
+            selected_index -= spots;
             return true;
-        }
+        },
+                   align_pow2, size);
+    }
 
-        const size_t spots = AllocationSpotsInRange(gap_len, size, align_pow2);
-        if (selected_index < spots) {
-            alloc_spot = gap_base + (selected_index << align_pow2);
-            return false;
-        }
-        selected_index -= spots;
-        return true;
-    },
-               align_pow2);
     ASSERT(alloc_spot != static_cast<vaddr_t>(-1));
     ASSERT(IS_ALIGNED(alloc_spot, align));
 
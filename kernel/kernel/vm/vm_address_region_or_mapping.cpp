@@ -90,3 +90,61 @@ size_t VmAddressRegionOrMapping::AllocatedPages() const {
     }
     return AllocatedPagesLocked();
 }
+
+namespace {
+using ChildPtrTraits = mxtl::internal::ContainerPtrTraits<mxtl::RefPtr<VmAddressRegionOrMapping>>;
+} // namespace
+
+VmAddressRegionOrMapping* VmAddressRegionOrMapping::subtree_left() const {
+    const auto& child = subregion_list_node_.left_;
+    return ChildPtrTraits::IsValid(child) ? child.get() : nullptr;
+}
+
+VmAddressRegionOrMapping* VmAddressRegionOrMapping::subtree_right() const {
+    const auto& child = subregion_list_node_.right_;
+    return ChildPtrTraits::IsValid(child) ? child.get() : nullptr;
+}
+
+void VmAddressRegionOrMapping::UpdateSubtreeGaps() {
+    SubtreeGaps gaps = {base_, base_ + size_ - 1, 0, 0, 0};
+
+    auto add_gap = [&gaps](size_t gap) {
+        if (gap > 0) {
+            gaps.max_gap = mxtl::max(gaps.max_gap, gap);
+            gaps.gap_bytes += gap;
+            gaps.gap_count++;
+        }
+    };
+    auto add_subtree = [&gaps](const SubtreeGaps& sub) {
+        gaps.max_gap = mxtl::max(gaps.max_gap, sub.max_gap);
+        gaps.gap_bytes += sub.gap_bytes;
+        gaps.gap_count += sub.gap_count;
+    };
+
+    if (const VmAddressRegionOrMapping* left = subtree_left()) {
+        gaps.first = left->subtree_gaps_.first;
+        add_subtree(left->subtree_gaps_);
+        add_gap(base_ - left->subtree_gaps_.last - 1);
+    }
+    if (const VmAddressRegionOrMapping* right = subtree_right()) {
+        gaps.last = right->subtree_gaps_.last;
+        add_subtree(right->subtree_gaps_);
+        add_gap(right->subtree_gaps_.first - (base_ + size_ - 1) - 1);
+    }
+
+    subtree_gaps_ = gaps;
+}
+
+void VmAddressRegionOrMapping::UpdateSubtreeGapsToRootLocked() {
+    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+
+    // a region whose parent is being torn down may already be out of the list
+    if (!subregion_list_node_.InContainer())
+        return;
+
+    VmAddressRegionOrMapping* node = this;
+    while (ChildPtrTraits::IsValid(node)) {
+        node->UpdateSubtreeGaps();
+        node = node->subregion_list_node_.parent_;
+    }
+}
@@ -18,6 +18,7 @@
 #include <kernel/vm/vm_object.h>
 #include <kernel/vm/vm_object_paged.h>
 #include <kernel/vm/vm_object_physical.h>
+#include <lib/heap.h>
 #include <lib/crypto/global_prng.h>
 #include <lib/crypto/prng.h>
 #include <mxtl/auto_call.h>
@@ -175,7 +176,7 @@ mxtl::RefPtr<VmAspace> VmAspace::Create(uint32_t flags, const char* name) {
     }
 
     AllocChecker ac;
-    auto aspace = mxtl::AdoptRef(new (&ac) VmAspace(base, size, flags, name));
+    auto aspace = mxtl::AdoptRef(new (HEAP_TAG_VM, &ac) VmAspace(base, size, flags, name));
     if (!ac.check())
         return nullptr;
 
@@ -585,7 +586,7 @@ size_t VmAspace::AllocatedPages() const {
 void VmAspace::InitializeAslr() {
     aslr_enabled_ = is_user() && !cmdline_get_bool("aslr.disable", false);
 
-    crypto::GlobalPRNG::GetInstance()->Draw(aslr_seed_, sizeof(aslr_seed_));
+    crypto::GlobalPRNG::Draw(aslr_seed_, sizeof(aslr_seed_));
     aslr_prng_.AddEntropy(aslr_seed_, sizeof(aslr_seed_));
 }
 
@@ -10,23 +10,49 @@
 #include <assert.h>
 #include <err.h>
 #include <inttypes.h>
+#include <kernel/cmdline.h>
+#include <kernel/stats.h>
 #include <kernel/vm.h>
 #include <kernel/vm/fault.h>
 #include <kernel/vm/vm_aspace.h>
 #include <kernel/vm/vm_object.h>
+#include <lib/ktrace.h>
+#include <lk/init.h>
 #include <mxalloc/new.h>
 #include <mxtl/auto_call.h>
 #include <mxtl/auto_lock.h>
+#include <pow2.h>
 #include <safeint/safe_math.h>
 #include <trace.h>
 
 #define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
 
+// Default fault-around window for new mappings, in pages.
+// Can be overridden with kernel.vm-fault-around-pages, 0 disables it.
+#define VM_FAULT_AROUND_DEFAULT_PAGES 16u
+
+// Objects hinted MX_VMO_OP_SEQUENTIAL map this many windows ahead of a fault.
+#define VM_FAULT_AROUND_SEQUENTIAL_SCALE 4u
+
+static uint fault_around_default_pages = VM_FAULT_AROUND_DEFAULT_PAGES;
+
+static void vm_fault_around_init(uint level) {
+    uint pages = cmdline_get_uint32("kernel.vm-fault-around-pages", VM_FAULT_AROUND_DEFAULT_PAGES);
+    if (pages > 1 && !ispow2(pages)) {
+        printf("VM: ignoring non power of two fault-around window of %u pages\n", pages);
+        return;
+    }
+    fault_around_default_pages = pages;
+}
+
+LK_INIT_HOOK(vm_fault_around, &vm_fault_around_init, LK_INIT_LEVEL_VM);
+
 VmMapping::VmMapping(VmAddressRegion& parent, vaddr_t base, size_t size, uint32_t vmar_flags,
                      mxtl::RefPtr<VmObject> vmo, uint64_t vmo_offset, uint arch_mmu_flags)
     : VmAddressRegionOrMapping(base, size, vmar_flags,
                                parent.aspace_.get(), &parent),
-      object_(mxtl::move(vmo)), object_offset_(vmo_offset), arch_mmu_flags_(arch_mmu_flags) {
+      object_(mxtl::move(vmo)), object_offset_(vmo_offset), arch_mmu_flags_(arch_mmu_flags),
+      fault_around_pages_(fault_around_default_pages) {
 
     LTRACEF("%p aspace %p base %#" PRIxPTR " size %#zx offset %#" PRIx64 "\n",
             this, aspace_.get(), base_, size_, vmo_offset);
@@ -91,6 +117,22 @@ status_t VmMapping::Protect(vaddr_t base, size_t size, uint new_arch_mmu_flags)
     return ProtectLocked(base, size, new_arch_mmu_flags);
 }
 
+status_t VmMapping::SetFaultAroundPages(uint pages) {
+    canary_.Assert();
+
+    if (pages > 1 && !ispow2(pages)) {
+        return MX_ERR_INVALID_ARGS;
+    }
+
+    AutoLock guard(aspace_->lock());
+    if (state_ != LifeCycleState::ALIVE) {
+        return MX_ERR_BAD_STATE;
+    }
+
+    fault_around_pages_ = pages;
+    return MX_OK;
+}
+
 status_t VmMapping::ProtectLocked(vaddr_t base, size_t size, uint new_arch_mmu_flags) {
     DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
     DEBUG_ASSERT(size != 0 && IS_PAGE_ALIGNED(base) && IS_PAGE_ALIGNED(size));
@@ -144,6 +186,8 @@ status_t VmMapping::ProtectLocked(vaddr_t base, size_t size, uint new_arch_mmu_f
         arch_mmu_flags_ = new_arch_mmu_flags;
 
         size_ = size;
+        UpdateSubtreeGapsToRootLocked();
+        mapping->fault_around_pages_ = fault_around_pages_;
         mapping->ActivateLocked();
         return MX_OK;
     }
@@ -166,6 +210,8 @@ status_t VmMapping::ProtectLocked(vaddr_t base, size_t size, uint new_arch_mmu_f
         LTRACEF("arch_mmu_protect returns %d\n", status);
 
         size_ -= size;
+        UpdateSubtreeGapsToRootLocked();
+        mapping->fault_around_pages_ = fault_around_pages_;
         mapping->ActivateLocked();
         return MX_OK;
     }
@@ -196,7 +242,10 @@ status_t VmMapping::ProtectLocked(vaddr_t base, size_t size, uint new_arch_mmu_f
 
     // Turn us into the left half
     size_ = left_size;
+    UpdateSubtreeGapsToRootLocked();
 
+    center_mapping->fault_around_pages_ = fault_around_pages_;
+    right_mapping->fault_around_pages_ = fault_around_pages_;
     center_mapping->ActivateLocked();
     right_mapping->ActivateLocked();
     return MX_OK;
@@ -271,6 +320,7 @@ status_t VmMapping::UnmapLocked(vaddr_t base, size_t size) {
             parent_->subregions_.insert(mxtl::move(ref));
         }
         size_ -= size;
+        UpdateSubtreeGapsToRootLocked();
 
         return MX_OK;
     }
@@ -299,6 +349,8 @@ status_t VmMapping::UnmapLocked(vaddr_t base, size_t size) {
 
     // Turn us into the left half
     size_ = base - base_;
+    UpdateSubtreeGapsToRootLocked();
+    mapping->fault_around_pages_ = fault_around_pages_;
     mapping->ActivateLocked();
     return MX_OK;
 }
@@ -370,6 +422,22 @@ status_t VmMapping::UnmapVmoRangeLocked(uint64_t offset, uint64_t len) const {
     return MX_OK;
 }
 
+bool VmMapping::IsVmoPageMappedLocked(uint64_t offset) const {
+    canary_.Assert();
+
+    DEBUG_ASSERT(state_ == LifeCycleState::ALIVE);
+    DEBUG_ASSERT(object_->lock()->IsHeld());
+    DEBUG_ASSERT(IS_PAGE_ALIGNED(offset));
+
+    if (offset < object_offset_ || offset - object_offset_ >= size_)
+        return false;
+
+    paddr_t pa;
+    uint mmu_flags;
+    return arch_mmu_query(&aspace_->arch_aspace(), base_ + (offset - object_offset_),
+                          &pa, &mmu_flags) == MX_OK;
+}
+
 status_t VmMapping::MapRange(size_t offset, size_t len, bool commit) {
     canary_.Assert();
 
@@ -405,7 +473,30 @@ status_t VmMapping::MapRange(size_t offset, size_t len, bool commit) {
     auto ac = mxtl::MakeAutoCall([&]() { currently_faulting_ = false; });
 
     // iterate through the range, grabbing a page from the underlying object and
-    // mapping it in
+    // mapping it in. Physically contiguous runs are handed to the arch layer in
+    // a single call so it can use large page entries where the alignment allows.
+    vaddr_t run_va = 0;
+    paddr_t run_pa = 0;
+    size_t run_count = 0;
+    auto flush_run = [&]() {
+        if (run_count == 0)
+            return;
+
+        LTRACEF_LEVEL(2, "mapping pa %#" PRIxPTR " to va %#" PRIxPTR " count %zu\n",
+                      run_pa, run_va, run_count);
+
+        size_t mapped;
+        auto ret = arch_mmu_map(&aspace_->arch_aspace(), run_va, run_pa, run_count,
+                                arch_mmu_flags_, &mapped);
+        if (ret < 0) {
+            TRACEF("error %d mapping %zu pages at va %#" PRIxPTR " pa %#" PRIxPTR "\n",
+                   ret, run_count, run_va, run_pa);
+        }
+
+        DEBUG_ASSERT(mapped == run_count);
+        run_count = 0;
+    };
+
     size_t o;
     for (o = offset; o < offset + len; o += PAGE_SIZE) {
         uint64_t vmo_offset = object_offset_ + o;
@@ -417,24 +508,27 @@ status_t VmMapping::MapRange(size_t offset, size_t len, bool commit) {
             // no page to map
             if (commit) {
                 // fail when we can't commit every requested page
+                flush_run();
                 return status;
             } else {
                 // skip ahead
+                flush_run();
                 continue;
             }
         }
 
         vaddr_t va = base_ + o;
-        LTRACEF_LEVEL(2, "mapping pa %#" PRIxPTR " to va %#" PRIxPTR "\n", pa, va);
-
-        size_t mapped;
-        auto ret = arch_mmu_map(&aspace_->arch_aspace(), va, pa, 1, arch_mmu_flags_, &mapped);
-        if (ret < 0) {
-            TRACEF("error %d mapping page at va %#" PRIxPTR " pa %#" PRIxPTR "\n", ret, va, pa);
+        if (run_count > 0 && pa == run_pa + run_count * PAGE_SIZE) {
+            run_count++;
+            continue;
         }
 
-        DEBUG_ASSERT(mapped == 1);
+        flush_run();
+        run_va = va;
+        run_pa = pa;
+        run_count = 1;
     }
+    flush_run();
 
     return MX_OK;
 }
@@ -507,6 +601,148 @@ status_t VmMapping::DestroyLocked() {
     return MX_OK;
 }
 
+// Size of the smallest block one level up from a base page: 2MB for 4K pages.
+static const size_t kLargePageSize = 1UL << (PAGE_SIZE_SHIFT + PAGE_SIZE_SHIFT - 3);
+
+bool VmMapping::TryMapLargePageLocked(vaddr_t va, paddr_t pa, uint mmu_flags) {
+    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(object_->lock()->IsHeld());
+
+    // the window has to lie entirely within this mapping
+    vaddr_t window_va = ROUNDDOWN(va, kLargePageSize);
+    if (window_va < base_ || window_va + kLargePageSize - 1 > base_ + size_ - 1)
+        return false;
+
+    // and the page we faulted on has to sit at the matching offset of an aligned
+    // physical run, which rules out most candidates without a lookup
+    paddr_t window_pa = pa - (va - window_va);
+    if (!IS_ALIGNED(window_pa, kLargePageSize))
+        return false;
+
+    // pages in clones may come from the parent and must not be made writable
+    if (pa == vm_get_zero_page_paddr() || object_->is_cow_clone_locked())
+        return false;
+
+    const uint64_t window_offset = window_va - base_ + object_offset_;
+    for (size_t o = 0; o < kLargePageSize; o += PAGE_SIZE) {
+        paddr_t page_pa;
+        // only look at pages that are already resident, so that giving up on
+        // the window leaves the object as it was
+        if (object_->LookupPageLocked(window_offset + o, &page_pa) != MX_OK)
+            return false;
+        if (page_pa != window_pa + o)
+            return false;
+    }
+
+    LTRACEF("mapping large page pa %#" PRIxPTR " at va %#" PRIxPTR "\n", window_pa, window_va);
+
+    // replace whatever small pages were already mapped in the window
+    const size_t count = kLargePageSize / PAGE_SIZE;
+    status_t status = arch_mmu_unmap(&aspace_->arch_aspace(), window_va, count, nullptr);
+    if (status < 0)
+        return false;
+
+    size_t mapped;
+    status = arch_mmu_map(&aspace_->arch_aspace(), window_va, window_pa, count, mmu_flags, &mapped);
+    if (status < 0) {
+        TRACEF("failed to map large page at va %#" PRIxPTR "\n", window_va);
+        // the single page will be mapped by the regular path
+        arch_mmu_unmap(&aspace_->arch_aspace(), window_va, count, nullptr);
+        return false;
+    }
+    DEBUG_ASSERT(mapped == count);
+
+    return true;
+}
+
+size_t VmMapping::FaultAroundLocked(vaddr_t va) {
+    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(object_->lock()->IsHeld());
+
+    const VmObject::AccessHint hint = object_->access_hint_locked();
+    if (fault_around_pages_ <= 1 || hint == VmObject::AccessHint::RANDOM)
+        return 0;
+
+    // an aligned window around the faulting page, clipped to the mapping. An
+    // object that is read front to back gets a bigger one starting at the fault.
+    const size_t window_size = (size_t)fault_around_pages_ * PAGE_SIZE;
+    vaddr_t start, end;
+    if (hint == VmObject::AccessHint::SEQUENTIAL) {
+        start = va;
+        end = va + MIN(window_size * VM_FAULT_AROUND_SEQUENTIAL_SCALE, base_ + size_ - va);
+    } else {
+        start = MAX(ROUNDDOWN(va, window_size), base_);
+        end = MIN(ROUNDDOWN(va, window_size) + window_size - 1, base_ + size_ - 1) + 1;
+    }
+
+    // pages in clones may come from the parent and must not be made writable,
+    // the write fault will take care of copying them
+    uint mmu_flags = arch_mmu_flags_;
+    if (object_->is_cow_clone_locked())
+        mmu_flags &= ~ARCH_MMU_FLAG_PERM_WRITE;
+
+    size_t total = 0;
+    vaddr_t run_va = 0;
+    paddr_t run_pa = 0;
+    size_t run_len = 0;
+    auto flush_run = [&]() {
+        if (run_len == 0)
+            return;
+        size_t mapped;
+        status_t status = arch_mmu_map(&aspace_->arch_aspace(), run_va, run_pa, run_len,
+                                       mmu_flags, &mapped);
+        if (status == MX_OK) {
+            DEBUG_ASSERT(mapped == run_len);
+#if ARCH_ARM64
+            if (arch_mmu_flags_ & ARCH_MMU_FLAG_PERM_EXECUTE)
+                arch_sync_cache_range(run_va, run_len * PAGE_SIZE);
+#endif
+            total += run_len;
+        }
+        run_len = 0;
+    };
+
+    for (vaddr_t cur = start; cur < end; cur += PAGE_SIZE) {
+        if (cur == va) {
+            flush_run();
+            continue;
+        }
+
+        // only look at pages that already exist, without faulting any in
+        // (or decompressing them)
+        paddr_t pa;
+        const uint64_t offset = cur - base_ + object_offset_;
+        if (object_->LookupPageLocked(offset, &pa) != MX_OK ||
+            pa == vm_get_zero_page_paddr()) {
+            flush_run();
+            continue;
+        }
+
+        // leave anything that is already mapped alone
+        if (arch_mmu_query(&aspace_->arch_aspace(), cur, nullptr, nullptr) == MX_OK) {
+            flush_run();
+            continue;
+        }
+
+        if (run_len > 0 && pa != run_pa + run_len * PAGE_SIZE)
+            flush_run();
+        if (run_len == 0) {
+            run_va = cur;
+            run_pa = pa;
+        }
+        run_len++;
+    }
+    flush_run();
+
+    if (total > 0) {
+        LTRACEF("fault around va %#" PRIxPTR " mapped %zu pages\n", va, total);
+        __atomic_fetch_add(&get_local_percpu()->stats.fault_around_pages, total, __ATOMIC_RELAXED);
+        ktrace_probe2("vm_fault_around", static_cast<uint32_t>(total), fault_around_pages_);
+    }
+
+    return total;
+}
+
 status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags) {
     canary_.Assert();
     DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
@@ -626,6 +862,14 @@ status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags) {
         // assert that we're not accidentally mapping the zero page writable
         DEBUG_ASSERT((new_pa != vm_get_zero_page_paddr()) || !(mmu_flags & ARCH_MMU_FLAG_PERM_WRITE));
 
+        if (TryMapLargePageLocked(va, new_pa, mmu_flags)) {
+#if ARCH_ARM64
+            if (arch_mmu_flags_ & ARCH_MMU_FLAG_PERM_EXECUTE)
+                arch_sync_cache_range(ROUNDDOWN(va, kLargePageSize), kLargePageSize);
+#endif
+            return MX_OK;
+        }
+
         size_t mapped;
         status = arch_mmu_map(&aspace_->arch_aspace(), va, new_pa, 1, mmu_flags, &mapped);
         if (status < 0) {
@@ -633,6 +877,8 @@ status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags) {
             return MX_ERR_NO_MEMORY;
         }
         DEBUG_ASSERT(mapped == 1);
+
+        FaultAroundLocked(va);
     }
 
 // TODO: figure out what to do with this
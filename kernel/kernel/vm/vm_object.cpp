@@ -86,6 +86,12 @@ void VmObject::set_user_id(uint64_t user_id) {
     user_id_ = user_id;
 }
 
+void VmObject::set_access_hint(AccessHint hint) {
+    canary_.Assert();
+    AutoLock a(&lock_);
+    access_hint_ = hint;
+}
+
 uint64_t VmObject::user_id() const {
     canary_.Assert();
     AutoLock a(&lock_);
@@ -231,6 +237,25 @@ void VmObject::RangeChangeUpdateLocked(uint64_t offset, uint64_t len) {
     }
 }
 
+bool VmObject::IsPageMappedLocked(uint64_t offset) {
+    canary_.Assert();
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    const uint64_t aligned_offset = ROUNDDOWN(offset, PAGE_SIZE);
+
+    for (const auto& m : mapping_list_) {
+        if (m.IsVmoPageMappedLocked(aligned_offset))
+            return true;
+    }
+
+    for (auto& child : children_list_) {
+        if (child.IsPageMappedFromParentLocked(aligned_offset))
+            return true;
+    }
+
+    return false;
+}
+
 static int cmd_vm_object(int argc, const cmd_args* argv, uint32_t flags) {
     if (argc < 2) {
     notenoughargs:
@@ -17,7 +17,9 @@
 #include <kernel/vm/fault.h>
 #include <kernel/vm/vm_address_region.h>
 #include <lib/console.h>
+#include <lib/heap.h>
 #include <lib/user_copy.h>
+#include <magenta/types.h>
 #include <mxalloc/new.h>
 #include <safeint/safe_math.h>
 #include <stdlib.h>
@@ -42,6 +44,9 @@ void ZeroPage(vm_page_t* p) {
 
 } // namespace
 
+Mutex VmObjectPaged::reclaim_list_lock_ = {};
+VmObjectPaged::ReclaimList VmObjectPaged::reclaim_list_ = {};
+
 VmObjectPaged::VmObjectPaged(uint32_t pmm_alloc_flags, mxtl::RefPtr<VmObject> parent)
     : VmObject(mxtl::move(parent)), pmm_alloc_flags_(pmm_alloc_flags) {
     LTRACEF("%p\n", this);
@@ -52,6 +57,20 @@ VmObjectPaged::~VmObjectPaged() {
 
     LTRACEF("%p\n", this);
 
+    // make sure the reclaim thread is done with us before tearing anything down
+    {
+        AutoLock a(&reclaim_list_lock_);
+        if (reclaim_registered_)
+            reclaim_list_.erase(*this);
+    }
+
+    // pins are owned by whoever made them, and are dropped before the last
+    // reference to us goes away
+    {
+        AutoLock a(&lock_);
+        DEBUG_ASSERT(!AnyPagesPinnedLocked(0, size_));
+    }
+
     // free all of the pages attached to us
     page_list_.FreeAllPages();
 }
@@ -62,7 +81,8 @@ mxtl::RefPtr<VmObject> VmObjectPaged::Create(uint32_t pmm_alloc_flags, uint64_t
         return nullptr;
 
     AllocChecker ac;
-    auto vmo = mxtl::AdoptRef<VmObject>(new (&ac) VmObjectPaged(pmm_alloc_flags, nullptr));
+    auto vmo = mxtl::AdoptRef<VmObject>(
+        new (HEAP_TAG_VM, &ac) VmObjectPaged(pmm_alloc_flags, nullptr));
     if (!ac.check())
         return nullptr;
 
@@ -83,7 +103,8 @@ status_t VmObjectPaged::CloneCOW(uint64_t offset, uint64_t size, bool copy_name,
     canary_.Assert();
 
     AllocChecker ac;
-    auto vmo = mxtl::AdoptRef<VmObjectPaged>(new (&ac) VmObjectPaged(pmm_alloc_flags_, mxtl::WrapRefPtr(this)));
+    auto vmo = mxtl::AdoptRef<VmObjectPaged>(
+        new (HEAP_TAG_VM, &ac) VmObjectPaged(pmm_alloc_flags_, mxtl::WrapRefPtr(this)));
     if (!ac.check())
         return MX_ERR_NO_MEMORY;
 
@@ -125,8 +146,8 @@ void VmObjectPaged::Dump(uint depth, bool verbose) {
         printf("  ");
     }
     printf("vmo %p/k%" PRIu64 " size %#" PRIx64
-           " pages %zu ref %d parent k%" PRIu64 "\n",
-           this, user_id_, size_, count, ref_count_debug(), parent_id);
+           " pages %zu compressed %zu ref %d parent k%" PRIu64 "\n",
+           this, user_id_, size_, count, compressed_pages_.size(), ref_count_debug(), parent_id);
 
     if (verbose) {
         auto f = [depth](const auto p, uint64_t offset) {
@@ -146,16 +167,9 @@ size_t VmObjectPaged::AllocatedPagesInRange(uint64_t offset, uint64_t len) const
     if (!TrimRange(offset, len, size_, &new_len)) {
         return 0;
     }
-    size_t count = 0;
     // TODO: Figure out what to do with our parent's pages. If we're a clone,
     // page_list_ only contains pages that we've made copies of.
-    page_list_.ForEveryPage(
-        [&count, offset, new_len](const auto p, uint64_t off) {
-            if (off >= offset && off < offset + new_len) {
-                count++;
-            }
-        });
-    return count;
+    return page_list_.CountPagesInRange(offset, offset + new_len);
 }
 
 status_t VmObjectPaged::AddPage(vm_page_t* p, uint64_t offset) {
@@ -217,6 +231,8 @@ mxtl::RefPtr<VmObject> VmObjectPaged::CreateFromROData(const void* data, size_t
                       page->state);
             }
 
+            page->object.pin_count = 0;
+
             // XXX hack to work around the ref pointer to the base class
             auto vmo2 = static_cast<VmObjectPaged*>(vmo.get());
             vmo2->AddPage(page, count * PAGE_SIZE);
@@ -234,6 +250,30 @@ mxtl::RefPtr<VmObject> VmObjectPaged::CreateFromROData(const void* data, size_t
     return vmo;
 }
 
+status_t VmObjectPaged::LookupPageLocked(uint64_t offset, paddr_t* pa) {
+    canary_.Assert();
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    if (offset >= size_)
+        return MX_ERR_OUT_OF_RANGE;
+
+    vm_page_t* p = page_list_.GetPage(offset);
+    if (p) {
+        *pa = vm_page_to_paddr(p);
+        return MX_OK;
+    }
+
+    if (parent_) {
+        safeint::CheckedNumeric<uint64_t> parent_offset = parent_offset_;
+        parent_offset += offset;
+        DEBUG_ASSERT(parent_offset.IsValid());
+
+        return parent_->LookupPageLocked(parent_offset.ValueOrDie(), pa);
+    }
+
+    return MX_ERR_NOT_FOUND;
+}
+
 status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, vm_page_t** const page_out, paddr_t* const pa_out) {
     canary_.Assert();
     DEBUG_ASSERT(lock_.IsHeld());
@@ -247,6 +287,7 @@ status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, vm_page_t*
     // see if we already have a page at that offset
     p = page_list_.GetPage(offset);
     if (p) {
+        p->age = 0;
         if (page_out)
             *page_out = p;
         if (pa_out)
@@ -254,6 +295,31 @@ status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, vm_page_t*
         return MX_OK;
     }
 
+    // bring back a page the reclaim thread compressed. nothing can have it
+    // mapped, that was all torn down when it was compressed.
+    if (unlikely(!compressed_pages_.is_empty()) && compressed_pages_.find(offset).IsValid()) {
+        p = pmm_alloc_page(pmm_alloc_flags_, &pa);
+        if (!p)
+            return MX_ERR_NO_MEMORY;
+
+        p->state = VM_PAGE_STATE_OBJECT;
+        p->object.pin_count = 0;
+
+        __UNUSED bool restored = RestoreCompressedPageLocked(offset, p);
+        DEBUG_ASSERT(restored);
+
+        status_t status = AddPageLocked(p, offset);
+        DEBUG_ASSERT(status == MX_OK);
+
+        LTRACEF("decompressed page %p, pa %#" PRIxPTR "\n", p, pa);
+
+        if (page_out)
+            *page_out = p;
+        if (pa_out)
+            *pa_out = pa;
+        return MX_OK;
+    }
+
     __UNUSED char pf_string[5];
     LTRACEF("vmo %p, offset %#" PRIx64 ", pf_flags %#x (%s)\n", this, offset, pf_flags,
             vmm_pf_flags_to_string(pf_flags, pf_string));
@@ -289,6 +355,7 @@ status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, vm_page_t*
                 return MX_ERR_NO_MEMORY;
 
             p_clone->state = VM_PAGE_STATE_OBJECT;
+            p_clone->object.pin_count = 0;
 
             // do a direct copy of the two pages
             const void* src = paddr_to_kvaddr(pa);
@@ -329,15 +396,13 @@ status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, vm_page_t*
         return MX_OK;
     }
 
-    // allocate a page
-    p = pmm_alloc_page(pmm_alloc_flags_, &pa);
+    // allocate a page, preferably out of the pre-zeroed pool
+    p = pmm_alloc_page(pmm_alloc_flags_ | PMM_ALLOC_FLAG_ZEROED, &pa);
     if (!p)
         return MX_ERR_NO_MEMORY;
 
     p->state = VM_PAGE_STATE_OBJECT;
-
-    // TODO: remove once pmm returns zeroed pages
-    ZeroPage(pa);
+    p->object.pin_count = 0;
 
     status_t status = AddPageLocked(p, offset);
     DEBUG_ASSERT(status == MX_OK);
@@ -377,12 +442,9 @@ status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len, uint64_t* com
     uint64_t end = ROUNDUP_PAGE_SIZE(offset + new_len);
     DEBUG_ASSERT(end > offset);
 
-    // make a pass through the list, counting the number of pages we need to allocate
-    size_t count = 0;
-    for (uint64_t o = offset; o < end; o += PAGE_SIZE) {
-        if (!page_list_.GetPage(o))
-            count++;
-    }
+    // count the number of pages we need to allocate
+    uint64_t start = ROUNDDOWN(offset, PAGE_SIZE);
+    size_t count = (end - start) / PAGE_SIZE - page_list_.CountPagesInRange(start, end);
     if (count == 0)
         return MX_OK;
 
@@ -390,7 +452,7 @@ status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len, uint64_t* com
     list_node page_list;
     list_initialize(&page_list);
 
-    size_t allocated = pmm_alloc_pages(count, pmm_alloc_flags_, &page_list);
+    size_t allocated = pmm_alloc_pages(count, pmm_alloc_flags_ | PMM_ALLOC_FLAG_ZEROED, &page_list);
     if (allocated < count) {
         LTRACEF("failed to allocate enough pages (asked for %zu, got %zu)\n", count, allocated);
         pmm_free(&page_list);
@@ -410,9 +472,10 @@ status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len, uint64_t* com
         ASSERT(p);
 
         p->state = VM_PAGE_STATE_OBJECT;
+        p->object.pin_count = 0;
 
-        // TODO: remove once pmm returns zeroed pages
-        ZeroPage(p);
+        // pages that were compressed get their old contents instead of zeros
+        RestoreCompressedPageLocked(o, p);
 
         status_t status = page_list_.AddPage(p, o);
         DEBUG_ASSERT(status == MX_OK);
@@ -452,6 +515,10 @@ status_t VmObjectPaged::CommitRangeContiguous(uint64_t offset, uint64_t len, uin
     uint64_t end = ROUNDUP_PAGE_SIZE(offset + new_len);
     DEBUG_ASSERT(end > offset);
 
+    // the caller is going to hand the physical addresses to hardware
+    reclaimable_ = false;
+    FreeCompressedPagesInRangeLocked(ROUNDDOWN(offset, PAGE_SIZE), end);
+
     // make a pass through the list, making sure we have an empty run on the object
     size_t count = 0;
     for (uint64_t o = offset; o < end; o += PAGE_SIZE) {
@@ -483,6 +550,7 @@ status_t VmObjectPaged::CommitRangeContiguous(uint64_t offset, uint64_t len, uin
         ASSERT(p);
 
         p->state = VM_PAGE_STATE_OBJECT;
+        p->object.pin_count = 0;
 
         // TODO: remove once pmm returns zeroed pages
         ZeroPage(p);
@@ -528,16 +596,18 @@ status_t VmObjectPaged::DecommitRange(uint64_t offset, uint64_t len, uint64_t* d
     LTRACEF("start offset %#" PRIx64 ", end %#" PRIx64 ", page_aliged_len %#" PRIx64 "\n", start, end,
             page_aligned_len);
 
+    // pages handed to hardware have to stay where they are
+    if (AnyPagesPinnedLocked(start, end))
+        return MX_ERR_BAD_STATE;
+
     // unmap all of the pages in this range on all the mapping regions
     RangeChangeUpdateLocked(start, page_aligned_len);
 
-    // iterate through the pages, freeing them
-    while (start < end) {
-        auto status = page_list_.FreePage(start);
-        if (status == MX_OK && decommitted) {
-            *decommitted += PAGE_SIZE;
-        }
-        start += PAGE_SIZE;
+    // free all of the pages in the range at once
+    size_t freed = page_list_.FreePagesInRange(start, end);
+    FreeCompressedPagesInRangeLocked(start, end);
+    if (decommitted) {
+        *decommitted = freed * PAGE_SIZE;
     }
 
     return MX_OK;
@@ -563,14 +633,15 @@ status_t VmObjectPaged::ResizeLocked(uint64_t s) {
 
         // we're only worried about whole pages to be removed
         if (page_aligned_len > 0) {
+            if (AnyPagesPinnedLocked(start, end))
+                return MX_ERR_BAD_STATE;
+
             // unmap all of the pages in this range on all the mapping regions
             RangeChangeUpdateLocked(start, page_aligned_len);
 
-            // iterate through the pages, freeing them
-            while (start < end) {
-                page_list_.FreePage(start);
-                start += PAGE_SIZE;
-            }
+            // free all of the pages in the range at once
+            page_list_.FreePagesInRange(start, end);
+            FreeCompressedPagesInRangeLocked(start, end);
         }
     } else if (s > size_) {
         // expanding
@@ -717,6 +788,9 @@ status_t VmObjectPaged::Lookup(uint64_t offset, uint64_t len, uint pf_flags,
     if (unlikely(!InRange(offset, len, size_)))
         return MX_ERR_OUT_OF_RANGE;
 
+    // the physical addresses may end up somewhere we can't unmap them from
+    reclaimable_ = false;
+
     uint64_t start_page_offset = ROUNDDOWN(offset, PAGE_SIZE);
     uint64_t end_page_offset = ROUNDUP(offset + len, PAGE_SIZE);
 
@@ -803,6 +877,283 @@ status_t VmObjectPaged::SyncCache(const uint64_t offset, const uint64_t len) {
     return CacheOp(offset, len, CacheOpType::Sync);
 }
 
+status_t VmObjectPaged::SetPreferredNode(uint32_t node) {
+    canary_.Assert();
+
+    if (node != MX_VMO_NUMA_NODE_LOCAL && node >= PMM_MAX_NODES)
+        return MX_ERR_INVALID_ARGS;
+
+    AutoLock a(&lock_);
+
+    pmm_alloc_flags_ &= ~(PMM_ALLOC_FLAG_NODE_VALID | PMM_ALLOC_FLAG_NODE_MASK);
+    if (node != MX_VMO_NUMA_NODE_LOCAL)
+        pmm_alloc_flags_ |= PMM_ALLOC_FLAG_NODE(node);
+
+    return MX_OK;
+}
+
+status_t VmObjectPaged::Pin(uint64_t offset, uint64_t len) {
+    canary_.Assert();
+    if (unlikely(len == 0))
+        return MX_ERR_INVALID_ARGS;
+
+    AutoLock a(&lock_);
+
+    if (unlikely(!InRange(offset, len, size_)))
+        return MX_ERR_OUT_OF_RANGE;
+
+    // pinned pages are handed to hardware behind the reclaim thread's back
+    reclaimable_ = false;
+
+    uint64_t start_page_offset = ROUNDDOWN(offset, PAGE_SIZE);
+    uint64_t end_page_offset = ROUNDUP(offset + len, PAGE_SIZE);
+
+    for (uint64_t off = start_page_offset; off != end_page_offset; off += PAGE_SIZE) {
+        // write fault the page in, so that it's our own and a copy-on-write
+        // fault can't replace it later
+        vm_page_t* p;
+        status_t status = GetPageLocked(off, VMM_PF_FLAG_SW_FAULT | VMM_PF_FLAG_WRITE, &p, nullptr);
+        if (status == MX_OK && p->object.pin_count == UINT32_MAX)
+            status = MX_ERR_UNAVAILABLE;
+        if (status != MX_OK) {
+            UnpinLocked(start_page_offset, off);
+            return status;
+        }
+        p->object.pin_count++;
+    }
+
+    return MX_OK;
+}
+
+status_t VmObjectPaged::Unpin(uint64_t offset, uint64_t len) {
+    canary_.Assert();
+    if (unlikely(len == 0))
+        return MX_ERR_INVALID_ARGS;
+
+    AutoLock a(&lock_);
+
+    if (unlikely(!InRange(offset, len, size_)))
+        return MX_ERR_OUT_OF_RANGE;
+
+    uint64_t start_page_offset = ROUNDDOWN(offset, PAGE_SIZE);
+    uint64_t end_page_offset = ROUNDUP(offset + len, PAGE_SIZE);
+
+    // check the whole range before dropping any pins, so a bad request
+    // changes nothing
+    for (uint64_t off = start_page_offset; off != end_page_offset; off += PAGE_SIZE) {
+        vm_page_t* p = page_list_.GetPage(off);
+        if (!p || p->object.pin_count == 0)
+            return MX_ERR_BAD_STATE;
+    }
+
+    UnpinLocked(start_page_offset, end_page_offset);
+    return MX_OK;
+}
+
+void VmObjectPaged::UnpinLocked(uint64_t start_offset, uint64_t end_offset) {
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    for (uint64_t off = start_offset; off != end_offset; off += PAGE_SIZE) {
+        vm_page_t* p = page_list_.GetPage(off);
+        DEBUG_ASSERT(p && p->object.pin_count > 0);
+        p->object.pin_count--;
+    }
+}
+
+bool VmObjectPaged::AnyPagesPinnedLocked(uint64_t start_offset, uint64_t end_offset) {
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    bool pinned = false;
+    page_list_.ForEveryPageInRange([&pinned](const vm_page_t* p, uint64_t) {
+        if (p->object.pin_count > 0)
+            pinned = true;
+    }, start_offset, end_offset);
+    return pinned;
+}
+
+status_t VmObjectPaged::EnableReclaim() {
+    canary_.Assert();
+
+    {
+        AutoLock a(&lock_);
+
+        // a clone's pages are either its own copies or borrowed from the parent,
+        // leave it to the parent to decide
+        if (is_cow_clone_locked())
+            return MX_ERR_NOT_SUPPORTED;
+
+        reclaimable_ = true;
+    }
+
+    AutoLock a(&reclaim_list_lock_);
+    if (!reclaim_registered_) {
+        reclaim_list_.push_back(this);
+        reclaim_registered_ = true;
+    }
+
+    return MX_OK;
+}
+
+status_t VmObjectPaged::MarkReclaimable(uint64_t offset, uint64_t len) {
+    canary_.Assert();
+
+    AutoLock a(&lock_);
+
+    uint64_t new_len;
+    if (!TrimRange(offset, len, size_, &new_len))
+        return MX_ERR_OUT_OF_RANGE;
+
+    if (!reclaimable_)
+        return MX_ERR_NOT_SUPPORTED;
+
+    // a page at the maximum age is taken as soon as a reclaim pass gets to it.
+    // Mapped pages keep their age, since they can still be in use.
+    uint64_t start = ROUNDDOWN(offset, PAGE_SIZE);
+    uint64_t end = ROUNDUP_PAGE_SIZE(offset + new_len);
+    for (uint64_t off = start; off < end; off += PAGE_SIZE) {
+        vm_page_t* p = page_list_.GetPage(off);
+        if (p && !IsPageMappedLocked(off))
+            p->age = VM_PAGE_AGE_MAX;
+    }
+
+    return MX_OK;
+}
+
+status_t VmObjectPaged::CommitRangeAsync(uint64_t offset, uint64_t len,
+                                         vmo_commit_done_fn_t done_fn, void* context) {
+    canary_.Assert();
+    LTRACEF("offset %#" PRIx64 ", len %#" PRIx64 "\n", offset, len);
+
+    // catch a bad range here rather than on the prefetch thread
+    {
+        AutoLock a(&lock_);
+        uint64_t new_len;
+        if (!TrimRange(offset, len, size_, &new_len))
+            return MX_ERR_OUT_OF_RANGE;
+    }
+
+    return vm_prefetch_queue(mxtl::RefPtr<VmObject>(this), offset, len, done_fn, context);
+}
+
+size_t VmObjectPaged::ReclaimPages(uint min_age, size_t max_pages) {
+    canary_.Assert();
+    DEBUG_ASSERT(min_age <= VM_PAGE_AGE_MAX);
+
+    static const size_t kBatch = 32;
+
+    AutoLock a(&lock_);
+
+    if (!reclaimable_)
+        return 0;
+
+    // age every resident page, picking out the first few that have been left
+    // alone long enough. Only lookups reset the age, and a page that is mapped
+    // can be used without one, so mapped pages that come of age start over
+    // rather than being taken.
+    uint64_t victims[kBatch];
+    size_t count = 0;
+    const size_t limit = MIN(max_pages, kBatch);
+    page_list_.ForEveryPage([&](vm_page_t* p, uint64_t offset) {
+        // reclaim may have been enabled after the page was pinned
+        if (p->object.pin_count > 0)
+            return;
+        if (p->age < min_age) {
+            p->age++;
+        } else if (count < limit) {
+            victims[count++] = offset;
+        } else if (p->age < VM_PAGE_AGE_MAX) {
+            p->age++;
+        }
+    });
+
+    size_t reclaimed = 0;
+    for (size_t i = 0; i < count; i++) {
+        const uint64_t offset = victims[i];
+        vm_page_t* p = page_list_.GetPage(offset);
+        DEBUG_ASSERT(p);
+
+        if (IsPageMappedLocked(offset)) {
+            p->age = 0;
+            continue;
+        }
+
+        // make sure nobody can see the page anymore before copying it out
+        RangeChangeUpdateLocked(offset, PAGE_SIZE);
+
+        // zero filled pages need no copy, the zero page stands in for them
+        const void* src = paddr_to_kvaddr(vm_page_to_paddr(p));
+        if (vm_page_is_zero(src)) {
+            vm_reclaim_count_zero_dropped();
+        } else {
+            auto cp = VmCompressedPage::Create(offset, src);
+            if (!cp) {
+                // not worth it or out of heap, give it another few passes
+                p->age = 0;
+                continue;
+            }
+            compressed_pages_.insert(mxtl::move(cp));
+        }
+
+        __UNUSED status_t status = page_list_.FreePage(offset);
+        DEBUG_ASSERT(status == MX_OK);
+        reclaimed++;
+    }
+
+    LTRACEF("vmo %p reclaimed %zu of %zu candidates\n", this, reclaimed, count);
+
+    return reclaimed;
+}
+
+size_t VmObjectPaged::ReclaimAll(uint min_age, size_t target) {
+    AutoLock a(&reclaim_list_lock_);
+
+    // rotate the list as we go so that the next pass starts where this one
+    // left off rather than always picking on the oldest objects
+    size_t reclaimed = 0;
+    for (size_t n = reclaim_list_.size_slow(); n > 0 && reclaimed < target; n--) {
+        VmObjectPaged* vmo = reclaim_list_.pop_front();
+        reclaim_list_.push_back(vmo);
+        reclaimed += vmo->ReclaimPages(min_age, target - reclaimed);
+    }
+
+    return reclaimed;
+}
+
+bool VmObjectPaged::IsPageMappedFromParentLocked(uint64_t offset) {
+    canary_.Assert();
+
+    if (offset < parent_offset_ || offset - parent_offset_ >= size_)
+        return false;
+    offset -= parent_offset_;
+
+    // a page of our own hides the parent's from our mappings
+    if (page_list_.GetPage(offset))
+        return false;
+
+    return IsPageMappedLocked(offset);
+}
+
+bool VmObjectPaged::RestoreCompressedPageLocked(uint64_t offset, vm_page_t* p) {
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    auto cp = compressed_pages_.erase(offset);
+    if (!cp)
+        return false;
+
+    cp->Decompress(paddr_to_kvaddr(vm_page_to_paddr(p)));
+    vm_reclaim_count_decompressed();
+    return true;
+}
+
+void VmObjectPaged::FreeCompressedPagesInRangeLocked(uint64_t start_offset, uint64_t end_offset) {
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    auto iter = compressed_pages_.lower_bound(start_offset);
+    while (iter.IsValid() && iter->GetKey() < end_offset) {
+        compressed_pages_.erase(iter++);
+    }
+}
+
 status_t VmObjectPaged::CacheOp(const uint64_t start_offset, const uint64_t len,
                                 const CacheOpType type) {
     canary_.Assert();
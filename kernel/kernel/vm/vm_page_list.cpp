@@ -68,16 +68,28 @@ VmPageList::~VmPageList() {
     DEBUG_ASSERT(list_.is_empty());
 }
 
+VmPageListNode* VmPageList::FindNode(uint64_t node_offset) {
+    if (last_node_ && last_node_->offset() == node_offset)
+        return last_node_;
+
+    auto pln = list_.find(node_offset);
+    if (!pln.IsValid())
+        return nullptr;
+
+    last_node_ = &*pln;
+    return last_node_;
+}
+
 status_t VmPageList::AddPage(vm_page* p, uint64_t offset) {
-    uint64_t node_offset = ROUNDDOWN(offset, PAGE_SIZE * VmPageListNode::kPageFanOut);
+    uint64_t node_offset = NodeOffset(offset);
     size_t index = (offset >> PAGE_SIZE_SHIFT) % VmPageListNode::kPageFanOut;
 
     LTRACEF_LEVEL(2, "%p page %p, offset %#" PRIx64 " node_offset %#" PRIx64 " index %zu\n", this, p, offset,
                   node_offset, index);
 
     // lookup the tree node that holds this page
-    auto pln = list_.find(node_offset);
-    if (!pln.IsValid()) {
+    auto pln = FindNode(node_offset);
+    if (!pln) {
         AllocChecker ac;
         mxtl::unique_ptr<VmPageListNode> pl =
             mxtl::unique_ptr<VmPageListNode>(new (&ac) VmPageListNode(node_offset));
@@ -88,6 +100,7 @@ status_t VmPageList::AddPage(vm_page* p, uint64_t offset) {
         __UNUSED auto status = pl->AddPage(p, index);
         DEBUG_ASSERT(status == MX_OK);
 
+        last_node_ = pl.get();
         list_.insert(mxtl::move(pl));
     } else {
         pln->AddPage(p, index);
@@ -97,15 +110,15 @@ status_t VmPageList::AddPage(vm_page* p, uint64_t offset) {
 }
 
 vm_page* VmPageList::GetPage(uint64_t offset) {
-    uint64_t node_offset = ROUNDDOWN(offset, PAGE_SIZE * VmPageListNode::kPageFanOut);
+    uint64_t node_offset = NodeOffset(offset);
     size_t index = (offset >> PAGE_SIZE_SHIFT) % VmPageListNode::kPageFanOut;
 
     LTRACEF_LEVEL(2, "%p offset %#" PRIx64 " node_offset %#" PRIx64 " index %zu\n", this, offset, node_offset,
                   index);
 
     // lookup the tree node that holds this page
-    auto pln = list_.find(node_offset);
-    if (!pln.IsValid()) {
+    auto pln = FindNode(node_offset);
+    if (!pln) {
         return nullptr;
     }
 
@@ -113,15 +126,15 @@ vm_page* VmPageList::GetPage(uint64_t offset) {
 }
 
 status_t VmPageList::FreePage(uint64_t offset) {
-    uint64_t node_offset = ROUNDDOWN(offset, PAGE_SIZE * VmPageListNode::kPageFanOut);
+    uint64_t node_offset = NodeOffset(offset);
     size_t index = (offset >> PAGE_SIZE_SHIFT) % VmPageListNode::kPageFanOut;
 
     LTRACEF_LEVEL(2, "%p offset %#" PRIx64 " node_offset %#" PRIx64 " index %zu\n", this, offset, node_offset,
                   index);
 
     // lookup the tree node that holds this page
-    auto pln = list_.find(node_offset);
-    if (!pln.IsValid()) {
+    auto pln = FindNode(node_offset);
+    if (!pln) {
         return MX_ERR_NOT_FOUND;
     }
 
@@ -131,6 +144,7 @@ status_t VmPageList::FreePage(uint64_t offset) {
         // if it was the last page in the node, remove the node from the tree
         if (pln->IsEmpty()) {
             LTRACEF_LEVEL(2, "%p freeing the list node\n", this);
+            last_node_ = nullptr;
             list_.erase(*pln);
         }
 
@@ -164,7 +178,49 @@ size_t VmPageList::FreeAllPages() {
     DEBUG_ASSERT(freed == count);
 
     // empty the tree
+    last_node_ = nullptr;
     list_.clear();
 
     return count;
 }
+
+size_t VmPageList::FreePagesInRange(uint64_t start_offset, uint64_t end_offset) {
+    LTRACEF("%p start %#" PRIx64 " end %#" PRIx64 "\n", this, start_offset, end_offset);
+
+    list_node list;
+    list_initialize(&list);
+
+    size_t count = 0;
+
+    auto per_page_func = [&](vm_page*& p, uint64_t offset) {
+        list_add_tail(&list, &p->free.node);
+        p = nullptr;
+        count++;
+    };
+
+    // walk the nodes overlapping the range, dropping any that end up empty
+    auto pl = list_.lower_bound(NodeOffset(start_offset));
+    while (pl.IsValid() && pl->offset() < end_offset) {
+        auto cur = pl++;
+        cur->ForEveryPageInRange(per_page_func, start_offset, end_offset);
+        if (cur->IsEmpty()) {
+            LTRACEF_LEVEL(2, "%p freeing the list node\n", this);
+            if (last_node_ == &*cur)
+                last_node_ = nullptr;
+            list_.erase(cur);
+        }
+    }
+
+    // return all the pages to the pmm at once
+    __UNUSED auto freed = pmm_free(&list);
+    DEBUG_ASSERT(freed == count);
+
+    return count;
+}
+
+size_t VmPageList::CountPagesInRange(uint64_t start_offset, uint64_t end_offset) const {
+    size_t count = 0;
+    ForEveryPageInRange([&count](const vm_page*, uint64_t) { count++; },
+                        start_offset, end_offset);
+    return count;
+}
@@ -0,0 +1,167 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <assert.h>
+#include <err.h>
+#include <inttypes.h>
+#include <kernel/auto_lock.h>
+#include <kernel/event.h>
+#include <kernel/mp.h>
+#include <kernel/mutex.h>
+#include <kernel/thread.h>
+#include <kernel/vm.h>
+#include <kernel/vm/vm_object.h>
+#include <lk/init.h>
+#include <mxalloc/new.h>
+#include <mxtl/atomic.h>
+#include <mxtl/intrusive_double_list.h>
+#include <mxtl/unique_ptr.h>
+#include <stdio.h>
+#include <trace.h>
+
+#include "vm_priv.h"
+
+#define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
+
+// Prefetches are committed by a thread per cpu, each pinned to its cpu and fed
+// from its own queue, and requests are dealt out round robin so that one big
+// prefetch doesn't hold up all of the others.
+
+// Ranges are committed this many pages at a time, so that a big prefetch
+// doesn't keep the object locked against faults for all of it.
+#define VM_PREFETCH_CHUNK_PAGES (64u)
+
+// At most this many requests wait across all cpus, more are refused until
+// the prefetch threads catch up.
+#define VM_PREFETCH_MAX_QUEUED (256u)
+
+namespace {
+
+struct PrefetchRequest : public mxtl::DoublyLinkedListable<mxtl::unique_ptr<PrefetchRequest>> {
+    mxtl::RefPtr<VmObject> vmo;
+    uint64_t offset;
+    uint64_t len;
+    vmo_commit_done_fn_t done_fn;
+    void* context;
+};
+
+struct PrefetchQueue {
+    Mutex lock;
+    mxtl::DoublyLinkedList<mxtl::unique_ptr<PrefetchRequest>> requests TA_GUARDED(lock);
+    event_t event;
+} __CPU_ALIGN;
+
+PrefetchQueue prefetch_queues[SMP_MAX_CPUS];
+
+// The cpus that have a prefetch thread, each added as it comes up.
+mxtl::atomic<mp_cpu_mask_t> prefetch_cpus;
+
+// Requests queued and not yet picked up by a prefetch thread.
+mxtl::atomic<uint32_t> prefetch_queued;
+
+// Where the next request goes looking for a cpu.
+mxtl::atomic<uint32_t> prefetch_next;
+
+} // namespace
+
+status_t vm_prefetch_queue(mxtl::RefPtr<VmObject> vmo, uint64_t offset, uint64_t len,
+                           vmo_commit_done_fn_t done_fn, void* context) {
+    LTRACEF("vmo %p offset %#" PRIx64 " len %#" PRIx64 "\n", vmo.get(), offset, len);
+
+    const mp_cpu_mask_t cpus = prefetch_cpus.load();
+    if (!cpus)
+        return MX_ERR_BAD_STATE;
+
+    if (prefetch_queued.fetch_add(1u) >= VM_PREFETCH_MAX_QUEUED) {
+        prefetch_queued.fetch_sub(1u);
+        return MX_ERR_SHOULD_WAIT;
+    }
+
+    AllocChecker ac;
+    mxtl::unique_ptr<PrefetchRequest> req(new (&ac) PrefetchRequest);
+    if (!ac.check()) {
+        prefetch_queued.fetch_sub(1u);
+        return MX_ERR_NO_MEMORY;
+    }
+
+    req->vmo = mxtl::move(vmo);
+    req->offset = offset;
+    req->len = len;
+    req->done_fn = done_fn;
+    req->context = context;
+
+    uint cpu = prefetch_next.fetch_add(1u) % SMP_MAX_CPUS;
+    while (!(cpus & (1u << cpu)))
+        cpu = (cpu + 1) % SMP_MAX_CPUS;
+
+    PrefetchQueue& q = prefetch_queues[cpu];
+    {
+        AutoLock a(&q.lock);
+        q.requests.push_back(mxtl::move(req));
+    }
+    event_signal(&q.event, false);
+
+    return MX_OK;
+}
+
+static status_t prefetch_range(VmObject* vmo, uint64_t offset, uint64_t len) {
+    const uint64_t chunk = VM_PREFETCH_CHUNK_PAGES * PAGE_SIZE;
+    while (len > 0) {
+        uint64_t n = MIN(len, chunk - (offset % chunk));
+        status_t status = vmo->CommitRange(offset, n, nullptr);
+        if (status != MX_OK)
+            return status;
+        offset += n;
+        len -= n;
+    }
+    return MX_OK;
+}
+
+static int prefetch_thread(void* arg) {
+    PrefetchQueue* q = static_cast<PrefetchQueue*>(arg);
+    for (;;) {
+        event_wait(&q->event);
+
+        for (;;) {
+            mxtl::unique_ptr<PrefetchRequest> req;
+            {
+                AutoLock a(&q->lock);
+                req = q->requests.pop_front();
+            }
+            if (!req)
+                break;
+            prefetch_queued.fetch_sub(1u);
+
+            status_t status = prefetch_range(req->vmo.get(), req->offset, req->len);
+            LTRACEF("vmo %p offset %#" PRIx64 " len %#" PRIx64 " status %d\n",
+                    req->vmo.get(), req->offset, req->len, status);
+            if (req->done_fn)
+                req->done_fn(req->context, status);
+        }
+    }
+    return 0;
+}
+
+// Runs on each cpu as it comes up, the boot cpu first, and starts its thread.
+static void vm_prefetch_init(uint level) {
+    uint cpu = arch_curr_cpu_num();
+    PrefetchQueue& q = prefetch_queues[cpu];
+    event_init(&q.event, false, EVENT_FLAG_AUTOUNSIGNAL);
+
+    char name[THREAD_NAME_LENGTH];
+    snprintf(name, sizeof(name), "vm prefetch-%u", cpu);
+    thread_t* t = thread_create(name, &prefetch_thread, &q, DEFAULT_PRIORITY,
+                                DEFAULT_STACK_SIZE);
+    if (!t)
+        return;
+    thread_set_pinned_cpu(t, cpu);
+    thread_detach_and_resume(t);
+
+    // requests are only queued for this cpu once its queue is ready
+    prefetch_cpus.fetch_or(1u << cpu);
+}
+
+LK_INIT_HOOK_FLAGS(vm_prefetch, &vm_prefetch_init, LK_INIT_LEVEL_THREADING, LK_INIT_FLAG_ALL_CPUS);
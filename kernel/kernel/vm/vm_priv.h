@@ -10,6 +10,7 @@
 #include <kernel/mutex.h>
 #include <kernel/vm.h>
 #include <kernel/vm/vm_aspace.h>
+#include <kernel/vm/vm_object.h>
 #include <mxtl/algorithm.h>
 #include <mxtl/limits.h>
 #include <stdint.h>
@@ -29,6 +30,11 @@ void vmm_init(void);
 // global vmm lock (for now)
 extern mutex_t vmm_lock;
 
+// hand a CommitRange() of |vmo| to a prefetch thread, see
+// VmObject::CommitRangeAsync()
+status_t vm_prefetch_queue(mxtl::RefPtr<VmObject> vmo, uint64_t offset, uint64_t len,
+                           vmo_commit_done_fn_t done_fn, void* context);
+
 // utility function to test that offset + len is entirely within a range
 // returns false if out of range
 // NOTE: only use unsigned lengths
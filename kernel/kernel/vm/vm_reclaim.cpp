@@ -0,0 +1,219 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <kernel/vm/vm_reclaim.h>
+
+#include <assert.h>
+#include <err.h>
+#include <inttypes.h>
+#include <kernel/auto_lock.h>
+#include <kernel/cmdline.h>
+#include <kernel/event.h>
+#include <kernel/mutex.h>
+#include <kernel/thread.h>
+#include <kernel/vm.h>
+#include <kernel/vm/pmm.h>
+#include <kernel/vm/vm_object_paged.h>
+#include <lib/console.h>
+#include <lk/init.h>
+#include <lz4/lz4.h>
+#include <mxalloc/new.h>
+#include <string.h>
+#include <trace.h>
+
+#include "vm_priv.h"
+
+#define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
+
+// Pages that don't compress to at least this size are left alone, the savings
+// would not pay for the trouble of bringing them back.
+#define VM_COMPRESSED_MAX_SIZE (PAGE_SIZE * 3 / 4)
+
+// Defaults for the free page watermarks, as a fraction of all memory.
+#define VM_RECLAIM_DEFAULT_LOW_SHIFT (6u)  // 1/64th
+#define VM_RECLAIM_DEFAULT_HIGH_SHIFT (5u) // 1/32nd
+
+namespace {
+
+// Only the reclaim thread and the unit tests compress pages, so one set of
+// scratch buffers is plenty.
+Mutex compress_lock;
+LZ4_stream_t compress_state TA_GUARDED(compress_lock);
+char compress_buffer[LZ4_COMPRESSBOUND(PAGE_SIZE)] TA_GUARDED(compress_lock);
+
+size_t stored_pages;
+size_t stored_bytes;
+uint64_t compressed_count;
+uint64_t zero_dropped_count;
+uint64_t rejected_count;
+uint64_t decompressed_count;
+uint64_t pass_count;
+
+size_t reclaim_low_pages;
+size_t reclaim_high_pages;
+event_t reclaim_event = EVENT_INITIAL_VALUE(reclaim_event, false, EVENT_FLAG_AUTOUNSIGNAL);
+
+} // namespace
+
+VmCompressedPage::VmCompressedPage(uint64_t offset, mxtl::unique_ptr<uint8_t[]> data, size_t size)
+    : offset_(offset), data_(mxtl::move(data)), size_(size) {
+    __atomic_fetch_add(&stored_pages, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stored_bytes, size_, __ATOMIC_RELAXED);
+}
+
+VmCompressedPage::~VmCompressedPage() {
+    __atomic_fetch_sub(&stored_pages, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_sub(&stored_bytes, size_, __ATOMIC_RELAXED);
+}
+
+mxtl::unique_ptr<VmCompressedPage> VmCompressedPage::Create(uint64_t offset, const void* src) {
+    AutoLock a(&compress_lock);
+
+    int size = LZ4_compress_fast_extState(&compress_state, static_cast<const char*>(src),
+                                          compress_buffer, PAGE_SIZE, sizeof(compress_buffer), 1);
+    if (size <= 0 || size > static_cast<int>(VM_COMPRESSED_MAX_SIZE)) {
+        __atomic_fetch_add(&rejected_count, 1, __ATOMIC_RELAXED);
+        return nullptr;
+    }
+
+    AllocChecker ac;
+    mxtl::unique_ptr<uint8_t[]> data(new (&ac) uint8_t[size]);
+    if (!ac.check())
+        return nullptr;
+    memcpy(data.get(), compress_buffer, size);
+
+    mxtl::unique_ptr<VmCompressedPage> page(
+        new (&ac) VmCompressedPage(offset, mxtl::move(data), size));
+    if (!ac.check())
+        return nullptr;
+
+    __atomic_fetch_add(&compressed_count, 1, __ATOMIC_RELAXED);
+    return page;
+}
+
+void VmCompressedPage::Decompress(void* dst) const {
+    int size = LZ4_decompress_safe(reinterpret_cast<const char*>(data_.get()),
+                                   static_cast<char*>(dst), static_cast<int>(size_), PAGE_SIZE);
+    if (size != PAGE_SIZE) {
+        panic("compressed page at offset %#" PRIx64 " is corrupt (%d)\n", offset_, size);
+    }
+}
+
+bool vm_page_is_zero(const void* ptr) {
+    const uint64_t* words = static_cast<const uint64_t*>(ptr);
+    for (size_t i = 0; i < PAGE_SIZE / sizeof(uint64_t); i++) {
+        if (words[i])
+            return false;
+    }
+    return true;
+}
+
+void vm_reclaim_count_zero_dropped() {
+    __atomic_fetch_add(&zero_dropped_count, 1, __ATOMIC_RELAXED);
+}
+
+void vm_reclaim_count_decompressed() {
+    __atomic_fetch_add(&decompressed_count, 1, __ATOMIC_RELAXED);
+}
+
+void vm_reclaim_get_stats(vm_reclaim_stats* stats) {
+    stats->stored_pages = __atomic_load_n(&stored_pages, __ATOMIC_RELAXED);
+    stats->stored_bytes = __atomic_load_n(&stored_bytes, __ATOMIC_RELAXED);
+    stats->compressed = __atomic_load_n(&compressed_count, __ATOMIC_RELAXED);
+    stats->zero_dropped = __atomic_load_n(&zero_dropped_count, __ATOMIC_RELAXED);
+    stats->rejected = __atomic_load_n(&rejected_count, __ATOMIC_RELAXED);
+    stats->decompressed = __atomic_load_n(&decompressed_count, __ATOMIC_RELAXED);
+    stats->passes = __atomic_load_n(&pass_count, __ATOMIC_RELAXED);
+}
+
+// Run passes over the reclaimable objects until the high watermark is reached.
+// Every pass ages the pages it does not take, so once a run of passes has come
+// up empty there is nothing cold enough left to compress.
+static void reclaim_to_high_watermark() {
+    uint idle_passes = 0;
+    size_t free_pages;
+    while ((free_pages = pmm_count_free_pages()) < reclaim_high_pages &&
+           idle_passes <= VM_PAGE_AGE_MAX) {
+        size_t reclaimed = VmObjectPaged::ReclaimAll(VM_RECLAIM_MIN_AGE,
+                                                     reclaim_high_pages - free_pages);
+        __atomic_fetch_add(&pass_count, 1, __ATOMIC_RELAXED);
+
+        LTRACEF("free %zu, reclaimed %zu\n", free_pages, reclaimed);
+
+        idle_passes = reclaimed ? 0 : idle_passes + 1;
+    }
+}
+
+static int reclaim_thread(void* arg) {
+    for (;;) {
+        event_wait(&reclaim_event);
+        reclaim_to_high_watermark();
+    }
+    return 0;
+}
+
+// Called by the pmm with its lock held when the low watermark is crossed.
+static void reclaim_low_memory() {
+    event_signal(&reclaim_event, false);
+}
+
+static void vm_reclaim_init(uint level) {
+    size_t total_pages = pmm_count_total_bytes() / PAGE_SIZE;
+    reclaim_low_pages = cmdline_get_uint32("kernel.vm-reclaim-low-pages",
+                                           static_cast<uint32_t>(total_pages >> VM_RECLAIM_DEFAULT_LOW_SHIFT));
+    reclaim_high_pages = cmdline_get_uint32("kernel.vm-reclaim-high-pages",
+                                            static_cast<uint32_t>(total_pages >> VM_RECLAIM_DEFAULT_HIGH_SHIFT));
+    if (reclaim_low_pages == 0)
+        return;
+    if (reclaim_high_pages < reclaim_low_pages)
+        reclaim_high_pages = reclaim_low_pages;
+
+    thread_t* t = thread_create("vm reclaim", &reclaim_thread, nullptr, DEFAULT_PRIORITY,
+                                DEFAULT_STACK_SIZE);
+    if (!t)
+        return;
+    thread_detach_and_resume(t);
+
+    pmm_set_low_memory_callback(reclaim_low_pages, &reclaim_low_memory);
+}
+
+LK_INIT_HOOK(vm_reclaim, &vm_reclaim_init, LK_INIT_LEVEL_THREADING);
+
+static int cmd_vm_reclaim(int argc, const cmd_args* argv, uint32_t flags) {
+    if (argc < 2) {
+    usage:
+        printf("usage:\n");
+        printf("%s stats\n", argv[0].str);
+        printf("%s run\n", argv[0].str);
+        return MX_ERR_INTERNAL;
+    }
+
+    if (!strcmp(argv[1].str, "stats")) {
+        vm_reclaim_stats stats;
+        vm_reclaim_get_stats(&stats);
+        printf("watermarks: low %zu high %zu free %zu\n",
+               reclaim_low_pages, reclaim_high_pages, pmm_count_free_pages());
+        printf("stored: %zu pages in %zu bytes\n", stats.stored_pages, stats.stored_bytes);
+        printf("compressed %" PRIu64 " zero dropped %" PRIu64 " rejected %" PRIu64
+               " decompressed %" PRIu64 " passes %" PRIu64 "\n",
+               stats.compressed, stats.zero_dropped, stats.rejected, stats.decompressed,
+               stats.passes);
+    } else if (!strcmp(argv[1].str, "run")) {
+        size_t reclaimed = VmObjectPaged::ReclaimAll(VM_RECLAIM_MIN_AGE, SIZE_MAX);
+        printf("reclaimed %zu pages\n", reclaimed);
+    } else {
+        printf("unknown command\n");
+        goto usage;
+    }
+
+    return MX_OK;
+}
+
+STATIC_COMMAND_START
+#if LK_DEBUGLEVEL > 0
+STATIC_COMMAND("vm_reclaim", "vm page reclaim commands", &cmd_vm_reclaim)
+#endif
+STATIC_COMMAND_END(vm_reclaim);
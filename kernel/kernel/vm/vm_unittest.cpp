@@ -12,8 +12,10 @@
 #include <kernel/vm/vm_object.h>
 #include <kernel/vm/vm_object_paged.h>
 #include <kernel/vm/vm_object_physical.h>
+#include <kernel/vm/vm_reclaim.h>
 #include <mxalloc/new.h>
 #include <mxtl/array.h>
+#include <pow2.h>
 #include <unittest.h>
 
 static const uint kArchRwFlags = ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE;
@@ -71,6 +73,28 @@ static bool pmm_oversized_alloc_test(void* context) {
     END_TEST;
 }
 
+// Allocates and frees enough single pages to push the per-cpu page cache
+// through several refills and drains.
+static bool pmm_single_page_churn_test(void* context) {
+    BEGIN_TEST;
+    static const size_t alloc_count = 256;
+    vm_page_t* pages[alloc_count];
+
+    for (size_t i = 0; i < alloc_count; i++) {
+        paddr_t pa;
+        pages[i] = pmm_alloc_page(0, &pa);
+        EXPECT_NEQ(nullptr, pages[i], "pmm_alloc_page");
+        EXPECT_EQ(pages[i], paddr_to_vm_page(pa), "pmm_alloc_page returned paddr");
+    }
+
+    for (size_t i = 0; i < alloc_count; i++) {
+        if (pages[i]) {
+            EXPECT_EQ(1u, pmm_free_page(pages[i]), "pmm_free_page");
+        }
+    }
+    END_TEST;
+}
+
 static uint32_t test_rand(uint32_t seed) {
     return (seed = seed * 1664525 + 1013904223);
 }
@@ -278,6 +302,39 @@ static bool vmm_alloc_contiguous_zero_size_fails(void* context) {
     END_TEST;
 }
 
+// Maps an aligned, contiguous 2MB region (which the arch layer may map with a
+// single large page) and changes the permissions of its first page only.
+static bool vmm_alloc_contiguous_large_page_protect_test(void* context) {
+    BEGIN_TEST;
+    static const size_t alloc_size = 2 * 1024 * 1024;
+
+    void* ptr;
+    auto kaspace = VmAspace::kernel_aspace();
+    auto err = kaspace->AllocContiguous("test", alloc_size, &ptr, 21,
+                                        VmAspace::VMM_FLAG_COMMIT, kArchRwFlags);
+    EXPECT_EQ(0, err, "VmAspace::AllocContiguous 2MB region");
+    if (err != MX_OK)
+        END_TEST;
+
+    vaddr_t base = reinterpret_cast<vaddr_t>(ptr);
+    EXPECT_TRUE(fill_and_test(ptr, alloc_size), "fill large region");
+
+    err = kaspace->RootVmar()->Protect(base, PAGE_SIZE, ARCH_MMU_FLAG_PERM_READ);
+    EXPECT_EQ(MX_OK, err, "protect first page read only");
+
+    paddr_t pa;
+    uint flags;
+    EXPECT_EQ(MX_OK, arch_mmu_query(&kaspace->arch_aspace(), base, &pa, &flags), "query first page");
+    EXPECT_EQ(0u, flags & ARCH_MMU_FLAG_PERM_WRITE, "first page read only");
+    EXPECT_EQ(MX_OK, arch_mmu_query(&kaspace->arch_aspace(), base + PAGE_SIZE, &pa, &flags),
+              "query second page");
+    EXPECT_NEQ(0u, flags & ARCH_MMU_FLAG_PERM_WRITE, "second page still writable");
+
+    err = kaspace->FreeRegion(base);
+    EXPECT_EQ(MX_OK, err, "FreeRegion large region");
+    END_TEST;
+}
+
 // Allocates a vm address space object directly, allows it to go out of scope.
 static bool vmaspace_create_smoke_test(void* context) {
     BEGIN_TEST;
@@ -304,6 +361,43 @@ static bool vmaspace_alloc_smoke_test(void* context) {
     END_TEST;
 }
 
+// Fills an aspace with regions, punches holes in it and makes sure new
+// allocations land in the holes without overlapping anything.
+static bool vmaspace_alloc_gaps_test(void* context) {
+    BEGIN_TEST;
+    static const size_t count = 64;
+    auto aspace = VmAspace::Create(0, "test aspace gaps");
+    REQUIRE_NONNULL(aspace, "");
+
+    void* ptrs[count];
+    for (size_t i = 0; i < count; i++) {
+        auto err = aspace->Alloc("test", PAGE_SIZE, &ptrs[i], 0, 0, kArchRwFlags);
+        REQUIRE_EQ(MX_OK, err, "allocating region\n");
+    }
+
+    // free every other region, then allocate into the space that opened up
+    for (size_t i = 0; i < count; i += 2) {
+        auto err = aspace->FreeRegion(reinterpret_cast<vaddr_t>(ptrs[i]));
+        EXPECT_EQ(MX_OK, err, "freeing region\n");
+    }
+    for (size_t i = 0; i < count; i += 2) {
+        auto err = aspace->Alloc("test", 2 * PAGE_SIZE, &ptrs[i], 0, 0, kArchRwFlags);
+        EXPECT_EQ(MX_OK, err, "allocating larger region\n");
+        EXPECT_TRUE(IS_PAGE_ALIGNED(ptrs[i]), "");
+    }
+
+    // every region should still be distinct
+    for (size_t i = 0; i < count; i++) {
+        for (size_t j = i + 1; j < count; j++) {
+            EXPECT_NEQ(ptrs[i], ptrs[j], "regions overlap\n");
+        }
+    }
+
+    aspace->Destroy();
+    aspace.reset();
+    END_TEST;
+}
+
 // Doesn't do anything, just prints all aspaces.
 // Should be run after all other tests so that people can manually comb
 // through the output for leaked test aspaces.
@@ -367,6 +461,113 @@ static bool vmo_contiguous_commit_test(void* context) {
     END_TEST;
 }
 
+// Creates a vm object, commits memory and decommits a range spanning several
+// page list nodes, checking the page counts on either side.
+static bool vmo_decommit_range_test(void* context) {
+    BEGIN_TEST;
+    static const size_t alloc_size = PAGE_SIZE * 64;
+    auto vmo = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, alloc_size);
+    REQUIRE_NONNULL(vmo, "vmobject creation\n");
+
+    uint64_t committed;
+    auto ret = vmo->CommitRange(0, alloc_size, &committed);
+    EXPECT_EQ(MX_OK, ret, "committing vm object\n");
+    EXPECT_EQ(alloc_size, committed, "committing vm object\n");
+
+    uint64_t decommitted;
+    ret = vmo->DecommitRange(PAGE_SIZE * 5, PAGE_SIZE * 40, &decommitted);
+    EXPECT_EQ(MX_OK, ret, "decommitting range\n");
+    EXPECT_EQ(PAGE_SIZE * 40, decommitted, "decommitting range\n");
+
+    EXPECT_EQ(24u, vmo->AllocatedPages(), "pages left\n");
+    EXPECT_EQ(5u, vmo->AllocatedPagesInRange(0, PAGE_SIZE * 6), "pages before the hole\n");
+    EXPECT_EQ(0u, vmo->AllocatedPagesInRange(PAGE_SIZE * 5, PAGE_SIZE * 40), "pages in the hole\n");
+    EXPECT_EQ(19u, vmo->AllocatedPagesInRange(PAGE_SIZE * 44, PAGE_SIZE * 20),
+              "pages after the hole\n");
+
+    // committing the whole object again only fills in the hole
+    ret = vmo->CommitRange(0, alloc_size, &committed);
+    EXPECT_EQ(MX_OK, ret, "recommitting vm object\n");
+    EXPECT_EQ(PAGE_SIZE * 40, committed, "recommitting vm object\n");
+    END_TEST;
+}
+
+// Creates a vm object with a zero, a compressible and an incompressible page,
+// reclaims it and checks that everything reads back the same.
+static bool vmo_reclaim_test(void* context) {
+    BEGIN_TEST;
+    static const size_t alloc_size = PAGE_SIZE * 3;
+    auto vmo = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, alloc_size);
+    REQUIRE_NONNULL(vmo, "vmobject creation\n");
+    EXPECT_EQ(MX_OK, vmo->EnableReclaim(), "enabling reclaim\n");
+    auto paged = static_cast<VmObjectPaged*>(vmo.get());
+
+    AllocChecker ac;
+    mxtl::Array<uint8_t> a(new (&ac) uint8_t[alloc_size], alloc_size);
+    REQUIRE_TRUE(ac.check(), "");
+    memset(a.get(), 0, PAGE_SIZE);
+    for (size_t i = 0; i < PAGE_SIZE; i++) {
+        a[PAGE_SIZE + i] = static_cast<uint8_t>(i / 64);
+    }
+    fill_region(77, a.get() + PAGE_SIZE * 2, PAGE_SIZE);
+
+    size_t bytes_written;
+    auto err = vmo->Write(a.get(), 0, alloc_size, &bytes_written);
+    EXPECT_EQ(MX_OK, err, "writing to object\n");
+    EXPECT_EQ(3u, vmo->AllocatedPages(), "pages before reclaim\n");
+
+    // freshly touched pages are too young to be taken
+    EXPECT_EQ(0u, paged->ReclaimPages(VM_RECLAIM_MIN_AGE, 16), "reclaiming young pages\n");
+
+    // the zero page is dropped, the patterned one compressed and the random
+    // one left alone
+    EXPECT_EQ(2u, paged->ReclaimPages(0, 16), "reclaiming pages\n");
+    EXPECT_EQ(1u, vmo->AllocatedPages(), "pages after reclaim\n");
+
+    mxtl::Array<uint8_t> b(new (&ac) uint8_t[alloc_size], alloc_size);
+    REQUIRE_TRUE(ac.check(), "");
+    size_t bytes_read;
+    err = vmo->Read(b.get(), 0, alloc_size, &bytes_read);
+    EXPECT_EQ(MX_OK, err, "reading from object\n");
+    EXPECT_EQ(alloc_size, bytes_read, "reading from object\n");
+    EXPECT_EQ(0, memcmp(a.get(), b.get(), alloc_size), "contents after reclaim\n");
+
+    // reading the zero page back doesn't need memory, the compressed one does
+    EXPECT_EQ(2u, vmo->AllocatedPages(), "pages after reading back\n");
+    END_TEST;
+}
+
+// Creates a vm object, maps one of its pages and checks that neither reclaim
+// nor marking everything reclaimable takes that page.
+static bool vmo_reclaim_mapped_test(void* context) {
+    BEGIN_TEST;
+    static const size_t alloc_size = PAGE_SIZE * 2;
+    auto vmo = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, alloc_size);
+    REQUIRE_NONNULL(vmo, "vmobject creation\n");
+    EXPECT_EQ(MX_OK, vmo->EnableReclaim(), "enabling reclaim\n");
+    auto paged = static_cast<VmObjectPaged*>(vmo.get());
+
+    uint64_t committed;
+    auto ret = vmo->CommitRange(0, alloc_size, &committed);
+    EXPECT_EQ(MX_OK, ret, "committing vm object\n");
+
+    auto ka = VmAspace::kernel_aspace();
+    void* ptr;
+    ret = ka->MapObjectInternal(vmo, "test", 0, PAGE_SIZE, &ptr,
+                                0, VmAspace::VMM_FLAG_COMMIT, kArchRwFlags);
+    EXPECT_EQ(MX_OK, ret, "mapping object\n");
+
+    EXPECT_EQ(MX_OK, vmo->MarkReclaimable(0, alloc_size), "marking reclaimable\n");
+    EXPECT_EQ(1u, paged->ReclaimPages(VM_PAGE_AGE_MAX, 16), "reclaiming marked pages\n");
+    EXPECT_EQ(0u, paged->ReclaimPages(0, 16), "reclaiming the mapped page\n");
+    EXPECT_EQ(1u, vmo->AllocatedPages(), "pages after reclaim\n");
+
+    auto err = ka->FreeRegion(reinterpret_cast<vaddr_t>(ptr));
+    EXPECT_EQ(MX_OK, err, "unmapping object\n");
+    EXPECT_EQ(1u, paged->ReclaimPages(0, 16), "reclaiming the unmapped page\n");
+    END_TEST;
+}
+
 // Creats a vm object, maps it, precommitted.
 static bool vmo_precommitted_map_test(void* context) {
     BEGIN_TEST;
@@ -411,6 +612,44 @@ static bool vmo_demand_paged_map_test(void* context) {
     END_TEST;
 }
 
+// Creates a vm object, commits it, maps it demand paged and checks that a
+// single fault maps the rest of the fault-around window.
+static bool vmo_fault_around_test(void* context) {
+    BEGIN_TEST;
+    static const size_t alloc_size = PAGE_SIZE * 16;
+    auto vmo = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, alloc_size);
+    REQUIRE_NONNULL(vmo, "vmobject creation\n");
+
+    uint64_t committed;
+    auto ret = vmo->CommitRange(0, alloc_size, &committed);
+    EXPECT_EQ(MX_OK, ret, "committing vm object\n");
+
+    auto ka = VmAspace::kernel_aspace();
+    void* ptr;
+    ret = ka->MapObjectInternal(vmo, "test", 0, alloc_size, &ptr,
+                                log2_uint_floor(alloc_size), 0, kArchRwFlags);
+    EXPECT_EQ(MX_OK, ret, "mapping object");
+
+    auto mapping = ka->FindRegion((vaddr_t)ptr)->as_vm_mapping();
+    REQUIRE_NONNULL(mapping, "finding mapping");
+    EXPECT_EQ(MX_OK, mapping->SetFaultAroundPages(alloc_size / PAGE_SIZE),
+              "setting fault-around window");
+
+    // a single read fault on the first page
+    __UNUSED volatile uint8_t val = *static_cast<volatile uint8_t*>(ptr);
+
+    for (size_t off = 0; off < alloc_size; off += PAGE_SIZE) {
+        paddr_t pa;
+        uint flags;
+        EXPECT_EQ(MX_OK, arch_mmu_query(&ka->arch_aspace(), (vaddr_t)ptr + off, &pa, &flags),
+                  "page mapped by fault-around");
+    }
+
+    auto err = ka->FreeRegion((vaddr_t)ptr);
+    EXPECT_EQ(MX_OK, err, "unmapping object");
+    END_TEST;
+}
+
 // Creates a vm object, maps it, drops ref before unmapping.
 static bool vmo_dropped_ref_test(void* context) {
     BEGIN_TEST;
@@ -692,8 +931,10 @@ UNITTEST_START_TESTCASE(vm_tests)
 VM_UNITTEST(pmm_smoke_test)
 VM_UNITTEST(pmm_large_alloc_test)
 VM_UNITTEST(pmm_oversized_alloc_test)
+VM_UNITTEST(pmm_single_page_churn_test)
 VM_UNITTEST(vmm_alloc_smoke_test)
 VM_UNITTEST(vmm_alloc_contiguous_smoke_test)
+VM_UNITTEST(vmm_alloc_contiguous_large_page_protect_test)
 VM_UNITTEST(multiple_regions_test)
 VM_UNITTEST(vmm_alloc_zero_size_fails)
 VM_UNITTEST(vmm_alloc_bad_specific_pointer_fails)
@@ -701,12 +942,17 @@ VM_UNITTEST(vmm_alloc_contiguous_missing_flag_commit_fails)
 VM_UNITTEST(vmm_alloc_contiguous_zero_size_fails)
 VM_UNITTEST(vmaspace_create_smoke_test)
 VM_UNITTEST(vmaspace_alloc_smoke_test)
+VM_UNITTEST(vmaspace_alloc_gaps_test)
 VM_UNITTEST(vmo_create_test)
 VM_UNITTEST(vmo_commit_test)
 VM_UNITTEST(vmo_odd_size_commit_test)
 VM_UNITTEST(vmo_contiguous_commit_test)
+VM_UNITTEST(vmo_decommit_range_test)
+VM_UNITTEST(vmo_reclaim_test)
+VM_UNITTEST(vmo_reclaim_mapped_test)
 VM_UNITTEST(vmo_precommitted_map_test)
 VM_UNITTEST(vmo_demand_paged_map_test)
+VM_UNITTEST(vmo_fault_around_test)
 VM_UNITTEST(vmo_dropped_ref_test)
 VM_UNITTEST(vmo_remap_test)
 VM_UNITTEST(vmo_double_remap_test)
@@ -6,6 +6,7 @@
 
 #include <lib/crypto/global_prng.h>
 
+#include <arch/ops.h>
 #include <assert.h>
 #include <ctype.h>
 #include <dev/hw_rng.h>
@@ -13,10 +14,12 @@
 #include <kernel/auto_lock.h>
 #include <kernel/cmdline.h>
 #include <kernel/mutex.h>
+#include <kernel/spinlock.h>
 #include <lib/crypto/cryptolib.h>
 #include <lib/crypto/prng.h>
 #include <mxcpp/new.h>
 #include <mxtl/algorithm.h>
+#include <mxtl/atomic.h>
 #include <lk/init.h>
 #include <string.h>
 
@@ -31,6 +34,91 @@ PRNG* GetInstance() {
     return kGlobalPrng;
 }
 
+// Each CPU draws from its own PRNG, seeded from the global one, so that
+// draws on different CPUs don't serialize on the global PRNG's lock.  A
+// per-CPU PRNG is only ever used on its own CPU with interrupts disabled,
+// which is all the locking it needs.
+struct PerCpuPrng {
+    PRNG* prng;
+    // Bytes drawn since the last reseed.
+    uint64_t drawn;
+    // The value of |entropy_generation| at the last reseed.
+    uint64_t generation;
+};
+
+static PerCpuPrng per_cpu_prngs[SMP_MAX_CPUS];
+static bool per_cpu_prngs_ready = false;
+
+// Bumped whenever entropy is added to the global PRNG, so that every CPU
+// mixes it in before its next draw.
+static mxtl::atomic<uint64_t> entropy_generation(0);
+
+// A per-CPU PRNG is reseeded from the global one after this many bytes.
+static constexpr uint64_t kPerCpuReseedBytes = 1ULL << 20;
+
+// Draws are broken into chunks of at most this size, to bound how long
+// interrupts are disabled for.
+static constexpr size_t kPerCpuDrawChunk = 256;
+
+// Reseeds the PRNG of whichever CPU this ends up running on.
+static void ReseedCurrentCpu() {
+    DEBUG_ASSERT(!arch_ints_disabled());
+
+    // Sample the generation first, so entropy that arrives while we draw
+    // leads to another reseed.
+    const uint64_t generation = entropy_generation.load();
+    uint8_t seed[PRNG::kMinEntropy];
+    kGlobalPrng->Draw(seed, sizeof(seed));
+
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+    PerCpuPrng* p = &per_cpu_prngs[arch_curr_cpu_num()];
+    p->prng->AddEntropy(seed, sizeof(seed));
+    p->drawn = 0;
+    p->generation = generation;
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    memset(seed, 0, sizeof(seed));
+}
+
+static void DrawChunk(uint8_t* out, size_t size) {
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+    PerCpuPrng* p = &per_cpu_prngs[arch_curr_cpu_num()];
+    if (unlikely(p->drawn >= kPerCpuReseedBytes ||
+                 p->generation != entropy_generation.load())) {
+        arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+        ReseedCurrentCpu();
+        arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+        p = &per_cpu_prngs[arch_curr_cpu_num()];
+    }
+    p->prng->Draw(out, size);
+    p->drawn += size;
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+}
+
+void Draw(void* out, size_t size) {
+    DEBUG_ASSERT(out || size == 0);
+    if (unlikely(!per_cpu_prngs_ready)) {
+        // Still single threaded.
+        GetInstance()->Draw(out, size);
+        return;
+    }
+
+    uint8_t* buf = static_cast<uint8_t*>(out);
+    while (size > 0) {
+        const size_t chunk = mxtl::min(size, kPerCpuDrawChunk);
+        DrawChunk(buf, chunk);
+        buf += chunk;
+        size -= chunk;
+    }
+}
+
+void AddEntropy(const void* data, size_t size) {
+    GetInstance()->AddEntropy(data, size);
+    entropy_generation.fetch_add(1);
+}
+
 // TODO(security): Remove this in favor of virtio-rng once it is available and
 // we decide we don't need it for getting entropy from elsewhere.
 static size_t IntegrateCmdlineEntropy() {
@@ -109,9 +197,22 @@ static void EarlyBootSeed(uint level) {
     }
 }
 
-// Migrate the global PRNG to enter thread-safe mode.
+// Seeds the per-CPU PRNGs and migrates the global PRNG to enter
+// thread-safe mode.
 static void BecomeThreadSafe(uint level) {
-    GetInstance()->BecomeThreadSafe();
+    PRNG* global = GetInstance();
+
+    alignas(alignof(PRNG))static uint8_t per_cpu_space[SMP_MAX_CPUS][sizeof(PRNG)];
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        uint8_t seed[PRNG::kMinEntropy];
+        global->Draw(seed, sizeof(seed));
+        per_cpu_prngs[i].prng = new (&per_cpu_space[i])
+            PRNG(seed, sizeof(seed), PRNG::NonThreadSafeTag());
+        memset(seed, 0, sizeof(seed));
+    }
+    per_cpu_prngs_ready = true;
+
+    global->BecomeThreadSafe();
 }
 
 } //namespace GlobalPRNG
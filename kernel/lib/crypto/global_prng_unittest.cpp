@@ -7,6 +7,7 @@
 #include <lib/crypto/global_prng.h>
 
 #include <stdint.h>
+#include <string.h>
 #include <unittest.h>
 
 namespace crypto {
@@ -24,10 +25,26 @@ bool identical(void*) {
     END_TEST;
 }
 
+bool per_cpu_draw(void*) {
+    BEGIN_TEST;
+
+    // Bigger than one chunk, so that it takes more than one per-CPU draw.
+    static uint8_t out1[1000];
+    static uint8_t out2[1000];
+    GlobalPRNG::Draw(out1, sizeof(out1));
+    GlobalPRNG::Draw(out2, sizeof(out2));
+
+    EXPECT_NEQ(0, memcmp(out1, out2, sizeof(out1)), "draws repeated");
+    EXPECT_NEQ(0, memcmp(out1, out1 + 500, 500), "draw repeated itself");
+
+    END_TEST;
+}
+
 } // namespace
 
 UNITTEST_START_TESTCASE(global_prng_tests)
 UNITTEST("Identical", identical)
+UNITTEST("PerCpuDraw", per_cpu_draw)
 UNITTEST_END_TESTCASE(global_prng_tests, "global_prng",
                       "Validate global PRNG singleton",
                       nullptr, nullptr);
@@ -16,6 +16,16 @@ namespace GlobalPRNG {
 // guaranteed to be non-null.
 PRNG* GetInstance();
 
+// Draws |size| bytes into |out| from the current CPU's PRNG, which is
+// seeded from the global one.  Unlike GetInstance()->Draw(), draws on
+// different CPUs don't contend with each other.  Must be called from
+// thread context with interrupts enabled.
+void Draw(void* out, size_t size);
+
+// Mixes entropy into the global PRNG, and so into every per-CPU PRNG
+// before its next draw.
+void AddEntropy(const void* data, size_t size);
+
 } //namespace GlobalPRNG
 
 } // namespace crypto
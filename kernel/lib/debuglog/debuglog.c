@@ -6,6 +6,7 @@
 
 #include <lib/debuglog.h>
 
+#include <arch/defines.h>
 #include <err.h>
 #include <dev/udisplay.h>
 #include <kernel/spinlock.h>
@@ -14,6 +15,7 @@
 #include <lib/io.h>
 #include <lib/version.h>
 #include <lk/init.h>
+#include <magenta/syscalls/log.h>
 #include <platform.h>
 #include <string.h>
 
@@ -24,13 +26,28 @@ static_assert((DLOG_SIZE & DLOG_MASK) == 0u, "must be power of two");
 static_assert(DLOG_MAX_RECORD <= DLOG_SIZE, "wat");
 static_assert((DLOG_MAX_RECORD & 3) == 0, "E_DONT_DO_THAT");
 
-static uint8_t DLOG_DATA[DLOG_SIZE];
+// The ring is shared read-only with user space readers through a vmo, see
+// dlog_get_ring(), so it and the page of shared state before it are page
+// aligned.
+static struct {
+    mx_log_ring_t ring;
+    uint8_t pad[PAGE_SIZE - sizeof(mx_log_ring_t)];
+    uint8_t data[DLOG_SIZE];
+} DLOG_SHARED __ALIGNED(PAGE_SIZE) = {
+    .ring = {
+        .size = DLOG_SIZE,
+        .data_offset = PAGE_SIZE,
+    },
+};
+
+static_assert(sizeof(DLOG_SHARED) == PAGE_SIZE + DLOG_SIZE, "");
 
 static dlog_t DLOG = {
     .lock = SPIN_LOCK_INITIAL_VALUE,
     .head = 0,
     .tail = 0,
-    .data = DLOG_DATA,
+    .data = DLOG_SHARED.data,
+    .ring = &DLOG_SHARED.ring,
     .event = EVENT_INITIAL_VALUE(DLOG.event, 0, EVENT_FLAG_AUTOUNSIGNAL),
 
     .readers_lock = MUTEX_INITIAL_VALUE(DLOG.readers_lock),
@@ -62,6 +79,11 @@ static dlog_t DLOG = {
 //       T                     T
 //  [....XXXX....]  [XX........XX]
 //           H         H
+//
+// Head and tail are also published in the shared mx_log_ring_t for readers
+// copying straight out of the ring. Tail is published before the space it
+// frees is overwritten and head after the new record is in place, so a
+// reader can tell which of the bytes it copied may have changed under it.
 
 
 #define ALIGN4(n) (((n) + 3) & (~3))
@@ -102,10 +124,15 @@ status_t dlog_write(uint32_t flags, const void* ptr, size_t len) {
 
     // Discard records at tail until there is enough
     // space for the new record.
+    size_t tail = log->tail;
     while ((log->head - log->tail) > (DLOG_SIZE - wiresize)) {
         uint32_t header = *((uint32_t*) (log->data + (log->tail & DLOG_MASK)));
         log->tail += DLOG_HDR_GET_FIFOLEN(header);
     }
+    if (log->tail != tail) {
+        __atomic_store_n(&log->ring->tail, log->tail, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+    }
 
     size_t offset = (log->head & DLOG_MASK);
 
@@ -129,6 +156,7 @@ status_t dlog_write(uint32_t flags, const void* ptr, size_t len) {
         memcpy(log->data, ptr + fifospace, len - fifospace);
     }
     log->head += wiresize;
+    __atomic_store_n(&log->ring->head, log->head, __ATOMIC_RELEASE);
 
     // if we happen to be called from within the global thread lock, use a
     // special version of event signal
@@ -221,6 +249,20 @@ void dlog_reader_init(dlog_reader_t* rdr, void (*notify)(void*), void* cookie) {
     mutex_release(&log->readers_lock);
 }
 
+void dlog_reader_skip(dlog_reader_t* rdr) {
+    dlog_t* log = rdr->log;
+
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&log->lock, state);
+    rdr->tail = log->head;
+    spin_unlock_irqrestore(&log->lock, state);
+}
+
+void* dlog_get_ring(size_t* size) {
+    *size = sizeof(DLOG_SHARED);
+    return &DLOG_SHARED;
+}
+
 void dlog_reader_destroy(dlog_reader_t* rdr) {
     dlog_t* log = rdr->log;
 
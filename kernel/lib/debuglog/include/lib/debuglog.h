@@ -34,6 +34,7 @@ typedef struct dlog dlog_t;
 typedef struct dlog_header dlog_header_t;
 typedef struct dlog_record dlog_record_t;
 typedef struct dlog_reader dlog_reader_t;
+typedef struct mx_log_ring mx_log_ring_t;
 
 struct dlog {
     spin_lock_t lock;
@@ -43,6 +44,9 @@ struct dlog {
 
     void* data;
 
+    // head and tail as seen by readers of the shared ring
+    mx_log_ring_t* ring;
+
     bool panic;
 
     event_t event;
@@ -93,6 +97,13 @@ void dlog_reader_destroy(dlog_reader_t* rdr);
 status_t dlog_write(uint32_t flags, const void* ptr, size_t len);
 status_t dlog_read(dlog_reader_t* rdr, uint32_t flags, void* ptr, size_t len, size_t* actual);
 
+// move the reader past everything written so far
+void dlog_reader_skip(dlog_reader_t* rdr);
+
+// the page aligned ring and shared state that starts with a mx_log_ring_t,
+// and its size in bytes
+void* dlog_get_ring(size_t* size);
+
 // bluescreen_init should be called at the "start" of a fatal fault or
 // panic to ensure that the fault output (via kernel printf/dprintf)
 // is captured or displayed to the user
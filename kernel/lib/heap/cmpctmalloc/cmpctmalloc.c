@@ -13,6 +13,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <err.h>
+#include <arch/ops.h>
 #include <kernel/thread.h>
 #include <kernel/mutex.h>
 #include <kernel/spinlock.h>
@@ -24,7 +25,8 @@
 //
 // Allocation strategy takes place with a global mutex.  Freelist entries are
 // kept in linked lists with 8 different sizes per binary order of magnitude
-// and the header size is two words with eager coalescing on free.
+// and the header size is two words with eager coalescing on free.  Small
+// allocations are cached per cpu in front of that, see "Per-cpu caches".
 
 #if defined(DEBUG) || LK_DEBUGLEVEL > 2
 #define CMPCT_DEBUG
@@ -86,6 +88,8 @@ struct heap {
 static struct heap theheap;
 
 static ssize_t heap_grow(size_t len, free_t **bucket);
+static void heap_free(void *payload);
+static void cache_drain_all(void);
 
 static void lock(void) TA_ACQ(theheap.lock)
 {
@@ -679,6 +683,7 @@ void cmpct_trim(void)
     // Look at free list entries that are at least as large as one page plus a
     // header. They might be at the start or the end of a block, so we can trim
     // them and free the page(s).
+    cache_drain_all();
     lock();
     for (int bucket = size_to_index_freeing(PAGE_SIZE);
             bucket < NUMBER_OF_BUCKETS;
@@ -746,18 +751,14 @@ void cmpct_trim(void)
     unlock();
 }
 
-void *cmpct_alloc(size_t size)
+// Allocates from the free lists, for sizes that aren't large_alloc()s.
+static void *alloc_locked(size_t size) TA_REQ(theheap.lock)
 {
-    if (size == 0u) return NULL;
-
-    if (size + sizeof(header_t) > (1u << HEAP_ALLOC_VIRTUAL_BITS)) return large_alloc(size);
-
     size_t rounded_up;
     int start_bucket = size_to_index_allocating(size, &rounded_up);
 
     rounded_up += sizeof(header_t);
 
-    lock();
     int bucket = find_nonempty_bucket(start_bucket);
     if (bucket == -1) {
         // Grow heap by at least 12% if we can.
@@ -766,7 +767,6 @@ void *cmpct_alloc(size_t size)
                                 MAX(HEAP_GROW_SIZE, rounded_up)));
         while (heap_grow(growby, NULL) < 0) {
             if (growby <= rounded_up) {
-                unlock();
                 return NULL;
             }
             growby = MAX(growby >> 1, rounded_up);
@@ -797,6 +797,18 @@ void *cmpct_alloc(size_t size)
     memset(result, ALLOC_FILL, size);
     memset(((char *)result) + size, PADDING_FILL, rounded_up - size - sizeof(header_t));
 #endif
+    return result;
+}
+
+// Allocates straight from the heap, bypassing the per-cpu caches.
+static void *heap_alloc(size_t size)
+{
+    if (size == 0u) return NULL;
+
+    if (size + sizeof(header_t) > (1u << HEAP_ALLOC_VIRTUAL_BITS)) return large_alloc(size);
+
+    lock();
+    void *result = alloc_locked(size);
     unlock();
     return result;
 }
@@ -822,7 +834,9 @@ void *cmpct_memalign(size_t size, size_t alignment)
         unaligned_header->size = left_over;
         FixLeftPointer(right, header);
         unlock();
-        cmpct_free(unaligned);
+        // Hand the front back to the heap rather than to a cache, so that it
+        // coalesces with its neighbours.
+        heap_free(unaligned);
     } else {
         unlock();
     }
@@ -830,13 +844,11 @@ void *cmpct_memalign(size_t size, size_t alignment)
     return payload;
 }
 
-void cmpct_free(void *payload)
+static void free_locked(void *payload) TA_REQ(theheap.lock)
 {
-    if (payload == NULL) return;
     header_t *header = (header_t *)payload - 1;
     DEBUG_ASSERT(!is_tagged_as_free(header));  // Double free!
     size_t size = header->size;
-    lock();
     header_t *left = header->left;
     if (left != NULL && is_tagged_as_free(left)) {
         // Coalesce with left free object.
@@ -865,9 +877,465 @@ void cmpct_free(void *payload)
             free_memory(header, left, size);
         }
     }
+}
+
+// Frees straight to the heap, bypassing the per-cpu caches.
+static void heap_free(void *payload)
+{
+    if (payload == NULL) return;
+    lock();
+    free_locked(payload);
     unlock();
 }
 
+// Per-cpu caches.
+//
+// Allocations of up to CACHE_MAX_SIZE bytes are served from per-cpu
+// magazines, stacks of free blocks of one bucket size, without taking the
+// heap lock. Each cpu has a loaded and a previous magazine per bucket, so
+// alternating allocations and frees can't make it bounce off the depot. Only
+// once both are empty (or full) is a whole magazine swapped with the
+// bucket's depot, and only when the depot has none to give (or no room) are
+// blocks moved to or from the heap, at most a magazine's worth under one
+// acquisition of the heap lock.
+//
+// Cached blocks are still allocated as far as the free lists are concerned,
+// they don't coalesce until trimming drains the caches. See Bonwick and
+// Adams, "Magazines and Vmem", USENIX 2001.
+
+// Buckets up to and including the one for CACHE_MAX_SIZE byte allocations.
+#define CACHE_BUCKETS 32
+#define CACHE_MAX_SIZE 512
+
+#define MAGAZINE_ROUNDS 16
+
+// Magazines a depot keeps of each kind, beyond which full ones are drained
+// back to the heap and empty ones freed.
+#define DEPOT_MAX_FULL 4
+#define DEPOT_MAX_EMPTY 4
+
+typedef struct magazine {
+    struct magazine *next;
+    size_t rounds;
+    void *round[MAGAZINE_ROUNDS];
+} magazine_t;
+
+struct cpu_bucket {
+    // |previous| is always either full or empty.
+    magazine_t *loaded;
+    magazine_t *previous;
+    uint64_t alloc_hits;
+    uint64_t free_hits;
+};
+
+// Only touched by its own cpu with interrupts disabled, apart from when
+// draining and dumping. The lock is for those.
+struct cpu_cache {
+    spin_lock_t lock;
+    struct cpu_bucket buckets[CACHE_BUCKETS];
+} __CPU_ALIGN;
+
+struct depot {
+    spin_lock_t lock;
+    magazine_t *full;
+    magazine_t *empty;
+    size_t full_count;
+    size_t empty_count;
+    // Magazines handed to a cpu.
+    uint64_t exchanges;
+    // Allocations no magazine could serve.
+    uint64_t misses;
+    // Blocks taken from and returned to the heap.
+    uint64_t refills;
+    uint64_t drains;
+} __CPU_ALIGN;
+
+static struct cpu_cache cpu_caches[SMP_MAX_CPUS];
+static struct depot depots[CACHE_BUCKETS];
+
+// The payload size of the blocks in each bucket, and the size from which
+// freed blocks no longer belong to any cached bucket.
+static size_t bucket_sizes[CACHE_BUCKETS + 1];
+
+static size_t bucket_size(int index)
+{
+    if (index < 15) return (index + 1) * 8;
+    int row_column = index - 15 + 32;
+    return (8 + (row_column & 7)) << (row_column >> 3);
+}
+
+static struct cpu_cache *cpu_cache_acquire(spin_lock_saved_state_t *state)
+{
+    arch_interrupt_save(state, SPIN_LOCK_FLAG_INTERRUPTS);
+    struct cpu_cache *cache = &cpu_caches[arch_curr_cpu_num()];
+    spin_lock(&cache->lock);
+    return cache;
+}
+
+static void cpu_cache_release(struct cpu_cache *cache, spin_lock_saved_state_t state)
+{
+    spin_unlock(&cache->lock);
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+}
+
+static void cache_fill_free(void *payload)
+{
+#ifdef CMPCT_DEBUG
+    header_t *header = (header_t *)payload - 1;
+    memset(payload, FREE_FILL, header->size - sizeof(header_t));
+#endif
+}
+
+static void cache_fill_alloc(void *payload, size_t size)
+{
+#ifdef CMPCT_DEBUG
+    header_t *header = (header_t *)payload - 1;
+    check_free_fill(payload, size);
+    memset(payload, ALLOC_FILL, size);
+    memset((char *)payload + size, PADDING_FILL, header->size - sizeof(header_t) - size);
+#endif
+}
+
+// Returns a magazine's rounds to the heap, and the magazine too unless the
+// depot takes it back as an empty.
+static void magazine_drain(int bucket, magazine_t *mag)
+{
+    struct depot *depot = &depots[bucket];
+
+    if (mag->rounds != 0) {
+        lock();
+        for (size_t i = 0; i < mag->rounds; i++)
+            free_locked(mag->round[i]);
+        unlock();
+        __atomic_fetch_add(&depot->drains, mag->rounds, __ATOMIC_RELAXED);
+        mag->rounds = 0;
+    }
+
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&depot->lock, state);
+    if (depot->empty_count < DEPOT_MAX_EMPTY) {
+        mag->next = depot->empty;
+        depot->empty = mag;
+        depot->empty_count++;
+        mag = NULL;
+    }
+    spin_unlock_irqrestore(&depot->lock, state);
+
+    heap_free(mag);
+}
+
+// Fills a magazine from the heap for a cpu whose magazines and depot are
+// empty, returning one more block for the allocation that found them so.
+static void *cache_refill(int bucket, size_t size)
+{
+    struct depot *depot = &depots[bucket];
+    spin_lock_saved_state_t state;
+
+    __atomic_fetch_add(&depot->misses, 1, __ATOMIC_RELAXED);
+
+    spin_lock_irqsave(&depot->lock, state);
+    magazine_t *mag = depot->empty;
+    if (mag != NULL) {
+        depot->empty = mag->next;
+        depot->empty_count--;
+    }
+    spin_unlock_irqrestore(&depot->lock, state);
+    if (mag == NULL) {
+        mag = heap_alloc(sizeof(magazine_t));
+        if (mag != NULL) mag->rounds = 0;
+    }
+
+    lock();
+    void *result = alloc_locked(bucket_sizes[bucket]);
+    if (result != NULL && mag != NULL) {
+        while (mag->rounds < MAGAZINE_ROUNDS) {
+            void *round = alloc_locked(bucket_sizes[bucket]);
+            if (round == NULL) break;
+            mag->round[mag->rounds++] = round;
+        }
+    }
+    unlock();
+
+    if (result == NULL) {
+        heap_free(mag);
+        return NULL;
+    }
+    // Blocks come out of the heap filled for a whole bucket's worth.
+    cache_fill_free(result);
+    cache_fill_alloc(result, size);
+    if (mag == NULL) return result;
+
+    __atomic_fetch_add(&depot->refills, mag->rounds + 1, __ATOMIC_RELAXED);
+    for (size_t i = 0; i < mag->rounds; i++)
+        cache_fill_free(mag->round[i]);
+
+    // We may have moved cpus or raced with another thread on this one.
+    // Anything that can't be loaded goes back to the depot or the heap.
+    struct cpu_cache *cache = cpu_cache_acquire(&state);
+    struct cpu_bucket *cb = &cache->buckets[bucket];
+    magazine_t *spare = mag;
+    if (cb->loaded == NULL || cb->loaded->rounds == 0) {
+        spare = cb->loaded;
+        cb->loaded = mag;
+    } else if (mag->rounds == MAGAZINE_ROUNDS) {
+        spin_lock(&depot->lock);
+        if (depot->full_count < DEPOT_MAX_FULL) {
+            mag->next = depot->full;
+            depot->full = mag;
+            depot->full_count++;
+            spare = NULL;
+        }
+        spin_unlock(&depot->lock);
+    }
+    cpu_cache_release(cache, state);
+
+    if (spare != NULL) magazine_drain(bucket, spare);
+    return result;
+}
+
+static void *cache_alloc(int bucket, size_t size)
+{
+    struct depot *depot = &depots[bucket];
+    magazine_t *unused = NULL;
+    void *result = NULL;
+
+    spin_lock_saved_state_t state;
+    struct cpu_cache *cache = cpu_cache_acquire(&state);
+    struct cpu_bucket *cb = &cache->buckets[bucket];
+
+    if (cb->loaded == NULL || cb->loaded->rounds == 0) {
+        if (cb->previous != NULL && cb->previous->rounds != 0) {
+            magazine_t *mag = cb->loaded;
+            cb->loaded = cb->previous;
+            cb->previous = mag;
+        } else {
+            spin_lock(&depot->lock);
+            magazine_t *full = depot->full;
+            if (full != NULL) {
+                depot->full = full->next;
+                depot->full_count--;
+                depot->exchanges++;
+                // Both of ours are empty, keep one.
+                unused = cb->previous;
+                if (unused != NULL && depot->empty_count < DEPOT_MAX_EMPTY) {
+                    unused->next = depot->empty;
+                    depot->empty = unused;
+                    depot->empty_count++;
+                    unused = NULL;
+                }
+                cb->previous = cb->loaded;
+                cb->loaded = full;
+            }
+            spin_unlock(&depot->lock);
+        }
+    }
+    if (cb->loaded != NULL && cb->loaded->rounds != 0) {
+        result = cb->loaded->round[--cb->loaded->rounds];
+        cb->alloc_hits++;
+    }
+    cpu_cache_release(cache, state);
+
+    heap_free(unused);
+    if (result == NULL) return cache_refill(bucket, size);
+
+    cache_fill_alloc(result, size);
+    return result;
+}
+
+static void cache_free(int bucket, void *payload)
+{
+    struct depot *depot = &depots[bucket];
+    magazine_t *spare = NULL;
+
+    cache_fill_free(payload);
+
+    for (;;) {
+        magazine_t *full = NULL;
+        bool cached = false;
+
+        spin_lock_saved_state_t state;
+        struct cpu_cache *cache = cpu_cache_acquire(&state);
+        struct cpu_bucket *cb = &cache->buckets[bucket];
+
+        if (cb->loaded != NULL && cb->loaded->rounds < MAGAZINE_ROUNDS) {
+            cached = true;
+        } else if (cb->previous != NULL && cb->previous->rounds == 0) {
+            magazine_t *mag = cb->loaded;
+            cb->loaded = cb->previous;
+            cb->previous = mag;
+            cached = true;
+        } else {
+            spin_lock(&depot->lock);
+            magazine_t *empty = spare;
+            spare = NULL;
+            if (empty == NULL && depot->empty != NULL) {
+                empty = depot->empty;
+                depot->empty = empty->next;
+                depot->empty_count--;
+            }
+            if (empty != NULL) {
+                depot->exchanges++;
+                // Both of ours are full, give one up.
+                if (cb->previous != NULL) {
+                    if (depot->full_count < DEPOT_MAX_FULL) {
+                        cb->previous->next = depot->full;
+                        depot->full = cb->previous;
+                        depot->full_count++;
+                    } else {
+                        full = cb->previous;
+                    }
+                }
+                cb->previous = cb->loaded;
+                cb->loaded = empty;
+                cached = true;
+            }
+            spin_unlock(&depot->lock);
+        }
+        if (cached) {
+            cb->loaded->round[cb->loaded->rounds++] = payload;
+            cb->free_hits++;
+        }
+        cpu_cache_release(cache, state);
+
+        if (full != NULL) magazine_drain(bucket, full);
+        if (cached) break;
+
+        // No empty magazine anywhere, bring one next time round.
+        spare = heap_alloc(sizeof(magazine_t));
+        if (spare == NULL) {
+            heap_free(payload);
+            return;
+        }
+        spare->rounds = 0;
+    }
+
+    if (spare != NULL) magazine_drain(bucket, spare);
+}
+
+// Returns everything the caches hold to the heap.
+static void cache_drain_all(void)
+{
+    for (int bucket = 0; bucket < CACHE_BUCKETS; bucket++) {
+        struct depot *depot = &depots[bucket];
+        magazine_t *list = NULL;
+        spin_lock_saved_state_t state;
+
+        for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+            struct cpu_cache *cache = &cpu_caches[cpu];
+            struct cpu_bucket *cb = &cache->buckets[bucket];
+
+            spin_lock_irqsave(&cache->lock, state);
+            if (cb->loaded != NULL) {
+                cb->loaded->next = list;
+                list = cb->loaded;
+            }
+            if (cb->previous != NULL) {
+                cb->previous->next = list;
+                list = cb->previous;
+            }
+            cb->loaded = cb->previous = NULL;
+            spin_unlock_irqrestore(&cache->lock, state);
+        }
+
+        spin_lock_irqsave(&depot->lock, state);
+        magazine_t *lists[2] = { depot->full, depot->empty };
+        depot->full = depot->empty = NULL;
+        depot->full_count = depot->empty_count = 0;
+        spin_unlock_irqrestore(&depot->lock, state);
+        for (int i = 0; i < 2; i++) {
+            while (lists[i] != NULL) {
+                magazine_t *mag = lists[i];
+                lists[i] = mag->next;
+                mag->next = list;
+                list = mag;
+            }
+        }
+
+        if (list == NULL) continue;
+
+        uint64_t drained = 0;
+        lock();
+        while (list != NULL) {
+            magazine_t *mag = list;
+            list = mag->next;
+            for (size_t i = 0; i < mag->rounds; i++)
+                free_locked(mag->round[i]);
+            drained += mag->rounds;
+            free_locked(mag);
+        }
+        unlock();
+        __atomic_fetch_add(&depot->drains, drained, __ATOMIC_RELAXED);
+    }
+}
+
+void cmpct_dump_cache_stats(bool panic_time)
+{
+    dprintf(INFO, "Heap cache (%d byte magazines of %d rounds):\n",
+            (int)sizeof(magazine_t), MAGAZINE_ROUNDS);
+    dprintf(INFO, "\t%6s %10s %10s %8s %8s %8s %8s %6s\n", "size", "alloc hit", "free hit",
+            "miss", "exchange", "refill", "drain", "cached");
+
+    for (int bucket = 0; bucket < CACHE_BUCKETS; bucket++) {
+        struct depot *depot = &depots[bucket];
+        uint64_t alloc_hits = 0, free_hits = 0;
+        size_t cached = 0;
+        spin_lock_saved_state_t state;
+
+        for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+            struct cpu_cache *cache = &cpu_caches[cpu];
+            struct cpu_bucket *cb = &cache->buckets[bucket];
+
+            if (!panic_time)
+                spin_lock_irqsave(&cache->lock, state);
+            alloc_hits += cb->alloc_hits;
+            free_hits += cb->free_hits;
+            if (cb->loaded != NULL) cached += cb->loaded->rounds;
+            if (cb->previous != NULL) cached += cb->previous->rounds;
+            if (!panic_time)
+                spin_unlock_irqrestore(&cache->lock, state);
+        }
+        cached += depot->full_count * MAGAZINE_ROUNDS;
+
+        if (alloc_hits == 0 && free_hits == 0 && depot->misses == 0)
+            continue;
+        dprintf(INFO, "\t%6zu %10" PRIu64 " %10" PRIu64 " %8" PRIu64 " %8" PRIu64 " %8" PRIu64
+                " %8" PRIu64 " %6zu\n", bucket_sizes[bucket], alloc_hits, free_hits,
+                depot->misses, depot->exchanges, depot->refills, depot->drains, cached);
+    }
+}
+
+void *cmpct_alloc(size_t size)
+{
+    if (size == 0u) return NULL;
+
+    if (size <= CACHE_MAX_SIZE) {
+        size_t rounded_up;
+        size_to_index_allocating(size, &rounded_up);
+        // Allocations too small for a free area come out of the next bucket
+        // up, which blocks of their size are freed to.
+        int bucket = size_to_index_freeing(rounded_up);
+        DEBUG_ASSERT(bucket < CACHE_BUCKETS);
+        return cache_alloc(bucket, size);
+    }
+
+    return heap_alloc(size);
+}
+
+void cmpct_free(void *payload)
+{
+    if (payload == NULL) return;
+    header_t *header = (header_t *)payload - 1;
+    DEBUG_ASSERT(!is_tagged_as_free(header));  // Double free!
+
+    size_t size = header->size - sizeof(header_t);
+    if (size < bucket_sizes[CACHE_BUCKETS]) {
+        cache_free(size_to_index_freeing(size), payload);
+        return;
+    }
+
+    heap_free(payload);
+}
+
 void *cmpct_realloc(void *payload, size_t size)
 {
     if (payload == NULL) return cmpct_alloc(size);
@@ -921,6 +1389,11 @@ void cmpct_init(void)
     // Create a mutex.
     mutex_init(&theheap.lock);
 
+    for (int i = 0; i <= CACHE_BUCKETS; i++) {
+        bucket_sizes[i] = bucket_size(i);
+    }
+    DEBUG_ASSERT(size_to_index_freeing(CACHE_MAX_SIZE) == CACHE_BUCKETS - 1);
+
     // Initialize the free list.
     for (int i = 0; i < NUMBER_OF_BUCKETS; i++) {
         theheap.free_lists[i] = NULL;
@@ -38,6 +38,182 @@ static bool heap_trace = false;
 #define heap_trace (false)
 #endif
 
+#if WITH_HEAP_TAGS
+
+namespace {
+
+// Ahead of every payload, so that free knows what to credit.
+struct tag_header {
+    uint32_t tag;
+    // From the start of the underlying allocation to the payload.
+    uint32_t offset;
+    size_t size;
+};
+
+// A multiple of the heap's own alignment, so payloads keep it.
+static_assert(sizeof(tag_header) == 16, "");
+
+struct tag_counts {
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t alloc_bytes;
+    uint64_t free_bytes;
+};
+
+// Each cpu counts on lines of its own. A thread can move cpus between picking
+// its counters and updating them, so the updates are still atomic, but the
+// lines are almost never shared.
+struct cpu_tag_counts {
+    tag_counts tags[HEAP_TAG_COUNT];
+} __CPU_ALIGN;
+
+cpu_tag_counts tag_counts_by_cpu[SMP_MAX_CPUS];
+
+const char *const tag_names[HEAP_TAG_COUNT] = {
+#define HEAP_TAG_NAME(tag, name) name,
+    HEAP_TAG_LIST(HEAP_TAG_NAME)
+#undef HEAP_TAG_NAME
+};
+
+inline tag_counts *local_counts(uint32_t tag)
+{
+    return &tag_counts_by_cpu[arch_curr_cpu_num()].tags[tag];
+}
+
+} // namespace
+
+static void *heap_alloc(size_t boundary, size_t size, heap_tag_t tag)
+{
+    DEBUG_ASSERT(tag < HEAP_TAG_COUNT);
+
+    size_t offset = MAX(boundary, sizeof(tag_header));
+    if (size > SIZE_MAX - offset || offset > UINT32_MAX)
+        return NULL;
+
+    char *raw = static_cast<char *>(boundary ? cmpct_memalign(size + offset, boundary)
+                                             : cmpct_alloc(size + offset));
+    if (unlikely(!raw))
+        return NULL;
+
+    tag_header *header = reinterpret_cast<tag_header *>(raw + offset) - 1;
+    header->tag = tag;
+    header->offset = static_cast<uint32_t>(offset);
+    header->size = size;
+
+    tag_counts *counts = local_counts(tag);
+    __atomic_fetch_add(&counts->allocs, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&counts->alloc_bytes, size, __ATOMIC_RELAXED);
+
+    return raw + offset;
+}
+
+static void heap_free(void *ptr)
+{
+    if (!ptr)
+        return;
+
+    tag_header *header = static_cast<tag_header *>(ptr) - 1;
+    DEBUG_ASSERT(header->tag < HEAP_TAG_COUNT);
+
+    tag_counts *counts = local_counts(header->tag);
+    __atomic_fetch_add(&counts->frees, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&counts->free_bytes, header->size, __ATOMIC_RELAXED);
+
+    cmpct_free(static_cast<char *>(ptr) - header->offset);
+}
+
+static void *heap_realloc(void *ptr, size_t size)
+{
+    if (!ptr)
+        return heap_alloc(0, size, HEAP_TAG_UNTAGGED);
+
+    // Keep the tag, and any alignment, by copying to a new allocation.
+    const tag_header *header = static_cast<const tag_header *>(ptr) - 1;
+    size_t boundary = (header->offset > sizeof(tag_header)) ? header->offset : 0;
+    void *ptr2 = heap_alloc(boundary, size, static_cast<heap_tag_t>(header->tag));
+    if (ptr2) {
+        memcpy(ptr2, ptr, MIN(size, header->size));
+        heap_free(ptr);
+    }
+    return ptr2;
+}
+
+void heap_tag_get_stats(heap_tag_t tag, heap_tag_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (tag >= HEAP_TAG_COUNT)
+        return;
+
+    stats->name = tag_names[tag];
+    for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        const tag_counts *counts = &tag_counts_by_cpu[cpu].tags[tag];
+        stats->allocs += __atomic_load_n(&counts->allocs, __ATOMIC_RELAXED);
+        stats->frees += __atomic_load_n(&counts->frees, __ATOMIC_RELAXED);
+        stats->alloc_bytes += __atomic_load_n(&counts->alloc_bytes, __ATOMIC_RELAXED);
+        stats->free_bytes += __atomic_load_n(&counts->free_bytes, __ATOMIC_RELAXED);
+    }
+}
+
+void *malloc_tagged(size_t size, heap_tag_t tag)
+{
+    DEBUG_ASSERT(!arch_in_int_handler());
+
+    void *ptr = heap_alloc(0, size, tag);
+    if (HEAP_PANIC_ON_ALLOC_FAIL && unlikely(!ptr)) {
+        panic("malloc of size %zu failed\n", size);
+    }
+    return ptr;
+}
+
+void *memalign_tagged(size_t boundary, size_t size, heap_tag_t tag)
+{
+    DEBUG_ASSERT(!arch_in_int_handler());
+
+    void *ptr = heap_alloc(boundary, size, tag);
+    if (HEAP_PANIC_ON_ALLOC_FAIL && unlikely(!ptr)) {
+        panic("memalign of size %zu align %zu failed\n", size, boundary);
+    }
+    return ptr;
+}
+
+void *calloc_tagged(size_t count, size_t size, heap_tag_t tag)
+{
+    DEBUG_ASSERT(!arch_in_int_handler());
+
+    size_t realsize = count * size;
+
+    void *ptr = heap_alloc(0, realsize, tag);
+    if (likely(ptr))
+        memset(ptr, 0, realsize);
+    return ptr;
+}
+
+void *operator new(size_t size, heap_tag_t tag, AllocChecker *ac) noexcept
+{
+    void *ptr = heap_alloc(0, size, tag);
+    ac->arm(size, ptr != nullptr);
+    return ptr;
+}
+
+#else
+
+static inline void *heap_alloc(size_t boundary, size_t size, heap_tag_t tag)
+{
+    return boundary ? cmpct_memalign(size, boundary) : cmpct_alloc(size);
+}
+
+static inline void heap_free(void *ptr)
+{
+    cmpct_free(ptr);
+}
+
+static inline void *heap_realloc(void *ptr, size_t size)
+{
+    return cmpct_realloc(ptr, size);
+}
+
+#endif // WITH_HEAP_TAGS
+
 void heap_init(void)
 {
     cmpct_init();
@@ -54,7 +230,7 @@ void *malloc(size_t size)
 
     LTRACEF("size %zu\n", size);
 
-    void *ptr = cmpct_alloc(size);
+    void *ptr = heap_alloc(0, size, HEAP_TAG_UNTAGGED);
     if (unlikely(heap_trace))
         printf("caller %p malloc %zu -> %p\n", __GET_CALLER(), size, ptr);
 
@@ -71,7 +247,7 @@ void *memalign(size_t boundary, size_t size)
 
     LTRACEF("boundary %zu, size %zu\n", boundary, size);
 
-    void *ptr = cmpct_memalign(size, boundary);
+    void *ptr = heap_alloc(boundary, size, HEAP_TAG_UNTAGGED);
     if (unlikely(heap_trace))
         printf("caller %p memalign %zu, %zu -> %p\n", __GET_CALLER(), boundary, size, ptr);
 
@@ -90,7 +266,7 @@ void *calloc(size_t count, size_t size)
 
     size_t realsize = count * size;
 
-    void *ptr = cmpct_alloc(realsize);
+    void *ptr = heap_alloc(0, realsize, HEAP_TAG_UNTAGGED);
     if (likely(ptr))
         memset(ptr, 0, realsize);
     if (unlikely(heap_trace))
@@ -104,7 +280,7 @@ void *realloc(void *ptr, size_t size)
 
     LTRACEF("ptr %p, size %zu\n", ptr, size);
 
-    void *ptr2 = cmpct_realloc(ptr, size);
+    void *ptr2 = heap_realloc(ptr, size);
     if (unlikely(heap_trace))
         printf("caller %p realloc %p, %zu -> %p\n", __GET_CALLER(), ptr, size, ptr2);
 
@@ -123,7 +299,7 @@ void free(void *ptr)
     if (unlikely(heap_trace))
         printf("caller %p free %p\n", __GET_CALLER(), ptr);
 
-    cmpct_free(ptr);
+    heap_free(ptr);
 }
 
 static void heap_dump(bool panic_time)
@@ -131,6 +307,11 @@ static void heap_dump(bool panic_time)
     cmpct_dump(panic_time);
 }
 
+static void heap_dump_stats(bool panic_time)
+{
+    cmpct_dump_cache_stats(panic_time);
+}
+
 void heap_get_info(size_t *size_bytes, size_t *free_bytes) {
     cmpct_get_info(size_bytes, free_bytes);
 }
@@ -186,6 +367,7 @@ notenoughargs:
 usage:
         printf("usage:\n");
         printf("\t%s info\n", argv[0].str);
+        printf("\t%s stats\n", argv[0].str);
         if (!(flags & CMD_FLAG_PANIC)) {
             printf("\t%s trace\n", argv[0].str);
             printf("\t%s trim\n", argv[0].str);
@@ -198,6 +380,8 @@ usage:
 
     if (strcmp(argv[1].str, "info") == 0) {
         heap_dump(flags & CMD_FLAG_PANIC);
+    } else if (strcmp(argv[1].str, "stats") == 0) {
+        heap_dump_stats(flags & CMD_FLAG_PANIC);
     } else if (!(flags & CMD_FLAG_PANIC) && strcmp(argv[1].str, "test") == 0) {
         heap_test();
     } else if (!(flags & CMD_FLAG_PANIC) && strcmp(argv[1].str, "trace") == 0) {
@@ -229,3 +413,67 @@ usage:
 
 #endif
 #endif
+
+#if WITH_HEAP_TAGS && WITH_LIB_CONSOLE
+
+#include <inttypes.h>
+#include <kernel/thread.h>
+
+static void kmemstat_print(const heap_tag_stats_t *stats, const heap_tag_stats_t *before,
+                           uint seconds)
+{
+    uint64_t live_bytes = stats->alloc_bytes - stats->free_bytes;
+    printf("%-10s %10" PRIu64 " %12" PRIu64, stats->name, stats->allocs - stats->frees,
+           live_bytes);
+    if (before) {
+        // Rates over the interval, and how much the live bytes grew by.
+        uint64_t live_before = before->alloc_bytes - before->free_bytes;
+        int64_t growth = static_cast<int64_t>(live_bytes - live_before);
+        printf(" %10" PRIu64 " %10" PRIu64 " %12" PRId64 "\n",
+               (stats->allocs - before->allocs) / seconds,
+               (stats->frees - before->frees) / seconds, growth);
+    } else {
+        printf(" %12" PRIu64 " %12" PRIu64 "\n", stats->allocs, stats->alloc_bytes);
+    }
+}
+
+static int cmd_kmemstat(int argc, const cmd_args *argv, uint32_t flags)
+{
+    if (argc > 2 || (argc == 2 && argv[1].u == 0)) {
+        printf("usage:\n");
+        printf("%s           : live kernel heap allocations by tag\n", argv[0].str);
+        printf("%s <seconds> : allocation and free rates by tag over an interval\n",
+               argv[0].str);
+        return MX_ERR_INVALID_ARGS;
+    }
+
+    heap_tag_stats_t stats[HEAP_TAG_COUNT];
+    for (uint tag = 0; tag < HEAP_TAG_COUNT; tag++)
+        heap_tag_get_stats(static_cast<heap_tag_t>(tag), &stats[tag]);
+
+    if (argc == 1) {
+        printf("%-10s %10s %12s %12s %12s\n", "tag", "live", "live bytes", "allocs",
+               "alloc bytes");
+        for (uint tag = 0; tag < HEAP_TAG_COUNT; tag++)
+            kmemstat_print(&stats[tag], NULL, 0);
+        return 0;
+    }
+
+    uint seconds = static_cast<uint>(argv[1].u);
+    thread_sleep_relative(LK_SEC(seconds));
+
+    printf("%-10s %10s %12s %10s %10s %12s\n", "tag", "live", "live bytes", "allocs/s",
+           "frees/s", "growth");
+    for (uint tag = 0; tag < HEAP_TAG_COUNT; tag++) {
+        heap_tag_stats_t now;
+        heap_tag_get_stats(static_cast<heap_tag_t>(tag), &now);
+        kmemstat_print(&now, &stats[tag], seconds);
+    }
+    return 0;
+}
+
+STATIC_COMMAND_START
+STATIC_COMMAND("kmemstat", "kernel heap usage by allocation tag", &cmd_kmemstat)
+STATIC_COMMAND_END(kmemstat);
+
+#endif
@@ -8,6 +8,7 @@
 #pragma once
 
 #include <stddef.h>
+#include <stdint.h>
 #include <sys/types.h>
 #include <magenta/compiler.h>
 
@@ -34,4 +35,75 @@ void heap_page_free(void *ptr, size_t pages);
  */
 void heap_get_info(size_t *size_bytes, size_t *free_bytes);
 
+/* Heap allocation tags, counted when built with ENABLE_HEAP_TAGS=true.
+ *
+ * Allocations made through the _tagged variants are charged to their tag, and
+ * everything else to HEAP_TAG_UNTAGGED. Each allocation remembers its tag, so
+ * free() credits the right one. Without the flag the _tagged variants are the
+ * plain ones and nothing is counted.
+ */
+#define HEAP_TAG_LIST(X) \
+    X(UNTAGGED, "untagged") \
+    X(SLAB,     "slab")     \
+    X(OBJECT,   "object")   \
+    X(VM,       "vm")       \
+    X(IPC,      "ipc")      \
+    X(THREAD,   "thread")
+
+typedef enum {
+#define HEAP_TAG_ENUM(tag, name) HEAP_TAG_##tag,
+    HEAP_TAG_LIST(HEAP_TAG_ENUM)
+#undef HEAP_TAG_ENUM
+    HEAP_TAG_COUNT
+} heap_tag_t;
+
+typedef struct heap_tag_stats {
+    const char *name;
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t alloc_bytes;
+    uint64_t free_bytes;
+} heap_tag_stats_t;
+
+#if WITH_HEAP_TAGS
+
+void *malloc_tagged(size_t size, heap_tag_t tag) __MALLOC;
+void *memalign_tagged(size_t boundary, size_t size, heap_tag_t tag) __MALLOC;
+void *calloc_tagged(size_t count, size_t size, heap_tag_t tag) __MALLOC;
+
+/* Sum the counts of |tag| over all cpus. */
+void heap_tag_get_stats(heap_tag_t tag, heap_tag_stats_t *stats);
+
+#else
+
+static inline void *malloc_tagged(size_t size, heap_tag_t tag) {
+    return malloc(size);
+}
+
+static inline void *memalign_tagged(size_t boundary, size_t size, heap_tag_t tag) {
+    return memalign(boundary, size);
+}
+
+static inline void *calloc_tagged(size_t count, size_t size, heap_tag_t tag) {
+    return calloc(count, size);
+}
+
+#endif
+
 __END_CDECLS
+
+#ifdef __cplusplus
+
+#include <mxalloc/new.h>
+
+/* A tagged new, as in new (HEAP_TAG_VM, &ac) VmObjectPaged(...). The object is
+ * deleted as usual. */
+#if WITH_HEAP_TAGS
+void *operator new(size_t size, heap_tag_t tag, AllocChecker *ac) noexcept;
+#else
+inline void *operator new(size_t size, heap_tag_t tag, AllocChecker *ac) noexcept {
+    return operator new(size, ac);
+}
+#endif
+
+#endif
@@ -57,12 +57,54 @@ status_t GuestPhysicalAddressSpace::MapApicPage(vaddr_t guest_paddr, paddr_t hos
     return map_page(&paspace_, guest_paddr, host_paddr, kApicMmuFlags);
 }
 
+namespace {
+
+// A run of guest physical pages backed by contiguous host physical pages.
+struct MapRun {
+    guest_paspace_t* paspace;
+    vaddr_t guest_paddr;
+    paddr_t host_paddr;
+    size_t num_pages;
+};
+
+} // namespace
+
+static status_t map_run(MapRun* run) {
+    if (run->num_pages == 0)
+        return MX_OK;
+    size_t mapped;
+    status_t status = guest_mmu_map(run->paspace, run->guest_paddr, run->host_paddr,
+                                    run->num_pages, kMmuFlags, &mapped);
+    if (status != MX_OK)
+        return status;
+    return mapped != run->num_pages ? MX_ERR_NO_MEMORY : MX_OK;
+}
+
 status_t GuestPhysicalAddressSpace::MapRange(vaddr_t guest_paddr, size_t size) {
+    // Map each physically contiguous run of the VMO with a single call, so
+    // that the MMU can use 2MB and 1GB pages wherever the run is aligned.
+    // Those are split again if part of one is later unmapped for a trap.
     auto mmu_map = [](void* context, size_t offset, size_t index, paddr_t pa) -> status_t {
-        guest_paspace_t* paspace = static_cast<guest_paspace_t*>(context);
-        return map_page(paspace, offset, pa, kMmuFlags);
+        MapRun* run = static_cast<MapRun*>(context);
+        if (run->num_pages != 0 &&
+            offset == run->guest_paddr + run->num_pages * PAGE_SIZE &&
+            pa == run->host_paddr + run->num_pages * PAGE_SIZE) {
+            run->num_pages++;
+            return MX_OK;
+        }
+        status_t status = map_run(run);
+        if (status != MX_OK)
+            return status;
+        run->guest_paddr = offset;
+        run->host_paddr = pa;
+        run->num_pages = 1;
+        return MX_OK;
     };
-    return guest_phys_mem_->Lookup(guest_paddr, size, kPfFlags, mmu_map, &paspace_);
+    MapRun run = {&paspace_, 0, 0, 0};
+    status_t status = guest_phys_mem_->Lookup(guest_paddr, size, kPfFlags, mmu_map, &run);
+    if (status != MX_OK)
+        return status;
+    return map_run(&run);
 }
 
 status_t GuestPhysicalAddressSpace::UnmapRange(vaddr_t guest_paddr, size_t size) {
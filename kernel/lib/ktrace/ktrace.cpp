@@ -7,11 +7,16 @@
 #include <debug.h>
 #include <err.h>
 #include <platform.h>
+#include <pow2.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <arch/ops.h>
 #include <arch/user_copy.h>
 #include <kernel/cmdline.h>
+#include <kernel/mp.h>
+#include <kernel/spinlock.h>
 #include <kernel/vm/vm_aspace.h>
 #include <lib/ktrace.h>
 #include <lk/init.h>
@@ -19,10 +24,8 @@
 #include <magenta/user_thread.h>
 
 #if __x86_64__
-#define ktrace_timestamp() rdtsc();
 #define ktrace_ticks_per_ms() (ticks_per_second() / 1000)
 #else
-#define ktrace_timestamp() current_time()
 #define ktrace_ticks_per_ms() (1000000)
 #endif
 
@@ -64,13 +67,51 @@ static ktrace_probe_info_t* ktrace_find_probe(const char* name) TA_REQ(probe_lis
     return nullptr;
 }
 
-static void ktrace_add_probe(ktrace_probe_info_t* probe) TA_REQ(probe_list_lock) {
+uint32_t ktrace_probe_enabled[KTRACE_MAX_PROBES / 32];
+
+static void ktrace_set_probe_enabled(ktrace_probe_info_t* probe, bool enable) {
+    uint32_t bit = 1u << (probe->num % 32);
+    if (enable) {
+        __atomic_fetch_or(&ktrace_probe_enabled[probe->num / 32], bit, __ATOMIC_RELAXED);
+    } else {
+        __atomic_fetch_and(&ktrace_probe_enabled[probe->num / 32], ~bit, __ATOMIC_RELAXED);
+    }
+}
+
+static status_t ktrace_add_probe(ktrace_probe_info_t* probe) TA_REQ(probe_list_lock) {
     if (probe->num == 0) {
+        if (probe_number == KTRACE_MAX_PROBES) {
+            return MX_ERR_NO_RESOURCES;
+        }
         probe->num = probe_number++;
     }
     probe->next = probe_list;
     probe_list = probe;
+    ktrace_set_probe_enabled(probe, !(probe->flags & KTRACE_PROBE_OFF));
     ktrace_name_etc(TAG_PROBE_NAME, probe->num, 0, probe->name, true);
+    return MX_OK;
+}
+
+// Switch on or off every probe with the given name, or whose name starts
+// with the given prefix if it ends in '*'. Returns how many were changed.
+static status_t ktrace_enable_probes(const char* pattern, bool enable) {
+    size_t len = strlen(pattern);
+    bool prefix = len > 0 && pattern[len - 1] == '*';
+    if (prefix) {
+        len--;
+    }
+
+    int count = 0;
+    mutex_acquire(&probe_list_lock);
+    for (ktrace_probe_info_t* probe = probe_list; probe != nullptr; probe = probe->next) {
+        if (prefix ? !strncmp(pattern, probe->name, len) : !strcmp(pattern, probe->name)) {
+            ktrace_set_probe_enabled(probe, enable);
+            count++;
+        }
+    }
+    mutex_release(&probe_list_lock);
+
+    return count ? count : MX_ERR_NOT_FOUND;
 }
 
 static void ktrace_report_probes(void) {
@@ -82,86 +123,420 @@ static void ktrace_report_probes(void) {
     mutex_release(&probe_list_lock);
 }
 
-typedef struct ktrace_state {
-    // where the next record will be written
-    int offset;
+// Each cpu writes timestamped records into a buffer of its own, with
+// interrupts disabled and without any atomic read-modify-write, so turning
+// tracing on doesn't have every cpu fighting over one cache line. Name and
+// metadata records carry no timestamp and are rare, so they share a single
+// buffer under a spin lock and are never overwritten.
+typedef struct ktrace_cpu {
+    // records live in [tail, head), counted in bytes since the last rewind
+    // and taken modulo the buffer size. only the owning cpu moves head, and
+    // tail too unless the trace is being streamed out
+    uint64_t head;
+    uint64_t tail;
+
+    // where the padding at the end of the buffer starts from the last time
+    // the records wrapped around to the start
+    uint64_t pad;
+
+    // records that did not fit
+    uint32_t dropped;
 
+    uint8_t* buffer;
+} __CPU_ALIGN ktrace_cpu_t;
+
+typedef struct ktrace_state {
     // mask of groups we allow, 0 == tracing disabled
     int grpmask;
 
-    // total size of the trace buffer
-    uint32_t bufsize;
+    // what happens when a cpu's buffer fills, one of KTRACE_MODE_*.
+    // only changed while tracing is stopped
+    uint32_t mode;
 
-    // offset where tracing was stopped, 0 if tracing active
-    uint32_t marker;
+    // where the next name record will be written, guarded by meta_lock
+    spin_lock_t meta_lock;
+    uint32_t meta_offset;
 
-    // raw trace buffer
-    uint8_t* buffer;
+    // size of the name buffer
+    uint32_t meta_bufsize;
+
+    // name and metadata records
+    uint8_t* meta_buffer;
+
+    // size of each cpu's buffer, a power of two
+    uint32_t cpu_bufsize;
+
+    uint32_t num_cpus;
+    ktrace_cpu_t cpu[SMP_MAX_CPUS];
 } ktrace_state_t;
 
 static ktrace_state_t KTRACE_STATE;
 
-int ktrace_read_user(void* ptr, uint32_t off, uint32_t len) {
-    ktrace_state_t* ks = &KTRACE_STATE;
-
-    // Buffer size is limited by the marker if set,
-    // otherwise limited by offset (last written point).
-    // Offset can end up pointing past the end, so clip
-    // it to the actual buffer size to be safe.
-    uint32_t max;
-    if (ks->marker) {
-        max = ks->marker;
-    } else {
-        max = ks->offset;
-        if (max > ks->bufsize) {
-            max = ks->bufsize;
+// Reserve len bytes in the current cpu's buffer, returning where the record
+// goes and in *headp where head will be once it has been written. Interrupts
+// must stay disabled until it is published with ktrace_commit().
+static void* ktrace_reserve(ktrace_state_t* ks, ktrace_cpu_t* kc, uint32_t len, uint64_t* headp) {
+    const uint32_t mask = ks->cpu_bufsize - 1;
+    uint64_t head = kc->head;
+    uint32_t pos = (uint32_t)head & mask;
+
+    // records are never split across the end of the buffer, a tag of 0
+    // marks the rest of it as padding
+    uint32_t pad = (pos + len > ks->cpu_bufsize) ? ks->cpu_bufsize - pos : 0;
+
+    uint64_t tail = __atomic_load_n(&kc->tail, __ATOMIC_ACQUIRE);
+    if (head + pad + len - tail > ks->cpu_bufsize) {
+        if (ks->mode != KTRACE_MODE_RING) {
+            if (ks->mode == KTRACE_MODE_ONESHOT) {
+                // if we arrive at the end, stop
+                atomic_store(&ks->grpmask, 0);
+            }
+            kc->dropped++;
+            return nullptr;
         }
+
+        // make room by throwing away the oldest records
+        do {
+            uint32_t tag = *(uint32_t*)(kc->buffer + ((uint32_t)tail & mask));
+            tail += tag ? KTRACE_LEN(tag) : ks->cpu_bufsize - ((uint32_t)tail & mask);
+        } while (head + pad + len - tail > ks->cpu_bufsize);
+        kc->tail = tail;
     }
 
-    // null read is a query for trace buffer size
-    if (ptr == nullptr) {
-        return max;
+    if (pad) {
+        *(uint32_t*)(kc->buffer + pos) = 0;
+        kc->pad = head;
+        head += pad;
+        pos = 0;
+    } else if (pos == 0) {
+        kc->pad = head;
+    }
+
+    *headp = head + len;
+    return kc->buffer + pos;
+}
+
+static void ktrace_commit(ktrace_cpu_t* kc, uint64_t head) {
+    __atomic_store_n(&kc->head, head, __ATOMIC_RELEASE);
+}
+
+// Write a record stamped with |ts|, the header followed by as much of args
+// as KTRACE_LEN(tag) leaves room for.
+static bool ktrace_write(ktrace_state_t* ks, uint32_t tag, uint32_t tid,
+                         const uint32_t* args, size_t args_size, uint64_t ts) {
+    uint32_t len = KTRACE_LEN(tag);
+    if (args_size > len - KTRACE_HDRSIZE) {
+        args_size = len - KTRACE_HDRSIZE;
+    }
+
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    ktrace_cpu_t* kc = &ks->cpu[arch_curr_cpu_num()];
+    uint64_t head;
+    ktrace_header_t* hdr = (ktrace_header_t*)ktrace_reserve(ks, kc, len, &head);
+    if (hdr != nullptr) {
+        hdr->ts = ts;
+        hdr->tag = tag;
+        hdr->tid = tid;
+        memcpy(hdr + 1, args, args_size);
+        ktrace_commit(kc, head);
+    }
+
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+    return hdr != nullptr;
+}
+
+static void ktrace_reset_cpu(ktrace_cpu_t* kc) {
+    kc->head = 0;
+    kc->tail = 0;
+    kc->pad = 0;
+    kc->dropped = 0;
+}
+
+static void ktrace_reset_local_cpu(void* arg) {
+    ktrace_state_t* ks = (ktrace_state_t*)arg;
+    ktrace_reset_cpu(&ks->cpu[arch_curr_cpu_num()]);
+}
+
+// The trace is read back as the name and metadata records followed by a
+// section for each cpu, a TAG_CPU_BUFFER record then that cpu's records
+// oldest first. Outside of streaming mode, reads are served from a snapshot
+// of where each buffer's records were when the size was last queried, so a
+// reader can take the trace in pieces.
+struct ktrace_extent {
+    const void* data;
+    uint32_t len;
+};
+
+static mutex_t read_lock = MUTEX_INITIAL_VALUE(read_lock);
+
+static struct {
+    ktrace_extent extents[1 + SMP_MAX_CPUS * 3];
+    uint32_t count;
+    uint32_t size;
+    ktrace_rec_32b_t cpu_hdr[SMP_MAX_CPUS];
+} snapshot TA_GUARDED(read_lock);
+
+// how much of the name buffer a streaming reader has been given
+static uint32_t meta_read TA_GUARDED(read_lock);
+
+// the cpu a streaming reader starts from next, so that one busy cpu can't
+// keep the others from being read
+static uint32_t next_drain_cpu TA_GUARDED(read_lock);
+
+static uint32_t ktrace_meta_offset(ktrace_state_t* ks) {
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&ks->meta_lock, state);
+    uint32_t offset = ks->meta_offset;
+    spin_unlock_irqrestore(&ks->meta_lock, state);
+    return offset;
+}
+
+static void ktrace_cpu_header(ktrace_rec_32b_t* hdr, uint32_t cpu, uint32_t len, uint32_t dropped) {
+    hdr->tag = TAG_CPU_BUFFER;
+    hdr->tid = 0;
+    hdr->ts = 0;
+    hdr->a = cpu;
+    hdr->b = len;
+    hdr->c = dropped;
+    hdr->d = 0;
+}
+
+static void ktrace_add_extent(const void* data, uint32_t len) TA_REQ(read_lock) {
+    snapshot.extents[snapshot.count++] = {data, len};
+    snapshot.size += len;
+}
+
+// In ring mode the buffers should be stopped before they are read, or the
+// oldest records may be overwritten while they are being copied out.
+static void ktrace_take_snapshot(ktrace_state_t* ks) TA_REQ(read_lock) {
+    snapshot.count = 0;
+    snapshot.size = 0;
+
+    ktrace_add_extent(ks->meta_buffer, ktrace_meta_offset(ks));
+
+    const uint32_t mask = ks->cpu_bufsize - 1;
+    for (uint32_t cpu = 0; cpu < ks->num_cpus; cpu++) {
+        ktrace_cpu_t* kc = &ks->cpu[cpu];
+        uint64_t head = __atomic_load_n(&kc->head, __ATOMIC_ACQUIRE);
+        uint64_t tail = __atomic_load_n(&kc->tail, __ATOMIC_ACQUIRE);
+        if (head == tail) {
+            continue;
+        }
+
+        // the records are in two pieces if they wrap around, with the
+        // padding left at the end of the buffer between them
+        uint64_t lap = head & ~(uint64_t)mask;
+        uint32_t len = (uint32_t)(head - tail);
+        ktrace_rec_32b_t* hdr = &snapshot.cpu_hdr[cpu];
+        ktrace_add_extent(hdr, sizeof(*hdr));
+        if (tail < lap && head > lap) {
+            uint64_t pad = kc->pad;
+            len -= (uint32_t)(lap - pad);
+            ktrace_add_extent(kc->buffer + ((uint32_t)tail & mask), (uint32_t)(pad - tail));
+            ktrace_add_extent(kc->buffer, (uint32_t)(head - lap));
+        } else {
+            ktrace_add_extent(kc->buffer + ((uint32_t)tail & mask), len);
+        }
+        ktrace_cpu_header(hdr, cpu, len, kc->dropped);
     }
+}
 
+static int ktrace_read_snapshot(void* ptr, uint32_t off, uint32_t len) TA_REQ(read_lock) {
     // constrain read to available buffer
-    if (off >= max) {
+    if (off >= snapshot.size) {
         return 0;
     }
-    if (len > (max - off)) {
-        len = max - off;
+    if (len > (snapshot.size - off)) {
+        len = snapshot.size - off;
     }
 
-    if (arch_copy_to_user(ptr, ks->buffer + off, len) != MX_OK) {
-        return MX_ERR_INVALID_ARGS;
+    uint8_t* dst = (uint8_t*)ptr;
+    uint32_t left = len;
+    for (uint32_t i = 0; i < snapshot.count && left > 0; i++) {
+        const ktrace_extent* e = &snapshot.extents[i];
+        if (off >= e->len) {
+            off -= e->len;
+            continue;
+        }
+        uint32_t n = MIN(e->len - off, left);
+        if (arch_copy_to_user(dst, (const uint8_t*)e->data + off, n) != MX_OK) {
+            return MX_ERR_INVALID_ARGS;
+        }
+        dst += n;
+        left -= n;
+        off = 0;
     }
     return len;
 }
 
+// Hand whole records that haven't been read yet to a streaming reader, the
+// names first then each cpu's section in turn, and give the space they took
+// back to the writers.
+static int ktrace_drain(ktrace_state_t* ks, void* ptr, uint32_t len) TA_REQ(read_lock) {
+    const uint32_t mask = ks->cpu_bufsize - 1;
+    uint32_t meta_offset = ktrace_meta_offset(ks);
+
+    // null read is a query for how much is waiting
+    if (ptr == nullptr) {
+        uint32_t n = meta_offset - meta_read;
+        for (uint32_t cpu = 0; cpu < ks->num_cpus; cpu++) {
+            ktrace_cpu_t* kc = &ks->cpu[cpu];
+            uint64_t avail = __atomic_load_n(&kc->head, __ATOMIC_ACQUIRE) - kc->tail;
+            if (avail) {
+                n += (uint32_t)avail + KTRACE_RECSIZE;
+            }
+        }
+        return n;
+    }
+
+    uint8_t* dst = (uint8_t*)ptr;
+    uint32_t out = 0;
+
+    uint32_t meta_end = meta_read;
+    while (meta_end < meta_offset) {
+        uint32_t n = KTRACE_LEN(*(uint32_t*)(ks->meta_buffer + meta_end));
+        if (meta_end - meta_read + n > len) {
+            break;
+        }
+        meta_end += n;
+    }
+    if (meta_end > meta_read) {
+        if (arch_copy_to_user(dst, ks->meta_buffer + meta_read, meta_end - meta_read) != MX_OK) {
+            return MX_ERR_INVALID_ARGS;
+        }
+        out = meta_end - meta_read;
+        meta_read = meta_end;
+    }
+
+    for (uint32_t i = 0; i < ks->num_cpus; i++) {
+        uint32_t cpu = (next_drain_cpu + i) % ks->num_cpus;
+        ktrace_cpu_t* kc = &ks->cpu[cpu];
+        uint64_t head = __atomic_load_n(&kc->head, __ATOMIC_ACQUIRE);
+        uint64_t tail = kc->tail;
+        if (head == tail || out + KTRACE_RECSIZE >= len) {
+            continue;
+        }
+
+        // copy the records out in contiguous runs, leaving room for the
+        // section header in front of them
+        uint32_t start = out;
+        out += KTRACE_RECSIZE;
+        auto copy_run = [&](uint64_t from, uint64_t to) -> bool {
+            uint32_t n = (uint32_t)(to - from);
+            if (n && arch_copy_to_user(dst + out, kc->buffer + ((uint32_t)from & mask), n) != MX_OK) {
+                return false;
+            }
+            out += n;
+            return true;
+        };
+
+        uint64_t run = tail;
+        while (tail < head) {
+            uint32_t pos = (uint32_t)tail & mask;
+            uint32_t tag = *(uint32_t*)(kc->buffer + pos);
+            if (tag == 0) {
+                // padding, the next record is at the start of the buffer
+                if (!copy_run(run, tail)) {
+                    return MX_ERR_INVALID_ARGS;
+                }
+                tail += ks->cpu_bufsize - pos;
+                run = tail;
+                continue;
+            }
+            if (out + (tail - run) + KTRACE_LEN(tag) > len) {
+                break;
+            }
+            tail += KTRACE_LEN(tag);
+        }
+        if (!copy_run(run, tail)) {
+            return MX_ERR_INVALID_ARGS;
+        }
+
+        if (out == start + KTRACE_RECSIZE) {
+            // not even one record fit
+            out = start;
+            continue;
+        }
+        ktrace_rec_32b_t hdr;
+        ktrace_cpu_header(&hdr, cpu, out - start - KTRACE_RECSIZE, kc->dropped);
+        if (arch_copy_to_user(dst + start, &hdr, sizeof(hdr)) != MX_OK) {
+            return MX_ERR_INVALID_ARGS;
+        }
+        __atomic_store_n(&kc->tail, tail, __ATOMIC_RELEASE);
+    }
+    next_drain_cpu = (next_drain_cpu + 1) % ks->num_cpus;
+
+    return out;
+}
+
+int ktrace_read_user(void* ptr, uint32_t off, uint32_t len) {
+    ktrace_state_t* ks = &KTRACE_STATE;
+    if (ks->num_cpus == 0) {
+        return (ptr == nullptr || off == 0) ? 0 : MX_ERR_INVALID_ARGS;
+    }
+
+    int result;
+    mutex_acquire(&read_lock);
+    if (ks->mode == KTRACE_MODE_STREAM) {
+        result = ktrace_drain(ks, ptr, len);
+    } else {
+        if (ptr == nullptr || snapshot.count == 0) {
+            ktrace_take_snapshot(ks);
+        }
+        // null read is a query for trace buffer size
+        result = (ptr == nullptr) ? snapshot.size : ktrace_read_snapshot(ptr, off, len);
+    }
+    mutex_release(&read_lock);
+    return result;
+}
+
+static void ktrace_rewind(ktrace_state_t* ks) {
+    mutex_acquire(&read_lock);
+
+    // each cpu rewinds its own buffer, which it can't be in the middle of
+    // writing to since records are written with interrupts disabled
+    mp_sync_exec(MP_CPU_ALL, ktrace_reset_local_cpu, ks);
+    mp_cpu_mask_t online = mp_get_online_mask();
+    for (uint32_t cpu = 0; cpu < ks->num_cpus; cpu++) {
+        if (!(online & (1u << cpu))) {
+            ktrace_reset_cpu(&ks->cpu[cpu]);
+        }
+    }
+
+    // roll back to just after the metadata
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&ks->meta_lock, state);
+    ks->meta_offset = KTRACE_RECSIZE * 2;
+    spin_unlock_irqrestore(&ks->meta_lock, state);
+    meta_read = 0;
+    snapshot.count = 0;
+    snapshot.size = 0;
+
+    mutex_release(&read_lock);
+
+    ktrace_report_syscalls(kt_syscall_info);
+    ktrace_report_probes();
+}
+
 status_t ktrace_control(uint32_t action, uint32_t options, void* ptr) {
     ktrace_state_t* ks = &KTRACE_STATE;
     switch (action) {
     case KTRACE_ACTION_START:
         options = KTRACE_GRP_TO_MASK(options);
-        ks->marker = 0;
         atomic_store(&ks->grpmask, options ? options : KTRACE_GRP_TO_MASK(KTRACE_GRP_ALL));
         ktrace_report_live_processes();
         ktrace_report_live_threads();
         break;
-    case KTRACE_ACTION_STOP: {
+    case KTRACE_ACTION_STOP:
         atomic_store(&ks->grpmask, 0);
-        uint32_t n = ks->offset;
-        if (n > ks->bufsize) {
-            ks->marker = ks->bufsize;
-        } else {
-            ks->marker = n;
-        }
         break;
-    }
     case KTRACE_ACTION_REWIND:
-        // roll back to just after the metadata
-        atomic_store(&ks->offset, KTRACE_RECSIZE * 2);
-        ktrace_report_syscalls(kt_syscall_info);
-        ktrace_report_probes();
+        if (ks->num_cpus == 0) {
+            return MX_ERR_BAD_STATE;
+        }
+        ktrace_rewind(ks);
         break;
     case KTRACE_ACTION_NEW_PROBE: {
         ktrace_probe_info_t* probe;
@@ -177,10 +552,28 @@ status_t ktrace_control(uint32_t action, uint32_t options, void* ptr) {
         }
         probe->name = (const char*) (probe + 1);
         memcpy(probe + 1, ptr, MX_MAX_NAME_LEN);
-        ktrace_add_probe(probe);
+        status_t status = ktrace_add_probe(probe);
         mutex_release(&probe_list_lock);
+        if (status != MX_OK) {
+            free(probe);
+            return status;
+        }
         return probe->num;
     }
+    case KTRACE_ACTION_ENABLE_PROBE:
+        return ktrace_enable_probes((const char*) ptr, true);
+    case KTRACE_ACTION_DISABLE_PROBE:
+        return ktrace_enable_probes((const char*) ptr, false);
+    case KTRACE_ACTION_SET_MODE:
+        if (options > KTRACE_MODE_STREAM) {
+            return MX_ERR_INVALID_ARGS;
+        }
+        if (ks->num_cpus == 0 || atomic_load(&ks->grpmask) != 0) {
+            return MX_ERR_BAD_STATE;
+        }
+        ks->mode = options;
+        ktrace_rewind(ks);
+        break;
     default:
         return MX_ERR_INVALID_ARGS;
     }
@@ -189,6 +582,21 @@ status_t ktrace_control(uint32_t action, uint32_t options, void* ptr) {
 
 int trace_not_ready = 0;
 
+static uint32_t ktrace_mode_from_cmdline(void) {
+    const char* mode = cmdline_get("ktrace.mode");
+    if (mode == nullptr || !strcmp(mode, "oneshot")) {
+        return KTRACE_MODE_ONESHOT;
+    }
+    if (!strcmp(mode, "ring")) {
+        return KTRACE_MODE_RING;
+    }
+    if (!strcmp(mode, "stream")) {
+        return KTRACE_MODE_STREAM;
+    }
+    dprintf(INFO, "ktrace: unknown mode '%s'\n", mode);
+    return KTRACE_MODE_ONESHOT;
+}
+
 void ktrace_init(unsigned level) {
     ktrace_state_t* ks = &KTRACE_STATE;
 
@@ -203,40 +611,48 @@ void ktrace_init(unsigned level) {
     mb *= (1024*1024);
 
     status_t status;
+    uint8_t* buffer;
     VmAspace* aspace = VmAspace::kernel_aspace();
-    if ((status = aspace->Alloc("ktrace", mb, (void**)&ks->buffer, 0, VmAspace::VMM_FLAG_COMMIT,
+    if ((status = aspace->Alloc("ktrace", mb, (void**)&buffer, 0, VmAspace::VMM_FLAG_COMMIT,
                                 ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE)) < 0) {
         dprintf(INFO, "ktrace: cannot alloc buffer %d\n", status);
         return;
     }
 
-    // The last packet written can overhang the end of the buffer,
-    // so we reduce the reported size by the max size of a record
-    ks->bufsize = mb - 256;
-
-    dprintf(INFO, "ktrace: buffer at %p (%u bytes)\n", ks->buffer, mb);
-
-    // register all static probes
-    ktrace_probe_info_t *probe;
-    mutex_acquire(&probe_list_lock);
-    for (probe = __start_ktrace_probe; probe != __stop_ktrace_probe; probe++) {
-        ktrace_add_probe(probe);
+    // a sixteenth of the buffer holds names, the rest is split between the
+    // cpus in power of two pieces
+    uint32_t num_cpus = arch_max_num_cpus();
+    ks->meta_buffer = buffer;
+    ks->meta_bufsize = mb / 16;
+    ks->cpu_bufsize = 1u << log2_uint_floor((mb - ks->meta_bufsize) / num_cpus);
+    for (uint32_t cpu = 0; cpu < num_cpus; cpu++) {
+        ks->cpu[cpu].buffer = buffer + ks->meta_bufsize + cpu * ks->cpu_bufsize;
     }
-    mutex_release(&probe_list_lock);
+    ks->mode = ktrace_mode_from_cmdline();
+    ks->num_cpus = num_cpus;
+
+    dprintf(INFO, "ktrace: buffer at %p (%u bytes, %u per cpu)\n", buffer, mb, ks->cpu_bufsize);
 
     // write metadata to the first two event slots
     uint64_t n = ktrace_ticks_per_ms();
-    ktrace_rec_32b_t* rec = (ktrace_rec_32b_t*) ks->buffer;
+    ktrace_rec_32b_t* rec = (ktrace_rec_32b_t*) ks->meta_buffer;
     rec[0].tag = TAG_VERSION;
     rec[0].a = KTRACE_VERSION;
     rec[1].tag = TAG_TICKS_PER_MS;
     rec[1].a = (uint32_t)n;
     rec[1].b = (uint32_t)(n >> 32);
+    ks->meta_offset = KTRACE_RECSIZE * 2;
+
+    // register all static probes
+    ktrace_probe_info_t *probe;
+    mutex_acquire(&probe_list_lock);
+    for (probe = __start_ktrace_probe; probe != __stop_ktrace_probe; probe++) {
+        ktrace_add_probe(probe);
+    }
+    mutex_release(&probe_list_lock);
 
     // enable tracing
-    atomic_store(&ks->offset, KTRACE_RECSIZE * 2);
     ktrace_report_syscalls(kt_syscall_info);
-    ktrace_report_probes();
     atomic_store(&ks->grpmask, KTRACE_GRP_TO_MASK(grpmask));
 
     // report names of existing threads
@@ -247,37 +663,19 @@ void ktrace_tiny(uint32_t tag, uint32_t arg) {
     ktrace_state_t* ks = &KTRACE_STATE;
     if (tag & atomic_load(&ks->grpmask)) {
         tag = (tag & 0xFFFFFFF0) | 2;
-        int off;
-        if ((off = atomic_add(&ks->offset, KTRACE_HDRSIZE)) >= (int)ks->bufsize) {
-            // if we arrive at the end, stop
-            atomic_store(&ks->grpmask, 0);
-        } else {
-            ktrace_header_t* hdr = (ktrace_header_t*) (ks->buffer + off);
-            hdr->ts = ktrace_timestamp();
-            hdr->tag = tag;
-            hdr->tid = arg;
-        }
+        ktrace_write(ks, tag, arg, nullptr, 0, ktrace_timestamp());
     }
 }
 
-void* ktrace_open(uint32_t tag) {
+bool ktrace_record(uint32_t tag, uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
     ktrace_state_t* ks = &KTRACE_STATE;
     if (!(tag & atomic_load(&ks->grpmask))) {
-        return nullptr;
+        return false;
     }
 
-    int off;
-    if ((off = atomic_add(&ks->offset, KTRACE_LEN(tag))) >= (int)ks->bufsize) {
-        // if we arrive at the end, stop
-        atomic_store(&ks->grpmask, 0);
-        return nullptr;
-    }
-
-    ktrace_header_t* hdr = (ktrace_header_t*) (ks->buffer + off);
-    hdr->ts = ktrace_timestamp();
-    hdr->tag = tag;
-    hdr->tid = (uint32_t)get_current_thread()->user_tid;
-    return hdr + 1;
+    uint32_t args[4] = {a, b, c, d};
+    return ktrace_write(ks, tag, (uint32_t)get_current_thread()->user_tid, args, sizeof(args),
+                        ktrace_timestamp());
 }
 
 static void ktrace_name_etc(uint32_t tag, uint32_t id, uint32_t arg, const char* name, bool always) {
@@ -288,18 +686,19 @@ static void ktrace_name_etc(uint32_t tag, uint32_t id, uint32_t arg, const char*
         // set size to: sizeof(hdr) + len + 1, round up to multiple of 8
         tag = (tag & 0xFFFFFFF0) | ((KTRACE_NAMESIZE + len + 1 + 7) >> 3);
 
-        int off;
-        if ((off = atomic_add(&ks->offset, KTRACE_LEN(tag))) >= (int)ks->bufsize) {
-            // if we arrive at the end, stop
-            atomic_store(&ks->grpmask, 0);
-        } else {
-            ktrace_rec_name_t* rec = (ktrace_rec_name_t*) (ks->buffer + off);
+        // names that don't fit are dropped, they don't stop the trace
+        spin_lock_saved_state_t state;
+        spin_lock_irqsave(&ks->meta_lock, state);
+        if (ks->meta_offset + KTRACE_LEN(tag) <= ks->meta_bufsize) {
+            ktrace_rec_name_t* rec = (ktrace_rec_name_t*) (ks->meta_buffer + ks->meta_offset);
             rec->tag = tag;
             rec->id = id;
             rec->arg = arg;
             memcpy(rec->name, name, len);
             rec->name[len] = 0;
+            ks->meta_offset += KTRACE_LEN(tag);
         }
+        spin_unlock_irqrestore(&ks->meta_lock, state);
     }
 }
 
@@ -307,4 +706,38 @@ void ktrace_name(uint32_t tag, uint32_t id, uint32_t arg, const char* name) {
     ktrace_name_etc(tag, id, arg, name, false);
 }
 
-LK_INIT_HOOK(ktrace, ktrace_init, LK_INIT_LEVEL_APPS - 1);
+// Most of kernel init is over before tracing is up, so once it is all over
+// each hook's timing goes in as a "boot:init:<hook>" probe, at the time the
+// hook returned: arg0 is how long it ran in microseconds, arg1 its level.
+static void ktrace_report_init(uint level) {
+    ktrace_state_t* ks = &KTRACE_STATE;
+    if (ks->num_cpus == 0) {
+        return;
+    }
+
+    uint64_t ticks_per_ms = ktrace_ticks_per_ms();
+    const struct lk_init_timing* timings;
+    size_t count = lk_init_timings(&timings);
+    for (size_t n = 0; n < count; n++) {
+        const struct lk_init_timing* t = &timings[n];
+        char name[MX_MAX_NAME_LEN] = {};
+        snprintf(name, sizeof(name), "boot:init:%s", t->hook->name);
+        status_t num = ktrace_control(KTRACE_ACTION_NEW_PROBE, 0, name);
+        if (num < 0) {
+            break;
+        }
+        uint32_t tag = TAG_PROBE_24(num);
+        if (!(tag & atomic_load(&ks->grpmask)) || !ktrace_probe_is_enabled(num)) {
+            continue;
+        }
+        uint32_t args[2] = {
+            (uint32_t)((t->end - t->start) * 1000 / ticks_per_ms),
+            t->hook->level,
+        };
+        ktrace_write(ks, tag, 0, args, sizeof(args), t->end);
+    }
+}
+
+// ahead of userboot, so the probes it makes are named in the trace
+LK_INIT_HOOK(ktrace, ktrace_init, LK_INIT_LEVEL_APPS - 2);
+LK_INIT_HOOK(ktrace_boot, ktrace_report_init, LK_INIT_LEVEL_LAST);
@@ -13,6 +13,7 @@
 #include <trace.h>
 
 #include <kernel/event.h>
+#include <kernel/thread.h>
 #include <platform.h>
 
 #include <magenta/handle.h>
@@ -25,6 +26,8 @@
 #include <mxalloc/new.h>
 #include <mxtl/type_support.h>
 
+OBJECT_CACHE(ChannelDispatcher, "channel");
+
 #define LOCAL_TRACE 0
 
 // static
@@ -220,12 +223,18 @@ status_t ChannelDispatcher::Call(mxtl::unique_ptr<MessagePacket> msg,
         waiters_.push_back(waiter);
     }
 
-    // (1) Write outbound message to opposing endpoint.
+    // (1) Write outbound message to opposing endpoint. We are about to
+    // block waiting for the reply, so the server thread this wakes can
+    // have our cpu and the rest of our time slice. Should the reply be
+    // there already and we not block, it's sent elsewhere after all.
+    thread_sync_wakeup_begin();
     other->WriteSelf(mxtl::move(msg));
 
     // Reuse the code from the half-call used for retrying a Call after thread
     // suspend.
-    return ResumeInterruptedCall(deadline, reply);
+    status_t status = ResumeInterruptedCall(deadline, reply);
+    thread_sync_wakeup_end();
+    return status;
 }
 
 status_t ChannelDispatcher::ResumeInterruptedCall(mx_time_t deadline,
@@ -17,6 +17,7 @@
 
 #include <magenta/job_dispatcher.h>
 #include <magenta/magenta.h>
+#include <magenta/message_packet.h>
 #include <magenta/process_dispatcher.h>
 #include <magenta/vm_object_dispatcher.h>
 
@@ -73,7 +74,7 @@ static char StateChar(const ProcessDispatcher& pd) {
 }
 
 static const char* ObjectTypeToString(mx_obj_type_t type) {
-    static_assert(MX_OBJ_TYPE_LAST == 24, "need to update switch below");
+    static_assert(MX_OBJ_TYPE_LAST == 25, "need to update switch below");
 
     switch (type) {
         case MX_OBJ_TYPE_PROCESS: return "process";
@@ -97,6 +98,7 @@ static const char* ObjectTypeToString(mx_obj_type_t type) {
         case MX_OBJ_TYPE_HYPERVISOR: return "hypervisor";
         case MX_OBJ_TYPE_GUEST: return "guest";
         case MX_OBJ_TYPE_TIMER: return "timer";
+        case MX_OBJ_TYPE_VCPU: return "vcpu";
         default: return "???";
     }
 }
@@ -777,6 +779,12 @@ static void DumpHandleTable() {
     internal::DumpHandleTableInfo();
 }
 
+static void DumpMessagePacketStats() {
+    size_t packets, bytes;
+    MessagePacket::GetStats(&packets, &bytes);
+    printf("outstanding message packets: %zu, %zu bytes\n", packets, bytes);
+}
+
 static size_t mwd_limit = 32 * 256;
 static bool mwd_running;
 
@@ -843,6 +851,7 @@ static int cmd_diagnostics(int argc, const cmd_args* argv, uint32_t flags) {
         printf("%s asd  <pid>|kernel : dump process/kernel address space\n",
                argv[0].str);
         printf("%s htinfo            : handle table info\n", argv[0].str);
+        printf("%s msgs              : channel message packet info\n", argv[0].str);
         return -1;
     }
 
@@ -913,6 +922,10 @@ static int cmd_diagnostics(int argc, const cmd_args* argv, uint32_t flags) {
         if (argc != 2)
             goto usage;
         DumpHandleTable();
+    } else if (strcmp(argv[1].str, "msgs") == 0) {
+        if (argc != 2)
+            goto usage;
+        DumpMessagePacketStats();
     } else {
         printf("unrecognized subcommand '%s'\n", argv[1].str);
         goto usage;
@@ -12,6 +12,8 @@
 #include <magenta/state_tracker.h>
 #include <mxalloc/new.h>
 
+OBJECT_CACHE(EventDispatcher, "event");
+
 constexpr uint32_t kUserSignalMask = MX_EVENT_SIGNALED | MX_USER_SIGNAL_ALL;
 
 status_t EventDispatcher::Create(uint32_t options, mxtl::RefPtr<Dispatcher>* dispatcher,
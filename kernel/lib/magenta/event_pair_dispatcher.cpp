@@ -14,6 +14,8 @@
 #include <magenta/state_tracker.h>
 #include <mxalloc/new.h>
 
+OBJECT_CACHE(EventPairDispatcher, "eventpair");
+
 constexpr uint32_t kUserSignalMask = MX_EVENT_SIGNALED | MX_USER_SIGNAL_ALL;
 
 status_t EventPairDispatcher::Create(mxtl::RefPtr<Dispatcher>* dispatcher0,
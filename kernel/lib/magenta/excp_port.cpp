@@ -40,9 +40,11 @@ static IOP_Packet* MakePacket(uint64_t key, const mx_exception_report_t* report,
 
 // static
 mx_status_t ExceptionPort::Create(Type type, mxtl::RefPtr<PortDispatcher> port, uint64_t port_key,
+                                  bool async_thread_events,
                                   mxtl::RefPtr<ExceptionPort>* out_eport) {
     AllocChecker ac;
-    auto eport = new (&ac) ExceptionPort(type, mxtl::move(port), port_key);
+    auto eport = new (&ac) ExceptionPort(type, mxtl::move(port), port_key,
+                                         async_thread_events);
     if (!ac.check())
         return MX_ERR_NO_MEMORY;
 
@@ -52,8 +54,9 @@ mx_status_t ExceptionPort::Create(Type type, mxtl::RefPtr<PortDispatcher> port,
     return MX_OK;
 }
 
-ExceptionPort::ExceptionPort(Type type, mxtl::RefPtr<PortDispatcher> port, uint64_t port_key)
-    : type_(type), port_key_(port_key), port_(port) {
+ExceptionPort::ExceptionPort(Type type, mxtl::RefPtr<PortDispatcher> port, uint64_t port_key,
+                             bool async_thread_events)
+    : type_(type), port_key_(port_key), async_thread_events_(async_thread_events), port_(port) {
     LTRACE_ENTRY_OBJ;
     DEBUG_ASSERT(port_ != nullptr);
     port_->LinkExceptionPort(this);
@@ -194,6 +197,7 @@ void ExceptionPort::OnTargetUnbind() {
         // so don't require that we're bound.
         bound_to_system_ = false;
         target_.reset();
+        handler_.reset();
     }
     // It should actually be safe to hold our lock while calling into
     // the PortDispatcher, but there's no reason to.
@@ -226,6 +230,22 @@ mx_status_t ExceptionPort::SendReport(const mx_exception_report_t* report) {
     return port_->Queue(iopk);
 }
 
+void ExceptionPort::SetHandler(mxtl::RefPtr<UserThread> handler) {
+    canary_.Assert();
+
+    AutoLock lock(&lock_);
+    // Once unbound, nothing will clear it again.
+    if (port_ != nullptr)
+        handler_ = mxtl::move(handler);
+}
+
+mxtl::RefPtr<UserThread> ExceptionPort::handler() {
+    canary_.Assert();
+
+    AutoLock lock(&lock_);
+    return handler_;
+}
+
 void ExceptionPort::BuildReport(mx_exception_report_t* report, uint32_t type,
                                 mx_koid_t pid, mx_koid_t tid) {
     memset(report, 0, sizeof(*report));
@@ -253,6 +273,11 @@ void ExceptionPort::OnThreadStart(UserThread* thread) {
     LTRACEF("thread %" PRIu64 ".%" PRIu64 " started\n", pid, tid);
     mx_exception_report_t report;
     BuildReport(&report, MX_EXCP_THREAD_STARTING, pid, tid);
+    if (async_thread_events_) {
+        // The result is ignored, the thread runs either way.
+        SendReport(&report);
+        return;
+    }
     arch_exception_context_t context;
     // There is no iframe at the moment. We'll need one (or equivalent) if/when
     // we want to make $pc, $sp available.
@@ -342,6 +367,11 @@ void ExceptionPort::OnThreadExitForDebugger(UserThread* thread) {
     LTRACEF("thread %" PRIu64 ".%" PRIu64 " exited\n", pid, tid);
     mx_exception_report_t report;
     BuildReport(&report, MX_EXCP_THREAD_EXITING, pid, tid);
+    if (async_thread_events_) {
+        // The result is ignored, we still want the thread to continue exiting.
+        SendReport(&report);
+        return;
+    }
     arch_exception_context_t context;
     // There is no iframe at the moment. We'll need one (or equivalent) if/when
     // we want to make $pc, $sp available.
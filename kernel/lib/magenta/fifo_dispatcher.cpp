@@ -13,6 +13,8 @@
 #include <magenta/rights.h>
 #include <mxalloc/new.h>
 
+OBJECT_CACHE(FifoDispatcher, "fifo");
+
 // static
 status_t FifoDispatcher::Create(uint32_t count, uint32_t elemsize, uint32_t options,
                                 mxtl::RefPtr<Dispatcher>* dispatcher0,
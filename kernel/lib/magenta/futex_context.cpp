@@ -24,10 +24,55 @@ FutexContext::~FutexContext() {
 
     // All of the threads should have removed themselves from wait queues
     // by the time the process has exited.
-    DEBUG_ASSERT(futex_table_.is_empty());
+    for (auto& bucket : buckets_) {
+        AutoLock lock(&bucket.lock);
+        DEBUG_ASSERT(bucket.table.is_empty());
+    }
+}
+
+FutexContext::Bucket* FutexContext::BucketFor(uintptr_t futex_key) {
+    // Futexes are ints, often packed together or a fixed stride apart, so
+    // mix all of the bits of the address rather than taking the low ones.
+    uint64_t hash = static_cast<uint64_t>(futex_key >> 2) * 0x9e3779b97f4a7c15ull;
+    return &buckets_[hash >> (64 - kNumBucketsShift)];
+}
+
+FutexContext::Bucket* FutexContext::LockNodeBucket(FutexNode* node) TA_NO_THREAD_SAFETY_ANALYSIS {
+    // The key only changes with the locks of the buckets of both the old and
+    // the new key held, so once it is seen to be the same with one of them
+    // held it stays that way.
+    for (;;) {
+        uintptr_t futex_key = node->GetKey();
+        Bucket* bucket = BucketFor(futex_key);
+        bucket->lock.Acquire();
+        if (node->GetKey() == futex_key)
+            return bucket;
+        bucket->lock.Release();
+    }
 }
 
-status_t FutexContext::FutexWait(user_ptr<int> value_ptr, int current_value, mx_time_t deadline) {
+// Two buckets are locked in address order, so that two requeues going
+// opposite ways between them can't deadlock.
+void FutexContext::LockBuckets(Bucket* a, Bucket* b) TA_NO_THREAD_SAFETY_ANALYSIS {
+    if (a == b) {
+        a->lock.Acquire();
+    } else if (a < b) {
+        a->lock.Acquire();
+        b->lock.Acquire();
+    } else {
+        b->lock.Acquire();
+        a->lock.Acquire();
+    }
+}
+
+void FutexContext::UnlockBuckets(Bucket* a, Bucket* b) TA_NO_THREAD_SAFETY_ANALYSIS {
+    a->lock.Release();
+    if (a != b)
+        b->lock.Release();
+}
+
+status_t FutexContext::FutexWait(user_ptr<int> value_ptr, int current_value, thread_t* owner,
+                                 mx_time_t deadline) TA_NO_THREAD_SAFETY_ANALYSIS {
     LTRACE_ENTRY;
 
     uintptr_t futex_key = reinterpret_cast<uintptr_t>(value_ptr.get());
@@ -42,16 +87,17 @@ status_t FutexContext::FutexWait(user_ptr<int> value_ptr, int current_value, mx_
     // If a FutexWake() operation could occur between them, a userland mutex
     // operation built on top of futexes would have a race condition that
     // could miss wakeups.
-    lock_.Acquire();
+    Bucket* bucket = BucketFor(futex_key);
+    bucket->lock.Acquire();
 
     int value;
     status_t result = value_ptr.copy_from_user(&value);
     if (result != MX_OK) {
-        lock_.Release();
+        bucket->lock.Release();
         return result;
     }
     if (value != current_value) {
-        lock_.Release();
+        bucket->lock.Release();
         return MX_ERR_BAD_STATE;
     }
 
@@ -60,18 +106,22 @@ status_t FutexContext::FutexWait(user_ptr<int> value_ptr, int current_value, mx_
     node->set_hash_key(futex_key);
     node->SetAsSingletonList();
 
-    QueueNodesLocked(node);
+    QueueNodesLocked(bucket, node);
+
+    // Block current thread.  This releases the bucket lock and does not reacquire it.
+    result = node->BlockThread(&bucket->lock, owner, deadline);
+
+    // We may have been requeued onto a futex in another bucket while we slept.
+    bucket = LockNodeBucket(node);
 
-    // Block current thread.  This releases lock_ and does not reacquire it.
-    result = node->BlockThread(&lock_, deadline);
     if (result == MX_OK) {
         // Fix/workaround for MG-624:
         // We must re-acquire the lock here to force this thread to wait until
         // the WakeThreads() marks this thread as not in the queue anymore.
         // Otherwise, this thread can exit before it does that, causing
         // WakeThreads() to scribble on memory.
-        AutoLock lock(&lock_);
         DEBUG_ASSERT(!node->IsInQueue());
+        bucket->lock.Release();
         // All the work necessary for removing us from the hash table was done by FutexWake()
         return MX_OK;
     }
@@ -82,8 +132,9 @@ status_t FutexContext::FutexWait(user_ptr<int> value_ptr, int current_value, mx_
     //
     // We need to ensure that the thread's node is removed from the wait
     // queue, because FutexWake() probably didn't do that.
-    AutoLock lock(&lock_);
-    if (UnqueueNodeLocked(node)) {
+    bool unqueued = UnqueueNodeLocked(bucket, node);
+    bucket->lock.Release();
+    if (unqueued) {
         return result;
     }
     // The current thread was not found on the wait queue.  This means
@@ -118,9 +169,10 @@ status_t FutexContext::FutexWake(user_ptr<const int> value_ptr,
     if (futex_key % sizeof(int))
         return MX_ERR_INVALID_ARGS;
 
-    AutoLock lock(&lock_);
+    Bucket* bucket = BucketFor(futex_key);
+    AutoLock lock(&bucket->lock);
 
-    FutexNode* node = futex_table_.erase(futex_key);
+    FutexNode* node = bucket->table.erase(futex_key);
     if (!node) {
         // nothing blocked on this futex if we can't find it
         return MX_OK;
@@ -128,12 +180,15 @@ status_t FutexContext::FutexWake(user_ptr<const int> value_ptr,
     DEBUG_ASSERT(node->GetKey() == futex_key);
 
     FutexNode* wake_head = node;
-    node = FutexNode::RemoveFromHead(node, count, futex_key, 0u);
+    // The woken threads keep their key, it leads them to this bucket's lock
+    // and so to wait for WakeThreads() below to be done with them.
+    node = FutexNode::RemoveFromHead(node, count, futex_key, futex_key);
     // node is now the new blocked thread list head
 
     if (node != nullptr) {
         DEBUG_ASSERT(node->GetKey() == futex_key);
-        futex_table_.insert(node);
+        bucket->table.insert(node);
+        FutexNode::HandOff(wake_head, node);
     }
 
     // Traversing this list of threads must be done while holding the
@@ -146,31 +201,42 @@ status_t FutexContext::FutexWake(user_ptr<const int> value_ptr,
 }
 
 status_t FutexContext::FutexRequeue(user_ptr<int> wake_ptr, uint32_t wake_count, int current_value,
-                                    user_ptr<int> requeue_ptr, uint32_t requeue_count) {
+                                    user_ptr<int> requeue_ptr, uint32_t requeue_count)
+                                    TA_NO_THREAD_SAFETY_ANALYSIS {
     LTRACE_ENTRY;
 
     if ((requeue_ptr.get() == nullptr) && requeue_count)
         return MX_ERR_INVALID_ARGS;
 
-    AutoLock lock(&lock_);
-
-    int value;
-    status_t result = wake_ptr.copy_from_user(&value);
-    if (result != MX_OK) return result;
-    if (value != current_value) return MX_ERR_BAD_STATE;
-
     uintptr_t wake_key = reinterpret_cast<uintptr_t>(wake_ptr.get());
     uintptr_t requeue_key = reinterpret_cast<uintptr_t>(requeue_ptr.get());
     if (wake_key == requeue_key) return MX_ERR_INVALID_ARGS;
     if (wake_key % sizeof(int) || requeue_key % sizeof(int))
         return MX_ERR_INVALID_ARGS;
 
+    // Only the buckets of the two futexes are locked.
+    Bucket* wake_bucket = BucketFor(wake_key);
+    Bucket* requeue_bucket = BucketFor(requeue_key);
+    LockBuckets(wake_bucket, requeue_bucket);
+
+    int value;
+    status_t result = wake_ptr.copy_from_user(&value);
+    if (result != MX_OK) {
+        UnlockBuckets(wake_bucket, requeue_bucket);
+        return result;
+    }
+    if (value != current_value) {
+        UnlockBuckets(wake_bucket, requeue_bucket);
+        return MX_ERR_BAD_STATE;
+    }
+
     // This must happen before RemoveFromHead() calls set_hash_key() on
-    // nodes below, because operations on futex_table_ look at the GetKey
+    // nodes below, because operations on the bucket tables look at the GetKey
     // field of the list head nodes for wake_key and requeue_key.
-    FutexNode* node = futex_table_.erase(wake_key);
+    FutexNode* node = wake_bucket->table.erase(wake_key);
     if (!node) {
         // nothing blocked on this futex if we can't find it
+        UnlockBuckets(wake_bucket, requeue_bucket);
         return MX_OK;
     }
 
@@ -179,7 +245,7 @@ status_t FutexContext::FutexRequeue(user_ptr<int> wake_ptr, uint32_t wake_count,
         wake_head = nullptr;
     } else {
         wake_head = node;
-        node = FutexNode::RemoveFromHead(node, wake_count, wake_key, 0u);
+        node = FutexNode::RemoveFromHead(node, wake_count, wake_key, wake_key);
     }
 
     // node is now the head of wake_ptr futex after possibly removing some threads to wake
@@ -190,24 +256,28 @@ status_t FutexContext::FutexRequeue(user_ptr<int> wake_ptr, uint32_t wake_count,
             node = FutexNode::RemoveFromHead(node, requeue_count,
                                              wake_key, requeue_key);
 
-            // now requeue our nodes to requeue_ptr mutex
+            // now requeue our nodes to requeue_ptr mutex, whoever they were
+            // waiting on does not have anything to do with that one
             DEBUG_ASSERT(requeue_head->GetKey() == requeue_key);
-            QueueNodesLocked(requeue_head);
+            FutexNode::HandOff(nullptr, requeue_head);
+            QueueNodesLocked(requeue_bucket, requeue_head);
         }
     }
 
     // add any remaining nodes back to wake_key futex
     if (node != nullptr) {
         DEBUG_ASSERT(node->GetKey() == wake_key);
-        futex_table_.insert(node);
+        wake_bucket->table.insert(node);
+        FutexNode::HandOff(wake_head, node);
     }
 
     FutexNode::WakeThreads(wake_head);
+    UnlockBuckets(wake_bucket, requeue_bucket);
     return MX_OK;
 }
 
-void FutexContext::QueueNodesLocked(FutexNode* head) {
-    DEBUG_ASSERT(lock_.IsHeld());
+void FutexContext::QueueNodesLocked(Bucket* bucket, FutexNode* head) {
+    DEBUG_ASSERT(bucket->lock.IsHeld());
 
     FutexNode::HashTable::iterator iter;
 
@@ -215,15 +285,15 @@ void FutexContext::QueueNodesLocked(FutexNode* head) {
     // succeeds, then the current thread is first to block on this futex and we
     // are finished.  If the insert fails, then there is already a thread
     // waiting on this futex.  Add ourselves to that thread's list.
-    if (!futex_table_.insert_or_find(head, &iter))
+    if (!bucket->table.insert_or_find(head, &iter))
         iter->AppendList(head);
 }
 
 // This attempts to unqueue a thread (which may or may not be waiting on a
 // futex), given its FutexNode.  This returns whether the FutexNode was
 // found and removed from a futex wait queue.
-bool FutexContext::UnqueueNodeLocked(FutexNode* node) {
-    DEBUG_ASSERT(lock_.IsHeld());
+bool FutexContext::UnqueueNodeLocked(Bucket* bucket, FutexNode* node) {
+    DEBUG_ASSERT(bucket->lock.IsHeld());
 
     if (!node->IsInQueue())
         return false;
@@ -234,10 +304,12 @@ bool FutexContext::UnqueueNodeLocked(FutexNode* node) {
     // FutexRequeue(), so we need to re-get the hash table key here.
     uintptr_t futex_key = node->GetKey();
 
-    FutexNode* old_head = futex_table_.erase(futex_key);
+    DEBUG_ASSERT(BucketFor(futex_key) == bucket);
+
+    FutexNode* old_head = bucket->table.erase(futex_key);
     DEBUG_ASSERT(old_head);
     FutexNode* new_head = FutexNode::RemoveNodeFromList(old_head, node);
     if (new_head)
-        futex_table_.insert(new_head);
+        bucket->table.insert(new_head);
     return true;
 }
@@ -16,7 +16,7 @@
 FutexNode::FutexNode() {
     LTRACE_ENTRY;
 
-    wait_queue_ = WAIT_QUEUE_INITIAL_VALUE(wait_queue_);
+    wait_queue_ = OWNED_WAIT_QUEUE_INITIAL_VALUE(wait_queue_);
 }
 
 FutexNode::~FutexNode() {
@@ -25,7 +25,7 @@ FutexNode::~FutexNode() {
     DEBUG_ASSERT(!IsInQueue());
 
     THREAD_LOCK(state);
-    wait_queue_destroy(&wait_queue_);
+    owned_wait_queue_destroy(&wait_queue_);
     THREAD_UNLOCK(state);
 }
 
@@ -105,7 +105,8 @@ FutexNode* FutexNode::RemoveFromHead(FutexNode* list_head, uint32_t count,
 // This blocks the current thread.  This releases the given mutex (which
 // must be held when BlockThread() is called).  To reduce contention, it
 // does not reclaim the mutex on return.
-status_t FutexNode::BlockThread(Mutex* mutex, mx_time_t deadline) TA_NO_THREAD_SAFETY_ANALYSIS {
+status_t FutexNode::BlockThread(Mutex* mutex, thread_t* owner,
+                                mx_time_t deadline) TA_NO_THREAD_SAFETY_ANALYSIS {
     THREAD_LOCK(state);
 
     // We specifically want reschedule=false here, otherwise the
@@ -119,9 +120,12 @@ status_t FutexNode::BlockThread(Mutex* mutex, mx_time_t deadline) TA_NO_THREAD_S
     thread_t* current_thread = get_current_thread();
     status_t result;
     current_thread->interruptable = true;
-    result = wait_queue_block(&wait_queue_, deadline);
+    result = owned_wait_queue_block(&wait_queue_, owner, deadline);
     current_thread->interruptable = false;
 
+    // However we stopped waiting, whoever we were waiting on is done with us.
+    owned_wait_queue_set_owner(&wait_queue_, nullptr);
+
     THREAD_UNLOCK(state);
 
     return result;
@@ -134,13 +138,31 @@ void FutexNode::WakeThreads(FutexNode* head) {
     do {
         FutexNode* next = node->queue_next_;
         THREAD_LOCK(state);
-        wait_queue_wake_one(&node->wait_queue_, true, MX_OK);
+        wait_queue_wake_one(&node->wait_queue_.wait, true, MX_OK);
         THREAD_UNLOCK(state);
         node->MarkAsNotInQueue();
         node = next;
     } while (node != head);
 }
 
+void FutexNode::HandOff(FutexNode* woken, FutexNode* remaining) {
+    if (!remaining)
+        return;
+
+    THREAD_LOCK(state);
+    // The woken thread may have already stopped waiting on its own.
+    thread_t* owner = woken ? list_peek_head_type(&woken->wait_queue_.wait.list,
+                                                  thread_t, queue_node)
+                            : nullptr;
+    FutexNode* node = remaining;
+    do {
+        if (node->wait_queue_.owner)
+            owned_wait_queue_set_owner(&node->wait_queue_, owner);
+        node = node->queue_next_;
+    } while (node != remaining);
+    THREAD_UNLOCK(state);
+}
+
 // Set |node1| and |node2|'s list pointers so that |node1| is immediately
 // before |node2| in the linked list.
 void FutexNode::RelinkAsAdjacent(FutexNode* node1, FutexNode* node2) {
@@ -5,12 +5,15 @@
 // https://opensource.org/licenses/MIT
 
 #include <kernel/vm/vm_object.h>
+#include <magenta/event_dispatcher.h>
 #include <magenta/fifo_dispatcher.h>
 #include <magenta/guest_dispatcher.h>
 #include <magenta/hypervisor_dispatcher.h>
 #include <magenta/rights.h>
 #include <mxalloc/new.h>
 
+OBJECT_CACHE(GuestDispatcher, "guest");
+
 // static
 mx_status_t GuestDispatcher::Create(mxtl::RefPtr<HypervisorDispatcher> hypervisor,
                                     mxtl::RefPtr<VmObject> phys_mem,
@@ -38,10 +41,16 @@ GuestDispatcher::GuestDispatcher(mxtl::RefPtr<HypervisorDispatcher> hypervisor,
 
 GuestDispatcher::~GuestDispatcher() {}
 
-mx_status_t GuestDispatcher::Enter() {
+mx_status_t GuestDispatcher::CreateVcpu(mxtl::RefPtr<FifoDispatcher> ctl_fifo, uint32_t* vcpu) {
+    canary_.Assert();
+
+    return arch_guest_create_vcpu(context_, ctl_fifo, vcpu);
+}
+
+mx_status_t GuestDispatcher::Enter(uint32_t vcpu) {
     canary_.Assert();
 
-    return arch_guest_enter(context_);
+    return arch_guest_enter(context_, vcpu);
 }
 
 mx_status_t GuestDispatcher::MemTrap(mx_vaddr_t guest_paddr, size_t size) {
@@ -50,42 +59,62 @@ mx_status_t GuestDispatcher::MemTrap(mx_vaddr_t guest_paddr, size_t size) {
     return arch_guest_mem_trap(context_, guest_paddr, size);
 }
 
-mx_status_t GuestDispatcher::Interrupt(uint8_t interrupt) {
+mx_status_t GuestDispatcher::Interrupt(uint32_t vcpu, uint8_t interrupt) {
     canary_.Assert();
 
-    return arch_guest_interrupt(context_, interrupt);
+    return arch_guest_interrupt(context_, vcpu, interrupt);
 }
 
-mx_status_t GuestDispatcher::SetGpr(const mx_guest_gpr_t& guest_gpr) {
+mx_status_t GuestDispatcher::SetGpr(uint32_t vcpu, const mx_guest_gpr_t& guest_gpr) {
     canary_.Assert();
 
-    return arch_guest_set_gpr(context_, guest_gpr);
+    return arch_guest_set_gpr(context_, vcpu, guest_gpr);
 }
 
-mx_status_t GuestDispatcher::GetGpr(mx_guest_gpr_t* guest_gpr) const {
+mx_status_t GuestDispatcher::GetGpr(uint32_t vcpu, mx_guest_gpr_t* guest_gpr) const {
     canary_.Assert();
 
-    return arch_guest_get_gpr(context_, guest_gpr);
+    return arch_guest_get_gpr(context_, vcpu, guest_gpr);
 }
 
 #if ARCH_X86_64
-mx_status_t GuestDispatcher::SetApicMem(mxtl::RefPtr<VmObject> apic_mem) {
+mx_status_t GuestDispatcher::SetApicMem(uint32_t vcpu, mxtl::RefPtr<VmObject> apic_mem) {
+    canary_.Assert();
+
+    return x86_guest_set_apic_mem(context_, vcpu, apic_mem);
+}
+
+mx_status_t GuestDispatcher::SetBell(uint32_t kind, uint64_t addr, uint64_t len,
+                                     mxtl::RefPtr<EventDispatcher> event) {
+    canary_.Assert();
+
+    return x86_guest_set_bell(context_, kind, addr, len, mxtl::move(event));
+}
+
+mx_status_t GuestDispatcher::SetInterruptEvent(uint8_t interrupt,
+                                               mxtl::RefPtr<EventDispatcher> event) {
+    canary_.Assert();
+
+    return x86_guest_set_interrupt_event(context_, interrupt, mxtl::move(event));
+}
+
+mx_status_t GuestDispatcher::GetExitStats(uint32_t vcpu, mx_guest_exit_stats_t* exit_stats) const {
     canary_.Assert();
 
-    return x86_guest_set_apic_mem(context_, apic_mem);
+    return x86_guest_get_exit_stats(context_, vcpu, exit_stats);
 }
 #endif // ARCH_X86_64
 
-mx_status_t GuestDispatcher::set_ip(uintptr_t guest_ip) {
+mx_status_t GuestDispatcher::set_ip(uint32_t vcpu, uintptr_t guest_ip) {
     canary_.Assert();
 
-    return arch_guest_set_ip(context_, guest_ip);
+    return arch_guest_set_ip(context_, vcpu, guest_ip);
 }
 
 #if ARCH_X86_64
-mx_status_t GuestDispatcher::set_cr3(uintptr_t guest_cr3) {
+mx_status_t GuestDispatcher::set_cr3(uint32_t vcpu, uintptr_t guest_cr3) {
     canary_.Assert();
 
-    return x86_guest_set_cr3(context_, guest_cr3);
+    return x86_guest_set_cr3(context_, vcpu, guest_cr3);
 }
 #endif // ARCH_X86_64
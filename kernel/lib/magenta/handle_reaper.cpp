@@ -6,30 +6,79 @@
 
 #include <assert.h>
 #include <inttypes.h>
-#include <lib/dpc.h>
+#include <kernel/event.h>
+#include <kernel/mp.h>
 #include <kernel/mutex.h>
+#include <kernel/thread.h>
+#include <lk/init.h>
 #include <magenta/dispatcher.h>
 #include <magenta/handle_reaper.h>
 #include <magenta/magenta.h>
+#include <mxtl/atomic.h>
+#include <stdio.h>
 #include <trace.h>
 
 #define LOCAL_TRACE 0
 
-static void ReaperRoutine(dpc_t* dpc);
+// Handles are reaped by a thread per cpu, each pinned to its cpu and fed from
+// its own queue, so that tearing down a process with a big handle table (or a
+// job full of them) doesn't leave one cpu doing all of the work. A batch is
+// dealt out in chunks of REAPER_CHUNK handles, the first to the queue of the
+// cpu doing the freeing and the rest round robin to the other online cpus.
+#define REAPER_CHUNK 256u
 
-static Mutex reaper_mutex;
-static mxtl::DoublyLinkedList<Handle*> reaper_handles TA_GUARDED(reaper_mutex);
-static dpc_t reaper_dpc = {
-    .node = LIST_INITIAL_CLEARED_VALUE,
-    .func = ReaperRoutine,
-    .arg = nullptr,
-};
+struct ReaperQueue {
+    Mutex lock;
+    mxtl::DoublyLinkedList<Handle*> handles TA_GUARDED(lock);
+    event_t event;
+} __CPU_ALIGN;
+
+static ReaperQueue reaper_queues[SMP_MAX_CPUS];
+
+// The cpus that have a reaper thread, each added as it comes up.
+static mxtl::atomic<mp_cpu_mask_t> reaper_cpus;
+
+static void QueueHandles(uint cpu, mxtl::DoublyLinkedList<Handle*>* handles) {
+    ReaperQueue& q = reaper_queues[cpu];
+    {
+        AutoLock lock(&q.lock);
+        q.handles.splice(q.handles.end(), *handles);
+    }
+    event_signal(&q.event, false);
+}
+
+// Returns the next cpu after |cpu| in |mask|, wrapping around.
+static uint NextCpu(mp_cpu_mask_t mask, uint cpu) {
+    for (uint i = 1; i <= SMP_MAX_CPUS; i++) {
+        uint next = (cpu + i) % SMP_MAX_CPUS;
+        if (mask & (1u << next))
+            return next;
+    }
+    return cpu;
+}
 
 void ReapHandles(mxtl::DoublyLinkedList<Handle*>* handles) {
     LTRACE_ENTRY;
-    AutoLock lock(&reaper_mutex);
-    reaper_handles.splice(reaper_handles.end(), *handles);
-    dpc_queue(&reaper_dpc, false);
+    mp_cpu_mask_t reapers = reaper_cpus.load();
+    DEBUG_ASSERT(reapers != 0);
+
+    // The thread may migrate while this runs, which only costs some locality.
+    // Should every cpu with a reaper be offline, the handles wait for one.
+    mp_cpu_mask_t cpus = reapers & mp_get_online_mask();
+    if (!cpus)
+        cpus = reapers;
+    uint cpu = arch_curr_cpu_num();
+    if (!(cpus & (1u << cpu)))
+        cpu = NextCpu(cpus, cpu);
+
+    while (!handles->is_empty()) {
+        mxtl::DoublyLinkedList<Handle*> chunk;
+        Handle* handle;
+        for (uint i = 0; i < REAPER_CHUNK && (handle = handles->pop_front()) != nullptr; i++)
+            chunk.push_back(handle);
+        QueueHandles(cpu, &chunk);
+        cpu = NextCpu(cpus, cpu);
+    }
 }
 
 void ReapHandles(Handle** handles, uint32_t num_handles) {
@@ -40,20 +89,44 @@ void ReapHandles(Handle** handles, uint32_t num_handles) {
     ReapHandles(&list);
 }
 
-static void ReaperRoutine(dpc_t* dpc) {
-    LTRACE_ENTRY;
-    mxtl::DoublyLinkedList<Handle*> list;
-    {
-        AutoLock lock(&reaper_mutex);
-        list.swap(reaper_handles);
-    }
-    Handle* handle;
-    while ((handle = list.pop_front()) != nullptr) {
-        LTRACEF("Reaping handle of koid %" PRIu64 " of pid %" PRIu64 "\n",
-                handle->dispatcher()->get_koid(), handle->process_id());
-        DEBUG_ASSERT(handle->process_id() == 0u);
-        DeleteHandle(handle);
+static int ReaperThread(void* arg) {
+    ReaperQueue* q = static_cast<ReaperQueue*>(arg);
+    for (;;) {
+        __UNUSED status_t status = event_wait(&q->event);
+        DEBUG_ASSERT(status == MX_OK);
+
+        mxtl::DoublyLinkedList<Handle*> list;
+        {
+            AutoLock lock(&q->lock);
+            list.swap(q->handles);
+        }
+        Handle* handle;
+        while ((handle = list.pop_front()) != nullptr) {
+            LTRACEF("Reaping handle of koid %" PRIu64 " of pid %" PRIu64 "\n",
+                    handle->dispatcher()->get_koid(), handle->process_id());
+            DEBUG_ASSERT(handle->process_id() == 0u);
+            DeleteHandle(handle);
+        }
     }
-    LTRACE_EXIT;
-;
+    return 0;
+}
+
+// Runs on each cpu as it comes up, the boot cpu first, and starts its reaper.
+static void ReaperInit(uint level) {
+    uint cpu = arch_curr_cpu_num();
+    ReaperQueue& q = reaper_queues[cpu];
+    event_init(&q.event, false, EVENT_FLAG_AUTOUNSIGNAL);
+
+    char name[THREAD_NAME_LENGTH];
+    snprintf(name, sizeof(name), "reaper-%u", cpu);
+    thread_t* t = thread_create(name, &ReaperThread, &q, DEFAULT_PRIORITY,
+                                DEFAULT_STACK_SIZE);
+    if (!t)
+        return;
+    thread_set_pinned_cpu(t, cpu);
+    thread_detach_and_resume(t);
+
+    // handles are only queued for this cpu once its queue is ready
+    reaper_cpus.fetch_or(1u << cpu);
 }
+LK_INIT_HOOK_FLAGS(handle_reaper, &ReaperInit, LK_INIT_LEVEL_THREADING, LK_INIT_FLAG_ALL_CPUS);
@@ -9,6 +9,8 @@
 #include <mxalloc/new.h>
 #include <mxtl/auto_lock.h>
 
+OBJECT_CACHE(HypervisorDispatcher, "hypervisor");
+
 static Mutex mutex;
 mxtl::RefPtr<HypervisorDispatcher> hypervisor TA_GUARDED(mutex);
 
@@ -10,6 +10,7 @@
 
 #include <magenta/dispatcher.h>
 #include <magenta/message_packet.h>
+#include <magenta/object_cache.h>
 #include <magenta/state_tracker.h>
 #include <magenta/types.h>
 #include <magenta/wait_event.h>
@@ -23,6 +24,7 @@ class PortClient;
 
 class ChannelDispatcher final : public Dispatcher {
 public:
+    OBJECT_CACHE_ALLOCATED(ChannelDispatcher);
     static status_t Create(uint32_t flags, mxtl::RefPtr<Dispatcher>* dispatcher0,
                            mxtl::RefPtr<Dispatcher>* dispatcher1, mx_rights_t* rights);
 
@@ -48,6 +48,7 @@ DECLARE_DISPTAG(PortDispatcherV2, MX_OBJ_TYPE_IOPORT2)
 DECLARE_DISPTAG(HypervisorDispatcher, MX_OBJ_TYPE_HYPERVISOR)
 DECLARE_DISPTAG(GuestDispatcher, MX_OBJ_TYPE_GUEST)
 DECLARE_DISPTAG(TimerDispatcher, MX_OBJ_TYPE_TIMER)
+DECLARE_DISPTAG(VcpuDispatcher, MX_OBJ_TYPE_VCPU)
 
 
 #undef DECLARE_DISPTAG
@@ -63,7 +64,8 @@ public:
 
     mx_koid_t get_koid() const { return koid_; }
 
-    // Updating |handle_count_| is done at the magenta handle management layer.
+    // Updating |handle_count_| is done at the magenta handle management layer,
+    // atomically.
     uint32_t* get_handle_count_ptr() { return &handle_count_; }
 
     // Interface for derived classes.
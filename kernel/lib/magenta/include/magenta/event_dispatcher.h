@@ -7,6 +7,7 @@
 #pragma once
 
 #include <magenta/dispatcher.h>
+#include <magenta/object_cache.h>
 #include <magenta/state_tracker.h>
 #include <mxtl/canary.h>
 
@@ -14,6 +15,7 @@
 
 class EventDispatcher final : public Dispatcher {
 public:
+    OBJECT_CACHE_ALLOCATED(EventDispatcher);
     static status_t Create(uint32_t options, mxtl::RefPtr<Dispatcher>* dispatcher,
                            mx_rights_t* rights);
 
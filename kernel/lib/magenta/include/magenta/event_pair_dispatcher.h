@@ -8,6 +8,7 @@
 
 #include <kernel/mutex.h>
 #include <magenta/dispatcher.h>
+#include <magenta/object_cache.h>
 #include <magenta/state_tracker.h>
 #include <mxtl/canary.h>
 #include <mxtl/ref_ptr.h>
@@ -15,6 +16,7 @@
 
 class EventPairDispatcher final : public Dispatcher {
 public:
+    OBJECT_CACHE_ALLOCATED(EventPairDispatcher);
     static status_t Create(mxtl::RefPtr<Dispatcher>* dispatcher0,
                            mxtl::RefPtr<Dispatcher>* dispatcher1,
                            mx_rights_t* rights);
@@ -25,7 +25,7 @@ public:
     enum class Type { NONE, DEBUGGER, THREAD, PROCESS, SYSTEM };
 
     static mx_status_t Create(Type type, mxtl::RefPtr<PortDispatcher> port,
-                              uint64_t port_key,
+                              uint64_t port_key, bool async_thread_events,
                               mxtl::RefPtr<ExceptionPort>* eport);
     ~ExceptionPort();
 
@@ -52,10 +52,16 @@ public:
     // Called by the target when the port is explicitly unbound.
     void OnTargetUnbind();
 
+    // The thread that last answered a report sent through this port, which
+    // is most likely the one to answer the next. Null if none has yet.
+    void SetHandler(mxtl::RefPtr<UserThread> handler);
+    mxtl::RefPtr<UserThread> handler();
+
 private:
     friend class PortDispatcher;
 
-    ExceptionPort(Type type, mxtl::RefPtr<PortDispatcher> port, uint64_t port_key);
+    ExceptionPort(Type type, mxtl::RefPtr<PortDispatcher> port, uint64_t port_key,
+                  bool async_thread_events);
 
     ExceptionPort(const ExceptionPort&) = delete;
     ExceptionPort& operator=(const ExceptionPort&) = delete;
@@ -90,6 +96,9 @@ private:
     // immutable (the io port itself has its own locking though).
     const Type type_;
     const uint64_t port_key_;
+    // If true, thread start and exit are reported without waiting for
+    // a response (MX_EXCEPTION_PORT_ASYNC_THREAD_EVENTS).
+    const bool async_thread_events_;
 
     // The underlying ioport. If null, the ExceptionPort has been unbound.
     mxtl::RefPtr<PortDispatcher> port_ TA_GUARDED(lock_);
@@ -99,6 +108,9 @@ private:
     mxtl::RefPtr<Dispatcher> target_ TA_GUARDED(lock_);
     bool bound_to_system_ TA_GUARDED(lock_) = false;
 
+    // See handler().
+    mxtl::RefPtr<UserThread> handler_ TA_GUARDED(lock_);
+
     Mutex lock_;
 
     // NOTE: The DoublyLinkedListNodeState is guarded by |port_|'s lock,
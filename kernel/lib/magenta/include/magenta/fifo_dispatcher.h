@@ -11,6 +11,7 @@
 #include <kernel/mutex.h>
 
 #include <magenta/dispatcher.h>
+#include <magenta/object_cache.h>
 #include <magenta/state_tracker.h>
 #include <magenta/types.h>
 
@@ -22,6 +23,7 @@ typedef mx_status_t (*fifo_copy_to_fn_t)(uint8_t* ptr, const uint8_t* data, size
 
 class FifoDispatcher final : public Dispatcher {
 public:
+    OBJECT_CACHE_ALLOCATED(FifoDispatcher);
     static status_t Create(uint32_t elem_count, uint32_t elem_size, uint32_t options,
                            mxtl::RefPtr<Dispatcher>* dispatcher0,
                            mxtl::RefPtr<Dispatcher>* dispatcher1,
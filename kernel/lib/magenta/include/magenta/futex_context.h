@@ -13,7 +13,8 @@
 
 // FutexContext is a class that encapsulates support for futex operations.
 // FutexContext uses a hash table keyed on the futex address (a pointer to integer in userspace)
-// to contain all active futexes.
+// to contain all active futexes. The table is split into buckets, each with its own lock,
+// so that operations on unrelated futexes mostly don't contend.
 // A futex is considered active if there is one or more threads blocked on the futex.
 // After no threads are left blocked on a futex it is removed from the hash table.
 // The value in the futex hash table is the FutexNode object associated with the head
@@ -33,7 +34,11 @@ public:
     // Otherwise it will block the current thread until the |deadline| passes,
     // or until the thread is woken by a FutexWake or FutexRequeue operation
     // on the same |value_ptr| futex.
-    status_t FutexWait(user_ptr<int> value_ptr, int current_value, mx_time_t deadline);
+    // If |owner| is not null, it runs with at least the priority of the
+    // current thread while the current thread waits. Woken threads take
+    // over as the owner of the threads that are left waiting.
+    status_t FutexWait(user_ptr<int> value_ptr, int current_value, thread_t* owner,
+                       mx_time_t deadline);
 
     // FutexWake will wake up to |count| number of threads blocked on the |value_ptr| futex.
     status_t FutexWake(user_ptr<const int> value_ptr, uint32_t count);
@@ -51,14 +56,33 @@ private:
     FutexContext(const FutexContext&) = delete;
     FutexContext& operator=(const FutexContext&) = delete;
 
-    void QueueNodesLocked(FutexNode* head) TA_REQ(lock_);
+    // Number of buckets, a power of two.
+    static constexpr uint32_t kNumBucketsShift = 5;
+    static constexpr uint32_t kNumBuckets = 1u << kNumBucketsShift;
 
-    bool UnqueueNodeLocked(FutexNode* node) TA_REQ(lock_);
+    struct Bucket {
+        // protects table
+        Mutex lock;
 
-    // protects futex_table_
-    Mutex lock_;
+        // Hash table for the futexes hashing to this bucket.
+        // Key is futex address, value is the FutexNode for the head of futex's blocked
+        // thread list.
+        FutexNode::HashTable table TA_GUARDED(lock);
+    };
 
-    // Hash table for futexes in this context.
-    // Key is futex address, value is the FutexNode for the head of futex's blocked thread list.
-    FutexNode::HashTable futex_table_ TA_GUARDED(lock_);
+    Bucket* BucketFor(uintptr_t futex_key);
+
+    // Acquires the lock of the bucket the futex |node| is waiting on currently
+    // hashes to, which FutexRequeue() may change until the lock is held.
+    Bucket* LockNodeBucket(FutexNode* node);
+
+    // Acquire and release the locks of two buckets, which may be the same.
+    static void LockBuckets(Bucket* a, Bucket* b);
+    static void UnlockBuckets(Bucket* a, Bucket* b);
+
+    void QueueNodesLocked(Bucket* bucket, FutexNode* head) TA_REQ(bucket->lock);
+
+    bool UnqueueNodeLocked(Bucket* bucket, FutexNode* node) TA_REQ(bucket->lock);
+
+    Bucket buckets_[kNumBuckets];
 };
@@ -17,7 +17,10 @@
 // Intended to be embedded within a UserThread Instance
 class FutexNode : public mxtl::SinglyLinkedListable<FutexNode*> {
 public:
-    using HashTable = mxtl::HashTable<uintptr_t, FutexNode*>;
+    // Each FutexContext bucket has one of these, so it only needs a few
+    // slots of its own.
+    using HashTable = mxtl::HashTable<uintptr_t, FutexNode*, mxtl::SinglyLinkedList<FutexNode*>,
+                                      size_t, 7>;
 
     FutexNode();
     ~FutexNode();
@@ -39,11 +42,18 @@ public:
                                      uintptr_t new_hash_key);
 
     // This must be called with |mutex| held and returns without |mutex| held.
-    status_t BlockThread(Mutex* mutex, mx_time_t deadline) TA_REL(mutex);
+    // |owner|, if not null, inherits the blocked thread's priority until it
+    // is woken.
+    status_t BlockThread(Mutex* mutex, thread_t* owner, mx_time_t deadline) TA_REL(mutex);
 
     // wakes the list of threads starting with node |head|
     static void WakeThreads(FutexNode* head);
 
+    // The threads in the list starting with |remaining| that named an owner
+    // when they blocked are now waiting on the first thread in the list
+    // starting with |woken| instead, or on nobody if |woken| is null.
+    static void HandOff(FutexNode* woken, FutexNode* remaining);
+
     void set_hash_key(uintptr_t key) {
         hash_key_ = key;
     }
@@ -66,8 +76,9 @@ private:
     //    intrusive SinglyLinkedLists).
     uintptr_t hash_key_;
 
-    // Used for waking the thread corresponding to the FutexNode.
-    wait_queue_t wait_queue_;
+    // Used for waking the thread corresponding to the FutexNode. Its owner is
+    // the thread the waiter is waiting on, if it said.
+    owned_wait_queue_t wait_queue_;
 
     // queue_prev_ and queue_next_ are used for maintaining a circular
     // doubly-linked list of threads that are waiting on one futex address.
@@ -7,10 +7,12 @@
 #pragma once
 
 #include <magenta/hypervisor_dispatcher.h>
+#include <magenta/object_cache.h>
 #include <mxtl/canary.h>
 
 class GuestDispatcher final : public Dispatcher {
 public:
+    OBJECT_CACHE_ALLOCATED(GuestDispatcher);
     static mx_status_t Create(mxtl::RefPtr<HypervisorDispatcher> hypervisor,
                               mxtl::RefPtr<VmObject> phys_mem,
                               mxtl::RefPtr<FifoDispatcher> ctl_fifo,
@@ -21,18 +23,23 @@ public:
 
     mx_obj_type_t get_type() const { return MX_OBJ_TYPE_GUEST; }
 
-    mx_status_t Enter();
+    mx_status_t CreateVcpu(mxtl::RefPtr<FifoDispatcher> ctl_fifo, uint32_t* vcpu);
+    mx_status_t Enter(uint32_t vcpu);
     mx_status_t MemTrap(mx_vaddr_t guest_paddr, size_t size);
-    mx_status_t Interrupt(uint8_t interrupt);
-    mx_status_t SetGpr(const mx_guest_gpr_t& guest_gpr);
-    mx_status_t GetGpr(mx_guest_gpr_t* guest_gpr) const;
+    mx_status_t Interrupt(uint32_t vcpu, uint8_t interrupt);
+    mx_status_t SetGpr(uint32_t vcpu, const mx_guest_gpr_t& guest_gpr);
+    mx_status_t GetGpr(uint32_t vcpu, mx_guest_gpr_t* guest_gpr) const;
 #if ARCH_X86_64
-    mx_status_t SetApicMem(mxtl::RefPtr<VmObject> apic_mem);
+    mx_status_t SetApicMem(uint32_t vcpu, mxtl::RefPtr<VmObject> apic_mem);
+    mx_status_t SetBell(uint32_t kind, uint64_t addr, uint64_t len,
+                        mxtl::RefPtr<EventDispatcher> event);
+    mx_status_t SetInterruptEvent(uint8_t interrupt, mxtl::RefPtr<EventDispatcher> event);
+    mx_status_t GetExitStats(uint32_t vcpu, mx_guest_exit_stats_t* exit_stats) const;
 #endif // ARCH_X86_64
 
-    mx_status_t set_ip(uintptr_t guest_ip);
+    mx_status_t set_ip(uint32_t vcpu, uintptr_t guest_ip);
 #if ARCH_X86_64
-    mx_status_t set_cr3(uintptr_t guest_cr3);
+    mx_status_t set_cr3(uint32_t vcpu, uintptr_t guest_cr3);
 #endif // ARCH_X86_64
 
 private:
@@ -28,13 +28,14 @@ public:
 
     // Returns the process that owns this instance. Used to guarantee
     // that one process may not access a handle owned by a different process.
+    // May be read without the owning process' handle table lock.
     mx_koid_t process_id() const {
-        return process_id_;
+        return __atomic_load_n(&process_id_, __ATOMIC_ACQUIRE);
     }
 
     // Sets the value returned by process_id().
     void set_process_id(mx_koid_t pid) {
-        process_id_ = pid;
+        __atomic_store_n(&process_id_, pid, __ATOMIC_RELEASE);
     }
 
     // Returns the |rights| parameter that was provided when this instance
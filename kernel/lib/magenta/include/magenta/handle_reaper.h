@@ -9,6 +9,7 @@
 #include <magenta/handle.h>
 #include <mxtl/intrusive_double_list.h>
 
-// Delete handles out-of-band, using a deferred procedure call.
+// Delete handles out-of-band, on the per-cpu reaper threads. Big batches are
+// split up so that several cpus share the work.
 void ReapHandles(mxtl::DoublyLinkedList<Handle*>* handles);
 void ReapHandles(Handle** handles, uint32_t num_handles);
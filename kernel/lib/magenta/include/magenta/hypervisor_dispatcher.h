@@ -8,11 +8,13 @@
 
 #include <arch/hypervisor.h>
 #include <magenta/dispatcher.h>
+#include <magenta/object_cache.h>
 #include <magenta/types.h>
 #include <mxtl/canary.h>
 
 class HypervisorDispatcher final : public Dispatcher {
 public:
+    OBJECT_CACHE_ALLOCATED(HypervisorDispatcher);
     static mx_status_t Create(mxtl::RefPtr<Dispatcher>* dispatcher,
                               mx_rights_t* rights);
 
@@ -8,12 +8,14 @@
 
 #include <kernel/mutex.h>
 #include <magenta/interrupt_dispatcher.h>
+#include <magenta/object_cache.h>
 #include <mxtl/canary.h>
 #include <mxtl/intrusive_wavl_tree.h>
 #include <sys/types.h>
 
 class InterruptEventDispatcher final : public InterruptDispatcher {
 public:
+    OBJECT_CACHE_ALLOCATED(InterruptEventDispatcher);
     static status_t Create(uint32_t vector,
                            uint32_t flags,
                            mxtl::RefPtr<Dispatcher>* dispatcher,
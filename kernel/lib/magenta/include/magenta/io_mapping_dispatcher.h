@@ -8,11 +8,13 @@
 
 #include <kernel/vm/vm_aspace.h>
 #include <magenta/dispatcher.h>
+#include <magenta/object_cache.h>
 #include <mxtl/canary.h>
 #include <sys/types.h>
 
 class IoMappingDispatcher : public Dispatcher {
 public:
+    OBJECT_CACHE_ALLOCATED(IoMappingDispatcher);
     static status_t Create(const char* dbg_name,
                            paddr_t paddr, size_t size,
                            uint vmm_flags, uint arch_mmu_flags,
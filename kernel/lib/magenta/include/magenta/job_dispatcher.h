@@ -11,6 +11,7 @@
 #include <kernel/mutex.h>
 
 #include <magenta/dispatcher.h>
+#include <magenta/object_cache.h>
 #include <magenta/policy_manager.h>
 #include <magenta/process_dispatcher.h>
 #include <magenta/state_tracker.h>
@@ -39,6 +40,7 @@ protected:
 
 class JobDispatcher final : public Dispatcher {
 public:
+    OBJECT_CACHE_ALLOCATED(JobDispatcher);
     // Traits to belong to the parent's raw job list.
     struct ListTraitsRaw {
         static mxtl::DoublyLinkedListNodeState<JobDispatcher*>& node_state(
@@ -80,6 +82,10 @@ public:
     void RemoveChildProcess(ProcessDispatcher* process);
     void Kill();
 
+    // Handles held by processes in this job or in any job under it, summed
+    // over the processes when asked for.
+    uint64_t GetHandleCount();
+
     // Set policy. |mode| is is either MX_JOB_POL_RELATIVE or MX_JOB_POL_ABSOLUTE and
     // in_policy is an array of |count| elements.
     status_t SetPolicy(uint32_t mode, const mx_policy_basic* in_policy, size_t policy_count);
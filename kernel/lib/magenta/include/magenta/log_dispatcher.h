@@ -9,12 +9,17 @@
 #include <lib/debuglog.h>
 
 #include <magenta/dispatcher.h>
+#include <magenta/object_cache.h>
 #include <magenta/state_tracker.h>
 #include <magenta/wait_event.h>
 #include <mxtl/canary.h>
+#include <mxtl/ref_ptr.h>
+
+class VmObject;
 
 class LogDispatcher final : public Dispatcher {
 public:
+    OBJECT_CACHE_ALLOCATED(LogDispatcher);
     static status_t Create(uint32_t flags, mxtl::RefPtr<Dispatcher>* dispatcher, mx_rights_t* rights);
 
     ~LogDispatcher() final;
@@ -24,6 +29,12 @@ public:
     status_t Write(uint32_t flags, const void* ptr, size_t len);
     status_t Read(uint32_t flags, void* ptr, size_t len, size_t* actual);
 
+    // Count everything written so far as read, for readers of the ring.
+    status_t Skip();
+
+    // The vmo every reader maps the log ring through.
+    status_t GetRingVmo(mxtl::RefPtr<VmObject>* vmo);
+
 private:
     explicit LogDispatcher(uint32_t flags);
 
@@ -32,9 +32,20 @@ Handle* DupHandle(Handle* source, mx_rights_t rights, bool is_replace);
 // trigger MX_SIGNAL_LAST_HANDLE.
 void DeleteHandle(Handle* handle);
 
+// Returns how many objects of MX_OBJ_TYPE_* |type| have handles, and how many handles
+// there are to them.
+void GetKernelObjectCounts(uint32_t type, uint64_t* objects, uint64_t* handles);
+
 // Maps an integer obtained by Handle->base_value() back to a Handle.
 Handle* MapU32ToHandle(uint32_t value);
 
+// Looks up the handle with base value |value| owned by process |process_id|
+// and returns a reference to its dispatcher, and its rights. Takes no locks,
+// which is safe against the handle being closed at the same time because
+// DeleteHandle() waits for lookups in progress before tearing a handle down.
+bool LookupHandleDispatcher(uint32_t value, mx_koid_t process_id,
+                            mxtl::RefPtr<Dispatcher>* dispatcher, mx_rights_t* rights);
+
 // Set/get the system exception port.
 mx_status_t SetSystemExceptionPort(mxtl::RefPtr<ExceptionPort> eport);
 // Returns true if a port had been set.
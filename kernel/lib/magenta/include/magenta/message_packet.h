@@ -6,8 +6,11 @@
 
 #pragma once
 
+#include <assert.h>
 #include <stdint.h>
 
+#include <arch/defines.h>
+#include <lib/user_copy/user_ptr.h>
 #include <magenta/types.h>
 #include <mxtl/intrusive_double_list.h>
 #include <mxtl/unique_ptr.h>
@@ -19,7 +22,15 @@ constexpr uint32_t kMaxMessageHandles = 64u;
 static_assert(MX_CHANNEL_MAX_MSG_BYTES == kMaxMessageSize, "");
 static_assert(MX_CHANNEL_MAX_MSG_HANDLES == kMaxMessageHandles, "");
 
+// Messages with at least this much data keep it in whole pages from the pmm
+// rather than in the packet's own allocation. The pages belong to the packet:
+// the data is still copied in on write and out on read, since the sender's
+// own pages can't be loaned until a COW clone stops seeing its parent's
+// later writes.
+constexpr uint32_t kPagedDataThreshold = 16384u;
+
 class Handle;
+struct vm_page;
 
 class MessagePacket : public mxtl::DoublyLinkedListable<mxtl::unique_ptr<MessagePacket>> {
 public:
@@ -27,36 +38,51 @@ public:
     static mx_status_t Create(uint32_t data_size, uint32_t num_handles,
                               mxtl::unique_ptr<MessagePacket>* msg);
 
+    // Returns how many packets exist and how many bytes they take up,
+    // headers included.
+    static void GetStats(size_t* packets, size_t* bytes);
+
     uint32_t data_size() const { return data_size_; }
     uint32_t num_handles() const { return num_handles_; }
 
     void set_owns_handles(bool own_handles) { owns_handles_ = own_handles; }
 
-    const void* data() const { return static_cast<void*>(handles_ + num_handles_); }
-    void* mutable_data() { return static_cast<void*>(handles_ + num_handles_); }
+    // Fill in or copy out all data_size() bytes of the message.
+    mx_status_t CopyDataFromUser(user_ptr<const void> src);
+    mx_status_t CopyDataToUser(user_ptr<void> dst) const;
+
+    // Direct access to the data, only for messages smaller than
+    // kPagedDataThreshold.
+    const void* data() const {
+        DEBUG_ASSERT(!paged_);
+        return static_cast<void*>(handles_ + num_handles_);
+    }
+    void* mutable_data() {
+        DEBUG_ASSERT(!paged_);
+        return static_cast<void*>(handles_ + num_handles_);
+    }
     Handle* const* handles() const { return handles_; }
     Handle** mutable_handles() { return handles_; }
 
     // mx_channel_call treats the leading bytes of the payload as
     // a transaction id of type mx_txid_t.
-    mx_txid_t get_txid() const {
-        if (data_size_ < sizeof(mx_txid_t)) {
-            return 0;
-        } else {
-            return *(reinterpret_cast<const mx_txid_t*>(data()));
-        }
-    }
+    mx_txid_t get_txid() const;
 
 private:
-    MessagePacket(uint32_t data_size, uint32_t num_handles, Handle** handles);
+    MessagePacket(uint32_t data_size, uint32_t num_handles, bool paged, Handle** handles);
     ~MessagePacket();
 
-    static void operator delete(void* ptr) {
-        free(ptr);
-    }
+    static size_t BufferSize(uint32_t data_size, uint32_t num_handles, bool paged);
+
+    size_t num_data_pages() const { return (data_size_ + PAGE_SIZE - 1) / PAGE_SIZE; }
+    vm_page** data_pages() const { return reinterpret_cast<vm_page**>(handles_ + num_handles_); }
+
+    static void operator delete(void* ptr);
     friend class mxtl::unique_ptr<MessagePacket>;
 
     bool owns_handles_;
+    bool paged_;
+    bool pages_allocated_;
     uint32_t data_size_;
     uint32_t num_handles_;
     Handle** handles_;
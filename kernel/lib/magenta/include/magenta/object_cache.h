@@ -0,0 +1,133 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <arch/ops.h>
+#include <kernel/mutex.h>
+#include <kernel/percpu_cache.h>
+#include <magenta/thread_annotations.h>
+#include <mxalloc/new.h>
+#include <mxtl/algorithm.h>
+#include <mxtl/slab_allocator.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Per-type caches of kernel object memory.
+//
+// A class allocated from an object cache has its memory carved from slabs
+// holding only objects of its type, so short-lived objects don't fragment the
+// heap, and freed objects are kept per cpu so that most allocations take no
+// lock shared with other cpus. Only when a cpu's cache runs dry or overflows
+// are objects moved to or from the slabs, a batch at a time under one
+// acquisition of the slab lock.
+//
+// To use one, name the cache in the public part of the class declaration
+//
+//     class EventDispatcher final : public Dispatcher {
+//     public:
+//         OBJECT_CACHE_ALLOCATED(EventDispatcher);
+//         ...
+//
+// and define it in the class' .cpp file
+//
+//     OBJECT_CACHE(EventDispatcher, "event");
+//
+// after which new (&ac) EventDispatcher(...) and deleting one go through the
+// cache. Classes derived from a cached class without a cache of their own are
+// bigger than the cache's objects and fall back to the heap.
+
+namespace internal {
+
+// The part of an object cache that doesn't depend on its type.
+class ObjectCacheBase {
+public:
+    ObjectCacheBase(const char* name, size_t object_size);
+
+    void* New(size_t size, AllocChecker* ac);
+    void Delete(void* ptr, size_t size);
+
+    // Returns every object the cpus hold to the slabs.
+    void Drain();
+
+    static void DumpAll();
+    static void DrainAll();
+
+protected:
+    virtual void* AllocFromSlabLocked() TA_REQ(slab_lock_) = 0;
+    virtual void FreeToSlabLocked(void* ptr) TA_REQ(slab_lock_) = 0;
+
+    Mutex slab_lock_;
+
+private:
+    // Free objects kept by each cpu, moved to and from the slabs 16 at a
+    // time.
+    using CpuCaches = PerCpuCache<32, ObjectCacheBase>;
+    friend CpuCaches;
+
+    // Where the cpus' caches refill from and overflow to.
+    size_t Get(void** objects, size_t count);
+    void Put(void* const* objects, size_t count);
+
+    void Dump();
+
+    const char* const name_;
+    const size_t object_size_;
+
+    // All the caches, which are only ever created.
+    ObjectCacheBase* next_;
+
+    CpuCaches cpus_;
+
+    // Objects handed out by the slabs, in use or cached, and the allocations
+    // that didn't fit the cache's objects.
+    size_t slab_objects_ TA_GUARDED(slab_lock_) = 0;
+    uint64_t heap_allocs_ = 0;
+};
+
+} // namespace internal
+
+template <typename T>
+class ObjectCache final : public internal::ObjectCacheBase {
+public:
+    explicit ObjectCache(const char* name)
+        : ObjectCacheBase(name, sizeof(T)), slab_(SIZE_MAX) {}
+
+private:
+    static_assert(sizeof(T) >= sizeof(void*), "");
+
+    // Room for at least 8 objects in a slab.
+    static constexpr size_t kSlabSize =
+        mxtl::max(mxtl::DEFAULT_SLAB_ALLOCATOR_SLAB_SIZE, 8 * sizeof(T) + 64);
+
+    struct Slot;
+    using SlabTraits = mxtl::UnlockedManualDeleteSlabAllocatorTraits<Slot*, kSlabSize>;
+    struct Slot : public mxtl::SlabAllocated<SlabTraits> {
+        alignas(T) uint8_t storage[sizeof(T)];
+    };
+
+    void* AllocFromSlabLocked() final TA_REQ(slab_lock_) {
+        return slab_.New();
+    }
+    void FreeToSlabLocked(void* ptr) final TA_REQ(slab_lock_) {
+        slab_.Delete(static_cast<Slot*>(ptr));
+    }
+
+    mxtl::SlabAllocator<SlabTraits> slab_ TA_GUARDED(slab_lock_);
+};
+
+#define OBJECT_CACHE_ALLOCATED(T)                                            \
+    static void* operator new(size_t size, AllocChecker* ac) noexcept;       \
+    static void operator delete(void* ptr, size_t size)
+
+#define OBJECT_CACHE(T, name)                                                \
+    static ObjectCache<T> T##_object_cache(name);                            \
+    void* T::operator new(size_t size, AllocChecker* ac) noexcept {          \
+        return T##_object_cache.New(size, ac);                               \
+    }                                                                        \
+    void T::operator delete(void* ptr, size_t size) {                        \
+        T##_object_cache.Delete(ptr, size);                                  \
+    }
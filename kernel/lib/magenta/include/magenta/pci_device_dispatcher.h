@@ -13,6 +13,7 @@
 #include <kernel/vm/vm_aspace.h>
 #include <magenta/dispatcher.h>
 #include <magenta/io_mapping_dispatcher.h>
+#include <magenta/object_cache.h>
 #include <magenta/syscalls/pci.h>
 #include <mxtl/canary.h>
 #include <mxtl/intrusive_single_list.h>
@@ -24,6 +25,7 @@ class PciInterruptDispatcher;
 
 class PciDeviceDispatcher final : public Dispatcher {
 public:
+    OBJECT_CACHE_ALLOCATED(PciDeviceDispatcher);
     static status_t Create(uint32_t index,
                            mx_pcie_device_info_t*    out_info,
                            mxtl::RefPtr<Dispatcher>* out_dispatcher,
@@ -49,6 +51,7 @@ public:
                           mx_rights_t* rights);
     status_t QueryIrqModeCaps(mx_pci_irq_mode_t mode, uint32_t* out_max_irqs);
     status_t SetIrqMode(mx_pci_irq_mode_t mode, uint32_t requested_irq_count);
+    status_t SetIrqAffinity(uint32_t which_irq, uint32_t cpu_num);
 
     bool irqs_maskable() const TA_REQ(lock_) { return irqs_maskable_; }
 
@@ -9,6 +9,7 @@
 
 #include <dev/pcie_irqs.h>
 #include <magenta/interrupt_dispatcher.h>
+#include <magenta/object_cache.h>
 #include <magenta/pci_device_dispatcher.h>
 #include <sys/types.h>
 
@@ -16,6 +17,7 @@ class PciDeviceDispatcher;
 
 class PciInterruptDispatcher final : public InterruptDispatcher {
 public:
+    OBJECT_CACHE_ALLOCATED(PciInterruptDispatcher);
     static status_t Create(const mxtl::RefPtr<PcieDevice>& device,
                            uint32_t irq_id,
                            bool maskable,
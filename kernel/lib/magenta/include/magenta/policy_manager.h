@@ -71,6 +71,11 @@ public:
     // MX_POL_ACTION_DENY all other failure modes.
     uint32_t QueryBasicPolicy(pol_cookie_t policy, uint32_t condition);
 
+    // Returns a bitmap with bit N set if QueryBasicPolicy() of |policy|
+    // returns a plain MX_POL_ACTION_ALLOW for condition N, for callers
+    // that keep an immutable |policy| and want to skip the lookup.
+    uint32_t QueryAllowedConditions(pol_cookie_t policy);
+
 private:
     PolicyManager(uint32_t default_action);
     ~PolicyManager() = default;
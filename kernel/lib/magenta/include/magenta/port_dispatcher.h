@@ -10,6 +10,7 @@
 #include <kernel/event.h>
 
 #include <magenta/dispatcher.h>
+#include <magenta/object_cache.h>
 #include <magenta/syscalls/port.h>
 #include <magenta/types.h>
 
@@ -72,6 +73,7 @@ struct IOP_Signal : public IOP_Packet {
 
 class PortDispatcher final : public Dispatcher {
 public:
+    OBJECT_CACHE_ALLOCATED(PortDispatcher);
     static status_t Create(uint32_t options,
                            mxtl::RefPtr<Dispatcher>* dispatcher,
                            mx_rights_t* rights);
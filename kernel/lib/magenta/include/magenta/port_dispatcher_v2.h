@@ -6,15 +6,18 @@
 
 #pragma once
 
-#include <kernel/mutex.h>
+#include <kernel/mp.h>
+#include <kernel/spinlock.h>
 
 #include <magenta/dispatcher.h>
+#include <magenta/object_cache.h>
 #include <magenta/semaphore.h>
 #include <magenta/state_observer.h>
 #include <magenta/syscalls/port.h>
 #include <magenta/types.h>
 #include <magenta/wait_event.h>
 
+#include <mxtl/atomic.h>
 #include <mxtl/canary.h>
 #include <mxtl/intrusive_double_list.h>
 #include <mxtl/unique_ptr.h>
@@ -80,8 +83,13 @@ class PortDispatcherV2;
 class PortObserver;
 
 struct PortPacket final : public mxtl::DoublyLinkedListable<PortPacket*> {
+    OBJECT_CACHE_ALLOCATED(PortPacket);
     mx_port_packet_t packet;
     PortObserver* observer;
+    // The per-cpu queue of the port the packet was last queued on.
+    uint32_t queue;
+    // When the packet was last queued, in the port's sequence.
+    uint64_t seq;
 
     PortPacket();
     PortPacket(const PortPacket&) = delete;
@@ -95,6 +103,7 @@ struct PortPacket final : public mxtl::DoublyLinkedListable<PortPacket*> {
 // callbacks.
 class PortObserver final : public StateObserver {
 public:
+    OBJECT_CACHE_ALLOCATED(PortObserver);
     PortObserver(uint32_t type, Handle* handle, mxtl::RefPtr<PortDispatcherV2> port,
                  uint64_t key, mx_signals_t signals);
     ~PortObserver() = default;
@@ -130,6 +139,7 @@ private:
 
 class PortDispatcherV2 final : public Dispatcher {
 public:
+    OBJECT_CACHE_ALLOCATED(PortDispatcherV2);
     static status_t Create(uint32_t options,
                            mxtl::RefPtr<Dispatcher>* dispatcher,
                            mx_rights_t* rights);
@@ -143,6 +153,11 @@ public:
     mx_status_t QueueUser(const mx_port_packet_t& packet);
     mx_status_t DeQueue(mx_time_t deadline, mx_port_packet_t* packet);
 
+    // Takes up to |count| packets at once, waiting until |deadline| only if
+    // there are none. |packets| may be null to discard them.
+    mx_status_t DeQueueMany(mx_time_t deadline, mx_port_packet_t* packets,
+                            size_t count, size_t* actual);
+
     // Decides who is going to destroy the observer. If it returns |true| it
     // is the duty of the caller. If it is false it is the duty of the port.
     bool CanReap(PortObserver* observer, PortPacket* port_packet);
@@ -156,12 +171,42 @@ public:
     bool CancelQueued(const void* handle, uint64_t key);
 
 private:
+    static constexpr uint64_t kNoPacket = UINT64_MAX;
+
+    // Packets are queued on the queue of the cpu the producer is running on,
+    // so producers on different cpus don't all contend on one lock. Each
+    // packet is stamped from a port-wide sequence as it is queued, and
+    // consumers take the packet with the lowest stamp at the head of any
+    // queue next, so packets come out in the order they went in.
+    struct CpuQueue {
+        // Held with interrupts disabled, guards the members below.
+        SpinLock lock;
+        mxtl::DoublyLinkedList<PortPacket*> packets;
+        // Set once the port has no handles, nothing more may be queued.
+        bool closed = false;
+        // Stamp of the packet at the head of |packets|, or kNoPacket. Written
+        // under the lock, read without it to pick the queue to take from.
+        mxtl::atomic<uint64_t> head_seq{kNoPacket};
+    };
+
     PortDispatcherV2(uint32_t options);
-    PortObserver* CopyLocked(PortPacket* port_packet, mx_port_packet_t* packet) TA_REQ(lock_);
+
+    // Moves up to |count| packets out of the queues into |packets|.
+    size_t Take(mx_port_packet_t* packets, size_t count);
+
+    // Add |port_packet| at the tail of |q| or take the head of |q|, keeping
+    // the head stamp and |nonempty_| up to date. |q.lock| must be held.
+    void PushLocked(uint32_t cpu, CpuQueue& q, PortPacket* port_packet);
+    PortPacket* PopLocked(uint32_t cpu, CpuQueue& q);
+    // Take |port_packet| out of |q| wherever it is. |q.lock| must be held.
+    PortPacket* EraseLocked(uint32_t cpu, CpuQueue& q, PortPacket* port_packet);
 
     mxtl::Canary<mxtl::magic("POR2")> canary_;
-    Mutex lock_;
     Semaphore sema_;
-    bool zero_handles_ TA_GUARDED(lock_);
-    mxtl::DoublyLinkedList<PortPacket*> packets_ TA_GUARDED(lock_);
+    bool zero_handles_;
+    // The next stamp to hand out.
+    mxtl::atomic<uint64_t> next_seq_{0u};
+    // Which of |queues_| have packets on them.
+    mxtl::atomic<mp_cpu_mask_t> nonempty_{0u};
+    CpuQueue queues_[SMP_MAX_CPUS];
 };
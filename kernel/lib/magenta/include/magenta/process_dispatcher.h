@@ -15,6 +15,7 @@
 #include <magenta/futex_context.h>
 #include <magenta/handle_owner.h>
 #include <magenta/magenta.h>
+#include <magenta/object_cache.h>
 #include <magenta/policy_manager.h>
 #include <magenta/state_tracker.h>
 #include <magenta/syscalls/object.h>
@@ -22,6 +23,7 @@
 #include <magenta/user_thread.h>
 
 #include <mxtl/array.h>
+#include <mxtl/atomic.h>
 #include <mxtl/canary.h>
 #include <mxtl/intrusive_double_list.h>
 #include <mxtl/name.h>
@@ -33,6 +35,7 @@ class JobDispatcher;
 
 class ProcessDispatcher : public Dispatcher {
 public:
+    OBJECT_CACHE_ALLOCATED(ProcessDispatcher);
     static mx_status_t Create(
         mxtl::RefPtr<JobDispatcher> job, mxtl::StringPiece name, uint32_t flags,
         mxtl::RefPtr<Dispatcher>* dispatcher, mx_rights_t* rights,
@@ -104,6 +107,10 @@ public:
     // back into this process.
     void UndoRemoveHandleLocked(mx_handle_t handle_value) TA_REQ(handle_table_lock_);
 
+    // Returns the number of handles in this process's handle table. May be
+    // read without |handle_table_lock_|.
+    uint64_t handle_count() const { return handle_count_.load(mxtl::memory_order_relaxed); }
+
     // Get the dispatcher corresponding to this handle value.
     template <typename T>
     mx_status_t GetDispatcher(mx_handle_t handle_value,
@@ -249,7 +256,12 @@ public:
     //         return res;
     //     }
     //     // Ok to create a channel.
-    mx_status_t QueryPolicy(uint32_t condition) const;
+    mx_status_t QueryPolicy(uint32_t condition) const {
+        // Plainly allowed conditions, the common case, are a bit test.
+        if (likely(condition < MX_POL_MAX && (allowed_conditions_ & (1u << condition))))
+            return MX_OK;
+        return QueryPolicySlow(condition);
+    }
 
     // return a cached copy of the vdso code address or compute a new one
     uintptr_t vdso_code_address() {
@@ -281,6 +293,9 @@ private:
                                                 mxtl::RefPtr<Dispatcher>* dispatcher_out,
                                                 mx_rights_t* out_rights);
 
+    // QueryPolicy() for conditions that aren't plainly allowed.
+    mx_status_t QueryPolicySlow(uint32_t condition) const;
+
     // Thread lifecycle support
     friend class UserThread;
     status_t AddThread(UserThread* t, bool initial_thread);
@@ -299,6 +314,9 @@ private:
     // Policy set by the Job during Create().
     const pol_cookie_t policy_;
 
+    // The conditions |policy_| plainly allows, see QueryPolicy().
+    const uint32_t allowed_conditions_;
+
     // The process can belong to either of these lists independently.
     mxtl::DoublyLinkedListNodeState<ProcessDispatcher*> dll_job_raw_;
     mxtl::SinglyLinkedListNodeState<mxtl::RefPtr<ProcessDispatcher>> dll_job_;
@@ -314,6 +332,9 @@ private:
     // our list of handles
     mutable Mutex handle_table_lock_; // protects |handles_|.
     mxtl::DoublyLinkedList<Handle*> handles_ TA_GUARDED(handle_table_lock_);
+    // The length of |handles_|, also counted in |job_|.  Only changed with
+    // |handle_table_lock_| held.
+    mxtl::atomic<uint64_t> handle_count_{0};
 
     StateTracker state_tracker_;
 
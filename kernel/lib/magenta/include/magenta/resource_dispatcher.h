@@ -10,6 +10,7 @@
 #include <lib/user_copy/user_array.h>
 #include <magenta/dispatcher.h>
 #include <magenta/handle_owner.h>
+#include <magenta/object_cache.h>
 #include <magenta/state_tracker.h>
 #include <magenta/syscalls/resource.h>
 #include <magenta/thread_annotations.h>
@@ -23,6 +24,7 @@ class ResourceRecord;
 class ResourceDispatcher final : public Dispatcher,
     public mxtl::DoublyLinkedListable<mxtl::RefPtr<ResourceDispatcher>> {
 public:
+    OBJECT_CACHE_ALLOCATED(ResourceDispatcher);
     static mx_status_t Create(mxtl::RefPtr<ResourceDispatcher>* dispatcher,
                            mx_rights_t* rights, const char* name, uint16_t subtype);
 
@@ -13,6 +13,7 @@
 #include <kernel/mutex.h>
 
 #include <magenta/dispatcher.h>
+#include <magenta/object_cache.h>
 #include <magenta/state_tracker.h>
 #include <magenta/types.h>
 
@@ -34,6 +35,7 @@ constexpr int kSocketSizeMax = 128 * kMBufDataSize;
 
 class SocketDispatcher final : public Dispatcher {
 public:
+    OBJECT_CACHE_ALLOCATED(SocketDispatcher);
     static status_t Create(uint32_t flags, mxtl::RefPtr<Dispatcher>* dispatcher0,
                            mxtl::RefPtr<Dispatcher>* dispatcher1, mx_rights_t* rights);
 
@@ -82,10 +84,13 @@ private:
     status_t HalfCloseOther();
 
     mx_status_t WriteStreamMBufsLocked(user_ptr<const void> src, size_t len, size_t* written) TA_REQ(lock_);
+    mx_status_t WriteRingLocked(user_ptr<const void> src, size_t len, size_t* written) TA_REQ(lock_);
+    size_t ReadRingLocked(user_ptr<void> dst, size_t len) TA_REQ(lock_);
     mx_status_t WriteDgramMBufsLocked(user_ptr<const void> src, size_t len, size_t* written) TA_REQ(lock_);
     size_t ReadMBufsLocked(user_ptr<void> dst, size_t len) TA_REQ(lock_);
     MBuf* AllocMBuf() TA_REQ(lock_);
     void FreeMBuf(MBuf* buf) TA_REQ(lock_);
+    size_t capacity() const;
     bool is_full() const TA_REQ(lock_);
     bool is_empty() const TA_REQ(lock_);
 
@@ -95,12 +100,21 @@ private:
     mx_koid_t peer_koid_;
     StateTracker state_tracker_;
 
+    // In MX_SOCKET_RING mode the data written to this end is kept in ring_,
+    // a power of two bytes long, instead of in MBufs.
+    mxtl::RefPtr<VmObject> ring_;
+    size_t ring_size_;
+
     // The |lock_| protects all members below.
     Mutex lock_;
     mxtl::SinglyLinkedList<MBuf*> freelist_ TA_GUARDED(lock_);
     mxtl::SinglyLinkedList<MBuf*> tail_ TA_GUARDED(lock_);
     MBuf* head_ TA_GUARDED(lock_);
     size_t size_ TA_GUARDED(lock_);
+    // Offset in ring_ of the next byte to read.
+    size_t ring_read_ TA_GUARDED(lock_);
+    // Bytes at the start of ring_ that writes may have committed pages for.
+    size_t ring_committed_ TA_GUARDED(lock_);
     mxtl::RefPtr<SocketDispatcher> other_ TA_GUARDED(lock_);
     mxtl::unique_ptr<PortClient> iopc_ TA_GUARDED(lock_);
     // half_closed_[0] is this end and [1] is the other end.
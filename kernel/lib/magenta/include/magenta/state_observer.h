@@ -69,12 +69,22 @@ public:
     // is safe to delete the observer.
     virtual void OnRemoved() {}
 
+    // The signals this observer cares about. OnStateChange() is skipped when none of them
+    // changed (or were strobed), so an observer should only narrow this if it would have done
+    // nothing for a change to any other signal.
+    mx_signals_t signal_interest() const { return signal_interest_; }
+
 protected:
     ~StateObserver() {}
 
+    // Must be called before the observer is added to a StateTracker.
+    void set_signal_interest(mx_signals_t signals) { signal_interest_ = signals; }
+
 private:
     mxtl::Canary<mxtl::magic("SOBS")> canary_;
 
+    mx_signals_t signal_interest_ = ~0u;
+
     friend struct StateObserverListTraits;
     mxtl::DoublyLinkedListNodeState<StateObserver*> state_observer_list_node_state_;
 };
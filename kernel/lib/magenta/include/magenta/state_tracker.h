@@ -70,8 +70,10 @@ public:
     mx_status_t InvalidateCookie(CookieJar *cookiejar);
 
 private:
-    // Returns flag kHandled if one of the observers have been signaled.
-    StateObserver::Flags UpdateInternalLocked(ObserverList* obs_to_remove, mx_signals_t signals) TA_REQ(lock_);
+    // Calls OnStateChange() on the observers interested in |changed|. Returns flag kHandled if
+    // one of the observers have been signaled.
+    StateObserver::Flags UpdateInternalLocked(ObserverList* obs_to_remove, mx_signals_t signals,
+                                              mx_signals_t changed) TA_REQ(lock_);
 
     mxtl::Canary<mxtl::magic("STRK")> canary_;
 
@@ -80,4 +82,8 @@ private:
 
     // Active observers are elements in |observers_|.
     ObserverList observers_ TA_GUARDED(lock_);
+
+    // Union of the signal interests of |observers_|, so that changes nobody cares about skip
+    // the walk. Observers leaving the list don't shrink it; the next walk does.
+    mx_signals_t interest_ TA_GUARDED(lock_) = 0u;
 };
@@ -7,6 +7,7 @@
 #pragma once
 
 #include <magenta/dispatcher.h>
+#include <magenta/object_cache.h>
 #include <magenta/syscalls/exception.h>
 #include <magenta/user_thread.h>
 #include <mxtl/canary.h>
@@ -14,6 +15,7 @@
 
 class ThreadDispatcher : public Dispatcher {
 public:
+    OBJECT_CACHE_ALLOCATED(ThreadDispatcher);
     static status_t Create(mxtl::RefPtr<UserThread> thread, mxtl::RefPtr<Dispatcher>* dispatcher,
                            mx_rights_t* rights);
 
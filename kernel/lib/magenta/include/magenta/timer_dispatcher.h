@@ -12,6 +12,7 @@
 #include <lib/dpc.h>
 
 #include <magenta/dispatcher.h>
+#include <magenta/object_cache.h>
 #include <magenta/state_tracker.h>
 #include <mxtl/canary.h>
 
@@ -19,6 +20,7 @@
 
 class TimerDispatcher final : public Dispatcher {
 public:
+    OBJECT_CACHE_ALLOCATED(TimerDispatcher);
     static status_t Create(uint32_t options,
                            mxtl::RefPtr<Dispatcher>* dispatcher,
                            mx_rights_t* rights);
@@ -29,7 +31,7 @@ public:
     void on_zero_handles() final;
 
     // Timer specific ops.
-    mx_status_t Set(mx_time_t deadline, mx_duration_t period);
+    mx_status_t Set(mx_time_t deadline, mx_duration_t period, mx_duration_t slack);
     mx_status_t Cancel();
 
     // Timer callback.
@@ -44,6 +46,7 @@ private:
     Mutex lock_;
     mx_time_t deadline_ TA_GUARDED(lock_);
     mx_duration_t period_ TA_GUARDED(lock_);
+    mx_duration_t slack_ TA_GUARDED(lock_);
     timer_t timer_ TA_GUARDED(lock_);
     StateTracker state_tracker_;
 };
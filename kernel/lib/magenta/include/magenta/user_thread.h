@@ -17,6 +17,7 @@
 #include <magenta/exception.h>
 #include <magenta/excp_port.h>
 #include <magenta/futex_node.h>
+#include <magenta/object_cache.h>
 #include <magenta/state_tracker.h>
 
 #include <mxtl/canary.h>
@@ -31,6 +32,8 @@ class ThreadDispatcher;
 class UserThread : public mxtl::DoublyLinkedListable<UserThread*>
                  , public mxtl::RefCounted<UserThread> {
 public:
+    OBJECT_CACHE_ALLOCATED(UserThread);
+
     // state of the thread
     enum class State {
         INITIAL,     // newly created thread
@@ -97,12 +100,17 @@ public:
     ThreadDispatcher* dispatcher() { return dispatcher_; }
 
     FutexNode* futex_node() { return &futex_node_; }
+    thread_t* kernel_thread() { return &thread_; }
     StateTracker* state_tracker() { return &state_tracker_; }
     const char* name() const { return thread_.name; }
     status_t set_name(const char* name, size_t len);
     void get_name(char out_name[MX_MAX_NAME_LEN]);
     uint64_t runtime_ns() const { return thread_runtime(&thread_); }
 
+    // Move the thread into or out of the deadline scheduling class, see
+    // thread_set_deadline().
+    status_t SetDeadline(mx_duration_t runtime, mx_duration_t deadline, mx_duration_t period);
+
     status_t SetExceptionPort(ThreadDispatcher* td, mxtl::RefPtr<ExceptionPort> eport);
     // Returns true if a port had been set.
     bool ResetExceptionPort(bool quietly);
@@ -123,6 +131,9 @@ public:
                                       ExceptionStatus* out_estatus);
     // Called when an exception handler is finished processing the exception.
     status_t MarkExceptionHandled(ExceptionStatus estatus);
+    // Return true if the thread is running on a cpu other than the current
+    // one. This is only a snapshot, taken without the thread lock.
+    bool IsRunningElsewhere() const;
     // Called when exception port |eport| is removed.
     // If the thread is waiting for the associated exception handler, continue
     // exception processing as if the exception port had not been installed.
@@ -178,6 +189,9 @@ private:
     // change states of the object, do what is appropriate for the state transition
     void SetStateLocked(State) TA_REQ(state_lock_);
 
+    // MarkExceptionHandled, less remembering the handler
+    status_t MarkExceptionHandledLocked(ExceptionStatus estatus) TA_REQ(exception_wait_lock_);
+
     mxtl::Canary<mxtl::magic("UTHR")> canary_;
 
     // The kernel object id. Since ProcessDispatcher maintains a list of
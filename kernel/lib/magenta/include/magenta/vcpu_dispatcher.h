@@ -0,0 +1,35 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <magenta/guest_dispatcher.h>
+#include <magenta/object_cache.h>
+#include <mxtl/canary.h>
+
+/* A VCPU of a guest, beyond the first, which the guest handle stands for. */
+class VcpuDispatcher final : public Dispatcher {
+public:
+    OBJECT_CACHE_ALLOCATED(VcpuDispatcher);
+    static mx_status_t Create(mxtl::RefPtr<GuestDispatcher> guest,
+                              mxtl::RefPtr<FifoDispatcher> ctl_fifo,
+                              mxtl::RefPtr<Dispatcher>* dispatcher,
+                              mx_rights_t* rights);
+
+    ~VcpuDispatcher();
+
+    mx_obj_type_t get_type() const { return MX_OBJ_TYPE_VCPU; }
+
+    const mxtl::RefPtr<GuestDispatcher>& guest() const { return guest_; }
+    uint32_t id() const { return id_; }
+
+private:
+    mxtl::Canary<mxtl::magic("VCPD")> canary_;
+    mxtl::RefPtr<GuestDispatcher> guest_;
+    const uint32_t id_;
+
+    explicit VcpuDispatcher(mxtl::RefPtr<GuestDispatcher> guest, uint32_t id);
+};
@@ -7,6 +7,7 @@
 #pragma once
 
 #include <magenta/dispatcher.h>
+#include <magenta/object_cache.h>
 #include <mxtl/canary.h>
 
 #include <sys/types.h>
@@ -17,6 +18,7 @@ class VmObject;
 
 class VmAddressRegionDispatcher final : public Dispatcher {
 public:
+    OBJECT_CACHE_ALLOCATED(VmAddressRegionDispatcher);
     static status_t Create(mxtl::RefPtr<VmAddressRegion> vmar,
                            mxtl::RefPtr<Dispatcher>* dispatcher,
                            mx_rights_t* rights);
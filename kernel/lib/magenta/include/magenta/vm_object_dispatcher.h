@@ -7,9 +7,14 @@
 #pragma once
 
 #include <magenta/dispatcher.h>
+#include <magenta/object_cache.h>
 #include <magenta/state_tracker.h>
+#include <magenta/thread_annotations.h>
 #include <mxtl/canary.h>
+#include <mxtl/intrusive_double_list.h>
+#include <mxtl/unique_ptr.h>
 
+#include <kernel/mutex.h>
 #include <lib/user_copy/user_ptr.h>
 
 #include <sys/types.h>
@@ -19,6 +24,7 @@ class VmAspace;
 
 class VmObjectDispatcher : public Dispatcher {
 public:
+    OBJECT_CACHE_ALLOCATED(VmObjectDispatcher);
     static status_t Create(mxtl::RefPtr<VmObject> vmo, mxtl::RefPtr<Dispatcher>* dispatcher,
                            mx_rights_t* rights);
 
@@ -35,7 +41,8 @@ public:
                       uint64_t offset, size_t* actual);
     mx_status_t SetSize(uint64_t);
     mx_status_t GetSize(uint64_t* size);
-    mx_status_t RangeOp(uint32_t op, uint64_t offset, uint64_t size, user_ptr<void> buffer, size_t buffer_size);
+    mx_status_t RangeOp(uint32_t op, uint64_t offset, uint64_t size, user_ptr<void> buffer,
+                        size_t buffer_size, mx_rights_t rights);
     mx_status_t Clone(uint32_t options, uint64_t offset, uint64_t size, bool copy_name, mxtl::RefPtr<VmObject>* clone_vmo);
     mx_status_t SetMappingCachePolicy(uint32_t cache_policy);
 
@@ -44,12 +51,38 @@ public:
 private:
     explicit VmObjectDispatcher(mxtl::RefPtr<VmObject> vmo);
 
+    // start an MX_VMO_OP_WILLNEED commit, deasserting MX_VMO_PREFETCHED
+    // until it and any others outstanding are done
+    mx_status_t Prefetch(uint64_t offset, uint64_t size);
+    static void PrefetchDone(void* context, status_t status);
+
+    // MX_VMO_OP_PIN and MX_VMO_OP_UNPIN; a pin belongs to the process that
+    // made it and only that process can unpin it, by the same range
+    mx_status_t PinRange(uint64_t offset, uint64_t size, user_ptr<void> buffer,
+                         size_t buffer_size);
+    mx_status_t UnpinRange(uint64_t offset, uint64_t size);
+
+    struct PinRecord : public mxtl::DoublyLinkedListable<mxtl::unique_ptr<PinRecord>> {
+        mx_koid_t owner;
+        uint64_t offset;
+        uint64_t size;
+    };
+
     mxtl::Canary<mxtl::magic("VMOD")> canary_;
     mxtl::RefPtr<VmObject> vmo_;
 
-    // VMOs do not currently maintain any VMO-specific signal state,
-    // but do allow user signals to be set. In addition, the CookieJar
-    // shares the same lock.
+    // MX_VMO_PREFETCHED is the only VMO-specific signal, user signals may
+    // be set too. In addition, the CookieJar shares the same lock.
     StateTracker state_tracker_;
+
+    // prefetches queued and not yet done; MX_VMO_PREFETCHED is updated
+    // under the lock so that it follows the count
+    Mutex prefetch_lock_;
+    uint32_t prefetches_ TA_GUARDED(prefetch_lock_) = 0;
+
+    // pins made through us that haven't been unpinned yet; whatever is left
+    // is dropped when the last handle goes away
+    Mutex pin_lock_;
+    mxtl::DoublyLinkedList<mxtl::unique_ptr<PinRecord>> pins_ TA_GUARDED(pin_lock_);
     CookieJar cookie_jar_;
 };
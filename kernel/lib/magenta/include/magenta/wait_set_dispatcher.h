@@ -12,6 +12,7 @@
 #include <kernel/mutex.h>
 
 #include <magenta/dispatcher.h>
+#include <magenta/object_cache.h>
 #include <magenta/state_observer.h>
 #include <magenta/state_tracker.h>
 
@@ -25,6 +26,7 @@
 
 class WaitSetDispatcher final : public Dispatcher, public StateObserver {
 public:
+    OBJECT_CACHE_ALLOCATED(WaitSetDispatcher);
     // A wait set entry. It is always in the tree |entries_| (which owns it) and it is sometimes in
     // the doubly-linked list |triggered_entries_|.
     class Entry final : public StateObserver {
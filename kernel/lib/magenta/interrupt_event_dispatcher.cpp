@@ -12,6 +12,8 @@
 
 #include <err.h>
 
+OBJECT_CACHE(InterruptEventDispatcher, "interrupt");
+
 // Static storage
 Mutex InterruptEventDispatcher::vectors_lock_;
 InterruptEventDispatcher::VectorCollection InterruptEventDispatcher::vectors_;
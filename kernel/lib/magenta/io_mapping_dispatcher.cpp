@@ -11,6 +11,8 @@
 #include <magenta/rights.h>
 #include <mxalloc/new.h>
 
+OBJECT_CACHE(IoMappingDispatcher, "io-mapping");
+
 status_t IoMappingDispatcher::Create(const char* dbg_name,
                                      paddr_t paddr, size_t size,
                                      uint vmm_flags, uint arch_mmu_flags,
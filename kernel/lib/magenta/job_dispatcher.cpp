@@ -15,6 +15,8 @@
 #include <magenta/syscalls/policy.h>
 #include <mxalloc/new.h>
 
+OBJECT_CACHE(JobDispatcher, "job");
+
 // The starting max_height value of the root job.
 static const uint32_t kRootJobMaxHeight = 32;
 
@@ -252,6 +254,24 @@ bool JobDispatcher::EnumerateChildren(JobEnumerator* je, bool recurse) {
     return true;
 }
 
+uint64_t JobDispatcher::GetHandleCount() {
+    // Counting here rather than as handles come and go keeps the jobs above
+    // a process out of every handle table change.
+    class HandleCounter final : public JobEnumerator {
+    public:
+        bool OnProcess(ProcessDispatcher* proc) final {
+            count += proc->handle_count();
+            return true;
+        }
+
+        uint64_t count = 0;
+    };
+
+    HandleCounter counter;
+    EnumerateChildren(&counter, /* recurse */ true);
+    return counter.count;
+}
+
 mxtl::RefPtr<ProcessDispatcher> JobDispatcher::LookupProcessById(mx_koid_t koid) {
     canary_.Assert();
 
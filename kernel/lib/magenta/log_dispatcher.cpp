@@ -9,9 +9,26 @@
 #include <magenta/syscalls/log.h>
 
 #include <err.h>
+#include <kernel/vm/pmm.h>
+#include <kernel/vm/vm_address_region.h>
+#include <kernel/vm/vm_aspace.h>
+#include <kernel/vm/vm_object_physical.h>
 
 #include <mxalloc/new.h>
 
+OBJECT_CACHE(LogDispatcher, "log");
+
+namespace {
+
+// One vmo over the ring is shared by every reader. The kernel keeps it
+// mapped too, so that its cache policy can't be changed from cached to
+// anything that would disagree with the kernel's own mapping of the ring.
+Mutex ring_lock;
+mxtl::RefPtr<VmObject> ring_vmo TA_GUARDED(ring_lock);
+mxtl::RefPtr<VmMapping> ring_mapping TA_GUARDED(ring_lock);
+
+} // namespace
+
 status_t LogDispatcher::Create(uint32_t flags, mxtl::RefPtr<Dispatcher>* dispatcher,
                                mx_rights_t* rights) {
     AllocChecker ac;
@@ -72,3 +89,49 @@ status_t LogDispatcher::Read(uint32_t flags, void* ptr, size_t len, size_t* actu
     return status;
 }
 
+status_t LogDispatcher::Skip() {
+    canary_.Assert();
+
+    if (!(flags_ & MX_LOG_FLAG_READABLE))
+        return MX_ERR_BAD_STATE;
+
+    AutoLock lock(&lock_);
+
+    // Anything written from here on signals again.
+    state_tracker_.UpdateState(MX_CHANNEL_READABLE, 0);
+    dlog_reader_skip(&reader_);
+    return MX_OK;
+}
+
+status_t LogDispatcher::GetRingVmo(mxtl::RefPtr<VmObject>* vmo) {
+    canary_.Assert();
+
+    if (!(flags_ & MX_LOG_FLAG_READABLE))
+        return MX_ERR_BAD_STATE;
+
+    AutoLock lock(&ring_lock);
+
+    if (!ring_vmo) {
+        size_t size;
+        void* ring = dlog_get_ring(&size);
+
+        auto new_vmo = VmObjectPhysical::Create(vaddr_to_paddr(ring), size);
+        if (!new_vmo)
+            return MX_ERR_NO_MEMORY;
+        status_t status = new_vmo->SetMappingCachePolicy(ARCH_MMU_FLAG_CACHED);
+        if (status != MX_OK)
+            return status;
+
+        status = VmAspace::kernel_aspace()->RootVmar()->CreateVmMapping(
+            0 /* ignored */, size, 0 /* align pow2 */, 0 /* vmar flags */,
+            new_vmo, 0, ARCH_MMU_FLAG_PERM_READ, "debuglog_ring", &ring_mapping);
+        if (status != MX_OK)
+            return status;
+
+        ring_vmo = mxtl::move(new_vmo);
+    }
+
+    *vmo = ring_vmo;
+    return MX_OK;
+}
+
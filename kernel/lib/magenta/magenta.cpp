@@ -7,11 +7,16 @@
 #include <magenta/magenta.h>
 
 #include <pow2.h>
+#include <string.h>
 #include <trace.h>
 
+#include <arch/ops.h>
+
 #include <kernel/auto_lock.h>
 #include <kernel/cmdline.h>
 #include <kernel/mutex.h>
+#include <kernel/percpu_cache.h>
+#include <kernel/spinlock.h>
 
 #include <lk/init.h>
 
@@ -30,6 +35,7 @@
 #include <magenta/io_mapping_dispatcher.h>
 
 #include <mxtl/arena.h>
+#include <mxtl/atomic.h>
 #include <mxtl/intrusive_double_list.h>
 #include <mxtl/type_support.h>
 
@@ -44,14 +50,70 @@ constexpr size_t kMaxHandleCount = 256 * 1024u;
 // there are this many outstanding handles.
 constexpr size_t kHighHandleCount = (kMaxHandleCount * 7) / 8;
 
-// The handle arena and its mutex. It also guards Dispatcher::handle_count_.
+// The handle arena and its mutex.
 static Mutex handle_mutex;
 static mxtl::Arena TA_GUARDED(handle_mutex) handle_arena;
-static size_t outstanding_handles TA_GUARDED(handle_mutex) = 0u;
+
+// Slots taken out of |handle_arena|, whether they hold a handle or sit in
+// one of the caches below.
+static size_t arena_slots_allocated TA_GUARDED(handle_mutex) = 0u;
+
+static void high_handle_count(size_t count);
+
+// Where the per-cpu caches of free slots below refill from and overflow to.
+struct HandleSlotSource {
+    size_t Get(void** slots, size_t count) {
+        size_t n = 0;
+        size_t allocated;
+        {
+            AutoLock lock(&handle_mutex);
+            while (n < count) {
+                void* addr = handle_arena.Alloc();
+                if (addr == nullptr)
+                    break;
+                slots[n++] = addr;
+            }
+            arena_slots_allocated += n;
+            allocated = arena_slots_allocated;
+        }
+
+        if (n > 0 && allocated > kHighHandleCount) {
+            const size_t oh = internal::OutstandingHandles();
+            if (oh > kHighHandleCount)
+                high_handle_count(oh);
+        }
+        return n;
+    }
+
+    void Put(void* const* slots, size_t count) {
+        AutoLock lock(&handle_mutex);
+        for (size_t i = 0; i < count; i++)
+            handle_arena.Free(slots[i]);
+        arena_slots_allocated -= count;
+    }
+};
+
+static HandleSlotSource handle_slot_source;
+
+// Each cpu keeps a stack of free slots in front of |handle_arena| so that
+// making and deleting a handle doesn't usually need |handle_mutex|. Slots
+// move between a cache and the arena 32 at a time.
+static PerCpuCache<64, HandleSlotSource> handle_slots(&handle_slot_source);
+
+// LookupHandleDispatcher() makes its count odd for as long as it looks at a
+// handle, with interrupts disabled so it stays on the cpu. DeleteHandle()
+// waits for every cpu that was in a lookup to leave it before the handle's
+// dispatcher reference can be dropped.
+struct HandleReader {
+    uint32_t seq = 0u;
+} __CPU_ALIGN;
+
+static HandleReader handle_readers[SMP_MAX_CPUS];
 
 size_t internal::OutstandingHandles() {
-    AutoLock lock(&handle_mutex);
-    return outstanding_handles;
+    decltype(handle_slots)::Stats stats;
+    handle_slots.GetStats(&stats);
+    return stats.outstanding > 0 ? static_cast<size_t>(stats.outstanding) : 0u;
 }
 
 // The system exception port.
@@ -99,7 +161,7 @@ static_assert(((3 << 30) ^ kHandleGenerationMask ^ kHandleIndexMask) ==
 // Returns a new |base_value| based on the value stored in the free
 // |handle_arena| slot pointed to by |addr|. The new value will be different
 // from the last |base_value| used by this slot.
-static uint32_t GetNewHandleBaseValue(void* addr) TA_REQ(handle_mutex) {
+static uint32_t GetNewHandleBaseValue(void* addr) TA_NO_THREAD_SAFETY_ANALYSIS {
     // Get the index of this slot within handle_arena.
     auto va = reinterpret_cast<Handle*>(addr) -
               reinterpret_cast<Handle*>(handle_arena.start());
@@ -147,36 +209,94 @@ void internal::TearDownHandle(Handle *handle) TA_EXCL(handle_mutex) {
 }
 
 static void high_handle_count(size_t count) {
-    // TODO: Avoid calling this for every handle after kHighHandleCount;
-    // printfs are slow and |handle_mutex| is held by our caller.
+    // TODO: Avoid calling this for every cache refill after kHighHandleCount;
+    // printfs are slow.
     printf("WARNING: High handle count: %zu handles\n", count);
 }
 
-Handle* MakeHandle(mxtl::RefPtr<Dispatcher> dispatcher, mx_rights_t rights) {
-    uint32_t* handle_count = nullptr;
-    void* addr;
-    uint32_t base_value;
+// Returns a free slot for a new handle, or nullptr if there are none left.
+static void* AllocHandleSlot() {
+    void* addr = handle_slots.Alloc();
+    // The arena has run dry, but other cpus may still have some.
+    return (addr != nullptr) ? addr : handle_slots.Steal();
+}
 
-    {
-        AutoLock lock(&handle_mutex);
-        addr = handle_arena.Alloc();
-        if (addr == nullptr) {
-            const auto oh = outstanding_handles;
-            lock.release();
-            printf("WARNING: Could not allocate new handle (%zu outstanding)\n",
-                   oh);
-            return nullptr;
-        }
-        if (++outstanding_handles > kHighHandleCount)
-            high_handle_count(outstanding_handles);
+// Gives back a slot whose handle has been torn down.
+static void FreeHandleSlot(void* addr) {
+    handle_slots.Free(addr);
+}
 
-        handle_count = dispatcher->get_handle_count_ptr();
-        (*handle_count)++;
-        if (*handle_count != 2u)
-            handle_count = nullptr;
+// Objects with handles, and the handles to them, by object type. Each cpu
+// counts the changes made on it, so making and deleting handles doesn't
+// bounce a shared line between cpus, and the counts are summed when read.
+// A cpu's counts can go negative.
+struct ObjectCounts {
+    mxtl::atomic<int64_t> objects[MX_OBJ_TYPE_LAST];
+    mxtl::atomic<int64_t> handles[MX_OBJ_TYPE_LAST];
+} __CPU_ALIGN;
+
+static ObjectCounts object_counts[SMP_MAX_CPUS];
+
+static void CountHandle(mx_obj_type_t type, int64_t delta, bool object) {
+    DEBUG_ASSERT(type < MX_OBJ_TYPE_LAST);
+    // Moving cpus part way through only means counting on another cpu.
+    ObjectCounts& counts = object_counts[arch_curr_cpu_num()];
+    counts.handles[type].fetch_add(delta, mxtl::memory_order_relaxed);
+    if (object)
+        counts.objects[type].fetch_add(delta, mxtl::memory_order_relaxed);
+}
 
-        base_value = GetNewHandleBaseValue(addr);
+void GetKernelObjectCounts(uint32_t type, uint64_t* objects, uint64_t* handles) {
+    DEBUG_ASSERT(type < MX_OBJ_TYPE_LAST);
+    int64_t total_objects = 0;
+    int64_t total_handles = 0;
+    for (auto& counts : object_counts) {
+        total_objects += counts.objects[type].load(mxtl::memory_order_relaxed);
+        total_handles += counts.handles[type].load(mxtl::memory_order_relaxed);
     }
+    *objects = total_objects > 0 ? static_cast<uint64_t>(total_objects) : 0u;
+    *handles = total_handles > 0 ? static_cast<uint64_t>(total_handles) : 0u;
+}
+
+// Counts one more handle to |dispatcher|, returning the count if it's now
+// the one UpdateLastHandleSignal() needs to hear about.
+static uint32_t* IncrementHandleCount(Dispatcher* dispatcher) {
+    uint32_t* handle_count = dispatcher->get_handle_count_ptr();
+    uint32_t count = atomic_add(reinterpret_cast<int*>(handle_count), 1) + 1;
+
+    CountHandle(dispatcher->get_type(), 1, count == 1u);
+
+    if (count != 2u)
+        return nullptr;
+    return handle_count;
+}
+
+// Waits until no cpu is in a lookup it started before this was called.
+static void WaitForHandleReaders() {
+    // Order the caller's removal of the handle from its process before
+    // checking for readers. Pairs with the fence in LookupHandleDispatcher().
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    const uint max_cpus = arch_max_num_cpus();
+    for (uint i = 0; i < max_cpus; i++) {
+        uint32_t seq = __atomic_load_n(&handle_readers[i].seq, __ATOMIC_ACQUIRE);
+        if ((seq & 1u) == 0)
+            continue;
+        while (__atomic_load_n(&handle_readers[i].seq, __ATOMIC_ACQUIRE) == seq)
+            arch_spinloop_pause();
+    }
+}
+
+Handle* MakeHandle(mxtl::RefPtr<Dispatcher> dispatcher, mx_rights_t rights) {
+    void* addr = AllocHandleSlot();
+    if (addr == nullptr) {
+        printf("WARNING: Could not allocate new handle (%zu outstanding)\n",
+               internal::OutstandingHandles());
+        return nullptr;
+    }
+
+    uint32_t* handle_count = IncrementHandleCount(dispatcher.get());
+    uint32_t base_value = GetNewHandleBaseValue(addr);
 
     auto state_tracker = dispatcher->get_state_tracker();
     if (state_tracker != nullptr)
@@ -187,31 +307,17 @@ Handle* MakeHandle(mxtl::RefPtr<Dispatcher> dispatcher, mx_rights_t rights) {
 
 Handle* DupHandle(Handle* source, mx_rights_t rights, bool is_replace) {
     mxtl::RefPtr<Dispatcher> dispatcher(source->dispatcher());
-    uint32_t* handle_count;
-    void* addr;
-    uint32_t base_value;
-
-    {
-        AutoLock lock(&handle_mutex);
-        addr = handle_arena.Alloc();
-        if (addr == nullptr) {
-            const auto oh = outstanding_handles;
-            lock.release();
-            printf(
-                "WARNING: Could not allocate duplicate handle (%zu outstanding)\n", oh);
-            return nullptr;
-        }
-        if (++outstanding_handles > kHighHandleCount)
-            high_handle_count(outstanding_handles);
-
-        handle_count = dispatcher->get_handle_count_ptr();
-        (*handle_count)++;
-        if (*handle_count != 2u)
-            handle_count = nullptr;
 
-        base_value = GetNewHandleBaseValue(addr);
+    void* addr = AllocHandleSlot();
+    if (addr == nullptr) {
+        printf("WARNING: Could not allocate duplicate handle (%zu outstanding)\n",
+               internal::OutstandingHandles());
+        return nullptr;
     }
 
+    uint32_t* handle_count = IncrementHandleCount(dispatcher.get());
+    uint32_t base_value = GetNewHandleBaseValue(addr);
+
     auto state_tracker = dispatcher->get_state_tracker();
     if (!is_replace && (state_tracker != nullptr))
         state_tracker->UpdateLastHandleSignal(handle_count);
@@ -244,26 +350,27 @@ void DeleteHandle(Handle* handle) {
         }
     }
 
+    // The handle is out of its process already, so no new lookup can
+    // find it; wait out the ones that might have.
+    WaitForHandleReaders();
+
     // Destroys, but does not free, the Handle, and fixes up its memory
     // to protect against stale pointers to it. Also stashes the Handle's
     // base_value for reuse the next time this slot is allocated.
     internal::TearDownHandle(handle);
 
+    FreeHandleSlot(handle);
+
     bool zero_handles = false;
-    uint32_t* handle_count;
-    {
-        AutoLock lock(&handle_mutex);
-        --outstanding_handles;
+    uint32_t* handle_count = dispatcher->get_handle_count_ptr();
+    uint32_t remaining = atomic_add(reinterpret_cast<int*>(handle_count), -1) - 1;
 
-        handle_count = dispatcher->get_handle_count_ptr();
-        (*handle_count)--;
-        if (*handle_count == 0u)
-            zero_handles = true;
-        else if (*handle_count != 1u)
-            handle_count = nullptr;
+    CountHandle(dispatcher->get_type(), -1, remaining == 0u);
 
-        handle_arena.Free(handle);
-    }
+    if (remaining == 0u)
+        zero_handles = true;
+    else if (remaining != 1u)
+        handle_count = nullptr;
 
     if (zero_handles) {
         dispatcher->on_zero_handles();
@@ -277,8 +384,9 @@ void DeleteHandle(Handle* handle) {
     // gets destroyed here.
 }
 
-bool HandleInRange(void* addr) {
-    AutoLock lock(&handle_mutex);
+bool HandleInRange(void* addr) TA_NO_THREAD_SAFETY_ANALYSIS {
+    // Slots are never given back to the arena's data pool, so this doesn't
+    // need |handle_mutex|.
     return handle_arena.in_range(addr);
 }
 
@@ -291,6 +399,32 @@ Handle* MapU32ToHandle(uint32_t value) TA_NO_THREAD_SAFETY_ANALYSIS {
     return handle->base_value() == value ? handle : nullptr;
 }
 
+bool LookupHandleDispatcher(uint32_t value, mx_koid_t process_id,
+                            mxtl::RefPtr<Dispatcher>* dispatcher, mx_rights_t* rights) {
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, ARCH_DEFAULT_SPIN_LOCK_FLAG_INTERRUPTS);
+
+    HandleReader* reader = &handle_readers[arch_curr_cpu_num()];
+    __atomic_store_n(&reader->seq, reader->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    // Check the owner before the base value: a slot reused by the same
+    // process is given to it only after its new base value is set.
+    bool found = false;
+    auto index = value & kHandleIndexMask;
+    Handle* handle = &reinterpret_cast<Handle*>(handle_arena.start())[index];
+    if (HandleInRange(handle) && handle->process_id() == process_id &&
+        handle->base_value() == value) {
+        *dispatcher = handle->dispatcher();
+        *rights = handle->rights();
+        found = true;
+    }
+
+    __atomic_store_n(&reader->seq, reader->seq + 1, __ATOMIC_RELEASE);
+    arch_interrupt_restore(state, ARCH_DEFAULT_SPIN_LOCK_FLAG_INTERRUPTS);
+    return found;
+}
+
 void internal::DumpHandleTableInfo() {
     AutoLock lock(&handle_mutex);
     handle_arena.Dump();
@@ -7,10 +7,165 @@
 #include <magenta/message_packet.h>
 
 #include <err.h>
+#include <list.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <arch/ops.h>
+#include <kernel/auto_lock.h>
+#include <kernel/percpu_cache.h>
+#include <kernel/spinlock.h>
+#include <kernel/vm.h>
+#include <kernel/vm/pmm.h>
+#include <lib/heap.h>
 
 #include <magenta/handle_reaper.h>
 #include <magenta/magenta.h>
 #include <mxcpp/new.h>
+#include <mxtl/atomic.h>
+
+namespace {
+
+// Packets of up to 4 KiB, header and handles included, come from per-cpu
+// caches of free buffers, one per size class. The caches refill from and
+// overflow to a shared depot per size class, and only the depot running dry
+// or overflowing goes to the heap.
+constexpr size_t kSizeClasses[] = {64u, 256u, 1024u, 4096u};
+constexpr uint8_t kNumSizeClasses = sizeof(kSizeClasses) / sizeof(kSizeClasses[0]);
+constexpr uint8_t kHeapSizeClass = kNumSizeClasses;
+
+constexpr size_t kCacheSize = 32u;
+
+// Free buffers the depot holds on to per size class before it gives
+// buffers back to the heap.
+constexpr size_t kDepotMax = 256u;
+
+class PacketDepot {
+public:
+    explicit constexpr PacketDepot(size_t buffer_size) : buffer_size_(buffer_size) {}
+
+    size_t Get(void** buffers, size_t count) {
+        size_t n = 0;
+        {
+            AutoSpinLockIrqSave guard(lock_);
+            while (n < count && free_ != nullptr) {
+                FreeBuffer* b = free_;
+                free_ = b->next;
+                buffers[n++] = b;
+            }
+            count_ -= n;
+        }
+        if (n == 0) {
+            buffers[0] = malloc_tagged(buffer_size_, HEAP_TAG_IPC);
+            if (buffers[0] != nullptr)
+                n = 1;
+        }
+        return n;
+    }
+
+    void Put(void* const* buffers, size_t count) {
+        FreeBuffer* excess = nullptr;
+        {
+            AutoSpinLockIrqSave guard(lock_);
+            for (size_t i = 0; i < count; i++) {
+                FreeBuffer* b = static_cast<FreeBuffer*>(buffers[i]);
+                if (count_ < kDepotMax) {
+                    b->next = free_;
+                    free_ = b;
+                    count_++;
+                } else {
+                    b->next = excess;
+                    excess = b;
+                }
+            }
+        }
+        while (excess != nullptr) {
+            FreeBuffer* next = excess->next;
+            free(excess);
+            excess = next;
+        }
+    }
+
+private:
+    struct FreeBuffer {
+        FreeBuffer* next;
+    };
+
+    const size_t buffer_size_;
+
+    spin_lock_t lock_ = SPIN_LOCK_INITIAL_VALUE;
+    FreeBuffer* free_ = nullptr; // Guarded by |lock_|.
+    size_t count_ = 0;           // Guarded by |lock_|.
+};
+
+using PacketCache = PerCpuCache<kCacheSize, PacketDepot>;
+
+struct PacketSizeClass {
+    // Not explicit, so the array below can be brace initialized.
+    PacketSizeClass(size_t buffer_size) : depot(buffer_size), cache(&depot) {}
+
+    PacketDepot depot;
+    PacketCache cache;
+};
+
+PacketSizeClass size_classes[kNumSizeClasses] = {
+    {kSizeClasses[0]}, {kSizeClasses[1]}, {kSizeClasses[2]}, {kSizeClasses[3]},
+};
+static_assert(kNumSizeClasses == 4, "");
+
+// Packets created on each cpu less those destroyed on it, and likewise their
+// sizes. Both can go negative; the sums over all cpus are what's outstanding.
+struct PacketCounts {
+    mxtl::atomic<int64_t> packets;
+    mxtl::atomic<int64_t> bytes;
+} __CPU_ALIGN;
+
+PacketCounts packet_counts[SMP_MAX_CPUS];
+
+// Sits in front of each packet, outside of the MessagePacket object, so it
+// can still be read once the packet has been destroyed.
+struct PacketHeader {
+    size_t size;
+};
+static_assert(sizeof(PacketHeader) % alignof(MessagePacket) == 0, "");
+
+uint8_t SizeClassFor(size_t size) {
+    for (uint8_t i = 0; i < kNumSizeClasses; i++) {
+        if (size <= kSizeClasses[i])
+            return i;
+    }
+    return kHeapSizeClass;
+}
+
+void CountPacket(size_t size, int64_t delta) {
+    PacketCounts& counts = packet_counts[arch_curr_cpu_num()];
+    counts.packets.fetch_add(delta, mxtl::memory_order_relaxed);
+    counts.bytes.fetch_add(delta * static_cast<int64_t>(size), mxtl::memory_order_relaxed);
+}
+
+void* AllocPacketBuffer(size_t size) {
+    const uint8_t size_class = SizeClassFor(size);
+    void* buffer = (size_class == kHeapSizeClass) ? malloc_tagged(size, HEAP_TAG_IPC)
+                                                  : size_classes[size_class].cache.Alloc();
+    if (buffer != nullptr) {
+        static_cast<PacketHeader*>(buffer)->size = size;
+        CountPacket(size, 1);
+    }
+    return buffer;
+}
+
+void FreePacketBuffer(void* buffer) {
+    const size_t size = static_cast<PacketHeader*>(buffer)->size;
+    CountPacket(size, -1);
+    const uint8_t size_class = SizeClassFor(size);
+    if (size_class == kHeapSizeClass) {
+        free(buffer);
+    } else {
+        size_classes[size_class].cache.Free(buffer);
+    }
+}
+
+} // namespace
 
 // static
 mx_status_t MessagePacket::Create(uint32_t data_size, uint32_t num_handles,
@@ -21,29 +176,124 @@ mx_status_t MessagePacket::Create(uint32_t data_size, uint32_t num_handles,
         return MX_ERR_OUT_OF_RANGE;
 
     // Allocate space for the MessagePacket object followed by num_handles
-    // Handle*s followed by data_size bytes.
-    char* ptr = static_cast<char*>(malloc(sizeof(MessagePacket) +
-                                          num_handles * sizeof(Handle*) +
-                                          data_size));
+    // Handle*s followed by data_size bytes, or for large messages by an
+    // array of the pages holding the data.
+    const bool paged = data_size >= kPagedDataThreshold;
+    const size_t size = sizeof(PacketHeader) + BufferSize(data_size, num_handles, paged);
+    char* ptr = static_cast<char*>(AllocPacketBuffer(size));
     if (ptr == nullptr)
         return MX_ERR_NO_MEMORY;
+    ptr += sizeof(PacketHeader);
 
     // The storage space for the Handle*s and bytes is not initialized
     // because the only creators of MessagePackets (sys_channel_write and _call)
     // fill these arrays immediately after creation of the object.
-    msg->reset(new (ptr) MessagePacket(data_size, num_handles,
-                                       reinterpret_cast<Handle**>(ptr + sizeof(MessagePacket))));
+    mxtl::unique_ptr<MessagePacket> packet(
+        new (ptr) MessagePacket(data_size, num_handles, paged,
+                                reinterpret_cast<Handle**>(ptr + sizeof(MessagePacket))));
+
+    if (paged) {
+        list_node list = LIST_INITIAL_VALUE(list);
+        const size_t num_pages = packet->num_data_pages();
+        if (pmm_alloc_pages(num_pages, PMM_ALLOC_FLAG_ANY, &list) != num_pages) {
+            pmm_free(&list);
+            return MX_ERR_NO_MEMORY;
+        }
+        vm_page_t** pages = packet->data_pages();
+        vm_page_t* page;
+        size_t i = 0;
+        list_for_every_entry (&list, page, vm_page_t, free.node) {
+            pages[i++] = page;
+        }
+        packet->pages_allocated_ = true;
+    }
+
+    *msg = mxtl::move(packet);
     return MX_OK;
 }
 
+// static
+size_t MessagePacket::BufferSize(uint32_t data_size, uint32_t num_handles, bool paged) {
+    size_t size = sizeof(MessagePacket) + num_handles * sizeof(Handle*);
+    if (paged)
+        return size + ROUNDUP(data_size, PAGE_SIZE) / PAGE_SIZE * sizeof(vm_page_t*);
+    return size + data_size;
+}
+
+// static
+void MessagePacket::operator delete(void* ptr) {
+    // The packet has been destroyed by now, so everything needed to free it
+    // comes from the header in front of it.
+    FreePacketBuffer(static_cast<PacketHeader*>(ptr) - 1);
+}
+
+template <typename T, typename F>
+static mx_status_t ForEachDataPage(T* const* pages, uint32_t data_size, F func) {
+    for (size_t offset = 0; offset < data_size; offset += PAGE_SIZE) {
+        const size_t len = MIN(data_size - offset, PAGE_SIZE);
+        void* va = paddr_to_kvaddr(vm_page_to_paddr(pages[offset / PAGE_SIZE]));
+        mx_status_t status = func(va, offset, len);
+        if (status != MX_OK)
+            return status;
+    }
+    return MX_OK;
+}
+
+mx_status_t MessagePacket::CopyDataFromUser(user_ptr<const void> src) {
+    if (!paged_)
+        return src.copy_array_from_user(mutable_data(), data_size_);
+
+    return ForEachDataPage(data_pages(), data_size_, [src](void* va, size_t offset, size_t len) {
+        return src.byte_offset(offset).copy_array_from_user(va, len);
+    });
+}
+
+mx_status_t MessagePacket::CopyDataToUser(user_ptr<void> dst) const {
+    if (!paged_)
+        return dst.copy_array_to_user(data(), data_size_);
+
+    return ForEachDataPage(data_pages(), data_size_, [dst](void* va, size_t offset, size_t len) {
+        return dst.byte_offset(offset).copy_array_to_user(va, len);
+    });
+}
+
+mx_txid_t MessagePacket::get_txid() const {
+    if (data_size_ < sizeof(mx_txid_t))
+        return 0;
+    if (!paged_)
+        return *(reinterpret_cast<const mx_txid_t*>(data()));
+    return *static_cast<const mx_txid_t*>(paddr_to_kvaddr(vm_page_to_paddr(data_pages()[0])));
+}
+
+// static
+void MessagePacket::GetStats(size_t* packets, size_t* bytes) {
+    int64_t total_packets = 0;
+    int64_t total_bytes = 0;
+    for (auto& counts : packet_counts) {
+        total_packets += counts.packets.load(mxtl::memory_order_relaxed);
+        total_bytes += counts.bytes.load(mxtl::memory_order_relaxed);
+    }
+    *packets = total_packets > 0 ? static_cast<size_t>(total_packets) : 0u;
+    *bytes = total_bytes > 0 ? static_cast<size_t>(total_bytes) : 0u;
+}
+
 MessagePacket::~MessagePacket() {
     if (owns_handles_) {
         // Delete handles out-of-band to avoid the worst case recursive
         // destruction behavior.
         ReapHandles(handles_, num_handles_);
     }
+    if (pages_allocated_) {
+        // hand the pages back to the pmm in one go
+        list_node list = LIST_INITIAL_VALUE(list);
+        vm_page_t** pages = data_pages();
+        for (size_t i = 0; i < num_data_pages(); i++)
+            list_add_tail(&list, &pages[i]->free.node);
+        pmm_free(&list);
+    }
 }
 
-MessagePacket::MessagePacket(uint32_t data_size, uint32_t num_handles, Handle** handles)
-    : owns_handles_(false), data_size_(data_size), num_handles_(num_handles), handles_(handles) {
+MessagePacket::MessagePacket(uint32_t data_size, uint32_t num_handles, bool paged,
+                             Handle** handles)
+    : owns_handles_(false), paged_(paged), pages_allocated_(false), data_size_(data_size), num_handles_(num_handles), handles_(handles) {
 }
@@ -0,0 +1,149 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <magenta/object_cache.h>
+
+#include <arch/ops.h>
+#include <err.h>
+#include <inttypes.h>
+#include <kernel/auto_lock.h>
+#include <lib/console.h>
+#include <lib/heap.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace internal {
+
+namespace {
+
+// Caches are only ever added, at the head, so the list can be walked without
+// the lock once its head has been read.
+Mutex caches_lock;
+ObjectCacheBase* all_caches TA_GUARDED(caches_lock);
+
+} // namespace
+
+ObjectCacheBase::ObjectCacheBase(const char* name, size_t object_size)
+    : name_(name), object_size_(object_size), cpus_(this) {
+    AutoLock lock(&caches_lock);
+    next_ = all_caches;
+    all_caches = this;
+}
+
+void* ObjectCacheBase::New(size_t size, AllocChecker* ac) {
+    void* ptr;
+    if (size == object_size_) {
+        ptr = cpus_.Alloc();
+    } else {
+        __atomic_fetch_add(&heap_allocs_, 1, __ATOMIC_RELAXED);
+        ptr = malloc_tagged(size, HEAP_TAG_OBJECT);
+    }
+    ac->arm(size, ptr != nullptr);
+    return ptr;
+}
+
+void ObjectCacheBase::Delete(void* ptr, size_t size) {
+    if (ptr == nullptr)
+        return;
+    if (size == object_size_) {
+        cpus_.Free(ptr);
+    } else {
+        free(ptr);
+    }
+}
+
+size_t ObjectCacheBase::Get(void** objects, size_t count) {
+    AutoLock lock(&slab_lock_);
+    size_t n = 0;
+    while (n < count) {
+        void* ptr = AllocFromSlabLocked();
+        if (ptr == nullptr)
+            break;
+        objects[n++] = ptr;
+    }
+    slab_objects_ += n;
+    return n;
+}
+
+void ObjectCacheBase::Put(void* const* objects, size_t count) {
+    AutoLock lock(&slab_lock_);
+    for (size_t i = 0; i < count; i++)
+        FreeToSlabLocked(objects[i]);
+    slab_objects_ -= count;
+}
+
+void ObjectCacheBase::Drain() {
+    cpus_.Drain();
+}
+
+void ObjectCacheBase::Dump() {
+    CpuCaches::Stats stats;
+    cpus_.GetStats(&stats);
+
+    size_t slab_objects;
+    {
+        AutoLock lock(&slab_lock_);
+        slab_objects = slab_objects_;
+    }
+
+    printf("%-16s %6zu %10" PRIu64 " %10" PRIu64 " %8zu %8zu %8" PRIu64 "\n",
+           name_, object_size_, stats.hits + stats.misses, stats.frees,
+           slab_objects - stats.cached, stats.cached, heap_allocs_);
+}
+
+// static
+void ObjectCacheBase::DumpAll() {
+    ObjectCacheBase* cache;
+    {
+        AutoLock lock(&caches_lock);
+        cache = all_caches;
+    }
+
+    printf("%-16s %6s %10s %10s %8s %8s %8s\n",
+           "cache", "size", "allocs", "frees", "in use", "cached", "heap");
+    for (; cache != nullptr; cache = cache->next_)
+        cache->Dump();
+}
+
+// static
+void ObjectCacheBase::DrainAll() {
+    ObjectCacheBase* cache;
+    {
+        AutoLock lock(&caches_lock);
+        cache = all_caches;
+    }
+
+    for (; cache != nullptr; cache = cache->next_)
+        cache->Drain();
+}
+
+} // namespace internal
+
+#if WITH_LIB_CONSOLE
+
+static int cmd_objcache(int argc, const cmd_args* argv, uint32_t flags) {
+    if (argc < 2) {
+        internal::ObjectCacheBase::DumpAll();
+        return MX_OK;
+    }
+
+    if (!strcmp(argv[1].str, "drain")) {
+        internal::ObjectCacheBase::DrainAll();
+        return MX_OK;
+    }
+
+    printf("usage:\n");
+    printf("%s        : per-type kernel object cache statistics\n", argv[0].str);
+    printf("%s drain  : return the objects cached by each cpu to the slabs\n", argv[0].str);
+    return MX_ERR_INTERNAL;
+}
+
+STATIC_COMMAND_START
+STATIC_COMMAND("objcache", "kernel object caches", &cmd_objcache)
+STATIC_COMMAND_END(objcache);
+
+#endif // WITH_LIB_CONSOLE
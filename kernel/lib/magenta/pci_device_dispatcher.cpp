@@ -19,6 +19,8 @@
 #include <err.h>
 #include <trace.h>
 
+OBJECT_CACHE(PciDeviceDispatcher, "pci-device");
+
 status_t PciDeviceDispatcher::Create(uint32_t                  index,
                                      mx_pcie_device_info_t*    out_info,
                                      mxtl::RefPtr<Dispatcher>*  out_dispatcher,
@@ -240,4 +242,16 @@ status_t PciDeviceDispatcher::SetIrqMode(mx_pci_irq_mode_t mode, uint32_t reques
     return ret;
 }
 
+status_t PciDeviceDispatcher::SetIrqAffinity(uint32_t which_irq, uint32_t cpu_num) {
+    canary_.Assert();
+
+    AutoLock lock(&lock_);
+    DEBUG_ASSERT(device_);
+
+    if (!device_->claimed()) return MX_ERR_BAD_STATE;  // Are we not claimed yet?
+    if (which_irq >= irqs_avail_cnt_) return MX_ERR_INVALID_ARGS;
+
+    return device_->SetIrqAffinity(which_irq, cpu_num);
+}
+
 #endif  // if WITH_DEV_PCIE
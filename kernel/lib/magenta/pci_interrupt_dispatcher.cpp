@@ -12,6 +12,8 @@
 #include <magenta/rights.h>
 #include <mxalloc/new.h>
 
+OBJECT_CACHE(PciInterruptDispatcher, "pci-interrupt");
+
 PciInterruptDispatcher::~PciInterruptDispatcher() {
     if (device_) {
         // Unregister our handler.
@@ -155,6 +155,17 @@ uint32_t PolicyManager::QueryBasicPolicy(pol_cookie_t policy, uint32_t condition
     }
 }
 
+uint32_t PolicyManager::QueryAllowedConditions(pol_cookie_t policy) {
+    static_assert(MX_POL_MAX <= 32u, "allowed conditions don't fit the bitmap");
+
+    uint32_t allowed = 0u;
+    for (uint32_t condition = 0u; condition < MX_POL_MAX; ++condition) {
+        if (QueryBasicPolicy(policy, condition) == MX_POL_ACTION_ALLOW)
+            allowed |= 1u << condition;
+    }
+    return allowed;
+}
+
 uint32_t PolicyManager::GetEffectiveAction(uint64_t policy) {
     return Encoding::is_default(policy) ?
         default_action_ : Encoding::action(policy);
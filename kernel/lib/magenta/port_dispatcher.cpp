@@ -24,6 +24,8 @@
 #include <mxalloc/new.h>
 #include <mxcpp/new.h>
 
+OBJECT_CACHE(PortDispatcher, "port");
+
 IOP_Packet* IOP_Packet::Alloc(size_t size) {
     AllocChecker ac;
     auto mem = new (&ac) char [sizeof(IOP_Packet) + size];
@@ -8,6 +8,7 @@
 
 #include <assert.h>
 #include <err.h>
+#include <arch/ops.h>
 #include <platform.h>
 #include <pow2.h>
 
@@ -20,7 +21,11 @@
 
 #include <kernel/auto_lock.h>
 
-PortPacket::PortPacket() : packet{}, observer(nullptr) {
+OBJECT_CACHE(PortDispatcherV2, "port-v2");
+OBJECT_CACHE(PortObserver, "port-observer");
+OBJECT_CACHE(PortPacket, "port-packet");
+
+PortPacket::PortPacket() : packet{}, observer(nullptr), queue(0u), seq(0u) {
     // Note that packet is initialized to zeros.
 }
 
@@ -37,6 +42,12 @@ PortObserver::PortObserver(uint32_t type, Handle* handle, mxtl::RefPtr<PortDispa
     packet.key = key_;
     packet.type = type_;
     packet.signal.trigger = trigger_;
+
+    // A one-shot observer is only on the list while none of its trigger signals are
+    // asserted, so no other change can make it queue. Repeating ones queue again on
+    // any change while triggered.
+    if (type_ == MX_PKT_TYPE_SIGNAL_ONE)
+        set_signal_interest(trigger_);
 }
 
 StateObserver::Flags PortObserver::OnInitialize(mx_signals_t initial_state,
@@ -117,9 +128,10 @@ PortDispatcherV2::~PortDispatcherV2() {
 void PortDispatcherV2::on_zero_handles() {
     canary_.Assert();
 
-    {
-        AutoLock al(&lock_);
-        zero_handles_ = true;
+    zero_handles_ = true;
+    for (auto& q : queues_) {
+        AutoSpinLockIrqSave guard(q.lock);
+        q.closed = true;
     }
     while (DeQueue(0ull, nullptr) == MX_OK) {}
 }
@@ -146,69 +158,154 @@ mx_status_t PortDispatcherV2::Queue(PortPacket* port_packet,
                                     uint64_t count) {
     canary_.Assert();
 
-    int wake_count = 0;
-    {
-        AutoLock al(&lock_);
-        if (zero_handles_)
+    if (observed) {
+        // Signal packets are queued from under the state lock of the object
+        // they observe, so nothing else is queueing this packet right now.
+        // Only a reader can be taking it off the queue it was last put on.
+        CpuQueue& last = queues_[port_packet->queue];
+        AutoSpinLockIrqSave guard(last.lock);
+        if (last.closed)
             return MX_ERR_BAD_STATE;
+        if (port_packet->InContainer())
+            return MX_OK;
+        port_packet->packet.signal.observed = observed;
+        port_packet->packet.signal.count = count;
+    }
 
-        if (observed) {
-            if (port_packet->InContainer())
-                return MX_OK;
-            port_packet->packet.signal.observed = observed;
-            port_packet->packet.signal.count = count;
-        }
+    {
+        // Migrating to some other cpu in the meantime is harmless, the queue
+        // is only picked to keep producers apart.
+        uint32_t cpu = arch_curr_cpu_num();
+        CpuQueue& q = queues_[cpu];
+        AutoSpinLockIrqSave guard(q.lock);
+        if (q.closed)
+            return MX_ERR_BAD_STATE;
 
-        packets_.push_back(port_packet);
-        wake_count = sema_.Post();
+        PushLocked(cpu, q, port_packet);
     }
 
-    if (wake_count)
+    // Wakes at most one waiter, which takes whatever it finds.
+    if (sema_.Post())
         thread_reschedule();
 
     return MX_OK;
 }
 
 mx_status_t PortDispatcherV2::DeQueue(mx_time_t deadline, mx_port_packet_t* packet) {
-    canary_.Assert();
+    size_t actual;
+    return DeQueueMany(deadline, packet, 1u, &actual);
+}
 
-    PortPacket* port_packet = nullptr;
-    PortObserver* observer = nullptr;
+mx_status_t PortDispatcherV2::DeQueueMany(mx_time_t deadline, mx_port_packet_t* packets,
+                                          size_t count, size_t* actual) {
+    canary_.Assert();
+    DEBUG_ASSERT(count > 0u);
 
     while (true) {
-        {
-            AutoLock al(&lock_);
-            if (packets_.is_empty())
-                goto wait;
-
-            port_packet = packets_.pop_front();
-            observer = CopyLocked(port_packet, packet);
+        size_t taken = Take(packets, count);
+        if (taken > 0u) {
+            *actual = taken;
+            return MX_OK;
         }
 
-        if (observer)
-            delete observer;
-        else if (packet && packet->type == MX_PKT_TYPE_USER)
-            delete port_packet;
-        return MX_OK;
-
-wait:
+        // The semaphore is only a hint the queues may not be empty, a reader
+        // that found a packet without waiting leaves the count high and the
+        // next one around this loop finds nothing.
         status_t st = sema_.Wait(deadline);
         if (st != MX_OK)
             return st;
     }
 }
 
-PortObserver* PortDispatcherV2::CopyLocked(PortPacket* port_packet, mx_port_packet_t* packet) {
-    if (packet)
-        *packet = port_packet->packet;
+void PortDispatcherV2::PushLocked(uint32_t cpu, CpuQueue& q, PortPacket* port_packet) {
+    // Stamping under the lock keeps each queue in stamp order.
+    port_packet->queue = cpu;
+    port_packet->seq = next_seq_.fetch_add(1u);
+    if (q.packets.is_empty()) {
+        q.head_seq.store(port_packet->seq);
+        nonempty_.fetch_or(1u << cpu);
+    }
+    q.packets.push_back(port_packet);
+}
+
+PortPacket* PortDispatcherV2::PopLocked(uint32_t cpu, CpuQueue& q) {
+    auto port_packet = q.packets.pop_front();
+    if (port_packet == nullptr)
+        return nullptr;
+    if (q.packets.is_empty()) {
+        q.head_seq.store(kNoPacket);
+        nonempty_.fetch_and(~(1u << cpu));
+    } else {
+        q.head_seq.store(q.packets.front().seq);
+    }
+    return port_packet;
+}
+
+PortPacket* PortDispatcherV2::EraseLocked(uint32_t cpu, CpuQueue& q, PortPacket* port_packet) {
+    if (&q.packets.front() == port_packet)
+        return PopLocked(cpu, q);
+    return q.packets.erase(*port_packet);
+}
+
+size_t PortDispatcherV2::Take(mx_port_packet_t* packets, size_t count) {
+    // Packets are disposed of once all the queue locks are dropped.
+    mxtl::DoublyLinkedList<PortPacket*> reap;
+    size_t taken = 0u;
+
+    while (taken < count) {
+        // Find the queue holding the oldest packet. Another reader may get to
+        // it first, in which case it is that reader that keeps the order.
+        mp_cpu_mask_t nonempty = nonempty_.load();
+        if (nonempty == 0u)
+            break;
+        uint32_t cpu = 0u;
+        uint64_t oldest = kNoPacket;
+        for (; nonempty != 0u; nonempty &= nonempty - 1u) {
+            uint32_t ix = __builtin_ctz(nonempty);
+            uint64_t seq = queues_[ix].head_seq.load();
+            if (seq < oldest) {
+                oldest = seq;
+                cpu = ix;
+            }
+        }
+        if (oldest == kNoPacket)
+            continue;
 
-    return (port_packet->type() == MX_PKT_TYPE_USER) ? nullptr : port_packet->observer;
+        CpuQueue& q = queues_[cpu];
+        AutoSpinLockIrqSave guard(q.lock);
+        auto port_packet = PopLocked(cpu, q);
+        if (port_packet == nullptr)
+            continue;
+
+        if (packets)
+            packets[taken] = port_packet->packet;
+        ++taken;
+
+        // User packets belong to the port. Signal packets belong to their
+        // observer, which is left to the port to destroy if it was
+        // removed from its object while the packet was queued.
+        if (port_packet->type() == MX_PKT_TYPE_USER || port_packet->observer)
+            reap.push_back(port_packet);
+    }
+
+    while (!reap.is_empty()) {
+        auto port_packet = reap.pop_front();
+        if (port_packet->type() == MX_PKT_TYPE_USER)
+            delete port_packet;
+        else
+            delete port_packet->observer;
+    }
+
+    return taken;
 }
 
 bool PortDispatcherV2::CanReap(PortObserver* observer, PortPacket* port_packet) {
     canary_.Assert();
 
-    AutoLock al(&lock_);
+    // The observer is off its object, so the packet can't be queued again and
+    // is either on the queue it was last put on or on none.
+    CpuQueue& q = queues_[port_packet->queue];
+    AutoSpinLockIrqSave guard(q.lock);
     if (!port_packet->InContainer())
         return true;
     // The destruction will happen when the packet is dequeued or in CancelQueued()
@@ -243,48 +340,43 @@ mx_status_t PortDispatcherV2::MakeObservers(uint32_t options, Handle* handle,
 bool PortDispatcherV2::CancelQueued(const void* handle, uint64_t key) {
     canary_.Assert();
 
-    AutoLock al(&lock_);
-
     // This loop can take a while if there are many items.
     // In practice, the number of pending signal packets is
     // approximately the number of signaled _and_ watched
     // objects plus the number of pending user-queued
-    // packets.
-    //
-    // There are two strategies to deal with too much
-    // looping here if that is seen in practice.
-    //
-    // 1. Swap the |packets_| list for an empty list and
-    //    release the lock. New arriving packets are
-    //    added to the empty list while the loop happens.
-    //    Readers will be blocked but the watched objects
-    //    will be fully operational. Once processing
-    //    is done the lists are appended.
-    //
-    // 2. Segregate user packets from signal packets
-    //    and deliver them in order via timestamps or
-    //    a side structure.
-
-    bool packet_removed = false;
-
-    for (auto it = packets_.begin(); it != packets_.end();) {
-        if (it->observer == nullptr) {
-            ++it;
+    // packets. Only one cpu's queue is locked at a time, so
+    // producers and readers on the other cpus carry on.
+
+    mxtl::DoublyLinkedList<PortPacket*> reap;
+
+    for (uint32_t cpu = 0u; cpu < SMP_MAX_CPUS; ++cpu) {
+        if (!(nonempty_.load() & (1u << cpu)))
             continue;
-        }
 
-        auto ob_handle = it->observer->handle();
-        auto ob_key = it->observer->key();
+        CpuQueue& q = queues_[cpu];
+        AutoSpinLockIrqSave guard(q.lock);
+        for (auto it = q.packets.begin(); it != q.packets.end();) {
+            if (it->observer == nullptr) {
+                ++it;
+                continue;
+            }
+
+            auto ob_handle = it->observer->handle();
+            auto ob_key = it->observer->key();
 
-        if ((ob_handle == handle) && (ob_key == key)) {
-            auto to_remove = it;
-            ++it;
-            delete packets_.erase(to_remove)->observer;
-            packet_removed = true;
-        } else {
-            ++it;
+            if ((ob_handle == handle) && (ob_key == key)) {
+                auto to_remove = &(*it);
+                ++it;
+                reap.push_back(EraseLocked(cpu, q, to_remove));
+            } else {
+                ++it;
+            }
         }
     }
 
+    bool packet_removed = !reap.is_empty();
+    while (!reap.is_empty())
+        delete reap.pop_front()->observer;
+
     return packet_removed;
 }
@@ -38,6 +38,8 @@
 
 #include <mxalloc/new.h>
 
+OBJECT_CACHE(ProcessDispatcher, "process");
+
 #define LOCAL_TRACE 0
 
 static mx_handle_t map_handle_to_value(const Handle* handle, mx_handle_t mixer) {
@@ -56,6 +58,10 @@ static Handle* map_value_to_handle(mx_handle_t value, mx_handle_t mixer) {
     return MapU32ToHandle(handle_id);
 }
 
+static uint32_t map_value_to_base_value(mx_handle_t value, mx_handle_t mixer) {
+    return (value ^ mixer) >> 1;
+}
+
 mx_status_t ProcessDispatcher::Create(
     mxtl::RefPtr<JobDispatcher> job, mxtl::StringPiece name, uint32_t flags,
     mxtl::RefPtr<Dispatcher>* dispatcher, mx_rights_t* rights,
@@ -94,14 +100,15 @@ mx_status_t ProcessDispatcher::Create(
 ProcessDispatcher::ProcessDispatcher(mxtl::RefPtr<JobDispatcher> job,
                                      mxtl::StringPiece name,
                                      uint32_t flags)
-  : job_(mxtl::move(job)), policy_(job_->GetPolicy()), state_tracker_(0u),
+  : job_(mxtl::move(job)), policy_(job_->GetPolicy()),
+    allowed_conditions_(GetSystemPolicyManager()->QueryAllowedConditions(policy_)),
+    state_tracker_(0u),
     name_(name.data(), name.length()) {
     LTRACE_ENTRY_OBJ;
 
     // Generate handle XOR mask with top bit and bottom two bits cleared
     uint32_t secret;
-    auto prng = crypto::GlobalPRNG::GetInstance();
-    prng->Draw(&secret, sizeof(secret));
+    crypto::GlobalPRNG::Draw(&secret, sizeof(secret));
 
     // Handle values cannot be negative values, so we mask the high bit.
     handle_rand_ = (secret << 2) & INT_MAX;
@@ -320,6 +327,7 @@ void ProcessDispatcher::SetStateLocked(State s) {
             // Delete handles out-of-band to avoid the worst case recursive
             // destruction behavior.
             ReapHandles(&handles_);
+            handle_count_.store(0, mxtl::memory_order_relaxed);
         }
         LTRACEF_LEVEL(2, "done cleaning up handle table on proc %p\n", this);
 
@@ -394,6 +402,7 @@ void ProcessDispatcher::AddHandle(HandleOwner handle) {
 void ProcessDispatcher::AddHandleLocked(HandleOwner handle) {
     handle->set_process_id(get_koid());
     handles_.push_front(handle.release());
+    handle_count_.fetch_add(1, mxtl::memory_order_relaxed);
 }
 
 HandleOwner ProcessDispatcher::RemoveHandle(mx_handle_t handle_value) {
@@ -408,6 +417,7 @@ HandleOwner ProcessDispatcher::RemoveHandleLocked(mx_handle_t handle_value) {
 
     handle->set_process_id(0u);
     handles_.erase(*handle);
+    handle_count_.fetch_sub(1, mxtl::memory_order_relaxed);
 
     return HandleOwner(handle);
 }
@@ -418,24 +428,24 @@ void ProcessDispatcher::UndoRemoveHandleLocked(mx_handle_t handle_value) {
 }
 
 mx_koid_t ProcessDispatcher::GetKoidForHandle(mx_handle_t handle_value) {
-    AutoLock lock(&handle_table_lock_);
-    Handle* handle = GetHandleLocked(handle_value);
-    if (!handle)
+    mxtl::RefPtr<Dispatcher> dispatcher;
+    if (GetDispatcherInternal(handle_value, &dispatcher, nullptr) != MX_OK)
         return MX_KOID_INVALID;
-    return handle->dispatcher()->get_koid();
+    return dispatcher->get_koid();
 }
 
+// The lookups below don't take |handle_table_lock_|; see
+// LookupHandleDispatcher().
 mx_status_t ProcessDispatcher::GetDispatcherInternal(mx_handle_t handle_value,
                                                      mxtl::RefPtr<Dispatcher>* dispatcher,
                                                      mx_rights_t* rights) {
-    AutoLock lock(&handle_table_lock_);
-    Handle* handle = GetHandleLocked(handle_value);
-    if (!handle)
+    mx_rights_t handle_rights;
+    if (!LookupHandleDispatcher(map_value_to_base_value(handle_value, handle_rand_),
+                                get_koid(), dispatcher, &handle_rights))
         return MX_ERR_BAD_HANDLE;
 
-    *dispatcher = handle->dispatcher();
     if (rights)
-        *rights = handle->rights();
+        *rights = handle_rights;
     return MX_OK;
 }
 
@@ -443,17 +453,18 @@ mx_status_t ProcessDispatcher::GetDispatcherWithRightsInternal(mx_handle_t handl
                                                                mx_rights_t desired_rights,
                                                                mxtl::RefPtr<Dispatcher>* dispatcher_out,
                                                                mx_rights_t* out_rights) {
-    AutoLock lock(&handle_table_lock_);
-    Handle* handle = GetHandleLocked(handle_value);
-    if (!handle)
+    mxtl::RefPtr<Dispatcher> dispatcher;
+    mx_rights_t handle_rights;
+    if (!LookupHandleDispatcher(map_value_to_base_value(handle_value, handle_rand_),
+                                get_koid(), &dispatcher, &handle_rights))
         return MX_ERR_BAD_HANDLE;
 
-    if (!magenta_rights_check(handle, desired_rights))
+    if ((handle_rights & desired_rights) != desired_rights)
         return MX_ERR_ACCESS_DENIED;
 
-    *dispatcher_out = handle->dispatcher();
+    *dispatcher_out = mxtl::move(dispatcher);
     if (out_rights)
-        *out_rights = handle->rights();
+        *out_rights = handle_rights;
     return MX_OK;
 }
 
@@ -733,7 +744,7 @@ mx_status_t ProcessDispatcher::set_debug_addr(uintptr_t addr) {
     return MX_OK;
 }
 
-mx_status_t ProcessDispatcher::QueryPolicy(uint32_t condition) const {
+mx_status_t ProcessDispatcher::QueryPolicySlow(uint32_t condition) const {
     auto action = GetSystemPolicyManager()->QueryBasicPolicy(policy_, condition);
     if (action & MX_POL_ACTION_EXCEPTION) {
         thread_signal_exception();
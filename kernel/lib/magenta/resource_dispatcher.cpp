@@ -18,6 +18,8 @@
 #include <mxalloc/new.h>
 #include <string.h>
 
+OBJECT_CACHE(ResourceDispatcher, "resource");
+
 class ResourceRecord : public mxtl::DoublyLinkedListable<mxtl::unique_ptr<ResourceRecord>> {
 private:
     static status_t Create(mxtl::unique_ptr<ResourceRecord>& out) {
@@ -25,17 +25,27 @@
 #include <magenta/rights.h>
 #include <mxalloc/new.h>
 
+OBJECT_CACHE(SocketDispatcher, "socket");
+
 #define LOCAL_TRACE 0
 
 constexpr mx_signals_t kValidSignalMask =
     MX_SOCKET_READABLE | MX_SOCKET_PEER_CLOSED | MX_USER_SIGNAL_ALL;
 
+// A drained ring keeps at most this much of itself committed, so a socket
+// that once took a burst doesn't hold on to the pages for it while idle.
+constexpr size_t kRingRetainedSize = 64u * 1024u;
+
 size_t SocketDispatcher::MBuf::rem() const {
     return kMBufDataSize - (off_ + len_);
 }
 
+size_t SocketDispatcher::capacity() const {
+    return ring_ ? ring_size_ : kSocketSizeMax;
+}
+
 bool SocketDispatcher::is_full() const {
-    return size_ >= kSocketSizeMax;
+    return size_ >= capacity();
 }
 
 bool SocketDispatcher::is_empty() const {
@@ -74,8 +84,11 @@ SocketDispatcher::SocketDispatcher(uint32_t flags)
     : flags_(flags),
       peer_koid_(0u),
       state_tracker_(MX_SOCKET_WRITABLE),
+      ring_size_(0u),
       head_(nullptr),
       size_(0u),
+      ring_read_(0u),
+      ring_committed_(0u),
       half_closed_{false, false} {
 }
 
@@ -91,6 +104,21 @@ SocketDispatcher::~SocketDispatcher() {
 mx_status_t SocketDispatcher::Init(mxtl::RefPtr<SocketDispatcher> other) TA_NO_THREAD_SAFETY_ANALYSIS {
     other_ = mxtl::move(other);
     peer_koid_ = other_->get_koid();
+
+    if (flags_ & MX_SOCKET_RING) {
+        uint32_t order = flags_ >> 8;
+        if ((flags_ & ~MX_SOCKET_RING_ORDER(0xffu)) != MX_SOCKET_RING ||
+            order < MX_SOCKET_RING_ORDER_MIN || order > MX_SOCKET_RING_ORDER_MAX) {
+            return MX_ERR_INVALID_ARGS;
+        }
+        // Pages are only committed as the data written reaches them.
+        ring_size_ = 1ul << order;
+        ring_ = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, ring_size_);
+        if (!ring_)
+            return MX_ERR_NO_MEMORY;
+        return MX_OK;
+    }
+
     if (flags_ != MX_SOCKET_STREAM && flags_ != MX_SOCKET_DATAGRAM) {
         return MX_ERR_INVALID_ARGS;
     }
@@ -240,7 +268,9 @@ mx_status_t SocketDispatcher::WriteSelf(user_ptr<const void> src, size_t len,
 
     size_t st = 0u;
     mx_status_t status;
-    if (flags_ == MX_SOCKET_DATAGRAM) {
+    if (ring_) {
+        status = WriteRingLocked(src, len, &st);
+    } else if (flags_ == MX_SOCKET_DATAGRAM) {
         status = WriteDgramMBufsLocked(src, len, &st);
     } else {
         status = WriteStreamMBufsLocked(src, len, &st);
@@ -372,7 +402,7 @@ mx_status_t SocketDispatcher::Read(user_ptr<void> dst, size_t len,
 
     bool was_full = is_full();
 
-    auto st = ReadMBufsLocked(dst, len);
+    auto st = ring_ ? ReadRingLocked(dst, len) : ReadMBufsLocked(dst, len);
 
     if (is_empty())
         state_tracker_.UpdateState(MX_SOCKET_READABLE, 0u);
@@ -416,6 +446,60 @@ size_t SocketDispatcher::ReadMBufsLocked(user_ptr<void> dst, size_t len) {
     return pos;
 }
 
+// The data in the ring starts at ring_read_ and runs for size_ bytes,
+// wrapping around at the end, so both reads and writes are at most two
+// copies.
+mx_status_t SocketDispatcher::WriteRingLocked(user_ptr<const void> src,
+                                              size_t len, size_t* written) {
+    len = MIN(len, ring_size_ - size_);
+
+    size_t pos = 0;
+    while (pos < len) {
+        size_t offset = (ring_read_ + size_) & (ring_size_ - 1);
+        size_t copy_len = MIN(len - pos, ring_size_ - offset);
+        size_t copied;
+        status_t status = ring_->WriteUser(src.byte_offset(pos), offset, copy_len, &copied);
+        pos += copied;
+        size_ += copied;
+        ring_committed_ = MAX(ring_committed_, ROUNDUP(offset + copied, PAGE_SIZE));
+        if (status != MX_OK)
+            break;
+    }
+
+    if (pos == 0)
+        return MX_ERR_SHOULD_WAIT;
+
+    *written = pos;
+    return MX_OK;
+}
+
+size_t SocketDispatcher::ReadRingLocked(user_ptr<void> dst, size_t len) {
+    len = MIN(len, size_);
+
+    size_t pos = 0;
+    while (pos < len) {
+        size_t copy_len = MIN(len - pos, ring_size_ - ring_read_);
+        size_t copied;
+        status_t status = ring_->ReadUser(dst.byte_offset(pos), ring_read_, copy_len, &copied);
+        pos += copied;
+        size_ -= copied;
+        ring_read_ = (ring_read_ + copied) & (ring_size_ - 1);
+        if (status != MX_OK)
+            break;
+    }
+
+    // Start over at the beginning so that small messages don't wrap, and
+    // give back the pages past what a reused ring needs.
+    if (size_ == 0) {
+        ring_read_ = 0;
+        if (ring_committed_ > kRingRetainedSize) {
+            ring_->DecommitRange(kRingRetainedSize, ring_committed_ - kRingRetainedSize, nullptr);
+            ring_committed_ = kRingRetainedSize;
+        }
+    }
+    return pos;
+}
+
 SocketDispatcher::MBuf* SocketDispatcher::AllocMBuf() {
     if (freelist_.is_empty()) {
         AllocChecker ac;
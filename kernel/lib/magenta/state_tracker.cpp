@@ -51,8 +51,10 @@ void StateTracker::AddObserver(StateObserver* observer, const StateObserver::Cou
         AutoLock lock(&lock_);
 
         flags = observer->OnInitialize(signals_, cinfo);
-        if (!(flags & StateObserver::kNeedRemoval))
+        if (!(flags & StateObserver::kNeedRemoval)) {
             observers_.push_front(observer);
+            interest_ |= observer->signal_interest();
+        }
     }
     if (flags & StateObserver::kNeedRemoval)
         observer->OnRemoved();
@@ -110,7 +112,7 @@ void StateTracker::UpdateState(mx_signals_t clear_mask,
         if (previous_signals == signals_)
             return;
 
-        flags = UpdateInternalLocked(&obs_to_remove, signals_);
+        flags = UpdateInternalLocked(&obs_to_remove, signals_, previous_signals ^ signals_);
     }
 
     while (!obs_to_remove.is_empty()) {
@@ -130,8 +132,7 @@ void StateTracker::StrobeState(mx_signals_t notify_mask) {
     {
         AutoLock lock(&lock_);
         // include currently active signals as well
-        notify_mask |= signals_;
-        flags = UpdateInternalLocked(&obs_to_remove, notify_mask);
+        flags = UpdateInternalLocked(&obs_to_remove, notify_mask | signals_, notify_mask);
     }
 
     while (!obs_to_remove.is_empty()) {
@@ -164,7 +165,7 @@ void StateTracker::UpdateLastHandleSignal(uint32_t* count) {
         if (previous_signals == signals_)
             return;
 
-        flags = UpdateInternalLocked(&obs_to_remove, signals_);
+        flags = UpdateInternalLocked(&obs_to_remove, signals_, MX_SIGNAL_LAST_HANDLE);
     }
 
     while (!obs_to_remove.is_empty()) {
@@ -219,20 +220,28 @@ mx_status_t StateTracker::InvalidateCookie(CookieJar* cookiejar) {
     return MX_OK;
 }
 
-StateObserver::Flags StateTracker::UpdateInternalLocked(ObserverList* obs_to_remove, mx_signals_t signals) {
+StateObserver::Flags StateTracker::UpdateInternalLocked(ObserverList* obs_to_remove, mx_signals_t signals,
+                                                        mx_signals_t changed) {
+    if (!(changed & interest_))
+        return 0;
+
     StateObserver::Flags flags = 0;
+    mx_signals_t interest = 0u;
 
     for (auto it = observers_.begin(); it != observers_.end();) {
-        StateObserver::Flags it_flags = it->OnStateChange(signals);
+        StateObserver::Flags it_flags =
+            (changed & it->signal_interest()) ? it->OnStateChange(signals) : 0;
         flags |= it_flags;
         if (it_flags & StateObserver::kNeedRemoval) {
             auto to_remove = it;
             ++it;
             obs_to_remove->push_back(observers_.erase(to_remove));
         } else {
+            interest |= it->signal_interest();
             ++it;
         }
     }
+    interest_ = interest;
 
     // Filter out NeedRemoval flag because we processed that here
     return flags & (~StateObserver::kNeedRemoval);
@@ -219,6 +219,88 @@ bool on_cancel_by_key(void* context) {
 
 } // namespace removal
 
+// Tests for observers that narrow their signal interest
+namespace interest {
+
+class CountingObserver : public StateObserver {
+public:
+    explicit CountingObserver(mx_signals_t signals) { set_signal_interest(signals); }
+
+    // The number of times OnStateChange() has been called.
+    int changes() const { return changes_; }
+
+private:
+    Flags OnInitialize(mx_signals_t initial_state,
+                       const StateObserver::CountInfo* cinfo) override {
+        return 0;
+    }
+    Flags OnStateChange(mx_signals_t new_state) override {
+        changes_++;
+        return 0;
+    }
+    Flags OnCancel(Handle* handle) override { return 0; }
+
+    int changes_ = 0;
+};
+
+bool skips_uninteresting_changes(void* context) {
+    BEGIN_TEST;
+
+    CountingObserver narrow(2u);
+    CountingObserver wide(~0u);
+
+    StateTracker st;
+    st.AddObserver(&narrow, nullptr);
+    st.AddObserver(&wide, nullptr);
+
+    // Neither setting nor clearing other signals reaches |narrow|.
+    st.UpdateState(0, 1u);
+    st.UpdateState(1u, 4u);
+    st.StrobeState(8u);
+    EXPECT_EQ(0, narrow.changes(), "");
+    EXPECT_EQ(3, wide.changes(), "");
+
+    // Setting, clearing and strobing its own signal do.
+    st.UpdateState(0, 2u);
+    st.UpdateState(2u, 0);
+    st.StrobeState(2u);
+    EXPECT_EQ(3, narrow.changes(), "");
+    EXPECT_EQ(6, wide.changes(), "");
+
+    st.RemoveObserver(&narrow);
+    st.RemoveObserver(&wide);
+
+    END_TEST;
+}
+
+bool skips_walk_without_interest(void* context) {
+    BEGIN_TEST;
+
+    CountingObserver first(2u);
+    CountingObserver second(4u);
+
+    StateTracker st;
+    st.AddObserver(&first, nullptr);
+    st.AddObserver(&second, nullptr);
+
+    st.UpdateState(0, 1u);
+    EXPECT_EQ(0, first.changes(), "");
+    EXPECT_EQ(0, second.changes(), "");
+
+    // Once |second| is gone its signal no longer interests anyone.
+    st.RemoveObserver(&second);
+    st.UpdateState(0, 2u);
+    st.UpdateState(0, 4u);
+    EXPECT_EQ(1, first.changes(), "");
+    EXPECT_EQ(0, second.changes(), "");
+
+    st.RemoveObserver(&first);
+
+    END_TEST;
+}
+
+} // namespace interest
+
 #define ST_UNITTEST(fname) UNITTEST(#fname, fname)
 
 UNITTEST_START_TESTCASE(state_tracker_tests)
@@ -229,6 +311,8 @@ ST_UNITTEST(removal::on_state_change_via_strobe_state)
 ST_UNITTEST(removal::on_state_change_via_last_handle)
 ST_UNITTEST(removal::on_cancel)
 ST_UNITTEST(removal::on_cancel_by_key)
+ST_UNITTEST(interest::skips_uninteresting_changes)
+ST_UNITTEST(interest::skips_walk_without_interest)
 
 UNITTEST_END_TESTCASE(
     state_tracker_tests, "statetracker", "StateTracker test", nullptr, nullptr);
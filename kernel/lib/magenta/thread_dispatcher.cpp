@@ -13,6 +13,8 @@
 #include <magenta/rights.h>
 #include <mxalloc/new.h>
 
+OBJECT_CACHE(ThreadDispatcher, "thread");
+
 #define LOCAL_TRACE 0
 
 // static
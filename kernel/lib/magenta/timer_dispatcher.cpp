@@ -19,6 +19,8 @@
 
 #include <safeint/safe_math.h>
 
+OBJECT_CACHE(TimerDispatcher, "timer");
+
 constexpr mx_duration_t kMinTimerPeriod = MX_TIMER_MIN_PERIOD;
 constexpr mx_time_t     kMinTimerDeadline = MX_TIMER_MIN_DEADLINE;
 constexpr mx_duration_t kTimerCanceled = 1u;
@@ -49,7 +51,7 @@ mx_status_t TimerDispatcher::Create(uint32_t options,
 
 TimerDispatcher::TimerDispatcher(uint32_t /*options*/)
     : timer_dpc_({LIST_INITIAL_CLEARED_VALUE, &dpc_callback, this}),
-      deadline_(0u), period_(0u),
+      deadline_(0u), period_(0u), slack_(0u),
       timer_(TIMER_INITIAL_VALUE(timer_)) {
 }
 
@@ -63,7 +65,8 @@ void TimerDispatcher::on_zero_handles() {
     Cancel();
 }
 
-mx_status_t TimerDispatcher::Set(mx_time_t deadline, mx_duration_t period) {
+mx_status_t TimerDispatcher::Set(mx_time_t deadline, mx_duration_t period,
+                                 mx_duration_t slack) {
     canary_.Assert();
 
     // Deadline values 0 and 1 are special.
@@ -82,12 +85,13 @@ mx_status_t TimerDispatcher::Set(mx_time_t deadline, mx_duration_t period) {
     // is re-issued in the timer callback.
     deadline_ = deadline;
     period_ = period;
+    slack_ = slack;
 
     // We need to ref-up because the timer and the dpc don't understand
     // refcounted objects. The Release() is called either in OnTimerFired()
     // or in the complicated cancelation path above.
     AddRef();
-    timer_set_oneshot(&timer_, deadline_, &timer_irq_callback, &timer_dpc_);
+    timer_set_oneshot_etc(&timer_, deadline_, slack_, &timer_irq_callback, &timer_dpc_);
     return MX_OK;
 }
 
@@ -151,7 +155,7 @@ void TimerDispatcher::OnTimerFired() {
             if (deadline_ == 0u)
                 return;
 
-            timer_set_oneshot(&timer_, deadline_, &timer_irq_callback, &timer_dpc_);
+            timer_set_oneshot_etc(&timer_, deadline_, slack_, &timer_irq_callback, &timer_dpc_);
             return;
         } else {
             // The timer is a one-shot timer.
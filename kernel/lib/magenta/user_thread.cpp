@@ -16,8 +16,10 @@
 #include <lib/dpc.h>
 
 #include <arch/debugger.h>
+#include <arch/ops.h>
 
 #include <kernel/auto_lock.h>
+#include <kernel/mp.h>
 #include <kernel/thread.h>
 #include <kernel/vm.h>
 #include <kernel/vm/vm_aspace.h>
@@ -37,6 +39,14 @@
 
 #define LOCAL_TRACE 0
 
+// How long a thread that has sent an exception report spins waiting for the
+// response before going to sleep, while the port's handler is running on
+// another cpu. Handlers that answer quickly (profilers, breakpoint counters)
+// then resume the thread without waking it through the scheduler.
+#define EXCEPTION_SPIN_MAX_DURATION LK_USEC(20)
+
+OBJECT_CACHE(UserThread, "user_thread");
+
 UserThread::UserThread(mxtl::RefPtr<ProcessDispatcher> process,
                        uint32_t flags)
     : koid_(MX_KOID_INVALID),
@@ -55,50 +65,56 @@ void UserThread::set_dispatcher(ThreadDispatcher* dispatcher) {
     koid_ = dispatcher->get_koid();
  }
 
-UserThread::~UserThread() {
-    LTRACE_ENTRY_OBJ;
+namespace {
 
-    DEBUG_ASSERT(&thread_ != get_current_thread());
+// Kernel stacks of threads which have gone away, still mapped, committed and
+// surrounded by their guard pages, kept for the next threads created on the
+// same cpu.  Short lived threads then skip creating a VMO and a VMAR for each
+// stack, and the TLB shootdown of unmapping it afterwards.
+constexpr size_t kStackCacheSize = 4u;
 
-    switch (state_) {
-    case State::DEAD: {
-        // join the LK thread before doing anything else to clean up LK state and ensure
-        // the thread we're destroying has stopped.
-        LTRACEF("joining LK thread to clean up state\n");
-        __UNUSED auto ret = thread_join(&thread_, nullptr, INFINITE_TIME);
-        LTRACEF("done joining LK thread\n");
-        DEBUG_ASSERT_MSG(ret == MX_OK, "thread_join returned something other than MX_OK\n");
-        break;
-    }
-    case State::INITIAL:
-        // this gets a pass, we can destruct a partially constructed thread
-        break;
-    default:
-        DEBUG_ASSERT_MSG(false, "bad state %s, this %p\n", StateToString(state_), this);
-    }
+struct KernelStack {
+    mxtl::RefPtr<VmMapping> mapping;
+    mxtl::RefPtr<VmAddressRegion> vmar;
+};
 
-    // free the kernel stack
-    kstack_mapping_.reset();
-    if (kstack_vmar_) {
-        kstack_vmar_->Destroy();
-        kstack_vmar_.reset();
-    }
-#if __has_feature(safe_stack)
-    unsafe_kstack_mapping_.reset();
-    if (unsafe_kstack_vmar_) {
-        unsafe_kstack_vmar_->Destroy();
-        unsafe_kstack_vmar_.reset();
-    }
-#endif
+struct StackCache {
+    spin_lock_t lock = SPIN_LOCK_INITIAL_VALUE;
 
-    event_destroy(&exception_event_);
+    // Guarded by |lock|, indexed by whether they are unsafe stacks.
+    size_t count[2] = {};
+    KernelStack stacks[2][kStackCacheSize];
+} __CPU_ALIGN;
+
+StackCache stack_cache[SMP_MAX_CPUS];
+
+StackCache* LocalStackCache() {
+    return &stack_cache[arch_curr_cpu_num()];
 }
 
-namespace {
+bool get_cached_stack(bool unsafe,
+                      mxtl::RefPtr<VmMapping>* out_kstack_mapping,
+                      mxtl::RefPtr<VmAddressRegion>* out_kstack_vmar) {
+    StackCache* cache = LocalStackCache();
+    AutoSpinLockIrqSave guard(cache->lock);
+    if (cache->count[unsafe] == 0)
+        return false;
+
+    KernelStack* stack = &cache->stacks[unsafe][--cache->count[unsafe]];
+    *out_kstack_mapping = mxtl::move(stack->mapping);
+    *out_kstack_vmar = mxtl::move(stack->vmar);
+    return true;
+}
 
 status_t allocate_stack(const mxtl::RefPtr<VmAddressRegion>& vmar, bool unsafe,
                         mxtl::RefPtr<VmMapping>* out_kstack_mapping,
                         mxtl::RefPtr<VmAddressRegion>* out_kstack_vmar) {
+    if (get_cached_stack(unsafe, out_kstack_mapping, out_kstack_vmar)) {
+        LTRACEF("reusing %s stack at %#" PRIxPTR "\n",
+                unsafe ? "unsafe" : "safe", (*out_kstack_mapping)->base());
+        return MX_OK;
+    }
+
     LTRACEF("allocating %s stack\n", unsafe ? "unsafe" : "safe");
 
     // Create a VMO for our stack
@@ -160,8 +176,63 @@ status_t allocate_stack(const mxtl::RefPtr<VmAddressRegion>& vmar, bool unsafe,
     return MX_OK;
 }
 
+// Give back a stack from allocate_stack, caching it if there's room.  The
+// thread which ran on it must have exited.
+void free_stack(bool unsafe,
+                mxtl::RefPtr<VmMapping>* kstack_mapping,
+                mxtl::RefPtr<VmAddressRegion>* kstack_vmar) {
+    if (!*kstack_vmar)
+        return;
+
+    {
+        StackCache* cache = LocalStackCache();
+        AutoSpinLockIrqSave guard(cache->lock);
+        if (cache->count[unsafe] < kStackCacheSize) {
+            KernelStack* stack = &cache->stacks[unsafe][cache->count[unsafe]++];
+            stack->mapping = mxtl::move(*kstack_mapping);
+            stack->vmar = mxtl::move(*kstack_vmar);
+            return;
+        }
+    }
+
+    kstack_mapping->reset();
+    (*kstack_vmar)->Destroy();
+    kstack_vmar->reset();
+}
+
 };
 
+UserThread::~UserThread() {
+    LTRACE_ENTRY_OBJ;
+
+    DEBUG_ASSERT(&thread_ != get_current_thread());
+
+    switch (state_) {
+    case State::DEAD: {
+        // join the LK thread before doing anything else to clean up LK state and ensure
+        // the thread we're destroying has stopped.
+        LTRACEF("joining LK thread to clean up state\n");
+        __UNUSED auto ret = thread_join(&thread_, nullptr, INFINITE_TIME);
+        LTRACEF("done joining LK thread\n");
+        DEBUG_ASSERT_MSG(ret == MX_OK, "thread_join returned something other than MX_OK\n");
+        break;
+    }
+    case State::INITIAL:
+        // this gets a pass, we can destruct a partially constructed thread
+        break;
+    default:
+        DEBUG_ASSERT_MSG(false, "bad state %s, this %p\n", StateToString(state_), this);
+    }
+
+    // free the kernel stack
+    free_stack(false, &kstack_mapping_, &kstack_vmar_);
+#if __has_feature(safe_stack)
+    free_stack(true, &unsafe_kstack_mapping_, &unsafe_kstack_vmar_);
+#endif
+
+    event_destroy(&exception_event_);
+}
+
 // complete initialization of the thread object outside of the constructor
 status_t UserThread::Initialize(const char* name, size_t len) {
     LTRACE_ENTRY_OBJ;
@@ -241,6 +312,18 @@ status_t UserThread::set_name(const char* name, size_t len) {
     return MX_OK;
 }
 
+status_t UserThread::SetDeadline(mx_duration_t runtime, mx_duration_t deadline,
+                                 mx_duration_t period) {
+    canary_.Assert();
+
+    AutoLock lock(&state_lock_);
+
+    if (state_ == State::DEAD || state_ == State::DYING)
+        return MX_ERR_BAD_STATE;
+
+    return thread_set_deadline(&thread_, runtime, deadline, period);
+}
+
 void UserThread::get_name(char out_name[MX_MAX_NAME_LEN]) {
     canary_.Assert();
 
@@ -674,6 +757,20 @@ status_t UserThread::ExceptionHandlerExchange(
         exception_status_ = ExceptionStatus::UNPROCESSED;
     }
 
+    // Give the handler a moment to respond before blocking, for as long as
+    // it is running on another cpu; one that is asleep or waiting for ours
+    // won't answer before we block. The event auto-unsignals, so if the
+    // response arrives during the spin the wait below returns without
+    // sleeping.
+    mxtl::RefPtr<UserThread> handler = eport->handler();
+    if (handler) {
+        lk_time_t start = current_time();
+        while (!event_signaled(&exception_event_) && handler->IsRunningElsewhere() &&
+               current_time() - start < EXCEPTION_SPIN_MAX_DURATION) {
+            arch_spinloop_pause();
+        }
+    }
+
     // Continue to wait for the exception response if we get suspended.
     // If it is suspended, the suspension will be processed after the
     // exception response is received (requiring a second resume).
@@ -726,7 +823,24 @@ status_t UserThread::MarkExceptionHandled(ExceptionStatus estatus) {
     DEBUG_ASSERT(estatus != ExceptionStatus::IDLE &&
                  estatus != ExceptionStatus::UNPROCESSED);
 
-    AutoLock lock(&exception_wait_lock_);
+    mxtl::RefPtr<ExceptionPort> eport;
+    {
+        AutoLock lock(&exception_wait_lock_);
+        status_t status = MarkExceptionHandledLocked(estatus);
+        if (status != MX_OK)
+            return status;
+        eport = exception_wait_port_;
+    }
+
+    // Remember who answered, for the next exception's spin. The eport lock
+    // isn't taken under exception_wait_lock_.
+    UserThread* handler = UserThread::GetCurrent();
+    if (eport && handler)
+        eport->SetHandler(mxtl::WrapRefPtr(handler));
+    return MX_OK;
+}
+
+status_t UserThread::MarkExceptionHandledLocked(ExceptionStatus estatus) {
     if (!InExceptionLocked())
         return MX_ERR_BAD_STATE;
 
@@ -747,6 +861,11 @@ status_t UserThread::MarkExceptionHandled(ExceptionStatus estatus) {
     return MX_OK;
 }
 
+bool UserThread::IsRunningElsewhere() const {
+    const volatile thread_t* t = &thread_;
+    return t->state == THREAD_RUNNING && t->last_cpu != arch_curr_cpu_num();
+}
+
 void UserThread::OnExceptionPortRemoval(const mxtl::RefPtr<ExceptionPort>& eport) {
     canary_.Assert();
 
@@ -0,0 +1,37 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <magenta/fifo_dispatcher.h>
+#include <magenta/rights.h>
+#include <magenta/vcpu_dispatcher.h>
+#include <mxalloc/new.h>
+
+OBJECT_CACHE(VcpuDispatcher, "vcpu");
+
+// static
+mx_status_t VcpuDispatcher::Create(mxtl::RefPtr<GuestDispatcher> guest,
+                                   mxtl::RefPtr<FifoDispatcher> ctl_fifo,
+                                   mxtl::RefPtr<Dispatcher>* dispatcher,
+                                   mx_rights_t* rights) {
+    uint32_t id;
+    mx_status_t status = guest->CreateVcpu(ctl_fifo, &id);
+    if (status != MX_OK)
+        return status;
+
+    AllocChecker ac;
+    auto vcpu = mxtl::AdoptRef(new (&ac) VcpuDispatcher(guest, id));
+    if (!ac.check())
+        return MX_ERR_NO_MEMORY;
+
+    *rights = MX_DEFAULT_VCPU_RIGHTS;
+    *dispatcher = mxtl::RefPtr<Dispatcher>(vcpu.get());
+    return MX_OK;
+}
+
+VcpuDispatcher::VcpuDispatcher(mxtl::RefPtr<GuestDispatcher> guest, uint32_t id)
+    : guest_(guest), id_(id) {}
+
+VcpuDispatcher::~VcpuDispatcher() {}
@@ -19,6 +19,8 @@
 #include <inttypes.h>
 #include <trace.h>
 
+OBJECT_CACHE(VmAddressRegionDispatcher, "vmar");
+
 #define LOCAL_TRACE 0
 
 namespace {
@@ -6,9 +6,11 @@
 
 #include <magenta/vm_object_dispatcher.h>
 
+#include <kernel/auto_lock.h>
 #include <kernel/vm/vm_aspace.h>
 #include <kernel/vm/vm_object.h>
 
+#include <magenta/process_dispatcher.h>
 #include <magenta/rights.h>
 
 #include <mxalloc/new.h>
@@ -18,8 +20,14 @@
 #include <inttypes.h>
 #include <trace.h>
 
+OBJECT_CACHE(VmObjectDispatcher, "vmo");
+
 #define LOCAL_TRACE 0
 
+// MX_VMO_OP_WILLNEED ranges up to this size are committed before returning
+// rather than handed to a prefetch thread
+static constexpr uint64_t kPrefetchSyncLimit = 16 * PAGE_SIZE;
+
 status_t VmObjectDispatcher::Create(mxtl::RefPtr<VmObject> vmo,
                                     mxtl::RefPtr<Dispatcher>* dispatcher,
                                     mx_rights_t* rights) {
@@ -35,9 +43,13 @@ status_t VmObjectDispatcher::Create(mxtl::RefPtr<VmObject> vmo,
 }
 
 VmObjectDispatcher::VmObjectDispatcher(mxtl::RefPtr<VmObject> vmo)
-    : vmo_(vmo), state_tracker_(0u) {}
+    : vmo_(vmo), state_tracker_(MX_VMO_PREFETCHED) {}
 
 VmObjectDispatcher::~VmObjectDispatcher() {
+    // nobody can unpin through us anymore, so give the pages back
+    while (auto pin = pins_.pop_front())
+        vmo_->Unpin(pin->offset, pin->size);
+
     // Intentionally leave vmo_->user_id() set to our koid even though we're
     // dying and the koid will no longer map to a Dispatcher. koids are never
     // recycled, and it could be a useful breadcrumb.
@@ -86,7 +98,8 @@ mx_status_t VmObjectDispatcher::GetSize(uint64_t* size) {
 }
 
 mx_status_t VmObjectDispatcher::RangeOp(uint32_t op, uint64_t offset, uint64_t size,
-                                        user_ptr<void> buffer, size_t buffer_size) {
+                                        user_ptr<void> buffer, size_t buffer_size,
+                                        mx_rights_t rights) {
     canary_.Assert();
 
     LTRACEF("op %u offset %#" PRIx64 " size %#" PRIx64
@@ -125,11 +138,142 @@ mx_status_t VmObjectDispatcher::RangeOp(uint32_t op, uint64_t offset, uint64_t s
             return vmo_->CleanCache(offset, size);
         case MX_VMO_OP_CACHE_CLEAN_INVALIDATE:
             return vmo_->CleanInvalidateCache(offset, size);
+        case MX_VMO_OP_PIN:
+            if (!(rights & MX_RIGHT_WRITE))
+                return MX_ERR_ACCESS_DENIED;
+            return PinRange(offset, size, buffer, buffer_size);
+        case MX_VMO_OP_UNPIN:
+            if (!(rights & MX_RIGHT_WRITE))
+                return MX_ERR_ACCESS_DENIED;
+            return UnpinRange(offset, size);
+        case MX_VMO_OP_WILLNEED:
+            if (!(rights & MX_RIGHT_WRITE))
+                return MX_ERR_ACCESS_DENIED;
+            return Prefetch(offset, size);
+        case MX_VMO_OP_DONTNEED: {
+            if (!(rights & MX_RIGHT_WRITE))
+                return MX_ERR_ACCESS_DENIED;
+            // only a hint: objects that can't be reclaimed just keep their pages
+            auto status = vmo_->MarkReclaimable(offset, size);
+            return (status == MX_ERR_NOT_SUPPORTED) ? MX_OK : status;
+        }
+        case MX_VMO_OP_SEQUENTIAL:
+            vmo_->set_access_hint(VmObject::AccessHint::SEQUENTIAL);
+            return MX_OK;
+        case MX_VMO_OP_RANDOM:
+            vmo_->set_access_hint(VmObject::AccessHint::RANDOM);
+            return MX_OK;
+        case MX_VMO_OP_NORMAL:
+            vmo_->set_access_hint(VmObject::AccessHint::NORMAL);
+            return MX_OK;
+        case MX_VMO_OP_SET_NUMA_NODE: {
+            uint32_t node;
+            if (buffer_size < sizeof(node))
+                return MX_ERR_BUFFER_TOO_SMALL;
+            if (buffer.reinterpret<uint32_t>().copy_from_user(&node) != MX_OK)
+                return MX_ERR_INVALID_ARGS;
+            return vmo_->SetPreferredNode(node);
+        }
         default:
             return MX_ERR_INVALID_ARGS;
     }
 }
 
+mx_status_t VmObjectDispatcher::PinRange(uint64_t offset, uint64_t size, user_ptr<void> buffer,
+                                         size_t buffer_size) {
+    AllocChecker ac;
+    mxtl::unique_ptr<PinRecord> pin(new (&ac) PinRecord);
+    if (!ac.check())
+        return MX_ERR_NO_MEMORY;
+    pin->owner = ProcessDispatcher::GetCurrent()->get_koid();
+    pin->offset = offset;
+    pin->size = size;
+
+    auto status = vmo_->Pin(offset, size);
+    if (status != MX_OK)
+        return status;
+
+    // hand back where the pages were pinned, if asked
+    if (buffer) {
+        status = vmo_->LookupUser(offset, size, buffer.reinterpret<paddr_t>(), buffer_size);
+        if (status != MX_OK) {
+            vmo_->Unpin(offset, size);
+            return status;
+        }
+    }
+
+    AutoLock lock(&pin_lock_);
+    pins_.push_back(mxtl::move(pin));
+    return MX_OK;
+}
+
+mx_status_t VmObjectDispatcher::UnpinRange(uint64_t offset, uint64_t size) {
+    const mx_koid_t owner = ProcessDispatcher::GetCurrent()->get_koid();
+
+    mxtl::unique_ptr<PinRecord> pin;
+    {
+        AutoLock lock(&pin_lock_);
+        auto it = pins_.find_if([owner, offset, size](const PinRecord& p) {
+            return p.owner == owner && p.offset == offset && p.size == size;
+        });
+        if (!it.IsValid())
+            return MX_ERR_NOT_FOUND;
+        pin = pins_.erase(it);
+    }
+
+    auto status = vmo_->Unpin(offset, size);
+    DEBUG_ASSERT(status == MX_OK);
+    return status;
+}
+
+namespace {
+struct PrefetchContext {
+    mxtl::RefPtr<VmObjectDispatcher> dispatcher;
+};
+} // namespace
+
+mx_status_t VmObjectDispatcher::Prefetch(uint64_t offset, uint64_t size) {
+    // small ranges are cheaper to commit than to queue
+    if (size <= kPrefetchSyncLimit)
+        return vmo_->CommitRange(offset, size, nullptr);
+
+    // the context keeps us alive until the prefetch thread is done
+    AllocChecker ac;
+    auto context = new (&ac) PrefetchContext{mxtl::RefPtr<VmObjectDispatcher>(this)};
+    if (!ac.check())
+        return MX_ERR_NO_MEMORY;
+
+    AutoLock lock(&prefetch_lock_);
+
+    auto status = vmo_->CommitRangeAsync(offset, size, &PrefetchDone, context);
+    if (status != MX_OK) {
+        delete context;
+        return status;
+    }
+
+    if (prefetches_++ == 0)
+        state_tracker_.UpdateState(MX_VMO_PREFETCHED, 0u);
+
+    return MX_OK;
+}
+
+void VmObjectDispatcher::PrefetchDone(void* context, status_t status) {
+    auto prefetch = static_cast<PrefetchContext*>(context);
+    VmObjectDispatcher* dispatcher = prefetch->dispatcher.get();
+
+    LTRACEF("vmo dispatcher %p status %d\n", dispatcher, status);
+
+    {
+        AutoLock lock(&dispatcher->prefetch_lock_);
+        DEBUG_ASSERT(dispatcher->prefetches_ > 0);
+        if (--dispatcher->prefetches_ == 0)
+            dispatcher->state_tracker_.UpdateState(0u, MX_VMO_PREFETCHED);
+    }
+
+    // may drop the last reference to the dispatcher
+    delete prefetch;
+}
+
 mx_status_t VmObjectDispatcher::SetMappingCachePolicy(uint32_t cache_policy) {
     return vmo_->SetMappingCachePolicy(cache_policy);
 }
@@ -23,6 +23,8 @@
 #include <mxalloc/new.h>
 #include <mxtl/type_support.h>
 
+OBJECT_CACHE(WaitSetDispatcher, "waitset");
+
 // WaitSetDispatcher::Entry ------------------------------------------------------------------------
 
 // static
@@ -0,0 +1,70 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#ifdef __x86_64__ // entire file
+
+#include <arch/user_copy.h>
+#include "lib/mtrace.h"
+#include "trace.h"
+
+#include <magenta/device/cpu-counters.h>
+#include <magenta/mtrace.h>
+
+#include "arch/x86/perfmon.h"
+
+#define LOCAL_TRACE 0
+
+status_t mtrace_counters_control(uint32_t action, uint32_t options,
+                                 void* arg, uint32_t size) {
+    LTRACEF("action %u, options 0x%x, arg %p, size 0x%x\n",
+            action, options, arg, size);
+
+    switch (action) {
+    case MTRACE_COUNTERS_START_CPUS:
+    case MTRACE_COUNTERS_START_THREAD: {
+        if (options != 0)
+            return MX_ERR_INVALID_ARGS;
+        mx_cpu_counters_config_t config;
+        if (size != sizeof(config))
+            return MX_ERR_INVALID_ARGS;
+        if (arch_copy_from_user(&config, arg, size) != MX_OK)
+            return MX_ERR_INVALID_ARGS;
+        if (action == MTRACE_COUNTERS_START_CPUS)
+            return x86_perfmon_counters_start_cpus(&config);
+        return x86_perfmon_counters_start_thread(&config);
+    }
+
+    case MTRACE_COUNTERS_READ: {
+        mx_cpu_counters_t counters;
+        if (size != sizeof(counters))
+            return MX_ERR_INVALID_ARGS;
+        status_t status;
+        if (options == MTRACE_COUNTERS_OPTIONS_THREAD) {
+            status = x86_perfmon_counters_read_thread(&counters);
+        } else {
+            if (options != MTRACE_COUNTERS_OPTIONS_CPU(options))
+                return MX_ERR_INVALID_ARGS;
+            status = x86_perfmon_counters_read_cpu(MTRACE_COUNTERS_OPTIONS_CPU(options),
+                                                   &counters);
+        }
+        if (status != MX_OK)
+            return status;
+        if (arch_copy_to_user(arg, &counters, size) != MX_OK)
+            return MX_ERR_INVALID_ARGS;
+        return MX_OK;
+    }
+
+    case MTRACE_COUNTERS_STOP:
+        if (options != 0 || size != 0)
+            return MX_ERR_INVALID_ARGS;
+        return x86_perfmon_counters_stop();
+
+    default:
+        return MX_ERR_INVALID_ARGS;
+    }
+}
+
+#endif
@@ -0,0 +1,59 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#ifdef __x86_64__ // entire file
+
+#include <inttypes.h>
+
+#include <arch/user_copy.h>
+#include "lib/mtrace.h"
+#include "trace.h"
+
+#include <magenta/device/cpu-profile.h>
+#include <magenta/mtrace.h>
+#include <magenta/process_dispatcher.h>
+#include <magenta/vm_object_dispatcher.h>
+
+#include "arch/x86/perfmon.h"
+
+#define LOCAL_TRACE 0
+
+status_t mtrace_profile_control(uint32_t action, uint32_t options,
+                                void* arg, uint32_t size) {
+    LTRACEF("action %u, options 0x%x, arg %p, size 0x%x\n",
+            action, options, arg, size);
+
+    switch (action) {
+    case MTRACE_PROFILE_START: {
+        if (options != 0)
+            return MX_ERR_INVALID_ARGS;
+        mx_cpu_profile_config_t config;
+        if (size != sizeof(config))
+            return MX_ERR_INVALID_ARGS;
+        if (arch_copy_from_user(&config, arg, size) != MX_OK)
+            return MX_ERR_INVALID_ARGS;
+
+        mxtl::RefPtr<VmObjectDispatcher> vmo;
+        status_t status = ProcessDispatcher::GetCurrent()->GetDispatcherWithRights(
+            config.vmo, MX_RIGHT_READ | MX_RIGHT_WRITE, &vmo);
+        if (status != MX_OK)
+            return status;
+
+        LTRACEF("event %u, period %" PRIu64 "\n", config.event, config.period);
+        return x86_perfmon_profile_start(vmo->vmo(), config.event, config.period);
+    }
+
+    case MTRACE_PROFILE_STOP:
+        if (options != 0 || size != 0)
+            return MX_ERR_INVALID_ARGS;
+        return x86_perfmon_profile_stop();
+
+    default:
+        return MX_ERR_INVALID_ARGS;
+    }
+}
+
+#endif
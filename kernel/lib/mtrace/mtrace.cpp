@@ -24,6 +24,10 @@ status_t mtrace_control(uint32_t kind, uint32_t action, uint32_t options,
 #ifdef __x86_64__
     case MTRACE_KIND_IPT:
         return mtrace_ipt_control(action, options, arg, size);
+    case MTRACE_KIND_PROFILE:
+        return mtrace_profile_control(action, options, arg, size);
+    case MTRACE_KIND_COUNTERS:
+        return mtrace_counters_control(action, options, arg, size);
 #endif
     default:
         return MX_ERR_INVALID_ARGS;
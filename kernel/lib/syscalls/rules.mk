@@ -19,6 +19,7 @@ MODULE_DEPS := \
 
 MODULE_SRCS := \
     $(LOCAL_DIR)/syscalls.cpp \
+    $(LOCAL_DIR)/syscalls_batch.cpp \
     $(LOCAL_DIR)/syscalls_channel.cpp \
     $(LOCAL_DIR)/syscalls_ddk.cpp \
     $(LOCAL_DIR)/syscalls_ddk_pci.cpp \
@@ -34,6 +35,7 @@ MODULE_SRCS := \
     $(LOCAL_DIR)/syscalls_port.cpp \
     $(LOCAL_DIR)/syscalls_resource.cpp \
     $(LOCAL_DIR)/syscalls_socket.cpp \
+    $(LOCAL_DIR)/syscalls_stats.cpp \
     $(LOCAL_DIR)/syscalls_system.cpp \
     $(LOCAL_DIR)/syscalls_task.cpp \
     $(LOCAL_DIR)/syscalls_test.cpp \
@@ -18,6 +18,7 @@
 #include <stdint.h>
 
 #include "syscalls_priv.h"
+#include "syscalls_stats.h"
 #include "vdso-valid-sysret.h"
 
 #define LOCAL_TRACE 0
@@ -29,6 +30,23 @@ int sys_invalid_syscall(uint64_t num, uint64_t pc,
     return MX_ERR_BAD_SYSCALL;
 }
 
+// Hooks sysgen puts around every call into a sys_*() function, seeing its
+// first three arguments and its result. They are built in with
+// ENABLE_SYSCALL_HOOKS=true, and trace how long the call itself took,
+// from after its arguments were copied in.
+#if WITH_SYSCALL_HOOKS
+#define SYSCALL_HOOK_ENTER(name, a0, a1, a2)                                \
+    __UNUSED lk_time_t syscall_hook_start = current_time();                 \
+    ktrace(TAG_SYSCALL_ARGS, MX_SYS_##name, (uint32_t)(uint64_t)(a0),       \
+           (uint32_t)(uint64_t)(a1), (uint32_t)(uint64_t)(a2))
+#define SYSCALL_HOOK_EXIT(name, ret)                                        \
+    ktrace(TAG_SYSCALL_DONE, MX_SYS_##name, (uint32_t)(ret),                \
+           (uint32_t)((ret) >> 32), (uint32_t)(current_time() - syscall_hook_start))
+#else
+#define SYSCALL_HOOK_ENTER(name, a0, a1, a2) do {} while (0)
+#define SYSCALL_HOOK_EXIT(name, ret) do {} while (0)
+#endif
+
 inline uint64_t invoke_syscall(
     uint64_t syscall_num, uint64_t pc,
     uint64_t arg1, uint64_t arg2, uint64_t arg3, uint64_t arg4,
@@ -63,6 +81,7 @@ inline uint64_t invoke_syscall(
 
 extern "C" void arm64_syscall(struct arm64_iframe_long* frame, bool is_64bit, uint64_t pc) {
     uint64_t syscall_num = frame->r[16];
+    lk_time_t start = current_time();
 
     ktrace_tiny(TAG_SYSCALL_ENTER, ((uint32_t)syscall_num << 8) | arch_curr_cpu_num());
 
@@ -91,6 +110,8 @@ extern "C" void arm64_syscall(struct arm64_iframe_long* frame, bool is_64bit, ui
     arch_disable_ints();
 
     ktrace_tiny(TAG_SYSCALL_EXIT, ((uint32_t)syscall_num << 8) | arch_curr_cpu_num());
+
+    syscall_stats_record(syscall_num, current_time() - start);
 }
 
 #endif
@@ -105,6 +126,8 @@ extern "C" void arm64_syscall(struct arm64_iframe_long* frame, bool is_64bit, ui
 template <typename T>
 inline x86_64_syscall_result do_syscall(uint64_t syscall_num, uint64_t ip,
                                         bool (*valid_pc)(uintptr_t), T make_call) {
+    lk_time_t start = current_time();
+
     ktrace_tiny(TAG_SYSCALL_ENTER, (static_cast<uint32_t>(syscall_num) << 8) | arch_curr_cpu_num());
 
     CPU_STATS_INC(syscalls);
@@ -135,6 +158,8 @@ inline x86_64_syscall_result do_syscall(uint64_t syscall_num, uint64_t ip,
 
     ktrace_tiny(TAG_SYSCALL_EXIT, (static_cast<uint32_t>(syscall_num << 8)) | arch_curr_cpu_num());
 
+    syscall_stats_record(syscall_num, current_time() - start);
+
     // The assembler caller will re-disable interrupts at the appropriate time.
     return {ret, thread_is_signaled(get_current_thread())};
 }
@@ -0,0 +1,64 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <err.h>
+#include <inttypes.h>
+#include <trace.h>
+
+#include <magenta/syscalls/batch.h>
+
+#include <mxalloc/new.h>
+#include <mxtl/inline_array.h>
+
+#include "syscalls_priv.h"
+
+#define LOCAL_TRACE 0
+
+static mx_status_t batch_op(const mx_batch_op_t& op) {
+    switch (op.op) {
+    case MX_BATCH_OP_HANDLE_CLOSE:
+        return sys_handle_close(op.handle);
+    case MX_BATCH_OP_OBJECT_SIGNAL:
+        return sys_object_signal(op.handle, static_cast<uint32_t>(op.args[0]),
+                                 static_cast<uint32_t>(op.args[1]));
+    case MX_BATCH_OP_OBJECT_SIGNAL_PEER:
+        return sys_object_signal_peer(op.handle, static_cast<uint32_t>(op.args[0]),
+                                      static_cast<uint32_t>(op.args[1]));
+    case MX_BATCH_OP_PORT_QUEUE: {
+        auto packet = reinterpret_cast<const void*>(static_cast<uintptr_t>(op.args[0]));
+        return sys_port_queue(op.handle, make_user_ptr(packet), static_cast<size_t>(op.args[1]));
+    }
+    case MX_BATCH_OP_VMO_OP_RANGE:
+        // There is no buffer, so MX_VMO_OP_LOOKUP fails here.
+        return sys_vmo_op_range(op.handle, static_cast<uint32_t>(op.args[0]),
+                                op.args[1], op.args[2], make_user_ptr<void>(nullptr), 0u);
+    default:
+        return MX_ERR_NOT_SUPPORTED;
+    }
+}
+
+// Unlike the *_many syscalls every operation is run, whether or not the ones
+// before it succeeded, since they are not expected to depend on each other.
+mx_status_t sys_batch_submit(user_ptr<mx_batch_op_t> _ops, uint32_t count) {
+    LTRACEF("ops %p count %u\n", _ops.get(), count);
+
+    if (!_ops || count == 0u || count > kMaxBatchCount)
+        return MX_ERR_INVALID_ARGS;
+
+    AllocChecker ac;
+    mxtl::InlineArray<mx_batch_op_t, kSyscallInlineCount> ops(&ac, count);
+    if (!ac.check())
+        return MX_ERR_NO_MEMORY;
+    if (_ops.copy_array_from_user(ops.get(), count) != MX_OK)
+        return MX_ERR_INVALID_ARGS;
+
+    for (uint32_t i = 0; i < count; ++i)
+        ops[i].status = batch_op(ops[i]);
+
+    if (_ops.copy_array_to_user(ops.get(), count) != MX_OK)
+        return MX_ERR_INVALID_ARGS;
+    return MX_OK;
+}
@@ -22,6 +22,7 @@
 #include <magenta/user_copy.h>
 
 #include <mxtl/algorithm.h>
+#include <mxtl/inline_array.h>
 #include <mxtl/ref_ptr.h>
 
 #include "syscalls_priv.h"
@@ -30,7 +31,7 @@
 
 static mx_status_t channel_call_epilogue(ProcessDispatcher* up,
                                          mxtl::unique_ptr<MessagePacket> reply,
-                                         mx_channel_call_args_t* args,
+                                         const mx_channel_call_args_t* args,
                                          mx_status_t call_status,
                                          user_ptr<uint32_t> actual_bytes,
                                          user_ptr<uint32_t> actual_handles,
@@ -135,7 +136,7 @@ mx_status_t sys_channel_read(mx_handle_t handle_value, uint32_t options,
         return result;
 
     if (num_bytes > 0u) {
-        if (_bytes.copy_array_to_user(msg->data(), num_bytes) != MX_OK)
+        if (msg->CopyDataToUser(_bytes) != MX_OK)
             return MX_ERR_INVALID_ARGS;
     }
 
@@ -198,6 +199,42 @@ static mx_status_t msg_put_handles(ProcessDispatcher* up, MessagePacket* msg, mx
     return MX_OK;
 }
 
+// Writes one message to |channel|, taking the handles out of the process
+// only if the write succeeds.
+static mx_status_t channel_write_one(ProcessDispatcher* up, ChannelDispatcher* channel,
+                                     user_ptr<const void> _bytes, uint32_t num_bytes,
+                                     user_ptr<const mx_handle_t> _handles, uint32_t num_handles) {
+    mxtl::unique_ptr<MessagePacket> msg;
+    mx_status_t result = MessagePacket::Create(num_bytes, num_handles, &msg);
+    if (result != MX_OK)
+        return result;
+
+    if (num_bytes > 0u) {
+        if (msg->CopyDataFromUser(_bytes) != MX_OK)
+            return MX_ERR_INVALID_ARGS;
+    }
+
+    mx_handle_t handles[kMaxMessageHandles];
+    if (num_handles > 0u) {
+        result = msg_put_handles(up, msg.get(), handles, _handles, num_handles,
+                                 static_cast<Dispatcher*>(channel));
+        if (result)
+            return result;
+    }
+
+    result = channel->Write(mxtl::move(msg));
+    if (result != MX_OK) {
+        // Write failed, put back the handles into this process.
+        AutoLock lock(up->handle_table_lock());
+        for (size_t ix = 0; ix != num_handles; ++ix) {
+            up->UndoRemoveHandleLocked(handles[ix]);
+        }
+    }
+
+    ktrace(TAG_CHANNEL_WRITE, (uint32_t)channel->get_koid(), num_bytes, num_handles, 0);
+    return result;
+}
+
 mx_status_t sys_channel_write(mx_handle_t handle_value, uint32_t options,
                               user_ptr<const void> _bytes, uint32_t num_bytes,
                               user_ptr<const mx_handle_t> _handles, uint32_t num_handles) {
@@ -214,54 +251,124 @@ mx_status_t sys_channel_write(mx_handle_t handle_value, uint32_t options,
     if (result != MX_OK)
         return result;
 
+    return channel_write_one(up, channel.get(), _bytes, num_bytes, _handles, num_handles);
+}
 
+// Reads the next message of |channel| into the user buffers. The message is
+// left in the channel if it doesn't fit, and its sizes are returned.
+static mx_status_t channel_read_one(ProcessDispatcher* up, ChannelDispatcher* channel,
+                                    user_ptr<void> _bytes, user_ptr<mx_handle_t> _handles,
+                                    uint32_t* num_bytes, uint32_t* num_handles) {
     mxtl::unique_ptr<MessagePacket> msg;
-    result = MessagePacket::Create(num_bytes, num_handles, &msg);
+    mx_status_t result = channel->Read(num_bytes, num_handles, &msg, false);
     if (result != MX_OK)
         return result;
 
-    if (num_bytes > 0u) {
-        if (_bytes.copy_array_from_user(msg->mutable_data(), num_bytes) != MX_OK)
+    if (*num_bytes > 0u) {
+        if (msg->CopyDataToUser(_bytes) != MX_OK)
             return MX_ERR_INVALID_ARGS;
     }
+    if (*num_handles > 0u)
+        msg_get_handles(up, msg.get(), _handles, *num_handles);
 
-    mx_handle_t handles[kMaxMessageHandles];
-    if (num_handles > 0u) {
-        result = msg_put_handles(up, msg.get(), handles, _handles, num_handles,
-                                 static_cast<Dispatcher*>(channel.get()));
-        if (result)
-            return result;
-    }
+    ktrace(TAG_CHANNEL_READ, (uint32_t)channel->get_koid(), *num_bytes, *num_handles, 0);
+    return MX_OK;
+}
 
-    result = channel->Write(mxtl::move(msg));
-    if (result != MX_OK) {
-        // Write failed, put back the handles into this process.
-        AutoLock lock(up->handle_table_lock());
-        for (size_t ix = 0; ix != num_handles; ++ix) {
-            up->UndoRemoveHandleLocked(handles[ix]);
+// Runs |op| on each of the messages described by |_msgs|, in order, stopping
+// at the first that fails. Consecutive messages for the same channel look
+// the channel up only once.
+template <typename Op>
+static mx_status_t channel_batch(mx_rights_t rights, user_ptr<mx_channel_msg_t> _msgs,
+                                 uint32_t count, user_ptr<uint32_t> _actual, Op op) {
+    if (!_msgs || count == 0u || count > kMaxBatchCount)
+        return MX_ERR_INVALID_ARGS;
+
+    AllocChecker ac;
+    mxtl::InlineArray<mx_channel_msg_t, kSyscallInlineCount> msgs(&ac, count);
+    if (!ac.check())
+        return MX_ERR_NO_MEMORY;
+    if (_msgs.copy_array_from_user(msgs.get(), count) != MX_OK)
+        return MX_ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<ChannelDispatcher> channel;
+    mx_handle_t channel_handle = MX_HANDLE_INVALID;
+    uint32_t done = 0;
+    mx_status_t result = MX_OK;
+    for (; done < count; ++done) {
+        mx_channel_msg_t& msg = msgs[done];
+        if (!channel || msg.channel != channel_handle) {
+            channel.reset();
+            result = up->GetDispatcherWithRights(msg.channel, rights, &channel);
+            if (result != MX_OK) {
+                msg.status = result;
+                break;
+            }
+            channel_handle = msg.channel;
         }
+
+        result = op(up, channel.get(), &msg);
+        msg.status = result;
+        if (result != MX_OK)
+            break;
     }
 
-    ktrace(TAG_CHANNEL_WRITE, (uint32_t)channel->get_koid(), num_bytes, num_handles, 0);
-    return result;
+    // Report back on the messages moved and the one that stopped us.
+    const uint32_t reported = (done < count) ? done + 1 : done;
+    if (_msgs.copy_array_to_user(msgs.get(), reported) != MX_OK)
+        return MX_ERR_INVALID_ARGS;
+    if (_actual.copy_to_user(done) != MX_OK)
+        return MX_ERR_INVALID_ARGS;
+
+    return done > 0 ? MX_OK : result;
+}
+
+mx_status_t sys_channel_read_many(uint32_t options, user_ptr<mx_channel_msg_t> _msgs,
+                                  uint32_t count, user_ptr<uint32_t> _actual) {
+    LTRACEF("msgs %p count %u options 0x%x\n", _msgs.get(), count, options);
+
+    if (options)
+        return MX_ERR_INVALID_ARGS;
+
+    return channel_batch(MX_RIGHT_READ, _msgs, count, _actual,
+                         [](ProcessDispatcher* up, ChannelDispatcher* channel,
+                            mx_channel_msg_t* msg) {
+        return channel_read_one(up, channel, make_user_ptr(msg->bytes),
+                                make_user_ptr(msg->handles), &msg->num_bytes,
+                                &msg->num_handles);
+    });
+}
+
+mx_status_t sys_channel_write_many(uint32_t options, user_ptr<mx_channel_msg_t> _msgs,
+                                   uint32_t count, user_ptr<uint32_t> _actual) {
+    LTRACEF("msgs %p count %u options 0x%x\n", _msgs.get(), count, options);
+
+    if (options)
+        return MX_ERR_INVALID_ARGS;
+
+    return channel_batch(MX_RIGHT_WRITE, _msgs, count, _actual,
+                         [](ProcessDispatcher* up, ChannelDispatcher* channel,
+                            mx_channel_msg_t* msg) {
+        return channel_write_one(up, channel, make_user_ptr<const void>(msg->bytes),
+                                 msg->num_bytes,
+                                 make_user_ptr<const mx_handle_t>(msg->handles),
+                                 msg->num_handles);
+    });
 }
 
 mx_status_t sys_channel_call_noretry(mx_handle_t handle_value, uint32_t options,
                                      mx_time_t deadline,
-                                     user_ptr<const mx_channel_call_args_t> _args,
+                                     const mx_channel_call_args_t* args,
                                      user_ptr<uint32_t> actual_bytes,
                                      user_ptr<uint32_t> actual_handles,
                                      user_ptr<mx_status_t> read_status) {
-    mx_channel_call_args_t args;
-
-    if (_args.copy_from_user(&args) != MX_OK)
-        return MX_ERR_INVALID_ARGS;
-
     if (options)
         return MX_ERR_INVALID_ARGS;
 
-    uint32_t num_bytes = args.wr_num_bytes;
-    uint32_t num_handles = args.wr_num_handles;
+    uint32_t num_bytes = args->wr_num_bytes;
+    uint32_t num_handles = args->wr_num_handles;
 
     auto up = ProcessDispatcher::GetCurrent();
 
@@ -277,14 +384,14 @@ mx_status_t sys_channel_call_noretry(mx_handle_t handle_value, uint32_t options,
         return result;
 
     if (num_bytes > 0u) {
-        if (make_user_ptr(args.wr_bytes).copy_array_from_user(msg->mutable_data(), num_bytes) != MX_OK)
+        if (msg->CopyDataFromUser(make_user_ptr<const void>(args->wr_bytes)) != MX_OK)
             return MX_ERR_INVALID_ARGS;
     }
 
     mx_handle_t handles[kMaxMessageHandles];
     if (num_handles > 0u) {
         result = msg_put_handles(up, msg.get(), handles,
-                                 make_user_ptr<const mx_handle_t>(args.wr_handles), num_handles,
+                                 make_user_ptr<const mx_handle_t>(args->wr_handles), num_handles,
                                  static_cast<Dispatcher*>(channel.get()));
         if (result)
             return result;
@@ -307,20 +414,16 @@ mx_status_t sys_channel_call_noretry(mx_handle_t handle_value, uint32_t options,
             return result;
         }
     }
-    return channel_call_epilogue(up, mxtl::move(reply), &args, result,
+    return channel_call_epilogue(up, mxtl::move(reply), args, result,
                                  actual_bytes, actual_handles, read_status);
 }
 
 mx_status_t sys_channel_call_finish(mx_handle_t handle_value, mx_time_t deadline,
-                                    user_ptr<const mx_channel_call_args_t> _args,
+                                    const mx_channel_call_args_t* args,
                                     user_ptr<uint32_t> actual_bytes,
                                     user_ptr<uint32_t> actual_handles,
                                     user_ptr<mx_status_t> read_status) {
 
-    mx_channel_call_args_t args;
-    if (_args.copy_from_user(&args) != MX_OK)
-        return MX_ERR_INVALID_ARGS;
-
     auto up = ProcessDispatcher::GetCurrent();
 
     mxtl::RefPtr<ChannelDispatcher> channel;
@@ -330,7 +433,7 @@ mx_status_t sys_channel_call_finish(mx_handle_t handle_value, mx_time_t deadline
 
     mxtl::unique_ptr<MessagePacket> reply;
     result = channel->ResumeInterruptedCall(deadline, &reply);
-    return channel_call_epilogue(up, mxtl::move(reply), &args, result,
+    return channel_call_epilogue(up, mxtl::move(reply), args, result,
                                  actual_bytes, actual_handles, read_status);
 
 }
@@ -338,7 +441,7 @@ mx_status_t sys_channel_call_finish(mx_handle_t handle_value, mx_time_t deadline
 // Handles generating the final results for call successes and read-half failures.
 mx_status_t channel_call_epilogue(ProcessDispatcher* up,
                                   mxtl::unique_ptr<MessagePacket> reply,
-                                  mx_channel_call_args_t* args,
+                                  const mx_channel_call_args_t* args,
                                   mx_status_t call_status,
                                   user_ptr<uint32_t> actual_bytes,
                                   user_ptr<uint32_t> actual_handles,
@@ -373,7 +476,7 @@ mx_status_t channel_call_epilogue(ProcessDispatcher* up,
     }
 
     if (num_bytes > 0u) {
-        if (make_user_ptr(args->rd_bytes).copy_array_to_user(reply->data(), num_bytes) != MX_OK) {
+        if (reply->CopyDataToUser(make_user_ptr(args->rd_bytes)) != MX_OK) {
             call_status = MX_ERR_INVALID_ARGS;
             goto read_failed;
         }
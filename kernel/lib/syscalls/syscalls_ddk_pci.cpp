@@ -639,6 +639,27 @@ mx_status_t sys_pci_set_irq_mode(mx_handle_t dev_handle,
 
     return pci_device->SetIrqMode((mx_pci_irq_mode_t)mode, requested_irq_count);
 }
+
+/**
+ * Steers one of a PCI device's IRQs to a CPU.
+ * @param handle Handle associated with a PCI device.
+ * @param which_irq The IRQ to steer, as for sys_pci_map_interrupt.
+ * @param cpu_num The CPU which should take the IRQ.
+ */
+mx_status_t sys_pci_set_irq_affinity(mx_handle_t dev_handle,
+                                     uint32_t which_irq,
+                                     uint32_t cpu_num) {
+    LTRACEF("handle %d\n", dev_handle);
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<PciDeviceDispatcher> pci_device;
+    mx_status_t status = up->GetDispatcherWithRights(dev_handle, MX_RIGHT_WRITE, &pci_device);
+    if (status != MX_OK)
+        return status;
+
+    return pci_device->SetIrqAffinity(which_irq, cpu_num);
+}
 #else  // WITH_DEV_PCIE
 mx_status_t sys_pci_init(mx_handle_t, user_ptr<const mx_pci_init_arg_t>, uint32_t) {
     shutdown_early_init_console();
@@ -696,4 +717,8 @@ mx_status_t sys_pci_query_irq_mode_caps(mx_handle_t, uint32_t, user_ptr<uint32_t
 mx_status_t sys_pci_set_irq_mode(mx_handle_t, uint32_t, uint32_t) {
     return MX_ERR_NOT_SUPPORTED;
 }
+
+mx_status_t sys_pci_set_irq_affinity(mx_handle_t, uint32_t, uint32_t) {
+    return MX_ERR_NOT_SUPPORTED;
+}
 #endif // WITH_DEV_PCIE
@@ -144,7 +144,9 @@ mx_status_t sys_ktrace_control(
     }
 
     switch (action) {
-    case KTRACE_ACTION_NEW_PROBE: {
+    case KTRACE_ACTION_NEW_PROBE:
+    case KTRACE_ACTION_ENABLE_PROBE:
+    case KTRACE_ACTION_DISABLE_PROBE: {
         char name[MX_MAX_NAME_LEN];
         if (_ptr.copy_array_from_user(name, sizeof(name) - 1) != MX_OK)
             return MX_ERR_INVALID_ARGS;
@@ -167,14 +169,16 @@ mx_status_t sys_ktrace_write(mx_handle_t handle, uint32_t event_id, uint32_t arg
         return MX_ERR_INVALID_ARGS;
     }
 
-    uint32_t* args = static_cast<uint32_t*>(ktrace_open(TAG_PROBE_24(event_id)));
-    if (!args) {
+    // a probe that has been switched off is not a failure
+    if (!ktrace_probe_is_enabled(event_id)) {
+        return MX_OK;
+    }
+
+    if (!ktrace_record(TAG_PROBE_24(event_id), arg0, arg1, 0, 0)) {
         //  There is not a single reason for failure. Assume it reached the end.
         return MX_ERR_UNAVAILABLE;
     }
 
-    args[0] = arg0;
-    args[1] = arg1;
     return MX_OK;
 }
 
@@ -60,7 +60,8 @@ static mx_status_t object_unbind_exception_port(mx_handle_t obj_handle, bool deb
     return MX_ERR_WRONG_TYPE;
 }
 
-static mx_status_t task_bind_exception_port(mx_handle_t obj_handle, mx_handle_t eport_handle, uint64_t key, bool debugger) {
+static mx_status_t task_bind_exception_port(mx_handle_t obj_handle, mx_handle_t eport_handle, uint64_t key,
+                                            bool debugger, bool async_thread_events) {
     //TODO: check rights once appropriate right is determined
     auto up = ProcessDispatcher::GetCurrent();
 
@@ -76,7 +77,7 @@ static mx_status_t task_bind_exception_port(mx_handle_t obj_handle, mx_handle_t
         if (debugger)
             return MX_ERR_INVALID_ARGS;
         status = ExceptionPort::Create(ExceptionPort::Type::SYSTEM,
-                                       mxtl::move(ioport), key, &eport);
+                                       mxtl::move(ioport), key, false, &eport);
         if (status != MX_OK)
             return status;
         status = SetSystemExceptionPort(eport);
@@ -99,7 +100,8 @@ static mx_status_t task_bind_exception_port(mx_handle_t obj_handle, mx_handle_t
             type = ExceptionPort::Type::DEBUGGER;
         else
             type = ExceptionPort::Type::PROCESS;
-        status = ExceptionPort::Create(type, mxtl::move(ioport), key, &eport);
+        status = ExceptionPort::Create(type, mxtl::move(ioport), key, async_thread_events,
+                                       &eport);
         if (status != MX_OK)
             return status;
         status = process->SetExceptionPort(eport);
@@ -115,7 +117,7 @@ static mx_status_t task_bind_exception_port(mx_handle_t obj_handle, mx_handle_t
         if (debugger)
             return MX_ERR_INVALID_ARGS;
         status = ExceptionPort::Create(ExceptionPort::Type::THREAD,
-                                       mxtl::move(ioport), key, &eport);
+                                       mxtl::move(ioport), key, false, &eport);
         if (status != MX_OK)
             return status;
         status = thread->SetExceptionPort(eport);
@@ -137,7 +139,11 @@ mx_status_t sys_task_bind_exception_port(mx_handle_t obj_handle, mx_handle_t epo
         if (options & ~(MX_EXCEPTION_PORT_DEBUGGER + MX_EXCEPTION_PORT_UNBIND_QUIETLY))
             return MX_ERR_INVALID_ARGS;
     } else {
-        if (options & ~MX_EXCEPTION_PORT_DEBUGGER)
+        if (options & ~(MX_EXCEPTION_PORT_DEBUGGER | MX_EXCEPTION_PORT_ASYNC_THREAD_EVENTS))
+            return MX_ERR_INVALID_ARGS;
+        // Only debuggers get thread start and exit reports.
+        if ((options & MX_EXCEPTION_PORT_ASYNC_THREAD_EVENTS) &&
+            !(options & MX_EXCEPTION_PORT_DEBUGGER))
             return MX_ERR_INVALID_ARGS;
     }
 
@@ -147,7 +153,9 @@ mx_status_t sys_task_bind_exception_port(mx_handle_t obj_handle, mx_handle_t epo
         bool quietly = (options & MX_EXCEPTION_PORT_UNBIND_QUIETLY) != 0;
         return object_unbind_exception_port(obj_handle, debugger, quietly);
     } else {
-        return task_bind_exception_port(obj_handle, eport_handle, key, debugger);
+        bool async_thread_events = (options & MX_EXCEPTION_PORT_ASYNC_THREAD_EVENTS) != 0;
+        return task_bind_exception_port(obj_handle, eport_handle, key, debugger,
+                                        async_thread_events);
     }
 }
 
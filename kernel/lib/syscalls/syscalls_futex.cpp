@@ -7,6 +7,8 @@
 #include <trace.h>
 
 #include <magenta/process_dispatcher.h>
+#include <magenta/thread_dispatcher.h>
+#include <magenta/user_thread.h>
 
 #include "syscalls_priv.h"
 
@@ -16,7 +18,28 @@ mx_status_t sys_futex_wait(user_ptr<mx_futex_t> value_ptr, int current_value, mx
     LTRACEF("futex %p current %d\n", value_ptr.get(), current_value);
 
     return ProcessDispatcher::GetCurrent()->futex_context()->FutexWait(
-        value_ptr, current_value, deadline);
+        value_ptr, current_value, nullptr, deadline);
+}
+
+mx_status_t sys_futex_wait_owner(user_ptr<mx_futex_t> value_ptr, int current_value,
+                                 mx_handle_t owner, mx_time_t deadline) {
+    LTRACEF("futex %p current %d owner %d\n", value_ptr.get(), current_value, owner);
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    // holding the dispatcher keeps the owner's thread around while we wait on it
+    mxtl::RefPtr<ThreadDispatcher> thread;
+    thread_t* owner_thread = nullptr;
+    if (owner != MX_HANDLE_INVALID) {
+        mx_status_t status = up->GetDispatcherWithRights(owner, MX_RIGHT_READ, &thread);
+        if (status != MX_OK)
+            return status;
+        if (thread->thread() == UserThread::GetCurrent())
+            return MX_ERR_INVALID_ARGS;
+        owner_thread = thread->thread()->kernel_thread();
+    }
+
+    return up->futex_context()->FutexWait(value_ptr, current_value, owner_thread, deadline);
 }
 
 mx_status_t sys_futex_wake(user_ptr<const mx_futex_t> value_ptr, uint32_t count) {
@@ -4,12 +4,14 @@
 // license that can be found in the LICENSE file or at
 // https://opensource.org/licenses/MIT
 
+#include <magenta/event_dispatcher.h>
 #include <magenta/fifo_dispatcher.h>
 #include <magenta/guest_dispatcher.h>
 #include <magenta/handle_owner.h>
 #include <magenta/hypervisor_dispatcher.h>
 #include <magenta/process_dispatcher.h>
 #include <magenta/syscalls/hypervisor.h>
+#include <magenta/vcpu_dispatcher.h>
 #include <magenta/vm_object_dispatcher.h>
 
 #include <mxtl/ref_ptr.h>
@@ -75,15 +77,69 @@ static mx_status_t guest_create(mx_handle_t hypervisor_handle,
     return MX_OK;
 }
 
-static mx_status_t guest_enter(mx_handle_t handle) {
+static mx_status_t vcpu_create(mx_handle_t guest_handle, mx_handle_t ctl_fifo_handle,
+                               mx_handle_t* out) {
     auto up = ProcessDispatcher::GetCurrent();
 
     mxtl::RefPtr<GuestDispatcher> guest;
-    mx_status_t status = up->GetDispatcherWithRights(handle, MX_RIGHT_EXECUTE, &guest);
+    mx_status_t status = up->GetDispatcherWithRights(guest_handle, MX_RIGHT_EXECUTE, &guest);
+    if (status != MX_OK)
+        return status;
+
+    mxtl::RefPtr<FifoDispatcher> ctl_fifo;
+    status = up->GetDispatcherWithRights(
+        ctl_fifo_handle, MX_RIGHT_READ | MX_RIGHT_WRITE, &ctl_fifo);
     if (status != MX_OK)
         return status;
 
-    return guest->Enter();
+    mxtl::RefPtr<Dispatcher> dispatcher;
+    mx_rights_t rights;
+    status = VcpuDispatcher::Create(guest, ctl_fifo, &dispatcher, &rights);
+    if (status != MX_OK)
+        return status;
+
+    HandleOwner handle(MakeHandle(mxtl::move(dispatcher), rights));
+    if (!handle)
+        return MX_ERR_NO_MEMORY;
+
+    *out = up->MapHandleToValue(handle);
+    up->AddHandle(mxtl::move(handle));
+    return MX_OK;
+}
+
+// Looks up the VCPU |handle| refers to. A guest handle refers to the first
+// VCPU of the guest.
+static mx_status_t get_vcpu(mx_handle_t handle, mx_rights_t rights,
+                            mxtl::RefPtr<GuestDispatcher>* guest, uint32_t* vcpu) {
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<Dispatcher> dispatcher;
+    mx_status_t status = up->GetDispatcherWithRights(handle, rights, &dispatcher);
+    if (status != MX_OK)
+        return status;
+
+    auto vcpu_dispatcher = DownCastDispatcher<VcpuDispatcher>(&dispatcher);
+    if (vcpu_dispatcher) {
+        *guest = vcpu_dispatcher->guest();
+        *vcpu = vcpu_dispatcher->id();
+        return MX_OK;
+    }
+
+    *guest = DownCastDispatcher<GuestDispatcher>(&dispatcher);
+    if (!*guest)
+        return MX_ERR_WRONG_TYPE;
+    *vcpu = 0;
+    return MX_OK;
+}
+
+static mx_status_t guest_enter(mx_handle_t handle) {
+    mxtl::RefPtr<GuestDispatcher> guest;
+    uint32_t vcpu;
+    mx_status_t status = get_vcpu(handle, MX_RIGHT_EXECUTE, &guest, &vcpu);
+    if (status != MX_OK)
+        return status;
+
+    return guest->Enter(vcpu);
 }
 
 static mx_status_t guest_mem_trap(mx_handle_t handle, mx_vaddr_t guest_paddr, size_t size) {
@@ -103,66 +159,62 @@ static mx_status_t guest_mem_trap(mx_handle_t handle, mx_vaddr_t guest_paddr, si
 }
 
 static mx_status_t guest_interrupt(mx_handle_t handle, uint8_t interrupt) {
-    auto up = ProcessDispatcher::GetCurrent();
-
     mxtl::RefPtr<GuestDispatcher> guest;
-    mx_status_t status = up->GetDispatcherWithRights(handle, MX_RIGHT_EXECUTE, &guest);
+    uint32_t vcpu;
+    mx_status_t status = get_vcpu(handle, MX_RIGHT_EXECUTE, &guest, &vcpu);
     if (status != MX_OK)
         return status;
 
-    return guest->Interrupt(interrupt);
+    return guest->Interrupt(vcpu, interrupt);
 }
 
 static mx_status_t guest_set_gpr(mx_handle_t handle, const mx_guest_gpr_t& guest_gpr) {
-    auto up = ProcessDispatcher::GetCurrent();
-
     mxtl::RefPtr<GuestDispatcher> guest;
-    mx_status_t status = up->GetDispatcherWithRights(handle, MX_RIGHT_WRITE, &guest);
+    uint32_t vcpu;
+    mx_status_t status = get_vcpu(handle, MX_RIGHT_WRITE, &guest, &vcpu);
     if (status != MX_OK)
         return status;
 
-    return guest->SetGpr(guest_gpr);
+    return guest->SetGpr(vcpu, guest_gpr);
 }
 
 static mx_status_t guest_get_gpr(mx_handle_t handle, mx_guest_gpr_t* guest_gpr) {
-    auto up = ProcessDispatcher::GetCurrent();
-
     mxtl::RefPtr<GuestDispatcher> guest;
-    mx_status_t status = up->GetDispatcherWithRights(handle, MX_RIGHT_READ, &guest);
+    uint32_t vcpu;
+    mx_status_t status = get_vcpu(handle, MX_RIGHT_READ, &guest, &vcpu);
     if (status != MX_OK)
         return status;
 
-    return guest->GetGpr(guest_gpr);
+    return guest->GetGpr(vcpu, guest_gpr);
 }
 
 static mx_status_t guest_set_ip(mx_handle_t handle, uintptr_t guest_ip) {
-    auto up = ProcessDispatcher::GetCurrent();
-
     mxtl::RefPtr<GuestDispatcher> guest;
-    mx_status_t status = up->GetDispatcherWithRights(handle, MX_RIGHT_WRITE, &guest);
+    uint32_t vcpu;
+    mx_status_t status = get_vcpu(handle, MX_RIGHT_WRITE, &guest, &vcpu);
     if (status != MX_OK)
         return status;
 
-    return guest->set_ip(guest_ip);
+    return guest->set_ip(vcpu, guest_ip);
 }
 
 #if ARCH_X86_64
 static mx_status_t guest_set_cr3(mx_handle_t handle, uintptr_t guest_cr3) {
-    auto up = ProcessDispatcher::GetCurrent();
-
     mxtl::RefPtr<GuestDispatcher> guest;
-    mx_status_t status = up->GetDispatcherWithRights(handle, MX_RIGHT_WRITE, &guest);
+    uint32_t vcpu;
+    mx_status_t status = get_vcpu(handle, MX_RIGHT_WRITE, &guest, &vcpu);
     if (status != MX_OK)
         return status;
 
-    return guest->set_cr3(guest_cr3);
+    return guest->set_cr3(vcpu, guest_cr3);
 }
 
 static mx_status_t guest_set_apic_mem(mx_handle_t handle, mx_handle_t apic_mem_handle) {
     auto up = ProcessDispatcher::GetCurrent();
 
     mxtl::RefPtr<GuestDispatcher> guest;
-    mx_status_t status = up->GetDispatcherWithRights(handle, MX_RIGHT_WRITE, &guest);
+    uint32_t vcpu;
+    mx_status_t status = get_vcpu(handle, MX_RIGHT_WRITE, &guest, &vcpu);
     if (status != MX_OK)
         return status;
 
@@ -172,7 +224,56 @@ static mx_status_t guest_set_apic_mem(mx_handle_t handle, mx_handle_t apic_mem_h
     if (status != MX_OK)
         return status;
 
-    return guest->SetApicMem(apic_mem->vmo());
+    return guest->SetApicMem(vcpu, apic_mem->vmo());
+}
+
+static mx_status_t guest_set_bell(mx_handle_t handle, const mx_guest_bell_t& bell) {
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<GuestDispatcher> guest;
+    mx_status_t status = up->GetDispatcherWithRights(handle, MX_RIGHT_WRITE, &guest);
+    if (status != MX_OK)
+        return status;
+
+    mxtl::RefPtr<EventDispatcher> event;
+    if (bell.event != MX_HANDLE_INVALID) {
+        status = up->GetDispatcherWithRights(bell.event, MX_RIGHT_WRITE, &event);
+        if (status != MX_OK)
+            return status;
+    }
+
+    return guest->SetBell(bell.kind, bell.addr, bell.len, mxtl::move(event));
+}
+
+static mx_status_t guest_set_interrupt_event(mx_handle_t handle,
+                                             const mx_guest_interrupt_event_t& interrupt_event) {
+    auto up = ProcessDispatcher::GetCurrent();
+
+    if (interrupt_event.interrupt > UINT8_MAX)
+        return MX_ERR_OUT_OF_RANGE;
+
+    mxtl::RefPtr<GuestDispatcher> guest;
+    mx_status_t status = up->GetDispatcherWithRights(handle, MX_RIGHT_WRITE, &guest);
+    if (status != MX_OK)
+        return status;
+
+    mxtl::RefPtr<EventDispatcher> event;
+    status = up->GetDispatcherWithRights(interrupt_event.event, MX_RIGHT_READ, &event);
+    if (status != MX_OK)
+        return status;
+
+    return guest->SetInterruptEvent(static_cast<uint8_t>(interrupt_event.interrupt),
+                                    mxtl::move(event));
+}
+
+static mx_status_t guest_get_exit_stats(mx_handle_t handle, mx_guest_exit_stats_t* exit_stats) {
+    mxtl::RefPtr<GuestDispatcher> guest;
+    uint32_t vcpu;
+    mx_status_t status = get_vcpu(handle, MX_RIGHT_READ, &guest, &vcpu);
+    if (status != MX_OK)
+        return status;
+
+    return guest->GetExitStats(vcpu, exit_stats);
 }
 #endif
 
@@ -257,7 +358,50 @@ static mx_status_t guest_set_apic_mem(mx_handle_t handle, mx_handle_t apic_mem_h
             return MX_ERR_INVALID_ARGS;
         return guest_set_apic_mem(handle, apic_mem);
     }
+    case MX_HYPERVISOR_OP_GUEST_SET_BELL: {
+        mx_guest_bell_t bell;
+        if (args_len != sizeof(bell))
+            return MX_ERR_INVALID_ARGS;
+        if (args.copy_array_from_user(&bell, sizeof(bell)) != MX_OK)
+            return MX_ERR_INVALID_ARGS;
+        return guest_set_bell(handle, bell);
+    }
+    case MX_HYPERVISOR_OP_GUEST_SET_INTERRUPT_EVENT: {
+        mx_guest_interrupt_event_t interrupt_event;
+        if (args_len != sizeof(interrupt_event))
+            return MX_ERR_INVALID_ARGS;
+        if (args.copy_array_from_user(&interrupt_event, sizeof(interrupt_event)) != MX_OK)
+            return MX_ERR_INVALID_ARGS;
+        return guest_set_interrupt_event(handle, interrupt_event);
+    }
+    case MX_HYPERVISOR_OP_GUEST_GET_EXIT_STATS: {
+        mx_guest_exit_stats_t exit_stats;
+        if (result_len != sizeof(exit_stats))
+            return MX_ERR_INVALID_ARGS;
+        mx_status_t status = guest_get_exit_stats(handle, &exit_stats);
+        if (status != MX_OK)
+            return status;
+        if (result.copy_array_to_user(&exit_stats, sizeof(exit_stats)) != MX_OK)
+            return MX_ERR_INVALID_ARGS;
+        return MX_OK;
+    }
 #endif // ARCH_X86_64
+    case MX_HYPERVISOR_OP_VCPU_CREATE: {
+        mx_handle_t ctl_fifo;
+        if (args_len != sizeof(ctl_fifo))
+            return MX_ERR_INVALID_ARGS;
+        if (args.copy_array_from_user(&ctl_fifo, sizeof(ctl_fifo)) != MX_OK)
+            return MX_ERR_INVALID_ARGS;
+        mx_handle_t out;
+        if (result_len != sizeof(out))
+            return MX_ERR_INVALID_ARGS;
+        mx_status_t status = vcpu_create(handle, ctl_fifo, &out);
+        if (status != MX_OK)
+            return status;
+        if (result.copy_array_to_user(&out, sizeof(out)) != MX_OK)
+            return MX_ERR_INVALID_ARGS;
+        return MX_OK;
+    }
     default:
         return MX_ERR_INVALID_ARGS;
     }
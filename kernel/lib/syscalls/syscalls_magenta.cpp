@@ -19,6 +19,7 @@
 #include <lib/crypto/global_prng.h>
 #include <lib/user_copy.h>
 #include <lib/user_copy/user_ptr.h>
+#include <lib/vdso.h>
 
 #include <magenta/event_dispatcher.h>
 #include <magenta/event_pair_dispatcher.h>
@@ -30,6 +31,7 @@
 #include <magenta/syscalls/policy.h>
 #include <magenta/user_copy.h>
 #include <magenta/user_thread.h>
+#include <magenta/vm_object_dispatcher.h>
 #include <magenta/wait_set_dispatcher.h>
 
 #include <mxalloc/new.h>
@@ -60,8 +62,10 @@ mx_status_t sys_nanosleep(mx_time_t deadline) {
 
 // This must be accessed atomically from any given thread.
 static mxtl::atomic<int64_t> utc_offset;
+// Serializes adjustments so that the vDSO is left with the same offset.
+static Mutex utc_offset_lock;
 
-uint64_t sys_time_get(uint32_t clock_id) {
+uint64_t sys_time_get_via_kernel(uint32_t clock_id) {
     switch (clock_id) {
     case MX_CLOCK_MONOTONIC:
         return current_time();
@@ -85,9 +89,12 @@ mx_status_t sys_clock_adjust(mx_handle_t hrsrc, uint32_t clock_id, int64_t offse
     switch (clock_id) {
     case MX_CLOCK_MONOTONIC:
         return MX_ERR_ACCESS_DENIED;
-    case MX_CLOCK_UTC:
+    case MX_CLOCK_UTC: {
+        AutoLock lock(&utc_offset_lock);
         utc_offset.store(offset);
+        VDso::SetUtcOffset(offset);
         return MX_OK;
+    }
     default:
         return MX_ERR_INVALID_ARGS;
     }
@@ -219,13 +226,23 @@ mx_status_t sys_log_write(mx_handle_t log_handle, uint32_t len, user_ptr<const v
 mx_status_t sys_log_read(mx_handle_t log_handle, uint32_t len, user_ptr<void> _ptr, uint32_t options) {
     LTRACEF("log handle %d, len 0x%x, ptr 0x%p\n", log_handle, len, _ptr.get());
 
-    if (len < DLOG_MAX_RECORD)
-        return MX_ERR_BUFFER_TOO_SMALL;
-
     auto up = ProcessDispatcher::GetCurrent();
 
     mxtl::RefPtr<LogDispatcher> log;
-    mx_status_t status = up->GetDispatcherWithRights(log_handle, MX_RIGHT_READ, &log);
+    mx_status_t status;
+
+    // nothing is copied out when skipping, any buffer will do
+    if (options & MX_LOG_READ_SKIP) {
+        status = up->GetDispatcherWithRights(log_handle, MX_RIGHT_READ, &log);
+        if (status != MX_OK)
+            return status;
+        return log->Skip();
+    }
+
+    if (len < DLOG_MAX_RECORD)
+        return MX_ERR_BUFFER_TOO_SMALL;
+
+    status = up->GetDispatcherWithRights(log_handle, MX_RIGHT_READ, &log);
     if (status != MX_OK)
         return status;
 
@@ -240,15 +257,47 @@ mx_status_t sys_log_read(mx_handle_t log_handle, uint32_t len, user_ptr<void> _p
     return static_cast<mx_status_t>(actual);
 }
 
+mx_status_t sys_log_get_vmo(mx_handle_t log_handle, user_ptr<mx_handle_t> out) {
+    LTRACEF("log handle %d\n", log_handle);
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<LogDispatcher> log;
+    mx_status_t status = up->GetDispatcherWithRights(log_handle, MX_RIGHT_READ, &log);
+    if (status != MX_OK)
+        return status;
+
+    mxtl::RefPtr<VmObject> vmo;
+    if ((status = log->GetRingVmo(&vmo)) != MX_OK)
+        return status;
+
+    mxtl::RefPtr<Dispatcher> dispatcher;
+    mx_rights_t rights;
+    if ((status = VmObjectDispatcher::Create(mxtl::move(vmo), &dispatcher, &rights)) != MX_OK)
+        return status;
+
+    // the ring can only be read
+    rights &= ~(MX_RIGHT_WRITE | MX_RIGHT_EXECUTE);
+
+    HandleOwner handle(MakeHandle(mxtl::move(dispatcher), rights));
+    if (!handle)
+        return MX_ERR_NO_MEMORY;
+
+    if (out.copy_to_user(up->MapHandleToValue(handle)) != MX_OK)
+        return MX_ERR_INVALID_ARGS;
+
+    up->AddHandle(mxtl::move(handle));
+
+    return MX_OK;
+}
+
 mx_status_t sys_cprng_draw(user_ptr<void> _buffer, size_t len, user_ptr<size_t> _actual) {
     if (len > kMaxCPRNGDraw)
         return MX_ERR_INVALID_ARGS;
 
     uint8_t kernel_buf[kMaxCPRNGDraw];
 
-    auto prng = crypto::GlobalPRNG::GetInstance();
-    ASSERT(prng->is_thread_safe());
-    prng->Draw(kernel_buf, static_cast<int>(len));
+    crypto::GlobalPRNG::Draw(kernel_buf, len);
 
     if (_buffer.copy_array_to_user(kernel_buf, len) != MX_OK)
         return MX_ERR_INVALID_ARGS;
@@ -269,9 +318,7 @@ mx_status_t sys_cprng_add_entropy(user_ptr<const void> _buffer, size_t len) {
     if (_buffer.copy_array_from_user(kernel_buf, len) != MX_OK)
         return MX_ERR_INVALID_ARGS;
 
-    auto prng = crypto::GlobalPRNG::GetInstance();
-    ASSERT(prng->is_thread_safe());
-    prng->AddEntropy(kernel_buf, static_cast<int>(len));
+    crypto::GlobalPRNG::AddEntropy(kernel_buf, len);
 
     // Get rid of the stack copy of the random data
     memset(kernel_buf, 0, sizeof(kernel_buf));
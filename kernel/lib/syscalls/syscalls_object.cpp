@@ -6,10 +6,12 @@
 
 #include <err.h>
 #include <inttypes.h>
+#include <string.h>
 #include <trace.h>
 
 #include <kernel/mp.h>
 #include <kernel/stats.h>
+#include <kernel/thread.h>
 #include <kernel/vm/pmm.h>
 #include <lib/heap.h>
 #include <platform.h>
@@ -18,14 +20,18 @@
 #include <magenta/handle_owner.h>
 #include <magenta/job_dispatcher.h>
 #include <magenta/magenta.h>
+#include <magenta/mx-syscall-numbers.h>
 #include <magenta/process_dispatcher.h>
 #include <magenta/resource_dispatcher.h>
 #include <magenta/thread_dispatcher.h>
 #include <magenta/vm_address_region_dispatcher.h>
 
+#include <mxalloc/new.h>
+#include <mxtl/inline_array.h>
 #include <mxtl/ref_ptr.h>
 
 #include "syscalls_priv.h"
+#include "syscalls_stats.h"
 
 #define LOCAL_TRACE 0
 
@@ -432,6 +438,9 @@ mx_status_t sys_object_get_info(mx_handle_t handle, uint32_t topic,
                 stats.irq_preempts = cpu->stats.irq_preempts;
                 stats.preempts = cpu->stats.preempts;
                 stats.yields = cpu->stats.yields;
+                stats.steals = cpu->stats.steals;
+                stats.balances = cpu->stats.balances;
+                stats.migrations = cpu->stats.migrations;
                 stats.ints = cpu->stats.interrupts;
                 stats.timer_ints = cpu->stats.timer_ints;
                 stats.timers = cpu->stats.timers;
@@ -504,6 +513,129 @@ mx_status_t sys_object_get_info(mx_handle_t handle, uint32_t topic,
             return single_record_result(
                 _buffer, buffer_size, _actual, _avail, &stats, sizeof(stats));
         }
+        case MX_INFO_SYSCALL_STATS: {
+            // grab a reference to the dispatcher
+            mxtl::RefPtr<ResourceDispatcher> resource;
+            auto error = up->GetDispatcherWithRights(handle, MX_RIGHT_NONE, &resource);
+            if (error < 0)
+                return error;
+
+            // TODO: check that this is the root resource
+
+            size_t num_space_for = buffer_size / sizeof(mx_info_syscall_stats_t);
+            size_t num_to_copy = MIN(static_cast<size_t>(MX_SYS_COUNT), num_space_for);
+
+            user_ptr<mx_info_syscall_stats_t> stats_buf(
+                static_cast<mx_info_syscall_stats_t*>(_buffer.get()));
+
+            for (uint32_t i = 0; i < static_cast<uint32_t>(num_to_copy); i++) {
+                mx_info_syscall_stats_t stats;
+                syscall_stats_get(i, &stats);
+
+                // copy out one at a time
+                if (stats_buf.copy_array_to_user(&stats, 1, i) != MX_OK)
+                    return MX_ERR_INVALID_ARGS;
+            }
+
+            if (_actual && (_actual.copy_to_user(num_to_copy) != MX_OK))
+                return MX_ERR_INVALID_ARGS;
+            if (_avail && (_avail.copy_to_user(static_cast<size_t>(MX_SYS_COUNT)) != MX_OK))
+                return MX_ERR_INVALID_ARGS;
+            return MX_OK;
+        }
+        case MX_INFO_KMEM_HEAP_TAGS: {
+#if WITH_HEAP_TAGS
+            // grab a reference to the dispatcher
+            mxtl::RefPtr<ResourceDispatcher> resource;
+            auto error = up->GetDispatcherWithRights(handle, MX_RIGHT_NONE, &resource);
+            if (error < 0)
+                return error;
+
+            // TODO: check that this is the root resource
+
+            size_t num_space_for = buffer_size / sizeof(mx_info_heap_tag_t);
+            size_t num_to_copy = MIN(static_cast<size_t>(HEAP_TAG_COUNT), num_space_for);
+
+            user_ptr<mx_info_heap_tag_t> tags_buf(
+                static_cast<mx_info_heap_tag_t*>(_buffer.get()));
+
+            for (uint32_t i = 0; i < static_cast<uint32_t>(num_to_copy); i++) {
+                heap_tag_stats_t stats;
+                heap_tag_get_stats(static_cast<heap_tag_t>(i), &stats);
+
+                mx_info_heap_tag_t info = {};
+                strlcpy(info.name, stats.name, sizeof(info.name));
+                info.allocs = stats.allocs;
+                info.frees = stats.frees;
+                info.alloc_bytes = stats.alloc_bytes;
+                info.free_bytes = stats.free_bytes;
+                info.live_bytes = stats.alloc_bytes - stats.free_bytes;
+
+                // copy out one at a time
+                if (tags_buf.copy_array_to_user(&info, 1, i) != MX_OK)
+                    return MX_ERR_INVALID_ARGS;
+            }
+
+            if (_actual && (_actual.copy_to_user(num_to_copy) != MX_OK))
+                return MX_ERR_INVALID_ARGS;
+            if (_avail && (_avail.copy_to_user(static_cast<size_t>(HEAP_TAG_COUNT)) != MX_OK))
+                return MX_ERR_INVALID_ARGS;
+            return MX_OK;
+#else
+            return MX_ERR_NOT_SUPPORTED;
+#endif
+        }
+        case MX_INFO_KERNEL_OBJECTS: {
+            // grab a reference to the dispatcher
+            mxtl::RefPtr<ResourceDispatcher> resource;
+            auto error = up->GetDispatcherWithRights(handle, MX_RIGHT_NONE, &resource);
+            if (error < 0)
+                return error;
+
+            // TODO: check that this is the root resource
+
+            size_t num_space_for = buffer_size / sizeof(mx_info_kernel_objects_t);
+            size_t num_to_copy = MIN(static_cast<size_t>(MX_OBJ_TYPE_LAST), num_space_for);
+
+            user_ptr<mx_info_kernel_objects_t> counts_buf(
+                static_cast<mx_info_kernel_objects_t*>(_buffer.get()));
+
+            for (uint32_t i = 0; i < static_cast<uint32_t>(num_to_copy); i++) {
+                mx_info_kernel_objects_t info = {};
+                info.type = i;
+                GetKernelObjectCounts(i, &info.objects, &info.handles);
+
+                // copy out one at a time
+                if (counts_buf.copy_array_to_user(&info, 1, i) != MX_OK)
+                    return MX_ERR_INVALID_ARGS;
+            }
+
+            if (_actual && (_actual.copy_to_user(num_to_copy) != MX_OK))
+                return MX_ERR_INVALID_ARGS;
+            if (_avail && (_avail.copy_to_user(static_cast<size_t>(MX_OBJ_TYPE_LAST)) != MX_OK))
+                return MX_ERR_INVALID_ARGS;
+            return MX_OK;
+        }
+        case MX_INFO_TASK_HANDLES: {
+            mxtl::RefPtr<Dispatcher> dispatcher;
+            auto error = up->GetDispatcherWithRights(handle, MX_RIGHT_READ, &dispatcher);
+            if (error < 0)
+                return error;
+
+            mx_info_task_handles_t info = {};
+            auto process = DownCastDispatcher<ProcessDispatcher>(&dispatcher);
+            if (process) {
+                info.handles = process->handle_count();
+            } else {
+                auto job = DownCastDispatcher<JobDispatcher>(&dispatcher);
+                if (!job)
+                    return MX_ERR_WRONG_TYPE;
+                info.handles = job->GetHandleCount();
+            }
+
+            return single_record_result(
+                _buffer, buffer_size, _actual, _avail, &info, sizeof(info));
+        }
         default:
             return MX_ERR_NOT_SUPPORTED;
     }
@@ -643,6 +775,47 @@ mx_status_t sys_object_signal(mx_handle_t handle_value, uint32_t clear_mask, uin
     return dispatcher->user_signal(clear_mask, set_mask, false);
 }
 
+// Like mx_batch_submit() every item is tried, whether or not the ones before
+// it succeeded. All of the handles are looked up before any object is
+// signalled, and the reschedule ipis for the threads the signals wake are
+// held back until the last one, so that each cpu gets one for the batch.
+mx_status_t sys_object_signal_many(user_ptr<mx_signal_item_t> _items, uint32_t count) {
+    LTRACEF("count %u\n", count);
+
+    if (!_items || count == 0u || count > kMaxWaitSignalCount)
+        return MX_ERR_INVALID_ARGS;
+
+    AllocChecker ac;
+    mxtl::InlineArray<mx_signal_item_t, kSyscallInlineCount> items(&ac, count);
+    if (!ac.check())
+        return MX_ERR_NO_MEMORY;
+    if (_items.copy_array_from_user(items.get(), count) != MX_OK)
+        return MX_ERR_INVALID_ARGS;
+
+    mxtl::InlineArray<mxtl::RefPtr<Dispatcher>, kSyscallInlineCount> dispatchers(&ac, count);
+    if (!ac.check())
+        return MX_ERR_NO_MEMORY;
+
+    auto up = ProcessDispatcher::GetCurrent();
+    for (uint32_t i = 0; i < count; ++i) {
+        items[i].status = up->GetDispatcherWithRights(items[i].handle, MX_RIGHT_WRITE,
+                                                      &dispatchers[i]);
+    }
+
+    thread_batch_wakeup_begin();
+    for (uint32_t i = 0; i < count; ++i) {
+        if (items[i].status != MX_OK)
+            continue;
+        items[i].status = dispatchers[i]->user_signal(items[i].clear_mask, items[i].set_mask,
+                                                      false);
+    }
+    thread_batch_wakeup_end();
+
+    if (_items.copy_array_to_user(items.get(), count) != MX_OK)
+        return MX_ERR_INVALID_ARGS;
+    return MX_OK;
+}
+
 mx_status_t sys_object_signal_peer(mx_handle_t handle_value, uint32_t clear_mask, uint32_t set_mask) {
     LTRACEF("handle %d\n", handle_value);
 
@@ -27,11 +27,6 @@
 
 #define LOCAL_TRACE 0
 
-constexpr uint32_t kMaxWaitHandleCount = 1024u;
-
-// Note: This is used for quite a few InlineArrays (simultaneously) in sys_handle_wait_many.
-constexpr size_t kWaitManyInlineCount = 8u;
-
 mx_status_t sys_object_wait_one(mx_handle_t handle_value,
                                 mx_signals_t signals,
                                 mx_time_t deadline,
@@ -99,17 +94,17 @@ mx_status_t sys_object_wait_many(user_ptr<mx_wait_item_t> _items, uint32_t count
 
     if (!_items)
         return MX_ERR_INVALID_ARGS;
-    if (count > kMaxWaitHandleCount)
+    if (count > kMaxWaitSignalCount)
         return MX_ERR_INVALID_ARGS;
 
     AllocChecker ac;
-    mxtl::InlineArray<mx_wait_item_t, kWaitManyInlineCount> items(&ac, count);
+    mxtl::InlineArray<mx_wait_item_t, kSyscallInlineCount> items(&ac, count);
     if (!ac.check())
         return MX_ERR_NO_MEMORY;
     if (_items.copy_array_from_user(items.get(), count) != MX_OK)
         return MX_ERR_INVALID_ARGS;
 
-    mxtl::InlineArray<WaitStateObserver, kWaitManyInlineCount> wait_state_observers(&ac, count);
+    mxtl::InlineArray<WaitStateObserver, kSyscallInlineCount> wait_state_observers(&ac, count);
     if (!ac.check())
         return MX_ERR_NO_MEMORY;
 
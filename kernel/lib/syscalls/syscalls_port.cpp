@@ -19,6 +19,7 @@
 #include <magenta/user_copy.h>
 
 #include <mxalloc/new.h>
+#include <mxtl/inline_array.h>
 #include <mxtl/ref_ptr.h>
 
 #include "syscalls_priv.h"
@@ -123,6 +124,38 @@ mx_status_t sys_port_wait2(mx_handle_t handle, mx_time_t deadline, user_ptr<void
     return MX_OK;
 }
 
+mx_status_t sys_port_wait_many(mx_handle_t handle, mx_time_t deadline,
+                               user_ptr<mx_port_packet_t> _packets, uint32_t count,
+                               user_ptr<uint32_t> _actual) {
+    LTRACEF("handle %d count %u\n", handle, count);
+
+    if (!_packets || !_actual || count == 0u || count > kMaxBatchCount)
+        return MX_ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<PortDispatcherV2> port;
+    mx_status_t status = up->GetDispatcherWithRights(handle, MX_RIGHT_WRITE, &port);
+    if (status != MX_OK)
+        return status;
+
+    AllocChecker ac;
+    mxtl::InlineArray<mx_port_packet_t, kSyscallInlineCount> packets(&ac, count);
+    if (!ac.check())
+        return MX_ERR_NO_MEMORY;
+
+    size_t actual;
+    status = port->DeQueueMany(deadline, packets.get(), count, &actual);
+    if (status != MX_OK)
+        return status;
+
+    if (_packets.copy_array_to_user(packets.get(), actual) != MX_OK)
+        return MX_ERR_INVALID_ARGS;
+    if (_actual.copy_to_user(static_cast<uint32_t>(actual)) != MX_OK)
+        return MX_ERR_INVALID_ARGS;
+    return MX_OK;
+}
+
 mx_status_t sys_port_wait(mx_handle_t handle, mx_time_t deadline,
                           user_ptr<void> _packet, size_t size) {
     LTRACEF("handle %d\n", handle);
@@ -8,6 +8,21 @@
 
 #include <magenta/types.h>
 #include <magenta/syscalls/types.h>
+#include <magenta/syscalls/batch.h>
+#include <magenta/syscalls/port.h>
 #include <lib/user_copy/user_ptr.h>
 
 #include <magenta/syscall-definitions.h>
+
+// The most entries the batched calls, mx_batch_submit(), mx_channel_read_many(),
+// mx_channel_write_many() and mx_port_wait_many(), take at once.
+constexpr uint32_t kMaxBatchCount = 64u;
+
+// The most items mx_object_wait_many() and mx_object_signal_many() take at
+// once.
+constexpr uint32_t kMaxWaitSignalCount = 1024u;
+
+// How many of the entries or items copied in by the calls above are kept on
+// the stack before going to the heap. Some calls keep several arrays of this
+// many at a time.
+constexpr size_t kSyscallInlineCount = 8u;
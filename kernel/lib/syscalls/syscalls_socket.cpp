@@ -30,9 +30,7 @@
 mx_status_t sys_socket_create(uint32_t options, user_ptr<mx_handle_t> _out0, user_ptr<mx_handle_t> _out1) {
     LTRACEF("entry out_handles %p, %p\n", _out0.get(), _out1.get());
 
-    if (options != MX_SOCKET_STREAM && options != MX_SOCKET_DATAGRAM)
-        return MX_ERR_INVALID_ARGS;
-
+    // The options are checked by SocketDispatcher::Init().
     auto up = ProcessDispatcher::GetCurrent();
     mx_status_t res = up->QueryPolicy(MX_POL_NEW_SOCKET);
     if (res < 0)
@@ -0,0 +1,186 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+// Always on latency histograms for every syscall, kept per-cpu so that
+// counting a call touches nothing shared.
+
+#include "syscalls_stats.h"
+
+#include <arch/ops.h>
+#include <debug.h>
+#include <inttypes.h>
+#include <lib/console.h>
+#include <lk/init.h>
+#include <magenta/mx-syscall-numbers.h>
+#include <mxtl/algorithm.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+
+// Bucket 0 is everything under 2^kFirstBucketShift ns.
+constexpr uint kFirstBucketShift = 7;
+constexpr uint kNumBuckets = MX_INFO_SYSCALL_STATS_BUCKETS;
+
+struct SyscallCounts {
+    uint64_t total_time;
+    uint64_t max_time;
+    // 32 bits each to keep a cpu's table small, the totals are 64 bits.
+    uint32_t buckets[kNumBuckets];
+};
+
+// MX_SYS_COUNT entries per cpu, allocated during boot. Syscalls made before
+// then aren't counted.
+SyscallCounts* counts;
+uint num_cpus;
+
+inline uint bucket_for(lk_time_t duration) {
+    if (duration < (1ull << kFirstBucketShift))
+        return 0;
+    uint log2 = 63 - __builtin_clzll(duration);
+    return mxtl::min(log2 - kFirstBucketShift + 1, kNumBuckets - 1);
+}
+
+void syscall_stats_init(uint level) {
+    num_cpus = arch_max_num_cpus();
+    counts = static_cast<SyscallCounts*>(calloc(num_cpus * MX_SYS_COUNT, sizeof(*counts)));
+    if (!counts)
+        printf("syscall stats: no memory for %u cpus\n", num_cpus);
+}
+
+} // namespace
+
+void syscall_stats_record(uint64_t syscall_num, lk_time_t duration) {
+    if (unlikely(!counts || syscall_num >= MX_SYS_COUNT))
+        return;
+
+    SyscallCounts* c = &counts[arch_curr_cpu_num() * MX_SYS_COUNT + syscall_num];
+    c->total_time += duration;
+    if (duration > c->max_time)
+        c->max_time = duration;
+    c->buckets[bucket_for(duration)]++;
+}
+
+void syscall_stats_get(uint32_t syscall_num, mx_info_syscall_stats_t* stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->syscall_num = syscall_num;
+    if (!counts || syscall_num >= MX_SYS_COUNT)
+        return;
+
+    // Racy against the cpus still counting, but each field is a word.
+    for (uint cpu = 0; cpu < num_cpus; cpu++) {
+        const SyscallCounts* c = &counts[cpu * MX_SYS_COUNT + syscall_num];
+        stats->total_time += c->total_time;
+        stats->max_time = mxtl::max<uint64_t>(stats->max_time, c->max_time);
+        for (uint i = 0; i < kNumBuckets; i++) {
+            stats->buckets[i] += c->buckets[i];
+            stats->calls += c->buckets[i];
+        }
+    }
+}
+
+// Late enough that every cpu has been found.
+LK_INIT_HOOK(syscall_stats, syscall_stats_init, LK_INIT_LEVEL_TARGET);
+
+#if WITH_LIB_CONSOLE
+
+struct SyscallName {
+    uint32_t id;
+    uint32_t nargs;
+    const char* name;
+};
+
+static const SyscallName syscall_names[] = {
+#include <magenta/syscall-ktrace-info.inc>
+};
+
+// The upper bound of a bucket, in ns.
+static uint64_t bucket_limit(uint bucket) {
+    return 1ull << (kFirstBucketShift + bucket);
+}
+
+// The upper bound of the bucket holding the |pct|th percentile call.
+static uint64_t percentile(const mx_info_syscall_stats_t* stats, uint pct) {
+    uint64_t want = (stats->calls * pct + 99) / 100;
+    uint64_t seen = 0;
+    for (uint i = 0; i < kNumBuckets; i++) {
+        seen += stats->buckets[i];
+        if (seen >= want)
+            return bucket_limit(i);
+    }
+    return bucket_limit(kNumBuckets - 1);
+}
+
+static const SyscallName* find_syscall(const char* name) {
+    for (const auto& sc : syscall_names) {
+        if (!strcmp(sc.name, name))
+            return &sc;
+    }
+    return nullptr;
+}
+
+static int cmd_syscallstat(int argc, const cmd_args* argv, uint32_t flags) {
+    if (argc > 2) {
+    usage:
+        printf("usage:\n");
+        printf("%s               : calls, mean and percentile latencies of every syscall made\n",
+               argv[0].str);
+        printf("%s <syscall>     : the latency histogram of one syscall\n", argv[0].str);
+        printf("%s reset         : clear all counts\n", argv[0].str);
+        return MX_ERR_INTERNAL;
+    }
+
+    if (!counts) {
+        printf("no syscall stats\n");
+        return MX_ERR_NO_MEMORY;
+    }
+
+    if (argc == 2 && !strcmp(argv[1].str, "reset")) {
+        memset(counts, 0, num_cpus * MX_SYS_COUNT * sizeof(*counts));
+        return MX_OK;
+    }
+
+    mx_info_syscall_stats_t stats;
+
+    if (argc == 2) {
+        const SyscallName* sc = find_syscall(argv[1].str);
+        if (!sc)
+            goto usage;
+        syscall_stats_get(sc->id, &stats);
+        printf("%s: %" PRIu64 " calls, max %" PRIu64 " ns\n", sc->name, stats.calls,
+               stats.max_time);
+        for (uint i = 0; i < kNumBuckets; i++) {
+            if (!stats.buckets[i])
+                continue;
+            if (i == kNumBuckets - 1)
+                printf("  >= %12" PRIu64 " ns", bucket_limit(i - 1));
+            else
+                printf("   < %12" PRIu64 " ns", bucket_limit(i));
+            printf(" %12" PRIu64 "\n", stats.buckets[i]);
+        }
+        return MX_OK;
+    }
+
+    // Percentiles are the upper bound of their bucket, so within 2x.
+    printf("%-28s %12s %10s %10s %10s %12s\n", "syscall", "calls", "mean ns", "p50 <ns",
+           "p99 <ns", "max ns");
+    for (const auto& sc : syscall_names) {
+        syscall_stats_get(sc.id, &stats);
+        if (!stats.calls)
+            continue;
+        printf("%-28s %12" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %12" PRIu64 "\n",
+               sc.name, stats.calls, stats.total_time / stats.calls, percentile(&stats, 50),
+               percentile(&stats, 99), stats.max_time);
+    }
+    return MX_OK;
+}
+
+STATIC_COMMAND_START
+STATIC_COMMAND("syscallstat", "syscall latency histograms", &cmd_syscallstat)
+STATIC_COMMAND_END(syscallstat);
+
+#endif // WITH_LIB_CONSOLE
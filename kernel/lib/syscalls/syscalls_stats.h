@@ -0,0 +1,17 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <magenta/syscalls/object.h>
+#include <sys/types.h>
+
+// Count one call to |syscall_num| that took |duration|. Interrupts must be
+// disabled, the counts are per-cpu.
+void syscall_stats_record(uint64_t syscall_num, lk_time_t duration);
+
+// Sum the counts of |syscall_num| over all cpus.
+void syscall_stats_get(uint32_t syscall_num, mx_info_syscall_stats_t* stats);
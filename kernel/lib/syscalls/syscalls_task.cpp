@@ -122,6 +122,28 @@ mx_status_t sys_thread_start(mx_handle_t thread_handle, uintptr_t entry,
     return thread->Start(entry, stack, arg1, arg2, /* initial_thread= */ false);
 }
 
+mx_status_t sys_thread_set_deadline(mx_handle_t hrsrc, mx_handle_t handle, mx_duration_t runtime,
+                                    mx_duration_t deadline, mx_duration_t period) {
+    LTRACEF("handle %d, runtime %" PRIu64 " deadline %" PRIu64 " period %" PRIu64 "\n",
+            handle, runtime, deadline, period);
+
+    // Reserved cpu time is taken away from every other thread in the system,
+    // so only holders of the root resource may reserve it.
+    // TODO: finer grained validation
+    mx_status_t status;
+    if ((status = validate_resource_handle(hrsrc)) < 0)
+        return status;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<ThreadDispatcher> thread;
+    status = up->GetDispatcherWithRights(handle, MX_RIGHT_WRITE, &thread);
+    if (status != MX_OK)
+        return status;
+
+    return thread->thread()->SetDeadline(runtime, deadline, period);
+}
+
 void sys_thread_exit() {
     LTRACE_ENTRY;
     UserThread::GetCurrent()->Exit();
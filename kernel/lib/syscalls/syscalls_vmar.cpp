@@ -163,7 +163,8 @@ mx_status_t sys_vmar_map(mx_handle_t vmar_handle, size_t vmar_offset,
     });
 
     if (do_map_range) {
-        status = vm_mapping->MapRange(vmo_offset, len, false);
+        // the offset is into the mapping, which starts at vmo_offset
+        status = vm_mapping->MapRange(0, len, false);
         if (status != MX_OK) {
             return status;
         }
@@ -42,6 +42,9 @@ mx_status_t sys_vmo_create(uint64_t size, uint32_t options, user_ptr<mx_handle_t
     if (!vmo)
         return MX_ERR_NO_MEMORY;
 
+    // anonymous memory handed to userspace may be compressed under pressure
+    vmo->EnableReclaim();
+
     // create a Vm Object dispatcher
     mxtl::RefPtr<Dispatcher> dispatcher;
     mx_rights_t rights;
@@ -193,14 +196,14 @@ mx_status_t sys_vmo_op_range(mx_handle_t handle, uint32_t op, uint64_t offset, u
 
     auto up = ProcessDispatcher::GetCurrent();
 
-    // lookup the dispatcher from handle
-    // TODO: test rights
+    // lookup the dispatcher from handle, the rights needed depend on the op
     mxtl::RefPtr<VmObjectDispatcher> vmo;
-    mx_status_t status = up->GetDispatcher(handle, &vmo);
+    mx_rights_t rights;
+    mx_status_t status = up->GetDispatcherAndRights(handle, &vmo, &rights);
     if (status != MX_OK)
         return status;
 
-    return vmo->RangeOp(op, offset, size, _buffer, buffer_size);
+    return vmo->RangeOp(op, offset, size, _buffer, buffer_size, rights);
 }
 
 mx_status_t sys_vmo_set_cache_policy(mx_handle_t handle, uint32_t cache_policy) {
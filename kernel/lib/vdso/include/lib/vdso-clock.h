@@ -0,0 +1,47 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+// This file is used both in the kernel and in the vDSO implementation.
+// So it must be compatible with both the kernel and userland header
+// environments.  It must use only the basic types so that struct
+// layouts match exactly in both contexts.
+
+#define VDSO_CLOCK_SIZE (4 * 4 + 8)
+#define VDSO_CLOCK_ALIGN 8
+
+#ifndef ASSEMBLY
+
+#include <stdint.h>
+#include <lib/fixed_point.h>
+
+// This struct lets the vDSO read the system clocks without entering
+// the kernel.  Unlike vdso_constants, it is not read-only from the
+// kernel's perspective: utc_offset changes whenever the UTC clock is
+// adjusted, and the kernel writes it in place while user code may be
+// reading it.
+struct vdso_clock {
+
+    // Nonzero if the monotonic clock is the counter mx_ticks_get reads
+    // scaled by ns_per_tick, so the vDSO can compute it itself.  When
+    // zero the vDSO asks the kernel for the time.
+    uint32_t user_clock;
+
+    // Conversion factor from mx_ticks_get values to nanoseconds.
+    struct fp_32_64 ns_per_tick;
+
+    // MX_CLOCK_UTC minus MX_CLOCK_MONOTONIC.  Only ever accessed with
+    // single atomic loads and stores.
+    int64_t utc_offset;
+};
+
+static_assert(VDSO_CLOCK_SIZE == sizeof(vdso_clock),
+              "Need to adjust VDSO_CLOCK_SIZE");
+static_assert(VDSO_CLOCK_ALIGN == alignof(vdso_clock),
+              "Need to adjust VDSO_CLOCK_ALIGN");
+
+#endif // ASSEMBLY
@@ -50,6 +50,10 @@ public:
     // Return a handle to the VMO for the given variant.
     HandleOwner vmo_handle(Variant) const;
 
+    // Make the vDSO's MX_CLOCK_UTC follow a new offset from
+    // MX_CLOCK_MONOTONIC, in every variant.
+    static void SetUtcOffset(int64_t offset);
+
 private:
     VDso();
     void CreateVariant(Variant);
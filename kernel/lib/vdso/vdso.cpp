@@ -5,6 +5,7 @@
 // https://opensource.org/licenses/MIT
 
 #include <lib/vdso.h>
+#include <lib/vdso-clock.h>
 #include <lib/vdso-constants.h>
 
 #include <kernel/cmdline.h>
@@ -16,6 +17,10 @@
 #include <mxtl/type_support.h>
 #include <platform.h>
 
+#if ARCH_X86
+#include <arch/x86/feature.h>
+#endif
+
 #include "vdso-code.h"
 
 // This is defined in assembly by vdso-image.S; vdso-code.h
@@ -197,6 +202,22 @@ void blacklist_##category##_syscalls(VDsoDynSymWindow& dynsym_window, \
 #undef SYSCALL_IN_CATEGORY_END
 #undef SYSCALL_CATEGORY_END
 
+// Each variant's vdso_clock struct, as seen through a kernel mapping
+// that is never torn down.  Each variant VMO needs its own, since the
+// page holding the struct may have been copied into the clone.
+vdso_clock* clock_data[VDso::variants()];
+
+vdso_clock* MapClockData(VDso::Variant variant, mxtl::RefPtr<VmObject> vmo) {
+    static_assert(sizeof(vdso_clock) == VDSO_DATA_CLOCK_SIZE,
+                  "gen-rodso-code.sh is suspect");
+    AllocChecker ac;
+    auto window = new(&ac) KernelVmoWindow<vdso_clock>(
+        "vDSO clock", mxtl::move(vmo), VDSO_DATA_CLOCK);
+    ASSERT(ac.check());
+    clock_data[static_cast<size_t>(variant)] = window->data();
+    return window->data();
+}
+
 } // anonymous namespace
 
 const VDso* VDso::instance_ = NULL;
@@ -242,6 +263,20 @@ const VDso* VDso::Create() {
         REDIRECT_SYSCALL(dynsym_window, mx_ticks_get, soft_ticks_get);
     }
 
+#if ARCH_X86
+    // Without rdtscp there's no telling user mode which cpu it's on.
+    if (!x86_feature_test(X86_FEATURE_RDTSCP)) {
+        VDsoDynSymWindow dynsym_window(vdso->vmo()->vmo());
+        REDIRECT_SYSCALL(dynsym_window, mx_system_get_cpu_hint, soft_cpu_hint);
+    }
+#endif
+
+    // Let mx_time_get compute the time itself if the hardware allows.
+    // The variants are cloned from this VMO, so they start out the same.
+    vdso_clock* clock = MapClockData(Variant::FULL, vdso->vmo()->vmo());
+    clock->user_clock = platform_get_user_clock(&clock->ns_per_tick);
+    clock->utc_offset = 0;
+
     for (size_t v = static_cast<size_t>(Variant::FULL) + 1;
          v < static_cast<size_t>(Variant::COUNT);
          ++v)
@@ -251,6 +286,12 @@ const VDso* VDso::Create() {
     return instance_;
 }
 
+void VDso::SetUtcOffset(int64_t offset) {
+    DEBUG_ASSERT(instance_);
+    for (vdso_clock* clock : clock_data)
+        __atomic_store_n(&clock->utc_offset, offset, __ATOMIC_RELAXED);
+}
+
 uintptr_t VDso::base_address(const mxtl::RefPtr<VmMapping>& code_mapping) {
     return code_mapping ? code_mapping->base() - VDSO_CODE_START : 0;
 }
@@ -287,6 +328,7 @@ void VDso::CreateVariant(Variant variant) {
                                       false, &new_vmo);
     ASSERT(status == MX_OK);
 
+    MapClockData(variant, new_vmo);
     VDsoDynSymWindow dynsym_window(new_vmo);
     VDsoCodeWindow code_window(new_vmo);
 
@@ -9,12 +9,16 @@
 #include <acpica/acpi.h>
 
 #include <assert.h>
+#include <debug.h>
 #include <err.h>
+#include <inttypes.h>
 #include <trace.h>
 
 #include <lk/init.h>
 
 #include <arch/x86/apic.h>
+#include <arch/x86/mp.h>
+#include <kernel/vm/pmm.h>
 #include <platform/pc/acpi.h>
 
 #define LOCAL_TRACE 0
@@ -276,6 +280,110 @@ status_t platform_enumerate_interrupt_source_overrides(
     return MX_OK;
 }
 
+/* @brief Tag cpus and pmm arenas with their memory proximity domain.
+ *
+ * Walks the SRAT, if present, and passes the memory and processor affinity
+ * records on to the pmm. Must be called after the cpu structures have been
+ * allocated so apic ids can be translated into cpu numbers.
+ *
+ * @return MX_OK on success, MX_ERR_NOT_FOUND if there is no SRAT.
+ */
+status_t platform_init_numa(void)
+{
+    ACPI_TABLE_HEADER *table = NULL;
+    ACPI_STATUS status = AcpiGetTable((char *)ACPI_SIG_SRAT, 1, &table);
+    if (status != AE_OK) {
+        LTRACEF("no SRAT, assuming a single memory node\n");
+        return MX_ERR_NOT_FOUND;
+    }
+
+    ACPI_TABLE_SRAT *srat = (ACPI_TABLE_SRAT *)table;
+    uintptr_t records_start = ((uintptr_t)srat) + sizeof(*srat);
+    uintptr_t records_end = ((uintptr_t)srat) + srat->Header.Length;
+    if (records_start >= records_end) {
+        TRACEF("malformed SRAT\n");
+        return MX_ERR_INTERNAL;
+    }
+
+    // Proximity domains are arbitrary 32 bit ids, compact them into the
+    // small node numbers the pmm understands in the order we see them.
+    uint32_t domains[PMM_MAX_NODES];
+    uint num_domains = 0;
+    auto domain_to_node = [&domains, &num_domains](uint32_t domain) -> int {
+        for (uint i = 0; i < num_domains; i++) {
+            if (domains[i] == domain)
+                return i;
+        }
+        if (num_domains == PMM_MAX_NODES) {
+            TRACEF("too many proximity domains, ignoring domain %u\n", domain);
+            return -1;
+        }
+        domains[num_domains] = domain;
+        return num_domains++;
+    };
+
+    uintptr_t addr;
+    ACPI_SUBTABLE_HEADER *record_hdr;
+    for (addr = records_start; addr < records_end; addr += record_hdr->Length) {
+        record_hdr = (ACPI_SUBTABLE_HEADER *)addr;
+        if (record_hdr->Length == 0) {
+            break;
+        }
+        switch (record_hdr->Type) {
+            case ACPI_SRAT_TYPE_CPU_AFFINITY: {
+                ACPI_SRAT_CPU_AFFINITY *cpu = (ACPI_SRAT_CPU_AFFINITY *)record_hdr;
+                if (!(cpu->Flags & ACPI_SRAT_CPU_ENABLED)) {
+                    continue;
+                }
+                uint32_t domain = cpu->ProximityDomainLo |
+                        ((uint32_t)cpu->ProximityDomainHi[0] << 8) |
+                        ((uint32_t)cpu->ProximityDomainHi[1] << 16) |
+                        ((uint32_t)cpu->ProximityDomainHi[2] << 24);
+                int node = domain_to_node(domain);
+                int cpu_num = x86_apic_id_to_cpu_num(cpu->ApicId);
+                if (node >= 0 && cpu_num >= 0) {
+                    LTRACEF("apic id %u (cpu %d) -> node %d\n", cpu->ApicId, cpu_num, node);
+                    pmm_set_cpu_node(cpu_num, node);
+                }
+                break;
+            }
+            case ACPI_SRAT_TYPE_X2APIC_CPU_AFFINITY: {
+                ACPI_SRAT_X2APIC_CPU_AFFINITY *cpu = (ACPI_SRAT_X2APIC_CPU_AFFINITY *)record_hdr;
+                if (!(cpu->Flags & ACPI_SRAT_CPU_ENABLED)) {
+                    continue;
+                }
+                int node = domain_to_node(cpu->ProximityDomain);
+                int cpu_num = x86_apic_id_to_cpu_num(cpu->ApicId);
+                if (node >= 0 && cpu_num >= 0) {
+                    LTRACEF("x2apic id %u (cpu %d) -> node %d\n", cpu->ApicId, cpu_num, node);
+                    pmm_set_cpu_node(cpu_num, node);
+                }
+                break;
+            }
+            case ACPI_SRAT_TYPE_MEMORY_AFFINITY: {
+                ACPI_SRAT_MEM_AFFINITY *mem = (ACPI_SRAT_MEM_AFFINITY *)record_hdr;
+                if (!(mem->Flags & ACPI_SRAT_MEM_ENABLED)) {
+                    continue;
+                }
+                int node = domain_to_node(mem->ProximityDomain);
+                if (node >= 0) {
+                    LTRACEF("memory %#" PRIx64 " len %#" PRIx64 " -> node %d\n",
+                            mem->BaseAddress, mem->Length, node);
+                    pmm_set_arena_node(mem->BaseAddress, mem->Length, node);
+                }
+                break;
+            }
+        }
+    }
+    if (addr != records_end) {
+        TRACEF("malformed SRAT\n");
+        return MX_ERR_INTERNAL;
+    }
+
+    dprintf(INFO, "Found %u memory nodes\n", num_domains);
+    return MX_OK;
+}
+
 /* @brief Return information about the High Precision Event Timer, if present.
  *
  * @param hpet Descriptor to populate
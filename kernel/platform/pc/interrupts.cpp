@@ -16,7 +16,9 @@
 #include <arch/x86.h>
 #include <arch/x86/interrupts.h>
 #include <arch/x86/apic.h>
+#include <arch/x86/mp.h>
 #include <lk/init.h>
+#include <kernel/mp.h>
 #include <kernel/spinlock.h>
 #include "platform_p.h"
 #include <platform/pc.h>
@@ -367,4 +369,32 @@ void x86_register_msi_handler(const pcie_msi_block_t* block,
     int_handler_table[x86_vector].arg     = handler ? ctx : NULL;
     spin_unlock(&int_handler_table[x86_vector].lock);
 }
+
+status_t x86_get_msi_target(const pcie_msi_block_t* block,
+                            uint                    msi_id,
+                            uint                    cpu_num,
+                            uint64_t*               out_tgt_addr,
+                            uint32_t*               out_tgt_data) {
+    DEBUG_ASSERT(block && block->allocated);
+    DEBUG_ASSERT(msi_id < block->num_irq);
+
+    if ((cpu_num >= SMP_MAX_CPUS) || !mp_is_cpu_online(cpu_num))
+        return MX_ERR_INVALID_ARGS;
+
+    uint32_t apic_id = (cpu_num == 0) ? bp_percpu.apic_id : ap_percpus[cpu_num - 1].apic_id;
+    if (apic_id > 0xFF)
+        return MX_ERR_NOT_SUPPORTED;
+
+    // Same format as the block's own target (see x86_alloc_msi_block), but
+    // aimed at the chosen CPU's local APIC, with no redirection so that the
+    // interrupt stays there.
+    uint32_t tgt_addr = 0xFEE00000;     // base addr
+    tgt_addr |= apic_id << 12;          // Dest ID
+    tgt_addr &= ~0x08;                  // Redir hint == 0
+    tgt_addr &= ~0x04;                  // Dest Mode == Physical
+
+    *out_tgt_addr = tgt_addr;
+    *out_tgt_data = block->base_irq_id + msi_id;
+    return MX_OK;
+}
 #endif  // WITH_DEV_PCIE
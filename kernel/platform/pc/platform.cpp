@@ -12,6 +12,7 @@
 #include <arch/x86/apic.h>
 #include <arch/x86/cpu_topology.h>
 #include <arch/x86/mmu.h>
+#include <arch/x86/mp.h>
 #include <platform.h>
 #include "platform_p.h"
 #include <platform/pc.h>
@@ -31,6 +32,7 @@
 #include <assert.h>
 #include <lk/init.h>
 #include <kernel/cmdline.h>
+#include <kernel/mp.h>
 #include <kernel/vm/initial_map.h>
 #include <kernel/vm/pmm.h>
 #include <kernel/vm/vm_aspace.h>
@@ -431,8 +433,8 @@ static void platform_init_smp(void)
         if (!use_ht && topo.smt_id != 0)
             keep = false;
 
-        dprintf(INFO, "\t%u: apic id 0x%x package %u core %u smt %u%s%s\n",
-                i, apic_ids_temp[i], topo.package_id, topo.core_id, topo.smt_id,
+        dprintf(INFO, "\t%u: apic id 0x%x package %u core %u smt %u cache %u%s%s\n",
+                i, apic_ids_temp[i], topo.package_id, topo.core_id, topo.smt_id, topo.cache_id,
                 (apic_ids_temp[i] == bsp_apic_id) ? " BSP" : "",
                 keep ? "" : " (not using)");
 
@@ -472,6 +474,20 @@ static void platform_init_smp(void)
 
     x86_init_smp(apic_ids, num_cpus);
 
+    // tell the scheduler which cpus share cores and caches
+    for (uint i = 0; i < num_cpus; ++i) {
+        int cpu_num = x86_apic_id_to_cpu_num(apic_ids[i]);
+        if (cpu_num < 0)
+            continue;
+
+        x86_cpu_topology_t topo;
+        x86_cpu_topology_decode(apic_ids[i], &topo);
+        mp_set_cpu_topology(cpu_num, topo.package_id, topo.cache_id, topo.core_id);
+    }
+
+    // now that cpu numbers are assigned, find out which memory is local to them
+    platform_init_numa();
+
     for (uint i = 0; i < num_cpus - 1; ++i) {
         if (apic_ids[i] == bsp_apic_id) {
             apic_ids[i] = apic_ids[num_cpus - 1];
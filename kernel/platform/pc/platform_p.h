@@ -38,6 +38,11 @@ void x86_register_msi_handler(const pcie_msi_block_t* block,
                               uint msi_id,
                               int_handler handler,
                               void* ctx);
+status_t x86_get_msi_target(const pcie_msi_block_t* block,
+                            uint msi_id,
+                            uint cpu_num,
+                            uint64_t* out_tgt_addr,
+                            uint32_t* out_tgt_data);
 
 status_t platform_configure_watchdog(uint32_t frequency);
 
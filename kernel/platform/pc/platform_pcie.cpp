@@ -40,6 +40,14 @@ public:
                             void*                   ctx) override {
         x86_register_msi_handler(block, msi_id, handler, ctx);
     }
+
+    status_t GetMsiTarget(const pcie_msi_block_t* block,
+                          uint                    msi_id,
+                          uint                    cpu_num,
+                          uint64_t*               out_tgt_addr,
+                          uint32_t*               out_tgt_data) override {
+        return x86_get_msi_target(block, msi_id, cpu_num, out_tgt_addr, out_tgt_data);
+    }
 };
 
 X86PciePlatformSupport platform_pcie_support;
@@ -17,6 +17,7 @@
 #include <assert.h>
 #include <magenta/compiler.h>
 #include <debug.h>
+#include <lib/ktrace.h>
 #include <trace.h>
 
 #define LOCAL_TRACE 0
@@ -28,6 +29,17 @@
 extern const struct lk_init_struct __start_lk_init[] __WEAK;
 extern const struct lk_init_struct __stop_lk_init[] __WEAK;
 
+// more than there are primary cpu hooks; any past this aren't timed
+#define MAX_INIT_TIMINGS 128
+static struct lk_init_timing init_timings[MAX_INIT_TIMINGS];
+static size_t init_timing_count;
+
+size_t lk_init_timings(const struct lk_init_timing **timings)
+{
+    *timings = init_timings;
+    return init_timing_count;
+}
+
 void lk_init_level(enum lk_init_flags required_flag, uint start_level, uint stop_level)
 {
     LTRACEF("flags %#x, start_level %#x, stop_level %#x\n",
@@ -83,7 +95,14 @@ void lk_init_level(enum lk_init_flags required_flag, uint start_level, uint stop
                    arch_curr_cpu_num(), found->hook, found->name, found->level, found->flags);
         }
 #endif
+        uint64_t start = ktrace_timestamp();
         found->hook(found->level);
+        if (required_flag == LK_INIT_FLAG_PRIMARY_CPU && init_timing_count < MAX_INIT_TIMINGS) {
+            struct lk_init_timing *t = &init_timings[init_timing_count++];
+            t->hook = found;
+            t->start = start;
+            t->end = ktrace_timestamp();
+        }
         last_called_level = found->level;
         last = found;
     }
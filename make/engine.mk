@@ -37,6 +37,9 @@ endif
 LKNAME ?= magenta
 CLANG_TARGET_FUCHSIA ?= false
 USE_LINKER_GC ?= true
+ENABLE_LOCK_STATS ?= false
+ENABLE_HEAP_TAGS ?= false
+ENABLE_SYSCALL_HOOKS ?= false
 
 
 # If no build directory suffix has been explicitly supplied by the environment,
@@ -326,6 +329,21 @@ MDI_INCLUDES := system/public/magenta/mdi/magenta.mdi
 KERNEL_DEFINES += WITH_PANIC_BACKTRACE=1 WITH_FRAME_POINTERS=1
 KERNEL_COMPILEFLAGS += $(KEEP_FRAME_POINTER_COMPILEFLAGS)
 
+# count kernel lock contention, see kernel/include/kernel/lockstat.h
+ifeq ($(call TOBOOL,$(ENABLE_LOCK_STATS)),true)
+KERNEL_DEFINES += WITH_LOCK_STATS=1
+endif
+
+# trace every syscall's arguments and result, see kernel/lib/syscalls/syscalls.cpp
+ifeq ($(call TOBOOL,$(ENABLE_SYSCALL_HOOKS)),true)
+KERNEL_DEFINES += WITH_SYSCALL_HOOKS=1
+endif
+
+# count kernel heap usage by allocation tag, see kernel/lib/heap/include/lib/heap.h
+ifeq ($(call TOBOOL,$(ENABLE_HEAP_TAGS)),true)
+KERNEL_DEFINES += WITH_HEAP_TAGS=1
+endif
+
 # userspace boot file system generated by the build system
 USER_BOOTDATA := $(BUILDDIR)/bootdata.bin
 USER_FS := $(BUILDDIR)/user.fs
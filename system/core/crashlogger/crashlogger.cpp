@@ -40,6 +40,10 @@ using gregs_type = int; // unsupported arch
 // Ultimately will want to switch this to off.
 static bool swbreak_backtrace_enabled = true;
 
+// If true then a backtrace of each of the other threads of the process is
+// printed as well.
+static bool other_threads_dump_enabled = true;
+
 #ifdef __x86_64__
 // If true then an attempt is made to dump processor trace data.
 // Requires processor tracing turned on in the kernel.
@@ -231,6 +235,101 @@ void resume_thread_from_exception(mx_handle_t thread,
     resume_thread(thread, false);
 }
 
+// The most threads of a process, besides the crashed one, that get dumped.
+constexpr size_t kMaxDumpThreads = 64;
+
+// How long to wait for the other threads to stop before dumping the ones
+// that have.
+constexpr mx_duration_t kSuspendTimeout = MX_MSEC(100);
+
+// Fetches the registers a backtrace starts from out of |regs|.
+static bool get_frame(const gregs_type& regs, mx_vaddr_t* pc, mx_vaddr_t* sp, mx_vaddr_t* fp) {
+#if defined(__x86_64__)
+    *pc = regs.rip;
+    *sp = regs.rsp;
+    *fp = regs.rbp;
+    return true;
+#elif defined(__aarch64__)
+    *pc = regs.pc;
+    *sp = regs.sp;
+    *fp = regs.r[29];
+    return true;
+#else
+    return false;
+#endif
+}
+
+static bool thread_is_stopped(mx_handle_t thread) {
+    mx_info_thread_t info;
+    if (mx_object_get_info(thread, MX_INFO_THREAD, &info, sizeof(info), nullptr, nullptr) != MX_OK)
+        return false;
+    return info.state == MX_THREAD_STATE_SUSPENDED ||
+           info.wait_exception_port_type != MX_EXCEPTION_PORT_TYPE_NONE;
+}
+
+// Prints a backtrace of each of the other threads of |process|.
+// The threads are all asked to suspend before waiting for any of them, so
+// they stop in parallel, and they all carry on once they've been dumped.
+static void dump_other_threads(mx_handle_t process, mx_koid_t crashed_tid, bool use_libunwind) {
+    mx_koid_t koids[kMaxDumpThreads + 1];
+    size_t num_koids;
+    size_t avail;
+    mx_status_t status = mx_object_get_info(process, MX_INFO_PROCESS_THREADS,
+                                            koids, sizeof(koids), &num_koids, &avail);
+    if (status != MX_OK) {
+        print_mx_error("unable to get the list of threads", status);
+        return;
+    }
+
+    mx_handle_t threads[kMaxDumpThreads + 1];
+    bool suspended[kMaxDumpThreads + 1];
+    size_t num_threads = 0;
+    for (size_t i = 0; i < num_koids; ++i) {
+        if (koids[i] == crashed_tid)
+            continue;
+        mx_handle_t thread;
+        if (mx_object_get_child(process, koids[i], MX_RIGHT_SAME_RIGHTS, &thread) != MX_OK)
+            continue;
+        threads[num_threads] = thread;
+        suspended[num_threads] = mx_task_suspend(thread) == MX_OK;
+        ++num_threads;
+    }
+    if (avail > num_koids)
+        printf("(only dumping %zu of %zu threads)\n", num_koids, avail);
+
+    mx_time_t deadline = mx_deadline_after(kSuspendTimeout);
+    for (;;) {
+        bool all_stopped = true;
+        for (size_t i = 0; i < num_threads; ++i) {
+            if (suspended[i] && !thread_is_stopped(threads[i]))
+                all_stopped = false;
+        }
+        if (all_stopped || mx_time_get(MX_CLOCK_MONOTONIC) >= deadline)
+            break;
+        mx_nanosleep(mx_deadline_after(MX_MSEC(1)));
+    }
+
+    for (size_t i = 0; i < num_threads; ++i) {
+        mx_koid_t tid = get_koid(threads[i]);
+        gregs_type regs;
+        mx_vaddr_t pc, sp, fp;
+        if (!thread_is_stopped(threads[i]) ||
+            !read_general_regs(threads[i], &regs, sizeof(regs)) ||
+            !get_frame(regs, &pc, &sp, &fp)) {
+            printf("<== thread [%" PRIu64 "] didn't stop, no backtrace\n", tid);
+            continue;
+        }
+        printf("<== thread [%" PRIu64 "]\n", tid);
+        backtrace(process, threads[i], pc, sp, fp, use_libunwind);
+    }
+
+    for (size_t i = 0; i < num_threads; ++i) {
+        if (suspended[i])
+            mx_task_resume(threads[i], 0);
+        mx_handle_close(threads[i]);
+    }
+}
+
 void process_report(const mx_exception_report_t* report, bool use_libunwind) {
     if (!MX_EXCP_IS_ARCH(report->header.type))
         return;
@@ -306,8 +405,8 @@ void process_report(const mx_exception_report_t* report, bool use_libunwind) {
     printf("arch: %s\n", arch);
     backtrace(process, thread, pc, sp, fp, use_libunwind);
 
-    // TODO(dje): Print a backtrace of all other threads in the process.
-    // Need to be able to suspend/resume threads first. MG-588
+    if (other_threads_dump_enabled)
+        dump_other_threads(process, context.tid, use_libunwind);
 
 #ifdef __x86_64__
     if (pt_dump_enabled) {
@@ -407,6 +506,8 @@ void usage() {
     fprintf(stderr, "  -n = do not use libunwind\n");
     fprintf(stderr, "  -s[on|off] = enable s/w breakpoints to trigger\n");
     fprintf(stderr, "      a backtrace without terminating the process\n");
+    fprintf(stderr, "  -a[on|off] = also print backtraces of the\n");
+    fprintf(stderr, "      process's other threads\n");
 }
 
 int main(int argc, char** argv) {
@@ -451,6 +552,15 @@ int main(int argc, char** argv) {
                 usage();
                 return 1;
             }
+        } else if (strncmp(arg, "-a", 2) == 0) {
+            if (arg[2] == '\0' || strcmp(arg, "-aon") == 0) {
+                other_threads_dump_enabled = true;
+            } else if (strcmp(arg, "-aoff") == 0) {
+                other_threads_dump_enabled = false;
+            } else {
+                usage();
+                return 1;
+            }
         } else {
             usage();
             return 1;
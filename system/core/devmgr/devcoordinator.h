@@ -31,6 +31,8 @@ struct dc_pending {
     list_node_t node;
     void* ctx;
     uint32_t op;
+    // when the request was sent
+    mx_time_t started;
 };
 
 #define PENDING_BIND 1
@@ -121,6 +123,17 @@ struct dc_driver {
     uint32_t flags;
     struct list_node node;
     const char* libname;
+
+    // the binding program compiled at load, by dc_compile_binding():
+    // for each instruction, the index of the LABEL its GOTO goes to
+    const uint16_t* bind_jumps;
+    // the only protocol the program can match, unless any_protocol
+    uint32_t bind_protocol;
+    bool any_protocol;
+
+    // in the coordinator's index of drivers by bind_protocol
+    struct list_node inode;
+    uint32_t index_order;
 };
 
 #define DRIVER_NAME_LEN_MAX 64
@@ -140,6 +153,17 @@ bool dc_is_bindable(driver_t* drv, uint32_t protocol_id,
                     mx_device_prop_t* props, size_t prop_count,
                     bool autobind);
 
+// Compiles a newly loaded driver's binding program, with room in
+// |jumps| for one entry per instruction, and works out its
+// bind_protocol: a program can only match a device of one protocol
+// when it aborts unless BIND_PROTOCOL is some value before doing
+// anything else that could match.
+void dc_compile_binding(driver_t* drv, uint16_t* jumps);
+
+// The BIND_PROTOCOL a binding program sees for a device.
+uint32_t dc_device_protocol(uint32_t protocol_id,
+                            mx_device_prop_t* props, size_t prop_count);
+
 #define DC_MAX_DATA 4096
 
 // The first two fields of devcoordinator messages align
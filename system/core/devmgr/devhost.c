@@ -7,6 +7,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <threads.h>
 #include <unistd.h>
 
 #include <ddk/device.h>
@@ -35,6 +36,18 @@ static mx_status_t dh_handle_dc_rpc(port_handler_t* ph, mx_signals_t signals, ui
 
 static port_t dh_port;
 
+// Connections to devices are served from dh_port too, unless
+// devhost.rpc-threads asks for more than one thread: then they get a
+// port of their own and that many threads to serve it, so a slow
+// request to one device doesn't hold up those to every other.  Each
+// connection is still served by one thread at a time.
+#define DH_RIO_THREADS_MAX 16
+static port_t dh_rio_port;
+static port_t* dh_rio = &dh_port;
+
+// the most messages taken from a connection before returning to its port
+#define DH_RIO_BATCH 16
+
 typedef struct devhost_iostate iostate_t;
 
 static iostate_t root_ios = {
@@ -401,7 +414,14 @@ static mx_status_t dh_handle_rio_rpc(port_handler_t* ph, mx_signals_t signals, u
     mx_status_t r;
     mxrio_msg_t msg;
     if (signals & MX_CHANNEL_READABLE) {
-        if ((r = mxrio_handle_rpc(ph->handle, &msg, devhost_rio_handler, ios)) == MX_OK) {
+        // Handle whatever else is already queued on the channel while
+        // here, rather than waiting on the port again for each message.
+        for (unsigned n = 0; n < DH_RIO_BATCH; n++) {
+            if ((r = mxrio_handle_rpc(ph->handle, &msg, devhost_rio_handler, ios)) != MX_OK) {
+                break;
+            }
+        }
+        if ((r == MX_OK) || (r == MX_ERR_SHOULD_WAIT)) {
             return MX_OK;
         }
     } else if (signals & MX_CHANNEL_PEER_CLOSED) {
@@ -595,7 +615,45 @@ mx_status_t devhost_start_iostate(devhost_iostate_t* ios, mx_handle_t h) {
     ios->ph.handle = h;
     ios->ph.waitfor = MX_CHANNEL_READABLE | MX_CHANNEL_PEER_CLOSED;
     ios->ph.func = dh_handle_rio_rpc;
-    return port_wait(&dh_port, &ios->ph);
+    return port_wait(dh_rio, &ios->ph);
+}
+
+static int dh_rio_thread(void* arg) {
+    mx_status_t r = port_dispatch(&dh_rio_port, MX_TIME_INFINITE, false);
+    log(ERROR, "devhost: rio port dispatch finished: %d\n", r);
+    return 0;
+}
+
+static void devhost_rio_init(void) {
+    const char* arg = getenv("devhost.rpc-threads");
+    unsigned count = (arg != NULL) ? strtoul(arg, NULL, 10) : 1;
+    if (count <= 1) {
+        return;
+    }
+    if (count > DH_RIO_THREADS_MAX) {
+        count = DH_RIO_THREADS_MAX;
+    }
+
+    mx_status_t r;
+    if ((r = port_init(&dh_rio_port)) < 0) {
+        log(ERROR, "devhost: could not create rio port: %d\n", r);
+        return;
+    }
+    unsigned started = 0;
+    for (unsigned n = 0; n < count; n++) {
+        thrd_t t;
+        if (thrd_create_with_name(&t, dh_rio_thread, NULL, "devhost-rio") != thrd_success) {
+            break;
+        }
+        thrd_detach(t);
+        started++;
+    }
+    if (started == 0) {
+        log(ERROR, "devhost: could not start rio threads\n");
+        mx_handle_close(dh_rio_port.handle);
+        return;
+    }
+    dh_rio = &dh_rio_port;
 }
 
 __EXPORT int device_host_main(int argc, char** argv) {
@@ -619,6 +677,7 @@ __EXPORT int device_host_main(int argc, char** argv) {
         log(ERROR, "devhost: could not create port: %d\n", r);
         return -1;
     }
+    devhost_rio_init();
     if ((r = port_wait(&dh_port, &root_ios.ph)) < 0) {
         log(ERROR, "devhost: could not watch rpc channel: %d\n", r);
         return -1;
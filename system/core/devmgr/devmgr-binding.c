@@ -16,10 +16,13 @@ typedef struct {
     uint32_t protocol_id;
     uint32_t binding_size;
     const mx_bind_inst_t* binding;
+    const uint16_t* jumps;
     const char* name;
     uint32_t autobind;
 } bpctx_t;
 
+#define NO_LABEL UINT16_MAX
+
 static uint32_t dev_get_prop(bpctx_t* ctx, uint32_t id) {
     const mx_device_prop_t* props = ctx->props;
     const mx_device_prop_t* end = ctx->end;
@@ -104,6 +107,15 @@ static bool is_bindable(bpctx_t* ctx) {
             case OP_MATCH:
                 return true;
             case OP_GOTO: {
+                if (ctx->jumps != NULL) {
+                    uint16_t target = ctx->jumps[ip - ctx->binding];
+                    if (target != NO_LABEL) {
+                        ip = ctx->binding + target;
+                        goto next_instruction;
+                    }
+                    printf("devmgr: driver '%s' illegal GOTO\n", ctx->name);
+                    return false;
+                }
                 uint32_t label = BINDINST_PA(inst);
                 while (++ip < end) {
                     if ((BINDINST_OP(ip->op) == OP_LABEL) &&
@@ -138,6 +150,79 @@ next_instruction:
     return false;
 }
 
+static bool binding_protocol(const mx_bind_inst_t* binding, uint32_t binding_size,
+                             uint32_t* protocol) {
+    const mx_bind_inst_t* ip = binding;
+    const mx_bind_inst_t* end = ip + (binding_size / sizeof(mx_bind_inst_t));
+
+    // Leading aborts can only rule devices out, and GOTO only jumps
+    // forward, so the first abort-unless-protocol holds for every match.
+    for (; ip < end; ip++) {
+        uint32_t inst = ip->op;
+        switch (BINDINST_OP(inst)) {
+        case OP_ABORT:
+            if ((BINDINST_CC(inst) == COND_NE) &&
+                (BINDINST_PB(inst) == BIND_PROTOCOL)) {
+                *protocol = ip->arg;
+                return true;
+            }
+            break;
+        case OP_SET:
+        case OP_CLEAR:
+        case OP_LABEL:
+            break;
+        case OP_MATCH:
+            // a program which is just "match if the protocol is ..."
+            if ((BINDINST_CC(inst) == COND_EQ) &&
+                (BINDINST_PB(inst) == BIND_PROTOCOL) && (ip + 1 == end)) {
+                *protocol = ip->arg;
+                return true;
+            }
+            return false;
+        default:
+            return false;
+        }
+    }
+    return false;
+}
+
+void dc_compile_binding(driver_t* drv, uint16_t* jumps) {
+    const mx_bind_inst_t* binding = drv->binding;
+    size_t count = drv->binding_size / sizeof(mx_bind_inst_t);
+
+    drv->any_protocol = !binding_protocol(binding, drv->binding_size,
+                                          &drv->bind_protocol);
+
+    // GOTO only jumps forward, to the first matching LABEL after it
+    if (count >= NO_LABEL) {
+        return;
+    }
+    for (size_t n = 0; n < count; n++) {
+        jumps[n] = NO_LABEL;
+        if (BINDINST_OP(binding[n].op) != OP_GOTO) {
+            continue;
+        }
+        uint32_t label = BINDINST_PA(binding[n].op);
+        for (size_t m = n + 1; m < count; m++) {
+            if ((BINDINST_OP(binding[m].op) == OP_LABEL) &&
+                (BINDINST_PA(binding[m].op) == label)) {
+                jumps[n] = m;
+                break;
+            }
+        }
+    }
+    drv->bind_jumps = jumps;
+}
+
+uint32_t dc_device_protocol(uint32_t protocol_id,
+                            mx_device_prop_t* props, size_t prop_count) {
+    bpctx_t ctx;
+    ctx.props = props;
+    ctx.end = props + prop_count;
+    ctx.protocol_id = protocol_id;
+    return dev_get_prop(&ctx, BIND_PROTOCOL);
+}
+
 bool dc_is_bindable(driver_t* drv, uint32_t protocol_id,
                     mx_device_prop_t* props, size_t prop_count,
                     bool autobind) {
@@ -150,6 +235,7 @@ bool dc_is_bindable(driver_t* drv, uint32_t protocol_id,
     ctx.protocol_id = protocol_id;
     ctx.binding = drv->binding;
     ctx.binding_size = drv->binding_size;
+    ctx.jumps = drv->bind_jumps;
     ctx.name = drv->name;
     ctx.autobind = autobind ? 1 : 0;
     return is_bindable(&ctx);
@@ -4,6 +4,7 @@
 
 #include <ctype.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
@@ -11,6 +12,7 @@
 #include <ddk/driver.h>
 #include <driver-info/driver-info.h>
 #include <launchpad/launchpad.h>
+#include <launchpad/vmo.h>
 #include <magenta/assert.h>
 #include <magenta/ktrace.h>
 #include <magenta/processargs.h>
@@ -20,6 +22,7 @@
 
 #include "acpi.h"
 #include "devcoordinator.h"
+#include "devmgr.h"
 #include "log.h"
 #include "memfs-private.h"
 
@@ -144,6 +147,35 @@ static list_node_t list_drivers_new = LIST_INITIAL_VALUE(list_drivers_new);
 // All Devices (excluding static immortal devices)
 static list_node_t list_devices = LIST_INITIAL_VALUE(list_devices);
 
+// All Drivers again, by the protocol their binding programs require,
+// so that a new device is only tried against those that could bind to
+// it.  Each bucket, like the list of drivers with no one protocol,
+// keeps the order of All Drivers.  Rebuilt once that changes.
+#define DRIVER_BUCKETS 64
+static list_node_t driver_buckets[DRIVER_BUCKETS];
+static list_node_t list_drivers_any;
+static bool driver_index_stale = true;
+
+static void dc_index_drivers(void) {
+    for (unsigned n = 0; n < DRIVER_BUCKETS; n++) {
+        list_initialize(&driver_buckets[n]);
+    }
+    list_initialize(&list_drivers_any);
+
+    uint32_t order = 0;
+    driver_t* drv;
+    list_for_every_entry(&list_drivers, drv, driver_t, node) {
+        drv->index_order = order++;
+        if (drv->any_protocol) {
+            list_add_tail(&list_drivers_any, &drv->inode);
+        } else {
+            list_add_tail(&driver_buckets[drv->bind_protocol % DRIVER_BUCKETS],
+                          &drv->inode);
+        }
+    }
+    driver_index_stale = false;
+}
+
 static driver_t* libname_to_driver(const char* libname) {
     driver_t* drv;
     list_for_every_entry(&list_drivers, drv, driver_t, node) {
@@ -475,11 +507,28 @@ static void dc_watch(mx_handle_t h) {
     }
 }
 
+// Every devhost is the same binary, so it's only looked at once.
+static launchpad_template_t* devhost_template;
+
 static mx_status_t dc_launch_devhost(devhost_t* host,
                                      const char* name, mx_handle_t hrpc) {
+    mx_time_t start = mx_time_get(MX_CLOCK_MONOTONIC);
+    if (devhost_template == NULL) {
+        mx_status_t r = launchpad_template_create(
+            launchpad_vmo_from_file(devhost_bin), MX_HANDLE_INVALID, &devhost_template);
+        if (r < 0) {
+            log(ERROR, "devcoord: cannot load '%s': %d\n", devhost_bin, r);
+            devhost_template = NULL;
+        }
+    }
+
     launchpad_t* lp;
     launchpad_create_with_jobs(devhost_job, 0, name, &lp);
-    launchpad_load_from_file(lp, devhost_bin);
+    if (devhost_template != NULL) {
+        launchpad_load_from_template(lp, devhost_template);
+    } else {
+        launchpad_load_from_file(lp, devhost_bin);
+    }
     launchpad_set_args(lp, 1, &devhost_bin);
 
     launchpad_add_handle(lp, hrpc, PA_HND(PA_USER0, 0));
@@ -509,6 +558,8 @@ static mx_status_t dc_launch_devhost(devhost_t* host,
 
     const char* errmsg;
     mx_status_t status = launchpad_go(lp, &host->proc, &errmsg);
+    // one stage for all of them, as there is a devhost for most devices
+    devmgr_timeline("launch:devhost", start, status);
     if (status < 0) {
         log(ERROR, "devcoord: launch devhost '%s': failed: %d: %s\n",
             name, status, errmsg);
@@ -848,6 +899,20 @@ static mx_status_t dc_bind_device(device_t* dev, const char* drvlibname) {
     return MX_OK;
 };
 
+// Binds go on the boot timeline as "bind:<driver>", by the driver's
+// library name without its directory or ".so".
+static void dc_bind_timeline(const char* libname, mx_time_t start, mx_status_t status) {
+    const char* base = strrchr(libname, '/');
+    base = base ? base + 1 : libname;
+    size_t len = strlen(base);
+    if ((len > 3) && !strcmp(base + len - 3, ".so")) {
+        len -= 3;
+    }
+    char stage[MX_MAX_NAME_LEN];
+    snprintf(stage, sizeof(stage), "bind:%.*s", (int) len, base);
+    devmgr_timeline(stage, start, status);
+}
+
 static mx_status_t dc_handle_device_read(device_t* dev) {
     dc_msg_t msg;
     mx_handle_t hin[2];
@@ -967,6 +1032,10 @@ static mx_status_t dc_handle_device_read(device_t* dev) {
         }
         switch (pending->op) {
         case PENDING_BIND:
+            log(BIND, "devcoord: bind '%s' to dev='%s': status %d after %" PRIu64 "us\n",
+                (const char*) pending->ctx, dev->name, msg.status,
+                (mx_time_get(MX_CLOCK_MONOTONIC) - pending->started) / 1000);
+            dc_bind_timeline((const char*) pending->ctx, pending->started, msg.status);
             if (msg.status != MX_OK) {
                 log(ERROR, "devcoord: rpc: bind-driver '%s' status %d\n",
                     dev->name, msg.status);
@@ -1156,6 +1225,8 @@ static mx_status_t dh_bind_driver(device_t* dev, const char* libname) {
         return r;
     }
 
+    pending->started = mx_time_get(MX_CLOCK_MONOTONIC);
+
     msg.txid = 0;
     msg.op = DC_OP_BIND_DRIVER;
 
@@ -1166,7 +1237,8 @@ static mx_status_t dh_bind_driver(device_t* dev, const char* libname) {
 
     dev->flags |= DEV_CTX_BOUND;
     pending->op = PENDING_BIND;
-    pending->ctx = NULL;
+    // drivers, and so their names, are never freed
+    pending->ctx = (void*) libname;
     list_add_tail(&dev->pending, &pending->node);
     return MX_OK;
 }
@@ -1219,9 +1291,31 @@ static mx_status_t dc_attempt_bind(driver_t* drv, device_t* dev) {
 }
 
 static void dc_handle_new_device(device_t* dev) {
-    driver_t* drv;
+    if (driver_index_stale) {
+        dc_index_drivers();
+    }
+
+    // Walk the drivers for this protocol and those for any protocol
+    // together, in the order of All Drivers.
+    uint32_t protocol = dc_device_protocol(dev->protocol_id,
+                                           dev->props, dev->prop_count);
+    list_node_t* bucket = &driver_buckets[protocol % DRIVER_BUCKETS];
+    driver_t* next = list_peek_head_type(bucket, driver_t, inode);
+    driver_t* next_any = list_peek_head_type(&list_drivers_any, driver_t, inode);
+    while ((next != NULL) || (next_any != NULL)) {
+        driver_t* drv;
+        if ((next == NULL) ||
+            ((next_any != NULL) && (next_any->index_order < next->index_order))) {
+            drv = next_any;
+            next_any = list_next_type(&list_drivers_any, &drv->inode, driver_t, inode);
+        } else {
+            drv = next;
+            next = list_next_type(bucket, &drv->inode, driver_t, inode);
+            if (drv->bind_protocol != protocol) {
+                continue;
+            }
+        }
 
-    list_for_every_entry(&list_drivers, drv, driver_t, node) {
         if (dc_is_bindable(drv, dev->protocol_id,
                            dev->props, dev->prop_count, true)) {
             log(INFO, "devcoord: drv='%s' bindable to dev='%s'\n",
@@ -1271,6 +1365,7 @@ void dc_driver_added(driver_t* drv, const char* version) {
         }
         return;
     }
+    driver_index_stale = true;
     if (version[0] == '!') {
         // debugging / development hack
         // prioritize drivers with version "!..." over others
@@ -1341,6 +1436,7 @@ void dc_handle_new_driver(void) {
     driver_t* drv;
     while ((drv = list_remove_head_type(&list_drivers_new, driver_t, node)) != NULL) {
         list_add_tail(&list_drivers, &drv->node);
+        driver_index_stale = true;
         dc_bind_driver(drv);
     }
 }
@@ -1355,8 +1451,10 @@ static mx_status_t dc_control_event(port_handler_t* ph, mx_signals_t signals, ui
     case CTL_SCAN_SYSTEM:
         if (!system_loaded) {
             system_loaded = true;
+            mx_time_t start = mx_time_get(MX_CLOCK_MONOTONIC);
             find_loadable_drivers("/system/driver");
             find_loadable_drivers("/system/lib/driver");
+            devmgr_timeline("devmgr:system-drivers", start, 0);
         }
         break;
     }
@@ -1379,6 +1477,9 @@ void coordinator(void) {
     if (getenv("devmgr.verbose")) {
         log_flags |= LOG_DEVLC;
     }
+    if (getenv("devmgr.log-bind")) {
+        log_flags |= LOG_BIND;
+    }
     acpi_init();
 
     devfs_publish(&root_device, &misc_device);
@@ -1387,9 +1488,11 @@ void coordinator(void) {
         devfs_publish(&root_device, &platform_device);
     }
 
+    mx_time_t start = mx_time_get(MX_CLOCK_MONOTONIC);
     find_loadable_drivers("/boot/driver");
     find_loadable_drivers("/boot/driver/test");
     find_loadable_drivers("/boot/lib/driver");
+    devmgr_timeline("devmgr:boot-drivers", start, 0);
 
     // Special case early handling for the ramdisk boot
     // path where /system is present before the coordinator
@@ -36,7 +36,8 @@ static void found_driver(magenta_driver_note_t* note, mx_bind_inst_t* bi, void*
     size_t pathlen = strlen(libname) + 1;
     size_t namelen = strlen(note->name) + 1;
     size_t bindlen = note->bindcount * sizeof(mx_bind_inst_t);
-    size_t len = sizeof(driver_t) + bindlen + pathlen + namelen;
+    size_t jumpslen = note->bindcount * sizeof(uint16_t);
+    size_t len = sizeof(driver_t) + bindlen + jumpslen + pathlen + namelen;
 
     driver_t* drv;
     if ((drv = malloc(len)) == NULL) {
@@ -46,12 +47,14 @@ static void found_driver(magenta_driver_note_t* note, mx_bind_inst_t* bi, void*
     memset(drv, 0, sizeof(driver_t));
     drv->binding_size = bindlen;
     drv->binding = (void*) (drv + 1);
-    drv->libname = (void*) (drv->binding + note->bindcount);
+    uint16_t* jumps = (void*) (drv->binding + note->bindcount);
+    drv->libname = (void*) (jumps + note->bindcount);
     drv->name = drv->libname + pathlen;
 
     memcpy((void*) drv->binding, bi, bindlen);
     memcpy((void*) drv->libname, libname, pathlen);
     memcpy((void*) drv->name, note->name, namelen);
+    dc_compile_binding(drv, jumps);
 
 #if VERBOSE_DRIVER_LOAD
     printf("found driver: %s\n", (char*) cookie);
@@ -86,6 +86,8 @@ mx_status_t devmgr_launch(mx_handle_t job, const char* name,
     }
     envp[envn++] = NULL;
 
+    mx_time_t start = mx_time_get(MX_CLOCK_MONOTONIC);
+
     mx_handle_t job_copy = MX_HANDLE_INVALID;;
     mx_handle_duplicate(job, CHILD_JOB_RIGHTS, &job_copy);
 
@@ -125,6 +127,9 @@ mx_status_t devmgr_launch(mx_handle_t job, const char* name,
     } else {
         printf("devmgr: launch %s (%s) OK\n", argv[0], name);
     }
+    char stage[MX_MAX_NAME_LEN];
+    snprintf(stage, sizeof(stage), "launch:%s", name);
+    devmgr_timeline(stage, start, status);
     return status;
 }
 
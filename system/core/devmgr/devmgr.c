@@ -13,6 +13,7 @@
 #include <magenta/device/console.h>
 #include <magenta/device/vfs.h>
 #include <magenta/dlfcn.h>
+#include <magenta/ktrace.h>
 #include <magenta/process.h>
 #include <magenta/processargs.h>
 #include <magenta/syscalls.h>
@@ -48,6 +49,16 @@ mx_handle_t virtcon_open;
 mx_handle_t get_root_resource(void) {
     return root_resource_handle;
 }
+void devmgr_timeline(const char* stage, mx_time_t start, uint32_t detail) {
+    char name[MX_MAX_NAME_LEN] = {};
+    snprintf(name, sizeof(name), KTRACE_BOOT_PREFIX "%s", stage);
+    mx_status_t id = mx_ktrace_control(root_resource_handle, KTRACE_ACTION_NEW_PROBE, 0, name);
+    if (id >= 0) {
+        mx_time_t duration = mx_time_get(MX_CLOCK_MONOTONIC) - start;
+        mx_ktrace_write(root_resource_handle, id, (uint32_t)(duration / MX_USEC(1)), detail);
+    }
+}
+
 mx_handle_t get_sysinfo_job_root(void) {
     mx_handle_t h;
     //TODO: limit to enumerate rights
@@ -78,6 +89,17 @@ static mx_status_t launch_fat(int argc, const char** argv, mx_handle_t* hnd,
 
 static bool data_mounted = false;
 
+// mount(), putting how long it took on the boot timeline
+static mx_status_t devmgr_mount(int fd, const char* path, disk_format_t df,
+                                const mount_options_t* options, LaunchCallback cb) {
+    mx_time_t start = mx_time_get(MX_CLOCK_MONOTONIC);
+    mx_status_t st = mount(fd, path, df, options, cb);
+    char stage[MX_MAX_NAME_LEN];
+    snprintf(stage, sizeof(stage), "mount:%s", path);
+    devmgr_timeline(stage, start, st);
+    return st;
+}
+
 /*
  * Attempt to mount the device pointed to be the file descriptor at a known
  * location.
@@ -106,7 +128,7 @@ static mx_status_t mount_minfs(int fd, mount_options_t* options) {
             options->wait_until_ready = true;
             options->create_mountpoint = true;
 
-            mx_status_t st = mount(fd, "/system", DISK_FORMAT_MINFS, options, launch_minfs);
+            mx_status_t st = devmgr_mount(fd, "/system", DISK_FORMAT_MINFS, options, launch_minfs);
             if (st != MX_OK) {
                 printf("devmgr: failed to mount /system, retcode = %d\n", st);
             } else {
@@ -121,7 +143,7 @@ static mx_status_t mount_minfs(int fd, mount_options_t* options) {
             data_mounted = true;
             options->wait_until_ready = true;
 
-            mx_status_t st = mount(fd, "/data", DISK_FORMAT_MINFS, options, launch_minfs);
+            mx_status_t st = devmgr_mount(fd, "/data", DISK_FORMAT_MINFS, options, launch_minfs);
             if (st != MX_OK) {
                 printf("devmgr: failed to mount /data, retcode = %d\n", st);
             }
@@ -169,7 +191,7 @@ static mx_status_t block_device_added(int dirfd, int event, const char* name, vo
     case DISK_FORMAT_BLOBFS: {
         mount_options_t options = default_mount_options;
         options.create_mountpoint = true;
-        mount(fd, "/blobstore", DISK_FORMAT_BLOBFS, &options, launch_blobstore);
+        devmgr_mount(fd, "/blobstore", DISK_FORMAT_BLOBFS, &options, launch_blobstore);
         return MX_OK;
     }
     case DISK_FORMAT_MINFS: {
@@ -203,7 +225,7 @@ static mx_status_t block_device_added(int dirfd, int event, const char* name, vo
         }
         options.wait_until_ready = false;
         printf("devmgr: fatfs\n");
-        mount(fd, mountpath, df, &options, launch_fat);
+        devmgr_mount(fd, mountpath, df, &options, launch_fat);
         return MX_OK;
     }
     default:
@@ -393,6 +415,8 @@ static void fetch_vdsos(void) {
 }
 
 int main(int argc, char** argv) {
+    mx_time_t started = mx_time_get(MX_CLOCK_MONOTONIC);
+
     // Close the loader-service channel so the service can go away.
     // We won't use it any more (no dlopen calls in this process).
     mx_handle_t loader_svc = dl_set_loader_service(MX_HANDLE_INVALID);
@@ -420,6 +444,7 @@ int main(int argc, char** argv) {
     mx_object_set_property(root_job_handle, MX_PROP_NAME, "root", 4);
 
     fetch_vdsos();
+    devmgr_timeline("devmgr:init", started, 0);
 
     mx_status_t status = mx_job_create(root_job_handle, 0u, &svcs_job_handle);
     if (status < 0) {
@@ -477,6 +502,7 @@ int main(int argc, char** argv) {
         thrd_detach(t);
     }
 
+    devmgr_timeline("devmgr:started", started, 0);
     devmgr_handle_messages();
     printf("devmgr: message handler returned?!\n");
     return 0;
@@ -29,6 +29,10 @@ int devmgr_start_appmgr(void* arg);
 
 void load_system_drivers(void);
 
+// Puts a stage that began at |start| on the boot timeline, as the
+// KTRACE_BOOT_PREFIX probe named for it, with |detail| as its arg1.
+void devmgr_timeline(const char* stage, mx_time_t start, uint32_t detail);
+
 // The variable to set on the kernel command line to enable ld.so tracing
 // of the processes we launch.
 #define LDSO_TRACE_CMDLINE "ldso.trace"
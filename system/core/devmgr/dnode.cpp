@@ -17,6 +17,12 @@
 
 namespace memfs {
 
+// Directories with no more children than this are searched in order.
+constexpr size_t kDnodeHashMin = 16;
+constexpr size_t kDnodeHashInitialBuckets = 32;
+// The table doubles once its chains average more than this.
+constexpr size_t kDnodeHashLoad = 2;
+
 // Create a new dnode and attach it to a vnode
 mxtl::RefPtr<Dnode> Dnode::Create(const char* name, size_t len, mxtl::RefPtr<VnodeMemfs> vn) {
     if ((len > kDnodeNameMax) || (len < 1)) {
@@ -44,10 +50,15 @@ void Dnode::RemoveFromParent() {
 
     // Detach from parent
     if (parent_) {
+        parent_->HashRemove(this);
+        if (parent_->readdir_last_ == this) {
+            parent_->readdir_last_ = nullptr;
+        }
+        parent_->child_count_--;
         parent_->children_.erase(*this);
         if (IsDirectory()) {
             // '..' no longer references parent.
-            parent_->vnode_->link_count_--;
+            parent_->vnode_->link_count_.fetch_sub(1);
         }
         if (parent_->vnode_->IsDetachedDevice() && !parent_->HasChildren()) {
             // Extremely special case: Parent is a detached device node,
@@ -58,7 +69,7 @@ void Dnode::RemoveFromParent() {
             delete parent_->vnode_.get();
         }
         parent_ = nullptr;
-        vnode_->link_count_--;
+        vnode_->link_count_.fetch_sub(1);
     }
 }
 
@@ -69,8 +80,11 @@ void Dnode::Detach() {
     }
 
     RemoveFromParent();
-    // Detach from vnode
-    vnode_->dnode_ = nullptr;
+    // Detach from vnode. Only a directory's vnode points back at its dnode;
+    // a file's is left untouched, since other threads may be reading it.
+    if (vnode_->dnode_.get() == this) {
+        vnode_->dnode_ = nullptr;
+    }
     vnode_ = nullptr;
 }
 
@@ -82,10 +96,10 @@ void Dnode::AddChild(mxtl::RefPtr<Dnode> parent, mxtl::RefPtr<Dnode> child) {
     MX_DEBUG_ASSERT(parent->IsDirectory());
 
     child->parent_ = parent;
-    child->vnode_->link_count_++;
+    child->vnode_->link_count_.fetch_add(1);
     if (child->IsDirectory()) {
         // Child has '..' pointing back at parent.
-        parent->vnode_->link_count_++;
+        parent->vnode_->link_count_.fetch_add(1);
     }
     // Ensure that the ordering of tokens in the children list is absolute.
     if (parent->children_.is_empty()) {
@@ -93,7 +107,72 @@ void Dnode::AddChild(mxtl::RefPtr<Dnode> parent, mxtl::RefPtr<Dnode> child) {
     } else {
         child->ordering_token_ = parent->children_.back().ordering_token_ + 1;
     }
+    Dnode* raw = child.get();
     parent->children_.push_back(mxtl::move(child));
+    parent->child_count_++;
+
+    if ((parent->buckets_ == nullptr) && (parent->child_count_ <= kDnodeHashMin)) {
+        return;
+    }
+    if ((parent->buckets_ == nullptr) ||
+        (parent->child_count_ > parent->bucket_count_ * kDnodeHashLoad)) {
+        if (parent->HashGrow()) {
+            return;
+        }
+        // Without memory for a bigger table, make do with what there is
+        if (parent->buckets_ == nullptr) {
+            return;
+        }
+    }
+    parent->HashInsert(raw);
+}
+
+uint32_t Dnode::HashName(const char* name, size_t len) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ static_cast<uint8_t>(name[i])) * 16777619u;
+    }
+    return hash;
+}
+
+void Dnode::HashInsert(Dnode* child) {
+    child->hash_ = HashName(child->name_.get(), child->NameLen());
+    Dnode** bucket = &buckets_[child->hash_ & (bucket_count_ - 1)];
+    child->hash_next_ = *bucket;
+    *bucket = child;
+}
+
+void Dnode::HashRemove(Dnode* child) {
+    if (buckets_ == nullptr) {
+        return;
+    }
+    for (Dnode** p = &buckets_[child->hash_ & (bucket_count_ - 1)]; *p != nullptr;
+         p = &(*p)->hash_next_) {
+        if (*p == child) {
+            *p = child->hash_next_;
+            child->hash_next_ = nullptr;
+            return;
+        }
+    }
+}
+
+// Rebuilds the table, twice the size (or at its initial size), from the list
+// of children.  Returns false, leaving the table as it was, if there is no
+// memory for it.
+bool Dnode::HashGrow() {
+    size_t count = (buckets_ == nullptr) ? kDnodeHashInitialBuckets : bucket_count_ * 2;
+    AllocChecker ac;
+    mxtl::unique_ptr<Dnode*[]> buckets(new (&ac) Dnode*[count]());
+    if (!ac.check()) {
+        return false;
+    }
+    buckets_ = mxtl::move(buckets);
+    bucket_count_ = count;
+    for (auto& dn : children_) {
+        HashInsert(&dn);
+    }
+    return true;
 }
 
 mx_status_t Dnode::Lookup(const char* name, size_t len, mxtl::RefPtr<Dnode>* out) const {
@@ -107,6 +186,20 @@ mx_status_t Dnode::Lookup(const char* name, size_t len, mxtl::RefPtr<Dnode>* out
         return MX_ERR_NOT_SUPPORTED;
     }
 
+    if (buckets_ != nullptr) {
+        uint32_t hash = HashName(name, len);
+        for (Dnode* dn = buckets_[hash & (bucket_count_ - 1)]; dn != nullptr;
+             dn = dn->hash_next_) {
+            if ((dn->hash_ == hash) && dn->NameMatch(name, len)) {
+                if (out != nullptr) {
+                    *out = mxtl::RefPtr<Dnode>(dn);
+                }
+                return MX_OK;
+            }
+        }
+        return MX_ERR_NOT_FOUND;
+    }
+
     auto dn = children_.find_if([&name, &len](const Dnode& elem) -> bool {
         return elem.NameMatch(name, len);
     });
@@ -157,7 +250,7 @@ mx_status_t Dnode::ReaddirStart(fs::DirentFiller* df, void* cookie) {
     return MX_OK;
 }
 
-void Dnode::Readdir(fs::DirentFiller* df, void* cookie) const {
+void Dnode::Readdir(fs::DirentFiller* df, void* cookie) {
     dircookie_t* c = static_cast<dircookie_t*>(cookie);
     mx_status_t r = 0;
 
@@ -167,7 +260,15 @@ void Dnode::Readdir(fs::DirentFiller* df, void* cookie) const {
         }
     }
 
-    for (const auto& dn : children_) {
+    // Children are in order of their tokens, so a listing which picks up
+    // where the last one stopped needn't walk past everything it has already
+    // returned.
+    auto it = children_.begin();
+    if ((readdir_last_ != nullptr) && (readdir_last_->ordering_token_ + 1 == c->order)) {
+        it = ++children_.make_iterator(*readdir_last_);
+    }
+    for (; it != children_.end(); ++it) {
+        Dnode& dn = *it;
         if (dn.ordering_token_ < c->order) {
             continue;
         }
@@ -176,6 +277,7 @@ void Dnode::Readdir(fs::DirentFiller* df, void* cookie) const {
             return;
         }
         c->order = dn.ordering_token_ + 1;
+        readdir_last_ = &dn;
     }
 }
 
@@ -205,7 +307,9 @@ void Dnode::PutName(mxtl::unique_ptr<char[]> name, size_t len) {
 bool Dnode::IsDirectory() const { return vnode_->IsDirectory(); }
 
 Dnode::Dnode(mxtl::RefPtr<VnodeMemfs> vn, mxtl::unique_ptr<char[]> name, uint32_t flags) :
-    vnode_(mxtl::move(vn)), parent_(nullptr), ordering_token_(0), flags_(flags), name_(mxtl::move(name)) {
+    vnode_(mxtl::move(vn)), parent_(nullptr), ordering_token_(0), child_count_(0),
+    bucket_count_(0), hash_next_(nullptr), hash_(0), readdir_last_(nullptr), flags_(flags),
+    name_(mxtl::move(name)) {
 };
 
 size_t Dnode::NameLen() const {
@@ -25,6 +25,10 @@ static_assert(NAME_MAX == 255, "NAME_MAX must be 255");
 static_assert(((kDnodeNameMax + 1) & kDnodeNameMax) == 0,
               "Expected kDnodeNameMax to be one less than a power of two");
 
+// A Dnode's children, and its place among its parent's children, are guarded
+// by the lock of the directory vnode holding them.  The parent pointers of
+// directories change only while the whole tree is locked; see
+// memfs-private.h.
 class Dnode : public mxtl::RefCounted<Dnode> {
 public:
     DISALLOW_COPY_ASSIGN_AND_MOVE(Dnode);
@@ -68,6 +72,8 @@ public:
     // MX_OK is still returned.
     // If "out" is provided as "nullptr", the returned status appears the
     // same, but the "out" argument is not touched.
+    //
+    // Large directories find their children by hashing the name.
     mx_status_t Lookup(const char* name, size_t len, mxtl::RefPtr<Dnode>* out) const;
 
     // Acquire a pointer to the vnode underneath this dnode.
@@ -82,7 +88,7 @@ public:
     // at the beginning of a directory.
     // On success, return the number of bytes read.
     static mx_status_t ReaddirStart(fs::DirentFiller* df, void* cookie);
-    void Readdir(fs::DirentFiller* df, void* cookie) const;
+    void Readdir(fs::DirentFiller* df, void* cookie);
 
     // Answers the question: "Is dn a subdirectory of this?"
     bool IsSubdirectory(mxtl::RefPtr<Dnode> dn) const;
@@ -102,6 +108,13 @@ private:
     size_t NameLen() const;
     bool NameMatch(const char* name, size_t len) const;
 
+    // The children's hash table, which exists once there are more than a few
+    // of them.  It doubles as it fills, and never shrinks.
+    static uint32_t HashName(const char* name, size_t len);
+    void HashInsert(Dnode* child);
+    void HashRemove(Dnode* child);
+    bool HashGrow();
+
     NodeState type_child_state_;
     NodeState type_device_state_;
     mxtl::RefPtr<VnodeMemfs> vnode_;
@@ -109,6 +122,15 @@ private:
     // Used to impose an absolute order on dnodes within a directory.
     size_t ordering_token_;
     ChildList children_;
+    size_t child_count_;
+    mxtl::unique_ptr<Dnode*[]> buckets_;
+    size_t bucket_count_;
+    // Chains dnodes within one of the parent's hash buckets.
+    Dnode* hash_next_;
+    uint32_t hash_;
+    // The child most recently returned by Readdir, from which the next
+    // Readdir of the directory will most likely carry on.
+    Dnode* readdir_last_;
     uint32_t flags_;
     mxtl::unique_ptr<char[]> name_;
 };
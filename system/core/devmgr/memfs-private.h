@@ -16,7 +16,9 @@
 
 #ifdef __cplusplus
 
+#include <mxtl/atomic.h>
 #include <mxtl/intrusive_double_list.h>
+#include <mxtl/mutex.h>
 #include <mxtl/ref_ptr.h>
 #include <mxtl/unique_ptr.h>
 
@@ -28,6 +30,24 @@ extern mxtl::unique_ptr<fs::Dispatcher> memfs_global_dispatcher;
 
 class Dnode;
 
+// Locking
+//
+// Memfs is served from a pool of threads, and takes none of the VFS layer's
+// global locks.  Instead:
+//
+// - Each vnode's |lock_| guards its own state: a file's contents and size, or
+//   a directory's children and remote handle.
+// - A reader-writer lock over the whole tree is held shared by every
+//   directory operation, and exclusively by those which add or remove a
+//   directory (mkdir, rmdir, rename, and mounting a subtree).  Holding it
+//   exclusively excludes every other directory operation, so rename can
+//   check ancestry and move entries between directories without taking
+//   either directory's lock.
+// - Link counts are atomic, since a file's names may be in several
+//   directories at once.
+//
+// The tree lock is taken before a vnode's lock, and no more than one
+// vnode's lock is held at a time.
 class VnodeMemfs : public fs::Vnode {
 public:
     virtual mx_status_t Setattr(vnattr_t* a) override;
@@ -36,6 +56,7 @@ public:
                   size_t in_len, void* out_buf, size_t out_len) final;
     mx_status_t AttachRemote(mx_handle_t h) final;
     fs::Dispatcher* GetDispatcher() final;
+    bool ConcurrentOps() const final { return true; }
 
     // To be more specific: Is this vnode connected into the directory hierarchy?
     // VnodeDirs can be unlinked, and this method will subsequently return false.
@@ -47,13 +68,14 @@ public:
     uint32_t seqcount_;
 
     mxtl::RefPtr<Dnode> dnode_;
-    uint32_t link_count_;
+    mxtl::atomic<uint32_t> link_count_;
 
 protected:
     VnodeMemfs();
 
+    mutable mxtl::Mutex lock_;
     uint64_t create_time_;
-    uint64_t modify_time_;
+    uint64_t modify_time_ TA_GUARDED(lock_);
 };
 
 class VnodeFile final : public VnodeMemfs {
@@ -68,9 +90,10 @@ private:
     ssize_t Write(const void* data, size_t len, size_t off) final;
     mx_status_t Truncate(size_t len) final;
     mx_status_t Getattr(vnattr_t* a) final;
+    mx_status_t Mmap(int flags, size_t len, size_t* off, mx_handle_t* out) final;
 
-    mx_handle_t vmo_;
-    mx_off_t length_;
+    mx_handle_t vmo_ TA_GUARDED(lock_);
+    mx_off_t length_ TA_GUARDED(lock_);
 };
 
 class VnodeDir : public VnodeMemfs {
@@ -88,8 +111,12 @@ public:
     mx_status_t CreateFromVmo(const char* name, size_t namelen, mx_handle_t vmo, mx_off_t off,
                               mx_off_t len);
 
+    // Adds the root of another memfs tree as a child of this directory.
+    void MountSubtree(mxtl::RefPtr<VnodeDir> subtree);
+
     // Use the watcher container to implement a directory watcher
     void NotifyAdd(const char* name, size_t len) final;
+    void NotifyRemove(const char* name, size_t len) final;
     mx_status_t WatchDir(mx_handle_t* out) final;
     mx_status_t WatchDirV2(const vfs_watch_dir_t* cmd) final;
 
@@ -105,12 +132,12 @@ private:
 
     // Resolves the question, "Can this directory create a child node with the name?"
     // Returns "MX_OK" on success; otherwise explains failure with error message.
-    mx_status_t CanCreate(const char* name, size_t namelen) const;
+    mx_status_t CanCreate(const char* name, size_t namelen) const TA_REQ(lock_);
 
     // Creates a dnode for the Vnode, attaches vnode to dnode, (if directory) attaches
     // dnode to vnode, and adds dnode to parent directory.
     mx_status_t AttachVnode(mxtl::RefPtr<memfs::VnodeMemfs> vn, const char* name, size_t namelen,
-                            bool isdir);
+                            bool isdir) TA_REQ(lock_);
 
     mx_status_t Unlink(const char* name, size_t len, bool must_be_dir) final;
     mx_status_t Rename(mxtl::RefPtr<fs::Vnode> newdir,
@@ -120,7 +147,7 @@ private:
     mx_status_t Link(const char* name, size_t len, mxtl::RefPtr<fs::Vnode> target) final;
     mx_status_t Getattr(vnattr_t* a) override;
 
-    fs::RemoteContainer remoter_;
+    fs::RemoteContainer remoter_ TA_GUARDED(lock_);
     fs::WatcherContainer watcher_;
 };
 
@@ -138,10 +165,10 @@ private:
     mx_status_t GetHandles(uint32_t flags, mx_handle_t* hnds,
                            uint32_t* type, void* extra, uint32_t* esize) final;
 
-    mx_handle_t vmo_;
-    mx_off_t offset_;
+    mx_handle_t vmo_ TA_GUARDED(lock_);
+    mx_off_t offset_ TA_GUARDED(lock_);
     mx_off_t length_;
-    bool have_local_clone_;
+    bool have_local_clone_ TA_GUARDED(lock_);
 };
 
 } // namespace memfs
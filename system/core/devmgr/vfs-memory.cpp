@@ -5,6 +5,7 @@
 #include <inttypes.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
@@ -39,6 +40,27 @@ static mxtl::RefPtr<VnodeDir> devfs_root = nullptr;
 static mxtl::RefPtr<VnodeDir> bootfs_root = nullptr;
 static mxtl::RefPtr<VnodeDir> systemfs_root = nullptr;
 
+// Held exclusively while the parent of a directory changes, and shared by
+// every other directory operation.
+static pthread_rwlock_t memfs_tree_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+namespace {
+
+class TreeLock {
+public:
+    explicit TreeLock(bool exclusive) {
+        if (exclusive) {
+            pthread_rwlock_wrlock(&memfs_tree_lock);
+        } else {
+            pthread_rwlock_rdlock(&memfs_tree_lock);
+        }
+    }
+    ~TreeLock() { pthread_rwlock_unlock(&memfs_tree_lock); }
+    DISALLOW_COPY_ASSIGN_AND_MOVE(TreeLock);
+};
+
+} // namespace
+
 static bool WindowMatchesVMO(mx_handle_t vmo, mx_off_t offset, mx_off_t length) {
     if (offset != 0)
         return false;
@@ -66,7 +88,7 @@ VnodeFile::~VnodeFile() {
 }
 
 VnodeDir::VnodeDir() {
-    link_count_ = 1; // Implied '.'
+    link_count_.store(1); // Implied '.'
 }
 VnodeDir::~VnodeDir() {}
 
@@ -113,6 +135,7 @@ mx_status_t VnodeVmo::Serve(mx_handle_t h, uint32_t flags) {
 
 mx_status_t VnodeVmo::GetHandles(uint32_t flags, mx_handle_t* hnds,
                                  uint32_t* type, void* extra, uint32_t* esize) {
+    mxtl::AutoLock lock(&lock_);
     mx_off_t* off = static_cast<mx_off_t*>(extra);
     mx_off_t* len = off + 1;
     mx_handle_t vmo;
@@ -142,6 +165,7 @@ mx_status_t VnodeVmo::GetHandles(uint32_t flags, mx_handle_t* hnds,
 }
 
 ssize_t VnodeFile::Read(void* data, size_t len, size_t off) {
+    mxtl::AutoLock lock(&lock_);
     if ((off >= length_) || (vmo_ == MX_HANDLE_INVALID)) {
         return 0;
     }
@@ -155,6 +179,7 @@ ssize_t VnodeFile::Read(void* data, size_t len, size_t off) {
 }
 
 ssize_t VnodeVmo::Read(void* data, size_t len, size_t off) {
+    mxtl::AutoLock lock(&lock_);
     if (off > length_)
         return 0;
     size_t rlen = length_ - off;
@@ -168,6 +193,7 @@ ssize_t VnodeVmo::Read(void* data, size_t len, size_t off) {
 }
 
 ssize_t VnodeFile::Write(const void* data, size_t len, size_t off) {
+    mxtl::AutoLock lock(&lock_);
     mx_status_t status;
     size_t newlen = off + len;
     newlen = newlen > kMemfsMaxFileSize ? kMemfsMaxFileSize : newlen;
@@ -202,13 +228,70 @@ ssize_t VnodeFile::Write(const void* data, size_t len, size_t off) {
     return actual;
 }
 
-bool VnodeDir::IsRemote() const { return remoter_.IsRemote(); }
-mx_handle_t VnodeDir::DetachRemote() { return remoter_.DetachRemote(flags_); }
-mx_handle_t VnodeDir::WaitForRemote() { return remoter_.WaitForRemote(flags_); }
-mx_handle_t VnodeDir::GetRemote() const { return remoter_.GetRemote(); }
-void VnodeDir::SetRemote(mx_handle_t remote) { return remoter_.SetRemote(remote); }
+mx_status_t VnodeFile::Mmap(int flags, size_t len, size_t* off, mx_handle_t* out) {
+    mxtl::AutoLock lock(&lock_);
+    mx_status_t status;
+    if ((vmo_ == MX_HANDLE_INVALID) && ((status = mx_vmo_create(0, 0, &vmo_)) != MX_OK)) {
+        return status;
+    }
+
+    mx_rights_t rights = MX_RIGHT_TRANSFER | MX_RIGHT_MAP | MX_RIGHT_GET_PROPERTY;
+    rights |= (flags & MXIO_MMAP_FLAG_READ) ? MX_RIGHT_READ : 0;
+    rights |= (flags & MXIO_MMAP_FLAG_WRITE) ? MX_RIGHT_WRITE : 0;
+    rights |= (flags & MXIO_MMAP_FLAG_EXEC) ? MX_RIGHT_EXECUTE : 0;
+
+    // The file's VMO holds its contents, so a shared mapping is simply the
+    // VMO itself, and a private one a copy-on-write clone of it.
+    mx_handle_t vmo;
+    if (flags & MXIO_MMAP_FLAG_PRIVATE) {
+        uint64_t size;
+        if ((status = mx_vmo_get_size(vmo_, &size)) != MX_OK) {
+            return status;
+        }
+        if ((status = mx_vmo_clone(vmo_, MX_VMO_CLONE_COPY_ON_WRITE, 0, size, &vmo)) != MX_OK) {
+            return status;
+        }
+        if ((status = mx_handle_replace(vmo, rights, &vmo)) != MX_OK) {
+            return status;
+        }
+    } else if ((status = mx_handle_duplicate(vmo_, rights, &vmo)) != MX_OK) {
+        return status;
+    }
+    *off = 0;
+    *out = vmo;
+    return MX_OK;
+}
+
+bool VnodeDir::IsRemote() const {
+    mxtl::AutoLock lock(&lock_);
+    return remoter_.IsRemote();
+}
+
+mx_handle_t VnodeDir::DetachRemote() {
+    mxtl::AutoLock lock(&lock_);
+    return remoter_.DetachRemote(flags_);
+}
+
+mx_handle_t VnodeDir::WaitForRemote() {
+    // Anything done to the directory while its filesystem starts up would
+    // need the remote anyway, so it's held for the wait.
+    mxtl::AutoLock lock(&lock_);
+    return remoter_.WaitForRemote(flags_);
+}
+
+mx_handle_t VnodeDir::GetRemote() const {
+    mxtl::AutoLock lock(&lock_);
+    return remoter_.GetRemote();
+}
+
+void VnodeDir::SetRemote(mx_handle_t remote) {
+    mxtl::AutoLock lock(&lock_);
+    return remoter_.SetRemote(remote);
+}
 
 mx_status_t VnodeDir::Lookup(mxtl::RefPtr<fs::Vnode>* out, const char* name, size_t len) {
+    TreeLock tree(false);
+    mxtl::AutoLock lock(&lock_);
     if (!IsDirectory()) {
         return MX_ERR_NOT_FOUND;
     }
@@ -230,36 +313,39 @@ mx_status_t VnodeDir::Lookup(mxtl::RefPtr<fs::Vnode>* out, const char* name, siz
 constexpr uint64_t kMemfsBlksize = PAGE_SIZE;
 
 mx_status_t VnodeFile::Getattr(vnattr_t* attr) {
+    mxtl::AutoLock lock(&lock_);
     memset(attr, 0, sizeof(vnattr_t));
     attr->mode = V_TYPE_FILE | V_IRUSR | V_IWUSR;
     attr->size = length_;
     attr->blksize = kMemfsBlksize;
     attr->blkcount = mxtl::roundup(attr->size, kMemfsBlksize) / VNATTR_BLKSIZE;
-    attr->nlink = link_count_;
+    attr->nlink = link_count_.load();
     attr->create_time = create_time_;
     attr->modify_time = modify_time_;
     return MX_OK;
 }
 
 mx_status_t VnodeDir::Getattr(vnattr_t* attr) {
+    mxtl::AutoLock lock(&lock_);
     memset(attr, 0, sizeof(vnattr_t));
     attr->mode = V_TYPE_DIR | V_IRUSR;
     attr->size = 0;
     attr->blksize = kMemfsBlksize;
     attr->blkcount = mxtl::roundup(attr->size, kMemfsBlksize) / VNATTR_BLKSIZE;
-    attr->nlink = link_count_;
+    attr->nlink = link_count_.load();
     attr->create_time = create_time_;
     attr->modify_time = modify_time_;
     return MX_OK;
 }
 
 mx_status_t VnodeVmo::Getattr(vnattr_t* attr) {
+    mxtl::AutoLock lock(&lock_);
     memset(attr, 0, sizeof(vnattr_t));
     attr->mode = V_TYPE_FILE | V_IRUSR;
     attr->size = length_;
     attr->blksize = kMemfsBlksize;
     attr->blkcount = mxtl::roundup(attr->size, kMemfsBlksize) / VNATTR_BLKSIZE;
-    attr->nlink = link_count_;
+    attr->nlink = link_count_.load();
     attr->create_time = create_time_;
     attr->modify_time = modify_time_;
     return MX_OK;
@@ -271,12 +357,15 @@ mx_status_t VnodeMemfs::Setattr(vnattr_t* attr) {
         return MX_ERR_INVALID_ARGS;
     }
     if (attr->valid & ATTR_MTIME) {
+        mxtl::AutoLock lock(&lock_);
         modify_time_ = attr->modify_time;
     }
     return MX_OK;
 }
 
 mx_status_t VnodeDir::Readdir(void* cookie, void* data, size_t len) {
+    TreeLock tree(false);
+    mxtl::AutoLock lock(&lock_);
     fs::DirentFiller df(data, len);
     if (!IsDirectory()) {
         // This WAS a directory, but it has been deleted.
@@ -289,6 +378,8 @@ mx_status_t VnodeDir::Readdir(void* cookie, void* data, size_t len) {
 
 // postcondition: reference taken on vn returned through "out"
 mx_status_t VnodeDir::Create(mxtl::RefPtr<fs::Vnode>* out, const char* name, size_t len, uint32_t mode) {
+    TreeLock tree(S_ISDIR(mode));
+    mxtl::AutoLock lock(&lock_);
     mx_status_t status;
     if ((status = CanCreate(name, len)) != MX_OK) {
         return status;
@@ -315,29 +406,40 @@ mx_status_t VnodeDir::Create(mxtl::RefPtr<fs::Vnode>* out, const char* name, siz
 
 mx_status_t VnodeDir::Unlink(const char* name, size_t len, bool must_be_dir) {
     xprintf("memfs_unlink(%p,'%.*s')\n", this, (int)len, name);
-    if (!IsDirectory()) {
-        // Calling unlink from unlinked, empty directory
-        return MX_ERR_BAD_STATE;
-    }
-    mxtl::RefPtr<Dnode> dn;
-    mx_status_t r;
-    if ((r = dnode_->Lookup(name, len, &dn)) != MX_OK) {
-        return r;
-    } else if (dn == nullptr) {
-        // Cannot unlink directory 'foo' using the argument 'foo/.'
-        return MX_ERR_INVALID_ARGS;
-    } else if (!dn->IsDirectory() && must_be_dir) {
-        // Path ending in "/" was requested, implying that the dnode must be a directory
-        return MX_ERR_NOT_DIR;
-    } else if ((r = dn->CanUnlink()) != MX_OK) {
-        return r;
-    }
+    // Removing a directory changes its parent, so needs the tree to itself;
+    // whether the name is a directory is only known once it's been found.
+    bool exclusive = must_be_dir;
+    for (;;) {
+        TreeLock tree(exclusive);
+        mxtl::AutoLock lock(&lock_);
+        if (!IsDirectory()) {
+            // Calling unlink from unlinked, empty directory
+            return MX_ERR_BAD_STATE;
+        }
+        mxtl::RefPtr<Dnode> dn;
+        mx_status_t r;
+        if ((r = dnode_->Lookup(name, len, &dn)) != MX_OK) {
+            return r;
+        } else if (dn == nullptr) {
+            // Cannot unlink directory 'foo' using the argument 'foo/.'
+            return MX_ERR_INVALID_ARGS;
+        } else if (dn->IsDirectory() && !exclusive) {
+            exclusive = true;
+            continue;
+        } else if (!dn->IsDirectory() && must_be_dir) {
+            // Path ending in "/" was requested, implying that the dnode must be a directory
+            return MX_ERR_NOT_DIR;
+        } else if ((r = dn->CanUnlink()) != MX_OK) {
+            return r;
+        }
 
-    dn->Detach();
-    return MX_OK;
+        dn->Detach();
+        return MX_OK;
+    }
 }
 
 mx_status_t VnodeFile::Truncate(size_t len) {
+    mxtl::AutoLock lock(&lock_);
     mx_status_t status;
     len = len > kMemfsMaxFileSize ? kMemfsMaxFileSize : len;
 
@@ -379,6 +481,10 @@ mx_status_t VnodeDir::Rename(mxtl::RefPtr<fs::Vnode> _newdir, const char* oldnam
                              bool dst_must_be_dir) {
     auto newdir = mxtl::RefPtr<VnodeMemfs>::Downcast(mxtl::move(_newdir));
 
+    // Every other directory operation holds the tree shared, so nothing can
+    // be looking at either directory's children while it's held exclusively.
+    TreeLock tree(true);
+
     if (!IsDirectory() || !newdir->IsDirectory())
         return MX_ERR_BAD_STATE;
     if ((oldlen == 1) && (oldname[0] == '.'))
@@ -460,6 +566,8 @@ mx_status_t VnodeDir::Rename(mxtl::RefPtr<fs::Vnode> _newdir, const char* oldnam
 mx_status_t VnodeDir::Link(const char* name, size_t len, mxtl::RefPtr<fs::Vnode> target) {
     auto vn = mxtl::RefPtr<VnodeMemfs>::Downcast(mxtl::move(target));
 
+    TreeLock tree(false);
+    mxtl::AutoLock lock(&lock_);
     if ((len == 1) && (name[0] == '.')) {
         return MX_ERR_BAD_STATE;
     } else if ((len == 2) && (name[0] == '.') && (name[1] == '.')) {
@@ -556,11 +664,19 @@ static mx_status_t memfs_create_fs(const char* name, mxtl::RefPtr<VnodeDir>* out
 }
 
 static void memfs_mount_locked(mxtl::RefPtr<VnodeDir> parent, mxtl::RefPtr<VnodeDir> subtree) TA_REQ(vfs_lock) {
-    Dnode::AddChild(parent->dnode_, subtree->dnode_);
+    parent->MountSubtree(mxtl::move(subtree));
+}
+
+void VnodeDir::MountSubtree(mxtl::RefPtr<VnodeDir> subtree) {
+    TreeLock tree(true);
+    mxtl::AutoLock lock(&lock_);
+    Dnode::AddChild(dnode_, subtree->dnode_);
 }
 
 mx_status_t VnodeDir::CreateFromVmo(const char* name, size_t namelen,
                                     mx_handle_t vmo, mx_off_t off, mx_off_t len) {
+    TreeLock tree(false);
+    mxtl::AutoLock lock(&lock_);
     mx_status_t status;
     if ((status = CanCreate(name, namelen)) != MX_OK) {
         return status;
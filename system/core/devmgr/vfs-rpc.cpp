@@ -8,7 +8,7 @@
 #include <string.h>
 #include <threads.h>
 
-#include <fs/mxio-dispatcher.h>
+#include <fs/vfs-dispatcher.h>
 #include <fs/vfs.h>
 #include <magenta/device/device.h>
 #include <magenta/device/vfs.h>
@@ -34,6 +34,7 @@ namespace memfs {
 static VnodeMemfs* global_vfs_root;
 
 void VnodeDir::NotifyAdd(const char* name, size_t len) { watcher_.NotifyAdd(name, len); }
+void VnodeDir::NotifyRemove(const char* name, size_t len) { watcher_.NotifyRemove(name, len); }
 mx_status_t VnodeDir::WatchDir(mx_handle_t* out) { return watcher_.WatchDir(out); }
 mx_status_t VnodeDir::WatchDirV2(const vfs_watch_dir_t* cmd) { return watcher_.WatchDirV2(cmd); }
 
@@ -62,10 +63,14 @@ mx_handle_t vfs_create_root_handle(VnodeMemfs* vn) {
     return h2;
 }
 
+// Memfs does its own locking (see memfs-private.h), so requests on
+// different handles are served concurrently.
+static const unsigned kMemfsPoolSize = 4;
+
 // Initialize the global root VFS node and dispatcher
 void vfs_global_init(VnodeDir* root) {
     memfs::global_vfs_root = root;
-    fs::MxioDispatcher::Create(&memfs::memfs_global_dispatcher);
+    fs::VfsDispatcher::Create(mxrio_handler, kMemfsPoolSize, &memfs::memfs_global_dispatcher);
 }
 
 // Return a RIO handle to the global root
@@ -74,6 +74,12 @@ again: // label here to catch filename=/path/to/new/directory/
         netfile.fd = open(filename, O_RDONLY);
         break;
     case O_WRONLY: {
+        if (!strncmp(filename, "/dev/", 5)) {
+            // Devices are written in place; there is nothing to rename.
+            netfile.needs_rename = false;
+            netfile.fd = open(filename, O_WRONLY);
+            break;
+        }
         // If we're writing a file, actually write to "filename + TMP_SUFFIX",
         // and rename to the final destination when we would close. This makes
         // written files appear to atomically update.
@@ -140,6 +146,36 @@ int netfile_write(const char* data, size_t len) {
     return len;
 }
 
+int netfile_pwrite(const char* data, size_t len, off_t offset) {
+    if (netfile.fd < 0) {
+        printf("netsvc: write, but no open file\n");
+        return -EBADF;
+    }
+    ssize_t n = pwrite(netfile.fd, data, len, offset);
+    if (n != (ssize_t)len) {
+        printf("netsvc: error writing %s: %d\n", netfile.filename, errno);
+        int result = (errno == 0) ? -EIO : -errno;
+        close(netfile.fd);
+        netfile.fd = -1;
+        return result;
+    }
+    return len;
+}
+
+void netfile_abort(void) {
+    if (netfile.fd < 0) {
+        return;
+    }
+    close(netfile.fd);
+    netfile.fd = -1;
+    if (netfile.needs_rename) {
+        char src[PATH_MAX];
+        strlcpy(src, netfile.filename, sizeof(netfile.filename));
+        strcat(src, TMP_SUFFIX);
+        unlink(src);
+    }
+}
+
 int netfile_close(void) {
     int result = 0;
     if (netfile.fd < 0) {
@@ -98,6 +98,13 @@ void udp6_recv(void* data, size_t len,
         return netboot_recv(data, len, mcast, daddr, dport, saddr, sport);
     }
 
+    if (dport == NB_TFTP_INCOMING_PORT) {
+        if (mcast) {
+            return;
+        }
+        return tftp_recv(data, len, daddr, dport, saddr, sport);
+    }
+
     if (dport == DEBUGLOG_ACK_PORT) {
         if ((len != 8) || mcast) {
             return;
@@ -185,6 +192,8 @@ int main(int argc, char** argv) {
                 }
             }
 
+            tftp_timeout_expired();
+
             if (netbootloader)
                 netboot_advertise(nodename);
 
@@ -6,6 +6,7 @@
 
 #include <stdio.h>
 #include <limits.h>
+#include <sys/types.h>
 
 #include <inet6/inet6.h>
 
@@ -34,8 +35,15 @@ int netfile_read(void* data_out, size_t data_sz);
 
 int netfile_write(const char* data, size_t len);
 
+// Write |len| bytes at |offset|, for transfers whose blocks may be resent.
+int netfile_pwrite(const char* data, size_t len, off_t offset);
+
 int netfile_close(void);
 
+// Close the open file, dropping anything written to it but not yet renamed
+// into place.
+void netfile_abort(void);
+
 void netboot_advertise(const char* nodename);
 
 void netboot_recv(void* data, size_t len, bool is_mcast,
@@ -43,3 +51,11 @@ void netboot_recv(void* data, size_t len, bool is_mcast,
                   const ip6_addr_t* saddr, uint16_t sport);
 
 void netboot_run_cmd(const char* cmd);
+
+void tftp_recv(void* data, size_t len,
+               const ip6_addr_t* daddr, uint16_t dport,
+               const ip6_addr_t* saddr, uint16_t sport);
+
+// Retransmit or abandon a TFTP transfer whose peer has gone quiet for too
+// long; called on every trip around the main loop.
+void tftp_timeout_expired(void);
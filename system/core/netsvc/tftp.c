@@ -0,0 +1,169 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "netsvc.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <inet6/inet6.h>
+#include <magenta/syscalls.h>
+#include <tftp/tftp.h>
+
+#include <magenta/boot/netboot.h>
+
+// Large enough for a DATA message of NB_TFTP_BLOCK_SIZE, and for the session.
+#define SCRATCHSZ 2048
+
+// RFC 1350; a write request from a new peer starts a new transfer.
+#define TFTP_OPCODE_WRQ 2
+
+typedef struct {
+    // The netboot image being received into, or NULL for netfile's file.
+    nbfile* nbfile;
+    bool opened;
+    size_t size;
+} tftp_file_t;
+
+static char session_scratch[SCRATCHSZ];
+static char out_scratch[SCRATCHSZ];
+
+static tftp_session* session = NULL;
+static tftp_file_t file;
+static bool transfer_active = false;
+
+// The peer of the current transfer (or of the last one), and when to give
+// up waiting to hear from it.
+static ip6_addr_t transfer_addr;
+static uint16_t transfer_port;
+static mx_time_t transfer_deadline;
+
+// The final ACK of a completed transfer, repeated if the peer missed it.
+static size_t last_msg_size = 0;
+
+static tftp_status file_open(const char* filename, size_t size, void* cookie) {
+    tftp_file_t* f = cookie;
+    f->nbfile = NULL;
+    f->size = size;
+    if (netbootloader) {
+        f->nbfile = netboot_get_buffer(filename, size);
+        if (f->nbfile) {
+            printf("netsvc: receiving '%s' (%zu bytes)...\n", filename, size);
+            f->opened = true;
+            return TFTP_NO_ERROR;
+        }
+    }
+    if (filename[0] != '/') {
+        printf("netsvc: rejected file '%s'\n", filename);
+        return TFTP_ERR_INVALID_ARGS;
+    }
+    if (netfile_open(filename, O_WRONLY) < 0) {
+        printf("netsvc: cannot open '%s' for writing\n", filename);
+        return TFTP_ERR_IO;
+    }
+    printf("netsvc: receiving '%s' (%zu bytes)...\n", filename, size);
+    f->opened = true;
+    return TFTP_NO_ERROR;
+}
+
+// Blocks are written where they belong as they arrive, straight into the
+// mapped image or through to the file.
+static tftp_status file_write(const void* data, size_t* len, off_t offset, void* cookie) {
+    tftp_file_t* f = cookie;
+    if (f->nbfile) {
+        nbfile* nb = f->nbfile;
+        if (((size_t)offset > nb->size) || (*len > nb->size - offset)) {
+            return TFTP_ERR_BUFFER_TOO_SMALL;
+        }
+        memcpy(nb->data + offset, data, *len);
+        if (offset + *len > nb->offset) {
+            nb->offset = offset + *len;
+        }
+        return TFTP_NO_ERROR;
+    }
+    if (netfile_pwrite(data, *len, offset) < 0) {
+        return TFTP_ERR_IO;
+    }
+    return TFTP_NO_ERROR;
+}
+
+static void end_transfer(bool completed) {
+    if (file.opened && !file.nbfile) {
+        if (completed) {
+            netfile_close();
+        } else {
+            netfile_abort();
+        }
+    }
+    file.opened = false;
+    transfer_active = false;
+}
+
+static void start_transfer(const ip6_addr_t* saddr, uint16_t sport) {
+    if (transfer_active) {
+        printf("netsvc: abandoning tftp transfer for a new one\n");
+        end_transfer(false);
+    }
+    tftp_init(&session, session_scratch, sizeof(session_scratch));
+    tftp_session_set_open_cb(session, file_open);
+    tftp_session_set_write_cb(session, file_write);
+    memcpy(&transfer_addr, saddr, sizeof(transfer_addr));
+    transfer_port = sport;
+    transfer_active = true;
+    last_msg_size = 0;
+}
+
+static void handle_status(tftp_status status, size_t outlen, uint32_t timeout_ms) {
+    if (outlen > 0) {
+        udp6_send(out_scratch, outlen, &transfer_addr, transfer_port, NB_TFTP_INCOMING_PORT);
+    }
+    transfer_deadline = mx_time_get(MX_CLOCK_MONOTONIC) + MX_MSEC(timeout_ms);
+    if (status == TFTP_TRANSFER_COMPLETED) {
+        printf("netsvc: received %zu bytes\n", file.size);
+        last_msg_size = outlen;
+        end_transfer(true);
+    } else if (status < 0) {
+        printf("netsvc: tftp transfer failed: %d\n", status);
+        end_transfer(false);
+    }
+}
+
+void tftp_recv(void* data, size_t len,
+               const ip6_addr_t* daddr, uint16_t dport,
+               const ip6_addr_t* saddr, uint16_t sport) {
+    if (len < sizeof(uint16_t)) {
+        return;
+    }
+    uint16_t opcode;
+    memcpy(&opcode, data, sizeof(opcode));
+    bool same_peer = (sport == transfer_port) &&
+                     !memcmp(saddr, &transfer_addr, sizeof(transfer_addr));
+    if ((ntohs(opcode) == TFTP_OPCODE_WRQ) && !(same_peer && transfer_active)) {
+        start_transfer(saddr, sport);
+    } else if (!same_peer) {
+        return;
+    } else if (!transfer_active) {
+        if (last_msg_size > 0) {
+            udp6_send(out_scratch, last_msg_size, saddr, sport, NB_TFTP_INCOMING_PORT);
+        }
+        return;
+    }
+
+    size_t outlen = sizeof(out_scratch);
+    uint32_t timeout_ms;
+    tftp_status status = tftp_handle_msg(session, data, len, out_scratch, &outlen,
+                                         &timeout_ms, &file);
+    handle_status(status, outlen, timeout_ms);
+}
+
+void tftp_timeout_expired(void) {
+    if (!transfer_active || (mx_time_get(MX_CLOCK_MONOTONIC) < transfer_deadline)) {
+        return;
+    }
+    size_t outlen = sizeof(out_scratch);
+    uint32_t timeout_ms;
+    tftp_status status = tftp_timeout(session, out_scratch, &outlen, &timeout_ms, &file);
+    handle_status(status, outlen, timeout_ms);
+}
@@ -11,6 +11,7 @@
 
 #pragma GCC visibility push(hidden)
 
+#include <magenta/ktrace.h>
 #include <magenta/stack.h>
 #include <magenta/syscalls.h>
 #include <magenta/syscalls/log.h>
@@ -35,6 +36,19 @@ static noreturn void do_shutdown(mx_handle_t log, mx_handle_t rroot) {
         __builtin_trap();
 }
 
+// Puts a stage that began at |start| on the boot timeline.
+static void timeline(mx_handle_t rroot, const char* stage, mx_time_t start) {
+    char name[MX_MAX_NAME_LEN] = KTRACE_BOOT_PREFIX;
+    size_t len = strlen(name);
+    size_t n = MIN(strlen(stage), sizeof(name) - 1 - len);
+    memcpy(&name[len], stage, n);
+    mx_status_t id = mx_ktrace_control(rroot, KTRACE_ACTION_NEW_PROBE, 0, name);
+    if (id >= 0) {
+        mx_time_t duration = mx_time_get(MX_CLOCK_MONOTONIC) - start;
+        mx_ktrace_write(rroot, id, (uint32_t)(duration / MX_USEC(1)), 0);
+    }
+}
+
 static void load_child_process(mx_handle_t log,
                                const struct options* o, struct bootfs* bootfs,
                                mx_handle_t vdso_vmo, mx_handle_t proc,
@@ -92,6 +106,8 @@ enum {
 // 5. Start the child process running.
 // 6. Optionally, wait for it to exit and then shut down.
 static noreturn void bootstrap(mx_handle_t log, mx_handle_t bootstrap_pipe) {
+    mx_time_t started = mx_time_get(MX_CLOCK_MONOTONIC);
+
     // Sample the bootstrap message to see how big it is.
     uint32_t nbytes;
     uint32_t nhandles;
@@ -209,7 +225,9 @@ static noreturn void bootstrap(mx_handle_t log, mx_handle_t bootstrap_pipe) {
     // Locate the first bootfs bootdata section and decompress it.
     // We need it to load devmgr and libc from.
     // Later bootfs sections will be processed by devmgr.
+    mx_time_t bootfs_started = mx_time_get(MX_CLOCK_MONOTONIC);
     mx_handle_t bootfs_vmo = bootdata_get_bootfs(log, vmar_self, bootdata_vmo);
+    timeline(root_resource_handle, "userboot:bootfs", bootfs_started);
 
     // Pass the decompressed bootfs VMO on.
     handles[nhandles + EXTRA_HANDLE_BOOTFS] = bootfs_vmo;
@@ -226,6 +244,7 @@ static noreturn void bootstrap(mx_handle_t log, mx_handle_t bootstrap_pipe) {
     status = mx_channel_create(0, &to_child, &child_start_handle);
     check(log, status, "mx_channel_create failed\n");
 
+    mx_time_t load_started = mx_time_get(MX_CLOCK_MONOTONIC);
     const char* filename = o.value[OPTION_FILENAME];
     mx_handle_t proc;
     mx_handle_t vmar;
@@ -311,6 +330,8 @@ static noreturn void bootstrap(mx_handle_t log, mx_handle_t bootstrap_pipe) {
     status = mx_process_start(proc, thread, entry, sp,
                               child_start_handle, vdso_base);
     check(log, status, "mx_process_start failed\n");
+    timeline(root_resource_handle, "userboot:load", load_started);
+    timeline(root_resource_handle, "userboot", started);
     status = mx_handle_close(thread);
     check(log, status, "mx_handle_close failed on thread handle\n");
 
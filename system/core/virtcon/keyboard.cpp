@@ -7,6 +7,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/param.h>
 
 #include <hid/hid.h>
 #include <hid/usages.h>
@@ -66,6 +67,11 @@ struct vc_input {
     port_handler_t th;
     mx_handle_t timer;
 
+    // Reports come through the report fifo when the device has one, and
+    // through |fh| otherwise.
+    port_handler_t fifoh;
+    mx_handle_t fifo;
+
     keypress_handler_t handler;
     int fd;
 
@@ -116,8 +122,12 @@ bool vc_input_process(vc_input_t* vi, uint8_t report[8]) {
 #if !BUILD_FOR_TEST
 static void vc_input_destroy(vc_input_t* vi) {
     port_cancel(&port, &vi->th);
-    if (vi->fd >= 0) {
+    if (vi->fifo != MX_HANDLE_INVALID) {
+        mx_handle_close(vi->fifo);
+    } else if (vi->fd >= 0) {
         port_fd_handler_done(&vi->fh);
+    }
+    if (vi->fd >= 0) {
         close(vi->fd);
     }
     mx_handle_close(vi->timer);
@@ -146,6 +156,21 @@ static mx_status_t vc_timer_cb(port_handler_t* ph, mx_signals_t signals, uint32_
     return MX_ERR_STOP;
 }
 
+// Handles the report of |len| bytes just put in |vi->report_buf|.
+static void vc_input_report(vc_input_t* vi, size_t len) {
+    if (len != sizeof(vi->report_buf)) {
+        vi->repeat_interval = MX_TIME_INFINITE;
+        return;
+    }
+
+    if (vc_input_process(vi, vi->report_buf) && vi->repeat_enabled) {
+        vi->repeat_interval = LOW_REPEAT_KEY_FREQ;
+        mx_timer_start(vi->timer, mx_deadline_after(vi->repeat_interval), 0, 0);
+    } else {
+        vi->repeat_interval = MX_TIME_INFINITE;
+    }
+}
+
 static mx_status_t vc_input_cb(port_fd_handler_t* fh, unsigned pollevt, uint32_t evt) {
     vc_input_t* vi = containerof(fh, vc_input_t, fh);
     ssize_t r;
@@ -160,16 +185,29 @@ static mx_status_t vc_input_cb(port_fd_handler_t* fh, unsigned pollevt, uint32_t
         vc_input_destroy(vi);
         return MX_ERR_STOP;
     }
-    if ((size_t)(r) != sizeof(vi->report_buf)) {
-        vi->repeat_interval = MX_TIME_INFINITE;
-        return MX_OK;
-    }
+    vc_input_report(vi, r);
+    return MX_OK;
+}
 
-    if (vc_input_process(vi, vi->report_buf) && vi->repeat_enabled) {
-        vi->repeat_interval = LOW_REPEAT_KEY_FREQ;
-        mx_timer_start(vi->timer, mx_deadline_after(vi->repeat_interval), 0, 0);
-    } else {
-        vi->repeat_interval = MX_TIME_INFINITE;
+static mx_status_t vc_input_fifo_cb(port_handler_t* ph, mx_signals_t signals, uint32_t evt) {
+    vc_input_t* vi = containerof(ph, vc_input_t, fifoh);
+
+    // Everything typed since the last wakeup, in one read.
+    input_report_entry_t entries[INPUT_REPORT_FIFO_DEPTH];
+    uint32_t count = 0;
+    mx_status_t status = MX_ERR_PEER_CLOSED;
+    if (signals & MX_FIFO_READABLE) {
+        status = mx_fifo_read(vi->fifo, entries, sizeof(entries), &count);
+    }
+    if (status != MX_OK) {
+        vc_input_destroy(vi);
+        return MX_ERR_STOP;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        memcpy(vi->previous_report_buf, vi->report_buf, sizeof(vi->report_buf));
+        size_t len = entries[i].len;
+        memcpy(vi->report_buf, entries[i].data, MIN(len, sizeof(vi->report_buf)));
+        vc_input_report(vi, len);
     }
     return MX_OK;
 }
@@ -182,6 +220,7 @@ mx_status_t vc_input_create(vc_input_t** out, keypress_handler_t handler, int fd
     }
 
     vi->fd = fd;
+    vi->fifo = MX_HANDLE_INVALID;
     vi->handler = handler;
 
     vi->cur_idx = 0;
@@ -203,18 +242,32 @@ mx_status_t vc_input_create(vc_input_t** out, keypress_handler_t handler, int fd
         return r;
     }
 
-    vi->fh.func = vc_input_cb;
-    if ((r = port_fd_handler_init(&vi->fh, fd, POLLIN | POLLHUP)) < 0) {
-        mx_handle_close(vi->timer);
-        free(vi);
-        return r;
-    }
+    if (ioctl_input_get_report_fifo(fd, &vi->fifo) == sizeof(vi->fifo)) {
+        vi->fifoh.handle = vi->fifo;
+        vi->fifoh.waitfor = MX_FIFO_READABLE | MX_FIFO_PEER_CLOSED;
+        vi->fifoh.func = vc_input_fifo_cb;
+        if ((r = port_wait(&port, &vi->fifoh)) < 0) {
+            mx_handle_close(vi->fifo);
+            mx_handle_close(vi->timer);
+            free(vi);
+            return r;
+        }
+        // |fd| is still needed to set the LEDs, but not polled.
+    } else {
+        vi->fifo = MX_HANDLE_INVALID;
+        vi->fh.func = vc_input_cb;
+        if ((r = port_fd_handler_init(&vi->fh, fd, POLLIN | POLLHUP)) < 0) {
+            mx_handle_close(vi->timer);
+            free(vi);
+            return r;
+        }
 
-    if ((r = port_wait(&port, &vi->fh.ph)) < 0) {
-        port_fd_handler_done(&vi->fh);
-        mx_handle_close(vi->timer);
-        free(vi);
-        return r;
+        if ((r = port_wait(&port, &vi->fh.ph)) < 0) {
+            port_fd_handler_done(&vi->fh);
+            mx_handle_close(vi->timer);
+            free(vi);
+            return r;
+        }
     }
 
     vi->th.handle = vi->timer;
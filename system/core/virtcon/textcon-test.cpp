@@ -336,6 +336,28 @@ bool test_scroll_up_nel() {
     END_TEST;
 }
 
+// Scrolling by more lines in one write than the screen holds, with the
+// cursor moved and lines inserted along the way.
+bool test_scroll_up_many() {
+    BEGIN_TEST;
+
+    TextconHelper tc(10, 4);
+    tc.PutString("1\n2\n3\n4\n5\n6\n7\n8\n9\n");
+    tc.AssertLineContains(0, "7");
+    tc.AssertLineContains(1, "8");
+    tc.AssertLineContains(2, "9");
+    tc.AssertLineContains(3, "");
+    EXPECT_EQ(vc_get_scrollback_lines(tc.vc_dev), 6, "");
+
+    tc.PutString("A\nB" "\x1b[1;1H" "\x1b[1L" "C\x1b[4;1H\nD\nE");
+    tc.AssertLineContains(0, "9");
+    tc.AssertLineContains(1, "A");
+    tc.AssertLineContains(2, "D");
+    tc.AssertLineContains(3, "E");
+
+    END_TEST;
+}
+
 bool test_insert_lines() {
     BEGIN_TEST;
 
@@ -680,6 +702,7 @@ RUN_TEST(test_backspace_moves_cursor)
 RUN_TEST(test_backspace_at_start_of_line)
 RUN_TEST(test_scroll_up)
 RUN_TEST(test_scroll_up_nel)
+RUN_TEST(test_scroll_up_many)
 RUN_TEST(test_insert_lines)
 RUN_TEST(test_delete_lines)
 RUN_TEST(test_insert_lines_many)
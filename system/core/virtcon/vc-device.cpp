@@ -71,6 +71,14 @@ static mx_status_t vc_setup(vc_t* vc) {
         return MX_ERR_NO_MEMORY;
     }
 
+    vc->damage = reinterpret_cast<vc_damage_t*>(
+        calloc(vc->rows, sizeof(vc_damage_t)));
+    if (!vc->damage) {
+        free(vc->scrollback_buf);
+        free(vc->text_buf);
+        return MX_ERR_NO_MEMORY;
+    }
+
     // set up the default palette
     memcpy(&vc->palette, default_palette, sizeof(default_palette));
     vc->front_color = DEFAULT_FRONT_COLOR;
@@ -79,13 +87,7 @@ static mx_status_t vc_setup(vc_t* vc) {
     return MX_OK;
 }
 
-static void vc_invalidate(void* cookie, int x0, int y0, int w, int h) {
-    vc_t* vc = reinterpret_cast<vc_t*>(cookie);
-
-    if (!vc->active) {
-        return;
-    }
-
+static void vc_draw(vc_t* vc, int x0, int y0, int w, int h) {
     assert(h >= 0);
     int y1 = y0 + h;
     assert(y0 <= static_cast<int>(vc->rows));
@@ -127,6 +129,76 @@ static void vc_invalidate(void* cookie, int x0, int y0, int w, int h) {
     }
 }
 
+static void vc_invalidate(void* cookie, int x0, int y0, int w, int h) {
+    vc_t* vc = reinterpret_cast<vc_t*>(cookie);
+
+    if (!vc->active) {
+        return;
+    }
+    if (!vc->defer_draw) {
+        vc_draw(vc, x0, y0, w, h);
+        return;
+    }
+
+    // The viewport is at the bottom while drawing is deferred.
+    int y1 = MIN(y0 + h, vc_rows(vc));
+    for (int y = MAX(y0, 0); y < y1; y++) {
+        vc_damage_t* d = &vc->damage[y];
+        if (d->x0 == d->x1) {
+            d->x0 = static_cast<uint16_t>(x0);
+            d->x1 = static_cast<uint16_t>(x0 + w);
+        } else {
+            d->x0 = static_cast<uint16_t>(MIN(d->x0, x0));
+            d->x1 = static_cast<uint16_t>(MAX(d->x1, x0 + w));
+        }
+    }
+}
+
+// Scrolls the screen up by |lines| while drawing is deferred.  The pixels
+// move once vc_write() is done; meanwhile each row's damage moves with it.
+static void vc_defer_scroll(vc_t* vc, int lines) {
+    int rows = vc_rows(vc);
+    // The cursor's cell is now what moves up, so draw it again where it
+    // ends up, as it would have been hidden for the copy.
+    if (vc->cursor_x < vc->columns) {
+        vc_invalidate(vc, vc->cursor_x, vc->cursor_y, 1, 1);
+    }
+    memmove(vc->damage, vc->damage + lines, (rows - lines) * sizeof(vc_damage_t));
+    memset(vc->damage + rows - lines, 0, lines * sizeof(vc_damage_t));
+    vc->pending_scroll += lines;
+}
+
+// Does what was deferred: one copy for however far the screen scrolled,
+// then the damaged characters.
+void vc_draw_deferred(vc_t* vc) {
+    int rows = vc_rows(vc);
+    int scroll = vc->pending_scroll;
+    vc->pending_scroll = 0;
+    vc->defer_draw = false;
+
+    if (scroll >= rows) {
+        for (int y = 0; y < rows; y++) {
+            vc->damage[y].x0 = 0;
+            vc->damage[y].x1 = static_cast<uint16_t>(vc->columns);
+        }
+    } else if (scroll > 0) {
+        gfx_copyrect(vc_gfx, 0, scroll * vc->charh,
+                     vc_gfx->width, (rows - scroll) * vc->charh, 0, 0);
+    }
+    if (scroll > 0) {
+        vc_status_update();
+        vc_gfx_invalidate_status();
+    }
+
+    for (int y = 0; y < rows; y++) {
+        vc_damage_t* d = &vc->damage[y];
+        if (d->x0 != d->x1) {
+            vc_draw(vc, d->x0, y, d->x1 - d->x0, 1);
+            d->x0 = d->x1 = 0;
+        }
+    }
+}
+
 // implement tc callbacks:
 
 static inline void vc_invalidate_lines(vc_t* vc, int y, int h) {
@@ -222,6 +294,22 @@ static void vc_set_cursor_hidden(vc_t* vc, bool hide) {
 static void vc_tc_copy_lines(void* cookie, int y_dest, int y_src, int line_count) {
     vc_t* vc = reinterpret_cast<vc_t*>(cookie);
 
+    if (vc->defer_draw) {
+        if (y_dest == 0 && y_src + line_count == vc_rows(vc)) {
+            // The whole screen scrolling up, as it does for each line of
+            // output once the screen is full.
+            tc_copy_lines(&vc->textcon, y_dest, y_src, line_count);
+            vc_defer_scroll(vc, y_src);
+            vc_invalidate_lines(vc, 0, vc_rows(vc));
+            return;
+        }
+        // Anything else moves the pixels as it is now.
+        vc_draw_deferred(vc);
+        vc_tc_copy_lines(cookie, y_dest, y_src, line_count);
+        vc->defer_draw = true;
+        return;
+    }
+
     if (vc->viewport_y < 0) {
         tc_copy_lines(&vc->textcon, y_dest, y_src, line_count);
 
@@ -466,6 +554,7 @@ void vc_free(vc_t* vc) {
     }
     free(vc->text_buf);
     free(vc->scrollback_buf);
+    free(vc->damage);
     free(vc);
 }
 
@@ -2,6 +2,9 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <stdlib.h>
+#include <string.h>
+
 #include <gfx/gfx.h>
 
 #include <magenta/device/display.h>
@@ -15,6 +18,74 @@ gfx_surface* vc_tb_gfx;
 
 const gfx_font* vc_font;
 
+// Glyphs already rasterized in some pair of colors, so that drawing a
+// character is a copy of its rows.  Consoles mostly draw in a few pairs,
+// so a handful of them, rasterized a glyph at a time as they are first
+// drawn, covers nearly everything.
+#define GLYPH_COUNT 128
+#define GLYPH_CACHE_SIZE 8
+
+typedef struct {
+    uint32_t fg, bg;
+    uint64_t last_used;
+    uint8_t* pixels;
+    uint8_t rendered[GLYPH_COUNT / 8];
+} glyph_atlas_t;
+
+static glyph_atlas_t glyph_cache[GLYPH_CACHE_SIZE];
+static uint64_t glyph_clock;
+
+static void glyph_cache_reset() {
+    for (unsigned i = 0; i < GLYPH_CACHE_SIZE; i++) {
+        free(glyph_cache[i].pixels);
+    }
+    memset(glyph_cache, 0, sizeof(glyph_cache));
+}
+
+static size_t glyph_size() {
+    return vc_font->width * vc_font->height * vc_gfx->pixelsize;
+}
+
+// Returns the glyph's pixels in these colors, or NULL if there's no memory
+// for them.
+static const uint8_t* glyph_get(unsigned ch, uint32_t fg, uint32_t bg) {
+    glyph_atlas_t* atlas = NULL;
+    glyph_atlas_t* oldest = &glyph_cache[0];
+    for (unsigned i = 0; i < GLYPH_CACHE_SIZE; i++) {
+        glyph_atlas_t* a = &glyph_cache[i];
+        if (a->pixels && a->fg == fg && a->bg == bg) {
+            atlas = a;
+            break;
+        }
+        if (!a->pixels || (oldest->pixels && a->last_used < oldest->last_used)) {
+            oldest = a;
+        }
+    }
+    if (atlas == NULL) {
+        atlas = oldest;
+        if (atlas->pixels == NULL) {
+            atlas->pixels = static_cast<uint8_t*>(malloc(GLYPH_COUNT * glyph_size()));
+            if (atlas->pixels == NULL) {
+                return NULL;
+            }
+        }
+        atlas->fg = fg;
+        atlas->bg = bg;
+        memset(atlas->rendered, 0, sizeof(atlas->rendered));
+    }
+    atlas->last_used = ++glyph_clock;
+
+    uint8_t* glyph = atlas->pixels + ch * glyph_size();
+    if (!(atlas->rendered[ch / 8] & (1u << (ch % 8)))) {
+        gfx_surface s;
+        gfx_init_surface(&s, glyph, vc_font->width, vc_font->height,
+                         vc_font->width, vc_gfx->format, 0);
+        gfx_putchar(&s, vc_font, ch, 0, 0, fg, bg);
+        atlas->rendered[ch / 8] |= static_cast<uint8_t>(1u << (ch % 8));
+    }
+    return glyph;
+}
+
 void vc_gfx_draw_char(vc_t* vc, vc_char_t ch, unsigned x, unsigned y,
                       bool invert) {
     uint8_t fg_color = vc_char_get_fg_color(ch);
@@ -25,10 +96,26 @@ void vc_gfx_draw_char(vc_t* vc, vc_char_t ch, unsigned x, unsigned y,
         fg_color = bg_color;
         bg_color = temp;
     }
-    gfx_putchar(vc_gfx, vc->font, vc_char_get_char(ch),
-                x * vc->charw, y * vc->charh,
-                palette_to_color(vc, fg_color),
-                palette_to_color(vc, bg_color));
+    unsigned c = vc_char_get_char(ch);
+    uint32_t fg = palette_to_color(vc, fg_color);
+    uint32_t bg = palette_to_color(vc, bg_color);
+    x *= vc->charw;
+    y *= vc->charh;
+
+    const uint8_t* glyph;
+    if (vc->font != vc_font || c >= GLYPH_COUNT ||
+        x > vc_gfx->width - vc->charw || y > vc_gfx->height - vc->charh ||
+        (glyph = glyph_get(c, fg, bg)) == NULL) {
+        gfx_putchar(vc_gfx, vc->font, c, x, y, fg, bg);
+        return;
+    }
+
+    size_t row = vc->charw * vc_gfx->pixelsize;
+    size_t pitch = vc_gfx->stride * vc_gfx->pixelsize;
+    uint8_t* dest = static_cast<uint8_t*>(vc_gfx->ptr) + y * pitch + x * vc_gfx->pixelsize;
+    for (unsigned i = 0; i < vc->charh; i++, glyph += row, dest += pitch) {
+        memcpy(dest, glyph, row);
+    }
 }
 
 #if BUILD_FOR_TEST
@@ -37,6 +124,7 @@ static gfx_surface* vc_test_gfx;
 mx_status_t vc_init_gfx(gfx_surface* test) {
     const gfx_font* font = vc_get_font();
     vc_font = font;
+    glyph_cache_reset();
 
     vc_test_gfx = test;
 
@@ -93,6 +181,7 @@ static uintptr_t vc_gfx_mem = 0;
 static size_t vc_gfx_size = 0;
 
 void vc_free_gfx() {
+    glyph_cache_reset();
     if (vc_gfx) {
         gfx_surface_destroy(vc_gfx);
         vc_gfx = NULL;
@@ -198,10 +198,16 @@ void handle_key_press(uint8_t keycode, int modifiers) {
 ssize_t vc_write(vc_t* vc, const void* buf, size_t count, mx_off_t off) {
     vc->invy0 = vc_rows(vc) + 1;
     vc->invy1 = -1;
+    // Draw once at the end, rather than after each character and each
+    // line scrolled, unless showing scrollback.
+    vc->defer_draw = vc->active && vc->viewport_y == 0;
     const uint8_t* str = (const uint8_t*)buf;
     for (size_t i = 0; i < count; i++) {
         vc->textcon.putc(&vc->textcon, str[i]);
     }
+    if (vc->defer_draw) {
+        vc_draw_deferred(vc);
+    }
     if (vc->invy1 >= 0) {
         int rows = vc_rows(vc);
         // Adjust for the current viewport position.  Convert
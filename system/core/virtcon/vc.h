@@ -39,6 +39,11 @@ mx_status_t new_input_device(int fd, keypress_handler_t handler);
 #define STATUS_COLOR_ACTIVE 11
 #define STATUS_COLOR_UPDATED 10
 
+// The columns [x0, x1) of a row, to be drawn.
+typedef struct vc_damage {
+    uint16_t x0, x1;
+} vc_damage_t;
+
 typedef struct vc {
     char title[MAX_TAB_WIDTH];
     // vc title, shown in status bar
@@ -72,6 +77,12 @@ typedef struct vc {
     int invy0, invy1;
     // offscreen invalid lines, tracked during textcon drawing
 
+    bool defer_draw;
+    int pending_scroll;
+    vc_damage_t* damage;
+    // while vc_write() runs: the characters to draw once it's done, by
+    // row, and how many lines the screen has scrolled up meanwhile
+
     unsigned cursor_x, cursor_y;
     // cursor
     bool hide_cursor;
@@ -142,6 +153,8 @@ void vc_gfx_invalidate(vc_t* vc, unsigned x, unsigned y, unsigned w, unsigned h)
 void vc_gfx_invalidate_region(vc_t* vc, unsigned x, unsigned y, unsigned w, unsigned h);
 void vc_gfx_draw_char(vc_t* vc, vc_char_t ch, unsigned x, unsigned y,
                       bool invert);
+// draws what was deferred while vc->defer_draw was set, and clears it
+void vc_draw_deferred(vc_t* vc);
 
 static inline uint32_t palette_to_color(vc_t* vc, uint8_t color) {
     assert(color <= MAX_COLOR);
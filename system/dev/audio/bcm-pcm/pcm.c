@@ -18,6 +18,7 @@
 #include <magenta/compiler.h>
 #include <magenta/device/audio2.h>
 #include <magenta/device/i2c.h>
+#include <magenta/process.h>
 #include <magenta/syscalls.h>
 #include <magenta/syscalls/port.h>
 #include <magenta/threads.h>
@@ -50,6 +51,9 @@
 #define BCM_PCM_BCLK_PER_FRAME  64
 
 #define DMA_CHAN 11
+
+// how often the position VMO is updated while the ring buffer runs
+#define BCM_PCM_POSITION_PERIOD_US 1000
 #define PCM_TRACE 0
 // clang-format on
 
@@ -60,6 +64,7 @@ typedef union {
     audio2_rb_cmd_start_req_t start_req;
     audio2_rb_cmd_stop_req_t stop_req;
     audio2_rb_cmd_get_fifo_depth_req_t get_fifo_req;
+    audio2_rb_cmd_get_position_vmo_req_t get_position_req;
 } buffer_packet_t;
 
 typedef struct {
@@ -80,6 +85,11 @@ typedef struct {
     size_t buffer_size; // size of buffer in bytes
     uint32_t buffer_notifications;
 
+    // position published to clients, if any have asked for it
+    mx_handle_t position_vmo;
+    audio2_rb_position_t* position;
+    uint64_t start_ticks;
+
     thrd_t notify_thrd;
     thrd_t port_thrd;
     volatile atomic_bool notify_running;
@@ -132,11 +142,20 @@ static void pcm_close_handle(mx_handle_t* handle) {
     }
 }
 
+static void pcm_release_position_locked(bcm_pcm_t* ctx) {
+    if (ctx->position != NULL) {
+        mx_vmar_unmap(mx_vmar_root_self(), (uintptr_t)ctx->position, BCM_PCM_PAGE_SIZE);
+        ctx->position = NULL;
+    }
+    pcm_close_handle(&ctx->position_vmo);
+}
+
 static void pcm_deinit_locked(bcm_pcm_t* ctx) {
 
     xprintf("deiniting buffer\n");
     pcm_deinit_buffer_locked(ctx);
 
+    pcm_release_position_locked(ctx);
     pcm_close_handle(&ctx->buffer_ch);
 
     xprintf("closing stream\n");
@@ -158,31 +177,68 @@ static void pcm_deinit(bcm_pcm_t* ctx) {
     mtx_unlock(&ctx->pcm_lock);
 }
 
+static void pcm_publish_position(audio2_rb_position_t* p, uint32_t offset,
+                                 uint64_t frames, uint64_t ticks, uint64_t start_ticks) {
+    uint32_t seq = p->seq;
+    __atomic_store_n(&p->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    p->ring_buffer_pos = offset;
+    p->frames = frames;
+    p->ticks = ticks;
+    p->start_ticks = start_ticks;
+    __atomic_store_n(&p->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
 static int pcm_notify_thread(void* arg) {
 
     bcm_pcm_t* ctx = arg;
 
     uint32_t offset = 0;
+    uint32_t last_offset = 0;
+    uint64_t wraps = 0;
     ctx->notify_running = true;
 
     mx_status_t status = MX_OK;
 
-    double notify_time = (1000000.0 * ctx->buffer_size) /
-                         (ctx->sample_rate * ctx->audio_frame_size * ctx->buffer_notifications);
-
-    uint64_t notify_period_us = (uint64_t)notify_time;
+    // With a position VMO to keep up to date we wake up far more often than
+    // notifications are due, and only send one once its period has passed.
+    uint64_t notify_period_us = 0;
+    if (ctx->buffer_notifications > 0) {
+        double notify_time = (1000000.0 * ctx->buffer_size) /
+                             (ctx->sample_rate * ctx->audio_frame_size * ctx->buffer_notifications);
+        notify_period_us = (uint64_t)notify_time;
+        xprintf("notification interval = %lu  %fuS\n", notify_period_us, notify_time);
+    }
+    uint64_t period_us = notify_period_us;
+    if ((ctx->position != NULL) &&
+        ((period_us == 0) || (period_us > BCM_PCM_POSITION_PERIOD_US))) {
+        period_us = BCM_PCM_POSITION_PERIOD_US;
+    }
 
-    xprintf("notification interval = %lu  %fuS\n", notify_period_us, notify_time);
     xprintf("buffer size = %lu\n", ctx->buffer_size);
     xprintf("sample rate = %u\n", ctx->sample_rate);
     xprintf("notifications = %u\n", ctx->buffer_notifications);
 
+    mx_time_t next_notify = mx_deadline_after(MX_USEC(notify_period_us));
     while ((ctx->state & BCM_PCM_STATE_RUNNING) && !(ctx->state & BCM_PCM_STATE_SHUTTING_DOWN)) {
-        mx_nanosleep(mx_deadline_after(MX_USEC(notify_period_us)));
+        mx_nanosleep(mx_deadline_after(MX_USEC(period_us)));
 
         mx_paddr_t pos = bcm_dma_get_position(&ctx->dma);
         bcm_dma_paddr_to_offset(&ctx->dma, pos, &offset);
 
+        if (ctx->position != NULL) {
+            if (offset < last_offset)
+                wraps++;
+            last_offset = offset;
+            uint64_t frames = (wraps * ctx->buffer_size + offset) / ctx->audio_frame_size;
+            pcm_publish_position(ctx->position, offset, frames, mx_ticks_get(),
+                                 ctx->start_ticks);
+        }
+
+        if ((notify_period_us == 0) || (mx_time_get(MX_CLOCK_MONOTONIC) < next_notify))
+            continue;
+        next_notify += MX_USEC(notify_period_us);
+
         audio2_rb_position_notify_t resp;
         resp.hdr.cmd = AUDIO2_RB_POSITION_NOTIFY;
         resp.ring_buffer_pos = offset;
@@ -260,11 +316,16 @@ static mx_status_t pcm_start(bcm_pcm_t* ctx, audio2_rb_cmd_start_req_t req) {
     hw_wmb();
     //i2s is running at this point
     resp.start_ticks = mx_ticks_get();
+    ctx->start_ticks = resp.start_ticks;
     ctx->state |= BCM_PCM_STATE_RUNNING;
 
     hifiberry_start();
 
-    if (ctx->buffer_notifications > 0) {
+    if (ctx->position != NULL) {
+        pcm_publish_position(ctx->position, 0, 0, resp.start_ticks, resp.start_ticks);
+    }
+
+    if ((ctx->buffer_notifications > 0) || (ctx->position != NULL)) {
 
         int thrd_rc = thrd_create_with_name(&ctx->notify_thrd,
                                             pcm_notify_thread, ctx,
@@ -343,6 +404,7 @@ static mx_status_t pcm_set_stream_fmt(bcm_pcm_t* ctx, audio2_stream_cmd_set_form
             // We weren't running, but there was a buffer/buffer_ch configured,
             //  need to clear out previous state.
             pcm_deinit_buffer_locked(ctx);
+            pcm_release_position_locked(ctx);
             pcm_close_handle(&ctx->buffer_ch);
         }
     }
@@ -383,6 +445,7 @@ static mx_status_t pcm_set_stream_fmt(bcm_pcm_t* ctx, audio2_stream_cmd_set_form
 set_stream_fail:
     xprintf("set stream FAIL\n");
     pcm_deinit_buffer_locked(ctx);
+    pcm_release_position_locked(ctx);
     pcm_close_handle(&ctx->buffer_ch);
 
 set_stream_done:
@@ -485,6 +548,48 @@ gb_fail2:
     return status;
 }
 
+static mx_status_t pcm_get_position_vmo(bcm_pcm_t* ctx,
+                                        audio2_rb_cmd_get_position_vmo_req_t req) {
+    audio2_rb_cmd_get_position_vmo_resp_t resp;
+    resp.hdr = req.hdr;
+    mx_handle_t ret_handle = MX_HANDLE_INVALID;
+    mx_status_t status = MX_OK;
+
+    mtx_lock(&ctx->pcm_lock);
+
+    // The notify thread only looks for the position when it starts.
+    if (ctx->state & BCM_PCM_STATE_RUNNING) {
+        status = MX_ERR_BAD_STATE;
+        goto done;
+    }
+
+    if (ctx->position_vmo == MX_HANDLE_INVALID) {
+        status = mx_vmo_create(BCM_PCM_PAGE_SIZE, 0, &ctx->position_vmo);
+        if (status != MX_OK)
+            goto done;
+        status = mx_vmar_map(mx_vmar_root_self(), 0, ctx->position_vmo, 0, BCM_PCM_PAGE_SIZE,
+                             MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE,
+                             (uintptr_t*)&ctx->position);
+        if (status != MX_OK) {
+            ctx->position = NULL;
+            pcm_close_handle(&ctx->position_vmo);
+            goto done;
+        }
+    }
+
+    status = mx_handle_duplicate(ctx->position_vmo, MX_RIGHT_TRANSFER |
+                                                    MX_RIGHT_READ     |
+                                                    MX_RIGHT_MAP,
+                                                    &ret_handle);
+
+done:
+    resp.result = status;
+    status = mx_channel_write(ctx->buffer_ch, 0, &resp, sizeof(resp),
+                              &ret_handle, (ret_handle != MX_HANDLE_INVALID) ? 1 : 0);
+    mtx_unlock(&ctx->pcm_lock);
+    return status;
+}
+
 #define HANDLE_REQ(_ioctl, _payload, _handler)      \
     case _ioctl:                                    \
         if (req_size != sizeof(req._payload)) {     \
@@ -539,6 +644,7 @@ static int pcm_port_thread(void* arg) {
                     HANDLE_REQ(AUDIO2_RB_CMD_STOP, stop_req, pcm_stop_req);
                     HANDLE_REQ(AUDIO2_RB_CMD_GET_BUFFER, get_buffer_req, pcm_get_buffer);
                     HANDLE_REQ(AUDIO2_RB_CMD_GET_FIFO_DEPTH, get_fifo_req, pcm_get_fifo_depth);
+                    HANDLE_REQ(AUDIO2_RB_CMD_GET_POSITION_VMO, get_position_req, pcm_get_position_vmo);
                 case AUDIO2_RB_POSITION_NOTIFY:
                 default:
                     xprintf("unrecognized buffer command\n");
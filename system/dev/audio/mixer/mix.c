@@ -0,0 +1,244 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "mix.h"
+
+// SSE2 and NEON are part of the base x86-64 and arm64 architectures, so
+// these kernels need no check of what the CPU has.
+
+#define FRAC_ONE (1ull << 32)
+#define PHASE_SHIFT (32 - 6)
+
+static_assert(MIX_RESAMPLER_PHASES == (1 << (32 - PHASE_SHIFT)), "phase bits");
+static_assert((MIX_RESAMPLER_TAPS % 2) == 0, "taps are taken two frames at a time");
+
+// Where the output frame sits among the taps at phase 0.
+#define CENTER_TAP (MIX_RESAMPLER_TAPS / 2 - 1)
+
+void mix_resampler_init(mix_resampler_t* r, uint32_t in_rate, uint32_t out_rate) {
+    memset(r->history, 0, sizeof(r->history));
+    r->frac = 0;
+    r->step = ((uint64_t)in_rate << 32) / out_rate;
+
+    // Below the lower of the two Nyquist frequencies, relative to the input.
+    double cutoff = (in_rate > out_rate) ? (double)out_rate / in_rate : 1.0;
+
+    for (int p = 0; p < MIX_RESAMPLER_PHASES; p++) {
+        double phi = (double)p / MIX_RESAMPLER_PHASES;
+        double h[MIX_RESAMPLER_TAPS];
+        double sum = 0.0;
+        for (int k = 0; k < MIX_RESAMPLER_TAPS; k++) {
+            double x = k - CENTER_TAP - phi;
+            double s = (x == 0.0) ? 1.0 : sin(M_PI * cutoff * x) / (M_PI * cutoff * x);
+            // Blackman window over the span of the taps.
+            double u = x / (MIX_RESAMPLER_TAPS / 2);
+            double w = (fabs(u) >= 1.0) ? 0.0
+                                        : 0.42 + 0.5 * cos(M_PI * u) + 0.08 * cos(2 * M_PI * u);
+            h[k] = s * w;
+            sum += h[k];
+        }
+        // Unity gain at DC, so that the same phase twice in a row doesn't
+        // make a step in the output level.
+        for (int k = 0; k < MIX_RESAMPLER_TAPS; k++) {
+            float c = (float)(h[k] / sum);
+            r->coeffs[p][2 * k] = c;
+            r->coeffs[p][2 * k + 1] = c;
+        }
+    }
+}
+
+size_t mix_resample_frames_needed(const mix_resampler_t* r, size_t out_frames) {
+    return (size_t)((r->frac + out_frames * r->step) >> 32);
+}
+
+// One output frame from the taps starting at |in|.
+static inline void filter_frame(float* out, const float* in, const float* coeffs) {
+#if defined(__x86_64__)
+    __m128 acc = _mm_setzero_ps();
+    for (int k = 0; k < MIX_RESAMPLER_TAPS * 2; k += 4)
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(in + k), _mm_load_ps(coeffs + k)));
+    // Even frames are in the low half, odd frames in the high half.
+    acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+    _mm_storel_pi((__m64*)out, acc);
+#elif defined(__aarch64__)
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    for (int k = 0; k < MIX_RESAMPLER_TAPS * 2; k += 4)
+        acc = vmlaq_f32(acc, vld1q_f32(in + k), vld1q_f32(coeffs + k));
+    vst1_f32(out, vadd_f32(vget_low_f32(acc), vget_high_f32(acc)));
+#else
+    float l = 0.0f, r = 0.0f;
+    for (int k = 0; k < MIX_RESAMPLER_TAPS * 2; k += 2) {
+        l += in[k] * coeffs[k];
+        r += in[k + 1] * coeffs[k + 1];
+    }
+    out[0] = l;
+    out[1] = r;
+#endif
+}
+
+void mix_resample(mix_resampler_t* r, float* out, float* in, size_t out_frames) {
+    size_t consumed = mix_resample_frames_needed(r, out_frames);
+    memcpy(in, r->history, sizeof(r->history));
+
+    if ((r->step == FRAC_ONE) && (r->frac == 0)) {
+        // Same rate in and out: phase 0 only ever picks out the center tap.
+        memcpy(out, in + CENTER_TAP * 2, out_frames * 2 * sizeof(float));
+    } else {
+        uint64_t pos = r->frac;
+        for (size_t j = 0; j < out_frames; j++, pos += r->step) {
+            size_t i = (size_t)(pos >> 32);
+            uint32_t phase = (uint32_t)(pos >> PHASE_SHIFT) & (MIX_RESAMPLER_PHASES - 1);
+            filter_frame(out + 2 * j, in + 2 * i, r->coeffs[phase]);
+        }
+    }
+
+    r->frac = (r->frac + out_frames * r->step) - ((uint64_t)consumed << 32);
+    memcpy(r->history, in + consumed * 2, sizeof(r->history));
+}
+
+bool mix_format_supported(audio2_sample_format_t format, uint16_t channels) {
+    if ((channels != 1) && (channels != 2))
+        return false;
+    switch (format) {
+    case AUDIO2_SAMPLE_FORMAT_16BIT:
+    case AUDIO2_SAMPLE_FORMAT_32BIT:
+    case AUDIO2_SAMPLE_FORMAT_32BIT_FLOAT:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void convert_s16_stereo(float* dst, const int16_t* src, size_t samples) {
+    const float scale = 1.0f / 32768.0f;
+    size_t i = 0;
+#if defined(__x86_64__)
+    __m128 vscale = _mm_set1_ps(scale);
+    for (; i + 8 <= samples; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        // Sign extend by putting each sample in the top half and shifting
+        // it back down.
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), vscale));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), vscale));
+    }
+#elif defined(__aarch64__)
+    for (; i + 8 <= samples; i += 8) {
+        int16x8_t v = vld1q_s16(src + i);
+        int32x4_t lo = vmovl_s16(vget_low_s16(v));
+        int32x4_t hi = vmovl_s16(vget_high_s16(v));
+        vst1q_f32(dst + i, vmulq_n_f32(vcvtq_f32_s32(lo), scale));
+        vst1q_f32(dst + i + 4, vmulq_n_f32(vcvtq_f32_s32(hi), scale));
+    }
+#endif
+    for (; i < samples; i++)
+        dst[i] = src[i] * scale;
+}
+
+void mix_convert_in(float* dst, const void* src, size_t frames,
+                    audio2_sample_format_t format, uint16_t channels) {
+    if (channels == 2) {
+        size_t samples = frames * 2;
+        switch (format) {
+        case AUDIO2_SAMPLE_FORMAT_16BIT:
+            convert_s16_stereo(dst, src, samples);
+            break;
+        case AUDIO2_SAMPLE_FORMAT_32BIT: {
+            const int32_t* s = src;
+            for (size_t i = 0; i < samples; i++)
+                dst[i] = s[i] * (1.0f / 2147483648.0f);
+            break;
+        }
+        default:
+            memcpy(dst, src, samples * sizeof(float));
+            break;
+        }
+        return;
+    }
+
+    // Mono goes to both sides.
+    for (size_t i = 0; i < frames; i++) {
+        float v;
+        switch (format) {
+        case AUDIO2_SAMPLE_FORMAT_16BIT:
+            v = ((const int16_t*)src)[i] * (1.0f / 32768.0f);
+            break;
+        case AUDIO2_SAMPLE_FORMAT_32BIT:
+            v = ((const int32_t*)src)[i] * (1.0f / 2147483648.0f);
+            break;
+        default:
+            v = ((const float*)src)[i];
+            break;
+        }
+        dst[2 * i] = v;
+        dst[2 * i + 1] = v;
+    }
+}
+
+void mix_accumulate(float* acc, const float* src, size_t samples, float gain) {
+    size_t i = 0;
+#if defined(__x86_64__)
+    __m128 g = _mm_set1_ps(gain);
+    for (; i + 8 <= samples; i += 8) {
+        __m128 a0 = _mm_loadu_ps(acc + i);
+        __m128 a1 = _mm_loadu_ps(acc + i + 4);
+        a0 = _mm_add_ps(a0, _mm_mul_ps(_mm_loadu_ps(src + i), g));
+        a1 = _mm_add_ps(a1, _mm_mul_ps(_mm_loadu_ps(src + i + 4), g));
+        _mm_storeu_ps(acc + i, a0);
+        _mm_storeu_ps(acc + i + 4, a1);
+    }
+#elif defined(__aarch64__)
+    for (; i + 8 <= samples; i += 8) {
+        vst1q_f32(acc + i, vmlaq_n_f32(vld1q_f32(acc + i), vld1q_f32(src + i), gain));
+        vst1q_f32(acc + i + 4, vmlaq_n_f32(vld1q_f32(acc + i + 4), vld1q_f32(src + i + 4), gain));
+    }
+#endif
+    for (; i < samples; i++)
+        acc[i] += src[i] * gain;
+}
+
+void mix_output_s16(int16_t* dst, const float* src, size_t samples) {
+    size_t i = 0;
+#if defined(__x86_64__)
+    // Clamp before converting: anything out of the range of int32 would
+    // come back as INT32_MIN, whatever its sign.
+    __m128 scale = _mm_set1_ps(32768.0f);
+    __m128 lo = _mm_set1_ps(-32768.0f);
+    __m128 hi = _mm_set1_ps(32767.0f);
+    for (; i + 8 <= samples; i += 8) {
+        __m128 a = _mm_mul_ps(_mm_loadu_ps(src + i), scale);
+        __m128 b = _mm_mul_ps(_mm_loadu_ps(src + i + 4), scale);
+        a = _mm_min_ps(_mm_max_ps(a, lo), hi);
+        b = _mm_min_ps(_mm_max_ps(b, lo), hi);
+        __m128i v = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+        _mm_storeu_si128((__m128i*)(dst + i), v);
+    }
+#elif defined(__aarch64__)
+    // Both the conversion and the narrowing saturate.
+    for (; i + 8 <= samples; i += 8) {
+        int32x4_t a = vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(src + i), 32768.0f));
+        int32x4_t b = vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(src + i + 4), 32768.0f));
+        vst1q_s16(dst + i, vcombine_s16(vqmovn_s32(a), vqmovn_s32(b)));
+    }
+#endif
+    for (; i < samples; i++) {
+        float v = src[i] * 32768.0f;
+        if (v > 32767.0f)
+            v = 32767.0f;
+        else if (v < -32768.0f)
+            v = -32768.0f;
+        dst[i] = (int16_t)lrintf(v);
+    }
+}
@@ -0,0 +1,67 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <magenta/compiler.h>
+#include <magenta/device/audio2.h>
+
+__BEGIN_CDECLS
+
+// The mixer works on interleaved stereo float frames, full scale being
+// [-1.0, 1.0].
+
+// Length of the resampling filter, in input frames, and how many fractional
+// positions between two input frames it has coefficients for.
+#define MIX_RESAMPLER_TAPS   16
+#define MIX_RESAMPLER_PHASES 64
+
+typedef struct mix_resampler {
+    // Input frames per output frame, as a 32.32 fixed point number.
+    uint64_t step;
+
+    // Where the next output frame falls between input frames, in the same
+    // fixed point, counted from the oldest frame of |history|.
+    uint64_t frac;
+
+    // The last MIX_RESAMPLER_TAPS input frames, which the filter still
+    // needs for the next output frames.
+    float history[MIX_RESAMPLER_TAPS * 2];
+
+    // One windowed sinc per phase, each coefficient stored twice so that
+    // it lines up with both samples of a frame.
+    float coeffs[MIX_RESAMPLER_PHASES][MIX_RESAMPLER_TAPS * 2] __ALIGNED(16);
+} mix_resampler_t;
+
+// Sets up |r| to convert from |in_rate| to |out_rate| frames per second,
+// with the cutoff low enough that downsampling does not alias.
+void mix_resampler_init(mix_resampler_t* r, uint32_t in_rate, uint32_t out_rate);
+
+// How many input frames mix_resample() will consume to produce |out_frames|.
+size_t mix_resample_frames_needed(const mix_resampler_t* r, size_t out_frames);
+
+// Produces |out_frames| at |out| from |in|, which must start with room for
+// the resampler's history (MIX_RESAMPLER_TAPS frames), followed by the
+// frames given by mix_resample_frames_needed().  The history is copied in
+// first, and the newest frames are kept as history for next time.
+void mix_resample(mix_resampler_t* r, float* out, float* in, size_t out_frames);
+
+// Converts |frames| frames of |channels| channels in |format| to stereo
+// float.  Only mono and stereo 16 and 32 bit and float formats are handled;
+// mix_format_supported() says what is.
+bool mix_format_supported(audio2_sample_format_t format, uint16_t channels);
+void mix_convert_in(float* dst, const void* src, size_t frames,
+                    audio2_sample_format_t format, uint16_t channels);
+
+// Adds |samples| samples from |src|, scaled by |gain|, into |acc|.
+void mix_accumulate(float* acc, const float* src, size_t samples, float gain);
+
+// Converts |samples| samples to signed 16 bit, clipping what is out of range.
+void mix_output_s16(int16_t* dst, const float* src, size_t samples);
+
+__END_CDECLS
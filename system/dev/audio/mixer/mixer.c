@@ -0,0 +1,920 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// A software mixer that sits on top of an audio2 output stream and lets any
+// number of clients play through it at once.  Each client gets its own
+// stream and ring buffer channels, speaking the same audio2 protocol as the
+// hardware does, in whatever rate and (mono or stereo, 16 bit, 32 bit or
+// float) format it likes.  A mix thread, scheduled by deadline, pulls every
+// running client's ring buffer through its own resampler, adds them up and
+// writes the result a few milliseconds ahead of the hardware.
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ddk/binding.h>
+#include <ddk/device.h>
+#include <ddk/driver.h>
+
+#include <magenta/device/audio2.h>
+#include <magenta/listnode.h>
+#include <magenta/process.h>
+#include <magenta/syscalls.h>
+#include <magenta/syscalls/port.h>
+#include <magenta/threads.h>
+
+#include "mix.h"
+
+#define TRACE 0
+// clang-format off
+#define xprintf(fmt...) \
+    do { \
+        if (TRACE) { \
+            printf("mixer: "fmt); \
+        } \
+    } while (false)
+
+// What the hardware is run at.
+#define MIXER_FRAME_RATE        48000
+#define MIXER_CHANNELS          2
+#define MIXER_FRAME_SIZE        (MIXER_CHANNELS * sizeof(int16_t))
+
+// The mix thread wakes up this often, and keeps the hardware this far ahead
+// of what it has played.
+#define MIXER_PERIOD            MX_MSEC(5)
+#define MIXER_PERIOD_FRAMES     (MIXER_FRAME_RATE / 200)
+#define MIXER_LEAD_FRAMES       (3 * MIXER_PERIOD_FRAMES)
+#define MIXER_HW_RING_FRAMES    (8 * MIXER_PERIOD_FRAMES)
+
+// CPU time reserved for the mix thread every period.
+#define MIXER_RUNTIME           MX_MSEC(1)
+
+// The most frames mixed at a time, and the most a client may be read for
+// them: clients are not allowed below a quarter of the mixer's rate.
+#define MIXER_MAX_FRAMES        MIXER_LEAD_FRAMES
+#define MIXER_MIN_CLIENT_RATE   8000
+#define MIXER_MAX_CLIENT_RATE   (4 * MIXER_FRAME_RATE)
+#define MIXER_MAX_CLIENT_FRAMES (4 * MIXER_MAX_FRAMES + 1)
+
+#define MIXER_CALL_TIMEOUT      MX_MSEC(100)
+
+// Port keys are client pointers, with the low bit set for ring buffer channels.
+#define KEY_RB_CHANNEL          1ull
+// clang-format on
+
+typedef struct mixer mixer_t;
+
+typedef struct mixer_client {
+    mixer_t* mixer;
+    list_node_t node;
+
+    mx_handle_t stream_ch;
+    mx_handle_t rb_ch;
+
+    uint32_t frame_rate;
+    uint16_t channels;
+    audio2_sample_format_t format;
+    uint32_t frame_size;
+
+    float gain;
+    bool muted;
+
+    mx_handle_t rb_vmo;
+    uint8_t* rb;
+    uint32_t rb_size;
+    uint32_t notify_bytes;
+    uint32_t since_notify;
+
+    mx_handle_t pos_vmo;
+    audio2_rb_position_t* pos;
+
+    // Everything below is the mix thread's while |running|.
+    bool running;
+    uint32_t rd;
+    uint64_t frames;
+    uint64_t start_ticks;
+    mix_resampler_t resampler;
+} mixer_client_t;
+
+struct mixer {
+    mx_device_t* mxdev;
+    mx_device_t* parent;
+
+    mx_handle_t port;
+    thrd_t port_thrd;
+
+    // Guards |clients| and the state of those that are running.
+    mtx_t lock;
+    list_node_t clients;
+
+    // The hardware, which the mixer has to itself.
+    mx_handle_t hw_stream_ch;
+    mx_handle_t hw_rb_ch;
+    mx_handle_t hw_vmo;
+    int16_t* hw_rb;
+    uint32_t hw_frames;
+    mx_handle_t hw_pos_vmo;
+    const audio2_rb_position_t* hw_pos;
+    uint64_t hw_start_ticks;
+    uint64_t hw_written;
+    bool hw_running;
+
+    thrd_t mix_thrd;
+    volatile bool mixing;
+
+    // Scratch space for the mix thread.
+    float mix_buf[MIXER_MAX_FRAMES * 2];
+    float client_buf[MIXER_MAX_FRAMES * 2];
+    float stage_buf[(MIX_RESAMPLER_TAPS + MIXER_MAX_CLIENT_FRAMES) * 2];
+};
+
+static void mixer_close_handle(mx_handle_t* handle) {
+    if (*handle != MX_HANDLE_INVALID) {
+        mx_handle_close(*handle);
+        *handle = MX_HANDLE_INVALID;
+    }
+}
+
+static void mixer_unmap(void* ptr, size_t len) {
+    if (ptr != NULL) {
+        mx_vmar_unmap(mx_vmar_root_self(), (uintptr_t)ptr, len);
+    }
+}
+
+// Every response from the hardware that the mixer cares about leads with
+// its result.
+typedef struct {
+    audio2_cmd_hdr_t hdr;
+    mx_status_t result;
+} hw_resp_t;
+
+static mx_status_t mixer_hw_call(mx_handle_t ch, const void* req, uint32_t req_size,
+                                 void* resp, uint32_t resp_size, mx_handle_t* handle_out) {
+    mx_channel_call_args_t args = {
+        .wr_bytes = (void*)req,
+        .wr_num_bytes = req_size,
+        .rd_bytes = resp,
+        .rd_num_bytes = resp_size,
+        .rd_handles = handle_out,
+        .rd_num_handles = handle_out ? 1 : 0,
+    };
+    uint32_t bytes, handles;
+    mx_status_t read_status;
+    mx_status_t status = mx_channel_call(ch, 0, mx_deadline_after(MIXER_CALL_TIMEOUT), &args,
+                                         &bytes, &handles, &read_status);
+    if (status == MX_ERR_CALL_FAILED)
+        return read_status;
+    if (status != MX_OK)
+        return status;
+    if (bytes != resp_size) {
+        if (handles > 0)
+            mx_handle_close(*handle_out);
+        return MX_ERR_INTERNAL;
+    }
+    status = ((hw_resp_t*)resp)->result;
+    if (status != MX_OK && handles > 0)
+        mx_handle_close(*handle_out);
+    return status;
+}
+
+static mx_status_t mixer_hw_init(mixer_t* m) {
+    mx_status_t status;
+    size_t actual;
+    status = device_ioctl(m->parent, AUDIO2_IOCTL_GET_CHANNEL, NULL, 0,
+                          &m->hw_stream_ch, sizeof(m->hw_stream_ch), &actual);
+    if (status != MX_OK)
+        return status;
+
+    audio2_stream_cmd_set_format_req_t fmt_req = {
+        .hdr = {.transaction_id = 1, .cmd = AUDIO2_STREAM_CMD_SET_FORMAT},
+        .frames_per_second = MIXER_FRAME_RATE,
+        .sample_format = AUDIO2_SAMPLE_FORMAT_16BIT,
+        .channels = MIXER_CHANNELS,
+    };
+    audio2_stream_cmd_set_format_resp_t fmt_resp;
+    status = mixer_hw_call(m->hw_stream_ch, &fmt_req, sizeof(fmt_req),
+                           &fmt_resp, sizeof(fmt_resp), &m->hw_rb_ch);
+    if (status != MX_OK) {
+        printf("mixer: cannot set the hardware format: %d\n", status);
+        return status;
+    }
+
+    // Without a position VMO the mixer goes by the clock instead.
+    audio2_rb_cmd_get_position_vmo_req_t pos_req = {
+        .hdr = {.transaction_id = 1, .cmd = AUDIO2_RB_CMD_GET_POSITION_VMO},
+    };
+    audio2_rb_cmd_get_position_vmo_resp_t pos_resp;
+    if (mixer_hw_call(m->hw_rb_ch, &pos_req, sizeof(pos_req),
+                      &pos_resp, sizeof(pos_resp), &m->hw_pos_vmo) == MX_OK) {
+        status = mx_vmar_map(mx_vmar_root_self(), 0, m->hw_pos_vmo, 0,
+                             sizeof(audio2_rb_position_t), MX_VM_FLAG_PERM_READ,
+                             (uintptr_t*)&m->hw_pos);
+        if (status != MX_OK) {
+            m->hw_pos = NULL;
+            mixer_close_handle(&m->hw_pos_vmo);
+        }
+    }
+
+    audio2_rb_cmd_get_buffer_req_t buf_req = {
+        .hdr = {.transaction_id = 1, .cmd = AUDIO2_RB_CMD_GET_BUFFER},
+        .min_ring_buffer_frames = MIXER_HW_RING_FRAMES,
+        .notifications_per_ring = 0,
+    };
+    audio2_rb_cmd_get_buffer_resp_t buf_resp;
+    status = mixer_hw_call(m->hw_rb_ch, &buf_req, sizeof(buf_req),
+                           &buf_resp, sizeof(buf_resp), &m->hw_vmo);
+    if (status != MX_OK) {
+        printf("mixer: cannot get the hardware ring buffer: %d\n", status);
+        return status;
+    }
+
+    uint64_t size;
+    status = mx_vmo_get_size(m->hw_vmo, &size);
+    if (status != MX_OK)
+        return status;
+    if ((size < MIXER_LEAD_FRAMES * MIXER_FRAME_SIZE) || (size % MIXER_FRAME_SIZE))
+        return MX_ERR_INTERNAL;
+    m->hw_frames = (uint32_t)(size / MIXER_FRAME_SIZE);
+
+    status = mx_vmar_map(mx_vmar_root_self(), 0, m->hw_vmo, 0, size,
+                         MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE,
+                         (uintptr_t*)&m->hw_rb);
+    if (status != MX_OK) {
+        m->hw_rb = NULL;
+        return status;
+    }
+
+    xprintf("hardware ring of %u frames, position %s\n",
+            m->hw_frames, m->hw_pos ? "shared" : "by the clock");
+    return MX_OK;
+}
+
+static void mixer_hw_release(mixer_t* m) {
+    mixer_unmap(m->hw_rb, m->hw_frames * MIXER_FRAME_SIZE);
+    m->hw_rb = NULL;
+    mixer_unmap((void*)m->hw_pos, sizeof(audio2_rb_position_t));
+    m->hw_pos = NULL;
+    mixer_close_handle(&m->hw_vmo);
+    mixer_close_handle(&m->hw_pos_vmo);
+    mixer_close_handle(&m->hw_rb_ch);
+    mixer_close_handle(&m->hw_stream_ch);
+}
+
+// How many frames the hardware has played since it was started.
+static uint64_t mixer_hw_played(mixer_t* m) {
+    if (m->hw_pos != NULL) {
+        audio2_rb_position_t pos;
+        audio2_rb_position_read(m->hw_pos, &pos);
+        return pos.frames;
+    }
+    uint64_t ticks = mx_ticks_get() - m->hw_start_ticks;
+    return ticks * MIXER_FRAME_RATE / mx_ticks_per_second();
+}
+
+static void mixer_publish_position(mixer_client_t* c) {
+    if (c->pos == NULL)
+        return;
+    audio2_rb_position_t* p = c->pos;
+    uint32_t seq = p->seq;
+    __atomic_store_n(&p->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    p->ring_buffer_pos = c->rd;
+    p->frames = c->frames;
+    p->ticks = mx_ticks_get();
+    p->start_ticks = c->start_ticks;
+    __atomic_store_n(&p->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+// Reads enough of the client's ring buffer for |frames| frames at the
+// mixer's rate and adds them into |m->mix_buf|.
+// called with m->lock held
+static void mixer_mix_client(mixer_t* m, mixer_client_t* c, size_t frames) {
+    size_t needed = mix_resample_frames_needed(&c->resampler, frames);
+    float* stage = m->stage_buf + MIX_RESAMPLER_TAPS * 2;
+    size_t done = 0;
+    while (done < needed) {
+        size_t todo = (c->rb_size - c->rd) / c->frame_size;
+        if (todo > needed - done)
+            todo = needed - done;
+        mix_convert_in(stage + done * 2, c->rb + c->rd, todo, c->format, c->channels);
+        done += todo;
+        c->rd += (uint32_t)(todo * c->frame_size);
+        if (c->rd == c->rb_size)
+            c->rd = 0;
+    }
+    c->frames += needed;
+
+    mix_resample(&c->resampler, m->client_buf, m->stage_buf, frames);
+    if (!c->muted)
+        mix_accumulate(m->mix_buf, m->client_buf, frames * 2, c->gain);
+
+    mixer_publish_position(c);
+
+    if (c->notify_bytes == 0)
+        return;
+    c->since_notify += (uint32_t)(needed * c->frame_size);
+    if (c->since_notify >= c->notify_bytes) {
+        c->since_notify %= c->notify_bytes;
+        audio2_rb_position_notify_t notify = {
+            .hdr = {.transaction_id = AUDIO2_INVALID_TRANSACTION_ID,
+                    .cmd = AUDIO2_RB_POSITION_NOTIFY},
+            .ring_buffer_pos = c->rd,
+        };
+        mx_channel_write(c->rb_ch, 0, &notify, sizeof(notify), NULL, 0);
+    }
+}
+
+// Mixes the next |frames| frames into the hardware ring buffer.
+static void mixer_mix(mixer_t* m, size_t frames) {
+    memset(m->mix_buf, 0, frames * 2 * sizeof(float));
+
+    mtx_lock(&m->lock);
+    mixer_client_t* c;
+    list_for_every_entry (&m->clients, c, mixer_client_t, node) {
+        if (c->running)
+            mixer_mix_client(m, c, frames);
+    }
+    mtx_unlock(&m->lock);
+
+    size_t done = 0;
+    while (done < frames) {
+        uint32_t wr = (uint32_t)((m->hw_written + done) % m->hw_frames);
+        size_t todo = m->hw_frames - wr;
+        if (todo > frames - done)
+            todo = frames - done;
+        mix_output_s16(m->hw_rb + wr * MIXER_CHANNELS, m->mix_buf + done * 2, todo * 2);
+        done += todo;
+    }
+    m->hw_written += frames;
+}
+
+static int mixer_mix_thread(void* arg) {
+    mixer_t* m = arg;
+
+    // If the reservation can't be had, mix on a best effort basis.
+    mx_status_t status = mx_thread_set_deadline(get_root_resource(),
+                                                thrd_get_mx_handle(thrd_current()),
+                                                MIXER_RUNTIME, MIXER_PERIOD, MIXER_PERIOD);
+    if (status != MX_OK) {
+        xprintf("no deadline reservation for the mix thread: %d\n", status);
+    }
+
+    mx_time_t next = mx_time_get(MX_CLOCK_MONOTONIC);
+    while (m->mixing) {
+        next += MIXER_PERIOD;
+        mx_nanosleep(next);
+
+        uint64_t played = mixer_hw_played(m);
+        if (m->hw_written < played) {
+            xprintf("underrun by %" PRIu64 " frames\n", played - m->hw_written);
+            m->hw_written = played;
+        }
+        uint64_t frames = played + MIXER_LEAD_FRAMES - m->hw_written;
+        if (frames > MIXER_MAX_FRAMES)
+            frames = MIXER_MAX_FRAMES;
+        if (frames > 0)
+            mixer_mix(m, (size_t)frames);
+    }
+    return 0;
+}
+
+// called from the port thread only
+static mx_status_t mixer_hw_start(mixer_t* m) {
+    if (m->hw_running)
+        return MX_OK;
+
+    // Fill the lead before the hardware starts to play it.
+    m->hw_written = 0;
+    mixer_mix(m, MIXER_LEAD_FRAMES);
+
+    audio2_rb_cmd_start_req_t req = {
+        .hdr = {.transaction_id = 1, .cmd = AUDIO2_RB_CMD_START},
+    };
+    audio2_rb_cmd_start_resp_t resp;
+    mx_status_t status = mixer_hw_call(m->hw_rb_ch, &req, sizeof(req),
+                                       &resp, sizeof(resp), NULL);
+    if (status != MX_OK) {
+        printf("mixer: cannot start the hardware: %d\n", status);
+        return status;
+    }
+    m->hw_start_ticks = resp.start_ticks;
+
+    m->mixing = true;
+    int thrd_rc = thrd_create_with_name(&m->mix_thrd, mixer_mix_thread, m, "mixer_mix_thread");
+    if (thrd_rc != thrd_success) {
+        m->mixing = false;
+        audio2_rb_cmd_stop_req_t stop = {
+            .hdr = {.transaction_id = 1, .cmd = AUDIO2_RB_CMD_STOP},
+        };
+        audio2_rb_cmd_stop_resp_t stop_resp;
+        mixer_hw_call(m->hw_rb_ch, &stop, sizeof(stop), &stop_resp, sizeof(stop_resp), NULL);
+        return thrd_status_to_mx_status(thrd_rc);
+    }
+    m->hw_running = true;
+    return MX_OK;
+}
+
+// called from the port thread only
+static void mixer_hw_stop(mixer_t* m) {
+    if (!m->hw_running)
+        return;
+
+    m->mixing = false;
+    thrd_join(m->mix_thrd, NULL);
+    m->hw_running = false;
+
+    audio2_rb_cmd_stop_req_t req = {
+        .hdr = {.transaction_id = 1, .cmd = AUDIO2_RB_CMD_STOP},
+    };
+    audio2_rb_cmd_stop_resp_t resp;
+    mixer_hw_call(m->hw_rb_ch, &req, sizeof(req), &resp, sizeof(resp), NULL);
+
+    // Whatever is left in the ring is stale now.
+    memset(m->hw_rb, 0, m->hw_frames * MIXER_FRAME_SIZE);
+}
+
+static mx_status_t client_reply(mx_handle_t ch, const void* resp, uint32_t size,
+                                mx_handle_t handle) {
+    return mx_channel_write(ch, 0, resp, size, &handle,
+                            (handle != MX_HANDLE_INVALID) ? 1 : 0);
+}
+
+// Stops the client, and the hardware too if nobody else is playing.
+static mx_status_t client_stop(mixer_client_t* c) {
+    mixer_t* m = c->mixer;
+
+    mtx_lock(&m->lock);
+    if (!c->running) {
+        mtx_unlock(&m->lock);
+        return MX_ERR_BAD_STATE;
+    }
+    c->running = false;
+    bool idle = true;
+    mixer_client_t* other;
+    list_for_every_entry (&m->clients, other, mixer_client_t, node) {
+        if (other->running)
+            idle = false;
+    }
+    mtx_unlock(&m->lock);
+
+    if (idle)
+        mixer_hw_stop(m);
+    return MX_OK;
+}
+
+static void client_release_rb(mixer_client_t* c) {
+    client_stop(c);
+    mixer_unmap(c->rb, c->rb_size);
+    c->rb = NULL;
+    c->rb_size = 0;
+    mixer_unmap(c->pos, sizeof(audio2_rb_position_t));
+    c->pos = NULL;
+    mixer_close_handle(&c->rb_vmo);
+    mixer_close_handle(&c->pos_vmo);
+    mixer_close_handle(&c->rb_ch);
+}
+
+static void client_destroy(mixer_client_t* c) {
+    mixer_t* m = c->mixer;
+    client_release_rb(c);
+    mixer_close_handle(&c->stream_ch);
+
+    mtx_lock(&m->lock);
+    list_delete(&c->node);
+    mtx_unlock(&m->lock);
+    free(c);
+}
+
+static mx_status_t client_set_format(mixer_client_t* c,
+                                     const audio2_stream_cmd_set_format_req_t* req) {
+    audio2_stream_cmd_set_format_resp_t resp = {.hdr = req->hdr};
+    mx_handle_t ret_handle = MX_HANDLE_INVALID;
+    mx_status_t status;
+
+    if (!mix_format_supported(req->sample_format, req->channels) ||
+        (req->frames_per_second < MIXER_MIN_CLIENT_RATE) ||
+        (req->frames_per_second > MIXER_MAX_CLIENT_RATE)) {
+        status = MX_ERR_NOT_SUPPORTED;
+        goto done;
+    }
+
+    // A new format means a new ring buffer channel.
+    client_release_rb(c);
+
+    c->frame_rate = req->frames_per_second;
+    c->channels = req->channels;
+    c->format = req->sample_format;
+    c->frame_size = c->channels * ((c->format == AUDIO2_SAMPLE_FORMAT_16BIT) ? 2 : 4);
+    mix_resampler_init(&c->resampler, c->frame_rate, MIXER_FRAME_RATE);
+
+    status = mx_channel_create(0, &c->rb_ch, &ret_handle);
+    if (status != MX_OK)
+        goto done;
+    status = mx_port_bind(c->mixer->port, (uintptr_t)c | KEY_RB_CHANNEL, c->rb_ch,
+                          MX_CHANNEL_READABLE | MX_CHANNEL_PEER_CLOSED);
+    if (status != MX_OK) {
+        mixer_close_handle(&c->rb_ch);
+        mixer_close_handle(&ret_handle);
+    }
+
+done:
+    resp.result = status;
+    return client_reply(c->stream_ch, &resp, sizeof(resp), ret_handle);
+}
+
+static mx_status_t client_stream_cmd(mixer_client_t* c, const void* buf, uint32_t size) {
+    const audio2_cmd_hdr_t* hdr = buf;
+    bool no_ack = (hdr->cmd & AUDIO2_FLAG_NO_ACK) != 0;
+
+    switch (hdr->cmd & ~AUDIO2_FLAG_NO_ACK) {
+    case AUDIO2_STREAM_CMD_SET_FORMAT:
+        if (size != sizeof(audio2_stream_cmd_set_format_req_t))
+            return MX_ERR_INVALID_ARGS;
+        return client_set_format(c, buf);
+
+    case AUDIO2_STREAM_CMD_GET_GAIN: {
+        audio2_stream_cmd_get_gain_resp_t resp = {
+            .hdr = *hdr,
+            .cur_mute = c->muted,
+            .cur_gain = 20.0f * log10f(c->gain),
+            .can_mute = true,
+            .min_gain = -100.0f,
+            .max_gain = 0.0f,
+            .gain_step = 0.0f,
+        };
+        return client_reply(c->stream_ch, &resp, sizeof(resp), MX_HANDLE_INVALID);
+    }
+    case AUDIO2_STREAM_CMD_SET_GAIN: {
+        if (size != sizeof(audio2_stream_cmd_set_gain_req_t))
+            return MX_ERR_INVALID_ARGS;
+        const audio2_stream_cmd_set_gain_req_t* req = buf;
+        audio2_stream_cmd_set_gain_resp_t resp = {.hdr = *hdr, .result = MX_OK};
+        if ((req->flags & AUDIO2_SGF_GAIN_VALID) &&
+            ((req->gain < -100.0f) || (req->gain > 0.0f))) {
+            resp.result = MX_ERR_INVALID_ARGS;
+        } else {
+            // The mix thread picks these up on its next pass.
+            mtx_lock(&c->mixer->lock);
+            if (req->flags & AUDIO2_SGF_MUTE_VALID)
+                c->muted = (req->flags & AUDIO2_SGF_MUTE) != 0;
+            if (req->flags & AUDIO2_SGF_GAIN_VALID)
+                c->gain = powf(10.0f, req->gain / 20.0f);
+            mtx_unlock(&c->mixer->lock);
+        }
+        resp.cur_mute = c->muted;
+        resp.cur_gain = 20.0f * log10f(c->gain);
+        if (no_ack)
+            return MX_OK;
+        return client_reply(c->stream_ch, &resp, sizeof(resp), MX_HANDLE_INVALID);
+    }
+    case AUDIO2_STREAM_CMD_PLUG_DETECT: {
+        // Whether the hardware is plugged in is the hardware's business.
+        audio2_stream_cmd_plug_detect_resp_t resp = {
+            .hdr = *hdr,
+            .flags = AUDIO2_PDNF_HARDWIRED | AUDIO2_PDNF_PLUGGED,
+            .plug_state_time = 0,
+        };
+        if (no_ack)
+            return MX_OK;
+        return client_reply(c->stream_ch, &resp, sizeof(resp), MX_HANDLE_INVALID);
+    }
+    default:
+        xprintf("unrecognized stream command %#x\n", hdr->cmd);
+        return MX_ERR_NOT_SUPPORTED;
+    }
+}
+
+static mx_status_t client_get_buffer(mixer_client_t* c, const audio2_rb_cmd_get_buffer_req_t* req) {
+    audio2_rb_cmd_get_buffer_resp_t resp = {.hdr = req->hdr};
+    mx_handle_t ret_handle = MX_HANDLE_INVALID;
+    mx_status_t status;
+
+    if (c->running) {
+        status = MX_ERR_BAD_STATE;
+        goto done;
+    }
+    if (req->min_ring_buffer_frames == 0) {
+        status = MX_ERR_INVALID_ARGS;
+        goto done;
+    }
+
+    mixer_unmap(c->rb, c->rb_size);
+    c->rb = NULL;
+    mixer_close_handle(&c->rb_vmo);
+
+    c->rb_size = req->min_ring_buffer_frames * c->frame_size;
+    status = mx_vmo_create(c->rb_size, 0, &c->rb_vmo);
+    if (status != MX_OK)
+        goto fail;
+    status = mx_vmar_map(mx_vmar_root_self(), 0, c->rb_vmo, 0, c->rb_size,
+                         MX_VM_FLAG_PERM_READ, (uintptr_t*)&c->rb);
+    if (status != MX_OK) {
+        c->rb = NULL;
+        goto fail;
+    }
+    status = mx_handle_duplicate(c->rb_vmo, MX_RIGHT_TRANSFER | MX_RIGHT_READ |
+                                            MX_RIGHT_WRITE | MX_RIGHT_MAP,
+                                 &ret_handle);
+    if (status != MX_OK)
+        goto fail;
+
+    // Rounded to whole frames, so that notifications land on frame edges.
+    c->notify_bytes = 0;
+    if (req->notifications_per_ring > 0) {
+        c->notify_bytes = (c->rb_size / req->notifications_per_ring) / c->frame_size * c->frame_size;
+        if (c->notify_bytes == 0)
+            c->notify_bytes = c->frame_size;
+    }
+    goto done;
+
+fail:
+    mixer_unmap(c->rb, c->rb_size);
+    c->rb = NULL;
+    c->rb_size = 0;
+    mixer_close_handle(&c->rb_vmo);
+done:
+    resp.result = status;
+    return client_reply(c->rb_ch, &resp, sizeof(resp), ret_handle);
+}
+
+static mx_status_t client_get_position_vmo(mixer_client_t* c,
+                                           const audio2_rb_cmd_get_position_vmo_req_t* req) {
+    audio2_rb_cmd_get_position_vmo_resp_t resp = {.hdr = req->hdr};
+    mx_handle_t ret_handle = MX_HANDLE_INVALID;
+    mx_status_t status = MX_OK;
+
+    if (c->pos_vmo == MX_HANDLE_INVALID) {
+        status = mx_vmo_create(sizeof(audio2_rb_position_t), 0, &c->pos_vmo);
+        if (status != MX_OK)
+            goto done;
+        audio2_rb_position_t* pos;
+        status = mx_vmar_map(mx_vmar_root_self(), 0, c->pos_vmo, 0, sizeof(*pos),
+                             MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE, (uintptr_t*)&pos);
+        if (status != MX_OK) {
+            mixer_close_handle(&c->pos_vmo);
+            goto done;
+        }
+        // Published to the mix thread with the lock, should it be running.
+        mtx_lock(&c->mixer->lock);
+        c->pos = pos;
+        mtx_unlock(&c->mixer->lock);
+    }
+    status = mx_handle_duplicate(c->pos_vmo, MX_RIGHT_TRANSFER | MX_RIGHT_READ | MX_RIGHT_MAP,
+                                 &ret_handle);
+
+done:
+    resp.result = status;
+    return client_reply(c->rb_ch, &resp, sizeof(resp), ret_handle);
+}
+
+static mx_status_t client_rb_cmd(mixer_client_t* c, const void* buf, uint32_t size) {
+    const audio2_cmd_hdr_t* hdr = buf;
+    mixer_t* m = c->mixer;
+
+    switch (hdr->cmd) {
+    case AUDIO2_RB_CMD_GET_FIFO_DEPTH: {
+        // The mixer reads this far ahead of the position it reports.
+        uint64_t frames = (uint64_t)MIXER_MAX_FRAMES * c->frame_rate / MIXER_FRAME_RATE +
+                          MIX_RESAMPLER_TAPS + 1;
+        audio2_rb_cmd_get_fifo_depth_resp_t resp = {
+            .hdr = *hdr,
+            .result = MX_OK,
+            .fifo_depth = (uint32_t)(frames * c->frame_size),
+        };
+        return client_reply(c->rb_ch, &resp, sizeof(resp), MX_HANDLE_INVALID);
+    }
+    case AUDIO2_RB_CMD_GET_BUFFER:
+        if (size != sizeof(audio2_rb_cmd_get_buffer_req_t))
+            return MX_ERR_INVALID_ARGS;
+        return client_get_buffer(c, buf);
+
+    case AUDIO2_RB_CMD_GET_POSITION_VMO:
+        return client_get_position_vmo(c, buf);
+
+    case AUDIO2_RB_CMD_START: {
+        audio2_rb_cmd_start_resp_t resp = {.hdr = *hdr, .result = MX_OK};
+        if ((c->rb == NULL) || c->running) {
+            resp.result = MX_ERR_BAD_STATE;
+        } else {
+            mix_resampler_init(&c->resampler, c->frame_rate, MIXER_FRAME_RATE);
+            c->rd = 0;
+            c->frames = 0;
+            c->since_notify = 0;
+            c->start_ticks = mx_ticks_get();
+            resp.start_ticks = c->start_ticks;
+            mixer_publish_position(c);
+
+            mtx_lock(&m->lock);
+            c->running = true;
+            mtx_unlock(&m->lock);
+
+            resp.result = mixer_hw_start(m);
+            if (resp.result != MX_OK) {
+                mtx_lock(&m->lock);
+                c->running = false;
+                mtx_unlock(&m->lock);
+            }
+        }
+        return client_reply(c->rb_ch, &resp, sizeof(resp), MX_HANDLE_INVALID);
+    }
+    case AUDIO2_RB_CMD_STOP: {
+        audio2_rb_cmd_stop_resp_t resp = {.hdr = *hdr};
+        resp.result = client_stop(c);
+        return client_reply(c->rb_ch, &resp, sizeof(resp), MX_HANDLE_INVALID);
+    }
+    default:
+        xprintf("unrecognized ring buffer command %#x\n", hdr->cmd);
+        return MX_ERR_NOT_SUPPORTED;
+    }
+}
+
+static int mixer_port_thread(void* arg) {
+    mixer_t* m = arg;
+
+    union {
+        audio2_cmd_hdr_t hdr;
+        audio2_stream_cmd_set_format_req_t set_format;
+        audio2_stream_cmd_set_gain_req_t set_gain;
+        audio2_rb_cmd_get_buffer_req_t get_buffer;
+    } req;
+
+    for (;;) {
+        mx_io_packet_t packet;
+        mx_status_t status = mx_port_wait(m->port, MX_TIME_INFINITE, &packet, sizeof(packet));
+        if (status != MX_OK)
+            break;
+
+        mixer_client_t* c = (mixer_client_t*)(uintptr_t)(packet.hdr.key & ~KEY_RB_CHANNEL);
+        bool rb = (packet.hdr.key & KEY_RB_CHANNEL) != 0;
+        mx_handle_t* ch = rb ? &c->rb_ch : &c->stream_ch;
+
+        // A packet may still come for a ring buffer channel which has been
+        // replaced since.
+        if (*ch == MX_HANDLE_INVALID)
+            continue;
+
+        bool closed = (packet.signals & MX_CHANNEL_PEER_CLOSED) != 0;
+        // Take everything queued, since the port only reports the change.
+        while (packet.signals & MX_CHANNEL_READABLE) {
+            uint32_t size;
+            status = mx_channel_read(*ch, 0, &req, NULL, sizeof(req), 0, &size, NULL);
+            if (status == MX_ERR_SHOULD_WAIT)
+                break;
+            if ((status != MX_OK) || (size < sizeof(req.hdr))) {
+                closed = true;
+                break;
+            }
+            status = rb ? client_rb_cmd(c, &req, size) : client_stream_cmd(c, &req, size);
+            if ((status != MX_OK) && (status != MX_ERR_NOT_SUPPORTED)) {
+                closed = true;
+                break;
+            }
+        }
+        if (!closed)
+            continue;
+
+        // Whichever channel goes, the client is done with it.
+        if (rb) {
+            client_release_rb(c);
+        } else {
+            mixer_close_handle(&c->stream_ch);
+        }
+        if ((c->stream_ch == MX_HANDLE_INVALID) && (c->rb_ch == MX_HANDLE_INVALID))
+            client_destroy(c);
+    }
+    return 0;
+}
+
+static mx_status_t mixer_ioctl(void* ctx, uint32_t op, const void* in_buf, size_t in_len,
+                               void* out_buf, size_t out_len, size_t* out_actual) {
+    mixer_t* m = ctx;
+
+    if (op != AUDIO2_IOCTL_GET_CHANNEL)
+        return MX_ERR_NOT_SUPPORTED;
+    if (out_len < sizeof(mx_handle_t))
+        return MX_ERR_BUFFER_TOO_SMALL;
+
+    // Every caller gets a stream of its own.
+    mixer_client_t* c = calloc(1, sizeof(*c));
+    if (c == NULL)
+        return MX_ERR_NO_MEMORY;
+    c->mixer = m;
+    c->gain = 1.0f;
+
+    mx_handle_t ret_handle;
+    mx_status_t status = mx_channel_create(0, &c->stream_ch, &ret_handle);
+    if (status != MX_OK) {
+        free(c);
+        return status;
+    }
+
+    mtx_lock(&m->lock);
+    list_add_tail(&m->clients, &c->node);
+    mtx_unlock(&m->lock);
+
+    // Bound last: from here on the port thread may act on |c|.
+    status = mx_port_bind(m->port, (uintptr_t)c, c->stream_ch,
+                          MX_CHANNEL_READABLE | MX_CHANNEL_PEER_CLOSED);
+    if (status != MX_OK) {
+        mtx_lock(&m->lock);
+        list_delete(&c->node);
+        mtx_unlock(&m->lock);
+        mx_handle_close(ret_handle);
+        mx_handle_close(c->stream_ch);
+        free(c);
+        return status;
+    }
+
+    *(mx_handle_t*)out_buf = ret_handle;
+    *out_actual = sizeof(ret_handle);
+    return MX_OK;
+}
+
+static void mixer_release(void* ctx) {
+    mixer_t* m = ctx;
+    mixer_hw_release(m);
+    free(m);
+}
+
+static mx_protocol_device_t mixer_device_proto = {
+    .version = DEVICE_OPS_VERSION,
+    .ioctl = mixer_ioctl,
+    .release = mixer_release,
+};
+
+static int mixer_bootstrap_thread(void* arg) {
+    mixer_t* m = arg;
+
+    mx_status_t status = mixer_hw_init(m);
+    if (status != MX_OK)
+        goto fail;
+
+    status = mx_port_create(0, &m->port);
+    if (status != MX_OK)
+        goto fail;
+
+    int thrd_rc = thrd_create_with_name(&m->port_thrd, mixer_port_thread, m,
+                                        "mixer_port_thread");
+    if (thrd_rc != thrd_success)
+        goto fail;
+    thrd_detach(m->port_thrd);
+
+    device_add_args_t args = {
+        .version = DEVICE_ADD_ARGS_VERSION,
+        .name = "mixer",
+        .ctx = m,
+        .ops = &mixer_device_proto,
+        .proto_id = MX_PROTOCOL_AUDIO2_MIXER,
+    };
+    status = device_add(m->parent, &args, &m->mxdev);
+    if (status != MX_OK) {
+        // The port thread goes with the port.
+        mixer_close_handle(&m->port);
+        printf("mixer: cannot add device: %d\n", status);
+        return -1;
+    }
+    return 0;
+
+fail:
+    printf("mixer: cannot take over the output: %d\n", status);
+    mixer_close_handle(&m->port);
+    mixer_hw_release(m);
+    free(m);
+    return -1;
+}
+
+static mx_status_t mixer_bind(void* ctx, mx_device_t* parent, void** cookie) {
+    mixer_t* m = calloc(1, sizeof(*m));
+    if (m == NULL)
+        return MX_ERR_NO_MEMORY;
+
+    m->parent = parent;
+    mtx_init(&m->lock, mtx_plain);
+    list_initialize(&m->clients);
+
+    // Talking to the hardware's channel waits for its driver, which must
+    // not happen from inside bind.
+    thrd_t bootstrap_thrd;
+    int thrd_rc = thrd_create_with_name(&bootstrap_thrd, mixer_bootstrap_thread, m,
+                                        "mixer_bootstrap_thread");
+    if (thrd_rc != thrd_success) {
+        free(m);
+        return thrd_status_to_mx_status(thrd_rc);
+    }
+    thrd_detach(bootstrap_thrd);
+    return MX_OK;
+}
+
+static mx_driver_ops_t mixer_driver_ops = {
+    .version = DRIVER_OPS_VERSION,
+    .bind = mixer_bind,
+};
+
+// clang-format off
+MAGENTA_DRIVER_BEGIN(audio_mixer, mixer_driver_ops, "magenta", "0.1", 1)
+    BI_MATCH_IF(EQ, BIND_PROTOCOL, MX_PROTOCOL_AUDIO2_OUTPUT),
+MAGENTA_DRIVER_END(audio_mixer)
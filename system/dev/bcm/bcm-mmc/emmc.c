@@ -92,7 +92,7 @@ static mx_paddr_t emmc_sdhci_get_dma_offset(void* ctx) {
 }
 
 static uint64_t emmc_sdhci_get_quirks(void* ctx) {
-    return SDHCI_QUIRK_STRIP_RESPONSE_CRC;
+    return SDHCI_QUIRK_STRIP_RESPONSE_CRC | SDHCI_QUIRK_NO_DMA;
 }
 
 static sdhci_protocol_ops_t emmc_sdhci_proto = {
@@ -46,6 +46,7 @@
 #define AHCI_PORT_FLAG_IMPLEMENTED (1 << 0)
 #define AHCI_PORT_FLAG_PRESENT     (1 << 1)
 #define AHCI_PORT_FLAG_SYNC_PAUSED (1 << 2) // port is paused until pending xfers are done
+#define AHCI_PORT_FLAG_ERROR       (1 << 3) // port stopped on an error, and needs a reset
 //clang-format on
 
 typedef struct ahci_port {
@@ -61,6 +62,8 @@ typedef struct ahci_port {
 
     uint32_t running;   // bitmask of running commands
     uint32_t completed; // bitmask of completed commands
+    uint32_t failed;    // bitmask of completed commands which failed
+    uint32_t queued;    // bitmask of running commands which are NCQ
     iotxn_t* commands[AHCI_MAX_COMMANDS]; // commands in flight
 
     list_node_t txn_list;
@@ -191,7 +194,9 @@ static bool cmd_is_read(uint8_t cmd) {
 static bool cmd_is_write(uint8_t cmd) {
     if (cmd == SATA_CMD_WRITE_DMA ||
         cmd == SATA_CMD_WRITE_DMA_EXT ||
-        cmd == SATA_CMD_WRITE_FPDMA_QUEUED) {
+        cmd == SATA_CMD_WRITE_DMA_FUA_EXT ||
+        cmd == SATA_CMD_WRITE_FPDMA_QUEUED ||
+        cmd == SATA_CMD_DATA_SET_MANAGEMENT) {
         return true;
     } else {
         return false;
@@ -202,14 +207,34 @@ static bool cmd_is_queued(uint8_t cmd) {
     return (cmd == SATA_CMD_READ_FPDMA_QUEUED) || (cmd == SATA_CMD_WRITE_FPDMA_QUEUED);
 }
 
+// Whether the command can go to the device as an NCQ command, which it is
+// switched to if so.
+static bool ahci_use_ncq(ahci_device_t* dev, sata_pdata_t* pdata) {
+    if (!(dev->cap & AHCI_CAP_NCQ) || (pdata->max_cmd == 0)) {
+        return false;
+    }
+    if (pdata->cmd == SATA_CMD_READ_DMA_EXT) {
+        pdata->cmd = SATA_CMD_READ_FPDMA_QUEUED;
+    } else if (pdata->cmd == SATA_CMD_WRITE_DMA_EXT) {
+        pdata->cmd = SATA_CMD_WRITE_FPDMA_QUEUED;
+    } else if (pdata->cmd == SATA_CMD_WRITE_DMA_FUA_EXT) {
+        pdata->cmd = SATA_CMD_WRITE_FPDMA_QUEUED;
+        pdata->device |= SATA_DEVICE_FUA;
+    }
+    return cmd_is_queued(pdata->cmd);
+}
+
 static void ahci_port_complete_txn(ahci_device_t* dev, ahci_port_t* port, mx_status_t status) {
     mtx_lock(&port->lock);
-    uint32_t sact = ahci_read(&port->regs->sact);
-    uint32_t running = port->running;
-    uint32_t done = sact ^ running;
-    // assert if a channel without an outstanding transaction is active
-    MX_DEBUG_ASSERT(!(done & sact));
-    port->completed |= done;
+    // NCQ commands are done once the device clears their bit in SACT, and
+    // others once the HBA clears theirs in CI. A single interrupt may cover
+    // any number of them.
+    uint32_t active = ahci_read(&port->regs->sact) | ahci_read(&port->regs->ci);
+    port->completed |= port->running & ~active;
+    if (status != MX_OK) {
+        // The port stops on an error, so nothing still active finishes.
+        port->flags |= AHCI_PORT_FLAG_ERROR;
+    }
     mtx_unlock(&port->lock);
     // hit the worker thread to complete commands
     completion_signal(&dev->worker_completion);
@@ -220,7 +245,8 @@ static mx_status_t ahci_do_txn(ahci_device_t* dev, ahci_port_t* port, int slot,
     assert(!ahci_port_cmd_busy(port, slot));
 
     sata_pdata_t* pdata = sata_iotxn_pdata(txn);
-    mx_status_t status = iotxn_physmap(txn);
+    // Commands without data, like flushes, have no pages to map.
+    mx_status_t status = (txn->length == 0) ? MX_OK : iotxn_physmap(txn);
     if (status != MX_OK) {
         iotxn_complete(txn, status, 0);
         completion_signal(&dev->worker_completion);
@@ -229,14 +255,6 @@ static mx_status_t ahci_do_txn(ahci_device_t* dev, ahci_port_t* port, int slot,
     iotxn_phys_iter_t iter;
     iotxn_phys_iter_init(&iter, txn, AHCI_PRD_MAX_SIZE);
 
-    if (dev->cap & AHCI_CAP_NCQ) {
-        if (pdata->cmd == SATA_CMD_READ_DMA_EXT) {
-            pdata->cmd = SATA_CMD_READ_FPDMA_QUEUED;
-        } else if (pdata->cmd == SATA_CMD_WRITE_DMA_EXT) {
-            pdata->cmd = SATA_CMD_WRITE_FPDMA_QUEUED;
-        }
-    }
-
     // build the command
     ahci_cl_t* cl = port->cl + slot;
     // don't clear the cl since we set up ctba/ctbau at init
@@ -254,7 +272,8 @@ static mx_status_t ahci_do_txn(ahci_device_t* dev, ahci_port_t* port, int slot,
 
     // some commands have lba/count fields
     if (pdata->cmd == SATA_CMD_READ_DMA_EXT ||
-        pdata->cmd == SATA_CMD_WRITE_DMA_EXT) {
+        pdata->cmd == SATA_CMD_WRITE_DMA_EXT ||
+        pdata->cmd == SATA_CMD_WRITE_DMA_FUA_EXT) {
         cfis[4] = pdata->lba & 0xff;
         cfis[5] = (pdata->lba >> 8) & 0xff;
         cfis[6] = (pdata->lba >> 16) & 0xff;
@@ -274,13 +293,18 @@ static mx_status_t ahci_do_txn(ahci_device_t* dev, ahci_port_t* port, int slot,
         cfis[11] = (pdata->count >> 8) & 0xff;
         cfis[12] = (slot << 3) & 0xff; // tag
         cfis[13] = 0; // normal priority
+    } else if (pdata->cmd == SATA_CMD_DATA_SET_MANAGEMENT) {
+        // The ranges are in the data; count is how many 512-byte blocks of them.
+        cfis[3] = pdata->feature;
+        cfis[12] = pdata->count & 0xff;
+        cfis[13] = (pdata->count >> 8) & 0xff;
     }
 
     cl->prdtl = 0;
     ahci_prd_t* prd = (ahci_prd_t*)((void*)port->ct[slot] + sizeof(ahci_ct_t));
     size_t length;
     mx_paddr_t paddr;
-    for (;;) {
+    while (txn->length != 0) {
         length = iotxn_phys_iter_next(&iter, &paddr);
         if (length == 0) {
             break;
@@ -310,13 +334,17 @@ static mx_status_t ahci_do_txn(ahci_device_t* dev, ahci_port_t* port, int slot,
 
     // start command
     if (cmd_is_queued(pdata->cmd)) {
+        port->queued |= (1 << slot);
         ahci_write(&port->regs->sact, (1 << slot));
     }
     ahci_write(&port->regs->ci, (1 << slot));
 
     // set the watchdog
     // TODO: general timeout mechanism
-    pdata->timeout = mx_time_get(MX_CLOCK_MONOTONIC) + MX_SEC(1);
+    // Flushing a large write cache, or trimming many ranges, can take a good while.
+    mx_time_t timeout = ((pdata->cmd == SATA_CMD_FLUSH_EXT) ||
+                         (pdata->cmd == SATA_CMD_DATA_SET_MANAGEMENT)) ? MX_SEC(30) : MX_SEC(1);
+    pdata->timeout = mx_time_get(MX_CLOCK_MONOTONIC) + timeout;
     completion_signal(&dev->watchdog_completion);
     return MX_OK;
 }
@@ -424,8 +452,8 @@ static void ahci_iotxn_queue(void* ctx, iotxn_t* txn) {
     assert(pdata->port < AHCI_MAX_PORTS);
     assert(port->flags & (AHCI_PORT_FLAG_IMPLEMENTED | AHCI_PORT_FLAG_PRESENT));
 
-    // complete empty txns immediately
-    if (txn->length == 0) {
+    // complete empty txns immediately, other than commands which move no data
+    if ((txn->length == 0) && (pdata->cmd != SATA_CMD_FLUSH_EXT)) {
         iotxn_complete(txn, MX_OK, txn->length);
         return;
     }
@@ -460,59 +488,82 @@ static int ahci_worker_thread(void* arg) {
                 goto next;
             }
 
+            if (port->flags & AHCI_PORT_FLAG_ERROR) {
+                // Whatever hadn't finished when the port stopped has failed.
+                // Restarting the port clears SACT and CI, and frees the slots.
+                port->flags &= ~AHCI_PORT_FLAG_ERROR;
+                uint32_t active = ahci_read(&port->regs->sact) | ahci_read(&port->regs->ci);
+                port->completed |= port->running & ~active;
+                port->failed |= port->running & active;
+                port->completed |= port->failed;
+                xprintf("ahci.%d: error, failing commands 0x%08x\n", port->nr, port->failed);
+                mtx_unlock(&port->lock);
+                ahci_port_reset(port);
+                mtx_lock(&port->lock);
+            }
+
             // complete commands first
             while (port->completed) {
                 unsigned slot = 32 - __builtin_clz(port->completed) - 1;
+                uint32_t bit = 1u << slot;
                 txn = port->commands[slot];
+                mx_status_t status = (port->failed & bit) ? MX_ERR_IO : MX_OK;
+                port->completed &= ~bit;
+                port->failed &= ~bit;
+                port->running &= ~bit;
+                port->queued &= ~bit;
+                port->commands[slot] = NULL;
+                // resume the port if paused for sync and no outstanding transactions
+                if ((port->flags & AHCI_PORT_FLAG_SYNC_PAUSED) && !port->running) {
+                    port->flags &= ~AHCI_PORT_FLAG_SYNC_PAUSED;
+                }
                 if (txn == NULL) {
                     xprintf("ahci.%d: illegal state, completing slot %d but txn == NULL\n", port->nr, slot);
                 } else {
                     mtx_unlock(&port->lock);
-                    iotxn_complete(txn, MX_OK, txn->length);
+                    iotxn_complete(txn, status, (status == MX_OK) ? txn->length : 0);
                     mtx_lock(&port->lock);
                 }
-                port->completed &= ~(1 << slot);
-                port->running &= ~(1 << slot);
-                port->commands[slot] = NULL;
-                // resume the port if paused for sync and no outstanding transactions
-                if ((port->flags & AHCI_PORT_FLAG_SYNC_PAUSED) && !port->running) {
-                    port->flags &= ~AHCI_PORT_FLAG_SYNC_PAUSED;
-                }
             }
 
-            if (port->flags & AHCI_PORT_FLAG_SYNC_PAUSED) {
-                goto next;
-            }
+            // issue as many commands as the device has free slots for
+            uint32_t busy = port->running | ahci_read(&port->regs->sact) | ahci_read(&port->regs->ci);
+            while (!(port->flags & AHCI_PORT_FLAG_SYNC_PAUSED)) {
+                txn = list_peek_head_type(&port->txn_list, iotxn_t, node);
+                if (!txn) {
+                    break;
+                }
 
-            txn = list_peek_head_type(&port->txn_list, iotxn_t, node);
-            if (!txn) {
-                goto next;
-            }
+                // if IOTXN_SYNC_BEFORE, pause the port if there are transactions in flight
+                if ((txn->flags & IOTXN_SYNC_BEFORE) && port->running) {
+                    port->flags |= AHCI_PORT_FLAG_SYNC_PAUSED;
+                    break;
+                }
 
-            // if IOTXN_SYNC_BEFORE, pause the port if there are transactions in flight
-            if ((txn->flags & IOTXN_SYNC_BEFORE) && port->running) {
-                port->flags |= AHCI_PORT_FLAG_SYNC_PAUSED;
-                goto next;
-            }
+                // NCQ commands may share the device only with each other, and
+                // other commands go one at a time.
+                sata_pdata_t* pdata = sata_iotxn_pdata(txn);
+                if (ahci_use_ncq(dev, pdata) ? (port->running & ~port->queued) : port->running) {
+                    break;
+                }
 
-            // find a free command tag
-            sata_pdata_t* pdata = sata_iotxn_pdata(txn);
-            int max = MIN(pdata->max_cmd, (int)((dev->cap >> 8) & 0x1f));
-            int i = 0;
-            for (i = 0; i <= max; i++) {
-                if (!ahci_port_cmd_busy(port, i)) break;
-            }
-            if (i > max) {
-                goto next;
-            }
+                // find a free command tag
+                int max = MIN(pdata->max_cmd, (int)((dev->cap >> 8) & 0x1f));
+                uint32_t slots = (max == AHCI_MAX_COMMANDS - 1) ? ~0u : ((1u << (max + 1)) - 1);
+                if (!(slots & ~busy)) {
+                    break;
+                }
+                int slot = __builtin_ctz(slots & ~busy);
+                busy |= 1u << slot;
 
-            list_delete(&txn->node);
-            // if IOTXN_SYNC_AFTER, pause the port until this command is complete
-            if (txn->flags & IOTXN_SYNC_AFTER) {
-                port->flags |= AHCI_PORT_FLAG_SYNC_PAUSED;
+                list_delete(&txn->node);
+                // if IOTXN_SYNC_AFTER, pause the port until this command is complete
+                if (txn->flags & IOTXN_SYNC_AFTER) {
+                    port->flags |= AHCI_PORT_FLAG_SYNC_PAUSED;
+                }
+                // run the command
+                ahci_do_txn(dev, port, slot, txn);
             }
-            // run the command
-            ahci_do_txn(dev, port, i, txn);
 next:
             mtx_unlock(&port->lock);
         }
@@ -548,6 +599,7 @@ static int ahci_watchdog_thread(void* arg) {
                         // time out
                         printf("ahci: txn time out on port %d txn %p\n", port->nr, txn);
                         port->running &= ~(1 << slot);
+                        port->queued &= ~(1 << slot);
                         port->commands[slot] = NULL;
                         mtx_unlock(&port->lock);
                         iotxn_complete(txn, MX_ERR_TIMED_OUT, 0);
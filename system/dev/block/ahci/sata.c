@@ -18,6 +18,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <endian.h>
 
 #include "sata.h"
 
@@ -34,8 +35,19 @@
 #define sata_devinfo_u32(base, offs) (((uint32_t)(base)[(offs) + 1] << 16) | ((uint32_t)(base)[(offs)]))
 #define sata_devinfo_u64(base, offs) (((uint64_t)(base)[(offs) + 3] << 48) | ((uint64_t)(base)[(offs) + 2] << 32) | ((uint64_t)(base)[(offs) + 1] << 16) | ((uint32_t)(base)[(offs)]))
 
-#define SATA_FLAG_DMA   (1 << 0)
-#define SATA_FLAG_LBA48 (1 << 1)
+#define SATA_FLAG_DMA    (1 << 0)
+#define SATA_FLAG_LBA48  (1 << 1)
+#define SATA_FLAG_FUA    (1 << 2)
+#define SATA_FLAG_WCACHE (1 << 3)
+#define SATA_FLAG_TRIM   (1 << 4)
+
+// Each TRIM range is an LBA in the low 48 bits and a count of sectors in the
+// high 16, and a 512-byte block of the payload holds 64 of them.
+#define SATA_TRIM_RANGE_MAX    0xffffull
+#define SATA_TRIM_RANGES       (512 / sizeof(uint64_t))
+// However many blocks of ranges the drive takes, a single discard sends at
+// most this many; what doesn't fit is left as it is, as it may be.
+#define SATA_TRIM_MAX_BLOCKS   8
 
 typedef struct sata_device {
     mx_device_t* mxdev;
@@ -49,6 +61,11 @@ typedef struct sata_device {
 
     size_t sector_sz;
     mx_off_t capacity; // bytes
+
+    uint16_t trim_blocks; // blocks of ranges per DATA SET MANAGEMENT
+
+    // Only offers FUA writes if the drive has them.
+    block_protocol_ops_t block_ops;
 } sata_device_t;
 
 static void sata_device_identify_complete(iotxn_t* txn, void* cookie) {
@@ -128,7 +145,13 @@ static mx_status_t sata_device_identify(sata_device_t* dev, mx_device_t* control
     } else {
         xprintf(" PIO");
     }
-    dev->max_cmd = *(devinfo + SATA_DEVINFO_QUEUE_DEPTH);
+    // Without NCQ, the device takes one command at a time.
+    if (*(devinfo + SATA_DEVINFO_SATA_CAP) & (1 << 8)) {
+        dev->max_cmd = *(devinfo + SATA_DEVINFO_QUEUE_DEPTH) & 0x1f;
+        xprintf(" NCQ");
+    } else {
+        dev->max_cmd = 0;
+    }
     xprintf(" %d commands\n", dev->max_cmd + 1);
     if (cap & (1 << 9)) {
         dev->sector_sz = 512; // default
@@ -147,6 +170,22 @@ static mx_status_t sata_device_identify(sata_device_t* dev, mx_device_t* control
     } else {
         xprintf("  CHS unsupported!\n");
     }
+    if (*(devinfo + SATA_DEVINFO_CMD_ENABLED_1) & (1 << 5)) {
+        flags |= SATA_FLAG_WCACHE;
+        xprintf("  write cache");
+        if ((flags & SATA_FLAG_LBA48) && (*(devinfo + SATA_DEVINFO_CMD_SET_EXT) & (1 << 6))) {
+            flags |= SATA_FLAG_FUA;
+            xprintf(", FUA");
+        }
+        xprintf("\n");
+    }
+    if (*(devinfo + SATA_DEVINFO_DSM) & (1 << 0)) {
+        flags |= SATA_FLAG_TRIM;
+        // Drives which don't say how many blocks of ranges they take, take one.
+        uint16_t blocks = *(devinfo + SATA_DEVINFO_DSM_MAX_BLOCKS);
+        dev->trim_blocks = MIN(MAX(blocks, 1), SATA_TRIM_MAX_BLOCKS);
+        xprintf("  TRIM, %u blocks of ranges\n", blocks);
+    }
     dev->flags = flags;
 
     return MX_OK;
@@ -156,20 +195,117 @@ static mx_status_t sata_device_identify(sata_device_t* dev, mx_device_t* control
 
 static mx_protocol_device_t sata_device_proto;
 
+static void sata_trim_complete(iotxn_t* trim, void* cookie) {
+    iotxn_t* txn = cookie;
+    iotxn_complete(txn, trim->status, 0);
+    iotxn_release(trim);
+}
+
+// A discard becomes a DATA SET MANAGEMENT command whose data is the list of
+// ranges to trim. It isn't a queued command, so like a flush, it waits for
+// what is in flight to finish.
+static void sata_trim(sata_device_t* device, iotxn_t* txn) {
+    if ((txn->offset % device->sector_sz) || (txn->length % device->sector_sz)) {
+        iotxn_complete(txn, MX_ERR_INVALID_ARGS, 0);
+        return;
+    }
+    if ((txn->offset >= device->capacity) || (txn->length > (device->capacity - txn->offset))) {
+        iotxn_complete(txn, MX_ERR_OUT_OF_RANGE, 0);
+        return;
+    }
+
+    uint64_t lba = txn->offset / device->sector_sz;
+    uint64_t count = txn->length / device->sector_sz;
+    uint64_t ranges = MIN((count + SATA_TRIM_RANGE_MAX - 1) / SATA_TRIM_RANGE_MAX,
+                          device->trim_blocks * SATA_TRIM_RANGES);
+    if (!(device->flags & SATA_FLAG_TRIM) || (ranges == 0)) {
+        iotxn_complete(txn, MX_OK, 0);
+        return;
+    }
+    uint16_t blocks = (ranges + SATA_TRIM_RANGES - 1) / SATA_TRIM_RANGES;
+
+    iotxn_t* trim;
+    mx_status_t status = iotxn_alloc(&trim, IOTXN_ALLOC_CONTIGUOUS, blocks * 512);
+    if (status != MX_OK) {
+        iotxn_complete(txn, status, 0);
+        return;
+    }
+    // Unused entries are left zero, which the drive ignores.
+    uint64_t entries[SATA_TRIM_RANGES];
+    for (uint16_t b = 0; b < blocks; b++) {
+        memset(entries, 0, sizeof(entries));
+        for (size_t i = 0; (i < SATA_TRIM_RANGES) && (count != 0); i++) {
+            uint64_t n = MIN(count, SATA_TRIM_RANGE_MAX);
+            entries[i] = htole64((n << 48) | lba);
+            lba += n;
+            count -= n;
+        }
+        iotxn_copyto(trim, entries, sizeof(entries), b * sizeof(entries));
+    }
+
+    sata_pdata_t* pdata = sata_iotxn_pdata(trim);
+    pdata->cmd = SATA_CMD_DATA_SET_MANAGEMENT;
+    pdata->feature = SATA_DSM_TRIM;
+    pdata->device = 0x40;
+    pdata->lba = 0;
+    pdata->count = blocks;
+    pdata->max_cmd = device->max_cmd;
+    pdata->port = device->port;
+    trim->opcode = IOTXN_OP_WRITE;
+    trim->length = blocks * 512;
+    trim->complete_cb = sata_trim_complete;
+    trim->cookie = txn;
+    iotxn_queue(device->parent, trim);
+}
+
 static void sata_iotxn_queue(void* ctx, iotxn_t* txn) {
     sata_device_t* device = ctx;
+    sata_pdata_t* pdata = sata_iotxn_pdata(txn);
+
+    if (txn->opcode == IOTXN_OP_FLUSH) {
+        // FLUSH CACHE isn't a queued command, so it runs with nothing else in
+        // flight. Drives without a write cache have nothing to flush.
+        if (!(device->flags & SATA_FLAG_WCACHE)) {
+            iotxn_complete(txn, MX_OK, 0);
+            return;
+        }
+        txn->flags |= IOTXN_SYNC_BEFORE | IOTXN_SYNC_AFTER;
+        txn->length = 0;
+        pdata->cmd = SATA_CMD_FLUSH_EXT;
+        pdata->device = 0x40;
+        pdata->lba = 0;
+        pdata->count = 0;
+        pdata->max_cmd = device->max_cmd;
+        pdata->port = device->port;
+        iotxn_queue(device->parent, txn);
+        return;
+    }
+    if (txn->opcode == IOTXN_OP_DISCARD) {
+        sata_trim(device, txn);
+        return;
+    }
 
     // offset must be aligned to block size
     if (txn->offset % device->sector_sz) {
         iotxn_complete(txn, MX_ERR_INVALID_ARGS, 0);
         return;
     }
+    if ((txn->flags & IOTXN_FUA) && (txn->opcode == IOTXN_OP_WRITE) &&
+        !(device->flags & SATA_FLAG_FUA) && (device->flags & SATA_FLAG_WCACHE)) {
+        iotxn_complete(txn, MX_ERR_NOT_SUPPORTED, 0);
+        return;
+    }
 
     // constrain to device capacity and round down to block aligned
     txn->length = MIN(ROUNDDOWN(txn->length, device->sector_sz), device->capacity - txn->offset);
 
-    sata_pdata_t* pdata = sata_iotxn_pdata(txn);
-    pdata->cmd = txn->opcode == IOTXN_OP_READ ? SATA_CMD_READ_DMA_EXT : SATA_CMD_WRITE_DMA_EXT;
+    if (txn->opcode == IOTXN_OP_READ) {
+        pdata->cmd = SATA_CMD_READ_DMA_EXT;
+    } else if ((txn->flags & IOTXN_FUA) && (device->flags & SATA_FLAG_FUA)) {
+        pdata->cmd = SATA_CMD_WRITE_DMA_FUA_EXT;
+    } else {
+        pdata->cmd = SATA_CMD_WRITE_DMA_EXT;
+    }
     pdata->device = 0x40;
     pdata->lba = txn->offset / device->sector_sz;
     pdata->count = txn->length / device->sector_sz;
@@ -188,6 +324,9 @@ static void sata_get_info(sata_device_t* dev, block_info_t* info) {
     info->block_size = dev->sector_sz;
     info->block_count = dev->capacity / dev->sector_sz;
     info->max_transfer_size = AHCI_MAX_PRDS * PAGE_SIZE; // fully discontiguous
+    if (dev->flags & SATA_FLAG_TRIM) {
+        info->flags |= BLOCK_FLAG_DISCARD;
+    }
 }
 
 static mx_status_t sata_ioctl(void* ctx, uint32_t op, const void* cmd, size_t cmdlen, void* reply,
@@ -214,8 +353,7 @@ static mx_status_t sata_ioctl(void* ctx, uint32_t op, const void* cmd, size_t cm
             return status;
         }
         completion_t completion = COMPLETION_INIT;
-        txn->opcode = IOTXN_OP_READ;
-        txn->flags = IOTXN_SYNC_BEFORE;
+        txn->opcode = IOTXN_OP_FLUSH;
         txn->offset = 0;
         txn->length = 0;
         txn->complete_cb = sata_sync_complete;
@@ -267,9 +405,9 @@ static void sata_block_complete(iotxn_t* txn, void* cookie) {
     iotxn_release(txn);
 }
 
-static void sata_block_txn(sata_device_t* dev, uint32_t opcode, mx_handle_t vmo,
+static void sata_block_txn(sata_device_t* dev, uint32_t opcode, uint32_t flags, mx_handle_t vmo,
                            uint64_t length, uint64_t vmo_offset, uint64_t dev_offset,
-                           void* cookie) {
+                           mx_paddr_t* phys, uint64_t phys_count, void* cookie) {
     if ((dev_offset % dev->sector_sz) || (length % dev->sector_sz)) {
         dev->callbacks->complete(cookie, MX_ERR_INVALID_ARGS);
         return;
@@ -286,7 +424,10 @@ static void sata_block_txn(sata_device_t* dev, uint32_t opcode, mx_handle_t vmo,
         return;
     }
     txn->opcode = opcode;
+    txn->flags = flags;
     txn->offset = dev_offset;
+    txn->phys = phys;
+    txn->phys_count = phys_count;
     txn->complete_cb = sata_block_complete;
     txn->cookie = cookie;
     memcpy(txn->extra, &dev, sizeof(sata_device_t*));
@@ -296,12 +437,76 @@ static void sata_block_txn(sata_device_t* dev, uint32_t opcode, mx_handle_t vmo,
 
 static void sata_block_read(void* ctx, mx_handle_t vmo, uint64_t length,
                            uint64_t vmo_offset, uint64_t dev_offset, void* cookie) {
-    sata_block_txn(ctx, IOTXN_OP_READ, vmo, length, vmo_offset, dev_offset, cookie);
+    sata_block_txn(ctx, IOTXN_OP_READ, 0, vmo, length, vmo_offset, dev_offset, NULL, 0, cookie);
 }
 
 static void sata_block_write(void* ctx, mx_handle_t vmo, uint64_t length,
                             uint64_t vmo_offset, uint64_t dev_offset, void* cookie) {
-    sata_block_txn(ctx, IOTXN_OP_WRITE, vmo, length, vmo_offset, dev_offset, cookie);
+    sata_block_txn(ctx, IOTXN_OP_WRITE, 0, vmo, length, vmo_offset, dev_offset, NULL, 0, cookie);
+}
+
+static void sata_block_read_phys(void* ctx, mx_handle_t vmo, uint64_t length,
+                                 uint64_t vmo_offset, uint64_t dev_offset,
+                                 mx_paddr_t* phys, uint64_t phys_count, void* cookie) {
+    sata_block_txn(ctx, IOTXN_OP_READ, 0, vmo, length, vmo_offset, dev_offset,
+                   phys, phys_count, cookie);
+}
+
+static void sata_block_write_phys(void* ctx, mx_handle_t vmo, uint64_t length,
+                                  uint64_t vmo_offset, uint64_t dev_offset,
+                                  mx_paddr_t* phys, uint64_t phys_count, void* cookie) {
+    sata_block_txn(ctx, IOTXN_OP_WRITE, 0, vmo, length, vmo_offset, dev_offset,
+                   phys, phys_count, cookie);
+}
+
+static void sata_block_write_fua(void* ctx, mx_handle_t vmo, uint64_t length,
+                                 uint64_t vmo_offset, uint64_t dev_offset,
+                                 mx_paddr_t* phys, uint64_t phys_count, void* cookie) {
+    sata_block_txn(ctx, IOTXN_OP_WRITE, IOTXN_FUA, vmo, length, vmo_offset, dev_offset,
+                   phys, phys_count, cookie);
+}
+
+static void sata_block_flush(void* ctx, void* cookie) {
+    sata_device_t* dev = ctx;
+    mx_status_t status;
+    iotxn_t* txn;
+    if ((status = iotxn_alloc(&txn, IOTXN_ALLOC_POOL, 0)) != MX_OK) {
+        dev->callbacks->complete(cookie, status);
+        return;
+    }
+    txn->opcode = IOTXN_OP_FLUSH;
+    txn->complete_cb = sata_block_complete;
+    txn->cookie = cookie;
+    memcpy(txn->extra, &dev, sizeof(sata_device_t*));
+
+    iotxn_queue(dev->mxdev, txn);
+}
+
+static void sata_block_discard(void* ctx, uint64_t length, uint64_t dev_offset, void* cookie) {
+    sata_device_t* dev = ctx;
+    if ((dev_offset % dev->sector_sz) || (length % dev->sector_sz)) {
+        dev->callbacks->complete(cookie, MX_ERR_INVALID_ARGS);
+        return;
+    }
+    if ((dev_offset >= dev->capacity) || (length > (dev->capacity - dev_offset))) {
+        dev->callbacks->complete(cookie, MX_ERR_OUT_OF_RANGE);
+        return;
+    }
+
+    mx_status_t status;
+    iotxn_t* txn;
+    if ((status = iotxn_alloc(&txn, IOTXN_ALLOC_POOL, 0)) != MX_OK) {
+        dev->callbacks->complete(cookie, status);
+        return;
+    }
+    txn->opcode = IOTXN_OP_DISCARD;
+    txn->offset = dev_offset;
+    txn->length = length;
+    txn->complete_cb = sata_block_complete;
+    txn->cookie = cookie;
+    memcpy(txn->extra, &dev, sizeof(sata_device_t*));
+
+    iotxn_queue(dev->mxdev, txn);
 }
 
 static block_protocol_ops_t sata_block_ops = {
@@ -309,6 +514,11 @@ static block_protocol_ops_t sata_block_ops = {
     .get_info = sata_block_get_info,
     .read = sata_block_read,
     .write = sata_block_write,
+    .read_phys = sata_block_read_phys,
+    .write_phys = sata_block_write_phys,
+    .flush = sata_block_flush,
+    .write_fua = sata_block_write_fua,
+    .discard = sata_block_discard,
 };
 
 mx_status_t sata_bind(mx_device_t* dev, int port) {
@@ -332,6 +542,14 @@ mx_status_t sata_bind(mx_device_t* dev, int port) {
         return status;
     }
 
+    device->block_ops = sata_block_ops;
+    if (!(device->flags & SATA_FLAG_FUA)) {
+        device->block_ops.write_fua = NULL;
+    }
+    if (!(device->flags & SATA_FLAG_TRIM)) {
+        device->block_ops.discard = NULL;
+    }
+
     // add the device
     device_add_args_t args = {
         .version = DEVICE_ADD_ARGS_VERSION,
@@ -339,7 +557,7 @@ mx_status_t sata_bind(mx_device_t* dev, int port) {
         .ctx = device,
         .ops = &sata_device_proto,
         .proto_id = MX_PROTOCOL_BLOCK_CORE,
-        .proto_ops = &sata_block_ops,
+        .proto_ops = &device->block_ops,
     };
 
     status = device_add(dev, &args, &device->mxdev);
@@ -13,6 +13,15 @@
 #define SATA_CMD_WRITE_DMA            0xca
 #define SATA_CMD_WRITE_DMA_EXT        0x35
 #define SATA_CMD_WRITE_FPDMA_QUEUED   0x61
+#define SATA_CMD_WRITE_DMA_FUA_EXT    0x3d
+#define SATA_CMD_FLUSH_EXT            0xea
+#define SATA_CMD_DATA_SET_MANAGEMENT  0x06
+
+// In the features register of DATA SET MANAGEMENT.
+#define SATA_DSM_TRIM                 0x01
+
+// In the device register of a queued write, which makes it FUA.
+#define SATA_DEVICE_FUA               0x80
 
 #define SATA_DEVINFO_SERIAL              10
 #define SATA_DEVINFO_FW_REV              23
@@ -23,10 +32,15 @@
 #define SATA_DEVINFO_SATA_CAP            76
 #define SATA_DEVINFO_SATA_CAP2           77
 #define SATA_DEVINFO_MAJOR_VERS          80
+#define SATA_DEVINFO_CMD_SET_1           82
 #define SATA_DEVINFO_CMD_SET_2           83
+#define SATA_DEVINFO_CMD_SET_EXT         84
+#define SATA_DEVINFO_CMD_ENABLED_1       85
 #define SATA_DEVINFO_LBA_CAPACITY_2      100
+#define SATA_DEVINFO_DSM_MAX_BLOCKS      105
 #define SATA_DEVINFO_SECTOR_SIZE         106
 #define SATA_DEVINFO_LOGICAL_SECTOR_SIZE 117
+#define SATA_DEVINFO_DSM                 169
 
 #define SATA_DEVINFO_SERIAL_LEN   20
 #define SATA_DEVINFO_FW_REV_LEN   8
@@ -38,7 +52,8 @@ typedef struct sata_pdata {
     uint16_t count; // in blocks
     uint8_t cmd;
     uint8_t device;
-    int max_cmd;
+    uint8_t feature;
+    int max_cmd;    // highest command tag the device takes, 0 without NCQ
     int port;
 } sata_pdata_t;
 
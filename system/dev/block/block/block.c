@@ -19,6 +19,7 @@
 #include <threads.h>
 
 #include "server.h"
+#include "stats.h"
 
 typedef struct blkdev {
     mx_device_t* mxdev;
@@ -28,36 +29,75 @@ typedef struct blkdev {
     mtx_t lock;
     uint32_t threadcount;
     BlockServer* bs;
+    BlockStats* stats; // Outlives each server, which holds a reference to it.
     bool dead; // Release has been called; we should free memory and leave.
 } blkdev_t;
 
+static void blkdev_free(blkdev_t* bdev) {
+    if (bdev->stats != NULL) {
+        blockstats_release(bdev->stats);
+    }
+    free(bdev);
+}
+
+typedef struct {
+    blkdev_t* bdev;
+    BlockServer* bs;
+    uint32_t index;
+} blockserver_arg_t;
+
 static int blockserver_thread(void* arg) {
-    blkdev_t* bdev = (blkdev_t*)arg;
-    BlockServer* bs = bdev->bs;
+    blockserver_arg_t* bsarg = (blockserver_arg_t*)arg;
+    blkdev_t* bdev = bsarg->bdev;
+    BlockServer* bs = bsarg->bs;
+    uint32_t index = bsarg->index;
+    free(bsarg);
     bdev->threadcount++;
     mtx_unlock(&bdev->lock);
 
-    blockserver_serve(bs, &bdev->proto);
+    blockserver_serve(bs, &bdev->proto, index);
 
     mtx_lock(&bdev->lock);
-    if (bdev->bs == bs) {
+    // The first fifo owns the server: once it closes, so do the others.
+    if ((index == 0) && (bdev->bs == bs)) {
         // Only nullify 'bs' if no one has replaced it yet. This is the
         // case when the blockserver shuts itself down because the fifo
         // has closed.
+        blockserver_shutdown(bs);
         bdev->bs = NULL;
     }
     bdev->threadcount--;
     bool cleanup = bdev->dead & (bdev->threadcount == 0);
     mtx_unlock(&bdev->lock);
 
-    blockserver_free(bs);
+    blockserver_release(bs);
 
     if (cleanup) {
-        free(bdev);
+        blkdev_free(bdev);
     }
     return 0;
 }
 
+// Starts a thread serving fifo |index| of |bs|. On success, the thread takes
+// over the fifo's reference to the server, and holds the lock.
+static mx_status_t blkdev_start_thread_locked(blkdev_t* bdev, BlockServer* bs, uint32_t index) {
+    blockserver_arg_t* bsarg;
+    if ((bsarg = malloc(sizeof(blockserver_arg_t))) == NULL) {
+        return MX_ERR_NO_MEMORY;
+    }
+    bsarg->bdev = bdev;
+    bsarg->bs = bs;
+    bsarg->index = index;
+
+    thrd_t thread;
+    if (thrd_create(&thread, blockserver_thread, bsarg) != thrd_success) {
+        free(bsarg);
+        return MX_ERR_NO_MEMORY;
+    }
+    thrd_detach(thread);
+    return MX_OK;
+}
+
 static mx_status_t blkdev_get_fifos(blkdev_t* bdev, void* out_buf, size_t out_len) {
     if (out_len < sizeof(mx_handle_t)) {
         return MX_ERR_INVALID_ARGS;
@@ -70,21 +110,56 @@ static mx_status_t blkdev_get_fifos(blkdev_t* bdev, void* out_buf, size_t out_le
     }
 
     BlockServer* bs;
-    if ((status = blockserver_create(out_buf, &bs)) != MX_OK) {
+    if ((status = blockserver_create(out_buf, bdev->stats, &bs)) != MX_OK) {
         goto done;
     }
 
     // As soon as we launch a thread, the background thread is responsible
     // for the blockserver in the bdev->bs field.
     bdev->bs = bs;
-    thrd_t thread;
-    if (thrd_create(&thread, blockserver_thread, bdev) != thrd_success) {
-        blockserver_free(bs);
+    if ((status = blkdev_start_thread_locked(bdev, bs, 0)) != MX_OK) {
+        mx_handle_close(*(mx_handle_t*)out_buf);
+        blockserver_release(bs);
         bdev->bs = NULL;
-        status = MX_ERR_NO_MEMORY;
         goto done;
     }
-    thrd_detach(thread);
+
+    // On success, the blockserver thread holds the lock.
+    return sizeof(mx_handle_t);
+done:
+    mtx_unlock(&bdev->lock);
+    return status;
+}
+
+static mx_status_t blkdev_add_fifo(blkdev_t* bdev, const void* in_buf, size_t in_len,
+                                   void* out_buf, size_t out_len) {
+    uint32_t weight = BLOCK_FIFO_WEIGHT_DEFAULT;
+    if (in_len == sizeof(uint32_t)) {
+        weight = *(const uint32_t*)in_buf;
+    } else if (in_len != 0) {
+        return MX_ERR_INVALID_ARGS;
+    }
+    if (out_len < sizeof(mx_handle_t)) {
+        return MX_ERR_INVALID_ARGS;
+    }
+    mx_status_t status;
+    mtx_lock(&bdev->lock);
+    if (bdev->bs == NULL) {
+        status = MX_ERR_BAD_STATE;
+        goto done;
+    }
+
+    uint32_t index;
+    if ((status = blockserver_add_fifo(bdev->bs, weight, out_buf, &index)) != MX_OK) {
+        goto done;
+    }
+    if ((status = blkdev_start_thread_locked(bdev, bdev->bs, index)) != MX_OK) {
+        // The fifo is left unserved until the server shuts down, so don't
+        // hand it out.
+        mx_handle_close(*(mx_handle_t*)out_buf);
+        blockserver_release(bdev->bs);
+        goto done;
+    }
 
     // On success, the blockserver thread holds the lock.
     return sizeof(mx_handle_t);
@@ -163,6 +238,23 @@ done:
     return status;
 }
 
+static mx_status_t blkdev_get_stats(blkdev_t* bdev, void* out_buf, size_t out_len,
+                                    size_t* out_actual) {
+    if (out_len < sizeof(block_stats_t)) {
+        return MX_ERR_BUFFER_TOO_SMALL;
+    }
+    block_stats_t* stats = out_buf;
+    memset(stats, 0, sizeof(block_stats_t));
+    mtx_lock(&bdev->lock);
+    blockstats_get(bdev->stats, stats);
+    if (bdev->bs != NULL) {
+        blockserver_get_stats(bdev->bs, stats);
+    }
+    mtx_unlock(&bdev->lock);
+    *out_actual = sizeof(block_stats_t);
+    return MX_OK;
+}
+
 static mx_status_t blkdev_fifo_close_locked(blkdev_t* bdev) {
     if (bdev->bs != NULL) {
         blockserver_shutdown(bdev->bs);
@@ -181,12 +273,16 @@ static mx_status_t blkdev_ioctl(void* ctx, uint32_t op, const void* cmd,
     switch (op) {
     case IOCTL_BLOCK_GET_FIFOS:
         return blkdev_get_fifos(blkdev, reply, max);
+    case IOCTL_BLOCK_ADD_FIFO:
+        return blkdev_add_fifo(blkdev, cmd, cmdlen, reply, max);
     case IOCTL_BLOCK_ATTACH_VMO:
         return blkdev_attach_vmo(blkdev, cmd, cmdlen, reply, max, out_actual);
     case IOCTL_BLOCK_ALLOC_TXN:
         return blkdev_alloc_txn(blkdev, cmd, cmdlen, reply, max, out_actual);
     case IOCTL_BLOCK_FREE_TXN:
         return blkdev_free_txn(blkdev, cmd, cmdlen);
+    case IOCTL_BLOCK_GET_STATS:
+        return blkdev_get_stats(blkdev, reply, max, out_actual);
     case IOCTL_BLOCK_FIFO_CLOSE: {
         mtx_lock(&blkdev->lock);
         mx_status_t status = blkdev_fifo_close_locked(blkdev);
@@ -226,7 +322,7 @@ static void blkdev_release(void* ctx) {
         // Otherwise, it'll free blkdev's memory when it's done,
         // since (1) no one else can call get_fifos anymore, and
         // (2) it'll clean up when it sees that blkdev is dead.
-        free(blkdev);
+        blkdev_free(blkdev);
     }
 }
 
@@ -253,6 +349,9 @@ static mx_status_t block_driver_bind(void* ctx, mx_device_t* dev, void** cookie)
         status = MX_ERR_INTERNAL;
         goto fail;
     }
+    if ((status = blockstats_create(&bdev->stats)) != MX_OK) {
+        goto fail;
+    }
 
    device_add_args_t args = {
         .version = DEVICE_ADD_ARGS_VERSION,
@@ -270,7 +369,7 @@ static mx_status_t block_driver_bind(void* ctx, mx_device_t* dev, void** cookie)
     return MX_OK;
 
 fail:
-    free(bdev);
+    blkdev_free(bdev);
     return status;
 }
 
@@ -10,7 +10,9 @@ MODULE_TYPE := driver
 
 MODULE_SRCS := \
     $(LOCAL_DIR)/block.c \
+    $(LOCAL_DIR)/scheduler.cpp \
     $(LOCAL_DIR)/server.cpp \
+    $(LOCAL_DIR)/stats.cpp \
 
 MODULE_STATIC_LIBS := \
     system/ulib/ddk \
@@ -0,0 +1,186 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string.h>
+
+#include <magenta/syscalls.h>
+#include <mxtl/algorithm.h>
+#include <mxtl/auto_lock.h>
+
+#include "scheduler.h"
+#include "server.h"
+
+// Writes are mostly write-back, which nobody is waiting on, so they may wait
+// much longer than reads.
+constexpr mx_time_t kReadDeadline = MX_MSEC(100);
+constexpr mx_time_t kWriteDeadline = MX_SEC(1);
+
+// What each request costs on top of the bytes it moves, so that a client
+// can't get ahead with many small requests.
+constexpr uint64_t kRequestCost = 16 * 1024;
+
+IoScheduler::IoScheduler(BlockServer* server) :
+    server_(server), vclock_(0), max_transfer_(kMaxMergeBytes), in_flight_(0),
+    dispatching_(false) {
+    memset(clients_, 0, sizeof(clients_));
+    for (size_t i = 0; i < countof(clients_); i++) {
+        clients_[i].weight = BLOCK_FIFO_WEIGHT_DEFAULT;
+    }
+}
+
+void IoScheduler::SetMaxTransfer(uint64_t bytes) {
+    mxtl::AutoLock lock(&lock_);
+    max_transfer_ = (bytes == 0) ? kMaxMergeBytes : mxtl::min(bytes, kMaxMergeBytes);
+}
+
+void IoScheduler::SetWeight(uint32_t client, uint32_t weight) {
+    MX_DEBUG_ASSERT(client < countof(clients_));
+    MX_DEBUG_ASSERT(weight != 0);
+    mxtl::AutoLock lock(&lock_);
+    clients_[client].weight = weight;
+}
+
+void IoScheduler::Enqueue(uint32_t client, block_msg_t* msg) {
+    MX_DEBUG_ASSERT(client < countof(clients_));
+    bool is_read = (msg->opcode & BLOCKIO_OP_MASK) == BLOCKIO_READ;
+    msg->deadline = mx_time_get(MX_CLOCK_MONOTONIC) + (is_read ? kReadDeadline : kWriteDeadline);
+    msg->next = nullptr;
+    {
+        mxtl::AutoLock lock(&lock_);
+        Client* c = &clients_[client];
+        if (IsIdle(*c)) {
+            // Time spent idle doesn't count towards a client's share.
+            c->vtime = mxtl::max(c->vtime, vclock_);
+        }
+        Queue* q = is_read ? &c->reads : &c->writes;
+        if (q->tail == nullptr) {
+            q->head = msg;
+        } else {
+            q->tail->next = msg;
+        }
+        q->tail = msg;
+    }
+    Dispatch();
+}
+
+void IoScheduler::Complete() {
+    {
+        mxtl::AutoLock lock(&lock_);
+        MX_DEBUG_ASSERT(in_flight_ != 0);
+        in_flight_--;
+    }
+    Dispatch();
+}
+
+uint32_t IoScheduler::InFlight() {
+    mxtl::AutoLock lock(&lock_);
+    return in_flight_;
+}
+
+void IoScheduler::Dispatch() {
+    {
+        mxtl::AutoLock lock(&lock_);
+        if (dispatching_) {
+            // Whoever is dispatching sees the change before they stop.
+            return;
+        }
+        dispatching_ = true;
+    }
+    while (true) {
+        block_msg_t* msg;
+        {
+            mxtl::AutoLock lock(&lock_);
+            if ((in_flight_ == kMaxInFlight) ||
+                ((msg = PickLocked(mx_time_get(MX_CLOCK_MONOTONIC))) == nullptr)) {
+                dispatching_ = false;
+                return;
+            }
+            in_flight_++;
+        }
+        server_->Issue(msg);
+    }
+}
+
+block_msg_t* IoScheduler::PickLocked(mx_time_t now) {
+    // A request past its deadline goes first, the longest overdue of them.
+    Client* best = nullptr;
+    Queue* queue = nullptr;
+    for (size_t i = 0; i < countof(clients_); i++) {
+        Queue* queues[] = { &clients_[i].reads, &clients_[i].writes };
+        for (Queue* q : queues) {
+            if ((q->head != nullptr) && (q->head->deadline <= now) &&
+                ((queue == nullptr) || (q->head->deadline < queue->head->deadline))) {
+                best = &clients_[i];
+                queue = q;
+            }
+        }
+    }
+
+    // Otherwise the client furthest short of its share goes next.
+    if (queue == nullptr) {
+        for (size_t i = 0; i < countof(clients_); i++) {
+            if (!IsIdle(clients_[i]) && ((best == nullptr) || (clients_[i].vtime < best->vtime))) {
+                best = &clients_[i];
+            }
+        }
+        if (best == nullptr) {
+            return nullptr;
+        }
+        if (best->reads.head == nullptr) {
+            queue = &best->writes;
+        } else if (best->writes.head == nullptr) {
+            queue = &best->reads;
+        } else {
+            queue = (best->writes.head->deadline < best->reads.head->deadline) ?
+                    &best->writes : &best->reads;
+        }
+    }
+
+    block_msg_t* msg = queue->head;
+    queue->head = msg->next;
+    if (queue->head == nullptr) {
+        queue->tail = nullptr;
+    }
+    MergeLocked(queue, msg);
+
+    vclock_ = best->vtime;
+    best->vtime += (msg->io_length + kRequestCost) * BLOCK_FIFO_WEIGHT_DEFAULT / best->weight;
+    return msg;
+}
+
+void IoScheduler::MergeLocked(Queue* queue, block_msg_t* msg) {
+    msg->next = nullptr;
+    msg->io_length = msg->length;
+    block_msg_t* last = msg;
+    bool merged = msg->io_length < max_transfer_;
+    while (merged) {
+        merged = false;
+        block_msg_t* prev = nullptr;
+        uint32_t scanned = 0;
+        for (block_msg_t* m = queue->head; (m != nullptr) && (scanned < kMergeWindow);
+             prev = m, m = m->next, scanned++) {
+            if ((m->opcode != msg->opcode) || (m->flags != msg->flags) ||
+                (m->iobuf != msg->iobuf) ||
+                (m->dev_offset != msg->dev_offset + msg->io_length) ||
+                (m->vmo_offset != msg->vmo_offset + msg->io_length) ||
+                (m->length > max_transfer_ - msg->io_length)) {
+                continue;
+            }
+            if (prev == nullptr) {
+                queue->head = m->next;
+            } else {
+                prev->next = m->next;
+            }
+            if (queue->tail == m) {
+                queue->tail = prev;
+            }
+            m->next = nullptr;
+            last->next = m;
+            last = m;
+            msg->io_length += m->length;
+            merged = true;
+            break;
+        }
+    }
+}
@@ -0,0 +1,100 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <magenta/device/block.h>
+#include <magenta/thread_annotations.h>
+#include <magenta/types.h>
+#include <mxtl/mutex.h>
+
+class BlockServer;
+struct block_msg;
+typedef struct block_msg block_msg_t;
+
+// Decides the order in which the reads and writes of a BlockServer's fifos go
+// to the device, keeping a bounded number of them there at once so that the
+// rest wait here, where they can still be reordered.
+//
+// Each fifo is a client, with a weight: the device is shared between the
+// clients with requests waiting in proportion to their weights, by the bytes
+// each has had moved. Within a client, reads and writes have deadlines, reads
+// the sooner, and whichever is due first goes next. A request which waits
+// past its deadline goes ahead of every client's, so low weights are slowed
+// down rather than starved. Requests which continue where the next one to go
+// ends, in the same VMO, go with it as a single request to the device.
+class IoScheduler {
+public:
+    explicit IoScheduler(BlockServer* server);
+
+    // Caps the size of merged requests at what the device takes in one
+    // transfer; zero is no limit of the device's own.
+    void SetMaxTransfer(uint64_t bytes);
+
+    void SetWeight(uint32_t client, uint32_t weight);
+
+    // Queues a read or write, to be handed to BlockServer::Issue when its
+    // turn comes, perhaps on this thread. Requests merged into it are linked
+    // from its |next|, with |io_length| covering them all.
+    void Enqueue(uint32_t client, block_msg_t* msg);
+
+    // Called once an issued request has completed, to issue the next.
+    void Complete();
+
+    // The requests issued and not yet completed.
+    uint32_t InFlight();
+
+private:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(IoScheduler);
+
+    // Deep enough to keep every slot of an NCQ drive busy, and no deeper,
+    // so that a burst from one client doesn't bury everyone else's requests
+    // where they can't be reordered.
+    static constexpr uint32_t kMaxInFlight = 32;
+
+    // How far into a queue requests are looked for to merge, and the most
+    // bytes a merged request covers.
+    static constexpr uint32_t kMergeWindow = 16;
+    static constexpr uint64_t kMaxMergeBytes = 1 << 20;
+
+    struct Queue {
+        block_msg_t* head;
+        block_msg_t* tail;
+    };
+
+    struct Client {
+        uint32_t weight;
+        // Bytes moved, scaled by the inverse of the weight, since the client
+        // last started from even with the others.
+        uint64_t vtime;
+        Queue reads;
+        Queue writes;
+    };
+
+    static bool IsIdle(const Client& client) {
+        return (client.reads.head == nullptr) && (client.writes.head == nullptr);
+    }
+
+    // Issues requests until enough are in flight, or none are waiting. Only
+    // one thread at a time does, so that drivers may complete requests from
+    // within their read and write ops.
+    void Dispatch();
+
+    // Picks the next request, and merges what continues it.
+    block_msg_t* PickLocked(mx_time_t now) TA_REQ(lock_);
+    void MergeLocked(Queue* queue, block_msg_t* msg) TA_REQ(lock_);
+
+    BlockServer* const server_;
+
+    mxtl::Mutex lock_;
+    Client clients_[BLOCK_MAX_FIFOS] TA_GUARDED(lock_);
+    // The virtual time of the client served last, which clients with
+    // nothing waiting catch up to as they start again.
+    uint64_t vclock_ TA_GUARDED(lock_);
+    uint64_t max_transfer_ TA_GUARDED(lock_);
+    uint32_t in_flight_ TA_GUARDED(lock_);
+    bool dispatching_ TA_GUARDED(lock_);
+};
@@ -2,6 +2,7 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <limits.h>
 #include <unistd.h>
 
 #include <stdbool.h>
@@ -11,29 +12,97 @@
 #include <magenta/device/block.h>
 #include <magenta/syscalls.h>
 #include <mxalloc/new.h>
+#include <mxtl/algorithm.h>
 #include <mxtl/auto_lock.h>
 #include <mxtl/limits.h>
 #include <mxtl/ref_ptr.h>
 
 #include "server.h"
 
-static mx_status_t do_read(mx_handle_t fifo, block_fifo_request_t* requests, uint32_t* count) {
-    mx_status_t status;
-    while (true) {
-        status = mx_fifo_read(fifo, requests, sizeof(block_fifo_request_t), count);
-        if (status == MX_ERR_SHOULD_WAIT) {
-            mx_signals_t signals;
-            if ((status = mx_object_wait_one(fifo,
-                                             MX_FIFO_READABLE | MX_FIFO_PEER_CLOSED,
-                                             MX_TIME_INFINITE, &signals)) != MX_OK) {
-                return status;
-            } else if (signals & MX_FIFO_PEER_CLOSED) {
-                return MX_ERR_PEER_CLOSED;
+// Larger VMOs are left unpinned, rather than have every page of them
+// committed for as long as they're attached.
+constexpr uint64_t kMaxPinnedVmoSize = 64 * (1 << 20);
+
+// How long a fifo's thread polls a device which offers it, once there is
+// nothing to issue, before it waits for interrupts. Each completion starts
+// the window again.
+constexpr mx_time_t kPollWindow = MX_USEC(50);
+
+// Responses to send when the batch of completions they are part of ends.
+namespace {
+struct ResponseBatch {
+    static constexpr uint32_t kMaxResponses = 64;
+
+    uint32_t depth;
+    uint32_t count;
+    mx_handle_t fifos[kMaxResponses];
+    block_fifo_response_t responses[kMaxResponses];
+};
+} // namespace
+
+static thread_local ResponseBatch response_batch;
+
+static void WriteResponses(mx_handle_t fifo, const block_fifo_response_t* responses,
+                           uint32_t count) {
+    while (count > 0) {
+        uint32_t actual;
+        mx_status_t status = mx_fifo_write(fifo, responses, sizeof(block_fifo_response_t) * count,
+                                           &actual);
+        if (status != MX_OK) {
+            fprintf(stderr, "Block Server I/O error: Could not write response\n");
+            return;
+        }
+        responses += actual;
+        count -= actual;
+    }
+}
+
+// Sends the responses held back, with a single write to each fifo.
+static void FlushResponses(ResponseBatch* batch) {
+    block_fifo_response_t responses[ResponseBatch::kMaxResponses];
+    uint32_t remaining = batch->count;
+    while (remaining > 0) {
+        mx_handle_t fifo = batch->fifos[0];
+        uint32_t count = 0;
+        uint32_t kept = 0;
+        for (uint32_t i = 0; i < remaining; i++) {
+            if (batch->fifos[i] == fifo) {
+                responses[count++] = batch->responses[i];
+            } else {
+                batch->fifos[kept] = batch->fifos[i];
+                batch->responses[kept++] = batch->responses[i];
             }
-            // Try reading again...
-        } else {
-            return status;
         }
+        WriteResponses(fifo, responses, count);
+        remaining = kept;
+    }
+    batch->count = 0;
+}
+
+static void SendResponse(mx_handle_t fifo, const block_fifo_response_t& response) {
+    ResponseBatch* batch = &response_batch;
+    if (batch->depth == 0) {
+        // Don't block the block device. Respond if we can (and in the absence
+        // of an I/O error or closed remote, this should just work).
+        WriteResponses(fifo, &response, 1);
+        return;
+    }
+    if (batch->count == ResponseBatch::kMaxResponses) {
+        FlushResponses(batch);
+    }
+    batch->fifos[batch->count] = fifo;
+    batch->responses[batch->count++] = response;
+}
+
+static void blockserver_batch_begin() {
+    response_batch.depth++;
+}
+
+static void blockserver_batch_end() {
+    ResponseBatch* batch = &response_batch;
+    MX_DEBUG_ASSERT(batch->depth != 0);
+    if ((--batch->depth == 0) && (batch->count != 0)) {
+        FlushResponses(batch);
     }
 }
 
@@ -50,15 +119,21 @@ static void OutOfBandErrorRespond(mx_handle_t fifo, mx_status_t status, txnid_t
     }
 }
 
-BlockTransaction::BlockTransaction(mx_handle_t fifo, txnid_t txnid) :
-    fifo_(fifo), flags_(0), goal_(0) {
+BlockTransaction::BlockTransaction(BlockServer* server, txnid_t txnid) :
+    server_(server), allocated_(0), fifo_(MX_HANDLE_INVALID), flags_(0), goal_(0) {
+    memset(msgs_, 0, sizeof(msgs_));
     memset(&response_, 0, sizeof(response_));
     response_.txnid = txnid;
 }
 
 BlockTransaction::~BlockTransaction() {}
 
-mx_status_t BlockTransaction::Enqueue(bool do_respond, block_msg_t** msg_out) {
+bool BlockTransaction::IsBusy() {
+    mxtl::AutoLock lock(&lock_);
+    return goal_ != 0;
+}
+
+mx_status_t BlockTransaction::Enqueue(mx_handle_t fifo, bool do_respond, block_msg_t** msg_out) {
     mxtl::AutoLock lock(&lock_);
     if (flags_ & kTxnFlagRespond) {
         // Can't get more than one response for a txn
@@ -70,13 +145,16 @@ mx_status_t BlockTransaction::Enqueue(bool do_respond, block_msg_t** msg_out) {
         // clear the current block transaction.
         do_respond = true;
     }
+    if (goal_ == 0) {
+        fifo_ = fifo;
+    }
     MX_DEBUG_ASSERT(goal_ < MAX_TXN_MESSAGES); // Avoid overflowing msgs
     *msg_out = &msgs_[goal_++];
     flags_ |= do_respond ? kTxnFlagRespond : 0;
     return MX_OK;
 fail:
     if (do_respond) {
-        OutOfBandErrorRespond(fifo_, MX_ERR_IO, response_.txnid);
+        OutOfBandErrorRespond(fifo, MX_ERR_IO, response_.txnid);
     }
     return MX_ERR_IO;
 }
@@ -92,48 +170,149 @@ void BlockTransaction::Complete(block_msg_t* msg, mx_status_t status) {
     }
 
     if ((flags_ & kTxnFlagRespond) && (response_.count == goal_)) {
-        // Don't block the block device. Respond if we can (and in the absence
-        // of an I/O error or closed remote, this should just work).
-        uint32_t actual;
-        mx_status_t status = mx_fifo_write(fifo_, &response_,
-                                           sizeof(block_fifo_response_t), &actual);
-        if (status != MX_OK) {
-            fprintf(stderr, "Block Server I/O error: Could not write response\n");
-        }
+        SendResponse(fifo_, response_);
         response_.count = 0;
         response_.status = MX_OK;
         goal_ = 0;
         flags_ &= ~kTxnFlagRespond;
     }
-    msg->txn.reset();
-    msg->iobuf.reset();
+    msg->txn = nullptr;
+    msg->iobuf = nullptr;
+    msg->proto = nullptr;
+    msg->flags = 0;
+    msg->next = nullptr;
+}
+
+static bool range_within(uint64_t length, uint64_t offset, uint64_t size) {
+    return (offset <= size) && (length <= size - offset);
+}
+
+IoBuffer::IoBuffer() : state_(0), in_use_(0), pinned_length_(0) {}
+
+IoBuffer::~IoBuffer() {
+    Reset();
+}
+
+bool IoBuffer::Acquire() {
+    uint32_t state = state_.load(mxtl::memory_order_relaxed);
+    do {
+        if (!(state & kAttached)) {
+            return false;
+        }
+    } while (!state_.compare_exchange_weak(&state, state + 1, mxtl::memory_order_acquire,
+                                           mxtl::memory_order_relaxed));
+    return true;
+}
+
+void IoBuffer::Release() {
+    // Only a detached VMO can drop from one reference to none.
+    if (state_.fetch_sub(1, mxtl::memory_order_acq_rel) == 1) {
+        Reset();
+        in_use_.store(0, mxtl::memory_order_release);
+    }
 }
 
-IoBuffer::IoBuffer(mx::vmo vmo, vmoid_t id) : io_vmo_(mxtl::move(vmo)), vmoid_(id) {}
+bool IoBuffer::Detach() {
+    return state_.fetch_and(~kAttached, mxtl::memory_order_acq_rel) & kAttached;
+}
+
+void IoBuffer::Attach(mx::vmo vmo) {
+    MX_DEBUG_ASSERT(state_.load() == 0);
+    io_vmo_ = mxtl::move(vmo);
+    // Not every VMO can be pinned; those that can't are served without it.
+    Pin();
+    in_use_.store(1, mxtl::memory_order_relaxed);
+    state_.store(kAttached, mxtl::memory_order_release);
+}
 
-IoBuffer::~IoBuffer() {}
+void IoBuffer::Reset() {
+    if (pinned_length_ != 0) {
+        io_vmo_.op_range(MX_VMO_OP_UNPIN, 0, pinned_length_, nullptr, 0);
+        pinned_length_ = 0;
+    }
+    phys_.reset();
+    io_vmo_.reset();
+}
 
-mx_status_t IoBuffer::ValidateVmoHack(uint64_t length, uint64_t vmo_offset) {
+mx_status_t IoBuffer::Pin() {
     uint64_t vmo_size;
     mx_status_t status;
     if ((status = io_vmo_.get_size(&vmo_size)) != MX_OK) {
         return status;
-    } else if (length + vmo_offset > vmo_size) {
+    } else if ((vmo_size == 0) || (vmo_size > kMaxPinnedVmoSize)) {
+        return MX_ERR_NOT_SUPPORTED;
+    }
+
+    uint64_t pages = mxtl::roundup(vmo_size, static_cast<uint64_t>(PAGE_SIZE)) / PAGE_SIZE;
+    AllocChecker ac;
+    mxtl::unique_ptr<mx_paddr_t[]> phys(new (&ac) mx_paddr_t[pages]);
+    if (!ac.check()) {
+        return MX_ERR_NO_MEMORY;
+    }
+    if ((status = io_vmo_.op_range(MX_VMO_OP_PIN, 0, vmo_size, phys.get(),
+                                   pages * sizeof(mx_paddr_t))) != MX_OK) {
+        return status;
+    }
+    phys_ = mxtl::move(phys);
+    pinned_length_ = vmo_size;
+    return MX_OK;
+}
+
+mx_status_t IoBuffer::ValidateVmo(uint64_t length, uint64_t vmo_offset) const {
+    if (range_within(length, vmo_offset, pinned_length_)) {
+        return MX_OK;
+    }
+    uint64_t vmo_size;
+    mx_status_t status;
+    if ((status = io_vmo_.get_size(&vmo_size)) != MX_OK) {
+        return status;
+    } else if (!range_within(length, vmo_offset, vmo_size)) {
         return MX_ERR_INVALID_ARGS;
     }
     return MX_OK;
 }
 
+bool IoBuffer::LookupPinned(uint64_t length, uint64_t vmo_offset,
+                            mx_paddr_t** phys, uint64_t* phys_count) const {
+    if ((length == 0) || !range_within(length, vmo_offset, pinned_length_)) {
+        return false;
+    }
+    uint64_t first = vmo_offset / PAGE_SIZE;
+    uint64_t end = mxtl::roundup(vmo_offset + length, static_cast<uint64_t>(PAGE_SIZE)) / PAGE_SIZE;
+    *phys = &phys_[first];
+    *phys_count = end - first;
+    return true;
+}
+
+IoBuffer* BlockServer::GetIoBuffer(vmoid_t vmoid) const {
+    uintptr_t chunk = vmo_chunks_[vmoid / kVmoChunkSize].load(mxtl::memory_order_acquire);
+    if (chunk == 0) {
+        return nullptr;
+    }
+    return &reinterpret_cast<IoBuffer*>(chunk)[vmoid % kVmoChunkSize];
+}
+
+BlockTransaction* BlockServer::GetTxn(txnid_t txnid) const {
+    if (txnid >= MAX_TXN_COUNT) {
+        return nullptr;
+    }
+    return reinterpret_cast<BlockTransaction*>(txns_[txnid].load(mxtl::memory_order_acquire));
+}
+
 mx_status_t BlockServer::FindVmoIDLocked(vmoid_t* out) {
+    auto is_free = [this](vmoid_t i) {
+        IoBuffer* iobuf = GetIoBuffer(i);
+        return (iobuf == nullptr) || (iobuf->in_use_.load(mxtl::memory_order_acquire) == 0);
+    };
     for (vmoid_t i = last_id; i < mxtl::numeric_limits<vmoid_t>::max(); i++) {
-        if (!tree_.find(i).IsValid()) {
+        if (is_free(i)) {
             *out = i;
             last_id = static_cast<vmoid_t>(i + 1);
             return MX_OK;
         }
     }
     for (vmoid_t i = 0; i < last_id; i++) {
-        if (!tree_.find(i).IsValid()) {
+        if (is_free(i)) {
             *out = i;
             last_id = static_cast<vmoid_t>(i + 1);
             return MX_OK;
@@ -150,12 +329,18 @@ mx_status_t BlockServer::AttachVmo(mx::vmo vmo, vmoid_t* out) {
         return status;
     }
 
-    AllocChecker ac;
-    mxtl::RefPtr<IoBuffer> ibuf = mxtl::AdoptRef(new (&ac) IoBuffer(mxtl::move(vmo), id));
-    if (!ac.check()) {
-        return MX_ERR_NO_MEMORY;
+    IoBuffer* iobuf = GetIoBuffer(id);
+    if (iobuf == nullptr) {
+        AllocChecker ac;
+        IoBuffer* chunk = new (&ac) IoBuffer[kVmoChunkSize];
+        if (!ac.check()) {
+            return MX_ERR_NO_MEMORY;
+        }
+        vmo_chunks_[id / kVmoChunkSize].store(reinterpret_cast<uintptr_t>(chunk),
+                                              mxtl::memory_order_release);
+        iobuf = &chunk[id % kVmoChunkSize];
     }
-    tree_.insert(mxtl::move(ibuf));
+    iobuf->Attach(mxtl::move(vmo));
     *out = id;
     return MX_OK;
 }
@@ -163,39 +348,65 @@ mx_status_t BlockServer::AttachVmo(mx::vmo vmo, vmoid_t* out) {
 mx_status_t BlockServer::AllocateTxn(txnid_t* out) {
     mxtl::AutoLock server_lock(&server_lock_);
     for (size_t i = 0; i < countof(txns_); i++) {
-        if (txns_[i] == nullptr) {
-            txnid_t txnid = static_cast<txnid_t>(i);
+        txnid_t txnid = static_cast<txnid_t>(i);
+        BlockTransaction* txn = GetTxn(txnid);
+        if (txn == nullptr) {
             AllocChecker ac;
-            txns_[i] = mxtl::AdoptRef(new (&ac) BlockTransaction(fifo_.get(), txnid));
+            txn = new (&ac) BlockTransaction(this, txnid);
             if (!ac.check()) {
                 return MX_ERR_NO_MEMORY;
             }
-            *out = txnid;
-            return MX_OK;
+            txn->allocated_.store(1, mxtl::memory_order_relaxed);
+            txns_[i].store(reinterpret_cast<uintptr_t>(txn), mxtl::memory_order_release);
+        } else if (txn->IsAllocated() || txn->IsBusy()) {
+            // A freed txn can't be reused until its last messages complete.
+            continue;
+        } else {
+            txn->allocated_.store(1, mxtl::memory_order_release);
         }
+        *out = txnid;
+        return MX_OK;
     }
     return MX_ERR_NO_RESOURCES;
 }
 
 void BlockServer::FreeTxn(txnid_t txnid) {
     mxtl::AutoLock server_lock(&server_lock_);
-    if (txnid >= countof(txns_)) {
+    BlockTransaction* txn = GetTxn(txnid);
+    if (txn == nullptr) {
         return;
     }
-    MX_DEBUG_ASSERT(txns_[txnid] != nullptr);
-    txns_[txnid] = nullptr;
+    MX_DEBUG_ASSERT(txn->IsAllocated());
+    txn->allocated_.store(0, mxtl::memory_order_release);
 }
 
-mx_status_t BlockServer::Create(mx::fifo* fifo_out, BlockServer** out) {
+mx_status_t BlockServer::CreateFifoLocked(mx::fifo* fifo_out, uint32_t* index_out) {
+    if (fifo_count_ == countof(fifos_)) {
+        return MX_ERR_NO_RESOURCES;
+    }
+    mx_status_t status;
+    if ((status = mx::fifo::create(BLOCK_FIFO_MAX_DEPTH, BLOCK_FIFO_ESIZE, 0,
+                                   fifo_out, &fifos_[fifo_count_])) != MX_OK) {
+        return status;
+    }
+    *index_out = fifo_count_++;
+    return MX_OK;
+}
+
+mx_status_t BlockServer::Create(mx::fifo* fifo_out, BlockStats* stats, BlockServer** out) {
     AllocChecker ac;
-    BlockServer* bs = new (&ac) BlockServer();
+    BlockServer* bs = new (&ac) BlockServer(stats);
     if (!ac.check()) {
         return MX_ERR_NO_MEMORY;
     }
 
     mx_status_t status;
-    if ((status = mx::fifo::create(BLOCK_FIFO_MAX_DEPTH, BLOCK_FIFO_ESIZE, 0,
-                                   fifo_out, &bs->fifo_)) != MX_OK) {
+    uint32_t index;
+    {
+        mxtl::AutoLock server_lock(&bs->server_lock_);
+        status = bs->CreateFifoLocked(fifo_out, &index);
+    }
+    if (status != MX_OK) {
         delete bs;
         return status;
     }
@@ -204,28 +415,181 @@ mx_status_t BlockServer::Create(mx::fifo* fifo_out, BlockServer** out) {
     return MX_OK;
 }
 
+mx_status_t BlockServer::AddFifo(uint32_t weight, mx::fifo* fifo_out, uint32_t* index_out) {
+    if ((weight == 0) || (weight > BLOCK_FIFO_WEIGHT_MAX)) {
+        return MX_ERR_INVALID_ARGS;
+    }
+    mxtl::AutoLock server_lock(&server_lock_);
+    mx_status_t status;
+    if ((status = CreateFifoLocked(fifo_out, index_out)) != MX_OK) {
+        return status;
+    }
+    scheduler_.SetWeight(*index_out, weight);
+    refs_.fetch_add(1, mxtl::memory_order_relaxed);
+    return MX_OK;
+}
+
+void BlockServer::GetStats(block_stats_t* out) {
+    mxtl::AutoLock server_lock(&server_lock_);
+    out->client_count = fifo_count_;
+    for (uint32_t i = 0; i < fifo_count_; i++) {
+        client_stats_[i].GetClient(&out->clients[i]);
+    }
+}
+
+void BlockServer::StartStats(block_msg_t* msg, uint32_t client, mx_time_t now) {
+    msg->client = client;
+    msg->arrival = now;
+    stats_->Start();
+    client_stats_[client].Start();
+}
+
+void BlockServer::CompleteStats(const block_msg_t* msg, mx_status_t status, mx_time_t now) {
+    uint32_t op;
+    switch (msg->opcode & BLOCKIO_OP_MASK) {
+    case BLOCKIO_READ:
+        op = BLOCK_STAT_READ;
+        break;
+    case BLOCKIO_WRITE:
+        op = BLOCK_STAT_WRITE;
+        break;
+    case BLOCKIO_SYNC:
+        op = BLOCK_STAT_FLUSH;
+        break;
+    default:
+        op = BLOCK_STAT_DISCARD;
+        break;
+    }
+    mx_time_t latency = now - msg->arrival;
+    stats_->Complete(op, msg->length, latency, status);
+    client_stats_[msg->client].Complete(op, msg->length, latency, status);
+}
+
+void BlockServer::Release() {
+    if (refs_.fetch_sub(1, mxtl::memory_order_acq_rel) == 1) {
+        delete this;
+    }
+}
+
 void blockserver_fifo_complete(void* cookie, mx_status_t status) {
     block_msg_t* msg = static_cast<block_msg_t*>(cookie);
-    // Since iobuf is a RefPtr, it lives at least as long as the txn,
-    // and is not discarded underneath the block device driver.
-    MX_DEBUG_ASSERT(msg->iobuf != nullptr);
     MX_DEBUG_ASSERT(msg->txn != nullptr);
-    // Hold an extra copy of the 'txn' refptr; if we don't, and 'msg->txn' is
-    // the last copy, then when we nullify 'msg->txn' in Complete we end up
-    // trying to unlock a lock in a deleted BlockTxn.
-    auto txn = msg->txn;
-    // Pass msg to complete so 'msg->txn' can be nullified while protected
-    // by the BlockTransaction's lock.
-    txn->Complete(msg, status);
+    if ((msg->flags & kMsgFlagFlush) && (status == MX_OK)) {
+        // A FUA write the device can't do natively: the write is done, and
+        // the request completes once it has been flushed too.
+        msg->flags &= ~kMsgFlagFlush;
+        msg->proto->ops->flush(msg->proto->ctx, msg);
+        return;
+    }
+    // Once completed, 'msg' may be reused by the next request on the txn.
+    // The requests' references to their iobufs and the server, which owns
+    // the txns, are only dropped after they are done with, and the server's
+    // once the scheduler is done with it too.
+    BlockServer* bs = msg->txn->server();
+    bool scheduled = msg->flags & kMsgFlagScheduled;
+    uint32_t count = 0;
+    mx_time_t now = mx_time_get(MX_CLOCK_MONOTONIC);
+    // The requests merged into one are answered together.
+    blockserver_batch_begin();
+    while (msg != nullptr) {
+        block_msg_t* next = msg->next;
+        IoBuffer* iobuf = msg->iobuf;
+        bs->CompleteStats(msg, status, now);
+        msg->txn->Complete(msg, status);
+        if (iobuf != nullptr) {
+            iobuf->Release();
+        }
+        count++;
+        msg = next;
+    }
+    blockserver_batch_end();
+    if (scheduled) {
+        bs->scheduler_.Complete();
+    }
+    while (count-- > 0) {
+        bs->Release();
+    }
 }
 
 static block_callbacks_t cb = {
     blockserver_fifo_complete,
+    blockserver_batch_begin,
+    blockserver_batch_end,
 };
 
-mx_status_t BlockServer::Serve(block_protocol_t* proto) {
+mx_status_t BlockServer::Read(block_protocol_t* proto, mx_handle_t fifo,
+                              block_fifo_request_t* requests, uint32_t* count) {
+    mx_time_t poll_deadline = 0;
+    while (true) {
+        mx_status_t status = mx_fifo_read(fifo, requests,
+                                          sizeof(block_fifo_request_t) * BLOCK_FIFO_MAX_DEPTH,
+                                          count);
+        if (status != MX_ERR_SHOULD_WAIT) {
+            return status;
+        }
+
+        if ((proto->ops->poll != nullptr) && (scheduler_.InFlight() != 0)) {
+            mx_time_t now = mx_time_get(MX_CLOCK_MONOTONIC);
+            if (poll_deadline == 0) {
+                poll_deadline = now + kPollWindow;
+            }
+            if (now < poll_deadline) {
+                blockserver_batch_begin();
+                if (proto->ops->poll(proto->ctx) != 0) {
+                    poll_deadline = 0;
+                }
+                blockserver_batch_end();
+                // Look for new requests between polls.
+                continue;
+            }
+        }
+
+        mx_signals_t signals;
+        if ((status = mx_object_wait_one(fifo, MX_FIFO_READABLE | MX_FIFO_PEER_CLOSED,
+                                         MX_TIME_INFINITE, &signals)) != MX_OK) {
+            return status;
+        } else if (signals & MX_FIFO_PEER_CLOSED) {
+            return MX_ERR_PEER_CLOSED;
+        }
+        poll_deadline = 0;
+        // Try reading again...
+    }
+}
+
+void BlockServer::Issue(block_msg_t* msg) {
+    block_protocol_t* proto = msg->proto;
+    mx_handle_t vmo = msg->iobuf->io_vmo_.get();
+    bool is_read = (msg->opcode & BLOCKIO_OP_MASK) == BLOCKIO_READ;
+    bool fua = !is_read && (msg->opcode & BLOCKIO_FUA);
+    mx_paddr_t* phys = nullptr;
+    uint64_t phys_count = 0;
+    bool pinned = msg->iobuf->LookupPinned(msg->io_length, msg->vmo_offset, &phys, &phys_count);
+    if (fua && proto->ops->write_fua) {
+        proto->ops->write_fua(proto->ctx, vmo, msg->io_length, msg->vmo_offset,
+                              msg->dev_offset, phys, phys_count, msg);
+    } else if (proto->ops->read_phys && proto->ops->write_phys && pinned) {
+        if (is_read) {
+            proto->ops->read_phys(proto->ctx, vmo, msg->io_length, msg->vmo_offset,
+                                  msg->dev_offset, phys, phys_count, msg);
+        } else {
+            proto->ops->write_phys(proto->ctx, vmo, msg->io_length, msg->vmo_offset,
+                                   msg->dev_offset, phys, phys_count, msg);
+        }
+    } else if (is_read) {
+        proto->ops->read(proto->ctx, vmo, msg->io_length, msg->vmo_offset,
+                         msg->dev_offset, msg);
+    } else {
+        proto->ops->write(proto->ctx, vmo, msg->io_length, msg->vmo_offset,
+                          msg->dev_offset, msg);
+    }
+}
+
+mx_status_t BlockServer::Serve(block_protocol_t* proto, uint32_t index) {
 
     proto->ops->set_callbacks(proto->ctx, &cb);
+    block_info_t info;
+    proto->ops->get_info(proto->ctx, &info);
+    scheduler_.SetMaxTransfer(info.max_transfer_size);
 
     mx_status_t status;
     block_fifo_request_t requests[BLOCK_FIFO_MAX_DEPTH];
@@ -233,73 +597,129 @@ mx_status_t BlockServer::Serve(block_protocol_t* proto) {
     mx_handle_t fifo;
     {
         mxtl::AutoLock server_lock(&server_lock_);
-        fifo = fifo_.get();
+        if (index >= fifo_count_) {
+            return MX_ERR_INVALID_ARGS;
+        }
+        fifo = fifos_[index].get();
     }
     while (true) {
-        if ((status = do_read(fifo, &requests[0], &count)) != MX_OK) {
+        if ((status = Read(proto, fifo, &requests[0], &count)) != MX_OK) {
             return status;
         }
+        mx_time_t now = mx_time_get(MX_CLOCK_MONOTONIC);
 
         for (size_t i = 0; i < count; i++) {
             bool wants_reply = requests[i].opcode & BLOCKIO_TXN_END;
             txnid_t txnid = requests[i].txnid;
             vmoid_t vmoid = requests[i].vmoid;
+            uint32_t op = requests[i].opcode & BLOCKIO_OP_MASK;
 
-            mxtl::AutoLock server_lock(&server_lock_);
-            auto iobuf = tree_.find(vmoid);
-            if (!iobuf.IsValid()) {
-                // Operation which is not accessing a valid vmo
+            BlockTransaction* txn = GetTxn(txnid);
+            if ((txn == nullptr) || !txn->IsAllocated()) {
+                // Operation which is not accessing a valid txn
                 if (wants_reply) {
                     OutOfBandErrorRespond(fifo, MX_ERR_IO, txnid);
                 }
                 continue;
             }
-            if (txnid >= MAX_TXN_COUNT || txns_[txnid] == nullptr) {
-                // Operation which is not accessing a valid txn
+            // Flushes and discards are the only requests not against a VMO.
+            IoBuffer* iobuf = nullptr;
+            if ((op != BLOCKIO_SYNC) && (op != BLOCKIO_DISCARD) &&
+                (((iobuf = GetIoBuffer(vmoid)) == nullptr) || !iobuf->Acquire())) {
+                // Operation which is not accessing a valid vmo
                 if (wants_reply) {
                     OutOfBandErrorRespond(fifo, MX_ERR_IO, txnid);
                 }
                 continue;
             }
 
-            switch (requests[i].opcode & BLOCKIO_OP_MASK) {
+            switch (op) {
             case BLOCKIO_READ:
             case BLOCKIO_WRITE: {
                 block_msg_t* msg;
-                status = txns_[txnid]->Enqueue(wants_reply, &msg);
+                status = txn->Enqueue(fifo, wants_reply, &msg);
                 if (status != MX_OK) {
+                    iobuf->Release();
                     break;
                 }
+                // The request keeps its references to the iobuf (and so its
+                // pins) and the server until it completes.
                 MX_DEBUG_ASSERT(msg->txn == nullptr);
-                msg->txn = txns_[txnid];
+                msg->txn = txn;
                 MX_DEBUG_ASSERT(msg->iobuf == nullptr);
-                msg->iobuf = iobuf.CopyPointer();
+                msg->iobuf = iobuf;
+                msg->proto = proto;
+                refs_.fetch_add(1, mxtl::memory_order_relaxed);
+
+                msg->opcode = requests[i].opcode & ~BLOCKIO_TXN_END;
+                msg->length = requests[i].length;
+                msg->vmo_offset = requests[i].vmo_offset;
+                msg->dev_offset = requests[i].dev_offset;
+                StartStats(msg, index, now);
 
-                // Hack to ensure that the vmo is valid.
-                // In the future, this code will be responsible for pinning VMO pages,
-                // and the completion will be responsible for un-pinning those same pages.
-                status = iobuf->ValidateVmoHack(requests[i].length, requests[i].vmo_offset);
+                status = iobuf->ValidateVmo(msg->length, msg->vmo_offset);
                 if (status != MX_OK) {
                     cb.complete(msg, status);
                     break;
                 }
 
-                if ((requests[i].opcode & BLOCKIO_OP_MASK) == BLOCKIO_READ) {
-                    proto->ops->read(proto->ctx, iobuf->io_vmo_.get(), requests[i].length,
-                                     requests[i].vmo_offset, requests[i].dev_offset, msg);
-                } else {
-                    proto->ops->write(proto->ctx, iobuf->io_vmo_.get(), requests[i].length,
-                                      requests[i].vmo_offset, requests[i].dev_offset, msg);
+                // Devices without a flush have no write cache, so every
+                // write they complete is already durable.
+                bool fua = (op == BLOCKIO_WRITE) && (msg->opcode & BLOCKIO_FUA);
+                if (fua && !proto->ops->write_fua && proto->ops->flush) {
+                    msg->flags |= kMsgFlagFlush;
                 }
+                msg->flags |= kMsgFlagScheduled;
+                scheduler_.Enqueue(index, msg);
                 break;
             }
             case BLOCKIO_SYNC: {
-                // TODO(smklein): It might be more useful to have this on a per-vmo basis
-                fprintf(stderr, "Warning: BLOCKIO_SYNC is currently unimplemented\n");
+                block_msg_t* msg;
+                if (txn->Enqueue(fifo, wants_reply, &msg) != MX_OK) {
+                    break;
+                }
+                msg->txn = txn;
+                msg->proto = proto;
+                refs_.fetch_add(1, mxtl::memory_order_relaxed);
+                msg->opcode = BLOCKIO_SYNC;
+                msg->length = 0;
+                StartStats(msg, index, now);
+                // Flushes cover only the writes which have completed, so they
+                // gain nothing from waiting their turn in the scheduler.
+                // Devices without a flush have no write cache to flush.
+                if (proto->ops->flush) {
+                    proto->ops->flush(proto->ctx, msg);
+                } else {
+                    cb.complete(msg, MX_OK);
+                }
+                break;
+            }
+            case BLOCKIO_DISCARD: {
+                block_msg_t* msg;
+                if (txn->Enqueue(fifo, wants_reply, &msg) != MX_OK) {
+                    break;
+                }
+                msg->txn = txn;
+                msg->proto = proto;
+                refs_.fetch_add(1, mxtl::memory_order_relaxed);
+                msg->opcode = BLOCKIO_DISCARD;
+                msg->length = requests[i].length;
+                StartStats(msg, index, now);
+                // Like flushes, discards move no data, so they skip the
+                // scheduler; devices with nothing to free are done already.
+                if (proto->ops->discard) {
+                    proto->ops->discard(proto->ctx, requests[i].length, requests[i].dev_offset,
+                                        msg);
+                } else {
+                    cb.complete(msg, MX_OK);
+                }
                 break;
             }
             case BLOCKIO_CLOSE_VMO: {
-                tree_.erase(*iobuf);
+                // The VMO is closed once the last request using it, possibly
+                // on another fifo, completes.
+                iobuf->Detach();
+                iobuf->Release();
                 if (wants_reply) {
                     OutOfBandErrorRespond(fifo, MX_OK, txnid);
                 }
@@ -308,39 +728,66 @@ mx_status_t BlockServer::Serve(block_protocol_t* proto) {
             default: {
                 fprintf(stderr, "Unrecognized Block Server operation: %x\n",
                         requests[i].opcode);
+                iobuf->Release();
             }
             }
         }
     }
 }
 
-BlockServer::BlockServer() : last_id(0) {}
+BlockServer::BlockServer(BlockStats* stats) :
+    fifo_count_(0), last_id(0), refs_(1), scheduler_(this), stats_(stats) {
+    stats_->AddRef();
+    for (size_t i = 0; i < countof(vmo_chunks_); i++) {
+        vmo_chunks_[i].store(0, mxtl::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < countof(txns_); i++) {
+        txns_[i].store(0, mxtl::memory_order_relaxed);
+    }
+}
+
 BlockServer::~BlockServer() {
     ShutDown();
+    for (size_t i = 0; i < countof(vmo_chunks_); i++) {
+        delete[] reinterpret_cast<IoBuffer*>(vmo_chunks_[i].load());
+    }
+    for (size_t i = 0; i < countof(txns_); i++) {
+        delete reinterpret_cast<BlockTransaction*>(txns_[i].load());
+    }
+    stats_->Release();
 }
 
 void BlockServer::ShutDown() {
     mxtl::AutoLock server_lock(&server_lock_);
-    // Explicitly close the fifo so the server, when done dispatching
-    // requests, will stop reading and return.
-    fifo_.reset();
+    // Explicitly close the fifos so the threads serving them, when done
+    // dispatching requests, will stop reading and return.
+    for (uint32_t i = 0; i < fifo_count_; i++) {
+        fifos_[i].reset();
+    }
 }
 
 // C declarations
-mx_status_t blockserver_create(mx_handle_t* fifo_out, BlockServer** out) {
+mx_status_t blockserver_create(mx_handle_t* fifo_out, BlockStats* stats, BlockServer** out) {
     mx::fifo fifo;
-    mx_status_t status = BlockServer::Create(&fifo, out);
+    mx_status_t status = BlockServer::Create(&fifo, stats, out);
     *fifo_out = fifo.release();
     return status;
 }
 void blockserver_shutdown(BlockServer* bs) {
     bs->ShutDown();
 }
-void blockserver_free(BlockServer* bs) {
-    delete bs;
+mx_status_t blockserver_add_fifo(BlockServer* bs, uint32_t weight, mx_handle_t* fifo_out,
+                                 uint32_t* index_out) {
+    mx::fifo fifo;
+    mx_status_t status = bs->AddFifo(weight, &fifo, index_out);
+    *fifo_out = fifo.release();
+    return status;
 }
-mx_status_t blockserver_serve(BlockServer* bs, block_protocol_t* proto) {
-    return bs->Serve(proto);
+void blockserver_release(BlockServer* bs) {
+    bs->Release();
+}
+mx_status_t blockserver_serve(BlockServer* bs, block_protocol_t* proto, uint32_t index) {
+    return bs->Serve(proto, index);
 }
 mx_status_t blockserver_attach_vmo(BlockServer* bs, mx_handle_t raw_vmo, vmoid_t* out) {
     mx::vmo vmo(raw_vmo);
@@ -352,3 +799,6 @@ mx_status_t blockserver_allocate_txn(BlockServer* bs, txnid_t* out) {
 void blockserver_free_txn(BlockServer* bs, txnid_t txnid) {
     return bs->FreeTxn(txnid);
 }
+void blockserver_get_stats(BlockServer* bs, block_stats_t* out) {
+    bs->GetStats(out);
+}
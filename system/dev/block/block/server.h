@@ -13,98 +13,234 @@
 #include <magenta/thread_annotations.h>
 #include <magenta/types.h>
 
+#include "stats.h"
+
 #ifdef __cplusplus
 
 #include <mx/fifo.h>
 #include <mx/vmo.h>
-#include <mxtl/intrusive_wavl_tree.h>
+#include <mxtl/atomic.h>
 #include <mxtl/mutex.h>
-#include <mxtl/ref_counted.h>
-#include <mxtl/ref_ptr.h>
 #include <mxtl/unique_ptr.h>
 
+#include "scheduler.h"
+
 // Represents the mapping of "vmoid --> VMO"
-class IoBuffer : public mxtl::WAVLTreeContainable<mxtl::RefPtr<IoBuffer>>,
-                 public mxtl::RefCounted<IoBuffer> {
+//
+// IoBuffers are slots in a table which lives as long as the server, so that
+// the threads serving fifos can look them up without a lock. A slot is
+// reused once its VMO has been detached and every request against it has
+// completed.
+class IoBuffer {
 public:
-    vmoid_t GetKey() const { return vmoid_; }
-
-    // TODO(smklein): This function is currently labelled 'hack' since we have
-    // no way to ensure that the size of the VMO won't change in between
-    // checking it and using it.  This will require a mechanism to "pin" VMO pages.
-    mx_status_t ValidateVmoHack(uint64_t length, uint64_t vmo_offset);
-
-    IoBuffer(mx::vmo vmo, vmoid_t vmoid);
+    // Takes a reference to the VMO for a request, failing if the slot has
+    // no VMO attached.
+    bool Acquire();
+
+    // Drops a reference taken by Acquire. Dropping the last one of a
+    // detached VMO closes it and frees the slot.
+    void Release();
+
+    // Detaches the VMO; it is closed once the requests in flight against it
+    // complete. The caller must hold a reference. Returns false if the VMO
+    // was already detached.
+    bool Detach();
+
+    // Pins the pages of the VMO and records where they are, so that requests
+    // against it need neither a size check nor a page lookup. VMOs which
+    // can't be pinned are still served, the slow way.
+    mx_status_t Pin();
+
+    // Checks that a request lies within the VMO. Requests within the pinned
+    // pages can't be invalidated before they complete; for the rest, there
+    // is nothing to stop the VMO shrinking between the check and its use.
+    mx_status_t ValidateVmo(uint64_t length, uint64_t vmo_offset) const;
+
+    // If a request lies within the pinned pages, returns the physical address
+    // of each page it touches, starting with the one holding |vmo_offset|.
+    bool LookupPinned(uint64_t length, uint64_t vmo_offset,
+                      mx_paddr_t** phys, uint64_t* phys_count) const;
+
+    IoBuffer();
     ~IoBuffer();
 
 private:
     friend class BlockServer;
-    friend struct TypeWAVLTraits;
     DISALLOW_COPY_ASSIGN_AND_MOVE(IoBuffer);
 
-    const mx::vmo io_vmo_;
-    const vmoid_t vmoid_;
+    // Set while a VMO is attached; the remaining bits count references.
+    static constexpr uint32_t kAttached = 0x80000000;
+
+    // Called with the slot free, under the server lock.
+    void Attach(mx::vmo vmo);
+    void Reset();
+
+    mxtl::atomic<uint32_t> state_;
+    // Cleared once the last reference to a detached VMO is dropped. Only
+    // slots which aren't in use may be attached to.
+    mxtl::atomic<uint32_t> in_use_;
+
+    mx::vmo io_vmo_;
+
+    // Zero if the VMO isn't pinned.
+    uint64_t pinned_length_;
+    mxtl::unique_ptr<mx_paddr_t[]> phys_;
 };
 
 constexpr uint32_t kTxnFlagRespond = 0x00000001; // Should a reponse be sent when we hit goal?
 
 class BlockTransaction;
 
-typedef struct {
-    mxtl::RefPtr<BlockTransaction> txn;
-    mxtl::RefPtr<IoBuffer> iobuf;
-} block_msg_t;
+// Set on writes which are to be followed by a flush before they complete.
+constexpr uint32_t kMsgFlagFlush = 0x00000001;
+// Set on requests which went through the scheduler.
+constexpr uint32_t kMsgFlagScheduled = 0x00000002;
+
+struct block_msg {
+    BlockTransaction* txn;
+    IoBuffer* iobuf; // Null for flushes
+    block_protocol_t* proto;
+    uint32_t flags;
+
+    // The fifo the request arrived on, and when.
+    uint32_t client;
+    mx_time_t arrival;
+
+    // The request, as it arrived.
+    uint32_t opcode;
+    uint64_t length;
+    uint64_t vmo_offset;
+    uint64_t dev_offset;
+
+    // Kept by the scheduler. |next| links the queue a request waits in, and
+    // once it is issued, the requests merged into it.
+    mx_time_t deadline;
+    block_msg_t* next;
+    uint64_t io_length;
+};
+
+// Like IoBuffers, transactions are never freed while the server is running,
+// only marked as available for reuse.
+class BlockServer;
 
-class BlockTransaction : public mxtl::RefCounted<BlockTransaction> {
+class BlockTransaction {
 public:
-    BlockTransaction(mx_handle_t fifo, txnid_t txnid);
+    BlockTransaction(BlockServer* server, txnid_t txnid);
     ~BlockTransaction();
 
     // Verifies that the incoming txn does not break the Block IO fifo protocol.
     // If it is successful, sets up the response_ with the registered cookie,
     // and adds to the "goal_" counter of number of Completions that must be
     // received before the transaction is identified as successful.
-    mx_status_t Enqueue(bool do_respond, block_msg_t** msg_out);
+    //
+    // The response is sent on |fifo|, which is the one the first message of
+    // the transaction arrived on.
+    mx_status_t Enqueue(mx_handle_t fifo, bool do_respond, block_msg_t** msg_out);
 
     // Called once the transaction has completed successfully.
     void Complete(block_msg_t* msg, mx_status_t status);
+
+    bool IsAllocated() const { return allocated_.load(mxtl::memory_order_acquire) != 0; }
+    BlockServer* server() const { return server_; }
+
 private:
+    friend class BlockServer;
     DISALLOW_COPY_ASSIGN_AND_MOVE(BlockTransaction);
 
-    const mx_handle_t fifo_;
+    // Whether messages are outstanding, so the txn can't yet be reused.
+    bool IsBusy();
+
+    BlockServer* const server_;
+    mxtl::atomic<uint32_t> allocated_;
 
     mxtl::Mutex lock_;
+    mx_handle_t fifo_ TA_GUARDED(lock_);
     block_msg_t msgs_[MAX_TXN_MESSAGES] TA_GUARDED(lock_);
     block_fifo_response_t response_ TA_GUARDED(lock_); // The response to be sent back to the client
     uint32_t flags_ TA_GUARDED(lock_);
     uint32_t goal_ TA_GUARDED(lock_); // How many ops does the block device need to complete?
 };
 
+// A BlockServer serves up to BLOCK_MAX_FIFOS fifos at once, each with a
+// thread of its own, so that clients on different CPUs don't contend on a
+// single fifo. VMOs and transactions are shared between all the fifos.
+//
+// Requests look up their VMO and transaction without taking any lock;
+// only attaching VMOs and allocating transactions take the server lock.
 class BlockServer {
 public:
-    // Creates a new BlockServer
-    static mx_status_t Create(mx::fifo* fifo_out, BlockServer** out);
-
-    // Starts the BlockServer using the current thread
-    mx_status_t Serve(block_protocol_t* proto);
+    // Creates a new BlockServer, along with its first fifo. Each fifo, and
+    // each request in flight, holds a reference to the server. The server
+    // holds one to the device statistics, |stats|, which it adds to.
+    static mx_status_t Create(mx::fifo* fifo_out, BlockStats* stats, BlockServer** out);
+
+    // Adds another fifo, returning its index. It gets a share of the device
+    // in proportion to |weight| (see IoScheduler).
+    mx_status_t AddFifo(uint32_t weight, mx::fifo* fifo_out, uint32_t* index_out);
+
+    // Uses the current thread to serve the fifo at |index|, until it or the
+    // server is closed.
+    mx_status_t Serve(block_protocol_t* proto, uint32_t index);
     mx_status_t AttachVmo(mx::vmo vmo, vmoid_t* out);
     mx_status_t AllocateTxn(txnid_t* out);
     void FreeTxn(txnid_t txnid);
 
+    // Fills in the statistics of each fifo.
+    void GetStats(block_stats_t* out);
+
     void ShutDown();
 
+    // Drops a reference, deleting the server on the last.
+    void Release();
+
     ~BlockServer();
 private:
+    friend class IoScheduler;
+    friend void blockserver_fifo_complete(void* cookie, mx_status_t status);
     DISALLOW_COPY_ASSIGN_AND_MOVE(BlockServer);
-    BlockServer();
+    explicit BlockServer(BlockStats* stats);
+
+    // Counts a request against the device and its fifo as it arrives, and
+    // again as it completes.
+    void StartStats(block_msg_t* msg, uint32_t client, mx_time_t now);
+    void CompleteStats(const block_msg_t* msg, mx_status_t status, mx_time_t now);
+
+    // Hands a read or write, and those merged into it, to the device.
+    void Issue(block_msg_t* msg);
+
+    // Reads what requests there are on |fifo|, waiting for some if there are
+    // none. While requests are in flight to a device which can be polled,
+    // it is polled for a while before the thread sleeps.
+    mx_status_t Read(block_protocol_t* proto, mx_handle_t fifo,
+                     block_fifo_request_t* requests, uint32_t* count);
+
+    // VMO slots are allocated a chunk at a time, as vmoids are handed out.
+    static constexpr size_t kVmoChunkSize = 256;
+    static constexpr size_t kVmoChunkCount = (1 << (8 * sizeof(vmoid_t))) / kVmoChunkSize;
+
+    // Lock-free lookups. Return nullptr if the id has never been used.
+    IoBuffer* GetIoBuffer(vmoid_t vmoid) const;
+    BlockTransaction* GetTxn(txnid_t txnid) const;
 
     mx_status_t FindVmoIDLocked(vmoid_t* out) TA_REQ(server_lock_);
+    mx_status_t CreateFifoLocked(mx::fifo* fifo_out, uint32_t* index_out) TA_REQ(server_lock_);
 
     mxtl::Mutex server_lock_;
-    mx::fifo fifo_ TA_GUARDED(server_lock_);
-    mxtl::WAVLTree<vmoid_t, mxtl::RefPtr<IoBuffer>> tree_ TA_GUARDED(server_lock_);
-    mxtl::RefPtr<BlockTransaction> txns_[MAX_TXN_COUNT] TA_GUARDED(server_lock_);
+    mx::fifo fifos_[BLOCK_MAX_FIFOS] TA_GUARDED(server_lock_);
+    uint32_t fifo_count_ TA_GUARDED(server_lock_);
     vmoid_t last_id TA_GUARDED(server_lock_);
+
+    mxtl::atomic<uint32_t> refs_;
+
+    IoScheduler scheduler_;
+
+    BlockStats* const stats_;
+    BlockStats client_stats_[BLOCK_MAX_FIFOS];
+
+    // Written under the server lock, but read without it. Each entry is the
+    // address of an IoBuffer[kVmoChunkSize] or BlockTransaction, or zero.
+    mxtl::atomic<uintptr_t> vmo_chunks_[kVmoChunkCount];
+    mxtl::atomic<uintptr_t> txns_[MAX_TXN_COUNT];
 };
 
 #else
@@ -116,17 +252,23 @@ typedef struct BlockServer BlockServer;
 
 __BEGIN_CDECLS
 
-// Allocate a new blockserver + FIFO combo
-mx_status_t blockserver_create(mx_handle_t* fifo_out, BlockServer** out);
+// Allocate a new blockserver + FIFO combo, counting requests in |stats|
+mx_status_t blockserver_create(mx_handle_t* fifo_out, BlockStats* stats, BlockServer** out);
 
 // Shut down the blockserver. It will stop serving requests.
 void blockserver_shutdown(BlockServer* bs);
 
-// Free the memory allocated to the blockserver.
-void blockserver_free(BlockServer* bs);
+// Add another FIFO to the blockserver, with a share of the device in
+// proportion to |weight|, returning its index.
+mx_status_t blockserver_add_fifo(BlockServer* bs, uint32_t weight, mx_handle_t* fifo_out,
+                                 uint32_t* index_out);
+
+// Drop the reference one FIFO holds to the blockserver. The memory allocated
+// to the blockserver is freed once every FIFO has been released.
+void blockserver_release(BlockServer* bs);
 
-// Use the current thread to block on incoming FIFO requests.
-mx_status_t blockserver_serve(BlockServer* bs, block_protocol_t* ops);
+// Use the current thread to block on incoming requests on one FIFO.
+mx_status_t blockserver_serve(BlockServer* bs, block_protocol_t* ops, uint32_t index);
 
 // Attach an IO buffer to the Block Server
 mx_status_t blockserver_attach_vmo(BlockServer* bs, mx_handle_t vmo, vmoid_t* out);
@@ -135,4 +277,7 @@ mx_status_t blockserver_attach_vmo(BlockServer* bs, mx_handle_t vmo, vmoid_t* ou
 mx_status_t blockserver_allocate_txn(BlockServer* bs, txnid_t* out);
 void blockserver_free_txn(BlockServer* bs, txnid_t txnid);
 
+// Fill in the statistics of each FIFO of the blockserver
+void blockserver_get_stats(BlockServer* bs, block_stats_t* out);
+
 __END_CDECLS
@@ -0,0 +1,116 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string.h>
+
+#include <magenta/assert.h>
+#include <magenta/syscalls.h>
+#include <mxalloc/new.h>
+
+#include "stats.h"
+
+BlockStats::BlockStats() :
+    start_(mx_time_get(MX_CLOCK_MONOTONIC)), queue_depth_(0), max_queue_depth_(0), refs_(1) {
+    for (size_t i = 0; i < countof(ops_); i++) {
+        OpStats* stats = &ops_[i];
+        stats->ops.store(0, mxtl::memory_order_relaxed);
+        stats->bytes.store(0, mxtl::memory_order_relaxed);
+        stats->errors.store(0, mxtl::memory_order_relaxed);
+        stats->total_ns.store(0, mxtl::memory_order_relaxed);
+        stats->max_ns.store(0, mxtl::memory_order_relaxed);
+        for (size_t b = 0; b < countof(stats->latency); b++) {
+            stats->latency[b].store(0, mxtl::memory_order_relaxed);
+        }
+    }
+}
+
+void BlockStats::Start() {
+    uint32_t depth = queue_depth_.fetch_add(1, mxtl::memory_order_relaxed) + 1;
+    uint32_t max = max_queue_depth_.load(mxtl::memory_order_relaxed);
+    while ((depth > max) &&
+           !max_queue_depth_.compare_exchange_weak(&max, depth, mxtl::memory_order_relaxed,
+                                                   mxtl::memory_order_relaxed)) {
+    }
+}
+
+void BlockStats::Complete(uint32_t op, uint64_t bytes, mx_time_t latency, mx_status_t status) {
+    MX_DEBUG_ASSERT(op < countof(ops_));
+    queue_depth_.fetch_sub(1, mxtl::memory_order_relaxed);
+
+    OpStats* stats = &ops_[op];
+    stats->ops.fetch_add(1, mxtl::memory_order_relaxed);
+    stats->bytes.fetch_add(bytes, mxtl::memory_order_relaxed);
+    if (status != MX_OK) {
+        stats->errors.fetch_add(1, mxtl::memory_order_relaxed);
+    }
+    stats->total_ns.fetch_add(latency, mxtl::memory_order_relaxed);
+    uint64_t max = stats->max_ns.load(mxtl::memory_order_relaxed);
+    while ((latency > max) &&
+           !stats->max_ns.compare_exchange_weak(&max, latency, mxtl::memory_order_relaxed,
+                                                mxtl::memory_order_relaxed)) {
+    }
+
+    // The bucket is the number of bits in the latency in microseconds.
+    uint64_t us = latency / MX_USEC(1);
+    size_t bucket = (us == 0) ? 0 : 64 - __builtin_clzll(us);
+    if (bucket >= BLOCK_LATENCY_BUCKETS) {
+        bucket = BLOCK_LATENCY_BUCKETS - 1;
+    }
+    stats->latency[bucket].fetch_add(1, mxtl::memory_order_relaxed);
+}
+
+void BlockStats::GetCounts(const OpStats& stats, block_op_counts_t* out) const {
+    out->ops = stats.ops.load(mxtl::memory_order_relaxed);
+    out->bytes = stats.bytes.load(mxtl::memory_order_relaxed);
+    out->errors = stats.errors.load(mxtl::memory_order_relaxed);
+    out->total_ns = stats.total_ns.load(mxtl::memory_order_relaxed);
+}
+
+void BlockStats::GetDevice(block_stats_t* out) const {
+    out->elapsed_ns = mx_time_get(MX_CLOCK_MONOTONIC) - start_;
+    for (size_t i = 0; i < countof(ops_); i++) {
+        GetCounts(ops_[i], &out->ops[i].counts);
+        out->ops[i].max_ns = ops_[i].max_ns.load(mxtl::memory_order_relaxed);
+        for (size_t b = 0; b < countof(ops_[i].latency); b++) {
+            out->ops[i].latency[b] = ops_[i].latency[b].load(mxtl::memory_order_relaxed);
+        }
+    }
+    out->queue_depth = queue_depth_.load(mxtl::memory_order_relaxed);
+    out->max_queue_depth = max_queue_depth_.load(mxtl::memory_order_relaxed);
+}
+
+void BlockStats::GetClient(block_client_stats_t* out) const {
+    for (size_t i = 0; i < countof(ops_); i++) {
+        GetCounts(ops_[i], &out->ops[i]);
+    }
+    out->queue_depth = queue_depth_.load(mxtl::memory_order_relaxed);
+    out->max_queue_depth = max_queue_depth_.load(mxtl::memory_order_relaxed);
+}
+
+void BlockStats::AddRef() {
+    refs_.fetch_add(1, mxtl::memory_order_relaxed);
+}
+
+void BlockStats::Release() {
+    if (refs_.fetch_sub(1, mxtl::memory_order_acq_rel) == 1) {
+        delete this;
+    }
+}
+
+// C declarations
+mx_status_t blockstats_create(BlockStats** out) {
+    AllocChecker ac;
+    BlockStats* stats = new (&ac) BlockStats();
+    if (!ac.check()) {
+        return MX_ERR_NO_MEMORY;
+    }
+    *out = stats;
+    return MX_OK;
+}
+void blockstats_release(BlockStats* stats) {
+    stats->Release();
+}
+void blockstats_get(BlockStats* stats, block_stats_t* out) {
+    stats->GetDevice(out);
+}
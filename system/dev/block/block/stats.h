@@ -0,0 +1,81 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <magenta/compiler.h>
+#include <magenta/device/block.h>
+#include <magenta/types.h>
+
+#ifdef __cplusplus
+
+#include <mxtl/atomic.h>
+#include <mxtl/macros.h>
+
+// Counts the requests of a device, or of one client of its server, as they
+// arrive and complete. Requests complete on whichever thread the device
+// completes them on, so the counts are kept without a lock; a snapshot of
+// them may catch a request half counted.
+class BlockStats {
+public:
+    BlockStats();
+
+    // Notes a request arriving, so that it counts towards the queue depth
+    // until it completes.
+    void Start();
+
+    // Notes a request of kind |op| (one of BLOCK_STAT_*) completing, having
+    // taken |latency| since it arrived.
+    void Complete(uint32_t op, uint64_t bytes, mx_time_t latency, mx_status_t status);
+
+    // Statistics with and without the latency histograms.
+    void GetDevice(block_stats_t* out) const;
+    void GetClient(block_client_stats_t* out) const;
+
+    // Device statistics are shared by the device and its servers, which
+    // may outlive it; each holds a reference. The last deletes them.
+    void AddRef();
+    void Release();
+
+private:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(BlockStats);
+
+    struct OpStats {
+        mxtl::atomic<uint64_t> ops;
+        mxtl::atomic<uint64_t> bytes;
+        mxtl::atomic<uint64_t> errors;
+        mxtl::atomic<uint64_t> total_ns;
+        mxtl::atomic<uint64_t> max_ns;
+        mxtl::atomic<uint64_t> latency[BLOCK_LATENCY_BUCKETS];
+    };
+
+    void GetCounts(const OpStats& stats, block_op_counts_t* out) const;
+
+    mx_time_t start_;
+    OpStats ops_[BLOCK_STAT_COUNT];
+    mxtl::atomic<uint32_t> queue_depth_;
+    mxtl::atomic<uint32_t> max_queue_depth_;
+    mxtl::atomic<uint32_t> refs_;
+};
+
+#else
+
+typedef struct BlockStats BlockStats;
+
+#endif  // ifdef __cplusplus
+
+__BEGIN_CDECLS
+
+// Allocate the statistics of a device, holding one reference to them.
+mx_status_t blockstats_create(BlockStats** out);
+
+// Drop a reference to the statistics.
+void blockstats_release(BlockStats* stats);
+
+// Fill in the device-wide statistics of |out|, leaving the clients alone.
+void blockstats_get(BlockStats* stats, block_stats_t* out);
+
+__END_CDECLS
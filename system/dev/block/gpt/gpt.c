@@ -7,12 +7,12 @@
 #include <ddk/binding.h>
 #include <ddk/protocol/block.h>
 
+#include <gpt/gpt.h>
 #include <magenta/syscalls.h>
 #include <magenta/types.h>
 #include <magenta/listnode.h>
 #include <sys/param.h>
 #include <sync/completion.h>
-#include <lib/cksum.h>
 #include <assert.h>
 #include <inttypes.h>
 #include <fcntl.h>
@@ -23,8 +23,6 @@
 #include <limits.h>
 #include <threads.h>
 
-#include "gpt.h"
-
 #define TRACE 0
 
 #if TRACE
@@ -35,31 +33,22 @@
     } while (0)
 #endif
 
-#define TXN_SIZE 0x4000 // 128 partition entries
+#define TXN_SIZE (PARTITIONS_COUNT * GPT_ENTRY_SIZE)
 
 typedef struct gptpart_device {
     mx_device_t* mxdev;
     mx_device_t* parent;
 
-    gpt_entry_t gpt_entry;
+    gpt_partition_t gpt_entry;
 
     block_info_t info;
     block_callbacks_t* callbacks;
 
     atomic_int writercount;
-} gptpart_device_t;
 
-struct guid {
-    uint32_t data1;
-    uint16_t data2;
-    uint16_t data3;
-    uint8_t data4[8];
-};
-
-static void uint8_to_guid_string(char* dst, uint8_t* src) {
-    struct guid* guid = (struct guid*)src;
-    sprintf(dst, "%08X-%04X-%04X-%02X%02X-%02X%02X%02X%02X%02X%02X", guid->data1, guid->data2, guid->data3, guid->data4[0], guid->data4[1], guid->data4[2], guid->data4[3], guid->data4[4], guid->data4[5], guid->data4[6], guid->data4[7]);
-}
+    // Offers discard only if the parent does.
+    block_protocol_ops_t block_ops;
+} gptpart_device_t;
 
 static void utf16_to_cstring(char* dst, uint8_t* src, size_t charcount) {
     while (charcount > 0) {
@@ -71,36 +60,12 @@ static void utf16_to_cstring(char* dst, uint8_t* src, size_t charcount) {
 
 static uint64_t getsize(gptpart_device_t* dev) {
     // last LBA is inclusive
-    uint64_t lbacount = dev->gpt_entry.last_lba - dev->gpt_entry.first_lba + 1;
+    uint64_t lbacount = dev->gpt_entry.last - dev->gpt_entry.first + 1;
     return lbacount * dev->info.block_size;
 }
 
 static mx_off_t to_parent_offset(gptpart_device_t* dev, mx_off_t offset) {
-    return offset + dev->gpt_entry.first_lba * dev->info.block_size;
-}
-
-static bool validate_header(const gpt_t* header, const block_info_t* info) {
-    if (header->size > sizeof(gpt_t)) {
-        xprintf("gpt: invalid header size\n");
-        return false;
-    }
-    gpt_t copy;
-    memcpy(&copy, header, sizeof(gpt_t));
-    copy.crc32 = 0;
-    uint32_t crc = crc32(0, (const unsigned char*)&copy, copy.size);
-    if (crc != header->crc32) {
-        xprintf("gpt: header crc invalid\n");
-        return false;
-    }
-    if (header->last_lba >= info->block_count) {
-        xprintf("gpt: last block > block count\n");
-        return false;
-    }
-    if (header->entries_count * header->entries_sz > TXN_SIZE) {
-        xprintf("gpt: entry table too big\n");
-        return false;
-    }
-    return true;
+    return offset + dev->gpt_entry.first * dev->info.block_size;
 }
 
 // implement device protocol:
@@ -151,6 +116,11 @@ static mx_status_t gpt_ioctl(void* ctx, uint32_t op, const void* cmd, size_t cmd
 
 static void gpt_iotxn_queue(void* ctx, iotxn_t* txn) {
     gptpart_device_t* device = ctx;
+    if (txn->opcode == IOTXN_OP_FLUSH) {
+        // The whole disk's cache is flushed, not only this partition's part
+        iotxn_queue(device->parent, txn);
+        return;
+    }
     if (txn->offset % device->info.block_size) {
         iotxn_complete(txn, MX_ERR_INVALID_ARGS, 0);
         return;
@@ -235,7 +205,7 @@ static void gpt_block_complete(iotxn_t* txn, void* cookie) {
     iotxn_release(txn);
 }
 
-static void block_do_txn(gptpart_device_t* dev, uint32_t opcode, mx_handle_t vmo, uint64_t length, uint64_t vmo_offset, uint64_t dev_offset, void* cookie) {
+static void block_do_txn(gptpart_device_t* dev, uint32_t opcode, mx_handle_t vmo, uint64_t length, uint64_t vmo_offset, uint64_t dev_offset, mx_paddr_t* phys, uint64_t phys_count, void* cookie) {
     block_info_t* info = &dev->info;
     if ((dev_offset % info->block_size) || (length % info->block_size)) {
         dev->callbacks->complete(cookie, MX_ERR_INVALID_ARGS);
@@ -256,6 +226,8 @@ static void block_do_txn(gptpart_device_t* dev, uint32_t opcode, mx_handle_t vmo
     txn->opcode = opcode;
     txn->length = length;
     txn->offset = to_parent_offset(dev, dev_offset);
+    txn->phys = phys;
+    txn->phys_count = phys_count;
     txn->complete_cb = gpt_block_complete;
     txn->cookie = cookie;
     memcpy(txn->extra, &dev, sizeof(gptpart_device_t*));
@@ -263,11 +235,64 @@ static void block_do_txn(gptpart_device_t* dev, uint32_t opcode, mx_handle_t vmo
 }
 
 static void gpt_block_read(void* ctx, mx_handle_t vmo, uint64_t length, uint64_t vmo_offset, uint64_t dev_offset, void* cookie) {
-    block_do_txn(ctx, IOTXN_OP_READ, vmo, length, vmo_offset, dev_offset, cookie);
+    block_do_txn(ctx, IOTXN_OP_READ, vmo, length, vmo_offset, dev_offset, NULL, 0, cookie);
 }
 
 static void gpt_block_write(void* ctx, mx_handle_t vmo, uint64_t length, uint64_t vmo_offset, uint64_t dev_offset, void* cookie) {
-    block_do_txn(ctx, IOTXN_OP_WRITE, vmo, length, vmo_offset, dev_offset, cookie);
+    block_do_txn(ctx, IOTXN_OP_WRITE, vmo, length, vmo_offset, dev_offset, NULL, 0, cookie);
+}
+
+// The parent's transaction is against the same VMO range, so the pages the
+// caller looked up are passed straight through.
+static void gpt_block_read_phys(void* ctx, mx_handle_t vmo, uint64_t length, uint64_t vmo_offset, uint64_t dev_offset, mx_paddr_t* phys, uint64_t phys_count, void* cookie) {
+    block_do_txn(ctx, IOTXN_OP_READ, vmo, length, vmo_offset, dev_offset, phys, phys_count, cookie);
+}
+
+static void gpt_block_write_phys(void* ctx, mx_handle_t vmo, uint64_t length, uint64_t vmo_offset, uint64_t dev_offset, mx_paddr_t* phys, uint64_t phys_count, void* cookie) {
+    block_do_txn(ctx, IOTXN_OP_WRITE, vmo, length, vmo_offset, dev_offset, phys, phys_count, cookie);
+}
+
+static void gpt_block_flush(void* ctx, void* cookie) {
+    gptpart_device_t* dev = ctx;
+    mx_status_t status;
+    iotxn_t* txn;
+    if ((status = iotxn_alloc(&txn, IOTXN_ALLOC_POOL, 0)) != MX_OK) {
+        dev->callbacks->complete(cookie, status);
+        return;
+    }
+    txn->opcode = IOTXN_OP_FLUSH;
+    txn->complete_cb = gpt_block_complete;
+    txn->cookie = cookie;
+    memcpy(txn->extra, &dev, sizeof(gptpart_device_t*));
+    iotxn_queue(dev->parent, txn);
+}
+
+static void gpt_block_discard(void* ctx, uint64_t length, uint64_t dev_offset, void* cookie) {
+    gptpart_device_t* dev = ctx;
+    block_info_t* info = &dev->info;
+    if ((dev_offset % info->block_size) || (length % info->block_size)) {
+        dev->callbacks->complete(cookie, MX_ERR_INVALID_ARGS);
+        return;
+    }
+    uint64_t size = getsize(dev);
+    if ((dev_offset >= size) || (length > (size - dev_offset))) {
+        dev->callbacks->complete(cookie, MX_ERR_OUT_OF_RANGE);
+        return;
+    }
+
+    mx_status_t status;
+    iotxn_t* txn;
+    if ((status = iotxn_alloc(&txn, IOTXN_ALLOC_POOL, 0)) != MX_OK) {
+        dev->callbacks->complete(cookie, status);
+        return;
+    }
+    txn->opcode = IOTXN_OP_DISCARD;
+    txn->length = length;
+    txn->offset = to_parent_offset(dev, dev_offset);
+    txn->complete_cb = gpt_block_complete;
+    txn->cookie = cookie;
+    memcpy(txn->extra, &dev, sizeof(gptpart_device_t*));
+    iotxn_queue(dev->parent, txn);
 }
 
 static block_protocol_ops_t gpt_block_ops = {
@@ -275,6 +300,10 @@ static block_protocol_ops_t gpt_block_ops = {
     .get_info = gpt_block_get_info,
     .read = gpt_block_read,
     .write = gpt_block_write,
+    .read_phys = gpt_block_read_phys,
+    .write_phys = gpt_block_write_phys,
+    .flush = gpt_block_flush,
+    .discard = gpt_block_discard,
 };
 
 static void gpt_read_sync_complete(iotxn_t* txn, void* cookie) {
@@ -301,14 +330,11 @@ static int gpt_bind_thread(void* arg) {
         goto unbind;
     }
 
-    // sanity check the default txn size with the block size
-    if (TXN_SIZE % block_info.block_size) {
-        xprintf("gpt: default txn size=%d is not aligned to blksize=%u!\n", TXN_SIZE,
-                block_info.block_size);
-    }
-
-    // allocate an iotxn to read the partition table
-    mx_status_t status = iotxn_alloc(&txn, IOTXN_ALLOC_CONTIGUOUS, TXN_SIZE);
+    // The table nearly always starts at LBA 2, right after the header, so
+    // read both at once and only go back for the table if it's elsewhere.
+    size_t table_blocks = ROUNDUP(TXN_SIZE, block_info.block_size) / block_info.block_size;
+    size_t read_sz = (1 + table_blocks) * block_info.block_size;
+    mx_status_t status = iotxn_alloc(&txn, IOTXN_ALLOC_CONTIGUOUS, read_sz);
     if (status != MX_OK) {
         xprintf("gpt: error %d allocating iotxn\n", status);
         goto unbind;
@@ -316,77 +342,75 @@ static int gpt_bind_thread(void* arg) {
 
     completion_t completion = COMPLETION_INIT;
 
-    // read partition table header synchronously (LBA1)
     txn->opcode = IOTXN_OP_READ;
     txn->offset = block_info.block_size;
-    txn->length = block_info.block_size;
+    txn->length = MIN(read_sz, (block_info.block_count - 1) * block_info.block_size);
     txn->complete_cb = gpt_read_sync_complete;
     txn->cookie = &completion;
 
     iotxn_queue(dev, txn);
     completion_wait(&completion, MX_TIME_INFINITE);
 
-    if (txn->status != MX_OK) {
+    if ((txn->status != MX_OK) || (txn->actual < block_info.block_size)) {
         xprintf("gpt: error %d reading partition header\n", txn->status);
         goto unbind;
     }
 
     // read the header
-    gpt_t header;
-    iotxn_copyfrom(txn, &header, sizeof(gpt_t), 0);
-    if (header.magic != GPT_MAGIC) {
-        xprintf("gpt: bad header magic\n");
-        goto unbind;
-    }
-
-    if (!validate_header(&header, &block_info)) {
+    gpt_header_t header;
+    iotxn_copyfrom(txn, &header, MIN(sizeof(header), block_info.block_size), 0);
+    size_t table_sz;
+    if ((status = gpt_header_validate(&header, block_info.block_size,
+                                      block_info.block_count, &table_sz)) != MX_OK) {
+        xprintf("gpt: invalid header (%d)\n", status);
         goto unbind;
     }
 
     xprintf("gpt: found gpt header %u entries @ lba%" PRIu64 "\n", header.entries_count, header.entries);
 
-    // read partition table entries
-    size_t table_sz = header.entries_count * header.entries_sz;
-    if (table_sz > TXN_SIZE) {
-        xprintf("gpt: partition table is bigger than the iotxn!\n");
-        // FIXME read the whole partition table. ok for now because on pixel2, this is
-        // enough to read the entries that actually contain valid data
-        table_sz = TXN_SIZE;
+    gpt_partition_t entries[PARTITIONS_COUNT];
+    if ((header.entries == 2) && (txn->actual >= block_info.block_size + table_sz)) {
+        iotxn_copyfrom(txn, entries, table_sz, block_info.block_size);
+    } else {
+        txn->opcode = IOTXN_OP_READ;
+        txn->offset = header.entries * block_info.block_size;
+        txn->length = ROUNDUP(table_sz, block_info.block_size);
+        txn->complete_cb = gpt_read_sync_complete;
+        txn->cookie = &completion;
+
+        completion_reset(&completion);
+        iotxn_queue(dev, txn);
+        completion_wait(&completion, MX_TIME_INFINITE);
+
+        if ((txn->status != MX_OK) || (txn->actual < table_sz)) {
+            xprintf("gpt: error %d reading partition table\n", txn->status);
+            goto unbind;
+        }
+        iotxn_copyfrom(txn, entries, table_sz, 0);
     }
-    txn->opcode = IOTXN_OP_READ;
-    txn->offset = header.entries * block_info.block_size;
-    txn->length = table_sz;
-    txn->complete_cb = gpt_read_sync_complete;
-    txn->cookie = &completion;
-
-    completion_reset(&completion);
-    iotxn_queue(dev, txn);
-    completion_wait(&completion, MX_TIME_INFINITE);
-
-    uint8_t entries[TXN_SIZE];
-    iotxn_copyfrom(txn, entries, txn->actual, 0);
 
-    uint32_t crc = crc32(0, (const unsigned char*)entries, txn->actual);
-    if (crc != header.entries_crc) {
+    if (gpt_ptable_validate(&header, entries) != MX_OK) {
         xprintf("gpt: entries crc invalid\n");
         goto unbind;
     }
 
     uint64_t dev_block_count = block_info.block_count;
+    // Discards are only passed on to a disk which takes them.
+    block_protocol_t parent_proto;
+    bool parent_discards = (device_get_protocol(dev, MX_PROTOCOL_BLOCK_CORE, &parent_proto) == MX_OK) &&
+                           (parent_proto.ops->discard != NULL);
 
     for (partitions = 0; partitions < header.entries_count; partitions++) {
-        if (partitions * header.entries_sz > txn->actual) break;
-
         // skip over entries that look invalid
-        gpt_entry_t* entry = (gpt_entry_t*)(entries + (partitions * sizeof(gpt_entry_t)));
-        if (entry->first_lba < header.first_lba || entry->last_lba > header.last_lba) {
+        gpt_partition_t* entry = &entries[partitions];
+        if (entry->first < header.first || entry->last > header.last) {
             continue;
         }
-        if (entry->first_lba == entry->last_lba) {
+        if (entry->first == entry->last) {
             continue;
         }
-        if ((entry->last_lba - entry->first_lba + 1) > dev_block_count) {
-            xprintf("gpt: entry %u too big, last = 0x%" PRIx64 " first = 0x%" PRIx64 " block_count = 0x%" PRIx64 "\n", partitions, entry->last_lba, entry->first_lba, dev_block_count);
+        if ((entry->last - entry->first + 1) > dev_block_count) {
+            xprintf("gpt: entry %u too big, last = 0x%" PRIx64 " first = 0x%" PRIx64 " block_count = 0x%" PRIx64 "\n", partitions, entry->last, entry->first, dev_block_count);
             continue;
         }
 
@@ -397,9 +421,13 @@ static int gpt_bind_thread(void* arg) {
         }
         device->parent = dev;
 
-        memcpy(&device->gpt_entry, entry, sizeof(gpt_entry_t));
-        block_info.block_count = device->gpt_entry.last_lba - device->gpt_entry.first_lba + 1;
+        memcpy(&device->gpt_entry, entry, sizeof(gpt_partition_t));
+        block_info.block_count = device->gpt_entry.last - device->gpt_entry.first + 1;
         memcpy(&device->info, &block_info, sizeof(block_info));
+        device->block_ops = gpt_block_ops;
+        if (!parent_discards) {
+            device->block_ops.discard = NULL;
+        }
 
         char type_guid[GPT_GUID_STRLEN];
         uint8_to_guid_string(type_guid, device->gpt_entry.type);
@@ -413,7 +441,7 @@ static int gpt_bind_thread(void* arg) {
 
         xprintf("gpt: partition %u (%s) type=%s guid=%s name=%s first=0x%" PRIx64 " last=0x%" PRIx64 "\n",
                 partitions, name, type_guid, partition_guid, pname,
-                device->gpt_entry.first_lba, device->gpt_entry.last_lba);
+                device->gpt_entry.first, device->gpt_entry.last);
 
         device_add_args_t args = {
             .version = DEVICE_ADD_ARGS_VERSION,
@@ -421,7 +449,7 @@ static int gpt_bind_thread(void* arg) {
             .ctx = device,
             .ops = &gpt_proto,
             .proto_id = MX_PROTOCOL_BLOCK_CORE,
-            .proto_ops = &gpt_block_ops,
+            .proto_ops = &device->block_ops,
         };
 
         if (device_add(dev, &args, &device->mxdev) != MX_OK) {
@@ -10,7 +10,7 @@ MODULE_TYPE := driver
 
 MODULE_SRCS := $(LOCAL_DIR)/gpt.c
 
-MODULE_STATIC_LIBS := system/ulib/ddk system/ulib/sync third_party/ulib/cksum
+MODULE_STATIC_LIBS := system/ulib/ddk system/ulib/gpt system/ulib/sync third_party/ulib/cksum
 
 MODULE_LIBS := system/ulib/driver system/ulib/magenta system/ulib/c
 
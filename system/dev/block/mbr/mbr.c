@@ -70,6 +70,9 @@ typedef struct mbrpart_device {
     block_info_t info;
     block_callbacks_t* callbacks;
     atomic_int writercount;
+
+    // Offers discard only if the parent does.
+    block_protocol_ops_t block_ops;
 } mbrpart_device_t;
 
 
@@ -142,6 +145,11 @@ static mx_off_t to_parent_offset(mbrpart_device_t* dev, mx_off_t offset) {
 
 static void mbr_iotxn_queue(void* ctx, iotxn_t* txn) {
     mbrpart_device_t* dev = ctx;
+    if (txn->opcode == IOTXN_OP_FLUSH) {
+        // The whole disk's cache is flushed, not only this partition's part
+        iotxn_queue(dev->parent, txn);
+        return;
+    }
     if (txn->offset % dev->info.block_size) {
         iotxn_complete(txn, MX_ERR_INVALID_ARGS, 0);
         return;
@@ -222,7 +230,7 @@ static void mbr_block_complete(iotxn_t* txn, void* cookie) {
     iotxn_release(txn);
 }
 
-static void block_do_txn(mbrpart_device_t* dev, uint32_t opcode, mx_handle_t vmo, uint64_t length, uint64_t vmo_offset, uint64_t dev_offset, void* cookie) {
+static void block_do_txn(mbrpart_device_t* dev, uint32_t opcode, mx_handle_t vmo, uint64_t length, uint64_t vmo_offset, uint64_t dev_offset, mx_paddr_t* phys, uint64_t phys_count, void* cookie) {
     block_info_t* info = &dev->info;
     if ((dev_offset % info->block_size) || (length % info->block_size)) {
         dev->callbacks->complete(cookie, MX_ERR_INVALID_ARGS);
@@ -243,6 +251,8 @@ static void block_do_txn(mbrpart_device_t* dev, uint32_t opcode, mx_handle_t vmo
     txn->opcode = opcode;
     txn->length = length;
     txn->offset = to_parent_offset(dev, dev_offset);
+    txn->phys = phys;
+    txn->phys_count = phys_count;
     txn->complete_cb = mbr_block_complete;
     txn->cookie = cookie;
     memcpy(txn->extra, &dev, sizeof(mbrpart_device_t*));
@@ -250,11 +260,64 @@ static void block_do_txn(mbrpart_device_t* dev, uint32_t opcode, mx_handle_t vmo
 }
 
 static void mbr_block_read(void* ctx, mx_handle_t vmo, uint64_t length, uint64_t vmo_offset, uint64_t dev_offset, void* cookie) {
-    block_do_txn(ctx, IOTXN_OP_READ, vmo, length, vmo_offset, dev_offset, cookie);
+    block_do_txn(ctx, IOTXN_OP_READ, vmo, length, vmo_offset, dev_offset, NULL, 0, cookie);
 }
 
 static void mbr_block_write(void* ctx, mx_handle_t vmo, uint64_t length, uint64_t vmo_offset, uint64_t dev_offset, void* cookie) {
-    block_do_txn(ctx, IOTXN_OP_WRITE, vmo, length, vmo_offset, dev_offset, cookie);
+    block_do_txn(ctx, IOTXN_OP_WRITE, vmo, length, vmo_offset, dev_offset, NULL, 0, cookie);
+}
+
+// The parent's transaction is against the same VMO range, so the pages the
+// caller looked up are passed straight through.
+static void mbr_block_read_phys(void* ctx, mx_handle_t vmo, uint64_t length, uint64_t vmo_offset, uint64_t dev_offset, mx_paddr_t* phys, uint64_t phys_count, void* cookie) {
+    block_do_txn(ctx, IOTXN_OP_READ, vmo, length, vmo_offset, dev_offset, phys, phys_count, cookie);
+}
+
+static void mbr_block_write_phys(void* ctx, mx_handle_t vmo, uint64_t length, uint64_t vmo_offset, uint64_t dev_offset, mx_paddr_t* phys, uint64_t phys_count, void* cookie) {
+    block_do_txn(ctx, IOTXN_OP_WRITE, vmo, length, vmo_offset, dev_offset, phys, phys_count, cookie);
+}
+
+static void mbr_block_flush(void* ctx, void* cookie) {
+    mbrpart_device_t* dev = ctx;
+    mx_status_t status;
+    iotxn_t* txn;
+    if ((status = iotxn_alloc(&txn, IOTXN_ALLOC_POOL, 0)) != MX_OK) {
+        dev->callbacks->complete(cookie, status);
+        return;
+    }
+    txn->opcode = IOTXN_OP_FLUSH;
+    txn->complete_cb = mbr_block_complete;
+    txn->cookie = cookie;
+    memcpy(txn->extra, &dev, sizeof(mbrpart_device_t*));
+    iotxn_queue(dev->parent, txn);
+}
+
+static void mbr_block_discard(void* ctx, uint64_t length, uint64_t dev_offset, void* cookie) {
+    mbrpart_device_t* dev = ctx;
+    block_info_t* info = &dev->info;
+    if ((dev_offset % info->block_size) || (length % info->block_size)) {
+        dev->callbacks->complete(cookie, MX_ERR_INVALID_ARGS);
+        return;
+    }
+    uint64_t size = getsize(dev);
+    if ((dev_offset >= size) || (length > (size - dev_offset))) {
+        dev->callbacks->complete(cookie, MX_ERR_OUT_OF_RANGE);
+        return;
+    }
+
+    mx_status_t status;
+    iotxn_t* txn;
+    if ((status = iotxn_alloc(&txn, IOTXN_ALLOC_POOL, 0)) != MX_OK) {
+        dev->callbacks->complete(cookie, status);
+        return;
+    }
+    txn->opcode = IOTXN_OP_DISCARD;
+    txn->length = length;
+    txn->offset = to_parent_offset(dev, dev_offset);
+    txn->complete_cb = mbr_block_complete;
+    txn->cookie = cookie;
+    memcpy(txn->extra, &dev, sizeof(mbrpart_device_t*));
+    iotxn_queue(dev->parent, txn);
 }
 
 static block_protocol_ops_t mbr_block_ops = {
@@ -262,6 +325,10 @@ static block_protocol_ops_t mbr_block_ops = {
     .get_info = mbr_block_get_info,
     .read = mbr_block_read,
     .write = mbr_block_write,
+    .read_phys = mbr_block_read_phys,
+    .write_phys = mbr_block_write_phys,
+    .flush = mbr_block_flush,
+    .discard = mbr_block_discard,
 };
 
 static int mbr_bind_thread(void* arg) {
@@ -330,6 +397,11 @@ static int mbr_bind_thread(void* arg) {
         goto unbind;
     }
 
+    // Discards are only passed on to a disk which takes them.
+    block_protocol_t parent_proto;
+    bool parent_discards = (device_get_protocol(dev, MX_PROTOCOL_BLOCK_CORE, &parent_proto) == MX_OK) &&
+                           (parent_proto.ops->discard != NULL);
+
     // Parse the partitions out of the MBR.
     for (; partition_count < MBR_NUM_PARTITIONS; partition_count++) {
         mbr_partition_entry_t* entry = &mbr->partition[partition_count];
@@ -354,6 +426,10 @@ static int mbr_bind_thread(void* arg) {
         memcpy(&pdev->partition, entry, sizeof(*entry));
         block_info.block_count = pdev->partition.sector_partition_length;
         memcpy(&pdev->info, &block_info, sizeof(block_info));
+        pdev->block_ops = mbr_block_ops;
+        if (!parent_discards) {
+            pdev->block_ops.discard = NULL;
+        }
 
         char name[16];
         snprintf(name, sizeof(name), "part-%03u",partition_count);
@@ -364,7 +440,7 @@ static int mbr_bind_thread(void* arg) {
             .ctx = pdev,
             .ops = &mbr_proto,
             .proto_id = MX_PROTOCOL_BLOCK_CORE,
-            .proto_ops = &mbr_block_ops,
+            .proto_ops = &pdev->block_ops,
         };
 
         if ((st = device_add(dev, &args, &pdev->mxdev)) != MX_OK) {
@@ -0,0 +1,1118 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <ddk/binding.h>
+#include <ddk/device.h>
+#include <ddk/driver.h>
+#include <ddk/io-buffer.h>
+#include <ddk/iotxn.h>
+#include <ddk/protocol/block.h>
+#include <ddk/protocol/pci.h>
+
+#include <magenta/listnode.h>
+#include <magenta/syscalls.h>
+#include <magenta/types.h>
+#include <sync/completion.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <threads.h>
+#include <unistd.h>
+
+#include "nvme.h"
+
+// clang-format off
+#define TRACE 0
+
+#if TRACE
+#define xprintf(fmt...) printf(fmt)
+#else
+#define xprintf(fmt...) \
+    do {                \
+    } while (0)
+#endif
+
+#define HI32(val) (((val) >> 32) & 0xffffffff)
+#define LO32(val) ((val) & 0xffffffff)
+
+#define NVME_ADMIN_QUEUE_DEPTH 32
+#define NVME_IO_QUEUE_DEPTH    128 // entries in each I/O queue, if the controller takes that many
+#define NVME_MAX_IO_QUEUES     32
+
+// Admin commands are only sent while the controller is brought up, and are
+// polled for.
+#define NVME_ADMIN_TIMEOUT MX_SEC(5)
+
+// A command's PRP list is a single page. A transfer of one page less than
+// the list covers can start anywhere in a page and still fit.
+#define NVME_PRP_ENTRIES (PAGE_SIZE / sizeof(uint64_t))
+#define NVME_MAX_XFER    ((NVME_PRP_ENTRIES - 1) * PAGE_SIZE)
+// clang-format on
+
+typedef struct nvme_device nvme_device_t;
+
+typedef struct nvme_namespace {
+    mx_device_t* mxdev;
+    nvme_device_t* dev;
+
+    block_callbacks_t* callbacks;
+
+    uint32_t nsid;
+    uint32_t block_size;
+    uint64_t block_count;
+
+    // Only offers flushes if the controller has a volatile write cache.
+    block_protocol_ops_t block_ops;
+} nvme_namespace_t;
+
+typedef struct nvme_slot {
+    iotxn_t* txn;
+    // for commands which cover more than two pages
+    uint64_t* prp_list;
+    mx_paddr_t prp_list_phys;
+} nvme_slot_t;
+
+// A submission queue and the completion queue its commands complete to.
+typedef struct nvme_queue {
+    uint16_t qid;
+    uint16_t depth; // entries in each of the two queues
+    uint32_t vector;
+
+    nvme_cmd_t* sq;
+    volatile nvme_cpl_t* cq;
+    volatile uint32_t* sq_doorbell;
+    volatile uint32_t* cq_doorbell;
+    io_buffer_t buffer;
+
+    mtx_t lock;
+    uint16_t sq_tail;
+    uint16_t cq_head;
+    uint16_t cq_phase;
+
+    // A command for each submission queue entry but one, which keeps the
+    // queue from ever being full.
+    nvme_slot_t slots[NVME_IO_QUEUE_DEPTH];
+    uint16_t free_cids[NVME_IO_QUEUE_DEPTH];
+    uint16_t free_count;
+
+    // iotxns waiting for free commands, the first perhaps partly issued
+    list_node_t pending;
+} nvme_queue_t;
+
+typedef struct nvme_irq {
+    nvme_device_t* dev;
+    uint32_t vector;
+    mx_handle_t handle;
+    thrd_t thread;
+} nvme_irq_t;
+
+struct nvme_device {
+    mx_device_t* mxdev;
+
+    nvme_regs_t* regs;
+    uint64_t regs_size;
+    mx_handle_t regs_handle;
+
+    pci_protocol_t pci;
+
+    uint64_t cap;
+    mx_time_t timeout; // for the controller to become ready, or not
+    uint32_t doorbell_stride;
+    uint64_t max_xfer;
+    bool volatile_write_cache;
+
+    nvme_queue_t admin_queue;
+
+    // One queue pair per CPU, as many as the controller takes. The
+    // interrupts are shared out between them.
+    nvme_queue_t* io_queues;
+    uint32_t io_queue_count;
+    nvme_irq_t irqs[NVME_MAX_IO_QUEUES];
+    uint32_t irq_count;
+    uint32_t irq_threads; // started, of the irq_count
+
+    thrd_t init_thread;
+    bool init_started;
+    // Set on release, to stop the irq threads.
+    atomic_bool stopping;
+};
+
+// Kept in the iotxn's protocol data while it is being processed.
+typedef struct nvme_txn_data {
+    nvme_namespace_t* ns;
+    uint64_t submitted; // bytes which commands have been issued for
+    uint32_t pending;   // commands issued and not yet complete
+    mx_status_t status;
+} nvme_txn_data_t;
+
+#define nvme_iotxn_pdata(txn) iotxn_pdata(txn, nvme_txn_data_t)
+
+static uint64_t nvme_read64(const volatile uint32_t* reg) {
+    return pcie_read32(reg) | ((uint64_t)pcie_read32(reg + 1) << 32);
+}
+
+static void nvme_write64(volatile uint32_t* reg, uint64_t val) {
+    pcie_write32(reg, LO32(val));
+    pcie_write32(reg + 1, HI32(val));
+}
+
+static volatile uint32_t* nvme_doorbell(nvme_device_t* dev, uint16_t qid, bool completion) {
+    uintptr_t offset = NVME_DOORBELL_BASE + (2 * qid + (completion ? 1 : 0)) * dev->doorbell_stride;
+    return (volatile uint32_t*)((uintptr_t)dev->regs + offset);
+}
+
+static void nvme_ring_sq(nvme_queue_t* q) {
+    // the commands have to be in memory before the controller looks
+    atomic_thread_fence(memory_order_release);
+    pcie_write32(q->sq_doorbell, q->sq_tail);
+}
+
+static mx_status_t nvme_cpl_status(uint16_t status) {
+    switch (NVME_CPL_STATUS(status)) {
+    case 0:
+        return MX_OK;
+    case NVME_CPL_STATUS_LBA_RANGE:
+        return MX_ERR_OUT_OF_RANGE;
+    default:
+        return MX_ERR_IO;
+    }
+}
+
+static mx_status_t nvme_queue_init(nvme_device_t* dev, nvme_queue_t* q, uint16_t qid,
+                                   uint16_t depth) {
+    // each queue starts on a page of its own
+    size_t sq_size = ROUNDUP(depth * sizeof(nvme_cmd_t), PAGE_SIZE);
+    size_t cq_size = ROUNDUP(depth * sizeof(nvme_cpl_t), PAGE_SIZE);
+    // the admin queue only sends commands without data
+    size_t prp_size = (qid == 0) ? 0 : (depth - 1) * PAGE_SIZE;
+    mx_status_t status = io_buffer_init(&q->buffer, sq_size + cq_size + prp_size, IO_BUFFER_RW);
+    if (status != MX_OK) {
+        xprintf("nvme: error %d allocating queue %u\n", status, qid);
+        return status;
+    }
+    void* mem = io_buffer_virt(&q->buffer);
+    mx_paddr_t mem_phys = io_buffer_phys(&q->buffer);
+    memset(mem, 0, sq_size + cq_size + prp_size);
+
+    q->qid = qid;
+    q->depth = depth;
+    q->sq = mem;
+    q->cq = mem + sq_size;
+    q->sq_doorbell = nvme_doorbell(dev, qid, false);
+    q->cq_doorbell = nvme_doorbell(dev, qid, true);
+    q->sq_tail = 0;
+    q->cq_head = 0;
+    // the controller flips the phase of the entries it posts on each pass
+    q->cq_phase = NVME_CPL_PHASE;
+
+    mem += sq_size + cq_size;
+    mem_phys += sq_size + cq_size;
+    q->free_count = 0;
+    if (qid != 0) {
+        for (uint16_t cid = 0; cid < depth - 1; cid++) {
+            q->slots[cid].txn = NULL;
+            q->slots[cid].prp_list = mem + cid * PAGE_SIZE;
+            q->slots[cid].prp_list_phys = mem_phys + cid * PAGE_SIZE;
+            // hand out the lowest first
+            q->free_cids[q->free_count++] = depth - 2 - cid;
+        }
+    }
+
+    mtx_init(&q->lock, mtx_plain);
+    list_initialize(&q->pending);
+    return MX_OK;
+}
+
+// admin commands:
+
+static mx_status_t nvme_admin_cmd(nvme_device_t* dev, nvme_cmd_t* cmd, uint32_t* cdw0) {
+    nvme_queue_t* q = &dev->admin_queue;
+    cmd->cid = q->sq_tail;
+    q->sq[q->sq_tail] = *cmd;
+    q->sq_tail = (q->sq_tail + 1) % q->depth;
+    nvme_ring_sq(q);
+
+    mx_time_t deadline = mx_time_get(MX_CLOCK_MONOTONIC) + NVME_ADMIN_TIMEOUT;
+    volatile nvme_cpl_t* cpl = &q->cq[q->cq_head];
+    while ((cpl->status & NVME_CPL_PHASE) != q->cq_phase) {
+        if (mx_time_get(MX_CLOCK_MONOTONIC) > deadline) {
+            xprintf("nvme: admin command 0x%02x timed out\n", cmd->opcode);
+            return MX_ERR_TIMED_OUT;
+        }
+        usleep(100);
+    }
+    uint16_t status = cpl->status;
+    if (cdw0) {
+        *cdw0 = cpl->cdw0;
+    }
+    if (++q->cq_head == q->depth) {
+        q->cq_head = 0;
+        q->cq_phase ^= NVME_CPL_PHASE;
+    }
+    pcie_write32(q->cq_doorbell, q->cq_head);
+
+    if (NVME_CPL_STATUS(status) != 0) {
+        xprintf("nvme: admin command 0x%02x failed, status 0x%x\n", cmd->opcode,
+                NVME_CPL_STATUS(status));
+    }
+    return nvme_cpl_status(status);
+}
+
+static mx_status_t nvme_identify(nvme_device_t* dev, uint32_t cns, uint32_t nsid,
+                                 io_buffer_t* buffer) {
+    nvme_cmd_t cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.opcode = NVME_ADMIN_IDENTIFY;
+    cmd.nsid = nsid;
+    cmd.prp1 = io_buffer_phys(buffer);
+    cmd.cdw10 = cns;
+    return nvme_admin_cmd(dev, &cmd, NULL);
+}
+
+static mx_status_t nvme_create_io_queue(nvme_device_t* dev, nvme_queue_t* q) {
+    nvme_cmd_t cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.opcode = NVME_ADMIN_CREATE_CQ;
+    cmd.prp1 = io_buffer_phys(&q->buffer) + ((uintptr_t)q->cq - (uintptr_t)q->sq);
+    cmd.cdw10 = ((uint32_t)(q->depth - 1) << 16) | q->qid;
+    cmd.cdw11 = (q->vector << 16) | NVME_CQ_IRQ_ENABLED | NVME_QUEUE_PHYS_CONTIG;
+    mx_status_t status = nvme_admin_cmd(dev, &cmd, NULL);
+    if (status != MX_OK) {
+        return status;
+    }
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.opcode = NVME_ADMIN_CREATE_SQ;
+    cmd.prp1 = io_buffer_phys(&q->buffer);
+    cmd.cdw10 = ((uint32_t)(q->depth - 1) << 16) | q->qid;
+    cmd.cdw11 = ((uint32_t)q->qid << 16) | NVME_QUEUE_PHYS_CONTIG;
+    return nvme_admin_cmd(dev, &cmd, NULL);
+}
+
+// I/O queues:
+
+static mx_paddr_t nvme_page_phys(iotxn_t* txn, uint64_t page) {
+    return (txn->phys_count == 1) ? txn->phys[0] + page * PAGE_SIZE : txn->phys[page];
+}
+
+// Points the command at |length| bytes of the iotxn's buffer, from |offset|.
+static void nvme_build_prps(iotxn_t* txn, uint64_t offset, uint64_t length,
+                            nvme_slot_t* slot, nvme_cmd_t* cmd) {
+    uint64_t start = (txn->vmo_offset & (PAGE_SIZE - 1)) + offset;
+    uint64_t first = start / PAGE_SIZE;
+    uint64_t last = (start + length - 1) / PAGE_SIZE;
+    cmd->prp1 = nvme_page_phys(txn, first) + (start & (PAGE_SIZE - 1));
+    if (last == first + 1) {
+        cmd->prp2 = nvme_page_phys(txn, last);
+    } else if (last > first + 1) {
+        for (uint64_t page = first + 1; page <= last; page++) {
+            slot->prp_list[page - first - 1] = nvme_page_phys(txn, page);
+        }
+        cmd->prp2 = slot->prp_list_phys;
+    }
+}
+
+// Issues commands for as much of the iotxn as there are free commands for,
+// and returns whether that was all of it. Transfers larger than a command
+// takes are split between several.
+static bool nvme_queue_submit_locked(nvme_device_t* dev, nvme_queue_t* q, iotxn_t* txn) {
+    nvme_txn_data_t* data = nvme_iotxn_pdata(txn);
+    nvme_namespace_t* ns = data->ns;
+    do {
+        if (q->free_count == 0) {
+            return false;
+        }
+        uint16_t cid = q->free_cids[--q->free_count];
+        nvme_slot_t* slot = &q->slots[cid];
+        nvme_cmd_t* cmd = &q->sq[q->sq_tail];
+        memset(cmd, 0, sizeof(*cmd));
+        cmd->cid = cid;
+        cmd->nsid = ns->nsid;
+        if (txn->opcode == IOTXN_OP_FLUSH) {
+            cmd->opcode = NVME_CMD_FLUSH;
+        } else {
+            uint64_t length = MIN(txn->length - data->submitted, dev->max_xfer);
+            uint64_t lba = (txn->offset + data->submitted) / ns->block_size;
+            nvme_build_prps(txn, data->submitted, length, slot, cmd);
+            cmd->opcode = (txn->opcode == IOTXN_OP_READ) ? NVME_CMD_READ : NVME_CMD_WRITE;
+            cmd->cdw10 = LO32(lba);
+            cmd->cdw11 = HI32(lba);
+            cmd->cdw12 = (uint32_t)(length / ns->block_size - 1);
+            if ((txn->opcode == IOTXN_OP_WRITE) && (txn->flags & IOTXN_FUA)) {
+                cmd->cdw12 |= NVME_RW_FUA;
+            }
+            data->submitted += length;
+        }
+        slot->txn = txn;
+        data->pending++;
+        q->sq_tail = (q->sq_tail + 1) % q->depth;
+    } while (data->submitted < txn->length);
+    return true;
+}
+
+// A thread keeps to one queue pair, as it would to a CPU, so that threads
+// only contend for a queue when there are more of them than queues.
+static thread_local uint32_t nvme_thread_queue = UINT32_MAX;
+static atomic_uint nvme_next_thread_queue;
+
+static void nvme_queue_txn(nvme_device_t* dev, iotxn_t* txn) {
+    if (nvme_thread_queue == UINT32_MAX) {
+        nvme_thread_queue = atomic_fetch_add(&nvme_next_thread_queue, 1);
+    }
+    nvme_queue_t* q = &dev->io_queues[nvme_thread_queue % dev->io_queue_count];
+
+    mtx_lock(&q->lock);
+    uint16_t tail = q->sq_tail;
+    // keep behind anything already waiting
+    if (!list_is_empty(&q->pending) || !nvme_queue_submit_locked(dev, q, txn)) {
+        list_add_tail(&q->pending, &txn->node);
+    }
+    if (q->sq_tail != tail) {
+        nvme_ring_sq(q);
+    }
+    mtx_unlock(&q->lock);
+}
+
+// Completes everything the controller has posted to the queue, and issues
+// waiting iotxns in the commands that frees up. Returns how many iotxns it
+// completed.
+static uint32_t nvme_queue_drain(nvme_device_t* dev, nvme_queue_t* q) {
+    list_node_t done = LIST_INITIAL_VALUE(done);
+
+    mtx_lock(&q->lock);
+    uint16_t head = q->cq_head;
+    for (;;) {
+        volatile nvme_cpl_t* cpl = &q->cq[q->cq_head];
+        uint16_t status = cpl->status;
+        if ((status & NVME_CPL_PHASE) != q->cq_phase) {
+            break;
+        }
+        uint16_t cid = cpl->cid;
+        if (++q->cq_head == q->depth) {
+            q->cq_head = 0;
+            q->cq_phase ^= NVME_CPL_PHASE;
+        }
+
+        iotxn_t* txn = (cid < q->depth - 1) ? q->slots[cid].txn : NULL;
+        if (txn == NULL) {
+            xprintf("nvme: completion for idle command %u on queue %u\n", cid, q->qid);
+            continue;
+        }
+        q->slots[cid].txn = NULL;
+        q->free_cids[q->free_count++] = cid;
+
+        nvme_txn_data_t* data = nvme_iotxn_pdata(txn);
+        if (data->status == MX_OK) {
+            data->status = nvme_cpl_status(status);
+        }
+        if ((--data->pending == 0) && (data->submitted == txn->length)) {
+            list_add_tail(&done, &txn->node);
+        }
+    }
+
+    if (q->cq_head != head) {
+        pcie_write32(q->cq_doorbell, q->cq_head);
+
+        uint16_t tail = q->sq_tail;
+        iotxn_t* txn;
+        while ((txn = list_peek_head_type(&q->pending, iotxn_t, node)) != NULL) {
+            if (!nvme_queue_submit_locked(dev, q, txn)) {
+                break;
+            }
+            list_delete(&txn->node);
+        }
+        if (q->sq_tail != tail) {
+            nvme_ring_sq(q);
+        }
+    }
+    mtx_unlock(&q->lock);
+
+    // Every namespace is served with the same callbacks, so whichever has
+    // them reports the whole lot of completions together.
+    iotxn_t* txn = list_peek_head_type(&done, iotxn_t, node);
+    block_callbacks_t* cb = (txn != NULL) ? nvme_iotxn_pdata(txn)->ns->callbacks : NULL;
+    if ((cb != NULL) && (cb->batch_begin != NULL)) {
+        cb->batch_begin();
+    }
+    uint32_t count = 0;
+    iotxn_t* temp;
+    list_for_every_entry_safe (&done, txn, temp, iotxn_t, node) {
+        list_delete(&txn->node);
+        mx_status_t status = nvme_iotxn_pdata(txn)->status;
+        iotxn_complete(txn, status, (status == MX_OK) ? txn->length : 0);
+        count++;
+    }
+    if ((cb != NULL) && (cb->batch_end != NULL)) {
+        cb->batch_end();
+    }
+    return count;
+}
+
+static int nvme_irq_thread(void* arg) {
+    nvme_irq_t* irq = arg;
+    nvme_device_t* dev = irq->dev;
+    for (;;) {
+        mx_status_t status = mx_interrupt_wait(irq->handle);
+        if (atomic_load(&dev->stopping)) {
+            break;
+        }
+        if (status != MX_OK) {
+            xprintf("nvme: error %d waiting for interrupt %u\n", status, irq->vector);
+            continue;
+        }
+        mx_interrupt_complete(irq->handle);
+
+        for (uint32_t i = irq->vector; i < dev->io_queue_count; i += dev->irq_count) {
+            nvme_queue_drain(dev, &dev->io_queues[i]);
+        }
+    }
+    return 0;
+}
+
+// implement namespace device protocol:
+
+static void nvme_ns_get_info(nvme_namespace_t* ns, block_info_t* info) {
+    memset(info, 0, sizeof(*info));
+    info->block_size = ns->block_size;
+    info->block_count = ns->block_count;
+    info->max_transfer_size = ns->dev->max_xfer;
+}
+
+static void nvme_ns_iotxn_queue(void* ctx, iotxn_t* txn) {
+    nvme_namespace_t* ns = ctx;
+    nvme_device_t* dev = ns->dev;
+
+    if (txn->opcode == IOTXN_OP_FLUSH) {
+        // without a volatile write cache, writes are durable once complete
+        if (!dev->volatile_write_cache) {
+            iotxn_complete(txn, MX_OK, 0);
+            return;
+        }
+        txn->length = 0;
+    } else {
+        if ((txn->opcode != IOTXN_OP_READ) && (txn->opcode != IOTXN_OP_WRITE)) {
+            iotxn_complete(txn, MX_ERR_NOT_SUPPORTED, 0);
+            return;
+        }
+        // offset must be aligned to block size
+        if (txn->offset % ns->block_size) {
+            iotxn_complete(txn, MX_ERR_INVALID_ARGS, 0);
+            return;
+        }
+        // constrain to device capacity and round down to block aligned
+        uint64_t capacity = ns->block_count * ns->block_size;
+        if (txn->offset >= capacity) {
+            iotxn_complete(txn, MX_OK, 0);
+            return;
+        }
+        txn->length = MIN(ROUNDDOWN(txn->length, ns->block_size), capacity - txn->offset);
+        if (txn->length == 0) {
+            iotxn_complete(txn, MX_OK, 0);
+            return;
+        }
+        mx_status_t status = iotxn_physmap(txn);
+        if (status != MX_OK) {
+            iotxn_complete(txn, status, 0);
+            return;
+        }
+    }
+
+    nvme_txn_data_t* data = nvme_iotxn_pdata(txn);
+    data->ns = ns;
+    data->submitted = 0;
+    data->pending = 0;
+    data->status = MX_OK;
+    nvme_queue_txn(dev, txn);
+}
+
+static void nvme_ns_sync_complete(iotxn_t* txn, void* cookie) {
+    completion_signal((completion_t*)cookie);
+}
+
+static mx_status_t nvme_ns_ioctl(void* ctx, uint32_t op, const void* cmd, size_t cmdlen,
+                                 void* reply, size_t max, size_t* out_actual) {
+    nvme_namespace_t* ns = ctx;
+    switch (op) {
+    case IOCTL_BLOCK_GET_INFO: {
+        block_info_t* info = reply;
+        if (max < sizeof(*info))
+            return MX_ERR_BUFFER_TOO_SMALL;
+        nvme_ns_get_info(ns, info);
+        *out_actual = sizeof(*info);
+        return MX_OK;
+    }
+    case IOCTL_BLOCK_RR_PART: {
+        // rebind to reread the partition table
+        return device_rebind(ns->mxdev);
+    }
+    case IOCTL_DEVICE_SYNC: {
+        iotxn_t* txn;
+        mx_status_t status = iotxn_alloc(&txn, IOTXN_ALLOC_CONTIGUOUS, 0);
+        if (status != MX_OK) {
+            return status;
+        }
+        completion_t completion = COMPLETION_INIT;
+        txn->opcode = IOTXN_OP_FLUSH;
+        txn->offset = 0;
+        txn->length = 0;
+        txn->complete_cb = nvme_ns_sync_complete;
+        txn->cookie = &completion;
+        iotxn_queue(ns->mxdev, txn);
+        completion_wait(&completion, MX_TIME_INFINITE);
+        status = txn->status;
+        iotxn_release(txn);
+        return status;
+    }
+    default:
+        return MX_ERR_NOT_SUPPORTED;
+    }
+}
+
+static mx_off_t nvme_ns_get_size(void* ctx) {
+    nvme_namespace_t* ns = ctx;
+    return ns->block_count * ns->block_size;
+}
+
+static void nvme_ns_release(void* ctx) {
+    nvme_namespace_t* ns = ctx;
+    free(ns);
+}
+
+static mx_protocol_device_t nvme_ns_device_proto = {
+    .version = DEVICE_OPS_VERSION,
+    .ioctl = nvme_ns_ioctl,
+    .iotxn_queue = nvme_ns_iotxn_queue,
+    .get_size = nvme_ns_get_size,
+    .release = nvme_ns_release,
+};
+
+// implement block protocol:
+
+static void nvme_block_set_callbacks(void* ctx, block_callbacks_t* cb) {
+    nvme_namespace_t* ns = ctx;
+    ns->callbacks = cb;
+}
+
+static void nvme_block_get_info(void* ctx, block_info_t* info) {
+    nvme_namespace_t* ns = ctx;
+    nvme_ns_get_info(ns, info);
+}
+
+static void nvme_block_complete(iotxn_t* txn, void* cookie) {
+    nvme_namespace_t* ns;
+    memcpy(&ns, txn->extra, sizeof(nvme_namespace_t*));
+    ns->callbacks->complete(cookie, txn->status);
+    iotxn_release(txn);
+}
+
+static void nvme_block_txn(nvme_namespace_t* ns, uint32_t opcode, uint32_t flags, mx_handle_t vmo,
+                           uint64_t length, uint64_t vmo_offset, uint64_t dev_offset,
+                           mx_paddr_t* phys, uint64_t phys_count, void* cookie) {
+    uint64_t capacity = ns->block_count * ns->block_size;
+    if ((dev_offset % ns->block_size) || (length % ns->block_size)) {
+        ns->callbacks->complete(cookie, MX_ERR_INVALID_ARGS);
+        return;
+    }
+    if ((dev_offset >= capacity) || (length > (capacity - dev_offset))) {
+        ns->callbacks->complete(cookie, MX_ERR_OUT_OF_RANGE);
+        return;
+    }
+
+    mx_status_t status;
+    iotxn_t* txn;
+    if ((status = iotxn_alloc_vmo(&txn, IOTXN_ALLOC_POOL, vmo, vmo_offset, length)) != MX_OK) {
+        ns->callbacks->complete(cookie, status);
+        return;
+    }
+    txn->opcode = opcode;
+    txn->flags = flags;
+    txn->offset = dev_offset;
+    txn->phys = phys;
+    txn->phys_count = phys_count;
+    txn->complete_cb = nvme_block_complete;
+    txn->cookie = cookie;
+    memcpy(txn->extra, &ns, sizeof(nvme_namespace_t*));
+
+    iotxn_queue(ns->mxdev, txn);
+}
+
+static void nvme_block_read(void* ctx, mx_handle_t vmo, uint64_t length,
+                            uint64_t vmo_offset, uint64_t dev_offset, void* cookie) {
+    nvme_block_txn(ctx, IOTXN_OP_READ, 0, vmo, length, vmo_offset, dev_offset, NULL, 0, cookie);
+}
+
+static void nvme_block_write(void* ctx, mx_handle_t vmo, uint64_t length,
+                             uint64_t vmo_offset, uint64_t dev_offset, void* cookie) {
+    nvme_block_txn(ctx, IOTXN_OP_WRITE, 0, vmo, length, vmo_offset, dev_offset, NULL, 0, cookie);
+}
+
+static void nvme_block_read_phys(void* ctx, mx_handle_t vmo, uint64_t length,
+                                 uint64_t vmo_offset, uint64_t dev_offset,
+                                 mx_paddr_t* phys, uint64_t phys_count, void* cookie) {
+    nvme_block_txn(ctx, IOTXN_OP_READ, 0, vmo, length, vmo_offset, dev_offset,
+                   phys, phys_count, cookie);
+}
+
+static void nvme_block_write_phys(void* ctx, mx_handle_t vmo, uint64_t length,
+                                  uint64_t vmo_offset, uint64_t dev_offset,
+                                  mx_paddr_t* phys, uint64_t phys_count, void* cookie) {
+    nvme_block_txn(ctx, IOTXN_OP_WRITE, 0, vmo, length, vmo_offset, dev_offset,
+                   phys, phys_count, cookie);
+}
+
+static void nvme_block_write_fua(void* ctx, mx_handle_t vmo, uint64_t length,
+                                 uint64_t vmo_offset, uint64_t dev_offset,
+                                 mx_paddr_t* phys, uint64_t phys_count, void* cookie) {
+    nvme_block_txn(ctx, IOTXN_OP_WRITE, IOTXN_FUA, vmo, length, vmo_offset, dev_offset,
+                   phys, phys_count, cookie);
+}
+
+static void nvme_block_flush(void* ctx, void* cookie) {
+    nvme_namespace_t* ns = ctx;
+    mx_status_t status;
+    iotxn_t* txn;
+    if ((status = iotxn_alloc(&txn, IOTXN_ALLOC_POOL, 0)) != MX_OK) {
+        ns->callbacks->complete(cookie, status);
+        return;
+    }
+    txn->opcode = IOTXN_OP_FLUSH;
+    txn->complete_cb = nvme_block_complete;
+    txn->cookie = cookie;
+    memcpy(txn->extra, &ns, sizeof(nvme_namespace_t*));
+
+    iotxn_queue(ns->mxdev, txn);
+}
+
+// Issues go to the calling thread's queue, so that is where to look for
+// their completions.
+static uint32_t nvme_block_poll(void* ctx) {
+    nvme_namespace_t* ns = ctx;
+    nvme_device_t* dev = ns->dev;
+    if (nvme_thread_queue == UINT32_MAX) {
+        return 0;
+    }
+    return nvme_queue_drain(dev, &dev->io_queues[nvme_thread_queue % dev->io_queue_count]);
+}
+
+static block_protocol_ops_t nvme_block_ops = {
+    .set_callbacks = nvme_block_set_callbacks,
+    .get_info = nvme_block_get_info,
+    .read = nvme_block_read,
+    .write = nvme_block_write,
+    .read_phys = nvme_block_read_phys,
+    .write_phys = nvme_block_write_phys,
+    .flush = nvme_block_flush,
+    .write_fua = nvme_block_write_fua,
+    .poll = nvme_block_poll,
+};
+
+static mx_status_t nvme_namespace_add(nvme_device_t* dev, uint32_t nsid, io_buffer_t* buffer) {
+    mx_status_t status = nvme_identify(dev, NVME_IDENTIFY_NAMESPACE, nsid, buffer);
+    if (status != MX_OK) {
+        return status;
+    }
+    const uint8_t* idns = io_buffer_virt(buffer);
+    uint64_t nsze;
+    memcpy(&nsze, idns + NVME_IDNS_NSZE, sizeof(nsze));
+    if (nsze == 0) {
+        // not an active namespace
+        return MX_OK;
+    }
+    uint32_t lbaf;
+    memcpy(&lbaf, idns + NVME_IDNS_LBAF + 4 * (idns[NVME_IDNS_FLBAS] & 0xf), sizeof(lbaf));
+    uint32_t lbads = (lbaf >> 16) & 0xff;
+    if ((lbads < 9) || ((1u << lbads) > PAGE_SIZE)) {
+        printf("nvme: namespace %u block size 2^%u unsupported\n", nsid, lbads);
+        return MX_ERR_NOT_SUPPORTED;
+    }
+
+    nvme_namespace_t* ns = calloc(1, sizeof(nvme_namespace_t));
+    if (!ns) {
+        return MX_ERR_NO_MEMORY;
+    }
+    ns->dev = dev;
+    ns->nsid = nsid;
+    ns->block_size = 1u << lbads;
+    ns->block_count = nsze;
+    ns->block_ops = nvme_block_ops;
+    if (!dev->volatile_write_cache) {
+        ns->block_ops.flush = NULL;
+    }
+    xprintf("nvme: namespace %u, %" PRIu64 " blocks of %u bytes\n", nsid, ns->block_count,
+            ns->block_size);
+
+    char name[16];
+    snprintf(name, sizeof(name), "ns%u", nsid);
+
+    device_add_args_t args = {
+        .version = DEVICE_ADD_ARGS_VERSION,
+        .name = name,
+        .ctx = ns,
+        .ops = &nvme_ns_device_proto,
+        .proto_id = MX_PROTOCOL_BLOCK_CORE,
+        .proto_ops = &ns->block_ops,
+    };
+
+    status = device_add(dev->mxdev, &args, &ns->mxdev);
+    if (status != MX_OK) {
+        free(ns);
+        return status;
+    }
+    return MX_OK;
+}
+
+// controller initialization:
+
+static mx_status_t nvme_wait_ready(nvme_device_t* dev, bool ready) {
+    mx_time_t deadline = mx_time_get(MX_CLOCK_MONOTONIC) + dev->timeout;
+    while (((pcie_read32(&dev->regs->csts) & NVME_CSTS_RDY) != 0) != ready) {
+        if (mx_time_get(MX_CLOCK_MONOTONIC) > deadline) {
+            return MX_ERR_TIMED_OUT;
+        }
+        usleep(1000);
+    }
+    return MX_OK;
+}
+
+// MSI-X gives each queue pair an interrupt of its own. Failing that, MSI may
+// give several, and failing that, there is the legacy interrupt.
+static mx_status_t nvme_irq_init(nvme_device_t* dev, uint32_t wanted) {
+    pci_protocol_t* pci = &dev->pci;
+    uint32_t count;
+    mx_status_t status;
+    if ((pci->ops->query_irq_mode_caps(pci->ctx, MX_PCIE_IRQ_MODE_MSI_X, &count) == MX_OK) &&
+        (count > 0)) {
+        count = MIN(count, wanted);
+        if (pci->ops->set_irq_mode(pci->ctx, MX_PCIE_IRQ_MODE_MSI_X, count) == MX_OK) {
+            goto mapped;
+        }
+    }
+    if ((pci->ops->query_irq_mode_caps(pci->ctx, MX_PCIE_IRQ_MODE_MSI, &count) == MX_OK) &&
+        (count > 0)) {
+        // MSI hands out vectors in powers of two
+        count = MIN(count, wanted);
+        count = 1u << (31 - __builtin_clz(count));
+        if (pci->ops->set_irq_mode(pci->ctx, MX_PCIE_IRQ_MODE_MSI, count) == MX_OK) {
+            goto mapped;
+        }
+    }
+    count = 1;
+    status = pci->ops->set_irq_mode(pci->ctx, MX_PCIE_IRQ_MODE_LEGACY, count);
+    if (status != MX_OK) {
+        xprintf("nvme: error %d setting irq mode\n", status);
+        return status;
+    }
+
+mapped:
+    for (uint32_t i = 0; i < count; i++) {
+        status = pci->ops->map_interrupt(pci->ctx, i, &dev->irqs[i].handle);
+        if (status != MX_OK) {
+            xprintf("nvme: error %d getting irq handle %u\n", status, i);
+            return status;
+        }
+        dev->irqs[i].dev = dev;
+        dev->irqs[i].vector = i;
+    }
+    dev->irq_count = count;
+    return MX_OK;
+}
+
+static mx_status_t nvme_controller_init(nvme_device_t* dev) {
+    dev->cap = nvme_read64(&dev->regs->cap_lo);
+    dev->timeout = MAX(NVME_CAP_TO(dev->cap), 1u) * MX_MSEC(500);
+    dev->doorbell_stride = 4u << NVME_CAP_DSTRD(dev->cap);
+    if (!(dev->cap & NVME_CAP_CSS_NVM)) {
+        printf("nvme: controller lacks the NVM command set\n");
+        return MX_ERR_NOT_SUPPORTED;
+    }
+    uint32_t page_shift = __builtin_ctz(PAGE_SIZE);
+    if ((page_shift < 12 + NVME_CAP_MPSMIN(dev->cap)) ||
+        (page_shift > 12 + NVME_CAP_MPSMAX(dev->cap))) {
+        printf("nvme: controller doesn't take %u byte pages\n", PAGE_SIZE);
+        return MX_ERR_NOT_SUPPORTED;
+    }
+
+    // the controller has to be stopped to point it at the admin queue
+    uint32_t cc = pcie_read32(&dev->regs->cc);
+    if (cc & NVME_CC_EN) {
+        pcie_write32(&dev->regs->cc, cc & ~NVME_CC_EN);
+    }
+    mx_status_t status = nvme_wait_ready(dev, false);
+    if (status != MX_OK) {
+        xprintf("nvme: timed out waiting for controller to stop\n");
+        return status;
+    }
+
+    uint16_t depth = MIN(NVME_ADMIN_QUEUE_DEPTH, NVME_CAP_MQES(dev->cap) + 1);
+    if ((status = nvme_queue_init(dev, &dev->admin_queue, 0, depth)) != MX_OK) {
+        return status;
+    }
+    nvme_queue_t* aq = &dev->admin_queue;
+    pcie_write32(&dev->regs->aqa, ((uint32_t)(depth - 1) << 16) | (depth - 1));
+    nvme_write64(&dev->regs->asq_lo, io_buffer_phys(&aq->buffer));
+    nvme_write64(&dev->regs->acq_lo, io_buffer_phys(&aq->buffer) +
+                                     ((uintptr_t)aq->cq - (uintptr_t)aq->sq));
+
+    pcie_write32(&dev->regs->cc, NVME_CC_EN | NVME_CC_CSS_NVM | NVME_CC_MPS(page_shift) |
+                                 NVME_CC_AMS_RR | NVME_CC_IOSQES(NVME_CMD_SIZE_LOG2) |
+                                 NVME_CC_IOCQES(NVME_CPL_SIZE_LOG2));
+    if ((status = nvme_wait_ready(dev, true)) != MX_OK) {
+        xprintf("nvme: timed out waiting for controller to start\n");
+        return status;
+    }
+    if (pcie_read32(&dev->regs->csts) & NVME_CSTS_CFS) {
+        printf("nvme: controller fatal status\n");
+        return MX_ERR_IO;
+    }
+    return MX_OK;
+}
+
+static mx_status_t nvme_io_queues_init(nvme_device_t* dev) {
+    // ask for a queue pair for each CPU
+    uint32_t wanted = MIN(mx_system_get_num_cpus(), NVME_MAX_IO_QUEUES);
+    nvme_cmd_t cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.opcode = NVME_ADMIN_SET_FEATURES;
+    cmd.cdw10 = NVME_FEATURE_NUM_QUEUES;
+    cmd.cdw11 = ((wanted - 1) << 16) | (wanted - 1);
+    uint32_t granted;
+    mx_status_t status = nvme_admin_cmd(dev, &cmd, &granted);
+    if (status != MX_OK) {
+        return status;
+    }
+    // 0-based, submission queues in the low half
+    uint32_t count = MIN(wanted, MIN((granted & 0xffff) + 1, (granted >> 16) + 1));
+
+    if ((status = nvme_irq_init(dev, count)) != MX_OK) {
+        return status;
+    }
+
+    dev->io_queues = calloc(count, sizeof(nvme_queue_t));
+    if (!dev->io_queues) {
+        return MX_ERR_NO_MEMORY;
+    }
+    uint16_t depth = MIN(NVME_IO_QUEUE_DEPTH, NVME_CAP_MQES(dev->cap) + 1);
+    for (uint32_t i = 0; i < count; i++) {
+        nvme_queue_t* q = &dev->io_queues[i];
+        if ((status = nvme_queue_init(dev, q, i + 1, depth)) != MX_OK) {
+            break;
+        }
+        q->vector = i % dev->irq_count;
+        if ((status = nvme_create_io_queue(dev, q)) != MX_OK) {
+            io_buffer_release(&q->buffer);
+            break;
+        }
+        dev->io_queue_count++;
+    }
+    if (dev->io_queue_count == 0) {
+        return status;
+    }
+    xprintf("nvme: %u I/O queues of %u, %u interrupts\n", dev->io_queue_count, depth,
+            dev->irq_count);
+
+    for (uint32_t i = 0; i < dev->irq_count; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "nvme-irq%u", i);
+        int ret = thrd_create_with_name(&dev->irqs[i].thread, nvme_irq_thread, &dev->irqs[i], name);
+        if (ret != thrd_success) {
+            xprintf("nvme: error %d in irq thread create\n", ret);
+            return MX_ERR_NO_RESOURCES;
+        }
+        dev->irq_threads++;
+    }
+    return MX_OK;
+}
+
+static int nvme_init_thread(void* arg) {
+    nvme_device_t* dev = arg;
+
+    mx_status_t status = nvme_controller_init(dev);
+    if (status != MX_OK) {
+        return status;
+    }
+
+    io_buffer_t buffer;
+    if ((status = io_buffer_init(&buffer, NVME_IDENTIFY_SIZE, IO_BUFFER_RW)) != MX_OK) {
+        return status;
+    }
+    if ((status = nvme_identify(dev, NVME_IDENTIFY_CONTROLLER, 0, &buffer)) != MX_OK) {
+        goto done;
+    }
+    const uint8_t* idctl = io_buffer_virt(&buffer);
+    char str[NVME_IDCTL_MODEL_LEN + 1];
+    snprintf(str, NVME_IDCTL_MODEL_LEN + 1, "%s", (const char*)(idctl + NVME_IDCTL_MODEL));
+    xprintf("nvme: model %s\n", str);
+    snprintf(str, NVME_IDCTL_SERIAL_LEN + 1, "%s", (const char*)(idctl + NVME_IDCTL_SERIAL));
+    xprintf("  serial=%s\n", str);
+    snprintf(str, NVME_IDCTL_FW_REV_LEN + 1, "%s", (const char*)(idctl + NVME_IDCTL_FW_REV));
+    xprintf("  firmware rev=%s\n", str);
+
+    // the transfer limit is in units of the smallest page size
+    dev->max_xfer = NVME_MAX_XFER;
+    if (idctl[NVME_IDCTL_MDTS] != 0) {
+        uint64_t mdts = (1ull << idctl[NVME_IDCTL_MDTS]) << (12 + NVME_CAP_MPSMIN(dev->cap));
+        dev->max_xfer = MIN(dev->max_xfer, mdts);
+    }
+    dev->volatile_write_cache = idctl[NVME_IDCTL_VWC] & 1;
+    uint32_t nn;
+    memcpy(&nn, idctl + NVME_IDCTL_NN, sizeof(nn));
+    xprintf("  max transfer=%" PRIu64 " namespaces=%u%s\n", dev->max_xfer, nn,
+            dev->volatile_write_cache ? " write cache" : "");
+
+    if ((status = nvme_io_queues_init(dev)) != MX_OK) {
+        printf("nvme: error %d setting up I/O queues\n", status);
+        goto done;
+    }
+
+    for (uint32_t nsid = 1; nsid <= nn; nsid++) {
+        if ((status = nvme_namespace_add(dev, nsid, &buffer)) != MX_OK) {
+            xprintf("nvme: error %d adding namespace %u\n", status, nsid);
+        }
+    }
+    status = MX_OK;
+done:
+    io_buffer_release(&buffer);
+    return status;
+}
+
+// implement controller device protocol:
+
+// Undoes as much of the bring-up as was done. The namespaces are released
+// before the controller is, so nothing is issued to it any more.
+static void nvme_shutdown(nvme_device_t* dev) {
+    // stop the controller first, so it writes no more to the queues
+    if (dev->init_started) {
+        thrd_join(dev->init_thread, NULL);
+        uint32_t cc = pcie_read32(&dev->regs->cc);
+        if (cc & NVME_CC_EN) {
+            pcie_write32(&dev->regs->cc, cc & ~NVME_CC_EN);
+            if (nvme_wait_ready(dev, false) != MX_OK) {
+                printf("nvme: timed out waiting for controller to stop\n");
+            }
+        }
+    }
+    if (dev->regs != NULL) {
+        dev->pci.ops->enable_bus_master(dev->pci.ctx, false);
+    }
+
+    // the irq threads are woken to see they're to stop
+    atomic_store(&dev->stopping, true);
+    for (uint32_t i = 0; i < dev->irq_threads; i++) {
+        mx_interrupt_signal(dev->irqs[i].handle);
+        thrd_join(dev->irqs[i].thread, NULL);
+    }
+    for (uint32_t i = 0; i < NVME_MAX_IO_QUEUES; i++) {
+        if (dev->irqs[i].handle != MX_HANDLE_INVALID) {
+            mx_handle_close(dev->irqs[i].handle);
+        }
+    }
+
+    if (dev->io_queues != NULL) {
+        for (uint32_t i = 0; i < dev->io_queue_count; i++) {
+            io_buffer_release(&dev->io_queues[i].buffer);
+        }
+        free(dev->io_queues);
+    }
+    io_buffer_release(&dev->admin_queue.buffer);
+
+    if (dev->regs != NULL) {
+        mx_vmar_unmap(mx_vmar_root_self(), (uintptr_t)dev->regs, dev->regs_size);
+    }
+    if (dev->regs_handle != MX_HANDLE_INVALID) {
+        mx_handle_close(dev->regs_handle);
+    }
+}
+
+static void nvme_release(void* ctx) {
+    nvme_device_t* dev = ctx;
+    nvme_shutdown(dev);
+    free(dev);
+}
+
+static mx_protocol_device_t nvme_device_proto = {
+    .version = DEVICE_OPS_VERSION,
+    .release = nvme_release,
+};
+
+// implement driver object:
+
+static mx_status_t nvme_bind(void* ctx, mx_device_t* parent, void** cookie) {
+    nvme_device_t* dev = calloc(1, sizeof(nvme_device_t));
+    if (!dev) {
+        xprintf("nvme: out of memory\n");
+        return MX_ERR_NO_MEMORY;
+    }
+
+    if (device_get_protocol(parent, MX_PROTOCOL_PCI, &dev->pci)) {
+        free(dev);
+        return MX_ERR_NOT_SUPPORTED;
+    }
+
+    mx_status_t status = dev->pci.ops->claim_device(dev->pci.ctx);
+    if (status != MX_OK) {
+        xprintf("nvme: error %d claiming pci device\n", status);
+        free(dev);
+        return status;
+    }
+
+    // map register window
+    status = dev->pci.ops->map_resource(dev->pci.ctx, PCI_RESOURCE_BAR_0,
+                                        MX_CACHE_POLICY_UNCACHED_DEVICE, (void**)&dev->regs,
+                                        &dev->regs_size, &dev->regs_handle);
+    if (status != MX_OK) {
+        xprintf("nvme: error %d mapping register window\n", status);
+        goto fail;
+    }
+
+    status = dev->pci.ops->enable_bus_master(dev->pci.ctx, true);
+    if (status != MX_OK) {
+        xprintf("nvme: error %d in enable bus master\n", status);
+        goto fail;
+    }
+
+    device_add_args_t args = {
+        .version = DEVICE_ADD_ARGS_VERSION,
+        .name = "nvme",
+        .ctx = dev,
+        .ops = &nvme_device_proto,
+        .flags = DEVICE_ADD_NON_BINDABLE,
+    };
+
+    status = device_add(parent, &args, &dev->mxdev);
+    if (status != MX_OK) {
+        xprintf("nvme: error %d in device_add\n", status);
+        goto fail;
+    }
+
+    // bring up the controller and find its namespaces
+    int ret = thrd_create_with_name(&dev->init_thread, nvme_init_thread, dev, "nvme-init");
+    if (ret != thrd_success) {
+        xprintf("nvme: error %d in init thread create\n", ret);
+        device_remove(dev->mxdev);
+        return MX_ERR_NO_RESOURCES;
+    }
+    dev->init_started = true;
+
+    return MX_OK;
+fail:
+    nvme_shutdown(dev);
+    free(dev);
+    return status;
+}
+
+static mx_driver_ops_t nvme_driver_ops = {
+    .version = DRIVER_OPS_VERSION,
+    .bind = nvme_bind,
+};
+
+// clang-format off
+MAGENTA_DRIVER_BEGIN(nvme, nvme_driver_ops, "magenta", "0.1", 4)
+    BI_ABORT_IF(NE, BIND_PROTOCOL, MX_PROTOCOL_PCI),
+    BI_ABORT_IF(NE, BIND_PCI_CLASS, 0x01),
+    BI_ABORT_IF(NE, BIND_PCI_SUBCLASS, 0x08),
+    BI_MATCH_IF(EQ, BIND_PCI_INTERFACE, 0x02),
+MAGENTA_DRIVER_END(nvme)
@@ -0,0 +1,132 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+
+// NVM Express 1.2 controller registers and queue entries.
+
+#define NVME_CAP_MQES(cap)   ((uint32_t)((cap) & 0xffff))      // 0-based
+#define NVME_CAP_TO(cap)     ((uint32_t)(((cap) >> 24) & 0xff)) // in 500ms units
+#define NVME_CAP_DSTRD(cap)  ((uint32_t)(((cap) >> 32) & 0xf))
+#define NVME_CAP_CSS_NVM     (1ull << 37)
+#define NVME_CAP_MPSMIN(cap) ((uint32_t)(((cap) >> 48) & 0xf))
+#define NVME_CAP_MPSMAX(cap) ((uint32_t)(((cap) >> 52) & 0xf))
+
+#define NVME_CC_EN          (1 << 0)
+#define NVME_CC_CSS_NVM     (0 << 4)
+#define NVME_CC_MPS(shift)  (((shift) - 12) << 7)
+#define NVME_CC_AMS_RR      (0 << 11)
+#define NVME_CC_SHN_NORMAL  (1 << 14)
+#define NVME_CC_SHN_MASK    (3 << 14)
+#define NVME_CC_IOSQES(log) ((log) << 16)
+#define NVME_CC_IOCQES(log) ((log) << 20)
+
+#define NVME_CSTS_RDY            (1 << 0)
+#define NVME_CSTS_CFS            (1 << 1)
+#define NVME_CSTS_SHST_MASK      (3 << 2)
+#define NVME_CSTS_SHST_COMPLETE  (2 << 2)
+
+typedef struct {
+    uint32_t cap_lo;        // controller capabilities
+    uint32_t cap_hi;
+    uint32_t vs;            // version
+    uint32_t intms;         // interrupt mask set
+    uint32_t intmc;         // interrupt mask clear
+    uint32_t cc;            // controller configuration
+    uint32_t reserved0;
+    uint32_t csts;          // controller status
+    uint32_t nssr;          // NVM subsystem reset
+    uint32_t aqa;           // admin queue attributes
+    uint32_t asq_lo;        // admin submission queue base address
+    uint32_t asq_hi;
+    uint32_t acq_lo;        // admin completion queue base address
+    uint32_t acq_hi;
+} __attribute__((packed)) nvme_regs_t;
+
+// Doorbells follow the registers, each queue's submission tail and then its
+// completion head, spaced by the doorbell stride.
+#define NVME_DOORBELL_BASE 0x1000
+
+// admin commands
+#define NVME_ADMIN_DELETE_SQ    0x00
+#define NVME_ADMIN_CREATE_SQ    0x01
+#define NVME_ADMIN_DELETE_CQ    0x04
+#define NVME_ADMIN_CREATE_CQ    0x05
+#define NVME_ADMIN_IDENTIFY     0x06
+#define NVME_ADMIN_SET_FEATURES 0x09
+
+#define NVME_IDENTIFY_NAMESPACE  0
+#define NVME_IDENTIFY_CONTROLLER 1
+
+#define NVME_FEATURE_NUM_QUEUES 0x07
+
+#define NVME_QUEUE_PHYS_CONTIG (1 << 0)
+#define NVME_CQ_IRQ_ENABLED    (1 << 1)
+
+// NVM commands
+#define NVME_CMD_FLUSH 0x00
+#define NVME_CMD_WRITE 0x01
+#define NVME_CMD_READ  0x02
+
+// In cdw12 of a read or write.
+#define NVME_RW_FUA (1 << 30)
+
+typedef struct {
+    uint8_t opcode;
+    uint8_t flags;          // fused operation, PRP or SGL
+    uint16_t cid;           // command identifier
+    uint32_t nsid;          // namespace
+    uint64_t reserved;
+    uint64_t mptr;          // metadata pointer
+    uint64_t prp1;          // data pointer
+    uint64_t prp2;
+    uint32_t cdw10;         // command specific
+    uint32_t cdw11;
+    uint32_t cdw12;
+    uint32_t cdw13;
+    uint32_t cdw14;
+    uint32_t cdw15;
+} __attribute__((packed)) nvme_cmd_t;
+
+typedef struct {
+    uint32_t cdw0;          // command specific
+    uint32_t reserved;
+    uint16_t sq_head;       // how far the controller has read the submission queue
+    uint16_t sq_id;
+    uint16_t cid;
+    uint16_t status;        // phase tag in bit 0, status code above it
+} __attribute__((packed)) nvme_cpl_t;
+
+#define NVME_CPL_PHASE            (1 << 0)
+#define NVME_CPL_STATUS(status)   (((status) >> 1) & 0x7ff) // type and code
+#define NVME_CPL_STATUS_LBA_RANGE 0x080
+
+// log2 of the entry sizes, for CC
+#define NVME_CMD_SIZE_LOG2 6
+#define NVME_CPL_SIZE_LOG2 4
+
+static_assert(sizeof(nvme_cmd_t) == (1 << NVME_CMD_SIZE_LOG2), "unexpected command size");
+static_assert(sizeof(nvme_cpl_t) == (1 << NVME_CPL_SIZE_LOG2), "unexpected completion size");
+
+// Byte offsets into the identify controller data.
+#define NVME_IDCTL_SERIAL    4
+#define NVME_IDCTL_MODEL     24
+#define NVME_IDCTL_FW_REV    64
+#define NVME_IDCTL_MDTS      77
+#define NVME_IDCTL_NN        516
+#define NVME_IDCTL_VWC       525
+
+#define NVME_IDCTL_SERIAL_LEN 20
+#define NVME_IDCTL_MODEL_LEN  40
+#define NVME_IDCTL_FW_REV_LEN 8
+
+// Byte offsets into the identify namespace data.
+#define NVME_IDNS_NSZE  0
+#define NVME_IDNS_FLBAS 26
+#define NVME_IDNS_LBAF  128 // 4 bytes for each format, the data size in bits 23:16
+
+#define NVME_IDENTIFY_SIZE 4096
@@ -32,6 +32,10 @@ typedef struct ramdisk_device {
     uint64_t blk_count;
     mx_handle_t vmo;
     uintptr_t mapped_addr;
+    // A bit for each page of the VMO which has been written, and so has
+    // memory behind it. The rest read as zeros without being touched, as
+    // touching them through the mapping would commit them.
+    uint64_t* committed;
     block_callbacks_t* cb;
     char name[NAME_MAX];
 
@@ -46,6 +50,51 @@ static uint64_t sizebytes(ramdisk_device_t* rdev) {
     return rdev->blk_size * rdev->blk_count;
 }
 
+// A page of zeros, to fill reads of pages which were never written.
+static const uint8_t zeros[PAGE_SIZE];
+
+static bool page_committed(ramdisk_device_t* rdev, uint64_t page) {
+    return rdev->committed[page / 64] & (1ull << (page % 64));
+}
+
+static void set_committed(ramdisk_device_t* rdev, uint64_t offset, uint64_t length,
+                          bool committed) {
+    uint64_t end = ROUNDUP(offset + length, PAGE_SIZE) / PAGE_SIZE;
+    for (uint64_t page = offset / PAGE_SIZE; page < end; page++) {
+        if (committed) {
+            rdev->committed[page / 64] |= 1ull << (page % 64);
+        } else {
+            rdev->committed[page / 64] &= ~(1ull << (page % 64));
+        }
+    }
+}
+
+// Returns how much of [offset, offset + length) from its start lies in
+// pages which are all committed, or all not, as the first one is.
+static uint64_t page_run(ramdisk_device_t* rdev, uint64_t offset, uint64_t length,
+                         bool* committed) {
+    *committed = page_committed(rdev, offset / PAGE_SIZE);
+    uint64_t end = ROUNDUP(offset + 1, PAGE_SIZE);
+    while ((end < offset + length) && (page_committed(rdev, end / PAGE_SIZE) == *committed)) {
+        end += PAGE_SIZE;
+    }
+    return MIN(end, offset + length) - offset;
+}
+
+// Zeroes the parts of [offset, offset + length) which are in committed
+// pages, leaving the rest uncommitted.
+static void zero_committed(ramdisk_device_t* rdev, uint64_t offset, uint64_t length) {
+    while (length > 0) {
+        bool committed;
+        uint64_t run = page_run(rdev, offset, length, &committed);
+        if (committed) {
+            memset((void*)rdev->mapped_addr + offset, 0, run);
+        }
+        offset += run;
+        length -= run;
+    }
+}
+
 static mx_status_t constrain_args(ramdisk_device_t* ramdev,
                                   mx_off_t* offset, mx_off_t* length) {
     // Offset must be aligned
@@ -69,6 +118,7 @@ static void ramdisk_get_info(void* ctx, block_info_t* info) {
     memset(info, 0, sizeof(*info));
     info->block_size = ramdev->blk_size;
     info->block_count = sizebytes(ramdev) / ramdev->blk_size;
+    info->flags |= BLOCK_FLAG_DISCARD;
 }
 
 static void ramdisk_fifo_set_callbacks(void* ctx, block_callbacks_t* cb) {
@@ -90,10 +140,25 @@ static void ramdisk_fifo_read(void* ctx, mx_handle_t vmo, uint64_t length,
     if (rdev->dead) {
         status = MX_ERR_BAD_STATE;
     } else {
-        size_t actual;
         // Reading from disk --> Write to file VMO
-        status = mx_vmo_write(vmo, (void*)rdev->mapped_addr + dev_offset,
-                              vmo_offset, len, &actual);
+        while ((status == MX_OK) && (len > 0)) {
+            bool committed;
+            uint64_t run = page_run(rdev, dev_offset, len, &committed);
+            size_t actual;
+            if (committed) {
+                status = mx_vmo_write(vmo, (void*)rdev->mapped_addr + dev_offset,
+                                      vmo_offset, run, &actual);
+            } else {
+                for (uint64_t done = 0; (status == MX_OK) && (done < run);
+                     done += sizeof(zeros)) {
+                    status = mx_vmo_write(vmo, zeros, vmo_offset + done,
+                                          MIN(run - done, sizeof(zeros)), &actual);
+                }
+            }
+            dev_offset += run;
+            vmo_offset += run;
+            len -= run;
+        }
     }
     mtx_unlock(&rdev->lock);
     rdev->cb->complete(cookie, status);
@@ -117,16 +182,61 @@ static void ramdisk_fifo_write(void* ctx, mx_handle_t vmo, uint64_t length,
         // Writing to disk --> Read from file VMO
         status = mx_vmo_read(vmo, (void*)rdev->mapped_addr + dev_offset,
                              vmo_offset, len, &actual);
+        set_committed(rdev, dev_offset, len, true);
     }
     mtx_unlock(&rdev->lock);
     rdev->cb->complete(cookie, status);
 }
 
+// Called with the lock held.
+static mx_status_t ramdisk_discard(ramdisk_device_t* rdev, uint64_t dev_offset, uint64_t len) {
+    if (rdev->dead) {
+        return MX_ERR_BAD_STATE;
+    }
+    if (len == 0) {
+        return MX_OK;
+    }
+    // The whole pages are given back; what's discarded of the pages at
+    // either end, which hold blocks still in use, is zeroed instead.
+    mx_status_t status = MX_OK;
+    uint64_t start = ROUNDUP(dev_offset, PAGE_SIZE);
+    uint64_t end = ROUNDDOWN(dev_offset + len, PAGE_SIZE);
+    if (start < end) {
+        status = mx_vmo_op_range(rdev->vmo, MX_VMO_OP_DECOMMIT, start, end - start,
+                                 NULL, 0);
+        if (status == MX_OK) {
+            set_committed(rdev, start, end - start, false);
+        }
+        zero_committed(rdev, dev_offset, start - dev_offset);
+        zero_committed(rdev, end, dev_offset + len - end);
+    } else {
+        zero_committed(rdev, dev_offset, len);
+    }
+    return status;
+}
+
+static void ramdisk_fifo_discard(void* ctx, uint64_t length, uint64_t dev_offset,
+                                 void* cookie) {
+    ramdisk_device_t* rdev = ctx;
+    mx_off_t len = length;
+    mx_status_t status = constrain_args(rdev, &dev_offset, &len);
+    if (status != MX_OK) {
+        rdev->cb->complete(cookie, status);
+        return;
+    }
+
+    mtx_lock(&rdev->lock);
+    status = ramdisk_discard(rdev, dev_offset, len);
+    mtx_unlock(&rdev->lock);
+    rdev->cb->complete(cookie, status);
+}
+
 static block_protocol_ops_t ramdisk_block_ops = {
     .set_callbacks = ramdisk_fifo_set_callbacks,
     .get_info = ramdisk_get_info,
     .read = ramdisk_fifo_read,
     .write = ramdisk_fifo_write,
+    .discard = ramdisk_fifo_discard,
 };
 
 // implement device protocol:
@@ -193,15 +303,40 @@ static void ramdisk_iotxn_queue(void* ctx, iotxn_t* txn) {
 
     switch (txn->opcode) {
         case IOTXN_OP_READ: {
-            iotxn_copyto(txn, (void*) ramdev->mapped_addr + txn->offset, txn->length, 0);
+            mtx_lock(&ramdev->lock);
+            for (uint64_t done = 0; done < txn->length;) {
+                bool committed;
+                uint64_t run = page_run(ramdev, txn->offset + done, txn->length - done,
+                                        &committed);
+                if (committed) {
+                    iotxn_copyto(txn, (void*) ramdev->mapped_addr + txn->offset + done, run,
+                                 done);
+                } else {
+                    for (uint64_t n = 0; n < run; n += sizeof(zeros)) {
+                        iotxn_copyto(txn, zeros, MIN(run - n, sizeof(zeros)), done + n);
+                    }
+                }
+                done += run;
+            }
+            mtx_unlock(&ramdev->lock);
             iotxn_complete(txn, MX_OK, txn->length);
             return;
         }
         case IOTXN_OP_WRITE: {
+            mtx_lock(&ramdev->lock);
             iotxn_copyfrom(txn, (void*) ramdev->mapped_addr + txn->offset, txn->length, 0);
+            set_committed(ramdev, txn->offset, txn->length, true);
+            mtx_unlock(&ramdev->lock);
             iotxn_complete(txn, MX_OK, txn->length);
             return;
         }
+        case IOTXN_OP_DISCARD: {
+            mtx_lock(&ramdev->lock);
+            status = ramdisk_discard(ramdev, txn->offset, txn->length);
+            mtx_unlock(&ramdev->lock);
+            iotxn_complete(txn, status, 0);
+            return;
+        }
         default: {
             iotxn_complete(txn, MX_ERR_INVALID_ARGS, 0);
             return;
@@ -219,6 +354,7 @@ static void ramdisk_release(void* ctx) {
         mx_vmar_unmap(mx_vmar_root_self(), ramdev->mapped_addr, sizebytes(ramdev));
         mx_handle_close(ramdev->vmo);
     }
+    free(ramdev->committed);
     free(ramdev);
 }
 
@@ -257,8 +393,15 @@ static mx_status_t ramctl_ioctl(void* ctx, uint32_t op, const void* cmd,
         ramdev->blk_count = config->blk_count;
         mtx_init(&ramdev->lock, mtx_plain);
         sprintf(ramdev->name, "ramdisk-%lu", ramdisk_count++);
+        uint64_t pages = ROUNDUP(sizebytes(ramdev), PAGE_SIZE) / PAGE_SIZE;
+        if ((ramdev->committed = calloc((pages + 63) / 64, sizeof(uint64_t))) == NULL) {
+            free(ramdev);
+            return MX_ERR_NO_MEMORY;
+        }
+        // The VMO is left uncommitted, to be filled in as it's written.
         mx_status_t status;
         if ((status = mx_vmo_create(sizebytes(ramdev), 0, &ramdev->vmo)) != MX_OK) {
+            free(ramdev->committed);
             free(ramdev);
             return status;
         }
@@ -266,6 +409,7 @@ static mx_status_t ramctl_ioctl(void* ctx, uint32_t op, const void* cmd,
                                   MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE,
                                   &ramdev->mapped_addr)) != MX_OK) {
             mx_handle_close(ramdev->vmo);
+            free(ramdev->committed);
             free(ramdev);
             return status;
         }
@@ -282,6 +426,7 @@ static mx_status_t ramctl_ioctl(void* ctx, uint32_t op, const void* cmd,
         if ((status = device_add(ramctl->mxdev, &args, &ramdev->mxdev)) != MX_OK) {
             mx_vmar_unmap(mx_vmar_root_self(), ramdev->mapped_addr, sizebytes(ramdev));
             mx_handle_close(ramdev->vmo);
+            free(ramdev->committed);
             free(ramdev);
             return status;
         }
@@ -3,7 +3,8 @@
 // found in the LICENSE file.
 
 // Notes and limitations:
-// 1. This driver only uses PIO mode.
+// 1. Data moves by ADMA2 when the controller supports it, and by PIO
+//    otherwise (or when a quirk says its DMA can't be used).
 //
 // 2. This driver only supports SDHCv3 and above. Lower versions of SD are not
 //    currently supported. The driver should fail gracefully if a lower version
@@ -21,6 +22,7 @@
 // DDK Includes
 #include <ddk/binding.h>
 #include <ddk/device.h>
+#include <ddk/io-buffer.h>
 #include <ddk/iotxn.h>
 #include <ddk/protocol/sdmmc.h>
 #include <ddk/protocol/sdhci.h>
@@ -33,6 +35,9 @@
 
 #define SD_FREQ_SETUP_HZ  400000
 
+// The largest run of pages that fits the 16-bit length of a descriptor.
+#define ADMA2_MAX_LENGTH (64 * 1024 - PAGE_SIZE)
+
 typedef struct sdhci_device {
     // Interrupts mapped here.
     mx_handle_t irq_handle;
@@ -61,6 +66,12 @@ typedef struct sdhci_device {
     // Offset to DMA address
     // XXX temporary (see ddk/protocol/sdhci.h)
     mx_paddr_t dma_offset;
+
+    // Whether data moves by ADMA2, and with which size of descriptor.
+    bool dma;
+    bool dma64;
+    // The descriptor table, a page of them, filled for each transfer.
+    io_buffer_t descs;
 } sdhci_device_t;
 
 // If any of these interrupts is asserted in the SDHCI irq register, it means
@@ -83,6 +94,7 @@ static const uint32_t error_interrupts = (
 // These interrupts indicate that a transfer or command has progressed normally.
 static const uint32_t normal_interrupts = (
     SDHCI_IRQ_CMD_CPLT |
+    SDHCI_IRQ_XFER_CPLT |
     SDHCI_IRQ_BUFF_READ_READY |
     SDHCI_IRQ_BUFF_WRITE_READY
 );
@@ -160,6 +172,81 @@ static mx_status_t sdhci_await_irq(sdhci_device_t* dev) {
     return MX_OK;
 }
 
+// Describes the first |length| bytes of |txn| to the controller's DMA
+// engine. Returns MX_ERR_NOT_SUPPORTED if its pages won't fit the table, or
+// are out of the controller's reach, in which case it moves by PIO instead.
+static mx_status_t sdhci_setup_dma(sdhci_device_t* dev, iotxn_t* txn, size_t length) {
+    if (length > txn->length) {
+        return MX_ERR_INVALID_ARGS;
+    }
+    mx_status_t st;
+    if ((st = iotxn_physmap(txn)) != MX_OK) {
+        return st;
+    }
+
+    sdhci_adma2_desc_t* descs = io_buffer_virt(&dev->descs);
+    sdhci_adma2_desc64_t* descs64 = io_buffer_virt(&dev->descs);
+    const size_t desc_size = dev->dma64 ? sizeof(*descs64) : sizeof(*descs);
+    const size_t max_descs = PAGE_SIZE / desc_size;
+
+    iotxn_phys_iter_t iter;
+    iotxn_phys_iter_init(&iter, txn, ADMA2_MAX_LENGTH);
+    size_t count = 0;
+    while (length > 0) {
+        mx_paddr_t paddr;
+        size_t chunk = iotxn_phys_iter_next(&iter, &paddr);
+        MX_DEBUG_ASSERT(chunk != 0);
+        if (chunk > length) {
+            chunk = length;
+        }
+        if (count == max_descs) {
+            return MX_ERR_NOT_SUPPORTED;
+        }
+        paddr += dev->dma_offset;
+        const uint16_t attr = SDHCI_ADMA2_DESC_VALID | SDHCI_ADMA2_DESC_ACT_TRAN;
+        if (dev->dma64) {
+            descs64[count] = (sdhci_adma2_desc64_t){
+                .attr = attr, .length = (uint16_t)chunk, .address = paddr,
+            };
+        } else {
+            if ((paddr + chunk - 1) > UINT32_MAX) {
+                return MX_ERR_NOT_SUPPORTED;
+            }
+            descs[count] = (sdhci_adma2_desc_t){
+                .attr = attr, .length = (uint16_t)chunk, .address = (uint32_t)paddr,
+            };
+        }
+        count++;
+        length -= chunk;
+    }
+    if (count == 0) {
+        return MX_ERR_INVALID_ARGS;
+    }
+    if (dev->dma64) {
+        descs64[count - 1].attr |= SDHCI_ADMA2_DESC_END;
+    } else {
+        descs[count - 1].attr |= SDHCI_ADMA2_DESC_END;
+    }
+    io_buffer_cache_op(&dev->descs, IOTXN_CACHE_CLEAN, 0, count * desc_size);
+
+    const mx_paddr_t table = io_buffer_phys(&dev->descs) + dev->dma_offset;
+    dev->regs->admaaddr0 = (uint32_t)table;
+    dev->regs->admaaddr1 = (uint32_t)(table >> 32);
+    return MX_OK;
+}
+
+// After an ADMA error the data line stays in the error state until reset.
+static void sdhci_reset_dat(sdhci_device_t* dev) {
+    dev->regs->ctrl1 |= SDHCI_SOFTWARE_RESET_DAT;
+    const mx_time_t deadline = mx_time_get(MX_CLOCK_MONOTONIC) + MX_MSEC(100);
+    while (dev->regs->ctrl1 & SDHCI_SOFTWARE_RESET_DAT) {
+        if (mx_time_get(MX_CLOCK_MONOTONIC) > deadline) {
+            printf("sdhci: timed out resetting the data line\n");
+            return;
+        }
+    }
+}
+
 static void sdhci_iotxn_queue(void* ctx, iotxn_t* txn) {
     // Ensure that the offset is some multiple of the block size, we don't allow
     // writes that are partway into a block.
@@ -205,15 +292,36 @@ static void sdhci_iotxn_queue(void* ctx, iotxn_t* txn) {
         mx_nanosleep(mx_deadline_after(MX_MSEC(1)));
 
     // This command has a data phase?
+    const size_t length = blkcnt * blksiz;
+    bool dma = false;
     if (cmd & SDMMC_RESP_DATA_PRESENT) {
-        iotxn_physmap(txn);
-        MX_DEBUG_ASSERT(txn->phys_count == 1);
-        regs->arg2 = iotxn_phys(txn) + dev->dma_offset;
+        if (dev->dma) {
+            st = sdhci_setup_dma(dev, txn, length);
+            if (st == MX_OK) {
+                dma = true;
+                cmd |= SDMMC_CMD_DMA_EN;
+            } else if (st != MX_ERR_NOT_SUPPORTED) {
+                iotxn_complete(txn, st, 0);
+                goto exit;
+            }
+        }
 
-        iotxn_cacheop(txn, IOTXN_CACHE_CLEAN, 0, blkcnt * blksiz);
+        if (dma) {
+            // Nothing of the buffer may be left in the cache to be written
+            // back over what the controller puts there.
+            iotxn_cacheop(txn, (cmd & SDMMC_CMD_READ) ? IOTXN_CACHE_CLEAN_INVALIDATE
+                                                      : IOTXN_CACHE_CLEAN, 0, length);
+        }
 
-        if (cmd & SDMMC_CMD_MULTI_BLK)
-            cmd |= SDMMC_CMD_AUTO12;
+        // The host ends a multi-block transfer itself, by setting the block
+        // count ahead with CMD23 if the card takes it, or else by CMD12.
+        if (cmd & SDMMC_CMD_MULTI_BLK) {
+            if ((cmd & SDMMC_CMD_AUTO23) == SDMMC_CMD_AUTO23) {
+                regs->arg2 = blkcnt;
+            } else {
+                cmd |= SDMMC_CMD_AUTO12;
+            }
+        }
     }
 
     regs->blkcntsiz = (blksiz | (blkcnt << 16));
@@ -225,7 +333,7 @@ static void sdhci_iotxn_queue(void* ctx, iotxn_t* txn) {
     regs->irqen = error_interrupts | SDHCI_IRQ_CMD_CPLT;
 
     // Clear any pending interrupts before starting the transaction.
-    regs->irq = regs->irqen;
+    regs->irq = error_interrupts | normal_interrupts;
 
     // And we're off to the races!
     regs->cmd = cmd;
@@ -250,7 +358,24 @@ static void sdhci_iotxn_queue(void* ctx, iotxn_t* txn) {
 
 
     size_t bytes_copied = 0;
-    if (cmd & SDMMC_RESP_DATA_PRESENT) {
+    if (dma) {
+        // The controller raises one interrupt once the whole transfer, and
+        // any auto command after it, is done.
+        regs->irqen = error_interrupts | SDHCI_IRQ_XFER_CPLT;
+        if ((st = sdhci_await_irq(dev)) != MX_OK) {
+            if (dev->irq & SDHCI_IRQ_ERR_ADMA) {
+                printf("sdhci: adma error 0x%x at 0x%08x%08x\n", regs->admaerr,
+                       regs->admaaddr1, regs->admaaddr0);
+            }
+            sdhci_reset_dat(dev);
+            iotxn_complete(txn, st, 0);
+            goto exit;
+        }
+        if (cmd & SDMMC_CMD_READ) {
+            iotxn_cacheop(txn, IOTXN_CACHE_INVALIDATE, 0, length);
+        }
+        bytes_copied = length;
+    } else if (cmd & SDMMC_RESP_DATA_PRESENT) {
         // Select the interrupt that we want to wait on based on whether we're
         // reading or writing.
         if (cmd & SDMMC_CMD_READ) {
@@ -261,11 +386,8 @@ static void sdhci_iotxn_queue(void* ctx, iotxn_t* txn) {
 
         // Sequentially read or write each block.
         // BCM28xx quirk: The BCM28xx appears to use its internal DMA engine to
-        // perform transfers against the SD card. Normally we would use SDMA or
-        // ADMA (if the part supported it). Since this part doesn't appear to
-        // support either, we just use PIO.
-        // TODO(yky): add DMA mode if it works on intel and add quirk/detection
-        // to do PIO
+        // perform transfers against the SD card, so neither SDMA nor ADMA can
+        // be used with it (see SDHCI_QUIRK_NO_DMA).
         for (size_t blkid = 0; blkid < blkcnt; blkid++) {
             mx_status_t st;
             if ((st = sdhci_await_irq(dev)) != MX_OK) {
@@ -427,6 +549,7 @@ static void sdhci_unbind(void* ctx) {
 
 static void sdhci_release(void* ctx) {
     sdhci_device_t* dev = ctx;
+    io_buffer_release(&dev->descs);
     free(dev);
 }
 
@@ -512,6 +635,13 @@ static mx_status_t sdhci_controller_init(sdhci_device_t* dev) {
     dev->regs->ctrl1 = ctrl1;
     mx_nanosleep(mx_deadline_after(MX_MSEC(2)));
 
+    // Select ADMA2, which the reset cleared.
+    if (dev->dma) {
+        uint32_t ctrl0 = dev->regs->ctrl0 & ~SDHCI_HOSTCTRL_DMA_SELECT_MASK;
+        ctrl0 |= dev->dma64 ? SDHCI_HOSTCTRL_DMA_SELECT_ADMA2_64 : SDHCI_HOSTCTRL_DMA_SELECT_ADMA2;
+        dev->regs->ctrl0 = ctrl0;
+    }
+
     // Disable all interrupts
     dev->regs->irqen = 0;
     dev->regs->irq = 0xffffffff;
@@ -574,6 +704,17 @@ static mx_status_t sdhci_bind(void* ctx, mx_device_t* parent, void** cookie) {
     dev->dma_offset = sdhci.ops->get_dma_offset(sdhci.ctx);
     dev->quirks = sdhci.ops->get_quirks(sdhci.ctx);
 
+    // Use ADMA2 where the controller has it, unless it's known not to work.
+    const uint32_t caps0 = dev->regs->caps0;
+    if ((caps0 & SDHCI_CORECFG_ADMA2_SUPPORT) && !(dev->quirks & SDHCI_QUIRK_NO_DMA)) {
+        if ((status = io_buffer_init(&dev->descs, PAGE_SIZE, IO_BUFFER_RW)) != MX_OK) {
+            printf("sdhci: error %d allocating dma descriptors\n", status);
+            goto fail;
+        }
+        dev->dma = true;
+        dev->dma64 = !!(caps0 & SDHCI_CORECFG_64BIT_SUPPORT);
+    }
+
     // initialize the controller
     status = sdhci_controller_init(dev);
     if (status != MX_OK) {
@@ -599,6 +740,7 @@ fail:
         if (dev->irq_handle != MX_HANDLE_INVALID) {
             mx_handle_close(dev->irq_handle);
         }
+        io_buffer_release(&dev->descs);
         free(dev);
     }
     return status;
@@ -52,6 +52,8 @@ typedef struct sdmmc {
     mx_device_t* sdmmc_mxdev;
     uint16_t rca;
     uint64_t capacity;
+    // whether the card takes SET_BLOCK_COUNT ahead of multi-block transfers
+    bool cmd23;
     block_callbacks_t* callbacks;
 } sdmmc_t;
 
@@ -207,6 +209,10 @@ static void sdmmc_iotxn_queue(void* ctx, iotxn_t* txn) {
         goto out;
     }
 
+    if ((cmd & SDMMC_CMD_MULTI_BLK) && sdmmc->cmd23) {
+        cmd |= SDMMC_CMD_AUTO23;
+    }
+
     // Which block to operate against.
     const uint32_t blkid = emmc_txn->offset / SDHC_BLOCK_SIZE;
 
@@ -494,6 +500,10 @@ static int sdmmc_bootstrap_thread(void* arg) {
     iotxn_copyfrom(setup_txn, &scr, sizeof(scr), 0);
     scr = be32toh(scr);
 
+    // CMD_SUPPORT, in the bottom bits of the word, says whether SET_BLOCK_COUNT
+    // is supported.
+    sdmmc->cmd23 = !!(scr & 0x2);
+
     // If this card supports 4 bit mode, then put it into 4 bit mode.
     const uint32_t supported_bus_widths = (scr >> 16) & 0xf;
     if (supported_bus_widths & 0x4) {
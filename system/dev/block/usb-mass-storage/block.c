@@ -10,11 +10,9 @@
 static void ums_block_queue(void* ctx, iotxn_t* txn) {
     ums_block_t* dev = ctx;
 
-    if (txn->offset % dev->block_size) {
-        iotxn_complete(txn, MX_ERR_INVALID_ARGS, 0);
-        return;
-    }
-    if (txn->length % dev->block_size) {
+    if (txn->opcode == IOTXN_OP_FLUSH) {
+        txn->length = 0;
+    } else if ((txn->offset % dev->block_size) || (txn->length % dev->block_size)) {
         iotxn_complete(txn, MX_ERR_INVALID_ARGS, 0);
         return;
     }
@@ -32,6 +30,7 @@ static void ums_get_info(void* ctx, block_info_t* info) {
     memset(info, 0, sizeof(*info));
     info->block_size = dev->block_size;
     info->block_count = dev->total_blocks;
+    info->max_transfer_size = dev->chunk_blocks * UMS_MAX_DATA_TXNS * dev->block_size;
     info->flags = dev->flags;
 }
 
@@ -138,11 +137,28 @@ static void ums_async_write(void* ctx, mx_handle_t vmo, uint64_t length,
     iotxn_queue(dev->mxdev, txn);
 }
 
+static void ums_async_flush(void* ctx, void* cookie) {
+    ums_block_t* dev = ctx;
+
+    iotxn_t* txn;
+    mx_status_t status = iotxn_alloc(&txn, IOTXN_ALLOC_POOL, 0);
+    if (status != MX_OK) {
+        dev->cb->complete(cookie, status);
+        return;
+    }
+    txn->opcode = IOTXN_OP_FLUSH;
+    txn->complete_cb = ums_async_complete;
+    txn->cookie = cookie;
+    txn->extra[0] = (uintptr_t)dev;
+    iotxn_queue(dev->mxdev, txn);
+}
+
 static block_protocol_ops_t ums_block_ops = {
     .set_callbacks = ums_async_set_callbacks,
     .get_info = ums_get_info,
     .read = ums_async_read,
     .write = ums_async_write,
+    .flush = ums_async_flush,
 };
 
 mx_status_t ums_block_add_device(ums_t* ums, ums_block_t* dev) {
@@ -70,18 +70,24 @@ static void ums_send_cbw(ums_t* ums, uint8_t lun, uint32_t transfer_length, uint
     // copy command_len bytes from the command passed in into the command_len
     memcpy(cbw->CBWCB, command, command_len);
 
-    completion_t completion = COMPLETION_INIT;
-    txn->cookie = &completion;
+    // The data and status phases are queued behind the CBW without waiting
+    // for it; the CSW can't arrive until it has been taken.
+    completion_reset(&ums->cbw_completion);
+    txn->cookie = &ums->cbw_completion;
     ums_queue_request(ums, txn);
-    completion_wait(&completion, MX_TIME_INFINITE);
 }
 
-static mx_status_t ums_read_csw(ums_t* ums, uint32_t* out_residue) {
-    completion_t completion = COMPLETION_INIT;
+static void ums_queue_csw(ums_t* ums) {
     iotxn_t* csw_request = ums->csw_iotxn;
-    csw_request->cookie = &completion;
+    completion_reset(&ums->csw_completion);
+    csw_request->cookie = &ums->csw_completion;
     ums_queue_request(ums, csw_request);
-    completion_wait(&completion, MX_TIME_INFINITE);
+}
+
+static mx_status_t ums_wait_csw(ums_t* ums, uint32_t* out_residue) {
+    iotxn_t* csw_request = ums->csw_iotxn;
+    completion_wait(&ums->csw_completion, MX_TIME_INFINITE);
+    completion_wait(&ums->cbw_completion, MX_TIME_INFINITE);
 
     csw_status_t csw_error = ums_verify_csw(ums, csw_request, out_residue);
 
@@ -98,6 +104,11 @@ static mx_status_t ums_read_csw(ums_t* ums, uint32_t* out_residue) {
     }
 }
 
+static mx_status_t ums_read_csw(ums_t* ums, uint32_t* out_residue) {
+    ums_queue_csw(ums);
+    return ums_wait_csw(ums, out_residue);
+}
+
 static csw_status_t ums_verify_csw(ums_t* ums, iotxn_t* csw_request, uint32_t* out_residue) {
     ums_csw_t csw;
     iotxn_copyfrom(csw_request, &csw, sizeof(csw), 0);
@@ -240,35 +251,45 @@ static mx_status_t ums_mode_sense6(ums_t* ums, uint8_t lun, scsi_mode_sense_6_da
     return status;
 }
 
-static mx_status_t ums_data_transfer(ums_t* ums, iotxn_t* txn, mx_off_t offset, size_t length,
-                                     uint8_t ep_address) {
-    iotxn_t* clone = NULL;
-    mx_status_t status = iotxn_clone_partial(txn, txn->vmo_offset + offset, length, &clone);
-    if (status != MX_OK) {
-        return status;
-    }
-    clone->complete_cb = ums_txn_complete;
-
-    usb_protocol_data_t* pdata = iotxn_pdata(clone, usb_protocol_data_t);
-    memset(pdata, 0, sizeof(*pdata));
-    pdata->ep_address = ep_address;
-
-    completion_t completion = COMPLETION_INIT;
-    clone->cookie = &completion;
-    ums_queue_request(ums, clone);
-    completion_wait(&completion, MX_TIME_INFINITE);
-
-    status = clone->status;
-    if (status == MX_OK && clone->actual != length) {
-        status = MX_ERR_IO;
+static void ums_send_rw_cbw(ums_t* ums, ums_block_t* dev, bool is_read, uint64_t lba,
+                            uint32_t blocks) {
+    uint32_t length = blocks * dev->block_size;
+    uint8_t flags = is_read ? USB_DIR_IN : USB_DIR_OUT;
+
+    // Need to use READ16 / WRITE16 if block addresses are greater than 32 bit
+    if (dev->total_blocks > UINT32_MAX) {
+        scsi_command16_t command;
+        memset(&command, 0, sizeof(command));
+        command.opcode = is_read ? UMS_READ16 : UMS_WRITE16;
+        command.lba = htobe64(lba);
+        command.length = htobe32(blocks);
+        ums_send_cbw(ums, dev->lun, length, flags, sizeof(command), &command);
+    } else if (blocks <= UINT16_MAX) {
+        scsi_command10_t command;
+        memset(&command, 0, sizeof(command));
+        command.opcode = is_read ? UMS_READ10 : UMS_WRITE10;
+        command.lba = htobe32(lba);
+        command.length_hi = blocks >> 8;
+        command.length_lo = blocks & 0xFF;
+        ums_send_cbw(ums, dev->lun, length, flags, sizeof(command), &command);
+    } else {
+        scsi_command12_t command;
+        memset(&command, 0, sizeof(command));
+        command.opcode = is_read ? UMS_READ12 : UMS_WRITE12;
+        command.lba = htobe32(lba);
+        command.length = htobe32(blocks);
+        ums_send_cbw(ums, dev->lun, length, flags, sizeof(command), &command);
     }
-
-    iotxn_release(clone);
-    return status;
 }
 
-static ssize_t ums_read(ums_block_t* dev, iotxn_t* txn) {
+// Reads or writes |txn|, with as few commands as the device's limits allow.
+// The data phase of each is split into transfers the host controller can
+// take, and they are queued along with the CBW and CSW, so that the device
+// is never left waiting for the next part of the command.
+static ssize_t ums_transfer(ums_block_t* dev, iotxn_t* txn) {
     ums_t* ums = block_to_ums(dev);
+    bool is_read = txn->opcode == IOTXN_OP_READ;
+    uint8_t ep_address = is_read ? ums->bulk_in_addr : ums->bulk_out_addr;
 
     uint64_t lba = txn->offset / dev->block_size;
     if (lba > dev->total_blocks) {
@@ -283,7 +304,7 @@ static ssize_t ums_read(ums_block_t* dev, iotxn_t* txn) {
     }
 
     size_t blocks_transferred = 0;
-    size_t max_blocks = ums->max_transfer / dev->block_size;
+    size_t max_blocks = dev->chunk_blocks * UMS_MAX_DATA_TXNS;
     mx_status_t status = MX_OK;
 
     while (status == MX_OK && blocks_transferred < num_blocks) {
@@ -292,44 +313,68 @@ static ssize_t ums_read(ums_block_t* dev, iotxn_t* txn) {
             blocks = max_blocks;
         }
         size_t length = blocks * dev->block_size;
-
-        // CBW Configuration
-        // Need to use UMS_READ16 if block addresses are greater than 32 bit
-        if (dev->total_blocks > UINT32_MAX) {
-            scsi_command16_t command;
-            memset(&command, 0, sizeof(command));
-            command.opcode = UMS_READ16;
-            command.lba = htobe64(lba + blocks_transferred);
-            command.length = htobe32(blocks);
-            ums_send_cbw(ums, dev->lun, length, USB_DIR_IN, sizeof(command), &command);
-        } else if (blocks <= UINT16_MAX) {
-            scsi_command10_t command;
-            memset(&command, 0, sizeof(command));
-            command.opcode = UMS_READ10;
-            command.lba = htobe32(lba + blocks_transferred);
-            command.length_hi = blocks >> 8;
-            command.length_lo = blocks & 0xFF;
-            ums_send_cbw(ums, dev->lun, length, USB_DIR_IN, sizeof(command), &command);
-        } else {
-            scsi_command12_t command;
-            memset(&command, 0, sizeof(command));
-            command.opcode = UMS_READ12;
-            command.lba = htobe32(lba + blocks_transferred);
-            command.length = htobe32(blocks);
-            ums_send_cbw(ums, dev->lun, length, USB_DIR_IN, sizeof(command), &command);
+        size_t chunk = dev->chunk_blocks * dev->block_size;
+
+        // All of the data phase is ready before the command is sent, since
+        // the device can't be left expecting data which never comes.
+        iotxn_t* clones[UMS_MAX_DATA_TXNS];
+        completion_t completions[UMS_MAX_DATA_TXNS];
+        size_t count = 0;
+        for (size_t done = 0; done < length; done += chunk, count++) {
+            size_t n = (length - done < chunk) ? length - done : chunk;
+            mx_off_t offset = blocks_transferred * dev->block_size + done;
+            if ((status = iotxn_clone_partial(txn, txn->vmo_offset + offset, n,
+                                              &clones[count])) != MX_OK) {
+                break;
+            }
+            clones[count]->complete_cb = ums_txn_complete;
+            completions[count] = COMPLETION_INIT;
+            clones[count]->cookie = &completions[count];
+            usb_protocol_data_t* pdata = iotxn_pdata(clones[count], usb_protocol_data_t);
+            memset(pdata, 0, sizeof(*pdata));
+            pdata->ep_address = ep_address;
+        }
+        if (status != MX_OK) {
+            while (count > 0) {
+                iotxn_release(clones[--count]);
+            }
+            break;
         }
 
-        status = ums_data_transfer(ums, txn, blocks_transferred * dev->block_size, length,
-                                   ums->bulk_in_addr);
+        ums_send_rw_cbw(ums, dev, is_read, lba + blocks_transferred, blocks);
+        for (size_t i = 0; i < count; i++) {
+            ums_queue_request(ums, clones[i]);
+        }
+        ums_queue_csw(ums);
+
+        mx_status_t data_status = MX_OK;
+        for (size_t i = 0; i < count; i++) {
+            completion_wait(&completions[i], MX_TIME_INFINITE);
+            if (data_status == MX_OK) {
+                if (clones[i]->status != MX_OK) {
+                    data_status = clones[i]->status;
+                } else if (clones[i]->actual != clones[i]->length) {
+                    data_status = MX_ERR_IO;
+                }
+            }
+            iotxn_release(clones[i]);
+        }
+        if (data_status != MX_OK) {
+            // A stalled data phase must be cleared for the CSW to follow.
+            usb_reset_endpoint(ums->usb_mxdev, ep_address);
+        }
         blocks_transferred += blocks;
 
         // receive CSW
         uint32_t residue;
-        status = ums_read_csw(ums, &residue);
+        status = ums_wait_csw(ums, &residue);
         if (status == MX_OK && residue) {
-            printf("unexpected residue in ums_read\n");
+            printf("unexpected residue in ums_transfer\n");
             status = MX_ERR_IO;
         }
+        if (status == MX_OK) {
+            status = data_status;
+        }
     }
 
     if (status == MX_OK) {
@@ -339,75 +384,17 @@ static ssize_t ums_read(ums_block_t* dev, iotxn_t* txn) {
     }
 }
 
-static ssize_t ums_write(ums_block_t* dev, iotxn_t* txn) {
+static mx_status_t ums_synchronize_cache(ums_block_t* dev) {
     ums_t* ums = block_to_ums(dev);
 
-    uint64_t lba = txn->offset / dev->block_size;
-    if (lba > dev->total_blocks) {
-        return MX_ERR_OUT_OF_RANGE;
-    }
-    uint32_t num_blocks = txn->length / dev->block_size;
-    if (lba + num_blocks >= dev->total_blocks) {
-        num_blocks = dev->total_blocks - lba;
-        if (num_blocks == 0) {
-            return 0;
-        }
-    }
-
-    size_t blocks_transferred = 0;
-    size_t max_blocks = ums->max_transfer / dev->block_size;
-    mx_status_t status = MX_OK;
-
-    while (status == MX_OK && blocks_transferred < num_blocks) {
-        size_t blocks = num_blocks - blocks_transferred;
-        if (blocks > max_blocks) {
-            blocks = max_blocks;
-        }
-        size_t length = blocks * dev->block_size;
-
-        // Need to use UMS_WRITE16 if block addresses are greater than 32 bit
-        if (dev->total_blocks > UINT32_MAX) {
-            scsi_command16_t command;
-            memset(&command, 0, sizeof(command));
-            command.opcode = UMS_WRITE16;
-            command.lba = htobe64(lba + blocks_transferred);
-            command.length = htobe32(blocks);
-            ums_send_cbw(ums, dev->lun, length, USB_DIR_OUT, sizeof(command), &command);
-        } else if (blocks <= UINT16_MAX) {
-            scsi_command10_t command;
-            memset(&command, 0, sizeof(command));
-            command.opcode = UMS_WRITE10;
-            command.lba = htobe32(lba + blocks_transferred);
-            command.length_hi = blocks >> 8;
-            command.length_lo = blocks & 0xFF;
-            ums_send_cbw(ums, dev->lun, length, USB_DIR_OUT, sizeof(command), &command);
-        } else {
-            scsi_command12_t command;
-            memset(&command, 0, sizeof(command));
-            command.opcode = UMS_WRITE12;
-            command.lba = htobe32(lba + blocks_transferred);
-            command.length = htobe32(blocks);
-            ums_send_cbw(ums, dev->lun, length, USB_DIR_OUT, sizeof(command), &command);
-        }
-
-        status = ums_data_transfer(ums, txn, blocks_transferred * dev->block_size, length,
-                                   ums->bulk_out_addr);
-        blocks_transferred += blocks;
-
-        // receive CSW
-        uint32_t residue;
-        status = ums_read_csw(ums, &residue);
-        if (status == MX_OK && residue) {
-            printf("unexpected residue in ums_write\n");
-            status = MX_ERR_IO;
-        }
-    }
+    // Covers the whole unit, since both the LBA and the block count are zero
+    scsi_command10_t command;
+    memset(&command, 0, sizeof(command));
+    command.opcode = UMS_SYNCHRONIZE_CACHE;
+    ums_send_cbw(ums, dev->lun, 0, USB_DIR_OUT, sizeof(command), &command);
 
-    if (status == MX_OK) {
-        return num_blocks * dev->block_size;
-    } else {
-        return status;
-    }
+    // wait for CSW
+    return ums_read_csw(ums, NULL);
 }
 
 static void ums_unbind(void* ctx) {
@@ -483,6 +470,19 @@ static mx_status_t ums_add_block_device(ums_block_t* dev) {
     // +1 because this returns the address of the final block, and blocks are zero indexed
     dev->total_blocks++;
 
+    // Each transfer of a data phase is whole blocks, and whole packets but
+    // for the last, so that no short packet ends the phase early.
+    size_t max_packet = (ums->bulk_in_max_packet > ums->bulk_out_max_packet) ?
+                        ums->bulk_in_max_packet : ums->bulk_out_max_packet;
+    dev->chunk_blocks = ums->max_transfer / dev->block_size;
+    while ((dev->chunk_blocks > 1) && ((dev->chunk_blocks * dev->block_size) % max_packet)) {
+        dev->chunk_blocks--;
+    }
+    if (dev->chunk_blocks == 0) {
+        printf("UMS block size %u is larger than a transfer\n", dev->block_size);
+        return MX_ERR_NOT_SUPPORTED;
+    }
+
     // determine if LUN is read-only
     scsi_mode_sense_6_data_t ms_data;
     status = ums_mode_sense6(ums, lun, &ms_data);
@@ -610,10 +610,10 @@ static int ums_worker_thread(void* arg) {
         ums_block_t* dev = txn->context;
 
         mx_status_t status;
-        if (txn->opcode == IOTXN_OP_READ) {
-            status = ums_read(dev, txn);
-        }else if (txn->opcode == IOTXN_OP_WRITE) {
-            status = ums_write(dev, txn);
+        if ((txn->opcode == IOTXN_OP_READ) || (txn->opcode == IOTXN_OP_WRITE)) {
+            status = ums_transfer(dev, txn);
+        } else if (txn->opcode == IOTXN_OP_FLUSH) {
+            status = ums_synchronize_cache(dev);
         } else {
             status = MX_ERR_INVALID_ARGS;
         }
@@ -727,6 +727,8 @@ static mx_status_t ums_bind(void* ctx, mx_device_t* device, void** cookie) {
     list_initialize(&ums->queued_iotxns);
     list_initialize(&ums->sync_nodes);
     completion_reset(&ums->iotxn_completion);
+    ums->cbw_completion = COMPLETION_INIT;
+    ums->csw_completion = COMPLETION_INIT;
     mtx_init(&ums->iotxn_lock, mtx_plain);
 
     ums->usb_mxdev = device;
@@ -20,6 +20,9 @@ typedef struct {
     list_node_t node;           // node for ums_t.sync_nodes list
 } ums_sync_node_t;
 
+// The most USB transfers the data phase of a single command is split into.
+#define UMS_MAX_DATA_TXNS 16
+
 // struct representing a block device for a logical unit
 typedef struct {
     mx_device_t* mxdev;         // block device we publish
@@ -27,6 +30,7 @@ typedef struct {
 
     uint64_t total_blocks;
     uint32_t block_size;
+    uint32_t chunk_blocks;      // blocks in each USB transfer of a data phase
 
     uint8_t lun;                // our logical unit number
     uint32_t flags;             // flags for block_info_t
@@ -52,6 +56,8 @@ typedef struct {
     iotxn_t* cbw_iotxn;
     iotxn_t* data_iotxn;
     iotxn_t* csw_iotxn;
+    completion_t cbw_completion;    // signaled when cbw_iotxn completes
+    completion_t csw_completion;    // signaled when csw_iotxn completes
 
     thrd_t worker_thread;
     bool dead;
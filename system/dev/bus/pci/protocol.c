@@ -179,6 +179,11 @@ static mx_status_t pci_set_irq_mode(void* ctx, mx_pci_irq_mode_t mode,
     return mx_pci_set_irq_mode(device->handle, mode, requested_irq_count);
 }
 
+static mx_status_t pci_set_irq_affinity(void* ctx, uint32_t which_irq, uint32_t cpu_num) {
+    kpci_device_t* device = ctx;
+    return mx_pci_set_irq_affinity(device->handle, which_irq, cpu_num);
+}
+
 static mx_status_t pci_get_device_info(void* ctx, mx_pcie_device_info_t* out_info) {
     if (out_info == NULL) {
         return MX_ERR_INVALID_ARGS;
@@ -198,5 +203,6 @@ static pci_protocol_ops_t _pci_protocol = {
     .map_interrupt = pci_map_interrupt,
     .query_irq_mode_caps = pci_query_irq_mode_caps,
     .set_irq_mode = pci_set_irq_mode,
+    .set_irq_affinity = pci_set_irq_affinity,
     .get_device_info = pci_get_device_info,
 };
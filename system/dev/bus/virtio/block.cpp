@@ -7,6 +7,8 @@
 #include <ddk/protocol/block.h>
 #include <inttypes.h>
 #include <magenta/compiler.h>
+#include <magenta/syscalls.h>
+#include <mxalloc/new.h>
 #include <mxtl/algorithm.h>
 #include <mxtl/auto_lock.h>
 #include <pretty/hexdump.h>
@@ -31,14 +33,21 @@ void BlockDevice::virtio_block_iotxn_queue(void* ctx, iotxn_t* txn) {
     BlockDevice* bd = static_cast<BlockDevice*>(ctx);
 
     switch (txn->opcode) {
-    case IOTXN_OP_READ: {
+    case IOTXN_OP_READ:
         LTRACEF("READ offset %#" PRIx64 " length %#" PRIx64 "\n", txn->offset, txn->length);
-        bd->QueueReadWriteTxn(txn);
+        bd->QueueTxn(txn);
         break;
-    }
     case IOTXN_OP_WRITE:
         LTRACEF("WRITE offset %#" PRIx64 " length %#" PRIx64 "\n", txn->offset, txn->length);
-        bd->QueueReadWriteTxn(txn);
+        bd->QueueTxn(txn);
+        break;
+    case IOTXN_OP_FLUSH:
+        LTRACEF("FLUSH\n");
+        bd->QueueTxn(txn);
+        break;
+    case IOTXN_OP_DISCARD:
+        LTRACEF("DISCARD offset %#" PRIx64 " length %#" PRIx64 "\n", txn->offset, txn->length);
+        bd->QueueTxn(txn);
         break;
     default:
         iotxn_complete(txn, -1, 0);
@@ -60,7 +69,11 @@ void BlockDevice::GetInfo(block_info_t* info) {
     memset(info, 0, sizeof(*info));
     info->block_size = GetBlockSize();
     info->block_count = GetSize() / GetBlockSize();
-    info->max_transfer_size = (uint32_t)(PAGE_SIZE * (ring_size - 2));
+    // a transfer that doesn't start on a page boundary spans one more page than its length
+    info->max_transfer_size = (uint32_t)(PAGE_SIZE * (max_segments_ - 1));
+    if (has_discard_) {
+        info->flags |= BLOCK_FLAG_DISCARD;
+    }
 }
 
 mx_status_t BlockDevice::virtio_block_ioctl(void* ctx, uint32_t op, const void* in_buf, size_t in_len,
@@ -115,14 +128,15 @@ void BlockDevice::virtio_block_complete(iotxn_t* txn, void* cookie) {
 
 void BlockDevice::block_do_txn(BlockDevice* dev, uint32_t opcode,
                                mx_handle_t vmo, uint64_t length,
-                               uint64_t vmo_offset, uint64_t dev_offset, void* cookie) {
+                               uint64_t vmo_offset, uint64_t dev_offset,
+                               mx_paddr_t* phys, uint64_t phys_count, void* cookie) {
     LTRACEF("vmo offset %#lx dev_offset %#lx length %#lx\n", vmo_offset, dev_offset, length);
     if ((dev_offset % dev->GetBlockSize()) || (length % dev->GetBlockSize())) {
         dev->callbacks_->complete(cookie, MX_ERR_INVALID_ARGS);
         return;
     }
     uint64_t size = dev->GetSize();
-    if ((dev_offset >= size) || (length >= (size - dev_offset))) {
+    if ((dev_offset >= size) || (length > (size - dev_offset))) {
         dev->callbacks_->complete(cookie, MX_ERR_OUT_OF_RANGE);
         return;
     }
@@ -137,6 +151,8 @@ void BlockDevice::block_do_txn(BlockDevice* dev, uint32_t opcode,
     txn->opcode = opcode;
     txn->length = length;
     txn->offset = dev_offset;
+    txn->phys = phys;
+    txn->phys_count = phys_count;
     txn->complete_cb = virtio_block_complete;
     txn->cookie = cookie;
     txn->extra[0] = (uint64_t)dev;
@@ -147,13 +163,77 @@ void BlockDevice::block_do_txn(BlockDevice* dev, uint32_t opcode,
 void BlockDevice::virtio_block_read(void* ctx, mx_handle_t vmo,
                                     uint64_t length, uint64_t vmo_offset,
                                     uint64_t dev_offset, void* cookie) {
-    block_do_txn((BlockDevice*)ctx, IOTXN_OP_READ, vmo, length, vmo_offset, dev_offset, cookie);
+    block_do_txn((BlockDevice*)ctx, IOTXN_OP_READ, vmo, length, vmo_offset, dev_offset,
+                 nullptr, 0, cookie);
 }
 
 void BlockDevice::virtio_block_write(void* ctx, mx_handle_t vmo,
                                      uint64_t length, uint64_t vmo_offset,
                                      uint64_t dev_offset, void* cookie) {
-    block_do_txn((BlockDevice*)ctx, IOTXN_OP_WRITE, vmo, length, vmo_offset, dev_offset, cookie);
+    block_do_txn((BlockDevice*)ctx, IOTXN_OP_WRITE, vmo, length, vmo_offset, dev_offset,
+                 nullptr, 0, cookie);
+}
+
+void BlockDevice::virtio_block_read_phys(void* ctx, mx_handle_t vmo,
+                                         uint64_t length, uint64_t vmo_offset,
+                                         uint64_t dev_offset, mx_paddr_t* phys,
+                                         uint64_t phys_count, void* cookie) {
+    block_do_txn((BlockDevice*)ctx, IOTXN_OP_READ, vmo, length, vmo_offset, dev_offset,
+                 phys, phys_count, cookie);
+}
+
+void BlockDevice::virtio_block_write_phys(void* ctx, mx_handle_t vmo,
+                                          uint64_t length, uint64_t vmo_offset,
+                                          uint64_t dev_offset, mx_paddr_t* phys,
+                                          uint64_t phys_count, void* cookie) {
+    block_do_txn((BlockDevice*)ctx, IOTXN_OP_WRITE, vmo, length, vmo_offset, dev_offset,
+                 phys, phys_count, cookie);
+}
+
+void BlockDevice::virtio_block_flush(void* ctx, void* cookie) {
+    BlockDevice* dev = static_cast<BlockDevice*>(ctx);
+
+    mx_status_t status;
+    iotxn_t* txn;
+    if ((status = iotxn_alloc(&txn, IOTXN_ALLOC_POOL, 0)) != MX_OK) {
+        dev->callbacks_->complete(cookie, status);
+        return;
+    }
+    txn->opcode = IOTXN_OP_FLUSH;
+    txn->complete_cb = virtio_block_complete;
+    txn->cookie = cookie;
+    txn->extra[0] = (uint64_t)dev;
+
+    iotxn_queue(dev->device_, txn);
+}
+
+void BlockDevice::virtio_block_discard(void* ctx, uint64_t length, uint64_t dev_offset,
+                                       void* cookie) {
+    BlockDevice* dev = static_cast<BlockDevice*>(ctx);
+    if ((dev_offset % dev->GetBlockSize()) || (length % dev->GetBlockSize())) {
+        dev->callbacks_->complete(cookie, MX_ERR_INVALID_ARGS);
+        return;
+    }
+    uint64_t size = dev->GetSize();
+    if ((dev_offset >= size) || (length > (size - dev_offset))) {
+        dev->callbacks_->complete(cookie, MX_ERR_OUT_OF_RANGE);
+        return;
+    }
+
+    mx_status_t status;
+    iotxn_t* txn;
+    if ((status = iotxn_alloc(&txn, IOTXN_ALLOC_POOL, 0)) != MX_OK) {
+        dev->callbacks_->complete(cookie, status);
+        return;
+    }
+    txn->opcode = IOTXN_OP_DISCARD;
+    txn->offset = dev_offset;
+    txn->length = length;
+    txn->complete_cb = virtio_block_complete;
+    txn->cookie = cookie;
+    txn->extra[0] = (uint64_t)dev;
+
+    iotxn_queue(dev->device_, txn);
 }
 
 mx_status_t BlockDevice::Init() {
@@ -162,8 +242,11 @@ mx_status_t BlockDevice::Init() {
     // reset the device
     Reset();
 
-    // read our configuration
-    CopyDeviceConfig(&config_, sizeof(config_));
+    // read our configuration; the legacy window into it stops short of the
+    // discard fields, so only devices with it mapped may discard
+    bool can_discard = mmio_regs_.device_config != nullptr;
+    CopyDeviceConfig(&config_, can_discard ? sizeof(config_)
+                                           : offsetof(virtio_blk_config_t, max_discard_sectors));
 
     LTRACEF("capacity %#" PRIx64 "\n", config_.capacity);
     LTRACEF("size_max %#x\n", config_.size_max);
@@ -173,31 +256,51 @@ mx_status_t BlockDevice::Init() {
     // ack and set the driver status bit
     StatusAcknowledgeDriver();
 
-    // XXX check features bits and ack/nak them
-
-    // allocate the main vring
-    auto err = vring_.Init(0, ring_size);
-    if (err < 0) {
-        VIRTIO_ERROR("failed to allocate vring\n");
-        return err;
+    // XXX check the rest of the feature bits and ack/nak them
+    uint32_t features = ReadDeviceFeatures();
+    LTRACEF("device features %#x\n", features);
+    features &= VIRTIO_BLK_F_FLUSH | VIRTIO_BLK_F_SEG_MAX | VIRTIO_BLK_F_MQ |
+                (can_discard ? VIRTIO_BLK_F_DISCARD : 0) |
+                (1u << VIRTIO_RING_F_INDIRECT_DESC) | (1u << VIRTIO_RING_F_EVENT_IDX);
+    WriteDriverFeatures(features);
+    has_flush_ = (features & VIRTIO_BLK_F_FLUSH) != 0;
+    // each discard is sent as a single range
+    has_discard_ = (features & VIRTIO_BLK_F_DISCARD) != 0;
+    max_discard_sectors_ = config_.max_discard_sectors ? config_.max_discard_sectors : UINT32_MAX;
+    indirect_ = (features & (1u << VIRTIO_RING_F_INDIRECT_DESC)) != 0;
+
+    // with indirect descriptors a request takes one slot of the ring however
+    // many runs it has, up to the size of its table
+    max_segments_ = (indirect_ ? kIndirectDescs : ring_size) - 2;
+    if ((features & VIRTIO_BLK_F_SEG_MAX) && (config_.seg_max > 0)) {
+        max_segments_ = mxtl::min(max_segments_, config_.seg_max);
     }
-
-    // allocate a queue of block requests
-    size_t size = sizeof(virtio_blk_req_t) * blk_req_count + sizeof(uint8_t) * blk_req_count;
-
-    mx_status_t r = map_contiguous_memory(size, (uintptr_t*)&blk_req_, &blk_req_pa_);
-    if (r < 0) {
-        VIRTIO_ERROR("cannot alloc blk_req buffers %d\n", r);
-        return r;
+    // a page is the least it takes for any transfer at all
+    max_segments_ = mxtl::max(max_segments_, 2u);
+
+    // a virtqueue per cpu, so that they don't all contend for one ring
+    uint16_t queue_count = 1;
+    if ((features & VIRTIO_BLK_F_MQ) && (config_.num_queues > 1)) {
+        queue_count = (uint16_t)mxtl::min<uint32_t>(
+            mxtl::min<uint32_t>(config_.num_queues, mx_system_get_num_cpus()), kMaxQueues);
     }
+    LTRACEF("%u queues, %u segments, indirect %d\n", queue_count, max_segments_, indirect_);
 
-    LTRACEF("allocated blk request at %p, physical address %#" PRIxPTR "\n", blk_req_, blk_req_pa_);
-
-    // responses are 32 words at the end of the allocated block
-    blk_res_pa_ = blk_req_pa_ + sizeof(virtio_blk_req_t) * blk_req_count;
-    blk_res_ = (uint8_t*)((uintptr_t)blk_req_ + sizeof(virtio_blk_req_t) * blk_req_count);
-
-    LTRACEF("allocated blk responses at %p, physical address %#" PRIxPTR "\n", blk_res_, blk_res_pa_);
+    for (uint16_t i = 0; i < queue_count; i++) {
+        AllocChecker ac;
+        queues_[i].reset(new (&ac) Queue(this));
+        if (!ac.check()) {
+            return MX_ERR_NO_MEMORY;
+        }
+        if (features & (1u << VIRTIO_RING_F_EVENT_IDX)) {
+            queues_[i]->ring.UseEventIndex();
+        }
+        mx_status_t r = InitQueue(queues_[i].get(), i);
+        if (r != MX_OK) {
+            return r;
+        }
+        queue_count_++;
+    }
 
     // start the interrupt thread
     StartIrqThread();
@@ -215,6 +318,14 @@ mx_status_t BlockDevice::Init() {
     device_block_ops_.get_info = &virtio_block_get_info;
     device_block_ops_.read = &virtio_block_read;
     device_block_ops_.write = &virtio_block_write;
+    device_block_ops_.read_phys = &virtio_block_read_phys;
+    device_block_ops_.write_phys = &virtio_block_write_phys;
+    if (has_flush_) {
+        device_block_ops_.flush = &virtio_block_flush;
+    }
+    if (has_discard_) {
+        device_block_ops_.discard = &virtio_block_discard;
+    }
 
     device_add_args_t args = {};
     args.version = DEVICE_ADD_ARGS_VERSION;
@@ -233,51 +344,100 @@ mx_status_t BlockDevice::Init() {
     return MX_OK;
 }
 
-void BlockDevice::IrqRingUpdate() {
-    LTRACE_ENTRY;
+mx_status_t BlockDevice::InitQueue(Queue* q, uint16_t index) {
+    mxtl::AutoLock lock(&q->lock);
 
-    // parse our descriptor chain, add back to the free queue
-    auto free_chain = [this](vring_used_elem* used_elem) {
-        uint32_t i = (uint16_t)used_elem->id;
-        struct vring_desc* desc = vring_.DescFromIndex((uint16_t)i);
-        auto head_desc = desc; // save the first element
-        for (;;) {
-            int next;
+    auto err = q->ring.Init(index, ring_size);
+    if (err < 0) {
+        VIRTIO_ERROR("failed to allocate vring %u\n", index);
+        return err;
+    }
 
-#if LOCAL_TRACE > 0
-            virtio_dump_desc(desc);
-#endif
+    // allocate the requests, each with its header, status byte and indirect table
+    size_t size = sizeof(Request) * kRequestsPerQueue;
+    mx_status_t r = map_contiguous_memory(size, (uintptr_t*)&q->requests, &q->requests_pa);
+    if (r < 0) {
+        VIRTIO_ERROR("cannot alloc blk_req buffers %d\n", r);
+        return r;
+    }
+    LTRACEF("queue %u requests at %p, physical address %#" PRIxPTR "\n", index, q->requests,
+            q->requests_pa);
 
-            if (desc->flags & VRING_DESC_F_NEXT) {
-                next = desc->next;
-            } else {
-                /* end of chain */
-                next = -1;
-            }
+    q->free_requests = (uint32_t)((1ull << kRequestsPerQueue) - 1);
+    return MX_OK;
+}
 
-            vring_.FreeDesc((uint16_t)i);
+void BlockDevice::IrqRingUpdate() {
+    LTRACE_ENTRY;
 
-            if (next < 0)
-                break;
-            i = next;
-            desc = vring_.DescFromIndex((uint16_t)i);
+    // what one interrupt completes is reported together
+    block_callbacks_t* callbacks = callbacks_;
+    if ((callbacks != nullptr) && (callbacks->batch_begin != nullptr)) {
+        callbacks->batch_begin();
+    }
+    for (uint16_t i = 0; i < queue_count_; i++) {
+        Queue* q = queues_[i].get();
+        list_node done = LIST_INITIAL_VALUE(done);
+        {
+            mxtl::AutoLock lock(&q->lock);
+            ReapLocked(q, &done);
         }
 
-        // search our pending txn list to see if this completes it
+        // completions may queue more txns straight away, so no queue lock is held here
         iotxn_t* txn;
-        list_for_every_entry (&iotxn_list, txn, iotxn_t, node) {
-            if (txn->context == head_desc) {
-                LTRACEF("completes txn %p\n", txn);
-                free_blk_req((unsigned int)txn->extra[1]);
-                list_delete(&txn->node);
+        while ((txn = list_remove_head_type(&done, iotxn_t, node)) != nullptr) {
+            if (txn->status == MX_OK) {
                 iotxn_complete(txn, MX_OK, txn->length);
-                break;
+            } else {
+                iotxn_complete(txn, txn->status, 0);
             }
         }
+    }
+    if ((callbacks != nullptr) && (callbacks->batch_end != nullptr)) {
+        callbacks->batch_end();
+    }
+}
+
+void BlockDevice::ReapLocked(Queue* q, list_node* done) {
+    // parse our descriptor chain, add back to the free queue
+    auto free_chain = [q, done](vring_used_elem* used_elem) TA_NO_THREAD_SAFETY_ANALYSIS {
+        uint16_t head = (uint16_t)used_elem->id;
+#if LOCAL_TRACE > 0
+        virtio_dump_desc(q->ring.DescFromIndex(head));
+#endif
+        q->ring.FreeDescChain(head);
+
+        size_t index = q->head_request[head];
+        iotxn_t* txn = q->txns[index];
+        uint8_t res = q->requests[index].status;
+        q->txns[index] = nullptr;
+        q->free_requests |= (1u << index);
+
+        LTRACEF("completes txn %p\n", txn);
+        if (res == VIRTIO_BLK_S_OK) {
+            txn->status = MX_OK;
+        } else {
+            txn->status = (res == VIRTIO_BLK_S_UNSUPP) ? MX_ERR_NOT_SUPPORTED : MX_ERR_IO;
+        }
+        list_add_tail(done, &txn->node);
     };
 
     // tell the ring to find free chains and hand it back to our lambda
-    vring_.IrqRingUpdate(free_chain);
+    q->ring.IrqRingUpdate(free_chain);
+
+    // what was freed may let the txns waiting on this queue go
+    bool started = false;
+    iotxn_t* txn;
+    while ((txn = list_peek_head_type(&q->pending, iotxn_t, node)) != nullptr) {
+        if (!StartTxnLocked(q, txn)) {
+            break;
+        }
+        list_delete(&txn->node);
+        started = true;
+    }
+    if (started) {
+        q->ring.Kick();
+    }
 }
 
 void BlockDevice::IrqConfigChange() {
@@ -320,138 +480,194 @@ static void ScatterGatherHelper(const iotxn_t *txn, callback callback_new_run) {
         callback_new_run(run_start, run_len);
 }
 
-void BlockDevice::QueueReadWriteTxn(iotxn_t* txn) {
-    LTRACEF("txn %p, pflags %#x\n", txn, txn->pflags);
-
-    mxtl::AutoLock lock(&lock_);
-
-    bool write = (txn->opcode == IOTXN_OP_WRITE);
-
-    // offset must be aligned to block size
-    if (txn->offset % config_.blk_size) {
-        LTRACEF("offset %#" PRIx64 " is not aligned to sector size %u!\n", txn->offset, config_.blk_size);
-        iotxn_complete(txn, MX_ERR_INVALID_ARGS, 0);
-        return;
-    }
-
-    // trim length to a multiple of the block size
-    if (txn->length % config_.blk_size) {
-        txn->length = ROUNDDOWN(txn->length, config_.blk_size);
+BlockDevice::Queue* BlockDevice::PickQueue() {
+    // each thread sticks to one queue, handed out in turn
+    static thread_local uint32_t queue_index = UINT32_MAX;
+    static uint32_t next_index = 0;
+    if (queue_index == UINT32_MAX) {
+        queue_index = __atomic_fetch_add(&next_index, 1, __ATOMIC_RELAXED);
     }
+    return queues_[queue_index % queue_count_].get();
+}
 
-    // constrain to device capacity
-    txn->length = mxtl::min(txn->length, GetSize() - txn->offset);
-    if (txn->length == 0) {
-        iotxn_complete(txn, MX_OK, 0);
-        return;
-    }
+void BlockDevice::QueueTxn(iotxn_t* txn) {
+    LTRACEF("txn %p, pflags %#x\n", txn, txn->pflags);
 
-    // allocate and start filling out a block request
-    auto index = alloc_blk_req();
-    if (index >= blk_req_count) {
-        TRACEF("too many block requests queued (%zu)!\n", index);
-        iotxn_complete(txn, MX_ERR_NO_RESOURCES, 0);
-        return;
-    }
+    if (txn->opcode == IOTXN_OP_FLUSH) {
+        // without a write cache every completed write is already durable
+        if (!has_flush_) {
+            iotxn_complete(txn, MX_OK, 0);
+            return;
+        }
+        txn->length = 0;
+    } else if (txn->opcode == IOTXN_OP_DISCARD) {
+        if ((txn->offset % config_.blk_size) || (txn->length % config_.blk_size)) {
+            iotxn_complete(txn, MX_ERR_INVALID_ARGS, 0);
+            return;
+        }
+        if ((txn->offset >= GetSize()) || (txn->length > GetSize() - txn->offset)) {
+            iotxn_complete(txn, MX_ERR_OUT_OF_RANGE, 0);
+            return;
+        }
+        // The device may free less than it was asked to, so what is past
+        // the most it takes at once is left alone.
+        txn->length = mxtl::min<uint64_t>(txn->length,
+                                          (uint64_t)max_discard_sectors_ * 512);
+        if (!has_discard_ || (txn->length == 0)) {
+            iotxn_complete(txn, MX_OK, 0);
+            return;
+        }
+    } else {
+        // offset must be aligned to block size
+        if (txn->offset % config_.blk_size) {
+            LTRACEF("offset %#" PRIx64 " is not aligned to sector size %u!\n", txn->offset, config_.blk_size);
+            iotxn_complete(txn, MX_ERR_INVALID_ARGS, 0);
+            return;
+        }
 
-    auto req = &blk_req_[index];
-    req->type = write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
-    req->ioprio = 0;
-    req->sector = txn->offset / 512;
-    LTRACEF("blk_req type %u ioprio %u sector %" PRIu64 "\n",
-            req->type, req->ioprio, req->sector);
+        // trim length to a multiple of the block size
+        if (txn->length % config_.blk_size) {
+            txn->length = ROUNDDOWN(txn->length, config_.blk_size);
+        }
 
-    // save the req index into the txn->extra[1] slot so we can free it when we complete the transfer
-    txn->extra[1] = index;
+        // constrain to device capacity
+        if (txn->offset >= GetSize()) {
+            iotxn_complete(txn, MX_ERR_OUT_OF_RANGE, 0);
+            return;
+        }
+        txn->length = mxtl::min(txn->length, GetSize() - txn->offset);
+        if (txn->length == 0) {
+            iotxn_complete(txn, MX_OK, 0);
+            return;
+        }
 
-    // get the physical map for the transfer
-    auto status = iotxn_physmap(txn);
-    LTRACEF("status %d, pflags %#x\n", status, txn->pflags);
+        // get the physical map for the transfer
+        auto status = iotxn_physmap(txn);
+        if (status != MX_OK) {
+            iotxn_complete(txn, status, 0);
+            return;
+        }
 #if LOCAL_TRACE
-    LTRACEF("phys %p, phys_count %#lx\n", txn->phys, txn->phys_count);
-    for (uint64_t i = 0; i < txn->phys_count; i++) {
-        LTRACEF("phys %lu: %#lx\n", i, txn->phys[i]);
-    }
+        LTRACEF("phys %p, phys_count %#lx\n", txn->phys, txn->phys_count);
+        for (uint64_t i = 0; i < txn->phys_count; i++) {
+            LTRACEF("phys %lu: %#lx\n", i, txn->phys[i]);
+        }
 #endif
 
-    // count the number of physical runs we're going to need
-    size_t run_count = 0;
-
-    {
-        auto new_run_callback = [&run_count](uint64_t start, uint64_t len) {
+        // count the number of physical runs we're going to need
+        uint32_t run_count = 0;
+        ScatterGatherHelper(txn, [&run_count](uint64_t start, uint64_t len) {
             LTRACEF("start %#lx len %#lx\n", start, len);
             run_count++;
-        };
-
-        ScatterGatherHelper(txn, new_run_callback);
+        });
+        LTRACEF("run count %u\n", run_count);
+        assert(run_count > 0);
+
+        if (run_count > max_segments_) {
+            TRACEF("txn of %u runs is more than the %u a request takes\n", run_count, max_segments_);
+            iotxn_complete(txn, MX_ERR_OUT_OF_RANGE, 0);
+            return;
+        }
     }
 
-    LTRACEF("run count %lu\n", run_count);
-    assert(run_count > 0);
-
-    /* put together a transfer */
-    uint16_t i;
-    auto desc = vring_.AllocDescChain((uint16_t)(2u + run_count), &i);
-    if (!desc) {
-        TRACEF("failed to allocate descriptor chain of length %zu\n", 2u + run_count);
-        // TODO: handle this scenario by requeing the transfer in smaller runs
-        iotxn_complete(txn, MX_ERR_NO_RESOURCES, 0);
+    Queue* q = PickQueue();
+    mxtl::AutoLock lock(&q->lock);
+    // behind whatever is already waiting, to keep the order txns were queued in
+    if (!list_is_empty(&q->pending) || !StartTxnLocked(q, txn)) {
+        list_add_tail(&q->pending, &txn->node);
         return;
     }
+    q->ring.Kick();
+}
 
-    LTRACEF("after alloc chain desc %p, i %u\n", desc, i);
-
-    /* point the iotxn at this head descriptor */
-    txn->context = desc;
-
-    /* set up the descriptor pointing to the head */
-    desc->addr = blk_req_pa_ + index * sizeof(virtio_blk_req_t);
-    desc->len = sizeof(virtio_blk_req_t);
-    desc->flags |= VRING_DESC_F_NEXT;
-
-#if LOCAL_TRACE > 0
-    virtio_dump_desc(desc);
-#endif
-
-    {
-        auto new_run_callback = [this, write, &desc](uint64_t start, uint64_t len) {
-            /* set up the descriptor pointing to the buffer */
-            desc = vring_.DescFromIndex(desc->next);
-
-            desc->addr = start;
-            desc->len = (uint32_t)len;
-            LTRACEF("pa %#lx, len %#x\n", desc->addr, desc->len);
-
-            if (!write)
-                desc->flags |= VRING_DESC_F_WRITE; /* mark buffer as write-only if its a block read */
-            desc->flags |= VRING_DESC_F_NEXT;
-        };
-
-        ScatterGatherHelper(txn, new_run_callback);
+bool BlockDevice::StartTxnLocked(Queue* q, iotxn_t* txn) {
+    if (q->free_requests == 0) {
+        return false;
     }
 
-#if LOCAL_TRACE > 0
-    virtio_dump_desc(desc);
-#endif
+    // the header, at most max_segments_ data runs and the status byte
+    vring_desc descs[(kIndirectDescs > ring_size) ? kIndirectDescs : ring_size];
+    size_t count = 0;
+
+    size_t index = __builtin_ctz(q->free_requests);
+    Request* req = &q->requests[index];
+    mx_paddr_t req_pa = q->requests_pa + index * sizeof(Request);
+
+    descs[count++] = { req_pa + offsetof(Request, header), sizeof(virtio_blk_req_t), 0, 0 };
+    if (txn->opcode == IOTXN_OP_DISCARD) {
+        descs[count++] = { req_pa + offsetof(Request, discard), sizeof(virtio_blk_discard_t), 0, 0 };
+    } else if (txn->opcode != IOTXN_OP_FLUSH) {
+        /* mark buffers as write-only if its a block read */
+        uint16_t flags = (txn->opcode == IOTXN_OP_WRITE) ? 0 : VRING_DESC_F_WRITE;
+        ScatterGatherHelper(txn, [&descs, &count, flags](uint64_t start, uint64_t len) {
+            descs[count++] = { start, (uint32_t)len, flags, 0 };
+        });
+    }
+    descs[count++] = { req_pa + offsetof(Request, status), 1, VRING_DESC_F_WRITE, 0 };
 
-    /* set up the descriptor pointing to the response */
-    desc = vring_.DescFromIndex(desc->next);
-    desc->addr = blk_res_pa_ + index;
-    desc->len = 1;
-    desc->flags = VRING_DESC_F_WRITE;
+    uint16_t head;
+    auto desc = q->ring.AllocDescChain(indirect_ ? 1 : (uint16_t)count, &head);
+    if (!desc) {
+        return false;
+    }
+    q->free_requests &= ~(1u << index);
+    q->txns[index] = txn;
+    q->head_request[head] = (uint8_t)index;
 
+    switch (txn->opcode) {
+    case IOTXN_OP_READ:
+        req->header.type = VIRTIO_BLK_T_IN;
+        break;
+    case IOTXN_OP_WRITE:
+        req->header.type = VIRTIO_BLK_T_OUT;
+        break;
+    case IOTXN_OP_DISCARD:
+        req->header.type = VIRTIO_BLK_T_DISCARD;
+        req->discard.sector = txn->offset / 512;
+        req->discard.num_sectors = (uint32_t)(txn->length / 512);
+        req->discard.flags = 0;
+        break;
+    default:
+        req->header.type = VIRTIO_BLK_T_FLUSH;
+        break;
+    }
+    req->header.ioprio = 0;
+    req->header.sector = ((txn->opcode == IOTXN_OP_FLUSH) ||
+                          (txn->opcode == IOTXN_OP_DISCARD)) ? 0 : txn->offset / 512;
+    req->status = VIRTIO_BLK_S_IOERR;
+    LTRACEF("blk_req type %u ioprio %u sector %" PRIu64 "\n",
+            req->header.type, req->header.ioprio, req->header.sector);
+
+    if (indirect_) {
+        /* the ring descriptor points at the request's own table */
+        for (size_t i = 0; i < count; i++) {
+            req->table[i] = descs[i];
+            if (i + 1 < count) {
+                req->table[i].flags |= VRING_DESC_F_NEXT;
+                req->table[i].next = (uint16_t)(i + 1);
+            }
+        }
+        desc->addr = req_pa + offsetof(Request, table);
+        desc->len = (uint32_t)(count * sizeof(vring_desc));
+        desc->flags = VRING_DESC_F_INDIRECT;
+    } else {
+        /* fill in the chain, which is already linked */
+        for (size_t i = 0; i < count; i++) {
+            desc->addr = descs[i].addr;
+            desc->len = descs[i].len;
+            desc->flags = (uint16_t)((desc->flags & VRING_DESC_F_NEXT) | descs[i].flags);
+            if (i + 1 < count) {
+                desc = q->ring.DescFromIndex(desc->next);
+            }
+        }
+    }
 #if LOCAL_TRACE > 0
     virtio_dump_desc(desc);
 #endif
 
-    // save the iotxn in a list
-    list_add_tail(&iotxn_list, &txn->node);
-
     /* submit the transfer */
-    vring_.SubmitChain(i);
-
-    /* kick it off */
-    vring_.Kick();
+    q->ring.SubmitChain(head);
+    return true;
 }
 
 } // namespace virtio
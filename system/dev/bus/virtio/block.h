@@ -10,6 +10,9 @@
 #include <stdlib.h>
 
 #include <ddk/protocol/block.h>
+#include <magenta/thread_annotations.h>
+#include <mxtl/mutex.h>
+#include <mxtl/unique_ptr.h>
 #include <virtio/block.h>
 
 namespace virtio {
@@ -46,52 +49,101 @@ private:
     static void virtio_block_write(void* ctx, mx_handle_t vmo,
                                    uint64_t length, uint64_t vmo_offset,
                                    uint64_t dev_offset, void* cookie);
+    static void virtio_block_read_phys(void* ctx, mx_handle_t vmo,
+                                       uint64_t length, uint64_t vmo_offset,
+                                       uint64_t dev_offset, mx_paddr_t* phys,
+                                       uint64_t phys_count, void* cookie);
+    static void virtio_block_write_phys(void* ctx, mx_handle_t vmo,
+                                        uint64_t length, uint64_t vmo_offset,
+                                        uint64_t dev_offset, mx_paddr_t* phys,
+                                        uint64_t phys_count, void* cookie);
+    static void virtio_block_flush(void* ctx, void* cookie);
+    static void virtio_block_discard(void* ctx, uint64_t length, uint64_t dev_offset,
+                                     void* cookie);
     static void block_do_txn(BlockDevice* dev, uint32_t opcode, mx_handle_t vmo,
                              uint64_t length, uint64_t vmo_offset,
-                             uint64_t dev_offset, void* cookie);
+                             uint64_t dev_offset, mx_paddr_t* phys,
+                             uint64_t phys_count, void* cookie);
 
     void GetInfo(block_info_t* info);
 
-    void QueueReadWriteTxn(iotxn_t* txn);
+    void QueueTxn(iotxn_t* txn);
 
-    // the main virtio ring
-    Ring vring_ = {this};
+    // 128 matches legacy pci
+    static const uint16_t ring_size = 128;
 
-    static const uint16_t ring_size = 128; // 128 matches legacy pci
+    // at most one virtqueue per cpu, up to this many
+    static const uint16_t kMaxQueues = 16;
 
-    // saved block device configuration out of the pci config BAR
-    virtio_blk_config_t config_ = {};
+    // requests in flight on each virtqueue
+    static const size_t kRequestsPerQueue = 32;
 
-    // a queue of block request/responses
-    static const size_t blk_req_count = 32;
+    // descriptors in each request's indirect table: the header, the status
+    // byte and the data runs between them
+    static const uint16_t kIndirectDescs = 128;
 
-    mx_paddr_t blk_req_pa_ = 0;
-    virtio_blk_req_t* blk_req_ = nullptr;
+    // What the device reads and writes of each request besides its data,
+    // in contiguous memory. The indirect table is first, to keep it aligned.
+    // A discard's range is the one piece of data kept here.
+    struct Request {
+        vring_desc table[kIndirectDescs];
+        virtio_blk_req_t header;
+        virtio_blk_discard_t discard;
+        uint8_t status;
+    };
 
-    mx_paddr_t blk_res_pa_ = 0;
-    uint8_t* blk_res_ = nullptr;
+    struct Queue {
+        explicit Queue(Device* device) : ring(device) {}
 
-    uint32_t blk_req_bitmap_ = 0;
-    static_assert(blk_req_count <= sizeof(blk_req_bitmap_) * CHAR_BIT, "");
+        mxtl::Mutex lock;
+        Ring ring TA_GUARDED(lock);
 
-    size_t alloc_blk_req() {
-        size_t i = 0;
-        if (blk_req_bitmap_ != 0)
-            i = sizeof(blk_req_bitmap_) * CHAR_BIT - __builtin_clz(blk_req_bitmap_);
-        blk_req_bitmap_ |= (1 << i);
-        return i;
-    }
+        mx_paddr_t requests_pa = 0;
+        Request* requests = nullptr;
 
-    void free_blk_req(size_t i) {
-        blk_req_bitmap_ &= ~(1 << i);
-    }
+        // free entries of |requests|, and the txn each of the others is for
+        uint32_t free_requests TA_GUARDED(lock) = 0;
+        static_assert(kRequestsPerQueue <= sizeof(uint32_t) * CHAR_BIT, "");
+        iotxn_t* txns[kRequestsPerQueue] TA_GUARDED(lock) = {};
+        // the request each descriptor chain in flight belongs to, by its head
+        uint8_t head_request[ring_size] TA_GUARDED(lock) = {};
 
-    // Callbacks for PROTOCOL_BLOCK
-    block_callbacks_t* callbacks_;
-    block_protocol_ops_t device_block_ops_;
+        // txns waiting for a free request or descriptors, in order
+        list_node pending TA_GUARDED(lock) = LIST_INITIAL_VALUE(pending);
+    };
+
+    Queue* PickQueue();
+    mx_status_t InitQueue(Queue* q, uint16_t index);
+
+    // Puts |txn| on the ring, or returns false if it has to wait for a
+    // request or descriptors to be freed.
+    bool StartTxnLocked(Queue* q, iotxn_t* txn) TA_REQ(q->lock);
+
+    // Gathers what the device has finished on |q| into |done|, to be
+    // completed once the lock is dropped, and starts what was waiting.
+    void ReapLocked(Queue* q, list_node* done) TA_REQ(q->lock);
+
+    mxtl::unique_ptr<Queue> queues_[kMaxQueues];
+    uint16_t queue_count_ = 0;
 
-    // pending iotxns
-    list_node iotxn_list = LIST_INITIAL_VALUE(iotxn_list);
+    // saved block device configuration out of the pci config BAR
+    virtio_blk_config_t config_ = {};
+
+    // whether the device negotiated VIRTIO_BLK_F_FLUSH, and so caches writes
+    bool has_flush_ = false;
+    // whether the device negotiated VIRTIO_BLK_F_DISCARD, and the most
+    // sectors (of 512 bytes) one discard may cover
+    bool has_discard_ = false;
+    uint32_t max_discard_sectors_ = 0;
+    // whether requests take one ring descriptor pointing at their own table
+    bool indirect_ = false;
+
+    // the most data runs a single request may have
+    uint32_t max_segments_ = 0;
+
+    // Callbacks for PROTOCOL_BLOCK
+    block_callbacks_t* callbacks_ = nullptr;
+    block_protocol_ops_t device_block_ops_ = {};
 };
 
 } // namespace virtio
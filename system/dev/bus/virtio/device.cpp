@@ -145,7 +145,8 @@ mx_status_t Device::Bind(pci_protocol_t* pci,
                     case VIRTIO_PCI_CAP_NOTIFY_CFG: {
                         MapBar(cap->bar);
                         mmio_regs_.notify_base = (volatile uint16_t*)((uintptr_t)bar_[cap->bar].mmio_base + cap->offset);
-                        mmio_regs_.notify_mul = 0x1000;
+                        // the notify capability carries the multiplier right after the common fields
+                        mmio_regs_.notify_mul = *(uint32_t*)((uintptr_t)cap + sizeof(virtio_pci_cap));
                         LTRACEF("notify_base %p\n", mmio_regs_.notify_base);
                         break;
                     }
@@ -337,9 +338,12 @@ mx_status_t Device::CopyDeviceConfig(void* _buf, size_t len) {
 uint16_t Device::GetRingSize(uint16_t index) {
     if (!mmio_regs_.common_config) {
         if (bar0_pio_base_) {
+            outpw((bar0_pio_base_ + VIRTIO_PCI_QUEUE_SELECT) & 0xffff, index);
             return inpw((bar0_pio_base_ + VIRTIO_PCI_QUEUE_SIZE) & 0xffff);
         } else if (bar_[0].mmio_base) {
-            volatile uint16_t *ptr16 = (volatile uint16_t *)((uintptr_t)bar_[0].mmio_base + VIRTIO_PCI_QUEUE_SIZE);
+            volatile uint16_t *ptr16 = (volatile uint16_t *)((uintptr_t)bar_[0].mmio_base + VIRTIO_PCI_QUEUE_SELECT);
+            *ptr16 = index;
+            ptr16 = (volatile uint16_t *)((uintptr_t)bar_[0].mmio_base + VIRTIO_PCI_QUEUE_SIZE);
             return *ptr16;
         } else {
             // XXX implement
@@ -379,6 +383,10 @@ void Device::SetRing(uint16_t index, uint16_t count, mx_paddr_t pa_desc, mx_padd
         mmio_regs_.common_config->queue_avail = pa_avail;
         mmio_regs_.common_config->queue_used = pa_used;
         mmio_regs_.common_config->queue_enable = 1;
+
+        // where this ring's doorbell is, in units of the notify multiplier
+        assert(index < countof(queue_notify_off_));
+        queue_notify_off_[index] = mmio_regs_.common_config->queue_notify_off;
     }
 }
 
@@ -392,7 +400,8 @@ void Device::RingKick(uint16_t ring_index) {
             assert(0);
         }
     } else {
-        volatile uint16_t* notify = mmio_regs_.notify_base + ring_index * mmio_regs_.notify_mul / sizeof(uint16_t);
+        volatile uint16_t* notify = mmio_regs_.notify_base +
+                                    queue_notify_off_[ring_index] * mmio_regs_.notify_mul / sizeof(uint16_t);
         LTRACEF_LEVEL(2, "notify address %p\n", notify);
         *notify = ring_index;
     }
@@ -416,6 +425,24 @@ void Device::StatusAcknowledgeDriver() {
     }
 }
 
+uint32_t Device::ReadDeviceFeatures() {
+    if (!mmio_regs_.common_config) {
+        return ReadConfigBar<uint32_t>(VIRTIO_PCI_DEVICE_FEATURES);
+    } else {
+        mmio_regs_.common_config->device_feature_select = 0;
+        return mmio_regs_.common_config->device_feature;
+    }
+}
+
+void Device::WriteDriverFeatures(uint32_t features) {
+    if (!mmio_regs_.common_config) {
+        WriteConfigBar(VIRTIO_PCI_DRIVER_FEATURES, features);
+    } else {
+        mmio_regs_.common_config->driver_feature_select = 0;
+        mmio_regs_.common_config->driver_feature = features;
+    }
+}
+
 void Device::StatusDriverOK() {
     if (!mmio_regs_.common_config) {
         uint8_t val = ReadConfigBar<uint8_t>(VIRTIO_PCI_DEVICE_STATUS);
@@ -70,6 +70,10 @@ protected:
     void StatusAcknowledgeDriver();
     void StatusDriverOK();
 
+    // the low 32 feature bits, which is all the drivers here care about
+    uint32_t ReadDeviceFeatures();
+    void WriteDriverFeatures(uint32_t features);
+
     static int IrqThreadEntry(void* arg);
     void IrqWorker();
 
@@ -102,6 +106,10 @@ protected:
         volatile void* device_config;
     } mmio_regs_ = {};
 
+    // per ring, from the common configuration
+    static constexpr uint16_t kMaxRings = 32;
+    uint16_t queue_notify_off_[kMaxRings] = {};
+
     // irq thread object
     thrd_t irq_thread_ = {};
 
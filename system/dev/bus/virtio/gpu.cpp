@@ -74,6 +74,15 @@ void GpuDevice::virtio_gpu_flush(void* ctx) {
     gd->Flush();
 }
 
+void GpuDevice::virtio_gpu_flush_region(void* ctx, uint32_t x, uint32_t y,
+                                        uint32_t width, uint32_t height) {
+    GpuDevice* gd = static_cast<GpuDevice*>(ctx);
+
+    LTRACEF("dev %p, x %u y %u w %u h %u\n", gd, x, y, width, height);
+
+    gd->FlushRegion(x, y, width, height);
+}
+
 GpuDevice::GpuDevice(mx_device_t* bus_device)
     : Device(bus_device) {
 
@@ -94,44 +103,64 @@ static void dump_gpu_config(const volatile struct virtio_gpu_config* config) {
     LTRACEF("reserved 0x%x\n", config->reserved);
 }
 
-mx_status_t GpuDevice::send_command_response(const void* cmd, size_t cmd_len, void** _res, size_t res_len) {
-    LTRACEF("dev %p, cmd %p, cmd_len %zu, res %p, res_len %zu\n", this, cmd, cmd_len, _res, res_len);
+// Sends a batch of commands with one kick and waits for every response.
+// The caller holds request_lock_.
+mx_status_t GpuDevice::send_commands(Command* cmds, size_t count) {
+    LTRACEF("dev %p, cmds %p, count %zu\n", this, cmds, count);
+
+    size_t offset = 0;
+    for (size_t n = 0; n < count; n++) {
+        Command* c = &cmds[n];
 
-    uint16_t i;
-    struct vring_desc* desc = vring_.AllocDescChain(2, &i);
-    assert(desc);
+        uint16_t i;
+        struct vring_desc* desc = vring_.AllocDescChain(2, &i);
+        assert(desc);
 
-    memcpy(gpu_req_, cmd, cmd_len);
+        assert(offset + c->cmd_len + c->res_len <= PAGE_SIZE);
+        uint8_t* req = (uint8_t*)gpu_req_ + offset;
+        mx_paddr_t req_phys = gpu_req_pa_ + offset;
+        memcpy(req, c->cmd, c->cmd_len);
 
-    desc->addr = gpu_req_pa_;
-    desc->len = (uint32_t)cmd_len;
-    desc->flags |= VRING_DESC_F_NEXT;
+        desc->addr = req_phys;
+        desc->len = (uint32_t)c->cmd_len;
+        desc->flags |= VRING_DESC_F_NEXT;
 
-    /* set the second descriptor to the response with the write bit set */
-    desc = vring_.DescFromIndex(desc->next);
-    assert(desc);
+        /* set the second descriptor to the response with the write bit set */
+        desc = vring_.DescFromIndex(desc->next);
+        assert(desc);
 
-    void* res = (void*)((uint8_t*)gpu_req_ + cmd_len);
-    *_res = res;
-    mx_paddr_t res_phys = gpu_req_pa_ + cmd_len;
-    memset(res, 0, res_len);
+        void* res = req + c->cmd_len;
+        *c->res = res;
+        memset(res, 0, c->res_len);
 
-    desc->addr = res_phys;
-    desc->len = (uint32_t)res_len;
-    desc->flags = VRING_DESC_F_WRITE;
+        desc->addr = req_phys + c->cmd_len;
+        desc->len = (uint32_t)c->res_len;
+        desc->flags = VRING_DESC_F_WRITE;
 
-    /* submit the transfer */
-    vring_.SubmitChain(i);
+        /* submit the transfer */
+        vring_.SubmitChain(i);
 
-    /* kick it off */
+        offset += ROUNDUP(c->cmd_len + c->res_len, 16);
+    }
+    requests_pending_ += count;
+
+    /* kick them all off at once */
     vring_.Kick();
 
-    /* wait for result */
-    cnd_wait(&request_cond_, request_lock_.GetInternal());
+    /* wait for the results */
+    while (requests_pending_ > 0)
+        cnd_wait(&request_cond_, request_lock_.GetInternal());
 
     return MX_OK;
 }
 
+mx_status_t GpuDevice::send_command_response(const void* cmd, size_t cmd_len, void** _res, size_t res_len) {
+    LTRACEF("dev %p, cmd %p, cmd_len %zu, res %p, res_len %zu\n", this, cmd, cmd_len, _res, res_len);
+
+    Command c = {cmd, cmd_len, _res, res_len};
+    return send_commands(&c, 1);
+}
+
 mx_status_t GpuDevice::get_display_info() {
     LTRACEF("dev %p\n", this);
 
@@ -266,65 +295,86 @@ mx_status_t GpuDevice::set_scanout(uint32_t scanout_id, uint32_t resource_id, ui
     return err;
 }
 
-mx_status_t GpuDevice::flush_resource(uint32_t resource_id, uint32_t width, uint32_t height) {
-    LTRACEF("dev %p, resource_id %u, width %u, height %u\n", this, resource_id, width, height);
-
-    /* grab a lock to keep this single message at a time */
-    mxtl::AutoLock lock(&request_lock_);
-
-    /* construct the request */
-    virtio_gpu_resource_flush req;
-    memset(&req, 0, sizeof(req));
-
-    req.hdr.type = VIRTIO_GPU_CMD_RESOURCE_FLUSH;
-    req.r.x = req.r.y = 0;
-    req.r.width = width;
-    req.r.height = height;
-    req.resource_id = resource_id;
-
-    /* send the command and get a response */
-    virtio_gpu_ctrl_hdr* res;
-    auto err = send_command_response(&req, sizeof(req), (void**)&res, sizeof(*res));
-    assert(err == MX_OK);
-
-    /* see if we got a valid response */
-    LTRACEF("response type 0x%x\n", res->type);
-    err = (res->type == VIRTIO_GPU_RESP_OK_NODATA) ? MX_OK : MX_ERR_NO_MEMORY;
-
-    return err;
-}
+// Transfers the given rectangles of the resource to the host, then flushes
+// the smallest rectangle that covers them, all in one submission.
+mx_status_t GpuDevice::transfer_and_flush(uint32_t resource_id, const virtio_gpu_rect* rects,
+                                          size_t count) {
+    LTRACEF("dev %p, resource_id %u, count %zu\n", this, resource_id, count);
 
-mx_status_t GpuDevice::transfer_to_host_2d(uint32_t resource_id, uint32_t width, uint32_t height) {
-    LTRACEF("dev %p, resource_id %u, width %u, height %u\n", this, resource_id, width, height);
+    assert(count > 0 && count <= kMaxFlushRects);
 
-    /* grab a lock to keep this single message at a time */
+    /* grab a lock to keep this single batch at a time */
     mxtl::AutoLock lock(&request_lock_);
 
-    /* construct the request */
-    virtio_gpu_transfer_to_host_2d req;
-    memset(&req, 0, sizeof(req));
+    /* construct the requests */
+    virtio_gpu_transfer_to_host_2d transfers[kMaxFlushRects];
+    virtio_gpu_resource_flush flush;
+    virtio_gpu_ctrl_hdr* res[kMaxFlushRects + 1];
+    Command cmds[kMaxFlushRects + 1];
+
+    uint32_t x0 = UINT32_MAX, y0 = UINT32_MAX, x1 = 0, y1 = 0;
+    for (size_t i = 0; i < count; i++) {
+        const virtio_gpu_rect& r = rects[i];
+        LTRACEF("transfer x %u y %u w %u h %u\n", r.x, r.y, r.width, r.height);
+
+        virtio_gpu_transfer_to_host_2d* req = &transfers[i];
+        memset(req, 0, sizeof(*req));
+        req->hdr.type = VIRTIO_GPU_CMD_TRANSFER_TO_HOST_2D;
+        req->r = r;
+        /* where the rectangle starts in the backing store, which has no padding */
+        req->offset = ((uint64_t)r.y * pmode_.r.width + r.x) * 4;
+        req->resource_id = resource_id;
+        cmds[i] = {req, sizeof(*req), (void**)&res[i], sizeof(*res[i])};
+
+        x0 = MIN(x0, r.x);
+        y0 = MIN(y0, r.y);
+        x1 = MAX(x1, r.x + r.width);
+        y1 = MAX(y1, r.y + r.height);
+    }
 
-    req.hdr.type = VIRTIO_GPU_CMD_TRANSFER_TO_HOST_2D;
-    req.r.x = req.r.y = 0;
-    req.r.width = width;
-    req.r.height = height;
-    req.offset = 0;
-    req.resource_id = resource_id;
+    memset(&flush, 0, sizeof(flush));
+    flush.hdr.type = VIRTIO_GPU_CMD_RESOURCE_FLUSH;
+    flush.r = {x0, y0, x1 - x0, y1 - y0};
+    flush.resource_id = resource_id;
+    cmds[count] = {&flush, sizeof(flush), (void**)&res[count], sizeof(*res[count])};
 
-    /* send the command and get a response */
-    virtio_gpu_ctrl_hdr* res;
-    auto err = send_command_response(&req, sizeof(req), (void**)&res, sizeof(*res));
+    /* send the commands and get the responses */
+    auto err = send_commands(cmds, count + 1);
     assert(err == MX_OK);
 
-    /* see if we got a valid response */
-    LTRACEF("response type 0x%x\n", res->type);
-    err = (res->type == VIRTIO_GPU_RESP_OK_NODATA) ? MX_OK : MX_ERR_NO_MEMORY;
+    /* see if we got valid responses */
+    for (size_t i = 0; i <= count; i++) {
+        LTRACEF("response type 0x%x\n", res[i]->type);
+        if (res[i]->type != VIRTIO_GPU_RESP_OK_NODATA)
+            err = MX_ERR_NO_MEMORY;
+    }
 
     return err;
 }
 
 void GpuDevice::Flush() {
+    FlushRegion(0, 0, pmode_.r.width, pmode_.r.height);
+}
+
+void GpuDevice::FlushRegion(uint32_t x, uint32_t y, uint32_t width, uint32_t height) {
+    if (x >= pmode_.r.width || y >= pmode_.r.height || width == 0 || height == 0)
+        return;
+    width = MIN(width, pmode_.r.width - x);
+    height = MIN(height, pmode_.r.height - y);
+
     mxtl::AutoLock al(&flush_lock_);
+    if (flush_rect_count_ < kMaxFlushRects) {
+        flush_rects_[flush_rect_count_++] = {x, y, width, height};
+    } else {
+        /* out of room, so grow the last rectangle to cover this one too */
+        virtio_gpu_rect* r = &flush_rects_[kMaxFlushRects - 1];
+        uint32_t x1 = MAX(r->x + r->width, x + width);
+        uint32_t y1 = MAX(r->y + r->height, y + height);
+        r->x = MIN(r->x, x);
+        r->y = MIN(r->y, y);
+        r->width = x1 - r->x;
+        r->height = y1 - r->y;
+    }
     flush_pending_ = true;
     cnd_signal(&flush_cond_);
 }
@@ -332,24 +382,22 @@ void GpuDevice::Flush() {
 void GpuDevice::virtio_gpu_flusher() {
     LTRACE_ENTRY;
     for (;;) {
+        virtio_gpu_rect rects[kMaxFlushRects];
+        size_t count;
         {
             mxtl::AutoLock al(&flush_lock_);
-            if (!flush_pending_)
+            while (!flush_pending_)
                 cnd_wait(&flush_cond_, flush_lock_.GetInternal());
             flush_pending_ = false;
+            count = flush_rect_count_;
+            memcpy(rects, flush_rects_, count * sizeof(rects[0]));
+            flush_rect_count_ = 0;
         }
 
-        LTRACEF("flushing\n");
-
-        /* transfer to host 2d */
-        auto err = transfer_to_host_2d(display_resource_id_, pmode_.r.width, pmode_.r.height);
-        if (err < 0) {
-            LTRACEF("failed to flush resource\n");
-            continue;
-        }
+        LTRACEF("flushing %zu rects\n", count);
 
-        /* resource flush */
-        err = flush_resource(display_resource_id_, pmode_.r.width, pmode_.r.height);
+        /* transfer just the damaged rectangles to host 2d and flush them */
+        auto err = transfer_and_flush(display_resource_id_, rects, count);
         if (err < 0) {
             LTRACEF("failed to flush resource\n");
             continue;
@@ -427,6 +475,7 @@ mx_status_t GpuDevice::virtio_gpu_start() {
     display_proto_ops_.get_mode = virtio_gpu_get_mode;
     display_proto_ops_.get_framebuffer = virtio_gpu_get_framebuffer;
     display_proto_ops_.flush = virtio_gpu_flush;
+    display_proto_ops_.flush_region = virtio_gpu_flush_region;
 
     // initialize the mx_device and publish us
     // point the ctx of our DDK device at ourself
@@ -530,6 +579,7 @@ void GpuDevice::IrqRingUpdate() {
 
         // wack the request condition
         request_lock_.Acquire();
+        requests_pending_--;
         cnd_signal(&request_cond_);
         request_lock_.Release();
     };
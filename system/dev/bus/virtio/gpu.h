@@ -30,6 +30,7 @@ public:
     const virtio_gpu_resp_display_info::virtio_gpu_display_one* pmode() const { return &pmode_; }
 
     void Flush();
+    void FlushRegion(uint32_t x, uint32_t y, uint32_t width, uint32_t height);
 
 private:
     // DDK driver hooks
@@ -37,15 +38,28 @@ private:
     static mx_status_t virtio_gpu_get_mode(void* ctx, mx_display_info_t* info);
     static mx_status_t virtio_gpu_get_framebuffer(void* ctx, void** framebuffer);
     static void virtio_gpu_flush(void* ctx);
+    static void virtio_gpu_flush_region(void* ctx, uint32_t x, uint32_t y,
+                                        uint32_t width, uint32_t height);
+
+    // a command to send along with others, and where its response goes
+    struct Command {
+        const void* cmd;
+        size_t cmd_len;
+        void** res;
+        size_t res_len;
+    };
+
+    // the most damaged rectangles the flusher keeps apart before merging them
+    static constexpr size_t kMaxFlushRects = 4;
 
     // internal routines
+    mx_status_t send_commands(Command* cmds, size_t count);
     mx_status_t send_command_response(const void* cmd, size_t cmd_len, void** _res, size_t res_len);
     mx_status_t get_display_info();
     mx_status_t allocate_2d_resource(uint32_t* resource_id, uint32_t width, uint32_t height);
     mx_status_t attach_backing(uint32_t resource_id, mx_paddr_t ptr, size_t buf_len);
     mx_status_t set_scanout(uint32_t scanout_id, uint32_t resource_id, uint32_t width, uint32_t height);
-    mx_status_t flush_resource(uint32_t resource_id, uint32_t width, uint32_t height);
-    mx_status_t transfer_to_host_2d(uint32_t resource_id, uint32_t width, uint32_t height);
+    mx_status_t transfer_and_flush(uint32_t resource_id, const virtio_gpu_rect* rects, size_t count);
 
     mx_status_t virtio_gpu_start();
     static int virtio_gpu_start_entry(void* arg);
@@ -78,6 +92,8 @@ private:
     // request condition
     mxtl::Mutex request_lock_;
     cnd_t request_cond_ = {};
+    // commands submitted that the device has not answered yet
+    size_t requests_pending_ = 0;
 
     // flush thread
     void virtio_gpu_flusher();
@@ -86,6 +102,9 @@ private:
     mxtl::Mutex flush_lock_;
     cnd_t flush_cond_ = {};
     bool flush_pending_ = false;
+    // the regions flushed since the flusher last ran
+    virtio_gpu_rect flush_rects_[kMaxFlushRects] = {};
+    size_t flush_rect_count_ = 0;
 };
 
 } // namespace virtio
@@ -0,0 +1,697 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "net.h"
+
+#include <inttypes.h>
+#include <magenta/compiler.h>
+#include <magenta/syscalls.h>
+#include <mx/vmar.h>
+#include <mxalloc/new.h>
+#include <mxtl/algorithm.h>
+#include <mxtl/auto_lock.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <virtio/virtio.h>
+
+#include "trace.h"
+#include "utils.h"
+
+#define LOCAL_TRACE 0
+
+namespace virtio {
+
+namespace {
+
+// room for an ethernet header and a vlan tag past the mtu
+constexpr size_t kEthFrameOverhead = 18;
+
+// folds a sum of 16-bit words into the checksum stored
+uint16_t FinishChecksum(uint32_t sum) {
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    uint16_t csum = (uint16_t)~sum;
+    // zero would mean "no checksum" to UDP; to TCP the two are the same
+    return (csum == 0) ? 0xffff : csum;
+}
+
+// Completes the checksum of a packet the host left partial, as it does
+// for those from another guest: the field |offset| past |start| holds the
+// pseudo-header sum, and the rest is summed from |start| to the end.
+bool FillChecksum(uint8_t* frame, size_t len, uint16_t start, uint16_t offset) {
+    if ((start >= len) || (offset + sizeof(uint16_t) > len - start)) {
+        return false;
+    }
+    uint32_t sum = 0;
+    size_t i;
+    for (i = start; i + 1 < len; i += 2) {
+        sum += ((uint32_t)frame[i] << 8) | frame[i + 1];
+    }
+    if (i < len) {
+        // an odd byte at the end is summed as if padded with zero
+        sum += (uint32_t)frame[i] << 8;
+    }
+    uint16_t csum = FinishChecksum(sum);
+    frame[start + offset] = (uint8_t)(csum >> 8);
+    frame[start + offset + 1] = (uint8_t)csum;
+    return true;
+}
+
+// the command turning on more queue pairs, and the device's answer
+struct CtrlMqCommand {
+    virtio_net_ctrl_hdr_t hdr;
+    virtio_net_ctrl_mq_t mq;
+    uint8_t ack;
+} __PACKED;
+
+} // anon namespace
+
+// DDK level ops
+
+mx_status_t NetDevice::virtio_net_query(void* ctx, uint32_t options, ethmac_info_t* info) {
+    NetDevice* nd = static_cast<NetDevice*>(ctx);
+
+    if (options) {
+        return MX_ERR_INVALID_ARGS;
+    }
+
+    memset(info, 0, sizeof(*info));
+    info->features = ETHMAC_FEATURE_TX_QUEUE;
+    if (nd->tx_csum_) {
+        info->features |= ETHMAC_FEATURE_TX_CSUM;
+    }
+    if (nd->rx_csum_) {
+        info->features |= ETHMAC_FEATURE_RX_CSUM;
+    }
+    if (nd->pair_count_ > 1) {
+        info->features |= ETHMAC_FEATURE_TX_FLOW;
+    }
+    info->mtu = nd->mtu_;
+    info->tx_queue_depth = nd->tx_depth_;
+    memcpy(info->mac, nd->mac_, sizeof(info->mac));
+    return MX_OK;
+}
+
+void NetDevice::virtio_net_stop(void* ctx) {
+    static_cast<NetDevice*>(ctx)->Stop();
+}
+
+mx_status_t NetDevice::virtio_net_start(void* ctx, ethmac_ifc_t* ifc, void* cookie) {
+    return static_cast<NetDevice*>(ctx)->Start(ifc, cookie);
+}
+
+void NetDevice::virtio_net_send(void* ctx, uint32_t options, void* data, size_t length) {
+    // frames are queued with virtio_net_queue_tx instead
+}
+
+void NetDevice::virtio_net_queue_tx(void* ctx, uint32_t options,
+                                    uintptr_t pa0, uintptr_t pa1, size_t length) {
+    static_cast<NetDevice*>(ctx)->QueueTx(options, pa0, pa1, length);
+}
+
+NetDevice::NetDevice(mx_device_t* bus_device)
+    : Device(bus_device) {
+    // so that Bind() knows how much io space to allocate
+    bar0_size_ = 0x40;
+}
+
+NetDevice::~NetDevice() {
+    // Nothing was given to the device before Init() got as far as the tx
+    // requests; past that, it's stopped before the memory it writes to goes.
+    if (tx_requests_ == nullptr) {
+        return;
+    }
+    Reset();
+
+    // the contiguous vmos were only kept by their mappings, so unmapping
+    // frees them; the rings unmap their own as rx_, tx_ and ctrl_ go
+    for (uint16_t i = 0; i < kMaxPairs; i++) {
+        if (rx_[i] && (rx_[i]->bufs != nullptr)) {
+            mx::vmar::root_self().unmap((uintptr_t)rx_[i]->bufs, kRxBufSize * rx_[i]->size);
+        }
+    }
+    mx::vmar::root_self().unmap((uintptr_t)tx_requests_, sizeof(TxRequest) * kTxSlots);
+}
+
+uint16_t NetDevice::RingSize(uint16_t index) {
+    uint16_t size = GetRingSize(index);
+    // a legacy device's rings are as big as it says, and no other size
+    if (mmio_regs_.common_config && (size > kMaxRingSize)) {
+        size = kMaxRingSize;
+    }
+    return size;
+}
+
+mx_status_t NetDevice::Init() {
+    LTRACE_ENTRY;
+
+    // reset the device
+    Reset();
+
+    // read our configuration
+    CopyDeviceConfig(&config_, sizeof(config_));
+
+    // ack and set the driver status bit
+    StatusAcknowledgeDriver();
+
+    uint32_t features = ReadDeviceFeatures();
+    LTRACEF("device features %#x\n", features);
+    features &= VIRTIO_NET_F_CSUM | VIRTIO_NET_F_GUEST_CSUM | VIRTIO_NET_F_MTU |
+                VIRTIO_NET_F_MAC | VIRTIO_NET_F_MRG_RXBUF | VIRTIO_NET_F_STATUS |
+                VIRTIO_NET_F_CTRL_VQ | VIRTIO_NET_F_MQ | (1u << VIRTIO_F_ANY_LAYOUT) |
+                (1u << VIRTIO_RING_F_INDIRECT_DESC) | (1u << VIRTIO_RING_F_EVENT_IDX);
+    // the control queue is only wanted to turn on the other queue pairs,
+    // and comes after all of them
+    if (!(features & VIRTIO_NET_F_CTRL_VQ) || (config_.max_virtqueue_pairs < 2) ||
+        (config_.max_virtqueue_pairs * 2 >= kMaxRings)) {
+        features &= ~VIRTIO_NET_F_MQ;
+    }
+    if (!(features & VIRTIO_NET_F_MQ)) {
+        features &= ~VIRTIO_NET_F_CTRL_VQ;
+    }
+    // without mergeable buffers, one descriptor holding both the header and
+    // the packet is only allowed with any layout
+    if (!(features & (VIRTIO_NET_F_MRG_RXBUF | (1u << VIRTIO_F_ANY_LAYOUT)))) {
+        VIRTIO_ERROR("net device takes neither mergeable rx buffers nor any layout\n");
+        return MX_ERR_NOT_SUPPORTED;
+    }
+    WriteDriverFeatures(features);
+
+    mrg_rxbuf_ = (features & VIRTIO_NET_F_MRG_RXBUF) != 0;
+    hdr_size_ = mrg_rxbuf_ ? sizeof(virtio_net_hdr_t) : offsetof(virtio_net_hdr_t, num_buffers);
+    indirect_ = (features & (1u << VIRTIO_RING_F_INDIRECT_DESC)) != 0;
+    tx_csum_ = (features & VIRTIO_NET_F_CSUM) != 0;
+    rx_csum_ = (features & VIRTIO_NET_F_GUEST_CSUM) != 0;
+    has_status_ = (features & VIRTIO_NET_F_STATUS) != 0;
+
+    mtu_ = ((features & VIRTIO_NET_F_MTU) && (config_.mtu != 0)) ? config_.mtu : 1500;
+    if (!mrg_rxbuf_) {
+        // a packet has to fit a single buffer
+        mtu_ = mxtl::min<uint32_t>(mtu_, (uint32_t)(kRxBufSize - hdr_size_ - kEthFrameOverhead));
+    } else {
+        frame_size_ = mtu_ + kEthFrameOverhead;
+        AllocChecker ac;
+        frame_.reset(new (&ac) uint8_t[frame_size_]);
+        if (!ac.check()) {
+            return MX_ERR_NO_MEMORY;
+        }
+    }
+
+    if (features & VIRTIO_NET_F_MAC) {
+        memcpy(mac_, config_.mac, sizeof(mac_));
+    } else {
+        // a random, locally administered, unicast address
+        size_t actual;
+        mx_cprng_draw(mac_, sizeof(mac_), &actual);
+        mac_[0] = (uint8_t)((mac_[0] & ~0x01) | 0x02);
+    }
+    UpdateLinkStatus();
+
+    // a queue pair per cpu, so that flows are spread over the host's
+    // threads too
+    uint16_t pairs = 1;
+    if (features & VIRTIO_NET_F_MQ) {
+        pairs = (uint16_t)mxtl::min<uint32_t>(
+            mxtl::min<uint32_t>(config_.max_virtqueue_pairs, mx_system_get_num_cpus()), kMaxPairs);
+        pairs = mxtl::max<uint16_t>(pairs, 1);
+    }
+    LTRACEF("%u queue pairs, mtu %u, mergeable %d, indirect %d\n", pairs, mtu_, mrg_rxbuf_,
+            indirect_);
+
+    size_t size = sizeof(TxRequest) * kTxSlots;
+    mx_status_t r = map_contiguous_memory(size, (uintptr_t*)&tx_requests_, &tx_requests_pa_);
+    if (r < 0) {
+        VIRTIO_ERROR("cannot alloc tx requests %d\n", r);
+        return r;
+    }
+
+    // each pair is an rx queue followed by a tx queue
+    tx_depth_ = kTxDepth;
+    for (uint16_t i = 0; i < pairs; i++) {
+        AllocChecker ac;
+        rx_[i].reset(new (&ac) RxQueue(this));
+        if (!ac.check()) {
+            return MX_ERR_NO_MEMORY;
+        }
+        tx_[i].reset(new (&ac) TxQueue(this));
+        if (!ac.check()) {
+            return MX_ERR_NO_MEMORY;
+        }
+        if (features & (1u << VIRTIO_RING_F_EVENT_IDX)) {
+            rx_[i]->ring.UseEventIndex();
+            tx_[i]->ring.UseEventIndex();
+        }
+        if ((r = InitRxQueue(rx_[i].get(), (uint16_t)(2 * i))) != MX_OK) {
+            return r;
+        }
+        if ((r = InitTxQueue(tx_[i].get(), (uint16_t)(2 * i + 1))) != MX_OK) {
+            return r;
+        }
+        // every buffer may end up on the same queue
+        tx_depth_ = mxtl::min<uint32_t>(tx_depth_, tx_[i]->size / (indirect_ ? 1 : 3));
+    }
+    pair_count_ = 1;
+
+    if (features & VIRTIO_NET_F_CTRL_VQ) {
+        AllocChecker ac;
+        ctrl_.reset(new (&ac) Ring(this));
+        if (!ac.check()) {
+            return MX_ERR_NO_MEMORY;
+        }
+        uint16_t index = (uint16_t)(2 * config_.max_virtqueue_pairs);
+        if ((r = ctrl_->Init(index, RingSize(index))) != MX_OK) {
+            VIRTIO_ERROR("failed to allocate control vring\n");
+            return r;
+        }
+    }
+
+    // start the interrupt thread
+    StartIrqThread();
+
+    // set DRIVER_OK
+    StatusDriverOK();
+
+    // the device may only be told of the rx buffers from now on
+    {
+        mxtl::AutoLock lock(&lock_);
+        rx_[0]->ring.Kick();
+    }
+
+    if ((pairs > 1) && (SetQueuePairs(pairs) == MX_OK)) {
+        mxtl::AutoLock lock(&lock_);
+        for (uint16_t i = 1; i < pairs; i++) {
+            rx_[i]->ring.Kick();
+        }
+        pair_count_ = pairs;
+    }
+
+    ethmac_ops_.query = &virtio_net_query;
+    ethmac_ops_.stop = &virtio_net_stop;
+    ethmac_ops_.start = &virtio_net_start;
+    ethmac_ops_.send = &virtio_net_send;
+    ethmac_ops_.queue_tx = &virtio_net_queue_tx;
+
+    device_add_args_t args = {};
+    args.version = DEVICE_ADD_ARGS_VERSION;
+    args.name = "virtio-net";
+    args.ctx = this;
+    args.ops = &device_ops_;
+    args.proto_id = MX_PROTOCOL_ETHERMAC;
+    args.proto_ops = &ethmac_ops_;
+
+    auto status = device_add(bus_device_, &args, &device_);
+    if (status < 0) {
+        device_ = nullptr;
+        return status;
+    }
+
+    return MX_OK;
+}
+
+mx_status_t NetDevice::InitRxQueue(RxQueue* q, uint16_t index) {
+    q->size = RingSize(index);
+    auto err = q->ring.Init(index, q->size);
+    if (err < 0) {
+        VIRTIO_ERROR("failed to allocate vring %u\n", index);
+        return err;
+    }
+
+    AllocChecker ac;
+    q->used.reset(new (&ac) vring_used_elem[q->size]);
+    if (!ac.check()) {
+        return MX_ERR_NO_MEMORY;
+    }
+
+    // a buffer for every descriptor, all of them given to the device
+    mx_status_t r = map_contiguous_memory(kRxBufSize * q->size, (uintptr_t*)&q->bufs, &q->bufs_pa);
+    if (r < 0) {
+        VIRTIO_ERROR("cannot alloc rx buffers %d\n", r);
+        return r;
+    }
+    LTRACEF("queue %u rx buffers at %p, physical address %#" PRIxPTR "\n", index, q->bufs,
+            q->bufs_pa);
+    for (size_t i = 0; i < q->size; i++) {
+        PostRxBuffer(q, i);
+    }
+    return MX_OK;
+}
+
+mx_status_t NetDevice::InitTxQueue(TxQueue* q, uint16_t index) {
+    mxtl::AutoLock lock(&tx_lock_);
+
+    q->size = RingSize(index);
+    auto err = q->ring.Init(index, q->size);
+    if (err < 0) {
+        VIRTIO_ERROR("failed to allocate vring %u\n", index);
+        return err;
+    }
+
+    AllocChecker ac;
+    q->head_slot.reset(new (&ac) uint16_t[q->size]);
+    if (!ac.check()) {
+        return MX_ERR_NO_MEMORY;
+    }
+    return MX_OK;
+}
+
+mx_status_t NetDevice::SetQueuePairs(uint16_t pairs) {
+    uintptr_t va;
+    mx_paddr_t pa;
+    mx_status_t r = map_contiguous_memory(PAGE_SIZE, &va, &pa);
+    if (r < 0) {
+        return r;
+    }
+    CtrlMqCommand* cmd = reinterpret_cast<CtrlMqCommand*>(va);
+    cmd->hdr.class_ = VIRTIO_NET_CTRL_MQ;
+    cmd->hdr.cmd = VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET;
+    cmd->mq.virtqueue_pairs = pairs;
+    cmd->ack = VIRTIO_NET_ERR;
+
+    const vring_desc descs[] = {
+        { pa + offsetof(CtrlMqCommand, hdr), sizeof(cmd->hdr), 0, 0 },
+        { pa + offsetof(CtrlMqCommand, mq), sizeof(cmd->mq), 0, 0 },
+        { pa + offsetof(CtrlMqCommand, ack), sizeof(cmd->ack), VRING_DESC_F_WRITE, 0 },
+    };
+    uint16_t head;
+    vring_desc* desc = ctrl_->AllocDescChain(countof(descs), &head);
+    for (size_t i = 0; i < countof(descs); i++) {
+        desc->addr = descs[i].addr;
+        desc->len = descs[i].len;
+        desc->flags = (uint16_t)((desc->flags & VRING_DESC_F_NEXT) | descs[i].flags);
+        if (i + 1 < countof(descs)) {
+            desc = ctrl_->DescFromIndex(desc->next);
+        }
+    }
+    ctrl_->SubmitChain(head);
+    ctrl_->Kick();
+
+    // the device answers at once, so it is polled for rather than waited on
+    bool done = false;
+    Ring* ring = ctrl_.get();
+    mx_time_t deadline = mx_deadline_after(MX_SEC(1));
+    for (;;) {
+        ring->IrqRingUpdate([ring, &done](vring_used_elem* used_elem) {
+            ring->FreeDescChain((uint16_t)used_elem->id);
+            done = true;
+        });
+        if (done) {
+            r = (cmd->ack == VIRTIO_NET_OK) ? MX_OK : MX_ERR_NOT_SUPPORTED;
+            break;
+        }
+        if (mx_time_get(MX_CLOCK_MONOTONIC) > deadline) {
+            r = MX_ERR_TIMED_OUT;
+            break;
+        }
+        mx_nanosleep(mx_deadline_after(MX_MSEC(1)));
+    }
+    if (r != MX_OK) {
+        VIRTIO_ERROR("cannot turn on %u queue pairs %d\n", pairs, r);
+    }
+    // the device may still write the ack if it timed out; leave it mapped
+    if (done) {
+        mx::vmar::root_self().unmap(va, PAGE_SIZE);
+    }
+    return r;
+}
+
+void NetDevice::PostRxBuffer(RxQueue* q, size_t buffer) {
+    uint16_t i = q->ring.AllocDesc();
+    vring_desc* desc = q->ring.DescFromIndex(i);
+    desc->addr = q->bufs_pa + buffer * kRxBufSize;
+    desc->len = kRxBufSize;
+    desc->flags = VRING_DESC_F_WRITE;
+    desc->next = 0;
+    q->ring.SubmitChain(i);
+}
+
+bool NetDevice::UpdateLinkStatus() {
+    bool up = true;
+    if (has_status_) {
+        virtio_net_config_t config;
+        CopyDeviceConfig(&config, offsetof(virtio_net_config_t, max_virtqueue_pairs));
+        up = (config.status & VIRTIO_NET_S_LINK_UP) != 0;
+    }
+    bool changed = up != link_up_;
+    link_up_ = up;
+    return changed;
+}
+
+void NetDevice::IrqRingUpdate() {
+    LTRACE_ENTRY;
+
+    ethmac_ifc_t* ifc = __atomic_load_n(&ifc_, __ATOMIC_ACQUIRE);
+    void* cookie = cookie_;
+
+    // what all the tx queues finished is reported at once
+    uint32_t sent;
+    {
+        mxtl::AutoLock lock(&tx_lock_);
+        sent = ReapTxLocked();
+    }
+    if ((sent > 0) && (ifc != nullptr)) {
+        ifc->complete_tx(cookie, sent);
+    }
+
+    for (uint16_t i = 0; i < pair_count_; i++) {
+        Receive(rx_[i].get(), ifc, cookie);
+    }
+}
+
+void NetDevice::Receive(RxQueue* q, ethmac_ifc_t* ifc, void* cookie) {
+    // Gather everything first, so that all but the last packet go with
+    // ETHMAC_RX_OPT_MORE. Nothing is given back until then, so there is no
+    // more than one used element for each buffer.
+    uint16_t count = 0;
+    Ring* ring = &q->ring;
+    vring_used_elem* used = q->used.get();
+    mx_paddr_t bufs_pa = q->bufs_pa;
+    ring->IrqRingUpdate([ring, used, bufs_pa, &count](vring_used_elem* used_elem) {
+        uint16_t head = (uint16_t)used_elem->id;
+        // from here on, the element's id is the buffer's
+        used[count].id = (uint32_t)((ring->DescFromIndex(head)->addr - bufs_pa) / kRxBufSize);
+        used[count].len = used_elem->len;
+        count++;
+        ring->FreeDescChain(head);
+    });
+    if (count == 0) {
+        return;
+    }
+
+    for (uint16_t i = 0; i < count;) {
+        uint8_t* buf = q->bufs + used[i].id * kRxBufSize;
+        const virtio_net_hdr_t* hdr = reinterpret_cast<const virtio_net_hdr_t*>(buf);
+        size_t len = used[i].len;
+        bool ok = len >= hdr_size_;
+        uint16_t n = 1;
+        if (ok && mrg_rxbuf_ && (hdr->num_buffers > 1)) {
+            n = hdr->num_buffers;
+            if (n > count - i) {
+                // the rest should have come with it
+                VIRTIO_ERROR("rx packet missing %u of its %u buffers\n", n - (count - i), n);
+                n = (uint16_t)(count - i);
+                ok = false;
+            }
+        }
+
+        uint8_t* frame = buf + hdr_size_;
+        size_t frame_len = ok ? len - hdr_size_ : 0;
+        if (ok && (n > 1)) {
+            // copied out in one piece, which is only needed past kRxBufSize
+            frame = frame_.get();
+            size_t total = 0;
+            for (uint16_t j = 0; ok && (j < n); j++) {
+                const uint8_t* src = q->bufs + used[i + j].id * kRxBufSize;
+                size_t src_len = used[i + j].len;
+                if (j == 0) {
+                    src += hdr_size_;
+                    src_len -= hdr_size_;
+                }
+                if (src_len > frame_size_ - total) {
+                    ok = false;
+                    break;
+                }
+                memcpy(frame + total, src, src_len);
+                total += src_len;
+            }
+            frame_len = total;
+        }
+
+        if (ok && (ifc != nullptr)) {
+            uint32_t flags = (i + n < count) ? ETHMAC_RX_OPT_MORE : 0;
+            if (rx_csum_) {
+                if (hdr->flags & VIRTIO_NET_HDR_F_NEEDS_CSUM) {
+                    if (FillChecksum(frame, frame_len, hdr->csum_start, hdr->csum_offset)) {
+                        flags |= ETHMAC_RX_OPT_CSUM_OK;
+                    }
+                } else if (hdr->flags & VIRTIO_NET_HDR_F_DATA_VALID) {
+                    flags |= ETHMAC_RX_OPT_CSUM_OK;
+                }
+            }
+            ifc->recv(cookie, frame, frame_len, flags);
+        }
+
+        for (uint16_t j = 0; j < n; j++) {
+            PostRxBuffer(q, used[i + j].id);
+        }
+        i = (uint16_t)(i + n);
+    }
+    ring->Kick();
+}
+
+void NetDevice::QueueTx(uint32_t options, uintptr_t pa0, uintptr_t pa1, size_t length) {
+    mxtl::AutoLock lock(&tx_lock_);
+
+    if (tx_count_ == kTxSlots) {
+        // the ethernet layer holds to tx_depth_, so this can't happen
+        VIRTIO_ERROR("tx buffer queued past the tx queue depth\n");
+        return;
+    }
+    uint32_t slot = (tx_head_ + tx_count_) % kTxSlots;
+    tx_count_++;
+
+    // each flow sticks to one queue, so that it isn't reordered
+    TxQueue* q = tx_[(pair_count_ > 1) ? ETHMAC_TX_FLOW(options) % pair_count_ : 0].get();
+
+    TxRequest* req = &tx_requests_[slot];
+    mx_paddr_t req_pa = tx_requests_pa_ + slot * sizeof(TxRequest);
+    memset(&req->hdr, 0, sizeof(req->hdr));
+    req->hdr.gso_type = VIRTIO_NET_HDR_GSO_NONE;
+    if (tx_csum_ && (options & ETHMAC_TX_OPT_CSUM) &&
+        (ETHMAC_TX_CSUM_OFFSET(options) > ETHMAC_TX_CSUM_START(options))) {
+        req->hdr.flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+        req->hdr.csum_start = (uint16_t)ETHMAC_TX_CSUM_START(options);
+        // from where the sum starts, rather than from the frame
+        req->hdr.csum_offset =
+            (uint16_t)(ETHMAC_TX_CSUM_OFFSET(options) - ETHMAC_TX_CSUM_START(options));
+    }
+
+    // the header, then the frame, which may cross into a second page
+    vring_desc descs[3];
+    size_t count = 0;
+    size_t len0 = pa1 ? mxtl::min<size_t>(length, PAGE_SIZE - (pa0 % PAGE_SIZE)) : length;
+    descs[count++] = { req_pa + offsetof(TxRequest, hdr), (uint32_t)hdr_size_, 0, 0 };
+    descs[count++] = { pa0, (uint32_t)len0, 0, 0 };
+    if (len0 < length) {
+        descs[count++] = { pa1, (uint32_t)(length - len0), 0, 0 };
+    }
+
+    uint16_t head;
+    vring_desc* desc = q->ring.AllocDescChain(indirect_ ? 1 : (uint16_t)count, &head);
+    if (!desc) {
+        // Also can't happen. It is reported sent with the next ones, so
+        // that the ethernet layer isn't left waiting for it.
+        VIRTIO_ERROR("tx ring full\n");
+        tx_sent_[slot] = true;
+        return;
+    }
+    if (indirect_) {
+        /* the ring descriptor points at the buffer's own table */
+        for (size_t i = 0; i < count; i++) {
+            req->table[i] = descs[i];
+            if (i + 1 < count) {
+                req->table[i].flags |= VRING_DESC_F_NEXT;
+                req->table[i].next = (uint16_t)(i + 1);
+            }
+        }
+        desc->addr = req_pa + offsetof(TxRequest, table);
+        desc->len = (uint32_t)(count * sizeof(vring_desc));
+        desc->flags = VRING_DESC_F_INDIRECT;
+    } else {
+        /* fill in the chain, which is already linked */
+        for (size_t i = 0; i < count; i++) {
+            desc->addr = descs[i].addr;
+            desc->len = descs[i].len;
+            desc->flags = (uint16_t)((desc->flags & VRING_DESC_F_NEXT) | descs[i].flags);
+            if (i + 1 < count) {
+                desc = q->ring.DescFromIndex(desc->next);
+            }
+        }
+    }
+
+    q->head_slot[head] = (uint16_t)slot;
+    tx_sent_[slot] = false;
+    q->ring.SubmitChain(head);
+    q->needs_kick = true;
+
+    // the device is told of a batch once, at its last buffer
+    if (!(options & ETHMAC_TX_OPT_MORE)) {
+        for (uint16_t i = 0; i < pair_count_; i++) {
+            if (tx_[i]->needs_kick) {
+                tx_[i]->ring.Kick();
+                tx_[i]->needs_kick = false;
+            }
+        }
+    }
+}
+
+uint32_t NetDevice::ReapTxLocked() {
+    for (uint16_t i = 0; i < pair_count_; i++) {
+        TxQueue* q = tx_[i].get();
+        q->ring.IrqRingUpdate([this, q](vring_used_elem* used_elem) TA_NO_THREAD_SAFETY_ANALYSIS {
+            uint16_t head = (uint16_t)used_elem->id;
+            tx_sent_[q->head_slot[head]] = true;
+            q->ring.FreeDescChain(head);
+        });
+    }
+
+    // the queues finish independently, but are reported in the order given
+    uint32_t count = 0;
+    while ((tx_count_ > 0) && tx_sent_[tx_head_]) {
+        tx_head_ = (tx_head_ + 1) % kTxSlots;
+        tx_count_--;
+        if (tx_abandoned_ > 0) {
+            tx_abandoned_--;
+        } else {
+            count++;
+        }
+    }
+    return count;
+}
+
+void NetDevice::Stop() {
+    __atomic_store_n(&ifc_, nullptr, __ATOMIC_RELEASE);
+
+    // The ethernet layer takes its tx buffers back as soon as this returns,
+    // so wait a little for the device to be done reading them. Any it is
+    // still reading after that aren't reported sent when it is done.
+    mxtl::AutoLock lock(&tx_lock_);
+    mx_time_t deadline = mx_deadline_after(MX_MSEC(100));
+    for (;;) {
+        ReapTxLocked();
+        if (tx_count_ == 0) {
+            break;
+        }
+        if (mx_time_get(MX_CLOCK_MONOTONIC) > deadline) {
+            VIRTIO_ERROR("%u tx buffers still queued at stop\n", tx_count_);
+            break;
+        }
+        mx_nanosleep(mx_deadline_after(MX_USEC(100)));
+    }
+    tx_abandoned_ = tx_count_;
+}
+
+mx_status_t NetDevice::Start(ethmac_ifc_t* ifc, void* cookie) {
+    if (__atomic_load_n(&ifc_, __ATOMIC_ACQUIRE) != nullptr) {
+        return MX_ERR_BAD_STATE;
+    }
+    cookie_ = cookie;
+    __atomic_store_n(&ifc_, ifc, __ATOMIC_RELEASE);
+    return MX_OK;
+}
+
+void NetDevice::IrqConfigChange() {
+    LTRACE_ENTRY;
+
+    if (!UpdateLinkStatus()) {
+        return;
+    }
+    ethmac_ifc_t* ifc = __atomic_load_n(&ifc_, __ATOMIC_ACQUIRE);
+    if (ifc != nullptr) {
+        ifc->status(cookie_, link_up_ ? ETHMAC_STATUS_ONLINE : 0);
+    }
+}
+
+} // namespace virtio
@@ -0,0 +1,166 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+#pragma once
+
+#include "device.h"
+#include "ring.h"
+
+#include <magenta/compiler.h>
+#include <stdlib.h>
+
+#include <ddk/protocol/ethernet.h>
+#include <magenta/thread_annotations.h>
+#include <mxtl/mutex.h>
+#include <mxtl/unique_ptr.h>
+#include <virtio/net.h>
+
+namespace virtio {
+
+class Ring;
+
+// Received packets are copied out of the driver's own buffers, which with
+// VIRTIO_NET_F_MRG_RXBUF take one descriptor each, header and all. Sent
+// ones go straight from the ethernet layer's buffers, with the header in
+// a descriptor of its own.
+class NetDevice : public Device {
+public:
+    NetDevice(mx_device_t* device);
+    virtual ~NetDevice();
+
+    virtual mx_status_t Init();
+
+    virtual void IrqRingUpdate();
+    virtual void IrqConfigChange();
+
+private:
+    // DDK driver hooks
+    static mx_status_t virtio_net_query(void* ctx, uint32_t options, ethmac_info_t* info);
+    static void virtio_net_stop(void* ctx);
+    static mx_status_t virtio_net_start(void* ctx, ethmac_ifc_t* ifc, void* cookie);
+    static void virtio_net_send(void* ctx, uint32_t options, void* data, size_t length);
+    static void virtio_net_queue_tx(void* ctx, uint32_t options,
+                                    uintptr_t pa0, uintptr_t pa1, size_t length);
+
+    // the most a modern device's rings are given; a legacy one's are the
+    // size the device says
+    static const uint16_t kMaxRingSize = 256;
+
+    // at most one queue pair per cpu, up to this many
+    static const uint16_t kMaxPairs = 8;
+
+    // two to a page, so that none crosses a page boundary
+    static const size_t kRxBufSize = 2048;
+
+    // the most tx buffers held at once, though a ring may hold fewer
+    static const uint32_t kTxDepth = 128;
+
+    // Each tx buffer queued takes one of these, in turn, and gives it up
+    // once it and all those before it are sent; there are enough for
+    // those left on the rings by a stop() that timed out as well.
+    static const uint32_t kTxSlots = kTxDepth * 2;
+
+    // What the device reads of a tx buffer besides its data: the header,
+    // and with indirect descriptors the table the ring descriptor points
+    // at. The table is first, to keep it aligned.
+    struct TxRequest {
+        vring_desc table[3];
+        virtio_net_hdr_t hdr;
+        uint8_t reserved[4];
+    };
+    static_assert(sizeof(TxRequest) == 64, "");
+
+    struct RxQueue {
+        explicit RxQueue(Device* device) : ring(device) {}
+
+        // only touched by the irq thread once running, under lock_
+        Ring ring;
+        uint16_t size = 0;
+        mx_paddr_t bufs_pa = 0;
+        uint8_t* bufs = nullptr;
+        // what the device has filled, gathered before any is handed on
+        mxtl::unique_ptr<vring_used_elem[]> used;
+    };
+
+    struct TxQueue {
+        explicit TxQueue(Device* device) : ring(device) {}
+
+        // all under tx_lock_
+        Ring ring;
+        uint16_t size = 0;
+        // the slot of each descriptor chain in flight, by its head
+        mxtl::unique_ptr<uint16_t[]> head_slot;
+        // whether anything was queued since the device was last told
+        bool needs_kick = false;
+    };
+
+    uint16_t RingSize(uint16_t index);
+    mx_status_t InitRxQueue(RxQueue* q, uint16_t index);
+    mx_status_t InitTxQueue(TxQueue* q, uint16_t index);
+    mx_status_t SetQueuePairs(uint16_t pairs);
+    void PostRxBuffer(RxQueue* q, size_t buffer);
+
+    // Hands on what the device has received on |q|, and gives it the
+    // buffers back.
+    void Receive(RxQueue* q, ethmac_ifc_t* ifc, void* cookie);
+
+    void QueueTx(uint32_t options, uintptr_t pa0, uintptr_t pa1, size_t length);
+
+    // Frees what the device has sent, returning how many of the oldest tx
+    // buffers can now be reported sent.
+    uint32_t ReapTxLocked() TA_REQ(tx_lock_);
+
+    void Stop();
+    mx_status_t Start(ethmac_ifc_t* ifc, void* cookie);
+
+    // Reads the link state, returning whether it changed.
+    bool UpdateLinkStatus();
+
+    mxtl::unique_ptr<RxQueue> rx_[kMaxPairs];
+    mxtl::unique_ptr<TxQueue> tx_[kMaxPairs];
+    uint16_t pair_count_ = 0;
+
+    // only used at Init(), to turn on the other pairs
+    mxtl::unique_ptr<Ring> ctrl_;
+
+    // the header the device puts before each packet, and so its size
+    size_t hdr_size_ = 0;
+    bool mrg_rxbuf_ = false;
+    // reassembles packets which span rx buffers
+    mxtl::unique_ptr<uint8_t[]> frame_;
+    size_t frame_size_ = 0;
+
+    mxtl::Mutex tx_lock_;
+    mx_paddr_t tx_requests_pa_ = 0;
+    TxRequest* tx_requests_ = nullptr;
+    // the slots in flight, oldest first, and whether each has been sent
+    uint32_t tx_head_ TA_GUARDED(tx_lock_) = 0;
+    uint32_t tx_count_ TA_GUARDED(tx_lock_) = 0;
+    bool tx_sent_[kTxSlots] TA_GUARDED(tx_lock_) = {};
+    // the oldest of those in flight, which were given up at a stop()
+    uint32_t tx_abandoned_ TA_GUARDED(tx_lock_) = 0;
+    // how many the ethernet layer may queue at once
+    uint32_t tx_depth_ = 0;
+    // whether tx buffers take one ring descriptor pointing at their own table
+    bool indirect_ = false;
+
+    // The ethernet layer holds its own lock while it calls stop(), and
+    // takes it in every callback, so these are loaded without a lock of
+    // ours. A callback already under way when stop() returns finds nothing
+    // left of what was stopped.
+    ethmac_ifc_t* ifc_ = nullptr;
+    void* cookie_ = nullptr;
+
+    // saved net device configuration out of the pci config BAR
+    virtio_net_config_t config_ = {};
+    uint8_t mac_[ETH_MAC_SIZE] = {};
+    uint32_t mtu_ = 0;
+    bool has_status_ = false;
+    bool link_up_ = false;
+    bool tx_csum_ = false;
+    bool rx_csum_ = false;
+
+    ethmac_protocol_ops_t ethmac_ops_ = {};
+};
+
+} // namespace virtio
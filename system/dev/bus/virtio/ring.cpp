@@ -156,14 +156,29 @@ void Ring::SubmitChain(uint16_t desc_index) {
     struct vring_avail* avail = ring_.avail;
 
     avail->ring[avail->idx & ring_.num_mask] = desc_index;
-    //mb();
+    // the device may act on the new index at once, so the entry goes first
+    hw_wmb();
     avail->idx++;
 }
 
 void Ring::Kick() {
     LTRACE_ENTRY;
 
-    device_->RingKick(index_);
+    uint16_t new_idx = ring_.avail->idx;
+    uint16_t old_idx = kicked_idx_;
+    kicked_idx_ = new_idx;
+
+    // the device has to see the new index before we look at whether it wants to hear about it
+    hw_mb();
+
+    bool notify;
+    if (event_index_) {
+        notify = vring_need_event(*(volatile uint16_t*)&vring_avail_event(&ring_), new_idx, old_idx);
+    } else {
+        notify = !(*(volatile uint16_t*)&ring_.used->flags & VRING_USED_F_NO_NOTIFY);
+    }
+    if (notify)
+        device_->RingKick(index_);
 }
 
 } // namespace virtio
@@ -3,6 +3,7 @@
 // found in the LICENSE file.
 #pragma once
 
+#include <hw/arch_ops.h>
 #include <magenta/types.h>
 #include <virtio/virtio_ring.h>
 
@@ -19,6 +20,11 @@ public:
 
     mx_status_t Init(uint16_t index, uint16_t count);
 
+    // Once VIRTIO_RING_F_EVENT_IDX is negotiated: the device is only kicked,
+    // and only interrupts, when the other side has caught up to what it last
+    // said it had seen.
+    void UseEventIndex() { event_index_ = true; }
+
     void FreeDesc(uint16_t desc_index);
     void FreeDescChain(uint16_t chain_head);
     uint16_t AllocDesc();
@@ -42,6 +48,10 @@ private:
 
     uint16_t index_ = 0;
 
+    bool event_index_ = false;
+    // avail->idx as of the last kick
+    uint16_t kicked_idx_ = 0;
+
     vring ring_ = {};
 };
 
@@ -51,18 +61,29 @@ inline void Ring::IrqRingUpdate(T free_chain) {
     // TRACEF("used flags %#x idx %#x last_used %u\n",
     //         ring_.used->flags, ring_.used->idx, ring_.last_used);
 
-    // find a new free chain of descriptors
-    unsigned int cur_idx = ring_.used->idx;
-    for (unsigned int i = ring_.last_used; i != (cur_idx & ring_.num_mask); i = (i + 1) & ring_.num_mask) {
-        // TRACEF("looking at idx %u\n", i);
-
-        struct vring_used_elem* used_elem = &ring_.used->ring[i];
+    // last_used runs free, like the device's idx, and is masked to index the ring
+    volatile uint16_t* used_idx = &ring_.used->idx;
+    for (;;) {
+        if (*used_idx == ring_.last_used) {
+            if (!event_index_)
+                break;
+            // ask to be interrupted for the next one, then look once more in
+            // case it arrived before the device could see that
+            *(volatile uint16_t*)&vring_used_event(&ring_) = ring_.last_used;
+            hw_mb();
+            if (*used_idx == ring_.last_used)
+                break;
+        }
+        // read the element only after the index that covers it
+        hw_rmb();
+
+        struct vring_used_elem* used_elem = &ring_.used->ring[ring_.last_used & ring_.num_mask];
         // TRACEF("used chain id %u, len %u\n", used_elem->id, used_elem->len);
 
         // free the chain
         free_chain(used_elem);
 
-        ring_.last_used = ((ring_.last_used + 1) & ring_.num_mask) & 0xffff;
+        ring_.last_used++;
     }
 }
 
@@ -20,6 +20,7 @@
 #include "block.h"
 #include "device.h"
 #include "gpu.h"
+#include "net.h"
 #include "trace.h"
 
 #define LOCAL_TRACE 0
@@ -57,6 +58,11 @@ extern "C" mx_status_t virtio_bind(void* ctx, mx_device_t* device, void** cookie
         LTRACEF("found block device\n");
         vd.reset(new virtio::BlockDevice(device));
         break;
+    case 0x1000:
+    case 0x1041:
+        LTRACEF("found net device\n");
+        vd.reset(new virtio::NetDevice(device));
+        break;
     case 0x1050:
         LTRACEF("found gpu device\n");
         vd.reset(new virtio::GpuDevice(device));
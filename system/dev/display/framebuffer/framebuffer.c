@@ -54,9 +54,15 @@ static inline void FB_FLUSH(fb_t* fb) {
 
 struct fbi {
     fb_t* fb;
-    void* buffer;
-    mx_handle_t vmo;
+    void* buffer[MX_DISPLAY_MAX_BUFFERS];
+    mx_handle_t vmo[MX_DISPLAY_MAX_BUFFERS];
     uint32_t group;
+
+    // the buffer flushes copy from, which is the last one presented
+    uint32_t front;
+
+    // signaled each time a present reaches the display
+    mx_handle_t present_event;
 };
 
 void fb_callback(bool acquired, void* cookie) {
@@ -72,31 +78,290 @@ void fb_callback(bool acquired, void* cookie) {
     mtx_unlock(&fb->lock);
 }
 
-static mx_status_t fbi_get_vmo(fbi_t* fbi, mx_handle_t* vmo) {
+static mx_status_t fbi_get_vmo(fbi_t* fbi, uint32_t n, mx_handle_t* vmo) {
     mtx_lock(&fbi->fb->lock);
     mx_status_t r;
-    if (fbi->vmo != MX_HANDLE_INVALID) {
+    if (fbi->vmo[n] != MX_HANDLE_INVALID) {
         r = MX_OK;
         goto done;
     }
-    if ((r = mx_vmo_create(fbi->fb->bufsz, 0, &fbi->vmo)) < 0) {
+    if ((r = mx_vmo_create(fbi->fb->bufsz, 0, &fbi->vmo[n])) < 0) {
         printf("fb: cannot create vmo (%zu bytes): %d\n", fbi->fb->bufsz, r);
         goto done;
     }
-    if ((r = mx_vmar_map(mx_vmar_root_self(), 0, fbi->vmo, 0, fbi->fb->bufsz,
+    if ((r = mx_vmar_map(mx_vmar_root_self(), 0, fbi->vmo[n], 0, fbi->fb->bufsz,
                 MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE,
-                (uintptr_t*) &fbi->buffer)) < 0) {
+                (uintptr_t*) &fbi->buffer[n])) < 0) {
         printf("fb: cannot map buffer: %d\n", r);
-        mx_handle_close(fbi->vmo);
-        fbi->vmo = MX_HANDLE_INVALID;
+        mx_handle_close(fbi->vmo[n]);
+        fbi->vmo[n] = MX_HANDLE_INVALID;
         goto done;
     }
 done:
-    *vmo = fbi->vmo;
+    *vmo = fbi->vmo[n];
     mtx_unlock(&fbi->fb->lock);
     return r;
 }
 
+static mx_status_t fb_check_region(fb_t* fb, const ioctl_display_region_t* r) {
+    if ((r->x >= fb->info.width) || (r->width > (fb->info.width - r->x)) ||
+        (r->y >= fb->info.height) || (r->height > (fb->info.height - r->y))) {
+        return MX_ERR_OUT_OF_RANGE;
+    }
+    return MX_OK;
+}
+
+// copy the given regions of a client buffer to the display and flush them,
+// or all of it if there are none
+// called with fb->lock held
+static void fb_update(fb_t* fb, const void* buffer,
+                      const ioctl_display_region_t* regions, size_t count) {
+    if (count == 0) {
+        memcpy(fb->buffer, buffer, fb->bufsz);
+        FB_FLUSH(fb);
+        return;
+    }
+    uint32_t linesize = fb->info.stride * fb->info.pixelsize;
+    for (size_t i = 0; i < count; i++) {
+        const ioctl_display_region_t* r = &regions[i];
+        size_t off = r->y * linesize + r->x * fb->info.pixelsize;
+        size_t len = r->width * fb->info.pixelsize;
+        if (len == linesize) {
+            memcpy(fb->buffer + off, buffer + off, r->height * linesize);
+        } else {
+            for (uint32_t y = 0; y < r->height; y++, off += linesize) {
+                memcpy(fb->buffer + off, buffer + off, len);
+            }
+        }
+    }
+    if (fb->dpy.ops->flush_region) {
+        for (size_t i = 0; i < count; i++) {
+            fb->dpy.ops->flush_region(fb->dpy.ctx, regions[i].x, regions[i].y,
+                                      regions[i].width, regions[i].height);
+        }
+    } else {
+        FB_FLUSH(fb);
+    }
+}
+
+static mx_status_t fbi_flush(fbi_t* fbi, uint32_t n,
+                             const ioctl_display_region_t* regions, size_t count) {
+    fb_t* fb = fbi->fb;
+    for (size_t i = 0; i < count; i++) {
+        mx_status_t r;
+        if ((r = fb_check_region(fb, &regions[i])) < 0) {
+            return r;
+        }
+    }
+    mtx_lock(&fb->lock);
+    if ((fb->active == fbi->group) && (fbi->buffer[n] != NULL)) {
+        fb_update(fb, fbi->buffer[n], regions, count);
+    }
+    mtx_unlock(&fb->lock);
+    return MX_OK;
+}
+
+// fill a region of a buffer laid out like the display
+static void fb_fill(fb_t* fb, void* buffer, const ioctl_display_region_t* r, uint32_t color) {
+    uint32_t linesize = fb->info.stride * fb->info.pixelsize;
+    uint8_t* line = buffer + r->y * linesize + r->x * fb->info.pixelsize;
+    for (uint32_t y = 0; y < r->height; y++, line += linesize) {
+        for (uint32_t x = 0; x < r->width; x++) {
+            switch (fb->info.pixelsize) {
+            case 4:
+                ((uint32_t*)line)[x] = color;
+                break;
+            case 2:
+                ((uint16_t*)line)[x] = (uint16_t)color;
+                break;
+            default:
+                line[x] = (uint8_t)color;
+                break;
+            }
+        }
+    }
+}
+
+// copy a region of a buffer laid out like the display, which may overlap
+// its destination
+static void fb_copy(fb_t* fb, void* buffer, const ioctl_display_copy_t* c) {
+    uint32_t linesize = fb->info.stride * fb->info.pixelsize;
+    size_t len = c->src.width * fb->info.pixelsize;
+    uint8_t* src = buffer + c->src.y * linesize + c->src.x * fb->info.pixelsize;
+    uint8_t* dst = buffer + c->dst_y * linesize + c->dst_x * fb->info.pixelsize;
+    if (dst < src) {
+        for (uint32_t y = 0; y < c->src.height; y++) {
+            memmove(dst + y * linesize, src + y * linesize, len);
+        }
+    } else {
+        for (uint32_t y = c->src.height; y-- > 0;) {
+            memmove(dst + y * linesize, src + y * linesize, len);
+        }
+    }
+}
+
+static mx_status_t fbi_fill(fbi_t* fbi, const ioctl_display_fill_t* f) {
+    fb_t* fb = fbi->fb;
+    mx_status_t r;
+    if ((r = fb_check_region(fb, &f->region)) < 0) {
+        return r;
+    }
+    mtx_lock(&fb->lock);
+    void* buffer = fbi->buffer[fbi->front];
+    if (buffer != NULL) {
+        fb_fill(fb, buffer, &f->region, f->color);
+        if (fb->active == fbi->group) {
+            const ioctl_display_region_t* rr = &f->region;
+            if ((fb->dpy.ops->fill_region == NULL) ||
+                (fb->dpy.ops->fill_region(fb->dpy.ctx, rr->x, rr->y, rr->width, rr->height,
+                                          f->color) < 0)) {
+                fb_update(fb, buffer, rr, 1);
+            }
+        }
+    }
+    mtx_unlock(&fb->lock);
+    return MX_OK;
+}
+
+static mx_status_t fbi_copy(fbi_t* fbi, const ioctl_display_copy_t* c) {
+    fb_t* fb = fbi->fb;
+    mx_status_t r;
+    const ioctl_display_region_t dst = {
+        .x = c->dst_x,
+        .y = c->dst_y,
+        .width = c->src.width,
+        .height = c->src.height,
+    };
+    if (((r = fb_check_region(fb, &c->src)) < 0) || ((r = fb_check_region(fb, &dst)) < 0)) {
+        return r;
+    }
+    mtx_lock(&fb->lock);
+    void* buffer = fbi->buffer[fbi->front];
+    if (buffer != NULL) {
+        fb_copy(fb, buffer, c);
+        if (fb->active == fbi->group) {
+            if ((fb->dpy.ops->copy_region == NULL) ||
+                (fb->dpy.ops->copy_region(fb->dpy.ctx, c->src.x, c->src.y, c->src.width,
+                                          c->src.height, c->dst_x, c->dst_y) < 0)) {
+                fb_update(fb, buffer, &dst, 1);
+            }
+        }
+    }
+    mtx_unlock(&fb->lock);
+    return MX_OK;
+}
+
+static mx_status_t fbi_set_cursor(fbi_t* fbi, const ioctl_display_cursor_t* c) {
+    fb_t* fb = fbi->fb;
+    mx_status_t r;
+    uint32_t* pixels = NULL;
+    if (fb->dpy.ops->set_cursor == NULL) {
+        r = MX_ERR_NOT_SUPPORTED;
+        goto done;
+    }
+    if ((c->width == 0) || (c->width > MX_DISPLAY_MAX_CURSOR_SIZE) ||
+        (c->height == 0) || (c->height > MX_DISPLAY_MAX_CURSOR_SIZE)) {
+        r = MX_ERR_INVALID_ARGS;
+        goto done;
+    }
+    size_t len = c->width * c->height * sizeof(uint32_t);
+    size_t actual;
+    if ((pixels = malloc(len)) == NULL) {
+        r = MX_ERR_NO_MEMORY;
+        goto done;
+    }
+    if ((r = mx_vmo_read(c->vmo, pixels, 0, len, &actual)) < 0) {
+        goto done;
+    }
+    if (actual != len) {
+        r = MX_ERR_OUT_OF_RANGE;
+        goto done;
+    }
+    mtx_lock(&fb->lock);
+    if (fb->active == fbi->group) {
+        r = fb->dpy.ops->set_cursor(fb->dpy.ctx, pixels, c->width, c->height);
+    } else {
+        r = MX_ERR_ACCESS_DENIED;
+    }
+    mtx_unlock(&fb->lock);
+done:
+    free(pixels);
+    mx_handle_close(c->vmo);
+    return r;
+}
+
+static mx_status_t fbi_move_cursor(fbi_t* fbi, const ioctl_display_cursor_position_t* p) {
+    fb_t* fb = fbi->fb;
+    if (fb->dpy.ops->move_cursor == NULL) {
+        return MX_ERR_NOT_SUPPORTED;
+    }
+    mx_status_t r;
+    mtx_lock(&fb->lock);
+    if (fb->active == fbi->group) {
+        r = fb->dpy.ops->move_cursor(fb->dpy.ctx, p->x, p->y, p->visible != 0);
+    } else {
+        r = MX_ERR_ACCESS_DENIED;
+    }
+    mtx_unlock(&fb->lock);
+    return r;
+}
+
+// the cursor belongs to whichever group is on screen, so it goes away
+// when the other one takes over
+// called with fb->lock held
+static void fb_hide_cursor(fb_t* fb) {
+    if (fb->dpy.ops->move_cursor) {
+        fb->dpy.ops->move_cursor(fb->dpy.ctx, 0, 0, false);
+    }
+}
+
+static mx_status_t fbi_present(fbi_t* fbi, const ioctl_display_present_t* p, size_t len) {
+    if ((len < sizeof(*p)) || (p->region_count > MX_DISPLAY_MAX_REGIONS) ||
+        (len != sizeof(*p) + p->region_count * sizeof(ioctl_display_region_t))) {
+        return MX_ERR_INVALID_ARGS;
+    }
+    if ((p->buffer >= MX_DISPLAY_MAX_BUFFERS) || (fbi->buffer[p->buffer] == NULL)) {
+        return MX_ERR_INVALID_ARGS;
+    }
+    mx_status_t r;
+    if ((r = fbi_flush(fbi, p->buffer, p->regions, p->region_count)) < 0) {
+        return r;
+    }
+    fbi->front = p->buffer;
+    if (fbi->present_event != MX_HANDLE_INVALID) {
+        mx_object_signal(fbi->present_event, 0, MX_USER_SIGNAL_0);
+    }
+    return MX_OK;
+}
+
+static mx_status_t fbi_get_fb(fbi_t* fbi, uint32_t n, void* out_buf, size_t out_len,
+                              size_t* out_actual) {
+    fb_t* fb = fbi->fb;
+    if ((fbi->group == GROUP_FULLSCREEN) && FB_HAS_GPU(fb)) {
+        printf("fb: fullscreen soft framebuffer not supported (GPU)\n");
+        return MX_ERR_NOT_SUPPORTED;
+    }
+
+    if (out_len < sizeof(ioctl_display_get_fb_t)) {
+        return MX_ERR_BUFFER_TOO_SMALL;
+    }
+    ioctl_display_get_fb_t* out = out_buf;
+    memcpy(&out->info, &fb->info, sizeof(mx_display_info_t));
+    out->info.flags = 0;
+
+    mx_status_t r;
+    mx_handle_t vmo;
+    if ((r = fbi_get_vmo(fbi, n, &vmo)) < 0) {
+        return r;
+    }
+    if ((r = mx_handle_duplicate(vmo, MX_RIGHT_SAME_RIGHTS, &out->vmo)) < 0) {
+        return r;
+    } else {
+        *out_actual = sizeof(ioctl_display_get_fb_t);
+        return MX_OK;
+    }
+}
+
 static mx_status_t fbi_ioctl(void* ctx, uint32_t op,
                              const void* in_buf, size_t in_len,
                              void* out_buf, size_t out_len, size_t* out_actual) {
@@ -113,56 +378,83 @@ static mx_status_t fbi_ioctl(void* ctx, uint32_t op,
         //TODO: remove compat stub once no longer needed
         return MX_OK;
 
-    case IOCTL_DISPLAY_FLUSH_FB_REGION: {
+    case IOCTL_DISPLAY_FLUSH_FB_REGION:
         if (in_len != sizeof(ioctl_display_region_t)) {
             return MX_ERR_INVALID_ARGS;
         }
-        const ioctl_display_region_t* r = in_buf;
-        uint32_t y = r->y;
-        uint32_t h = r->height;
-        if ((y >= fb->info.height) ||
-            (h > (fb->info.height - y))) {
-            return MX_ERR_OUT_OF_RANGE;
-        }
-        uint32_t linesize = fb->info.stride * fb->info.pixelsize;
-        mtx_lock(&fb->lock);
-        if ((fb->active == fbi->group) && (fbi->buffer != NULL)) {
-            memcpy(fb->buffer + y * linesize, fbi->buffer + y * linesize, h * linesize);
-            FB_FLUSH(fb);
+        return fbi_flush(fbi, fbi->front, in_buf, 1);
+
+    case IOCTL_DISPLAY_FLUSH_FB_REGIONS:
+        if ((in_len == 0) || (in_len % sizeof(ioctl_display_region_t)) ||
+            (in_len > MX_DISPLAY_MAX_REGIONS * sizeof(ioctl_display_region_t))) {
+            return MX_ERR_INVALID_ARGS;
         }
-        mtx_unlock(&fb->lock);
-        return MX_OK;
-    }
+        return fbi_flush(fbi, fbi->front, in_buf, in_len / sizeof(ioctl_display_region_t));
+
     case IOCTL_DISPLAY_FLUSH_FB:
-        mtx_lock(&fb->lock);
-        if ((fb->active == fbi->group) && (fbi->buffer != NULL)) {
-            memcpy(fb->buffer, fbi->buffer, fb->bufsz);
-            FB_FLUSH(fb);
+        return fbi_flush(fbi, fbi->front, NULL, 0);
+
+    case IOCTL_DISPLAY_PRESENT:
+        return fbi_present(fbi, in_buf, in_len);
+
+    case IOCTL_DISPLAY_FILL_FB_REGION:
+        if (in_len != sizeof(ioctl_display_fill_t)) {
+            return MX_ERR_INVALID_ARGS;
         }
-        mtx_unlock(&fb->lock);
-        return MX_OK;
+        return fbi_fill(fbi, in_buf);
 
-    case IOCTL_DISPLAY_GET_FB: {
-        if ((fbi->group == GROUP_FULLSCREEN) && FB_HAS_GPU(fb)) {
-            printf("fb: fullscreen soft framebuffer not supported (GPU)\n");
-            return MX_ERR_NOT_SUPPORTED;
+    case IOCTL_DISPLAY_COPY_FB_REGION:
+        if (in_len != sizeof(ioctl_display_copy_t)) {
+            return MX_ERR_INVALID_ARGS;
         }
+        return fbi_copy(fbi, in_buf);
 
-        if (out_len < sizeof(ioctl_display_get_fb_t)) {
-            return MX_ERR_BUFFER_TOO_SMALL;
+    case IOCTL_DISPLAY_SET_CURSOR:
+        if (in_len != sizeof(ioctl_display_cursor_t)) {
+            if (in_len >= sizeof(mx_handle_t)) {
+                mx_handle_close(*(const mx_handle_t*) in_buf);
+            }
+            return MX_ERR_INVALID_ARGS;
         }
-        ioctl_display_get_fb_t* out = out_buf;
-        memcpy(&out->info, &fb->info, sizeof(mx_display_info_t));
-        out->info.flags = 0;
+        return fbi_set_cursor(fbi, in_buf);
 
-        mx_handle_t vmo;
-        if ((r = fbi_get_vmo(fbi, &vmo)) < 0) {
+    case IOCTL_DISPLAY_MOVE_CURSOR:
+        if (in_len != sizeof(ioctl_display_cursor_position_t)) {
+            return MX_ERR_INVALID_ARGS;
+        }
+        return fbi_move_cursor(fbi, in_buf);
+
+    case IOCTL_DISPLAY_GET_FB:
+        return fbi_get_fb(fbi, 0, out_buf, out_len, out_actual);
+
+    case IOCTL_DISPLAY_GET_FB_BUFFER: {
+        if (in_len != sizeof(uint32_t)) {
+            return MX_ERR_INVALID_ARGS;
+        }
+        uint32_t n = *(const uint32_t*) in_buf;
+        if (n >= MX_DISPLAY_MAX_BUFFERS) {
+            return MX_ERR_OUT_OF_RANGE;
+        }
+        return fbi_get_fb(fbi, n, out_buf, out_len, out_actual);
+    }
+    case IOCTL_DISPLAY_GET_PRESENT_EVENT: {
+        if (out_len != sizeof(mx_handle_t)) {
+            return MX_ERR_INVALID_ARGS;
+        }
+        mtx_lock(&fb->lock);
+        r = MX_OK;
+        if (fbi->present_event == MX_HANDLE_INVALID) {
+            r = mx_event_create(0, &fbi->present_event);
+        }
+        mtx_unlock(&fb->lock);
+        if (r < 0) {
             return r;
         }
-        if ((r = mx_handle_duplicate(vmo, MX_RIGHT_SAME_RIGHTS, &out->vmo)) < 0) {
+        mx_handle_t* out = (mx_handle_t*) out_buf;
+        if ((r = mx_handle_duplicate(fbi->present_event, MX_RIGHT_SAME_RIGHTS, out)) < 0) {
             return r;
         } else {
-            *out_actual = sizeof(ioctl_display_get_fb_t);
+            *out_actual = sizeof(mx_handle_t);
             return MX_OK;
         }
     }
@@ -185,14 +477,18 @@ static mx_status_t fbi_ioctl(void* ctx, uint32_t op,
             return MX_OK;
         }
         mtx_lock(&fb->lock);
+        if (*n != fb->active) {
+            fb_hide_cursor(fb);
+        }
         if ((*n == GROUP_VIRTCON) || (fb->fullscreen == NULL)) {
             fb->active = GROUP_VIRTCON;
             mx_object_signal(fb->event, MX_USER_SIGNAL_1, MX_USER_SIGNAL_0);
         } else {
             fb->active = GROUP_FULLSCREEN;
             mx_object_signal(fb->event, MX_USER_SIGNAL_0, MX_USER_SIGNAL_1);
-            if (fb->fullscreen->buffer) {
-                memcpy(fb->buffer, fb->fullscreen->buffer, fb->bufsz);
+            fbi_t* fs = fb->fullscreen;
+            if (fs->buffer[fs->front]) {
+                memcpy(fb->buffer, fs->buffer[fs->front], fb->bufsz);
             } else {
                 memset(fb->buffer, 0, fb->bufsz);
             }
@@ -230,17 +526,23 @@ static void fbi_release(void* ctx) {
     if (fb->fullscreen == fbi) {
         fb->fullscreen = NULL;
         if (fb->active == GROUP_FULLSCREEN) {
+            fb_hide_cursor(fb);
             fb->active = GROUP_VIRTCON;
             mx_object_signal(fb->event, MX_USER_SIGNAL_1, MX_USER_SIGNAL_0);
         }
     }
     mtx_unlock(&fb->lock);
 
-    if (fbi->buffer) {
-        mx_vmar_unmap(mx_vmar_root_self(), (uintptr_t) fbi->buffer, fbi->fb->bufsz);
+    for (uint32_t n = 0; n < MX_DISPLAY_MAX_BUFFERS; n++) {
+        if (fbi->buffer[n]) {
+            mx_vmar_unmap(mx_vmar_root_self(), (uintptr_t) fbi->buffer[n], fbi->fb->bufsz);
+        }
+        if (fbi->vmo[n] != MX_HANDLE_INVALID) {
+            mx_handle_close(fbi->vmo[n]);
+        }
     }
-    if (fbi->vmo != MX_HANDLE_INVALID) {
-        mx_handle_close(fbi->vmo);
+    if (fbi->present_event != MX_HANDLE_INVALID) {
+        mx_handle_close(fbi->present_event);
     }
     free(fbi);
 }
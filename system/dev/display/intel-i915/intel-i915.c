@@ -5,8 +5,10 @@
 #include <ddk/binding.h>
 #include <ddk/device.h>
 #include <ddk/driver.h>
+#include <ddk/io-buffer.h>
 #include <ddk/protocol/display.h>
 #include <ddk/protocol/pci.h>
+#include <hw/arch_ops.h>
 #include <hw/pci.h>
 
 #include <assert.h>
@@ -15,6 +17,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <threads.h>
 
 #define INTEL_I915_VID (0x8086)
 #define INTEL_I915_BROADWELL_DID (0x1616)
@@ -25,6 +28,53 @@
 #define BACKLIGHT_CTRL_OFFSET (0xc8250)
 #define BACKLIGHT_CTRL_BIT ((uint32_t)(1u << 31))
 
+// The GTT is the upper half of the register window, one 64 bit entry per
+// page of graphics address space.
+#define GTT_PTE_PRESENT (1u << 0)
+#define GFX_FLSH_CNTL (0x101008)
+
+// Keeps the GT awake while the blitter registers are in use.
+#define FORCEWAKE_MT (0xa188)
+#define FORCEWAKE_ACK (0x130044)
+#define FORCEWAKE_KERNEL (1u << 0)
+
+// pipe A cursor plane
+#define CURACNTR (0x70080)
+#define CURABASE (0x70084)
+#define CURAPOS (0x70088)
+#define CURSOR_MODE_DISABLED (0x00)
+#define CURSOR_MODE_64_ARGB (0x27)
+#define CURSOR_POS_SIGN (1u << 15)
+#define CURSOR_SIZE 64
+
+// blitter engine ring
+#define BCS_RING_TAIL (0x22030)
+#define BCS_RING_HEAD (0x22034)
+#define BCS_RING_START (0x22038)
+#define BCS_RING_CTL (0x2203c)
+#define BCS_GFX_MODE (0x2229c)
+#define GFX_MODE_EXECLIST_ENABLE (1u << 15)
+#define RING_ADDR_MASK (0x1ffffc)
+#define RING_VALID (1u << 0)
+#define RING_SIZE (PAGE_SIZE)
+
+#define MI_NOOP (0)
+#define MI_FLUSH_DW ((0x26u << 23) | 2)
+#define XY_COLOR_BLT ((2u << 29) | (0x50u << 22) | 5)
+#define XY_SRC_COPY_BLT ((2u << 29) | (0x53u << 22) | 8)
+#define BLT_WRITE_ARGB (3u << 20)
+#define BLT_DEPTH_565 (1u << 24)
+#define BLT_DEPTH_8888 (3u << 24)
+#define BLT_ROP_COPY (0xccu << 16)
+#define BLT_ROP_PATCOPY (0xf0u << 16)
+
+// The cursor image and the ring live at the top of the aperture, past the
+// framebuffer, in pages of our own.
+#define CURSOR_BUFFER_SIZE (CURSOR_SIZE * CURSOR_SIZE * 4)
+#define GFX_BUFFER_SIZE (CURSOR_BUFFER_SIZE + RING_SIZE)
+
+#define BLT_TIMEOUT MX_MSEC(100)
+
 #define TRACE 0
 
 #if TRACE
@@ -46,9 +96,30 @@ typedef struct intel_i915_device {
 
     mx_display_info_t info;
     uint32_t flags;
+
+    // pages that the cursor and the blitter use, mapped into the GTT at
+    // gfx_base and reached by the CPU through the aperture
+    io_buffer_t gfx_buffer;
+    uint64_t gfx_base;
+    uint32_t* cursor;
+    uint32_t* ring;
+    uint32_t ring_tail;
+
+    mtx_t lock;
+    bool cursor_visible;
 } intel_i915_device_t;
 
 #define FLAGS_BACKLIGHT 1
+#define FLAGS_CURSOR 2
+#define FLAGS_BLITTER 4
+
+static inline uint32_t intel_i915_read(intel_i915_device_t* dev, uint32_t offset) {
+    return pcie_read32((void*)((uint8_t*)dev->regs + offset));
+}
+
+static inline void intel_i915_write(intel_i915_device_t* dev, uint32_t offset, uint32_t val) {
+    pcie_write32((void*)((uint8_t*)dev->regs + offset), val);
+}
 
 static void intel_i915_enable_backlight(intel_i915_device_t* dev, bool enable) {
     if (dev->flags & FLAGS_BACKLIGHT) {
@@ -64,6 +135,129 @@ static void intel_i915_enable_backlight(intel_i915_device_t* dev, bool enable) {
     }
 }
 
+// Maps the gfx buffer's pages at the top of the aperture, so that both the
+// display engine and the CPU (through the aperture) see them.
+static mx_status_t intel_i915_gtt_init(intel_i915_device_t* dev) {
+    size_t fb_size = dev->info.stride * dev->info.pixelsize * dev->info.height;
+    if (fb_size + GFX_BUFFER_SIZE > dev->framebuffer_size) {
+        return MX_ERR_NO_RESOURCES;
+    }
+
+    mx_status_t status = io_buffer_init(&dev->gfx_buffer, GFX_BUFFER_SIZE, IO_BUFFER_RW);
+    if (status != MX_OK) {
+        return status;
+    }
+
+    dev->gfx_base = dev->framebuffer_size - GFX_BUFFER_SIZE;
+    volatile uint32_t* gtt = (void*)((uint8_t*)dev->regs + dev->regs_size / 2);
+    mx_paddr_t phys = io_buffer_phys(&dev->gfx_buffer);
+    for (size_t off = 0; off < GFX_BUFFER_SIZE; off += PAGE_SIZE) {
+        size_t i = ((dev->gfx_base + off) / PAGE_SIZE) * 2;
+        uint64_t pte = (phys + off) | GTT_PTE_PRESENT;
+        pcie_write32(&gtt[i], (uint32_t)pte);
+        pcie_write32(&gtt[i + 1], (uint32_t)(pte >> 32));
+    }
+    // The read makes sure the entries have landed before the flush.
+    pcie_read32(&gtt[((dev->gfx_base + GFX_BUFFER_SIZE) / PAGE_SIZE - 1) * 2]);
+    intel_i915_write(dev, GFX_FLSH_CNTL, 1);
+
+    uint8_t* aperture = (uint8_t*)dev->framebuffer + dev->gfx_base;
+    dev->cursor = (uint32_t*)aperture;
+    dev->ring = (uint32_t*)(aperture + CURSOR_BUFFER_SIZE);
+    return MX_OK;
+}
+
+static void intel_i915_cursor_init(intel_i915_device_t* dev) {
+    memset(dev->cursor, 0, CURSOR_BUFFER_SIZE);
+    intel_i915_write(dev, CURACNTR, CURSOR_MODE_DISABLED);
+    intel_i915_write(dev, CURABASE, (uint32_t)dev->gfx_base);
+    dev->flags |= FLAGS_CURSOR;
+}
+
+// Sets up the blitter's ring for legacy submission.  The firmware leaves
+// the blitter alone, so it is idle, and the GT is kept awake from here on
+// since the ring registers go away whenever it sleeps.
+static mx_status_t intel_i915_blitter_init(intel_i915_device_t* dev) {
+    intel_i915_write(dev, FORCEWAKE_MT, (FORCEWAKE_KERNEL << 16) | FORCEWAKE_KERNEL);
+    mx_time_t deadline = mx_time_get(MX_CLOCK_MONOTONIC) + BLT_TIMEOUT;
+    while (!(intel_i915_read(dev, FORCEWAKE_ACK) & FORCEWAKE_KERNEL)) {
+        if (mx_time_get(MX_CLOCK_MONOTONIC) > deadline) {
+            return MX_ERR_TIMED_OUT;
+        }
+    }
+
+    if (intel_i915_read(dev, BCS_GFX_MODE) & GFX_MODE_EXECLIST_ENABLE) {
+        // masked write, clearing the bit
+        intel_i915_write(dev, BCS_GFX_MODE, GFX_MODE_EXECLIST_ENABLE << 16);
+    }
+
+    uint32_t ring_base = (uint32_t)dev->gfx_base + CURSOR_BUFFER_SIZE;
+    memset(dev->ring, 0, RING_SIZE);
+    intel_i915_write(dev, BCS_RING_CTL, 0);
+    intel_i915_write(dev, BCS_RING_HEAD, 0);
+    intel_i915_write(dev, BCS_RING_TAIL, 0);
+    intel_i915_write(dev, BCS_RING_START, ring_base);
+    intel_i915_write(dev, BCS_RING_CTL, ((RING_SIZE - PAGE_SIZE) & 0x1ff000) | RING_VALID);
+    if ((intel_i915_read(dev, BCS_RING_START) != ring_base) ||
+        !(intel_i915_read(dev, BCS_RING_CTL) & RING_VALID)) {
+        return MX_ERR_BAD_STATE;
+    }
+    dev->ring_tail = 0;
+    dev->flags |= FLAGS_BLITTER;
+    return MX_OK;
+}
+
+// Writes |count| dwords to the ring, followed by a flush, and waits for
+// the blitter to get through them.  Waiting every time keeps the CPU's
+// writes to the framebuffer ordered with the blitter's, and means the ring
+// is always empty when we start.
+// called with dev->lock held
+static mx_status_t intel_i915_blit(intel_i915_device_t* dev, const uint32_t* cmd, uint32_t count) {
+    // the tail has to stay 8 byte aligned
+    uint32_t len = ((count + 4) + 1) & ~1u;
+    if (dev->ring_tail + len * 4 > RING_SIZE) {
+        while (dev->ring_tail < RING_SIZE) {
+            dev->ring[dev->ring_tail / 4] = MI_NOOP;
+            dev->ring_tail += 4;
+        }
+        dev->ring_tail = 0;
+    }
+    uint32_t* p = dev->ring + dev->ring_tail / 4;
+    for (uint32_t i = 0; i < count; i++) {
+        *p++ = cmd[i];
+    }
+    *p++ = MI_FLUSH_DW;
+    *p++ = 0;
+    *p++ = 0;
+    *p++ = 0;
+    if ((count + 4) & 1) {
+        *p++ = MI_NOOP;
+    }
+    // The ring is write combined through the aperture.
+    hw_wmb();
+    dev->ring_tail = (dev->ring_tail + len * 4) % RING_SIZE;
+    intel_i915_write(dev, BCS_RING_TAIL, dev->ring_tail);
+
+    mx_time_t deadline = mx_time_get(MX_CLOCK_MONOTONIC) + BLT_TIMEOUT;
+    while ((intel_i915_read(dev, BCS_RING_HEAD) & RING_ADDR_MASK) != dev->ring_tail) {
+        if (mx_time_get(MX_CLOCK_MONOTONIC) > deadline) {
+            printf("i915: blitter timed out, falling back to the CPU\n");
+            dev->flags &= ~FLAGS_BLITTER;
+            return MX_ERR_TIMED_OUT;
+        }
+        mx_nanosleep(mx_deadline_after(MX_USEC(10)));
+    }
+    return MX_OK;
+}
+
+static uint32_t intel_i915_blt_format(intel_i915_device_t* dev) {
+    uint32_t pitch = dev->info.stride * dev->info.pixelsize;
+    if (dev->info.pixelsize == 4) {
+        return BLT_DEPTH_8888 | pitch;
+    }
+    return BLT_DEPTH_565 | pitch;
+}
+
 // implement display protocol
 
 static mx_status_t intel_i915_set_mode(void* ctx, mx_display_info_t* info) {
@@ -84,10 +278,117 @@ static mx_status_t intel_i915_get_framebuffer(void* ctx, void** framebuffer) {
     return MX_OK;
 }
 
+static mx_status_t intel_i915_set_cursor(void* ctx, const uint32_t* pixels,
+                                         uint32_t width, uint32_t height) {
+    intel_i915_device_t* device = ctx;
+    if (!(device->flags & FLAGS_CURSOR)) {
+        return MX_ERR_NOT_SUPPORTED;
+    }
+    mtx_lock(&device->lock);
+    // The plane is always 64x64, so smaller images are padded with
+    // transparent pixels.
+    for (uint32_t y = 0; y < CURSOR_SIZE; y++) {
+        uint32_t* row = device->cursor + y * CURSOR_SIZE;
+        if (y < height) {
+            memcpy(row, pixels + y * width, width * sizeof(uint32_t));
+            memset(row + width, 0, (CURSOR_SIZE - width) * sizeof(uint32_t));
+        } else {
+            memset(row, 0, CURSOR_SIZE * sizeof(uint32_t));
+        }
+    }
+    hw_wmb();
+    // The base register is what latches the plane's other registers.
+    intel_i915_write(device, CURABASE, (uint32_t)device->gfx_base);
+    mtx_unlock(&device->lock);
+    return MX_OK;
+}
+
+static mx_status_t intel_i915_move_cursor(void* ctx, int32_t x, int32_t y, bool visible) {
+    intel_i915_device_t* device = ctx;
+    if (!(device->flags & FLAGS_CURSOR)) {
+        return MX_ERR_NOT_SUPPORTED;
+    }
+    // each coordinate is a sign and 12 bits of magnitude
+    x = (x < -CURSOR_SIZE) ? -CURSOR_SIZE : (x > 4095) ? 4095 : x;
+    y = (y < -CURSOR_SIZE) ? -CURSOR_SIZE : (y > 4095) ? 4095 : y;
+    uint32_t xpos = (x < 0) ? (CURSOR_POS_SIGN | (uint32_t)-x) : (uint32_t)x;
+    uint32_t ypos = (y < 0) ? (CURSOR_POS_SIGN | (uint32_t)-y) : (uint32_t)y;
+
+    mtx_lock(&device->lock);
+    intel_i915_write(device, CURAPOS, (ypos << 16) | xpos);
+    if (visible != device->cursor_visible) {
+        intel_i915_write(device, CURACNTR, visible ? CURSOR_MODE_64_ARGB : CURSOR_MODE_DISABLED);
+        device->cursor_visible = visible;
+    }
+    intel_i915_write(device, CURABASE, (uint32_t)device->gfx_base);
+    mtx_unlock(&device->lock);
+    return MX_OK;
+}
+
+static mx_status_t intel_i915_fill_region(void* ctx, uint32_t x, uint32_t y,
+                                          uint32_t width, uint32_t height, uint32_t color) {
+    intel_i915_device_t* device = ctx;
+    mx_status_t status = MX_ERR_NOT_SUPPORTED;
+    mtx_lock(&device->lock);
+    if (device->flags & FLAGS_BLITTER) {
+        // the framebuffer is at the start of the aperture
+        uint32_t cmd[] = {
+            XY_COLOR_BLT | ((device->info.pixelsize == 4) ? BLT_WRITE_ARGB : 0),
+            intel_i915_blt_format(device) | BLT_ROP_PATCOPY,
+            (y << 16) | x,
+            ((y + height) << 16) | (x + width),
+            0,
+            0,
+            color,
+        };
+        status = intel_i915_blit(device, cmd, countof(cmd));
+    }
+    mtx_unlock(&device->lock);
+    return status;
+}
+
+static mx_status_t intel_i915_copy_region(void* ctx, uint32_t src_x, uint32_t src_y,
+                                          uint32_t width, uint32_t height,
+                                          uint32_t dst_x, uint32_t dst_y) {
+    intel_i915_device_t* device = ctx;
+    // The blitter goes top to bottom and left to right, which is only
+    // safe for overlapping regions when the copy goes up or left.
+    bool overlap = (dst_x < src_x + width) && (src_x < dst_x + width) &&
+                   (dst_y < src_y + height) && (src_y < dst_y + height);
+    if (overlap && ((dst_y > src_y) || ((dst_y == src_y) && (dst_x > src_x)))) {
+        return MX_ERR_NOT_SUPPORTED;
+    }
+
+    mx_status_t status = MX_ERR_NOT_SUPPORTED;
+    mtx_lock(&device->lock);
+    if (device->flags & FLAGS_BLITTER) {
+        uint32_t format = intel_i915_blt_format(device);
+        uint32_t cmd[] = {
+            XY_SRC_COPY_BLT | ((device->info.pixelsize == 4) ? BLT_WRITE_ARGB : 0),
+            format | BLT_ROP_COPY,
+            (dst_y << 16) | dst_x,
+            ((dst_y + height) << 16) | (dst_x + width),
+            0,
+            0,
+            (src_y << 16) | src_x,
+            format & 0xffff,
+            0,
+            0,
+        };
+        status = intel_i915_blit(device, cmd, countof(cmd));
+    }
+    mtx_unlock(&device->lock);
+    return status;
+}
+
 static display_protocol_ops_t intel_i915_display_proto = {
     .set_mode = intel_i915_set_mode,
     .get_mode = intel_i915_get_mode,
     .get_framebuffer = intel_i915_get_framebuffer,
+    .set_cursor = intel_i915_set_cursor,
+    .move_cursor = intel_i915_move_cursor,
+    .fill_region = intel_i915_fill_region,
+    .copy_region = intel_i915_copy_region,
 };
 
 // implement device protocol
@@ -116,6 +417,7 @@ static void intel_i915_release(void* ctx) {
         device->framebuffer_handle = -1;
     }
 
+    io_buffer_release(&device->gfx_buffer);
     free(device);
 }
 
@@ -187,8 +489,34 @@ static mx_status_t intel_i915_bind(void* ctx, mx_device_t* dev, void** cookie) {
         di->height = 1700 / 2;
         di->stride = 2560 / 2;
     }
+    switch (di->format) {
+    case MX_PIXEL_FORMAT_RGB_565:
+        di->pixelsize = 2;
+        break;
+    case MX_PIXEL_FORMAT_RGB_x888:
+    case MX_PIXEL_FORMAT_ARGB_8888:
+        di->pixelsize = 4;
+        break;
+    default:
+        di->pixelsize = 1;
+        break;
+    }
     di->flags = MX_DISPLAY_FLAG_HW_FRAMEBUFFER;
 
+    // Without these the display still works, drawn entirely by the CPU.
+    mtx_init(&device->lock, mtx_plain);
+    if ((status = intel_i915_gtt_init(device)) == MX_OK) {
+        intel_i915_cursor_init(device);
+        // the blitter only does 16 and 32 bit pixels
+        if (di->pixelsize == 1) {
+            printf("i915: no blitter for format %u\n", di->format);
+        } else if ((status = intel_i915_blitter_init(device)) != MX_OK) {
+            printf("i915: no blitter: %d\n", status);
+        }
+    } else {
+        printf("i915: no room for the cursor and blitter: %d\n", status);
+    }
+
     // TODO remove when the gfxconsole moves to user space
     intel_i915_enable_backlight(device, true);
     mx_set_framebuffer(get_root_resource(), device->framebuffer, device->framebuffer_size,
@@ -215,6 +543,7 @@ static mx_status_t intel_i915_bind(void* ctx, mx_device_t* dev, void** cookie) {
     return MX_OK;
 
 fail:
+    io_buffer_release(&device->gfx_buffer);
     free(device);
     return status;
 }
@@ -0,0 +1,162 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <magenta/process.h>
+#include <magenta/syscalls.h>
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "capture.h"
+
+#define RECORD_ALIGN 8
+
+static bool eth_capture_config_valid(const eth_capture_config_t* config) {
+    if ((config->flags == 0) || (config->flags & ~(ETH_CAPTURE_RX | ETH_CAPTURE_TX))) {
+        return false;
+    }
+    if ((config->size < ETH_CAPTURE_SIZE_MIN) || (config->size > ETH_CAPTURE_SIZE_MAX) ||
+        (config->size & (config->size - 1))) {
+        return false;
+    }
+    if (config->match_count > ETH_CAPTURE_MATCH_MAX) {
+        return false;
+    }
+    for (uint32_t i = 0; i < config->match_count; i++) {
+        uint8_t size = config->match[i].size;
+        if ((size != 1) && (size != 2) && (size != 4)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+mx_status_t eth_capture_create(const eth_capture_config_t* config, eth_capture_handles_t* out,
+                               eth_capture_t** capture) {
+    if (!eth_capture_config_valid(config)) {
+        return MX_ERR_INVALID_ARGS;
+    }
+
+    eth_capture_t* c;
+    if ((c = calloc(1, sizeof(eth_capture_t))) == NULL) {
+        return MX_ERR_NO_MEMORY;
+    }
+    c->config = *config;
+
+    size_t size = (sizeof(eth_capture_ring_t) + config->size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    mx_status_t status;
+    uintptr_t addr;
+    if ((status = mx_vmo_create(size, 0, &c->vmo)) < 0) {
+        goto fail;
+    }
+    if ((status = mx_vmar_map(mx_vmar_root_self(), 0, c->vmo, 0, size,
+                              MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE, &addr)) < 0) {
+        goto fail;
+    }
+    c->ring = (eth_capture_ring_t*)addr;
+    c->data = (uint8_t*)(c->ring + 1);
+    c->ring->size = config->size;
+    if ((status = mx_event_create(0, &c->event)) < 0) {
+        goto fail;
+    }
+
+    if ((status = mx_handle_duplicate(c->vmo, MX_RIGHT_SAME_RIGHTS, &out->vmo)) < 0) {
+        goto fail;
+    }
+    if ((status = mx_handle_duplicate(c->event, MX_RIGHT_SAME_RIGHTS, &out->event)) < 0) {
+        mx_handle_close(out->vmo);
+        goto fail;
+    }
+    *capture = c;
+    return MX_OK;
+
+fail:
+    eth_capture_destroy(c);
+    return status;
+}
+
+void eth_capture_destroy(eth_capture_t* capture) {
+    if (capture->ring) {
+        mx_vmar_unmap(mx_vmar_root_self(), (uintptr_t)capture->ring, 0);
+    }
+    if (capture->vmo) {
+        mx_handle_close(capture->vmo);
+    }
+    if (capture->event) {
+        mx_handle_close(capture->event);
+    }
+    free(capture);
+}
+
+static bool eth_capture_matches(const eth_capture_config_t* config, const uint8_t* frame,
+                                size_t len) {
+    for (uint32_t i = 0; i < config->match_count; i++) {
+        const eth_capture_match_t* m = &config->match[i];
+        if ((size_t)m->offset + m->size > len) {
+            return false;
+        }
+        uint32_t value = 0;
+        for (uint32_t j = 0; j < m->size; j++) {
+            value = (value << 8) | frame[m->offset + j];
+        }
+        if ((value & m->mask) != m->value) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void eth_capture_packet(eth_capture_t* capture, const void* data, size_t len, uint32_t dir) {
+    const eth_capture_config_t* config = &capture->config;
+    if (!(config->flags & dir) || !eth_capture_matches(config, data, len)) {
+        return;
+    }
+
+    size_t caplen = len;
+    if ((config->snaplen != 0) && (caplen > config->snaplen)) {
+        caplen = config->snaplen;
+    }
+    uint32_t size = config->size;
+    uint64_t need = (sizeof(eth_capture_record_t) + caplen + RECORD_ALIGN - 1) &
+                    ~(uint64_t)(RECORD_ALIGN - 1);
+
+    // The client may have written anything to |tail|; if it makes no
+    // sense, the ring is taken to be full.
+    uint64_t head = capture->head;
+    uint64_t tail = __atomic_load_n(&capture->ring->tail, __ATOMIC_ACQUIRE);
+    uint32_t off = head & (size - 1);
+    uint64_t skip = (size - off < need) ? size - off : 0;
+    if ((tail > head) || (head - tail + skip + need > size)) {
+        __atomic_fetch_add(&capture->ring->dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    eth_capture_record_t* rec;
+    if (skip != 0) {
+        if (skip >= sizeof(eth_capture_record_t)) {
+            rec = (eth_capture_record_t*)(capture->data + off);
+            memset(rec, 0, sizeof(*rec));
+            rec->flags = ETH_CAPTURE_WRAP;
+        }
+        off = 0;
+    }
+    rec = (eth_capture_record_t*)(capture->data + off);
+    rec->timestamp = mx_time_get(MX_CLOCK_MONOTONIC);
+    rec->length = caplen;
+    rec->orig_length = len;
+    rec->flags = dir;
+    rec->reserved = 0;
+    memcpy(rec + 1, data, caplen);
+
+    // Publishing |head| and then looking at |tail| pairs with the client
+    // clearing the signal, then storing |tail| and looking at |head|: one
+    // side or the other sees the new record.
+    capture->head = head + skip + need;
+    __atomic_store_n(&capture->ring->head, capture->head, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&capture->ring->tail, __ATOMIC_SEQ_CST) == head) {
+        mx_object_signal(capture->event, 0, MX_USER_SIGNAL_0);
+    }
+}
@@ -0,0 +1,38 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <magenta/compiler.h>
+#include <magenta/device/ethernet.h>
+#include <magenta/types.h>
+#include <stddef.h>
+#include <stdint.h>
+
+__BEGIN_CDECLS;
+
+// A capture ring, and what the device keeps of it
+typedef struct eth_capture {
+    eth_capture_config_t config;
+    mx_handle_t vmo;
+    mx_handle_t event;
+    eth_capture_ring_t* ring;
+    uint8_t* data;
+    // how far the ring has been written; the copy in the ring is the
+    // client's to scribble on
+    uint64_t head;
+} eth_capture_t;
+
+// Creates a capture ring as |config| asks, returning handles to it and its
+// event for the client in |out|.
+mx_status_t eth_capture_create(const eth_capture_config_t* config, eth_capture_handles_t* out,
+                               eth_capture_t** capture);
+
+void eth_capture_destroy(eth_capture_t* capture);
+
+// Appends a packet going in the direction of |dir| (ETH_CAPTURE_RX or
+// ETH_CAPTURE_TX) to the ring, if it was asked for and the filter takes it.
+void eth_capture_packet(eth_capture_t* capture, const void* data, size_t len, uint32_t dir);
+
+__END_CDECLS;
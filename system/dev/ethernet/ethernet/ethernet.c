@@ -13,11 +13,15 @@
 #include <magenta/syscalls.h>
 #include <magenta/types.h>
 
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <threads.h>
 
+#include "capture.h"
+#include "rss.h"
+
 #define FIFO_DEPTH 256
 #define FIFO_ESIZE sizeof(eth_fifo_entry_t)
 #define DEVICE_NAME_LEN 16
@@ -35,6 +39,27 @@
 // ensure that we will not exceed fifo capacity
 static_assert((FIFO_DEPTH * FIFO_ESIZE) <= 4096, "");
 
+typedef struct ethdev ethdev_t;
+
+// An rx fifo of an instance, with the rx buffers read from it and not yet
+// used, and those used which are yet to be written back, at the end of the
+// batch. There is room to give back the buffers the mac held when the
+// owner moves.
+typedef struct eth_rxq {
+    mx_handle_t fifo;
+    eth_fifo_entry_t free[FIFO_DEPTH * 2];
+    uint32_t free_head;
+    uint32_t free_count;
+    eth_fifo_entry_t done[FIFO_DEPTH];
+    uint32_t done_count;
+} eth_rxq_t;
+
+// a tx buffer of an instance, queued to the mac
+typedef struct eth_tx_queued {
+    ethdev_t* edev;
+    eth_fifo_entry_t e;
+} eth_tx_queued_t;
+
 // ethernet device
 typedef struct ethdev0 {
     // shared state
@@ -49,6 +74,32 @@ typedef struct ethdev0 {
 
   ethmac_info_t info;
 
+    // With ETHMAC_FEATURE_RX_QUEUE, the mac receives into the rx buffers
+    // of one active instance, the rx owner, which are queued to it in order.
+    ethdev_t* rx_owner;
+    eth_fifo_entry_t rx_queued[FIFO_DEPTH];
+    uint32_t rx_queued_head;
+    uint32_t rx_queued_count;
+    uint32_t rx_queue_depth;
+
+    // With ETHMAC_FEATURE_TX_QUEUE, the tx buffers of all instances, in the
+    // order they were queued to the mac and so will complete.
+    eth_tx_queued_t tx_queued[FIFO_DEPTH];
+    uint32_t tx_queued_head;
+    uint32_t tx_queued_count;
+    uint32_t tx_queue_depth;
+
+    // instances capturing packets (ethdev_t), and the directions any of
+    // them capture
+    list_node_t list_capture;
+    uint32_t capture_flags;
+
+    // packets received from and sent to the mac
+    uint64_t rx_packets;
+    uint64_t rx_bytes;
+    uint64_t tx_packets;
+    uint64_t tx_bytes;
+
     mx_device_t* mxdev;
 } ethdev0_t;
 
@@ -68,7 +119,7 @@ typedef struct ethdev0 {
 #define ETHDEV_TX_LISTEN (16u)
 
 // ethernet instance device
-typedef struct ethdev {
+struct ethdev {
     list_node_t node;
 
     ethdev0_t* edev0;
@@ -81,41 +132,150 @@ typedef struct ethdev {
     // to the network interface
     mx_handle_t tx_fifo;
     uint32_t tx_depth;
-    mx_handle_t rx_fifo;
     uint32_t rx_depth;
 
     // io buffer
     mx_handle_t io_vmo;
     void* io_buf;
     size_t io_size;
+    // Its pages, pinned for a mac which receives into or sends from them.
+    mx_paddr_t* io_phys;
+
+    // rx queues; the first is the rx fifo, and the only one the mac
+    // receives into. Packets are spread over the rest by their flow.
+    eth_rxq_t* rxq[ETH_RX_QUEUES_MAX];
+    uint32_t rxq_count;
+    eth_rxq_t rxq0;
+    uint8_t rss_key[ETH_RSS_KEY_SIZE];
+    uint8_t rss_table[ETH_RSS_TABLE_SIZE];
+    // unless set, the table spreads packets evenly over the queues
+    bool rss_table_set;
+    // Set while the mac has room for buffers the rx owner hasn't yet given,
+    // so its tx thread waits for them too.
+    bool rx_starved;
+
+    // tx buffers sent by the mac, or found invalid, which are yet to be
+    // written back, and how many are still queued to it.
+    eth_fifo_entry_t tx_done[FIFO_DEPTH];
+    uint32_t tx_done_count;
+    uint32_t tx_queued;
+    // Set while the tx thread waits for the mac to have room for more.
+    bool tx_blocked;
 
     // fifo thread
     thrd_t tx_thr;
 
     mx_device_t* mxdev;
 
+    eth_capture_t* capture;
+    list_node_t capture_node;
+
+    // its counters, under the lock; the device's and those below are
+    // filled in as they are asked for
+    eth_stats_t stats;
+
     uint32_t fail_rx_read;
     uint32_t fail_rx_write;
     uint32_t fail_tx_write;
-} ethdev_t;
+};
 
 #define FAIL_REPORT_RATE 50
 
-static void eth_handle_rx(ethdev_t* edev, const void* data, size_t len, uint32_t extra) {
-    eth_fifo_entry_t e;
+// Takes an rx buffer the client has given, reading all that are waiting in
+// the fifo at once when none are left over.
+static mx_status_t eth_take_rx_locked(ethdev_t* edev, eth_rxq_t* q, eth_fifo_entry_t* e) {
+    if (q->free_count == 0) {
+        mx_status_t status;
+        uint32_t count;
+        if ((status = mx_fifo_read(q->fifo, q->free,
+                                   sizeof(eth_fifo_entry_t) * FIFO_DEPTH, &count)) < 0) {
+            if (status != MX_ERR_SHOULD_WAIT) {
+                // Fatal, should force teardown
+                printf("eth [%s]: rx fifo read failed %d\n", edev->name, status);
+            }
+            return status;
+        }
+        q->free_head = 0;
+        q->free_count = count;
+    }
+    *e = q->free[q->free_head++];
+    q->free_count--;
+    return MX_OK;
+}
+
+// Writes the rx buffers used so far back to the client, all at once. Those
+// which don't fit are kept for the next time.
+static void eth_flush_rxq_locked(ethdev_t* edev, eth_rxq_t* q) {
+    if (q->done_count == 0) {
+        return;
+    }
     mx_status_t status;
     uint32_t count;
+    if ((status = mx_fifo_write(q->fifo, q->done,
+                                sizeof(eth_fifo_entry_t) * q->done_count, &count)) < 0) {
+        if (status == MX_ERR_SHOULD_WAIT) {
+            if ((edev->fail_rx_write++ % FAIL_REPORT_RATE) == 0) {
+                printf("eth [%s]: no rx_fifo space available (%u times)\n",
+                       edev->name, edev->fail_rx_write);
+            }
+        } else {
+            // Fatal, should force teardown
+            printf("eth [%s]: rx_fifo write failed %d\n", edev->name, status);
+        }
+        return;
+    }
+    q->done_count -= count;
+    memmove(q->done, q->done + count, sizeof(eth_fifo_entry_t) * q->done_count);
+}
+
+static void eth_flush_rx_locked(ethdev_t* edev) {
+    for (uint32_t i = 0; i < edev->rxq_count; i++) {
+        eth_flush_rxq_locked(edev, edev->rxq[i]);
+    }
+}
+
+// Whether there is room for another used rx buffer, once those used so far
+// have been written back if need be.
+static bool eth_rx_done_room_locked(ethdev_t* edev, eth_rxq_t* q) {
+    if (q->done_count == FIFO_DEPTH) {
+        eth_flush_rxq_locked(edev, q);
+    }
+    return q->done_count < FIFO_DEPTH;
+}
+
+static void eth_flush_rx_all_locked(ethdev0_t* edev0) {
+    ethdev_t* edev;
+    list_for_every_entry(&edev0->list_active, edev, ethdev_t, node) {
+        eth_flush_rx_locked(edev);
+    }
+}
+
+// Picks the rx queue for a packet, by the hash of its flow.
+static eth_rxq_t* eth_steer_rx_locked(ethdev_t* edev, const void* data, size_t len) {
+    uint32_t hash;
+    if ((edev->rxq_count == 1) || !eth_rss_hash(edev->rss_key, data, len, &hash)) {
+        return &edev->rxq0;
+    }
+    uint32_t n = edev->rss_table[hash % ETH_RSS_TABLE_SIZE];
+    return (n < edev->rxq_count) ? edev->rxq[n] : &edev->rxq0;
+}
 
-    // TODO: read multiple and cache locally to reduce syscalls
-    if ((status = mx_fifo_read(edev->rx_fifo, &e, sizeof(e), &count)) < 0) {
+static void eth_handle_rx(ethdev_t* edev, const void* data, size_t len, uint32_t extra) {
+    eth_rxq_t* q = eth_steer_rx_locked(edev, data, len);
+    if (!eth_rx_done_room_locked(edev, q)) {
+        // The client isn't reading its packets; drop this one.
+        edev->stats.rx_dropped++;
+        return;
+    }
+
+    eth_fifo_entry_t e;
+    mx_status_t status;
+    if ((status = eth_take_rx_locked(edev, q, &e)) < 0) {
         if (status == MX_ERR_SHOULD_WAIT) {
             if ((edev->fail_rx_read++ % FAIL_REPORT_RATE) == 0) {
                 printf("eth [%s]: no rx buffers available (%u times)\n",
                     edev->name, edev->fail_rx_read);
             }
-        } else {
-            // Fatal, should force teardown
-            printf("eth [%s]: rx fifo read failed %d\n", edev->name, status);
         }
         return;
     }
@@ -124,28 +284,155 @@ static void eth_handle_rx(ethdev_t* edev, const void* data, size_t len, uint32_t
         // invalid offset/length. report error. drop packet
         e.length = 0;
         e.flags = ETH_FIFO_INVALID;
+        edev->stats.rx_dropped++;
     } else if (len > e.length) {
         e.length = 0;
         e.flags = ETH_FIFO_INVALID;
+        edev->stats.rx_dropped++;
     } else {
         // packet fits. deliver it
         memcpy(edev->io_buf + e.offset, data, len);
         e.length = len;
         e.flags = ETH_FIFO_RX_OK | extra;
+        edev->stats.client_rx_packets++;
+        edev->stats.client_rx_bytes += len;
+    }
+    q->done[q->done_count++] = e;
+}
+
+// Hands one of the rx owner's buffers to the mac, if it lies within the io
+// buffer and crosses at most one page boundary.
+static void eth_queue_rx_buffer_locked(ethdev0_t* edev0, eth_fifo_entry_t* e) {
+    ethdev_t* edev = edev0->rx_owner;
+    uint64_t first = e->offset / PAGE_SIZE;
+    uint64_t last = ((uint64_t)e->offset + e->length - 1) / PAGE_SIZE;
+    if ((e->length == 0) || (e->offset >= edev->io_size) ||
+        (e->length > (edev->io_size - e->offset)) || (last - first > 1)) {
+        e->length = 0;
+        e->flags = ETH_FIFO_INVALID;
+        if (eth_rx_done_room_locked(edev, &edev->rxq0)) {
+            edev->rxq0.done[edev->rxq0.done_count++] = *e;
+        }
+        return;
+    }
+    uintptr_t pa0 = edev->io_phys[first] + (e->offset % PAGE_SIZE);
+    uintptr_t pa1 = (last != first) ? edev->io_phys[last] : 0;
+    uint32_t tail = (edev0->rx_queued_head + edev0->rx_queued_count) % FIFO_DEPTH;
+    edev0->rx_queued[tail] = *e;
+    edev0->rx_queued_count++;
+    edev0->mac.ops->queue_rx(edev0->mac.ctx, 0, pa0, pa1, e->length);
+}
+
+// Queues the rx owner's buffers to the mac, until it holds as many as it
+// can. If it could hold more than there are, the owner's tx thread is told
+// to wait for them.
+static void eth_queue_rx_locked(ethdev0_t* edev0) {
+    ethdev_t* edev = edev0->rx_owner;
+    if (edev == NULL) {
+        return;
+    }
+    while (edev0->rx_queued_count < edev0->rx_queue_depth) {
+        eth_fifo_entry_t e;
+        if (eth_take_rx_locked(edev, &edev->rxq0, &e) != MX_OK) {
+            break;
+        }
+        eth_queue_rx_buffer_locked(edev0, &e);
+    }
+    eth_flush_rx_locked(edev);
+
+    bool starved = edev0->rx_queued_count < edev0->rx_queue_depth;
+    if (starved && !edev->rx_starved) {
+        mx_object_signal(edev->tx_fifo, 0, MX_USER_SIGNAL_0);
+    }
+    edev->rx_starved = starved;
+}
+
+// Takes back the buffers the mac held, once it has stopped, so the owner
+// finds them first when it next has them queued.
+static void eth_unqueue_rx_locked(ethdev0_t* edev0) {
+    ethdev_t* edev = edev0->rx_owner;
+    uint32_t count = edev0->rx_queued_count;
+    eth_rxq_t* q = &edev->rxq0;
+    memmove(q->free + count, q->free + q->free_head, sizeof(eth_fifo_entry_t) * q->free_count);
+    for (uint32_t i = 0; i < count; i++) {
+        q->free[i] = edev0->rx_queued[(edev0->rx_queued_head + i) % FIFO_DEPTH];
     }
+    q->free_head = 0;
+    q->free_count += count;
+    edev0->rx_queued_head = 0;
+    edev0->rx_queued_count = 0;
+    edev->rx_starved = false;
+}
 
-    if ((status = mx_fifo_write(edev->rx_fifo, &e, sizeof(e), &count)) < 0) {
+// Writes the tx buffers the mac is done with back to the client, all at
+// once. Those which don't fit are kept for the next time.
+static void eth_flush_tx_locked(ethdev_t* edev) {
+    if (edev->tx_done_count == 0) {
+        return;
+    }
+    mx_status_t status;
+    uint32_t count;
+    if ((status = mx_fifo_write(edev->tx_fifo, edev->tx_done,
+                                sizeof(eth_fifo_entry_t) * edev->tx_done_count, &count)) < 0) {
         if (status == MX_ERR_SHOULD_WAIT) {
-            if ((edev->fail_rx_write++ % FAIL_REPORT_RATE) == 0) {
-                printf("eth [%s]: no rx_fifo space available (%u times)\n",
-                       edev->name, edev->fail_rx_write);
+            if ((edev->fail_tx_write++ % FAIL_REPORT_RATE) == 0) {
+                printf("eth [%s]: no tx_fifo space available (%u times)\n",
+                       edev->name, edev->fail_tx_write);
             }
         } else {
-            // Fatal, should force teardown
-            printf("eth [%s]: rx_fifo write failed %d\n", edev->name, status);
+            printf("eth [%s]: tx_fifo write failed %d\n", edev->name, status);
         }
         return;
     }
+    edev->tx_done_count -= count;
+    memmove(edev->tx_done, edev->tx_done + count, sizeof(eth_fifo_entry_t) * edev->tx_done_count);
+}
+
+static void eth_tx_done_locked(ethdev_t* edev, const eth_fifo_entry_t* e) {
+    if (edev->tx_done_count == FIFO_DEPTH) {
+        eth_flush_tx_locked(edev);
+    }
+    if (edev->tx_done_count < FIFO_DEPTH) {
+        edev->tx_done[edev->tx_done_count++] = *e;
+    }
+}
+
+// Writes back every instance's sent buffers, waking those tx threads
+// waiting for room at the mac.
+static void eth_flush_tx_all_locked(ethdev0_t* edev0) {
+    list_node_t* lists[] = { &edev0->list_active, &edev0->list_idle };
+    for (size_t i = 0; i < countof(lists); i++) {
+        ethdev_t* edev;
+        list_for_every_entry(lists[i], edev, ethdev_t, node) {
+            eth_flush_tx_locked(edev);
+            if (edev->tx_blocked) {
+                mx_object_signal(edev->tx_fifo, 0, MX_USER_SIGNAL_0);
+            }
+        }
+    }
+}
+
+// Takes back the tx buffers the mac held, once it has stopped.
+static void eth_unqueue_tx_locked(ethdev0_t* edev0) {
+    while (edev0->tx_queued_count > 0) {
+        eth_tx_queued_t* q = &edev0->tx_queued[edev0->tx_queued_head];
+        q->e.flags = 0;
+        q->edev->tx_queued--;
+        eth_tx_done_locked(q->edev, &q->e);
+        edev0->tx_queued_head = (edev0->tx_queued_head + 1) % FIFO_DEPTH;
+        edev0->tx_queued_count--;
+    }
+    edev0->tx_queued_head = 0;
+    eth_flush_tx_all_locked(edev0);
+}
+
+// Stops the mac, which then gives up the buffers it held.
+static void eth_mac_stop_locked(ethdev0_t* edev0) {
+    edev0->mac.ops->stop(edev0->mac.ctx);
+    if (edev0->rx_owner != NULL) {
+        eth_unqueue_rx_locked(edev0);
+    }
+    eth_unqueue_tx_locked(edev0);
 }
 
 static void eth0_status(void* cookie, uint32_t status) {
@@ -154,30 +441,235 @@ static void eth0_status(void* cookie, uint32_t status) {
 
 // TODO: I think if this arrives at the wrong time during teardown we
 // can deadlock with the ethermac device
+// The flags a client's rx fifo gives a packet, from those the mac gave it.
+static uint32_t eth_rx_flags(uint32_t flags) {
+    return (flags & ETHMAC_RX_OPT_CSUM_OK) ? ETH_FIFO_RX_CSUM_OK : 0;
+}
+
+// Appends a packet to the rings of the instances capturing |dir|.
+static void eth_capture_locked(ethdev0_t* edev0, const void* data, size_t len, uint32_t dir) {
+    ethdev_t* edev;
+    list_for_every_entry(&edev0->list_capture, edev, ethdev_t, capture_node) {
+        eth_capture_packet(edev->capture, data, len, dir);
+    }
+}
+
 static void eth0_recv(void* cookie, void* data, size_t len, uint32_t flags) {
     ethdev0_t* edev0 = cookie;
 
     ethdev_t* edev;
     mtx_lock(&edev0->lock);
+    edev0->rx_packets++;
+    edev0->rx_bytes += len;
+    if (edev0->capture_flags & ETH_CAPTURE_RX) {
+        eth_capture_locked(edev0, data, len, ETH_CAPTURE_RX);
+    }
     list_for_every_entry(&edev0->list_active, edev, ethdev_t, node) {
-        eth_handle_rx(edev, data, len, 0);
+        eth_handle_rx(edev, data, len, eth_rx_flags(flags));
+    }
+    if (!(flags & ETHMAC_RX_OPT_MORE)) {
+        eth_flush_rx_all_locked(edev0);
+    }
+    mtx_unlock(&edev0->lock);
+}
+
+static void eth0_complete_rx(void* cookie, uint32_t length, uint32_t flags) {
+    ethdev0_t* edev0 = cookie;
+
+    mtx_lock(&edev0->lock);
+    ethdev_t* owner = edev0->rx_owner;
+    if ((owner == NULL) || (edev0->rx_queued_count == 0)) {
+        // Nothing was queued; the mac is confused
+        mtx_unlock(&edev0->lock);
+        return;
+    }
+    eth_fifo_entry_t e = edev0->rx_queued[edev0->rx_queued_head];
+    edev0->rx_queued_head = (edev0->rx_queued_head + 1) % FIFO_DEPTH;
+    edev0->rx_queued_count--;
+
+    if ((length == 0) || (length > e.length)) {
+        // Returned unused, so it may go straight back
+        eth_queue_rx_buffer_locked(edev0, &e);
+    } else {
+        edev0->rx_packets++;
+        edev0->rx_bytes += length;
+        if (edev0->capture_flags & ETH_CAPTURE_RX) {
+            eth_capture_locked(edev0, owner->io_buf + e.offset, length, ETH_CAPTURE_RX);
+        }
+        // The other instances are given copies of the packet
+        ethdev_t* edev;
+        list_for_every_entry(&edev0->list_active, edev, ethdev_t, node) {
+            if (edev != owner) {
+                eth_handle_rx(edev, owner->io_buf + e.offset, length, eth_rx_flags(flags));
+            }
+        }
+        if (eth_rx_done_room_locked(owner, &owner->rxq0)) {
+            e.length = length;
+            e.flags = ETH_FIFO_RX_OK | eth_rx_flags(flags);
+            owner->rxq0.done[owner->rxq0.done_count++] = e;
+            owner->stats.client_rx_packets++;
+            owner->stats.client_rx_bytes += length;
+        } else {
+            // The owner isn't reading its packets; drop this one, and
+            // reuse its buffer.
+            owner->stats.rx_dropped++;
+            eth_queue_rx_buffer_locked(edev0, &e);
+        }
+    }
+    if (!(flags & ETHMAC_RX_OPT_MORE)) {
+        eth_flush_rx_all_locked(edev0);
+    }
+    eth_queue_rx_locked(edev0);
+    mtx_unlock(&edev0->lock);
+}
+
+static void eth0_complete_tx(void* cookie, uint32_t count) {
+    ethdev0_t* edev0 = cookie;
+
+    mtx_lock(&edev0->lock);
+    while ((count > 0) && (edev0->tx_queued_count > 0)) {
+        eth_tx_queued_t* q = &edev0->tx_queued[edev0->tx_queued_head];
+        q->e.flags = ETH_FIFO_TX_OK;
+        q->edev->tx_queued--;
+        eth_tx_done_locked(q->edev, &q->e);
+        edev0->tx_queued_head = (edev0->tx_queued_head + 1) % FIFO_DEPTH;
+        edev0->tx_queued_count--;
+        count--;
     }
+    eth_flush_tx_all_locked(edev0);
     mtx_unlock(&edev0->lock);
 }
 
 static ethmac_ifc_t ethmac_ifc = {
     .status = eth0_status,
     .recv = eth0_recv,
+    .complete_rx = eth0_complete_rx,
+    .complete_tx = eth0_complete_tx,
 };
 
-static void eth_tx_echo(ethdev0_t* edev0, const void* data, size_t len) {
+static void eth_tx_echo_locked(ethdev0_t* edev0, const void* data, size_t len, bool more) {
     ethdev_t* edev;
-    mtx_lock(&edev0->lock);
     list_for_every_entry(&edev0->list_active, edev, ethdev_t, node) {
         if (edev->state & ETHDEV_TX_LISTEN) {
             eth_handle_rx(edev, data, len, ETH_FIFO_RX_TX);
+            if (!more) {
+                eth_flush_rx_locked(edev);
+            }
+        }
+    }
+}
+
+static void eth_tx_echo(ethdev0_t* edev0, const void* data, size_t len, bool more) {
+    mtx_lock(&edev0->lock);
+    eth_tx_echo_locked(edev0, data, len, more);
+    mtx_unlock(&edev0->lock);
+}
+
+// Works out the options to send a tx buffer with, returning false if it
+// asks for what the mac can't do.
+static bool eth_tx_options(ethdev_t* edev, const eth_fifo_entry_t* e, uint32_t* opt) {
+    *opt = 0;
+    uint32_t hash;
+    if ((edev->edev0->info.features & ETHMAC_FEATURE_TX_FLOW) &&
+        eth_rss_hash(eth_rss_default_key, edev->io_buf + e->offset, e->length, &hash)) {
+        *opt |= ETHMAC_TX_OPT_FLOW(hash);
+    }
+    if (!(e->flags & ETH_FIFO_TX_CSUM)) {
+        return true;
+    }
+    uint32_t start, offset;
+    if (!(edev->edev0->info.features & ETHMAC_FEATURE_TX_CSUM) ||
+        !eth_csum_offsets(edev->io_buf + e->offset, e->length, &start, &offset)) {
+        return false;
+    }
+    *opt |= ETHMAC_TX_OPT_CSUM | ETHMAC_TX_OPT_CSUM_START(start) |
+            ETHMAC_TX_OPT_CSUM_OFFSET(offset);
+    return true;
+}
+
+// Queues tx buffers to the mac until it has as many as it can hold,
+// returning how many of |count| were taken. Each is only handed over once
+// the next is found, so that the last of the batch goes without
+// ETHMAC_TX_OPT_MORE and the mac tells its hardware of them all at once.
+static uint32_t eth_queue_tx_locked(ethdev_t* edev, eth_fifo_entry_t* entries, uint32_t count) {
+    ethdev0_t* edev0 = edev->edev0;
+    uintptr_t pa0 = 0, pa1 = 0;
+    size_t length = 0;
+    uint32_t opt = 0;
+    uint32_t i;
+    for (i = 0; i < count; i++) {
+        eth_fifo_entry_t* e = &entries[i];
+        uint64_t first = e->offset / PAGE_SIZE;
+        uint64_t last = ((uint64_t)e->offset + e->length - 1) / PAGE_SIZE;
+        uint32_t e_opt;
+        if ((e->length == 0) || (e->offset >= edev->io_size) ||
+            (e->length > (edev->io_size - e->offset)) || (last - first > 1) ||
+            !eth_tx_options(edev, e, &e_opt)) {
+            e->flags = ETH_FIFO_INVALID;
+            edev->stats.tx_invalid++;
+            eth_tx_done_locked(edev, e);
+            continue;
+        }
+        if (list_is_empty(&edev0->list_active)) {
+            // the mac is stopped, and would not complete it
+            e->flags = 0;
+            eth_tx_done_locked(edev, e);
+            continue;
+        }
+        if (edev0->tx_queued_count == edev0->tx_queue_depth) {
+            break;
+        }
+        if (length != 0) {
+            edev0->mac.ops->queue_tx(edev0->mac.ctx, opt | ETHMAC_TX_OPT_MORE, pa0, pa1, length);
+        }
+        pa0 = edev->io_phys[first] + (e->offset % PAGE_SIZE);
+        pa1 = (last != first) ? edev->io_phys[last] : 0;
+        length = e->length;
+        opt = e_opt;
+
+        uint32_t tail = (edev0->tx_queued_head + edev0->tx_queued_count) % FIFO_DEPTH;
+        edev0->tx_queued[tail].edev = edev;
+        edev0->tx_queued[tail].e = *e;
+        edev0->tx_queued_count++;
+        edev->tx_queued++;
+        edev0->tx_packets++;
+        edev0->tx_bytes += e->length;
+        edev->stats.client_tx_packets++;
+        edev->stats.client_tx_bytes += e->length;
+        if (edev0->capture_flags & ETH_CAPTURE_TX) {
+            eth_capture_locked(edev0, edev->io_buf + e->offset, e->length, ETH_CAPTURE_TX);
+        }
+        if (edev->state & ETHDEV_TX_LOOPBACK) {
+            eth_tx_echo_locked(edev0, edev->io_buf + e->offset, e->length, i + 1 < count);
+        }
+    }
+    if (length != 0) {
+        edev0->mac.ops->queue_tx(edev0->mac.ctx, opt, pa0, pa1, length);
+    }
+    eth_flush_tx_locked(edev);
+    return i;
+}
+
+// Counts a batch the mac has sent from its own buffers, and captures it,
+// before the buffers go back to the client.
+static void eth_tx_sent(ethdev_t* edev, const eth_fifo_entry_t* entries, uint32_t count,
+                        uint64_t bytes) {
+    ethdev0_t* edev0 = edev->edev0;
+    mtx_lock(&edev0->lock);
+    for (uint32_t i = 0; i < count; i++) {
+        const eth_fifo_entry_t* e = &entries[i];
+        if (e->flags != ETH_FIFO_TX_OK) {
+            edev->stats.tx_invalid++;
+            continue;
+        }
+        edev->stats.client_tx_packets++;
+        edev0->tx_packets++;
+        if (edev0->capture_flags & ETH_CAPTURE_TX) {
+            eth_capture_locked(edev0, edev->io_buf + e->offset, e->length, ETH_CAPTURE_TX);
         }
     }
+    edev->stats.client_tx_bytes += bytes;
+    edev0->tx_bytes += bytes;
     mtx_unlock(&edev0->lock);
 }
 
@@ -216,43 +708,95 @@ static int eth_tx_thread(void* arg) {
     ethdev0_t* edev0 = edev->edev0;
     eth_fifo_entry_t entries[FIFO_DEPTH / 2];
     mx_status_t status;
-    uint32_t count;
+    uint32_t count = 0;
+    // entries before this have been handed to the mac
+    uint32_t next = 0;
 
     for (;;) {
-        if ((status = mx_fifo_read(edev->tx_fifo, entries, sizeof(entries), &count)) < 0) {
+        if (next < count) {
+            // Wait for the mac to finish with some of those it has.
+            mx_signals_t pending;
+            if ((status = mx_object_wait_one(edev->tx_fifo, MX_USER_SIGNAL_0 | MX_FIFO_PEER_CLOSED,
+                                             MX_TIME_INFINITE, &pending)) < 0) {
+                if (status != MX_ERR_CANCELED) {
+                    printf("eth [%s]: tx_fifo: error waiting: %d\n", edev->name, status);
+                }
+                break;
+            }
+            if (pending & MX_FIFO_PEER_CLOSED) {
+                status = MX_ERR_PEER_CLOSED;
+                break;
+            }
+            mx_object_signal(edev->tx_fifo, MX_USER_SIGNAL_0, 0);
+        } else if ((status = mx_fifo_read(edev->tx_fifo, entries, sizeof(entries), &count)) < 0) {
             if (status == MX_ERR_SHOULD_WAIT) {
-                if ((status = mx_object_wait_one(edev->tx_fifo,
-                                                 MX_FIFO_READABLE | MX_FIFO_PEER_CLOSED,
-                                                 MX_TIME_INFINITE, NULL)) < 0) {
+                // The rx owner's thread also waits for rx buffers, while the
+                // mac has room for more of them than it has been given.
+                mtx_lock(&edev0->lock);
+                mx_wait_item_t items[2] = {
+                    { edev->tx_fifo, MX_FIFO_READABLE | MX_FIFO_PEER_CLOSED | MX_USER_SIGNAL_0, 0 },
+                    { edev->rxq0.fifo, MX_FIFO_READABLE, 0 },
+                };
+                uint32_t nitems = edev->rx_starved ? 2 : 1;
+                mtx_unlock(&edev0->lock);
+                count = 0;
+                if ((status = mx_object_wait_many(items, nitems, MX_TIME_INFINITE)) < 0) {
                     if (status != MX_ERR_CANCELED) {
                         printf("eth [%s]: tx_fifo: error waiting: %d\n", edev->name, status);
                     }
                     break;
                 }
+                if (items[0].pending & MX_USER_SIGNAL_0) {
+                    mx_object_signal(edev->tx_fifo, MX_USER_SIGNAL_0, 0);
+                }
+                if ((nitems == 2) && (items[1].pending & MX_FIFO_READABLE)) {
+                    mtx_lock(&edev0->lock);
+                    if (edev0->rx_owner == edev) {
+                        eth_queue_rx_locked(edev0);
+                    }
+                    mtx_unlock(&edev0->lock);
+                }
                 continue;
             } else {
                 printf("eth [%s]: tx_fifo: cannot read: %d\n", edev->name, status);
                 break;
             }
+        } else {
+            next = 0;
+        }
+
+        if (edev0->info.features & ETHMAC_FEATURE_TX_QUEUE) {
+            // Buffers are written back as the mac completes them.
+            mtx_lock(&edev0->lock);
+            next += eth_queue_tx_locked(edev, entries + next, count - next);
+            edev->tx_blocked = (next < count);
+            mtx_unlock(&edev0->lock);
+            continue;
         }
 
         uint32_t n = count;
+        next = count;
+        uint64_t bytes = 0;
         for (eth_fifo_entry_t* e = entries; count > 0; e++) {
-            if ((e->offset > edev->io_size) || ((e->length > (edev->io_size - e->offset)))) {
+            uint32_t opt;
+            if ((e->offset > edev->io_size) || ((e->length > (edev->io_size - e->offset))) ||
+                !eth_tx_options(edev, e, &opt)) {
                 e->flags = ETH_FIFO_INVALID;
             } else {
-                uint32_t opt = count > 1 ? ETHMAC_TX_OPT_MORE : 0u;
-                if (opt) {
+                opt |= count > 1 ? ETHMAC_TX_OPT_MORE : 0u;
+                if (opt & ETHMAC_TX_OPT_MORE) {
                     xprintf("setting OPT_MORE (%u packets to go)\n", count);
                 }
                 edev0->mac.ops->send(edev0->mac.ctx, opt, edev->io_buf + e->offset, e->length);
                 e->flags = ETH_FIFO_TX_OK;
+                bytes += e->length;
                 if (edev->state & ETHDEV_TX_LOOPBACK) {
-                    eth_tx_echo(edev0, edev->io_buf + e->offset, e->length);
+                    eth_tx_echo(edev0, edev->io_buf + e->offset, e->length, count > 1);
                 }
             }
             count--;
         }
+        eth_tx_sent(edev, entries, n, bytes);
 
         if ((status = mx_fifo_write(edev->tx_fifo, entries, sizeof(eth_fifo_entry_t) * n, &count)) < 0) {
             if (status == MX_ERR_SHOULD_WAIT) {
@@ -268,6 +812,7 @@ static int eth_tx_thread(void* arg) {
         if (count != n) {
             printf("eth [%s]: tx_fifo: only wrote %u of %u!\n", edev->name, count, n);
         }
+        count = next = 0;
     }
 
     printf("eth [%s]: tx_thread: exit: %d\n", edev->name, status);
@@ -290,9 +835,9 @@ static mx_status_t eth_get_fifos_locked(ethdev_t* edev, void* out_buf, size_t ou
         fprintf(stderr, "eth_create  [%s]: failed to create tx fifo: %d\n", edev->name, status);
         return status;
     }
-    if ((status = mx_fifo_create(FIFO_DEPTH, FIFO_ESIZE, 0, &fifos->rx_fifo, &edev->rx_fifo)) < 0) {
+    if ((status = mx_fifo_create(FIFO_DEPTH, FIFO_ESIZE, 0, &fifos->rx_fifo, &edev->rxq0.fifo)) < 0) {
         fprintf(stderr, "eth_create  [%s]: failed to create rx fifo: %d\n", edev->name, status);
-        mx_handle_close(fifos->rx_fifo);
+        mx_handle_close(fifos->tx_fifo);
         mx_handle_close(edev->tx_fifo);
         edev->tx_fifo = MX_HANDLE_INVALID;
         return status;
@@ -307,6 +852,54 @@ static mx_status_t eth_get_fifos_locked(ethdev_t* edev, void* out_buf, size_t ou
     return MX_OK;
 }
 
+static void eth_rss_spread_locked(ethdev_t* edev) {
+    for (uint32_t i = 0; i < ETH_RSS_TABLE_SIZE; i++) {
+        edev->rss_table[i] = i % edev->rxq_count;
+    }
+}
+
+static mx_status_t eth_add_rx_queue_locked(ethdev_t* edev, void* out_buf, size_t out_len,
+                                           size_t* out_actual) {
+    if (out_len < sizeof(mx_handle_t)) {
+        return MX_ERR_INVALID_ARGS;
+    }
+    if (edev->rxq0.fifo == MX_HANDLE_INVALID) {
+        return MX_ERR_BAD_STATE;
+    }
+    if (edev->rxq_count == ETH_RX_QUEUES_MAX) {
+        return MX_ERR_NO_RESOURCES;
+    }
+
+    eth_rxq_t* q;
+    if ((q = calloc(1, sizeof(eth_rxq_t))) == NULL) {
+        return MX_ERR_NO_MEMORY;
+    }
+    mx_status_t status;
+    if ((status = mx_fifo_create(FIFO_DEPTH, FIFO_ESIZE, 0, out_buf, &q->fifo)) < 0) {
+        fprintf(stderr, "eth_create  [%s]: failed to create rx fifo: %d\n", edev->name, status);
+        free(q);
+        return status;
+    }
+    edev->rxq[edev->rxq_count++] = q;
+    if (!edev->rss_table_set) {
+        eth_rss_spread_locked(edev);
+    }
+
+    *out_actual = sizeof(mx_handle_t);
+    return MX_OK;
+}
+
+static mx_status_t eth_set_rss_config_locked(ethdev_t* edev, const void* in_buf, size_t in_len) {
+    if (in_len < sizeof(eth_rss_config_t)) {
+        return MX_ERR_INVALID_ARGS;
+    }
+    const eth_rss_config_t* config = in_buf;
+    memcpy(edev->rss_key, config->key, ETH_RSS_KEY_SIZE);
+    memcpy(edev->rss_table, config->table, ETH_RSS_TABLE_SIZE);
+    edev->rss_table_set = true;
+    return MX_OK;
+}
+
 static ssize_t eth_set_iobuf_locked(ethdev_t* edev, const void* in_buf, size_t in_len) {
     if (in_len < sizeof(mx_handle_t)) {
         return MX_ERR_INVALID_ARGS;
@@ -332,23 +925,98 @@ static ssize_t eth_set_iobuf_locked(ethdev_t* edev, const void* in_buf, size_t i
         goto fail;
     }
 
+    // A mac which receives into or sends from the io buffer is told where
+    // its pages are.
+    if (edev->edev0->info.features & (ETHMAC_FEATURE_RX_QUEUE | ETHMAC_FEATURE_TX_QUEUE)) {
+        size_t pages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+        if ((edev->io_phys = malloc(pages * sizeof(mx_paddr_t))) == NULL) {
+            status = MX_ERR_NO_MEMORY;
+            goto fail_unmap;
+        }
+        if ((status = mx_vmo_op_range(vmo, MX_VMO_OP_PIN, 0, size, edev->io_phys,
+                                      pages * sizeof(mx_paddr_t))) < 0) {
+            printf("eth [%s]: could not pin io_buf: %d\n", edev->name, status);
+            free(edev->io_phys);
+            edev->io_phys = NULL;
+            goto fail_unmap;
+        }
+    }
+
     edev->io_vmo = vmo;
     edev->io_size = size;
 
     return MX_OK;
 
+fail_unmap:
+    mx_vmar_unmap(mx_vmar_root_self(), (uintptr_t)edev->io_buf, 0);
+    edev->io_buf = NULL;
 fail:
     mx_handle_close(vmo);
     return status;
 }
 
+static void eth_capture_flags_locked(ethdev0_t* edev0) {
+    edev0->capture_flags = 0;
+    ethdev_t* edev;
+    list_for_every_entry(&edev0->list_capture, edev, ethdev_t, capture_node) {
+        edev0->capture_flags |= edev->capture->config.flags;
+    }
+}
+
+static mx_status_t eth_start_capture_locked(ethdev_t* edev, const void* in_buf, size_t in_len,
+                                            void* out_buf, size_t out_len, size_t* out_actual) {
+    if ((in_len < sizeof(eth_capture_config_t)) || (out_len < sizeof(eth_capture_handles_t))) {
+        return MX_ERR_INVALID_ARGS;
+    }
+    if (edev->capture != NULL) {
+        return MX_ERR_ALREADY_BOUND;
+    }
+    mx_status_t status;
+    if ((status = eth_capture_create(in_buf, out_buf, &edev->capture)) < 0) {
+        return status;
+    }
+    list_add_tail(&edev->edev0->list_capture, &edev->capture_node);
+    eth_capture_flags_locked(edev->edev0);
+    *out_actual = sizeof(eth_capture_handles_t);
+    return MX_OK;
+}
+
+static mx_status_t eth_stop_capture_locked(ethdev_t* edev) {
+    if (edev->capture != NULL) {
+        list_delete(&edev->capture_node);
+        eth_capture_flags_locked(edev->edev0);
+        eth_capture_destroy(edev->capture);
+        edev->capture = NULL;
+    }
+    return MX_OK;
+}
+
+static mx_status_t eth_get_stats_locked(ethdev_t* edev, void* out_buf, size_t out_len,
+                                        size_t* out_actual) {
+    if (out_len < sizeof(eth_stats_t)) {
+        return MX_ERR_BUFFER_TOO_SMALL;
+    }
+    ethdev0_t* edev0 = edev->edev0;
+    eth_stats_t* stats = out_buf;
+    *stats = edev->stats;
+    stats->rx_packets = edev0->rx_packets;
+    stats->rx_bytes = edev0->rx_bytes;
+    stats->tx_packets = edev0->tx_packets;
+    stats->tx_bytes = edev0->tx_bytes;
+    stats->rx_no_buffer = edev->fail_rx_read;
+    stats->rx_fifo_full = edev->fail_rx_write;
+    stats->tx_fifo_full = edev->fail_tx_write;
+    *out_actual = sizeof(*stats);
+    return MX_OK;
+}
+
 static mx_status_t eth_start_locked(ethdev_t* edev) {
     ethdev0_t* edev0 = edev->edev0;
 
     // Cannot start unless tx/rx rings are configured
     if ((edev->io_vmo == MX_HANDLE_INVALID) ||
         (edev->tx_fifo == MX_HANDLE_INVALID) ||
-        (edev->rx_fifo == MX_HANDLE_INVALID)) {
+        (edev->rxq0.fifo == MX_HANDLE_INVALID)) {
         return MX_ERR_BAD_STATE;
     }
 
@@ -366,6 +1034,13 @@ static mx_status_t eth_start_locked(ethdev_t* edev) {
         edev->state |= ETHDEV_TX_THREAD;
     }
 
+    // The first instance running on a mac which receives into rx buffers
+    // becomes the one whose buffers it has.
+    bool owner = (edev0->info.features & ETHMAC_FEATURE_RX_QUEUE) && (edev0->rx_owner == NULL);
+    if (owner) {
+        edev0->rx_owner = edev;
+    }
+
     mx_status_t status;
     if (list_is_empty(&edev0->list_active)) {
         status = edev0->mac.ops->start(edev0->mac.ctx, &ethmac_ifc, edev0);
@@ -377,13 +1052,40 @@ static mx_status_t eth_start_locked(ethdev_t* edev) {
         edev->state |= ETHDEV_RUNNING;
         list_delete(&edev->node);
         list_add_tail(&edev0->list_active, &edev->node);
+        eth_queue_rx_locked(edev0);
     } else {
         printf("eth [%s]: failed to start mac: %d\n", edev->name, status);
+        if (owner) {
+            edev0->rx_owner = NULL;
+        }
     }
 
     return status;
 }
 
+// Takes back the buffers the mac has of |edev|, as the mac only gives them
+// up when stopped, restarting it for the other instances if |restart|. If
+// |edev| was the rx owner, the next active instance takes its place.
+static void eth_mac_release_locked(ethdev0_t* edev0, ethdev_t* edev, bool restart) {
+    eth_mac_stop_locked(edev0);
+    if (edev0->rx_owner == edev) {
+        edev0->rx_owner = NULL;
+    }
+    if (!restart || list_is_empty(&edev0->list_active)) {
+        return;
+    }
+    if ((edev0->info.features & ETHMAC_FEATURE_RX_QUEUE) && (edev0->rx_owner == NULL)) {
+        edev0->rx_owner = list_peek_head_type(&edev0->list_active, ethdev_t, node);
+    }
+    mx_status_t status;
+    if ((status = edev0->mac.ops->start(edev0->mac.ctx, &ethmac_ifc, edev0)) < 0) {
+        printf("eth: failed to restart mac: %d\n", status);
+        edev0->rx_owner = NULL;
+        return;
+    }
+    eth_queue_rx_locked(edev0);
+}
+
 static mx_status_t eth_stop_locked(ethdev_t* edev) {
     ethdev0_t* edev0 = edev->edev0;
 
@@ -391,11 +1093,14 @@ static mx_status_t eth_stop_locked(ethdev_t* edev) {
         edev->state &= (~ETHDEV_RUNNING);
         list_delete(&edev->node);
         list_add_tail(&edev0->list_idle, &edev->node);
-        if (list_is_empty(&edev0->list_active)) {
+        if (edev0->rx_owner == edev) {
+            eth_mac_release_locked(edev0, edev, !(edev->state & ETHDEV_DEAD));
+        } else if (list_is_empty(&edev0->list_active)) {
             if (!(edev->state & ETHDEV_DEAD)) {
-                edev0->mac.ops->stop(edev0->mac.ctx);
+                eth_mac_stop_locked(edev0);
             }
         }
+        eth_flush_rx_locked(edev);
     }
 
     return MX_OK;
@@ -433,6 +1138,12 @@ static mx_status_t eth_ioctl(void* ctx, uint32_t op,
             if (edev->edev0->info.features & ETHMAC_FEATURE_WLAN) {
                 info->features |= ETH_FEATURE_WLAN;
             }
+            if (edev->edev0->info.features & ETHMAC_FEATURE_RX_CSUM) {
+                info->features |= ETH_FEATURE_RX_CSUM;
+            }
+            if (edev->edev0->info.features & ETHMAC_FEATURE_TX_CSUM) {
+                info->features |= ETH_FEATURE_TX_CSUM;
+            }
             info->mtu = edev->edev0->info.mtu;
             *out_actual = sizeof(*info);
             status = MX_OK;
@@ -442,6 +1153,12 @@ static mx_status_t eth_ioctl(void* ctx, uint32_t op,
     case IOCTL_ETHERNET_GET_FIFOS:
         status = eth_get_fifos_locked(edev, out_buf, out_len, out_actual);
         break;
+    case IOCTL_ETHERNET_ADD_RX_QUEUE:
+        status = eth_add_rx_queue_locked(edev, out_buf, out_len, out_actual);
+        break;
+    case IOCTL_ETHERNET_SET_RSS_CONFIG:
+        status = eth_set_rss_config_locked(edev, in_buf, in_len);
+        break;
     case IOCTL_ETHERNET_SET_IOBUF:
         status = eth_set_iobuf_locked(edev, in_buf, in_len);
         break;
@@ -460,6 +1177,15 @@ static mx_status_t eth_ioctl(void* ctx, uint32_t op,
     case IOCTL_ETHERNET_SET_CLIENT_NAME:
         status = eth_set_client_name(edev, in_buf, in_len);
         break;
+    case IOCTL_ETHERNET_START_CAPTURE:
+        status = eth_start_capture_locked(edev, in_buf, in_len, out_buf, out_len, out_actual);
+        break;
+    case IOCTL_ETHERNET_STOP_CAPTURE:
+        status = eth_stop_capture_locked(edev);
+        break;
+    case IOCTL_ETHERNET_GET_STATS:
+        status = eth_get_stats_locked(edev, out_buf, out_len, out_actual);
+        break;
     default:
         // TODO: consider if we want this under the edev0->lock or not
         status = device_ioctl(edev->edev0->macdev, op, in_buf, in_len, out_buf, out_len, out_actual);
@@ -473,8 +1199,8 @@ done:
 }
 
 // kill tx thread, release buffers, etc
-// called from unbind and close
-static void eth_kill_locked(ethdev_t* edev) {
+// called from unbind and close; |restart| is whether the mac stays in use
+static void eth_kill_locked(ethdev_t* edev, bool restart) {
     if (edev->state & ETHDEV_DEAD) {
         return;
     }
@@ -485,16 +1211,30 @@ static void eth_kill_locked(ethdev_t* edev) {
     // make sure any future ioctls or other ops will fail
     edev->state |= ETHDEV_DEAD;
 
+    // the mac must be done with the io buffer before it is unpinned
+    if ((edev->edev0->rx_owner == edev) || (edev->tx_queued > 0)) {
+        eth_mac_release_locked(edev->edev0, edev, restart);
+    }
+
+    eth_stop_capture_locked(edev);
+
     // try to convince clients to close us
-    if (edev->rx_fifo) {
-        mx_handle_close(edev->rx_fifo);
-        edev->rx_fifo = MX_HANDLE_INVALID;
+    for (uint32_t i = 0; i < edev->rxq_count; i++) {
+        if (edev->rxq[i]->fifo) {
+            mx_handle_close(edev->rxq[i]->fifo);
+            edev->rxq[i]->fifo = MX_HANDLE_INVALID;
+        }
     }
     if (edev->tx_fifo) {
         mx_handle_close(edev->tx_fifo);
         edev->tx_fifo = MX_HANDLE_INVALID;
     }
     if (edev->io_vmo) {
+        if (edev->io_phys) {
+            mx_vmo_op_range(edev->io_vmo, MX_VMO_OP_UNPIN, 0, edev->io_size, NULL, 0);
+            free(edev->io_phys);
+            edev->io_phys = NULL;
+        }
         mx_handle_close(edev->io_vmo);
         edev->io_vmo = MX_HANDLE_INVALID;
     }
@@ -516,6 +1256,9 @@ static void eth_kill_locked(ethdev_t* edev) {
 
 static void eth_release(void* ctx) {
     ethdev_t* edev = ctx;
+    for (uint32_t i = 1; i < edev->rxq_count; i++) {
+        free(edev->rxq[i]);
+    }
     free(edev);
 }
 
@@ -524,7 +1267,7 @@ static mx_status_t eth_close(void* ctx, uint32_t flags) {
 
     mtx_lock(&edev->edev0->lock);
     eth_stop_locked(edev);
-    eth_kill_locked(edev);
+    eth_kill_locked(edev, true);
     list_delete(&edev->node);
     mtx_unlock(&edev->edev0->lock);
 
@@ -546,6 +1289,9 @@ static mx_status_t eth0_open(void* ctx, mx_device_t** out, uint32_t flags) {
         return MX_ERR_NO_MEMORY;
     }
     edev->edev0 = edev0;
+    edev->rxq[0] = &edev->rxq0;
+    edev->rxq_count = 1;
+    memcpy(edev->rss_key, eth_rss_default_key, ETH_RSS_KEY_SIZE);
 
     device_add_args_t args = {
         .version = DEVICE_ADD_ARGS_VERSION,
@@ -579,10 +1325,10 @@ static void eth0_unbind(void* ctx) {
     // to encourage any open instances to close
     ethdev_t* edev;
     list_for_every_entry(&edev0->list_active, edev, ethdev_t, node) {
-        eth_kill_locked(edev);
+        eth_kill_locked(edev, false);
     }
     list_for_every_entry(&edev0->list_idle, edev, ethdev_t, node) {
-        eth_kill_locked(edev);
+        eth_kill_locked(edev, false);
     }
 
     mtx_unlock(&edev0->lock);
@@ -603,8 +1349,6 @@ static mx_protocol_device_t ethdev0_ops = {
 };
 
 
-#define BAD_FEATURES (ETHMAC_FEATURE_RX_QUEUE | ETHMAC_FEATURE_TX_QUEUE)
-
 static mx_status_t eth_bind(void* ctx, mx_device_t* dev, void** cookie) {
     ethdev0_t* edev0;
     if ((edev0 = calloc(1, sizeof(ethdev0_t))) == NULL) {
@@ -623,16 +1367,19 @@ static mx_status_t eth_bind(void* ctx, mx_device_t* dev, void** cookie) {
         goto fail;
     }
 
-    if (edev0->info.features & BAD_FEATURES) {
-        printf("eth: bind: ethermac requires unsupported features: %08x\n",
-               edev0->info.features & BAD_FEATURES);
-        status = MX_ERR_NOT_SUPPORTED;
-        goto fail;
+    edev0->rx_queue_depth = FIFO_DEPTH;
+    if ((edev0->info.rx_queue_depth != 0) && (edev0->info.rx_queue_depth < FIFO_DEPTH)) {
+        edev0->rx_queue_depth = edev0->info.rx_queue_depth;
+    }
+    edev0->tx_queue_depth = FIFO_DEPTH;
+    if ((edev0->info.tx_queue_depth != 0) && (edev0->info.tx_queue_depth < FIFO_DEPTH)) {
+        edev0->tx_queue_depth = edev0->info.tx_queue_depth;
     }
 
     mtx_init(&edev0->lock, mtx_plain);
     list_initialize(&edev0->list_active);
     list_initialize(&edev0->list_idle);
+    list_initialize(&edev0->list_capture);
 
     edev0->macdev = dev;
 
@@ -0,0 +1,130 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string.h>
+
+#include "rss.h"
+
+#define ETH_HDR_LEN 14
+#define ETH_TYPE_IP4 0x0800
+#define ETH_TYPE_IP6 0x86DD
+
+#define IP4_HDR_LEN 20
+#define IP6_HDR_LEN 40
+#define IP_PROTO_TCP 6
+#define IP_PROTO_UDP 17
+
+#define TCP_CSUM_OFFSET 16
+#define UDP_CSUM_OFFSET 6
+
+const uint8_t eth_rss_default_key[ETH_RSS_KEY_SIZE] = {
+    0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2,
+    0x41, 0x67, 0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0,
+    0xd0, 0xca, 0x2b, 0xcb, 0xae, 0x7b, 0x30, 0xb4,
+    0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30, 0xf2, 0x0c,
+    0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa,
+};
+
+// For each bit set in the input, the 32 bits of the key starting there are
+// folded into the hash. The input is at most 36 bytes, so the key suffices.
+static uint32_t toeplitz(const uint8_t* key, const uint8_t* in, size_t len) {
+    uint32_t hash = 0;
+    uint32_t window = ((uint32_t)key[0] << 24) | ((uint32_t)key[1] << 16) |
+                      ((uint32_t)key[2] << 8) | key[3];
+    for (size_t i = 0; i < len; i++) {
+        for (int bit = 7; bit >= 0; bit--) {
+            if (in[i] & (1u << bit)) {
+                hash ^= window;
+            }
+            window = (window << 1) | ((key[i + 4] >> bit) & 1u);
+        }
+    }
+    return hash;
+}
+
+bool eth_rss_hash(const uint8_t* key, const void* frame, size_t len, uint32_t* hash) {
+    const uint8_t* p = frame;
+    if (len < ETH_HDR_LEN) {
+        return false;
+    }
+    uint16_t type = (p[12] << 8) | p[13];
+    p += ETH_HDR_LEN;
+    len -= ETH_HDR_LEN;
+
+    // source and destination addresses, then ports
+    uint8_t in[36];
+    size_t in_len;
+    size_t ports;
+    uint8_t proto;
+    if (type == ETH_TYPE_IP4) {
+        if (len < IP4_HDR_LEN) {
+            return false;
+        }
+        size_t hdr_len = (p[0] & 0x0f) * 4;
+        proto = p[9];
+        memcpy(in, p + 12, 8);
+        in_len = 8;
+        // fragments go without ports, as only the first has them
+        bool fragment = ((p[6] & 0x3f) | p[7]) != 0;
+        ports = fragment ? len : hdr_len;
+    } else if (type == ETH_TYPE_IP6) {
+        if (len < IP6_HDR_LEN) {
+            return false;
+        }
+        proto = p[6];
+        memcpy(in, p + 8, 32);
+        in_len = 32;
+        ports = IP6_HDR_LEN;
+    } else {
+        return false;
+    }
+    if (((proto == IP_PROTO_TCP) || (proto == IP_PROTO_UDP)) && (ports + 4 <= len)) {
+        memcpy(in + in_len, p + ports, 4);
+        in_len += 4;
+    }
+
+    *hash = toeplitz(key, in, in_len);
+    return true;
+}
+
+bool eth_csum_offsets(const void* frame, size_t len, uint32_t* start, uint32_t* offset) {
+    const uint8_t* p = frame;
+    if (len < ETH_HDR_LEN) {
+        return false;
+    }
+    uint16_t type = (p[12] << 8) | p[13];
+
+    size_t l4;
+    uint8_t proto;
+    if (type == ETH_TYPE_IP4) {
+        if (len < ETH_HDR_LEN + IP4_HDR_LEN) {
+            return false;
+        }
+        l4 = ETH_HDR_LEN + (p[ETH_HDR_LEN] & 0x0f) * 4;
+        proto = p[ETH_HDR_LEN + 9];
+    } else if (type == ETH_TYPE_IP6) {
+        if (len < ETH_HDR_LEN + IP6_HDR_LEN) {
+            return false;
+        }
+        l4 = ETH_HDR_LEN + IP6_HDR_LEN;
+        proto = p[ETH_HDR_LEN + 6];
+    } else {
+        return false;
+    }
+
+    size_t field;
+    if (proto == IP_PROTO_TCP) {
+        field = l4 + TCP_CSUM_OFFSET;
+    } else if (proto == IP_PROTO_UDP) {
+        field = l4 + UDP_CSUM_OFFSET;
+    } else {
+        return false;
+    }
+    if ((field + 2 > len) || (field > 0xFF)) {
+        return false;
+    }
+    *start = l4;
+    *offset = field;
+    return true;
+}
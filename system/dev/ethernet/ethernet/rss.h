@@ -0,0 +1,29 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <magenta/compiler.h>
+#include <magenta/device/ethernet.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+__BEGIN_CDECLS;
+
+// The key suggested by the Microsoft RSS specification, which most
+// hardware defaults to, so that flows hash as they would there.
+extern const uint8_t eth_rss_default_key[ETH_RSS_KEY_SIZE];
+
+// Hash the flow of an ethernet frame with |key|. Returns false, leaving
+// |hash| alone, if it is not an IPv4 or IPv6 packet.
+bool eth_rss_hash(const uint8_t* key, const void* frame, size_t len, uint32_t* hash);
+
+// Find where the TCP or UDP checksum of an ethernet frame is summed from,
+// and where it is stored, both from the start of the frame. Returns false
+// if it is not a TCP or UDP packet over IPv4 or IPv6, or they lie past
+// the first 256 bytes.
+bool eth_csum_offsets(const void* frame, size_t len, uint32_t* start, uint32_t* offset);
+
+__END_CDECLS;
@@ -8,7 +8,10 @@ MODULE := $(LOCAL_DIR)
 
 MODULE_TYPE := driver
 
-MODULE_SRCS := $(LOCAL_DIR)/ethernet.c
+MODULE_SRCS := \
+    $(LOCAL_DIR)/capture.c \
+    $(LOCAL_DIR)/ethernet.c \
+    $(LOCAL_DIR)/rss.c
 
 MODULE_STATIC_LIBS := system/ulib/ddk
 
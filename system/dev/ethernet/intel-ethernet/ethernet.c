@@ -10,6 +10,7 @@
 #include <ddk/protocol/pci.h>
 #include <hw/pci.h>
 
+#include <magenta/device/ethernet.h>
 #include <magenta/syscalls.h>
 #include <magenta/types.h>
 #include <stdio.h>
@@ -20,6 +21,9 @@
 typedef mx_status_t status_t;
 #include "ie.h"
 
+// at most 8000 interrupts a second, so that each finds a batch of packets
+#define ETH_IRQ_INTERVAL_DEFAULT_US 125
+
 typedef struct ethernet_device {
     ethdev_t eth;
     mtx_t lock;
@@ -30,12 +34,42 @@ typedef struct ethernet_device {
     bool edge_triggered_irq;
     thrd_t thread;
     io_buffer_t buffer;
+    eth_irq_moderation_t moderation;
 
     // callback interface to attached ethernet layer
     ethmac_ifc_t* ifc;
     void* cookie;
 } ethernet_device_t;
 
+// Hands on the packets received and reports those sent, returning whether
+// there were any. Called with the lock held.
+static bool eth_handle_rings(ethernet_device_t* edev) {
+    bool busy = false;
+    void* data;
+    size_t len;
+
+    while (eth_rx(&edev->eth, &data, &len) == MX_OK) {
+        if (edev->ifc) {
+            uint32_t flags = eth_rx_pending(&edev->eth) ? ETHMAC_RX_OPT_MORE : 0;
+            if (eth_rx_csum_ok(&edev->eth)) {
+                flags |= ETHMAC_RX_OPT_CSUM_OK;
+            }
+            edev->ifc->recv(edev->cookie, data, len, flags);
+        }
+        eth_rx_ack(&edev->eth);
+        busy = true;
+    }
+
+    uint32_t count = eth_reclaim_tx(&edev->eth);
+    if (count > 0) {
+        if (edev->ifc) {
+            edev->ifc->complete_tx(edev->cookie, count);
+        }
+        busy = true;
+    }
+    return busy;
+}
+
 static int irq_thread(void* arg) {
     ethernet_device_t* edev = arg;
     for (;;) {
@@ -50,21 +84,34 @@ static int irq_thread(void* arg) {
             mx_interrupt_complete(edev->irqh);
 
         mtx_lock(&edev->lock);
-        if (eth_handle_irq(&edev->eth) & ETH_IRQ_RX) {
-            void* data;
-            size_t len;
-
-            while (eth_rx(&edev->eth, &data, &len) == MX_OK) {
-                if (edev->ifc) {
-                    edev->ifc->recv(edev->cookie, data, len, 0);
-                }
-                eth_rx_ack(&edev->eth);
-            }
-        }
+        eth_handle_irq(&edev->eth);
+        bool busy = eth_handle_rings(edev);
+        uint32_t poll_us = edev->moderation.poll_us;
         mtx_unlock(&edev->lock);
 
         if (!edev->edge_triggered_irq)
             mx_interrupt_complete(edev->irqh);
+
+        if ((poll_us == 0) || !busy) {
+            continue;
+        }
+
+        // Busy poll, with interrupts off, until nothing has come or gone
+        // for poll_us.
+        eth_enable_irqs(&edev->eth, false);
+        mx_time_t idle = mx_deadline_after(MX_USEC(poll_us));
+        while (mx_time_get(MX_CLOCK_MONOTONIC) < idle) {
+            mtx_lock(&edev->lock);
+            busy = eth_handle_rings(edev);
+            poll_us = edev->moderation.poll_us;
+            mtx_unlock(&edev->lock);
+            if (busy) {
+                idle = mx_deadline_after(MX_USEC(poll_us));
+            } else {
+                thrd_yield();
+            }
+        }
+        eth_enable_irqs(&edev->eth, true);
     }
     return 0;
 }
@@ -77,7 +124,9 @@ static mx_status_t eth_query(void* ctx, uint32_t options, ethmac_info_t* info) {
     }
 
     memset(info, 0, sizeof(*info));
+    info->features = ETHMAC_FEATURE_TX_QUEUE | ETHMAC_FEATURE_RX_CSUM | ETHMAC_FEATURE_TX_CSUM;
     info->mtu = ETH_RXBUF_SIZE; //TODO: not actually the mtu!
+    info->tx_queue_depth = ETH_TX_QUEUE_DEPTH;
     memcpy(info->mac, edev->eth.mac, sizeof(edev->eth.mac));
 
     return MX_OK;
@@ -87,6 +136,7 @@ static void eth_stop(void* ctx) {
     ethernet_device_t* edev = ctx;
     mtx_lock(&edev->lock);
     edev->ifc = NULL;
+    eth_reset_tx(&edev->eth);
     mtx_unlock(&edev->lock);
 }
 
@@ -107,8 +157,15 @@ static mx_status_t eth_start(void* ctx, ethmac_ifc_t* ifc, void* cookie) {
 }
 
 static void eth_send(void* ctx, uint32_t options, void* data, size_t length) {
+    // frames are queued with eth_queue_tx instead
+}
+
+static void eth_queue_tx_frame(void* ctx, uint32_t options,
+                               uintptr_t pa0, uintptr_t pa1, size_t length) {
     ethernet_device_t* edev = ctx;
-    eth_tx(&edev->eth, data, length);
+    uint32_t cso = (options & ETHMAC_TX_OPT_CSUM) ? ETHMAC_TX_CSUM_OFFSET(options) : 0;
+    eth_queue_tx(&edev->eth, pa0, pa1, length, ETHMAC_TX_CSUM_START(options), cso,
+                 options & ETHMAC_TX_OPT_MORE);
 }
 
 static ethmac_protocol_ops_t ethmac_ops = {
@@ -116,8 +173,43 @@ static ethmac_protocol_ops_t ethmac_ops = {
     .stop = eth_stop,
     .start = eth_start,
     .send = eth_send,
+    .queue_tx = eth_queue_tx_frame,
 };
 
+static mx_status_t eth_ioctl(void* ctx, uint32_t op,
+                             const void* in_buf, size_t in_len,
+                             void* out_buf, size_t out_len, size_t* out_actual) {
+    ethernet_device_t* edev = ctx;
+    switch (op) {
+    case IOCTL_ETHERNET_GET_IRQ_MODERATION:
+        if (out_len < sizeof(eth_irq_moderation_t)) {
+            return MX_ERR_BUFFER_TOO_SMALL;
+        }
+        mtx_lock(&edev->lock);
+        memcpy(out_buf, &edev->moderation, sizeof(eth_irq_moderation_t));
+        mtx_unlock(&edev->lock);
+        *out_actual = sizeof(eth_irq_moderation_t);
+        return MX_OK;
+    case IOCTL_ETHERNET_SET_IRQ_MODERATION: {
+        if (in_len < sizeof(eth_irq_moderation_t)) {
+            return MX_ERR_INVALID_ARGS;
+        }
+        const eth_irq_moderation_t* moderation = in_buf;
+        if (moderation->interval_us > ETH_IRQ_INTERVAL_MAX_US) {
+            return MX_ERR_OUT_OF_RANGE;
+        }
+        mtx_lock(&edev->lock);
+        edev->moderation.interval_us = moderation->interval_us;
+        edev->moderation.poll_us = moderation->poll_us;
+        eth_set_irq_interval(&edev->eth, moderation->interval_us);
+        mtx_unlock(&edev->lock);
+        return MX_OK;
+    }
+    default:
+        return MX_ERR_NOT_SUPPORTED;
+    }
+}
+
 static void eth_release(void* ctx) {
     ethernet_device_t* edev = ctx;
     eth_reset_hw(&edev->eth);
@@ -129,6 +221,7 @@ static void eth_release(void* ctx) {
 
 static mx_protocol_device_t device_ops = {
     .version = DEVICE_OPS_VERSION,
+    .ioctl = eth_ioctl,
     .release = eth_release,
 };
 
@@ -200,6 +293,8 @@ static mx_status_t eth_bind(void* ctx, mx_device_t* dev, void** cookie) {
 
     eth_setup_buffers(&edev->eth, io_buffer_virt(&edev->buffer), io_buffer_phys(&edev->buffer));
     eth_init_hw(&edev->eth);
+    edev->moderation.interval_us = ETH_IRQ_INTERVAL_DEFAULT_US;
+    eth_set_irq_interval(&edev->eth, edev->moderation.interval_us);
 
     device_add_args_t args = {
         .version = DEVICE_ADD_ARGS_VERSION,
@@ -3,6 +3,7 @@
 // found in the LICENSE file.
 
 #include <inttypes.h>
+#include <limits.h>
 #include <stdint.h>
 #include <magenta/listnode.h>
 
@@ -45,6 +46,20 @@ unsigned eth_handle_irq(ethdev_t* eth) {
     return readl(IE_ICR);
 }
 
+void eth_enable_irqs(ethdev_t* eth, bool enable) {
+    // causes still accumulate while masked, and interrupt once unmasked
+    if (enable) {
+        writel(ETH_IRQ_RX | ETH_IRQ_TX, IE_IMS);
+    } else {
+        writel(ETH_IRQ_RX | ETH_IRQ_TX, IE_IMC);
+    }
+}
+
+void eth_set_irq_interval(ethdev_t* eth, uint32_t usecs) {
+    // in 256ns units
+    writel((usecs * 1000) / 256, IE_ITR);
+}
+
 status_t eth_rx(ethdev_t* eth, void** data, size_t* len) {
     uint32_t n = eth->rx_rd_ptr;
     uint64_t info = eth->rxd[n].info;
@@ -62,6 +77,16 @@ status_t eth_rx(ethdev_t* eth, void** data, size_t* len) {
     return MX_OK;
 }
 
+bool eth_rx_pending(ethdev_t* eth) {
+    uint32_t n = (eth->rx_rd_ptr + 1) & (ETH_RXBUF_COUNT - 1);
+    return (eth->rxd[n].info & IE_RXD_DONE) != 0;
+}
+
+bool eth_rx_csum_ok(ethdev_t* eth) {
+    uint64_t info = eth->rxd[eth->rx_rd_ptr].info;
+    return (info & IE_RXD_TCPCS) && !(info & (IE_RXD_TCPE | IE_RXD_IXSM));
+}
+
 void eth_rx_ack(ethdev_t* eth) {
     uint32_t n = eth->rx_rd_ptr;
 
@@ -72,54 +97,76 @@ void eth_rx_ack(ethdev_t* eth) {
     eth->rx_rd_ptr = n;
 }
 
-status_t eth_tx(ethdev_t* eth, const void* data, size_t len) {
-    if ((len < 60) || (len > ETH_TXBUF_DSIZE)) {
-        return MX_ERR_INVALID_ARGS;
+void eth_queue_tx(ethdev_t* eth, uintptr_t pa0, uintptr_t pa1, size_t len,
+                  uint32_t css, uint32_t cso, bool more) {
+    // the hw takes the checksum fields from the first descriptor
+    uint64_t csum = cso ? (IE_TXD_IC | IE_TXD_CSS(css) | IE_TXD_CSO(cso)) : 0;
+
+    mtx_lock(&eth->send_lock);
+
+    // the frame is split where it crosses onto its second page
+    uint32_t n = eth->tx_wr_ptr;
+    if (pa1 != 0) {
+        size_t len0 = PAGE_SIZE - (pa0 & (PAGE_SIZE - 1));
+        eth->txd[n].addr = pa0;
+        eth->txd[n].info = IE_TXD_LEN(len0) | IE_TXD_IFCS | csum;
+        n = (n + 1) & (ETH_TXBUF_COUNT - 1);
+        pa0 = pa1;
+        len -= len0;
     }
+    // only the last descriptor reports status, after a delay so that
+    // frames sent together complete together
+    eth->txd[n].addr = pa0;
+    eth->txd[n].info = IE_TXD_LEN(len) | IE_TXD_EOP | IE_TXD_IFCS | IE_TXD_RS | IE_TXD_IDE | csum;
+    n = (n + 1) & (ETH_TXBUF_COUNT - 1);
+    eth->tx_wr_ptr = n;
 
-    mx_status_t status = MX_OK;
+    // inform hw of buffer availability
+    if (!more) {
+        writel(n, IE_TDT);
+    }
 
-    mtx_lock(&eth->send_lock);
+    mtx_unlock(&eth->send_lock);
+}
 
-    // reclaim completed buffers from hw
+uint32_t eth_reclaim_tx(ethdev_t* eth) {
+    uint32_t count = 0;
+
+    mtx_lock(&eth->send_lock);
     uint32_t n = eth->tx_rd_ptr;
-    for (;;) {
-        uint64_t info = eth->txd[n].info;
-        if (!(info & IE_TXD_DONE)) {
-            break;
+    while (n != eth->tx_wr_ptr) {
+        // a frame's status is in its last descriptor
+        uint32_t last = n;
+        if (!(eth->txd[last].info & IE_TXD_EOP)) {
+            last = (last + 1) & (ETH_TXBUF_COUNT - 1);
         }
-        framebuf_t* frame = list_remove_head_type(&eth->busy_frames, framebuf_t, node);
-        if (frame == NULL) {
-            panic();
+        if (!(eth->txd[last].info & IE_TXD_DONE)) {
+            break;
         }
-        // TODO: verify that this is the matching buffer to txd[n] addr?
-        list_add_tail(&eth->free_frames, &frame->node);
         eth->txd[n].info = 0;
-        n = (n + 1) & (ETH_TXBUF_COUNT - 1);
+        eth->txd[last].info = 0;
+        n = (last + 1) & (ETH_TXBUF_COUNT - 1);
+        count++;
     }
     eth->tx_rd_ptr = n;
+    mtx_unlock(&eth->send_lock);
 
-    // obtain buffer, copy into it, setup descriptor
-    framebuf_t *frame = list_remove_head_type(&eth->free_frames, framebuf_t, node);
-    if (frame == NULL) {
-        status = MX_ERR_NO_MEMORY;
-        goto out;
-    }
-
-    n = eth->tx_wr_ptr;
-    memcpy(frame->data, data, len);
-    eth->txd[n].addr = frame->phys;
-    eth->txd[n].info = IE_TXD_LEN(len) | IE_TXD_EOP | IE_TXD_IFCS | IE_TXD_RS;
-    list_add_tail(&eth->busy_frames, &frame->node);
-
-    // inform hw of buffer availability
-    n = (n + 1) & (ETH_TXBUF_COUNT - 1);
-    eth->tx_wr_ptr = n;
-    writel(n, IE_TDT);
+    return count;
+}
 
-out:
+void eth_reset_tx(ethdev_t* eth) {
+    mtx_lock(&eth->send_lock);
+    uint32_t tctl = readl(IE_TCTL);
+    writel(tctl & ~IE_TCTL_EN, IE_TCTL);
+    // let the frame in progress finish
+    __nanosleep(MX_USEC(100));
+    memset(eth->txd, 0, ETH_DRING_SIZE);
+    eth->tx_wr_ptr = 0;
+    eth->tx_rd_ptr = 0;
+    writel(0, IE_TDH);
+    writel(0, IE_TDT);
+    writel(tctl, IE_TCTL);
     mtx_unlock(&eth->send_lock);
-    return status;
 }
 
 status_t eth_reset_hw(ethdev_t* eth) {
@@ -153,7 +200,7 @@ void eth_init_hw(ethdev_t* eth) {
 
     // setup rx ring
     eth->rx_rd_ptr = 0;
-    writel(0, IE_RXCSUM);
+    writel(IE_RXCSUM_TUOFL, IE_RXCSUM);
     writel((4 << 0) | (1 << 8) | (1 << 16) | (1 << 24), IE_RXDCTL);
     writel(eth->rxd_phys, IE_RDBAL);
     writel(eth->rxd_phys >> 32, IE_RDBAH);
@@ -168,20 +215,18 @@ void eth_init_hw(ethdev_t* eth) {
     writel(eth->txd_phys, IE_TDBAL);
     writel(eth->txd_phys >> 32, IE_TDBAH);
     writel(ETH_TXBUF_COUNT * 16, IE_TDLEN);
-    writel(IE_TCTL_CT(15) | IE_TCTL_COLD_FD | IE_TCTL_EN, IE_TCTL);
+    writel(64, IE_TIDV); // in 1.024us units
+    writel(IE_TCTL_CT(15) | IE_TCTL_COLD_FD | IE_TCTL_PSP | IE_TCTL_EN, IE_TCTL);
 
     // disable all irqs (write to "clear" mask)
     writel(0xFFFF, IE_IMC);
-    // enable rx irq (write to "set" mask)
-    writel(IE_INT_RXT0, IE_IMS);
+    // enable rx and tx irqs (write to "set" mask)
+    eth_enable_irqs(eth, true);
 }
 
 void eth_setup_buffers(ethdev_t* eth, void* iomem, mx_paddr_t iophys) {
     printf("eth: iomem @%p (phys %" PRIxPTR ")\n", iomem, iophys);
 
-    list_initialize(&eth->free_frames);
-    list_initialize(&eth->busy_frames);
-
     eth->rxd = iomem;
     eth->rxd_phys = iophys;
     iomem += ETH_DRING_SIZE;
@@ -202,14 +247,4 @@ void eth_setup_buffers(ethdev_t* eth, void* iomem, mx_paddr_t iophys) {
     for (int n = 0; n < ETH_RXBUF_COUNT; n++) {
         eth->rxd[n].addr = eth->rxb_phys + ETH_RXBUF_SIZE * n;
     }
-    for (int n = 0; n < ETH_TXBUF_COUNT - 1; n++) {
-        framebuf_t *txb = iomem;
-        txb->phys = iophys + ETH_TXBUF_HSIZE;
-        txb->size = ETH_TXBUF_SIZE - ETH_TXBUF_HSIZE;
-        txb->data = iomem + ETH_TXBUF_HSIZE;
-        list_add_tail(&eth->free_frames, &txb->node);
-
-        iomem += ETH_TXBUF_SIZE;
-        iophys += ETH_TXBUF_SIZE;
-    }
 }
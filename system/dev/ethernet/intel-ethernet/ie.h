@@ -4,20 +4,13 @@
 
 #pragma once
 
+#include <stdbool.h>
 #include <threads.h>
 
 #include "ie-hw.h"
 
-typedef struct framebuf framebuf_t;
 typedef struct ethdev ethdev_t;
 
-struct framebuf {
-    list_node_t node;
-    uintptr_t phys;
-    void* data;
-    size_t size;
-};
-
 struct ethdev {
     uintptr_t iobase;
 
@@ -29,9 +22,6 @@ struct ethdev {
     uint32_t tx_rd_ptr;
     uint32_t rx_rd_ptr;
 
-    list_node_t free_frames;
-    list_node_t busy_frames;
-
     // base physical addresses for
     // tx/rx rings and rx buffers
     // store as 64bit integer to match hw register size
@@ -48,15 +38,14 @@ struct ethdev {
 #define ETH_RXBUF_SIZE  2048
 #define ETH_RXBUF_COUNT 32
 
-#define ETH_TXBUF_SIZE  2048
+// Frames are sent from the buffers they are queued in, using a descriptor
+// for each page they are on. One is always left free.
 #define ETH_TXBUF_COUNT 32
-#define ETH_TXBUF_HSIZE 128
-#define ETH_TXBUF_DSIZE (ETH_TXBUF_SIZE - ETH_TXBUF_HSIZE)
+#define ETH_TX_QUEUE_DEPTH ((ETH_TXBUF_COUNT - 1) / 2)
 
 #define ETH_DRING_SIZE 2048
 
 #define ETH_ALLOC ((ETH_RXBUF_SIZE * ETH_RXBUF_COUNT) + \
-                   (ETH_TXBUF_SIZE * ETH_TXBUF_COUNT) + \
                    (ETH_DRING_SIZE * 2))
 
 status_t eth_reset_hw(ethdev_t* eth);
@@ -66,9 +55,28 @@ void eth_init_hw(ethdev_t* eth);
 void eth_dump_regs(ethdev_t* eth);
 
 status_t eth_rx(ethdev_t* eth, void** data, size_t* len);
+// whether another packet follows the one eth_rx() returned
+bool eth_rx_pending(ethdev_t* eth);
+// whether the hw found the TCP/UDP checksum of the one eth_rx() returned good
+bool eth_rx_csum_ok(ethdev_t* eth);
 void eth_rx_ack(ethdev_t* eth);
 
-status_t eth_tx(ethdev_t* eth, const void* data, size_t len);
+// queue a frame at pa0, continuing at pa1 if nonzero, telling the hw
+// of it and those queued before it unless more follow; if cso is nonzero,
+// the hw stores the checksum from byte css on there
+void eth_queue_tx(ethdev_t* eth, uintptr_t pa0, uintptr_t pa1, size_t len,
+                  uint32_t css, uint32_t cso, bool more);
+// reclaim the descriptors of frames sent, returning how many were
+uint32_t eth_reclaim_tx(ethdev_t* eth);
+// give up all frames queued, sent or not
+void eth_reset_tx(ethdev_t* eth);
 
 #define ETH_IRQ_RX IE_INT_RXT0
+#define ETH_IRQ_TX IE_INT_TXDW
 unsigned eth_handle_irq(ethdev_t* eth);
+void eth_enable_irqs(ethdev_t* eth, bool enable);
+
+// the longest interval the hw can hold interrupts back for
+#define ETH_IRQ_INTERVAL_MAX_US 16000
+// hold interrupts back so there are at most one every |usecs|
+void eth_set_irq_interval(ethdev_t* eth, uint32_t usecs);
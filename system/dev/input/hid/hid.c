@@ -11,6 +11,7 @@
 
 #include <magenta/assert.h>
 #include <magenta/listnode.h>
+#include <magenta/syscalls.h>
 
 #include <assert.h>
 #include <stdio.h>
@@ -31,6 +32,10 @@
     list_for_every_entry(&base->instance_list, instance, hid_instance_t, node)
 #define bits_to_bytes(n) (((n) + 7) / 8)
 
+// Reports staged in hid_io_queue() before they are written to the report
+// fifos together.
+#define HID_REPORT_BATCH 8
+
 // Until we do full HID parsing, we put mouse and keyboard devices into boot
 // protocol mode. In particular, a mouse will always send 3 byte reports (see
 // ddk/protocol/input.h for the format). This macro sets ioctl return values for
@@ -68,6 +73,12 @@ typedef struct hid_device {
     size_t num_reports;
     hid_report_size_t sizes[HID_MAX_REPORT_IDS];
 
+    // Input report sizes in bytes, by report ID, worked out from |sizes| once
+    // the report descriptor has been parsed, so that every incoming report
+    // doesn't have to go looking for its size.
+    input_report_size_t in_size_by_id[256];
+    input_report_size_t max_in_size;
+
     struct list_node instance_list;
     mtx_t instance_lock;
 
@@ -82,6 +93,10 @@ typedef struct hid_instance {
 
     mx_hid_fifo_t fifo;
 
+    // Our end of the fifo from IOCTL_INPUT_GET_REPORT_FIFO. Once there is one,
+    // reports go to it instead of |fifo|. Guarded by the base's instance_lock.
+    mx_handle_t report_fifo;
+
     struct list_node node;
 } hid_instance_t;
 
@@ -134,6 +149,9 @@ static inline mx_status_t hid_op_set_protocol(hid_device_t* hid, uint8_t protoco
 static input_report_size_t hid_get_report_size_by_id(hid_device_t* hid,
                                                      input_report_id_t id,
                                                      input_report_type_t type) {
+    if (type == INPUT_REPORT_INPUT) {
+        return hid->in_size_by_id[id];
+    }
     for (size_t i = 0; i < hid->num_reports; i++) {
         if ((hid->sizes[i].id == id) || (hid->num_reports == 1)) {
             switch (type) {
@@ -229,15 +247,49 @@ static ssize_t hid_get_max_input_reportsize(hid_device_t* hid, void* out_buf, si
     if (out_len < sizeof(input_report_size_t)) return MX_ERR_INVALID_ARGS;
 
     input_report_size_t* reply = out_buf;
+    *reply = hid->max_in_size;
+    *out_actual = sizeof(*reply);
+    return MX_OK;
+}
+
+static mx_status_t hid_get_report_sizes(hid_device_t* hid, void* out_buf, size_t out_len,
+                                        size_t* out_actual) {
+    if (out_len < hid->num_reports * sizeof(input_report_sizes_t))
+        return MX_ERR_INVALID_ARGS;
 
-    *reply = 0;
+    input_report_sizes_t* reply = out_buf;
     for (size_t i = 0; i < hid->num_reports; i++) {
-        if (hid->sizes[i].in_size > *reply)
-            *reply = hid->sizes[i].in_size;
+        reply[i].id = (input_report_id_t)hid->sizes[i].id;
+        reply[i].in_size = bits_to_bytes(hid->sizes[i].in_size);
+        reply[i].out_size = bits_to_bytes(hid->sizes[i].out_size);
+        reply[i].feat_size = bits_to_bytes(hid->sizes[i].feat_size);
     }
+    *out_actual = hid->num_reports * sizeof(input_report_sizes_t);
+    return MX_OK;
+}
 
-    *reply = bits_to_bytes(*reply);
-    *out_actual = sizeof(*reply);
+static mx_status_t hid_get_report_fifo(hid_instance_t* hid, void* out_buf, size_t out_len,
+                                       size_t* out_actual) {
+    if (out_len < sizeof(mx_handle_t)) return MX_ERR_INVALID_ARGS;
+    if (hid->base->max_in_size > INPUT_REPORT_ENTRY_MAX_DATA) return MX_ERR_NOT_SUPPORTED;
+
+    mx_handle_t ours, theirs;
+    mx_status_t status = mx_fifo_create(INPUT_REPORT_FIFO_DEPTH, sizeof(input_report_entry_t), 0,
+                                        &ours, &theirs);
+    if (status != MX_OK) return status;
+
+    mtx_lock(&hid->base->instance_lock);
+    if (hid->report_fifo != MX_HANDLE_INVALID) {
+        mtx_unlock(&hid->base->instance_lock);
+        mx_handle_close(ours);
+        mx_handle_close(theirs);
+        return MX_ERR_ALREADY_BOUND;
+    }
+    hid->report_fifo = ours;
+    mtx_unlock(&hid->base->instance_lock);
+
+    *(mx_handle_t*)out_buf = theirs;
+    *out_actual = sizeof(mx_handle_t);
     return MX_OK;
 }
 
@@ -343,6 +395,10 @@ static mx_status_t hid_ioctl_instance(void* ctx, uint32_t op,
         return hid_get_report(hid->base, in_buf, in_len, out_buf, out_len, out_actual);
     case IOCTL_INPUT_SET_REPORT:
         return hid_set_report(hid->base, in_buf, in_len);
+    case IOCTL_INPUT_GET_REPORT_FIFO:
+        return hid_get_report_fifo(hid, out_buf, out_len, out_actual);
+    case IOCTL_INPUT_GET_REPORT_SIZES:
+        return hid_get_report_sizes(hid->base, out_buf, out_len, out_actual);
     }
     return MX_ERR_NOT_SUPPORTED;
 }
@@ -361,6 +417,9 @@ static void hid_release_reassembly_buffer(hid_device_t* dev);
 
 static void hid_release_instance(void* ctx) {
     hid_instance_t* hid = ctx;
+    if (hid->report_fifo != MX_HANDLE_INVALID) {
+        mx_handle_close(hid->report_fifo);
+    }
     free(hid);
 }
 
@@ -617,6 +676,24 @@ done:
     return status;
 }
 
+static void hid_cache_report_sizes(hid_device_t* dev) {
+    memset(dev->in_size_by_id, 0, sizeof(dev->in_size_by_id));
+    dev->max_in_size = 0;
+    for (size_t i = 0; i < dev->num_reports; i++) {
+        input_report_size_t size = bits_to_bytes(dev->sizes[i].in_size);
+        if (size > dev->max_in_size) {
+            dev->max_in_size = size;
+        }
+        dev->in_size_by_id[(input_report_id_t)dev->sizes[i].id] = size;
+    }
+    // Without report IDs, whatever the first byte is, it's the one report.
+    if (dev->num_reports == 1) {
+        for (size_t id = 0; id < countof(dev->in_size_by_id); id++) {
+            dev->in_size_by_id[id] = dev->max_in_size;
+        }
+    }
+}
+
 static void hid_release_reassembly_buffer(hid_device_t* dev) {
     if (dev->rbuf != NULL) {
         free(dev->rbuf);
@@ -723,9 +800,42 @@ mx_protocol_device_t hid_device_proto = {
     .release = hid_release_device,
 };
 
+// Hands the staged reports to every instance with a report fifo, as one
+// write each. Instances too slow to keep up lose what doesn't fit.
+// called with hid->instance_lock held
+static void hid_flush_reports(hid_device_t* hid, const input_report_entry_t* entries,
+                              size_t count) {
+    if (count == 0) {
+        return;
+    }
+    hid_instance_t* instance;
+    foreach_instance(hid, instance) {
+        if (instance->report_fifo == MX_HANDLE_INVALID) {
+            continue;
+        }
+        uint32_t wrote = 0;
+        mx_status_t status = mx_fifo_write(instance->report_fifo, entries,
+                                           count * sizeof(*entries), &wrote);
+        if (status != MX_OK || wrote < count) {
+            if (!(instance->flags & HID_FLAGS_WRITE_FAILED)) {
+                printf("%s: report fifo full, dropped %zu reports (status=%d)\n",
+                        hid->name, count - wrote, status);
+                instance->flags |= HID_FLAGS_WRITE_FAILED;
+            }
+        } else {
+            instance->flags &= ~HID_FLAGS_WRITE_FAILED;
+        }
+    }
+}
+
 void hid_io_queue(void* cookie, const uint8_t* buf, size_t len) {
     hid_device_t* hid = cookie;
 
+    // Every report in this payload arrived together.
+    mx_time_t timestamp = mx_time_get(MX_CLOCK_MONOTONIC);
+    input_report_entry_t entries[HID_REPORT_BATCH];
+    size_t staged = 0;
+
     mtx_lock(&hid->instance_lock);
 
     while (len) {
@@ -794,8 +904,22 @@ void hid_io_queue(void* cookie, const uint8_t* buf, size_t len) {
         buf += consumed;
         len -= consumed;
 
+        if (rlen <= INPUT_REPORT_ENTRY_MAX_DATA) {
+            input_report_entry_t* entry = &entries[staged++];
+            entry->timestamp = timestamp;
+            entry->len = rlen;
+            memcpy(entry->data, rbuf, rlen);
+            if (staged == countof(entries)) {
+                hid_flush_reports(hid, entries, staged);
+                staged = 0;
+            }
+        }
+
         hid_instance_t* instance;
         foreach_instance(hid, instance) {
+            if (instance->report_fifo != MX_HANDLE_INVALID) {
+                continue;
+            }
             mtx_lock(&instance->fifo.lock);
             bool was_empty = mx_hid_fifo_size(&instance->fifo) == 0;
             ssize_t wrote = mx_hid_fifo_write(&instance->fifo, rbuf, rlen);
@@ -816,6 +940,7 @@ void hid_io_queue(void* cookie, const uint8_t* buf, size_t len) {
         }
     }
 
+    hid_flush_reports(hid, entries, staged);
     mtx_unlock(&hid->instance_lock);
 }
 
@@ -874,6 +999,7 @@ static mx_status_t hid_bind(void* ctx, mx_device_t* parent, void** cookie) {
         printf("hid: could not parse hid report descriptor: %d\n", status);
         goto fail;
     }
+    hid_cache_report_sizes(hiddev);
 #if USB_HID_DEBUG
     hid_dump_hid_report_desc(hiddev);
 #endif
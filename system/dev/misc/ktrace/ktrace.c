@@ -17,19 +17,145 @@
 #include <string.h>
 #include <threads.h>
 
+// The kernel hands back the name records followed by a section for each cpu,
+// a TAG_CPU_BUFFER record then that cpu's records in time order. Reads are
+// served from a copy merged back into the single time ordered stream that
+// trace tools expect, taken again whenever the size is asked for or the
+// trace is read from the start.
+static mtx_t trace_lock = MTX_INIT;
+static uint8_t* trace_data;
+static size_t trace_size;
+
+typedef struct ktrace_section {
+    const uint8_t* next;
+    const uint8_t* end;
+} ktrace_section_t;
+
+static void ktrace_merge(const uint8_t* raw, size_t size, uint8_t* out, size_t* out_size) {
+    ktrace_section_t* sections = NULL;
+    size_t num_sections = 0;
+    size_t n = 0;
+
+    const uint8_t* p = raw;
+    const uint8_t* end = raw + size;
+    while (p + KTRACE_HDRSIZE <= end) {
+        uint32_t tag = *(const uint32_t*)p;
+        size_t len = KTRACE_LEN(tag);
+        if ((len == 0) || (len > (size_t)(end - p))) {
+            break;
+        }
+        if (tag != TAG_CPU_BUFFER) {
+            memcpy(out + n, p, len);
+            n += len;
+            p += len;
+            continue;
+        }
+        const ktrace_rec_32b_t* rec = (const ktrace_rec_32b_t*)p;
+        p += len;
+        size_t section_len = rec->b < (size_t)(end - p) ? rec->b : (size_t)(end - p);
+        ktrace_section_t* grown = realloc(sections, (num_sections + 1) * sizeof(*sections));
+        if (grown == NULL) {
+            break;
+        }
+        sections = grown;
+        sections[num_sections].next = p;
+        sections[num_sections].end = p + section_len;
+        num_sections++;
+        p += section_len;
+    }
+
+    for (;;) {
+        ktrace_section_t* earliest = NULL;
+        uint64_t earliest_ts = 0;
+        for (size_t i = 0; i < num_sections; i++) {
+            ktrace_section_t* s = &sections[i];
+            if (s->end - s->next < KTRACE_HDRSIZE) {
+                continue;
+            }
+            uint64_t ts = ((const ktrace_header_t*)s->next)->ts;
+            if ((earliest == NULL) || (ts < earliest_ts)) {
+                earliest = s;
+                earliest_ts = ts;
+            }
+        }
+        if (earliest == NULL) {
+            break;
+        }
+        size_t len = KTRACE_LEN(*(const uint32_t*)earliest->next);
+        if ((len == 0) || (len > (size_t)(earliest->end - earliest->next))) {
+            earliest->next = earliest->end;
+            continue;
+        }
+        memcpy(out + n, earliest->next, len);
+        n += len;
+        earliest->next += len;
+    }
+
+    free(sections);
+    *out_size = n;
+}
+
+static mx_status_t ktrace_snapshot(void) {
+    uint32_t size;
+    mx_status_t status = mx_ktrace_read(get_root_resource(), NULL, 0, 0, &size);
+    if (status != MX_OK) {
+        return status;
+    }
+
+    uint8_t* raw = malloc(size);
+    uint8_t* merged = malloc(size);
+    if ((size != 0) && ((raw == NULL) || (merged == NULL))) {
+        free(raw);
+        free(merged);
+        return MX_ERR_NO_MEMORY;
+    }
+
+    uint32_t off = 0;
+    while (off < size) {
+        uint32_t actual;
+        status = mx_ktrace_read(get_root_resource(), raw + off, off, size - off, &actual);
+        if (status != MX_OK) {
+            free(raw);
+            free(merged);
+            return status;
+        }
+        if (actual == 0) {
+            break;
+        }
+        off += actual;
+    }
+
+    free(trace_data);
+    trace_data = merged;
+    ktrace_merge(raw, off, trace_data, &trace_size);
+    free(raw);
+    return MX_OK;
+}
+
 static mx_status_t ktrace_read(void* ctx, void* buf, size_t count, mx_off_t off, size_t* actual) {
-    uint32_t length;
-    mx_status_t status = mx_ktrace_read(get_root_resource(), buf, off, count, &length);
+    mtx_lock(&trace_lock);
+    mx_status_t status = MX_OK;
+    if (off == 0) {
+        status = ktrace_snapshot();
+    }
     if (status == MX_OK) {
-        *actual = length;
+        size_t n = 0;
+        if (off < trace_size) {
+            n = trace_size - off < count ? trace_size - off : count;
+            memcpy(buf, trace_data + off, n);
+        }
+        *actual = n;
     }
+    mtx_unlock(&trace_lock);
     return status;
 }
 
 static mx_off_t ktrace_get_size(void* ctx) {
-    uint32_t size;
-    mx_status_t status = mx_ktrace_read(get_root_resource(), NULL, 0, 0, &size);
-    return status != MX_OK ? (mx_off_t)status : (mx_off_t)size;
+    mtx_lock(&trace_lock);
+    mx_status_t status = ktrace_snapshot();
+    mx_off_t size = status != MX_OK ? (mx_off_t)status : (mx_off_t)trace_size;
+    mtx_unlock(&trace_lock);
+    return size;
 }
 
 static mx_status_t ktrace_ioctl(void* ctx, uint32_t op,
@@ -65,6 +191,19 @@ static mx_status_t ktrace_ioctl(void* ctx, uint32_t op,
         *out_actual = sizeof(uint32_t);
         return MX_OK;
     }
+    case IOCTL_KTRACE_ENABLE_PROBE:
+    case IOCTL_KTRACE_DISABLE_PROBE: {
+        char name[MX_MAX_NAME_LEN];
+        if ((cmdlen >= MX_MAX_NAME_LEN) || (cmdlen < 1)) {
+            return MX_ERR_INVALID_ARGS;
+        }
+        memcpy(name, cmd, cmdlen);
+        name[cmdlen] = 0;
+        uint32_t action = (op == IOCTL_KTRACE_ENABLE_PROBE) ? KTRACE_ACTION_ENABLE_PROBE
+                                                            : KTRACE_ACTION_DISABLE_PROBE;
+        mx_status_t status = mx_ktrace_control(get_root_resource(), action, 0, name);
+        return status < 0 ? status : MX_OK;
+    }
     default:
         return MX_ERR_INVALID_ARGS;
     }
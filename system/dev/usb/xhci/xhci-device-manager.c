@@ -536,22 +536,44 @@ mx_status_t xhci_enable_endpoint(xhci_t* xhci, uint32_t slot_id, usb_endpoint_de
         int cerr = (ep_type == USB_ENDPOINT_ISOCHRONOUS ? 0 : 3);
         int max_packet_size = usb_ep_max_packet(ep_desc);
 
+        bool periodic = (ep_type == USB_ENDPOINT_ISOCHRONOUS ||
+                         ep_type == USB_ENDPOINT_INTERRUPT);
+
+        // max_burst and mult are both zero based: the number of packets per
+        // burst and bursts per service interval, less one.
         int max_burst = 0;
+        int mult = 0;
         if (speed == USB_SPEED_SUPER) {
             if (ss_comp_desc != NULL) {
                 max_burst = ss_comp_desc->bMaxBurst;
+                // with large ESIT payloads the controller works out Mult itself
+                if (ep_type == USB_ENDPOINT_ISOCHRONOUS && !xhci->large_esit) {
+                    mult = ss_comp_desc->bmAttributes & 3;
+                }
             }
         } else if (speed == USB_SPEED_HIGH) {
-            if (ep_type == USB_ENDPOINT_ISOCHRONOUS || ep_type == USB_ENDPOINT_ISOCHRONOUS) {
+            if (periodic) {
+                // high bandwidth endpoints make up to three transactions per microframe
                 max_burst = usb_ep_add_mf_transactions(ep_desc);
             }
         }
 
-        int avg_trb_length = max_packet_size * max_burst;
+        // See section 4.14 of the XHCI spec
         int max_esit_payload = 0;
-        if (ep_type == USB_ENDPOINT_ISOCHRONOUS) {
-            // FIXME - more work needed for superspeed here
-            max_esit_payload = max_packet_size * max_burst;
+        if (periodic) {
+            if (speed == USB_SPEED_SUPER && ss_comp_desc != NULL) {
+                max_esit_payload = le16toh(ss_comp_desc->wBytesPerInterval);
+            } else {
+                max_esit_payload = max_packet_size * (max_burst + 1) * (mult + 1);
+            }
+        }
+        int avg_trb_length;
+        if (periodic) {
+            avg_trb_length = max_esit_payload;
+        } else if (ep_type == USB_ENDPOINT_CONTROL) {
+            avg_trb_length = 8;
+        } else {
+            avg_trb_length = 3 * 1024;
         }
 
         xhci_endpoint_context_t* epc = (xhci_endpoint_context_t*)&xhci->input_context[(index + 2) * xhci->context_size];
@@ -566,10 +588,12 @@ mx_status_t xhci_enable_endpoint(xhci_t* xhci, uint32_t slot_id, usb_endpoint_de
         mx_paddr_t tr_dequeue = xhci_transfer_ring_start_phys(&slot->eps[index].transfer_ring);
 
         XHCI_SET_BITS32(&epc->epc0, EP_CTX_INTERVAL_START, EP_CTX_INTERVAL_BITS, compute_interval(ep_desc, speed));
+        XHCI_SET_BITS32(&epc->epc0, EP_CTX_MULT_START, EP_CTX_MULT_BITS, mult);
         XHCI_SET_BITS32(&epc->epc0, EP_CTX_MAX_ESIT_PAYLOAD_HI_START, EP_CTX_MAX_ESIT_PAYLOAD_HI_BITS,
                         max_esit_payload >> EP_CTX_MAX_ESIT_PAYLOAD_LO_BITS);
         XHCI_SET_BITS32(&epc->epc1, EP_CTX_CERR_START, EP_CTX_CERR_BITS, cerr);
         XHCI_SET_BITS32(&epc->epc1, EP_CTX_EP_TYPE_START, EP_CTX_EP_TYPE_BITS, ep_index);
+        XHCI_SET_BITS32(&epc->epc1, EP_CTX_MAX_BURST_SIZE_START, EP_CTX_MAX_BURST_SIZE_BITS, max_burst);
         XHCI_SET_BITS32(&epc->epc1, EP_CTX_MAX_PACKET_SIZE_START, EP_CTX_MAX_PACKET_SIZE_BITS, max_packet_size);
 
         XHCI_WRITE32(&epc->epc2, ((uint32_t)tr_dequeue & EP_CTX_TR_DEQUEUE_LO_MASK) | EP_CTX_DCS);
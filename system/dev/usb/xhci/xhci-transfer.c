@@ -172,6 +172,26 @@ static mx_status_t xhci_start_transfer_locked(xhci_t* xhci, xhci_endpoint_t* ep,
     return MX_OK;
 }
 
+// Transfer Burst Count and Last Burst Packet Count for an isochronous TD of
+// |length| bytes. See section 4.11.2.3 of the XHCI spec.
+static uint32_t xhci_isoch_burst_bits(xhci_endpoint_t* ep, size_t length) {
+    xhci_endpoint_context_t* epc = ep->epc;
+    uint32_t max_packet_size = XHCI_GET_BITS32(&epc->epc1, EP_CTX_MAX_PACKET_SIZE_START,
+                                               EP_CTX_MAX_PACKET_SIZE_BITS);
+    uint32_t burst = XHCI_GET_BITS32(&epc->epc1, EP_CTX_MAX_BURST_SIZE_START,
+                                     EP_CTX_MAX_BURST_SIZE_BITS) + 1;
+    uint32_t packets = 1;
+    if (max_packet_size > 0 && length > max_packet_size) {
+        packets = (length + max_packet_size - 1) / max_packet_size;
+    }
+    uint32_t tbc = (packets + burst - 1) / burst - 1;
+    uint32_t tlbpc = (packets - 1) % burst;
+    return ((tbc << XFER_TRB_FRAME_TBC_START) &
+            XHCI_MASK(XFER_TRB_FRAME_TBC_START, XFER_TRB_FRAME_TBC_BITS)) |
+           ((tlbpc << XFER_TRB_TLBPC_START) &
+            XHCI_MASK(XFER_TRB_TLBPC_START, XFER_TRB_TLBPC_BITS));
+}
+
 // returns MX_OK if txn has been successfully queued,
 // MX_ERR_SHOULD_WAIT if we ran out of TRBs and need to try again later,
 // or other error for a hard failure.
@@ -242,7 +262,9 @@ static mx_status_t xhci_continue_transfer_locked(xhci_t* xhci, xhci_endpoint_t*
                 // schedule packet for specified frame
                 control_bits |= (((frame % 2048) << XFER_TRB_FRAME_ID_START) &
                                  XHCI_MASK(XFER_TRB_FRAME_ID_START, XFER_TRB_FRAME_ID_BITS));
-           }
+            }
+            // high bandwidth endpoints move the TD in several bursts per interval
+            control_bits |= xhci_isoch_burst_bits(ep, length);
             trb_set_control(trb, TRB_TRANSFER_ISOCH, control_bits);
         } else {
             trb_set_control(trb, TRB_TRANSFER_NORMAL, control_bits);
@@ -324,30 +346,32 @@ static mx_status_t xhci_continue_transfer_locked(xhci_t* xhci, xhci_endpoint_t*
         state->needs_data_event = false;
     }
 
-    // if we get here, then we are ready to ring the doorbell
+    // if we get here, then the whole transaction is on the ring.
     // update dequeue_ptr to TRB following this transaction
     txn->context = (void *)ring->current;
 
-    XHCI_WRITE32(&xhci->doorbells[proto_data->device_id], ep_index + 1);
-
     return MX_OK;
 }
 
+// Queues as many iotxns as the transfer ring has room for, then rings the
+// doorbell once for all of them.
 static void xhci_process_transactions_locked(xhci_t* xhci, xhci_endpoint_t* ep,
+                                             uint32_t slot_id, uint8_t ep_index,
                                              list_node_t* completed_txns) {
+    xhci_trb_t* start = ep->transfer_ring.current;
+
     // loop until we fill our transfer ring or run out of iotxns to process
     while (1) {
         if (xhci_transfer_ring_free_trbs(&ep->transfer_ring) == 0) {
             // no available TRBs - need to wait for some complete
-            return;
+            break;
         }
 
         while (!ep->current_txn) {
             // start the next transaction in the queue
             iotxn_t* txn = list_remove_head_type(&ep->queued_txns, iotxn_t, node);
             if (!txn) {
-                // nothing to do
-                return;
+                break;
             }
 
             mx_status_t status = xhci_start_transfer_locked(xhci, ep, txn);
@@ -360,22 +384,29 @@ static void xhci_process_transactions_locked(xhci_t* xhci, xhci_endpoint_t* ep,
                 list_add_tail(completed_txns, &txn->node);
             }
         }
+        if (!ep->current_txn) {
+            // nothing left to do
+            break;
+        }
 
-        if (ep->current_txn) {
-            iotxn_t* txn = ep->current_txn;
-            mx_status_t status = xhci_continue_transfer_locked(xhci, ep, txn);
-            if (status == MX_ERR_SHOULD_WAIT) {
-                // no available TRBs - need to wait for some complete
-                return;
-            } else {
-                if (status != MX_OK) {
-                    txn->status = status;
-                    txn->actual = 0;
-                    list_add_tail(completed_txns, &txn->node);
-                }
-                ep->current_txn = NULL;
-            }
+        iotxn_t* txn = ep->current_txn;
+        mx_status_t status = xhci_continue_transfer_locked(xhci, ep, txn);
+        if (status == MX_ERR_SHOULD_WAIT) {
+            // no available TRBs - need to wait for some complete
+            break;
+        }
+        if (status != MX_OK) {
+            txn->status = status;
+            txn->actual = 0;
+            list_add_tail(completed_txns, &txn->node);
         }
+        ep->current_txn = NULL;
+    }
+
+    // The controller stops at the first TRB it doesn't own, so a transaction
+    // that is only partly queued can start on what is there already.
+    if (ep->transfer_ring.current != start) {
+        XHCI_WRITE32(&xhci->doorbells[slot_id], ep_index + 1);
     }
 }
 
@@ -418,7 +449,7 @@ mx_status_t xhci_queue_transfer(xhci_t* xhci, iotxn_t* txn) {
 
     list_node_t completed_txns;
     list_initialize(&completed_txns);
-    xhci_process_transactions_locked(xhci, ep, &completed_txns);
+    xhci_process_transactions_locked(xhci, ep, slot_id, ep_index, &completed_txns);
 
     mtx_unlock(&ep->lock);
 
@@ -492,7 +523,7 @@ mx_status_t xhci_get_descriptor(xhci_t* xhci, uint32_t slot_id, uint8_t type, ui
                                 USB_REQ_GET_DESCRIPTOR, value, index, data, length);
 }
 
-void xhci_handle_transfer_event(xhci_t* xhci, xhci_trb_t* trb) {
+void xhci_handle_transfer_event(xhci_t* xhci, xhci_trb_t* trb, list_node_t* completed_txns) {
     xprintf("xhci_handle_transfer_event: %08X %08X %08X %08X\n",
             ((uint32_t*)trb)[0], ((uint32_t*)trb)[1], ((uint32_t*)trb)[2], ((uint32_t*)trb)[3]);
 
@@ -550,6 +581,16 @@ void xhci_handle_transfer_event(xhci_t* xhci, xhci_trb_t* trb) {
                 result = MX_ERR_IO;
             }
             break;
+        case TRB_CC_MISSED_SERVICE_ERROR:
+            // the isochronous TD's service interval passed before the controller
+            // got to it. the endpoint keeps running, so this only affects this txn.
+            xprintf("TRB_CC_MISSED_SERVICE_ERROR\n");
+            result = MX_ERR_IO_DATA_LOSS;
+            break;
+        case TRB_CC_ISOCH_BUFFER_OVERRUN:
+            // device sent more than the TD had room for
+            result = MX_ERR_IO_DATA_INTEGRITY;
+            break;
         case TRB_CC_RING_UNDERRUN:
             // non-fatal error that happens when no transfers are available for isochronous endpoint
             xprintf("TRB_CC_RING_UNDERRUN\n");
@@ -609,16 +650,16 @@ void xhci_handle_transfer_event(xhci_t* xhci, xhci_trb_t* trb) {
         txn->actual = result;
     }
 
-    list_node_t completed_txns;
-    list_initialize(&completed_txns);
-    list_add_head(&completed_txns, &txn->node);
+    list_add_tail(completed_txns, &txn->node);
 
-    xhci_process_transactions_locked(xhci, ep, &completed_txns);
+    xhci_process_transactions_locked(xhci, ep, slot_id, ep_index, completed_txns);
 
     mtx_unlock(&ep->lock);
+}
 
-    // call complete callbacks out of the lock
-    while ((txn = list_remove_head_type(&completed_txns, iotxn_t, node)) != NULL) {
+void xhci_complete_transfers(list_node_t* completed_txns) {
+    iotxn_t* txn;
+    while ((txn = list_remove_head_type(completed_txns, iotxn_t, node)) != NULL) {
         iotxn_complete(txn, txn->status, txn->actual);
     }
 }
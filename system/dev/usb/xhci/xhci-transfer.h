@@ -18,6 +18,10 @@ int xhci_control_request(xhci_t* xhci, uint32_t slot_id, uint8_t request_type, u
                          uint16_t value, uint16_t index, void* data, uint16_t length);
 mx_status_t xhci_get_descriptor(xhci_t* xhci, uint32_t slot_id, uint8_t type, uint16_t value,
                                 uint16_t index, void* data, uint16_t length);
-void xhci_handle_transfer_event(xhci_t* xhci, xhci_trb_t* trb);
+// Adds the iotxns that the event completes to |completed_txns|, for
+// xhci_complete_transfers() to complete once the caller is done with the
+// event ring.
+void xhci_handle_transfer_event(xhci_t* xhci, xhci_trb_t* trb, list_node_t* completed_txns);
+void xhci_complete_transfers(list_node_t* completed_txns);
 
 mx_status_t xhci_reset_endpoint(xhci_t* xhci, uint32_t slot_id, uint32_t endpoint);
@@ -401,6 +401,9 @@ static void xhci_interruptor_init(xhci_t* xhci, int interruptor) {
 
     xhci_update_erdp(xhci, interruptor);
 
+    // Events that come within XHCI_IMOD_INTERVAL of an interrupt wait for
+    // the next one, so that a burst of completions costs one wakeup.
+    XHCI_SET_BITS32(&intr_regs->imod, IMODI_START, IMODI_BITS, XHCI_IMOD_INTERVAL / 250);
     XHCI_SET32(&intr_regs->iman, IMAN_IE, IMAN_IE);
     XHCI_SET32(&intr_regs->erstsz, ERSTSZ_MASK, ERST_ARRAY_SIZE);
     XHCI_WRITE64(&intr_regs->erstba, xhci->erst_arrays_phys[interruptor]);
@@ -515,6 +518,9 @@ uint64_t xhci_get_current_frame(xhci_t* xhci) {
 
 static void xhci_handle_events(xhci_t* xhci, int interruptor) {
     xhci_event_ring_t* er = &xhci->event_rings[interruptor];
+    list_node_t completed_txns;
+    list_initialize(&completed_txns);
+    size_t handled = 0;
 
     // process all TRBs with cycle bit matching our CCS
     while ((XHCI_READ32(&er->current->control) & TRB_C) == er->ccs) {
@@ -527,7 +533,7 @@ static void xhci_handle_events(xhci_t* xhci, int interruptor) {
             // ignore, these are dealt with in xhci_handle_interrupt() below
             break;
         case TRB_EVENT_TRANSFER:
-            xhci_handle_transfer_event(xhci, er->current);
+            xhci_handle_transfer_event(xhci, er->current, &completed_txns);
             break;
         case TRB_EVENT_MFINDEX_WRAP:
             xhci_handle_mfindex_wrap(xhci);
@@ -542,8 +548,16 @@ static void xhci_handle_events(xhci_t* xhci, int interruptor) {
             er->current = er->start;
             er->ccs ^= TRB_C;
         }
-        xhci_update_erdp(xhci, interruptor);
+        // The dequeue pointer only needs to move often enough that the
+        // controller never sees the ring as full.
+        if (++handled % XHCI_ERDP_BATCH == 0) {
+            xhci_update_erdp(xhci, interruptor);
+        }
     }
+    xhci_update_erdp(xhci, interruptor);
+
+    // call complete callbacks for the whole batch, off the event ring
+    xhci_complete_transfers(&completed_txns);
 }
 
 void xhci_handle_interrupt(xhci_t* xhci, bool legacy) {
@@ -27,6 +27,11 @@
 #define EVENT_RING_SIZE (PAGE_SIZE / sizeof(xhci_trb_t))
 #define ERST_ARRAY_SIZE 1
 
+// minimum time between interrupts, in nanoseconds
+#define XHCI_IMOD_INTERVAL 40000
+// events handled between updates of the event ring dequeue pointer
+#define XHCI_ERDP_BATCH (EVENT_RING_SIZE / 4)
+
 #define XHCI_RH_USB_2 0 // index of USB 2.0 virtual root hub device
 #define XHCI_RH_USB_3 1 // index of USB 2.0 virtual root hub device
 #define XHCI_RH_COUNT 2 // number of virtual root hub devices
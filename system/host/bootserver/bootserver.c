@@ -26,15 +26,17 @@
 
 #include <magenta/boot/netboot.h>
 
+#include "bootserver.h"
+
 #define DEFAULT_US_BETWEEN_PACKETS 20
 
 static uint32_t cookie = 1;
-static char* appname;
+char* appname;
 static struct in6_addr allowed_addr;
 static const char spinner[] = {'|', '/', '-', '\\'};
 static const int MAX_READ_RETRIES = 10;
 static const int MAX_SEND_RETRIES = 10000;
-static int64_t us_between_packets = DEFAULT_US_BETWEEN_PACKETS;
+int64_t us_between_packets = DEFAULT_US_BETWEEN_PACKETS;
 
 static int io_rcv(int s, nbmsg* msg, nbmsg* ack) {
     for (int i = 0; i < MAX_READ_RETRIES; i++) {
@@ -190,6 +192,47 @@ static int io(int s, nbmsg* msg, size_t len, nbmsg* ack, bool wait_reply) {
     return -1;
 }
 
+static int send_boot_command(int s) {
+    char msgbuf[2048];
+    char ackbuf[2048];
+    nbmsg* msg = (void*)msgbuf;
+    nbmsg* ack = (void*)ackbuf;
+
+    msg->cmd = NB_BOOT;
+    msg->arg = 0;
+    if (io(s, msg, sizeof(nbmsg), ack, true)) {
+        fprintf(stderr, "\n%s: error: Failed to send boot command\n", appname);
+        return -1;
+    }
+    fprintf(stderr, "\n%s: sent boot command\n", appname);
+    return 0;
+}
+
+// Sends the boot command to a bootloader that took its images by TFTP.
+static int boot(struct sockaddr_in6* addr) {
+    char tmp[INET6_ADDRSTRLEN];
+    struct timeval tv;
+    int s, r;
+
+    if ((s = socket(AF_INET6, SOCK_DGRAM, IPPROTO_UDP)) < 0) {
+        fprintf(stderr, "%s: error: Cannot create socket %d\n", appname, errno);
+        return -1;
+    }
+    tv.tv_sec = 0;
+    tv.tv_usec = 250 * 1000;
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (connect(s, (void*)addr, sizeof(*addr)) < 0) {
+        fprintf(stderr, "%s: error: Cannot connect to [%s]%d\n", appname,
+                inet_ntop(AF_INET6, &addr->sin6_addr, tmp, sizeof(tmp)),
+                ntohs(addr->sin6_port));
+        close(s);
+        return -1;
+    }
+    r = send_boot_command(s);
+    close(s);
+    return r;
+}
+
 typedef struct {
     FILE* fp;
     const char* data;
@@ -381,13 +424,7 @@ static int xfer(struct sockaddr_in6* addr, const char* fn, const char* name, boo
     status = 0;
 
     if (boot) {
-        msg->cmd = NB_BOOT;
-        msg->arg = 0;
-        if (io(s, msg, sizeof(nbmsg), ack, true)) {
-            fprintf(stderr, "\n%s: error: Failed to send boot command\n", appname);
-        } else {
-            fprintf(stderr, "\n%s: sent boot command\n", appname);
-        }
+        send_boot_command(s);
     } else {
         fprintf(stderr, "\n");
     }
@@ -418,7 +455,9 @@ void usage(void) {
             "  -a      only boot device with this IPv6 address\n"
             "  -i <NN> number of microseconds between packets\n"
             "          set between 50-500 to deal with poor bootloader network stacks (default=%d)\n"
-            "  -n      only boot device with this nodename\n",
+            "  -n      only boot device with this nodename\n"
+            "  --no-tftp\n"
+            "          use the netboot protocol even if the device advertises TFTP\n",
             appname, DEFAULT_US_BETWEEN_PACKETS);
     exit(1);
 }
@@ -442,6 +481,7 @@ int main(int argc, char** argv) {
     const char* kernel_fn = NULL;
     const char* ramdisk_fn = NULL;
     int once = 0;
+    bool use_tftp = true;
     int status;
 
     cmdline[0] = 0;
@@ -462,6 +502,8 @@ int main(int argc, char** argv) {
             }
         } else if (!strcmp(argv[1], "-1")) {
             once = 1;
+        } else if (!strcmp(argv[1], "--no-tftp")) {
+            use_tftp = false;
         } else if (!strcmp(argv[1], "-i")) {
             if (argc <= 1) {
                 fprintf(stderr, "'-i' option requires an argument (micros between packets)\n");
@@ -612,11 +654,14 @@ int main(int argc, char** argv) {
         char* save = NULL;
         char* adv_nodename = NULL;
         char* adv_version = "unknown";
+        int adv_tftp_port = 0;
         for (char* var = strtok_r((char*)msg->data, ";", &save); var; var = strtok_r(NULL, ";", &save)) {
             if (!strncmp(var, "nodename=", 9)) {
                 adv_nodename = var + 9;
             } else if(!strncmp(var, "version=", 8)) {
                 adv_version = var + 8;
+            } else if (!strncmp(var, "tftp=", 5)) {
+                adv_tftp_port = atoi(var + 5);
             }
         }
 
@@ -639,21 +684,46 @@ int main(int argc, char** argv) {
                     appname, appname, adv_version, BOOTLOADER_VERSION, appname);
         }
 
-        if (cmdline[0]) {
-            status = xfer(&ra, "(cmdline)", cmdline, false);
+        if (use_tftp && (adv_tftp_port > 0) && (adv_tftp_port <= 0xffff)) {
+            // Windowed transfers of large blocks, all on the one port.
+            struct sockaddr_in6 tftp_addr = ra;
+            tftp_addr.sin6_port = htons(adv_tftp_port);
+            if (cmdline[0]) {
+                status = tftp_xfer(&tftp_addr, "(cmdline)", cmdline);
+            } else {
+                status = 0;
+            }
+            if (status == 0) {
+                struct stat s;
+                if (ramdisk_fn) {
+                    status = tftp_xfer(&tftp_addr, ramdisk_fn, "ramdisk.bin");
+                } else if (auto_ramdisk_fn && (stat(auto_ramdisk_fn, &s) == 0)) {
+                    status = tftp_xfer(&tftp_addr, auto_ramdisk_fn, "ramdisk.bin");
+                }
+            }
+            if (status == 0) {
+                status = tftp_xfer(&tftp_addr, kernel_fn, "kernel.bin");
+            }
+            if (status == 0) {
+                boot(&ra);
+            }
         } else {
-            status = 0;
-        }
-        if (status == 0) {
-            struct stat s;
-            if (ramdisk_fn) {
-                status = xfer(&ra, ramdisk_fn, "ramdisk.bin", false);
-            } else if (auto_ramdisk_fn && (stat(auto_ramdisk_fn, &s) == 0)) {
-                status = xfer(&ra, auto_ramdisk_fn, "ramdisk.bin", false);
+            if (cmdline[0]) {
+                status = xfer(&ra, "(cmdline)", cmdline, false);
+            } else {
+                status = 0;
+            }
+            if (status == 0) {
+                struct stat s;
+                if (ramdisk_fn) {
+                    status = xfer(&ra, ramdisk_fn, "ramdisk.bin", false);
+                } else if (auto_ramdisk_fn && (stat(auto_ramdisk_fn, &s) == 0)) {
+                    status = xfer(&ra, auto_ramdisk_fn, "ramdisk.bin", false);
+                }
+            }
+            if (status == 0) {
+                xfer(&ra, kernel_fn, "kernel.bin", true);
             }
-        }
-        if (status == 0) {
-            xfer(&ra, kernel_fn, "kernel.bin", true);
         }
         if (once) {
             break;
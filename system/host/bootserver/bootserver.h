@@ -0,0 +1,15 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <netinet/in.h>
+#include <stdint.h>
+
+extern char* appname;
+extern int64_t us_between_packets;
+
+// Send the file |fn| to the TFTP server at |addr| as |name|. If |fn| is
+// "(cmdline)", |name| is the data to send instead, as the file "cmdline".
+int tftp_xfer(struct sockaddr_in6* addr, const char* fn, const char* name);
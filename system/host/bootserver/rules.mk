@@ -8,6 +8,10 @@ MODULE := $(LOCAL_DIR)
 
 MODULE_TYPE := hostapp
 
-MODULE_SRCS += $(LOCAL_DIR)/bootserver.c
+MODULE_SRCS += \
+    $(LOCAL_DIR)/bootserver.c \
+    $(LOCAL_DIR)/tftp.c
+
+MODULE_HOST_LIBS := system/ulib/tftp
 
 include make/module.mk
@@ -0,0 +1,242 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE
+#define _DARWIN_C_SOURCE
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <magenta/boot/netboot.h>
+#include <tftp/tftp.h>
+
+#include "bootserver.h"
+
+#define SCRATCHSZ 2048
+
+typedef struct {
+    int fd;
+    // With no file, the data to send.
+    const char* data;
+    size_t datalen;
+    // The furthest read so far, for the progress display.
+    size_t sent;
+} tftp_file;
+
+static tftp_status read_file(void* data, size_t* length, off_t offset, void* cookie) {
+    tftp_file* f = cookie;
+    if (f->fd < 0) {
+        if ((size_t)offset > f->datalen) {
+            return TFTP_ERR_INVALID_ARGS;
+        }
+        if (*length > f->datalen - offset) {
+            *length = f->datalen - offset;
+        }
+        memcpy(data, f->data + offset, *length);
+    } else {
+        ssize_t n = pread(f->fd, data, *length, offset);
+        if (n < 0) {
+            fprintf(stderr, "\n%s: error: Reading at offset %lld: %d\n", appname,
+                    (long long)offset, errno);
+            return TFTP_ERR_IO;
+        }
+        *length = n;
+    }
+    if (offset + *length > f->sent) {
+        f->sent = offset + *length;
+    }
+    return TFTP_NO_ERROR;
+}
+
+static int send_msg(int s, const void* data, size_t len) {
+    for (;;) {
+        if (write(s, data, len) >= 0) {
+            return 0;
+        }
+        if (errno != ENOBUFS) {
+            fprintf(stderr, "\n%s: error: Socket write error %d\n", appname, errno);
+            return -1;
+        }
+        // The host stack is briefly out of buffers; let it drain.
+        struct timespec reqtime;
+        reqtime.tv_sec = 0;
+        reqtime.tv_nsec = 50 * 1000;
+        nanosleep(&reqtime, NULL);
+    }
+}
+
+// Returns 1 once |s| is readable, or 0 if |timeout_ms| passes first.
+static int wait_readable(int s, uint32_t timeout_ms) {
+    fd_set reads;
+    FD_ZERO(&reads);
+    FD_SET(s, &reads);
+    struct timeval tv;
+    tv.tv_sec = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+    int rv = select(s + 1, &reads, NULL, NULL, &tv);
+    if (rv < 0) {
+        fprintf(stderr, "\n%s: error: Select failed %d\n", appname, errno);
+    }
+    return rv;
+}
+
+static int64_t us_since(const struct timeval* begin) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (int64_t)(now.tv_sec - begin->tv_sec) * 1000000 +
+           ((int64_t)now.tv_usec - (int64_t)begin->tv_usec);
+}
+
+static void show_progress(const tftp_file* f, const struct timeval* begin) {
+    int64_t us = us_since(begin);
+    fprintf(stderr, "\33[2K\r");
+    if (f->datalen > 0) {
+        fprintf(stderr, "%.01f%%", 100.0 * (float)f->sent / (float)f->datalen);
+    }
+    if (us >= 1000000) {
+        fprintf(stderr, " %.01fMB/s", (float)f->sent / (1024.0 * 1024.0) / ((float)us / 1000000.0));
+    }
+}
+
+int tftp_xfer(struct sockaddr_in6* addr, const char* fn, const char* name) {
+    char out[SCRATCHSZ];
+    char in[SCRATCHSZ];
+    char tmp[INET6_ADDRSTRLEN];
+    struct timeval begin, last_update;
+    tftp_file f = { .fd = -1 };
+    tftp_session* session;
+    void* session_data = NULL;
+    size_t outlen;
+    uint32_t timeout_ms;
+    tftp_status ret;
+    int s = -1;
+    int status = -1;
+
+    if (!strcmp(fn, "(cmdline)")) {
+        f.data = name;
+        f.datalen = strlen(name) + 1;
+        name = "cmdline";
+    } else {
+        struct stat st;
+        if ((f.fd = open(fn, O_RDONLY)) < 0) {
+            fprintf(stderr, "%s: error: Could not open file %s\n", appname, fn);
+            return -1;
+        }
+        if (fstat(f.fd, &st) < 0) {
+            fprintf(stderr, "%s: error: Could not determine size of %s\n", appname, fn);
+            goto done;
+        }
+        f.datalen = st.st_size;
+    }
+
+    if ((session_data = malloc(tftp_sizeof_session())) == NULL ||
+        tftp_init(&session, session_data, tftp_sizeof_session()) != TFTP_NO_ERROR) {
+        fprintf(stderr, "%s: error: Could not start a tftp session\n", appname);
+        goto done;
+    }
+    tftp_session_set_read_cb(session, read_file);
+
+    if ((s = socket(AF_INET6, SOCK_DGRAM, IPPROTO_UDP)) < 0) {
+        fprintf(stderr, "%s: error: Cannot create socket %d\n", appname, errno);
+        goto done;
+    }
+    if (connect(s, (void*)addr, sizeof(*addr)) < 0) {
+        fprintf(stderr, "%s: error: Cannot connect to [%s]%d\n", appname,
+                inet_ntop(AF_INET6, &addr->sin6_addr, tmp, sizeof(tmp)),
+                ntohs(addr->sin6_port));
+        goto done;
+    }
+    fprintf(stderr, "%s: sending '%s' by tftp...\n", appname, fn);
+    gettimeofday(&begin, NULL);
+    last_update = begin;
+
+    outlen = sizeof(out);
+    ret = tftp_generate_write_request(session, name, MODE_OCTET, f.datalen,
+                                      NB_TFTP_BLOCK_SIZE, 0, NB_TFTP_WINDOW_SIZE,
+                                      out, &outlen, &timeout_ms);
+    if (ret < 0) {
+        fprintf(stderr, "%s: error: Could not generate write request\n", appname);
+        goto done;
+    }
+    if (send_msg(s, out, outlen)) {
+        goto done;
+    }
+
+    for (;;) {
+        // While a window is going out, only stop for a reply if one is
+        // already waiting; otherwise wait as long as the session says.
+        bool pending = tftp_session_has_pending(session);
+        int r = wait_readable(s, pending ? 0 : timeout_ms);
+        if (r < 0) {
+            goto done;
+        }
+
+        outlen = sizeof(out);
+        if (r > 0) {
+            ssize_t n = read(s, in, sizeof(in));
+            if (n < 0) {
+                fprintf(stderr, "\n%s: error: Socket read error %d\n", appname, errno);
+                goto done;
+            }
+            ret = tftp_handle_msg(session, in, n, out, &outlen, &timeout_ms, &f);
+        } else if (pending) {
+            // Some netstacks lose back-to-back packets at full speed; keep
+            // the same spacing as the netboot protocol.
+            struct timeval packet_start_time;
+            gettimeofday(&packet_start_time, NULL);
+            while (us_since(&packet_start_time) < us_between_packets)
+                ;
+            ret = tftp_prepare_data(session, out, &outlen, &timeout_ms, &f);
+        } else {
+            ret = tftp_timeout(session, out, &outlen, &timeout_ms, &f);
+        }
+
+        if (outlen > 0 && send_msg(s, out, outlen)) {
+            goto done;
+        }
+        if (ret == TFTP_TRANSFER_COMPLETED) {
+            break;
+        }
+        if (ret == TFTP_ERR_TIMED_OUT) {
+            fprintf(stderr, "\n%s: error: Timed out sending '%s'\n", appname, fn);
+            goto done;
+        }
+        if (ret < 0) {
+            fprintf(stderr, "\n%s: error: Transfer of '%s' failed (%d)\n", appname, fn, ret);
+            goto done;
+        }
+        if (us_since(&last_update) >= 250000) {
+            show_progress(&f, &begin);
+            gettimeofday(&last_update, NULL);
+        }
+    }
+    f.sent = f.datalen;
+    show_progress(&f, &begin);
+    fprintf(stderr, "\n");
+    status = 0;
+
+done:
+    if (s >= 0) {
+        close(s);
+    }
+    if (f.fd >= 0) {
+        close(f.fd);
+    }
+    free(session_data);
+    return status;
+}
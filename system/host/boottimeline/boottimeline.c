@@ -0,0 +1,190 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Lays out the boot timeline from a ktrace file: every KTRACE_BOOT_PREFIX
+// probe record, oldest first, as when it started and how long it took from
+// boot, in milliseconds, with a bar to show where it fell:
+//
+//     start   length  stage
+//    12.301    4.522  init:vm  |  ##                    |
+//
+// With -j it writes them as Chrome trace events instead.
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <magenta/ktrace.h>
+
+#define BAR_WIDTH 50
+
+typedef struct {
+    uint64_t start_us;
+    uint32_t length_us;
+    uint32_t detail;
+    uint32_t tid;
+    uint32_t probe;
+} stage_t;
+
+// the names of probes, by number
+static char* probe_names[0x800];
+
+static stage_t* stages;
+static size_t num_stages;
+static size_t max_stages;
+
+static int add_stage(const stage_t* stage) {
+    if (num_stages == max_stages) {
+        size_t n = max_stages ? max_stages * 2 : 1024;
+        stage_t* p = realloc(stages, n * sizeof(*stages));
+        if (!p)
+            return -1;
+        stages = p;
+        max_stages = n;
+    }
+    stages[num_stages++] = *stage;
+    return 0;
+}
+
+static int compare_stages(const void* a, const void* b) {
+    const stage_t* x = a;
+    const stage_t* y = b;
+    if (x->start_us != y->start_us)
+        return x->start_us < y->start_us ? -1 : 1;
+    // the longer of two that start together holds the other
+    return x->length_us > y->length_us ? -1 : x->length_us < y->length_us;
+}
+
+static const char* stage_name(const stage_t* stage) {
+    return probe_names[stage->probe] + strlen(KTRACE_BOOT_PREFIX);
+}
+
+// Probe records may come before the name of their probe, so they're all
+// kept as they're read, and those that aren't boot stages dropped after.
+static int read_trace(FILE* f) {
+    uint64_t ticks_per_ms = 0;
+    uint8_t rec[256];
+    while (fread(rec, KTRACE_HDRSIZE / 2, 1, f) == 1) {
+        uint32_t tag = *(uint32_t*)rec;
+        size_t len = KTRACE_LEN(tag);
+        if (len < KTRACE_HDRSIZE / 2) {
+            fprintf(stderr, "bad record, tag %#x\n", tag);
+            return -1;
+        }
+        if (len > KTRACE_HDRSIZE / 2 &&
+            fread(rec + KTRACE_HDRSIZE / 2, len - KTRACE_HDRSIZE / 2, 1, f) != 1) {
+            fprintf(stderr, "trace is cut short\n");
+            return -1;
+        }
+
+        if (tag == TAG_TICKS_PER_MS) {
+            const ktrace_rec_32b_t* r = (const void*)rec;
+            ticks_per_ms = r->a | ((uint64_t)r->b << 32);
+        } else if (KTRACE_EVENT(tag) == KTRACE_EVENT(TAG_PROBE_NAME)) {
+            const ktrace_rec_name_t* r = (const void*)rec;
+            size_t max = len - KTRACE_NAMESIZE;
+            if (r->id < 0x800 && probe_names[r->id] == NULL)
+                probe_names[r->id] = strndup(r->name, max);
+        } else if ((KTRACE_EVENT(tag) & 0x800) && len >= 24) {
+            const ktrace_header_t* hdr = (const void*)rec;
+            const uint32_t* args = (const uint32_t*)(hdr + 1);
+            if (ticks_per_ms == 0) {
+                fprintf(stderr, "no clock rate before the first probe\n");
+                return -1;
+            }
+            uint64_t end_us = hdr->ts * 1000 / ticks_per_ms;
+            stage_t stage = {
+                .start_us = end_us > args[0] ? end_us - args[0] : 0,
+                .length_us = args[0],
+                .detail = args[1],
+                .tid = hdr->tid,
+                .probe = KTRACE_EVENT(tag) & 0x7FF,
+            };
+            if (add_stage(&stage) < 0)
+                return -1;
+        }
+    }
+
+    size_t n = 0;
+    for (size_t i = 0; i < num_stages; i++) {
+        const char* name = probe_names[stages[i].probe];
+        if (name && !strncmp(name, KTRACE_BOOT_PREFIX, strlen(KTRACE_BOOT_PREFIX)))
+            stages[n++] = stages[i];
+    }
+    num_stages = n;
+    qsort(stages, num_stages, sizeof(*stages), compare_stages);
+    return 0;
+}
+
+static void print_text(void) {
+    if (num_stages == 0)
+        return;
+    uint64_t first = stages[0].start_us;
+    uint64_t last = first + 1;
+    for (size_t i = 0; i < num_stages; i++) {
+        uint64_t end = stages[i].start_us + stages[i].length_us;
+        if (end > last)
+            last = end;
+    }
+
+    printf("%10s %10s  %s\n", "start", "length", "stage");
+    for (size_t i = 0; i < num_stages; i++) {
+        const stage_t* s = &stages[i];
+        char bar[BAR_WIDTH + 1];
+        size_t from = (s->start_us - first) * BAR_WIDTH / (last - first);
+        size_t to = (s->start_us + s->length_us - first) * BAR_WIDTH / (last - first);
+        for (size_t c = 0; c < BAR_WIDTH; c++)
+            bar[c] = (c >= from && (c < to || c == from)) ? '#' : ' ';
+        bar[BAR_WIDTH] = 0;
+        printf("%10.3f %10.3f  %-32s |%s|", s->start_us / 1000.0, s->length_us / 1000.0,
+               stage_name(s), bar);
+        if (s->detail != 0)
+            printf(" %d", (int32_t)s->detail);
+        printf("\n");
+    }
+}
+
+static void print_json(void) {
+    printf("[");
+    for (size_t i = 0; i < num_stages; i++) {
+        const stage_t* s = &stages[i];
+        printf("%s\n {\"name\": \"%s\", \"ph\": \"X\", \"pid\": 0, \"tid\": %u, "
+               "\"ts\": %" PRIu64 ", \"dur\": %u, \"args\": {\"detail\": %d}}",
+               i ? "," : "", stage_name(s), s->tid, s->start_us, s->length_us,
+               (int32_t)s->detail);
+    }
+    printf("\n]\n");
+}
+
+int main(int argc, char** argv) {
+    bool json = false;
+    if (argc == 3 && !strcmp(argv[1], "-j")) {
+        json = true;
+        argv++;
+        argc--;
+    }
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s [-j] <ktrace file>\n", argv[0]);
+        return -1;
+    }
+
+    FILE* f = fopen(argv[1], "rb");
+    if (!f) {
+        fprintf(stderr, "cannot open %s\n", argv[1]);
+        return -1;
+    }
+    int r = read_trace(f);
+    fclose(f);
+    if (r < 0)
+        return -1;
+
+    if (json) {
+        print_json();
+    } else {
+        print_text();
+    }
+    return 0;
+}
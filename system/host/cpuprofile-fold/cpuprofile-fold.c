@@ -0,0 +1,109 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Turns a file written by the cpuprofile app into folded stacks, one line
+// per distinct stack with the number of times it was sampled:
+//
+//   pid 1234;tid 5678;0xcaller;0xsampled-pc 42
+//
+// which is the input flamegraph.pl expects.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <magenta/device/cpu-profile.h>
+
+// "0x" plus 16 hex digits plus ';', per pc, and the pid and tid.
+#define MAX_LINE (64 + MX_CPU_PROFILE_MAX_PCS * 19)
+
+static char** lines;
+static size_t num_lines;
+static size_t max_lines;
+
+static int add_line(const char* line) {
+    if (num_lines == max_lines) {
+        size_t n = max_lines ? max_lines * 2 : 4096;
+        char** p = realloc(lines, n * sizeof(*lines));
+        if (!p)
+            return -1;
+        lines = p;
+        max_lines = n;
+    }
+    if (!(lines[num_lines] = strdup(line)))
+        return -1;
+    num_lines++;
+    return 0;
+}
+
+static int fold_sample(const mx_cpu_profile_sample_t* sample, const uint64_t* pcs) {
+    char line[MAX_LINE];
+    int len = snprintf(line, sizeof(line), "pid %" PRIu64 ";tid %" PRIu64,
+                       sample->pid, sample->tid);
+    // Callers come first in a folded stack, the sampled pc last.
+    for (uint32_t i = sample->num_pcs; i-- > 0;)
+        len += snprintf(line + len, sizeof(line) - len, ";%#" PRIx64, pcs[i]);
+    return add_line(line);
+}
+
+static int fold_cpu(const uint8_t* samples, uint64_t size) {
+    uint64_t offset = 0;
+    while (offset + sizeof(mx_cpu_profile_sample_t) <= size) {
+        const mx_cpu_profile_sample_t* sample = (const void*)(samples + offset);
+        if (sample->num_pcs == 0 || sample->num_pcs > MX_CPU_PROFILE_MAX_PCS)
+            return -1;
+        uint64_t len = sizeof(*sample) + sample->num_pcs * sizeof(uint64_t);
+        if (offset + len > size)
+            return -1;
+        if (fold_sample(sample, (const uint64_t*)(sample + 1)) < 0)
+            return -1;
+        offset += len;
+    }
+    return offset == size ? 0 : -1;
+}
+
+static int compare_lines(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <profile>\n", argv[0]);
+        return -1;
+    }
+
+    FILE* f = fopen(argv[1], "rb");
+    if (!f) {
+        fprintf(stderr, "cannot open %s\n", argv[1]);
+        return -1;
+    }
+
+    uint64_t dropped = 0;
+    mx_cpu_profile_header_t header;
+    while (fread(&header, sizeof(header), 1, f) == 1) {
+        uint8_t* samples = malloc(header.size ? header.size : 1);
+        if (!samples || fread(samples, 1, header.size, f) != header.size ||
+            fold_cpu(samples, header.size) < 0) {
+            fprintf(stderr, "%s is not a cpu profile\n", argv[1]);
+            return -1;
+        }
+        free(samples);
+        dropped += header.dropped;
+    }
+    fclose(f);
+
+    qsort(lines, num_lines, sizeof(*lines), compare_lines);
+    for (size_t i = 0; i < num_lines;) {
+        size_t j = i + 1;
+        while (j < num_lines && !strcmp(lines[i], lines[j]))
+            j++;
+        printf("%s %zu\n", lines[i], j - i);
+        i = j;
+    }
+
+    if (dropped)
+        fprintf(stderr, "%" PRIu64 " samples were dropped\n", dropped);
+    return 0;
+}
@@ -32,55 +32,100 @@ struct CompoundIdentifier {
 };
 
 struct Literal {
+    enum struct Kind {
+        String,
+        Numeric,
+        True,
+        False,
+        Default,
+    };
+
+    explicit Literal(Kind kind)
+        : kind(kind) {}
+    virtual ~Literal() {}
+
+    const Kind kind;
 };
 
 struct StringLiteral : public Literal {
     StringLiteral(Token literal)
-        : literal(literal) {}
+        : Literal(Kind::String), literal(literal) {}
 
     Token literal;
 };
 
 struct NumericLiteral : public Literal {
     NumericLiteral(Token literal)
-        : literal(literal) {}
+        : Literal(Kind::Numeric), literal(literal) {}
 
     Token literal;
 };
 
 struct TrueLiteral : public Literal {
+    TrueLiteral()
+        : Literal(Kind::True) {}
 };
 
 struct FalseLiteral : public Literal {
+    FalseLiteral()
+        : Literal(Kind::False) {}
 };
 
 struct DefaultLiteral : public Literal {
+    DefaultLiteral()
+        : Literal(Kind::Default) {}
 };
 
 struct Constant {
+    enum struct Kind {
+        Identifier,
+        Literal,
+    };
+
+    explicit Constant(Kind kind)
+        : kind(kind) {}
+    virtual ~Constant() {}
+
+    const Kind kind;
 };
 
 struct IdentifierConstant : Constant {
     IdentifierConstant(std::unique_ptr<CompoundIdentifier> identifier)
-        : identifier(std::move(identifier)) {}
+        : Constant(Kind::Identifier), identifier(std::move(identifier)) {}
 
     std::unique_ptr<CompoundIdentifier> identifier;
 };
 
 struct LiteralConstant : Constant {
     LiteralConstant(std::unique_ptr<Literal> literal)
-        : literal(std::move(literal)) {}
+        : Constant(Kind::Literal), literal(std::move(literal)) {}
 
     std::unique_ptr<Literal> literal;
 };
 
 struct Type {
+    enum struct Kind {
+        Array,
+        Vector,
+        String,
+        Handle,
+        Request,
+        Identifier,
+        Primitive,
+    };
+
+    explicit Type(Kind kind)
+        : kind(kind) {}
+    virtual ~Type() {}
+
+    const Kind kind;
 };
 
 struct ArrayType : public Type {
     ArrayType(std::unique_ptr<Type> element_type,
               std::unique_ptr<Constant> element_count)
-        : element_type(std::move(element_type)),
+        : Type(Kind::Array),
+          element_type(std::move(element_type)),
           element_count(std::move(element_count)) {}
 
     std::unique_ptr<Type> element_type;
@@ -91,7 +136,8 @@ struct VectorType : public Type {
     VectorType(std::unique_ptr<Type> element_type,
                std::unique_ptr<Constant> maybe_element_count,
                Nullability nullability)
-        : element_type(std::move(element_type)),
+        : Type(Kind::Vector),
+          element_type(std::move(element_type)),
           maybe_element_count(std::move(maybe_element_count)),
           nullability(nullability) {}
 
@@ -103,7 +149,8 @@ struct VectorType : public Type {
 struct StringType : public Type {
     StringType(std::unique_ptr<Constant> maybe_element_count,
                Nullability nullability)
-        : maybe_element_count(std::move(maybe_element_count)),
+        : Type(Kind::String),
+          maybe_element_count(std::move(maybe_element_count)),
           nullability(nullability) {}
 
     std::unique_ptr<Constant> maybe_element_count;
@@ -135,7 +182,8 @@ struct HandleType : public Type {
     };
 
     HandleType(Subtype subtype, Nullability nullability)
-        : subtype(subtype),
+        : Type(Kind::Handle),
+          subtype(subtype),
           nullability(nullability) {}
 
     Subtype subtype;
@@ -145,7 +193,8 @@ struct HandleType : public Type {
 struct RequestType : public Type {
     RequestType(std::unique_ptr<CompoundIdentifier> subtype,
                 Nullability nullability)
-        : subtype(std::move(subtype)),
+        : Type(Kind::Request),
+          subtype(std::move(subtype)),
           nullability(nullability) {}
 
     std::unique_ptr<CompoundIdentifier> subtype;
@@ -155,7 +204,8 @@ struct RequestType : public Type {
 struct IdentifierType : public Type {
     IdentifierType(std::unique_ptr<CompoundIdentifier> identifier,
                    Nullability nullability)
-        : identifier(std::move(identifier)),
+        : Type(Kind::Identifier),
+          identifier(std::move(identifier)),
           nullability(nullability) {}
 
     std::unique_ptr<CompoundIdentifier> identifier;
@@ -178,7 +228,7 @@ struct PrimitiveType : public Type {
     };
 
     PrimitiveType(TypeKind type_kind)
-        : type_kind(type_kind) {}
+        : Type(Kind::Primitive), type_kind(type_kind) {}
 
     TypeKind type_kind;
 };
@@ -207,18 +257,28 @@ struct ConstDeclaration {
 };
 
 struct EnumMemberValue {
+    enum struct Kind {
+        Identifier,
+        Numeric,
+    };
+
+    explicit EnumMemberValue(Kind kind)
+        : kind(kind) {}
+    virtual ~EnumMemberValue() {}
+
+    const Kind kind;
 };
 
 struct EnumMemberValueIdentifier : public EnumMemberValue {
     EnumMemberValueIdentifier(std::unique_ptr<CompoundIdentifier> identifier)
-        : identifier(std::move(identifier)) {}
+        : EnumMemberValue(Kind::Identifier), identifier(std::move(identifier)) {}
 
     std::unique_ptr<CompoundIdentifier> identifier;
 };
 
 struct EnumMemberValueNumeric : public EnumMemberValue {
     EnumMemberValueNumeric(std::unique_ptr<NumericLiteral> literal)
-        : literal(std::move(literal)) {}
+        : EnumMemberValue(Kind::Numeric), literal(std::move(literal)) {}
 
     std::unique_ptr<NumericLiteral> literal;
 };
@@ -0,0 +1,1380 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "c_generator.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace fidl {
+namespace {
+
+// Bounds that aren't known, or don't exist, saturate to this.
+constexpr uint64_t kUnbounded = UINT64_MAX;
+
+// MX_CHANNEL_MAX_MSG_BYTES and MX_CHANNEL_MAX_MSG_HANDLES.
+constexpr uint64_t kMaxMessageBytes = 65536;
+constexpr uint64_t kMaxMessageHandles = 64;
+
+constexpr uint64_t kAlignment = 8;
+
+uint64_t SatAdd(uint64_t a, uint64_t b) {
+    return (a > kUnbounded - b) ? kUnbounded : a + b;
+}
+
+uint64_t SatMul(uint64_t a, uint64_t b) {
+    if (a == 0 || b == 0)
+        return 0;
+    return (a > kUnbounded / b) ? kUnbounded : a * b;
+}
+
+uint64_t AlignTo(uint64_t value, uint64_t alignment) {
+    if (value > kUnbounded - (alignment - 1))
+        return kUnbounded;
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+std::string Str(StringView view) {
+    return std::string(view.data(), view.size());
+}
+
+std::string Name(const Identifier& identifier) {
+    return Str(identifier.identifier.data());
+}
+
+std::vector<std::string> Names(const CompoundIdentifier& identifier) {
+    std::vector<std::string> names;
+    for (const auto& component : identifier.components)
+        names.push_back(Name(*component));
+    return names;
+}
+
+std::string Join(const std::vector<std::string>& names, const char* separator) {
+    std::string joined;
+    for (const auto& name : names) {
+        if (!joined.empty())
+            joined += separator;
+        joined += name;
+    }
+    return joined;
+}
+
+std::string Bound(uint64_t bound) {
+    if (bound == kUnbounded)
+        return "UINT64_MAX";
+    return std::to_string(bound);
+}
+
+struct Aggregate;
+
+// A FIDL type as it is laid out in C.
+struct CType {
+    enum struct Kind {
+        Primitive,
+        Bool,
+        Header,
+        Handle,
+        String,
+        Vector,
+        Array,
+        Aggregate,
+        Pointer,
+    };
+
+    explicit CType(Kind kind)
+        : kind(kind) {}
+
+    Kind kind;
+    // The C spelling of the type, other than for arrays, which are spelled
+    // as their element with a suffix.
+    std::string spelling;
+    // Only for the primitive, bool, header and handle kinds.
+    uint64_t size = 0;
+    uint64_t alignment = 1;
+    // How many elements an array has, or how many at most a vector has, or
+    // a string has bytes.
+    uint64_t count = kUnbounded;
+    bool nullable = false;
+    std::unique_ptr<CType> element;
+    // The struct or union an aggregate is, or a pointer points to.
+    Aggregate* aggregate = nullptr;
+};
+
+struct Field {
+    std::string name;
+    std::unique_ptr<CType> type;
+};
+
+struct Aggregate {
+    enum struct Kind {
+        Struct,
+        Union,
+    };
+
+    enum struct State {
+        Unvisited,
+        Visiting,
+        Done,
+    };
+
+    Aggregate(Kind kind, std::string c_name)
+        : kind(kind), c_name(std::move(c_name)) {}
+
+    std::string type_name() const { return c_name + "_t"; }
+
+    Kind kind;
+    std::string c_name;
+    std::vector<Field> fields;
+
+    // Set for messages.
+    bool is_message = false;
+    std::string ordinal_name;
+    uint32_t ordinal = 0;
+
+    State layout_state = State::Unvisited;
+    uint64_t size = 0;
+    uint64_t alignment = 1;
+
+    State bounds_state = State::Unvisited;
+    uint64_t max_out_of_line = 0;
+    uint64_t max_handles = 0;
+
+    bool needs_decode = false;
+    bool needs_encode = false;
+};
+
+struct Scope;
+
+struct ConstInfo {
+    const ConstDeclaration* decl;
+    std::string c_name;
+    const Scope* scope;
+};
+
+struct EnumInfo {
+    const EnumDeclaration* decl;
+    std::string c_name;
+    std::string underlying;
+    uint64_t size;
+    const Scope* scope;
+    std::map<std::string, std::string> member_c_names;
+};
+
+// The names a declaration, or the module, declares.
+struct Scope {
+    const Scope* parent = nullptr;
+    std::string c_prefix;
+    std::map<std::string, std::unique_ptr<ConstInfo>> consts;
+    std::map<std::string, std::unique_ptr<EnumInfo>> enums;
+};
+
+struct Declared {
+    enum struct Kind {
+        None,
+        Const,
+        Enum,
+        EnumMember,
+        Aggregate,
+        Interface,
+    };
+
+    Kind kind = Kind::None;
+    const ConstInfo* const_info = nullptr;
+    const EnumInfo* enum_info = nullptr;
+    std::string c_name;
+    Aggregate* aggregate = nullptr;
+};
+
+class Generator {
+public:
+    explicit Generator(const File& file)
+        : file_(file) {}
+
+    bool Generate(std::string* header);
+
+private:
+    bool Fail(const char* format, ...) __attribute__((format(printf, 2, 3)));
+    void Emit(const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+    void DeclareConstsAndEnums(Scope* scope,
+                               const std::vector<std::unique_ptr<ConstDeclaration>>& consts,
+                               const std::vector<std::unique_ptr<EnumDeclaration>>& enums);
+    Scope* NewScope(const std::string& name);
+
+    Declared Resolve(const CompoundIdentifier& identifier, const Scope* scope) const;
+    bool EvalCount(const Constant& constant, const Scope* scope, int depth, uint64_t* count);
+    bool PrimitiveSpelling(PrimitiveType::TypeKind kind, std::string* spelling, uint64_t* size);
+    bool Lower(const Type& type, const Scope* scope, std::unique_ptr<CType>* out);
+    bool LowerInterface(const InterfaceDeclaration& interface, const Scope* scope);
+
+    uint64_t Size(const CType& type) const;
+    uint64_t Alignment(const CType& type) const;
+    bool Layout(Aggregate* aggregate);
+    bool LayoutType(const CType& type);
+    void Bounds(Aggregate* aggregate);
+    void TypeBounds(const CType& type, uint64_t* out_of_line, uint64_t* handles);
+    bool NeedsCoding(const CType& type, bool encode) const;
+
+    std::string Declarator(const CType& type, const std::string& name) const;
+    bool ConstValue(const ConstInfo& info, std::string* value);
+    bool EmitEnum(const EnumInfo& info);
+    bool EmitConstsAndEnums(const Scope& scope);
+    void EmitDefinition(const Aggregate& aggregate);
+    void EmitCoding(const CType& type, const std::string& value, bool encode, int indent);
+    void EmitCodingFunction(const Aggregate& aggregate, bool encode);
+    void EmitMessageFunctions(const Aggregate& message);
+
+    const File& file_;
+    std::vector<std::string> module_;
+    std::string module_prefix_;
+    std::string out_;
+    int counter_ = 0;
+    bool coder_used_ = false;
+
+    std::vector<std::unique_ptr<Scope>> scopes_;
+    Scope* module_scope_ = nullptr;
+    // The scope of each struct, union and interface, by name.
+    std::map<std::string, Scope*> decl_scopes_;
+    std::map<std::string, Aggregate*> aggregates_by_name_;
+    std::map<std::string, const InterfaceDeclaration*> interfaces_;
+
+    std::vector<std::unique_ptr<Aggregate>> aggregates_;
+    // Structs and unions in an order in which each comes after what it
+    // contains.
+    std::vector<Aggregate*> ordered_;
+    std::vector<Aggregate*> messages_;
+};
+
+bool Generator::Fail(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "fidl2: ");
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    return false;
+}
+
+void Generator::Emit(const char* format, ...) {
+    char buffer[1024];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (length < (int)sizeof(buffer)) {
+        out_.append(buffer, length);
+        return;
+    }
+    std::vector<char> big(length + 1);
+    va_start(args, format);
+    vsnprintf(big.data(), big.size(), format, args);
+    va_end(args);
+    out_.append(big.data(), length);
+}
+
+Scope* Generator::NewScope(const std::string& name) {
+    auto scope = std::make_unique<Scope>();
+    scope->parent = module_scope_;
+    scope->c_prefix = module_prefix_ + name + "_";
+    Scope* raw = scope.get();
+    scopes_.push_back(std::move(scope));
+    decl_scopes_[name] = raw;
+    return raw;
+}
+
+void Generator::DeclareConstsAndEnums(Scope* scope,
+                                      const std::vector<std::unique_ptr<ConstDeclaration>>& consts,
+                                      const std::vector<std::unique_ptr<EnumDeclaration>>& enums) {
+    for (const auto& decl : consts) {
+        auto info = std::make_unique<ConstInfo>();
+        info->decl = decl.get();
+        info->c_name = scope->c_prefix + Name(*decl->identifier);
+        info->scope = scope;
+        scope->consts[Name(*decl->identifier)] = std::move(info);
+    }
+    for (const auto& decl : enums) {
+        auto info = std::make_unique<EnumInfo>();
+        info->decl = decl.get();
+        info->c_name = scope->c_prefix + Name(*decl->identifier);
+        info->scope = scope;
+        for (const auto& member : decl->members)
+            info->member_c_names[Name(*member->identifier)] = info->c_name + "_" + Name(*member->identifier);
+        scope->enums[Name(*decl->identifier)] = std::move(info);
+    }
+}
+
+// Looks up |identifier|, which may be qualified by the module's name, first
+// in |scope| and then in the scopes around it.  Declarations nested in a
+// struct, union or interface can be named from outside it as Outer.name.
+Declared Generator::Resolve(const CompoundIdentifier& identifier, const Scope* scope) const {
+    Declared declared;
+    auto names = Names(identifier);
+    if (names.size() > module_.size() &&
+        std::equal(module_.begin(), module_.end(), names.begin()))
+        names.erase(names.begin(), names.begin() + module_.size());
+
+    if (names.size() == 1) {
+        const auto& name = names[0];
+        for (const Scope* s = scope; s != nullptr; s = s->parent) {
+            auto c = s->consts.find(name);
+            if (c != s->consts.end()) {
+                declared.kind = Declared::Kind::Const;
+                declared.const_info = c->second.get();
+                declared.c_name = c->second->c_name;
+                return declared;
+            }
+            auto e = s->enums.find(name);
+            if (e != s->enums.end()) {
+                declared.kind = Declared::Kind::Enum;
+                declared.enum_info = e->second.get();
+                declared.c_name = e->second->c_name;
+                return declared;
+            }
+        }
+        auto a = aggregates_by_name_.find(name);
+        if (a != aggregates_by_name_.end()) {
+            declared.kind = Declared::Kind::Aggregate;
+            declared.aggregate = a->second;
+            return declared;
+        }
+        if (interfaces_.count(name))
+            declared.kind = Declared::Kind::Interface;
+        return declared;
+    }
+
+    if (names.size() == 2) {
+        for (const Scope* s = scope; s != nullptr; s = s->parent) {
+            auto e = s->enums.find(names[0]);
+            if (e == s->enums.end())
+                continue;
+            auto member = e->second->member_c_names.find(names[1]);
+            if (member != e->second->member_c_names.end()) {
+                declared.kind = Declared::Kind::EnumMember;
+                declared.enum_info = e->second.get();
+                declared.c_name = member->second;
+            }
+            return declared;
+        }
+        auto nested = decl_scopes_.find(names[0]);
+        if (nested == decl_scopes_.end())
+            return declared;
+        const Scope* inner = nested->second;
+        auto c = inner->consts.find(names[1]);
+        if (c != inner->consts.end()) {
+            declared.kind = Declared::Kind::Const;
+            declared.const_info = c->second.get();
+            declared.c_name = c->second->c_name;
+            return declared;
+        }
+        auto e = inner->enums.find(names[1]);
+        if (e != inner->enums.end()) {
+            declared.kind = Declared::Kind::Enum;
+            declared.enum_info = e->second.get();
+            declared.c_name = e->second->c_name;
+        }
+    }
+    return declared;
+}
+
+bool Generator::EvalCount(const Constant& constant, const Scope* scope, int depth,
+                          uint64_t* count) {
+    if (depth > 16)
+        return Fail("constants refer to each other in a loop");
+
+    if (constant.kind == Constant::Kind::Identifier) {
+        const auto& identifier = *static_cast<const IdentifierConstant&>(constant).identifier;
+        auto declared = Resolve(identifier, scope);
+        if (declared.kind != Declared::Kind::Const)
+            return Fail("%s isn't a constant", Join(Names(identifier), ".").c_str());
+        return EvalCount(*declared.const_info->decl->constant, declared.const_info->scope,
+                         depth + 1, count);
+    }
+
+    const auto& literal = *static_cast<const LiteralConstant&>(constant).literal;
+    if (literal.kind != Literal::Kind::Numeric)
+        return Fail("a size has to be a number");
+    auto text = Str(static_cast<const NumericLiteral&>(literal).literal.data());
+    char* end;
+    errno = 0;
+    unsigned long long value = strtoull(text.c_str(), &end, 0);
+    if (text.empty() || text[0] == '-' || *end != '\0' || errno != 0)
+        return Fail("%s isn't a size", text.c_str());
+    *count = value;
+    return true;
+}
+
+bool Generator::PrimitiveSpelling(PrimitiveType::TypeKind kind, std::string* spelling,
+                                  uint64_t* size) {
+    switch (kind) {
+    case PrimitiveType::TypeKind::Bool:
+        *spelling = "bool";
+        *size = 1;
+        return true;
+    case PrimitiveType::TypeKind::Int8:
+        *spelling = "int8_t";
+        *size = 1;
+        return true;
+    case PrimitiveType::TypeKind::Int16:
+        *spelling = "int16_t";
+        *size = 2;
+        return true;
+    case PrimitiveType::TypeKind::Int32:
+        *spelling = "int32_t";
+        *size = 4;
+        return true;
+    case PrimitiveType::TypeKind::Int64:
+        *spelling = "int64_t";
+        *size = 8;
+        return true;
+    case PrimitiveType::TypeKind::Uint8:
+        *spelling = "uint8_t";
+        *size = 1;
+        return true;
+    case PrimitiveType::TypeKind::Uint16:
+        *spelling = "uint16_t";
+        *size = 2;
+        return true;
+    case PrimitiveType::TypeKind::Uint32:
+        *spelling = "uint32_t";
+        *size = 4;
+        return true;
+    case PrimitiveType::TypeKind::Uint64:
+        *spelling = "uint64_t";
+        *size = 8;
+        return true;
+    case PrimitiveType::TypeKind::Float32:
+        *spelling = "float";
+        *size = 4;
+        return true;
+    case PrimitiveType::TypeKind::Float64:
+        *spelling = "double";
+        *size = 8;
+        return true;
+    }
+    return Fail("unknown primitive type");
+}
+
+bool Generator::Lower(const Type& type, const Scope* scope, std::unique_ptr<CType>* out) {
+    switch (type.kind) {
+    case Type::Kind::Primitive: {
+        const auto& primitive = static_cast<const PrimitiveType&>(type);
+        auto lowered = std::make_unique<CType>(
+            primitive.type_kind == PrimitiveType::TypeKind::Bool ? CType::Kind::Bool
+                                                                 : CType::Kind::Primitive);
+        if (!PrimitiveSpelling(primitive.type_kind, &lowered->spelling, &lowered->size))
+            return false;
+        lowered->alignment = lowered->size;
+        *out = std::move(lowered);
+        return true;
+    }
+
+    case Type::Kind::String: {
+        const auto& string = static_cast<const StringType&>(type);
+        auto lowered = std::make_unique<CType>(CType::Kind::String);
+        lowered->spelling = "fidl_string_t";
+        if (string.maybe_element_count &&
+            !EvalCount(*string.maybe_element_count, scope, 0, &lowered->count))
+            return false;
+        lowered->nullable = string.nullability == Nullability::Nullable;
+        *out = std::move(lowered);
+        return true;
+    }
+
+    case Type::Kind::Vector: {
+        const auto& vector = static_cast<const VectorType&>(type);
+        auto lowered = std::make_unique<CType>(CType::Kind::Vector);
+        lowered->spelling = "fidl_vector_t";
+        if (vector.maybe_element_count &&
+            !EvalCount(*vector.maybe_element_count, scope, 0, &lowered->count))
+            return false;
+        lowered->nullable = vector.nullability == Nullability::Nullable;
+        if (!Lower(*vector.element_type, scope, &lowered->element))
+            return false;
+        *out = std::move(lowered);
+        return true;
+    }
+
+    case Type::Kind::Array: {
+        const auto& array = static_cast<const ArrayType&>(type);
+        auto lowered = std::make_unique<CType>(CType::Kind::Array);
+        if (!EvalCount(*array.element_count, scope, 0, &lowered->count))
+            return false;
+        if (lowered->count == 0)
+            return Fail("arrays can't be empty");
+        if (!Lower(*array.element_type, scope, &lowered->element))
+            return false;
+        *out = std::move(lowered);
+        return true;
+    }
+
+    case Type::Kind::Handle: {
+        const auto& handle = static_cast<const HandleType&>(type);
+        auto lowered = std::make_unique<CType>(CType::Kind::Handle);
+        lowered->spelling = "mx_handle_t";
+        lowered->size = lowered->alignment = 4;
+        lowered->nullable = handle.nullability == Nullability::Nullable;
+        *out = std::move(lowered);
+        return true;
+    }
+
+    case Type::Kind::Request: {
+        const auto& request = static_cast<const RequestType&>(type);
+        if (Resolve(*request.subtype, scope).kind != Declared::Kind::Interface)
+            return Fail("%s isn't an interface", Join(Names(*request.subtype), ".").c_str());
+        auto lowered = std::make_unique<CType>(CType::Kind::Handle);
+        lowered->spelling = "mx_handle_t";
+        lowered->size = lowered->alignment = 4;
+        lowered->nullable = request.nullability == Nullability::Nullable;
+        *out = std::move(lowered);
+        return true;
+    }
+
+    case Type::Kind::Identifier: {
+        const auto& identifier = static_cast<const IdentifierType&>(type);
+        bool nullable = identifier.nullability == Nullability::Nullable;
+        auto name = Join(Names(*identifier.identifier), ".");
+        auto declared = Resolve(*identifier.identifier, scope);
+        switch (declared.kind) {
+        case Declared::Kind::Aggregate: {
+            auto lowered = std::make_unique<CType>(nullable ? CType::Kind::Pointer
+                                                            : CType::Kind::Aggregate);
+            lowered->aggregate = declared.aggregate;
+            lowered->spelling = declared.aggregate->type_name() + (nullable ? "*" : "");
+            *out = std::move(lowered);
+            return true;
+        }
+        case Declared::Kind::Enum: {
+            if (nullable)
+                return Fail("enum %s can't be nullable", name.c_str());
+            auto lowered = std::make_unique<CType>(CType::Kind::Primitive);
+            lowered->spelling = declared.enum_info->c_name + "_t";
+            lowered->size = lowered->alignment = declared.enum_info->size;
+            *out = std::move(lowered);
+            return true;
+        }
+        case Declared::Kind::Interface: {
+            auto lowered = std::make_unique<CType>(CType::Kind::Handle);
+            lowered->spelling = "mx_handle_t";
+            lowered->size = lowered->alignment = 4;
+            lowered->nullable = nullable;
+            *out = std::move(lowered);
+            return true;
+        }
+        default:
+            return Fail("unknown type %s", name.c_str());
+        }
+    }
+    }
+    return Fail("unknown kind of type");
+}
+
+uint64_t Generator::Size(const CType& type) const {
+    switch (type.kind) {
+    case CType::Kind::String:
+    case CType::Kind::Vector:
+        return 16;
+    case CType::Kind::Pointer:
+        return 8;
+    case CType::Kind::Array:
+        return SatMul(type.count, Size(*type.element));
+    case CType::Kind::Aggregate:
+        return type.aggregate->size;
+    default:
+        return type.size;
+    }
+}
+
+uint64_t Generator::Alignment(const CType& type) const {
+    switch (type.kind) {
+    case CType::Kind::String:
+    case CType::Kind::Vector:
+    case CType::Kind::Pointer:
+        return 8;
+    case CType::Kind::Array:
+        return Alignment(*type.element);
+    case CType::Kind::Aggregate:
+        return type.aggregate->alignment;
+    default:
+        return type.alignment;
+    }
+}
+
+// Lays out what |type| holds inline.  What it points to is laid out on its
+// own, and may come later.
+bool Generator::LayoutType(const CType& type) {
+    if (type.kind == CType::Kind::Aggregate)
+        return Layout(type.aggregate);
+    if (type.kind == CType::Kind::Array)
+        return LayoutType(*type.element);
+    return true;
+}
+
+bool Generator::Layout(Aggregate* aggregate) {
+    if (aggregate->layout_state == Aggregate::State::Done)
+        return true;
+    if (aggregate->layout_state == Aggregate::State::Visiting)
+        return Fail("%s contains itself; only a nullable %s can refer back to it",
+                    aggregate->c_name.c_str(), aggregate->c_name.c_str());
+    aggregate->layout_state = Aggregate::State::Visiting;
+
+    for (const auto& field : aggregate->fields) {
+        if (!LayoutType(*field.type))
+            return false;
+    }
+
+    if (aggregate->kind == Aggregate::Kind::Struct) {
+        uint64_t offset = 0;
+        for (const auto& field : aggregate->fields) {
+            uint64_t alignment = Alignment(*field.type);
+            offset = SatAdd(AlignTo(offset, alignment), Size(*field.type));
+            if (alignment > aggregate->alignment)
+                aggregate->alignment = alignment;
+        }
+        aggregate->size = AlignTo(offset, aggregate->alignment);
+    } else {
+        // The tag, then the members.
+        uint64_t size = 0;
+        uint64_t alignment = 4;
+        for (const auto& field : aggregate->fields) {
+            if (Size(*field.type) > size)
+                size = Size(*field.type);
+            if (Alignment(*field.type) > alignment)
+                alignment = Alignment(*field.type);
+        }
+        aggregate->alignment = alignment;
+        aggregate->size = AlignTo(SatAdd(AlignTo(4, alignment), size), alignment);
+    }
+    if (aggregate->size > kMaxMessageBytes)
+        return Fail("%s is too big to fit in a message", aggregate->c_name.c_str());
+
+    // What's inline has been laid out and had this worked out already.
+    for (const auto& field : aggregate->fields) {
+        aggregate->needs_decode |= NeedsCoding(*field.type, false);
+        aggregate->needs_encode |= NeedsCoding(*field.type, true);
+    }
+    if (aggregate->kind == Aggregate::Kind::Union)
+        aggregate->needs_decode = aggregate->needs_encode = true;
+
+    aggregate->layout_state = Aggregate::State::Done;
+    if (!aggregate->is_message)
+        ordered_.push_back(aggregate);
+    return true;
+}
+
+// How much out-of-line data, and how many handles, |type| can bring along.
+void Generator::TypeBounds(const CType& type, uint64_t* out_of_line, uint64_t* handles) {
+    *out_of_line = 0;
+    *handles = 0;
+    uint64_t element_out_of_line;
+    uint64_t element_handles;
+    switch (type.kind) {
+    case CType::Kind::Handle:
+        *handles = 1;
+        break;
+    case CType::Kind::String:
+        *out_of_line = AlignTo(type.count, kAlignment);
+        break;
+    case CType::Kind::Vector:
+        TypeBounds(*type.element, &element_out_of_line, &element_handles);
+        *out_of_line = SatAdd(AlignTo(SatMul(type.count, Size(*type.element)), kAlignment),
+                              SatMul(type.count, element_out_of_line));
+        *handles = SatMul(type.count, element_handles);
+        break;
+    case CType::Kind::Array:
+        TypeBounds(*type.element, &element_out_of_line, &element_handles);
+        *out_of_line = SatMul(type.count, element_out_of_line);
+        *handles = SatMul(type.count, element_handles);
+        break;
+    case CType::Kind::Aggregate:
+        Bounds(type.aggregate);
+        *out_of_line = type.aggregate->max_out_of_line;
+        *handles = type.aggregate->max_handles;
+        break;
+    case CType::Kind::Pointer:
+        Bounds(type.aggregate);
+        *out_of_line = SatAdd(AlignTo(type.aggregate->size, kAlignment),
+                              type.aggregate->max_out_of_line);
+        *handles = type.aggregate->max_handles;
+        break;
+    default:
+        break;
+    }
+}
+
+void Generator::Bounds(Aggregate* aggregate) {
+    if (aggregate->bounds_state == Aggregate::State::Done)
+        return;
+    if (aggregate->bounds_state == Aggregate::State::Visiting) {
+        // Back round through a nullable struct or union: a list of them
+        // can be as long as the sender likes.
+        aggregate->max_out_of_line = kUnbounded;
+        aggregate->max_handles = kUnbounded;
+        return;
+    }
+    aggregate->bounds_state = Aggregate::State::Visiting;
+
+    uint64_t max_out_of_line = 0;
+    uint64_t max_handles = 0;
+    for (const auto& field : aggregate->fields) {
+        uint64_t out_of_line;
+        uint64_t handles;
+        TypeBounds(*field.type, &out_of_line, &handles);
+        if (aggregate->kind == Aggregate::Kind::Struct) {
+            max_out_of_line = SatAdd(max_out_of_line, out_of_line);
+            max_handles = SatAdd(max_handles, handles);
+        } else {
+            if (out_of_line > max_out_of_line)
+                max_out_of_line = out_of_line;
+            if (handles > max_handles)
+                max_handles = handles;
+        }
+    }
+    // Unless a loop back to here has already made them unbounded.
+    if (aggregate->max_out_of_line != kUnbounded)
+        aggregate->max_out_of_line = max_out_of_line;
+    if (aggregate->max_handles != kUnbounded)
+        aggregate->max_handles = max_handles;
+    aggregate->bounds_state = Aggregate::State::Done;
+}
+
+// Whether anything has to be done to |type| besides copying it.  Bools are
+// checked on the way in, but needn't be on the way out.
+bool Generator::NeedsCoding(const CType& type, bool encode) const {
+    switch (type.kind) {
+    case CType::Kind::Bool:
+        return !encode;
+    case CType::Kind::Handle:
+    case CType::Kind::String:
+    case CType::Kind::Vector:
+    case CType::Kind::Pointer:
+        return true;
+    case CType::Kind::Array:
+        return NeedsCoding(*type.element, encode);
+    case CType::Kind::Aggregate:
+        return encode ? type.aggregate->needs_encode : type.aggregate->needs_decode;
+    default:
+        return false;
+    }
+}
+
+bool Generator::LowerInterface(const InterfaceDeclaration& interface, const Scope* scope) {
+    auto interface_name = Name(*interface.identifier);
+
+    std::map<std::string, int> method_names;
+    for (const auto& method : interface.method_members)
+        method_names[Name(*method->identifier)]++;
+
+    std::map<uint64_t, std::string> ordinals;
+    for (const auto& method : interface.method_members) {
+        auto method_name = Name(*method->identifier);
+        auto text = Str(method->ordinal->literal.data());
+        char* end;
+        errno = 0;
+        unsigned long long ordinal = strtoull(text.c_str(), &end, 0);
+        if (text[0] == '-' || *end != '\0' || errno != 0 || ordinal > UINT32_MAX)
+            return Fail("%s.%s: %s isn't an ordinal", interface_name.c_str(),
+                        method_name.c_str(), text.c_str());
+        if (ordinals.count(ordinal))
+            return Fail("%s: %s and %s share ordinal %llu", interface_name.c_str(),
+                        ordinals[ordinal].c_str(), method_name.c_str(), ordinal);
+        ordinals[ordinal] = method_name;
+
+        // Overloads of a name are told apart by their ordinals.
+        std::string c_name = module_prefix_ + interface_name + "_" + method_name;
+        if (method_names[method_name] > 1)
+            c_name += "_" + std::to_string(ordinal);
+        std::string ordinal_name = c_name + "_ORDINAL";
+
+        const ParameterList* lists[] = {method->parameter_list.get(), method->maybe_response.get()};
+        const char* suffixes[] = {"_request", "_response"};
+        for (int i = 0; i < 2; i++) {
+            if (lists[i] == nullptr)
+                continue;
+            auto message = std::make_unique<Aggregate>(Aggregate::Kind::Struct, c_name + suffixes[i]);
+            message->is_message = true;
+            message->ordinal_name = ordinal_name;
+            message->ordinal = static_cast<uint32_t>(ordinal);
+
+            auto header = std::make_unique<CType>(CType::Kind::Header);
+            header->spelling = "fidl_message_header_t";
+            header->size = 16;
+            header->alignment = 4;
+            message->fields.push_back(Field{"hdr", std::move(header)});
+
+            for (const auto& parameter : lists[i]->parameter_list) {
+                Field field;
+                field.name = Name(*parameter->identifier);
+                if (!Lower(*parameter->type, scope, &field.type))
+                    return false;
+                message->fields.push_back(std::move(field));
+            }
+            messages_.push_back(message.get());
+            aggregates_.push_back(std::move(message));
+        }
+    }
+    return true;
+}
+
+std::string Generator::Declarator(const CType& type, const std::string& name) const {
+    if (type.kind == CType::Kind::Array)
+        return Declarator(*type.element, name + "[" + std::to_string(type.count) + "]");
+    if (name.empty())
+        return type.spelling;
+    return type.spelling + " " + name;
+}
+
+bool Generator::ConstValue(const ConstInfo& info, std::string* value) {
+    const auto& decl = *info.decl;
+    const Type& type = *decl.type;
+    auto name = Name(*decl.identifier);
+
+    std::string cast;
+    const EnumInfo* enum_info = nullptr;
+    bool is_string = false;
+    bool is_bool = false;
+    if (type.kind == Type::Kind::Primitive) {
+        const auto& primitive = static_cast<const PrimitiveType&>(type);
+        uint64_t size;
+        if (!PrimitiveSpelling(primitive.type_kind, &cast, &size))
+            return false;
+        is_bool = primitive.type_kind == PrimitiveType::TypeKind::Bool;
+    } else if (type.kind == Type::Kind::String) {
+        is_string = true;
+    } else if (type.kind == Type::Kind::Identifier) {
+        const auto& identifier = static_cast<const IdentifierType&>(type);
+        auto declared = Resolve(*identifier.identifier, info.scope);
+        if (declared.kind == Declared::Kind::None)
+            return Fail("const %s: unknown type %s", name.c_str(),
+                        Join(Names(*identifier.identifier), ".").c_str());
+        if (declared.kind != Declared::Kind::Enum)
+            return Fail("const %s: only primitives, strings and enums can be constants",
+                        name.c_str());
+        enum_info = declared.enum_info;
+        cast = enum_info->c_name + "_t";
+    } else {
+        return Fail("const %s: only primitives, strings and enums can be constants",
+                    name.c_str());
+    }
+
+    std::string text;
+    if (decl.constant->kind == Constant::Kind::Identifier) {
+        const auto& identifier = *static_cast<const IdentifierConstant&>(*decl.constant).identifier;
+        if (enum_info != nullptr && identifier.components.size() == 1) {
+            auto member = enum_info->member_c_names.find(Name(*identifier.components[0]));
+            if (member != enum_info->member_c_names.end())
+                text = member->second;
+        }
+        if (text.empty()) {
+            auto declared = Resolve(identifier, info.scope);
+            if (declared.kind != Declared::Kind::Const &&
+                declared.kind != Declared::Kind::EnumMember)
+                return Fail("const %s: %s isn't a constant", name.c_str(),
+                            Join(Names(identifier), ".").c_str());
+            text = declared.c_name;
+        }
+    } else {
+        const auto& literal = *static_cast<const LiteralConstant&>(*decl.constant).literal;
+        switch (literal.kind) {
+        case Literal::Kind::String:
+            if (!is_string)
+                return Fail("const %s: a string for a type that isn't one", name.c_str());
+            text = Str(static_cast<const StringLiteral&>(literal).literal.data());
+            break;
+        case Literal::Kind::Numeric:
+            if (is_string || is_bool)
+                return Fail("const %s: a number for a type that isn't one", name.c_str());
+            text = Str(static_cast<const NumericLiteral&>(literal).literal.data());
+            break;
+        case Literal::Kind::True:
+        case Literal::Kind::False:
+            if (!is_bool)
+                return Fail("const %s: a bool for a type that isn't one", name.c_str());
+            text = literal.kind == Literal::Kind::True ? "true" : "false";
+            break;
+        case Literal::Kind::Default:
+            return Fail("const %s: default isn't a value", name.c_str());
+        }
+    }
+
+    if (is_string)
+        *value = text;
+    else
+        *value = "((" + cast + ")" + text + ")";
+    return true;
+}
+
+bool Generator::EmitEnum(const EnumInfo& info) {
+    Emit("typedef %s %s_t;\n", info.underlying.c_str(), info.c_name.c_str());
+    std::string previous;
+    for (const auto& member : info.decl->members) {
+        auto member_name = Name(*member->identifier);
+        std::string text;
+        if (!member->maybe_value) {
+            text = previous.empty() ? "0" : previous + " + 1";
+        } else if (member->maybe_value->kind == EnumMemberValue::Kind::Numeric) {
+            text = Str(static_cast<const EnumMemberValueNumeric&>(*member->maybe_value)
+                           .literal->literal.data());
+        } else {
+            const auto& identifier =
+                *static_cast<const EnumMemberValueIdentifier&>(*member->maybe_value).identifier;
+            if (identifier.components.size() == 1) {
+                auto own = info.member_c_names.find(Name(*identifier.components[0]));
+                if (own != info.member_c_names.end())
+                    text = own->second;
+            }
+            if (text.empty()) {
+                auto declared = Resolve(identifier, info.scope);
+                if (declared.kind != Declared::Kind::Const &&
+                    declared.kind != Declared::Kind::EnumMember)
+                    return Fail("enum %s: %s isn't a constant", info.c_name.c_str(),
+                                Join(Names(identifier), ".").c_str());
+                text = declared.c_name;
+            }
+        }
+        const auto& c_name = info.member_c_names.at(member_name);
+        Emit("#define %s ((%s_t)(%s))\n", c_name.c_str(), info.c_name.c_str(), text.c_str());
+        previous = c_name;
+    }
+    Emit("\n");
+    return true;
+}
+
+bool Generator::EmitConstsAndEnums(const Scope& scope) {
+    for (const auto& entry : scope.enums) {
+        if (!EmitEnum(*entry.second))
+            return false;
+    }
+    bool any = false;
+    for (const auto& entry : scope.consts) {
+        std::string value;
+        if (!ConstValue(*entry.second, &value))
+            return false;
+        Emit("#define %s %s\n", entry.second->c_name.c_str(), value.c_str());
+        any = true;
+    }
+    if (any)
+        Emit("\n");
+    return true;
+}
+
+void Generator::EmitDefinition(const Aggregate& aggregate) {
+    const char* name = aggregate.c_name.c_str();
+    if (aggregate.kind == Aggregate::Kind::Union) {
+        for (size_t i = 0; i < aggregate.fields.size(); i++)
+            Emit("#define %s_tag_%s ((uint32_t)%zu)\n", name, aggregate.fields[i].name.c_str(), i);
+    }
+    Emit("struct %s {\n", name);
+    if (aggregate.kind == Aggregate::Kind::Union) {
+        Emit("    uint32_t tag;\n");
+        if (!aggregate.fields.empty()) {
+            Emit("    union {\n");
+            for (const auto& field : aggregate.fields)
+                Emit("        %s;\n", Declarator(*field.type, field.name).c_str());
+            Emit("    };\n");
+        }
+    } else {
+        for (const auto& field : aggregate.fields)
+            Emit("    %s;\n", Declarator(*field.type, field.name).c_str());
+    }
+    Emit("};\n");
+    Emit("static_assert(sizeof(%s_t) == %" PRIu64 ", \"%s_t doesn't match the wire format\");\n\n",
+         name, aggregate.size, name);
+}
+
+// Emits the statements that decode, or encode, the |type| at |value|,
+// returning the status from the enclosing function on failure.
+void Generator::EmitCoding(const CType& type, const std::string& value, bool encode,
+                           int indent) {
+    std::string pad(indent * 4, ' ');
+    const char* p = pad.c_str();
+    const char* v = value.c_str();
+    const char* coder = encode ? "encoder" : "decoder";
+    const char* verb = encode ? "encode" : "decode";
+    auto check = [&]() { Emit("%s    if (status != MX_OK)\n%s        return status;\n", p, p); };
+    int n = counter_++;
+    if (NeedsCoding(type, encode) && type.kind != CType::Kind::Bool &&
+        type.kind != CType::Kind::Array)
+        coder_used_ = true;
+
+    switch (type.kind) {
+    case CType::Kind::Bool:
+        if (!encode) {
+            Emit("%sstatus = fidl_decode_bool(&%s);\n", p, v);
+            Emit("%sif (status != MX_OK)\n%s    return status;\n", p, p);
+        }
+        break;
+
+    case CType::Kind::Handle:
+        Emit("%sstatus = fidl_%s_handle(%s, &%s, %s);\n", p, verb, coder, v,
+             type.nullable ? "true" : "false");
+        Emit("%sif (status != MX_OK)\n%s    return status;\n", p, p);
+        break;
+
+    case CType::Kind::String:
+        Emit("%sstatus = fidl_%s_string(%s, &%s, %s, %s);\n", p, verb, coder, v,
+             Bound(type.count).c_str(), type.nullable ? "true" : "false");
+        Emit("%sif (status != MX_OK)\n%s    return status;\n", p, p);
+        break;
+
+    case CType::Kind::Vector: {
+        const CType& element = *type.element;
+        std::string element_type = Declarator(element, "");
+        std::string elements = "elements" + std::to_string(n);
+        std::string index = "i" + std::to_string(n);
+        std::string pointer = element.kind == CType::Kind::Array
+                                  ? Declarator(*element.element, "(*" + elements + ")" +
+                                                                     "[" + std::to_string(element.count) + "]")
+                                  : element.spelling + "* " + elements;
+        std::string cast = element.kind == CType::Kind::Array
+                               ? Declarator(*element.element, "(*)[" + std::to_string(element.count) + "]")
+                               : element.spelling + "*";
+        Emit("%s{\n", p);
+        if (encode) {
+            Emit("%s    void* copy%d;\n", p, n);
+            Emit("%s    status = fidl_encode_vector(encoder, &%s, sizeof(%s), %s, %s, &copy%d);\n",
+                 p, v, element_type.c_str(), Bound(type.count).c_str(),
+                 type.nullable ? "true" : "false", n);
+        } else {
+            Emit("%s    status = fidl_decode_vector(decoder, &%s, sizeof(%s), %s, %s);\n",
+                 p, v, element_type.c_str(), Bound(type.count).c_str(),
+                 type.nullable ? "true" : "false");
+        }
+        check();
+        if (NeedsCoding(element, encode)) {
+            Emit("%s    %s = (%s)%s;\n", p, pointer.c_str(), cast.c_str(),
+                 encode ? ("copy" + std::to_string(n)).c_str() : (value + ".data").c_str());
+            Emit("%s    for (uint64_t %s = 0; %s < %s.count; %s++) {\n", p, index.c_str(),
+                 index.c_str(), v, index.c_str());
+            EmitCoding(element, elements + "[" + index + "]", encode, indent + 2);
+            Emit("%s    }\n", p);
+        } else if (encode) {
+            Emit("%s    (void)copy%d;\n", p, n);
+        }
+        Emit("%s}\n", p);
+        break;
+    }
+
+    case CType::Kind::Array: {
+        if (!NeedsCoding(*type.element, encode))
+            break;
+        std::string index = "i" + std::to_string(n);
+        Emit("%sfor (uint64_t %s = 0; %s < %" PRIu64 "; %s++) {\n", p, index.c_str(),
+             index.c_str(), type.count, index.c_str());
+        EmitCoding(*type.element, value + "[" + index + "]", encode, indent + 1);
+        Emit("%s}\n", p);
+        break;
+    }
+
+    case CType::Kind::Aggregate:
+        if (!NeedsCoding(type, encode))
+            break;
+        Emit("%sstatus = %s_%s_inline(%s, &%s);\n", p, type.aggregate->c_name.c_str(), verb,
+             coder, v);
+        Emit("%sif (status != MX_OK)\n%s    return status;\n", p, p);
+        break;
+
+    case CType::Kind::Pointer: {
+        const Aggregate& aggregate = *type.aggregate;
+        bool nested = encode ? aggregate.needs_encode : aggregate.needs_decode;
+        Emit("%s{\n", p);
+        Emit("%s    void* body%d = %s;\n", p, n, v);
+        if (encode) {
+            Emit("%s    void* copy%d;\n", p, n);
+            Emit("%s    status = fidl_encode_pointer(encoder, &body%d, sizeof(%s), &copy%d);\n",
+                 p, n, aggregate.type_name().c_str(), n);
+        } else {
+            Emit("%s    status = fidl_decode_pointer(decoder, &body%d, sizeof(%s));\n",
+                 p, n, aggregate.type_name().c_str());
+        }
+        check();
+        Emit("%s    %s = (%s*)body%d;\n", p, v, aggregate.type_name().c_str(), n);
+        std::string body = encode ? "copy" + std::to_string(n) : "body" + std::to_string(n);
+        if (nested) {
+            Emit("%s    if (%s != NULL) {\n", p, body.c_str());
+            Emit("%s        status = %s_%s_inline(%s, (%s*)%s);\n", p, aggregate.c_name.c_str(),
+                 verb, coder, aggregate.type_name().c_str(), body.c_str());
+            Emit("%s        if (status != MX_OK)\n%s            return status;\n", p, p);
+            Emit("%s    }\n", p);
+        } else if (encode) {
+            Emit("%s    (void)copy%d;\n", p, n);
+        }
+        Emit("%s}\n", p);
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+
+void Generator::EmitCodingFunction(const Aggregate& aggregate, bool encode) {
+    const char* verb = encode ? "encode" : "decode";
+    const char* coder = encode ? "encoder" : "decoder";
+    Emit("static inline mx_status_t %s_%s_inline(fidl_%s_t* %s, %s* value) {\n",
+         aggregate.c_name.c_str(), verb, coder, coder, aggregate.type_name().c_str());
+    Emit("    mx_status_t status = MX_OK;\n");
+
+    // The body goes in on its own, to know whether it used the coder.
+    std::string head;
+    head.swap(out_);
+    counter_ = 0;
+    coder_used_ = false;
+    if (aggregate.kind == Aggregate::Kind::Union) {
+        Emit("    switch (value->tag) {\n");
+        for (size_t i = 0; i < aggregate.fields.size(); i++) {
+            const auto& field = aggregate.fields[i];
+            Emit("    case %zu:\n", i);
+            EmitCoding(*field.type, "value->" + field.name, encode, 2);
+            Emit("        break;\n");
+        }
+        Emit("    default:\n");
+        Emit("        return MX_ERR_INVALID_ARGS;\n");
+        Emit("    }\n");
+    } else {
+        for (const auto& field : aggregate.fields)
+            EmitCoding(*field.type, "value->" + field.name, encode, 1);
+    }
+    std::string body;
+    body.swap(out_);
+    out_.swap(head);
+    if (!coder_used_)
+        Emit("    (void)%s;\n", coder);
+    out_ += body;
+    Emit("    return status;\n");
+    Emit("}\n\n");
+}
+
+void Generator::EmitMessageFunctions(const Aggregate& message) {
+    std::string type_name = message.type_name();
+    const char* name = message.c_name.c_str();
+    const char* type = type_name.c_str();
+    const char* ordinal = message.ordinal_name.c_str();
+
+    uint64_t max_bytes = SatAdd(AlignTo(message.size, kAlignment), message.max_out_of_line);
+    if (max_bytes > kMaxMessageBytes)
+        max_bytes = kMaxMessageBytes;
+    uint64_t max_handles = message.max_handles;
+    if (max_handles > kMaxMessageHandles)
+        max_handles = kMaxMessageHandles;
+
+    Emit("// Enough for any %s, so a buffer for encoding one can go on the stack.\n", name);
+    Emit("#define %s_MAX_BYTES %" PRIu64 "u\n", name, max_bytes);
+    Emit("#define %s_MAX_HANDLES %" PRIu64 "u\n\n", name, max_handles);
+
+    Emit("static inline mx_status_t %s_decode(\n", name);
+    Emit("    void* bytes, uint32_t num_bytes, mx_handle_t* handles, uint32_t num_handles,\n");
+    Emit("    %s** message) {\n", type);
+    Emit("    fidl_decoder_t decoder;\n");
+    Emit("    mx_status_t status = fidl_decoder_init(&decoder, bytes, num_bytes, handles, num_handles,\n");
+    Emit("                                           sizeof(%s));\n", type);
+    Emit("    if (status != MX_OK)\n        return status;\n");
+    Emit("    %s* value = (%s*)bytes;\n", type, type);
+    Emit("    if (value->hdr.ordinal != %s)\n        return MX_ERR_INVALID_ARGS;\n", ordinal);
+    if (message.needs_decode) {
+        Emit("    status = %s_decode_inline(&decoder, value);\n", name);
+        Emit("    if (status != MX_OK)\n        return status;\n");
+    }
+    Emit("    status = fidl_decoder_finish(&decoder);\n");
+    Emit("    if (status != MX_OK)\n        return status;\n");
+    Emit("    *message = value;\n");
+    Emit("    return MX_OK;\n");
+    Emit("}\n\n");
+
+    Emit("static inline mx_status_t %s_decode_msg(\n", name);
+    Emit("    mx_channel_msg_t* msg, %s** message) {\n", type);
+    Emit("    return %s_decode(\n", name);
+    Emit("        msg->bytes, msg->num_bytes, msg->handles, msg->num_handles, message);\n");
+    Emit("}\n\n");
+
+    Emit("static inline mx_status_t %s_encode(\n", name);
+    Emit("    const %s* message, void* bytes, uint32_t capacity,\n", type);
+    Emit("    mx_handle_t* handles, uint32_t handle_capacity,\n");
+    Emit("    uint32_t* actual_bytes, uint32_t* actual_handles) {\n");
+    Emit("    fidl_encoder_t encoder;\n");
+    Emit("    void* copy;\n");
+    Emit("    mx_status_t status = fidl_encoder_init(&encoder, bytes, capacity, handles, handle_capacity,\n");
+    Emit("                                           message, sizeof(%s), &copy);\n", type);
+    Emit("    if (status != MX_OK)\n        return status;\n");
+    Emit("    %s* value = (%s*)copy;\n", type, type);
+    Emit("    value->hdr.ordinal = %s;\n", ordinal);
+    if (message.needs_encode) {
+        Emit("    status = %s_encode_inline(&encoder, value);\n", name);
+        Emit("    if (status != MX_OK)\n        return status;\n");
+    }
+    Emit("    *actual_bytes = encoder.num_bytes;\n");
+    Emit("    *actual_handles = encoder.num_handles;\n");
+    Emit("    return MX_OK;\n");
+    Emit("}\n\n");
+}
+
+bool Generator::Generate(std::string* header) {
+    module_ = Names(*file_.identifier);
+    module_prefix_ = Join(module_, "_") + "_";
+
+    auto module_scope = std::make_unique<Scope>();
+    module_scope->c_prefix = module_prefix_;
+    module_scope_ = module_scope.get();
+    scopes_.push_back(std::move(module_scope));
+    DeclareConstsAndEnums(module_scope_, file_.const_declaration_list,
+                          file_.enum_declaration_list);
+
+    for (const auto& decl : file_.struct_declaration_list) {
+        auto name = Name(*decl->identifier);
+        DeclareConstsAndEnums(NewScope(name), decl->const_members, decl->enum_members);
+        auto aggregate = std::make_unique<Aggregate>(Aggregate::Kind::Struct, module_prefix_ + name);
+        aggregates_by_name_[name] = aggregate.get();
+        aggregates_.push_back(std::move(aggregate));
+    }
+    for (const auto& decl : file_.union_declaration_list) {
+        auto name = Name(*decl->identifier);
+        DeclareConstsAndEnums(NewScope(name), decl->const_members, decl->enum_members);
+        auto aggregate = std::make_unique<Aggregate>(Aggregate::Kind::Union, module_prefix_ + name);
+        aggregates_by_name_[name] = aggregate.get();
+        aggregates_.push_back(std::move(aggregate));
+    }
+    for (const auto& decl : file_.interface_declaration_list) {
+        auto name = Name(*decl->identifier);
+        DeclareConstsAndEnums(NewScope(name), decl->const_members, decl->enum_members);
+        interfaces_[name] = decl.get();
+    }
+
+    // Enums need their underlying types before anything can use them.
+    for (const auto& scope : scopes_) {
+        for (auto& entry : scope->enums) {
+            EnumInfo* info = entry.second.get();
+            if (info->decl->maybe_subtype) {
+                auto kind = info->decl->maybe_subtype->type_kind;
+                if (kind == PrimitiveType::TypeKind::Bool ||
+                    kind == PrimitiveType::TypeKind::Float32 ||
+                    kind == PrimitiveType::TypeKind::Float64)
+                    return Fail("enum %s has to be of an integer type", info->c_name.c_str());
+                if (!PrimitiveSpelling(kind, &info->underlying, &info->size))
+                    return false;
+            } else {
+                info->underlying = "uint32_t";
+                info->size = 4;
+            }
+        }
+    }
+
+    for (const auto& decl : file_.struct_declaration_list) {
+        auto name = Name(*decl->identifier);
+        Aggregate* aggregate = aggregates_by_name_[name];
+        for (const auto& member : decl->members) {
+            Field field;
+            field.name = Name(*member->identifier);
+            if (!Lower(*member->type, decl_scopes_[name], &field.type))
+                return Fail("in struct %s", name.c_str());
+            aggregate->fields.push_back(std::move(field));
+        }
+        // C has no empty structs, and C++ makes them a byte.
+        if (aggregate->fields.empty()) {
+            auto reserved = std::make_unique<CType>(CType::Kind::Primitive);
+            reserved->spelling = "uint8_t";
+            reserved->size = reserved->alignment = 1;
+            aggregate->fields.push_back(Field{"reserved", std::move(reserved)});
+        }
+    }
+    for (const auto& decl : file_.union_declaration_list) {
+        auto name = Name(*decl->identifier);
+        Aggregate* aggregate = aggregates_by_name_[name];
+        for (const auto& member : decl->members) {
+            Field field;
+            field.name = Name(*member->identifier);
+            if (!Lower(*member->type, decl_scopes_[name], &field.type))
+                return Fail("in union %s", name.c_str());
+            aggregate->fields.push_back(std::move(field));
+        }
+    }
+    for (const auto& decl : file_.interface_declaration_list) {
+        if (!LowerInterface(*decl, decl_scopes_[Name(*decl->identifier)]))
+            return false;
+    }
+
+    for (const auto& aggregate : aggregates_) {
+        if (!Layout(aggregate.get()))
+            return false;
+    }
+    for (const auto& aggregate : aggregates_)
+        Bounds(aggregate.get());
+
+    Emit("// Copyright 2017 The Fuchsia Authors. All rights reserved.\n");
+    Emit("// Use of this source code is governed by a BSD-style license that can be\n");
+    Emit("// found in the LICENSE file.\n\n");
+    Emit("// Generated by fidl2 from module %s.  Do not edit.\n\n", Join(module_, ".").c_str());
+    Emit("#pragma once\n\n");
+    Emit("#include <assert.h>\n");
+    Emit("#include <stdbool.h>\n");
+    Emit("#include <stdint.h>\n\n");
+    Emit("#include <fidl/coding.h>\n");
+    Emit("#include <magenta/compiler.h>\n");
+    Emit("#include <magenta/types.h>\n\n");
+    Emit("__BEGIN_CDECLS\n\n");
+
+    for (const auto& scope : scopes_) {
+        if (!EmitConstsAndEnums(*scope))
+            return false;
+    }
+
+    for (const auto& aggregate : aggregates_)
+        Emit("typedef struct %s %s;\n", aggregate->c_name.c_str(), aggregate->type_name().c_str());
+    Emit("\n");
+
+    for (Aggregate* aggregate : ordered_)
+        EmitDefinition(*aggregate);
+    std::string previous_ordinal;
+    for (Aggregate* message : messages_) {
+        if (message->ordinal_name == previous_ordinal)
+            continue;
+        Emit("#define %s ((uint32_t)%" PRIu32 "u)\n", message->ordinal_name.c_str(), message->ordinal);
+        previous_ordinal = message->ordinal_name;
+    }
+    if (!messages_.empty())
+        Emit("\n");
+    for (Aggregate* message : messages_)
+        EmitDefinition(*message);
+
+    // Nullable structs and unions can point at ones defined later, so
+    // declare everything before defining anything.
+    for (const auto& aggregate : aggregates_) {
+        if (aggregate->needs_decode)
+            Emit("static inline mx_status_t %s_decode_inline(fidl_decoder_t* decoder, %s* value);\n",
+                 aggregate->c_name.c_str(), aggregate->type_name().c_str());
+        if (aggregate->needs_encode)
+            Emit("static inline mx_status_t %s_encode_inline(fidl_encoder_t* encoder, %s* value);\n",
+                 aggregate->c_name.c_str(), aggregate->type_name().c_str());
+    }
+    Emit("\n");
+    for (const auto& aggregate : aggregates_) {
+        if (aggregate->needs_decode)
+            EmitCodingFunction(*aggregate, false);
+        if (aggregate->needs_encode)
+            EmitCodingFunction(*aggregate, true);
+    }
+    for (Aggregate* message : messages_)
+        EmitMessageFunctions(*message);
+
+    Emit("__END_CDECLS\n");
+    header->swap(out_);
+    return true;
+}
+
+} // namespace
+
+bool GenerateCHeader(const File& file, std::string* header) {
+    Generator generator(file);
+    return generator.Generate(header);
+}
+
+} // namespace fidl
@@ -0,0 +1,20 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <string>
+
+#include "ast.h"
+
+namespace fidl {
+
+// Generates the C bindings for |file|: one header, usable from C and C++,
+// with a struct for each struct, union and message whose layout is the
+// wire format's, and inline functions to encode each message into a
+// caller's buffer and to decode it where it was read.  Returns false,
+// having said why on stderr, when something in |file| can't be lowered.
+bool GenerateCHeader(const File& file, std::string* header);
+
+} // namespace fidl
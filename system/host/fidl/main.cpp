@@ -10,6 +10,7 @@
 #include <utility>
 #include <vector>
 
+#include "c_generator.h"
 #include "identifier_table.h"
 #include "lexer.h"
 #include "parser.h"
@@ -20,9 +21,23 @@ namespace {
 
 enum struct Behavior {
     None,
+    CHeader,
 };
 
-bool TestParser(int file_count, char** file_names, Behavior behavior) {
+bool WriteFile(const char* file_name, const std::string& contents) {
+    FILE* file = fopen(file_name, "w");
+    if (file == nullptr) {
+        fprintf(stderr, "Couldn't open %s for writing\n", file_name);
+        return false;
+    }
+    bool ok = fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+    ok = (fclose(file) == 0) && ok;
+    if (!ok)
+        fprintf(stderr, "Couldn't write %s\n", file_name);
+    return ok;
+}
+
+bool TestParser(int file_count, char** file_names, Behavior behavior, const char* output) {
     SourceManager source_manager;
     IdentifierTable identifier_table;
 
@@ -41,6 +56,14 @@ bool TestParser(int file_count, char** file_names, Behavior behavior) {
             fprintf(stderr, "Parse failed!\n");
             return false;
         }
+
+        if (behavior == Behavior::CHeader) {
+            std::string header;
+            if (!GenerateCHeader(*raw_ast, &header))
+                return false;
+            if (!WriteFile(output, header))
+                return false;
+        }
     }
 
     return true;
@@ -59,12 +82,22 @@ int main(int argc, char* argv[]) {
 
     // Parse the behavior.
     fidl::Behavior behavior;
-    if (!strncmp(argv[0], "none", 4))
+    const char* output = nullptr;
+    if (!strcmp(argv[0], "none")) {
         behavior = fidl::Behavior::None;
-    else
+    } else if (!strcmp(argv[0], "c-header")) {
+        // c-header <output.h> <file.fidl2>
+        if (argc != 3)
+            return 1;
+        behavior = fidl::Behavior::CHeader;
+        output = argv[1];
+        --argc;
+        ++argv;
+    } else {
         return 1;
+    }
     --argc;
     ++argv;
 
-    return TestParser(argc, argv, behavior) ? 0 : 1;
+    return TestParser(argc, argv, behavior, output) ? 0 : 1;
 }
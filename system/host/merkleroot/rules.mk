@@ -21,6 +21,7 @@ MODULE_COMPILEFLAGS += \
 MODULE_SRCS += \
 	system/ulib/digest/digest.cpp \
 	system/ulib/digest/merkle-tree.cpp \
+	system/ulib/digest/sha256.cpp \
 	system/ulib/mxalloc/alloc_checker.cpp \
 	$(LOCAL_DIR)/merkleroot.cpp
 
@@ -32,4 +33,6 @@ MODULE_COMPILEFLAGS += -Ithird_party/ulib/cryptolib/include
 MODULE_SRCS += third_party/ulib/cryptolib/cryptolib.c
 endif
 
+MODULE_HOST_SYSLIBS += -lpthread
+
 include make/module.mk
@@ -9,6 +9,8 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdint.h>
@@ -18,13 +20,17 @@
 #include <sys/mman.h>
 #include <sys/stat.h>
 
+#include <lz4.h>
 #include <lz4frame.h>
+#include <lz4hc.h>
+#include <xxhash.h>
 
 #include <magenta/boot/bootdata.h>
 
 #define MAXBUFFER (1024*1024)
 
 int verbose = 0;
+bool dedup = true;
 
 // BOOTFS is a trivial "filesystem" format
 //
@@ -50,6 +56,12 @@ struct fsentry {
     uint32_t length;
 
     char* srcpath;
+
+    // Set if the file's contents are those of an earlier file, whose data
+    // this entry shares rather than having its own copy.
+    fsentry_t* dup;
+    uint64_t hash;
+    fsentry_t* hash_next;
 };
 
 #define ITEM_BOOTDATA 0
@@ -396,6 +408,31 @@ static LZ4F_preferences_t lz4_prefs = {
     .compressionLevel = 4,
 };
 
+// Compression levels for --profile=speed and --profile=ratio. Levels below
+// LZ4_MIN_HC_LEVEL use the fast compressor rather than the HC one.
+#define LZ4_LEVEL_SPEED 1
+#define LZ4_LEVEL_RATIO 16
+#define LZ4_MIN_HC_LEVEL 3
+
+// Blocks are independent, so we cut the image into 64kB blocks ourselves and
+// compress a batch of them at a time, one thread per CPU. The output is what
+// LZ4F_compressUpdate() would produce for the same data, and decompress.c
+// relies on every block but the last being full.
+#define LZ4_BLOCK_SIZE 65536
+#define LZ4_BATCH_BLOCKS 128
+#define LZ4F_BLOCKUNCOMPRESSED_FLAG 0x80000000U
+
+static int compress_threads = 1;
+
+typedef struct {
+    uint8_t* in;                            // LZ4_BATCH_BLOCKS blocks
+    size_t in_len;                          // bytes buffered in in
+    uint8_t* out;                           // a size word and block per block
+    uint32_t out_len[LZ4_BATCH_BLOCKS];
+    size_t nblocks;
+    atomic_size_t next;                     // next block for a worker
+} lz4_batch_t;
+
 static bool check_and_log_lz4_error(LZ4F_errorCode_t code, const char* msg) {
     if (LZ4F_isError(code)) {
         fprintf(stderr, "%s: %s\n", msg, LZ4F_getErrorName(code));
@@ -404,7 +441,75 @@ static bool check_and_log_lz4_error(LZ4F_errorCode_t code, const char* msg) {
     return false;
 }
 
+static void compress_block(lz4_batch_t* batch, size_t i) {
+    const char* src = (const char*)batch->in + i * LZ4_BLOCK_SIZE;
+    size_t len = batch->in_len - i * LZ4_BLOCK_SIZE;
+    if (len > LZ4_BLOCK_SIZE) {
+        len = LZ4_BLOCK_SIZE;
+    }
+    uint8_t* dst = batch->out + i * (sizeof(uint32_t) + LZ4_BLOCK_SIZE);
+
+    // A block which doesn't shrink is stored as it is.
+    int r;
+    if (lz4_prefs.compressionLevel < LZ4_MIN_HC_LEVEL) {
+        r = LZ4_compress_default(src, (char*)dst + sizeof(uint32_t), len, len - 1);
+    } else {
+        r = LZ4_compress_HC(src, (char*)dst + sizeof(uint32_t), len, len - 1,
+                            lz4_prefs.compressionLevel);
+    }
+    uint32_t size = r;
+    if (r <= 0) {
+        memcpy(dst + sizeof(uint32_t), src, len);
+        size = len | LZ4F_BLOCKUNCOMPRESSED_FLAG;
+        r = len;
+    }
+    // The frame format is little-endian, as is every host we build on.
+    memcpy(dst, &size, sizeof(size));
+    batch->out_len[i] = sizeof(uint32_t) + r;
+}
+
+static void* compress_worker(void* arg) {
+    lz4_batch_t* batch = arg;
+    size_t i;
+    while ((i = atomic_fetch_add(&batch->next, 1)) < batch->nblocks) {
+        compress_block(batch, i);
+    }
+    return NULL;
+}
+
+// Compress whatever is buffered and write it out, in order.
+static ssize_t compress_flush(int fd, lz4_batch_t* batch) {
+    if (batch->in_len == 0) {
+        return 0;
+    }
+    batch->nblocks = (batch->in_len + LZ4_BLOCK_SIZE - 1) / LZ4_BLOCK_SIZE;
+    atomic_store(&batch->next, 0);
+
+    pthread_t threads[compress_threads];
+    int started = 0;
+    while ((started < compress_threads - 1) && (started + 1 < (int)batch->nblocks)) {
+        if (pthread_create(&threads[started], NULL, compress_worker, batch) != 0) {
+            break;
+        }
+        started++;
+    }
+    compress_worker(batch);
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    for (size_t i = 0; i < batch->nblocks; i++) {
+        if (writex(fd, batch->out + i * (sizeof(uint32_t) + LZ4_BLOCK_SIZE),
+                   batch->out_len[i]) < 0) {
+            return -1;
+        }
+    }
+    batch->in_len = 0;
+    return 0;
+}
+
 ssize_t compress_setup(int fd, void** cookie) {
+    // Let the library write the frame header, which carries a checksum.
     LZ4F_compressionContext_t cctx;
     LZ4F_errorCode_t errc = LZ4F_createCompressionContext(&cctx, LZ4F_VERSION);
     if (check_and_log_lz4_error(errc, "could not initialize compression context")) {
@@ -412,26 +517,48 @@ ssize_t compress_setup(int fd, void** cookie) {
     }
     uint8_t buf[128];
     size_t r = LZ4F_compressBegin(cctx, buf, sizeof(buf), &lz4_prefs);
+    LZ4F_freeCompressionContext(cctx);
     if (check_and_log_lz4_error(r, "could not begin compression")) {
-        return r;
+        return -1;
     }
 
-    // Note: LZ4F_compressionContext_t is a typedef to a pointer, so this is
-    // "safe".
-    *cookie = (void*)cctx;
+    lz4_batch_t* batch = calloc(1, sizeof(lz4_batch_t));
+    if (batch == NULL) {
+        return -1;
+    }
+    batch->in = malloc(LZ4_BATCH_BLOCKS * LZ4_BLOCK_SIZE);
+    batch->out = malloc(LZ4_BATCH_BLOCKS * (sizeof(uint32_t) + LZ4_BLOCK_SIZE));
+    if ((batch->in == NULL) || (batch->out == NULL)) {
+        fprintf(stderr, "OUT OF MEMORY\n");
+        free(batch->in);
+        free(batch->out);
+        free(batch);
+        return -1;
+    }
+    *cookie = batch;
 
     return writex(fd, buf, r);
 }
 
-ssize_t compress_data(int fd, const void* src, size_t len, void* cookie) {
-    // max will be, worst case, a bit larger than MAXBUFFER
-    size_t max = LZ4F_compressBound(len, &lz4_prefs);
-    uint8_t buf[max];
-    size_t r = LZ4F_compressUpdate((LZ4F_compressionContext_t)cookie, buf, max, src, len, NULL);
-    if (check_and_log_lz4_error(r, "could not compress data")) {
-        return -1;
+ssize_t compress_data(int fd, const void* ptr, size_t len, void* cookie) {
+    lz4_batch_t* batch = cookie;
+    const uint8_t* src = ptr;
+    size_t total = len;
+    while (len > 0) {
+        size_t xfer = LZ4_BATCH_BLOCKS * LZ4_BLOCK_SIZE - batch->in_len;
+        if (xfer > len) {
+            xfer = len;
+        }
+        memcpy(batch->in + batch->in_len, src, xfer);
+        batch->in_len += xfer;
+        src += xfer;
+        len -= xfer;
+        if ((batch->in_len == LZ4_BATCH_BLOCKS * LZ4_BLOCK_SIZE) &&
+            (compress_flush(fd, batch) < 0)) {
+            return -1;
+        }
     }
-    return writex(fd, buf, r);
+    return total;
 }
 
 ssize_t compress_file(int fd, const char* fn, size_t len, void* cookie) {
@@ -440,45 +567,47 @@ ssize_t compress_file(int fd, const char* fn, size_t len, void* cookie) {
         return 0;
     }
 
-    char buf[MAXBUFFER];
+    lz4_batch_t* batch = cookie;
     int r, fdi;
     if ((fdi = open(fn, O_RDONLY)) < 0) {
         fprintf(stderr, "error: cannot open '%s'\n", fn);
         return -1;
     }
 
+    // Read straight into the batch rather than through a bounce buffer.
     r = 0;
     size_t total = len;
     while (len > 0) {
-        size_t xfer = (len > sizeof(buf)) ? sizeof(buf) : len;
-        if ((r = readx(fdi, buf, xfer)) < 0) {
-            break;
+        size_t xfer = LZ4_BATCH_BLOCKS * LZ4_BLOCK_SIZE - batch->in_len;
+        if (xfer > len) {
+            xfer = len;
         }
-        if ((r = compress_data(fd, buf, xfer, cookie)) < 0) {
+        if ((r = readx(fdi, batch->in + batch->in_len, xfer)) < 0) {
             break;
         }
+        batch->in_len += xfer;
         len -= xfer;
+        if ((batch->in_len == LZ4_BATCH_BLOCKS * LZ4_BLOCK_SIZE) &&
+            ((r = compress_flush(fd, batch)) < 0)) {
+            break;
+        }
     }
     close(fdi);
     return (r < 0) ? -1 : total;
 }
 
 ssize_t compress_finish(int fd, void* cookie) {
-    // Max write is one block (64kB uncompressed) plus 8 bytes of footer.
-    size_t max = LZ4F_compressBound(65536, &lz4_prefs) + 8;
-    uint8_t buf[max];
-    size_t r = LZ4F_compressEnd((LZ4F_compressionContext_t)cookie, buf, max, NULL);
-    if (check_and_log_lz4_error(r, "could not finish compression")) {
-        r = -1;
-    } else {
-        r = writex(fd, buf, r);
-    }
-
-    LZ4F_errorCode_t errc = LZ4F_freeCompressionContext((LZ4F_compressionContext_t)cookie);
-    if (check_and_log_lz4_error(errc, "could not free compression context")) {
-        r = -1;
+    lz4_batch_t* batch = cookie;
+    ssize_t r = compress_flush(fd, batch);
+    if (r == 0) {
+        // End mark; there's no content checksum.
+        uint32_t end = 0;
+        r = writex(fd, &end, sizeof(end));
     }
 
+    free(batch->in);
+    free(batch->out);
+    free(batch);
     return r;
 }
 
@@ -536,6 +665,83 @@ fail:
 #define PAGEALIGN(n) (((n) + 4095) & (~4095))
 #define PAGEFILL(n) (PAGEALIGN(n) - (n))
 
+static void* map_file(const char* fn, size_t len) {
+    int fd;
+    if ((fd = open(fn, O_RDONLY)) < 0) {
+        fprintf(stderr, "error: cannot open '%s'\n", fn);
+        return NULL;
+    }
+    void* ptr = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        fprintf(stderr, "error: cannot map '%s'\n", fn);
+        return NULL;
+    }
+    return ptr;
+}
+
+static int same_contents(const fsentry_t* a, const fsentry_t* b, bool* same) {
+    void* pa = map_file(a->srcpath, a->length);
+    void* pb = map_file(b->srcpath, b->length);
+    int r = -1;
+    if ((pa != NULL) && (pb != NULL)) {
+        *same = (memcmp(pa, pb, a->length) == 0);
+        r = 0;
+    }
+    if (pa != NULL) {
+        munmap(pa, a->length);
+    }
+    if (pb != NULL) {
+        munmap(pb, b->length);
+    }
+    return r;
+}
+
+#define DEDUP_BUCKETS 4096
+
+// Find the files of a bootfs whose contents already appear earlier in it
+// (the same library installed under two names, say), so that only one copy
+// is stored.
+static int dedup_bootfs(item_t* item) {
+    fsentry_t* buckets[DEDUP_BUCKETS];
+    memset(buckets, 0, sizeof(buckets));
+
+    for (fsentry_t* e = item->first; e != NULL; e = e->next) {
+        // Empty files never take any space.
+        if (e->length == 0) {
+            continue;
+        }
+        void* ptr;
+        if ((ptr = map_file(e->srcpath, e->length)) == NULL) {
+            return -1;
+        }
+        e->hash = XXH64(ptr, e->length, 0);
+        munmap(ptr, e->length);
+
+        fsentry_t** bucket = &buckets[e->hash % DEDUP_BUCKETS];
+        for (fsentry_t* o = *bucket; o != NULL; o = o->hash_next) {
+            if ((o->hash != e->hash) || (o->length != e->length)) {
+                continue;
+            }
+            bool same;
+            if (same_contents(o, e, &same) < 0) {
+                return -1;
+            }
+            if (same) {
+                e->dup = o;
+                break;
+            }
+        }
+        if (e->dup == NULL) {
+            e->hash_next = *bucket;
+            *bucket = e;
+        } else if (verbose) {
+            fprintf(stderr, "%s is a copy of %s\n", e->name, e->dup->name);
+        }
+    }
+    return 0;
+}
+
 char fill[4096];
 
 #define CHECK(w) do { if ((w) < 0) goto fail; } while (0)
@@ -578,9 +784,11 @@ fail:
         hdr[2] = e->offset;
         CHECK(op->write(fd, hdr, sizeof(hdr), cookie));
         CHECK(op->write(fd, e->name, e->namelen, cookie));
-        last_entry = e;
+        if (e->dup == NULL) {
+            last_entry = e;
+        }
     }
-    // Record length of last file
+    // Record length of last file with data of its own
     uint32_t last_length = last_entry ? last_entry->length : 0;
 
     // null terminator record
@@ -594,6 +802,9 @@ fail:
         if (verbose) {
             fprintf(stderr, "%08x %08x %s\n", e->offset, e->length, e->name);
         }
+        if (e->dup) {
+            continue;
+        }
         CHECK(op->write_file(fd, e->srcpath, e->length, cookie));
         if ((n = PAGEFILL(e->length))) {
             CHECK(op->write(fd, fill, n, cookie));
@@ -832,8 +1043,12 @@ void usage(void) {
     "         -C <filename>    include kernel command line\n"
     "         -c               compress bootfs image (default)\n"
     "         -v               verbose output\n"
+    "         -j <n>           compress with <n> threads (default: one per CPU)\n"
     "         -t <filename>    dump bootdata contents\n"
     "         --uncompressed   don't compress bootfs image (debug only)\n"
+    "         --profile=speed  compress quickly, at some cost in size\n"
+    "         --profile=ratio  compress as small as lz4 can, slowly\n"
+    "         --no-dedup       store every copy of files with equal contents\n"
     "         --target=system  bootfs to be unpacked at /system\n"
     "         --target=boot    bootfs to be unpacked at /boot\n"
     "\n"
@@ -861,6 +1076,9 @@ int main(int argc, char **argv) {
     }
     bool system = true;
 
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    compress_threads = (cpus > 0) ? cpus : 1;
+
     if ((argc == 3) && (!strcmp(argv[1],"-t"))) {
         return dump_bootdata(argv[2]);
     }
@@ -925,6 +1143,19 @@ int main(int argc, char **argv) {
             compressed = true;
         } else if (!strcmp(cmd,"--uncompressed")) {
             compressed = false;
+        } else if (!strcmp(cmd,"--profile=speed")) {
+            lz4_prefs.compressionLevel = LZ4_LEVEL_SPEED;
+        } else if (!strcmp(cmd,"--profile=ratio")) {
+            lz4_prefs.compressionLevel = LZ4_LEVEL_RATIO;
+        } else if (!strcmp(cmd,"--no-dedup")) {
+            dedup = false;
+        } else if (!strcmp(cmd,"-j")) {
+            if ((argc < 2) || ((compress_threads = atoi(argv[1])) <= 0)) {
+                fprintf(stderr, "error: -j needs a thread count\n");
+                return -1;
+            }
+            argc--;
+            argv++;
         } else if (!strcmp(cmd,"--target=system")) {
             system = true;
         } else if (!strcmp(cmd,"--target=boot")) {
@@ -968,9 +1199,17 @@ int main(int argc, char **argv) {
             // account for bootdata plus the end record
             item->hdrsize += sizeof(bootdata_t) + 12;
 
+            if (dedup && (dedup_bootfs(item) < 0)) {
+                return -1;
+            }
+
             size_t off = PAGEALIGN(item->hdrsize);
             fsentry_t* last_entry = NULL;
             for (fsentry_t* e = item->first; e != NULL; e = e->next) {
+                if (e->dup) {
+                    e->offset = e->dup->offset;
+                    continue;
+                }
                 e->offset = off;
                 off += PAGEALIGN(e->length);
                 if (off > INT32_MAX) {
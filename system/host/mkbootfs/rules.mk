@@ -19,4 +19,6 @@ MODULE_SRCS += \
 
 MODULE_CFLAGS := -I$(LZ4_DIR)/include/lz4
 
+MODULE_HOST_SYSLIBS := -lpthread
+
 include make/module.mk
@@ -6,6 +6,8 @@ LOCAL_DIR := $(GET_LOCAL_DIR)
 
 HOSTAPPS := \
 	$(LOCAL_DIR)/bootserver/rules.mk \
+	$(LOCAL_DIR)/boottimeline/rules.mk \
+	$(LOCAL_DIR)/cpuprofile-fold/rules.mk \
 	$(LOCAL_DIR)/fidl/rules.mk \
 	$(LOCAL_DIR)/kernel-buildsig/rules.mk \
 	$(LOCAL_DIR)/loglistener/rules.mk \
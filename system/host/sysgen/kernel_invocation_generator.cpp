@@ -37,18 +37,49 @@ bool KernelInvocationGenerator::syscall(std::ofstream& os, const Syscall& sc) {
 
     os << code_sp << "CHECK_SYSCALL_PC(" << sc.name << ");\n";
 
+    // Copy in the copyin arguments before anything else, and fail the
+    // syscall as its own copy_from_user would have.
+    int arg_index = 1;
+    sc.for_each_kernel_arg([&](const TypeSpec& arg) {
+        string raw = arg_prefix_ + std::to_string(arg_index++);
+        if (!arg.copy_in)
+            return;
+        os << code_sp << arg.type << " copied_" << arg.name << ";\n"
+           << code_sp << "if (make_user_ptr(" << arg.as_cpp_cast(raw)
+           << ").copy_from_user(&copied_" << arg.name << ") != MX_OK) {\n"
+           << code_sp << block_sp << return_var_ << " = static_cast<" << return_type_
+           << ">(MX_ERR_INVALID_ARGS);\n"
+           << code_sp << block_sp << "break;\n"
+           << code_sp << "}\n";
+    });
+
+    // The hook on the way in sees the first three arguments.
+    os << code_sp << "SYSCALL_HOOK_ENTER(" << sc.name;
+    for (arg_index = 1; arg_index <= 3; ++arg_index) {
+        if (static_cast<size_t>(arg_index) <= sc.num_kernel_args())
+            os << ", " << arg_prefix_ << arg_index;
+        else
+            os << ", 0";
+    }
+    os << ");\n";
+
     os << code_sp;
 
     // ret = static_cast<uint64_t>(syscall_whatevs(      )) -closer
     string close_invocation = invocation(os, return_var_, return_type_, syscall_name, sc);
 
     // Writes all arguments.
-    int arg_index = 1;
+    arg_index = 1;
     sc.for_each_kernel_arg([&](const TypeSpec& arg) {
         os << "\n"
-           << arg_sp
-           << sc.maybe_wrap(arg.as_cpp_cast(arg_prefix_ + std::to_string(arg_index++)))
-           << ",";
+           << arg_sp;
+        if (arg.copy_in) {
+            os << "&copied_" << arg.name;
+        } else {
+            os << sc.maybe_wrap(arg.as_cpp_cast(arg_prefix_ + std::to_string(arg_index)));
+        }
+        os << ",";
+        ++arg_index;
     });
 
     if (!os.good()) {
@@ -67,6 +98,7 @@ bool KernelInvocationGenerator::syscall(std::ofstream& os, const Syscall& sc) {
            << block_sp << "}\n";
     } else {
         os << ";\n";
+        os << code_sp << "SYSCALL_HOOK_EXIT(" << sc.name << ", " << return_var_ << ");\n";
         os << code_sp << "break;\n"
            << block_sp << "}\n";
     }
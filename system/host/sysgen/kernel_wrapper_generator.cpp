@@ -20,10 +20,23 @@ static string invocation(ofstream& os, const string& out_type,
         return ")";
     }
 
-    os << "return static_cast<" << out_type << ">(" << syscall_name << "(";
+    os << out_type << " ret = static_cast<" << out_type << ">(" << syscall_name << "(";
     return "))";
 }
 
+// Writes the hook on the way in, which sees the first three arguments.
+static void write_hook_enter(ofstream& os, const Syscall& sc) {
+    os << "SYSCALL_HOOK_ENTER(" << sc.name;
+    size_t count = 0;
+    sc.for_each_kernel_arg([&](const TypeSpec& arg) {
+        if (count++ < 3)
+            os << ", " << arg.name;
+    });
+    for (; count < 3; ++count)
+        os << ", 0";
+    os << ");\n";
+}
+
 static void write_x86_syscall_signature_line(ofstream& os, const Syscall& sc, string name_prefix) {
     auto syscall_name = name_prefix + sc.name;
 
@@ -60,14 +73,30 @@ bool KernelWrapperGenerator::syscall(ofstream& os, const Syscall& sc) {
        << define_prefix_ << sc.name << ", "
        << "ip, "
        << "&VDso::ValidSyscallPC::" << sc.name << ", "
-       << "[&]() {\n"
-       << inin;
+       << "[&]() {\n";
+
+    // Copy in the copyin arguments before anything else, and fail the
+    // syscall as its own copy_from_user would have.
+    sc.for_each_kernel_arg([&](const TypeSpec& arg) {
+        if (!arg.copy_in)
+            return;
+        os << inin << arg.type << " copied_" << arg.name << ";\n"
+           << inin << "if (make_user_ptr(" << arg.name << ").copy_from_user(&copied_"
+           << arg.name << ") != MX_OK)\n"
+           << inin << in << "return static_cast<uint64_t>(MX_ERR_INVALID_ARGS);\n";
+    });
+
+    os << inin;
+    write_hook_enter(os, sc);
+    os << inin;
 
     string close_invocation = invocation(os, "uint64_t", syscall_name, sc);
 
     // Writes all arguments.
     sc.for_each_kernel_arg([&](const TypeSpec& arg) {
-        if (sc.is_no_wrap() || !arg.arr_spec) {
+        if (arg.copy_in) {
+            os << "&copied_" << arg.name << ", ";
+        } else if (sc.is_no_wrap() || !arg.arr_spec) {
             os << arg.name << ", ";
         } else {
             os << "make_user_ptr(" << arg.name << "), ";
@@ -87,6 +116,8 @@ bool KernelWrapperGenerator::syscall(ofstream& os, const Syscall& sc) {
         os << inin << "return MX_ERR_BAD_STATE;\n";
     } else {
         os << ";\n";
+        os << inin << "SYSCALL_HOOK_EXIT(" << sc.name << ", ret);\n";
+        os << inin << "return ret;\n";
     }
     os << in << "});\n";
     os << "}\n";
@@ -189,5 +189,14 @@ bool process_syscall(SysgenGenerator* parser, TokenStream& ts) {
         return false;
     }
 
+    // Single input structs of a copyin syscall are copied in by the
+    // wrapper, in one user_copy, before the syscall proper runs.
+    if (syscall.is_copy_in()) {
+        for (auto& arg : syscall.arg_spec) {
+            arg.copy_in = arg.arr_spec && arg.arr_spec->kind == ArraySpec::IN &&
+                          arg.arr_spec->count == 1u && arg.type != "any";
+        }
+    }
+
     return parser->AddSyscall(syscall);
 }
\ No newline at end of file
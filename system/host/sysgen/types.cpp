@@ -105,7 +105,7 @@ string TypeSpec::as_cpp_declaration(bool is_wrapped) const {
     string modifier = arr_spec->kind == ArraySpec::IN ? "const " : "";
     string ptr_type = type == "any" ? "void" : type;
 
-    if (is_wrapped) {
+    if (is_wrapped && !copy_in) {
         return "user_ptr<" + modifier + ptr_type + "> " + name;
     }
     return modifier + ptr_type + "* " + name;
@@ -165,6 +165,10 @@ bool Syscall::is_internal() const {
     return has_attribute("internal", attributes);
 }
 
+bool Syscall::is_copy_in() const {
+    return has_attribute("copyin", attributes);
+}
+
 size_t Syscall::num_kernel_args() const {
     return is_noreturn() ? arg_spec.size() : arg_spec.size() + ret_spec.size() - 1;
 }
@@ -203,6 +207,18 @@ bool Syscall::validate() const {
         return false;
     }
 
+    if (is_copy_in()) {
+        if (is_vdso() || is_noreturn()) {
+            print_error("copyin cannot be vdsocall or noreturn");
+            return false;
+        }
+        if (std::none_of(arg_spec.begin(), arg_spec.end(),
+                         [](const TypeSpec& arg) { return arg.copy_in; })) {
+            print_error("copyin needs a [1] IN argument that isn't any");
+            return false;
+        }
+    }
+
     bool valid_args = true;
     for_each_kernel_arg([this, &valid_args](const TypeSpec& arg) {
         if (arg.name.empty()) {
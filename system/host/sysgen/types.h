@@ -38,6 +38,8 @@ struct TypeSpec {
     std::string type;
     std::vector<std::string> attributes;
     ArraySpec* arr_spec = nullptr;
+    // Copied in by the kernel wrapper, so the kernel sees a plain pointer.
+    bool copy_in = false;
 
     void debug_dump() const;
     std::string to_string() const;
@@ -62,6 +64,7 @@ struct Syscall {
     bool is_no_wrap() const;
     bool is_blocking() const;
     bool is_internal() const;
+    bool is_copy_in() const;
     size_t num_kernel_args() const;
     void for_each_kernel_arg(const std::function<void(const TypeSpec&)>& cb) const;
     bool validate() const;
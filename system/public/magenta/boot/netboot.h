@@ -17,6 +17,15 @@
 #define NB_ADVERT_PORT        33331
 #define NB_CMD_PORT_START     33332
 #define NB_CMD_PORT_END       33339
+#define NB_TFTP_INCOMING_PORT 33340
+
+// netsvc takes files by TFTP (with the block size, transfer size and window
+// size options) on NB_TFTP_INCOMING_PORT, and says so in its advertisement
+// with a "tftp=<port>" field. When netbooting, kernel.bin and ramdisk.bin go
+// into the images to boot; other names must be absolute paths, and are
+// written there, which may be a block device.
+#define NB_TFTP_BLOCK_SIZE    1428  // with its DATA header, fits a 1500 byte MTU
+#define NB_TFTP_WINDOW_SIZE   64
 
 
 #define NB_COMMAND           1   // arg=0, data=command
@@ -35,6 +35,7 @@ typedef enum audio2_cmd {
     AUDIO2_RB_CMD_GET_BUFFER         = 0x3001,
     AUDIO2_RB_CMD_START              = 0x3002,
     AUDIO2_RB_CMD_STOP               = 0x3003,
+    AUDIO2_RB_CMD_GET_POSITION_VMO   = 0x3004,
 
     // Async notifications sent on the ring buffer channel.
     AUDIO2_RB_POSITION_NOTIFY        = 0x4000,
@@ -304,4 +305,65 @@ typedef struct audio2_rb_position_notify {
     uint32_t ring_buffer_pos;
 } audio2_rb_position_notify_t;
 
+// AUDIO2_RB_CMD_GET_POSITION_VMO
+//
+// Request a VMO through which the driver publishes where the hardware is in
+// the ring buffer, kept up to date while the ring buffer runs.  Clients who
+// poll it have no need for position notifications, and may ask for none
+// (notifications_per_ring == 0) when they get their buffer.  Drivers which
+// cannot keep such a VMO up to date fail the request with
+// MX_ERR_NOT_SUPPORTED.
+//
+// May not be used with the NO_ACK flag.
+typedef struct audio2_rb_cmd_get_position_vmo_req {
+    audio2_cmd_hdr_t hdr;
+} audio2_rb_cmd_get_position_vmo_req_t;
+
+typedef struct audio2_rb_cmd_get_position_vmo_resp {
+    audio2_cmd_hdr_t hdr;
+    mx_status_t      result;
+
+    // NOTE: If result == MX_OK, a VMO handle will be returned as well.  It
+    // may only be mapped read-only, and holds an audio2_rb_position_t at
+    // offset 0.
+} audio2_rb_cmd_get_position_vmo_resp_t;
+
+// audio2_rb_position_t
+//
+// The contents of the position VMO.  The driver makes |seq| odd while it
+// updates the rest and even again when it is done, so readers should use
+// audio2_rb_position_read() rather than reading the fields directly.
+//
+// |frames| and |ticks| are sampled together, which is what clients need to
+// recover the hardware's clock: the rate at which |frames| advances against
+// |ticks| (as measured by mx_ticks_get()) is the actual frame rate.
+typedef struct audio2_rb_position {
+    uint32_t seq;
+
+    // The same position (in bytes) as audio2_rb_position_notify_t reports.
+    uint32_t ring_buffer_pos;
+
+    // Frames clocked out (output) or in (input) since the ring buffer was
+    // last started, and when that count was taken.
+    uint64_t frames;
+    uint64_t ticks;
+
+    // The start_ticks reported by the last AUDIO2_RB_CMD_START.
+    uint64_t start_ticks;
+} audio2_rb_position_t;
+
+static inline void audio2_rb_position_read(const audio2_rb_position_t* pos,
+                                           audio2_rb_position_t* out) {
+    uint32_t seq;
+    do {
+        seq = __atomic_load_n(&pos->seq, __ATOMIC_ACQUIRE);
+        out->ring_buffer_pos = pos->ring_buffer_pos;
+        out->frames          = pos->frames;
+        out->ticks           = pos->ticks;
+        out->start_ticks     = pos->start_ticks;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || (seq != __atomic_load_n(&pos->seq, __ATOMIC_RELAXED)));
+    out->seq = seq;
+}
+
 __END_CDECLS
@@ -42,11 +42,20 @@
 // otherwise, closing the client fifo is sufficient to shut down the server.
 #define IOCTL_BLOCK_FIFO_CLOSE \
     IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_BLOCK, 10)
+// Add another FIFO to the currently running FIFO server; acquire the handle to it.
+// Closing it only stops the added FIFO; closing the one from "get_fifos" stops them all.
+// May be given the FIFO's weight.
+#define IOCTL_BLOCK_ADD_FIFO \
+    IOCTL(IOCTL_KIND_GET_HANDLE, IOCTL_FAMILY_BLOCK, 11)
+// Get the I/O statistics of the device, and of the FIFOs of its server.
+#define IOCTL_BLOCK_GET_STATS \
+    IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_BLOCK, 12)
 
 // Block Core ioctls (specific to each block device):
 
 #define BLOCK_FLAG_READONLY  0x00000001
 #define BLOCK_FLAG_REMOVABLE 0x00000002
+#define BLOCK_FLAG_DISCARD   0x00000004 // Frees what BLOCKIO_DISCARD asks it to
 
 typedef struct {
     uint64_t block_count; // The number of blocks in this block device
@@ -96,6 +105,67 @@ IOCTL_WRAPPER_IN(ioctl_block_free_txn, IOCTL_BLOCK_FREE_TXN, txnid_t);
 // ssize_t ioctl_block_fifo_close(int fd);
 IOCTL_WRAPPER(ioctl_block_fifo_close, IOCTL_BLOCK_FIFO_CLOSE);
 
+// The most FIFOs a single server may have, including the first.
+#define BLOCK_MAX_FIFOS 8
+
+// The device is shared between the FIFOs of a server which have requests
+// waiting in proportion to their weights. The FIFO from "get_fifos", and those
+// added without a weight, have the default one.
+#define BLOCK_FIFO_WEIGHT_DEFAULT 100
+#define BLOCK_FIFO_WEIGHT_MAX     1000
+
+// ssize_t ioctl_block_add_fifo(int fd, mx_handle_t* fifo_out);
+IOCTL_WRAPPER_OUT(ioctl_block_add_fifo, IOCTL_BLOCK_ADD_FIFO, mx_handle_t);
+
+// ssize_t ioctl_block_add_weighted_fifo(int fd, const uint32_t* weight, mx_handle_t* fifo_out);
+IOCTL_WRAPPER_INOUT(ioctl_block_add_weighted_fifo, IOCTL_BLOCK_ADD_FIFO, uint32_t, mx_handle_t);
+
+// The requests sent on a device's FIFOs are counted as they complete, by
+// kind: a BLOCKIO_SYNC counts as a flush.
+#define BLOCK_STAT_READ    0
+#define BLOCK_STAT_WRITE   1
+#define BLOCK_STAT_FLUSH   2
+#define BLOCK_STAT_DISCARD 3
+#define BLOCK_STAT_COUNT   4
+
+// Latency bucket i counts the requests which took less than 2^i microseconds,
+// and at least 2^(i-1); the last also counts every one which took longer.
+#define BLOCK_LATENCY_BUCKETS 24
+
+typedef struct {
+    uint64_t ops;      // Requests completed
+    uint64_t bytes;    // Bytes they covered
+    uint64_t errors;   // Requests which failed
+    uint64_t total_ns; // Their latencies added up, from arrival to completion
+} block_op_counts_t;
+
+typedef struct {
+    block_op_counts_t counts;
+    uint64_t max_ns;
+    uint64_t latency[BLOCK_LATENCY_BUCKETS];
+} block_op_stats_t;
+
+typedef struct {
+    block_op_counts_t ops[BLOCK_STAT_COUNT];
+    uint32_t queue_depth;     // Requests which have arrived and not completed
+    uint32_t max_queue_depth;
+} block_client_stats_t;
+
+// Device statistics last as long as the device; those of each FIFO, or
+// client, as long as the server which has it.
+typedef struct {
+    uint64_t elapsed_ns; // Since the device's statistics started
+    block_op_stats_t ops[BLOCK_STAT_COUNT];
+    uint32_t queue_depth;
+    uint32_t max_queue_depth;
+    uint32_t client_count; // Zero while the device has no server
+    uint32_t reserved;
+    block_client_stats_t clients[BLOCK_MAX_FIFOS];
+} block_stats_t;
+
+// ssize_t ioctl_block_get_stats(int fd, block_stats_t* out);
+IOCTL_WRAPPER_OUT(ioctl_block_get_stats, IOCTL_BLOCK_GET_STATS, block_stats_t);
+
 // Multiple Block IO operations may be sent at once before a response is actually sent back.
 // Block IO ops may be sent concurrently to different vmoids, and they also may be sent
 // to different transactions at any point in time. Up to MAX_TXN_COUNT transactions may
@@ -114,9 +184,29 @@ IOCTL_WRAPPER(ioctl_block_fifo_close, IOCTL_BLOCK_FIFO_CLOSE);
 //    This response is sent once all operations either complete or a single operation fails.
 //    At this point, step (1) may begin again without reallocating the txn.
 //
-// For BLOCKIO_READ and BLOCKIO_WRITE, N may be greater than 1.
+// For BLOCKIO_READ, BLOCKIO_WRITE and BLOCKIO_DISCARD, N may be greater than 1.
 // Otherwise, N == 1 (skipping step (1) in the protocol above).
 //
+// Reads and writes may be reordered, and adjacent ones merged, before they
+// reach the device.
+//
+// The requests of a txn are carried out concurrently, so a BLOCKIO_SYNC only
+// covers the writes whose responses have been received before it was sent; it
+// ignores its vmoid. Writes with BLOCKIO_FUA need no BLOCKIO_SYNC after them,
+// and on devices which support it natively, cost less than one.
+//
+// A BLOCKIO_DISCARD says the 'length' bytes at 'dev_offset' are no longer
+// needed, so the device may free what holds them; it also ignores its vmoid.
+// What is read from a discarded range afterwards is unspecified until it is
+// written again, and devices which can't free anything complete it at once;
+// those which can have BLOCK_FLAG_DISCARD set in their block_info_t.
+//
+// Requests may be sent on any of a server's FIFOs, each of which it serves
+// concurrently; vmoids and txnids are shared between them. A single txn should
+// be used from one FIFO at a time, as its response is sent on the FIFO its first
+// request arrived on. Clients with many threads are expected to add a FIFO per
+// thread (or per CPU), rather than contend on one.
+//
 // Notes:
 // - txnids may operate on any number of vmoids at once.
 // - If additional requests are sent on the same txnid before step (3) has completed, then
@@ -144,11 +234,13 @@ IOCTL_WRAPPER(ioctl_block_fifo_close, IOCTL_BLOCK_FIFO_CLOSE);
 
 #define BLOCKIO_READ      0x0001 // Reads from the Block device into the VMO
 #define BLOCKIO_WRITE     0x0002 // Writes to the Block device from the VMO
-#define BLOCKIO_SYNC      0x0003 // Unimplemented
+#define BLOCKIO_SYNC      0x0003 // Makes the writes which have already completed durable
 #define BLOCKIO_CLOSE_VMO 0x0004 // Detaches the VMO from the block device; closes the handle to it.
+#define BLOCKIO_DISCARD   0x0005 // Lets the device free a range whose contents are no longer needed
 #define BLOCKIO_OP_MASK   0x00FF
 
 #define BLOCKIO_TXN_END   0x0100 // Expects response after request (and all previous) have completed
+#define BLOCKIO_FUA       0x0200 // For writes: durable once complete, without a later BLOCKIO_SYNC
 #define BLOCKIO_FLAG_MASK 0xFF00
 
 typedef struct {
@@ -0,0 +1,57 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Hardware performance counters, run through
+// mx_mtrace_control(MTRACE_KIND_COUNTERS).
+
+#pragma once
+
+#include <magenta/compiler.h>
+#include <stdint.h>
+
+__BEGIN_CDECLS
+
+// Programmable counters that can be configured, fewer may exist.
+#define MX_CPU_COUNTERS_MAX_PROGRAMMABLE 4
+
+// Fixed counters: instructions retired, core cycles and reference cycles.
+#define MX_CPU_COUNTERS_NUM_FIXED 3
+
+// Bits of an x86 event select that may be set: event, unit mask, user, os,
+// edge, invert and counter mask. A zero event select leaves the counter off.
+#define MX_CPU_COUNTERS_EVTSEL_MASK 0xff87ffffu
+#define MX_CPU_COUNTERS_EVTSEL_USR  (1u << 16)
+#define MX_CPU_COUNTERS_EVTSEL_OS   (1u << 17)
+
+// Each fixed counter has a 4 bit field in |fixed_ctrl|, of which the os (bit
+// 0) and user (bit 1) enables may be set.
+#define MX_CPU_COUNTERS_FIXED_MASK 0x333u
+#define MX_CPU_COUNTERS_FIXED_OS(n)  (1u << ((n) * 4))
+#define MX_CPU_COUNTERS_FIXED_USR(n) (2u << ((n) * 4))
+
+typedef struct mx_cpu_counters_config {
+    uint32_t evtsel[MX_CPU_COUNTERS_MAX_PROGRAMMABLE];
+    uint32_t fixed_ctrl;
+    uint32_t reserved;
+} mx_cpu_counters_config_t;
+
+typedef struct mx_cpu_counters {
+    uint64_t programmable[MX_CPU_COUNTERS_MAX_PROGRAMMABLE];
+    uint64_t fixed[MX_CPU_COUNTERS_NUM_FIXED];
+} mx_cpu_counters_t;
+
+// While counters are running for the calling thread or for every cpu, user
+// code can read them directly with rdpmc, which is much cheaper than a
+// syscall. Fixed counters are numbered from MX_CPU_COUNTERS_RDPMC_FIXED.
+#define MX_CPU_COUNTERS_RDPMC_FIXED (1u << 30)
+
+#if defined(__x86_64__)
+static inline uint64_t mx_cpu_counters_rdpmc(uint32_t counter) {
+    uint32_t lo, hi;
+    __asm__ volatile("rdpmc" : "=a"(lo), "=d"(hi) : "c"(counter));
+    return ((uint64_t)hi << 32) | lo;
+}
+#endif
+
+__END_CDECLS
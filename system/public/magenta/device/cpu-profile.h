@@ -0,0 +1,64 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Sampling cpu profiler, run through mx_mtrace_control(MTRACE_KIND_PROFILE).
+
+#pragma once
+
+#include <magenta/compiler.h>
+#include <magenta/types.h>
+#include <stdint.h>
+
+__BEGIN_CDECLS
+
+// What is counted between samples.
+#define MX_CPU_PROFILE_EVENT_CYCLES        0
+#define MX_CPU_PROFILE_EVENT_INSTRUCTIONS  1
+#define MX_CPU_PROFILE_EVENT_CACHE_MISSES  2
+#define MX_CPU_PROFILE_EVENT_BRANCH_MISSES 3
+
+// The longest interval between samples, in events.
+#define MX_CPU_PROFILE_MAX_PERIOD 0x7fffffffu
+
+typedef struct mx_cpu_profile_config {
+    // Samples are written here. The vmo is split evenly between the cpus and
+    // must not be decommitted or resized while sampling is running.
+    mx_handle_t vmo;
+    // One of MX_CPU_PROFILE_EVENT_*.
+    uint32_t event;
+    // A sample is taken every |period| events.
+    uint64_t period;
+} mx_cpu_profile_config_t;
+
+// Each cpu's share of the vmo, the vmo size divided by the number of cpus and
+// rounded down to a multiple of 8 bytes, starts with this header followed by
+// samples. Samples that don't fit once a cpu's share is full are dropped.
+typedef struct mx_cpu_profile_header {
+    // Bytes of samples that follow.
+    uint64_t size;
+    // Samples that did not fit.
+    uint64_t dropped;
+} mx_cpu_profile_header_t;
+
+// The sampled pc was in user mode. Only the pc is recorded for those, the
+// kernel can't walk a user stack from the profiling interrupt.
+#define MX_CPU_PROFILE_SAMPLE_USER (1u << 0)
+
+// The most pcs in one sample, the sampled pc and its callers.
+#define MX_CPU_PROFILE_MAX_PCS 11
+
+typedef struct mx_cpu_profile_sample {
+    // Monotonic time of the sample, in nanoseconds.
+    mx_time_t time;
+    // Koids of the process and thread that were running, 0 for a kernel
+    // thread.
+    uint64_t pid;
+    uint64_t tid;
+    uint32_t flags;
+    // Number of pcs that follow, the sampled pc first.
+    uint32_t num_pcs;
+    // uint64_t pcs[num_pcs];
+} mx_cpu_profile_sample_t;
+
+__END_CDECLS
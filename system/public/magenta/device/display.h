@@ -11,6 +11,15 @@
 
 #define MX_DISPLAY_FLAG_HW_FRAMEBUFFER (1 << 0)
 
+// How many buffers a client may have for page flipping
+#define MX_DISPLAY_MAX_BUFFERS 3
+
+// How many dirty rectangles one flush or present may carry
+#define MX_DISPLAY_MAX_REGIONS 16
+
+// Largest cursor image a display may be given
+#define MX_DISPLAY_MAX_CURSOR_SIZE 64
+
 typedef struct mx_display_info {
     uint32_t format;
     uint32_t width;
@@ -59,6 +68,69 @@ typedef struct mx_display_info {
 #define IOCTL_DISPLAY_SET_OWNER \
     IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_DISPLAY, 6)
 
+// Get one of the client's buffers, allocating it if need be.
+// Buffer 0 is the one IOCTL_DISPLAY_GET_FB returns.
+//   in: uint32_t (buffer index)
+//   out: ioctl_display_get_fb_t
+#define IOCTL_DISPLAY_GET_FB_BUFFER \
+    IOCTL(IOCTL_KIND_GET_HANDLE, IOCTL_FAMILY_DISPLAY, 7)
+
+// Flush several regions of the framebuffer at once
+//   in: ioctl_display_region_t[]
+//   out: none
+#define IOCTL_DISPLAY_FLUSH_FB_REGIONS \
+    IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_DISPLAY, 8)
+
+// Make one of the client's buffers the one on screen, updating only
+// the regions given (or all of it if there are none).  The buffer that
+// was on screen before may be drawn into as soon as this returns.
+//   in: ioctl_display_present_t, followed by its regions
+//   out: none
+#define IOCTL_DISPLAY_PRESENT \
+    IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_DISPLAY, 9)
+
+// Get an event that is signaled with MX_USER_SIGNAL_0 each time a
+// presented buffer reaches the display.  Clients clear the signal
+// themselves before presenting the next one.
+//   in: none
+//   out: mx_handle_t
+#define IOCTL_DISPLAY_GET_PRESENT_EVENT \
+    IOCTL(IOCTL_KIND_GET_HANDLE, IOCTL_FAMILY_DISPLAY, 10)
+
+// Give the display a cursor image, which it shows on a hardware plane
+// over the framebuffer until the next one (or IOCTL_DISPLAY_MOVE_CURSOR
+// hides it).  The vmo holds 32 bit ARGB pixels, width * height of them,
+// with no padding between rows.  Fails with MX_ERR_NOT_SUPPORTED on
+// displays that have no cursor plane.
+//   in: ioctl_display_cursor_t
+//   out: none
+#define IOCTL_DISPLAY_SET_CURSOR \
+    IOCTL(IOCTL_KIND_SET_HANDLE, IOCTL_FAMILY_DISPLAY, 11)
+
+// Move the cursor, or show or hide it.  Moving it does not touch the
+// framebuffer.
+//   in: ioctl_display_cursor_position_t
+//   out: none
+#define IOCTL_DISPLAY_MOVE_CURSOR \
+    IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_DISPLAY, 12)
+
+// Fill a region of the client's current buffer with one color, and of
+// the display if the client owns it.  The display is filled by its
+// blitter where it has one, rather than by copying the region over.
+//   in: ioctl_display_fill_t
+//   out: none
+#define IOCTL_DISPLAY_FILL_FB_REGION \
+    IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_DISPLAY, 13)
+
+// Copy a region of the client's current buffer to (dst_x, dst_y) in it,
+// and the same on the display if the client owns it.  The regions may
+// overlap, which is what scrolling does.  The source region should have
+// been flushed, since the blitter copies from what is on screen.
+//   in: ioctl_display_copy_t
+//   out: none
+#define IOCTL_DISPLAY_COPY_FB_REGION \
+    IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_DISPLAY, 14)
+
 typedef struct {
     mx_handle_t vmo;
     mx_display_info_t info;
@@ -71,6 +143,37 @@ typedef struct {
     uint32_t height;
 } ioctl_display_region_t;
 
+typedef struct {
+    uint32_t buffer;
+    uint32_t region_count;
+    ioctl_display_region_t regions[];
+} ioctl_display_present_t;
+
+typedef struct {
+    mx_handle_t vmo;
+    uint32_t width;
+    uint32_t height;
+} ioctl_display_cursor_t;
+
+typedef struct {
+    // where the top left of the cursor image goes, which may be off screen
+    int32_t x;
+    int32_t y;
+    uint32_t visible;
+} ioctl_display_cursor_position_t;
+
+typedef struct {
+    ioctl_display_region_t region;
+    // in the display's pixel format
+    uint32_t color;
+} ioctl_display_fill_t;
+
+typedef struct {
+    ioctl_display_region_t src;
+    uint32_t dst_x;
+    uint32_t dst_y;
+} ioctl_display_copy_t;
+
 // ssize_t ioctl_display_get_fb(int fd, ioctl_display_get_fb_t* out);
 IOCTL_WRAPPER_OUT(ioctl_display_get_fb, IOCTL_DISPLAY_GET_FB, ioctl_display_get_fb_t);
 
@@ -87,4 +190,28 @@ IOCTL_WRAPPER_IN(ioctl_display_set_fullscreen, IOCTL_DISPLAY_SET_FULLSCREEN, uin
 IOCTL_WRAPPER_OUT(ioctl_display_get_ownership_change_event, IOCTL_DISPLAY_GET_OWNERSHIP_CHANGE_EVENT, mx_handle_t);
 
 // ssize_t ioctl_display_set_owner(int fd, uint32_t owner);
-IOCTL_WRAPPER_IN(ioctl_display_set_owner, IOCTL_DISPLAY_SET_OWNER, uint32_t)
\ No newline at end of file
+IOCTL_WRAPPER_IN(ioctl_display_set_owner, IOCTL_DISPLAY_SET_OWNER, uint32_t);
+
+// ssize_t ioctl_display_get_fb_buffer(int fd, const uint32_t* index, ioctl_display_get_fb_t* out);
+IOCTL_WRAPPER_INOUT(ioctl_display_get_fb_buffer, IOCTL_DISPLAY_GET_FB_BUFFER, uint32_t, ioctl_display_get_fb_t);
+
+// ssize_t ioctl_display_flush_fb_regions(int fd, const ioctl_display_region_t* in, size_t in_len);
+IOCTL_WRAPPER_VARIN(ioctl_display_flush_fb_regions, IOCTL_DISPLAY_FLUSH_FB_REGIONS, ioctl_display_region_t);
+
+// ssize_t ioctl_display_present(int fd, const ioctl_display_present_t* in, size_t in_len);
+IOCTL_WRAPPER_VARIN(ioctl_display_present, IOCTL_DISPLAY_PRESENT, ioctl_display_present_t);
+
+// ssize_t ioctl_display_get_present_event(int fd, mx_handle_t* out);
+IOCTL_WRAPPER_OUT(ioctl_display_get_present_event, IOCTL_DISPLAY_GET_PRESENT_EVENT, mx_handle_t);
+
+// ssize_t ioctl_display_set_cursor(int fd, const ioctl_display_cursor_t* in);
+IOCTL_WRAPPER_IN(ioctl_display_set_cursor, IOCTL_DISPLAY_SET_CURSOR, ioctl_display_cursor_t);
+
+// ssize_t ioctl_display_move_cursor(int fd, const ioctl_display_cursor_position_t* in);
+IOCTL_WRAPPER_IN(ioctl_display_move_cursor, IOCTL_DISPLAY_MOVE_CURSOR, ioctl_display_cursor_position_t);
+
+// ssize_t ioctl_display_fill_fb_region(int fd, const ioctl_display_fill_t* in);
+IOCTL_WRAPPER_IN(ioctl_display_fill_fb_region, IOCTL_DISPLAY_FILL_FB_REGION, ioctl_display_fill_t);
+
+// ssize_t ioctl_display_copy_fb_region(int fd, const ioctl_display_copy_t* in);
+IOCTL_WRAPPER_IN(ioctl_display_copy_fb_region, IOCTL_DISPLAY_COPY_FB_REGION, ioctl_display_copy_t);
@@ -26,6 +26,12 @@ typedef struct eth_info_t {
 } eth_info_t;
 
 #define ETH_FEATURE_WLAN 1
+// The device verifies the TCP and UDP checksums of packets it receives,
+// marking those it finds good with ETH_FIFO_RX_CSUM_OK.
+#define ETH_FEATURE_RX_CSUM 2
+// The device inserts the TCP or UDP checksum of packets sent with
+// ETH_FIFO_TX_CSUM.
+#define ETH_FEATURE_TX_CSUM 4
 
 // Get the fifos to submit tx and rx operations
 //   in: none
@@ -66,6 +72,166 @@ typedef struct eth_fifos_t {
 #define IOCTL_ETHERNET_SET_CLIENT_NAME \
     IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_ETH, 7)
 
+// Get/Set how the device moderates its interrupts. Devices which don't
+// fail with MX_ERR_NOT_SUPPORTED.
+//   in: eth_irq_moderation_t* (set)
+//  out: eth_irq_moderation_t* (get)
+#define IOCTL_ETHERNET_GET_IRQ_MODERATION \
+    IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_ETH, 8)
+#define IOCTL_ETHERNET_SET_IRQ_MODERATION \
+    IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_ETH, 9)
+
+typedef struct eth_irq_moderation {
+    // least time between interrupts, so that each finds a batch of
+    // packets; zero for an interrupt as soon as one arrives
+    uint32_t interval_us;
+    // time to keep polling with interrupts off once packets stop, for
+    // the lowest latency at the cost of a busy cpu; zero for none
+    uint32_t poll_us;
+    uint32_t reserved[2];
+} eth_irq_moderation_t;
+
+// Receive-side scaling: received packets are spread over several rx
+// fifos by the flow they belong to, so that each may be served by a
+// thread of its own while every packet of a flow arrives in order on
+// the same one. The flow's addresses (and ports, for TCP and UDP over
+// IPv4 or IPv6) are hashed with the Toeplitz hash, and the low bits of
+// the hash index a table of rx queues. Other packets go to queue 0,
+// the rx fifo from IOCTL_ETHERNET_GET_FIFOS. Each queue's fifo takes
+// rx buffers and returns packets as that one does. Until a table is
+// set, packets are spread evenly over the queues there are.
+#define ETH_RX_QUEUES_MAX  8
+#define ETH_RSS_KEY_SIZE   40
+#define ETH_RSS_TABLE_SIZE 128
+
+// Add an rx queue, returning its fifo. Fails with MX_ERR_NO_RESOURCES
+// once there are ETH_RX_QUEUES_MAX, and MX_ERR_BAD_STATE until the
+// fifos have been obtained.
+//   in: none
+//  out: mx_handle_t*
+#define IOCTL_ETHERNET_ADD_RX_QUEUE \
+    IOCTL(IOCTL_KIND_GET_HANDLE, IOCTL_FAMILY_ETH, 10)
+
+// Set the hash key and the queue each hash goes to.
+//   in: eth_rss_config_t*
+//  out: none
+#define IOCTL_ETHERNET_SET_RSS_CONFIG \
+    IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_ETH, 11)
+
+typedef struct eth_rss_config {
+    uint8_t key[ETH_RSS_KEY_SIZE];
+    // rx queue of each hash, by its low bits; queues not yet added
+    // stand for queue 0
+    uint8_t table[ETH_RSS_TABLE_SIZE];
+} eth_rss_config_t;
+
+// Capture: copies of the packets an instance's device receives and
+// sends are appended, as they pass and whether or not it is started, to a
+// ring in a vmo shared with it. Only packets every term of the filter
+// matches are copied, and only the first |snaplen| bytes of each, so that
+// capturing a little of a busy link costs it little. The ring is
+// eth_capture_ring_t, followed by |size| bytes of records (a power of two,
+// from 4K to 16M). Each is an eth_capture_record_t, then its data, padded
+// to 8 bytes. None wraps: when one doesn't fit before the end, that is
+// skipped, and marked with an ETH_CAPTURE_WRAP record if there's room.
+//
+// |head| and |tail| count bytes ever appended and read. The device
+// advances |head| once a record is written; the client advances |tail|
+// once done with it. Records which don't fit are counted in |dropped|.
+// MX_USER_SIGNAL_0 is raised on the event whenever the device appends to
+// an empty ring, so the client clears it, then sees if |head| has moved,
+// and only if not waits for it.
+//   in: eth_capture_config_t*
+//  out: eth_capture_handles_t*
+#define IOCTL_ETHERNET_START_CAPTURE \
+    IOCTL(IOCTL_KIND_GET_TWO_HANDLES, IOCTL_FAMILY_ETH, 12)
+#define IOCTL_ETHERNET_STOP_CAPTURE \
+    IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_ETH, 13)
+
+#define ETH_CAPTURE_RX   (1u)
+#define ETH_CAPTURE_TX   (2u)
+#define ETH_CAPTURE_WRAP (4u)   // the rest of the ring is unused
+
+#define ETH_CAPTURE_MATCH_MAX 4
+#define ETH_CAPTURE_SIZE_MIN  (4096u)
+#define ETH_CAPTURE_SIZE_MAX  (16u * 1024 * 1024)
+
+// Matches if the big-endian value of |size| (1, 2 or 4) bytes at |offset|
+// in the frame, and'ed with |mask|, is |value|.
+typedef struct eth_capture_match {
+    uint16_t offset;
+    uint8_t size;
+    uint8_t reserved;
+    uint32_t mask;
+    uint32_t value;
+} eth_capture_match_t;
+
+typedef struct eth_capture_config {
+    // ETH_CAPTURE_RX and/or ETH_CAPTURE_TX
+    uint32_t flags;
+    // bytes kept of each packet; zero for all of it
+    uint32_t snaplen;
+    // of the ring's records
+    uint32_t size;
+    uint32_t match_count;
+    eth_capture_match_t match[ETH_CAPTURE_MATCH_MAX];
+} eth_capture_config_t;
+
+typedef struct eth_capture_handles {
+    // the ring, to map read/write
+    mx_handle_t vmo;
+    mx_handle_t event;
+} eth_capture_handles_t;
+
+typedef struct eth_capture_ring {
+    uint64_t head;
+    uint64_t tail;
+    uint64_t dropped;
+    uint32_t size;
+    uint32_t reserved[9];
+} eth_capture_ring_t;
+
+typedef struct eth_capture_record {
+    mx_time_t timestamp;
+    // of the data captured, which follows
+    uint32_t length;
+    // of the packet
+    uint32_t orig_length;
+    // ETH_CAPTURE_RX, ETH_CAPTURE_TX or ETH_CAPTURE_WRAP
+    uint32_t flags;
+    uint32_t reserved;
+} eth_capture_record_t;
+
+// Get the counts of packets the device, and this instance, have passed
+// and dropped.
+//   in: none
+//  out: eth_stats_t*
+#define IOCTL_ETHERNET_GET_STATS \
+    IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_ETH, 14)
+
+typedef struct eth_stats {
+    // what the device has received and sent, for all its instances
+    uint64_t rx_packets;
+    uint64_t rx_bytes;
+    uint64_t tx_packets;
+    uint64_t tx_bytes;
+    // what this instance has been given and has had sent
+    uint64_t client_rx_packets;
+    uint64_t client_rx_bytes;
+    uint64_t client_tx_packets;
+    uint64_t client_tx_bytes;
+    // packets dropped for this instance, for want of an rx buffer, as it
+    // wasn't reading its rx fifo, or as they came back invalid
+    uint64_t rx_no_buffer;
+    uint64_t rx_dropped;
+    uint64_t tx_invalid;
+    // times the instance's rx and tx fifos had no room for what was
+    // done, and those buffers were lost
+    uint64_t rx_fifo_full;
+    uint64_t tx_fifo_full;
+    uint64_t reserved[3];
+} eth_stats_t;
+
 // Operation
 //
 // Packets are transmitted by writing data into the io_vmo and writing
@@ -88,13 +254,17 @@ typedef struct eth_fifos_t {
 // are returned along with the fifo handles in the eth_fifos_t.
 
 // flags values for request messages
-// - none -
+// Insert the TCP or UDP checksum of an IPv4 or IPv6 packet, whose
+// checksum field holds the sum of its pseudo-header. Only with
+// ETH_FEATURE_TX_CSUM; otherwise the packet is returned invalid.
+#define ETH_FIFO_TX_CSUM (1u)
 
 // flags values for response messages
 #define ETH_FIFO_RX_OK   (1u)   // packet received okay
 #define ETH_FIFO_TX_OK   (1u)   // packet transmitted okay
 #define ETH_FIFO_INVALID (2u)   // offset+length not within io_vmo bounds
 #define ETH_FIFO_RX_TX   (4u)   // received our own tx packet (when TX_LISTEN)
+#define ETH_FIFO_RX_CSUM_OK (8u) // device found the TCP or UDP checksum good
 
 typedef struct eth_fifo_entry {
     // offset from start of io_vmo to packet data
@@ -129,3 +299,28 @@ IOCTL_WRAPPER(ioctl_ethernet_tx_listen_stop, IOCTL_ETHERNET_TX_LISTEN_STOP);
 
 // ssize_t ioctl_ethernet_set_client_name(int fd, const char* in, size_t in_len);
 IOCTL_WRAPPER_VARIN(ioctl_ethernet_set_client_name, IOCTL_ETHERNET_SET_CLIENT_NAME, char);
+
+// ssize_t ioctl_ethernet_get_irq_moderation(int fd, eth_irq_moderation_t* out);
+IOCTL_WRAPPER_OUT(ioctl_ethernet_get_irq_moderation, IOCTL_ETHERNET_GET_IRQ_MODERATION,
+                  eth_irq_moderation_t);
+
+// ssize_t ioctl_ethernet_set_irq_moderation(int fd, const eth_irq_moderation_t* in);
+IOCTL_WRAPPER_IN(ioctl_ethernet_set_irq_moderation, IOCTL_ETHERNET_SET_IRQ_MODERATION,
+                 eth_irq_moderation_t);
+
+// ssize_t ioctl_ethernet_add_rx_queue(int fd, mx_handle_t* out);
+IOCTL_WRAPPER_OUT(ioctl_ethernet_add_rx_queue, IOCTL_ETHERNET_ADD_RX_QUEUE, mx_handle_t);
+
+// ssize_t ioctl_ethernet_set_rss_config(int fd, const eth_rss_config_t* in);
+IOCTL_WRAPPER_IN(ioctl_ethernet_set_rss_config, IOCTL_ETHERNET_SET_RSS_CONFIG, eth_rss_config_t);
+
+// ssize_t ioctl_ethernet_start_capture(int fd, const eth_capture_config_t* in,
+//                                      eth_capture_handles_t* out);
+IOCTL_WRAPPER_INOUT(ioctl_ethernet_start_capture, IOCTL_ETHERNET_START_CAPTURE,
+                    eth_capture_config_t, eth_capture_handles_t);
+
+// ssize_t ioctl_ethernet_stop_capture(int fd);
+IOCTL_WRAPPER(ioctl_ethernet_stop_capture, IOCTL_ETHERNET_STOP_CAPTURE);
+
+// ssize_t ioctl_ethernet_get_stats(int fd, eth_stats_t* out);
+IOCTL_WRAPPER_OUT(ioctl_ethernet_get_stats, IOCTL_ETHERNET_GET_STATS, eth_stats_t);
@@ -4,9 +4,11 @@
 
 #pragma once
 
+#include <assert.h>
 #include <stdint.h>
 #include <magenta/device/ioctl.h>
 #include <magenta/device/ioctl-wrapper.h>
+#include <magenta/types.h>
 
 #define IOCTL_INPUT_GET_PROTOCOL \
     IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_INPUT, 0)
@@ -26,6 +28,10 @@
     IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_INPUT, 7)
 #define IOCTL_INPUT_SET_REPORT \
     IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_INPUT, 8)
+#define IOCTL_INPUT_GET_REPORT_FIFO \
+    IOCTL(IOCTL_KIND_GET_HANDLE, IOCTL_FAMILY_INPUT, 9)
+#define IOCTL_INPUT_GET_REPORT_SIZES \
+    IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_INPUT, 10)
 
 enum {
     INPUT_PROTO_NONE = 0,
@@ -59,6 +65,32 @@ typedef struct input_set_report {
     uint8_t data[];
 } input_set_report_t;
 
+// The sizes, in bytes, of one report ID's input, output and feature reports,
+// as parsed from the report descriptor. Zero for a type the ID doesn't have.
+typedef struct input_report_sizes {
+    input_report_id_t id;
+    input_report_size_t in_size;
+    input_report_size_t out_size;
+    input_report_size_t feat_size;
+} input_report_sizes_t;
+
+// One input report, as delivered through the fifo returned by
+// IOCTL_INPUT_GET_REPORT_FIFO. |timestamp| is when the report came in from
+// the device. Devices with input reports larger than
+// INPUT_REPORT_ENTRY_MAX_DATA don't support the fifo.
+#define INPUT_REPORT_FIFO_DEPTH     32
+#define INPUT_REPORT_ENTRY_MAX_DATA 112
+
+typedef struct input_report_entry {
+    mx_time_t timestamp;
+    input_report_size_t len;
+    uint8_t reserved[6];
+    uint8_t data[INPUT_REPORT_ENTRY_MAX_DATA];
+} input_report_entry_t;
+
+static_assert(sizeof(input_report_entry_t) * INPUT_REPORT_FIFO_DEPTH <= 4096,
+              "report fifo is too large");
+
 typedef struct boot_kbd_report {
     uint8_t modifier;
     uint8_t reserved;
@@ -103,3 +135,12 @@ IOCTL_WRAPPER_IN_VAROUT(ioctl_input_get_report, IOCTL_INPUT_GET_REPORT,
 
 // ssize_t ioctl_input_set_report(int fd, const input_set_report_t* in, size_t in_len);
 IOCTL_WRAPPER_VARIN(ioctl_input_set_report, IOCTL_INPUT_SET_REPORT, input_set_report_t);
+
+// ssize_t ioctl_input_get_report_fifo(int fd, mx_handle_t* out);
+// Once an instance has handed out its fifo, its input reports go there,
+// as many to a read as the reader asks for, rather than to read().
+IOCTL_WRAPPER_OUT(ioctl_input_get_report_fifo, IOCTL_INPUT_GET_REPORT_FIFO, mx_handle_t);
+
+// ssize_t ioctl_input_get_report_sizes(int fd, input_report_sizes_t* out, size_t out_len);
+IOCTL_WRAPPER_VAROUT(ioctl_input_get_report_sizes, IOCTL_INPUT_GET_REPORT_SIZES,
+        input_report_sizes_t);
@@ -22,9 +22,25 @@
 #define IOCTL_KTRACE_ADD_PROBE \
     IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_KTRACE, 2)
 
+// switch ktrace probes on or off
+// input: ascii probe name, or a name prefix ending in '*' for every probe
+// starting with it, < MX_MAX_NAME_LEN
+#define IOCTL_KTRACE_ENABLE_PROBE \
+    IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_KTRACE, 3)
+#define IOCTL_KTRACE_DISABLE_PROBE \
+    IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_KTRACE, 4)
+
 IOCTL_WRAPPER_OUT(ioctl_ktrace_get_handle, IOCTL_KTRACE_GET_HANDLE, mx_handle_t);
 
 static inline mx_status_t ioctl_ktrace_add_probe(int fd, const char* name, uint32_t* probe_id) {
     return mxio_ioctl(fd, IOCTL_KTRACE_ADD_PROBE,
                       name, strlen(name), probe_id, sizeof(uint32_t));
 }
+
+static inline mx_status_t ioctl_ktrace_enable_probe(int fd, const char* name) {
+    return mxio_ioctl(fd, IOCTL_KTRACE_ENABLE_PROBE, name, strlen(name), NULL, 0);
+}
+
+static inline mx_status_t ioctl_ktrace_disable_probe(int fd, const char* name) {
+    return mxio_ioctl(fd, IOCTL_KTRACE_DISABLE_PROBE, name, strlen(name), NULL, 0);
+}
@@ -48,6 +48,18 @@
 #define IOCTL_VFS_WATCH_DIR_V2 \
     IOCTL(IOCTL_KIND_SET_HANDLE, IOCTL_FAMILY_VFS, 8)
 
+// Let go of what the filesystem keeps cached only to speed up later
+// accesses, such as closed files, when memory is running low.
+#define IOCTL_VFS_DROP_CACHE \
+    IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_VFS, 9)
+
+// Keep (nonzero) or stop keeping (zero) the contents of a file cached, however
+// long since they were last used and whatever IOCTL_VFS_DROP_CACHE lets go of.
+// Meant for the few files nearly every process needs, such as the loader and
+// libc. in: uint32_t.
+#define IOCTL_VFS_PIN_CACHE \
+    IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_VFS, 10)
+
 typedef struct {
     mx_handle_t channel; // Channel to which watch events will be sent
     uint32_t mask;       // Bitmask of desired events (1 << WATCH_EVT_*)
@@ -127,6 +139,12 @@ IOCTL_WRAPPER_OUT(ioctl_vfs_watch_dir, IOCTL_VFS_WATCH_DIR, mx_handle_t);
 // ssize_t ioctl_vfs_watch_dir_v2(int fd, vfs_watch_dir_t* in;
 IOCTL_WRAPPER_IN(ioctl_vfs_watch_dir_v2, IOCTL_VFS_WATCH_DIR_V2, vfs_watch_dir_t);
 
+// ssize_t ioctl_vfs_drop_cache(int fd);
+IOCTL_WRAPPER(ioctl_vfs_drop_cache, IOCTL_VFS_DROP_CACHE);
+
+// ssize_t ioctl_vfs_pin_cache(int fd, const uint32_t* pin);
+IOCTL_WRAPPER_IN(ioctl_vfs_pin_cache, IOCTL_VFS_PIN_CACHE, uint32_t);
+
 #define MOUNT_MKDIR_FLAG_REPLACE 1
 
 typedef struct mount_mkdir_config {
@@ -10,6 +10,7 @@
 
 KTRACE_DEF(0x000,32B,VERSION,META) // version
 KTRACE_DEF(0x001,32B,TICKS_PER_MS,META) // lo32, hi32
+KTRACE_DEF(0x002,32B,CPU_BUFFER,META) // cpu, bytes of records that follow, records dropped
 
 KTRACE_DEF(0x020,NAME,KTHREAD_NAME,META) // ktid, 0, name[]
 KTRACE_DEF(0x021,NAME,THREAD_NAME,META) // tid, pid, name[]
@@ -25,6 +26,10 @@ KTRACE_DEF(0x033,16B,SYSCALL_EXIT,IRQ) // (n << 8) | cpu
 
 KTRACE_DEF(0x034,32B,PAGE_FAULT,IRQ) // virtual_address_hi, virtual_address_lo, flags, cpu
 
+// only with syscall hooks built in
+KTRACE_DEF(0x035,32B,SYSCALL_ARGS,IRQ) // n, arg0, arg1, arg2 (low 32 bits)
+KTRACE_DEF(0x036,32B,SYSCALL_DONE,IRQ) // n, ret_lo, ret_hi, ns
+
 KTRACE_DEF(0x040,32B,CONTEXT_SWITCH,SCHEDULER) // to-tid, (state<<16|cpu), from-kt, to-kt
 
 // events from 0x100 on all share the tag/tid/ts common header
@@ -51,6 +56,9 @@ KTRACE_DEF(0x143,32B,PORT_QUEUE,IPC) // id, size
 KTRACE_DEF(0x150,32B,WAIT_ONE,IPC) // id, signals, timeoutlo, timeouthi
 KTRACE_DEF(0x151,32B,WAIT_ONE_DONE,IPC) // id, status, pending
 
+// only with kernel lock stats built in
+KTRACE_DEF(0x160,32B,LOCK_CONTENDED,LOCKS) // site_lo, site_hi, wait_ns, lock_lo
+
 // events from 0x200-0x2ff are for arch-specific needs
 
 #ifdef __x86_64__
@@ -58,6 +66,7 @@ KTRACE_DEF(0x200,32B,IPT_START,ARCH) // MSR_PLATFORM_INFO[15:8], kernel cr3
 KTRACE_DEF(0x201,32B,IPT_CPU_INFO,ARCH) // family, model, stepping
 KTRACE_DEF(0x202,32B,IPT_STOP,ARCH)
 KTRACE_DEF(0x203,32B,IPT_PROCESS_CREATE,ARCH) // pid, cr3
+KTRACE_DEF(0x210,32B,VCPU_EXIT,ARCH) // exit reason, guest rip lo, guest rip hi, handling ns
 #endif
 
 #undef KTRACE_DEF
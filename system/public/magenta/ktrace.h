@@ -46,6 +46,7 @@ __BEGIN_CDECLS
 #define KTRACE_GRP_IRQ            0x020
 #define KTRACE_GRP_PROBE          0x040
 #define KTRACE_GRP_ARCH           0x080
+#define KTRACE_GRP_LOCKS          0x100
 
 #define KTRACE_GRP_TO_MASK(grp)   ((grp) << 20)
 
@@ -88,5 +89,21 @@ enum {
 #define KTRACE_ACTION_STOP      2 // options ignored
 #define KTRACE_ACTION_REWIND    3 // options ignored
 #define KTRACE_ACTION_NEW_PROBE 4 // options ignored, ptr = name
+#define KTRACE_ACTION_SET_MODE  5 // options = KTRACE_MODE_*, only while stopped
+#define KTRACE_ACTION_ENABLE_PROBE  6 // options ignored, ptr = name, or prefix ending in '*'
+#define KTRACE_ACTION_DISABLE_PROBE 7 // options ignored, ptr = name, or prefix ending in '*'
+
+// Probes whose names start with this make up the boot timeline. Each is
+// written as its stage ends: arg0 is how long the stage took in
+// microseconds, 0 for one that only marks a point in time, and arg1 is
+// whatever the stage has to add, such as a status.
+#define KTRACE_BOOT_PREFIX      "boot:"
+
+// What happens when a cpu's trace buffer fills up
+#define KTRACE_MODE_ONESHOT     0 // tracing stops
+#define KTRACE_MODE_RING        1 // the oldest records are overwritten
+#define KTRACE_MODE_STREAM      2 // new records are dropped until a reader
+                                  // drains the buffer, reads consume records
+                                  // and ignore the offset
 
 __END_CDECLS
@@ -12,11 +12,14 @@
 
 __BEGIN_CDECLS
 
-// mtrace_control() can operate on a range of features, for now just IPT.
+// mtrace_control() can operate on a range of features, for now IPT, the
+// sampling cpu profiler and the performance counters.
 // It's an abstraction that doesn't mean much, and will likely be replaced
 // before it's useful; it's here in the interests of hackability in the
 // interim.
 #define MTRACE_KIND_IPT 0
+#define MTRACE_KIND_PROFILE 1
+#define MTRACE_KIND_COUNTERS 2
 
 // Actions for perf_control
 
@@ -45,4 +48,33 @@ __BEGIN_CDECLS
 
 #define MTRACE_IPT_OPTIONS_CPU(options) ((options) & MTRACE_IPT_OPTIONS_CPU_MASK)
 
+// Sampling profiler actions, see magenta/device/cpu-profile.h
+
+// Start sampling every cpu, arg = mx_cpu_profile_config_t.
+#define MTRACE_PROFILE_START 0
+
+// Stop sampling, options and arg unused.
+#define MTRACE_PROFILE_STOP 1
+
+// Performance counter actions, see magenta/device/cpu-counters.h
+// Counting is either for every cpu or for threads that asked for it, not
+// both, and not while the sampling profiler is running.
+
+// Count on every cpu all the time, arg = mx_cpu_counters_config_t.
+#define MTRACE_COUNTERS_START_CPUS 0
+
+// Count while the calling thread runs, arg = mx_cpu_counters_config_t.
+// The counters are saved and restored when the thread is switched.
+#define MTRACE_COUNTERS_START_THREAD 1
+
+// Read the counters of a cpu, or of the calling thread with
+// MTRACE_COUNTERS_OPTIONS_THREAD, arg = mx_cpu_counters_t.
+#define MTRACE_COUNTERS_READ 2
+
+// Stop counting everywhere, for every thread, options and arg unused.
+#define MTRACE_COUNTERS_STOP 3
+
+#define MTRACE_COUNTERS_OPTIONS_THREAD (1u << 31)
+#define MTRACE_COUNTERS_OPTIONS_CPU(options) ((options) & 0xff)
+
 __END_CDECLS
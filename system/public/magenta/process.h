@@ -29,4 +29,12 @@ mx_handle_t mx_vmar_root_self(void);
 mx_handle_t _mx_job_default(void);
 mx_handle_t mx_job_default(void);
 
+// The koids of the calling process and thread.  Only the first call made
+// in a process, or on a thread, asks the kernel; the rest are just loads.
+mx_koid_t _mx_process_self_koid(void);
+mx_koid_t mx_process_self_koid(void);
+
+mx_koid_t _mx_thread_self_koid(void);
+mx_koid_t mx_thread_self_koid(void);
+
 __END_CDECLS
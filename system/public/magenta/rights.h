@@ -24,6 +24,9 @@
 
 #define MX_DEFAULT_HYPERVISOR_RIGHTS MX_RIGHT_EXECUTE
 
+#define MX_DEFAULT_VCPU_RIGHTS \
+  (MX_RIGHT_READ | MX_RIGHT_WRITE | MX_RIGHT_EXECUTE)
+
 #define MX_DEFAULT_INTERRUPT_RIGHTS \
   (MX_RIGHT_TRANSFER | MX_RIGHT_READ | MX_RIGHT_WRITE)
 
@@ -7,8 +7,10 @@
 #include <magenta/types.h>
 #include <magenta/syscalls/types.h>
 
+#include <magenta/syscalls/batch.h>
 #include <magenta/syscalls/pci.h>
 #include <magenta/syscalls/object.h>
+#include <magenta/syscalls/port.h>
 
 __BEGIN_CDECLS
 
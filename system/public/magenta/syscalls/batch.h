@@ -0,0 +1,28 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <magenta/types.h>
+
+__BEGIN_CDECLS
+
+// mx_batch_op_t operations, each equivalent to the syscall of the same
+// name called with the given arguments.
+#define MX_BATCH_OP_HANDLE_CLOSE        1u  // (handle)
+#define MX_BATCH_OP_OBJECT_SIGNAL       2u  // (handle, clear_mask, set_mask)
+#define MX_BATCH_OP_OBJECT_SIGNAL_PEER  3u  // (handle, clear_mask, set_mask)
+#define MX_BATCH_OP_PORT_QUEUE          4u  // (handle, packet, size)
+#define MX_BATCH_OP_VMO_OP_RANGE        5u  // (handle, op, offset, size)
+
+typedef struct mx_batch_op {
+    uint32_t op;
+    mx_handle_t handle;
+    uint64_t args[3];
+    // Filled in with the result of the operation.
+    mx_status_t status;
+    uint32_t reserved;
+} mx_batch_op_t;
+
+__END_CDECLS
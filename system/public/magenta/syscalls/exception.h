@@ -150,6 +150,11 @@ typedef struct mx_exception_report {
 // When unbinding an exception port from a thread or process, any threads that
 // got an exception and are waiting for a response from this exception port
 // will continue to wait for a response.
+#define MX_EXCEPTION_PORT_ASYNC_THREAD_EVENTS (4)
+// Only meaningful when combined with MX_EXCEPTION_PORT_DEBUGGER.
+// MX_EXCP_THREAD_STARTING and MX_EXCP_THREAD_EXITING are reported without
+// stopping the thread, which carries on as soon as the report is queued.
+// These reports must not be answered with mx_task_resume().
 
 // The type of exception port a thread may be waiting for a response from.
 // These values are reported in mx_info_thread_t.wait_exception_port_type.
@@ -26,6 +26,85 @@ __BEGIN_CDECLS
 #if __x86_64__
 #define MX_HYPERVISOR_OP_GUEST_SET_ENTRY_CR3    8u
 #define MX_HYPERVISOR_OP_GUEST_SET_APIC_MEM     9u
+#define MX_HYPERVISOR_OP_GUEST_SET_BELL         10u
+#define MX_HYPERVISOR_OP_GUEST_SET_INTERRUPT_EVENT 11u
+#endif // __x86_64__
+
+// Creates another VCPU in the guest.  The argument is the handle of the
+// control FIFO for the VCPU, and the result is the handle of the VCPU.
+//
+// The VCPUs of a guest share its memory, and can be entered in parallel from
+// different threads.  The ops that act on a single VCPU (ENTER, INTERRUPT,
+// SET_GPR, GET_GPR, SET_ENTRY_IP, SET_ENTRY_CR3 and SET_APIC_MEM) take
+// either a VCPU handle or the guest handle, which stands for the first VCPU.
+#define MX_HYPERVISOR_OP_VCPU_CREATE            12u
+
+#if __x86_64__
+#define MX_HYPERVISOR_OP_GUEST_GET_EXIT_STATS   13u
+#endif // __x86_64__
+
+// Kinds of guest write that may ring a bell.
+
+#define MX_GUEST_BELL_PORT_OUT                  1u
+#define MX_GUEST_BELL_MEM_WRITE                 2u
+
+// Arguments to MX_HYPERVISOR_OP_GUEST_SET_BELL.
+//
+// A guest write to a port in [addr, addr + len), or to guest physical
+// memory in [addr, addr + len), signals the event with MX_EVENT_SIGNALED
+// and the guest carries on, without a packet on the control FIFO.  What was
+// written is not kept, so bells suit doorbells such as a virtio queue
+// notify, where the write itself is what matters.  Memory bells only ring
+// for addresses that are trapped with MX_HYPERVISOR_OP_GUEST_MEM_TRAP.
+// Setting a bell with an event of MX_HANDLE_INVALID removes the bell at
+// |addr|.
+typedef struct mx_guest_bell {
+    mx_handle_t event;
+    uint32_t kind;
+    uint64_t addr;
+    uint64_t len;
+} mx_guest_bell_t;
+
+// Arguments to MX_HYPERVISOR_OP_GUEST_SET_INTERRUPT_EVENT.
+//
+// Each time MX_EVENT_SIGNALED goes from clear to set on the event, the
+// guest is sent |interrupt|, as if by MX_HYPERVISOR_OP_GUEST_INTERRUPT.
+// To send another, the host clears the signal and then, separately, sets it
+// again.
+typedef struct mx_guest_interrupt_event {
+    mx_handle_t event;
+    uint32_t interrupt;
+} mx_guest_interrupt_event_t;
+
+#if __x86_64__
+// Kinds of VM exit counted by MX_HYPERVISOR_OP_GUEST_GET_EXIT_STATS.
+
+#define MX_GUEST_EXIT_EXTERNAL_INTERRUPT        0u
+#define MX_GUEST_EXIT_INTERRUPT_WINDOW          1u
+#define MX_GUEST_EXIT_CPUID                     2u
+#define MX_GUEST_EXIT_HLT                       3u
+#define MX_GUEST_EXIT_IO                        4u
+#define MX_GUEST_EXIT_MSR                       5u
+#define MX_GUEST_EXIT_APIC_ACCESS               6u
+#define MX_GUEST_EXIT_EPT_VIOLATION             7u
+#define MX_GUEST_EXIT_OTHER                     8u
+#define MX_GUEST_EXIT_KINDS                     9u
+
+// Result of MX_HYPERVISOR_OP_GUEST_GET_EXIT_STATS.
+//
+// For the VCPU, the number of VM exits of each kind since it was created,
+// and the time spent handling them, from the VM exit until the VCPU is about
+// to resume.  That time includes waiting for user space to reply to the
+// packets of IO and memory traps, and waiting for an interrupt after a HLT.
+//
+// Each VM exit is also written to ktrace, as a VCPU_EXIT record, while the
+// ARCH group is being traced.
+typedef struct mx_guest_exit_stats {
+    struct {
+        uint64_t count;
+        mx_time_t time;
+    } exits[MX_GUEST_EXIT_KINDS];
+} mx_guest_exit_stats_t;
 #endif // __x86_64__
 
 typedef struct mx_guest_gpr {
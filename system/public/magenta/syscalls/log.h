@@ -32,4 +32,32 @@ typedef struct mx_log_record {
 
 #define MX_LOG_FLAG_READABLE  0x40000000
 
+// Option for mx_log_read(): read nothing, but count everything written so far
+// as read, clearing MX_LOG_READABLE until more is written. For readers that
+// read the ring mapped from mx_log_get_vmo().
+#define MX_LOG_READ_SKIP      0x00000001
+
+// The start of the vmo returned by mx_log_get_vmo(), which holds the log
+// ring at |data_offset|.
+typedef struct mx_log_ring {
+    // Byte positions, which only ever increase, of the oldest record still
+    // in the ring and of the end of the newest. Position p is at byte
+    // p % |size| of the ring.
+    uint64_t tail;
+    uint64_t head;
+    // Bytes in the ring, a power of two.
+    uint64_t size;
+    uint64_t data_offset;
+} mx_log_ring_t;
+
+// Records in the ring are mx_log_record_t, starting on 4 byte boundaries,
+// with |reserved| holding the bytes the record takes up in the ring. A
+// record may wrap around the end of the ring anywhere after |reserved|.
+//
+// The kernel moves |tail| past the records it is about to overwrite before
+// writing, and moves |head| past a record once it is written. Bytes a reader
+// copied from positions below |tail| as it reads it after copying are not
+// to be trusted, the rest are.
+#define MX_LOG_RING_RECORD_SIZE(reserved) ((reserved) & 0xfff)
+
 __END_CDECLS
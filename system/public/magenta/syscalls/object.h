@@ -31,6 +31,10 @@ typedef enum {
     MX_INFO_THREAD_STATS               = 15, // mx_info_thread_stats_t[1]
     MX_INFO_CPU_STATS                  = 16, // mx_info_cpu_stats_t[n]
     MX_INFO_KMEM_STATS                 = 17, // mx_info_kmem_stats_t[1]
+    MX_INFO_SYSCALL_STATS              = 18, // mx_info_syscall_stats_t[n]
+    MX_INFO_KMEM_HEAP_TAGS             = 19, // mx_info_heap_tag_t[n]
+    MX_INFO_KERNEL_OBJECTS             = 20, // mx_info_kernel_objects_t[n]
+    MX_INFO_TASK_HANDLES               = 21, // mx_info_task_handles_t[1]
     MX_INFO_LAST
 } mx_object_info_topic_t;
 
@@ -57,6 +61,7 @@ typedef enum {
     MX_OBJ_TYPE_HYPERVISOR          = 21,
     MX_OBJ_TYPE_GUEST               = 22,
     MX_OBJ_TYPE_TIMER               = 23,
+    MX_OBJ_TYPE_VCPU                = 24,
     MX_OBJ_TYPE_LAST
 } mx_obj_type_t;
 
@@ -287,6 +292,9 @@ typedef struct mx_info_cpu_stats {
     uint64_t irq_preempts;
     uint64_t preempts;
     uint64_t yields;
+    uint64_t steals;        // threads taken from another cpu's run queue while idle
+    uint64_t balances;      // threads pulled from a busier cpu's run queue
+    uint64_t migrations;    // threads switched in here having last run on another cpu
 
     // cpu level interrupts and exceptions
     uint64_t ints;          // hardware interrupts, minus timer interrupts or inter-processor interrupts
@@ -340,6 +348,64 @@ typedef struct mx_info_kmem_stats {
 
 #define MX_INFO_CPU_STATS_FLAG_ONLINE       (1u<<0)
 
+#define MX_INFO_SYSCALL_STATS_BUCKETS       24
+
+// How long calls to one syscall took, summed over all cpus, from entering
+// the kernel to leaving it, including any time spent blocked.
+typedef struct mx_info_syscall_stats {
+    // The MX_SYS_* number of the syscall.
+    uint32_t syscall_num;
+    uint32_t reserved;
+
+    uint64_t calls;
+    mx_duration_t total_time;
+    mx_duration_t max_time;
+
+    // A log2 histogram of the time each call took. Bucket 0 counts calls
+    // shorter than 128ns, bucket i counts calls taking [2^(i+6), 2^(i+7))ns,
+    // and the last bucket everything longer.
+    uint64_t buckets[MX_INFO_SYSCALL_STATS_BUCKETS];
+} mx_info_syscall_stats_t;
+
+#define MX_INFO_HEAP_TAG_NAME_LEN           16
+
+// Kernel heap allocations charged to one allocation tag, summed over all
+// cpus. Only kept by kernels built with ENABLE_HEAP_TAGS=true.
+typedef struct mx_info_heap_tag {
+    char name[MX_INFO_HEAP_TAG_NAME_LEN];
+
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t alloc_bytes;
+    uint64_t free_bytes;
+
+    // The bytes allocated under the tag and not yet freed.
+    uint64_t live_bytes;
+} mx_info_heap_tag_t;
+
+// Live kernel objects of one type, and the handles to them. The counts are
+// kept up to date as handles come and go, so they are cheap to ask for.
+// MX_INFO_KERNEL_OBJECTS returns one record per MX_OBJ_TYPE_* value,
+// indexed by type.
+typedef struct mx_info_kernel_objects {
+    // The MX_OBJ_TYPE_* value.
+    uint32_t type;
+    uint32_t reserved;
+
+    // Objects of |type| with at least one handle. Objects only the kernel
+    // refers to are not counted.
+    uint64_t objects;
+
+    // Handles to objects of |type|, whether held by a process or in
+    // transit in a channel.
+    uint64_t handles;
+} mx_info_kernel_objects_t;
+
+// Handles held by a process, or by every process under a job.
+typedef struct mx_info_task_handles {
+    uint64_t handles;
+} mx_info_task_handles_t;
+
 // Object properties.
 
 // Argument is a uint32_t.
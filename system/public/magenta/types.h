@@ -124,6 +124,9 @@ typedef uint32_t mx_signals_t;
 #define MX_RESOURCE_WRITABLE        __MX_OBJECT_WRITABLE
 #define MX_RESOURCE_CHILD_ADDED     __MX_OBJECT_SIGNAL_4
 
+// Vmo
+#define MX_VMO_PREFETCHED           __MX_OBJECT_SIGNAL_4
+
 // Fifo
 #define MX_FIFO_READABLE            __MX_OBJECT_READABLE
 #define MX_FIFO_WRITABLE            __MX_OBJECT_WRITABLE
@@ -177,6 +180,16 @@ typedef struct {
     uint32_t rd_num_handles;
 } mx_channel_call_args_t;
 
+// Structure for mx_channel_read_many() and mx_channel_write_many():
+typedef struct {
+    void* bytes;
+    mx_handle_t* handles;
+    mx_handle_t channel;
+    uint32_t num_bytes;
+    uint32_t num_handles;
+    mx_status_t status;
+} mx_channel_msg_t;
+
 // Structure for mx_object_wait_many():
 typedef struct {
     mx_handle_t handle;
@@ -184,6 +197,14 @@ typedef struct {
     mx_signals_t pending;
 } mx_wait_item_t;
 
+// Structure for mx_object_signal_many():
+typedef struct {
+    mx_handle_t handle;
+    mx_signals_t clear_mask;
+    mx_signals_t set_mask;
+    mx_status_t status;
+} mx_signal_item_t;
+
 // Structure for mx_waitset_*():
 typedef struct mx_waitset_result {
     uint64_t cookie;
@@ -218,6 +239,17 @@ typedef uint32_t mx_rights_t;
 #define MX_VMO_OP_CACHE_INVALIDATE       7u
 #define MX_VMO_OP_CACHE_CLEAN            8u
 #define MX_VMO_OP_CACHE_CLEAN_INVALIDATE 9u
+#define MX_VMO_OP_SET_NUMA_NODE          10u
+#define MX_VMO_OP_PIN                    11u
+#define MX_VMO_OP_UNPIN                  12u
+#define MX_VMO_OP_WILLNEED               13u
+#define MX_VMO_OP_DONTNEED               14u
+#define MX_VMO_OP_SEQUENTIAL             15u
+#define MX_VMO_OP_RANDOM                 16u
+#define MX_VMO_OP_NORMAL                 17u
+
+// Passed to MX_VMO_OP_SET_NUMA_NODE to go back to cpu-local allocation
+#define MX_VMO_NUMA_NODE_LOCAL           ((uint32_t)-1)
 
 // VM Object clone flags
 #define MX_VMO_CLONE_COPY_ON_WRITE       1u
@@ -270,6 +302,12 @@ typedef int64_t mx_rel_off_t;
 #define MX_SOCKET_HALF_CLOSE                1u
 #define MX_SOCKET_STREAM                    0u
 #define MX_SOCKET_DATAGRAM                  1u
+// A stream socket whose data is kept in one contiguous ring of
+// 2^order bytes, given with MX_SOCKET_RING_ORDER().
+#define MX_SOCKET_RING                      2u
+#define MX_SOCKET_RING_ORDER(order)         ((uint32_t)(order) << 8)
+#define MX_SOCKET_RING_ORDER_MIN            12u
+#define MX_SOCKET_RING_ORDER_MAX            24u
 
 // Flags which can be used to to control cache policy for APIs which map memory.
 typedef enum {
@@ -36,7 +36,11 @@ mx_status_t AudioOutput::Play(AudioSource& source) {
     // TODO(johngro) : Add the ability to determine what type of read-ahead the
     // HW is going to require so we can adjust our buffer size to what the HW
     // requires, not what ALSA under QEMU requires.
-    res = GetBuffer(480 * 20 * 3, 3);
+    //
+    // Drivers which publish their position in a VMO need not send us
+    // notifications as well.
+    bool poll = (GetPositionVmo() == MX_OK);
+    res = GetBuffer(480 * 20 * 3, poll ? 0 : 3);
     if (res != MX_OK) {
         printf("Failed to set output format (res %d)\n", res);
         return res;
@@ -52,10 +56,6 @@ mx_status_t AudioOutput::Play(AudioSource& source) {
     playout_rd = playout_amt = 0;
 
     while (true) {
-        uint32_t bytes_read, junk;
-        audio2_rb_position_notify_t pos_notif;
-        mx_signals_t sigs;
-
         // Top up the buffer.  In theory, we should only need to loop 2 times in
         // order to handle a ring discontinuity
         for (uint32_t i = 0; i < 2; ++i) {
@@ -109,42 +109,9 @@ mx_status_t AudioOutput::Play(AudioSource& source) {
             started = true;
         }
 
-        res = rb_ch_.wait_one(MX_CHANNEL_READABLE | MX_CHANNEL_PEER_CLOSED,
-                              MX_TIME_INFINITE, &sigs);
-
-        if (res != MX_OK) {
-            printf("Failed to wait for notificiation (res %d)\n", res);
-            break;
-        }
-
-        if (sigs & MX_CHANNEL_PEER_CLOSED) {
-            printf("Peer closed connection during playback!\n");
-            break;
-        }
-
-        res = rb_ch_.read(0,
-                          &pos_notif, sizeof(pos_notif), &bytes_read,
-                          nullptr, 0, &junk);
-        if (res != MX_OK) {
-            printf("Failed to read notification from ring buffer channel (res %d)\n", res);
-            break;
-        }
-
-        if (bytes_read != sizeof(pos_notif)) {
-            printf("Bad size when reading notification from ring buffer channel (%u != %zu)\n",
-                   bytes_read, sizeof(pos_notif));
-            res = MX_ERR_INTERNAL;
-            break;
-        }
-
-        if (pos_notif.hdr.cmd != AUDIO2_RB_POSITION_NOTIFY) {
-            printf("Unexpected command type when reading notification from ring "
-                   "buffer channel (cmd %04x)\n", pos_notif.hdr.cmd);
-            res = MX_ERR_INTERNAL;
+        res = WaitForPosition(&rd);
+        if (res != MX_OK)
             break;
-        }
-
-        rd = pos_notif.ring_buffer_pos;
 
         // rd has moved.  If the source has finished and rd has moved at least
         // the playout distance, we are finsihed.
@@ -395,6 +395,37 @@ mx_status_t AudioStream::SetFormat(uint32_t frames_per_second,
     return res;
 }
 
+mx_status_t AudioStream::GetPositionVmo() {
+    if (!rb_ch_.is_valid() || pos_vmo_.is_valid())
+        return MX_ERR_BAD_STATE;
+
+    audio2_rb_cmd_get_position_vmo_req_t  req;
+    audio2_rb_cmd_get_position_vmo_resp_t resp;
+
+    req.hdr.cmd            = AUDIO2_RB_CMD_GET_POSITION_VMO;
+    req.hdr.transaction_id = 1;
+
+    mx::handle tmp;
+    mx_status_t res = DoCall(rb_ch_, req, &resp, &tmp);
+    if (res != MX_OK)
+        return res;
+
+    pos_vmo_.reset(tmp.release());
+
+    uintptr_t virt;
+    res = mx_vmar_map(mx_vmar_root_self(), 0u,
+                      pos_vmo_.get(), 0u, sizeof(audio2_rb_position_t),
+                      MX_VM_FLAG_PERM_READ, &virt);
+    if (res != MX_OK) {
+        printf("Failed to map position VMO (res %d)\n", res);
+        pos_vmo_.reset();
+        return res;
+    }
+
+    pos_virt_ = reinterpret_cast<const audio2_rb_position_t*>(virt);
+    return MX_OK;
+}
+
 mx_status_t AudioStream::GetBuffer(uint32_t frames, uint32_t irqs_per_ring) {
     if(!frames)
         return MX_ERR_INVALID_ARGS;
@@ -442,6 +473,7 @@ mx_status_t AudioStream::GetBuffer(uint32_t frames, uint32_t irqs_per_ring) {
     }
 
     rb_sz_ = static_cast<decltype(rb_sz_)>(rb_sz);
+    irqs_per_ring_ = irqs_per_ring;
 
     // Map the VMO into our address space
     // TODO(johngro) : How do I specify the cache policy for this mapping?
@@ -459,6 +491,62 @@ mx_status_t AudioStream::GetBuffer(uint32_t frames, uint32_t irqs_per_ring) {
     return MX_OK;
 }
 
+// Waits for the ring buffer position to move on, and returns it.  With a
+// position VMO this is a sleep of the time it would have taken for the next
+// notification to arrive; otherwise it is a wait for that notification.
+mx_status_t AudioStream::WaitForPosition(uint32_t* out_pos) {
+    if (pos_virt_ != nullptr) {
+        uint32_t polls = irqs_per_ring_ ? irqs_per_ring_ : 3;
+        uint64_t frames = rb_sz_ / frame_sz_;
+        mx_nanosleep(mx_deadline_after(MX_SEC(frames) / (frame_rate_ * polls)));
+
+        audio2_rb_position_t pos;
+        audio2_rb_position_read(pos_virt_, &pos);
+        *out_pos = pos.ring_buffer_pos;
+        return MX_OK;
+    }
+
+    mx_status_t res;
+    mx_signals_t sigs;
+    res = rb_ch_.wait_one(MX_CHANNEL_READABLE | MX_CHANNEL_PEER_CLOSED,
+                          MX_TIME_INFINITE, &sigs);
+
+    if (res != MX_OK) {
+        printf("Failed to wait for notificiation (res %d)\n", res);
+        return res;
+    }
+
+    if (sigs & MX_CHANNEL_PEER_CLOSED) {
+        printf("Peer closed connection during playback!\n");
+        return MX_ERR_PEER_CLOSED;
+    }
+
+    uint32_t bytes_read, junk;
+    audio2_rb_position_notify_t pos_notif;
+    res = rb_ch_.read(0,
+                      &pos_notif, sizeof(pos_notif), &bytes_read,
+                      nullptr, 0, &junk);
+    if (res != MX_OK) {
+        printf("Failed to read notification from ring buffer channel (res %d)\n", res);
+        return res;
+    }
+
+    if (bytes_read != sizeof(pos_notif)) {
+        printf("Bad size when reading notification from ring buffer channel (%u != %zu)\n",
+               bytes_read, sizeof(pos_notif));
+        return MX_ERR_INTERNAL;
+    }
+
+    if (pos_notif.hdr.cmd != AUDIO2_RB_POSITION_NOTIFY) {
+        printf("Unexpected command type when reading notification from ring "
+               "buffer channel (cmd %04x)\n", pos_notif.hdr.cmd);
+        return MX_ERR_INTERNAL;
+    }
+
+    *out_pos = pos_notif.ring_buffer_pos;
+    return MX_OK;
+}
+
 mx_status_t AudioStream::StartRingBuffer() {
     if (rb_ch_ == MX_HANDLE_INVALID)
         return MX_ERR_BAD_STATE;
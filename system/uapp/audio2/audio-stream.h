@@ -32,7 +32,9 @@ protected:
     mx_status_t SetFormat(uint32_t frames_per_second,
                           uint16_t channels,
                           audio2_sample_format_t sample_format);
+    mx_status_t GetPositionVmo();
     mx_status_t GetBuffer(uint32_t frames, uint32_t irqs_per_ring);
+    mx_status_t WaitForPosition(uint32_t* out_pos);
     mx_status_t StartRingBuffer();
     mx_status_t StopRingBuffer();
 
@@ -42,6 +44,7 @@ protected:
     mx::channel stream_ch_;
     mx::channel rb_ch_;
     mx::vmo     rb_vmo_;
+    mx::vmo     pos_vmo_;
 
     const bool     input_;
     const uint32_t dev_id_;
@@ -53,4 +56,7 @@ protected:
     uint32_t frame_sz_    = 0;
     uint32_t rb_sz_       = 0;
     void*    rb_virt_     = nullptr;
+    uint32_t irqs_per_ring_ = 0;
+
+    const audio2_rb_position_t* pos_virt_ = nullptr;
 };
@@ -0,0 +1,505 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Measures what a block device does with many requests in flight: each
+// thread keeps a number of requests outstanding on a fifo of its own,
+// issuing another as each completes, and the latency of every request is
+// recorded.
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <unistd.h>
+
+#include <magenta/device/block.h>
+#include <magenta/syscalls.h>
+
+#define MAX_THREADS BLOCK_MAX_FIFOS
+// The fifo holds a response for each request that can be in flight.
+#define MAX_DEPTH BLOCK_FIFO_MAX_DEPTH
+
+// Latencies in nanoseconds, bucketed by their top bits, so that each
+// percentile is within 1/16th of its value.
+#define HIST_SUB_BITS 4
+#define HIST_BUCKETS (64 << HIST_SUB_BITS)
+
+typedef struct {
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t total;
+    uint64_t sum;
+    uint64_t max;
+} histogram_t;
+
+static uint32_t hist_bucket(uint64_t v) {
+    if (v < (1u << HIST_SUB_BITS)) {
+        return (uint32_t)v;
+    }
+    uint32_t msb = 63 - __builtin_clzll(v);
+    uint32_t sub = (v >> (msb - HIST_SUB_BITS)) & ((1u << HIST_SUB_BITS) - 1);
+    return ((msb - HIST_SUB_BITS + 1) << HIST_SUB_BITS) + sub;
+}
+
+// the least value in a bucket
+static uint64_t hist_value(uint32_t bucket) {
+    if (bucket < (1u << HIST_SUB_BITS)) {
+        return bucket;
+    }
+    uint32_t group = bucket >> HIST_SUB_BITS;
+    uint64_t sub = bucket & ((1u << HIST_SUB_BITS) - 1);
+    return ((1ull << HIST_SUB_BITS) | sub) << (group - 1);
+}
+
+static void hist_add(histogram_t* h, uint64_t v) {
+    h->counts[hist_bucket(v)]++;
+    h->total++;
+    h->sum += v;
+    if (v > h->max) {
+        h->max = v;
+    }
+}
+
+static void hist_merge(histogram_t* h, const histogram_t* other) {
+    for (uint32_t i = 0; i < HIST_BUCKETS; i++) {
+        h->counts[i] += other->counts[i];
+    }
+    h->total += other->total;
+    h->sum += other->sum;
+    if (other->max > h->max) {
+        h->max = other->max;
+    }
+}
+
+static uint64_t hist_percentile(const histogram_t* h, double p) {
+    uint64_t target = (uint64_t)(h->total * p / 100.0);
+    if (target == 0) {
+        target = 1;
+    }
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= target) {
+            return hist_value(i);
+        }
+    }
+    return h->max;
+}
+
+typedef struct {
+    uint32_t threads;
+    uint32_t depth;
+    uint64_t block_size;
+    uint32_t read_percent;
+    bool random;
+    uint64_t count;      // requests per thread, or zero to run for |duration|
+    mx_time_t duration;
+    uint64_t size;       // the part of the device used, from its start
+} options_t;
+
+typedef struct {
+    const options_t* opts;
+
+    mx_handle_t fifo;
+    vmoid_t vmoid;
+    txnid_t txnids[MAX_DEPTH];
+    // the request slot of each txn
+    uint16_t slots[MAX_TXN_COUNT];
+
+    // sequential requests go through a slice of the device per thread
+    uint64_t start;
+    uint64_t length;
+    uint64_t next;
+    uint64_t rng;
+
+    uint64_t reads;
+    uint64_t writes;
+    uint64_t errors;
+    mx_time_t elapsed;
+    mx_status_t status;
+    histogram_t read_latency;
+    histogram_t write_latency;
+} worker_t;
+
+static uint64_t number(const char* str) {
+    char* end;
+    uint64_t n = strtoull(str, &end, 10);
+
+    uint64_t m = 1;
+    switch (*end) {
+    case 'G':
+    case 'g':
+        m = 1024 * 1024 * 1024;
+        break;
+    case 'M':
+    case 'm':
+        m = 1024 * 1024;
+        break;
+    case 'K':
+    case 'k':
+        m = 1024;
+        break;
+    }
+    return m * n;
+}
+
+// xorshift64*
+static uint64_t next_random(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1Dull;
+}
+
+static uint64_t next_offset(worker_t* w) {
+    const options_t* opts = w->opts;
+    if (opts->random) {
+        return (next_random(&w->rng) % (opts->size / opts->block_size)) * opts->block_size;
+    }
+    uint64_t offset = w->start + w->next;
+    w->next += opts->block_size;
+    if (w->next + opts->block_size > w->length) {
+        w->next = 0;
+    }
+    return offset;
+}
+
+static mx_status_t fifo_write_all(mx_handle_t fifo, block_fifo_request_t* requests,
+                                  uint32_t count) {
+    while (count > 0) {
+        uint32_t actual;
+        mx_status_t status = mx_fifo_write(fifo, requests, sizeof(block_fifo_request_t) * count,
+                                           &actual);
+        if (status == MX_ERR_SHOULD_WAIT) {
+            mx_signals_t signals;
+            if ((status = mx_object_wait_one(fifo, MX_FIFO_WRITABLE | MX_FIFO_PEER_CLOSED,
+                                             MX_TIME_INFINITE, &signals)) != MX_OK) {
+                return status;
+            } else if (signals & MX_FIFO_PEER_CLOSED) {
+                return MX_ERR_PEER_CLOSED;
+            }
+            continue;
+        } else if (status != MX_OK) {
+            return status;
+        }
+        requests += actual;
+        count -= actual;
+    }
+    return MX_OK;
+}
+
+static mx_status_t fifo_read_some(mx_handle_t fifo, block_fifo_response_t* responses,
+                                  uint32_t max, uint32_t* count) {
+    while (true) {
+        mx_status_t status = mx_fifo_read(fifo, responses, sizeof(block_fifo_response_t) * max,
+                                          count);
+        if (status != MX_ERR_SHOULD_WAIT) {
+            return status;
+        }
+        mx_signals_t signals;
+        if ((status = mx_object_wait_one(fifo, MX_FIFO_READABLE | MX_FIFO_PEER_CLOSED,
+                                         MX_TIME_INFINITE, &signals)) != MX_OK) {
+            return status;
+        } else if (signals & MX_FIFO_PEER_CLOSED) {
+            return MX_ERR_PEER_CLOSED;
+        }
+    }
+}
+
+static int worker_run(void* arg) {
+    worker_t* w = arg;
+    const options_t* opts = w->opts;
+
+    block_fifo_request_t requests[MAX_DEPTH];
+    block_fifo_response_t responses[MAX_DEPTH];
+    mx_time_t issued[MAX_DEPTH];
+    bool is_read[MAX_DEPTH];
+    uint16_t free_slots[MAX_DEPTH];
+    uint32_t free_count = 0;
+    for (uint32_t i = 0; i < opts->depth; i++) {
+        free_slots[free_count++] = (uint16_t)(opts->depth - 1 - i);
+    }
+
+    mx_time_t start = mx_time_get(MX_CLOCK_MONOTONIC);
+    mx_time_t deadline = start + opts->duration;
+    uint64_t issued_count = 0;
+    uint32_t in_flight = 0;
+    bool stop = false;
+    while (true) {
+        mx_time_t now = mx_time_get(MX_CLOCK_MONOTONIC);
+        if ((opts->count != 0) ? (issued_count == opts->count) : (now >= deadline)) {
+            stop = true;
+        }
+
+        // Top the requests in flight back up to the queue depth.
+        uint32_t n = 0;
+        while (!stop && (free_count > 0) &&
+               ((opts->count == 0) || (issued_count + n < opts->count))) {
+            uint16_t slot = free_slots[--free_count];
+            bool read = (next_random(&w->rng) % 100) < opts->read_percent;
+            requests[n++] = (block_fifo_request_t){
+                .txnid = w->txnids[slot],
+                .vmoid = w->vmoid,
+                .opcode = (read ? BLOCKIO_READ : BLOCKIO_WRITE) | BLOCKIO_TXN_END,
+                .length = opts->block_size,
+                .vmo_offset = slot * opts->block_size,
+                .dev_offset = next_offset(w),
+            };
+            issued[slot] = now;
+            is_read[slot] = read;
+        }
+        if (n > 0) {
+            if ((w->status = fifo_write_all(w->fifo, requests, n)) != MX_OK) {
+                return -1;
+            }
+            issued_count += n;
+            in_flight += n;
+        }
+        if (in_flight == 0) {
+            break;
+        }
+
+        uint32_t count;
+        if ((w->status = fifo_read_some(w->fifo, responses, in_flight, &count)) != MX_OK) {
+            return -1;
+        }
+        now = mx_time_get(MX_CLOCK_MONOTONIC);
+        for (uint32_t i = 0; i < count; i++) {
+            uint16_t slot = w->slots[responses[i].txnid];
+            if (responses[i].status != MX_OK) {
+                // Stop issuing, and let what's in flight finish.
+                w->errors++;
+                stop = true;
+            } else if (is_read[slot]) {
+                w->reads++;
+                hist_add(&w->read_latency, now - issued[slot]);
+            } else {
+                w->writes++;
+                hist_add(&w->write_latency, now - issued[slot]);
+            }
+            free_slots[free_count++] = slot;
+        }
+        in_flight -= count;
+    }
+    w->elapsed = mx_time_get(MX_CLOCK_MONOTONIC) - start;
+    return 0;
+}
+
+static mx_status_t worker_init(worker_t* w, int fd, uint32_t index) {
+    const options_t* opts = w->opts;
+
+    // The first fifo is made by asking for it; every one after is added.
+    ssize_t r = (index == 0) ? ioctl_block_get_fifos(fd, &w->fifo)
+                             : ioctl_block_add_fifo(fd, &w->fifo);
+    if (r != sizeof(w->fifo)) {
+        fprintf(stderr, "blkbench: cannot get fifo %u: %zd\n", index, r);
+        return (r < 0) ? (mx_status_t)r : MX_ERR_IO;
+    }
+
+    mx_handle_t vmo;
+    mx_status_t status;
+    if ((status = mx_vmo_create(opts->depth * opts->block_size, 0, &vmo)) != MX_OK) {
+        fprintf(stderr, "blkbench: cannot create vmo: %d\n", status);
+        return status;
+    }
+    if ((r = ioctl_block_attach_vmo(fd, &vmo, &w->vmoid)) != sizeof(w->vmoid)) {
+        fprintf(stderr, "blkbench: cannot attach vmo: %zd\n", r);
+        mx_handle_close(vmo);
+        return (r < 0) ? (mx_status_t)r : MX_ERR_IO;
+    }
+
+    for (uint32_t i = 0; i < opts->depth; i++) {
+        if ((r = ioctl_block_alloc_txn(fd, &w->txnids[i])) != sizeof(w->txnids[i])) {
+            fprintf(stderr, "blkbench: cannot allocate txn: %zd\n", r);
+            return (r < 0) ? (mx_status_t)r : MX_ERR_IO;
+        }
+        w->slots[w->txnids[i]] = (uint16_t)i;
+    }
+
+    w->length = (opts->size / opts->threads) / opts->block_size * opts->block_size;
+    w->start = index * w->length;
+    w->rng = mx_ticks_get() ^ ((uint64_t)(index + 1) << 32);
+    if (w->rng == 0) {
+        w->rng = 1;
+    }
+    return MX_OK;
+}
+
+static void print_latency(const char* what, const histogram_t* h) {
+    if (h->total == 0) {
+        return;
+    }
+    printf("  %s latency (us): avg %.1f  p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+           what, (double)h->sum / h->total / 1000.0,
+           hist_percentile(h, 50) / 1000.0, hist_percentile(h, 90) / 1000.0,
+           hist_percentile(h, 99) / 1000.0, hist_percentile(h, 99.9) / 1000.0,
+           h->max / 1000.0);
+}
+
+static int usage(void) {
+    fprintf(stderr,
+            "usage: blkbench [options] <device>\n\n"
+            "  -t <threads>  threads, each with a fifo of its own (1, at most %u)\n"
+            "  -d <depth>    requests each thread keeps in flight (1, at most %u)\n"
+            "  -b <size>     bytes in each request (4K)\n"
+            "  -r <percent>  of the requests to be reads, the rest writes (100)\n"
+            "  -R            random offsets, rather than sequential ones\n"
+            "  -n <count>    requests for each thread to issue, or\n"
+            "  -T <seconds>  how long to issue them for (5)\n"
+            "  -S <size>     bytes of the device to use, from its start (all of it)\n\n"
+            "Writes overwrite what is on the device.\n",
+            MAX_THREADS, (uint32_t)MAX_DEPTH);
+    return -1;
+}
+
+int main(int argc, char** argv) {
+    options_t opts = {
+        .threads = 1,
+        .depth = 1,
+        .block_size = 4096,
+        .read_percent = 100,
+        .random = false,
+        .count = 0,
+        .duration = MX_SEC(5),
+        .size = 0,
+    };
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:d:b:r:Rn:T:S:")) != -1) {
+        switch (opt) {
+        case 't':
+            opts.threads = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
+        case 'd':
+            opts.depth = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
+        case 'b':
+            opts.block_size = number(optarg);
+            break;
+        case 'r':
+            opts.read_percent = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
+        case 'R':
+            opts.random = true;
+            break;
+        case 'n':
+            opts.count = strtoull(optarg, NULL, 10);
+            break;
+        case 'T':
+            opts.duration = MX_SEC(strtoull(optarg, NULL, 10));
+            break;
+        case 'S':
+            opts.size = number(optarg);
+            break;
+        default:
+            return usage();
+        }
+    }
+    if (optind != argc - 1) {
+        return usage();
+    }
+    const char* path = argv[optind];
+
+    if ((opts.threads == 0) || (opts.threads > MAX_THREADS) ||
+        (opts.depth == 0) || (opts.depth > MAX_DEPTH) || (opts.read_percent > 100)) {
+        return usage();
+    }
+    if (opts.threads * opts.depth > MAX_TXN_COUNT) {
+        fprintf(stderr, "blkbench: at most %u requests may be in flight in all\n",
+                MAX_TXN_COUNT);
+        return -1;
+    }
+
+    int fd = open(path, (opts.read_percent == 100) ? O_RDONLY : O_RDWR);
+    if (fd < 0) {
+        fprintf(stderr, "blkbench: cannot open '%s'\n", path);
+        return -1;
+    }
+    block_info_t info;
+    if (ioctl_block_get_info(fd, &info) != sizeof(info)) {
+        fprintf(stderr, "blkbench: cannot get info for '%s'\n", path);
+        return -1;
+    }
+    uint64_t device_size = info.block_count * info.block_size;
+    if ((opts.size == 0) || (opts.size > device_size)) {
+        opts.size = device_size;
+    }
+    if ((opts.block_size == 0) || (opts.block_size % info.block_size) ||
+        ((info.max_transfer_size != 0) && (opts.block_size > info.max_transfer_size))) {
+        fprintf(stderr, "blkbench: requests must be a multiple of %u bytes, and at most %u\n",
+                info.block_size, info.max_transfer_size);
+        return -1;
+    }
+    if (opts.size / opts.threads < opts.block_size) {
+        fprintf(stderr, "blkbench: too little of the device for %u threads\n", opts.threads);
+        return -1;
+    }
+
+    worker_t* workers = calloc(opts.threads, sizeof(worker_t));
+    if (workers == NULL) {
+        fprintf(stderr, "blkbench: out of memory\n");
+        return -1;
+    }
+    for (uint32_t i = 0; i < opts.threads; i++) {
+        workers[i].opts = &opts;
+        if (worker_init(&workers[i], fd, i) != MX_OK) {
+            return -1;
+        }
+    }
+
+    thrd_t threads[MAX_THREADS];
+    for (uint32_t i = 0; i < opts.threads; i++) {
+        if (thrd_create(&threads[i], worker_run, &workers[i]) != thrd_success) {
+            fprintf(stderr, "blkbench: cannot start thread\n");
+            return -1;
+        }
+    }
+
+    histogram_t* reads = calloc(1, sizeof(histogram_t));
+    histogram_t* writes = calloc(1, sizeof(histogram_t));
+    if ((reads == NULL) || (writes == NULL)) {
+        fprintf(stderr, "blkbench: out of memory\n");
+        return -1;
+    }
+    uint64_t errors = 0;
+    mx_time_t elapsed = 0;
+    int result = 0;
+    for (uint32_t i = 0; i < opts.threads; i++) {
+        int r;
+        thrd_join(threads[i], &r);
+        worker_t* w = &workers[i];
+        if (r != 0) {
+            fprintf(stderr, "blkbench: thread %u failed: %d\n", i, w->status);
+            result = -1;
+        }
+        hist_merge(reads, &w->read_latency);
+        hist_merge(writes, &w->write_latency);
+        errors += w->errors;
+        if (w->elapsed > elapsed) {
+            elapsed = w->elapsed;
+        }
+    }
+
+    uint64_t requests = reads->total + writes->total;
+    double seconds = (double)elapsed / (double)MX_SEC(1);
+    printf("blkbench: %s, %u thread%s, depth %u, %" PRIu64 "-byte %s requests, %u%% reads\n",
+           path, opts.threads, (opts.threads == 1) ? "" : "s", opts.depth, opts.block_size,
+           opts.random ? "random" : "sequential", opts.read_percent);
+    printf("  %" PRIu64 " requests in %.2f s: %.0f IOPS, %.1f MB/s\n", requests, seconds,
+           requests / seconds, requests * opts.block_size / seconds / (1024 * 1024));
+    print_latency("read ", reads);
+    print_latency("write", writes);
+    if (errors != 0) {
+        printf("  %" PRIu64 " requests failed\n", errors);
+        result = -1;
+    }
+
+    close(fd);
+    return result;
+}
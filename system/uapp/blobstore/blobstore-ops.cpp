@@ -161,6 +161,16 @@ ssize_t VnodeBlob::Ioctl(uint32_t op, const void* in_buf, size_t in_len, void* o
         }
         return blobstore_->Unmount();
     }
+    case IOCTL_VFS_DROP_CACHE: {
+        blobstore_->BlobCacheDrop();
+        return MX_OK;
+    }
+    case IOCTL_VFS_PIN_CACHE: {
+        if ((in_len != sizeof(uint32_t)) || IsDirectory()) {
+            return MX_ERR_INVALID_ARGS;
+        }
+        return blobstore_->BlobCachePin(this, *static_cast<const uint32_t*>(in_buf) != 0);
+    }
     default: {
         return MX_ERR_NOT_SUPPORTED;
     }
@@ -197,12 +207,15 @@ mx_status_t VnodeBlob::Mmap(int flags, size_t len, size_t* off, mx_handle_t* out
     if (IsDirectory()) {
         return MX_ERR_NOT_SUPPORTED;
     }
-    if (flags & MXIO_MMAP_FLAG_WRITE) {
+    // The VMO handed out is a copy-on-write clone, so only private
+    // mappings may write to it
+    if ((flags & MXIO_MMAP_FLAG_WRITE) && !(flags & MXIO_MMAP_FLAG_PRIVATE)) {
         return MX_ERR_NOT_SUPPORTED;
     }
 
     mx_rights_t rights = MX_RIGHT_TRANSFER | MX_RIGHT_MAP;
     rights |= (flags & MXIO_MMAP_FLAG_READ) ? MX_RIGHT_READ : 0;
+    rights |= (flags & MXIO_MMAP_FLAG_WRITE) ? MX_RIGHT_WRITE : 0;
     rights |= (flags & MXIO_MMAP_FLAG_EXEC) ? MX_RIGHT_EXECUTE : 0;
     return CopyVmo(rights, out);
 }
@@ -7,10 +7,12 @@
 #include "blobstore.h"
 
 #include <bitmap/raw-bitmap.h>
+#include <bitmap/storage.h>
 #include <digest/digest.h>
 #include <mx/event.h>
 #include <mx/vmo.h>
 #include <mxtl/algorithm.h>
+#include <mxtl/intrusive_double_list.h>
 #include <mxtl/macros.h>
 #include <mxtl/ref_counted.h>
 #include <mxtl/ref_ptr.h>
@@ -20,6 +22,7 @@
 #include <fs/block-txn.h>
 #include <fs/mapped-vmo.h>
 #include <fs/vfs.h>
+#include <fs/vnode-cache.h>
 
 namespace blobstore {
 
@@ -50,6 +53,7 @@ constexpr BlobFlags kBlobStateMask        = 0x00FF0000;
 constexpr BlobFlags kBlobFlagSync         = 0x01000000; // The blob is being written to disk
 constexpr BlobFlags kBlobFlagDeletable    = 0x02000000; // This node should be unlinked when closed
 constexpr BlobFlags kBlobFlagDirectory    = 0x04000000; // This node represents the root directory
+constexpr BlobFlags kBlobFlagPinned       = 0x08000000; // This node is held by the cache until unpinned
 constexpr BlobFlags kBlobOtherMask        = 0xFF000000;
 
 // clang-format on
@@ -57,6 +61,9 @@ constexpr BlobFlags kBlobOtherMask        = 0xFF000000;
 static_assert(((kBlobStateMask | kBlobOtherMask) & V_FLAG_RESERVED_MASK) == 0,
               "Blobstore flags conflict with VFS-reserved flags");
 
+// The most memory the blob cache lets the VMOs of unpinned blobs add up to.
+constexpr size_t kBlobstoreCacheBytes = 32 * 1024 * 1024;
+
 class VnodeBlob final : public fs::Vnode {
 public:
     // Intrusive methods and structures
@@ -64,6 +71,11 @@ public:
     struct TypeWavlTraits {
         static WAVLTreeNodeState& node_state(VnodeBlob& b) { return b.type_wavl_state_; }
     };
+    using CacheNodeState = mxtl::DoublyLinkedListNodeState<mxtl::RefPtr<VnodeBlob>>;
+    struct CacheTraits {
+        static CacheNodeState& node_state(VnodeBlob& b) { return b.cache_node_state_; }
+        static size_t& cache_bytes(VnodeBlob& b) { return b.cache_bytes_; }
+    };
     const uint8_t* GetKey() const {
         return &digest_[0];
     };
@@ -81,6 +93,10 @@ public:
         return flags_ & kBlobFlagDeletable;
     }
 
+    bool Pinned() const {
+        return flags_ & kBlobFlagPinned;
+    }
+
     void SetState(BlobFlags new_state) {
         flags_ = (flags_ & ~kBlobStateMask) | new_state;
     }
@@ -102,7 +118,9 @@ public:
     virtual ~VnodeBlob();
 
 private:
+    friend class Blobstore;
     friend struct TypeWavlTraits;
+    friend struct CacheTraits;
 
     DISALLOW_COPY_ASSIGN_AND_MOVE(VnodeBlob);
 
@@ -148,15 +166,36 @@ private:
     mx_status_t Mmap(int flags, size_t len, size_t* off, mx_handle_t* out) final;
     mx_status_t Sync() final;
 
-    // Read both VMOs into memory, if we haven't already.
+    // Create the VMO and read the Merkle tree into it, if we haven't already.
     //
     // TODO(smklein): When we have can register the Blob Store as a pager
     // service, and it can properly handle pages faults on a vnode's contents,
-    // then we can avoid reading the entire blob up-front. Until then, read
-    // the contents of a VMO into memory when it is opened.
+    // then mapped blobs could be read in on demand too. Until then, the data
+    // is read in by LoadAndVerify as ranges of it are read.
     mx_status_t InitVmos();
 
+    // Reads in the data blocks covering [off, off + len) which haven't been
+    // already, and verifies them against the Merkle tree.
+    mx_status_t LoadAndVerify(size_t off, size_t len);
+
+    // Reads in and decompresses the chunks of a compressed blob covering its
+    // data blocks [start, end).
+    mx_status_t LoadChunks(size_t start, size_t end);
+
+    // Compresses the blob's data, unless that doesn't save enough to be
+    // worth it, returning the chunk table and chunks in *out.
+    mx_status_t CompressData(mxtl::unique_ptr<MappedVmo>* out, uint64_t* out_blocks);
+
+    // Writes out the data of a blob which has been written in full,
+    // compressed if it's worth it.
+    mx_status_t WriteData(WriteTxn* txn);
+
     mx_status_t WriteShared(WriteTxn* txn, size_t start, size_t len, uint64_t start_block);
+
+    // Roughly the memory the blob holds, counting its data as though all of
+    // it had been read in.
+    size_t CacheFootprint() const;
+
     // Called by Blob once the last write has completed, updating the
     // on-disk metadata.
     mx_status_t WriteMetadata();
@@ -166,6 +205,9 @@ private:
     void* GetMerkle() const;
 
     WAVLTreeNodeState type_wavl_state_;
+    CacheNodeState cache_node_state_;
+    // What the blob counted for when it was last put in the cache.
+    size_t cache_bytes_ = 0;
 
     const mxtl::RefPtr<Blobstore> blobstore_;
     // The blob_ here consists of:
@@ -173,6 +215,12 @@ private:
     // 2) The Blob itself, aligned to the nearest kBlobstoreBlockSize
     mxtl::unique_ptr<MappedVmo> blob_;
     vmoid_t vmoid_;
+    // The data blocks of blob_ which hold verified contents.
+    bitmap::RawBitmapGeneric<bitmap::DefaultStorage> verified_;
+    // Compressed blobs only: the chunk table and chunks, as they are laid out
+    // on disk after the Merkle tree, read in as they are needed.
+    mxtl::unique_ptr<MappedVmo> compressed_;
+    vmoid_t compressed_vmoid_;
 
     mx::event readable_event_;
     uint64_t bytes_written_;
@@ -230,9 +278,25 @@ public:
     // Removes blob from 'active' hashmap.
     mx_status_t ReleaseBlob(VnodeBlob* blob);
 
+    // The blob cache holds a reference to the most recently looked up
+    // readable blobs, so that closing and reopening one finds its VMO, and
+    // the data in it already read and verified, still there. Like the vnodes
+    // themselves, cached blobs are found through hash_. The least recently
+    // used are let go once the VMOs of those kept add up to more than
+    // kBlobstoreCacheBytes.
+    void BlobCacheTouch(VnodeBlob* vn);
+    // Lets go of |vn|, if it's held, as for a blob which is being unlinked.
+    void BlobCacheRemove(VnodeBlob* vn);
+    // Lets go of every unpinned blob held, when memory is wanted elsewhere.
+    void BlobCacheDrop();
+    // Pinned blobs, such as the loader and libc, are held until unpinned
+    // however long ago they were used, and don't count against the limit.
+    mx_status_t BlobCachePin(VnodeBlob* vn, bool pin);
+
     mx_status_t Readdir(void* cookie, void* dirents, size_t len);
 
     mx_status_t AttachVmo(mx_handle_t vmo, vmoid_t* out);
+    void DetachVmo(vmoid_t vmoid);
     mx_status_t Txn(block_fifo_request_t* requests, size_t count) {
         return block_fifo_txn(fifo_client_, requests, count);
     }
@@ -268,6 +332,11 @@ private:
     // Enqueues an update for allocated inode/block counts
     mx_status_t CountUpdate(WriteTxn* txn);
 
+    // The blocks of deleted blobs are discarded a batch at a time, once the
+    // updates freeing them are made durable, and before any are reused.
+    void QueueDiscard(uint64_t nblocks, uint64_t start_block);
+    void FlushDiscards();
+
     // VnodeBlobs exist in the WAVLTree as long as one or more reference exists;
     // when the Vnode is deleted, it is immediately removed from the WAVL tree.
     using WAVLTreeByMerkle = mxtl::WAVLTree<const uint8_t*,
@@ -276,6 +345,11 @@ private:
                                             VnodeBlob::TypeWavlTraits>;
     WAVLTreeByMerkle hash_; // Map of all 'in use' blobs
 
+    fs::VnodeCache<VnodeBlob, VnodeBlob::CacheTraits> blob_cache_{kBlobstoreCacheBytes};
+    // Shares the blobs' node state with blob_cache_, which holds no pinned
+    // blob.
+    mxtl::DoublyLinkedList<mxtl::RefPtr<VnodeBlob>, VnodeBlob::CacheTraits> pinned_;
+
     fifo_client_t* fifo_client_;
     txnid_t txnid_;
     RawBitmap block_map_;
@@ -284,6 +358,14 @@ private:
     vmoid_t node_map_vmoid_;
     mxtl::unique_ptr<MappedVmo> info_vmo_;
     vmoid_t info_vmoid_;
+
+    struct DiscardExtent {
+        uint64_t start;
+        uint64_t count;
+    };
+    bool discard_ = false;
+    DiscardExtent discards_[MAX_TXN_MESSAGES];
+    size_t discard_count_ = 0;
 };
 
 class BlobstoreChecker {
@@ -3,6 +3,7 @@
 // found in the LICENSE file.
 
 #include <fcntl.h>
+#include <limits.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -14,6 +15,7 @@
 #include <digest/merkle-tree.h>
 #include <fs/block-txn.h>
 #include <fs/mxio-dispatcher.h>
+#include <lz4/lz4.h>
 #include <magenta/process.h>
 #include <magenta/syscalls.h>
 #include <mxalloc/new.h>
@@ -162,9 +164,144 @@ mx_status_t VnodeBlob::InitVmos() {
         return status;
     }
 
+    // Only the Merkle tree (and chunk table) is read now; the data is read in
+    // as it is needed.
+    if ((status = verified_.Reset(BlobDataBlocks(*inode))) != MX_OK) {
+        BlobCloseHandles();
+        return status;
+    }
     ReadTxn txn(blobstore_.get());
-    txn.Enqueue(vmoid_, 0, inode->start_block, BlobDataBlocks(*inode) + MerkleTreeBlocks(*inode));
-    return txn.Flush();
+    txn.Enqueue(vmoid_, 0, inode->start_block, MerkleTreeBlocks(*inode));
+    if (inode->flags & kBlobstoreInodeFlagLZ4) {
+        uint64_t compressed_blocks = inode->num_blocks - MerkleTreeBlocks(*inode);
+        mxtl::unique_ptr<MappedVmo> compressed;
+        if ((status = MappedVmo::Create(compressed_blocks * kBlobstoreBlockSize,
+                                        "blob-compressed", &compressed)) != MX_OK) {
+            BlobCloseHandles();
+            return status;
+        }
+        if ((status = blobstore_->AttachVmo(compressed->GetVmo(), &compressed_vmoid_)) != MX_OK) {
+            BlobCloseHandles();
+            return status;
+        }
+        compressed_ = mxtl::move(compressed);
+        txn.Enqueue(compressed_vmoid_, 0, inode->start_block + MerkleTreeBlocks(*inode),
+                    ChunkTableBlocks(*inode));
+    }
+    if ((status = txn.Flush()) != MX_OK) {
+        BlobCloseHandles();
+        return status;
+    }
+
+    if (compressed_ != nullptr) {
+        // The tree covers the content, not the table, so check it's sane.
+        const uint32_t* table = static_cast<const uint32_t*>(compressed_->GetData());
+        uint64_t chunks = BlobChunks(*inode);
+        uint64_t limit = (inode->num_blocks - MerkleTreeBlocks(*inode) - ChunkTableBlocks(*inode)) *
+                         kBlobstoreBlockSize;
+        for (uint64_t c = 0; c < chunks; c++) {
+            if ((table[c] > table[c + 1]) || ((c == 0) && (table[c] != 0))) {
+                BlobCloseHandles();
+                return MX_ERR_IO_DATA_INTEGRITY;
+            }
+        }
+        if (table[chunks] > limit) {
+            BlobCloseHandles();
+            return MX_ERR_IO_DATA_INTEGRITY;
+        }
+    }
+    return MX_OK;
+}
+
+mx_status_t VnodeBlob::LoadChunks(size_t start, size_t end) {
+    auto inode = blobstore_->GetNode(map_index_);
+    uint64_t merkle_blocks = MerkleTreeBlocks(*inode);
+    uint64_t table_blocks = ChunkTableBlocks(*inode);
+    size_t first = start / kBlobstoreChunkBlocks;
+    size_t last = mxtl::roundup(end, kBlobstoreChunkBlocks) / kBlobstoreChunkBlocks;
+
+    const uint32_t* table = static_cast<const uint32_t*>(compressed_->GetData());
+    uint64_t cstart = table_blocks + table[first] / kBlobstoreBlockSize;
+    uint64_t cend = table_blocks + mxtl::roundup(table[last], kBlobstoreBlockSize) /
+                                   kBlobstoreBlockSize;
+    if (cend > cstart) {
+        ReadTxn txn(blobstore_.get());
+        txn.Enqueue(compressed_vmoid_, cstart, inode->start_block + merkle_blocks + cstart,
+                    cend - cstart);
+        mx_status_t status;
+        if ((status = txn.Flush()) != MX_OK) {
+            return status;
+        }
+    }
+
+    const char* chunks = static_cast<const char*>(compressed_->GetData()) +
+                         table_blocks * kBlobstoreBlockSize;
+    char* data = static_cast<char*>(GetData());
+    for (size_t c = first; c < last; c++) {
+        size_t off = c * kBlobstoreChunkSize;
+        int len = static_cast<int>(mxtl::min(static_cast<uint64_t>(kBlobstoreChunkSize),
+                                             inode->blob_size - off));
+        if (LZ4_decompress_safe(chunks + table[c], data + off,
+                                static_cast<int>(table[c + 1] - table[c]), len) != len) {
+            return MX_ERR_IO_DATA_INTEGRITY;
+        }
+    }
+    return MX_OK;
+}
+
+mx_status_t VnodeBlob::LoadAndVerify(size_t off, size_t len) {
+    auto inode = blobstore_->GetNode(map_index_);
+    uint64_t merkle_blocks = MerkleTreeBlocks(*inode);
+    size_t start = off / kBlobstoreBlockSize;
+    size_t end = mxtl::roundup(off + len, kBlobstoreBlockSize) / kBlobstoreBlockSize;
+    bool compressed = inode->flags & kBlobstoreInodeFlagLZ4;
+    if (compressed) {
+        // Compressed blobs are read in whole chunks.
+        start -= start % kBlobstoreChunkBlocks;
+        end = mxtl::min(mxtl::roundup(end, static_cast<size_t>(kBlobstoreChunkBlocks)),
+                        static_cast<size_t>(BlobDataBlocks(*inode)));
+    }
+
+    // Read every run of blocks missing from the range in one transaction...
+    ReadTxn txn(blobstore_.get());
+    bool missing = false;
+    mx_status_t status;
+    for (size_t n = start; (n = verified_.Scan(n, end, true)) < end;) {
+        size_t run_end = verified_.Scan(n, end, false);
+        if (!compressed) {
+            txn.Enqueue(vmoid_, merkle_blocks + n, inode->start_block + merkle_blocks + n,
+                        run_end - n);
+        } else if ((status = LoadChunks(n, run_end)) != MX_OK) {
+            return status;
+        }
+        missing = true;
+        n = run_end;
+    }
+    if (!missing) {
+        return MX_OK;
+    }
+    if ((status = txn.Flush()) != MX_OK) {
+        return status;
+    }
+
+    // ... and then check each run against the tree.
+    Digest d;
+    d = ((const uint8_t*)&digest_[0]);
+    uint64_t size_merkle = MerkleTree::GetTreeLength(inode->blob_size);
+    const void* merkle_data = GetMerkle();
+    const void* blob_data = GetData();
+    for (size_t n = start; (n = verified_.Scan(n, end, true)) < end;) {
+        size_t run_end = verified_.Scan(n, end, false);
+        size_t run_off = n * kBlobstoreBlockSize;
+        size_t run_len = mxtl::min(run_end * kBlobstoreBlockSize, inode->blob_size) - run_off;
+        if ((status = MerkleTree::Verify(blob_data, inode->blob_size, merkle_data, size_merkle,
+                                         run_off, run_len, d)) != MX_OK) {
+            return status;
+        }
+        verified_.Set(n, run_end);
+        n = run_end;
+    }
+    return MX_OK;
 }
 
 uint64_t VnodeBlob::SizeData() const {
@@ -190,6 +327,10 @@ VnodeBlob::VnodeBlob(mxtl::RefPtr<Blobstore> bs)
 
 void VnodeBlob::BlobCloseHandles() {
     blob_ = nullptr;
+    if (compressed_ != nullptr) {
+        blobstore_->DetachVmo(compressed_vmoid_);
+        compressed_ = nullptr;
+    }
     readable_event_.reset();
 }
 
@@ -210,6 +351,7 @@ mx_status_t VnodeBlob::SpaceAllocate(uint64_t size_data) {
     // Initialize the inode with known fields
     blobstore_inode_t* inode = blobstore_->GetNode(map_index_);
     memset(inode->merkle_root_hash, 0, Digest::kLength);
+    inode->flags = 0;
     inode->blob_size = size_data;
     inode->num_blocks = MerkleTreeBlocks(*inode) + BlobDataBlocks(*inode);
 
@@ -217,6 +359,9 @@ mx_status_t VnodeBlob::SpaceAllocate(uint64_t size_data) {
     if ((status = MappedVmo::Create(inode->num_blocks * kBlobstoreBlockSize, "blob", &blob_)) != MX_OK) {
         goto fail;
     }
+    if ((status = verified_.Reset(BlobDataBlocks(*inode))) != MX_OK) {
+        goto fail;
+    }
     if ((status = blobstore_->AttachVmo(blob_->GetVmo(), &vmoid_)) != MX_OK) {
         goto fail;
     }
@@ -245,6 +390,84 @@ mx_status_t VnodeBlob::WriteShared(WriteTxn* txn, size_t start, size_t len, uint
     return txn->Flush();
 }
 
+mx_status_t VnodeBlob::CompressData(mxtl::unique_ptr<MappedVmo>* out, uint64_t* out_blocks) {
+    auto inode = blobstore_->GetNode(map_index_);
+    uint64_t data_blocks = BlobDataBlocks(*inode);
+    uint64_t table_blocks = ChunkTableBlocks(*inode);
+
+    // Compressing has to save at least an eighth of the blocks to be worth
+    // decompressing on every read.
+    uint64_t max_blocks = data_blocks - data_blocks / 8;
+    if (max_blocks <= table_blocks) {
+        return MX_ERR_OUT_OF_RANGE;
+    }
+
+    mx_status_t status;
+    mxtl::unique_ptr<MappedVmo> vmo;
+    if ((status = MappedVmo::Create(max_blocks * kBlobstoreBlockSize, "blob-compressed",
+                                    &vmo)) != MX_OK) {
+        return status;
+    }
+    uint32_t* table = static_cast<uint32_t*>(vmo->GetData());
+    char* chunks = static_cast<char*>(vmo->GetData()) + table_blocks * kBlobstoreBlockSize;
+    size_t capacity = (max_blocks - table_blocks) * kBlobstoreBlockSize;
+
+    const char* data = static_cast<const char*>(GetData());
+    uint64_t chunk_count = BlobChunks(*inode);
+    size_t pos = 0;
+    for (uint64_t c = 0; c < chunk_count; c++) {
+        size_t off = c * kBlobstoreChunkSize;
+        int len = static_cast<int>(mxtl::min(static_cast<uint64_t>(kBlobstoreChunkSize),
+                                             inode->blob_size - off));
+        int room = static_cast<int>(mxtl::min(capacity - pos, static_cast<size_t>(INT_MAX)));
+        table[c] = static_cast<uint32_t>(pos);
+        int r = LZ4_compress_default(data + off, chunks + pos, len, room);
+        if (r <= 0) {
+            // Ran out of room: it doesn't compress well enough.
+            return MX_ERR_OUT_OF_RANGE;
+        }
+        pos += r;
+    }
+    table[chunk_count] = static_cast<uint32_t>(pos);
+
+    *out_blocks = table_blocks + mxtl::roundup(pos, kBlobstoreBlockSize) / kBlobstoreBlockSize;
+    *out = mxtl::move(vmo);
+    return MX_OK;
+}
+
+mx_status_t VnodeBlob::WriteData(WriteTxn* txn) {
+    auto inode = blobstore_->GetNode(map_index_);
+    uint64_t merkle_blocks = MerkleTreeBlocks(*inode);
+    uint64_t data_blocks = BlobDataBlocks(*inode);
+
+    mxtl::unique_ptr<MappedVmo> compressed;
+    uint64_t compressed_blocks;
+    if (CompressData(&compressed, &compressed_blocks) != MX_OK) {
+        return WriteShared(txn, merkle_blocks * kBlobstoreBlockSize,
+                           inode->blob_size, inode->start_block);
+    }
+
+    mx_status_t status;
+    vmoid_t vmoid;
+    if ((status = blobstore_->AttachVmo(compressed->GetVmo(), &vmoid)) != MX_OK) {
+        return status;
+    }
+    txn->Enqueue(vmoid, 0, inode->start_block + merkle_blocks, compressed_blocks);
+    status = txn->Flush();
+    blobstore_->DetachVmo(vmoid);
+    if (status != MX_OK) {
+        return status;
+    }
+
+    // Give back the blocks the compressed blob doesn't need. They were only
+    // ever allocated in memory.
+    blobstore_->FreeBlocks(data_blocks - compressed_blocks,
+                           inode->start_block + merkle_blocks + compressed_blocks);
+    inode->num_blocks = merkle_blocks + compressed_blocks;
+    inode->flags |= kBlobstoreInodeFlagLZ4;
+    return MX_OK;
+}
+
 void* VnodeBlob::GetData() const {
     auto inode = blobstore_->GetNode(map_index_);
     return fs::GetBlock<kBlobstoreBlockSize>(blob_->GetData(),
@@ -297,6 +520,8 @@ mx_status_t VnodeBlob::WriteMetadata() {
 
     blobstore_->CountUpdate(&txn);
     flags_ &= ~kBlobFlagSync;
+    // The blob was just written, and its data is all still in the VMO.
+    blobstore_->BlobCacheTouch(this);
     return MX_OK;
 }
 
@@ -317,12 +542,8 @@ mx_status_t VnodeBlob::WriteInternal(const void* data, size_t len, size_t* actua
             return status;
         }
 
-        status = WriteShared(&txn, offset, len, inode->start_block);
-        if (status != MX_OK) {
-            SetState(kBlobStateError);
-            return status;
-        }
-
+        // The data is only written to disk once all of it is here, and it
+        // can be compressed.
         *actual = to_write;
         bytes_written_ += to_write;
 
@@ -348,6 +569,8 @@ mx_status_t VnodeBlob::WriteInternal(const void* data, size_t len, size_t* actua
                 SetState(kBlobStateError);
                 return status;
             }
+            // The data in the VMO is just what the tree was made from.
+            verified_.Set(0, verified_.size());
 
             status = WriteShared(&txn, 0, merkle_size, inode->start_block);
             if (status != MX_OK) {
@@ -356,6 +579,11 @@ mx_status_t VnodeBlob::WriteInternal(const void* data, size_t len, size_t* actua
             }
         }
 
+        if ((status = WriteData(&txn)) != MX_OK) {
+            SetState(kBlobStateError);
+            return status;
+        }
+
         // No more data to write. Flush to disk.
         if ((status = WriteMetadata()) != MX_OK) {
             SetState(kBlobStateError);
@@ -397,16 +625,10 @@ mx_status_t VnodeBlob::CopyVmo(mx_rights_t rights, mx_handle_t* out) {
     // TODO(smklein): We could lazily verify more of the VMO if
     // we could fault in pages on-demand.
     //
-    // For now, we aggressively verify the entire VMO up front.
-    Digest d;
-    d = ((const uint8_t*)&digest_[0]);
+    // For now, the clone's pages can't be faulted in later, so all of the
+    // blob which hasn't been read yet is read and verified up front.
     auto inode = blobstore_->GetNode(map_index_);
-    uint64_t size_merkle = MerkleTree::GetTreeLength(inode->blob_size);
-    const void* merkle_data = GetMerkle();
-    const void* blob_data = GetData();
-    status = MerkleTree::Verify(blob_data, inode->blob_size, merkle_data,
-                                size_merkle, 0, inode->blob_size, d);
-    if (status != MX_OK) {
+    if ((status = LoadAndVerify(0, inode->blob_size)) != MX_OK) {
         return status;
     }
 
@@ -436,8 +658,6 @@ mx_status_t VnodeBlob::ReadInternal(void* data, size_t len, size_t off, size_t*
         return status;
     }
 
-    Digest d;
-    d = ((const uint8_t*)&digest_[0]);
     auto inode = blobstore_->GetNode(map_index_);
     if (off >= inode->blob_size) {
         *actual = 0;
@@ -447,12 +667,7 @@ mx_status_t VnodeBlob::ReadInternal(void* data, size_t len, size_t off, size_t*
         len = inode->blob_size - off;
     }
 
-    uint64_t size_merkle = MerkleTree::GetTreeLength(inode->blob_size);
-    const void* merkle_data = GetMerkle();
-    const void* blob_data = GetData();
-    status = MerkleTree::Verify(blob_data, inode->blob_size, merkle_data,
-                                size_merkle, off, len, d);
-    if (status != MX_OK) {
+    if ((status = LoadAndVerify(off, len)) != MX_OK) {
         return status;
     }
 
@@ -462,6 +677,18 @@ mx_status_t VnodeBlob::ReadInternal(void* data, size_t len, size_t off, size_t*
 
 void VnodeBlob::QueueUnlink() {
     flags_ |= kBlobFlagDeletable;
+    // Let go of the blob, so that it's freed on close.
+    blobstore_->BlobCacheRemove(this);
+}
+
+size_t VnodeBlob::CacheFootprint() const {
+    auto inode = blobstore_->GetNode(map_index_);
+    size_t bytes = sizeof(*this) +
+                   (MerkleTreeBlocks(*inode) + BlobDataBlocks(*inode)) * kBlobstoreBlockSize;
+    if (inode->flags & kBlobstoreInodeFlagLZ4) {
+        bytes += (inode->num_blocks - MerkleTreeBlocks(*inode)) * kBlobstoreBlockSize;
+    }
+    return bytes;
 }
 
 // Allocates Blocks IN MEMORY
@@ -474,6 +701,13 @@ mx_status_t Blobstore::AllocateBlocks(size_t nblocks, size_t* blkno_out) {
     status = block_map_.Set(*blkno_out, *blkno_out + nblocks);
     assert(status == MX_OK);
     info_.alloc_block_count += nblocks;
+    for (size_t i = 0; i < discard_count_; i++) {
+        if ((discards_[i].start < *blkno_out + nblocks) &&
+            (*blkno_out < discards_[i].start + discards_[i].count)) {
+            FlushDiscards();
+            break;
+        }
+    }
     return MX_OK;
 }
 
@@ -485,6 +719,39 @@ void Blobstore::FreeBlocks(size_t nblocks, size_t blkno) {
     assert(status == MX_OK);
 }
 
+void Blobstore::QueueDiscard(uint64_t nblocks, uint64_t start_block) {
+    if (!discard_ || (nblocks == 0)) {
+        return;
+    }
+    if (discard_count_ == MAX_TXN_MESSAGES) {
+        FlushDiscards();
+    }
+    discards_[discard_count_].start = start_block;
+    discards_[discard_count_].count = nblocks;
+    discard_count_++;
+}
+
+void Blobstore::FlushDiscards() {
+    if (discard_count_ == 0) {
+        return;
+    }
+    // Until the nodes and bitmaps no longer refer to the blocks, discarding
+    // them could leave a blob which fails to verify after a crash.
+    if (fsync(blockfd_) == 0) {
+        block_fifo_request_t requests[MAX_TXN_MESSAGES];
+        for (size_t i = 0; i < discard_count_; i++) {
+            requests[i].txnid = txnid_;
+            requests[i].vmoid = 0;
+            requests[i].opcode = BLOCKIO_DISCARD;
+            requests[i].vmo_offset = 0;
+            requests[i].dev_offset = discards_[i].start * kBlobstoreBlockSize;
+            requests[i].length = discards_[i].count * kBlobstoreBlockSize;
+        }
+        Txn(requests, discard_count_);
+    }
+    discard_count_ = 0;
+}
+
 // Allocates a node IN MEMORY
 mx_status_t Blobstore::AllocateNode(size_t* node_index_out) {
     for (size_t i = 0; i < info_.inode_count; ++i) {
@@ -506,6 +773,13 @@ void Blobstore::FreeNode(size_t node_index) {
 }
 
 mx_status_t Blobstore::Unmount() {
+    // The cached blobs hold references to the blobstore.
+    BlobCacheDrop();
+    while (!pinned_.is_empty()) {
+        mxtl::RefPtr<VnodeBlob> vn = pinned_.pop_front();
+        vn->flags_ &= ~kBlobFlagPinned;
+    }
+    FlushDiscards();
     close(blockfd_);
     return MX_OK;
 }
@@ -577,6 +851,7 @@ mx_status_t Blobstore::ReleaseBlob(VnodeBlob* vn) {
         WriteNode(&txn, node_index);
         WriteBitmap(&txn, nblocks, start_block);
         CountUpdate(&txn);
+        QueueDiscard(nblocks, start_block);
         hash_.erase(*vn);
         return MX_OK;
     }
@@ -587,6 +862,43 @@ mx_status_t Blobstore::ReleaseBlob(VnodeBlob* vn) {
     return MX_ERR_NOT_SUPPORTED;
 }
 
+void Blobstore::BlobCacheTouch(VnodeBlob* vn) {
+    if ((vn->GetState() != kBlobStateReadable) || vn->DeletionQueued() || vn->Pinned()) {
+        return;
+    }
+    blob_cache_.Touch(vn, vn->CacheFootprint());
+}
+
+void Blobstore::BlobCacheRemove(VnodeBlob* vn) {
+    if (vn->Pinned()) {
+        mxtl::RefPtr<VnodeBlob> ref = pinned_.erase(*vn);
+        vn->flags_ &= ~kBlobFlagPinned;
+    } else {
+        blob_cache_.Remove(vn);
+    }
+}
+
+void Blobstore::BlobCacheDrop() {
+    blob_cache_.Drop();
+}
+
+mx_status_t Blobstore::BlobCachePin(VnodeBlob* vn, bool pin) {
+    if ((vn->GetState() != kBlobStateReadable) || vn->DeletionQueued()) {
+        return MX_ERR_BAD_STATE;
+    } else if (pin == vn->Pinned()) {
+        return MX_OK;
+    }
+
+    BlobCacheRemove(vn);
+    if (pin) {
+        vn->flags_ |= kBlobFlagPinned;
+        pinned_.push_front(mxtl::WrapRefPtr(vn));
+    } else {
+        BlobCacheTouch(vn);
+    }
+    return MX_OK;
+}
+
 mx_status_t Blobstore::CountUpdate(WriteTxn* txn) {
     mx_status_t status = MX_OK;
     void* infodata = info_vmo_->GetData();
@@ -631,6 +943,7 @@ mx_status_t Blobstore::LookupBlob(const Digest& digest, mxtl::RefPtr<VnodeBlob>*
     digest.ReleaseBytes();
     if (vn != nullptr) {
         if (out != nullptr) {
+            BlobCacheTouch(vn.get());
             *out = mxtl::move(vn);
         }
         return MX_OK;
@@ -652,6 +965,7 @@ mx_status_t Blobstore::LookupBlob(const Digest& digest, mxtl::RefPtr<VnodeBlob>*
                     vn->SetMapIndex(i);
                     // Delay reading any data from disk until read.
                     hash_.insert(vn.get());
+                    BlobCacheTouch(vn.get());
                     *out = mxtl::move(vn);
                 }
                 return MX_OK;
@@ -675,6 +989,14 @@ mx_status_t Blobstore::AttachVmo(mx_handle_t vmo, vmoid_t* out) {
     return MX_OK;
 }
 
+void Blobstore::DetachVmo(vmoid_t vmoid) {
+    block_fifo_request_t request;
+    request.txnid = txnid_;
+    request.vmoid = vmoid;
+    request.opcode = BLOCKIO_CLOSE_VMO;
+    Txn(&request, 1);
+}
+
 Blobstore::Blobstore(int fd, const blobstore_info_t* info)
     : blockfd_(fd) {
     memcpy(&info_, info, sizeof(blobstore_info_t));
@@ -707,9 +1029,13 @@ mx_status_t Blobstore::Create(int fd, const blobstore_info_t* info, mxtl::RefPtr
     }
 
     mx_handle_t fifo;
+    block_info_t binfo;
     ssize_t r;
     if ((r = ioctl_block_get_fifos(fd, &fifo)) < 0) {
         return static_cast<mx_status_t>(r);
+    } else if ((r = ioctl_block_get_info(fd, &binfo)) < 0) {
+        mx_handle_close(fifo);
+        return static_cast<mx_status_t>(r);
     } else if ((r = ioctl_block_alloc_txn(fd, &fs->txnid_)) < 0) {
         mx_handle_close(fifo);
         return static_cast<mx_status_t>(r);
@@ -718,6 +1044,7 @@ mx_status_t Blobstore::Create(int fd, const blobstore_info_t* info, mxtl::RefPtr
         mx_handle_close(fifo);
         return status;
     }
+    fs->discard_ = (binfo.flags & BLOCK_FLAG_DISCARD) != 0;
 
     // Keep the block_map_ aligned to a block multiple
     if ((status = fs->block_map_.Reset(BlockMapBlocks(fs->info_) * kBlobstoreBlockBits)) < 0) {
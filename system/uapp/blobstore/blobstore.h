@@ -92,9 +92,22 @@ typedef struct {
     uint64_t start_block;
     uint64_t num_blocks;
     uint64_t blob_size;
-    uint64_t reserved;
+    uint32_t flags;
+    uint32_t reserved;
 } blobstore_inode_t;
 
+// The blob's data is stored compressed.
+constexpr uint32_t kBlobstoreInodeFlagLZ4   = 1;
+
+// A compressed blob's content is split into chunks of this size, each
+// compressed on its own with LZ4, so that a range of the blob can be read
+// without decompressing everything ahead of it. The blob's Merkle tree, still
+// computed over the uncompressed content, is followed by a table of where
+// each compressed chunk starts, relative to the end of the table, with one
+// more entry for the end of the last chunk, and then by the chunks.
+constexpr uint32_t kBlobstoreChunkSize      = 65536;
+constexpr uint32_t kBlobstoreChunkBlocks    = kBlobstoreChunkSize / kBlobstoreBlockSize;
+
 static_assert(sizeof(blobstore_inode_t) == kBlobstoreInodeSize,
               "Blobstore Inode size is wrong");
 static_assert(kBlobstoreBlockSize % kBlobstoreInodeSize == 0,
@@ -105,5 +118,15 @@ constexpr uint64_t BlobDataBlocks(const blobstore_inode_t& blobNode) {
     return mxtl::roundup(blobNode.blob_size, kBlobstoreBlockSize) / kBlobstoreBlockSize;
 }
 
+constexpr uint64_t BlobChunks(const blobstore_inode_t& blobNode) {
+    return mxtl::roundup(blobNode.blob_size, kBlobstoreChunkSize) / kBlobstoreChunkSize;
+}
+
+// Number of blocks holding the chunk table of a compressed blob
+constexpr uint64_t ChunkTableBlocks(const blobstore_inode_t& blobNode) {
+    return mxtl::roundup((BlobChunks(blobNode) + 1) * sizeof(uint32_t),
+                         kBlobstoreBlockSize) / kBlobstoreBlockSize;
+}
+
 void* GetBlock(const RawBitmap& bitmap, uint32_t blkno);
 void* GetBitBlock(const RawBitmap& bitmap, uint32_t* blkno_out, uint32_t bitno);
@@ -23,6 +23,7 @@ MODULE_STATIC_LIBS := \
     system/ulib/fs \
     system/ulib/digest \
     third_party/ulib/cryptolib \
+    third_party/ulib/lz4 \
     system/ulib/mx \
     system/ulib/mxalloc \
     system/ulib/mxcpp \
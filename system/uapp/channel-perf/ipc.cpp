@@ -0,0 +1,453 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Latency of each kind of IPC, one round trip at a time.  The one thread
+// tests send to themselves, so they cost the syscalls without a context
+// switch.  The two thread tests bounce off an echo thread, which the
+// scheduler is free to run on the same cpu or another: there is no way to
+// pin a thread yet, so repeated runs are the way to see both.
+
+#include "ipc.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+#include <magenta/syscalls.h>
+#include <magenta/syscalls/port.h>
+#include <mxtl/unique_ptr.h>
+
+namespace {
+
+constexpr uint32_t kMessageSize = 64;
+constexpr uint32_t kFifoElemSize = 8;
+constexpr uint32_t kFifoElemCount = 16;
+// Round trips made before timing starts, to settle caches and threads.
+constexpr uint32_t kWarmup = 100;
+constexpr uint64_t kPortStopKey = 1;
+
+// Times |samples| calls to |op|, after |kWarmup| untimed ones.
+template <typename T>
+bool measure(uint32_t samples, uint64_t* ticks, T op) {
+    for (uint32_t i = 0; i < kWarmup; i++) {
+        if (!op())
+            return false;
+    }
+    for (uint32_t i = 0; i < samples; i++) {
+        uint64_t start = mx_ticks_get();
+        if (!op())
+            return false;
+        ticks[i] = mx_ticks_get() - start;
+    }
+    return true;
+}
+
+// Waits for |handle| to be readable, failing once its peer has gone.
+bool wait_readable(mx_handle_t handle, mx_signals_t readable, mx_signals_t peer_closed) {
+    mx_signals_t observed;
+    if (mx_object_wait_one(handle, readable | peer_closed, MX_TIME_INFINITE,
+                           &observed) != MX_OK)
+        return false;
+    return (observed & readable) != 0;
+}
+
+mx_handle_t handle_from(void* arg) {
+    return static_cast<mx_handle_t>(reinterpret_cast<uintptr_t>(arg));
+}
+
+void* handle_to(mx_handle_t handle) {
+    return reinterpret_cast<void*>(static_cast<uintptr_t>(handle));
+}
+
+// The echo threads send back what they're sent until the other end is
+// closed, then close their own.
+
+int channel_echo(void* arg) {
+    mx_handle_t channel = handle_from(arg);
+    uint8_t buf[kMessageSize];
+    while (wait_readable(channel, MX_CHANNEL_READABLE, MX_CHANNEL_PEER_CLOSED)) {
+        uint32_t actual_bytes, actual_handles;
+        if (mx_channel_read(channel, 0u, buf, nullptr, sizeof(buf), 0u,
+                            &actual_bytes, &actual_handles) != MX_OK)
+            break;
+        if (mx_channel_write(channel, 0u, buf, actual_bytes, nullptr, 0u) != MX_OK)
+            break;
+    }
+    mx_handle_close(channel);
+    return 0;
+}
+
+int fifo_echo(void* arg) {
+    mx_handle_t fifo = handle_from(arg);
+    uint8_t buf[kFifoElemSize];
+    while (wait_readable(fifo, MX_FIFO_READABLE, MX_FIFO_PEER_CLOSED)) {
+        uint32_t actual;
+        if (mx_fifo_read(fifo, buf, sizeof(buf), &actual) != MX_OK)
+            break;
+        if (mx_fifo_write(fifo, buf, sizeof(buf), &actual) != MX_OK)
+            break;
+    }
+    mx_handle_close(fifo);
+    return 0;
+}
+
+int socket_echo(void* arg) {
+    mx_handle_t socket = handle_from(arg);
+    uint8_t buf[kMessageSize];
+    while (wait_readable(socket, MX_SOCKET_READABLE, MX_SOCKET_PEER_CLOSED)) {
+        size_t actual;
+        if (mx_socket_read(socket, 0u, buf, sizeof(buf), &actual) != MX_OK)
+            break;
+        if (mx_socket_write(socket, 0u, buf, actual, &actual) != MX_OK)
+            break;
+    }
+    mx_handle_close(socket);
+    return 0;
+}
+
+int eventpair_echo(void* arg) {
+    mx_handle_t eventpair = handle_from(arg);
+    while (wait_readable(eventpair, MX_USER_SIGNAL_0, MX_EPAIR_PEER_CLOSED)) {
+        if (mx_object_signal(eventpair, MX_USER_SIGNAL_0, 0u) != MX_OK)
+            break;
+        if (mx_object_signal_peer(eventpair, 0u, MX_USER_SIGNAL_0) != MX_OK)
+            break;
+    }
+    mx_handle_close(eventpair);
+    return 0;
+}
+
+// Starts an echo thread on |far|, which it then owns.
+bool start_echo(thrd_t* thread, thrd_start_t echo, mx_handle_t far) {
+    if (thrd_create(thread, echo, handle_to(far)) != thrd_success) {
+        mx_handle_close(far);
+        return false;
+    }
+    return true;
+}
+
+// Closes |near|, which stops the echo thread, and waits for it to go.
+void stop_echo(thrd_t thread, mx_handle_t near) {
+    mx_handle_close(near);
+    thrd_join(thread, nullptr);
+}
+
+bool channel_write_read(uint32_t samples, uint64_t* ticks, uint32_t) {
+    mx_handle_t channel[2];
+    if (mx_channel_create(0u, &channel[0], &channel[1]) != MX_OK)
+        return false;
+    uint8_t buf[kMessageSize] = {};
+    bool ok = measure(samples, ticks, [&]() {
+        uint32_t actual_bytes, actual_handles;
+        return mx_channel_write(channel[0], 0u, buf, sizeof(buf), nullptr, 0u) == MX_OK &&
+               mx_channel_read(channel[1], 0u, buf, nullptr, sizeof(buf), 0u,
+                               &actual_bytes, &actual_handles) == MX_OK;
+    });
+    mx_handle_close(channel[0]);
+    mx_handle_close(channel[1]);
+    return ok;
+}
+
+bool channel_call(uint32_t samples, uint64_t* ticks, uint32_t) {
+    mx_handle_t channel[2];
+    if (mx_channel_create(0u, &channel[0], &channel[1]) != MX_OK)
+        return false;
+    thrd_t thread;
+    if (!start_echo(&thread, channel_echo, channel[1])) {
+        mx_handle_close(channel[0]);
+        return false;
+    }
+
+    uint8_t wr[kMessageSize] = {};
+    uint8_t rd[kMessageSize];
+    uint32_t txid = 0;
+    bool ok = measure(samples, ticks, [&]() {
+        // The echo sends the txid back, which is all channel_call needs.
+        ++txid;
+        memcpy(wr, &txid, sizeof(txid));
+        mx_channel_call_args_t args = {wr, nullptr, rd, nullptr,
+                                       sizeof(wr), 0u, sizeof(rd), 0u};
+        uint32_t actual_bytes, actual_handles;
+        mx_status_t read_status;
+        return mx_channel_call(channel[0], 0u, MX_TIME_INFINITE, &args, &actual_bytes,
+                               &actual_handles, &read_status) == MX_OK;
+    });
+    stop_echo(thread, channel[0]);
+    return ok;
+}
+
+bool port_queue_wait(uint32_t samples, uint64_t* ticks, uint32_t) {
+    mx_handle_t port;
+    if (mx_port_create(MX_PORT_OPT_V2, &port) != MX_OK)
+        return false;
+    mx_port_packet_t packet = {};
+    bool ok = measure(samples, ticks, [&]() {
+        return mx_port_queue(port, &packet, 0u) == MX_OK &&
+               mx_port_wait(port, 0u, &packet, 0u) == MX_OK;
+    });
+    mx_handle_close(port);
+    return ok;
+}
+
+struct PortPair {
+    mx_handle_t to_echo;
+    mx_handle_t from_echo;
+};
+
+int port_echo(void* arg) {
+    auto ports = static_cast<PortPair*>(arg);
+    mx_port_packet_t packet;
+    while (mx_port_wait(ports->to_echo, MX_TIME_INFINITE, &packet, 0u) == MX_OK &&
+           packet.key != kPortStopKey) {
+        if (mx_port_queue(ports->from_echo, &packet, 0u) != MX_OK)
+            break;
+    }
+    return 0;
+}
+
+bool port_ping_pong(uint32_t samples, uint64_t* ticks, uint32_t) {
+    PortPair ports;
+    if (mx_port_create(MX_PORT_OPT_V2, &ports.to_echo) != MX_OK)
+        return false;
+    if (mx_port_create(MX_PORT_OPT_V2, &ports.from_echo) != MX_OK) {
+        mx_handle_close(ports.to_echo);
+        return false;
+    }
+
+    bool ok = false;
+    thrd_t thread;
+    if (thrd_create(&thread, port_echo, &ports) == thrd_success) {
+        mx_port_packet_t packet = {};
+        ok = measure(samples, ticks, [&]() {
+            packet.key = 0u;
+            return mx_port_queue(ports.to_echo, &packet, 0u) == MX_OK &&
+                   mx_port_wait(ports.from_echo, MX_TIME_INFINITE, &packet, 0u) == MX_OK;
+        });
+        packet.key = kPortStopKey;
+        mx_port_queue(ports.to_echo, &packet, 0u);
+        thrd_join(thread, nullptr);
+    }
+    mx_handle_close(ports.to_echo);
+    mx_handle_close(ports.from_echo);
+    return ok;
+}
+
+bool fifo_write_read(uint32_t samples, uint64_t* ticks, uint32_t) {
+    mx_handle_t fifo[2];
+    if (mx_fifo_create(kFifoElemCount, kFifoElemSize, 0u, &fifo[0], &fifo[1]) != MX_OK)
+        return false;
+    uint8_t buf[kFifoElemSize] = {};
+    bool ok = measure(samples, ticks, [&]() {
+        uint32_t actual;
+        return mx_fifo_write(fifo[0], buf, sizeof(buf), &actual) == MX_OK &&
+               mx_fifo_read(fifo[1], buf, sizeof(buf), &actual) == MX_OK;
+    });
+    mx_handle_close(fifo[0]);
+    mx_handle_close(fifo[1]);
+    return ok;
+}
+
+bool fifo_ping_pong(uint32_t samples, uint64_t* ticks, uint32_t) {
+    mx_handle_t fifo[2];
+    if (mx_fifo_create(kFifoElemCount, kFifoElemSize, 0u, &fifo[0], &fifo[1]) != MX_OK)
+        return false;
+    thrd_t thread;
+    if (!start_echo(&thread, fifo_echo, fifo[1])) {
+        mx_handle_close(fifo[0]);
+        return false;
+    }
+
+    uint8_t buf[kFifoElemSize] = {};
+    bool ok = measure(samples, ticks, [&]() {
+        uint32_t actual;
+        return mx_fifo_write(fifo[0], buf, sizeof(buf), &actual) == MX_OK &&
+               wait_readable(fifo[0], MX_FIFO_READABLE, MX_FIFO_PEER_CLOSED) &&
+               mx_fifo_read(fifo[0], buf, sizeof(buf), &actual) == MX_OK;
+    });
+    stop_echo(thread, fifo[0]);
+    return ok;
+}
+
+// |options| picks a stream or datagram socket.  A stream may come back in
+// pieces, so the round trip isn't over until all of it has.
+bool socket_ping_pong(uint32_t samples, uint64_t* ticks, uint32_t options) {
+    mx_handle_t socket[2];
+    if (mx_socket_create(options, &socket[0], &socket[1]) != MX_OK)
+        return false;
+    thrd_t thread;
+    if (!start_echo(&thread, socket_echo, socket[1])) {
+        mx_handle_close(socket[0]);
+        return false;
+    }
+
+    uint8_t buf[kMessageSize] = {};
+    bool ok = measure(samples, ticks, [&]() {
+        size_t actual;
+        if (mx_socket_write(socket[0], 0u, buf, sizeof(buf), &actual) != MX_OK ||
+            actual != sizeof(buf))
+            return false;
+        for (size_t got = 0; got < sizeof(buf); got += actual) {
+            if (!wait_readable(socket[0], MX_SOCKET_READABLE, MX_SOCKET_PEER_CLOSED) ||
+                mx_socket_read(socket[0], 0u, buf + got, sizeof(buf) - got, &actual) != MX_OK)
+                return false;
+        }
+        return true;
+    });
+    stop_echo(thread, socket[0]);
+    return ok;
+}
+
+// Whose turn it is: the echo thread's while kFutexEcho, and it stops when
+// it sees kFutexStop.
+enum : int {
+    kFutexNear = 0,
+    kFutexEcho = 1,
+    kFutexStop = 2,
+};
+
+// Waits for |*futex| to stop being |value|, and returns what it became.
+int futex_wait_change(mx_futex_t* futex, int value) {
+    int now;
+    while ((now = __atomic_load_n(futex, __ATOMIC_ACQUIRE)) == value)
+        mx_futex_wait(futex, value, MX_TIME_INFINITE);
+    return now;
+}
+
+void futex_hand_over(mx_futex_t* futex, int value) {
+    __atomic_store_n(futex, value, __ATOMIC_RELEASE);
+    mx_futex_wake(futex, 1u);
+}
+
+int futex_echo(void* arg) {
+    auto futex = static_cast<mx_futex_t*>(arg);
+    while (futex_wait_change(futex, kFutexNear) == kFutexEcho)
+        futex_hand_over(futex, kFutexNear);
+    return 0;
+}
+
+bool futex_ping_pong(uint32_t samples, uint64_t* ticks, uint32_t) {
+    mx_futex_t futex = kFutexNear;
+    thrd_t thread;
+    if (thrd_create(&thread, futex_echo, &futex) != thrd_success)
+        return false;
+    bool ok = measure(samples, ticks, [&]() {
+        futex_hand_over(&futex, kFutexEcho);
+        return futex_wait_change(&futex, kFutexEcho) == kFutexNear;
+    });
+    futex_hand_over(&futex, kFutexStop);
+    thrd_join(thread, nullptr);
+    return ok;
+}
+
+bool eventpair_ping_pong(uint32_t samples, uint64_t* ticks, uint32_t) {
+    mx_handle_t eventpair[2];
+    if (mx_eventpair_create(0u, &eventpair[0], &eventpair[1]) != MX_OK)
+        return false;
+    thrd_t thread;
+    if (!start_echo(&thread, eventpair_echo, eventpair[1])) {
+        mx_handle_close(eventpair[0]);
+        return false;
+    }
+
+    bool ok = measure(samples, ticks, [&]() {
+        return mx_object_signal_peer(eventpair[0], 0u, MX_USER_SIGNAL_0) == MX_OK &&
+               wait_readable(eventpair[0], MX_USER_SIGNAL_0, MX_EPAIR_PEER_CLOSED) &&
+               mx_object_signal(eventpair[0], MX_USER_SIGNAL_0, 0u) == MX_OK;
+    });
+    stop_echo(thread, eventpair[0]);
+    return ok;
+}
+
+// One of |fan_in| events is signaled at a time, taking turns, and found
+// with a wait on all of them.  The signaling costs the same whatever the
+// fan-in, so the differences are the wait's.
+bool wait_many(uint32_t samples, uint64_t* ticks, uint32_t fan_in) {
+    mxtl::unique_ptr<mx_wait_item_t[]> items(new mx_wait_item_t[fan_in]);
+    uint32_t created = 0;
+    bool ok = true;
+    for (; created < fan_in && ok; created++) {
+        ok = mx_event_create(0u, &items[created].handle) == MX_OK;
+        items[created].waitfor = MX_EVENT_SIGNALED;
+        items[created].pending = 0u;
+    }
+
+    uint32_t next = 0;
+    if (ok) {
+        ok = measure(samples, ticks, [&]() {
+            mx_handle_t event = items[next].handle;
+            next = (next + 1) % fan_in;
+            return mx_object_signal(event, 0u, MX_EVENT_SIGNALED) == MX_OK &&
+                   mx_object_wait_many(items.get(), fan_in, MX_TIME_INFINITE) == MX_OK &&
+                   mx_object_signal(event, MX_EVENT_SIGNALED, 0u) == MX_OK;
+        });
+    }
+
+    for (uint32_t i = 0; i < created; i++)
+        mx_handle_close(items[i].handle);
+    return ok;
+}
+
+struct Test {
+    const char* name;
+    bool (*run)(uint32_t samples, uint64_t* ticks, uint32_t arg);
+    uint32_t arg;
+};
+
+const Test kTests[] = {
+    {"channel_write_read", channel_write_read, 0u},
+    {"channel_call", channel_call, 0u},
+    {"port_queue_wait", port_queue_wait, 0u},
+    {"port_ping_pong", port_ping_pong, 0u},
+    {"fifo_write_read", fifo_write_read, 0u},
+    {"fifo_ping_pong", fifo_ping_pong, 0u},
+    {"socket_stream_ping_pong", socket_ping_pong, MX_SOCKET_STREAM},
+    {"socket_datagram_ping_pong", socket_ping_pong, MX_SOCKET_DATAGRAM},
+    {"futex_ping_pong", futex_ping_pong, 0u},
+    {"eventpair_ping_pong", eventpair_ping_pong, 0u},
+    {"wait_many_1", wait_many, 1u},
+    {"wait_many_4", wait_many, 4u},
+    {"wait_many_16", wait_many, 16u},
+    {"wait_many_64", wait_many, 64u},
+};
+
+int compare_ticks(const void* a, const void* b) {
+    uint64_t x = *static_cast<const uint64_t*>(a);
+    uint64_t y = *static_cast<const uint64_t*>(b);
+    return (x > y) - (x < y);
+}
+
+double percentile_ns(const uint64_t* sorted, uint32_t count, double p, double ns_per_tick) {
+    uint32_t i = static_cast<uint32_t>(p / 100.0 * (count - 1) + 0.5);
+    return static_cast<double>(sorted[i]) * ns_per_tick;
+}
+
+}  // namespace
+
+bool run_ipc_suite(uint32_t samples) {
+    if (samples == 0u)
+        return false;
+    mxtl::unique_ptr<uint64_t[]> ticks(new uint64_t[samples]);
+    double ns_per_tick = 1e9 / static_cast<double>(mx_ticks_per_second());
+
+    bool ok = true;
+    printf("test,samples,min_ns,p50_ns,p90_ns,p99_ns,p99.9_ns,max_ns\n");
+    for (const auto& test : kTests) {
+        if (!test.run(samples, ticks.get(), test.arg)) {
+            fprintf(stderr, "%s: failed\n", test.name);
+            ok = false;
+            continue;
+        }
+        qsort(ticks.get(), samples, sizeof(ticks[0]), compare_ticks);
+        printf("%s,%" PRIu32 ",%.0f,%.0f,%.0f,%.0f,%.0f,%.0f\n", test.name, samples,
+               percentile_ns(ticks.get(), samples, 0, ns_per_tick),
+               percentile_ns(ticks.get(), samples, 50, ns_per_tick),
+               percentile_ns(ticks.get(), samples, 90, ns_per_tick),
+               percentile_ns(ticks.get(), samples, 99, ns_per_tick),
+               percentile_ns(ticks.get(), samples, 99.9, ns_per_tick),
+               percentile_ns(ticks.get(), samples, 100, ns_per_tick));
+    }
+    return ok;
+}
@@ -0,0 +1,12 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stdint.h>
+
+// Runs the IPC latency suite, timing |samples| round trips of each kind of
+// IPC and printing one CSV line of percentiles per test.  Returns false if
+// any test couldn't be run.
+bool run_ipc_suite(uint32_t samples);
@@ -14,6 +14,8 @@
 #include <magenta/syscalls.h>
 #include <mxtl/unique_ptr.h>
 
+#include "ipc.h"
+
 namespace {
 
 void argument_error(const char* argv0, const char* message) {
@@ -121,15 +123,19 @@ int main(int argc, char** argv) {
         "  -h    show help (this)\n"
         "  -o    run single test (default)\n"
         "  -s    run suite (ignores -S/-H/-Q)\n"
+        "  -l    run IPC latency suite, as CSV (ignores -d/-S/-H/-Q)\n"
         "  -n N  set test repetition count to N (default: 1)\n"
         "  -d N  set test duration to N seconds (default: 5)\n"
         "  -S N  set message size to N bytes (default: 10)\n"
         "  -H N  set message handle count to N handles (default: 0)\n"
-        "  -Q N  set message pre-queue count to N messages (default: 0)\n";
-
-    bool run_suite = false;  // -o/-s
-    uint32_t duration = 5;   // -d
-    uint32_t repeats = 1;    // -n
+        "  -Q N  set message pre-queue count to N messages (default: 0)\n"
+        "  -N N  set latency samples per IPC test to N (default: 10000)\n";
+
+    bool run_suite = false;    // -o/-s
+    bool run_latency = false;  // -l
+    uint32_t samples = 10000;  // -N
+    uint32_t duration = 5;     // -d
+    uint32_t repeats = 1;      // -n
     // Ignored when running a suite:
     TestArgs test_args = {
         10,                  // -S (size)
@@ -138,7 +144,7 @@ int main(int argc, char** argv) {
     };
 
     int opt;
-    while ((opt = getopt(argc, argv, "+hosn:d:S:H:Q:")) != -1) {
+    while ((opt = getopt(argc, argv, "+hosln:d:S:H:Q:N:")) != -1) {
         // Our option values are always unsigned numbers.
         uint32_t value = 0;
         if (optarg) {
@@ -156,9 +162,14 @@ int main(int argc, char** argv) {
                 return EXIT_SUCCESS;
             case 'o':
                 run_suite = false;
+                run_latency = false;
                 break;
             case 's':
                 run_suite = true;
+                run_latency = false;
+                break;
+            case 'l':
+                run_latency = true;
                 break;
             case 'n':
                 assert(optarg);
@@ -180,6 +191,12 @@ int main(int argc, char** argv) {
                 assert(optarg);
                 test_args.queue = value;
                 break;
+            case 'N':
+                assert(optarg);
+                if (value == 0u)
+                    argument_error(argv[0], "need at least one sample");
+                samples = value;
+                break;
             default:  // '?'
                 argument_error(argv[0], "invalid option");
                 break;
@@ -196,7 +213,10 @@ int main(int argc, char** argv) {
                    repeats);
         }
 
-        if (run_suite) {
+        if (run_latency) {
+            if (!run_ipc_suite(samples))
+                return EXIT_FAILURE;
+        } else if (run_suite) {
             static constexpr TestArgs suite[] = {
                 {10, 0, 0},
                 {100, 0, 0},
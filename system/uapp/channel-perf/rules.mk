@@ -9,6 +9,7 @@ MODULE := $(LOCAL_DIR)
 MODULE_TYPE := userapp
 
 MODULE_SRCS += \
+    $(LOCAL_DIR)/ipc.cpp \
     $(LOCAL_DIR)/main.cpp \
 
 MODULE_LIBS := system/ulib/magenta system/ulib/mxio system/ulib/c
@@ -0,0 +1,172 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Samples every cpu for a while and writes out what was running.
+//
+// 1. Record:   magenta> cpuprofile -t 5 /tmp/cpu.prof
+// 2. Grab it:  host> netcp :/tmp/cpu.prof cpu.prof
+// 3. Fold:     host> cpuprofile-fold cpu.prof | flamegraph.pl > cpu.svg
+//
+// The file is each cpu's header followed by its samples, one cpu after
+// another, see magenta/device/cpu-profile.h.
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <magenta/device/cpu-profile.h>
+#include <magenta/device/ktrace.h>
+#include <magenta/mtrace.h>
+#include <magenta/syscalls.h>
+
+static const struct {
+    const char* name;
+    uint32_t event;
+} events[] = {
+    { "cycles", MX_CPU_PROFILE_EVENT_CYCLES },
+    { "instructions", MX_CPU_PROFILE_EVENT_INSTRUCTIONS },
+    { "cache-misses", MX_CPU_PROFILE_EVENT_CACHE_MISSES },
+    { "branch-misses", MX_CPU_PROFILE_EVENT_BRANCH_MISSES },
+};
+
+static void usage(const char* argv0) {
+    fprintf(stderr, "usage: %s [options] <file>\n", argv0);
+    fprintf(stderr, "  -e <event>   cycles (default), instructions, cache-misses, branch-misses\n");
+    fprintf(stderr, "  -p <period>  events between samples (default 1000000)\n");
+    fprintf(stderr, "  -t <secs>    how long to sample (default 1)\n");
+    fprintf(stderr, "  -m <mb>      buffer size in megabytes (default 16)\n");
+}
+
+static mx_handle_t get_root_resource(void) {
+    int fd = open("/dev/misc/ktrace", O_RDWR);
+    if (fd < 0)
+        return MX_HANDLE_INVALID;
+    mx_handle_t h;
+    ssize_t r = ioctl_ktrace_get_handle(fd, &h);
+    close(fd);
+    return r < 0 ? MX_HANDLE_INVALID : h;
+}
+
+static int write_profile(mx_handle_t vmo, size_t vmo_size, const char* path) {
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "cannot create %s\n", path);
+        return -1;
+    }
+
+    uint32_t num_cpus = mx_system_get_num_cpus();
+    size_t per_cpu = (vmo_size / num_cpus) & ~(size_t)7;
+    void* buf = malloc(per_cpu);
+    uint64_t total = 0, dropped = 0;
+    int ret = 0;
+    for (uint32_t cpu = 0; cpu < num_cpus; cpu++) {
+        size_t actual;
+        if (mx_vmo_read(vmo, buf, cpu * per_cpu, per_cpu, &actual) != MX_OK ||
+            actual != per_cpu) {
+            fprintf(stderr, "cannot read samples\n");
+            ret = -1;
+            break;
+        }
+        mx_cpu_profile_header_t* header = buf;
+        size_t len = sizeof(*header) + header->size;
+        if (fwrite(buf, 1, len, f) != len) {
+            fprintf(stderr, "cannot write %s\n", path);
+            ret = -1;
+            break;
+        }
+        total += header->size;
+        dropped += header->dropped;
+    }
+    free(buf);
+    fclose(f);
+
+    if (ret == 0) {
+        printf("wrote %" PRIu64 " bytes of samples to %s", total, path);
+        if (dropped)
+            printf(", %" PRIu64 " samples dropped, use a larger buffer", dropped);
+        printf("\n");
+    }
+    return ret;
+}
+
+int main(int argc, char** argv) {
+    uint32_t event = MX_CPU_PROFILE_EVENT_CYCLES;
+    uint64_t period = 1000000;
+    uint64_t seconds = 1;
+    size_t size_mb = 16;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "e:p:t:m:")) != -1) {
+        switch (opt) {
+        case 'e': {
+            size_t i;
+            for (i = 0; i < countof(events); i++) {
+                if (!strcmp(optarg, events[i].name))
+                    break;
+            }
+            if (i == countof(events)) {
+                usage(argv[0]);
+                return -1;
+            }
+            event = events[i].event;
+            break;
+        }
+        case 'p':
+            period = strtoull(optarg, NULL, 0);
+            break;
+        case 't':
+            seconds = strtoull(optarg, NULL, 0);
+            break;
+        case 'm':
+            size_mb = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+            return -1;
+        }
+    }
+    if (optind != argc - 1 || period == 0 || period > MX_CPU_PROFILE_MAX_PERIOD ||
+        size_mb == 0) {
+        usage(argv[0]);
+        return -1;
+    }
+
+    mx_handle_t resource = get_root_resource();
+    if (resource == MX_HANDLE_INVALID) {
+        fprintf(stderr, "cannot get the root resource\n");
+        return -1;
+    }
+
+    size_t vmo_size = size_mb * 1024 * 1024;
+    mx_handle_t vmo;
+    if (mx_vmo_create(vmo_size, 0, &vmo) != MX_OK) {
+        fprintf(stderr, "cannot create a %zu MB buffer\n", size_mb);
+        return -1;
+    }
+
+    mx_cpu_profile_config_t config = {
+        .vmo = vmo,
+        .event = event,
+        .period = period,
+    };
+    mx_status_t status = mx_mtrace_control(resource, MTRACE_KIND_PROFILE, MTRACE_PROFILE_START,
+                                           0, &config, sizeof(config));
+    if (status != MX_OK) {
+        fprintf(stderr, "cannot start sampling: %d\n", status);
+        return -1;
+    }
+
+    mx_nanosleep(mx_deadline_after(MX_SEC(seconds)));
+
+    status = mx_mtrace_control(resource, MTRACE_KIND_PROFILE, MTRACE_PROFILE_STOP, 0, NULL, 0);
+    if (status != MX_OK) {
+        fprintf(stderr, "cannot stop sampling: %d\n", status);
+        return -1;
+    }
+
+    return write_profile(vmo, vmo_size, argv[optind]);
+}
@@ -2,13 +2,28 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
 #include <magenta/syscalls.h>
 #include <magenta/syscalls/log.h>
 
+static void print_record(const mx_log_record_t* rec, const char* data) {
+    char tmp[32];
+    size_t len = snprintf(tmp, sizeof(tmp), "[%05d.%03d] %c ",
+                        (int)(rec->timestamp / 1000000000ULL),
+                        (int)((rec->timestamp / 1000000ULL) % 1000ULL),
+                        (rec->flags & MX_LOG_FLAG_KERNEL) ? 'K' : 'U');
+    write(1, tmp, (len > sizeof(tmp) ? sizeof(tmp) : len));
+    write(1, data, rec->datalen);
+    if ((rec->datalen == 0) || (data[rec->datalen - 1] != '\n')) {
+        write(1, "\n", 1);
+    }
+}
+
 int main(int argc, char** argv) {
     bool tail = false;
     mx_handle_t h;
@@ -18,29 +33,83 @@ int main(int argc, char** argv) {
     }
     if (mx_log_create(MX_LOG_FLAG_READABLE, &h) < 0) {
         printf("dlog: cannot open log\n");
+        return -1;
+    }
+
+    // Read the log straight out of the kernel's ring rather than a record
+    // per syscall.
+    mx_handle_t vmo;
+    uint64_t size;
+    uintptr_t addr;
+    if ((mx_log_get_vmo(h, &vmo) < 0) ||
+        (mx_vmo_get_size(vmo, &size) < 0) ||
+        (mx_vmar_map(mx_vmar_root_self(), 0, vmo, 0, size,
+                     MX_VM_FLAG_PERM_READ, &addr) < 0)) {
+        printf("dlog: cannot map log\n");
+        return -1;
+    }
+    mx_handle_close(vmo);
+
+    const mx_log_ring_t* ring = (const mx_log_ring_t*)addr;
+    const char* data = (const char*)(addr + ring->data_offset);
+    uint64_t mask = ring->size - 1;
+
+    char* copy = malloc(ring->size);
+    if (copy == NULL) {
+        printf("dlog: out of memory\n");
+        return -1;
     }
 
-    char buf[MX_LOG_RECORD_MAX];
-    mx_log_record_t* rec = (mx_log_record_t*)buf;
+    uint64_t pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
     for (;;) {
-        mx_status_t status;
-        if ((status = mx_log_read(h, MX_LOG_RECORD_MAX, rec, 0)) < 0) {
-            if ((status == MX_ERR_SHOULD_WAIT) && tail) {
+        // Clear MX_LOG_READABLE before looking at head, so anything written
+        // after this pass raises it again.
+        mx_log_read(h, 0, NULL, MX_LOG_READ_SKIP);
+
+        uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        uint64_t oldest = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+        if (oldest > head) {
+            // lapped while loading the two, try again
+            continue;
+        }
+        if (pos < oldest) {
+            pos = oldest;
+        }
+        if (pos == head) {
+            if (tail) {
                 mx_object_wait_one(h, MX_LOG_READABLE, MX_TIME_INFINITE, NULL);
                 continue;
             }
             break;
         }
-        char tmp[32];
-        size_t len = snprintf(tmp, sizeof(tmp), "[%05d.%03d] %c ",
-                            (int)(rec->timestamp / 1000000000ULL),
-                            (int)((rec->timestamp / 1000000ULL) % 1000ULL),
-                            (rec->flags & MX_LOG_FLAG_KERNEL) ? 'K' : 'U');
-        write(1, tmp, (len > sizeof(tmp) ? sizeof(tmp) : len));
-        write(1, rec->data, rec->datalen);
-        if ((rec->datalen == 0) || (rec->data[rec->datalen - 1] != '\n')) {
-            write(1, "\n", 1);
+
+        uint64_t offset = pos & mask;
+        uint64_t len = head - pos;
+        if (offset + len > ring->size) {
+            size_t fifospace = ring->size - offset;
+            memcpy(copy, data + offset, fifospace);
+            memcpy(copy + fifospace, data, len - fifospace);
+        } else {
+            memcpy(copy, data + offset, len);
+        }
+
+        // Whatever the kernel moved tail past while we copied may have been
+        // overwritten, skip it.
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        oldest = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+
+        uint64_t p = (pos < oldest) ? oldest : pos;
+        while (p < head) {
+            mx_log_record_t rec;
+            memcpy(&rec, copy + (p - pos), sizeof(rec));
+            size_t recsize = MX_LOG_RING_RECORD_SIZE(rec.reserved);
+            if ((recsize < sizeof(rec)) || (recsize > head - p)) {
+                break;
+            }
+            print_record(&rec, copy + (p - pos) + sizeof(rec));
+            p += recsize;
         }
+        pos = head;
     }
     return 0;
 }
@@ -72,6 +72,8 @@ int main(int argc, char** argv) {
         fprintf(stderr, "Failed to create guest\n");
         return status;
     }
+    context.vcpu = context.guest;
+    guest_state.vcpus[guest_state.num_vcpus++] = context.vcpu;
 
     uintptr_t pt_end_off;
     status = guest_create_page_table(addr, kVmoSize, &pt_end_off);
@@ -126,14 +128,14 @@ int main(int argc, char** argv) {
 #if __x86_64__
     guest_gpr.rsi = bootdata_off;
 #endif // __x86_64__
-    status = mx_hypervisor_op(context.guest, MX_HYPERVISOR_OP_GUEST_SET_GPR,
+    status = mx_hypervisor_op(context.vcpu, MX_HYPERVISOR_OP_GUEST_SET_GPR,
                               &guest_gpr, sizeof(guest_gpr), NULL, 0);
     if (status != MX_OK) {
         fprintf(stderr, "Failed to set guest ESI\n");
         return status;
     }
 
-    status = mx_hypervisor_op(context.guest, MX_HYPERVISOR_OP_GUEST_SET_ENTRY_IP,
+    status = mx_hypervisor_op(context.vcpu, MX_HYPERVISOR_OP_GUEST_SET_ENTRY_IP,
                               &guest_ip, sizeof(guest_ip), NULL, 0);
     if (status != MX_OK) {
         fprintf(stderr, "Failed to set guest RIP\n");
@@ -142,7 +144,7 @@ int main(int argc, char** argv) {
 
 #if __x86_64__
     uintptr_t guest_cr3 = 0;
-    status = mx_hypervisor_op(context.guest, MX_HYPERVISOR_OP_GUEST_SET_ENTRY_CR3,
+    status = mx_hypervisor_op(context.vcpu, MX_HYPERVISOR_OP_GUEST_SET_ENTRY_CR3,
                               &guest_cr3, sizeof(guest_cr3), NULL, 0);
     if (status != MX_OK) {
         fprintf(stderr, "Failed to set guest CR3\n");
@@ -155,7 +157,7 @@ int main(int argc, char** argv) {
         return status;
     }
 
-    status = mx_hypervisor_op(context.guest, MX_HYPERVISOR_OP_GUEST_SET_APIC_MEM,
+    status = mx_hypervisor_op(context.vcpu, MX_HYPERVISOR_OP_GUEST_SET_APIC_MEM,
                               &context.local_apic_state.apic_mem, sizeof(mx_handle_t), NULL, 0);
     if (status != MX_OK) {
         fprintf(stderr, "Failed to set guest local APIC memory\n");
@@ -182,7 +184,7 @@ int main(int argc, char** argv) {
         return MX_ERR_INTERNAL;
     }
 
-    status = mx_hypervisor_op(context.guest, MX_HYPERVISOR_OP_GUEST_ENTER, NULL, 0, NULL, 0);
+    status = mx_hypervisor_op(context.vcpu, MX_HYPERVISOR_OP_GUEST_ENTER, NULL, 0, NULL, 0);
     if (status != MX_OK)
         fprintf(stderr, "Failed to enter guest %d\n", status);
     return status;
@@ -36,10 +36,24 @@
 #define LOCAL_APIC_REGISTER_ID                  0x0020
 #define LOCAL_APIC_REGISTER_SVR                 0x00f0
 #define LOCAL_APIC_REGISTER_ESR                 0x0280
+#define LOCAL_APIC_REGISTER_ICR_LOW             0x0300
+#define LOCAL_APIC_REGISTER_ICR_HIGH            0x0310
 #define LOCAL_APIC_REGISTER_LVT_TIMER           0x0320
 #define LOCAL_APIC_REGISTER_LVT_ERROR           0x0370
 #define LOCAL_APIC_REGISTER_INITIAL_COUNT       0x0380
 
+/* Local APIC interrupt command register fields. */
+#define ICR_VECTOR(low)                         ((low) & 0xff)
+#define ICR_DELIVERY_MODE(low)                  (((low) >> 8) & 0x7)
+#define ICR_DST_LOGICAL                         (1u << 11)
+#define ICR_DST_SHORTHAND(low)                  (((low) >> 18) & 0x3)
+#define ICR_DST(high)                           ((high) >> 24)
+#define ICR_DELIVERY_MODE_FIXED                 0u
+#define ICR_DST_SHORTHAND_NONE                  0u
+#define ICR_DST_SHORTHAND_SELF                  1u
+#define ICR_DST_SHORTHAND_ALL                   2u
+#define ICR_DST_SHORTHAND_ALL_BUT_SELF          3u
+
 /* IO APIC register addresses. */
 #define IO_APIC_IOREGSEL                        0x00
 #define IO_APIC_IOWIN                           0x10
@@ -337,13 +351,56 @@ static mx_status_t handle_port_out(vcpu_context_t* context, const mx_guest_port_
     return MX_ERR_NOT_SUPPORTED;
 }
 
-static mx_status_t handle_local_apic(local_apic_state_t* local_apic_state,
-                                     const mx_guest_mem_trap_t* mem_trap, instruction_t* inst) {
+static mx_status_t send_ipi(vcpu_context_t* context, uint32_t id, uint8_t vector) {
+    guest_state_t* guest_state = context->guest_state;
+    if (id >= guest_state->num_vcpus)
+        return MX_ERR_OUT_OF_RANGE;
+    return mx_hypervisor_op(guest_state->vcpus[id], MX_HYPERVISOR_OP_GUEST_INTERRUPT,
+                            &vector, sizeof(vector), NULL, 0);
+}
+
+/* Delivers the IPI that a write to the low half of the ICR asks for. We only
+ * support fixed delivery to physical destinations, which covers IPIs between
+ * running VCPUs.
+ */
+static mx_status_t handle_icr_write(vcpu_context_t* context, uint32_t low, uint32_t high) {
+    if (ICR_DELIVERY_MODE(low) != ICR_DELIVERY_MODE_FIXED) {
+        fprintf(stderr, "Unsupported IPI delivery mode %#x\n", ICR_DELIVERY_MODE(low));
+        return MX_ERR_NOT_SUPPORTED;
+    }
+    uint8_t vector = ICR_VECTOR(low);
+    switch (ICR_DST_SHORTHAND(low)) {
+    case ICR_DST_SHORTHAND_NONE:
+        if (low & ICR_DST_LOGICAL) {
+            fprintf(stderr, "Unsupported IPI destination mode\n");
+            return MX_ERR_NOT_SUPPORTED;
+        }
+        return send_ipi(context, ICR_DST(high), vector);
+    case ICR_DST_SHORTHAND_SELF:
+        return send_ipi(context, context->id, vector);
+    case ICR_DST_SHORTHAND_ALL:
+    case ICR_DST_SHORTHAND_ALL_BUT_SELF: {
+        bool self = ICR_DST_SHORTHAND(low) == ICR_DST_SHORTHAND_ALL;
+        for (uint32_t id = 0; id < context->guest_state->num_vcpus; id++) {
+            if (id == context->id && !self)
+                continue;
+            mx_status_t status = send_ipi(context, id, vector);
+            if (status != MX_OK)
+                return status;
+        }
+        return MX_OK;
+    }}
+    return MX_ERR_NOT_SUPPORTED;
+}
+
+static mx_status_t handle_local_apic(vcpu_context_t* context, const mx_guest_mem_trap_t* mem_trap,
+                                     instruction_t* inst) {
     MX_ASSERT(mem_trap->guest_paddr >= LOCAL_APIC_PHYS_BASE);
+    local_apic_state_t* local_apic_state = &context->local_apic_state;
     mx_vaddr_t offset = mem_trap->guest_paddr - LOCAL_APIC_PHYS_BASE;
     switch (offset) {
     case LOCAL_APIC_REGISTER_ID:
-        return inst_read32(inst, 0);
+        return inst_read32(inst, context->id << 24);
     case LOCAL_APIC_REGISTER_ESR:
         // From Intel Volume 3, Section 10.5.3: Before attempt to read from the
         // ESR, software should first write to it.
@@ -355,6 +412,18 @@ static mx_status_t handle_local_apic(local_apic_state_t* local_apic_state,
     case LOCAL_APIC_REGISTER_LVT_TIMER:
     case LOCAL_APIC_REGISTER_LVT_ERROR:
         return inst_rw32(inst, local_apic_state->apic_addr + offset);;
+    case LOCAL_APIC_REGISTER_ICR_HIGH:
+        return inst_rw32(inst, local_apic_state->apic_addr + offset);
+    case LOCAL_APIC_REGISTER_ICR_LOW: {
+        // The delivery status always reads as idle, as we send IPIs as the
+        // register is written.
+        uint32_t* icr = local_apic_state->apic_addr + LOCAL_APIC_REGISTER_ICR_LOW;
+        mx_status_t status = inst_rw32(inst, icr);
+        if (status != MX_OK || inst->type != INST_MOV_WRITE)
+            return status;
+        uint32_t* icr_high = local_apic_state->apic_addr + LOCAL_APIC_REGISTER_ICR_HIGH;
+        return handle_icr_write(context, *icr, *icr_high);
+    }
     case LOCAL_APIC_REGISTER_INITIAL_COUNT: {
         uint32_t initial_count;
         mx_status_t status = inst_write32(inst, &initial_count);
@@ -460,7 +529,7 @@ static mx_status_t unhandled_mem_trap(const mx_guest_mem_trap_t* mem_trap, instr
 
 static mx_status_t handle_mem_trap(vcpu_context_t* context, const mx_guest_mem_trap_t* mem_trap) {
     mx_guest_gpr_t guest_gpr;
-    mx_status_t status = mx_hypervisor_op(context->guest, MX_HYPERVISOR_OP_GUEST_GET_GPR,
+    mx_status_t status = mx_hypervisor_op(context->vcpu, MX_HYPERVISOR_OP_GUEST_GET_GPR,
                                           NULL, 0, &guest_gpr, sizeof(guest_gpr));
     if (status != MX_OK)
         return status;
@@ -482,7 +551,7 @@ static mx_status_t handle_mem_trap(vcpu_context_t* context, const mx_guest_mem_t
         guest_state_t* guest_state = context->guest_state;
         switch (mem_trap->guest_paddr) {
         case LOCAL_APIC_PHYS_BASE ... LOCAL_APIC_PHYS_TOP:
-            status = handle_local_apic(&context->local_apic_state, mem_trap, &inst);
+            status = handle_local_apic(context, mem_trap, &inst);
             break;
         case IO_APIC_PHYS_BASE ... IO_APIC_PHYS_TOP:
             mtx_lock(&guest_state->mutex);
@@ -521,7 +590,7 @@ static mx_status_t handle_mem_trap(vcpu_context_t* context, const mx_guest_mem_t
 
     // If there was an attempt to read or test memory, update the GPRs.
     if (status == MX_OK && (inst.type == INST_MOV_READ || inst.type == INST_TEST)) {
-        status = mx_hypervisor_op(context->guest, MX_HYPERVISOR_OP_GUEST_SET_GPR,
+        status = mx_hypervisor_op(context->vcpu, MX_HYPERVISOR_OP_GUEST_SET_GPR,
                                   &guest_gpr, sizeof(guest_gpr), NULL, 0);
         if (status != MX_OK)
             return status;
@@ -12,6 +12,7 @@
 #define IO_BUFFER_SIZE              512u
 #define PCI_MAX_DEVICES             2u
 #define PCI_MAX_BARS                1u
+#define MAX_VCPUS                   16u
 
 /* Stores the local APIC state across VM exits. */
 typedef struct local_apic_state {
@@ -57,6 +58,9 @@ typedef struct pci_device_state {
 
 typedef struct guest_state {
     mtx_t mutex;
+    // VCPUs, indexed by local APIC ID, for delivering IPIs between them.
+    mx_handle_t vcpus[MAX_VCPUS];
+    uint32_t num_vcpus;
     io_apic_state_t io_apic_state;
     io_port_state_t io_port_state;
     pci_device_state_t pci_device_state[PCI_MAX_DEVICES];
@@ -64,7 +68,11 @@ typedef struct guest_state {
 
 typedef struct vcpu_context {
     mx_handle_t guest;
+    // The VCPU, which for the first VCPU is the guest.
+    mx_handle_t vcpu;
     mx_handle_t vcpu_fifo;
+    // Local APIC ID of the VCPU.
+    uint32_t id;
 
     local_apic_state_t local_apic_state;
     guest_state_t* guest_state;
@@ -114,10 +114,6 @@ void process_touchscreen_input(void* buf, size_t len, int vcfd, uint32_t* pixels
             clear_screen(pixels, fb);
         }
     }
-    ssize_t ret = ioctl_display_flush_fb(vcfd);
-    if (ret < 0) {
-        printf("failed to flush: %zd\n", ret);
-    }
 }
 
 void process_stylus_input(void* buf, size_t len, int vcfd, uint32_t* pixels,
@@ -136,7 +132,7 @@ void process_stylus_input(void* buf, size_t len, int vcfd, uint32_t* pixels,
     if (acer12_stylus_status_tswitch(rpt->status)) {
         if (x + CLEAR_BTN_SIZE > fb->info.width && y < CLEAR_BTN_SIZE) {
             clear_screen(pixels, fb);
-            goto flush;
+            return;
         }
     }
     uint32_t size, color;
@@ -165,8 +161,18 @@ void process_stylus_input(void* buf, size_t len, int vcfd, uint32_t* pixels,
     }
 
     draw_points(pixels, color, x, y, size, size, fb->info.stride, fb->info.height);
+}
 
-flush: ;
+void process_input(void* buf, size_t len, int vcfd, uint32_t* pixels,
+        ioctl_display_get_fb_t* fb) {
+    if (*(uint8_t*)buf == ACER12_RPT_ID_TOUCH) {
+        process_touchscreen_input(buf, len, vcfd, pixels, fb);
+    } else if (*(uint8_t*)buf == ACER12_RPT_ID_STYLUS) {
+        process_stylus_input(buf, len, vcfd, pixels, fb);
+    }
+}
+
+void flush(int vcfd) {
     ssize_t ret = ioctl_display_flush_fb(vcfd);
     if (ret < 0) {
         printf("failed to flush: %zd\n", ret);
@@ -301,16 +307,41 @@ next_node:
     }
 
     clear_screen((void*)fbo, &fb);
-    while (1) {
-        ssize_t r = read(touchfd, buf, max_rpt_sz);
-        if (r < 0) {
-            printf("touchscreen read error: %zd (errno=%d)\n", r, errno);
-            break;
+
+    // Take reports from the fifo if there is one, so that everything that
+    // came in since the last wakeup is drawn with one flush.
+    mx_handle_t fifo;
+    if (ioctl_input_get_report_fifo(touchfd, &fifo) == sizeof(fifo)) {
+        input_report_entry_t entries[INPUT_REPORT_FIFO_DEPTH];
+        while (1) {
+            mx_signals_t observed;
+            mx_status_t status = mx_object_wait_one(fifo,
+                    MX_FIFO_READABLE | MX_FIFO_PEER_CLOSED, MX_TIME_INFINITE, &observed);
+            if (status != MX_OK || !(observed & MX_FIFO_READABLE)) {
+                printf("touchscreen fifo closed: %d\n", status);
+                break;
+            }
+            uint32_t count;
+            status = mx_fifo_read(fifo, entries, sizeof(entries), &count);
+            if (status != MX_OK) {
+                printf("touchscreen fifo read error: %d\n", status);
+                break;
+            }
+            for (uint32_t i = 0; i < count; i++) {
+                process_input(entries[i].data, entries[i].len, vcfd, pixels32, &fb);
+            }
+            flush(vcfd);
         }
-        if (*(uint8_t*)buf == ACER12_RPT_ID_TOUCH) {
-            process_touchscreen_input(buf, r, vcfd, pixels32, &fb);
-        } else if (*(uint8_t*)buf == ACER12_RPT_ID_STYLUS) {
-            process_stylus_input(buf, r, vcfd, pixels32, &fb);
+        mx_handle_close(fifo);
+    } else {
+        while (1) {
+            ssize_t r = read(touchfd, buf, max_rpt_sz);
+            if (r < 0) {
+                printf("touchscreen read error: %zd (errno=%d)\n", r, errno);
+                break;
+            }
+            process_input(buf, r, vcfd, pixels32, &fb);
+            flush(vcfd);
         }
     }
 
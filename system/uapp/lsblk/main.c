@@ -136,6 +136,121 @@ out:
     return 0;
 }
 
+static const char* stat_names[BLOCK_STAT_COUNT] = {
+    [BLOCK_STAT_READ] = "read",
+    [BLOCK_STAT_WRITE] = "write",
+    [BLOCK_STAT_FLUSH] = "flush",
+    [BLOCK_STAT_DISCARD] = "discard",
+};
+
+static uint64_t avg_us(const block_op_counts_t* counts) {
+    return counts->ops ? (counts->total_ns / counts->ops) / 1000 : 0;
+}
+
+// One line per device, as for the listing.
+static int cmd_list_stats(void) {
+    DIR* dir = opendir(DEV_BLOCK);
+    if (!dir) {
+        printf("Error opening %s\n", DEV_BLOCK);
+        return -1;
+    }
+    printf("%-3s %-10s %-10s %-8s %-5s %-5s %-8s %-8s %-5s\n",
+           "ID", "READS", "WRITES", "FLUSHES", "READ", "WRIT", "AVG R us", "AVG W us", "DEPTH");
+    struct dirent* de;
+    while ((de = readdir(dir)) != NULL) {
+        if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")) {
+            continue;
+        }
+        char path[128];
+        snprintf(path, sizeof(path), "%s/%s", DEV_BLOCK, de->d_name);
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            printf("Error opening %s\n", path);
+            continue;
+        }
+        block_stats_t stats;
+        ssize_t r = ioctl_block_get_stats(fd, &stats);
+        close(fd);
+        if (r < 0) {
+            printf("%-3s (no statistics: %zd)\n", de->d_name, r);
+            continue;
+        }
+        const block_op_counts_t* reads = &stats.ops[BLOCK_STAT_READ].counts;
+        const block_op_counts_t* writes = &stats.ops[BLOCK_STAT_WRITE].counts;
+        char readstr[6], writestr[6];
+        size_to_cstring(readstr, sizeof(readstr), reads->bytes);
+        size_to_cstring(writestr, sizeof(writestr), writes->bytes);
+        printf("%-3s %-10" PRIu64 " %-10" PRIu64 " %-8" PRIu64 " %5s %5s %-8" PRIu64 " %-8"
+               PRIu64 " %u/%u\n", de->d_name, reads->ops, writes->ops,
+               stats.ops[BLOCK_STAT_FLUSH].counts.ops, readstr, writestr,
+               avg_us(reads), avg_us(writes), stats.queue_depth, stats.max_queue_depth);
+    }
+    closedir(dir);
+    return 0;
+}
+
+static void print_counts(const char* name, const block_op_counts_t* counts, uint64_t elapsed_ns) {
+    char bytestr[6];
+    size_to_cstring(bytestr, sizeof(bytestr), counts->bytes);
+    uint64_t secs = elapsed_ns / 1000000000;
+    printf("  %-8s %10" PRIu64 " ops %5s %6" PRIu64 " iops %6" PRIu64 " errors %8" PRIu64
+           " us avg\n", name, counts->ops, bytestr, secs ? counts->ops / secs : counts->ops,
+           counts->errors, avg_us(counts));
+}
+
+// Everything about one device: its counts and latency histograms, and the
+// counts of each client of its server.
+static int cmd_stats_blk(const char* dev) {
+    int fd = open(dev, O_RDONLY);
+    if (fd < 0) {
+        printf("Error opening %s\n", dev);
+        return fd;
+    }
+    block_stats_t stats;
+    ssize_t r = ioctl_block_get_stats(fd, &stats);
+    close(fd);
+    if (r < 0) {
+        printf("Error getting statistics for %s: %zd\n", dev, r);
+        return (int)r;
+    }
+
+    printf("%s: over %" PRIu64 "s, queue depth %u (max %u)\n", dev,
+           stats.elapsed_ns / 1000000000, stats.queue_depth, stats.max_queue_depth);
+    for (int op = 0; op < BLOCK_STAT_COUNT; op++) {
+        const block_op_stats_t* s = &stats.ops[op];
+        print_counts(stat_names[op], &s->counts, stats.elapsed_ns);
+        if (s->counts.ops == 0) {
+            continue;
+        }
+        printf("    max %" PRIu64 " us; latency:\n", s->max_ns / 1000);
+        for (int b = 0; b < BLOCK_LATENCY_BUCKETS; b++) {
+            if (s->latency[b] == 0) {
+                continue;
+            }
+            // Each bucket as a share of the requests, in a bar of up to 50.
+            int bar = (int)((s->latency[b] * 50) / s->counts.ops);
+            uint64_t low = b ? 1ull << (b - 1) : 0;
+            if (b == BLOCK_LATENCY_BUCKETS - 1) {
+                printf("    %8" PRIu64 "+        us", low);
+            } else {
+                printf("    %8" PRIu64 "-%-8llu us", low, 1ull << b);
+            }
+            printf(" %10" PRIu64 " %.*s\n", s->latency[b], bar,
+                   "##################################################");
+        }
+    }
+    for (uint32_t i = 0; i < stats.client_count; i++) {
+        const block_client_stats_t* c = &stats.clients[i];
+        printf(" fifo %u: queue depth %u (max %u)\n", i, c->queue_depth, c->max_queue_depth);
+        for (int op = 0; op < BLOCK_STAT_COUNT; op++) {
+            if (c->ops[op].ops != 0) {
+                print_counts(stat_names[op], &c->ops[op], stats.elapsed_ns);
+            }
+        }
+    }
+    return 0;
+}
+
 static int cmd_read_blk(const char* dev, off_t offset, size_t count) {
     int fd = open(dev, O_RDONLY);
     if (fd < 0) {
@@ -198,6 +313,8 @@ int main(int argc, const char** argv) {
         } else if (!strcmp(cmd, "read")) {
             if (argc < 5) goto usage;
             rc = cmd_read_blk(argv[2], strtoul(argv[3], NULL, 10), strtoull(argv[4], NULL, 10));
+        } else if (!strcmp(cmd, "stats")) {
+            rc = (argc > 2) ? cmd_stats_blk(argv[2]) : cmd_list_stats();
         } else {
             printf("Unrecognized command %s!\n", cmd);
             goto usage;
@@ -210,5 +327,6 @@ usage:
     printf("Usage:\n");
     printf("%s\n", argv[0]);
     printf("%s read <blkdev> <offset> <count>\n", argv[0]);
+    printf("%s stats [<blkdev>]\n", argv[0]);
     return 0;
 }
@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include <fs/trace.h>
@@ -13,40 +14,181 @@
 #include <mxtl/ref_ptr.h>
 #include <mxtl/unique_ptr.h>
 
+#ifdef __Fuchsia__
+#include <mxtl/auto_lock.h>
+#endif
+
 #include "minfs.h"
 #include "minfs-private.h"
 
 namespace minfs {
 
+mx_status_t Bcache::CacheLookupLocked(uint32_t bno, CachedBlock** out, bool* hit) {
+    CachedBlock** found = cache_.find(bno);
+    if (found != nullptr) {
+        CachedBlock* blk = *found;
+        cache_lru_.push_front(cache_lru_.erase(*blk));
+        *out = blk;
+        *hit = true;
+        return MX_OK;
+    }
+
+    mxtl::unique_ptr<CachedBlock> blk;
+    if (cache_.size() < kCacheBlocks) {
+        AllocChecker ac;
+        blk.reset(new (&ac) CachedBlock);
+        if (!ac.check()) {
+            return MX_ERR_NO_MEMORY;
+        }
+    } else {
+        // Evicting a dirty block writes back all of them, so that they go out
+        // in as few requests as possible.
+        mx_status_t status;
+        if (cache_lru_.back().dirty && ((status = CacheFlushLocked()) != MX_OK)) {
+            return status;
+        }
+        blk = cache_lru_.pop_back();
+        cache_.erase(blk->bno);
+    }
+    if (!cache_.insert(bno, blk.get())) {
+        return MX_ERR_NO_MEMORY;
+    }
+    blk->bno = bno;
+    blk->dirty = false;
+    *out = blk.get();
+    *hit = false;
+    cache_lru_.push_front(mxtl::move(blk));
+    return MX_OK;
+}
+
+mx_status_t Bcache::CacheFlushLocked() {
+    if (cache_dirty_ == 0) {
+        return MX_OK;
+    }
+
+    CachedBlock* dirty[kCacheBlocks];
+    uint32_t count = 0;
+    for (auto& blk : cache_lru_) {
+        if (blk.dirty) {
+            dirty[count++] = &blk;
+        }
+    }
+    qsort(dirty, count, sizeof(dirty[0]), [](const void* a, const void* b) {
+        uint32_t bno_a = (*static_cast<CachedBlock* const*>(a))->bno;
+        uint32_t bno_b = (*static_cast<CachedBlock* const*>(b))->bno;
+        return (bno_a > bno_b) - (bno_a < bno_b);
+    });
+
+    for (uint32_t i = 0; i < count;) {
+        struct iovec iov[kCacheRunMax];
+        uint32_t n = 0;
+        do {
+            iov[n].iov_base = dirty[i + n]->data;
+            iov[n].iov_len = kMinfsBlockSize;
+            n++;
+        } while ((i + n < count) && (n < kCacheRunMax) &&
+                 (dirty[i + n]->bno == dirty[i]->bno + n));
+
+        uint32_t bno = dirty[i]->bno;
+        off_t off = static_cast<off_t>(bno) * kMinfsBlockSize;
+        FS_TRACE(IO, "writeblk() bno=%u count=%u off=%#llx\n", bno, n,
+                 (unsigned long long)off);
+        ssize_t len = static_cast<ssize_t>(n) * kMinfsBlockSize;
+        if ((lseek(fd_, off, SEEK_SET) < 0) || (writev(fd_, iov, n) != len)) {
+            FS_TRACE_ERROR("minfs: cannot write blocks %u-%u\n", bno, bno + n - 1);
+            return MX_ERR_IO;
+        }
+        for (uint32_t j = 0; j < n; j++) {
+            dirty[i + j]->dirty = false;
+        }
+        cache_dirty_ -= n;
+        i += n;
+    }
+    return MX_OK;
+}
+
 mx_status_t Bcache::Readblk(uint32_t bno, void* data) {
-    off_t off = bno * kMinfsBlockSize;
-    FS_TRACE(IO, "readblk() bno=%u off=%#llx\n", bno, (unsigned long long)off);
-    if (lseek(fd_, off, SEEK_SET) < 0) {
-        FS_TRACE_ERROR("minfs: cannot seek to block %u\n", bno);
-        return MX_ERR_IO;
+    FS_TRACE(IO, "readblk() bno=%u\n", bno);
+#ifdef __Fuchsia__
+    mxtl::AutoLock lock(&cache_lock_);
+#endif
+    CachedBlock* blk;
+    bool hit;
+    mx_status_t status = CacheLookupLocked(bno, &blk, &hit);
+    if (status != MX_OK) {
+        return status;
     }
-    if (read(fd_, data, kMinfsBlockSize) != kMinfsBlockSize) {
-        FS_TRACE_ERROR("minfs: cannot read block %u\n", bno);
-        return MX_ERR_IO;
+    if (!hit) {
+        off_t off = static_cast<off_t>(bno) * kMinfsBlockSize;
+        if (pread(fd_, blk->data, kMinfsBlockSize, off) != kMinfsBlockSize) {
+            FS_TRACE_ERROR("minfs: cannot read block %u\n", bno);
+            cache_.erase(bno);
+            cache_lru_.erase(*blk);
+            return MX_ERR_IO;
+        }
     }
+    memcpy(data, blk->data, kMinfsBlockSize);
     return MX_OK;
 }
 
 mx_status_t Bcache::Writeblk(uint32_t bno, const void* data) {
-    off_t off = bno * kMinfsBlockSize;
-    FS_TRACE(IO, "writeblk() bno=%u off=%#llx\n", bno, (unsigned long long)off);
-    if (lseek(fd_, off, SEEK_SET) < 0) {
-        FS_TRACE_ERROR("minfs: cannot seek to block %u\n", bno);
-        return MX_ERR_IO;
+    FS_TRACE(IO, "writeblk() bno=%u\n", bno);
+#ifdef __Fuchsia__
+    mxtl::AutoLock lock(&cache_lock_);
+#endif
+    CachedBlock* blk;
+    bool hit;
+    mx_status_t status = CacheLookupLocked(bno, &blk, &hit);
+    if (status != MX_OK) {
+        return status;
+    }
+    memcpy(blk->data, data, kMinfsBlockSize);
+#ifdef __Fuchsia__
+    if (!blk->dirty) {
+        blk->dirty = true;
+        cache_dirty_++;
     }
-    if (write(fd_, data, kMinfsBlockSize) != kMinfsBlockSize) {
+#else
+    off_t off = static_cast<off_t>(bno) * kMinfsBlockSize;
+    if (pwrite(fd_, data, kMinfsBlockSize, off) != kMinfsBlockSize) {
         FS_TRACE_ERROR("minfs: cannot write block %u\n", bno);
+        cache_.erase(bno);
+        cache_lru_.erase(*blk);
+        return MX_ERR_IO;
+    }
+#endif
+    return MX_OK;
+}
+
+mx_status_t Bcache::Readblks(uint32_t bno, uint32_t count, void* data) {
+    FS_TRACE(IO, "readblk() bno=%u count=%u\n", bno, count);
+    {
+#ifdef __Fuchsia__
+        mxtl::AutoLock lock(&cache_lock_);
+#endif
+        mx_status_t status;
+        if ((status = CacheFlushLocked()) != MX_OK) {
+            return status;
+        }
+    }
+    off_t off = static_cast<off_t>(bno) * kMinfsBlockSize;
+    ssize_t len = static_cast<ssize_t>(count) * kMinfsBlockSize;
+    if (pread(fd_, data, len, off) != len) {
+        FS_TRACE_ERROR("minfs: cannot read blocks %u-%u\n", bno, bno + count - 1);
         return MX_ERR_IO;
     }
     return MX_OK;
 }
 
 int Bcache::Sync() {
+    {
+#ifdef __Fuchsia__
+        mxtl::AutoLock lock(&cache_lock_);
+#endif
+        if (CacheFlushLocked() != MX_OK) {
+            return -1;
+        }
+    }
     return fsync(fd_);
 }
 
@@ -61,16 +203,29 @@ mx_status_t Bcache::Create(mxtl::unique_ptr<Bcache>* out, int fd, uint32_t block
     mx_handle_t fifo;
     ssize_t r;
 
-    if ((r = ioctl_block_get_fifos(fd, &fifo)) < 0) {
+    block_info_t info;
+    if ((r = ioctl_block_get_info(fd, &info)) < 0) {
         return static_cast<mx_status_t>(r);
-    } else if ((r = ioctl_block_alloc_txn(fd, &bc->txnid_)) < 0) {
-        mx_handle_close(fifo);
+    }
+    bc->discard_ = (info.flags & BLOCK_FLAG_DISCARD) != 0;
+
+    if ((r = ioctl_block_get_fifos(fd, &fifo)) < 0) {
         return static_cast<mx_status_t>(r);
     } else if ((status = block_fifo_create_client(fifo, &bc->fifo_client_)) != MX_OK) {
-        ioctl_block_free_txn(fd, &bc->txnid_);
         mx_handle_close(fifo);
         return status;
     }
+    // The destructor gives back whatever was allocated if this fails
+    for (; bc->txn_count_ < kTxnCount; bc->txn_count_++) {
+        if ((r = ioctl_block_alloc_txn(fd, &bc->txns_[bc->txn_count_])) < 0) {
+            return static_cast<mx_status_t>(r);
+        }
+    }
+    {
+        mxtl::AutoLock lock(&bc->txn_lock_);
+        memcpy(bc->free_txns_, bc->txns_, sizeof(bc->txns_));
+        bc->free_count_ = kTxnCount;
+    }
 #endif
 
     *out = mxtl::move(bc);
@@ -78,6 +233,86 @@ mx_status_t Bcache::Create(mxtl::unique_ptr<Bcache>* out, int fd, uint32_t block
 }
 
 #ifdef __Fuchsia__
+mx_status_t Bcache::CacheSyncRequestsLocked(const block_fifo_request_t* requests, size_t count) {
+    for (size_t i = 0; (i < count) && !cache_.is_empty(); i++) {
+        // What a discard leaves on the device is no more worth keeping.
+        uint32_t op = requests[i].opcode & BLOCKIO_OP_MASK;
+        bool write = (op == BLOCKIO_WRITE) || (op == BLOCKIO_DISCARD);
+        uint64_t start = requests[i].dev_offset / kMinfsBlockSize;
+        uint64_t end = (requests[i].dev_offset + requests[i].length + kMinfsBlockSize - 1) /
+                       kMinfsBlockSize;
+        for (uint64_t bno = start; bno < end; bno++) {
+            CachedBlock** found = cache_.find(static_cast<uint32_t>(bno));
+            if (found == nullptr) {
+                continue;
+            }
+            CachedBlock* blk = *found;
+            if (write) {
+                // The device is about to hold newer data than the cache.
+                if (blk->dirty) {
+                    cache_dirty_--;
+                }
+                cache_.erase(blk->bno);
+                cache_lru_.erase(*blk);
+            } else if (blk->dirty) {
+                mx_status_t status;
+                if ((status = CacheFlushLocked()) != MX_OK) {
+                    return status;
+                }
+            }
+        }
+    }
+    return MX_OK;
+}
+
+mx_status_t Bcache::RawTxn(block_fifo_request_t* requests, size_t count) {
+    {
+        mxtl::AutoLock lock(&cache_lock_);
+        mx_status_t status;
+        if ((status = CacheSyncRequestsLocked(requests, count)) != MX_OK) {
+            return status;
+        }
+    }
+
+    txnid_t txnid;
+    {
+        mxtl::AutoLock lock(&txn_lock_);
+        while (free_count_ == 0) {
+            cnd_wait(&txn_free_, txn_lock_.GetInternal());
+        }
+        txnid = free_txns_[--free_count_];
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        requests[i].txnid = txnid;
+    }
+    mx_status_t status = block_fifo_txn(fifo_client_, requests, count);
+
+    mxtl::AutoLock lock(&txn_lock_);
+    free_txns_[free_count_++] = txnid;
+    cnd_signal(&txn_free_);
+    return status;
+}
+
+mx_status_t Bcache::Flush() {
+    block_fifo_request_t request;
+    memset(&request, 0, sizeof(request));
+    request.opcode = BLOCKIO_SYNC;
+    return RawTxn(&request, 1);
+}
+
+mx_status_t Bcache::Txn(block_fifo_request_t* requests, size_t count) {
+    if ((journal_ != nullptr) && (count > 0)) {
+        switch (requests[0].opcode & BLOCKIO_OP_MASK) {
+        case BLOCKIO_WRITE:
+            return journal_->Write(requests, count);
+        case BLOCKIO_READ:
+            return journal_->Read(requests, count);
+        }
+    }
+    return RawTxn(requests, count);
+}
+
 mx_status_t Bcache::AttachVmo(mx_handle_t vmo, vmoid_t* out) {
     mx_handle_t xfer_vmo;
     mx_status_t status = mx_handle_duplicate(vmo, MX_RIGHT_SAME_RIGHTS, &xfer_vmo);
@@ -94,12 +329,22 @@ mx_status_t Bcache::AttachVmo(mx_handle_t vmo, vmoid_t* out) {
 #endif
 
 Bcache::Bcache(int fd, uint32_t blockmax) :
-    fd_(fd), blockmax_(blockmax) {}
+    fd_(fd), blockmax_(blockmax) {
+#ifdef __Fuchsia__
+    cnd_init(&txn_free_);
+#endif
+}
 
 Bcache::~Bcache() {
+    if (CacheFlushLocked() != MX_OK) {
+        FS_TRACE_ERROR("minfs: lost cached writes\n");
+    }
 #ifdef __Fuchsia__
+    cnd_destroy(&txn_free_);
     if (fifo_client_ != nullptr) {
-        ioctl_block_free_txn(fd_, &txnid_);
+        for (uint32_t i = 0; i < txn_count_; i++) {
+            ioctl_block_free_txn(fd_, &txns_[i]);
+        }
         ioctl_block_fifo_close(fd_);
         block_fifo_release_client(fifo_client_);
     }
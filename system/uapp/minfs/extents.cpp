@@ -0,0 +1,495 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stdint.h>
+#include <string.h>
+
+#include <fs/block-txn.h>
+#include <fs/trace.h>
+#include <mxalloc/new.h>
+#include <mxtl/algorithm.h>
+
+#include "minfs-private.h"
+
+namespace minfs {
+
+namespace {
+
+// The slot of the inode's own entries.
+constexpr uint32_t kNoSlot = UINT32_MAX;
+
+// The number of |entries| which start at or before |n|.
+uint32_t ExtentsBefore(const minfs_extent_t* entries, uint32_t count, uint32_t n) {
+    uint32_t lo = 0;
+    uint32_t hi = count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (entries[mid].start <= n) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+#ifdef __Fuchsia__
+void CloseVmo(Bcache* bc, vmoid_t vmoid) {
+    block_fifo_request_t request;
+    request.txnid = bc->TxnId();
+    request.vmoid = vmoid;
+    request.opcode = BLOCKIO_CLOSE_VMO;
+    bc->Txn(&request, 1);
+}
+#endif
+
+} // namespace
+
+// The entries of the inode or of a node, and where they're kept.
+struct VnodeMinfs::ExtentList {
+    minfs_extent_t* entries;
+    uint32_t* count;
+    uint32_t max;
+    uint32_t depth;
+    uint32_t slot;
+};
+
+VnodeMinfs::ExtentList VnodeMinfs::ExtentRoot() {
+    return ExtentList{ inode_.extents, &inode_.extent_count, kMinfsInlineExtents,
+                       inode_.extent_depth, kNoSlot };
+}
+
+VnodeMinfs::ExtentList VnodeMinfs::ExtentAt(uint32_t slot) {
+    minfs_extent_node_t* node = ExtentNode(slot);
+    return ExtentList{ node->entries, &node->count, kMinfsExtentsPerNode, node->depth, slot };
+}
+
+VnodeMinfs::ExtentList VnodeMinfs::ExtentChild(const ExtentList& list, uint32_t index) {
+    // Every node of the tree is held once it's loaded
+    const uint32_t* slot = extent_slots_.find(list.entries[index].bno);
+    MX_DEBUG_ASSERT(slot != nullptr);
+    return ExtentAt(*slot);
+}
+
+minfs_extent_node_t* VnodeMinfs::ExtentNode(uint32_t slot) const {
+    const ExtentChunk& chunk = extent_chunks_[slot / kMinfsExtentChunkNodes];
+#ifdef __Fuchsia__
+    uintptr_t data = reinterpret_cast<uintptr_t>(chunk.vmo->GetData());
+#else
+    uintptr_t data = reinterpret_cast<uintptr_t>(chunk.data.get());
+#endif
+    return reinterpret_cast<minfs_extent_node_t*>(
+        data + (slot % kMinfsExtentChunkNodes) * kMinfsBlockSize);
+}
+
+mx_status_t VnodeMinfs::ExtentSlotNew(uint32_t bno, uint32_t* out) {
+    uint32_t slot;
+    if (!extent_free_slots_.is_empty()) {
+        slot = extent_free_slots_.back();
+    } else {
+        if (extent_slot_count_ == extent_chunks_.size() * kMinfsExtentChunkNodes) {
+            if (!extent_chunks_.reserve(extent_chunks_.size() + 1)) {
+                return MX_ERR_NO_MEMORY;
+            }
+            ExtentChunk chunk;
+#ifdef __Fuchsia__
+            mx_status_t status;
+            if ((status = MappedVmo::Create(kMinfsExtentChunkNodes * kMinfsBlockSize,
+                                            "minfs-extents", &chunk.vmo)) != MX_OK) {
+                return status;
+            }
+            if ((status = fs_->bc_->AttachVmo(chunk.vmo->GetVmo(), &chunk.vmoid)) != MX_OK) {
+                return status;
+            }
+            if ((status = fs_->RegisterMetadataVmo(chunk.vmoid, chunk.vmo->GetVmo())) != MX_OK) {
+                CloseVmo(fs_->bc_.get(), chunk.vmoid);
+                return status;
+            }
+#else
+            AllocChecker ac;
+            chunk.data.reset(new (&ac) uint8_t[kMinfsExtentChunkNodes * kMinfsBlockSize]);
+            if (!ac.check()) {
+                return MX_ERR_NO_MEMORY;
+            }
+#endif
+            extent_chunks_.push_back(mxtl::move(chunk));
+        }
+        slot = extent_slot_count_;
+    }
+
+    if (!extent_slots_.insert(bno, slot)) {
+        return MX_ERR_NO_MEMORY;
+    }
+    if (slot == extent_slot_count_) {
+        extent_slot_count_++;
+    } else {
+        extent_free_slots_.pop_back();
+    }
+    *out = slot;
+    return MX_OK;
+}
+
+void VnodeMinfs::ExtentsRelease() {
+#ifdef __Fuchsia__
+    for (size_t i = 0; i < extent_chunks_.size(); i++) {
+        fs_->UnregisterMetadataVmo(extent_chunks_[i].vmoid);
+        CloseVmo(fs_->bc_.get(), extent_chunks_[i].vmoid);
+    }
+#endif
+    extent_chunks_.reset();
+    extent_slots_.reset();
+    extent_free_slots_.reset();
+    extent_slot_count_ = 0;
+    extents_loaded_ = false;
+}
+
+mx_status_t VnodeMinfs::ExtentReadChildren(ReadTxn* txn, const ExtentList& list) {
+    mx_status_t status;
+    for (uint32_t i = 0; i < *list.count; i++) {
+        uint32_t bno = list.entries[i].bno;
+        if ((bno < fs_->info_.dat_block) || (bno >= fs_->info_.block_count) ||
+            (extent_slots_.find(bno) != nullptr)) {
+            return MX_ERR_IO_DATA_INTEGRITY;
+        }
+        uint32_t slot;
+        if ((status = ExtentSlotNew(bno, &slot)) != MX_OK) {
+            return status;
+        }
+        const ExtentChunk& chunk = extent_chunks_[slot / kMinfsExtentChunkNodes];
+#ifdef __Fuchsia__
+        txn->Enqueue(chunk.vmoid, slot % kMinfsExtentChunkNodes, bno, 1);
+#else
+        txn->Enqueue(chunk.data.get(), slot % kMinfsExtentChunkNodes, bno, 1);
+#endif
+    }
+    return MX_OK;
+}
+
+mx_status_t VnodeMinfs::ExtentsLoad() {
+    if (extents_loaded_) {
+        return MX_OK;
+    }
+    mx_status_t status = MX_OK;
+    if ((inode_.extent_count > kMinfsInlineExtents) ||
+        (inode_.extent_depth > kMinfsExtentDepthMax) ||
+        ((inode_.extent_depth > 0) && (inode_.extent_count == 0))) {
+        status = MX_ERR_IO_DATA_INTEGRITY;
+    }
+
+    // Each level is read at once, from the entries of the level above: the
+    // inode's at first, and then those of the nodes in [start, end).
+    uint32_t start = 0;
+    uint32_t end = 0;
+    for (uint32_t depth = inode_.extent_depth; (status == MX_OK) && (depth > 0); depth--) {
+        ReadTxn txn(fs_->bc_.get());
+        if (depth == inode_.extent_depth) {
+            status = ExtentReadChildren(&txn, ExtentRoot());
+        }
+        for (uint32_t s = start; (status == MX_OK) && (s < end); s++) {
+            status = ExtentReadChildren(&txn, ExtentAt(s));
+        }
+        if ((status != MX_OK) || ((status = txn.Flush()) != MX_OK)) {
+            break;
+        }
+
+        start = end;
+        end = extent_slot_count_;
+        for (uint32_t s = start; s < end; s++) {
+            minfs_extent_node_t* node = ExtentNode(s);
+            const uint32_t* slot = extent_slots_.find(node->bno);
+            if ((node->magic != kMinfsExtentNodeMagic) || (node->ino != ino_) ||
+                (slot == nullptr) || (*slot != s) || (node->depth != depth - 1) ||
+                (node->count == 0) || (node->count > kMinfsExtentsPerNode)) {
+                status = MX_ERR_IO_DATA_INTEGRITY;
+                break;
+            }
+        }
+    }
+
+    if (status != MX_OK) {
+        FS_TRACE_ERROR("minfs: failed to load extents of inode #%u: %d\n", ino_, status);
+        ExtentsRelease();
+        return status;
+    }
+    extents_loaded_ = true;
+    return MX_OK;
+}
+
+mx_status_t VnodeMinfs::ExtentNodeNew(WriteTxn* txn, uint32_t depth, uint32_t* out) {
+    mx_status_t status;
+    uint32_t bno, count;
+    if ((status = fs_->BlockNew(txn, 0, 1, &bno, &count)) != MX_OK) {
+        return status;
+    }
+    uint32_t slot;
+    if ((status = ExtentSlotNew(bno, &slot)) != MX_OK) {
+        fs_->BlockFree(txn, bno, 1);
+        return status;
+    }
+    minfs_extent_node_t* node = ExtentNode(slot);
+    memset(node, 0, kMinfsBlockSize);
+    node->magic = kMinfsExtentNodeMagic;
+    node->ino = ino_;
+    node->bno = bno;
+    node->depth = depth;
+    inode_.block_count++;
+    *out = slot;
+    return MX_OK;
+}
+
+void VnodeMinfs::ExtentNodeFree(WriteTxn* txn, uint32_t slot) {
+    minfs_extent_node_t* node = ExtentNode(slot);
+    fs_->BlockFree(txn, node->bno, 1);
+    extent_slots_.erase(node->bno);
+    node->magic = 0;
+    inode_.block_count--;
+    // A slot which can't be tracked is just never used again
+    extent_free_slots_.push_back(slot);
+}
+
+void VnodeMinfs::ExtentWrite(WriteTxn* txn, const ExtentList& list) {
+    // The inode is written by the caller
+    if (list.slot == kNoSlot) {
+        return;
+    }
+    const ExtentChunk& chunk = extent_chunks_[list.slot / kMinfsExtentChunkNodes];
+    uint32_t bno = ExtentNode(list.slot)->bno;
+#ifdef __Fuchsia__
+    txn->Enqueue(chunk.vmoid, list.slot % kMinfsExtentChunkNodes, bno, 1);
+#else
+    txn->Enqueue(chunk.data.get(), list.slot % kMinfsExtentChunkNodes, bno, 1);
+#endif
+}
+
+mx_status_t VnodeMinfs::ExtentLookup(uint32_t n, uint32_t* bno, uint32_t* count) {
+    MX_DEBUG_ASSERT(n < kMinfsMaxFileBlock);
+    mx_status_t status;
+    if ((status = ExtentsLoad()) != MX_OK) {
+        return status;
+    }
+
+    // Whatever follows |n| starts no later than the index entry after the
+    // one taken at each level on the way down.
+    uint32_t limit = static_cast<uint32_t>(kMinfsMaxFileBlock);
+    ExtentList list = ExtentRoot();
+    while (list.depth > 0) {
+        uint32_t i = ExtentsBefore(list.entries, *list.count, n);
+        i = (i > 0) ? i - 1 : 0;
+        if (i + 1 < *list.count) {
+            limit = mxtl::min(limit, list.entries[i + 1].start);
+        }
+        list = ExtentChild(list, i);
+    }
+
+    uint32_t i = ExtentsBefore(list.entries, *list.count, n);
+    if (i > 0) {
+        const minfs_extent_t& e = list.entries[i - 1];
+        if (n - e.start < e.count) {
+            *bno = e.bno + (n - e.start);
+            *count = e.count - (n - e.start);
+            return MX_OK;
+        }
+    }
+    *bno = 0;
+    *count = ((i < *list.count) ? list.entries[i].start : limit) - n;
+    return MX_OK;
+}
+
+mx_status_t VnodeMinfs::ExtentGrow(WriteTxn* txn) {
+    if (inode_.extent_depth == kMinfsExtentDepthMax) {
+        return MX_ERR_NO_SPACE;
+    }
+    mx_status_t status;
+    uint32_t slot;
+    if ((status = ExtentNodeNew(txn, inode_.extent_depth, &slot)) != MX_OK) {
+        return status;
+    }
+
+    // The inode's entries move down into the new node, which takes their place.
+    minfs_extent_node_t* node = ExtentNode(slot);
+    memcpy(node->entries, inode_.extents, inode_.extent_count * sizeof(minfs_extent_t));
+    node->count = inode_.extent_count;
+    memset(inode_.extents, 0, sizeof(inode_.extents));
+    inode_.extents[0].start = node->entries[0].start;
+    inode_.extents[0].bno = node->bno;
+    inode_.extent_count = 1;
+    inode_.extent_depth++;
+    ExtentWrite(txn, ExtentAt(slot));
+    return MX_OK;
+}
+
+mx_status_t VnodeMinfs::ExtentSplit(WriteTxn* txn, const ExtentList& parent, uint32_t index) {
+    ExtentList child = ExtentChild(parent, index);
+    mx_status_t status;
+    uint32_t slot;
+    if ((status = ExtentNodeNew(txn, child.depth, &slot)) != MX_OK) {
+        return status;
+    }
+
+    // The upper half of the child's entries move to the new node, which
+    // follows it in the parent.
+    ExtentList sibling = ExtentAt(slot);
+    uint32_t keep = *child.count / 2;
+    uint32_t moved = *child.count - keep;
+    memcpy(sibling.entries, &child.entries[keep], moved * sizeof(minfs_extent_t));
+    memset(&child.entries[keep], 0, moved * sizeof(minfs_extent_t));
+    *sibling.count = moved;
+    *child.count = keep;
+
+    minfs_extent_t* e = parent.entries;
+    memmove(&e[index + 2], &e[index + 1], (*parent.count - index - 1) * sizeof(minfs_extent_t));
+    e[index + 1].start = sibling.entries[0].start;
+    e[index + 1].bno = ExtentNode(slot)->bno;
+    e[index + 1].count = 0;
+    (*parent.count)++;
+
+    ExtentWrite(txn, child);
+    ExtentWrite(txn, sibling);
+    ExtentWrite(txn, parent);
+    return MX_OK;
+}
+
+mx_status_t VnodeMinfs::ExtentInsert(WriteTxn* txn, uint32_t n, uint32_t bno, uint32_t count) {
+    mx_status_t status;
+    if ((status = ExtentsLoad()) != MX_OK) {
+        return status;
+    }
+
+    while (true) {
+        // The way down to the leaf mapping |n|, and the entry taken at each
+        // level above it.
+        ExtentList path[kMinfsExtentDepthMax + 1];
+        uint32_t index[kMinfsExtentDepthMax + 1];
+        uint32_t level = 0;
+        path[0] = ExtentRoot();
+        while (path[level].depth > 0) {
+            uint32_t i = ExtentsBefore(path[level].entries, *path[level].count, n);
+            index[level] = (i > 0) ? i - 1 : 0;
+            path[level + 1] = ExtentChild(path[level], index[level]);
+            level++;
+        }
+
+        const ExtentList& leaf = path[level];
+        minfs_extent_t* e = leaf.entries;
+        uint32_t i = ExtentsBefore(e, *leaf.count, n);
+        bool joins_prev = (i > 0) && (e[i - 1].start + e[i - 1].count == n) &&
+                          (e[i - 1].bno + e[i - 1].count == bno);
+        bool joins_next = (i < *leaf.count) && (n + count == e[i].start) &&
+                          (bno + count == e[i].bno);
+
+        // Runs which carry on from their neighbours, on disk as in the file,
+        // are merged with them.
+        if (joins_prev) {
+            e[i - 1].count += count;
+            if (joins_next) {
+                e[i - 1].count += e[i].count;
+                memmove(&e[i], &e[i + 1], (*leaf.count - i - 1) * sizeof(minfs_extent_t));
+                memset(&e[*leaf.count - 1], 0, sizeof(minfs_extent_t));
+                (*leaf.count)--;
+            }
+            ExtentWrite(txn, leaf);
+            return MX_OK;
+        } else if (joins_next) {
+            e[i].start = n;
+            e[i].bno = bno;
+            e[i].count += count;
+        } else if (*leaf.count < leaf.max) {
+            memmove(&e[i + 1], &e[i], (*leaf.count - i) * sizeof(minfs_extent_t));
+            e[i].start = n;
+            e[i].bno = bno;
+            e[i].count = count;
+            (*leaf.count)++;
+        } else {
+            // Split the highest full node whose parent has room, or, if
+            // they're full all the way up, grow the tree from the inode.
+            while ((level > 0) && (*path[level - 1].count == path[level - 1].max)) {
+                level--;
+            }
+            if (level == 0) {
+                status = ExtentGrow(txn);
+            } else {
+                status = ExtentSplit(txn, path[level - 1], index[level - 1]);
+            }
+            if (status != MX_OK) {
+                return status;
+            }
+            continue;
+        }
+        ExtentWrite(txn, leaf);
+
+        // A new first entry moves the start of the index entries above it.
+        for (; (i == 0) && (level > 0); level--) {
+            i = index[level - 1];
+            path[level - 1].entries[i].start = path[level].entries[0].start;
+            ExtentWrite(txn, path[level - 1]);
+        }
+        return MX_OK;
+    }
+}
+
+void VnodeMinfs::ExtentTrim(WriteTxn* txn, const ExtentList& list, uint32_t start) {
+    bool changed = false;
+    while (*list.count > 0) {
+        uint32_t i = *list.count - 1;
+        minfs_extent_t* e = &list.entries[i];
+        if (e->start < start) {
+            if (list.depth > 0) {
+                ExtentTrim(txn, ExtentChild(list, i), start);
+            } else if (start - e->start < e->count) {
+                uint32_t keep = start - e->start;
+                fs_->BlockFree(txn, e->bno + keep, e->count - keep);
+                inode_.block_count -= e->count - keep;
+                e->count = keep;
+                changed = true;
+            }
+            break;
+        }
+
+        if (list.depth > 0) {
+            ExtentList child = ExtentChild(list, i);
+            ExtentTrim(txn, child, 0);
+            ExtentNodeFree(txn, child.slot);
+        } else {
+            fs_->BlockFree(txn, e->bno, e->count);
+            inode_.block_count -= e->count;
+        }
+        memset(e, 0, sizeof(*e));
+        (*list.count)--;
+        changed = true;
+    }
+
+    // A node left empty is freed by the caller rather than written.
+    if (changed && (*list.count > 0)) {
+        ExtentWrite(txn, list);
+    }
+}
+
+mx_status_t VnodeMinfs::ExtentTruncate(WriteTxn* txn, uint32_t start) {
+    mx_status_t status;
+    if ((status = ExtentsLoad()) != MX_OK) {
+        return status;
+    }
+    ExtentTrim(txn, ExtentRoot(), start);
+
+    // Once a single node is left below the inode, its entries move back up
+    // into the inode where they fit.
+    while ((inode_.extent_depth > 0) && (inode_.extent_count <= 1)) {
+        if (inode_.extent_count == 0) {
+            inode_.extent_depth = 0;
+            break;
+        }
+        ExtentList child = ExtentChild(ExtentRoot(), 0);
+        if (*child.count > kMinfsInlineExtents) {
+            break;
+        }
+        memset(inode_.extents, 0, sizeof(inode_.extents));
+        memcpy(inode_.extents, child.entries, *child.count * sizeof(minfs_extent_t));
+        inode_.extent_count = *child.count;
+        inode_.extent_depth = child.depth;
+        ExtentNodeFree(txn, child.slot);
+    }
+    return MX_OK;
+}
+
+} // namespace minfs
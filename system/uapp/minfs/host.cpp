@@ -21,6 +21,12 @@
 #include "minfs.h"
 #include "minfs-private.h"
 
+// The mxtl containers expect the program to define the placement new they
+// use, which on Fuchsia comes from mxcpp.
+void* operator new(size_t, void* ptr) {
+    return ptr;
+}
+
 static mx_status_t do_stat(mxtl::RefPtr<Vnode> vn, struct stat* s) {
     vnattr_t a;
     mx_status_t status = vn->Getattr(&a);
@@ -127,7 +133,8 @@ int emu_close(int fd) {
     file_t* f;
     FILE_WRAP(f, fd, close, fd);
     f->vn->Close();
-    memset(f, 0, sizeof(file_t));
+    // Assigned rather than cleared, to let go of the vnode.
+    *f = file_t();
     return 0;
 }
 
@@ -310,7 +317,8 @@ struct dirent* emu_readdir(DIR* dirp) {
             dir->size = 0;
         }
         mx_status_t status = dir->vn->Readdir(&dir->cookie, &dir->data, DIR_BUFSIZE);
-        if (status < 0) {
+        if (status <= 0) {
+            // Nothing more is read past the end of the directory
             break;
         }
         dir->ptr = dir->data;
@@ -0,0 +1,719 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <fs/trace.h>
+#include <mxalloc/new.h>
+#include <mxtl/unique_ptr.h>
+
+#ifdef __Fuchsia__
+#include <mxtl/auto_lock.h>
+#endif
+
+#include "minfs-private.h"
+
+namespace minfs {
+
+namespace {
+
+uint64_t checksum_continue(uint64_t sum, const void* ptr, size_t len) {
+    const uint8_t* data = static_cast<const uint8_t*>(ptr);
+    while (len-- > 0) {
+        sum = (sum ^ (*data++)) * FNV64_PRIME;
+    }
+    return sum;
+}
+
+// The checksum of an entry's header, to be continued with each of its blocks.
+uint64_t checksum_entry(const minfs_journal_entry_t* entry) {
+    minfs_journal_entry_t hdr;
+    memcpy(&hdr, entry, sizeof(hdr));
+    hdr.checksum = 0;
+    uint64_t sum = fnv1a64(&hdr, sizeof(hdr));
+    return checksum_continue(sum, entry->bno, entry->block_count * sizeof(uint32_t));
+}
+
+bool entry_valid(const minfs_journal_entry_t* entry, const minfs_info_t* info,
+                 uint64_t seq, uint32_t pos) {
+    if ((entry->magic != kMinfsJournalEntryMagic) || (entry->seq != seq) ||
+        (entry->block_count == 0) || (entry->block_count > kMinfsJournalEntryMax) ||
+        (entry->block_count > info->jnl_blocks - pos - 1)) {
+        return false;
+    }
+    for (uint32_t i = 0; i < entry->block_count; i++) {
+        uint32_t bno = entry->bno[i];
+        if ((bno >= info->block_count) ||
+            ((bno >= info->jnl_block) && (bno < info->jnl_block + info->jnl_blocks))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#ifdef __Fuchsia__
+// How long metadata writes wait for others to share their commit.
+constexpr long kCommitIntervalNs = 100 * 1000 * 1000;
+#endif
+
+} // namespace
+
+uint64_t minfs_journal_checksum(const minfs_journal_entry_t* entry, const void* blocks) {
+    return checksum_continue(checksum_entry(entry), blocks,
+                             entry->block_count * static_cast<size_t>(kMinfsBlockSize));
+}
+
+mx_status_t minfs_journal_replay(Bcache* bc, const minfs_info_t* info) {
+    AllocChecker ac;
+    // Room for an entry's header and one of its blocks.
+    mxtl::unique_ptr<uint8_t[]> buf(new (&ac) uint8_t[2 * kMinfsBlockSize]);
+    if (!ac.check()) {
+        return MX_ERR_NO_MEMORY;
+    }
+    uint8_t* hdr = buf.get();
+    uint8_t* blk = buf.get() + kMinfsBlockSize;
+
+    mx_status_t status;
+    if ((status = bc->Readblk(info->jnl_block, hdr)) != MX_OK) {
+        return status;
+    }
+    const minfs_journal_info_t* jinfo = reinterpret_cast<const minfs_journal_info_t*>(hdr);
+    if (jinfo->magic != kMinfsJournalMagic) {
+        FS_TRACE_ERROR("minfs: bad journal magic\n");
+        return MX_ERR_IO;
+    }
+
+    uint64_t seq = jinfo->start_seq;
+    uint32_t pos = 1;
+    uint32_t replayed = 0;
+    while (pos < info->jnl_blocks) {
+        if ((status = bc->Readblk(info->jnl_block + pos, hdr)) != MX_OK) {
+            return status;
+        }
+        const minfs_journal_entry_t* entry = reinterpret_cast<const minfs_journal_entry_t*>(hdr);
+        if (!entry_valid(entry, info, seq, pos)) {
+            break;
+        }
+
+        // An entry whose commit was cut short is simply dropped, along with
+        // anything after it.
+        uint64_t sum = checksum_entry(entry);
+        for (uint32_t i = 0; i < entry->block_count; i++) {
+            if ((status = bc->Readblk(info->jnl_block + pos + 1 + i, blk)) != MX_OK) {
+                return status;
+            }
+            sum = checksum_continue(sum, blk, kMinfsBlockSize);
+        }
+        if (sum != entry->checksum) {
+            break;
+        }
+
+        for (uint32_t i = 0; i < entry->block_count; i++) {
+            if ((status = bc->Readblk(info->jnl_block + pos + 1 + i, blk)) != MX_OK) {
+                return status;
+            }
+            if ((status = bc->Writeblk(entry->bno[i], blk)) != MX_OK) {
+                return status;
+            }
+        }
+
+        pos += 1 + entry->block_count;
+        seq++;
+        replayed++;
+    }
+
+    if (replayed == 0) {
+        return MX_OK;
+    }
+
+    // Retire the entries, once their blocks are in place.
+    if (bc->Sync() != 0) {
+        return MX_ERR_IO;
+    }
+    memset(hdr, 0, kMinfsBlockSize);
+    minfs_journal_info_t* retired = reinterpret_cast<minfs_journal_info_t*>(hdr);
+    retired->magic = kMinfsJournalMagic;
+    retired->start_seq = seq;
+    if ((status = bc->Writeblk(info->jnl_block, hdr)) != MX_OK) {
+        return status;
+    }
+    FS_TRACE(MINFS, "minfs: replayed %u journal entries\n", replayed);
+    return MX_OK;
+}
+
+#ifdef __Fuchsia__
+
+Journal::Journal(Bcache* bc, const minfs_info_t* info)
+    : bc_(bc), jnl_block_(info->jnl_block), jnl_blocks_(info->jnl_blocks),
+      discard_(bc->CanDiscard()) {
+    cnd_init(&wake_);
+}
+
+Journal::~Journal() {
+    bc_->SetJournal(nullptr);
+    if (thread_started_) {
+        {
+            mxtl::AutoLock lock(&lock_);
+            stop_ = true;
+            cnd_signal(&wake_);
+        }
+        thrd_join(thread_, nullptr);
+
+        mxtl::AutoLock lock(&lock_);
+        mx_status_t status;
+        if (((status = CommitLocked()) != MX_OK) ||
+            ((status = CheckpointLocked()) != MX_OK)) {
+            FS_TRACE_ERROR("minfs: failed to write back journal: %d\n", status);
+        }
+        Discard();
+        FS_TRACE(MINFS, "minfs: journal: %" PRIu64 " commits of %" PRIu64 " blocks, "
+                 "%" PRIu64 " checkpoints\n", commits_, blocks_committed_, checkpoints_);
+    }
+    cnd_destroy(&wake_);
+}
+
+mx_status_t Journal::Create(Bcache* bc, const minfs_info_t* info,
+                            mxtl::unique_ptr<Journal>* out) {
+    AllocChecker ac;
+    mxtl::unique_ptr<Journal> journal(new (&ac) Journal(bc, info));
+    if (!ac.check()) {
+        return MX_ERR_NO_MEMORY;
+    }
+    JournaledBlock* journaled = new (&ac) JournaledBlock[info->jnl_blocks];
+    if (!ac.check()) {
+        return MX_ERR_NO_MEMORY;
+    }
+
+    mx_status_t status;
+    mxtl::unique_ptr<MappedVmo> buffer;
+    if ((status = MappedVmo::Create(info->jnl_blocks * kMinfsBlockSize, "minfs-journal",
+                                    &buffer)) != MX_OK) {
+        delete[] journaled;
+        return status;
+    }
+
+    {
+        mxtl::AutoLock lock(&journal->lock_);
+        journal->journaled_.reset(journaled, info->jnl_blocks);
+        journal->buffer_ = mxtl::move(buffer);
+    }
+
+    if ((status = bc->AttachVmo(journal->buffer_->GetVmo(), &journal->vmoid_)) != MX_OK) {
+        return status;
+    }
+
+    // Replay has retired every entry, so new ones continue from its start_seq.
+    ReadTxn txn(bc);
+    txn.Enqueue(journal->vmoid_, 0, info->jnl_block, 1);
+    if ((status = txn.Flush()) != MX_OK) {
+        return status;
+    }
+    const minfs_journal_info_t* jinfo =
+        static_cast<const minfs_journal_info_t*>(journal->buffer_->GetData());
+    if (jinfo->magic != kMinfsJournalMagic) {
+        return MX_ERR_IO;
+    }
+
+    {
+        mxtl::AutoLock lock(&journal->lock_);
+        journal->seq_ = jinfo->start_seq;
+    }
+
+    if (thrd_create_with_name(&journal->thread_, CommitThread, journal.get(),
+                              "minfs-journal") != thrd_success) {
+        return MX_ERR_NO_RESOURCES;
+    }
+    journal->thread_started_ = true;
+
+    *out = mxtl::move(journal);
+    return MX_OK;
+}
+
+mx_status_t Journal::RegisterVmo(vmoid_t vmoid, const void* data) {
+    if (vmo_count_ == kMaxVmos) {
+        return MX_ERR_NO_RESOURCES;
+    }
+    vmos_[vmo_count_].vmoid = vmoid;
+    vmos_[vmo_count_].data = data;
+    vmo_count_++;
+    return MX_OK;
+}
+
+mx_status_t Journal::RegisterVnodeVmo(vmoid_t vmoid, mx_handle_t vmo) {
+    mxtl::AutoLock lock(&lock_);
+    return vnode_vmos_.insert(vmoid, vmo) ? MX_OK : MX_ERR_NO_MEMORY;
+}
+
+void Journal::UnregisterVnodeVmo(vmoid_t vmoid) {
+    mxtl::AutoLock lock(&lock_);
+    vnode_vmos_.erase(vmoid);
+}
+
+const void* Journal::FindVmo(vmoid_t vmoid) const {
+    for (size_t i = 0; i < vmo_count_; i++) {
+        if (vmos_[i].vmoid == vmoid) {
+            return vmos_[i].data;
+        }
+    }
+    return nullptr;
+}
+
+bool Journal::IsMetadataLocked(const block_fifo_request_t& request) const {
+    return (FindVmo(request.vmoid) != nullptr) || (vnode_vmos_.find(request.vmoid) != nullptr);
+}
+
+bool Journal::JournaledLocked(uint64_t bno, uint64_t count) const {
+    for (size_t i = 0; i < pending_count_; i++) {
+        if ((pending_[i] >= bno) && (pending_[i] < bno + count)) {
+            return true;
+        }
+    }
+    for (size_t i = 0; i < journaled_count_; i++) {
+        if ((journaled_[i].bno >= bno) && (journaled_[i].bno < bno + count)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int Journal::CommitThread(void* arg) {
+    Journal* journal = static_cast<Journal*>(arg);
+    journal->lock_.Acquire();
+    while (!journal->stop_) {
+        if (journal->discard_waiting_) {
+            // What commits have freed is discarded without holding up the
+            // writes behind them.
+            journal->discard_waiting_ = false;
+            journal->lock_.Release();
+            journal->Discard();
+            journal->lock_.Acquire();
+            continue;
+        }
+        if (journal->pending_count_ == 0) {
+            cnd_wait(&journal->wake_, journal->lock_.GetInternal());
+            continue;
+        }
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += kCommitIntervalNs;
+        if (deadline.tv_nsec >= 1000 * 1000 * 1000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000 * 1000 * 1000;
+        }
+        cnd_timedwait(&journal->wake_, journal->lock_.GetInternal(), &deadline);
+
+        // Whatever is left is committed on the way out.
+        if (journal->stop_) {
+            break;
+        }
+        mx_status_t status;
+        if ((status = journal->CommitLocked()) != MX_OK) {
+            FS_TRACE_ERROR("minfs: journal commit failed: %d\n", status);
+        }
+    }
+    journal->lock_.Release();
+    return 0;
+}
+
+mx_status_t Journal::Write(block_fifo_request_t* requests, size_t count) {
+    mxtl::AutoLock lock(&lock_);
+
+    // Data goes out first, so that it's on the device before any metadata
+    // referring to it can be committed.
+    block_fifo_request_t data[MAX_TXN_MESSAGES];
+    size_t data_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (!IsMetadataLocked(requests[i])) {
+            MX_DEBUG_ASSERT(data_count < MAX_TXN_MESSAGES);
+            data[data_count++] = requests[i];
+        }
+    }
+    mx_status_t status;
+    if ((data_count != 0) && ((status = bc_->RawTxn(data, data_count)) != MX_OK)) {
+        return status;
+    }
+
+    // The metadata blocks of a transaction are committed together or not at
+    // all, so whatever is waiting goes ahead of them if they don't fit with it.
+    size_t added = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (IsMetadataLocked(requests[i])) {
+            added += requests[i].length / kMinfsBlockSize;
+        }
+    }
+    if (added == 0) {
+        AdvanceFrees(FreeState::kFreed, FreeState::kWritten);
+        return MX_OK;
+    }
+    if (added > kMinfsJournalCommitBlocks) {
+        return MX_ERR_NO_RESOURCES;
+    }
+    if (((pending_count_ + added > kMinfsJournalCommitBlocks) ||
+         (head_ + 1 + pending_count_ + added > jnl_blocks_)) &&
+        ((status = CommitLocked()) != MX_OK)) {
+        return status;
+    }
+    if ((head_ + 1 + added > jnl_blocks_) && ((status = CheckpointLocked()) != MX_OK)) {
+        return status;
+    }
+
+    // The blocks are copied now, as the metadata VMOs go on changing under
+    // transactions which are yet to be written.
+    for (size_t i = 0; i < count; i++) {
+        const block_fifo_request_t& req = requests[i];
+        if (!IsMetadataLocked(req)) {
+            continue;
+        }
+        uint64_t bno = req.dev_offset / kMinfsBlockSize;
+        const void* vmo_data = FindVmo(req.vmoid);
+        for (uint64_t b = 0; b < req.length / kMinfsBlockSize; b++) {
+            void* copy = AddPendingLocked(static_cast<uint32_t>(bno + b));
+            uint64_t off = req.vmo_offset + b * kMinfsBlockSize;
+            if (vmo_data != nullptr) {
+                memcpy(copy, static_cast<const uint8_t*>(vmo_data) + off, kMinfsBlockSize);
+                continue;
+            }
+            size_t actual;
+            if (((status = mx_vmo_read(*vnode_vmos_.find(req.vmoid), copy, off,
+                                       kMinfsBlockSize, &actual)) != MX_OK) ||
+                (actual != kMinfsBlockSize)) {
+                // Only a VMO closed under us fails to read, and then the
+                // blocks copied so far are no worse than what a failed
+                // write would have left on the device.
+                return (status != MX_OK) ? status : MX_ERR_IO;
+            }
+        }
+    }
+
+    // The bitmap blocks freeing whatever was freed ahead of these writes are
+    // among them, or were before them.
+    AdvanceFrees(FreeState::kFreed, FreeState::kWritten);
+    return MX_OK;
+}
+
+mx_status_t Journal::Read(block_fifo_request_t* requests, size_t count) {
+    {
+        // Only the journal has the latest copies of the blocks it hasn't
+        // written in place yet, which is rare enough for the reader to wait
+        // for all of them to be.
+        mxtl::AutoLock lock(&lock_);
+        for (size_t i = 0; i < count; i++) {
+            if (!JournaledLocked(requests[i].dev_offset / kMinfsBlockSize,
+                                 requests[i].length / kMinfsBlockSize)) {
+                continue;
+            }
+            mx_status_t status;
+            if (((status = CommitLocked()) != MX_OK) ||
+                ((status = CheckpointLocked()) != MX_OK)) {
+                return status;
+            }
+            break;
+        }
+    }
+    return bc_->RawTxn(requests, count);
+}
+
+mx_status_t Journal::Commit() {
+    mxtl::AutoLock lock(&lock_);
+    return CommitLocked();
+}
+
+void Journal::SetWriteback(Minfs* fs) {
+    mxtl::AutoLock lock(&lock_);
+    fs_ = fs;
+}
+
+void* Journal::PendingDataLocked(size_t index) {
+    uintptr_t base = reinterpret_cast<uintptr_t>(buffer_->GetData());
+    return reinterpret_cast<void*>(base + (head_ + 1 + index) * kMinfsBlockSize);
+}
+
+void* Journal::AddPendingLocked(uint32_t bno) {
+    size_t i;
+    for (i = 0; i < pending_count_; i++) {
+        if (pending_[i] == bno) {
+            break;
+        }
+    }
+    if (i == pending_count_) {
+        MX_DEBUG_ASSERT(pending_count_ < kMinfsJournalCommitBlocks);
+        MX_DEBUG_ASSERT(head_ + 2 + pending_count_ <= jnl_blocks_);
+        if (pending_count_ == 0) {
+            cnd_signal(&wake_);
+        }
+        pending_[pending_count_++] = bno;
+    }
+    return PendingDataLocked(i);
+}
+
+mx_status_t Journal::CommitLocked() {
+    if (pending_count_ == 0) {
+        return MX_OK;
+    }
+
+    mx_status_t status;
+    if ((fs_ != nullptr) && ((status = fs_->FlushDirty(nullptr)) != MX_OK)) {
+        return status;
+    }
+
+    // The blocks were copied in behind the entry's header as they were
+    // written, and room was made for them then.
+    uint32_t blocks = static_cast<uint32_t>(pending_count_) + 1;
+    MX_DEBUG_ASSERT(head_ + blocks <= jnl_blocks_);
+
+    uintptr_t base = reinterpret_cast<uintptr_t>(buffer_->GetData());
+    minfs_journal_entry_t* entry =
+        reinterpret_cast<minfs_journal_entry_t*>(base + head_ * kMinfsBlockSize);
+    memset(entry, 0, kMinfsBlockSize);
+    entry->magic = kMinfsJournalEntryMagic;
+    entry->seq = seq_;
+    entry->block_count = blocks - 1;
+    for (size_t i = 0; i < pending_count_; i++) {
+        entry->bno[i] = pending_[i];
+    }
+    entry->checksum = minfs_journal_checksum(entry, PendingDataLocked(0));
+
+    // The data and the checkpointed blocks the entry depends on must be
+    // durable before the entry is, which is then durable before the commit
+    // returns.
+    if ((status = bc_->Flush()) != MX_OK) {
+        return status;
+    }
+
+    block_fifo_request_t request;
+    request.txnid = bc_->TxnId();
+    request.vmoid = vmoid_;
+    request.opcode = BLOCKIO_WRITE | BLOCKIO_FUA;
+    request.vmo_offset = static_cast<uint64_t>(head_) * kMinfsBlockSize;
+    request.dev_offset = static_cast<uint64_t>(jnl_block_ + head_) * kMinfsBlockSize;
+    request.length = static_cast<uint64_t>(blocks) * kMinfsBlockSize;
+    if ((status = bc_->RawTxn(&request, 1)) != MX_OK) {
+        return status;
+    }
+
+    // Only the latest copy of a block needs writing in place.
+    for (size_t i = 0; i < pending_count_; i++) {
+        uint32_t pos = head_ + 1 + static_cast<uint32_t>(i);
+        size_t j;
+        for (j = 0; j < journaled_count_; j++) {
+            if (journaled_[j].bno == pending_[i]) {
+                break;
+            }
+        }
+        if (j == journaled_count_) {
+            journaled_[journaled_count_++].bno = pending_[i];
+        }
+        journaled_[j].pos = pos;
+    }
+
+    head_ += blocks;
+    seq_++;
+    commits_++;
+    blocks_committed_ += pending_count_;
+    pending_count_ = 0;
+
+    if (CommittedFreesLocked()) {
+        discard_waiting_ = true;
+        cnd_signal(&wake_);
+    }
+    return MX_OK;
+}
+
+void Journal::Free(uint32_t start, uint32_t count) {
+    mxtl::AutoLock lock(&free_lock_);
+    // Files are mostly freed a run of blocks at a time.
+    if (!frees_.is_empty()) {
+        FreeExtent* last = &frees_[frees_.size() - 1];
+        if (last->state == FreeState::kFreed) {
+            if (last->start + last->count == start) {
+                last->count += count;
+                return;
+            } else if (start + count == last->start) {
+                last->start = start;
+                last->count += count;
+                return;
+            }
+        }
+    }
+    if (!frees_.push_back({ start, count, FreeState::kFreed })) {
+        // The blocks are never released, and stay out of use until the
+        // filesystem is mounted again.
+        FS_TRACE_ERROR("minfs: no memory to track freed blocks %u-%u\n",
+                       start, start + count - 1);
+    }
+}
+
+bool Journal::TakeReleased(uint32_t* start, uint32_t* count) {
+    mxtl::AutoLock lock(&free_lock_);
+    for (size_t i = 0; i < frees_.size(); i++) {
+        if (frees_[i].state != FreeState::kReleased) {
+            continue;
+        }
+        *start = frees_[i].start;
+        *count = frees_[i].count;
+        frees_.erase(i);
+        return true;
+    }
+    return false;
+}
+
+mx_status_t Journal::Release() {
+    {
+        mxtl::AutoLock lock(&lock_);
+        mx_status_t status;
+        if ((status = CommitLocked()) != MX_OK) {
+            return status;
+        }
+        bool held = false;
+        {
+            mxtl::AutoLock free_lock(&free_lock_);
+            for (size_t i = 0; i < frees_.size(); i++) {
+                held |= (frees_[i].state == FreeState::kHeld);
+            }
+        }
+        if (held && ((status = CheckpointLocked()) != MX_OK)) {
+            return status;
+        }
+    }
+    Discard();
+    return MX_OK;
+}
+
+bool Journal::AdvanceFrees(FreeState from, FreeState to) {
+    mxtl::AutoLock lock(&free_lock_);
+    bool any = false;
+    for (size_t i = 0; i < frees_.size(); i++) {
+        if (frees_[i].state == from) {
+            frees_[i].state = to;
+            any = true;
+        }
+    }
+    return any;
+}
+
+bool Journal::CommittedFreesLocked() {
+    mxtl::AutoLock lock(&free_lock_);
+    bool any = false;
+    for (size_t i = 0; i < frees_.size(); i++) {
+        FreeExtent* extent = &frees_[i];
+        if (extent->state != FreeState::kWritten) {
+            continue;
+        }
+        if (JournaledLocked(extent->start, extent->count)) {
+            extent->state = FreeState::kHeld;
+        } else if (discard_) {
+            extent->state = FreeState::kCommitted;
+            any = true;
+        } else {
+            extent->state = FreeState::kReleased;
+        }
+    }
+    return any;
+}
+
+bool Journal::CheckpointedFrees() {
+    return AdvanceFrees(FreeState::kHeld,
+                        discard_ ? FreeState::kCommitted : FreeState::kReleased) && discard_;
+}
+
+void Journal::Discard() {
+    mxtl::AutoLock lock(&free_lock_);
+    block_fifo_request_t requests[MAX_TXN_MESSAGES];
+    size_t count = 0;
+    for (size_t i = 0; i < frees_.size(); i++) {
+        FreeExtent* extent = &frees_[i];
+        if (extent->state != FreeState::kCommitted) {
+            continue;
+        }
+        // The blocks can't be allocated again before the discard is done,
+        // as the lock is held until then.
+        extent->state = FreeState::kReleased;
+        requests[count].txnid = bc_->TxnId();
+        requests[count].vmoid = 0;
+        requests[count].opcode = BLOCKIO_DISCARD;
+        requests[count].vmo_offset = 0;
+        requests[count].dev_offset = static_cast<uint64_t>(extent->start) * kMinfsBlockSize;
+        requests[count].length = static_cast<uint64_t>(extent->count) * kMinfsBlockSize;
+        blocks_discarded_ += extent->count;
+        if (++count == MAX_TXN_MESSAGES) {
+            // A discard which fails leaves the blocks as they were, which is
+            // no worse than not asking.
+            mx_status_t status;
+            if ((status = bc_->RawTxn(requests, count)) != MX_OK) {
+                FS_TRACE_ERROR("minfs: discard failed: %d\n", status);
+            }
+            count = 0;
+        }
+    }
+    mx_status_t status;
+    if ((count != 0) && ((status = bc_->RawTxn(requests, count)) != MX_OK)) {
+        FS_TRACE_ERROR("minfs: discard failed: %d\n", status);
+    }
+}
+
+mx_status_t Journal::CheckpointLocked() {
+    // Blocks waiting to be committed are copied in after head_, which starts
+    // over here.
+    MX_DEBUG_ASSERT(pending_count_ == 0);
+
+    // The blocks go home from their copies in the journal, which, unlike the
+    // metadata VMOs, hold nothing that hasn't been committed.
+    mx_status_t status;
+    block_fifo_request_t requests[MAX_TXN_MESSAGES];
+    size_t count = 0;
+    for (size_t i = 0; i < journaled_count_; i++) {
+        requests[count].txnid = bc_->TxnId();
+        requests[count].vmoid = vmoid_;
+        requests[count].opcode = BLOCKIO_WRITE;
+        requests[count].vmo_offset = static_cast<uint64_t>(journaled_[i].pos) * kMinfsBlockSize;
+        requests[count].dev_offset = static_cast<uint64_t>(journaled_[i].bno) * kMinfsBlockSize;
+        requests[count].length = kMinfsBlockSize;
+        if ((++count == MAX_TXN_MESSAGES) || (i + 1 == journaled_count_)) {
+            if ((status = bc_->RawTxn(requests, count)) != MX_OK) {
+                return status;
+            }
+            count = 0;
+        }
+    }
+
+    // With everything durably in place, retire the entries, and start over.
+    minfs_journal_info_t* jinfo = static_cast<minfs_journal_info_t*>(buffer_->GetData());
+    if (jinfo->start_seq != seq_) {
+        if ((status = bc_->Flush()) != MX_OK) {
+            return status;
+        }
+        jinfo->magic = kMinfsJournalMagic;
+        jinfo->start_seq = seq_;
+        requests[0].txnid = bc_->TxnId();
+        requests[0].vmoid = vmoid_;
+        requests[0].opcode = BLOCKIO_WRITE | BLOCKIO_FUA;
+        requests[0].vmo_offset = 0;
+        requests[0].dev_offset = static_cast<uint64_t>(jnl_block_) * kMinfsBlockSize;
+        requests[0].length = kMinfsBlockSize;
+        if ((status = bc_->RawTxn(requests, 1)) != MX_OK) {
+            return status;
+        }
+        checkpoints_++;
+    }
+
+    head_ = 1;
+    journaled_count_ = 0;
+
+    // Nothing is left in the journal to be written over whatever the freed
+    // blocks it held go on to hold.
+    if (CheckpointedFrees()) {
+        discard_waiting_ = true;
+        cnd_signal(&wake_);
+    }
+    return MX_OK;
+}
+
+#endif
+
+} // namespace minfs
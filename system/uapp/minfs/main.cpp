@@ -33,9 +33,14 @@ int run_fs_tests(int argc, char** argv);
 
 namespace {
 
+#ifdef __Fuchsia__
+minfs::MountOptions mount_options;
+bool check_incremental = false;
+#endif
+
 int do_minfs_check(mxtl::unique_ptr<minfs::Bcache> bc, int argc, char** argv) {
 #ifdef __Fuchsia__
-    return minfs_check(mxtl::move(bc));
+    return minfs_check(mxtl::move(bc), check_incremental);
 #else
     return -1;
 #endif
@@ -44,7 +49,7 @@ int do_minfs_check(mxtl::unique_ptr<minfs::Bcache> bc, int argc, char** argv) {
 #ifdef __Fuchsia__
 int do_minfs_mount(mxtl::unique_ptr<minfs::Bcache> bc, int argc, char** argv) {
     mxtl::RefPtr<minfs::VnodeMinfs> vn;
-    if (minfs_mount(&vn, mxtl::move(bc)) < 0) {
+    if (minfs_mount(&vn, mxtl::move(bc), mount_options) < 0) {
         return -1;
     }
 
@@ -260,14 +265,22 @@ int usage() {
             "usage: minfs [ <option>* ] <file-or-device>[@<size>] <command> [ <arg>* ]\n"
             "\n"
             "options:  -v         some debug messages\n"
-            "          -vv        all debug messages\n"
+            "          -vv        all debug messages\n");
 #ifdef __Fuchsia__
+    fprintf(stderr,
+            "          --readahead <blocks>\n"
+            "                     most blocks to read ahead of sequential reads when\n"
+            "                     mounted (default %u, 0 disables)\n"
+            "          --incremental\n"
+            "                     skip checking filesystems which were cleanly\n"
+            "                     unmounted\n"
             "\n"
             "On Fuchsia, MinFS takes the block device argument by handle.\n"
             "This can make 'minfs' commands hard to invoke from command line.\n"
-            "Try using the [mkfs,fsck,mount,umount] commands instead\n"
+            "Try using the [mkfs,fsck,mount,umount] commands instead\n",
+            minfs::kMinfsReadaheadMaxDefault);
 #endif
-            "\n");
+    fprintf(stderr, "\n");
     for (unsigned n = 0; n < countof(CMDS); n++) {
         fprintf(stderr, "%9s %-10s %s\n", n ? "" : "commands:",
                 CMDS[n].name, CMDS[n].help);
@@ -305,6 +318,19 @@ int main(int argc, char** argv) {
             fs_trace_on(FS_TRACE_SOME);
         } else if (!strcmp(argv[1], "-vv")) {
             fs_trace_on(FS_TRACE_ALL);
+#ifdef __Fuchsia__
+        } else if (!strcmp(argv[1], "--readahead") && (argc > 2)) {
+            char* end;
+            mount_options.readahead_max = static_cast<uint32_t>(strtoul(argv[2], &end, 10));
+            if ((end == argv[2]) || end[0]) {
+                fprintf(stderr, "minfs: bad readahead: %s\n", argv[2]);
+                return usage();
+            }
+            argc--;
+            argv++;
+        } else if (!strcmp(argv[1], "--incremental")) {
+            check_incremental = true;
+#endif
         } else {
             break;
         }
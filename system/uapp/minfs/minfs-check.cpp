@@ -2,27 +2,44 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <threads.h>
 #include <unistd.h>
 
+#include <magenta/syscalls.h>
+#include <mxalloc/new.h>
+#include <mxtl/algorithm.h>
+
 #include "minfs-private.h"
 #include "minfs.h"
 
 namespace minfs {
 
+namespace {
+
+// The most threads the block scan is spread across.
+constexpr uint32_t kScanThreadsMax = 8;
+
+} // namespace
+
+void MinfsChecker::CopyInode(minfs_inode_t* inode, uint32_t ino) {
+    uint32_t bno_of_ino = ino / kMinfsInodesPerBlock;
+    uint32_t off_of_ino = (ino % kMinfsInodesPerBlock) * kMinfsInodeSize;
+    uintptr_t iaddr = reinterpret_cast<uintptr_t>(fs_->inode_table_->GetData()) +
+                      bno_of_ino * kMinfsBlockSize + off_of_ino;
+    memcpy(inode, reinterpret_cast<void*>(iaddr), kMinfsInodeSize);
+}
+
 mx_status_t MinfsChecker::GetInode(minfs_inode_t* inode, uint32_t ino) {
     if (ino >= fs_->info_.inode_count) {
         FS_TRACE_ERROR("check: ino %u out of range (>=%u)\n",
               ino, fs_->info_.inode_count);
         return MX_ERR_OUT_OF_RANGE;
     }
-    uint32_t bno_of_ino = ino / kMinfsInodesPerBlock;
-    uint32_t off_of_ino = (ino % kMinfsInodesPerBlock) * kMinfsInodeSize;
-    uintptr_t iaddr = reinterpret_cast<uintptr_t>(fs_->inode_table_->GetData()) +
-                      bno_of_ino * kMinfsBlockSize + off_of_ino;
-    memcpy(inode, reinterpret_cast<void*>(iaddr), kMinfsInodeSize);
+    CopyInode(inode, ino);
     if ((inode->magic != kMinfsMagicFile) && (inode->magic != kMinfsMagicDir)) {
         FS_TRACE_ERROR("check: ino %u has bad magic %#x\n", ino, inode->magic);
         return MX_ERR_IO_DATA_INTEGRITY;
@@ -33,35 +50,6 @@ mx_status_t MinfsChecker::GetInode(minfs_inode_t* inode, uint32_t ino) {
 #define CD_DUMP 1
 #define CD_RECURSE 2
 
-mx_status_t MinfsChecker::GetInodeNthBno(minfs_inode_t* inode, uint32_t n,
-                                         uint32_t* bno_out) {
-    if (n < kMinfsDirect) {
-        *bno_out = inode->dnum[n];
-        return MX_OK;
-    }
-    n -= kMinfsDirect;
-    uint32_t i = static_cast<uint32_t>(n / (kMinfsBlockSize / sizeof(uint32_t)));
-    uint32_t j = n % (kMinfsBlockSize / sizeof(uint32_t));
-
-    if (i >= kMinfsIndirect) {
-        return MX_ERR_OUT_OF_RANGE;
-    }
-
-    uint32_t ibno;
-    if ((ibno = inode->inum[i]) == 0) {
-        *bno_out = 0;
-        return MX_OK;
-    }
-    char data[kMinfsBlockSize];
-    mx_status_t status;
-    if ((status = fs_->bc_->Readblk(ibno, data)) != MX_OK) {
-        return status;
-    }
-    uint32_t* ientry = reinterpret_cast<uint32_t*>(data);
-    *bno_out = ientry[j];
-    return MX_OK;
-}
-
 mx_status_t MinfsChecker::CheckDirectory(minfs_inode_t* inode, uint32_t ino,
                                          uint32_t parent, uint32_t flags) {
     unsigned eno = 0;
@@ -197,7 +185,75 @@ mx_status_t MinfsChecker::CheckDirectory(minfs_inode_t* inode, uint32_t ino,
     return MX_OK;
 }
 
-const char* MinfsChecker::CheckDataBlock(uint32_t bno) {
+mx_status_t MinfsChecker::CheckDirIndex(minfs_inode_t* inode, uint32_t ino) {
+    const uint32_t blocks = inode->dir_index_blocks;
+    if (blocks == 0) {
+        return MX_OK;
+    } else if (blocks > kMinfsDirIndexMaxBlocks) {
+        FS_TRACE_WARN("check: ino#%u: index of %u buckets\n", ino, blocks);
+        conforming_ = false;
+        return MX_OK;
+    }
+
+    mx_status_t status;
+    mxtl::RefPtr<VnodeMinfs> vn;
+    if ((status = VnodeMinfs::AllocateHollow(fs_.get(), &vn)) != MX_OK) {
+        return status;
+    }
+    memcpy(&vn->inode_, inode, kMinfsInodeSize);
+    vn->ino_ = ino;
+
+    AllocChecker ac;
+    mxtl::unique_ptr<uint8_t[]> buf(new (&ac) uint8_t[kMinfsBlockSize]);
+    RawBitmap offs;
+    if (!ac.check() || (offs.Reset(kMinfsMaxDirectorySize / 4) != MX_OK)) {
+        return MX_ERR_NO_MEMORY;
+    }
+    minfs_dir_bucket_t* bucket = reinterpret_cast<minfs_dir_bucket_t*>(buf.get());
+
+    // Each entry must name a live dirent of its hash, in the right bucket,
+    // and no dirent may be named twice; then there are as many entries as
+    // live dirents only if every one of them is in.
+    uint32_t entries = 0;
+    for (uint32_t b = 0; b < blocks; b++) {
+        if (vn->DirIndexRead(b, bucket) != MX_OK) {
+            conforming_ = false;
+            continue;
+        }
+        for (uint32_t i = 0; i < bucket->count; i++) {
+            const minfs_dir_hash_t* e = &bucket->entries[i];
+            uint32_t record[DirentSize(NAME_MAX)];
+            minfs_dirent_t* de = reinterpret_cast<minfs_dirent_t*>(record);
+            size_t actual;
+            if ((MinfsDirBucket(e->hash, blocks) != b) || (e->off & 3) ||
+                (e->off >= inode->size) || offs.Get(e->off / 4, e->off / 4 + 1)) {
+                FS_TRACE_WARN("check: ino#%u: bucket %u: bad entry %u+%u\n",
+                              ino, b, e->hash, e->off);
+                conforming_ = false;
+                continue;
+            }
+            offs.Set(e->off / 4, e->off / 4 + 1);
+            if ((vn->ReadInternal(record, sizeof(record), e->off, &actual) != MX_OK) ||
+                (actual < MINFS_DIRENT_SIZE) || (de->ino == 0) || (de->namelen == 0) ||
+                (actual < DirentSize(de->namelen)) ||
+                (MinfsDirHash(de->name, de->namelen) != e->hash)) {
+                FS_TRACE_WARN("check: ino#%u: bucket %u: no dirent of hash %u at %u\n",
+                              ino, b, e->hash, e->off);
+                conforming_ = false;
+                continue;
+            }
+            entries++;
+        }
+    }
+    if (entries != inode->dirent_count) {
+        FS_TRACE_WARN("check: ino#%u: index has %u of %u dirents\n",
+                      ino, entries, inode->dirent_count);
+        conforming_ = false;
+    }
+    return MX_OK;
+}
+
+const char* MinfsChecker::DataBlockError(uint32_t bno) const {
     if (bno < fs_->info_.dat_block) {
         return "in metadata area";
     }
@@ -207,6 +263,14 @@ const char* MinfsChecker::CheckDataBlock(uint32_t bno) {
     if (!fs_->block_map_.Get(bno, bno + 1)) {
         return "not allocated";
     }
+    return nullptr;
+}
+
+const char* MinfsChecker::CheckDataBlock(uint32_t bno) {
+    const char* msg;
+    if ((msg = DataBlockError(bno)) != nullptr) {
+        return msg;
+    }
     if (checked_blocks_.Get(bno, bno + 1)) {
         return "double-allocated";
     }
@@ -215,53 +279,243 @@ const char* MinfsChecker::CheckDataBlock(uint32_t bno) {
     return nullptr;
 }
 
-mx_status_t MinfsChecker::CheckFile(minfs_inode_t* inode, uint32_t ino) {
-    FS_TRACE_INFO("Direct blocks: \n");
-    for (unsigned n = 0; n < kMinfsDirect; n++) {
-        FS_TRACE_INFO(" %d,", inode->dnum[n]);
+// Only marks the blocks in the scanning thread's own bitmap; blocks claimed
+// by the inodes of more than one thread are caught when the bitmaps are
+// merged.
+const char* MinfsChecker::ScanDataBlock(ScanArgs* args, uint32_t bno) {
+    const char* msg;
+    if ((msg = DataBlockError(bno)) != nullptr) {
+        return msg;
     }
-    FS_TRACE_INFO(" ...\n");
+    if (args->blocks.Get(bno, bno + 1)) {
+        return "double-allocated";
+    }
+    args->blocks.Set(bno, bno + 1);
+    return nullptr;
+}
 
-    uint32_t blocks = 0;
+void MinfsChecker::Nonconforming(ScanArgs* args) {
+    if (args != nullptr) {
+        args->conforming = false;
+    } else {
+        conforming_ = false;
+    }
+}
 
-    // count and sanity-check indirect blocks
-    for (unsigned n = 0; n < kMinfsIndirect; n++) {
-        if (inode->inum[n]) {
-            const char* msg;
-            if ((msg = CheckDataBlock(inode->inum[n])) != nullptr) {
-               FS_TRACE_WARN("check: ino#%u: indirect block %u(@%u): %s\n",
-                     ino, n, inode->inum[n], msg);
-                conforming_ = false;
+const char* MinfsChecker::MarkBlock(ScanArgs* args, uint32_t bno) {
+    return (args != nullptr) ? ScanDataBlock(args, bno) : CheckDataBlock(bno);
+}
+
+mx_status_t MinfsChecker::WalkFile(ScanArgs* args, const minfs_inode_t* inode, uint32_t ino,
+                                   uint8_t* buffer, FileBlocks* out) {
+    out->blocks = 0;
+    out->blocks_allocated = 0;
+    if ((inode->extent_count > kMinfsInlineExtents) ||
+        (inode->extent_depth > kMinfsExtentDepthMax) ||
+        ((inode->extent_depth > 0) && (inode->extent_count == 0))) {
+        FS_TRACE_WARN("check: ino#%u: bad extents (count %u, depth %u)\n",
+                      ino, inode->extent_count, inode->extent_depth);
+        Nonconforming(args);
+        return MX_OK;
+    }
+    return WalkExtents(args, ino, inode->extents, inode->extent_count, inode->extent_depth,
+                       kMinfsMaxFileBlock, buffer, out);
+}
+
+mx_status_t MinfsChecker::WalkExtents(ScanArgs* args, uint32_t ino, const minfs_extent_t* entries,
+                                      uint32_t count, uint32_t depth, uint64_t end,
+                                      uint8_t* buffer, FileBlocks* out) {
+    const char* msg;
+    uint64_t prev_end = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        const minfs_extent_t* e = &entries[i];
+        if ((e->start < prev_end) || (e->start >= end)) {
+            FS_TRACE_WARN("check: ino#%u: extent at %u out of order\n", ino, e->start);
+            Nonconforming(args);
+            return MX_OK;
+        }
+
+        if (depth == 0) {
+            if ((e->count == 0) || (static_cast<uint64_t>(e->start) + e->count > end)) {
+                FS_TRACE_WARN("check: ino#%u: extent %u+%u overruns %" PRIu64 "\n",
+                              ino, e->start, e->count, end);
+                Nonconforming(args);
+                return MX_OK;
             }
-            blocks++;
+            if ((e->bno < fs_->info_.dat_block) ||
+                (static_cast<uint64_t>(e->bno) + e->count > fs_->info_.block_count)) {
+                FS_TRACE_WARN("check: ino#%u: extent %u+%u(@%u): out of range\n",
+                              ino, e->start, e->count, e->bno);
+                Nonconforming(args);
+                return MX_OK;
+            }
+            for (uint32_t n = 0; n < e->count; n++) {
+                if ((msg = MarkBlock(args, e->bno + n)) != nullptr) {
+                    FS_TRACE_WARN("check: ino#%u: block %u(@%u): %s\n",
+                                  ino, e->start + n, e->bno + n, msg);
+                    Nonconforming(args);
+                }
+            }
+            out->blocks += e->count;
+            out->blocks_allocated = e->start + e->count;
+            prev_end = e->start + e->count;
+            continue;
+        }
+
+        // An index entry; the node it names maps blocks up to the next one
+        if ((msg = MarkBlock(args, e->bno)) != nullptr) {
+            FS_TRACE_WARN("check: ino#%u: extent node %u(@%u): %s\n", ino, e->start, e->bno, msg);
+            Nonconforming(args);
+            return MX_OK;
+        }
+        out->blocks++;
+
+        uint8_t* data = buffer + (depth - 1) * kMinfsBlockSize;
+        mx_status_t status;
+        if ((status = fs_->bc_->Readblks(e->bno, 1, data)) != MX_OK) {
+            return status;
+        }
+        const minfs_extent_node_t* node = reinterpret_cast<const minfs_extent_node_t*>(data);
+        if ((node->magic != kMinfsExtentNodeMagic) || (node->ino != ino) ||
+            (node->bno != e->bno) || (node->depth != depth - 1) ||
+            (node->count == 0) || (node->count > kMinfsExtentsPerNode) ||
+            (node->entries[0].start != e->start)) {
+            FS_TRACE_WARN("check: ino#%u: extent node %u(@%u): bad header\n",
+                          ino, e->start, e->bno);
+            Nonconforming(args);
+            return MX_OK;
+        }
+        uint64_t next = (i + 1 < count) ? entries[i + 1].start : end;
+        if ((status = WalkExtents(args, ino, node->entries, node->count, depth - 1, next,
+                                  buffer, out)) != MX_OK) {
+            return status;
         }
+        prev_end = next;
     }
+    return MX_OK;
+}
 
-    // count and sanity-check data blocks
+mx_status_t MinfsChecker::ScanInodes(ScanArgs* args) {
+    AllocChecker ac;
+    mxtl::unique_ptr<uint8_t[]> buffer(new (&ac) uint8_t[kMinfsExtentDepthMax * kMinfsBlockSize]);
+    if (!ac.check()) {
+        return MX_ERR_NO_MEMORY;
+    }
 
-    unsigned blocks_allocated = 0;
-    for (unsigned n = 0;; n++) {
+    for (uint32_t ino = args->ino_start; ino < args->ino_end; ino++) {
+        if (!fs_->inode_map_.Get(ino, ino + 1)) {
+            continue;
+        }
+        // Inodes with a bad magic are left for the check of the tree.
+        minfs_inode_t inode;
+        CopyInode(&inode, ino);
+        if ((inode.magic != kMinfsMagicFile) && (inode.magic != kMinfsMagicDir)) {
+            continue;
+        }
         mx_status_t status;
-        uint32_t bno;
-        if ((status = GetInodeNthBno(inode, n, &bno)) < 0) {
-            if (status == MX_ERR_OUT_OF_RANGE) {
-                break;
-            } else {
-                return status;
-            }
+        FileBlocks* fb = &file_blocks_[ino];
+        if ((status = WalkFile(args, &inode, ino, buffer.get(), fb)) != MX_OK) {
+            return status;
         }
-        if (bno) {
-            blocks++;
-            const char* msg;
-            if ((msg = CheckDataBlock(bno)) != nullptr) {
-               FS_TRACE_WARN("check: ino#%u: block %u(@%u): %s\n", ino, n, bno, msg);
-                conforming_ = false;
+        fb->scanned = true;
+    }
+    return MX_OK;
+}
+
+int MinfsChecker::ScanThread(void* arg) {
+    ScanArgs* args = static_cast<ScanArgs*>(arg);
+    args->status = args->chk->ScanInodes(args);
+    return 0;
+}
+
+mx_status_t MinfsChecker::ScanBlocks() {
+    uint32_t inode_count = fs_->info_.inode_count;
+    uint32_t block_count = fs_->info_.block_count;
+    uint32_t threads = mxtl::max(1u, mxtl::min(mx_system_get_num_cpus(), kScanThreadsMax));
+    uint32_t per_thread = (inode_count + threads - 1) / threads;
+
+    AllocChecker ac;
+    mxtl::unique_ptr<ScanArgs[]> args(new (&ac) ScanArgs[threads]);
+    if (!ac.check()) {
+        return MX_ERR_NO_MEMORY;
+    }
+    mx_status_t status;
+    for (uint32_t t = 0; t < threads; t++) {
+        args[t].chk = this;
+        args[t].ino_start = mxtl::max(1u, t * per_thread);
+        args[t].ino_end = mxtl::min(inode_count, (t + 1) * per_thread);
+        args[t].conforming = true;
+        args[t].status = MX_OK;
+        if ((status = args[t].blocks.Reset(block_count)) != MX_OK) {
+            return status;
+        }
+    }
+
+    // A thread which can't be started has its share scanned here instead.
+    thrd_t tids[kScanThreadsMax];
+    bool started[kScanThreadsMax];
+    for (uint32_t t = 0; t < threads; t++) {
+        started[t] = (thrd_create(&tids[t], ScanThread, &args[t]) == thrd_success);
+        if (!started[t]) {
+            ScanThread(&args[t]);
+        }
+    }
+    for (uint32_t t = 0; t < threads; t++) {
+        if (started[t]) {
+            thrd_join(tids[t], nullptr);
+        }
+    }
+
+    for (uint32_t t = 0; t < threads; t++) {
+        if (args[t].status != MX_OK) {
+            return args[t].status;
+        }
+        conforming_ &= args[t].conforming;
+
+        size_t n = fs_->info_.dat_block;
+        while ((n = args[t].blocks.Scan(n, block_count, false)) < block_count) {
+            size_t end = args[t].blocks.Scan(n, block_count, true);
+            for (; n < end; n++) {
+                if (checked_blocks_.Get(n, n + 1)) {
+                    FS_TRACE_WARN("check: block %zu: double-allocated\n", n);
+                    conforming_ = false;
+                    continue;
+                }
+                checked_blocks_.Set(n, n + 1);
+                alloc_blocks_++;
             }
-            blocks_allocated = n + 1;
         }
     }
+    return MX_OK;
+}
+
+mx_status_t MinfsChecker::CheckFile(minfs_inode_t* inode, uint32_t ino) {
+    FS_TRACE_INFO("Extents: \n");
+    for (unsigned n = 0; n < mxtl::min(inode->extent_count, kMinfsInlineExtents); n++) {
+        FS_TRACE_INFO(" %u+%u(@%u),", inode->extents[n].start, inode->extents[n].count,
+                      inode->extents[n].bno);
+    }
+    FS_TRACE_INFO(" ...\n");
+
+    // Inodes which aren't marked in-use were skipped by the scan.
+    FileBlocks fb = file_blocks_[ino];
+    if (!fb.scanned) {
+        mx_status_t status;
+        if ((status = WalkFile(nullptr, inode, ino, walk_buffer_.get(), &fb)) != MX_OK) {
+            return status;
+        }
+    }
+    return CheckFileCounts(inode, ino, fb.blocks, fb.blocks_allocated);
+}
+
+mx_status_t MinfsChecker::CheckFileCounts(minfs_inode_t* inode, uint32_t ino, uint32_t blocks,
+                                          unsigned blocks_allocated) {
     if (blocks_allocated) {
         unsigned max_blocks = mxtl::roundup(inode->size, kMinfsBlockSize) / kMinfsBlockSize;
+        if ((inode->magic == kMinfsMagicDir) && (inode->dir_index_blocks != 0)) {
+            // The index lies past where the directory could ever reach
+            max_blocks = kMinfsDirIndexStart + inode->dir_index_blocks;
+        }
         if (blocks_allocated > max_blocks) {
            FS_TRACE_WARN("check: ino#%u: filesize too small\n", ino);
             conforming_ = false;
@@ -316,6 +570,9 @@ mx_status_t MinfsChecker::CheckInode(uint32_t ino, uint32_t parent, bool dot_or_
         if ((status = CheckDirectory(&inode, ino, parent, CD_DUMP)) < 0) {
             return status;
         }
+        if ((status = CheckDirIndex(&inode, ino)) < 0) {
+            return status;
+        }
         if ((status = CheckDirectory(&inode, ino, parent, CD_RECURSE)) < 0) {
             return status;
         }
@@ -401,6 +658,7 @@ MinfsChecker::MinfsChecker()
 mx_status_t MinfsChecker::Init(mxtl::unique_ptr<Bcache> bc, const minfs_info_t* info) {
     links_.reset(new int32_t[info->inode_count]{0}, info->inode_count);
     links_[0] = -1;
+    file_blocks_.reset(new FileBlocks[info->inode_count](), info->inode_count);
 
     mx_status_t status;
     if ((status = checked_inodes_.Reset(info->inode_count)) < 0) {
@@ -414,10 +672,16 @@ mx_status_t MinfsChecker::Init(mxtl::unique_ptr<Bcache> bc, const minfs_info_t*
         return status;
     }
     fs_.reset(fs);
+
+    AllocChecker ac;
+    walk_buffer_.reset(new (&ac) uint8_t[kMinfsExtentDepthMax * kMinfsBlockSize]);
+    if (!ac.check()) {
+        return MX_ERR_NO_MEMORY;
+    }
     return MX_OK;
 }
 
-mx_status_t minfs_check(mxtl::unique_ptr<Bcache> bc) {
+mx_status_t minfs_check(mxtl::unique_ptr<Bcache> bc, bool incremental) {
     mx_status_t status;
 
     char data[kMinfsBlockSize];
@@ -431,10 +695,28 @@ mx_status_t minfs_check(mxtl::unique_ptr<Bcache> bc) {
         return -1;
     }
 
+    if (incremental) {
+        // Mounting clears the mark through the journal, so it must be
+        // replayed before the mark can be trusted.
+        if ((status = minfs_journal_replay(bc.get(), info)) != MX_OK) {
+            return status;
+        }
+        if ((status = bc->Readblk(0, data)) != MX_OK) {
+            return status;
+        }
+        if (info->flags & kMinfsFlagClean) {
+            FS_TRACE_INFO("check: filesystem was unmounted cleanly\n");
+            return MX_OK;
+        }
+    }
+
     MinfsChecker chk;
     if ((status = chk.Init(mxtl::move(bc), info)) != MX_OK) {
         return status;
     }
+    if ((status = chk.ScanBlocks()) != MX_OK) {
+        return status;
+    }
 
     //TODO: check root not a directory
     if ((status = chk.CheckInode(1, 1, 0)) < 0) {
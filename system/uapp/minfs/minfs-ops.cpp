@@ -18,6 +18,7 @@
 #ifdef __Fuchsia__
 #include <magenta/syscalls.h>
 #include <mxio/vfs.h>
+#include <mxtl/auto_lock.h>
 #endif
 
 #include "minfs-private.h"
@@ -32,11 +33,36 @@ mx_time_t minfs_gettime_utc() {
     return time;
 }
 
+#ifdef __Fuchsia__
+
+// Sets in |to| the bits set in |from|, which is no larger.
+void CopyRuns(const bitmap::RawBitmapGeneric<bitmap::DefaultStorage>& from,
+              bitmap::RawBitmapGeneric<bitmap::DefaultStorage>* to) {
+    for (size_t off = 0; off < from.size();) {
+        size_t start = from.Scan(off, from.size(), false);
+        off = from.Scan(start, from.size(), true);
+        if (start < off) {
+            to->Set(start, off);
+        }
+    }
+}
+
+#endif
+
 } // namespace anonymous
 
 namespace minfs {
 
 #ifdef __Fuchsia__
+size_t VnodeMinfs::VmoSizeFor(size_t size) const {
+    size = mxtl::roundup(size, kMinfsBlockSize);
+    if (IsDirectory() && (inode_.dir_index_blocks != 0)) {
+        size = static_cast<size_t>(kMinfsDirIndexStart + inode_.dir_index_blocks) *
+               kMinfsBlockSize;
+    }
+    return size;
+}
+
 mx_status_t VnodeMinfs::VmoReadExact(void* data, uint64_t offset, size_t len) {
     size_t actual;
     mx_status_t status = vmo_.read(data, offset, len, &actual);
@@ -80,82 +106,17 @@ void VnodeMinfs::InodeSync(WriteTxn* txn, uint32_t flags) {
 // Delete all blocks (relative to a file) from "start" (inclusive) to the end of
 // the file. Does not update mtime/atime.
 mx_status_t VnodeMinfs::BlocksShrink(WriteTxn *txn, uint32_t start) {
-    bool doSync = false;
-
-    // release direct blocks
-    for (unsigned bno = start; bno < kMinfsDirect; bno++) {
-        if (inode_.dnum[bno] == 0) {
-            continue;
-        }
-        fs_->BlockFree(txn, inode_.dnum[bno]);
-        inode_.dnum[bno] = 0;
-        inode_.block_count--;
-        doSync = true;
-    }
-
-    const unsigned direct_per_indirect = kMinfsBlockSize / sizeof(uint32_t);
-
-    // release indirect blocks
-    for (unsigned indirect = 0; indirect < kMinfsIndirect; indirect++) {
-        if (inode_.inum[indirect] == 0) {
-            continue;
-        }
-        fs_->ValidateBno(inode_.inum[indirect]);
-        unsigned bno = kMinfsDirect + (indirect + 1) * direct_per_indirect;
-        if (start > bno) {
-            continue;
-        }
 #ifdef __Fuchsia__
-        MX_DEBUG_ASSERT(vmo_indirect_ != nullptr);
-        uintptr_t iaddr = reinterpret_cast<uintptr_t>(vmo_indirect_->GetData());
-        uint32_t* entry = reinterpret_cast<uint32_t*>(iaddr + kMinfsBlockSize * indirect);
-#else
-        uint8_t idata[kMinfsBlockSize];
-        fs_->bc_->Readblk(inode_.inum[indirect], idata);
-        uint32_t* entry = reinterpret_cast<uint32_t*>(idata);
+    // Nothing may be written to the blocks once they're freed
+    fs_->DiscardDirty(this, start);
 #endif
-        bool dirty = false;
-        bool delete_indirect = true; // can we delete the indirect block?
-        // release the blocks pointed at by the entries in the indirect block
-        for (unsigned direct = 0; direct < direct_per_indirect; direct++) {
-            if (entry[direct] == 0) {
-                continue;
-            }
-            fs_->ValidateBno(entry[direct]);
-            unsigned bno = kMinfsDirect + indirect * direct_per_indirect + direct;
-            if (start > bno) {
-                // This is a valid entry which exists in the indirect block
-                // BEFORE our truncation point. Don't delete it, and don't
-                // delete the indirect block.
-                delete_indirect = false;
-                continue;
-            }
 
-            fs_->BlockFree(txn, entry[direct]);
-            entry[direct] = 0;
-            dirty = true;
-            inode_.block_count--;
-        }
-        // only update the indirect block if an entry was deleted
-        if (dirty) {
-            doSync = true;
-#ifdef __Fuchsia__
-            txn->Enqueue(vmoid_indirect_, indirect, inode_.inum[indirect], 1);
-#else
-            fs_->bc_->Writeblk(inode_.inum[indirect], entry);
-#endif
-        }
-
-        if (delete_indirect)  {
-            // release the direct block itself
-            fs_->BlockFree(txn, inode_.inum[indirect]);
-            inode_.inum[indirect] = 0;
-            inode_.block_count--;
-            doSync = true;
-        }
+    uint32_t block_count = inode_.block_count;
+    mx_status_t status;
+    if ((status = ExtentTruncate(txn, start)) != MX_OK) {
+        return status;
     }
-
-    if (doSync) {
+    if (inode_.block_count != block_count) {
         InodeSync(txn, kMxFsSyncDefault);
     }
     return MX_OK;
@@ -163,48 +124,17 @@ mx_status_t VnodeMinfs::BlocksShrink(WriteTxn *txn, uint32_t start) {
 
 #ifdef __Fuchsia__
 
-mx_status_t VnodeMinfs::InitIndirectVmo() {
-    if (vmo_indirect_ != nullptr) {
-        return MX_OK;
-    }
-
-    constexpr size_t size = kMinfsBlockSize * kMinfsIndirect;
-    mx_status_t status;
-    if ((status = MappedVmo::Create(size, "minfs-indirect", &vmo_indirect_)) != MX_OK) {
-        return status;
-    }
-    if ((status = fs_->bc_->AttachVmo(vmo_indirect_->GetVmo(),
-                                      &vmoid_indirect_)) != MX_OK) {
-        vmo_indirect_ = nullptr;
-        return status;
-    }
-
-    ReadTxn txn(fs_->bc_.get());
-    for (uint32_t i = 0; i < kMinfsIndirect; i++) {
-        uint32_t ibno;
-        if ((ibno = inode_.inum[i]) != 0) {
-            fs_->ValidateBno(ibno);
-            txn.Enqueue(vmoid_indirect_, i, ibno, 1);
-        }
-    }
-    return txn.Flush();
-}
-
 // Since we cannot yet register the filesystem as a paging service (and cleanly
 // fault on pages when they are actually needed), we currently read an entire
-// file to a VMO when a file's data block are accessed.
-//
-// TODO(smklein): Even this hack can be optimized; a bitmap could be used to
-// track all 'empty/read/dirty' blocks for each vnode, rather than reading
-// the entire file.
+// directory to a VMO when its data blocks are accessed. Files get an empty
+// VMO, which their blocks are read into as they're used.
 mx_status_t VnodeMinfs::InitVmo() {
     if (vmo_.is_valid()) {
         return MX_OK;
     }
 
     mx_status_t status;
-    if ((status = mx::vmo::create(mxtl::roundup(inode_.size, kMinfsBlockSize),
-                                  0, &vmo_)) != MX_OK) {
+    if ((status = mx::vmo::create(VmoSizeFor(inode_.size), 0, &vmo_)) != MX_OK) {
         FS_TRACE_ERROR("Failed to initialize vmo; error: %d\n", status);
         return status;
     }
@@ -215,146 +145,210 @@ mx_status_t VnodeMinfs::InitVmo() {
         vmo_.reset();
         return status;
     }
-    ReadTxn txn(fs_->bc_.get());
 
-    // Initialize all direct blocks
-    uint32_t bno;
-    for (uint32_t d = 0; d < kMinfsDirect; d++) {
-        if ((bno = inode_.dnum[d]) != 0) {
-            fs_->ValidateBno(bno);
-            txn.Enqueue(vmoid_, d, bno, 1);
+    uint32_t blocks = static_cast<uint32_t>(mxtl::roundup(inode_.size, kMinfsBlockSize) /
+                                            kMinfsBlockSize);
+    if (!IsDirectory()) {
+        if ((status = GrowLoaded(blocks)) != MX_OK) {
+            vmo_.reset();
         }
+        return status;
+    }
+    if ((status = fs_->RegisterMetadataVmo(vmoid_, vmo_.get())) != MX_OK) {
+        vmo_.reset();
+        return status;
     }
 
-    // Initialize all indirect blocks
-    for (uint32_t i = 0; i < kMinfsIndirect; i++) {
-        uint32_t ibno;
-        if ((ibno = inode_.inum[i]) != 0) {
-            fs_->ValidateBno(ibno);
-
-            // Only initialize the indirect vmo if it is being used.
-            if ((status = InitIndirectVmo()) != MX_OK) {
-                vmo_.reset();
-                return status;
-            }
-
-            MX_DEBUG_ASSERT(vmo_indirect_ != nullptr);
-            uintptr_t iaddr = reinterpret_cast<uintptr_t>(vmo_indirect_->GetData());
-            uint32_t* ientry = reinterpret_cast<uint32_t*>(iaddr + kMinfsBlockSize * i);
-
-            constexpr uint32_t direct_per_indirect = kMinfsBlockSize / sizeof(uint32_t);
-            for (uint32_t j = 0; j < direct_per_indirect; j++) {
-                if ((bno = ientry[j]) != 0) {
-                    fs_->ValidateBno(bno);
-                    uint32_t n = kMinfsDirect + i * direct_per_indirect + j;
-                    txn.Enqueue(vmoid_, n, bno, 1);
-                }
-            }
+    // Read in the directory an extent at a time, and its index after it
+    const uint32_t end = static_cast<uint32_t>(VmoSizeFor(inode_.size) / kMinfsBlockSize);
+    ReadTxn txn(fs_->bc_.get());
+    for (uint32_t n = 0; n < end;) {
+        if ((n == blocks) && (n < kMinfsDirIndexStart)) {
+            n = kMinfsDirIndexStart;
+            continue;
+        }
+        uint32_t bno, count;
+        if ((status = ExtentLookup(n, &bno, &count)) != MX_OK) {
+            fs_->UnregisterMetadataVmo(vmoid_);
+            vmo_.reset();
+            return status;
+        }
+        count = mxtl::min(count, ((n < blocks) ? blocks : end) - n);
+        if (bno != 0) {
+            fs_->ValidateBno(bno);
+            txn.Enqueue(vmoid_, n, bno, count);
         }
+        n += count;
     }
 
     return txn.Flush();
 }
-#endif
 
-// Get the bno corresponding to the nth logical block within the file.
-mx_status_t VnodeMinfs::GetBno(WriteTxn* txn, uint32_t n, uint32_t* bno) {
-    uint32_t hint = 0;
-    // direct blocks are simple... is there an entry in dnum[]?
-    if (n < kMinfsDirect) {
-        if (((*bno = inode_.dnum[n]) == 0) && (txn != nullptr)) {
-            mx_status_t status = fs_->BlockNew(txn, hint, bno);
-            if (status != MX_OK) {
-                return status;
-            }
-            inode_.dnum[n] = *bno;
-            inode_.block_count++;
-        }
-        fs_->ValidateBno(*bno);
+mx_status_t VnodeMinfs::GrowLoaded(uint32_t blocks) {
+    if (blocks <= loaded_.size()) {
         return MX_OK;
     }
 
-    // for indirect blocks, adjust past the direct blocks
-    n -= kMinfsDirect;
+    // Grown by half again at least, so that a file written in order isn't
+    // copied for every block it gains.
+    size_t size = mxtl::max(static_cast<size_t>(blocks), loaded_.size() + loaded_.size() / 2);
+    size = mxtl::min(size, static_cast<size_t>(kMinfsMaxFileBlock));
 
-    // determine indices into the indirect block list and into
-    // the block list in the indirect block
-    uint32_t i = static_cast<uint32_t>(n / (kMinfsBlockSize / sizeof(uint32_t)));
-    uint32_t j = n % (kMinfsBlockSize / sizeof(uint32_t));
+    // The bitmap can only be resized empty, so what's loaded is set aside
+    // while it is.
+    bitmap::RawBitmapGeneric<bitmap::DefaultStorage> old;
+    mx_status_t status;
+    if ((status = old.Reset(loaded_.size())) != MX_OK) {
+        return status;
+    }
+    CopyRuns(loaded_, &old);
+    if (((status = loaded_.Reset(size)) != MX_OK) && (loaded_.Reset(old.size()) != MX_OK)) {
+        // Should blocks newer in the VMO be read in again, they'd be lost
+        FS_TRACE_ERROR("minfs: lost track of the loaded blocks of vnode #%u\n", ino_);
+        return status;
+    }
+    CopyRuns(old, &loaded_);
+    return status;
+}
 
-    if (i >= kMinfsIndirect) {
-        return MX_ERR_OUT_OF_RANGE;
+mx_status_t VnodeMinfs::LoadBlocks(uint32_t start, uint32_t end) {
+    size_t first;
+    if (loaded_.Get(start, end, &first)) {
+        return MX_OK;
     }
 
+    // Holes need no reading; their part of the VMO is still zero. Each run
+    // of an extent is read with one request, up to any block already loaded,
+    // whose copy in the VMO may be newer.
     mx_status_t status;
-#ifdef __Fuchsia__
-    // If the vmo_indirect_ vmo has not been created, make it now.
-    if ((status = InitIndirectVmo()) != MX_OK) {
+    ReadTxn txn(fs_->bc_.get());
+    for (uint32_t n = static_cast<uint32_t>(first); n < end;) {
+        if (loaded_.Get(n, n + 1)) {
+            n++;
+            continue;
+        }
+        uint32_t bno, count;
+        if ((status = ExtentLookup(n, &bno, &count)) != MX_OK) {
+            return status;
+        }
+        uint32_t stop = static_cast<uint32_t>(loaded_.Scan(n, mxtl::min(end, n + count), false));
+        if (bno != 0) {
+            fs_->ValidateBno(bno);
+            txn.Enqueue(vmoid_, n, bno, stop - n);
+        }
+        n = stop;
+    }
+    if ((status = txn.Flush()) != MX_OK) {
         return status;
     }
-#else
-    uint8_t idata[kMinfsBlockSize];
-#endif
+    return loaded_.Set(first, end);
+}
 
-    uint32_t ibno;
-    bool dirty = false;
+mx_status_t VnodeMinfs::ReadAhead(size_t off, size_t len) {
+    uint32_t start = static_cast<uint32_t>(off / kMinfsBlockSize);
+    uint32_t end = static_cast<uint32_t>((off + len + kMinfsBlockSize - 1) / kMinfsBlockSize);
 
-    // look up the indirect bno
-    if ((ibno = inode_.inum[i]) == 0) {
-        if (txn == nullptr) {
-            *bno = 0;
-            return MX_OK;
-        }
-        // allocate a new indirect block
-        if ((status = fs_->BlockNew(txn, hint, &ibno)) != MX_OK) {
+    // A read picking up where the last stopped (or in the block it stopped
+    // in) doubles the window; anything else closes it.
+    uint32_t max = fs_->ReadaheadMax();
+    if ((start == ra_next_) || (start + 1 == ra_next_)) {
+        ra_window_ = mxtl::min(mxtl::max(ra_window_ * 2, kMinfsReadaheadMin), max);
+    } else {
+        ra_window_ = 0;
+    }
+    ra_next_ = end;
+
+    uint32_t hits = 0;
+    if ((start < ra_end_) && (end > ra_start_)) {
+        hits = mxtl::min(end, ra_end_) - mxtl::max(start, ra_start_);
+        ra_start_ = mxtl::min(end, ra_end_);
+    }
+
+    // Go back to the disk only when the reader has caught up with what was
+    // read ahead, so that each trip reads a whole window.
+    uint32_t blocks = static_cast<uint32_t>(mxtl::roundup(inode_.size, kMinfsBlockSize) /
+                                            kMinfsBlockSize);
+    uint32_t ahead = mxtl::min(end + ra_window_, blocks);
+    if ((end < ahead) && !loaded_.Get(end, end + 1)) {
+        size_t first;
+        loaded_.Get(end, ahead, &first);
+        mx_status_t status;
+        if ((status = LoadBlocks(start, ahead)) != MX_OK) {
             return status;
         }
-#ifdef __Fuchsia__
-        MX_DEBUG_ASSERT(vmo_indirect_ != nullptr);
-        uintptr_t iaddr = reinterpret_cast<uintptr_t>(vmo_indirect_->GetData());
-        memset(reinterpret_cast<void*>(iaddr + kMinfsBlockSize * i), 0, kMinfsBlockSize);
-#else
-        memset(idata, 0, kMinfsBlockSize);
-        fs_->bc_->Writeblk(ibno, idata);
+        ra_start_ = static_cast<uint32_t>(first);
+        ra_end_ = ahead;
+        fs_->CountReadahead(ahead - static_cast<uint32_t>(first), hits);
+        return MX_OK;
+    }
+    fs_->CountReadahead(0, hits);
+    return LoadBlocks(start, end);
+}
 #endif
 
-        // record new indirect block in inode, note that we need to update
-        inode_.block_count++;
-        inode_.inum[i] = ibno;
-        dirty = true;
+// Get the bno corresponding to the nth logical block within the file.
+mx_status_t VnodeMinfs::GetBno(WriteTxn* txn, uint32_t n, uint32_t* bno) {
+    if (n >= kMinfsMaxFileBlock) {
+        return MX_ERR_OUT_OF_RANGE;
     }
-#ifdef __Fuchsia__
-    MX_DEBUG_ASSERT(vmo_indirect_ != nullptr);
-    uintptr_t iaddr = reinterpret_cast<uintptr_t>(vmo_indirect_->GetData());
-    uint32_t* ientry = reinterpret_cast<uint32_t*>(iaddr + kMinfsBlockSize * i);
-#else
-    fs_->bc_->Readblk(ibno, idata);
-    uint32_t* ientry = reinterpret_cast<uint32_t*>(idata);
-#endif
 
-    if (((*bno = ientry[j]) == 0) && (txn != nullptr)) {
-        // allocate a new block
-        status = fs_->BlockNew(txn, hint, bno);
-        if (status != MX_OK) {
+    mx_status_t status;
+    uint32_t count;
+    if ((status = ExtentLookup(n, bno, &count)) != MX_OK) {
+        return status;
+    }
+    if ((*bno == 0) && (txn != nullptr)) {
+        if (((status = MapBlocks(txn, n, n + 1)) != MX_OK) ||
+            ((status = ExtentLookup(n, bno, &count)) != MX_OK)) {
             return status;
         }
-        inode_.block_count++;
-        ientry[j] = *bno;
+    }
+    if (*bno != 0) {
+        fs_->ValidateBno(*bno);
+    }
+    return MX_OK;
+}
+
+// New runs are placed after the block before them in the file where there's
+// room, so that files which grow in order are laid out in long runs, and map
+// with few extents. The first run of a file goes where DataHint says.
+mx_status_t VnodeMinfs::MapBlocks(WriteTxn* txn, uint32_t start, uint32_t end) {
+    end = mxtl::min(end, static_cast<uint32_t>(kMinfsMaxFileBlock));
+    mx_status_t status = MX_OK;
+    bool dirty = false;
+    for (uint32_t n = start; n < end;) {
+        uint32_t bno, count;
+        if ((status = ExtentLookup(n, &bno, &count)) != MX_OK) {
+            break;
+        }
+        count = mxtl::min(count, end - n);
+        if (bno != 0) {
+            n += count;
+            continue;
+        }
+
+        uint32_t hint = fs_->DataHint(ino_);
+        uint32_t prev, unused;
+        if ((n > 0) && (ExtentLookup(n - 1, &prev, &unused) == MX_OK) && (prev != 0)) {
+            hint = prev + 1;
+        }
+        if ((status = fs_->BlockNew(txn, hint, count, &bno, &count)) != MX_OK) {
+            break;
+        }
+        inode_.block_count += count;
+        if ((status = ExtentInsert(txn, n, bno, count)) != MX_OK) {
+            fs_->BlockFree(txn, bno, count);
+            inode_.block_count -= count;
+            break;
+        }
         dirty = true;
+        n += count;
     }
 
     if (dirty) {
-        // Write back the indirect block if requested
-#ifdef __Fuchsia__
-        txn->Enqueue(vmoid_indirect_, i, ibno, 1);
-#else
-        fs_->bc_->Writeblk(ibno, ientry);
-#endif
         InodeSync(txn, kMxFsSyncDefault);
     }
-
-    fs_->ValidateBno(*bno);
-    return MX_OK;
+    return status;
 }
 
 // Immediately stop iterating over the directory.
@@ -425,6 +419,355 @@ static mx_status_t cb_dir_find(mxtl::RefPtr<VnodeMinfs> vndir, minfs_dirent_t* d
     }
 }
 
+static mx_status_t cb_dir_cache(mxtl::RefPtr<VnodeMinfs> vndir, minfs_dirent_t* de,
+                                DirArgs* args, DirectoryOffset* offs) {
+    if (de->ino != 0) {
+        vndir->DirCacheAdd(de->name, de->namelen, offs->off);
+    }
+    return do_next_dirent(de, offs);
+}
+
+mx_status_t VnodeMinfs::BuildDirCache() {
+    // Indexing visits each dirent in turn, adding it as it goes
+    dir_cached_ = true;
+    DirArgs args = DirArgs();
+    mx_status_t status = ForEachDirent(&args, cb_dir_cache);
+    if (status != MX_ERR_NOT_FOUND) {
+        DropDirCache();
+        return (status == MX_OK) ? MX_ERR_BAD_STATE : status;
+    } else if (dir_cache_disabled_) {
+        return MX_ERR_BAD_STATE;
+    }
+    return MX_OK;
+}
+
+void VnodeMinfs::DropDirCache() {
+    dir_cache_.reset();
+    dir_cached_ = false;
+    dir_cache_disabled_ = true;
+}
+
+void VnodeMinfs::DirCacheAdd(const char* name, size_t len, size_t off) {
+    if (!dir_cached_) {
+        return;
+    }
+    // Fails if the name's hash is taken, or the index can't grow
+    if (!dir_cache_.insert_or_find(fnv1a64(name, len), static_cast<uint32_t>(off))) {
+        DropDirCache();
+    }
+}
+
+void VnodeMinfs::DirCacheRemove(const char* name, size_t len) {
+    if (dir_cached_) {
+        dir_cache_.erase(fnv1a64(name, len));
+    }
+}
+
+mx_status_t VnodeMinfs::DirIndexRead(uint32_t bucket, minfs_dir_bucket_t* data) {
+    const uint32_t n = kMinfsDirIndexStart + bucket;
+    mx_status_t status;
+#ifdef __Fuchsia__
+    if ((status = InitVmo()) != MX_OK) {
+        return status;
+    } else if ((status = VmoReadExact(data, static_cast<uint64_t>(n) * kMinfsBlockSize,
+                                      kMinfsBlockSize)) != MX_OK) {
+        return status;
+    }
+#else
+    uint32_t bno;
+    if ((status = GetBno(nullptr, n, &bno)) != MX_OK) {
+        return status;
+    } else if ((bno == 0) || fs_->bc_->Readblk(bno, data)) {
+        return MX_ERR_IO;
+    }
+#endif
+    if ((data->magic != kMinfsDirBucketMagic) || (data->ino != ino_) ||
+        (data->count > kMinfsDirBucketEntries)) {
+        FS_TRACE_ERROR("minfs: bad bucket %u in the index of directory #%u\n", bucket, ino_);
+        return MX_ERR_IO;
+    }
+    return MX_OK;
+}
+
+mx_status_t VnodeMinfs::DirIndexWrite(WriteTxn* txn, uint32_t bucket,
+                                      const minfs_dir_bucket_t* data) {
+    const uint32_t n = kMinfsDirIndexStart + bucket;
+    uint32_t bno;
+    mx_status_t status;
+    if ((status = GetBno(txn, n, &bno)) != MX_OK) {
+        return status;
+    }
+    assert(bno != 0);
+#ifdef __Fuchsia__
+    if ((status = VmoWriteExact(data, static_cast<uint64_t>(n) * kMinfsBlockSize,
+                                kMinfsBlockSize)) != MX_OK) {
+        return status;
+    }
+    txn->Enqueue(vmoid_, n, bno, 1);
+#else
+    if (fs_->bc_->Writeblk(bno, data)) {
+        return MX_ERR_IO;
+    }
+#endif
+    return MX_OK;
+}
+
+static mx_status_t cb_dir_index(mxtl::RefPtr<VnodeMinfs> vndir, minfs_dirent_t* de,
+                                DirArgs* args, DirectoryOffset* offs) {
+    if (de->ino != 0) {
+        uint32_t hash = MinfsDirHash(de->name, de->namelen);
+        uint32_t b = MinfsDirBucket(hash, vndir->inode_.dir_index_blocks);
+        minfs_dir_bucket_t* bucket = reinterpret_cast<minfs_dir_bucket_t*>(
+            args->buckets + static_cast<size_t>(b) * kMinfsBlockSize);
+        if (bucket->count == kMinfsDirBucketEntries) {
+            return MX_ERR_NO_RESOURCES;
+        }
+        bucket->entries[bucket->count].hash = hash;
+        bucket->entries[bucket->count].off = static_cast<uint32_t>(offs->off);
+        bucket->count++;
+    }
+    return do_next_dirent(de, offs);
+}
+
+mx_status_t VnodeMinfs::DirIndexBuild(WriteTxn* txn) {
+    // Buckets start out as full as the index gets before it splits
+    uint32_t blocks = mxtl::max(1u, (inode_.dirent_count + kMinfsDirIndexSplitLoad - 1) /
+                                    kMinfsDirIndexSplitLoad);
+    if (blocks > kMinfsDirIndexMaxBlocks) {
+        return MX_ERR_NO_RESOURCES;
+    }
+
+    AllocChecker ac;
+    mxtl::unique_ptr<uint8_t[]> buf(new (&ac) uint8_t[blocks * kMinfsBlockSize]);
+    if (!ac.check()) {
+        return MX_ERR_NO_MEMORY;
+    }
+    memset(buf.get(), 0, blocks * kMinfsBlockSize);
+    for (uint32_t b = 0; b < blocks; b++) {
+        minfs_dir_bucket_t* bucket = reinterpret_cast<minfs_dir_bucket_t*>(
+            buf.get() + static_cast<size_t>(b) * kMinfsBlockSize);
+        bucket->magic = kMinfsDirBucketMagic;
+        bucket->ino = ino_;
+    }
+
+    // Nothing is written until every dirent has found room in a bucket
+    inode_.dir_index_blocks = blocks;
+    DirArgs args = DirArgs();
+    args.buckets = buf.get();
+    mx_status_t status = ForEachDirent(&args, cb_dir_index);
+    if (status != MX_ERR_NOT_FOUND) {
+        inode_.dir_index_blocks = 0;
+        return (status == MX_OK) ? MX_ERR_BAD_STATE : status;
+    }
+
+#ifdef __Fuchsia__
+    if ((status = vmo_.set_size(VmoSizeFor(inode_.size))) != MX_OK) {
+        inode_.dir_index_blocks = 0;
+        return status;
+    }
+#endif
+    for (uint32_t b = 0; b < blocks; b++) {
+        const minfs_dir_bucket_t* bucket = reinterpret_cast<const minfs_dir_bucket_t*>(
+            buf.get() + static_cast<size_t>(b) * kMinfsBlockSize);
+        if ((status = DirIndexWrite(txn, b, bucket)) != MX_OK) {
+            DirIndexDrop(txn);
+            return status;
+        }
+    }
+    return MX_OK;
+}
+
+void VnodeMinfs::DirIndexDrop(WriteTxn* txn) {
+    inode_.dir_index_blocks = 0;
+    // Buckets that can't be freed are left mapped, for fsck to find
+    BlocksShrink(txn, kMinfsDirIndexStart);
+#ifdef __Fuchsia__
+    vmo_.set_size(VmoSizeFor(inode_.size));
+#endif
+}
+
+mx_status_t VnodeMinfs::DirIndexSplit(WriteTxn* txn) {
+    const uint32_t blocks = inode_.dir_index_blocks;
+    uint32_t level = 1;
+    while (level <= blocks / 2) {
+        level *= 2;
+    }
+    const uint32_t from = blocks - level;
+
+    AllocChecker ac;
+    mxtl::unique_ptr<uint8_t[]> buf(new (&ac) uint8_t[2 * kMinfsBlockSize]);
+    if (!ac.check()) {
+        return MX_ERR_NO_MEMORY;
+    }
+    minfs_dir_bucket_t* old = reinterpret_cast<minfs_dir_bucket_t*>(buf.get());
+    minfs_dir_bucket_t* split = reinterpret_cast<minfs_dir_bucket_t*>(buf.get() +
+                                                                      kMinfsBlockSize);
+    mx_status_t status;
+    if ((status = DirIndexRead(from, old)) != MX_OK) {
+        return status;
+    }
+    memset(split, 0, kMinfsBlockSize);
+    split->magic = kMinfsDirBucketMagic;
+    split->ino = ino_;
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < old->count; i++) {
+        if (MinfsDirBucket(old->entries[i].hash, blocks + 1) == blocks) {
+            split->entries[split->count++] = old->entries[i];
+        } else {
+            old->entries[kept++] = old->entries[i];
+        }
+    }
+    old->count = kept;
+
+    // The new bucket is written before the index is taken to include it
+    inode_.dir_index_blocks = blocks + 1;
+#ifdef __Fuchsia__
+    if ((status = vmo_.set_size(VmoSizeFor(inode_.size))) != MX_OK) {
+        inode_.dir_index_blocks = blocks;
+        return status;
+    }
+#endif
+    if (((status = DirIndexWrite(txn, blocks, split)) != MX_OK) ||
+        ((status = DirIndexWrite(txn, from, old)) != MX_OK)) {
+        inode_.dir_index_blocks = blocks;
+        return status;
+    }
+    return MX_OK;
+}
+
+void VnodeMinfs::DirIndexAdd(WriteTxn* txn, const char* name, size_t len, size_t off) {
+    if (inode_.dir_index_blocks == 0) {
+        return;
+    }
+
+    uint32_t hash = MinfsDirHash(name, len);
+    uint32_t b = MinfsDirBucket(hash, inode_.dir_index_blocks);
+    uint64_t data[kMinfsBlockSize / sizeof(uint64_t)];
+    minfs_dir_bucket_t* bucket = reinterpret_cast<minfs_dir_bucket_t*>(data);
+    mx_status_t status;
+    if (((status = DirIndexRead(b, bucket)) == MX_OK) &&
+        (bucket->count == kMinfsDirBucketEntries)) {
+        // Names that hash alike are left to scans
+        status = MX_ERR_NO_RESOURCES;
+    }
+    if (status == MX_OK) {
+        bucket->entries[bucket->count].hash = hash;
+        bucket->entries[bucket->count].off = static_cast<uint32_t>(off);
+        bucket->count++;
+        status = DirIndexWrite(txn, b, bucket);
+    }
+    if (status != MX_OK) {
+        DirIndexDrop(txn);
+        return;
+    }
+
+    // If there's no room for another bucket, the index just fills up further
+    if ((inode_.dirent_count > inode_.dir_index_blocks * kMinfsDirIndexSplitLoad) &&
+        (inode_.dir_index_blocks < kMinfsDirIndexMaxBlocks) &&
+        ((status = DirIndexSplit(txn)) != MX_OK) && (status != MX_ERR_NO_SPACE)) {
+        DirIndexDrop(txn);
+    }
+}
+
+void VnodeMinfs::DirIndexRemove(WriteTxn* txn, const char* name, size_t len, size_t off) {
+    if (inode_.dir_index_blocks == 0) {
+        return;
+    }
+
+    uint32_t hash = MinfsDirHash(name, len);
+    uint32_t b = MinfsDirBucket(hash, inode_.dir_index_blocks);
+    uint64_t data[kMinfsBlockSize / sizeof(uint64_t)];
+    minfs_dir_bucket_t* bucket = reinterpret_cast<minfs_dir_bucket_t*>(data);
+    mx_status_t status;
+    if ((status = DirIndexRead(b, bucket)) == MX_OK) {
+        status = MX_ERR_NOT_FOUND;
+        for (uint32_t i = 0; i < bucket->count; i++) {
+            if ((bucket->entries[i].hash == hash) && (bucket->entries[i].off == off)) {
+                bucket->entries[i] = bucket->entries[--bucket->count];
+                status = DirIndexWrite(txn, b, bucket);
+                break;
+            }
+        }
+        if (status == MX_ERR_NOT_FOUND) {
+            FS_TRACE_ERROR("minfs: directory #%u disagrees with its index\n", ino_);
+        }
+    }
+    if (status != MX_OK) {
+        DirIndexDrop(txn);
+    }
+}
+
+mx_status_t VnodeMinfs::DirIndexFind(const char* name, size_t len, minfs_dirent_t* de,
+                                     size_t* off) {
+    uint32_t hash = MinfsDirHash(name, len);
+    uint64_t data[kMinfsBlockSize / sizeof(uint64_t)];
+    minfs_dir_bucket_t* bucket = reinterpret_cast<minfs_dir_bucket_t*>(data);
+    mx_status_t status;
+    if ((status = DirIndexRead(MinfsDirBucket(hash, inode_.dir_index_blocks), bucket)) != MX_OK) {
+        return status;
+    }
+    for (uint32_t i = 0; i < bucket->count; i++) {
+        if (bucket->entries[i].hash != hash) {
+            continue;
+        }
+        size_t r;
+        size_t at = bucket->entries[i].off;
+        if ((status = ReadInternal(de, kMinfsMaxDirentSize, at, &r)) != MX_OK) {
+            return status;
+        } else if ((validate_dirent(de, r, at) != MX_OK) || (de->ino == 0)) {
+            FS_TRACE_ERROR("minfs: directory #%u disagrees with its index\n", ino_);
+            return MX_ERR_IO;
+        } else if ((de->namelen == len) && !memcmp(de->name, name, len)) {
+            *off = at;
+            return MX_OK;
+        }
+    }
+    return MX_ERR_NOT_FOUND;
+}
+
+mx_status_t VnodeMinfs::FindDirent(DirArgs* args) {
+    char data[kMinfsMaxDirentSize];
+    minfs_dirent_t* de = reinterpret_cast<minfs_dirent_t*>(data);
+    size_t off;
+    mx_status_t status;
+    if (inode_.dir_index_blocks != 0) {
+        // An index that can't be read, or is wrong, leaves the directory to
+        // be scanned
+        if ((status = DirIndexFind(args->name, args->len, de, &off)) == MX_OK) {
+            args->ino = de->ino;
+            args->type = de->type;
+        }
+        if ((status == MX_OK) || (status == MX_ERR_NOT_FOUND)) {
+            return status;
+        }
+        return ForEachDirent(args, cb_dir_find);
+    }
+
+    if (!dir_cached_ && (dir_cache_disabled_ || (inode_.size < kMinfsDirIndexMinSize) ||
+                         (BuildDirCache() != MX_OK))) {
+        return ForEachDirent(args, cb_dir_find);
+    }
+
+    const uint32_t* cached = dir_cache_.find(fnv1a64(args->name, args->len));
+    if (cached == nullptr) {
+        return MX_ERR_NOT_FOUND;
+    }
+
+    size_t r;
+    if ((status = ReadInternal(data, kMinfsMaxDirentSize, *cached, &r)) != MX_OK) {
+        return status;
+    } else if ((validate_dirent(de, r, *cached) == MX_OK) && (de->ino != 0) &&
+               (de->namelen == args->len) && !memcmp(de->name, args->name, args->len)) {
+        args->ino = de->ino;
+        args->type = de->type;
+        return MX_OK;
+    }
+
+    FS_TRACE_ERROR("minfs: directory #%u disagrees with its index\n", ino_);
+    DropDirCache();
+    return ForEachDirent(args, cb_dir_find);
+}
+
 bool VnodeMinfs::CanUnlink() const {
     // directories must be empty (dirent_count == 2)
     if (IsDirectory()) {
@@ -486,6 +829,7 @@ mx_status_t VnodeMinfs::UnlinkChild(WriteTxn* txn,
         // Should only be possible if the on-disk record format is corrupted
         return MX_ERR_IO;
     }
+    DirCacheRemove(de->name, de->namelen);
     de->ino = 0;
     de->reclen = static_cast<uint32_t>(coalesced_size & kMinfsReclenMask) |
         (de->reclen & kMinfsReclenLast);
@@ -493,10 +837,12 @@ mx_status_t VnodeMinfs::UnlinkChild(WriteTxn* txn,
     if ((status = WriteExactInternal(txn, de, MINFS_DIRENT_SIZE, off)) != MX_OK) {
         return status;
     }
+    DirIndexRemove(txn, de->name, de->namelen, offs->off);
 
-    if (de->reclen & kMinfsReclenLast) {
+    if ((de->reclen & kMinfsReclenLast) && (inode_.dir_index_blocks == 0)) {
         // Truncating the directory merely removed unused space; if it fails,
-        // the directory contents are still valid.
+        // the directory contents are still valid. Indexed directories keep
+        // their size, as their index would go with it.
         TruncateInternal(txn, off + MINFS_DIRENT_SIZE);
     }
 
@@ -524,6 +870,11 @@ void VnodeMinfs::RemoveInodeLink(WriteTxn* txn) {
     }
 
     InodeSync(txn, kMxFsSyncMtime);
+#ifdef __Fuchsia__
+    if (inode_.link_count == 0) {
+        fs_->VnodeCacheRemove(this);
+    }
+#endif
 }
 
 // caller is expected to prevent unlink of "." or ".."
@@ -635,17 +986,28 @@ static mx_status_t add_dirent(mxtl::RefPtr<VnodeMinfs> vndir,
     de->type = static_cast<uint8_t>(args->type);
     de->namelen = static_cast<uint8_t>(args->len);
     memcpy(de->name, args->name, args->len);
+    size_t size = vndir->inode_.size;
     mx_status_t status = vndir->WriteExactInternal(args->txn, de,
                                                    DirentSize(de->namelen),
                                                    off);
     if (status != MX_OK) {
         return status;
     }
+    vndir->DirCacheAdd(args->name, args->len, off);
     vndir->inode_.dirent_count++;
     if (args->type == kMinfsTypeDir) {
         // Child directory has '..' which will point to parent directory
         vndir->inode_.link_count++;
     }
+
+    if (vndir->inode_.dir_index_blocks != 0) {
+        vndir->DirIndexAdd(args->txn, args->name, args->len, off);
+    } else if ((size < kMinfsDirIndexMinSize) &&
+               (vndir->inode_.size >= kMinfsDirIndexMinSize)) {
+        // A directory growing big enough is indexed as it stands; if it
+        // can't be, it's scanned as before.
+        vndir->DirIndexBuild(args->txn);
+    }
     return DIR_CB_SAVE_SYNC;
 }
 
@@ -731,20 +1093,70 @@ mx_status_t VnodeMinfs::ForEachDirent(DirArgs* args, const DirentCallback func)
     return MX_ERR_NOT_FOUND;
 }
 
+mx_status_t VnodeMinfs::ForNamedDirent(DirArgs* args, const DirentCallback func) {
+    char data[kMinfsMaxDirentSize];
+    minfs_dirent_t* de = (minfs_dirent_t*) data;
+    DirectoryOffset offs;
+    mx_status_t status;
+    if ((inode_.dir_index_blocks == 0) ||
+        (((status = DirIndexFind(args->name, args->len, de, &offs.off)) != MX_OK) &&
+         (status != MX_ERR_NOT_FOUND))) {
+        return ForEachDirent(args, func);
+    } else if (status == MX_ERR_NOT_FOUND) {
+        return status;
+    }
+
+    // Without the dirent before this one at hand, it isn't coalesced with it
+    offs.off_prev = offs.off;
+    switch ((status = func(mxtl::RefPtr<VnodeMinfs>(this), de, args, &offs))) {
+    case DIR_CB_NEXT:
+        return MX_ERR_NOT_FOUND;
+    case DIR_CB_SAVE_SYNC:
+        inode_.seq_num++;
+        InodeSync(args->txn, kMxFsSyncMtime);
+        return MX_OK;
+    case DIR_CB_DONE:
+    default:
+        return status;
+    }
+}
+
+#ifdef __Fuchsia__
+size_t VnodeMinfs::CacheFootprint() const {
+    size_t bytes = sizeof(*this);
+    if (vmo_.is_valid()) {
+        bytes += static_cast<size_t>(inode_.block_count) * kMinfsBlockSize;
+    }
+    bytes += static_cast<size_t>(extent_slot_count_) * kMinfsBlockSize;
+    return bytes;
+}
+#endif
+
 VnodeMinfs::~VnodeMinfs() {
-    if (inode_.link_count == 0) {
 #ifdef __Fuchsia__
-        if (InitIndirectVmo() == MX_OK) {
-            fs_->InoFree(vmo_indirect_.get(), inode_, ino_);
-        }
-#else
-        fs_->InoFree(inode_, ino_);
+    // The cache can't outlive the vnode: write out what's still wanted.
+    if (inode_.link_count == 0) {
+        fs_->DiscardDirty(this, 0);
+    } else if ((WritebackMapped() != MX_OK) || (fs_->FlushDirty(this) != MX_OK)) {
+        FS_TRACE_ERROR("minfs: failed to write back vnode #%u\n", ino_);
+    }
 #endif
+    if (inode_.link_count == 0) {
+        // Blocks that can't be freed stay allocated, along with the inode
+        // still mapping them, for fsck to find.
+        WriteTxn txn(fs_->bc_.get());
+        if (BlocksShrink(&txn, 0) == MX_OK) {
+            fs_->InoFree(&txn, ino_);
+        }
     }
 
     fs_->VnodeRelease(this);
 #ifdef __Fuchsia__
+    ExtentsRelease();
     if (vmo_.is_valid()) {
+        if (IsDirectory()) {
+            fs_->UnregisterMetadataVmo(vmoid_);
+        }
         block_fifo_request_t request;
         request.txnid = fs_->bc_->TxnId();
         request.vmoid = vmoid_;
@@ -767,6 +1179,9 @@ ssize_t VnodeMinfs::Read(void* data, size_t len, size_t off) {
     if (IsDirectory()) {
         return MX_ERR_NOT_FILE;
     }
+#ifdef __Fuchsia__
+    mxtl::AutoLock lock(&read_lock_);
+#endif
     size_t r;
     mx_status_t status = ReadInternal(data, len, off, &r);
     if (status != MX_OK) {
@@ -790,6 +1205,8 @@ mx_status_t VnodeMinfs::ReadInternal(void* data, size_t len, size_t off, size_t*
 #ifdef __Fuchsia__
     if ((status = InitVmo()) != MX_OK) {
         return status;
+    } else if (!IsDirectory() && ((status = ReadAhead(off, len)) != MX_OK)) {
+        return status;
     } else if ((status = vmo_.read(data, off, len, actual)) != MX_OK) {
         return status;
     }
@@ -866,6 +1283,12 @@ mx_status_t VnodeMinfs::WriteInternal(WriteTxn* txn, const void* data,
     uint32_t n = static_cast<uint32_t>(off / kMinfsBlockSize);
     size_t adjust = off % kMinfsBlockSize;
 
+    // The holes in the range are mapped up front, so that they get runs as
+    // long as the allocator can find; should it run out of space, GetBno
+    // below fails at the first block left unmapped.
+    MapBlocks(txn, n, static_cast<uint32_t>(mxtl::min((off + len + kMinfsBlockSize - 1) /
+                                                      kMinfsBlockSize, kMinfsMaxFileBlock)));
+
     while ((len > 0) && (n < kMinfsMaxFileBlock)) {
         size_t xfer;
         if (len > (kMinfsBlockSize - adjust)) {
@@ -878,12 +1301,24 @@ mx_status_t VnodeMinfs::WriteInternal(WriteTxn* txn, const void* data,
         size_t xfer_off = n * kMinfsBlockSize + adjust;
         if ((xfer_off + xfer) > inode_.size) {
             size_t new_size = xfer_off + xfer;
-            if ((status = vmo_.set_size(mxtl::roundup(new_size, kMinfsBlockSize))) != MX_OK) {
+            if ((status = vmo_.set_size(VmoSizeFor(new_size))) != MX_OK) {
+                goto done;
+            }
+            if (!IsDirectory() && ((status = GrowLoaded(n + 1)) != MX_OK)) {
                 goto done;
             }
             inode_.size = static_cast<uint32_t>(new_size);
         }
 
+        // A partly written file block has to be read in first
+        if (!IsDirectory()) {
+            if (xfer == kMinfsBlockSize) {
+                loaded_.Set(n, n + 1);
+            } else if ((status = LoadBlocks(n, n + 1)) != MX_OK) {
+                return status;
+            }
+        }
+
         // Update this block of the in-memory VMO
         if ((status = VmoWriteExact(data, xfer_off, xfer)) != MX_OK) {
             return MX_ERR_IO;
@@ -895,7 +1330,11 @@ mx_status_t VnodeMinfs::WriteInternal(WriteTxn* txn, const void* data,
             return status;
         }
         assert(bno != 0);
-        txn->Enqueue(vmoid_, n, bno, 1);
+        if (IsDirectory()) {
+            txn->Enqueue(vmoid_, n, bno, 1);
+        } else if ((status = fs_->MarkDirty(this, n, bno)) != MX_OK) {
+            return status;
+        }
 #else
         uint32_t bno;
         if ((status = GetBno(txn, n, &bno)) != MX_OK) {
@@ -961,7 +1400,7 @@ mx_status_t VnodeMinfs::LookupInternal(mxtl::RefPtr<fs::Vnode>* out,
     args.name = name;
     args.len = len;
     mx_status_t status;
-    if ((status = ForEachDirent(&args, cb_dir_find)) < 0) {
+    if ((status = FindDirent(&args)) < 0) {
         return status;
     }
     mxtl::RefPtr<VnodeMinfs> vn;
@@ -1083,9 +1522,10 @@ fail:
 
 #ifdef __Fuchsia__
 VnodeMinfs::VnodeMinfs(Minfs* fs) :
-    fs_(fs), vmo_(MX_HANDLE_INVALID), vmo_indirect_(nullptr) {}
+    fs_(fs), vmo_(MX_HANDLE_INVALID) {}
 
 void VnodeMinfs::NotifyAdd(const char* name, size_t len) { watcher_.NotifyAdd(name, len); }
+void VnodeMinfs::NotifyRemove(const char* name, size_t len) { watcher_.NotifyRemove(name, len); }
 mx_status_t VnodeMinfs::WatchDir(mx_handle_t* out) { return watcher_.WatchDir(out); }
 mx_status_t VnodeMinfs::WatchDirV2(const vfs_watch_dir_t* cmd) { return watcher_.WatchDirV2(cmd); }
 
@@ -1142,7 +1582,7 @@ mx_status_t VnodeMinfs::Create(mxtl::RefPtr<fs::Vnode>* out, const char* name, s
     args.len = len;
     // ensure file does not exist
     mx_status_t status;
-    if ((status = ForEachDirent(&args, cb_dir_find)) != MX_ERR_NOT_FOUND) {
+    if ((status = FindDirent(&args)) != MX_ERR_NOT_FOUND) {
         return MX_ERR_ALREADY_EXISTS;
     }
 
@@ -1152,7 +1592,7 @@ mx_status_t VnodeMinfs::Create(mxtl::RefPtr<fs::Vnode>* out, const char* name, s
     WriteTxn txn(fs_->bc_.get());
     // mint a new inode and vnode for it
     mxtl::RefPtr<VnodeMinfs> vn;
-    if ((status = fs_->VnodeNew(&txn, &vn, type)) < 0) {
+    if ((status = fs_->VnodeNew(&txn, &vn, type, ino_)) < 0) {
         return status;
     }
 
@@ -1207,6 +1647,12 @@ ssize_t VnodeMinfs::Ioctl(uint32_t op, const void* in_buf, size_t in_len, void*
             // 'fs_' is deleted after Unmount is called.
             return fs_->Unmount();
         }
+#ifdef __Fuchsia__
+        case IOCTL_VFS_DROP_CACHE: {
+            fs_->VnodeCacheDrop();
+            return MX_OK;
+        }
+#endif
         default: {
             return MX_ERR_NOT_SUPPORTED;
         }
@@ -1232,7 +1678,7 @@ mx_status_t VnodeMinfs::Unlink(const char* name, size_t len, bool must_be_dir) {
     args.len = len;
     args.type = must_be_dir ? kMinfsTypeDir : 0;
     args.txn = &txn;
-    return ForEachDirent(&args, cb_dir_unlink);
+    return ForNamedDirent(&args, cb_dir_unlink);
 }
 
 mx_status_t VnodeMinfs::Truncate(size_t len) {
@@ -1287,6 +1733,11 @@ mx_status_t VnodeMinfs::TruncateInternal(WriteTxn* txn, size_t len) {
             if (bno != 0) {
                 size_t adjust = len % kMinfsBlockSize;
 #ifdef __Fuchsia__
+                if (!IsDirectory() &&
+                    ((r = LoadBlocks(static_cast<uint32_t>(len / kMinfsBlockSize),
+                                     static_cast<uint32_t>(len / kMinfsBlockSize) + 1)) != MX_OK)) {
+                    return r;
+                }
                 if ((r = VmoReadExact(bdata, len - adjust, adjust)) != MX_OK) {
                     return MX_ERR_IO;
                 }
@@ -1322,7 +1773,7 @@ mx_status_t VnodeMinfs::TruncateInternal(WriteTxn* txn, size_t len) {
 
     inode_.size = static_cast<uint32_t>(len);
 #ifdef __Fuchsia__
-    if ((r = vmo_.set_size(mxtl::roundup(len, kMinfsBlockSize))) != MX_OK) {
+    if ((r = vmo_.set_size(VmoSizeFor(len))) != MX_OK) {
         return r;
     }
 #endif
@@ -1379,7 +1830,7 @@ mx_status_t VnodeMinfs::Rename(mxtl::RefPtr<fs::Vnode> _newdir, const char* oldn
     DirArgs args = DirArgs();
     args.name = oldname;
     args.len = oldlen;
-    if ((status = ForEachDirent(&args, cb_dir_find)) < 0) {
+    if ((status = FindDirent(&args)) < 0) {
         return status;
     } else if ((status = fs_->VnodeGet(&oldvn, args.ino)) < 0) {
         return status;
@@ -1400,7 +1851,7 @@ mx_status_t VnodeMinfs::Rename(mxtl::RefPtr<fs::Vnode> _newdir, const char* oldn
     args.len = newlen;
     args.ino = oldvn->ino_;
     args.type = oldvn->IsDirectory() ? kMinfsTypeDir : kMinfsTypeFile;
-    status = newdir->ForEachDirent(&args, cb_dir_attempt_rename);
+    status = newdir->ForNamedDirent(&args, cb_dir_attempt_rename);
     if (status == MX_ERR_NOT_FOUND) {
         // if 'newname' does not exist, create it
         args.reclen = static_cast<uint32_t>(DirentSize(static_cast<uint8_t>(newlen)));
@@ -1422,7 +1873,7 @@ mx_status_t VnodeMinfs::Rename(mxtl::RefPtr<fs::Vnode> _newdir, const char* oldn
         args.name = "..";
         args.len = 2;
         args.ino = newdir->ino_;
-        if ((status = vn->ForEachDirent(&args, cb_dir_update_inode)) < 0) {
+        if ((status = vn->ForNamedDirent(&args, cb_dir_update_inode)) < 0) {
             return status;
         }
     }
@@ -1434,7 +1885,7 @@ mx_status_t VnodeMinfs::Rename(mxtl::RefPtr<fs::Vnode> _newdir, const char* oldn
     // finally, remove oldname from its original position
     args.name = oldname;
     args.len = oldlen;
-    return ForEachDirent(&args, cb_dir_force_unlink);
+    return ForNamedDirent(&args, cb_dir_force_unlink);
 }
 
 mx_status_t VnodeMinfs::Link(const char* name, size_t len, mxtl::RefPtr<fs::Vnode> _target) {
@@ -1464,7 +1915,7 @@ mx_status_t VnodeMinfs::Link(const char* name, size_t len, mxtl::RefPtr<fs::Vnod
     args.name = name;
     args.len = len;
     mx_status_t status;
-    if ((status = ForEachDirent(&args, cb_dir_find)) != MX_ERR_NOT_FOUND) {
+    if ((status = FindDirent(&args)) != MX_ERR_NOT_FOUND) {
         return (status == MX_OK) ? MX_ERR_ALREADY_EXISTS : status;
     }
 
@@ -1484,8 +1935,90 @@ mx_status_t VnodeMinfs::Link(const char* name, size_t len, mxtl::RefPtr<fs::Vnod
     return MX_OK;
 }
 
+#ifdef __Fuchsia__
+mx_status_t VnodeMinfs::Mmap(int flags, size_t len, size_t* off, mx_handle_t* out) {
+    FS_TRACE(MINFS, "minfs_mmap() vn=%p(#%u) len=%zd flags=%x\n", this, ino_, len, flags);
+    if (IsDirectory()) {
+        return MX_ERR_NOT_SUPPORTED;
+    }
+
+    // Nothing pages the file in as it's touched, so all of it is read first
+    mx_status_t status;
+    if ((status = InitVmo()) != MX_OK) {
+        return status;
+    }
+    uint32_t blocks = static_cast<uint32_t>(mxtl::roundup(inode_.size, kMinfsBlockSize) /
+                                            kMinfsBlockSize);
+    if ((status = LoadBlocks(0, blocks)) != MX_OK) {
+        return status;
+    }
+
+    mx_rights_t rights = MX_RIGHT_TRANSFER | MX_RIGHT_MAP | MX_RIGHT_GET_PROPERTY;
+    rights |= (flags & MXIO_MMAP_FLAG_READ) ? MX_RIGHT_READ : 0;
+    rights |= (flags & MXIO_MMAP_FLAG_WRITE) ? MX_RIGHT_WRITE : 0;
+    rights |= (flags & MXIO_MMAP_FLAG_EXEC) ? MX_RIGHT_EXECUTE : 0;
+
+    mx::vmo vmo;
+    if (flags & MXIO_MMAP_FLAG_PRIVATE) {
+        // A private mapping sees the file as it is now, and keeps its own
+        // writes to itself.
+        uint64_t size;
+        if ((status = vmo_.get_size(&size)) != MX_OK) {
+            return status;
+        }
+        if ((status = vmo_.clone(MX_VMO_CLONE_COPY_ON_WRITE, 0, size, &vmo)) != MX_OK) {
+            return status;
+        }
+        if ((status = vmo.replace(rights, &vmo)) != MX_OK) {
+            return status;
+        }
+    } else {
+        // A shared mapping is the file's own VMO, so it sees, and makes,
+        // every change to the file.
+        if ((status = vmo_.duplicate(rights, &vmo)) != MX_OK) {
+            return status;
+        }
+        if (flags & MXIO_MMAP_FLAG_WRITE) {
+            mapped_writable_ = true;
+        }
+    }
+    *out = vmo.release();
+    return MX_OK;
+}
+
+mx_status_t VnodeMinfs::WritebackMapped() {
+    if (!mapped_writable_ || !vmo_.is_valid()) {
+        return MX_OK;
+    }
+
+    // Blocks of holes the mapping wrote into are allocated here
+    WriteTxn txn(fs_->bc_.get());
+    uint32_t blocks = static_cast<uint32_t>(mxtl::roundup(inode_.size, kMinfsBlockSize) /
+                                            kMinfsBlockSize);
+    mx_status_t status;
+    MapBlocks(&txn, 0, blocks);
+    for (uint32_t n = 0; n < blocks; n++) {
+        uint32_t bno;
+        if ((status = GetBno(&txn, n, &bno)) != MX_OK) {
+            return status;
+        }
+        if ((status = fs_->MarkDirty(this, n, bno)) != MX_OK) {
+            return status;
+        }
+    }
+    InodeSync(&txn, kMxFsSyncMtime);
+    return MX_OK;
+}
+#endif
+
 mx_status_t VnodeMinfs::Sync() {
-    return fs_->bc_->Sync();
+#ifdef __Fuchsia__
+    mx_status_t status;
+    if ((status = WritebackMapped()) != MX_OK) {
+        return status;
+    }
+#endif
+    return fs_->Sync();
 }
 
 mx_status_t VnodeMinfs::AttachRemote(mx_handle_t h) {
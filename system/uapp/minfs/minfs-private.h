@@ -6,12 +6,19 @@
 
 #ifdef __Fuchsia__
 #include <fs/dispatcher.h>
+#include <magenta/thread_annotations.h>
 #include <mx/vmo.h>
+#include <mxtl/array.h>
+#include <mxtl/mutex.h>
+#include <threads.h>
 #endif
 
 #include <mxtl/algorithm.h>
+#include <mxtl/flat_hash_map.h>
+#include <mxtl/inline_vector.h>
 #include <mxtl/intrusive_hash_table.h>
 #include <mxtl/intrusive_single_list.h>
+#include <mxtl/intrusive_wavl_tree.h>
 #include <mxtl/macros.h>
 #include <mxtl/ref_ptr.h>
 #include <mxtl/unique_ptr.h>
@@ -21,6 +28,7 @@
 
 #ifdef __Fuchsia__
 #include <fs/vfs-dispatcher.h>
+#include <fs/vnode-cache.h>
 #endif
 
 #include <fs/vfs.h>
@@ -46,11 +54,342 @@ constexpr uint32_t kMxFsSyncCtime = (1 << 1);
 
 constexpr uint32_t kMinfsBlockCacheSize = 64;
 
+// Extent nodes a vnode holds in memory per chunk.
+constexpr uint32_t kMinfsExtentChunkNodes = 16;
+
+// Metadata blocks which may be waiting to be committed to the journal at once.
+constexpr uint32_t kMinfsJournalCommitBlocks = 64;
+
+// File data blocks which may be dirty in the write-back cache at once.
+constexpr uint32_t kMinfsDirtyBlocksMax = 256;
+
+// Directories get an on-disk hash index (see minfs.h) as they grow to this
+// size. Those this big without one, as when it had to be dropped, are looked
+// up through an in-memory one instead, built on the first lookup. Neither
+// moves dirents, so Readdir order is unchanged.
+constexpr uint32_t kMinfsDirIndexMinSize = 2 * kMinfsBlockSize;
+
+// The index splits another bucket off whenever it holds more than this many
+// dirents a bucket. The buckets not yet split up to the next power of two
+// hold twice as many as the others, so they're three quarters full at worst.
+constexpr uint32_t kMinfsDirIndexSplitLoad = kMinfsDirBucketEntries * 3 / 8;
+
+// The hash names go by in the on-disk index: fnv1a32, with its high bits
+// folded into the low ones, which pick the bucket.
+static inline uint32_t MinfsDirHash(const char* name, size_t len) {
+    uint32_t hash = fnv1a32(name, len);
+    return hash ^ (hash >> 16);
+}
+
+// Blocks read ahead of a sequential reader at first, and at most unless the
+// mount says otherwise.
+constexpr uint32_t kMinfsReadaheadMin = 4;
+constexpr uint32_t kMinfsReadaheadMaxDefault = 32;
+
+// Most memory the vnode cache keeps closed vnodes around with.
+constexpr size_t kMinfsVnodeCacheBytes = 16 * 1024 * 1024;
+
+struct MountOptions {
+    // Most blocks read ahead of a sequential reader at once; zero disables
+    // readahead.
+    uint32_t readahead_max = kMinfsReadaheadMaxDefault;
+};
+
 // Used by fsck
 class MinfsChecker;
 
+class Minfs;
 class VnodeMinfs;
 
+#ifdef __Fuchsia__
+// Links the vnodes kept by the vnode cache.
+struct VnodeCacheTraits {
+    static mxtl::DoublyLinkedListNodeState<mxtl::RefPtr<VnodeMinfs>>& node_state(VnodeMinfs& vn);
+    static size_t& cache_bytes(VnodeMinfs& vn);
+};
+#endif
+
+#ifdef __Fuchsia__
+
+// The metadata journal of a mounted filesystem (see minfs.h).
+//
+// Writes of metadata blocks wait to be committed together, as one entry,
+// until enough of them have gathered, a short while has passed since the
+// first, or the filesystem is synced, so that operations which follow each
+// other closely share a commit. The metadata blocks of each write are copied
+// into the journal as it is made, and commits only ever take whole writes, so
+// that a later write still on its way can't change or tear what is committed.
+// The journaled blocks are only written in place once the journal fills up or
+// the filesystem is unmounted, by which time the same few bitmap and inode
+// table blocks have usually been journaled many times over, and are written
+// once. Directory blocks and extent nodes are metadata too, though they live
+// among the data blocks, and are journaled from their vnode's VMOs. Writes
+// of file data go straight to the device, and the file data in the write-back
+// cache is flushed before each commit, so that data is always on the device
+// ahead of the metadata which refers to it. The device's cache is flushed
+// ahead of each entry, which is itself written with BLOCKIO_FUA, so a commit
+// is durable once it returns. Reads of blocks the journal holds newer copies
+// of write them in place first.
+//
+// Blocks which are freed can't be allocated again until the journal releases
+// them: once the commit freeing them is durable, so that a crash can't leave
+// them in use by both their old and new owners, and once no copy of them is
+// left in the journal, which replay could write over the new owner's data. On
+// devices which free discarded blocks, they are discarded by the commit thread
+// on their way out.
+class Journal {
+public:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(Journal);
+
+    // Commits whatever is waiting, and writes everything in place.
+    ~Journal();
+
+    // The journal must already have been replayed.
+    static mx_status_t Create(Bcache* bc, const minfs_info_t* info,
+                              mxtl::unique_ptr<Journal>* out);
+
+    // Identifies where the contents of a metadata VMO attached as |vmoid| are
+    // mapped. Writes from VMOs which aren't registered go straight to the
+    // device.
+    mx_status_t RegisterVmo(vmoid_t vmoid, const void* data);
+    // Registers the VMO of a vnode, attached as |vmoid|, which holds metadata:
+    // a directory's blocks, or a file's extent nodes. Its blocks are read
+    // out of |vmo| as they're written. It must be unregistered before |vmo|
+    // is closed.
+    mx_status_t RegisterVnodeVmo(vmoid_t vmoid, mx_handle_t vmo);
+    void UnregisterVnodeVmo(vmoid_t vmoid);
+
+    // Writes the requests of a WriteTxn.
+    mx_status_t Write(block_fifo_request_t* requests, size_t count);
+    // Reads the requests of a ReadTxn.
+    mx_status_t Read(block_fifo_request_t* requests, size_t count);
+
+    // Commits the metadata writes which are waiting, if any.
+    mx_status_t Commit();
+
+    // Names the filesystem whose write-back cache is flushed ahead of commits.
+    void SetWriteback(Minfs* fs);
+
+    // Notes that the |count| data blocks from |start| have been freed, ahead
+    // of the write of the bitmap which frees them. They are not to be
+    // allocated again until released.
+    void Free(uint32_t start, uint32_t count);
+    // Takes the next run of freed blocks which has been released, if any.
+    bool TakeReleased(uint32_t* start, uint32_t* count);
+    // Commits, writes in place and discards whatever it takes to release
+    // every block whose freeing has been written.
+    mx_status_t Release();
+
+private:
+    Journal(Bcache* bc, const minfs_info_t* info);
+
+    // Freed blocks go from being freed, to being written with the bitmap
+    // which frees them, to being committed. Those the journal still holds
+    // copies of are then held until they have been written in place, and
+    // those which are to be discarded wait for the commit thread. Then they
+    // are released.
+    enum class FreeState : uint8_t {
+        kFreed,
+        kWritten,
+        kCommitted,
+        kHeld,
+        kReleased,
+    };
+
+    struct FreeExtent {
+        uint32_t start;
+        uint32_t count;
+        FreeState state;
+    };
+
+    // Runs of freed blocks tracked without allocating.
+    static constexpr size_t kInlineFreeExtents = 16;
+
+    static constexpr size_t kMaxVmos = 4;
+
+    struct MetadataVmo {
+        vmoid_t vmoid;
+        const void* data;
+    };
+
+    // A block which has been committed but not yet written in place, and
+    // where in the journal its latest copy is.
+    struct JournaledBlock {
+        uint32_t bno;
+        uint32_t pos;
+    };
+
+    static int CommitThread(void* arg);
+
+    const void* FindVmo(vmoid_t vmoid) const;
+    // Whether |request| writes metadata.
+    bool IsMetadataLocked(const block_fifo_request_t& request) const TA_REQ(lock_);
+    // Whether a copy of any of the |count| blocks from |bno| is waiting to be
+    // committed or written in place.
+    bool JournaledLocked(uint64_t bno, uint64_t count) const TA_REQ(lock_);
+    // Where the copy of the |index|th block waiting to be committed is kept:
+    // in the journal buffer, after the header of the entry it will go in.
+    void* PendingDataLocked(size_t index) TA_REQ(lock_);
+    // Makes room for block |bno| of a transaction, for which there must be
+    // room, and returns where its copy goes.
+    void* AddPendingLocked(uint32_t bno) TA_REQ(lock_);
+    mx_status_t CommitLocked() TA_REQ(lock_);
+    mx_status_t CheckpointLocked() TA_REQ(lock_);
+
+    // Moves the frees in state |from| to |to|, and returns whether there
+    // were any.
+    bool AdvanceFrees(FreeState from, FreeState to);
+    // Moves the frees which a commit has made durable on, and returns
+    // whether any of them are to be discarded.
+    bool CommittedFreesLocked() TA_REQ(lock_);
+    // Moves the frees which were held for a checkpoint on, likewise.
+    bool CheckpointedFrees();
+    // Discards the frees waiting for it, and releases them.
+    void Discard();
+
+    Bcache* bc_;
+    Minfs* fs_ TA_GUARDED(lock_) = nullptr;
+    const uint32_t jnl_block_;
+    const uint32_t jnl_blocks_;
+
+    // A copy of the journal, through which it is written.
+    mxtl::unique_ptr<MappedVmo> buffer_;
+    vmoid_t vmoid_;
+
+    MetadataVmo vmos_[kMaxVmos];
+    size_t vmo_count_ = 0;
+
+    mxtl::Mutex lock_;
+    mxtl::FlatHashMap<vmoid_t, mx_handle_t> vnode_vmos_ TA_GUARDED(lock_);
+    cnd_t wake_;
+    thrd_t thread_;
+    bool thread_started_ = false;
+    bool stop_ TA_GUARDED(lock_) = false;
+
+    // The blocks waiting to be committed, in the order of their copies.
+    uint32_t pending_[kMinfsJournalCommitBlocks] TA_GUARDED(lock_);
+    size_t pending_count_ TA_GUARDED(lock_) = 0;
+    mxtl::Array<JournaledBlock> journaled_ TA_GUARDED(lock_);
+    size_t journaled_count_ TA_GUARDED(lock_) = 0;
+
+    // The sequence number of the next entry, and the block it goes in.
+    uint64_t seq_ TA_GUARDED(lock_) = 0;
+    uint32_t head_ TA_GUARDED(lock_) = 1;
+
+    uint64_t commits_ TA_GUARDED(lock_) = 0;
+    uint64_t blocks_committed_ TA_GUARDED(lock_) = 0;
+    uint64_t checkpoints_ TA_GUARDED(lock_) = 0;
+
+    // Whether the device frees discarded blocks, and whether commits have
+    // freed any which the commit thread is yet to discard.
+    const bool discard_;
+    bool discard_waiting_ TA_GUARDED(lock_) = false;
+
+    // Guards the freed blocks, and is held while discards are in flight.
+    // Taken after lock_.
+    mxtl::Mutex free_lock_;
+    mxtl::InlineVector<FreeExtent, kInlineFreeExtents> frees_ TA_GUARDED(free_lock_);
+    uint64_t blocks_discarded_ TA_GUARDED(free_lock_) = 0;
+};
+
+#endif
+
+// Writes the blocks of every valid entry in the journal in place, and retires
+// the entries. Must be done before any metadata is read.
+mx_status_t minfs_journal_replay(Bcache* bc, const minfs_info_t* info);
+
+// The checksum of |entry|, whose blocks follow each other at |blocks|.
+uint64_t minfs_journal_checksum(const minfs_journal_entry_t* entry, const void* blocks);
+
+// Bits of an allocation bitmap counted together as a group.
+constexpr uint32_t kMinfsAllocGroupBits = 4096;
+
+// Counts of the free bits in each group of an allocation bitmap, so that
+// searches step over full groups rather than scanning every word of them.
+// The counts are kept in memory only, taken from the bitmap at mount.
+class AllocGroups {
+public:
+    // Counts the free bits of |map|, which must not change behind our back.
+    mx_status_t Init(const RawBitmap& map);
+
+    // Finds the first free bit of |map| at or after |hint|, wrapping around.
+    mx_status_t Find(const RawBitmap& map, size_t hint, size_t* out) const;
+
+    void Allocated(size_t bit) { free_[bit / kMinfsAllocGroupBits]--; }
+    void Freed(size_t bit) { free_[bit / kMinfsAllocGroupBits]++; }
+    // Likewise, for the |count| bits from |bit|.
+    void Allocated(size_t bit, size_t count);
+    void Freed(size_t bit, size_t count);
+
+private:
+    mxtl::Array<uint32_t> free_;
+};
+
+// Runs of free bits shorter than this are left to AllocGroups.
+constexpr size_t kMinfsFreeExtentMin = 16;
+
+// The runs of at least kMinfsFreeExtentMin free bits of an allocation bitmap,
+// in a tree by their first bit. Each node also knows the longest run in its
+// subtree, so the first run after a given bit that holds some number of bits,
+// or the longest run of all, is found without visiting every run. Like
+// AllocGroups, this is kept in memory only, and must be told of every change
+// to the bitmap.
+class FreeExtents {
+public:
+    FreeExtents() = default;
+    ~FreeExtents();
+    DISALLOW_COPY_ASSIGN_AND_MOVE(FreeExtents);
+
+    // Finds the runs of |map|.
+    mx_status_t Init(const RawBitmap& map);
+
+    // Finds the first run at or after |hint| of at least |want| bits, wrapping
+    // around, or, if there is none, the longest run there is.
+    mx_status_t Find(size_t hint, size_t want, size_t* out) const;
+
+    // To be called once the |count| bits from |bit| have been set in the
+    // bitmap, or cleared from |map|.
+    void Allocated(size_t bit, size_t count);
+    void Freed(const RawBitmap& map, size_t bit, size_t count);
+
+private:
+    struct Extent {
+        size_t GetKey() const { return start; }
+        // Updates |longest| from the extent and its children.
+        void UpdateLongest();
+        Extent* left() const;
+        Extent* right() const;
+
+        size_t start;
+        size_t count;
+        // The longest run in the subtree rooted at this extent
+        size_t longest;
+        mxtl::WAVLTreeNodeState<Extent*> node;
+    };
+    using ExtentPtrTraits = mxtl::internal::ContainerPtrTraits<Extent*>;
+    struct NodeTraits {
+        static mxtl::WAVLTreeNodeState<Extent*>& node_state(Extent& e) { return e.node; }
+    };
+    struct Observer : public mxtl::tests::intrusive_containers::DefaultWAVLTreeObserver {
+        template <typename TreeType>
+        static void RecordSubtreeChanged(typename TreeType::RawPtrType e) {
+            e->UpdateLongest();
+        }
+    };
+    using ExtentTree = mxtl::WAVLTree<size_t, Extent*,
+                                      mxtl::DefaultKeyedObjectTraits<size_t, Extent>,
+                                      NodeTraits, Observer>;
+
+    static const Extent* FirstFit(const Extent* e, size_t hint, size_t want);
+    // Adds the run of |count| bits from |start|, if it's long enough, in |e|
+    // or else a new extent; |e| is deleted if it isn't needed. Runs which
+    // can't be added for want of memory are left out, which only means that
+    // AllocGroups finds them instead.
+    void Insert(Extent* e, size_t start, size_t count);
+
+    ExtentTree tree_;
+};
+
 class Minfs {
 public:
     DISALLOW_COPY_ASSIGN_AND_MOVE(Minfs);
@@ -60,28 +399,90 @@ public:
 
     mx_status_t Unmount();
 
+    // Makes everything written so far durable.
+    mx_status_t Sync();
+
+    // Records whether the filesystem is cleanly unmounted, which lets an
+    // incremental check skip it. The mark is cleared while mounted.
+    mx_status_t SetClean(bool clean);
+
+#ifdef __Fuchsia__
+    // The write-back cache of file data (writeback.cpp).
+    //
+    // File writes only update the vnode's VMO, and leave the block in it
+    // marked dirty. Dirty blocks are written to the device, with adjacent
+    // ones combined into single requests, ahead of each journal commit, when
+    // too many of them build up, when their vnode goes away, or on Sync, so
+    // small writes to the same block reach the device once. Where block |n|
+    // of |vn| lives on disk, |bno|, is noted along with it by the writer,
+    // since the flush may run on the journal's thread, alongside operations
+    // changing the vnode's block map.
+    mx_status_t MarkDirty(VnodeMinfs* vn, uint32_t n, uint32_t bno);
+
+    // Forgets the dirty blocks of |vn| from its |start|th block on, which are
+    // about to be freed.
+    void DiscardDirty(VnodeMinfs* vn, uint32_t start);
+
+    // Writes out the dirty blocks of |vn|, or of every vnode if null.
+    mx_status_t FlushDirty(VnodeMinfs* vn);
+
+    // Has the writes from a vnode VMO holding metadata (see Journal) go
+    // through the journal, until it is unregistered.
+    mx_status_t RegisterMetadataVmo(vmoid_t vmoid, mx_handle_t vmo) {
+        return journal_->RegisterVnodeVmo(vmoid, vmo);
+    }
+    void UnregisterMetadataVmo(vmoid_t vmoid) { journal_->UnregisterVnodeVmo(vmoid); }
+
+    void SetReadaheadMax(uint32_t blocks) {
+        readahead_max_ = mxtl::min(blocks, static_cast<uint32_t>(kMinfsMaxFileBlock));
+    }
+    uint32_t ReadaheadMax() const { return readahead_max_; }
+
+    // Counts blocks read ahead, and blocks later read which had been.
+    void CountReadahead(uint32_t blocks, uint32_t hits) {
+        __atomic_fetch_add(&readahead_blocks_, blocks, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&readahead_hits_, hits, __ATOMIC_RELAXED);
+    }
+#endif
+
     // instantiate a vnode from an inode
     // the inode must exist in the file system
     mx_status_t VnodeGet(mxtl::RefPtr<VnodeMinfs>* out, uint32_t ino);
 
-    // instantiate a vnode with a new inode
-    mx_status_t VnodeNew(WriteTxn* txn, mxtl::RefPtr<VnodeMinfs>* out, uint32_t type);
+    // instantiate a vnode with a new inode, near the inode of |parent|
+    mx_status_t VnodeNew(WriteTxn* txn, mxtl::RefPtr<VnodeMinfs>* out, uint32_t type,
+                         uint32_t parent);
 
     // remove a vnode from the hash map
     void VnodeRelease(VnodeMinfs* vn);
 
-    // Allocate a new data block.
-    mx_status_t BlockNew(WriteTxn* txn, uint32_t hint, uint32_t* out_bno);
-
-    // free block in block bitmap
-    mx_status_t BlockFree(WriteTxn* txn, uint32_t bno);
-
-    // free ino in inode bitmap, release all blocks held by inode
-    mx_status_t InoFree(
 #ifdef __Fuchsia__
-        const MappedVmo* vmo_indirect,
+    // The vnode cache holds a reference to the most recently looked up
+    // vnodes, so that closing and reopening a file finds its vnode, and the
+    // file data already read into its VMO, still there. The least recently
+    // used are let go once the VMOs of those kept add up to more than
+    // kMinfsVnodeCacheBytes.
+    void VnodeCacheTouch(VnodeMinfs* vn);
+    // Lets go of |vn|, if it's held, as for a vnode which has been unlinked.
+    void VnodeCacheRemove(VnodeMinfs* vn);
+    // Lets go of every vnode held, when memory is wanted elsewhere.
+    void VnodeCacheDrop();
 #endif
-        const minfs_inode_t& inode, uint32_t ino);
+
+    // Allocate a run of up to |want| new data blocks, as long as the blocks
+    // after the first are free. There is always at least one. The run starts
+    // at |hint| if that block is free. If not, runs of fewer than
+    // kMinfsFreeExtentMin blocks start at the first free block after it, and
+    // longer ones at the first free extent after it which holds them all, or
+    // else the longest there is.
+    mx_status_t BlockNew(WriteTxn* txn, uint32_t hint, uint32_t want,
+                         uint32_t* out_bno, uint32_t* out_count);
+
+    // free the |count| blocks from |bno| in block bitmap
+    mx_status_t BlockFree(WriteTxn* txn, uint32_t bno, uint32_t count);
+
+    // free ino in inode bitmap; the blocks it held must already be freed
+    mx_status_t InoFree(WriteTxn* txn, uint32_t ino);
 
     // Writes back an inode into the inode table on persistent storage.
     // Does not modify inode bitmap.
@@ -92,6 +493,14 @@ public:
         return dispatcher_.get();
     }
 #endif
+    // Where the data of inode |ino| starts looking for room, so that files
+    // whose inodes are close, as those made in the same directory are, have
+    // their data close too.
+    uint32_t DataHint(uint32_t ino) const {
+        uint64_t blocks = info_.block_count - info_.dat_block;
+        return info_.dat_block + static_cast<uint32_t>(blocks * ino / info_.inode_count);
+    }
+
     void ValidateBno(uint32_t bno) const {
         MX_DEBUG_ASSERT(info_.dat_block <= bno);
         MX_DEBUG_ASSERT(bno < info_.block_count);
@@ -104,12 +513,20 @@ private:
     // Fsck can introspect Minfs
     friend class MinfsChecker;
     Minfs(mxtl::unique_ptr<Bcache> bc_, const minfs_info_t* info_);
-    // Find a free inode, allocate it in the inode bitmap, and write it back to disk
-    mx_status_t InoNew(WriteTxn* txn, const minfs_inode_t* inode, uint32_t* ino_out);
+    // Find a free inode, the first at or after |hint|, allocate it in the
+    // inode bitmap, and write it back to disk
+    mx_status_t InoNew(WriteTxn* txn, const minfs_inode_t* inode, uint32_t hint,
+                       uint32_t* ino_out);
+
+    // Finds the first block of a run for BlockNew among the clear bits of |map|.
+    mx_status_t BlockFind(const RawBitmap& map, size_t hint, size_t want, size_t* out) const;
 
     // Enqueues an update for allocated inode/block counts
     mx_status_t CountUpdate(WriteTxn* txn);
 #ifdef __Fuchsia__
+    // Makes the freed blocks the journal has released allocatable again.
+    void ReleaseBlocks();
+
     mxtl::unique_ptr<fs::Dispatcher> dispatcher_;
 #endif
     uint32_t abmblks_;
@@ -117,6 +534,38 @@ private:
     RawBitmap inode_map_;
     RawBitmap block_map_;
 #ifdef __Fuchsia__
+    // The blocks which can't be allocated: those of block_map_, and those
+    // freed which the journal is yet to release. block_groups_ and
+    // block_extents_ follow these.
+    RawBitmap block_busy_;
+#endif
+    AllocGroups inode_groups_;
+    AllocGroups block_groups_;
+    FreeExtents block_extents_;
+    // Where block allocations without a hint start looking.
+    uint32_t block_rotor_ = 0;
+#ifdef __Fuchsia__
+    struct DirtyBlock {
+        VnodeMinfs* vn;
+        uint32_t n;
+        uint32_t bno;
+    };
+
+    mx_status_t FlushDirtyLocked(VnodeMinfs* vn) TA_REQ(writeback_lock_);
+
+    mxtl::Mutex writeback_lock_;
+    DirtyBlock dirty_[kMinfsDirtyBlocksMax] TA_GUARDED(writeback_lock_);
+    size_t dirty_count_ TA_GUARDED(writeback_lock_) = 0;
+    uint64_t writeback_blocks_ TA_GUARDED(writeback_lock_) = 0;
+    uint64_t writeback_requests_ TA_GUARDED(writeback_lock_) = 0;
+
+    uint32_t readahead_max_ = kMinfsReadaheadMaxDefault;
+    uint64_t readahead_blocks_ = 0;
+    uint64_t readahead_hits_ = 0;
+
+    // Declared after bc_ and the write-back cache, which it flushes, so that
+    // it's destroyed (and done writing) first.
+    mxtl::unique_ptr<Journal> journal_;
     mxtl::unique_ptr<MappedVmo> inode_table_;
     mxtl::unique_ptr<MappedVmo> info_vmo_;
     vmoid_t inode_map_vmoid_;
@@ -129,6 +578,10 @@ private:
     // when the Vnode is deleted, it is immediately removed from the map.
     using HashTable = mxtl::HashTable<uint32_t, VnodeMinfs*>;
     HashTable vnode_hash_;
+
+#ifdef __Fuchsia__
+    fs::VnodeCache<VnodeMinfs, VnodeCacheTraits> vnode_cache_{kMinfsVnodeCacheBytes};
+#endif
 };
 
 struct DirArgs {
@@ -138,6 +591,7 @@ struct DirArgs {
     uint32_t type;
     uint32_t reclen;
     WriteTxn* txn;
+    uint8_t* buckets;       // when indexing, the blocks of the buckets
 };
 
 struct DirectoryOffset {
@@ -187,6 +641,19 @@ public:
     // Lookup which can traverse '..'
     mx_status_t LookupInternal(mxtl::RefPtr<fs::Vnode>* out, const char* name, size_t len);
 
+    // Directories only: keep the in-memory index, if there is one, in step
+    // with dirents being added at |off| and removed.
+    void DirCacheAdd(const char* name, size_t len, size_t off);
+    void DirCacheRemove(const char* name, size_t len);
+
+    // Directories only: the same for the on-disk index. Should a change fail
+    // to make it in, the index is dropped (and its blocks freed), leaving the
+    // directory to be scanned.
+    void DirIndexAdd(WriteTxn* txn, const char* name, size_t len, size_t off);
+    void DirIndexRemove(WriteTxn* txn, const char* name, size_t len, size_t off);
+    mx_status_t DirIndexBuild(WriteTxn* txn);
+    void DirIndexDrop(WriteTxn* txn);
+
     Minfs* fs_;
     uint32_t ino_;
     minfs_inode_t inode_;
@@ -194,14 +661,45 @@ public:
     ~VnodeMinfs();
 
 private:
+    // The offsets of the live dirents of a large directory without an index
+    // on disk, by the hash of their names. Live dirents never move, so the index is only touched as
+    // they come and go. Should it ever disagree with the directory (or two
+    // names share a hash), it's dropped for good, and lookups scan as before.
+    mxtl::FlatHashMap<uint64_t, uint32_t> dir_cache_;
+    bool dir_cached_ = false;
+    bool dir_cache_disabled_ = false;
+
+    // The nodes of the extent tree held in memory. |extent_slots_| finds the
+    // slot holding each node by its block; slots whose nodes have been freed
+    // are reused first.
+    struct ExtentChunk {
+#ifdef __Fuchsia__
+        mxtl::unique_ptr<MappedVmo> vmo;
+        vmoid_t vmoid;
+#else
+        mxtl::unique_ptr<uint8_t[]> data;
+#endif
+    };
+    mxtl::InlineVector<ExtentChunk, 1> extent_chunks_;
+    mxtl::FlatHashMap<uint32_t, uint32_t> extent_slots_;
+    mxtl::InlineVector<uint32_t, 4> extent_free_slots_;
+    uint32_t extent_slot_count_ = 0;
+    bool extents_loaded_ = false;
+
     // Fsck can introspect Minfs
     friend class MinfsChecker;
+    // The write-back cache maps and writes out vnode blocks
+    friend class Minfs;
     VnodeMinfs(Minfs* fs);
 
     // Implementing methods from the fs::Vnode, so MinFS vnodes may be utilized
     // by the VFS library.
     mx_status_t Open(uint32_t flags) final;
     ssize_t Read(void* data, size_t len, size_t off) final;
+#ifdef __Fuchsia__
+    bool ConcurrentReads() const final { return !IsDirectory(); }
+    mx_status_t Mmap(int flags, size_t len, size_t* off, mx_handle_t* out) final;
+#endif
     ssize_t Write(const void* data, size_t len, size_t off) final;
     mx_status_t Getattr(vnattr_t* a) final;
     mx_status_t Setattr(vnattr_t* a) final;
@@ -219,17 +717,69 @@ private:
 
 #ifdef __Fuchsia__
     mx_status_t InitVmo();
-    mx_status_t InitIndirectVmo();
+
+    // Makes |loaded_| big enough for a file of |blocks| blocks.
+    mx_status_t GrowLoaded(uint32_t blocks);
+
+    // Reads the blocks in [start, end) of a file into its VMO, unless they're
+    // there already.
+    mx_status_t LoadBlocks(uint32_t start, uint32_t end);
+
+    // Loads the blocks of a file covering [off, off + len), and, while it's
+    // read sequentially, a growing window of blocks beyond them.
+    mx_status_t ReadAhead(size_t off, size_t len);
+
+    // Queues every block of a file with a shared writable mapping for
+    // write-back, as nothing records which of them the mapping wrote.
+    mx_status_t WritebackMapped();
 #endif
 
     // Get the disk block 'bno' corresponding to the 'nth' logical block of the file.
     // Allocate the block if requested with a non-null "txn".
     mx_status_t GetBno(WriteTxn* txn, uint32_t n, uint32_t* bno);
 
+    // Allocates the blocks of the holes in [start, end) of the file, a run at
+    // a time, stopping at the first which can't be.
+    mx_status_t MapBlocks(WriteTxn* txn, uint32_t start, uint32_t end);
+
     // Deletes all blocks (relateive to a file) from "start" (inclusive) to the end
     // of the file. Does not update mtime/atime.
     mx_status_t BlocksShrink(WriteTxn* txn, uint32_t start);
 
+    // The extent tree (extents.cpp).
+    //
+    // A file whose extents outgrow its inode keeps them in a tree of nodes
+    // (see minfs.h). The whole tree is read in on first use, and stays in
+    // memory for as long as the vnode, in chunks of kMinfsExtentChunkNodes
+    // nodes. On Fuchsia each chunk is a VMO, written through the journal.
+    struct ExtentList;
+
+    // Finds where block |n| of the file is, or zero if it's a hole, and how
+    // many blocks from it on are mapped (or not) alike.
+    mx_status_t ExtentLookup(uint32_t n, uint32_t* bno, uint32_t* count);
+    // Maps the hole of |count| blocks from |n| to those from |bno|. The inode
+    // is left for the caller to write.
+    mx_status_t ExtentInsert(WriteTxn* txn, uint32_t n, uint32_t bno, uint32_t count);
+    // Frees every block from |start| on, and the nodes which no longer map
+    // any. The inode is left for the caller to write.
+    mx_status_t ExtentTruncate(WriteTxn* txn, uint32_t start);
+    // Lets go of the nodes held in memory.
+    void ExtentsRelease();
+
+    mx_status_t ExtentsLoad();
+    mx_status_t ExtentReadChildren(ReadTxn* txn, const ExtentList& list);
+    ExtentList ExtentRoot();
+    ExtentList ExtentAt(uint32_t slot);
+    ExtentList ExtentChild(const ExtentList& list, uint32_t index);
+    minfs_extent_node_t* ExtentNode(uint32_t slot) const;
+    mx_status_t ExtentSlotNew(uint32_t bno, uint32_t* out);
+    mx_status_t ExtentNodeNew(WriteTxn* txn, uint32_t depth, uint32_t* out);
+    void ExtentNodeFree(WriteTxn* txn, uint32_t slot);
+    void ExtentWrite(WriteTxn* txn, const ExtentList& list);
+    mx_status_t ExtentGrow(WriteTxn* txn);
+    mx_status_t ExtentSplit(WriteTxn* txn, const ExtentList& parent, uint32_t index);
+    void ExtentTrim(WriteTxn* txn, const ExtentList& list, uint32_t start);
+
     // Update the vnode's inode and write it to disk
     void InodeSync(WriteTxn* txn, uint32_t flags);
 
@@ -240,12 +790,42 @@ private:
     // Directories only
     mx_status_t ForEachDirent(DirArgs* args, const DirentCallback func);
 
+    // Calls |func| on the dirent named by |args| alone, as found through the
+    // on-disk index, or on each dirent in turn if the directory has none.
+    mx_status_t ForNamedDirent(DirArgs* args, const DirentCallback func);
+
+    // Finds the dirent named by |args|, filling in its inode and type, through
+    // an index when the directory is big enough to have one.
+    mx_status_t FindDirent(DirArgs* args);
+    mx_status_t BuildDirCache();
+    void DropDirCache();
+
+    // The on-disk index: reading and writing single buckets, finding the
+    // dirent |name| in them (read into |de|), and splitting off one more.
+    mx_status_t DirIndexRead(uint32_t bucket, minfs_dir_bucket_t* data);
+    mx_status_t DirIndexWrite(WriteTxn* txn, uint32_t bucket, const minfs_dir_bucket_t* data);
+    mx_status_t DirIndexFind(const char* name, size_t len, minfs_dirent_t* de, size_t* off);
+    mx_status_t DirIndexSplit(WriteTxn* txn);
+
 #ifdef __Fuchsia__
+    friend struct VnodeCacheTraits;
+
+    // Roughly the memory the vnode holds, counting its file data as though
+    // all of it had been read in.
+    size_t CacheFootprint() const;
+
+    mxtl::DoublyLinkedListNodeState<mxtl::RefPtr<VnodeMinfs>> cache_node_state_;
+    // What the vnode counted for when it was last put in the cache.
+    size_t cache_bytes_ = 0;
+
     fs::Dispatcher* GetDispatcher() final;
 
     // The following functionality interacts with handles directly, and are not applicable outside
     // Fuchsia (since there is no "handle-equivalent" in host-side tools).
 
+    // The size the VMO needs to hold a vnode |size| bytes long, along with
+    // the index of a directory.
+    size_t VmoSizeFor(size_t size) const;
     mx_status_t VmoReadExact(void* data, uint64_t offset, size_t len);
     mx_status_t VmoWriteExact(const void* data, uint64_t offset, size_t len);
 
@@ -254,12 +834,29 @@ private:
     // avoid reading the entire file up-front. Until then, read the contents of
     // a VMO into memory when it is read/written.
     mx::vmo vmo_;
-    mxtl::unique_ptr<MappedVmo> vmo_indirect_;
     vmoid_t vmoid_;
-    vmoid_t vmoid_indirect_;
+
+    // Directories are read into vmo_ whole. Files are read a block at a time,
+    // and |loaded_| tracks the blocks of vmo_ which hold the file's contents.
+    // The next block a sequential reader would read, how far ahead of it to
+    // read, and the blocks read ahead that it hasn't reached yet.
+    //
+    // Every other operation runs alone, but files may be read by several
+    // threads at once, so reads of one vnode take |read_lock_|.
+    mxtl::Mutex read_lock_;
+    bitmap::RawBitmapGeneric<bitmap::DefaultStorage> loaded_;
+    uint32_t ra_next_ = 0;
+    uint32_t ra_window_ = 0;
+    uint32_t ra_start_ = 0;
+    uint32_t ra_end_ = 0;
+
+    // Set once the file's VMO has been handed out for a shared writable
+    // mapping, after which writes may reach it without passing through Write.
+    bool mapped_writable_ = false;
 
     // Use the watcher container to implement a directory watcher
     void NotifyAdd(const char* name, size_t len) final;
+    void NotifyRemove(const char* name, size_t len) final;
     mx_status_t WatchDir(mx_handle_t* out) final;
     mx_status_t WatchDirV2(const vfs_watch_dir_t* cmd) final;
 
@@ -275,6 +872,17 @@ private:
 #endif
 };
 
+#ifdef __Fuchsia__
+inline mxtl::DoublyLinkedListNodeState<mxtl::RefPtr<VnodeMinfs>>&
+VnodeCacheTraits::node_state(VnodeMinfs& vn) {
+    return vn.cache_node_state_;
+}
+
+inline size_t& VnodeCacheTraits::cache_bytes(VnodeMinfs& vn) {
+    return vn.cache_bytes_;
+}
+#endif
+
 // write the inode data of this vnode to disk (default does not update time values)
 void minfs_sync_vnode(mxtl::RefPtr<VnodeMinfs> vn, uint32_t flags);
 
@@ -290,6 +898,10 @@ class MinfsChecker {
 public:
     MinfsChecker();
     mx_status_t Init(mxtl::unique_ptr<Bcache> bc, const minfs_info_t* info);
+    // Walks the block maps of every allocated inode, spread across threads,
+    // ahead of the check of the directory tree, which then takes each file's
+    // blocks from what was found rather than reading them itself.
+    mx_status_t ScanBlocks();
     mx_status_t CheckInode(uint32_t ino, uint32_t parent, bool dot_or_dotdot);
     mx_status_t CheckForUnusedBlocks() const;
     mx_status_t CheckForUnusedInodes() const;
@@ -303,26 +915,69 @@ public:
 private:
     DISALLOW_COPY_ASSIGN_AND_MOVE(MinfsChecker);
 
+    // The blocks of a file found by the block scan.
+    struct FileBlocks {
+        bool scanned;
+        uint32_t blocks;
+        uint32_t blocks_allocated;
+    };
+
+    // The inodes one thread of the block scan covers, and what it found.
+    struct ScanArgs {
+        MinfsChecker* chk;
+        uint32_t ino_start;
+        uint32_t ino_end;
+        RawBitmap blocks;
+        bool conforming;
+        mx_status_t status;
+    };
+
+    static int ScanThread(void* arg);
+    mx_status_t ScanInodes(ScanArgs* args);
+    const char* ScanDataBlock(ScanArgs* args, uint32_t bno);
+
+    // Walks the extents of a file, marking each block they hold: in the
+    // bitmap of the scanning thread, if there's |args|, and in
+    // checked_blocks_ otherwise. |buffer| has room for a node of each level.
+    mx_status_t WalkFile(ScanArgs* args, const minfs_inode_t* inode, uint32_t ino,
+                         uint8_t* buffer, FileBlocks* out);
+    // Walks |count| entries of depth |depth| mapping blocks below |end|.
+    mx_status_t WalkExtents(ScanArgs* args, uint32_t ino, const minfs_extent_t* entries,
+                            uint32_t count, uint32_t depth, uint64_t end,
+                            uint8_t* buffer, FileBlocks* out);
+    const char* MarkBlock(ScanArgs* args, uint32_t bno);
+    void Nonconforming(ScanArgs* args);
+
+    void CopyInode(minfs_inode_t* inode, uint32_t ino);
     mx_status_t GetInode(minfs_inode_t* inode, uint32_t ino);
-    mx_status_t GetInodeNthBno(minfs_inode_t* inode, uint32_t n, uint32_t* bno_out);
     mx_status_t CheckDirectory(minfs_inode_t* inode, uint32_t ino,
                                uint32_t parent, uint32_t flags);
+    // Checks the buckets of a directory's index against its dirents.
+    mx_status_t CheckDirIndex(minfs_inode_t* inode, uint32_t ino);
+    const char* DataBlockError(uint32_t bno) const;
     const char* CheckDataBlock(uint32_t bno);
     mx_status_t CheckFile(minfs_inode_t* inode, uint32_t ino);
+    mx_status_t CheckFileCounts(minfs_inode_t* inode, uint32_t ino, uint32_t blocks,
+                                unsigned blocks_allocated);
 
     mxtl::unique_ptr<Minfs> fs_;
     RawBitmap checked_inodes_;
     RawBitmap checked_blocks_;
+    mxtl::Array<FileBlocks> file_blocks_;
+    // The nodes CheckFile walks.
+    mxtl::unique_ptr<uint8_t[]> walk_buffer_;
 
     uint32_t alloc_inodes_;
     uint32_t alloc_blocks_;
     mxtl::Array<int32_t> links_;
 };
 
-mx_status_t minfs_check(mxtl::unique_ptr<Bcache> bc);
+// An incremental check skips filesystems which were cleanly unmounted.
+mx_status_t minfs_check(mxtl::unique_ptr<Bcache> bc, bool incremental = false);
 #endif
 
-mx_status_t minfs_mount(mxtl::RefPtr<VnodeMinfs>* root_out, mxtl::unique_ptr<Bcache> bc);
+mx_status_t minfs_mount(mxtl::RefPtr<VnodeMinfs>* root_out, mxtl::unique_ptr<Bcache> bc,
+                        const MountOptions& options = MountOptions());
 
 void minfs_dir_init(void* bdata, uint32_t ino_self, uint32_t ino_parent);
 
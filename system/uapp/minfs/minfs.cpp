@@ -3,6 +3,7 @@
 // found in the LICENSE file.
 
 #include <fcntl.h>
+#include <inttypes.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -17,6 +18,7 @@
 #include <mxtl/unique_ptr.h>
 #ifdef __Fuchsia__
 #include <fs/vfs-dispatcher.h>
+#include <mxtl/auto_lock.h>
 #endif
 
 #include "minfs-private.h"
@@ -32,6 +34,7 @@ void minfs_dump_info(const minfs_info_t* info) {
     FS_TRACE(MINFS, "minfs: alloc bitmap @ %10u\n", info->abm_block);
     FS_TRACE(MINFS, "minfs: inode table  @ %10u\n", info->ino_block);
     FS_TRACE(MINFS, "minfs: data blocks  @ %10u\n", info->dat_block);
+    FS_TRACE(MINFS, "minfs: journal      @ %10u (%u blocks)\n", info->jnl_block, info->jnl_blocks);
 }
 
 void minfs_dump_inode(const minfs_inode_t* inode, uint32_t ino) {
@@ -63,6 +66,12 @@ mx_status_t minfs_check_info(const minfs_info_t* info, uint32_t max) {
         FS_TRACE_ERROR("minfs: too large for device\n");
         return MX_ERR_INVALID_ARGS;
     }
+    if ((info->jnl_blocks < kMinfsJournalCommitBlocks + 2) ||
+        (info->jnl_block < info->ino_block) ||
+        (info->jnl_block + info->jnl_blocks > info->dat_block)) {
+        FS_TRACE_ERROR("minfs: bad journal %u/%u\n", info->jnl_block, info->jnl_blocks);
+        return MX_ERR_INVALID_ARGS;
+    }
     //TODO: validate layout
     return 0;
 }
@@ -89,85 +98,282 @@ mx_status_t Minfs::InodeSync(WriteTxn* txn, uint32_t ino, const minfs_inode_t* i
     return MX_OK;
 }
 
+mx_status_t AllocGroups::Init(const RawBitmap& map) {
+    size_t groups = (map.size() + kMinfsAllocGroupBits - 1) / kMinfsAllocGroupBits;
+    AllocChecker ac;
+    uint32_t* free = new (&ac) uint32_t[groups];
+    if (!ac.check()) {
+        return MX_ERR_NO_MEMORY;
+    }
+    free_.reset(free, groups);
+
+    for (size_t g = 0; g < groups; g++) {
+        size_t end = mxtl::min((g + 1) * kMinfsAllocGroupBits, map.size());
+        size_t off = g * kMinfsAllocGroupBits;
+        free_[g] = 0;
+        while (off < end) {
+            size_t start = map.Scan(off, end, true);
+            off = map.Scan(start, end, false);
+            free_[g] += static_cast<uint32_t>(off - start);
+        }
+    }
+    return MX_OK;
+}
+
+mx_status_t AllocGroups::Find(const RawBitmap& map, size_t hint, size_t* out) const {
+    size_t groups = free_.size();
+    size_t first = hint / kMinfsAllocGroupBits;
+    // The hint's group is searched from the hint, and, if need be, again last
+    // of all from its start.
+    for (size_t i = 0; i <= groups; i++) {
+        size_t g = (first + i) % groups;
+        if (free_[g] == 0) {
+            continue;
+        }
+        size_t start = (i == 0) ? hint : g * kMinfsAllocGroupBits;
+        size_t end = mxtl::min((g + 1) * kMinfsAllocGroupBits, map.size());
+        if ((start < end) && (map.Find(false, start, end, 1, out) == MX_OK)) {
+            return MX_OK;
+        }
+    }
+    return MX_ERR_NO_SPACE;
+}
+
+void AllocGroups::Allocated(size_t bit, size_t count) {
+    while (count > 0) {
+        size_t g = bit / kMinfsAllocGroupBits;
+        size_t n = mxtl::min(count, (g + 1) * kMinfsAllocGroupBits - bit);
+        free_[g] -= static_cast<uint32_t>(n);
+        bit += n;
+        count -= n;
+    }
+}
+
+void AllocGroups::Freed(size_t bit, size_t count) {
+    while (count > 0) {
+        size_t g = bit / kMinfsAllocGroupBits;
+        size_t n = mxtl::min(count, (g + 1) * kMinfsAllocGroupBits - bit);
+        free_[g] += static_cast<uint32_t>(n);
+        bit += n;
+        count -= n;
+    }
+}
+
+FreeExtents::Extent* FreeExtents::Extent::left() const {
+    return ExtentPtrTraits::IsValid(node.left_) ? node.left_ : nullptr;
+}
+
+FreeExtents::Extent* FreeExtents::Extent::right() const {
+    return ExtentPtrTraits::IsValid(node.right_) ? node.right_ : nullptr;
+}
+
+void FreeExtents::Extent::UpdateLongest() {
+    longest = count;
+    if (const Extent* l = left()) {
+        longest = mxtl::max(longest, l->longest);
+    }
+    if (const Extent* r = right()) {
+        longest = mxtl::max(longest, r->longest);
+    }
+}
+
+FreeExtents::~FreeExtents() {
+    while (!tree_.is_empty()) {
+        delete tree_.pop_front();
+    }
+}
+
+mx_status_t FreeExtents::Init(const RawBitmap& map) {
+    size_t bits = map.size();
+    for (size_t off = 0; off < bits;) {
+        size_t start = map.Scan(off, bits, true);
+        off = map.Scan(start, bits, false);
+        if (off - start >= kMinfsFreeExtentMin) {
+            AllocChecker ac;
+            Extent* e = new (&ac) Extent();
+            if (!ac.check()) {
+                return MX_ERR_NO_MEMORY;
+            }
+            e->start = start;
+            e->count = off - start;
+            tree_.insert(e);
+        }
+    }
+    return MX_OK;
+}
+
+// The first extent of the subtree rooted at |e| which starts at or after
+// |hint| and holds |want| bits; subtrees without a run that long are skipped.
+const FreeExtents::Extent* FreeExtents::FirstFit(const Extent* e, size_t hint, size_t want) {
+    while ((e != nullptr) && (e->longest >= want)) {
+        if (e->start < hint) {
+            e = e->right();
+            continue;
+        }
+        if (const Extent* found = FirstFit(e->left(), hint, want)) {
+            return found;
+        }
+        if (e->count >= want) {
+            return e;
+        }
+        // Everything to the right starts after the hint.
+        e = e->right();
+        hint = 0;
+    }
+    return nullptr;
+}
+
+mx_status_t FreeExtents::Find(size_t hint, size_t want, size_t* out) const {
+    const Extent* e = tree_.root();
+    if (e == nullptr) {
+        return MX_ERR_NO_SPACE;
+    }
+    if (e->longest < want) {
+        // Nothing is long enough, so the longest will have to do.
+        size_t longest = e->longest;
+        for (;;) {
+            const Extent* l = e->left();
+            if ((l != nullptr) && (l->longest == longest)) {
+                e = l;
+            } else if (e->count == longest) {
+                break;
+            } else {
+                e = e->right();
+            }
+        }
+    } else {
+        const Extent* found = FirstFit(e, hint, want);
+        e = (found != nullptr) ? found : FirstFit(e, 0, want);
+    }
+    *out = e->start;
+    return MX_OK;
+}
+
+void FreeExtents::Insert(Extent* e, size_t start, size_t count) {
+    if (count < kMinfsFreeExtentMin) {
+        delete e;
+        return;
+    }
+    if (e == nullptr) {
+        AllocChecker ac;
+        e = new (&ac) Extent();
+        if (!ac.check()) {
+            return;
+        }
+    }
+    e->start = start;
+    e->count = count;
+    tree_.insert(e);
+}
+
+void FreeExtents::Allocated(size_t bit, size_t count) {
+    size_t end = bit + count;
+    auto iter = tree_.upper_bound(bit);
+    if (iter != tree_.begin()) {
+        --iter;
+    }
+    while (iter.IsValid() && (iter->start < end)) {
+        Extent* e = &*iter;
+        ++iter;
+        size_t e_end = e->start + e->count;
+        if (e_end <= bit) {
+            continue;
+        }
+        // Whatever is left of the run either side of the allocation stays.
+        tree_.erase(*e);
+        if (e->start < bit) {
+            Insert(nullptr, e->start, bit - e->start);
+        }
+        Insert(e, end, (end < e_end) ? e_end - end : 0);
+    }
+}
+
+void FreeExtents::Freed(const RawBitmap& map, size_t bit, size_t count) {
+    size_t start = bit;
+    size_t end = bit + count;
+    Extent* merged = nullptr;
+
+    // The run now goes on to take in the runs either side. Short ones aren't
+    // in the tree, and are found in the bitmap.
+    auto next = tree_.lower_bound(end);
+    auto prev = next;
+    if (prev != tree_.begin()) {
+        --prev;
+    } else {
+        prev = tree_.end();
+    }
+    if (prev.IsValid() && (prev->start + prev->count == start)) {
+        start = prev->start;
+        merged = tree_.erase(prev);
+    } else {
+        size_t limit = prev.IsValid() ? prev->start + prev->count : 0;
+        while ((start > limit) && (bit - start < kMinfsFreeExtentMin) &&
+               !map.Get(start - 1, start)) {
+            start--;
+        }
+    }
+    if (next.IsValid() && (next->start == end)) {
+        end = next->start + next->count;
+        Extent* e = tree_.erase(next);
+        if (merged == nullptr) {
+            merged = e;
+        } else {
+            delete e;
+        }
+    } else {
+        end = map.Scan(end, next.IsValid() ? next->start : map.size(), false);
+    }
+    Insert(merged, start, end - start);
+}
+
 Minfs::Minfs(mxtl::unique_ptr<Bcache> bc, const minfs_info_t* info) : bc_(mxtl::move(bc)) {
     memcpy(&info_, info, sizeof(minfs_info_t));
 }
 
 Minfs::~Minfs() {
+#ifdef __Fuchsia__
+    VnodeCacheDrop();
+    if (FlushDirty(nullptr) != MX_OK) {
+        FS_TRACE_ERROR("minfs: failed to write back file data\n");
+    }
+    {
+        mxtl::AutoLock lock(&writeback_lock_);
+        FS_TRACE(MINFS, "minfs: write-back: %" PRIu64 " blocks in %" PRIu64 " requests\n",
+                 writeback_blocks_, writeback_requests_);
+    }
+    FS_TRACE(MINFS, "minfs: readahead: %" PRIu64 " blocks, %" PRIu64 " hits\n",
+             readahead_blocks_, readahead_hits_);
+#endif
     vnode_hash_.clear();
 }
 
-mx_status_t Minfs::InoFree(
-#ifdef __Fuchsia__
-    const MappedVmo* vmo_indirect,
-#endif
-    const minfs_inode_t& inode, uint32_t ino) {
-    // We're going to be updating block bitmaps repeatedly.
-    WriteTxn txn(bc_.get());
+mx_status_t Minfs::InoFree(WriteTxn* txn, uint32_t ino) {
 #ifdef __Fuchsia__
     auto ibm_id = inode_map_vmoid_;
 #else
     auto ibm_id = inode_map_.StorageUnsafe()->GetData();
 #endif
 
-    // Free the inode bit itself
     inode_map_.Clear(ino, ino + 1);
+    inode_groups_.Freed(ino);
     info_.alloc_inode_count--;
 
     uint32_t bitblock = ino / kMinfsBlockBits;
-    txn.Enqueue(ibm_id, bitblock, info_.ibm_block + bitblock, 1);
-    uint32_t block_count = inode.block_count;
-
-    // release all direct blocks
-    for (unsigned n = 0; n < kMinfsDirect; n++) {
-        if (inode.dnum[n] == 0) {
-            continue;
-        }
-        ValidateBno(inode.dnum[n]);
-        block_count--;
-        BlockFree(&txn, inode.dnum[n]);
-    }
-
-    // release all indirect blocks
-    for (unsigned n = 0; n < kMinfsIndirect; n++) {
-        if (inode.inum[n] == 0) {
-            continue;
-        }
-#ifdef __Fuchsia__
-        uintptr_t iaddr = reinterpret_cast<uintptr_t>(vmo_indirect->GetData());
-        uint32_t* entry = reinterpret_cast<uint32_t*>(iaddr + kMinfsBlockSize * n);
-#else
-        uint8_t idata[kMinfsBlockSize];
-        bc_->Readblk(inode.inum[n], idata);
-        uint32_t* entry = reinterpret_cast<uint32_t*>(idata);
-#endif
-        // release the blocks pointed at by the entries in the indirect block
-        for (unsigned m = 0; m < (kMinfsBlockSize / sizeof(uint32_t)); m++) {
-            if (entry[m] == 0) {
-                continue;
-            }
-            block_count--;
-            BlockFree(&txn, entry[m]);
-        }
-        // release the direct block itself
-        block_count--;
-        BlockFree(&txn, inode.inum[n]);
-    }
-
-    CountUpdate(&txn);
-    MX_DEBUG_ASSERT(block_count == 0);
-    return MX_OK;
+    txn->Enqueue(ibm_id, bitblock, info_.ibm_block + bitblock, 1);
+    return CountUpdate(txn);
 }
 
-mx_status_t Minfs::InoNew(WriteTxn* txn, const minfs_inode_t* inode, uint32_t* ino_out) {
+mx_status_t Minfs::InoNew(WriteTxn* txn, const minfs_inode_t* inode, uint32_t hint,
+                          uint32_t* ino_out) {
     size_t bitoff_start;
-    mx_status_t status = inode_map_.Find(false, 0, inode_map_.size(), 1, &bitoff_start);
+    mx_status_t status = inode_groups_.Find(inode_map_, hint, &bitoff_start);
     if (status != MX_OK) {
         return status;
     }
 
     status = inode_map_.Set(bitoff_start, bitoff_start + 1);
     assert(status == MX_OK);
+    inode_groups_.Allocated(bitoff_start);
     info_.alloc_inode_count++;
     uint32_t ino = static_cast<uint32_t>(bitoff_start);
 
@@ -184,6 +390,7 @@ mx_status_t Minfs::InoNew(WriteTxn* txn, const minfs_inode_t* inode, uint32_t* i
     // Write the inode back
     if ((status = InodeSync(txn, ino, inode)) != MX_OK) {
         inode_map_.Clear(ino, ino + 1);
+        inode_groups_.Freed(ino);
         info_.alloc_inode_count--;
         return status;
     }
@@ -201,7 +408,8 @@ mx_status_t Minfs::InoNew(WriteTxn* txn, const minfs_inode_t* inode, uint32_t* i
     return MX_OK;
 }
 
-mx_status_t Minfs::VnodeNew(WriteTxn* txn, mxtl::RefPtr<VnodeMinfs>* out, uint32_t type) {
+mx_status_t Minfs::VnodeNew(WriteTxn* txn, mxtl::RefPtr<VnodeMinfs>* out, uint32_t type,
+                            uint32_t parent) {
     if ((type != kMinfsTypeFile) && (type != kMinfsTypeDir)) {
         return MX_ERR_INVALID_ARGS;
     }
@@ -215,11 +423,14 @@ mx_status_t Minfs::VnodeNew(WriteTxn* txn, mxtl::RefPtr<VnodeMinfs>* out, uint32
     }
 
     // Allocate the on-disk inode
-    if ((status = InoNew(txn, &vn->inode_, &vn->ino_)) != MX_OK) {
+    if ((status = InoNew(txn, &vn->inode_, parent, &vn->ino_)) != MX_OK) {
         return status;
     }
 
     vnode_hash_.insert(vn.get());
+#ifdef __Fuchsia__
+    VnodeCacheTouch(vn.get());
+#endif
 
     *out = mxtl::move(vn);
     return 0;
@@ -229,12 +440,34 @@ void Minfs::VnodeRelease(VnodeMinfs* vn) {
     vnode_hash_.erase(*vn);
 }
 
+#ifdef __Fuchsia__
+void Minfs::VnodeCacheTouch(VnodeMinfs* vn) {
+    // Unlinked vnodes are let go, so that their inodes are freed on close.
+    if (vn->inode_.link_count == 0) {
+        vnode_cache_.Remove(vn);
+        return;
+    }
+    vnode_cache_.Touch(vn, vn->CacheFootprint());
+}
+
+void Minfs::VnodeCacheRemove(VnodeMinfs* vn) {
+    vnode_cache_.Remove(vn);
+}
+
+void Minfs::VnodeCacheDrop() {
+    vnode_cache_.Drop();
+}
+#endif
+
 mx_status_t Minfs::VnodeGet(mxtl::RefPtr<VnodeMinfs>* out, uint32_t ino) {
     if ((ino < 1) || (ino >= info_.inode_count)) {
         return MX_ERR_OUT_OF_RANGE;
     }
     mxtl::RefPtr<VnodeMinfs> vn = mxtl::RefPtr<VnodeMinfs>(vnode_hash_.find(ino).CopyPointer());
     if (vn != nullptr) {
+#ifdef __Fuchsia__
+        VnodeCacheTouch(vn.get());
+#endif
         *out = mxtl::move(vn);
         return MX_OK;
     }
@@ -255,13 +488,17 @@ mx_status_t Minfs::VnodeGet(mxtl::RefPtr<VnodeMinfs>* out, uint32_t ino) {
     memcpy(&vn->inode_, (void*)((uintptr_t)inodata + off_of_ino), kMinfsInodeSize);
     vn->ino_ = ino;
     vnode_hash_.insert(vn.get());
+#ifdef __Fuchsia__
+    VnodeCacheTouch(vn.get());
+#endif
 
     *out = mxtl::move(vn);
     return MX_OK;
 }
 
-mx_status_t Minfs::BlockFree(WriteTxn* txn, uint32_t bno) {
+mx_status_t Minfs::BlockFree(WriteTxn* txn, uint32_t bno, uint32_t count) {
     ValidateBno(bno);
+    ValidateBno(bno + count - 1);
 
 #ifdef __Fuchsia__
     auto bbm_id = block_map_vmoid_;
@@ -269,50 +506,116 @@ mx_status_t Minfs::BlockFree(WriteTxn* txn, uint32_t bno) {
     auto bbm_id = block_map_.StorageUnsafe()->GetData();
 #endif
 
-    block_map_.Clear(bno, bno + 1);
-    info_.alloc_block_count--;
-    uint32_t bitblock = bno / kMinfsBlockBits;
-    txn->Enqueue(bbm_id, bitblock, info_.abm_block + bitblock, 1);
+    block_map_.Clear(bno, bno + count);
+#ifdef __Fuchsia__
+    // They stay busy until the journal releases them.
+    journal_->Free(bno, count);
+#else
+    block_groups_.Freed(bno, count);
+    block_extents_.Freed(block_map_, bno, count);
+#endif
+    info_.alloc_block_count -= count;
+    uint32_t first = bno / kMinfsBlockBits;
+    uint32_t last = (bno + count - 1) / kMinfsBlockBits;
+    txn->Enqueue(bbm_id, first, info_.abm_block + first, last - first + 1);
     return CountUpdate(txn);
 }
 
-// Allocate a new data block from the block bitmap.
+mx_status_t Minfs::BlockFind(const RawBitmap& map, size_t hint, size_t want,
+                             size_t* out) const {
+    if ((hint < map.size()) && !map.Get(hint, hint + 1)) {
+        *out = hint;
+        return MX_OK;
+    }
+    if ((want >= kMinfsFreeExtentMin) && (block_extents_.Find(hint, want, out) == MX_OK)) {
+        return MX_OK;
+    }
+    return block_groups_.Find(map, hint, out);
+}
+
+// Allocate a run of new data blocks from the block bitmap.
 //
 // If hint is nonzero it indicates which block number to start the search for
 // free blocks from.
-mx_status_t Minfs::BlockNew(WriteTxn* txn, uint32_t hint, uint32_t* out_bno) {
+mx_status_t Minfs::BlockNew(WriteTxn* txn, uint32_t hint, uint32_t want,
+                            uint32_t* out_bno, uint32_t* out_count) {
+    MX_DEBUG_ASSERT(want > 0);
+    // Without a hint, carry on from the last block handed out rather than
+    // scanning the whole bitmap, which fills up from the front.
+    if ((hint == 0) || (hint >= block_map_.size())) {
+        hint = block_rotor_;
+    }
+
     size_t bitoff_start;
     mx_status_t status;
-    if ((status = block_map_.Find(false, hint, block_map_.size(), 1, &bitoff_start)) != MX_OK) {
-        if ((status = block_map_.Find(false, 0, hint, 1, &bitoff_start)) != MX_OK) {
+#ifdef __Fuchsia__
+    RawBitmap* busy = &block_busy_;
+    ReleaseBlocks();
+    if (BlockFind(block_busy_, hint, want, &bitoff_start) != MX_OK) {
+        // Whatever has been freed may be all that's left.
+        if ((status = journal_->Release()) != MX_OK) {
+            return status;
+        }
+        ReleaseBlocks();
+        if (BlockFind(block_busy_, hint, want, &bitoff_start) != MX_OK) {
             return MX_ERR_NO_SPACE;
         }
     }
+#else
+    RawBitmap* busy = &block_map_;
+    if ((status = BlockFind(block_map_, hint, want, &bitoff_start)) != MX_OK) {
+        return MX_ERR_NO_SPACE;
+    }
+#endif
+    // The run goes on for as long as the blocks after the first are free.
+    size_t max = mxtl::min(bitoff_start + want, busy->size());
+    size_t bitoff_end = busy->Scan(bitoff_start, max, false);
+    uint32_t bno = static_cast<uint32_t>(bitoff_start);
+    uint32_t count = static_cast<uint32_t>(bitoff_end - bitoff_start);
 
-    status = block_map_.Set(bitoff_start, bitoff_start + 1);
+#ifdef __Fuchsia__
+    block_busy_.Set(bitoff_start, bitoff_end);
+#endif
+    status = block_map_.Set(bitoff_start, bitoff_end);
     assert(status == MX_OK);
-    info_.alloc_block_count++;
-    uint32_t bno = static_cast<uint32_t>(bitoff_start);
+    block_groups_.Allocated(bitoff_start, count);
+    block_extents_.Allocated(bitoff_start, count);
+    info_.alloc_block_count += count;
     ValidateBno(bno);
+    ValidateBno(bno + count - 1);
+    block_rotor_ = bno + count;
 
-    // obtain the in-memory bitmap block
-    uint32_t bmbno_rel = bno / kMinfsBlockBits;       // bmbno relative to bitmap
-    uint32_t bmbno_abs = info_.abm_block + bmbno_rel; // bmbno relative to block device
+    // obtain the in-memory bitmap blocks
+    uint32_t first = bno / kMinfsBlockBits;             // bmbno relative to bitmap
+    uint32_t last = (bno + count - 1) / kMinfsBlockBits;
 
 // commit the bitmap
 #ifdef __Fuchsia__
-    txn->Enqueue(block_map_vmoid_, bmbno_rel, bmbno_abs, 1);
+    txn->Enqueue(block_map_vmoid_, first, info_.abm_block + first, last - first + 1);
 #else
-    void* bmdata = fs::GetBlock<kMinfsBlockSize>(block_map_.StorageUnsafe()->GetData(), bmbno_rel);
-    bc_->Writeblk(bmbno_abs, bmdata);
+    for (uint32_t n = first; n <= last; n++) {
+        void* bmdata = fs::GetBlock<kMinfsBlockSize>(block_map_.StorageUnsafe()->GetData(), n);
+        bc_->Writeblk(info_.abm_block + n, bmdata);
+    }
 #endif
-    ValidateBno(bno);
     *out_bno = bno;
+    *out_count = count;
 
     CountUpdate(txn);
     return MX_OK;
 }
 
+#ifdef __Fuchsia__
+void Minfs::ReleaseBlocks() {
+    uint32_t start, count;
+    while (journal_->TakeReleased(&start, &count)) {
+        block_busy_.Clear(start, start + count);
+        block_groups_.Freed(start, count);
+        block_extents_.Freed(block_busy_, start, count);
+    }
+}
+#endif
+
 mx_status_t Minfs::CountUpdate(WriteTxn* txn) {
     mx_status_t status = MX_OK;
 
@@ -365,6 +668,18 @@ mx_status_t Minfs::Create(Minfs** out, mxtl::unique_ptr<Bcache> bc, const minfs_
         return status;
     }
 
+    // Bring the metadata up to date before reading any of it, starting with
+    // the info block itself.
+    if ((status = minfs_journal_replay(bc.get(), info)) != MX_OK) {
+        FS_TRACE_ERROR("minfs: failed to replay journal\n");
+        return status;
+    }
+    char blk[kMinfsBlockSize];
+    if ((status = bc->Readblk(0, blk)) != MX_OK) {
+        return status;
+    }
+    info = reinterpret_cast<const minfs_info_t*>(blk);
+
     AllocChecker ac;
     mxtl::unique_ptr<Minfs> fs(new (&ac) Minfs(mxtl::move(bc), info));
     if (!ac.check()) {
@@ -438,6 +753,23 @@ mx_status_t Minfs::Create(Minfs** out, mxtl::unique_ptr<Bcache> bc, const minfs_
         return status;
     }
 
+    // From here on, metadata is written through the journal.
+    if ((status = Journal::Create(fs->bc_.get(), &fs->info_, &fs->journal_)) != MX_OK) {
+        return status;
+    }
+    if (((status = fs->journal_->RegisterVmo(fs->block_map_vmoid_,
+                                             fs->block_map_.StorageUnsafe()->GetData())) != MX_OK) ||
+        ((status = fs->journal_->RegisterVmo(fs->inode_map_vmoid_,
+                                             fs->inode_map_.StorageUnsafe()->GetData())) != MX_OK) ||
+        ((status = fs->journal_->RegisterVmo(fs->inode_table_vmoid_,
+                                             fs->inode_table_->GetData())) != MX_OK) ||
+        ((status = fs->journal_->RegisterVmo(fs->info_vmoid_,
+                                             fs->info_vmo_->GetData())) != MX_OK)) {
+        return status;
+    }
+    fs->bc_->SetJournal(fs->journal_.get());
+    fs->journal_->SetWriteback(fs.get());
+
 #else
     for (uint32_t n = 0; n < fs->abmblks_; n++) {
         void* bmdata = fs::GetBlock<kMinfsBlockSize>(fs->block_map_.StorageUnsafe()->GetData(), n);
@@ -453,11 +785,39 @@ mx_status_t Minfs::Create(Minfs** out, mxtl::unique_ptr<Bcache> bc, const minfs_
     }
 #endif
 
+#ifdef __Fuchsia__
+    // Nothing freed is waiting to be released yet.
+    size_t bits = fs->block_map_.size();
+    if ((status = fs->block_busy_.Reset(bits)) != MX_OK) {
+        return status;
+    }
+    for (size_t off = 0; off < bits;) {
+        size_t start = fs->block_map_.Scan(off, bits, false);
+        off = fs->block_map_.Scan(start, bits, true);
+        if (start < off) {
+            fs->block_busy_.Set(start, off);
+        }
+    }
+    if (((status = fs->block_groups_.Init(fs->block_busy_)) != MX_OK) ||
+        ((status = fs->block_extents_.Init(fs->block_busy_)) != MX_OK)) {
+        return status;
+    }
+#else
+    if (((status = fs->block_groups_.Init(fs->block_map_)) != MX_OK) ||
+        ((status = fs->block_extents_.Init(fs->block_map_)) != MX_OK)) {
+        return status;
+    }
+#endif
+    if ((status = fs->inode_groups_.Init(fs->inode_map_)) != MX_OK) {
+        return status;
+    }
+
     *out = fs.release();
     return MX_OK;
 }
 
-mx_status_t minfs_mount(mxtl::RefPtr<VnodeMinfs>* out, mxtl::unique_ptr<Bcache> bc) {
+mx_status_t minfs_mount(mxtl::RefPtr<VnodeMinfs>* out, mxtl::unique_ptr<Bcache> bc,
+                        const MountOptions& options) {
     mx_status_t status;
 
     char blk[kMinfsBlockSize];
@@ -473,6 +833,15 @@ mx_status_t minfs_mount(mxtl::RefPtr<VnodeMinfs>* out, mxtl::unique_ptr<Bcache>
         FS_TRACE_ERROR("minfs: mount failed\n");
         return status;
     }
+#ifdef __Fuchsia__
+    fs->SetReadaheadMax(options.readahead_max);
+#endif
+
+    if ((status = fs->SetClean(false)) != MX_OK) {
+        FS_TRACE_ERROR("minfs: cannot clear clean mark\n");
+        delete fs;
+        return status;
+    }
 
     mxtl::RefPtr<VnodeMinfs> vn;
     if ((status = fs->VnodeGet(&vn, kMinfsRootIno)) != MX_OK) {
@@ -486,10 +855,41 @@ mx_status_t minfs_mount(mxtl::RefPtr<VnodeMinfs>* out, mxtl::unique_ptr<Bcache>
     return MX_OK;
 }
 
+mx_status_t Minfs::Sync() {
+#ifdef __Fuchsia__
+    mx_status_t status;
+    if (((status = FlushDirty(nullptr)) != MX_OK) ||
+        ((status = journal_->Commit()) != MX_OK)) {
+        return status;
+    }
+#endif
+    return bc_->Sync();
+}
+
+mx_status_t Minfs::SetClean(bool clean) {
+    if (clean) {
+        info_.flags |= kMinfsFlagClean;
+    } else {
+        info_.flags &= ~kMinfsFlagClean;
+    }
+    mx_status_t status;
+    WriteTxn txn(bc_.get());
+    if (((status = CountUpdate(&txn)) != MX_OK) ||
+        ((status = txn.Flush()) != MX_OK)) {
+        return status;
+    }
+    return Sync();
+}
+
 mx_status_t Minfs::Unmount() {
 #ifdef __Fuchsia__
     dispatcher_ = nullptr;
 #endif
+    // The mark is committed along with the last of the metadata, once the
+    // file data has been flushed.
+    if (SetClean(true) != MX_OK) {
+        FS_TRACE_ERROR("minfs: cannot mark filesystem clean\n");
+    }
     // Explicitly delete this (rather than just letting the memory release when
     // the process exits) to ensure that the block device's fifo has been
     // closed.
@@ -533,7 +933,9 @@ int minfs_mkfs(mxtl::unique_ptr<Bcache> bc) {
     info.ibm_block = 8;
     info.abm_block = info.ibm_block + mxtl::roundup(ibmblks, 8u);
     info.ino_block = info.abm_block + mxtl::roundup(abmblks, 8u);
-    info.dat_block = info.ino_block + inoblks;
+    info.jnl_block = info.ino_block + inoblks;
+    info.jnl_blocks = kMinfsJournalBlocks;
+    info.dat_block = info.jnl_block + info.jnl_blocks;
     minfs_dump_info(&info);
 
     RawBitmap abm;
@@ -597,6 +999,14 @@ int minfs_mkfs(mxtl::unique_ptr<Bcache> bc) {
         bc->Writeblk(info.ino_block + n, blk);
     }
 
+    // start with an empty journal
+    memset(blk, 0, sizeof(blk));
+    bc->Writeblk(info.jnl_block + 1, blk);
+    minfs_journal_info_t* jinfo = reinterpret_cast<minfs_journal_info_t*>(&blk[0]);
+    jinfo->magic = kMinfsJournalMagic;
+    jinfo->start_seq = 1;
+    bc->Writeblk(info.jnl_block, blk);
+
     // setup root inode
     minfs_inode_t* ino = reinterpret_cast<minfs_inode_t*>(&blk[0]);
     ino[kMinfsRootIno].magic = kMinfsMagicDir;
@@ -604,7 +1014,10 @@ int minfs_mkfs(mxtl::unique_ptr<Bcache> bc) {
     ino[kMinfsRootIno].block_count = 1;
     ino[kMinfsRootIno].link_count = 2;
     ino[kMinfsRootIno].dirent_count = 2;
-    ino[kMinfsRootIno].dnum[0] = info.dat_block;
+    ino[kMinfsRootIno].extent_count = 1;
+    ino[kMinfsRootIno].extents[0].start = 0;
+    ino[kMinfsRootIno].extents[0].bno = info.dat_block;
+    ino[kMinfsRootIno].extents[0].count = 1;
     bc->Writeblk(info.ino_block, blk);
 
     memset(blk, 0, sizeof(blk));
@@ -6,6 +6,7 @@
 
 #include <bitmap/raw-bitmap.h>
 #include <bitmap/storage.h>
+#include <mxtl/flat_hash_map.h>
 #include <mxtl/intrusive_double_list.h>
 #include <mxtl/intrusive_hash_table.h>
 #include <mxtl/macros.h>
@@ -13,6 +14,7 @@
 #include <mxtl/ref_ptr.h>
 #include <mxtl/type_support.h>
 #include <mxtl/unique_free_ptr.h>
+#include <mxtl/unique_ptr.h>
 
 #include <magenta/types.h>
 
@@ -25,6 +27,9 @@
 
 #ifdef __Fuchsia__
 #include <block-client/client.h>
+#include <magenta/thread_annotations.h>
+#include <mxtl/mutex.h>
+#include <threads.h>
 using RawBitmap = bitmap::RawBitmapGeneric<bitmap::VmoStorage>;
 #else
 using RawBitmap = bitmap::RawBitmapGeneric<bitmap::DefaultStorage>;
@@ -36,7 +41,7 @@ namespace minfs {
 
 constexpr uint64_t kMinfsMagic0 = (0x002153466e694d21ULL);
 constexpr uint64_t kMinfsMagic1 = (0x385000d3d3d3d304ULL);
-constexpr uint32_t kMinfsVersion = 0x00000003;
+constexpr uint32_t kMinfsVersion = 0x00000006;
 
 constexpr uint32_t kMinfsRootIno        = 1;
 constexpr uint32_t kMinfsFlagClean      = 1;
@@ -45,12 +50,14 @@ constexpr uint32_t kMinfsBlockBits      = (kMinfsBlockSize * 8);
 constexpr uint32_t kMinfsInodeSize      = 256;
 constexpr uint32_t kMinfsInodesPerBlock = (kMinfsBlockSize / kMinfsInodeSize);
 
-constexpr uint32_t kMinfsDirect   = 16;
-constexpr uint32_t kMinfsIndirect = 32;
+// Files map their data with extents: runs of blocks which are adjacent both
+// in the file and on disk. The first few live in the inode; files with more
+// keep them in a tree of extent nodes below it.
+constexpr uint32_t kMinfsInlineExtents = 16;
 
 // not possible to have a block at or past this one
-// due to the limitations of the inode and indirect blocks
-constexpr uint64_t kMinfsMaxFileBlock = (kMinfsDirect + kMinfsIndirect * (kMinfsBlockSize / sizeof(uint32_t)));
+// due to the limitations of the inode's (byte) size
+constexpr uint64_t kMinfsMaxFileBlock = UINT32_MAX / kMinfsBlockSize;
 constexpr uint64_t kMinfsMaxFileSize  = kMinfsMaxFileBlock * kMinfsBlockSize;
 
 constexpr uint32_t kMinfsTypeFile = 8;
@@ -76,22 +83,30 @@ typedef struct {
     uint32_t abm_block;     // first blockno of block allocation bitmap
     uint32_t ino_block;     // first blockno of inode table
     uint32_t dat_block;     // first blockno available for file data
+    uint32_t jnl_block;     // first blockno of metadata journal
+    uint32_t jnl_blocks;    // number of blocks in metadata journal
 } minfs_info_t;
 
 // Notes:
-// - the ibm, abm, ino, and dat regions must be in that order
+// - the ibm, abm, ino, jnl, and dat regions must be in that order
 //   and may not overlap
 // - the abm has an entry for every block on the volume, including
 //   the info block (0), the bitmaps, etc
-// - data blocks referenced from direct and indirect block tables
-//   in inodes are also relative to (0), but it is not legal for
-//   a block number of less than dat_block (start of data blocks)
-//   to be used
+// - data blocks referenced from extents and extent nodes are also
+//   relative to (0), but it is not legal for a block number of less
+//   than dat_block (start of data blocks) to be used
 // - inode numbers refer to the inode in block:
 //     ino_block + ino / kMinfsInodesPerBlock
 //   at offset: ino % kMinfsInodesPerBlock
 // - inode 0 is never used, should be marked allocated but ignored
 
+typedef struct {
+    uint32_t start;                 // the first block of the file mapped
+    uint32_t bno;                   // the disk block it maps to, or in an
+                                    // index, the node mapping it
+    uint32_t count;                 // blocks mapped; zero in an index
+} minfs_extent_t;
+
 typedef struct {
     uint32_t magic;
     uint32_t size;
@@ -102,14 +117,44 @@ typedef struct {
     uint32_t seq_num;               // bumped when modified
     uint32_t gen_num;               // bumped when deleted
     uint32_t dirent_count;          // for directories
-    uint32_t rsvd[5];
-    uint32_t dnum[kMinfsDirect];    // direct blocks
-    uint32_t inum[kMinfsIndirect];  // indirect blocks
+    uint32_t extent_count;          // entries of extents[] in use
+    uint32_t extent_depth;          // levels of extent nodes below the inode
+    uint32_t dir_index_blocks;      // for directories: hash buckets, if indexed
+    uint32_t rsvd[2];
+    minfs_extent_t extents[kMinfsInlineExtents];
 } minfs_inode_t;
 
 static_assert(sizeof(minfs_inode_t) == kMinfsInodeSize,
               "minfs inode size is wrong");
 
+constexpr uint64_t kMinfsExtentNodeMagic = (0x65646f4e784d4d21ULL);
+
+// Levels of extent nodes a file may have. Nodes are at least half full
+// unless they're on the tree's right edge, so two would do for any file.
+constexpr uint32_t kMinfsExtentDepthMax = 3;
+
+typedef struct {
+    uint64_t magic;
+    uint32_t ino;                   // the inode whose tree this is
+    uint32_t bno;                   // where the node itself is
+    uint32_t depth;                 // levels of nodes below this one
+    uint32_t count;                 // entries in use
+    minfs_extent_t entries[];
+} minfs_extent_node_t;
+
+constexpr uint32_t kMinfsExtentsPerNode =
+    (kMinfsBlockSize - sizeof(minfs_extent_node_t)) / sizeof(minfs_extent_t);
+
+// Notes:
+// - the entries of the inode and of each node are sorted by start, and
+//   the extents of a file don't overlap; blocks not mapped are holes
+// - nodes of depth zero hold extents; the entries of those above (and of
+//   the inode, when extent_depth is nonzero) index the nodes below, which
+//   each map the blocks from their entry's start up to the next one's
+// - an index entry's start is that of the first extent below it, and no
+//   node below the inode is empty
+// - block_count counts the extent nodes along with the data blocks
+
 typedef struct {
     uint32_t ino;                   // inode number
     uint32_t reclen;                // Low 28 bits: Length of record
@@ -153,9 +198,86 @@ static_assert(kMinfsMaxDirectorySize <= kMinfsReclenMask,
 //   also increase in size.
 
 
-// blocksize   8K    16K    32K
-// 16 dir =  128K   256K   512K
-// 32 ind =  512M  1024M  2048M
+// Large directories are also indexed by the hash of their names. Each bucket
+// of the index is a block of the directory placed past its largest possible
+// size, holding the offsets of the live dirents whose names hash to it.
+constexpr uint64_t kMinfsDirBucketMagic = (0x74656b6375424421ULL);
+constexpr uint32_t kMinfsDirIndexStart = (kMinfsMaxDirectorySize + kMinfsBlockSize - 1) /
+                                         kMinfsBlockSize;
+constexpr uint32_t kMinfsDirIndexMaxBlocks = 128;
+
+typedef struct {
+    uint32_t hash;                  // of the name (see MinfsDirHash)
+    uint32_t off;                   // of the dirent within the directory
+} minfs_dir_hash_t;
+
+typedef struct {
+    uint64_t magic;
+    uint32_t ino;                   // the directory this is of
+    uint32_t count;                 // entries in use
+    minfs_dir_hash_t entries[];
+} minfs_dir_bucket_t;
+
+constexpr uint32_t kMinfsDirBucketEntries =
+    (kMinfsBlockSize - sizeof(minfs_dir_bucket_t)) / sizeof(minfs_dir_hash_t);
+
+// The bucket of |blocks| a hash belongs in. The index grows (by linear
+// hashing) a bucket at a time: the next is split off the bucket |blocks|
+// less the largest power of two not above it.
+static inline uint32_t MinfsDirBucket(uint32_t hash, uint32_t blocks) {
+    uint32_t level = 1;
+    while (level <= blocks / 2) {
+        level *= 2;
+    }
+    uint32_t b = hash & (2 * level - 1);
+    return (b < blocks) ? b : (hash & (level - 1));
+}
+
+// Notes:
+// - a directory is indexed when dir_index_blocks is nonzero; its buckets
+//   are its blocks from kMinfsDirIndexStart, and count towards block_count
+//   but not its size
+// - every live dirent is in the bucket of its name's hash just once, and
+//   the entries of a bucket are in no particular order
+
+
+// Metadata journal
+//
+// Every metadata block (the info block, the bitmaps and the inode table
+// before dat_block, and directory blocks and extent nodes after it) is
+// written to the journal before it is written in place. The first block of
+// the journal holds a minfs_journal_info_t, and the rest a sequence of
+// entries: a header block followed by a copy of each block the header names,
+// in order.
+//
+// Entries start in the block after the journal info, and are numbered
+// consecutively from start_seq. An entry is valid only if its sequence number
+// is the next one expected and its checksum holds, so the first one that
+// isn't ends the journal. Once the blocks of the entries have been written in
+// place, start_seq is moved past them and new entries start over at the
+// beginning.
+
+constexpr uint64_t kMinfsJournalMagic      = (0x6c6e72756f4a4d21ULL);
+constexpr uint64_t kMinfsJournalEntryMagic = (0x7972746e454a4d21ULL);
+constexpr uint32_t kMinfsJournalBlocks     = 256;
+
+typedef struct {
+    uint64_t magic;
+    uint64_t start_seq;     // sequence number of the first live entry
+} minfs_journal_info_t;
+
+typedef struct {
+    uint64_t magic;
+    uint64_t seq;
+    uint64_t checksum;      // fnv1a64 of the header (with a zero checksum)
+                            // followed by each of the blocks
+    uint32_t block_count;   // blocks following the header
+    uint32_t reserved;
+    uint32_t bno[];         // where each of those blocks belongs
+} minfs_journal_entry_t;
+
+constexpr uint32_t kMinfsJournalEntryMax =
+    (kMinfsBlockSize - sizeof(minfs_journal_entry_t)) / sizeof(uint32_t);
 
 //  1GB ->  128K blocks ->  16K bitmap (2K qword)
 //  4GB ->  512K blocks ->  64K bitmap (8K qword)
@@ -164,6 +286,8 @@ static_assert(kMinfsMaxDirectorySize <= kMinfsReclenMask,
 // Block Cache (bcache.c)
 constexpr uint32_t kMinfsHashBits = (8);
 
+class Journal;
+
 class Bcache {
 public:
     DISALLOW_COPY_ASSIGN_AND_MOVE(Bcache);
@@ -171,21 +295,35 @@ public:
 
     static mx_status_t Create(mxtl::unique_ptr<Bcache>* out, int fd, uint32_t blockmax);
 
-    // Raw block read functions.
-    // These do not track blocks (or attempt to access the block cache)
+    // Single block reads and writes, through a small cache of the most
+    // recently used blocks. On Fuchsia, written blocks stay in the cache until
+    // they are evicted or Sync() is called. The host tools may exit without
+    // ever unmounting, so there writes also go straight through to the image.
     mx_status_t Readblk(uint32_t bno, void* data);
     mx_status_t Writeblk(uint32_t bno, const void* data);
+    // Reads |count| adjacent blocks at once, straight from the device rather
+    // than through the cache, for bulk scans.
+    mx_status_t Readblks(uint32_t bno, uint32_t count, void* data);
 
     uint32_t Maxblk() const { return blockmax_; };
 
 #ifdef __Fuchsia__
     mx_status_t AttachVmo(mx_handle_t vmo, vmoid_t* out);
-    mx_status_t Txn(block_fifo_request_t* requests, size_t count) {
-        return block_fifo_txn(fifo_client_, requests, count);
-    }
-    txnid_t TxnId() const { return txnid_; }
+    // Reads and writes are handed to the journal, once there is one.
+    mx_status_t Txn(block_fifo_request_t* requests, size_t count);
+    // Issues requests straight to the device, as a transaction of their own,
+    // so that several threads can have requests outstanding at once.
+    mx_status_t RawTxn(block_fifo_request_t* requests, size_t count);
+    // Requests may be stamped with this; RawTxn picks their transaction.
+    txnid_t TxnId() const { return txns_[0]; }
+    // Makes every write which has completed durable on the device.
+    mx_status_t Flush();
+    void SetJournal(Journal* journal) { journal_ = journal; }
+    // Whether the device frees what BLOCKIO_DISCARD asks it to.
+    bool CanDiscard() const { return discard_; }
 #endif
 
+    // Writes back the dirty cached blocks, then flushes the device.
     int Sync();
 
     ~Bcache();
@@ -193,10 +331,47 @@ public:
 private:
     Bcache(int fd, uint32_t blockmax);
 
+    // Blocks kept by the cache, and the longest run of adjacent dirty blocks
+    // written back with a single request.
+    static constexpr uint32_t kCacheBlocks = 256;
+    static constexpr uint32_t kCacheRunMax = 64;
+
+    struct CachedBlock : public mxtl::DoublyLinkedListable<mxtl::unique_ptr<CachedBlock>> {
+        uint32_t bno;
+        bool dirty;
+        uint8_t data[kMinfsBlockSize];
+    };
+
+    // Finds |bno| in the cache, or makes room for it, in which case the
+    // block's data is left for the caller to fill.
+    mx_status_t CacheLookupLocked(uint32_t bno, CachedBlock** out, bool* hit);
+    mx_status_t CacheFlushLocked();
+#ifdef __Fuchsia__
+    // Keeps the cache coherent with requests sent straight to the device.
+    mx_status_t CacheSyncRequestsLocked(const block_fifo_request_t* requests, size_t count);
+#endif
+
 #ifdef __Fuchsia__
-    fifo_client_t* fifo_client_; // Fast path to interact with block device
-    txnid_t txnid_; // TODO(smklein): One per thread
+    // Enough transactions for each dispatcher thread and the journal's.
+    static constexpr uint32_t kTxnCount = 8;
+
+    fifo_client_t* fifo_client_ = nullptr; // Fast path to interact with block device
+    txnid_t txns_[kTxnCount];
+    uint32_t txn_count_ = 0;
+    mxtl::Mutex txn_lock_;
+    cnd_t txn_free_;
+    uint32_t free_count_ TA_GUARDED(txn_lock_) = 0;
+    txnid_t free_txns_[kTxnCount] TA_GUARDED(txn_lock_);
+    Journal* journal_ = nullptr;
+    bool discard_ = false;
+
+    // Guards the cache below. Taken before txn_lock_.
+    mxtl::Mutex cache_lock_;
 #endif
+    // Most recently used first.
+    mxtl::DoublyLinkedList<mxtl::unique_ptr<CachedBlock>> cache_lru_;
+    mxtl::FlatHashMap<uint32_t, CachedBlock*> cache_;
+    uint32_t cache_dirty_ = 0;
     int fd_;
     uint32_t blockmax_;
 };
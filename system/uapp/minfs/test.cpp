@@ -16,6 +16,7 @@
 #include <magenta/compiler.h>
 
 #include "host.h"
+#include "minfs-private.h"
 #include "misc.h"
 
 #define TRY(func) ({\
@@ -305,6 +306,415 @@ int test_rename() {
     return 0;
 }
 
+// Writes a journal entry for one block of |fill| bytes destined for |bno|,
+// starting at journal block |pos|. A torn entry has its block cut short.
+static int write_journal_entry(minfs::Bcache* bc, const minfs::minfs_info_t* info,
+                               uint32_t pos, uint64_t seq, uint32_t bno, uint8_t fill,
+                               bool torn) {
+    uint8_t hdr[minfs::kMinfsBlockSize];
+    uint8_t blk[minfs::kMinfsBlockSize];
+    memset(hdr, 0, sizeof(hdr));
+    memset(blk, fill, sizeof(blk));
+    minfs::minfs_journal_entry_t* entry = reinterpret_cast<minfs::minfs_journal_entry_t*>(hdr);
+    entry->magic = minfs::kMinfsJournalEntryMagic;
+    entry->seq = seq;
+    entry->block_count = 1;
+    entry->bno[0] = bno;
+    entry->checksum = minfs::minfs_journal_checksum(entry, blk);
+    if (torn) {
+        memset(blk + sizeof(blk) / 2, 0, sizeof(blk) / 2);
+    }
+    TRY(bc->Writeblk(info->jnl_block + pos, hdr));
+    TRY(bc->Writeblk(info->jnl_block + pos + 1, blk));
+    return 0;
+}
+
+static bool block_filled(minfs::Bcache* bc, uint32_t bno, uint8_t fill) {
+    uint8_t blk[minfs::kMinfsBlockSize];
+    if (bc->Readblk(bno, blk) != MX_OK) {
+        return false;
+    }
+    for (size_t i = 0; i < sizeof(blk); i++) {
+        if (blk[i] != fill) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// A committed entry is replayed, and one torn part way through its commit,
+// along with anything after it, is dropped.
+int test_journal_replay() {
+    constexpr uint32_t kBlocks = 2048;
+    char path[] = "/tmp/minfs-journal-XXXXXX";
+    int fd = TRY(mkstemp(path));
+    TRY(ftruncate(fd, static_cast<off_t>(kBlocks) * minfs::kMinfsBlockSize));
+
+    mxtl::unique_ptr<minfs::Bcache> bc;
+    TRY(minfs::Bcache::Create(&bc, fd, kBlocks));
+    TRY(minfs::minfs_mkfs(mxtl::move(bc)));
+
+    fd = TRY(open(path, O_RDWR));
+    TRY(minfs::Bcache::Create(&bc, fd, kBlocks));
+    uint8_t blk[minfs::kMinfsBlockSize];
+    TRY(bc->Readblk(0, blk));
+    minfs::minfs_info_t info;
+    memcpy(&info, blk, sizeof(info));
+    TRY(bc->Readblk(info.jnl_block, blk));
+    uint64_t seq = reinterpret_cast<minfs::minfs_journal_info_t*>(blk)->start_seq;
+
+    // Two blocks at the end of the inode table, which mkfs left zeroed.
+    uint32_t committed = info.jnl_block - 1;
+    uint32_t torn = info.jnl_block - 2;
+    TRY(write_journal_entry(bc.get(), &info, 1, seq, committed, 0xa5, false));
+    TRY(write_journal_entry(bc.get(), &info, 3, seq + 1, torn, 0x5a, true));
+    TRY(write_journal_entry(bc.get(), &info, 5, seq + 2, torn, 0x3c, false));
+
+    TRY(minfs::minfs_journal_replay(bc.get(), &info));
+    int r = 0;
+    if (!block_filled(bc.get(), committed, 0xa5)) {
+        fprintf(stderr, "committed journal entry was not replayed\n");
+        r = -1;
+    }
+    if (!block_filled(bc.get(), torn, 0)) {
+        fprintf(stderr, "torn journal entry was replayed\n");
+        r = -1;
+    }
+    TRY(bc->Readblk(info.jnl_block, blk));
+    if (reinterpret_cast<minfs::minfs_journal_info_t*>(blk)->start_seq != seq + 1) {
+        fprintf(stderr, "journal was not retired past the committed entry\n");
+        r = -1;
+    }
+
+    // What was retired isn't replayed again.
+    TRY(bc->Writeblk(committed, memset(blk, 0, sizeof(blk))));
+    TRY(minfs::minfs_journal_replay(bc.get(), &info));
+    if (!block_filled(bc.get(), committed, 0)) {
+        fprintf(stderr, "retired journal entry was replayed\n");
+        r = -1;
+    }
+
+    bc.reset();
+    unlink(path);
+    return r;
+}
+
+// Blocks written through the cache are in the image straight away, without
+// waiting for a sync, which the host tools may never get to.
+int test_bcache() {
+    constexpr uint32_t kBlocks = 16;
+    char path[] = "/tmp/minfs-bcache-XXXXXX";
+    int fd = TRY(mkstemp(path));
+    TRY(ftruncate(fd, static_cast<off_t>(kBlocks) * minfs::kMinfsBlockSize));
+    int raw = TRY(open(path, O_RDONLY));
+
+    mxtl::unique_ptr<minfs::Bcache> bc;
+    TRY(minfs::Bcache::Create(&bc, fd, kBlocks));
+    uint8_t blk[minfs::kMinfsBlockSize];
+    uint8_t back[minfs::kMinfsBlockSize];
+    int r = 0;
+    for (uint32_t bno = 0; bno < kBlocks; bno++) {
+        memset(blk, bno + 1, sizeof(blk));
+        TRY(bc->Writeblk(bno, blk));
+        // once more, now that the block is cached
+        memset(blk, bno + 0x80, sizeof(blk));
+        TRY(bc->Writeblk(bno, blk));
+        off_t off = static_cast<off_t>(bno) * minfs::kMinfsBlockSize;
+        if ((pread(raw, back, sizeof(back), off) != sizeof(back)) ||
+            memcmp(blk, back, sizeof(blk))) {
+            fprintf(stderr, "block %u was not written through\n", bno);
+            r = -1;
+        }
+        TRY(bc->Readblk(bno, back));
+        if (memcmp(blk, back, sizeof(blk))) {
+            fprintf(stderr, "block %u read back wrong\n", bno);
+            r = -1;
+        }
+    }
+
+    close(raw);
+    bc.reset();
+    unlink(path);
+    return r;
+}
+
+static void fill_block(uint8_t* blk, uint32_t file, uint32_t n) {
+    memset(blk, static_cast<uint8_t>(n * 7 + file), minfs::kMinfsBlockSize);
+    memcpy(blk, &n, sizeof(n));
+    memcpy(blk + sizeof(n), &file, sizeof(file));
+}
+
+// Files written a block at a time in turn are fragmented into far more
+// extents than fit in their inodes, and need a tree of extent nodes; one
+// written with holes too, as nothing merges across them.
+int test_extents() {
+    constexpr uint32_t kFiles = 3;
+    constexpr uint32_t kBlocks = 2048;
+    const char* names[kFiles] = { "::extent0", "::extent1", "::extent2" };
+    int fds[kFiles];
+    for (uint32_t f = 0; f < kFiles; f++) {
+        fds[f] = TRY(emu_open(names[f], O_RDWR | O_CREAT | O_EXCL, 0644));
+    }
+
+    uint8_t blk[minfs::kMinfsBlockSize];
+    uint8_t back[minfs::kMinfsBlockSize];
+    for (uint32_t n = 0; n < kBlocks; n++) {
+        for (uint32_t f = 0; f < kFiles; f++) {
+            // the last file only has the odd blocks
+            if ((f == kFiles - 1) && !(n % 2)) {
+                continue;
+            }
+            fill_block(blk, f, n);
+            TRY(emu_lseek(fds[f], static_cast<off_t>(n) * sizeof(blk), SEEK_SET));
+            if (TRY(emu_write(fds[f], blk, sizeof(blk))) != sizeof(blk)) {
+                fprintf(stderr, "short write of block %u of file %u\n", n, f);
+                return -1;
+            }
+        }
+    }
+
+    int r = 0;
+    for (uint32_t f = 0; f < kFiles; f++) {
+        TRY(emu_lseek(fds[f], 0, SEEK_SET));
+        for (uint32_t n = 0; n < kBlocks; n++) {
+            if ((f == kFiles - 1) && !(n % 2)) {
+                memset(blk, 0, sizeof(blk));
+            } else {
+                fill_block(blk, f, n);
+            }
+            if ((TRY(emu_read(fds[f], back, sizeof(back))) != sizeof(back)) ||
+                memcmp(blk, back, sizeof(blk))) {
+                fprintf(stderr, "block %u of file %u read back wrong\n", n, f);
+                r = -1;
+                break;
+            }
+        }
+    }
+
+    // Holes among the extents are filled in where they are
+    fill_block(blk, kFiles - 1, 2);
+    TRY(emu_lseek(fds[kFiles - 1], 2 * sizeof(blk), SEEK_SET));
+    TRY(emu_write(fds[kFiles - 1], blk, sizeof(blk)));
+    TRY(emu_lseek(fds[kFiles - 1], 2 * sizeof(blk), SEEK_SET));
+    if ((TRY(emu_read(fds[kFiles - 1], back, sizeof(back))) != sizeof(back)) ||
+        memcmp(blk, back, sizeof(blk))) {
+        fprintf(stderr, "filled hole read back wrong\n");
+        r = -1;
+    }
+
+    for (uint32_t f = 0; f < kFiles; f++) {
+        emu_close(fds[f]);
+    }
+
+    // Truncating frees the tree along with the blocks, and the file can
+    // grow again from nothing
+    int fd = TRY(emu_open(names[1], O_RDWR | O_TRUNC, 0644));
+    fill_block(blk, 1, 0);
+    TRY(emu_write(fd, blk, sizeof(blk)));
+    TRY(emu_lseek(fd, 0, SEEK_SET));
+    if ((TRY(emu_read(fd, back, sizeof(back))) != sizeof(back)) ||
+        memcmp(blk, back, sizeof(blk)) || (TRY(emu_read(fd, back, sizeof(back))) != 0)) {
+        fprintf(stderr, "truncated file read back wrong\n");
+        r = -1;
+    }
+    emu_close(fd);
+
+    // Leave one behind, for minfs-check to walk
+    for (uint32_t f = 1; f < kFiles; f++) {
+        TRY(emu_unlink(names[f]));
+    }
+    return r;
+}
+
+// Writes |blocks| blocks of file |file| to |fd| from its start, |chunk| at a
+// time, stopping early if the disk fills up. Returns how many were written.
+static uint32_t write_blocks(int fd, uint32_t file, uint32_t blocks, uint8_t* chunk,
+                             uint32_t chunk_blocks) {
+    uint32_t written = 0;
+    while (written < blocks) {
+        uint32_t n = mxtl::min(chunk_blocks, blocks - written);
+        for (uint32_t i = 0; i < n; i++) {
+            fill_block(chunk + i * minfs::kMinfsBlockSize, file, written + i);
+        }
+        ssize_t r = emu_write(fd, chunk, n * minfs::kMinfsBlockSize);
+        written += (r > 0) ? static_cast<uint32_t>(r / minfs::kMinfsBlockSize) : 0;
+        if (r != static_cast<ssize_t>(n * minfs::kMinfsBlockSize)) {
+            break;
+        }
+    }
+    return written;
+}
+
+static int check_blocks(int fd, uint32_t file, uint32_t blocks) {
+    uint8_t blk[minfs::kMinfsBlockSize];
+    uint8_t back[minfs::kMinfsBlockSize];
+    TRY(emu_lseek(fd, 0, SEEK_SET));
+    for (uint32_t n = 0; n < blocks; n++) {
+        fill_block(blk, file, n);
+        if ((TRY(emu_read(fd, back, sizeof(back))) != sizeof(back)) ||
+            memcmp(blk, back, sizeof(blk))) {
+            fprintf(stderr, "block %u of file %u read back wrong\n", n, file);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// A disk which has been filled with files of all sizes, and then had some of
+// them deleted, so that what's free is in holes of all sizes. Files written
+// over it in big writes, one to fill some of the holes and one the rest, must
+// still read back right; the holes are left for minfs-check to walk.
+int test_alloc() {
+    constexpr uint32_t kMaxFiles = 4096;
+    constexpr uint32_t kChunkBlocks = 32;
+    constexpr uint32_t kSomeBlocks = 512;
+    static uint8_t chunk[kChunkBlocks * minfs::kMinfsBlockSize];
+    char name[32];
+    uint32_t files;
+    for (files = 0; files < kMaxFiles; files++) {
+        snprintf(name, sizeof(name), "::fill%u", files);
+        int fd = TRY(emu_open(name, O_RDWR | O_CREAT | O_EXCL, 0644));
+        uint32_t blocks = files % 24 + 1;
+        bool full = (write_blocks(fd, files, blocks, chunk, 1) != blocks);
+        emu_close(fd);
+        if (full) {
+            TRY(emu_unlink(name));
+            break;
+        }
+    }
+    if (files == kMaxFiles) {
+        fprintf(stderr, "disk never filled up\n");
+        return -1;
+    }
+    // Every third file goes, and now and then a few in a row.
+    for (uint32_t f = 0; f < files; f++) {
+        if ((f % 3 == 0) || (f % 40 < 3)) {
+            snprintf(name, sizeof(name), "::fill%u", f);
+            TRY(emu_unlink(name));
+        }
+    }
+
+    int some = TRY(emu_open("::some", O_RDWR | O_CREAT | O_EXCL, 0644));
+    int rest = TRY(emu_open("::rest", O_RDWR | O_CREAT | O_EXCL, 0644));
+    int r = 0;
+    uint32_t written = write_blocks(some, files, kSomeBlocks, chunk, kChunkBlocks);
+    if (written != kSomeBlocks) {
+        fprintf(stderr, "only %u blocks could be written to the holes\n", written);
+        r = -1;
+    } else if (check_blocks(some, files, kSomeBlocks) < 0) {
+        r = -1;
+    } else {
+        written = write_blocks(rest, files + 1, UINT32_MAX, chunk, kChunkBlocks);
+        if (check_blocks(rest, files + 1, written) < 0) {
+            r = -1;
+        }
+    }
+    emu_close(some);
+    emu_close(rest);
+    return r;
+}
+
+// Reads the names in |path| other than "." and "..", in Readdir order.
+static int list_dir(const char* path, char (*names)[NAME_MAX + 1], uint32_t max,
+                    uint32_t* count) {
+    DIR* d = emu_opendir(path);
+    if (d == nullptr) {
+        return -1;
+    }
+    struct dirent* de;
+    *count = 0;
+    while ((de = emu_readdir(d)) != nullptr) {
+        if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")) {
+            continue;
+        } else if (*count == max) {
+            emu_closedir(d);
+            return -1;
+        }
+        strcpy(names[(*count)++], de->d_name);
+    }
+    emu_closedir(d);
+    return 0;
+}
+
+int test_dirindex() {
+    // Enough to be indexed, and to split buckets off a few times over
+    constexpr uint32_t kNames = 3000;
+    static char listed[kNames][NAME_MAX + 1];
+    static char relisted[kNames][NAME_MAX + 1];
+    char path[64];
+
+    TRY(emu_mkdir("::dirindex", 0755));
+    for (uint32_t n = 0; n < kNames; n++) {
+        snprintf(path, sizeof(path), "::dirindex/name%u", n);
+        emu_close(TRY(emu_open(path, O_RDWR | O_CREAT | O_EXCL, 0644)));
+    }
+
+    // Every name is found, and none twice
+    int r = 0;
+    for (uint32_t n = 0; n < kNames; n++) {
+        snprintf(path, sizeof(path), "::dirindex/name%u", n);
+        int fd = emu_open(path, O_RDWR, 0644);
+        if (fd < 0) {
+            fprintf(stderr, "%s not found\n", path);
+            r = -1;
+        } else {
+            emu_close(fd);
+        }
+        EXPECT_FAIL(emu_open(path, O_RDWR | O_CREAT | O_EXCL, 0644));
+    }
+    EXPECT_FAIL(emu_open("::dirindex/name", O_RDWR, 0644));
+
+    uint32_t count;
+    TRY(list_dir("::dirindex", listed, kNames, &count));
+    if (count != kNames) {
+        fprintf(stderr, "listed %u of %u names\n", count, kNames);
+        return -1;
+    }
+
+    // Unlinking goes through the index too, and leaves the others where they
+    // were in Readdir order
+    for (uint32_t n = 0; n < kNames; n += 3) {
+        snprintf(path, sizeof(path), "::dirindex/name%u", n);
+        TRY(emu_unlink(path));
+    }
+    for (uint32_t n = 0; n < kNames; n++) {
+        snprintf(path, sizeof(path), "::dirindex/name%u", n);
+        int fd = emu_open(path, O_RDWR, 0644);
+        if ((fd >= 0) != (n % 3 != 0)) {
+            fprintf(stderr, "%s %s after unlinking\n", path, (fd >= 0) ? "found" : "lost");
+            r = -1;
+        }
+        if (fd >= 0) {
+            emu_close(fd);
+        }
+    }
+    uint32_t recount;
+    TRY(list_dir("::dirindex", relisted, kNames, &recount));
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        unsigned n = static_cast<unsigned>(atoi(listed[i] + strlen("name")));
+        if (n % 3 == 0) {
+            continue;
+        } else if ((kept >= recount) || strcmp(listed[i], relisted[kept])) {
+            fprintf(stderr, "Readdir order changed at %s\n", listed[i]);
+            return -1;
+        }
+        kept++;
+    }
+    if (kept != recount) {
+        fprintf(stderr, "listed %u names, expected %u\n", recount, kept);
+        r = -1;
+    }
+
+    // The names freed can be taken again; leave the directory for
+    // minfs-check
+    for (uint32_t n = 0; n < kNames; n += 3) {
+        snprintf(path, sizeof(path), "::dirindex/name%u", n);
+        emu_close(TRY(emu_open(path, O_RDWR | O_CREAT | O_EXCL, 0644)));
+    }
+    return r;
+}
+
 int run_fs_tests(int argc, char** argv) {
     fprintf(stderr, "--- fs tests ---\n");
     if (argc > 0) {
@@ -320,6 +730,21 @@ int run_fs_tests(int argc, char** argv) {
         if (!strcmp(argv[0], "rename")) {
             return test_rename();
         }
+        if (!strcmp(argv[0], "bcache")) {
+            return test_bcache();
+        }
+        if (!strcmp(argv[0], "journal")) {
+            return test_journal_replay();
+        }
+        if (!strcmp(argv[0], "extents")) {
+            return test_extents();
+        }
+        if (!strcmp(argv[0], "dirindex")) {
+            return test_dirindex();
+        }
+        if (!strcmp(argv[0], "alloc")) {
+            return test_alloc();
+        }
         fprintf(stderr, "unknown test: %s\n", argv[0]);
         return -1;
     }
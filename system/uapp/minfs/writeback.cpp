@@ -0,0 +1,125 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stdint.h>
+#include <string.h>
+
+#include <fs/trace.h>
+#include <mxtl/auto_lock.h>
+
+#include "minfs-private.h"
+
+namespace minfs {
+
+mx_status_t Minfs::MarkDirty(VnodeMinfs* vn, uint32_t n, uint32_t bno) {
+    mxtl::AutoLock lock(&writeback_lock_);
+
+    // Small writes tend to land in the block written last, so look there first
+    for (size_t i = dirty_count_; i-- > 0;) {
+        if ((dirty_[i].vn == vn) && (dirty_[i].n == n)) {
+            dirty_[i].bno = bno;
+            return MX_OK;
+        }
+    }
+
+    if (dirty_count_ == kMinfsDirtyBlocksMax) {
+        mx_status_t status;
+        if ((status = FlushDirtyLocked(nullptr)) != MX_OK) {
+            return status;
+        }
+    }
+    dirty_[dirty_count_].vn = vn;
+    dirty_[dirty_count_].n = n;
+    dirty_[dirty_count_].bno = bno;
+    dirty_count_++;
+    return MX_OK;
+}
+
+void Minfs::DiscardDirty(VnodeMinfs* vn, uint32_t start) {
+    mxtl::AutoLock lock(&writeback_lock_);
+    size_t kept = 0;
+    for (size_t i = 0; i < dirty_count_; i++) {
+        if ((dirty_[i].vn != vn) || (dirty_[i].n < start)) {
+            dirty_[kept++] = dirty_[i];
+        }
+    }
+    dirty_count_ = kept;
+}
+
+mx_status_t Minfs::FlushDirty(VnodeMinfs* vn) {
+    mxtl::AutoLock lock(&writeback_lock_);
+    return FlushDirtyLocked(vn);
+}
+
+mx_status_t Minfs::FlushDirtyLocked(VnodeMinfs* vn) {
+    // Move the blocks to write to the front, ordered by vnode and position,
+    // so that runs of them can go out as single requests.
+    size_t count = 0;
+    for (size_t i = 0; i < dirty_count_; i++) {
+        if ((vn != nullptr) && (dirty_[i].vn != vn)) {
+            continue;
+        }
+        DirtyBlock b = dirty_[i];
+        dirty_[i] = dirty_[count];
+        size_t j = count++;
+        for (; (j > 0) && ((dirty_[j - 1].vn > b.vn) ||
+                           ((dirty_[j - 1].vn == b.vn) && (dirty_[j - 1].n > b.n))); j--) {
+            dirty_[j] = dirty_[j - 1];
+        }
+        dirty_[j] = b;
+    }
+    if (count == 0) {
+        return MX_OK;
+    }
+
+    mx_status_t status;
+    block_fifo_request_t requests[MAX_TXN_MESSAGES];
+    size_t reqs = 0;
+    uint64_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        // The block map isn't looked at here, as the vnode's operations may
+        // be changing it.
+        VnodeMinfs* dvn = dirty_[i].vn;
+        uint64_t vmo_offset = dirty_[i].n * static_cast<uint64_t>(kMinfsBlockSize);
+        uint64_t dev_offset = dirty_[i].bno * static_cast<uint64_t>(kMinfsBlockSize);
+
+        // Extend the last request if this block follows it in both the VMO
+        // and on disk
+        if (reqs > 0) {
+            block_fifo_request_t* last = &requests[reqs - 1];
+            if ((last->vmoid == dvn->vmoid_) &&
+                (last->vmo_offset + last->length == vmo_offset) &&
+                (last->dev_offset + last->length == dev_offset)) {
+                last->length += kMinfsBlockSize;
+                continue;
+            }
+            if (reqs == MAX_TXN_MESSAGES) {
+                if ((status = bc_->RawTxn(requests, reqs)) != MX_OK) {
+                    return status;
+                }
+                total += reqs;
+                reqs = 0;
+            }
+        }
+        requests[reqs].txnid = bc_->TxnId();
+        requests[reqs].vmoid = dvn->vmoid_;
+        requests[reqs].opcode = BLOCKIO_WRITE;
+        requests[reqs].length = kMinfsBlockSize;
+        requests[reqs].vmo_offset = vmo_offset;
+        requests[reqs].dev_offset = dev_offset;
+        reqs++;
+    }
+    if ((status = bc_->RawTxn(requests, reqs)) != MX_OK) {
+        return status;
+    }
+    total += reqs;
+
+    writeback_blocks_ += count;
+    writeback_requests_ += total;
+    dirty_count_ -= count;
+    memmove(&dirty_[0], &dirty_[count], dirty_count_ * sizeof(DirtyBlock));
+    return MX_OK;
+}
+
+} // namespace minfs
@@ -0,0 +1,676 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Measures what an ethernet device and its driver sustain, through the
+// fifo interface the network stack itself uses:
+//   tx   frames sent per second, and the cpu each costs, over a range of
+//        frame sizes
+//   rx   frames received per second from whatever sends them
+//   rtt  round trip times of probes bounced off netreflector
+
+#include <inet6/inet6.h>
+#include <magenta/device/ethernet.h>
+#include <magenta/device/sysinfo.h>
+#include <magenta/process.h>
+#include <magenta/syscalls.h>
+#include <magenta/syscalls/object.h>
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BUFSIZE 2048
+// of each of rx and tx
+#define BUFS 256
+
+// the ports netreflector reflects
+#define SRC_PORT 5004
+#define DST_PORT 5005
+
+#define PROBE_MAGIC 0x6e657462
+
+#define HDRS_LEN (ETH_HDR_LEN + IP6_HDR_LEN + UDP_HDR_LEN)
+#define MAX_SIZES 16
+#define MAX_CPUS 32
+
+// preamble, start of frame, frame check sequence and inter-frame gap
+#define WIRE_OVERHEAD 24
+
+typedef struct {
+    mac_addr_t dst;
+    mac_addr_t src;
+    uint16_t type;
+} __PACKED eth_hdr_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+    mx_time_t sent;
+} __PACKED probe_t;
+
+typedef struct {
+    eth_fifos_t fifos;
+    uint8_t* iobuf;
+    mac_addr_t mac;
+    mac_addr_t dst;
+    uint32_t mtu;
+    // tx buffers not in flight, by index
+    uint32_t tx_free[BUFS];
+    uint32_t tx_free_count;
+    uint32_t tx_in_flight;
+} bench_t;
+
+typedef struct {
+    mx_time_t time;
+    mx_time_t idle;
+    mx_time_t thread;
+    size_t cpus;
+} cpu_sample_t;
+
+static mx_handle_t root_resource = MX_HANDLE_INVALID;
+
+static void cpu_sample(cpu_sample_t* s) {
+    s->time = mx_time_get(MX_CLOCK_MONOTONIC);
+    s->idle = 0;
+    s->cpus = 0;
+    if (root_resource != MX_HANDLE_INVALID) {
+        mx_info_cpu_stats_t stats[MAX_CPUS];
+        size_t actual, avail;
+        if (mx_object_get_info(root_resource, MX_INFO_CPU_STATS, stats, sizeof(stats),
+                               &actual, &avail) == MX_OK) {
+            for (size_t i = 0; i < actual; i++) {
+                s->idle += stats[i].idle_time;
+            }
+            s->cpus = actual;
+        }
+    }
+    mx_info_thread_stats_t ts;
+    s->thread = 0;
+    if (mx_object_get_info(mx_thread_self(), MX_INFO_THREAD_STATS, &ts, sizeof(ts),
+                           NULL, NULL) == MX_OK) {
+        s->thread = ts.total_runtime;
+    }
+}
+
+static void print_cpu(const cpu_sample_t* a, const cpu_sample_t* b, uint64_t packets) {
+    if (packets == 0) {
+        return;
+    }
+    printf("   cpu:");
+    if (b->cpus != 0) {
+        // the driver, the ethernet layer and this, and whatever else runs
+        mx_time_t busy = (b->time - a->time) * b->cpus - (b->idle - a->idle);
+        printf(" %.3f us/packet in all, busy %.1f%% of %zu cpus,",
+               (double)busy / 1000.0 / (double)packets,
+               100.0 * (double)busy / (double)((b->time - a->time) * b->cpus), b->cpus);
+    }
+    printf(" %.3f us/packet in netbench\n",
+           (double)(b->thread - a->thread) / 1000.0 / (double)packets);
+}
+
+static void ll6addr(ip6_addr_t* ip, const mac_addr_t* mac) {
+    memset(ip, 0, sizeof(*ip));
+    ip->u8[0] = 0xFE;
+    ip->u8[1] = 0x80;
+    ip->u8[8] = mac->x[0] ^ 2;
+    ip->u8[9] = mac->x[1];
+    ip->u8[10] = mac->x[2];
+    ip->u8[11] = 0xFF;
+    ip->u8[12] = 0xFE;
+    ip->u8[13] = mac->x[3];
+    ip->u8[14] = mac->x[4];
+    ip->u8[15] = mac->x[5];
+}
+
+// Builds a UDP over IPv6 frame of |len| bytes, as netreflector reflects,
+// with |probe| at the start of its payload if given.
+static void build_frame(bench_t* b, uint8_t* frame, size_t len, const probe_t* probe) {
+    memset(frame, 0, len);
+    eth_hdr_t* eth = (eth_hdr_t*)frame;
+    eth->dst = b->dst;
+    eth->src = b->mac;
+    eth->type = htons(ETH_IP6);
+
+    ip6_hdr_t* ip = (ip6_hdr_t*)(frame + ETH_HDR_LEN);
+    size_t udp_len = len - ETH_HDR_LEN - IP6_HDR_LEN;
+    ip->ver_tc_flow = 0x60;
+    ip->length = htons(udp_len);
+    ip->next_header = HDR_UDP;
+    ip->hop_limit = 255;
+    ll6addr(&ip->src, &b->mac);
+    ll6addr(&ip->dst, &b->dst);
+
+    udp_hdr_t* udp = (udp_hdr_t*)(frame + ETH_HDR_LEN + IP6_HDR_LEN);
+    udp->src_port = htons(SRC_PORT);
+    udp->dst_port = htons(DST_PORT);
+    udp->length = htons(udp_len);
+    if (probe != NULL) {
+        memcpy(frame + HDRS_LEN, probe, sizeof(*probe));
+    }
+    udp->checksum = ip6_checksum(ip, HDR_UDP, udp_len);
+}
+
+static uint8_t* tx_buf(bench_t* b, uint32_t index) {
+    return b->iobuf + (BUFS + index) * BUFSIZE;
+}
+
+// Gives back the rx buffers which have been filled, after handing each
+// packet to |func|, if there is one.
+static uint32_t bench_rx(bench_t* b, void (*func)(void* ctx, const uint8_t* data, size_t len),
+                         void* ctx) {
+    eth_fifo_entry_t entries[BUFS];
+    uint32_t n;
+    if (mx_fifo_read(b->fifos.rx_fifo, entries, sizeof(entries), &n) < 0) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        eth_fifo_entry_t* e = &entries[i];
+        if ((e->flags & ETH_FIFO_RX_OK) && (func != NULL)) {
+            func(ctx, b->iobuf + e->offset, e->length);
+        }
+        e->length = BUFSIZE;
+        e->flags = 0;
+    }
+    uint32_t actual;
+    mx_status_t status;
+    if ((status = mx_fifo_write(b->fifos.rx_fifo, entries, n * sizeof(eth_fifo_entry_t),
+                                &actual)) < 0) {
+        fprintf(stderr, "netbench: failed to queue rx buffers: %d\n", status);
+    }
+    return n;
+}
+
+// Takes back the tx buffers which have been sent, returning how many were
+// sent without error.
+static uint32_t bench_tx_reap(bench_t* b) {
+    eth_fifo_entry_t entries[BUFS];
+    uint32_t n;
+    if (mx_fifo_read(b->fifos.tx_fifo, entries, sizeof(entries), &n) < 0) {
+        return 0;
+    }
+    uint32_t ok = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        if (entries[i].flags & ETH_FIFO_TX_OK) {
+            ok++;
+        }
+        b->tx_free[b->tx_free_count++] = (uint32_t)(uintptr_t)entries[i].cookie;
+    }
+    b->tx_in_flight -= n;
+    return ok;
+}
+
+// Queues up to |count| of the free tx buffers, each |len| bytes long,
+// returning how many were.
+static mx_status_t bench_tx(bench_t* b, uint32_t count, size_t len, uint32_t* queued) {
+    eth_fifo_entry_t entries[BUFS];
+    uint32_t n = 0;
+    while ((n < count) && (b->tx_free_count > 0)) {
+        uint32_t index = b->tx_free[--b->tx_free_count];
+        entries[n].offset = (BUFS + index) * BUFSIZE;
+        entries[n].length = len;
+        entries[n].flags = 0;
+        entries[n].cookie = (void*)(uintptr_t)index;
+        n++;
+    }
+    uint32_t actual = 0;
+    mx_status_t status = MX_OK;
+    if (n > 0) {
+        status = mx_fifo_write(b->fifos.tx_fifo, entries, n * sizeof(eth_fifo_entry_t), &actual);
+        if (status == MX_ERR_SHOULD_WAIT) {
+            actual = 0;
+            status = MX_OK;
+        }
+    }
+    // put back what didn't fit
+    for (uint32_t i = actual; i < n; i++) {
+        b->tx_free[b->tx_free_count++] = (uint32_t)(uintptr_t)entries[i].cookie;
+    }
+    b->tx_in_flight += actual;
+    *queued = actual;
+    return status;
+}
+
+// Waits for either fifo to have something to read, returning
+// MX_ERR_TIMED_OUT if |deadline| passes first.
+static mx_status_t bench_wait(bench_t* b, mx_time_t deadline, bool* tx, bool* rx) {
+    mx_wait_item_t items[2] = {
+        { b->fifos.tx_fifo, MX_FIFO_READABLE | MX_FIFO_PEER_CLOSED, 0 },
+        { b->fifos.rx_fifo, MX_FIFO_READABLE | MX_FIFO_PEER_CLOSED, 0 },
+    };
+    mx_status_t status;
+    if ((status = mx_object_wait_many(items, 2, deadline)) < 0) {
+        return status;
+    }
+    if ((items[0].pending | items[1].pending) & MX_FIFO_PEER_CLOSED) {
+        return MX_ERR_PEER_CLOSED;
+    }
+    *tx = items[0].pending & MX_FIFO_READABLE;
+    *rx = items[1].pending & MX_FIFO_READABLE;
+    return MX_OK;
+}
+
+static mx_status_t run_tx(bench_t* b, size_t len, mx_duration_t duration, uint32_t depth) {
+    for (uint32_t i = 0; i < BUFS; i++) {
+        build_frame(b, tx_buf(b, i), len, NULL);
+    }
+
+    cpu_sample_t start, end;
+    uint64_t packets = 0;
+    cpu_sample(&start);
+    mx_time_t deadline = start.time + duration;
+    mx_status_t status;
+    for (;;) {
+        mx_time_t now = mx_time_get(MX_CLOCK_MONOTONIC);
+        bool draining = now >= deadline;
+        if (!draining) {
+            uint32_t queued;
+            if ((status = bench_tx(b, depth - b->tx_in_flight, len, &queued)) < 0) {
+                fprintf(stderr, "netbench: failed to queue tx buffers: %d\n", status);
+                return status;
+            }
+        } else if (b->tx_in_flight == 0) {
+            break;
+        }
+        bool tx, rx;
+        if ((status = bench_wait(b, draining ? now + MX_SEC(1) : deadline, &tx, &rx)) < 0) {
+            if (status == MX_ERR_TIMED_OUT) {
+                if (draining) {
+                    fprintf(stderr, "netbench: %u tx buffers never came back\n",
+                            b->tx_in_flight);
+                    return status;
+                }
+                continue;
+            }
+            fprintf(stderr, "netbench: failed to wait for the fifos: %d\n", status);
+            return status;
+        }
+        if (tx) {
+            packets += bench_tx_reap(b);
+        }
+        if (rx) {
+            bench_rx(b, NULL, NULL);
+        }
+    }
+    cpu_sample(&end);
+
+    double secs = (double)(end.time - start.time) / 1e9;
+    printf("%5zu bytes: %10" PRIu64 " packets, %10.0f pps, %8.3f Gbps (%.3f on the wire)\n",
+           len, packets, packets / secs, packets * len * 8 / secs / 1e9,
+           packets * (len + WIRE_OVERHEAD) * 8 / secs / 1e9);
+    print_cpu(&start, &end, packets);
+    return MX_OK;
+}
+
+typedef struct {
+    uint64_t packets;
+    uint64_t bytes;
+} rx_count_t;
+
+static void count_rx(void* ctx, const uint8_t* data, size_t len) {
+    rx_count_t* c = ctx;
+    c->packets++;
+    c->bytes += len;
+}
+
+static mx_status_t run_rx(bench_t* b, mx_duration_t duration) {
+    cpu_sample_t start, end;
+    rx_count_t total = {};
+    rx_count_t interval = {};
+    cpu_sample(&start);
+    mx_time_t deadline = start.time + duration;
+    mx_time_t report = start.time + MX_SEC(1);
+    mx_status_t status;
+    for (;;) {
+        mx_time_t now = mx_time_get(MX_CLOCK_MONOTONIC);
+        if (now >= report) {
+            printf("%10" PRIu64 " pps, %8.3f Gbps\n", interval.packets,
+                   interval.bytes * 8 / 1e9);
+            total.packets += interval.packets;
+            total.bytes += interval.bytes;
+            interval.packets = interval.bytes = 0;
+            report += MX_SEC(1);
+        }
+        if (now >= deadline) {
+            break;
+        }
+        bool tx, rx;
+        if ((status = bench_wait(b, report < deadline ? report : deadline, &tx, &rx)) < 0) {
+            if (status == MX_ERR_TIMED_OUT) {
+                continue;
+            }
+            fprintf(stderr, "netbench: failed to wait for the fifos: %d\n", status);
+            return status;
+        }
+        if (rx) {
+            bench_rx(b, count_rx, &interval);
+        }
+    }
+    cpu_sample(&end);
+    total.packets += interval.packets;
+    total.bytes += interval.bytes;
+
+    double secs = (double)(end.time - start.time) / 1e9;
+    printf("total: %" PRIu64 " packets, %.0f pps, %.3f Gbps\n",
+           total.packets, total.packets / secs, total.bytes * 8 / secs / 1e9);
+    print_cpu(&start, &end, total.packets);
+    return MX_OK;
+}
+
+typedef struct {
+    uint32_t seq;
+    bool got;
+    mx_time_t rtt;
+} rtt_probe_t;
+
+static void check_reply(void* ctx, const uint8_t* data, size_t len) {
+    rtt_probe_t* p = ctx;
+    if (len < HDRS_LEN + sizeof(probe_t)) {
+        return;
+    }
+    const eth_hdr_t* eth = (const eth_hdr_t*)data;
+    const ip6_hdr_t* ip = (const ip6_hdr_t*)(data + ETH_HDR_LEN);
+    const udp_hdr_t* udp = (const udp_hdr_t*)(data + ETH_HDR_LEN + IP6_HDR_LEN);
+    if ((ntohs(eth->type) != ETH_IP6) || (ip->next_header != HDR_UDP) ||
+        (ntohs(udp->src_port) != DST_PORT) || (ntohs(udp->dst_port) != SRC_PORT)) {
+        return;
+    }
+    probe_t probe;
+    memcpy(&probe, data + HDRS_LEN, sizeof(probe));
+    if ((probe.magic == PROBE_MAGIC) && (probe.seq == p->seq)) {
+        p->got = true;
+        p->rtt = mx_time_get(MX_CLOCK_MONOTONIC) - probe.sent;
+    }
+}
+
+static int compare_time(const void* a, const void* b) {
+    mx_time_t x = *(const mx_time_t*)a;
+    mx_time_t y = *(const mx_time_t*)b;
+    return (x > y) - (x < y);
+}
+
+static mx_time_t percentile(const mx_time_t* sorted, uint32_t count, double p) {
+    uint32_t i = (uint32_t)(p / 100.0 * (count - 1) + 0.5);
+    return sorted[i];
+}
+
+static mx_status_t run_rtt(bench_t* b, size_t len, uint32_t count) {
+    mx_time_t* rtts;
+    if ((rtts = calloc(count, sizeof(mx_time_t))) == NULL) {
+        return MX_ERR_NO_MEMORY;
+    }
+    uint32_t got = 0;
+    mx_status_t status = MX_OK;
+    for (uint32_t seq = 0; seq < count; seq++) {
+        while (b->tx_free_count == 0) {
+            bool tx, rx;
+            if ((status = bench_wait(b, MX_TIME_INFINITE, &tx, &rx)) < 0) {
+                goto done;
+            }
+            if (tx) {
+                bench_tx_reap(b);
+            }
+            if (rx) {
+                bench_rx(b, NULL, NULL);
+            }
+        }
+        probe_t probe = {
+            .magic = PROBE_MAGIC,
+            .seq = seq,
+            .sent = mx_time_get(MX_CLOCK_MONOTONIC),
+        };
+        build_frame(b, tx_buf(b, b->tx_free[b->tx_free_count - 1]), len, &probe);
+        uint32_t queued;
+        if ((status = bench_tx(b, 1, len, &queued)) < 0) {
+            fprintf(stderr, "netbench: failed to send probe: %d\n", status);
+            goto done;
+        }
+
+        rtt_probe_t p = { .seq = seq };
+        mx_time_t deadline = probe.sent + MX_SEC(1);
+        while (!p.got) {
+            bool tx, rx;
+            if ((status = bench_wait(b, deadline, &tx, &rx)) < 0) {
+                if (status == MX_ERR_TIMED_OUT) {
+                    status = MX_OK;
+                    break;
+                }
+                fprintf(stderr, "netbench: failed to wait for the fifos: %d\n", status);
+                goto done;
+            }
+            if (tx) {
+                bench_tx_reap(b);
+            }
+            if (rx) {
+                bench_rx(b, check_reply, &p);
+            }
+        }
+        if (p.got) {
+            rtts[got++] = p.rtt;
+        }
+    }
+
+    printf("%zu bytes: %u of %u probes came back\n", len, got, count);
+    if (got > 0) {
+        qsort(rtts, got, sizeof(mx_time_t), compare_time);
+        printf("   rtt us: min %.1f  p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+               rtts[0] / 1000.0, percentile(rtts, got, 50) / 1000.0,
+               percentile(rtts, got, 90) / 1000.0, percentile(rtts, got, 99) / 1000.0,
+               percentile(rtts, got, 99.9) / 1000.0, rtts[got - 1] / 1000.0);
+    }
+
+done:
+    free(rtts);
+    return status;
+}
+
+static mx_status_t bench_init(bench_t* b, int fd) {
+    ssize_t r;
+    if ((r = ioctl_ethernet_set_client_name(fd, "netbench", 8)) < 0) {
+        fprintf(stderr, "netbench: failed to set client name %zd\n", r);
+    }
+
+    eth_info_t info;
+    if ((r = ioctl_ethernet_get_info(fd, &info)) < 0) {
+        fprintf(stderr, "netbench: failed to get device info: %zd\n", r);
+        return r;
+    }
+    memcpy(b->mac.x, info.mac, ETH_ADDR_LEN);
+    b->mtu = info.mtu;
+
+    if ((r = ioctl_ethernet_get_fifos(fd, &b->fifos)) < 0) {
+        fprintf(stderr, "netbench: failed to get fifos: %zd\n", r);
+        return r;
+    }
+
+    mx_status_t status;
+    mx_handle_t iovmo;
+    if ((status = mx_vmo_create(BUFS * 2 * BUFSIZE, 0, &iovmo)) < 0) {
+        return status;
+    }
+    if ((status = mx_vmar_map(mx_vmar_root_self(), 0, iovmo, 0, BUFS * 2 * BUFSIZE,
+                              MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE,
+                              (uintptr_t*)&b->iobuf)) < 0) {
+        return status;
+    }
+    if ((r = ioctl_ethernet_set_iobuf(fd, &iovmo)) < 0) {
+        fprintf(stderr, "netbench: failed to set iobuf: %zd\n", r);
+        return r;
+    }
+
+    // The first BUFS buffers are for rx, the rest for tx.
+    uint32_t rx_count = BUFS < b->fifos.rx_depth ? BUFS : b->fifos.rx_depth;
+    for (uint32_t n = 0; n < rx_count; n++) {
+        eth_fifo_entry_t entry = {
+            .offset = n * BUFSIZE, .length = BUFSIZE, .flags = 0, .cookie = NULL,
+        };
+        uint32_t actual;
+        if ((status = mx_fifo_write(b->fifos.rx_fifo, &entry, sizeof(entry), &actual)) < 0) {
+            fprintf(stderr, "netbench: failed to queue rx buffer: %d\n", status);
+            return status;
+        }
+    }
+    for (uint32_t n = 0; n < BUFS; n++) {
+        b->tx_free[b->tx_free_count++] = n;
+    }
+
+    if ((r = ioctl_ethernet_start(fd)) < 0) {
+        fprintf(stderr, "netbench: failed to start network interface: %zd\n", r);
+        return r;
+    }
+    return MX_OK;
+}
+
+static bool parse_mac(const char* s, mac_addr_t* mac) {
+    unsigned x[ETH_ADDR_LEN];
+    if (sscanf(s, "%x:%x:%x:%x:%x:%x", &x[0], &x[1], &x[2], &x[3], &x[4], &x[5]) != 6) {
+        return false;
+    }
+    for (int i = 0; i < ETH_ADDR_LEN; i++) {
+        if (x[i] > 0xFF) {
+            return false;
+        }
+        mac->x[i] = x[i];
+    }
+    return true;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: netbench [options] tx|rx|rtt [<network-device>]\n"
+            "  tx   send frames as fast as the device takes them\n"
+            "  rx   count the frames the device receives\n"
+            "  rtt  time probes to and back from netreflector, run at -m\n"
+            "options:\n"
+            "  -s <size>[,<size>...]  frame sizes (default 64,128,256,512,1024,1514 for tx,\n"
+            "                         128 for rtt)\n"
+            "  -t <seconds>           length of each tx or rx run (default 5)\n"
+            "  -m <mac>               where to send (default broadcast; required for rtt)\n"
+            "  -n <count>             rtt probes to send (default 1000)\n"
+            "  -d <depth>             tx buffers in flight at once (default %u)\n",
+            BUFS);
+}
+
+int main(int argc, char** argv) {
+    size_t sizes[MAX_SIZES];
+    uint32_t size_count = 0;
+    uint32_t seconds = 5;
+    uint32_t probes = 1000;
+    uint32_t depth = BUFS;
+    bench_t* b;
+    if ((b = calloc(1, sizeof(bench_t))) == NULL) {
+        return -1;
+    }
+    memset(b->dst.x, 0xFF, ETH_ADDR_LEN);
+    bool have_dst = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:t:m:n:d:")) != -1) {
+        switch (opt) {
+        case 's': {
+            char* s = optarg;
+            while ((*s != '\0') && (size_count < MAX_SIZES)) {
+                sizes[size_count++] = strtoul(s, &s, 0);
+                if (*s == ',') {
+                    s++;
+                }
+            }
+            break;
+        }
+        case 't':
+            seconds = strtoul(optarg, NULL, 0);
+            break;
+        case 'm':
+            if (!parse_mac(optarg, &b->dst)) {
+                fprintf(stderr, "netbench: bad mac address '%s'\n", optarg);
+                return -1;
+            }
+            have_dst = true;
+            break;
+        case 'n':
+            probes = strtoul(optarg, NULL, 0);
+            break;
+        case 'd':
+            depth = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            usage();
+            return -1;
+        }
+    }
+    if ((optind >= argc) || (argc - optind > 2)) {
+        usage();
+        return -1;
+    }
+    const char* mode = argv[optind];
+    const char* ethdev = (argc - optind > 1) ? argv[optind + 1] : "/dev/class/ethernet/000";
+    bool tx = !strcmp(mode, "tx");
+    bool rtt = !strcmp(mode, "rtt");
+    if (!tx && !rtt && strcmp(mode, "rx")) {
+        usage();
+        return -1;
+    }
+    if (rtt && !have_dst) {
+        fprintf(stderr, "netbench: rtt needs the mac address of netreflector's device\n");
+        return -1;
+    }
+    if (size_count == 0) {
+        static const size_t tx_sizes[] = { 64, 128, 256, 512, 1024, 1514 };
+        if (rtt) {
+            sizes[size_count++] = 128;
+        } else {
+            for (size_t i = 0; i < countof(tx_sizes); i++) {
+                sizes[size_count++] = tx_sizes[i];
+            }
+        }
+    }
+
+    int fd;
+    if ((fd = open(ethdev, O_RDWR)) < 0) {
+        fprintf(stderr, "netbench: cannot open '%s'\n", ethdev);
+        return -1;
+    }
+    if (bench_init(b, fd) < 0) {
+        return -1;
+    }
+    if ((depth == 0) || (depth > BUFS) || (depth > b->fifos.tx_depth)) {
+        depth = BUFS < b->fifos.tx_depth ? BUFS : b->fifos.tx_depth;
+    }
+
+    // Without the root resource, only the cost in this process is known.
+    int sfd;
+    if ((sfd = open("/dev/misc/sysinfo", O_RDWR)) >= 0) {
+        if (ioctl_sysinfo_get_root_resource(sfd, &root_resource) != sizeof(root_resource)) {
+            root_resource = MX_HANDLE_INVALID;
+        }
+        close(sfd);
+    }
+
+    if (!tx && !rtt) {
+        return run_rx(b, MX_SEC(seconds)) < 0 ? -1 : 0;
+    }
+
+    size_t min = HDRS_LEN + (rtt ? sizeof(probe_t) : 0);
+    size_t max = ETH_HDR_LEN + b->mtu;
+    if (max > BUFSIZE) {
+        max = BUFSIZE;
+    }
+    for (uint32_t i = 0; i < size_count; i++) {
+        if ((sizes[i] < min) || (sizes[i] > max)) {
+            fprintf(stderr, "netbench: skipping %zu byte frames, which must be %zu to %zu\n",
+                    sizes[i], min, max);
+            continue;
+        }
+        mx_status_t status = rtt ? run_rtt(b, sizes[i], probes)
+                                 : run_tx(b, sizes[i], MX_SEC(seconds), depth);
+        if (status < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
@@ -8,48 +8,80 @@
 #include <pretty/hexdump.h>
 
 #include <fcntl.h>
+#include <inttypes.h>
 #include <limits.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 
-#define BUFSIZE 2048
+#define RING_SIZE (256 * 1024)
 
-void handle_rx(mx_handle_t rx_fifo, char* iobuf, unsigned count) {
-    eth_fifo_entry_t entries[count];
+void handle_capture(eth_capture_ring_t* ring, mx_handle_t event) {
+    const uint8_t* data = (const uint8_t*)(ring + 1);
+    uint64_t dropped = 0;
 
     for (;;) {
-        uint32_t n;
-        mx_status_t status;
-        if ((status = mx_fifo_read(rx_fifo, entries, sizeof(entries), &n)) < 0) {
-            if (status == MX_ERR_SHOULD_WAIT) {
-                mx_object_wait_one(rx_fifo, MX_FIFO_READABLE | MX_FIFO_PEER_CLOSED, MX_TIME_INFINITE, NULL);
-                continue;
+        // Clear the signal before looking, so that a packet appended after
+        // that raises it again.
+        mx_object_signal(event, MX_USER_SIGNAL_0, 0);
+        uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST);
+        uint64_t tail = ring->tail;
+        if (head == tail) {
+            mx_status_t status;
+            if ((status = mx_object_wait_one(event, MX_USER_SIGNAL_0, MX_TIME_INFINITE,
+                                             NULL)) < 0) {
+                fprintf(stderr, "netdump: failed to wait for packets: %d\n", status);
+                return;
             }
-            fprintf(stderr, "netdump: failed to read rx packets: %d\n", status);
-            return;
+            continue;
         }
 
-        eth_fifo_entry_t* e = entries;
-        for (uint32_t i = 0; i < n; i++, e++) {
-            if (e->flags & ETH_FIFO_RX_OK) {
-                printf("---\n");
-                hexdump8_ex(iobuf + e->offset, e->length, 0);
-            }
-            e->length = BUFSIZE;
-            e->flags = 0;
-            uint32_t actual;
-            if ((status = mx_fifo_write(rx_fifo, e, sizeof(*e), &actual)) < 0) {
-                fprintf(stderr, "netdump: failed to queue rx packet: %d\n", status);
-                break;
+        while (tail != head) {
+            uint32_t off = tail & (ring->size - 1);
+            const eth_capture_record_t* rec = (const void*)(data + off);
+            if ((ring->size - off < sizeof(*rec)) || (rec->flags & ETH_CAPTURE_WRAP)) {
+                tail += ring->size - off;
+                continue;
             }
+            printf("--- %s %u bytes\n", (rec->flags & ETH_CAPTURE_TX) ? "tx" : "rx",
+                   rec->orig_length);
+            hexdump8_ex(rec + 1, rec->length, 0);
+            tail += (sizeof(*rec) + rec->length + 7) & ~7ull;
+        }
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_SEQ_CST);
+
+        uint64_t d = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+        if (d != dropped) {
+            printf("--- %" PRIu64 " packets dropped\n", d - dropped);
+            dropped = d;
         }
     }
 }
 
+static void print_stats(const eth_stats_t* s) {
+    printf("device:   rx %" PRIu64 " packets %" PRIu64 " bytes,"
+           " tx %" PRIu64 " packets %" PRIu64 " bytes\n",
+           s->rx_packets, s->rx_bytes, s->tx_packets, s->tx_bytes);
+    printf("instance: rx %" PRIu64 " packets %" PRIu64 " bytes,"
+           " tx %" PRIu64 " packets %" PRIu64 " bytes\n",
+           s->client_rx_packets, s->client_rx_bytes, s->client_tx_packets, s->client_tx_bytes);
+    printf("          rx no buffer %" PRIu64 ", dropped %" PRIu64 ", fifo full %" PRIu64 "\n",
+           s->rx_no_buffer, s->rx_dropped, s->rx_fifo_full);
+    printf("          tx invalid %" PRIu64 ", fifo full %" PRIu64 "\n",
+           s->tx_invalid, s->tx_fifo_full);
+}
+
 int main(int argc, char** argv) {
+    bool stats = false;
+    if ((argc == 3) && !strcmp(argv[1], "-s")) {
+        stats = true;
+        argc--;
+        argv++;
+    }
     if (argc != 2) {
-        fprintf(stderr, "usage:  netdump <network-device>\n");
+        fprintf(stderr, "usage:  netdump [-s] <network-device>\n");
+        fprintf(stderr, "  -s  show the device's packet counts, and exit\n");
         return -1;
     }
 
@@ -59,64 +91,46 @@ int main(int argc, char** argv) {
         return -1;
     }
 
-    eth_fifos_t fifos;
-    mx_status_t status;
-
     ssize_t r;
-    if ((r = ioctl_ethernet_get_fifos(fd, &fifos)) < 0) {
-        fprintf(stderr, "netdump: failed to get fifos: %zd\n", r);
-        return r;
-    }
-
-    unsigned count = fifos.rx_depth / 2;
-    mx_handle_t iovmo;
-    // allocate shareable ethernet buffer data heap
-    if ((status = mx_vmo_create(count * BUFSIZE, 0, &iovmo)) < 0) {
-        return -1;
-    }
-
-    char* iobuf;
-    if ((status = mx_vmar_map(mx_vmar_root_self(), 0, iovmo, 0, count * BUFSIZE,
-                              MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE,
-                              (uintptr_t*)&iobuf)) < 0) {
-        return -1;
-    }
-
-    if ((r = ioctl_ethernet_set_iobuf(fd, &iovmo)) < 0) {
-        fprintf(stderr, "netdump: failed to set iobuf: %zd\n", r);
-        return -1;
+    if (stats) {
+        eth_stats_t s;
+        if ((r = ioctl_ethernet_get_stats(fd, &s)) < 0) {
+            fprintf(stderr, "netdump: failed to get stats: %zd\n", r);
+            return -1;
+        }
+        print_stats(&s);
+        return 0;
     }
 
     if ((r = ioctl_ethernet_set_client_name(fd, "netdump", 7)) < 0) {
         fprintf(stderr, "netdump: failed to set client name %zd\n", r);
     }
 
-    // assign data chunks to ethbufs
-    for (unsigned n = 0; n < count; n++) {
-        eth_fifo_entry_t entry = {
-            .offset = n * BUFSIZE,
-            .length = BUFSIZE,
-            .flags = 0,
-            .cookie = NULL,
-        };
-        uint32_t actual;
-        if ((status = mx_fifo_write(fifos.rx_fifo, &entry, sizeof(entry), &actual)) < 0) {
-            fprintf(stderr, "netdump: failed to queue rx packet: %d\n", status);
-            return -1;
-        }
-    }
-
-    if (ioctl_ethernet_start(fd) < 0) {
-        fprintf(stderr, "netdump: failed to start network interface\n");
+    // The instance is never started; the packets come to the ring as
+    // they pass, without taking rx buffers or packets from anyone.
+    eth_capture_config_t config = {
+        .flags = ETH_CAPTURE_RX | ETH_CAPTURE_TX,
+        .snaplen = 0,
+        .size = RING_SIZE,
+        .match_count = 0,
+    };
+    eth_capture_handles_t handles;
+    if ((r = ioctl_ethernet_start_capture(fd, &config, &handles)) < 0) {
+        fprintf(stderr, "netdump: failed to start capture: %zd\n", r);
         return -1;
     }
 
-    if (ioctl_ethernet_tx_listen_start(fd) < 0) {
-        fprintf(stderr, "netdump: failed to start listening\n");
+    mx_status_t status;
+    eth_capture_ring_t* ring;
+    if ((status = mx_vmar_map(mx_vmar_root_self(), 0, handles.vmo, 0,
+                              sizeof(eth_capture_ring_t) + RING_SIZE,
+                              MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE,
+                              (uintptr_t*)&ring)) < 0) {
+        fprintf(stderr, "netdump: failed to map capture ring: %d\n", status);
         return -1;
     }
 
-    handle_rx(fifos.rx_fifo, iobuf, count);
+    handle_capture(ring, handles.event);
 
     return 0;
 }
@@ -3,6 +3,7 @@
 // found in the LICENSE file.
 
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <magenta/syscalls.h>
@@ -10,6 +11,42 @@
 #define TRIALS 10000
 #define BINS 32
 
+// Each thread of the throughput test makes this many draws of DRAW_LEN.
+#define THROUGHPUT_DRAWS 20000
+#define DRAW_LEN 32
+#define MAX_THREADS 8
+
+static void* draw_thread(void* arg) {
+    uint8_t buf[DRAW_LEN];
+    for (unsigned int i = 0; i < THROUGHPUT_DRAWS; ++i) {
+        size_t sz = 0;
+        mx_cprng_draw(buf, sizeof(buf), &sz);
+    }
+    return NULL;
+}
+
+// Draws from |threads| threads at once, to show whether draws on
+// different CPUs get in each other's way.
+static int throughput(unsigned int threads) {
+    pthread_t thread[MAX_THREADS];
+    mx_time_t start = mx_time_get(MX_CLOCK_MONOTONIC);
+    for (unsigned int i = 0; i < threads; ++i) {
+        if (pthread_create(&thread[i], NULL, draw_thread, NULL) != 0) {
+            printf("failed to create thread %u\n", i);
+            return 1;
+        }
+    }
+    for (unsigned int i = 0; i < threads; ++i) {
+        pthread_join(thread[i], NULL);
+    }
+    mx_time_t elapsed = mx_time_get(MX_CLOCK_MONOTONIC) - start;
+
+    uint64_t bytes = (uint64_t)threads * THROUGHPUT_DRAWS * DRAW_LEN;
+    printf("%u thread(s): %" PRIu64 " bytes in %" PRIu64 " us, %" PRIu64 " KB/s\n",
+           threads, bytes, elapsed / 1000, bytes * 1000000000 / 1024 / (elapsed ? elapsed : 1));
+    return 0;
+}
+
 int main(int argc, char** argv) {
     static uint8_t buf[32];
     uint64_t values[BINS] = { 0 };
@@ -41,5 +78,10 @@ int main(int argc, char** argv) {
         printf("bin %u: %" PRIu64 "\n", i, values[i]);
     }
 
+    for (unsigned int threads = 1; threads <= MAX_THREADS; threads *= 2) {
+        if (throughput(threads))
+            return 1;
+    }
+
     return 0;
 }
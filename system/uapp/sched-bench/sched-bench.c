@@ -0,0 +1,562 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Benchmarks of the scheduler as threads see it: how late a sleeper wakes,
+// idle and with every cpu busy; what a switch between two threads costs; a
+// hackbench style storm of messages; how evenly cpu hogs share the cpus,
+// and whether a thread that mostly sleeps still gets the cpu it asks for
+// alongside them, which is what priority boosting is for; and how fast
+// threads are made and done away with.  With the root resource it also
+// says how many context switches, migrations, steals and balances each
+// test caused, and -t switches on the sched_* ktrace probes for the run.
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <unistd.h>
+
+#include <magenta/device/ktrace.h>
+#include <magenta/device/sysinfo.h>
+#include <magenta/syscalls.h>
+#include <magenta/syscalls/object.h>
+#include <magenta/threads.h>
+
+#define MAX_CPUS 32
+#define MAX_THREADS 256
+
+// How far in the future the wakeup latency tests sleep until.
+#define SLEEP_NS MX_USEC(500)
+
+// The thread that mostly sleeps runs for this long each period.
+#define INTERACTIVE_RUN_NS MX_USEC(200)
+#define INTERACTIVE_PERIOD_NS MX_MSEC(1)
+
+#define HACKBENCH_SENDERS 10
+#define HACKBENCH_RECEIVERS 10
+#define HACKBENCH_LOOPS 100
+#define HACKBENCH_MSG_SIZE 100
+
+static mx_handle_t root_resource = MX_HANDLE_INVALID;
+static uint32_t num_cpus;
+
+// Set to stop the hog threads.
+static int stop_hogs;
+
+typedef struct {
+    size_t cpus;
+    mx_info_cpu_stats_t stats[MAX_CPUS];
+} cpu_sample_t;
+
+static void cpu_sample(cpu_sample_t* s) {
+    s->cpus = 0;
+    if (root_resource == MX_HANDLE_INVALID) {
+        return;
+    }
+    size_t actual, avail;
+    if (mx_object_get_info(root_resource, MX_INFO_CPU_STATS, s->stats, sizeof(s->stats),
+                           &actual, &avail) == MX_OK) {
+        s->cpus = actual;
+    }
+}
+
+// Prints what the scheduler did between |a| and |b|, summed over the cpus.
+static void print_cpu(const cpu_sample_t* a, const cpu_sample_t* b) {
+    if (b->cpus == 0 || a->cpus != b->cpus) {
+        return;
+    }
+    uint64_t cs = 0, migrations = 0, steals = 0, balances = 0, preempts = 0;
+    for (size_t i = 0; i < b->cpus; i++) {
+        cs += b->stats[i].context_switches - a->stats[i].context_switches;
+        migrations += b->stats[i].migrations - a->stats[i].migrations;
+        steals += b->stats[i].steals - a->stats[i].steals;
+        balances += b->stats[i].balances - a->stats[i].balances;
+        preempts += b->stats[i].preempts - a->stats[i].preempts;
+    }
+    printf("   sched: %" PRIu64 " context switches, %" PRIu64 " migrations, %" PRIu64
+           " steals, %" PRIu64 " balances, %" PRIu64 " preempts\n",
+           cs, migrations, steals, balances, preempts);
+}
+
+static int compare_time(const void* a, const void* b) {
+    mx_time_t x = *(const mx_time_t*)a;
+    mx_time_t y = *(const mx_time_t*)b;
+    return (x > y) - (x < y);
+}
+
+static mx_time_t percentile(const mx_time_t* sorted, uint32_t count, double p) {
+    uint32_t i = (uint32_t)(p / 100.0 * (count - 1) + 0.5);
+    return sorted[i];
+}
+
+static void print_latency(const char* what, mx_time_t* times, uint32_t count) {
+    qsort(times, count, sizeof(mx_time_t), compare_time);
+    printf("   %s us: min %.1f  p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+           what, times[0] / 1000.0, percentile(times, count, 50) / 1000.0,
+           percentile(times, count, 90) / 1000.0, percentile(times, count, 99) / 1000.0,
+           percentile(times, count, 99.9) / 1000.0, times[count - 1] / 1000.0);
+}
+
+static mx_time_t thread_runtime(thrd_t t) {
+    mx_info_thread_stats_t ts;
+    if (mx_object_get_info(thrd_get_mx_handle(t), MX_INFO_THREAD_STATS, &ts, sizeof(ts),
+                           NULL, NULL) != MX_OK) {
+        return 0;
+    }
+    return ts.total_runtime;
+}
+
+static int hog_thread(void* arg) {
+    while (!__atomic_load_n(&stop_hogs, __ATOMIC_RELAXED)) {
+    }
+    return 0;
+}
+
+static uint32_t start_hogs(thrd_t* hogs, uint32_t count) {
+    __atomic_store_n(&stop_hogs, 0, __ATOMIC_RELAXED);
+    uint32_t started = 0;
+    for (; started < count; started++) {
+        if (thrd_create_with_name(&hogs[started], hog_thread, NULL, "hog") != thrd_success) {
+            break;
+        }
+    }
+    return started;
+}
+
+static void stop_and_join_hogs(thrd_t* hogs, uint32_t count) {
+    __atomic_store_n(&stop_hogs, 1, __ATOMIC_RELAXED);
+    for (uint32_t i = 0; i < count; i++) {
+        thrd_join(hogs[i], NULL);
+    }
+}
+
+// How late a thread wakes from a sleep, with |load| hogs keeping the cpus
+// busy.  Hogs use up their quanta and lose their boost, the sleeper keeps
+// its, so under load it ought to be woken almost as promptly as when idle.
+static void wakeup_latency(uint32_t samples, uint32_t load) {
+    mx_time_t* late = calloc(samples, sizeof(mx_time_t));
+    thrd_t hogs[MAX_THREADS];
+    if (late == NULL) {
+        return;
+    }
+
+    printf("wakeup latency, %u hog threads:\n", load);
+    cpu_sample_t before, after;
+    cpu_sample(&before);
+    uint32_t started = start_hogs(hogs, load);
+    for (uint32_t i = 0; i < samples; i++) {
+        mx_time_t deadline = mx_deadline_after(SLEEP_NS);
+        mx_nanosleep(deadline);
+        late[i] = mx_time_get(MX_CLOCK_MONOTONIC) - deadline;
+    }
+    stop_and_join_hogs(hogs, started);
+    cpu_sample(&after);
+
+    print_latency("late", late, samples);
+    print_cpu(&before, &after);
+    free(late);
+}
+
+// Whose turn it is in the context switch test.
+static mx_futex_t turn;
+
+static int switch_partner(void* arg) {
+    for (;;) {
+        int now;
+        while ((now = __atomic_load_n(&turn, __ATOMIC_ACQUIRE)) == 0) {
+            mx_futex_wait(&turn, 0, MX_TIME_INFINITE);
+        }
+        if (now == 2) {
+            return 0;
+        }
+        __atomic_store_n(&turn, 0, __ATOMIC_RELEASE);
+        mx_futex_wake(&turn, 1);
+    }
+}
+
+// Two threads hand a futex back and forth, so each round trip is two
+// wakeups of a blocked thread.
+static void context_switch(uint32_t samples) {
+    mx_time_t* times = calloc(samples, sizeof(mx_time_t));
+    if (times == NULL) {
+        return;
+    }
+
+    printf("context switch, futex round trip / 2:\n");
+    __atomic_store_n(&turn, 0, __ATOMIC_RELAXED);
+    thrd_t partner;
+    if (thrd_create_with_name(&partner, switch_partner, NULL, "switch") != thrd_success) {
+        free(times);
+        return;
+    }
+
+    cpu_sample_t before, after;
+    cpu_sample(&before);
+    for (uint32_t i = 0; i < samples; i++) {
+        mx_time_t start = mx_time_get(MX_CLOCK_MONOTONIC);
+        __atomic_store_n(&turn, 1, __ATOMIC_RELEASE);
+        mx_futex_wake(&turn, 1);
+        while (__atomic_load_n(&turn, __ATOMIC_ACQUIRE) == 1) {
+            mx_futex_wait(&turn, 1, MX_TIME_INFINITE);
+        }
+        times[i] = (mx_time_get(MX_CLOCK_MONOTONIC) - start) / 2;
+    }
+    cpu_sample(&after);
+
+    __atomic_store_n(&turn, 2, __ATOMIC_RELEASE);
+    mx_futex_wake(&turn, 1);
+    thrd_join(partner, NULL);
+
+    print_latency("switch", times, samples);
+    print_cpu(&before, &after);
+    free(times);
+}
+
+typedef struct {
+    // Each sender writes to every receiver's socket in its group.
+    mx_handle_t* sockets;
+} hackbench_sender_t;
+
+typedef struct {
+    mx_handle_t socket;
+    size_t expected;
+} hackbench_receiver_t;
+
+static int hackbench_send(void* arg) {
+    hackbench_sender_t* s = arg;
+    char msg[HACKBENCH_MSG_SIZE];
+    memset(msg, 's', sizeof(msg));
+    for (int loop = 0; loop < HACKBENCH_LOOPS; loop++) {
+        for (int r = 0; r < HACKBENCH_RECEIVERS; r++) {
+            size_t sent = 0;
+            while (sent < sizeof(msg)) {
+                size_t actual;
+                mx_status_t status = mx_socket_write(s->sockets[r], 0u, msg + sent,
+                                                     sizeof(msg) - sent, &actual);
+                if (status == MX_ERR_SHOULD_WAIT) {
+                    mx_object_wait_one(s->sockets[r], MX_SOCKET_WRITABLE | MX_SOCKET_PEER_CLOSED,
+                                       MX_TIME_INFINITE, NULL);
+                    continue;
+                }
+                if (status != MX_OK) {
+                    return -1;
+                }
+                sent += actual;
+            }
+        }
+    }
+    return 0;
+}
+
+static int hackbench_receive(void* arg) {
+    hackbench_receiver_t* r = arg;
+    char buf[4096];
+    size_t got = 0;
+    while (got < r->expected) {
+        size_t actual;
+        mx_status_t status = mx_socket_read(r->socket, 0u, buf, sizeof(buf), &actual);
+        if (status == MX_ERR_SHOULD_WAIT) {
+            mx_object_wait_one(r->socket, MX_SOCKET_READABLE | MX_SOCKET_PEER_CLOSED,
+                               MX_TIME_INFINITE, NULL);
+            continue;
+        }
+        if (status != MX_OK) {
+            return -1;
+        }
+        got += actual;
+    }
+    return 0;
+}
+
+// Like hackbench: |groups| groups of senders each send every receiver in
+// their group |HACKBENCH_LOOPS| messages over a socket.
+static void hackbench(uint32_t groups) {
+    uint32_t per_group = HACKBENCH_SENDERS + HACKBENCH_RECEIVERS;
+    if (groups * per_group > MAX_THREADS) {
+        groups = MAX_THREADS / per_group;
+    }
+    printf("hackbench, %u groups of %d senders and %d receivers, %d messages of %d bytes:\n",
+           groups, HACKBENCH_SENDERS, HACKBENCH_RECEIVERS, HACKBENCH_LOOPS, HACKBENCH_MSG_SIZE);
+
+    // [group][receiver]: the senders' ends, then the receivers' ends.
+    mx_handle_t tx[MAX_THREADS];
+    hackbench_receiver_t receivers[MAX_THREADS];
+    hackbench_sender_t senders[MAX_THREADS];
+    thrd_t threads[MAX_THREADS];
+    uint32_t num_sockets = 0;
+    uint32_t num_threads = 0;
+    bool ok = true;
+
+    for (uint32_t g = 0; g < groups && ok; g++) {
+        for (int r = 0; r < HACKBENCH_RECEIVERS; r++) {
+            hackbench_receiver_t* rx = &receivers[num_sockets];
+            if (mx_socket_create(0u, &tx[num_sockets], &rx->socket) != MX_OK) {
+                ok = false;
+                break;
+            }
+            rx->expected = HACKBENCH_SENDERS * HACKBENCH_LOOPS * HACKBENCH_MSG_SIZE;
+            num_sockets++;
+        }
+    }
+
+    cpu_sample_t before, after;
+    cpu_sample(&before);
+    mx_time_t start = mx_time_get(MX_CLOCK_MONOTONIC);
+    for (uint32_t i = 0; i < num_sockets && ok; i++) {
+        ok = thrd_create_with_name(&threads[num_threads], hackbench_receive, &receivers[i],
+                                   "receiver") == thrd_success;
+        num_threads += ok;
+    }
+    for (uint32_t g = 0; g < groups && ok; g++) {
+        for (int s = 0; s < HACKBENCH_SENDERS && ok; s++) {
+            hackbench_sender_t* sender = &senders[g * HACKBENCH_SENDERS + s];
+            sender->sockets = &tx[g * HACKBENCH_RECEIVERS];
+            ok = thrd_create_with_name(&threads[num_threads], hackbench_send, sender,
+                                       "sender") == thrd_success;
+            num_threads += ok;
+        }
+    }
+    if (!ok) {
+        // Closing the sockets stops any threads stuck waiting.
+        for (uint32_t i = 0; i < num_sockets; i++) {
+            mx_handle_close(tx[i]);
+            tx[i] = MX_HANDLE_INVALID;
+        }
+    }
+    int failed = 0;
+    for (uint32_t i = 0; i < num_threads; i++) {
+        int result;
+        thrd_join(threads[i], &result);
+        failed |= result;
+    }
+    mx_time_t elapsed = mx_time_get(MX_CLOCK_MONOTONIC) - start;
+    cpu_sample(&after);
+
+    for (uint32_t i = 0; i < num_sockets; i++) {
+        mx_handle_close(tx[i]);
+        mx_handle_close(receivers[i].socket);
+    }
+    if (!ok || failed) {
+        printf("   failed\n");
+        return;
+    }
+    printf("   %.3f s\n", elapsed / 1e9);
+    print_cpu(&before, &after);
+}
+
+#define MAX_WAKEUPS 1024
+
+// Returns how many of its wakeups it kept in |arg|, the last MAX_WAKEUPS.
+static int interactive_thread(void* arg) {
+    mx_time_t* late = arg;
+    uint32_t n = 0;
+    mx_time_t next = mx_time_get(MX_CLOCK_MONOTONIC);
+    while (!__atomic_load_n(&stop_hogs, __ATOMIC_RELAXED)) {
+        mx_time_t run_until = next + INTERACTIVE_RUN_NS;
+        while (mx_time_get(MX_CLOCK_MONOTONIC) < run_until) {
+        }
+        next += INTERACTIVE_PERIOD_NS;
+        mx_nanosleep(next);
+        mx_time_t now = mx_time_get(MX_CLOCK_MONOTONIC);
+        late[n++ % MAX_WAKEUPS] = now - next;
+        // Don't try to make up for time lost while not running.
+        if (now > next) {
+            next = now;
+        }
+    }
+    return (int)(n < MAX_WAKEUPS ? n : MAX_WAKEUPS);
+}
+
+// |count| hogs share the cpus for |duration|, each ought to get the same
+// time.  A thread that wants a fifth of a cpu, a little at a time, runs
+// alongside them: it is boosted each time it wakes and so ought to get
+// what it wants.
+static void fairness(uint32_t count, mx_time_t duration) {
+    if (count > MAX_THREADS) {
+        count = MAX_THREADS;
+    }
+    printf("fairness, %u hog threads on %u cpus and one wanting %.0f%% of a cpu:\n",
+           count, num_cpus, 100.0 * INTERACTIVE_RUN_NS / INTERACTIVE_PERIOD_NS);
+
+    thrd_t hogs[MAX_THREADS];
+    thrd_t interactive;
+    mx_time_t* late = calloc(MAX_WAKEUPS, sizeof(mx_time_t));
+    if (late == NULL) {
+        return;
+    }
+
+    cpu_sample_t before, after;
+    cpu_sample(&before);
+    uint32_t started = start_hogs(hogs, count);
+    bool have_interactive = thrd_create_with_name(&interactive, interactive_thread, late,
+                                                  "interactive") == thrd_success;
+    mx_nanosleep(mx_deadline_after(duration));
+
+    // Take the runtimes before stopping, so the hogs are all measured over
+    // the same time.
+    double sum = 0.0, sum_sq = 0.0, min = INFINITY, max = 0.0;
+    for (uint32_t i = 0; i < started; i++) {
+        double t = (double)thread_runtime(hogs[i]);
+        sum += t;
+        sum_sq += t * t;
+        min = fmin(min, t);
+        max = fmax(max, t);
+    }
+    double interactive_runtime = have_interactive ? (double)thread_runtime(interactive) : 0.0;
+    stop_and_join_hogs(hogs, started);
+    int wakeups = 0;
+    if (have_interactive) {
+        thrd_join(interactive, &wakeups);
+    }
+    cpu_sample(&after);
+
+    if (started != 0 && sum > 0.0) {
+        // Jain's index: 1 when all got the same, 1/n when one got it all.
+        double jain = sum * sum / (started * sum_sq);
+        printf("   hogs: fairness index %.3f, least %.1f%% and most %.1f%% of a cpu\n",
+               jain, 100.0 * min / duration, 100.0 * max / duration);
+    }
+    if (have_interactive) {
+        printf("   interactive: got %.1f%% of a cpu\n", 100.0 * interactive_runtime / duration);
+        if (wakeups > 0) {
+            print_latency("interactive late", late, (uint32_t)wakeups);
+        }
+    }
+    print_cpu(&before, &after);
+    free(late);
+}
+
+static int empty_thread(void* arg) {
+    return 0;
+}
+
+// Threads made and joined one at a time, then |batch| at a time.
+static void thread_lifecycle(mx_time_t duration, uint32_t batch) {
+    printf("thread create and exit:\n");
+    if (batch > MAX_THREADS) {
+        batch = MAX_THREADS;
+    }
+
+    cpu_sample_t before, after;
+    cpu_sample(&before);
+    uint64_t count = 0;
+    mx_time_t start = mx_time_get(MX_CLOCK_MONOTONIC);
+    mx_time_t end = start + duration / 2;
+    mx_time_t now;
+    while ((now = mx_time_get(MX_CLOCK_MONOTONIC)) < end) {
+        thrd_t t;
+        if (thrd_create_with_name(&t, empty_thread, NULL, "empty") != thrd_success) {
+            printf("   failed\n");
+            return;
+        }
+        thrd_join(t, NULL);
+        count++;
+    }
+    printf("   one at a time: %.0f threads/s\n", count / ((now - start) / 1e9));
+
+    thrd_t threads[MAX_THREADS];
+    count = 0;
+    start = now;
+    end = start + duration / 2;
+    while ((now = mx_time_get(MX_CLOCK_MONOTONIC)) < end) {
+        uint32_t made = 0;
+        for (; made < batch; made++) {
+            if (thrd_create_with_name(&threads[made], empty_thread, NULL, "empty") !=
+                thrd_success) {
+                break;
+            }
+        }
+        for (uint32_t i = 0; i < made; i++) {
+            thrd_join(threads[i], NULL);
+        }
+        if (made == 0) {
+            printf("   failed\n");
+            return;
+        }
+        count += made;
+    }
+    cpu_sample(&after);
+    printf("   %u at a time: %.0f threads/s\n", batch, count / ((now - start) / 1e9));
+    print_cpu(&before, &after);
+}
+
+static void usage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -d N  seconds for each of the fairness and thread tests (default: 2)\n"
+            "  -n N  samples for each of the latency tests (default: 2000)\n"
+            "  -g N  hackbench groups (default: 4)\n"
+            "  -t    switch on the sched_* ktrace probes while running\n",
+            argv0);
+}
+
+int main(int argc, char** argv) {
+    uint32_t seconds = 2;
+    uint32_t samples = 2000;
+    uint32_t groups = 4;
+    bool trace = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "d:n:g:t")) != -1) {
+        switch (opt) {
+        case 'd':
+            seconds = (uint32_t)strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            samples = (uint32_t)strtoul(optarg, NULL, 0);
+            break;
+        case 'g':
+            groups = (uint32_t)strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            trace = true;
+            break;
+        default:
+            usage(argv[0]);
+            return -1;
+        }
+    }
+    if (seconds == 0 || samples == 0 || groups == 0) {
+        usage(argv[0]);
+        return -1;
+    }
+
+    num_cpus = mx_system_get_num_cpus();
+
+    int sfd;
+    if ((sfd = open("/dev/misc/sysinfo", O_RDWR)) >= 0) {
+        if (ioctl_sysinfo_get_root_resource(sfd, &root_resource) != sizeof(root_resource)) {
+            root_resource = MX_HANDLE_INVALID;
+        }
+        close(sfd);
+    }
+
+    int tfd = -1;
+    if (trace) {
+        if ((tfd = open("/dev/misc/ktrace", O_RDWR)) < 0 ||
+            ioctl_ktrace_enable_probe(tfd, "sched_*") < 0) {
+            fprintf(stderr, "cannot switch on the sched_* ktrace probes\n");
+            return -1;
+        }
+    }
+
+    mx_time_t duration = MX_SEC(seconds);
+    wakeup_latency(samples, 0);
+    wakeup_latency(samples, num_cpus);
+    context_switch(samples);
+    hackbench(groups);
+    fairness(num_cpus * 2, duration);
+    thread_lifecycle(duration, 100);
+
+    if (tfd >= 0) {
+        ioctl_ktrace_disable_probe(tfd, "sched_*");
+        close(tfd);
+    }
+    return 0;
+}
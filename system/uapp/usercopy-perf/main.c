@@ -0,0 +1,86 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Measures how fast the kernel copies to and from user memory, using vmo
+// writes and reads whose cost is almost all in the user copy.
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <magenta/syscalls.h>
+
+#define MAX_SIZE (1024u * 1024u)
+
+// Each size is repeated until at least this many bytes have been copied.
+#define BYTES_PER_SIZE (256ull * 1024 * 1024)
+#define MIN_ITERATIONS (1000u)
+
+static const size_t sizes[] = {
+    8, 16, 32, 64, 128, 256, 512, 1024, 4096, 16384, 65536, 262144, MAX_SIZE,
+};
+
+// Returns the rate in GB/s, or a negative number on failure.
+static double measure(mx_handle_t vmo, uint8_t* buf, size_t size, size_t offset, bool write) {
+    uint64_t iterations = BYTES_PER_SIZE / size;
+    if (iterations < MIN_ITERATIONS)
+        iterations = MIN_ITERATIONS;
+
+    mx_time_t start = mx_time_get(MX_CLOCK_MONOTONIC);
+    for (uint64_t i = 0; i < iterations; i++) {
+        size_t actual;
+        mx_status_t status = write ? mx_vmo_write(vmo, buf + offset, 0, size, &actual)
+                                   : mx_vmo_read(vmo, buf + offset, 0, size, &actual);
+        if (status != MX_OK || actual != size)
+            return -1.0;
+    }
+    mx_time_t elapsed = mx_time_get(MX_CLOCK_MONOTONIC) - start;
+
+    return (double)(iterations * size) / (double)elapsed;
+}
+
+int main(int argc, char** argv) {
+    // An offset into the user buffer, to see the cost of misaligned copies.
+    size_t offset = 0;
+    if (argc > 1) {
+        offset = strtoul(argv[1], NULL, 0);
+        if (offset >= 64) {
+            fprintf(stderr, "usage: %s [misalignment 0-63]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    uint8_t* buf = malloc(MAX_SIZE + 64);
+    if (!buf) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    memset(buf, 0x5a, MAX_SIZE + 64);
+
+    mx_handle_t vmo;
+    mx_status_t status = mx_vmo_create(MAX_SIZE, 0, &vmo);
+    if (status == MX_OK)
+        status = mx_vmo_op_range(vmo, MX_VMO_OP_COMMIT, 0, MAX_SIZE, NULL, 0);
+    if (status != MX_OK) {
+        fprintf(stderr, "failed to create vmo: %d\n", status);
+        return 1;
+    }
+
+    printf("%10s %14s %14s\n", "size", "to kernel", "to user");
+    for (size_t i = 0; i < countof(sizes); i++) {
+        double from_user = measure(vmo, buf, sizes[i], offset, true);
+        double to_user = measure(vmo, buf, sizes[i], offset, false);
+        if (from_user < 0 || to_user < 0) {
+            fprintf(stderr, "copy of %zu bytes failed\n", sizes[i]);
+            return 1;
+        }
+        printf("%10zu %9.3f GB/s %9.3f GB/s\n", sizes[i], from_user, to_user);
+    }
+
+    mx_handle_close(vmo);
+    free(buf);
+    return 0;
+}
@@ -0,0 +1,137 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <async/loop.h>
+#include <mxtl/macros.h>
+
+// The loop's waits, timers and tasks bound to methods of an object, for
+// code written as a chain of steps: each step says which one comes next
+// when it starts the next wait, so what would be a coroutine is an object
+// holding its own state and a member of one of these per thing it awaits.
+
+namespace async {
+
+class Loop {
+public:
+    Loop() = default;
+    ~Loop() {
+        if (loop_)
+            async_loop_destroy(loop_);
+    }
+
+    mx_status_t Create() { return async_loop_create(&loop_); }
+
+    mx_status_t Run(mx_time_t deadline = MX_TIME_INFINITE, bool once = false) {
+        return async_loop_run(loop_, deadline, once);
+    }
+    void Quit() { async_loop_quit(loop_); }
+
+    async_loop_t* get() const { return loop_; }
+
+private:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(Loop);
+
+    async_loop_t* loop_ = nullptr;
+};
+
+template <typename T>
+class Wait : private async_wait_t {
+public:
+    using Step = async_wait_result_t (T::*)(async_loop_t* loop, mx_status_t status,
+                                            const mx_packet_signal_t* signal);
+
+    explicit Wait(T* owner) : async_wait_t(), owner_(owner) {
+        handler = &Wait::Call;
+    }
+
+    // Waits for |object| to assert any of |trigger|, then calls |next|.
+    // A step returning ASYNC_WAIT_AGAIN waits the same way again, for
+    // whatever step was last given.
+    mx_status_t Begin(async_loop_t* loop, mx_handle_t object, mx_signals_t trigger, Step next) {
+        this->object = object;
+        this->trigger = trigger;
+        next_ = next;
+        return async_wait_begin(loop, this);
+    }
+
+    // Makes |next| the step a wait in progress calls, from a step
+    // returning ASYNC_WAIT_AGAIN for instance.
+    void set_next(Step next) { next_ = next; }
+
+    mx_status_t Cancel(async_loop_t* loop) { return async_wait_cancel(loop, this); }
+
+private:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(Wait);
+
+    static async_wait_result_t Call(async_loop_t* loop, async_wait_t* wait,
+                                    mx_status_t status, const mx_packet_signal_t* signal) {
+        Wait* self = static_cast<Wait*>(wait);
+        return (self->owner_->*self->next_)(loop, status, signal);
+    }
+
+    T* const owner_;
+    Step next_ = nullptr;
+};
+
+template <typename T>
+class Timer : private async_timer_t {
+public:
+    using Step = void (T::*)(async_loop_t* loop, mx_status_t status);
+
+    explicit Timer(T* owner) : async_timer_t(), owner_(owner) {
+        handler = &Timer::Call;
+    }
+
+    // Calls |next| at |deadline|.
+    mx_status_t Start(async_loop_t* loop, mx_time_t deadline, Step next) {
+        this->deadline = deadline;
+        next_ = next;
+        return async_timer_start(loop, this);
+    }
+
+    mx_status_t Cancel(async_loop_t* loop) { return async_timer_cancel(loop, this); }
+
+private:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(Timer);
+
+    static void Call(async_loop_t* loop, async_timer_t* timer, mx_status_t status) {
+        Timer* self = static_cast<Timer*>(timer);
+        (self->owner_->*self->next_)(loop, status);
+    }
+
+    T* const owner_;
+    Step next_ = nullptr;
+};
+
+template <typename T>
+class Task : private async_task_t {
+public:
+    using Step = void (T::*)(async_loop_t* loop, mx_status_t status);
+
+    explicit Task(T* owner) : async_task_t(), owner_(owner) {
+        handler = &Task::Call;
+    }
+
+    // Calls |next| on the loop's thread.  Unlike the rest, may be called
+    // from any thread, though not again until |next| has been called.
+    mx_status_t Post(async_loop_t* loop, Step next) {
+        next_ = next;
+        return async_task_post(loop, this);
+    }
+
+private:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(Task);
+
+    static void Call(async_loop_t* loop, async_task_t* task, mx_status_t status) {
+        Task* self = static_cast<Task*>(task);
+        (self->owner_->*self->next_)(loop, status);
+    }
+
+    T* const owner_;
+    Step next_ = nullptr;
+};
+
+} // namespace async
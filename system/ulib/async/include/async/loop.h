@@ -0,0 +1,150 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <magenta/compiler.h>
+#include <magenta/listnode.h>
+#include <magenta/syscalls/port.h>
+#include <magenta/types.h>
+
+__BEGIN_CDECLS
+
+// An event loop for one thread.  Handle waits, timers and tasks are all
+// structs the caller owns and the loop only links together while they are
+// pending, so none of them costs an allocation.  They all come in through
+// the one port: each handle wait is a packet keyed by the wait's address,
+// the timers share a single kernel timer set for the earliest of them, and
+// posted tasks share one packet however many there are.
+//
+// Handlers are called on the thread running the loop.  Except for
+// async_task_post() and async_loop_quit(), which may be called from any
+// thread, the functions here are to be called on that thread too, or
+// while no thread runs the loop.
+//
+// The structs below must start out zeroed, and their handlers set before
+// they are begun.  All handlers get MX_ERR_CANCELED if the loop is
+// destroyed while they are pending, which is the last the loop touches
+// them.
+
+typedef struct async_loop async_loop_t;
+typedef struct async_wait async_wait_t;
+typedef struct async_timer async_timer_t;
+typedef struct async_task async_task_t;
+typedef struct async_reader async_reader_t;
+
+typedef enum {
+    // The handler is done with the object for now.
+    ASYNC_WAIT_FINISHED = 0,
+    // The loop is to wait again, as it was, or with whatever the handler
+    // changed the struct to.
+    ASYNC_WAIT_AGAIN = 1,
+} async_wait_result_t;
+
+struct async_wait {
+    mx_handle_t object;
+    mx_signals_t trigger;
+    // Called once |object| asserts any of |trigger|, with MX_OK and the
+    // packet's signals.  |signal| is NULL when |status| is not MX_OK.
+    async_wait_result_t (*handler)(async_loop_t* loop, async_wait_t* wait,
+                                   mx_status_t status, const mx_packet_signal_t* signal);
+
+    // the loop's, while pending
+    list_node_t node;
+};
+
+struct async_timer {
+    mx_time_t deadline;
+    // Called once the time is |deadline|, with MX_OK.  The timer is no
+    // longer pending, and may be started again from the handler.
+    void (*handler)(async_loop_t* loop, async_timer_t* timer, mx_status_t status);
+
+    // the loop's, while pending: a node of a pairing heap
+    async_timer_t* child;
+    async_timer_t* sibling;
+    async_timer_t* prev;
+};
+
+struct async_task {
+    // Called once the loop gets to the task, with MX_OK.
+    void (*handler)(async_loop_t* loop, async_task_t* task, mx_status_t status);
+
+    // the loop's, while posted
+    list_node_t node;
+};
+
+// Reads messages from a channel into the caller's buffers as they come in.
+struct async_reader {
+    mx_handle_t channel;
+    void* bytes;
+    uint32_t num_bytes;
+    mx_handle_t* handles;
+    uint32_t num_handles;
+    // Called for each message read, with MX_OK and how much of the buffers
+    // it filled.  The next message overwrites them, so the handler is to
+    // take what it needs of them first.  The handler gets
+    // MX_ERR_BUFFER_TOO_SMALL, with the message's sizes, for a message
+    // that doesn't fit, which is left in the channel to be read again if
+    // it returns ASYNC_WAIT_AGAIN, so it had better grow them first; and
+    // MX_ERR_PEER_CLOSED once the other end is closed and every message
+    // read, at which point the reader is no longer pending whatever the
+    // handler returns.  Returning ASYNC_WAIT_FINISHED stops reading.
+    async_wait_result_t (*handler)(async_loop_t* loop, async_reader_t* reader,
+                                   mx_status_t status, uint32_t actual_bytes,
+                                   uint32_t actual_handles);
+
+    // the loop's
+    async_wait_t wait;
+};
+
+mx_status_t async_loop_create(async_loop_t** out);
+
+// Cancels whatever is still pending, then frees the loop.  Not to be
+// called while a thread runs the loop.
+void async_loop_destroy(async_loop_t* loop);
+
+// Runs handlers until |deadline|, returning MX_ERR_TIMED_OUT then, or
+// until async_loop_quit() is called, returning MX_ERR_CANCELED.  If |once|
+// it returns MX_OK after the first packet's handlers instead.
+//
+// A packet may have many handlers: one for each timer expired, each
+// message read, and each task posted while the loop was busy.  Packets
+// already queued when the loop wakes are handled before it sleeps again.
+mx_status_t async_loop_run(async_loop_t* loop, mx_time_t deadline, bool once);
+
+// Makes async_loop_run() return; for good, as every later call returns
+// MX_ERR_CANCELED straight away.
+void async_loop_quit(async_loop_t* loop);
+
+// The loop that this thread is running, if any.
+async_loop_t* async_loop_get_current(void);
+
+// Starts waiting for |wait->object| to assert any of |wait->trigger|.
+mx_status_t async_wait_begin(async_loop_t* loop, async_wait_t* wait);
+
+// Stops a pending wait without calling its handler.  Returns
+// MX_ERR_NOT_FOUND if the wait isn't pending.
+mx_status_t async_wait_cancel(async_loop_t* loop, async_wait_t* wait);
+
+// Calls |timer->handler| at |timer->deadline|, or as soon as the loop
+// can if that has passed.  Timers due at the same time fire in no
+// particular order.  The timer must not already be pending.
+mx_status_t async_timer_start(async_loop_t* loop, async_timer_t* timer);
+
+// Stops a pending timer without calling its handler.  Returns
+// MX_ERR_NOT_FOUND if the timer isn't pending.
+mx_status_t async_timer_cancel(async_loop_t* loop, async_timer_t* timer);
+
+// Calls |task->handler| on the loop's thread, after any tasks posted
+// before it.  The task must not already be posted.  May be called from
+// any thread.
+mx_status_t async_task_post(async_loop_t* loop, async_task_t* task);
+
+// Starts reading messages from |reader->channel|.
+mx_status_t async_reader_begin(async_loop_t* loop, async_reader_t* reader);
+
+// Stops reading without calling the reader's handler.
+mx_status_t async_reader_cancel(async_loop_t* loop, async_reader_t* reader);
+
+__END_CDECLS
@@ -0,0 +1,384 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <threads.h>
+
+#include <magenta/syscalls.h>
+#include <magenta/syscalls/port.h>
+
+#include <async/loop.h>
+
+// The keys of the loop's own packets; every handle wait's key is the
+// async_wait_t's address.
+#define KEY_WAKE 0
+#define KEY_TIMER 1
+
+// the most packets handled, and messages read from a channel, before
+// going back to the port
+#define BATCH 16
+
+struct async_loop {
+    mx_handle_t port;
+    atomic_bool quit;
+
+    // the waits pending, to cancel at destroy
+    list_node_t waits;
+
+    // the timers pending, and when the kernel timer is set for, which is
+    // the earliest of them
+    mx_handle_t timer;
+    async_timer_t* timers;
+    mx_time_t timer_deadline;
+
+    // tasks posted, and whether a packet is on its way to run them
+    mtx_t lock;
+    list_node_t tasks;
+    bool wake_queued;
+};
+
+static thread_local async_loop_t* current;
+
+// A pairing heap of timers, by deadline.  A node's |prev| is its parent if
+// it is the first child, else the sibling before it.
+
+static bool timer_pending(async_loop_t* loop, async_timer_t* t) {
+    return t->prev != NULL || loop->timers == t;
+}
+
+static async_timer_t* meld(async_timer_t* a, async_timer_t* b) {
+    if (a == NULL) {
+        return b;
+    }
+    if (b == NULL) {
+        return a;
+    }
+    if (b->deadline < a->deadline) {
+        async_timer_t* t = a;
+        a = b;
+        b = t;
+    }
+    b->prev = a;
+    b->sibling = a->child;
+    if (a->child) {
+        a->child->prev = b;
+    }
+    a->child = b;
+    return a;
+}
+
+// Melds a list of siblings into one heap: in pairs left to right, then
+// the pairs right to left.
+static async_timer_t* meld_siblings(async_timer_t* first) {
+    async_timer_t* pairs = NULL;
+    while (first) {
+        async_timer_t* a = first;
+        async_timer_t* b = a->sibling;
+        first = b ? b->sibling : NULL;
+        a->sibling = a->prev = NULL;
+        if (b) {
+            b->sibling = b->prev = NULL;
+        }
+        async_timer_t* pair = meld(a, b);
+        pair->sibling = pairs;
+        pairs = pair;
+    }
+    async_timer_t* root = NULL;
+    while (pairs) {
+        async_timer_t* next = pairs->sibling;
+        pairs->sibling = NULL;
+        root = meld(root, pairs);
+        pairs = next;
+    }
+    return root;
+}
+
+static void timer_remove(async_loop_t* loop, async_timer_t* t) {
+    if (t == loop->timers) {
+        loop->timers = meld_siblings(t->child);
+    } else {
+        if (t->prev->child == t) {
+            t->prev->child = t->sibling;
+        } else {
+            t->prev->sibling = t->sibling;
+        }
+        if (t->sibling) {
+            t->sibling->prev = t->prev;
+        }
+        loop->timers = meld(loop->timers, meld_siblings(t->child));
+    }
+    t->child = t->sibling = t->prev = NULL;
+}
+
+// Sets the kernel timer for the earliest timer, or cancels it if there is
+// none.  Either way it is no longer signaled, unless already due again.
+static void timer_update(async_loop_t* loop, bool force) {
+    mx_time_t deadline = loop->timers ? loop->timers->deadline : MX_TIME_INFINITE;
+    if (deadline == loop->timer_deadline && !force) {
+        return;
+    }
+    loop->timer_deadline = deadline;
+    if (deadline == MX_TIME_INFINITE) {
+        mx_timer_cancel(loop->timer);
+    } else {
+        mx_timer_start(loop->timer, deadline, 0, 0);
+    }
+}
+
+static mx_status_t timer_wait(async_loop_t* loop) {
+    return mx_object_wait_async(loop->timer, loop->port, KEY_TIMER,
+                                MX_TIMER_SIGNALED, MX_WAIT_ASYNC_ONCE);
+}
+
+static void fire_timers(async_loop_t* loop) {
+    mx_time_t now = mx_time_get(MX_CLOCK_MONOTONIC);
+    async_timer_t* t;
+    while ((t = loop->timers) != NULL && t->deadline <= now) {
+        timer_remove(loop, t);
+        t->handler(loop, t, MX_OK);
+    }
+    // The kernel timer has fired, and stays signaled until set again.
+    timer_update(loop, true);
+    timer_wait(loop);
+}
+
+static void run_tasks(async_loop_t* loop) {
+    list_node_t tasks = LIST_INITIAL_VALUE(tasks);
+    mtx_lock(&loop->lock);
+    list_move(&loop->tasks, &tasks);
+    loop->wake_queued = false;
+    mtx_unlock(&loop->lock);
+
+    async_task_t* task;
+    while ((task = list_remove_head_type(&tasks, async_task_t, node)) != NULL) {
+        task->handler(loop, task, MX_OK);
+    }
+}
+
+static mx_status_t wait_begin(async_loop_t* loop, async_wait_t* wait) {
+    mx_status_t status = mx_object_wait_async(wait->object, loop->port, (uintptr_t)wait,
+                                              wait->trigger, MX_WAIT_ASYNC_ONCE);
+    if (status == MX_OK) {
+        list_add_tail(&loop->waits, &wait->node);
+    }
+    return status;
+}
+
+static void wait_done(async_loop_t* loop, async_wait_t* wait, const mx_packet_signal_t* signal) {
+    list_delete(&wait->node);
+    if (wait->handler(loop, wait, MX_OK, signal) == ASYNC_WAIT_AGAIN) {
+        mx_status_t status = wait_begin(loop, wait);
+        if (status != MX_OK) {
+            wait->handler(loop, wait, status, NULL);
+        }
+    }
+}
+
+static void dispatch(async_loop_t* loop, const mx_port_packet_t* pkt) {
+    switch (pkt->key) {
+    case KEY_WAKE:
+        run_tasks(loop);
+        break;
+    case KEY_TIMER:
+        fire_timers(loop);
+        break;
+    default:
+        wait_done(loop, (async_wait_t*)(uintptr_t)pkt->key, &pkt->signal);
+        break;
+    }
+}
+
+mx_status_t async_loop_create(async_loop_t** out) {
+    async_loop_t* loop = calloc(1, sizeof(*loop));
+    if (loop == NULL) {
+        return MX_ERR_NO_MEMORY;
+    }
+    list_initialize(&loop->waits);
+    list_initialize(&loop->tasks);
+    mtx_init(&loop->lock, mtx_plain);
+    loop->timer_deadline = MX_TIME_INFINITE;
+
+    mx_status_t status;
+    if ((status = mx_port_create(MX_PORT_OPT_V2, &loop->port)) != MX_OK) {
+        goto fail;
+    }
+    if ((status = mx_timer_create(0, MX_CLOCK_MONOTONIC, &loop->timer)) != MX_OK) {
+        goto fail;
+    }
+    if ((status = timer_wait(loop)) != MX_OK) {
+        goto fail;
+    }
+    *out = loop;
+    return MX_OK;
+
+fail:
+    mx_handle_close(loop->timer);
+    mx_handle_close(loop->port);
+    mtx_destroy(&loop->lock);
+    free(loop);
+    return status;
+}
+
+void async_loop_destroy(async_loop_t* loop) {
+    atomic_store(&loop->quit, true);
+
+    async_wait_t* wait;
+    while ((wait = list_remove_head_type(&loop->waits, async_wait_t, node)) != NULL) {
+        mx_port_cancel(loop->port, wait->object, (uintptr_t)wait);
+        wait->handler(loop, wait, MX_ERR_CANCELED, NULL);
+    }
+    async_timer_t* t;
+    while ((t = loop->timers) != NULL) {
+        timer_remove(loop, t);
+        t->handler(loop, t, MX_ERR_CANCELED);
+    }
+    // Nothing can be posted now, so the lock can be left alone.
+    async_task_t* task;
+    while ((task = list_remove_head_type(&loop->tasks, async_task_t, node)) != NULL) {
+        task->handler(loop, task, MX_ERR_CANCELED);
+    }
+
+    if (current == loop) {
+        current = NULL;
+    }
+    mx_handle_close(loop->timer);
+    mx_handle_close(loop->port);
+    mtx_destroy(&loop->lock);
+    free(loop);
+}
+
+mx_status_t async_loop_run(async_loop_t* loop, mx_time_t deadline, bool once) {
+    async_loop_t* outer = current;
+    current = loop;
+    mx_status_t status = MX_OK;
+    while (!atomic_load(&loop->quit)) {
+        mx_port_packet_t pkt;
+        if ((status = mx_port_wait(loop->port, deadline, &pkt, 0)) != MX_OK) {
+            break;
+        }
+        // Handle a few more of what's already queued before checking the
+        // deadline again, without sleeping.
+        int n = 0;
+        do {
+            dispatch(loop, &pkt);
+        } while (++n < BATCH && !atomic_load(&loop->quit) &&
+                 mx_port_wait(loop->port, 0, &pkt, 0) == MX_OK);
+        if (once) {
+            break;
+        }
+    }
+    if (atomic_load(&loop->quit)) {
+        status = MX_ERR_CANCELED;
+    }
+    current = outer;
+    return status;
+}
+
+void async_loop_quit(async_loop_t* loop) {
+    atomic_store(&loop->quit, true);
+    mx_port_packet_t pkt = {
+        .key = KEY_WAKE,
+        .type = MX_PKT_TYPE_USER,
+    };
+    mx_port_queue(loop->port, &pkt, 0);
+}
+
+async_loop_t* async_loop_get_current(void) {
+    return current;
+}
+
+mx_status_t async_wait_begin(async_loop_t* loop, async_wait_t* wait) {
+    if (list_in_list(&wait->node)) {
+        return MX_ERR_ALREADY_EXISTS;
+    }
+    return wait_begin(loop, wait);
+}
+
+mx_status_t async_wait_cancel(async_loop_t* loop, async_wait_t* wait) {
+    if (!list_in_list(&wait->node)) {
+        return MX_ERR_NOT_FOUND;
+    }
+    // This takes back the packet too, if it is queued already.
+    mx_status_t status = mx_port_cancel(loop->port, wait->object, (uintptr_t)wait);
+    list_delete(&wait->node);
+    return status;
+}
+
+mx_status_t async_timer_start(async_loop_t* loop, async_timer_t* timer) {
+    if (timer_pending(loop, timer)) {
+        return MX_ERR_ALREADY_EXISTS;
+    }
+    timer->child = timer->sibling = timer->prev = NULL;
+    loop->timers = meld(loop->timers, timer);
+    timer_update(loop, false);
+    return MX_OK;
+}
+
+mx_status_t async_timer_cancel(async_loop_t* loop, async_timer_t* timer) {
+    if (!timer_pending(loop, timer)) {
+        return MX_ERR_NOT_FOUND;
+    }
+    timer_remove(loop, timer);
+    timer_update(loop, false);
+    return MX_OK;
+}
+
+mx_status_t async_task_post(async_loop_t* loop, async_task_t* task) {
+    mtx_lock(&loop->lock);
+    list_add_tail(&loop->tasks, &task->node);
+    bool wake = !loop->wake_queued;
+    loop->wake_queued = true;
+    mtx_unlock(&loop->lock);
+
+    if (wake) {
+        mx_port_packet_t pkt = {
+            .key = KEY_WAKE,
+            .type = MX_PKT_TYPE_USER,
+        };
+        return mx_port_queue(loop->port, &pkt, 0);
+    }
+    return MX_OK;
+}
+
+static async_wait_result_t reader_func(async_loop_t* loop, async_wait_t* wait,
+                                       mx_status_t status, const mx_packet_signal_t* signal) {
+    async_reader_t* reader = (async_reader_t*)((char*)wait - offsetof(async_reader_t, wait));
+    if (status != MX_OK) {
+        reader->handler(loop, reader, status, 0, 0);
+        return ASYNC_WAIT_FINISHED;
+    }
+    // Read what's there, up to a limit so as not to starve the rest of the
+    // loop.  If there's more, the wait fires again straight away.
+    for (int n = 0; n < BATCH; n++) {
+        uint32_t actual_bytes = 0;
+        uint32_t actual_handles = 0;
+        status = mx_channel_read(reader->channel, 0, reader->bytes, reader->handles,
+                                 reader->num_bytes, reader->num_handles,
+                                 &actual_bytes, &actual_handles);
+        if (status == MX_ERR_SHOULD_WAIT) {
+            break;
+        }
+        if (reader->handler(loop, reader, status, actual_bytes, actual_handles) !=
+                ASYNC_WAIT_AGAIN ||
+            (status != MX_OK && status != MX_ERR_BUFFER_TOO_SMALL)) {
+            return ASYNC_WAIT_FINISHED;
+        }
+    }
+    return ASYNC_WAIT_AGAIN;
+}
+
+mx_status_t async_reader_begin(async_loop_t* loop, async_reader_t* reader) {
+    reader->wait.object = reader->channel;
+    reader->wait.trigger = MX_CHANNEL_READABLE | MX_CHANNEL_PEER_CLOSED;
+    reader->wait.handler = reader_func;
+    return async_wait_begin(loop, &reader->wait);
+}
+
+mx_status_t async_reader_cancel(async_loop_t* loop, async_reader_t* reader) {
+    return async_wait_cancel(loop, &reader->wait);
+}
@@ -13,6 +13,10 @@
 
 #include <lz4/lz4.h>
 
+#if BOOTDATA_THREADS
+#include <threads.h>
+#endif
+
 // The LZ4 Frame format is used to compress a bootfs image, but we cannot use
 // the LZ4 library's decompression functions in userboot. The following
 // definitions are used in the reimplementation of LZ4 Frame decompression, with
@@ -85,6 +89,173 @@ static mx_status_t check_lz4_frame(const lz4_frame_desc* fd,
     return MX_OK;
 }
 
+// Read each LZ4 block and decompress it into dst, which has room for
+// remaining bytes. Block sizes are 32 bits.
+static mx_status_t decompress_lz4_blocks(const uint8_t* data, uint8_t* dst,
+                                         size_t remaining, size_t* leftover,
+                                         const char** err) {
+    uint32_t blocksize = *(const uint32_t*)data;
+    data += sizeof(uint32_t);
+    while (blocksize) {
+        // If the data is uncompressed, the high bit is 1.
+        if (blocksize >> 31) {
+            uint32_t actual = blocksize & 0x7fffffff;
+            if (actual > remaining) {
+                *err = "bootdata outsize too small for lz4 decompression";
+                return MX_ERR_INVALID_ARGS;
+            }
+            memcpy(dst, data, actual);
+            dst += actual;
+            data += actual;
+            remaining -= actual;
+        } else {
+            int dcmp = LZ4_decompress_safe((const char*)data, (char*)dst, blocksize, remaining);
+            if (dcmp < 0) {
+                *err = "lz4 decompression failed";
+                return MX_ERR_BAD_STATE;
+            }
+            dst += dcmp;
+            data += blocksize;
+            remaining -= dcmp;
+        }
+
+        blocksize = *(uint32_t*)data;
+        data += sizeof(uint32_t);
+    }
+    *leftover = remaining;
+    return MX_OK;
+}
+
+#if BOOTDATA_THREADS
+// Every block but the last of a frame written without flushes decompresses
+// to exactly the maximum block size, so block i lands at i * 64kB and the
+// blocks can be decompressed in any order, by as many threads as we like.
+#define LZ4_BLOCK_SIZE       (64 * 1024)
+#define MIN_BLOCKS_PER_THREAD 16
+#define MAX_DECOMP_THREADS    8
+
+typedef struct {
+    const uint8_t* data;    // first block header of the frame
+    uint8_t* dst;
+    size_t capacity;
+    size_t nblocks;
+    size_t first;           // this worker's blocks are [first, last)
+    size_t last;
+    size_t last_size;       // output size of the frame's final block
+    mx_status_t status;
+} lz4_worker_t;
+
+static int lz4_worker(void* arg) {
+    lz4_worker_t* w = arg;
+    const uint8_t* data = w->data;
+    w->status = MX_OK;
+    for (size_t i = 0; i < w->last; i++) {
+        uint32_t blocksize = *(const uint32_t*)data;
+        data += sizeof(uint32_t);
+        uint32_t actual = blocksize & 0x7fffffff;
+        if (i >= w->first) {
+            size_t off = i * LZ4_BLOCK_SIZE;
+            size_t room = w->capacity - off;
+            if (room > LZ4_BLOCK_SIZE) {
+                room = LZ4_BLOCK_SIZE;
+            }
+            size_t out;
+            if (blocksize >> 31) {
+                if (actual > room) {
+                    w->status = MX_ERR_NEXT;
+                    return 0;
+                }
+                memcpy(w->dst + off, data, actual);
+                out = actual;
+            } else {
+                int dcmp = LZ4_decompress_safe((const char*)data, (char*)w->dst + off,
+                                               blocksize, room);
+                if (dcmp < 0) {
+                    // This may only mean that the block is larger than its
+                    // slot; the serial pass decides whether it's corrupt.
+                    w->status = MX_ERR_NEXT;
+                    return 0;
+                }
+                out = dcmp;
+            }
+            if (i + 1 == w->nblocks) {
+                w->last_size = out;
+            } else if (out != LZ4_BLOCK_SIZE) {
+                w->status = MX_ERR_NEXT;
+                return 0;
+            }
+        }
+        data += actual;
+    }
+    return 0;
+}
+
+// Decompress the blocks of a frame across the CPUs. Returns MX_ERR_NEXT if
+// the frame isn't laid out in full blocks, in which case the caller must
+// fall back to decompress_lz4_blocks().
+static mx_status_t decompress_lz4_blocks_parallel(const uint8_t* data, uint8_t* dst,
+                                                  size_t remaining, size_t* leftover) {
+    // Walking the block headers is cheap next to decompressing the blocks.
+    size_t nblocks = 0;
+    for (const uint8_t* p = data; *(const uint32_t*)p != 0; nblocks++) {
+        p += sizeof(uint32_t) + (*(const uint32_t*)p & 0x7fffffff);
+    }
+    if ((nblocks == 0) || ((nblocks - 1) * LZ4_BLOCK_SIZE >= remaining)) {
+        return MX_ERR_NEXT;
+    }
+
+    size_t nthreads = mx_system_get_num_cpus();
+    if (nthreads > MAX_DECOMP_THREADS) {
+        nthreads = MAX_DECOMP_THREADS;
+    }
+    if (nthreads > nblocks / MIN_BLOCKS_PER_THREAD) {
+        nthreads = nblocks / MIN_BLOCKS_PER_THREAD;
+    }
+    if (nthreads <= 1) {
+        return MX_ERR_NEXT;
+    }
+
+    lz4_worker_t workers[MAX_DECOMP_THREADS];
+    thrd_t threads[MAX_DECOMP_THREADS];
+    bool started[MAX_DECOMP_THREADS];
+    for (size_t i = 0; i < nthreads; i++) {
+        workers[i] = (lz4_worker_t) {
+            .data = data,
+            .dst = dst,
+            .capacity = remaining,
+            .nblocks = nblocks,
+            .first = nblocks * i / nthreads,
+            .last = nblocks * (i + 1) / nthreads,
+        };
+        // The calling thread takes the first share itself.
+        started[i] = (i != 0) &&
+                     (thrd_create_with_name(&threads[i], lz4_worker, &workers[i],
+                                            "bootfs-lz4") == thrd_success);
+    }
+    for (size_t i = 0; i < nthreads; i++) {
+        if (!started[i]) {
+            lz4_worker(&workers[i]);
+        }
+    }
+
+    mx_status_t status = MX_OK;
+    for (size_t i = 0; i < nthreads; i++) {
+        if (started[i]) {
+            thrd_join(threads[i], NULL);
+        }
+        if (workers[i].status != MX_OK) {
+            status = workers[i].status;
+        }
+    }
+    if (status != MX_OK) {
+        return status;
+    }
+
+    *leftover = remaining - (nblocks - 1) * LZ4_BLOCK_SIZE - workers[nthreads - 1].last_size;
+    return MX_OK;
+}
+#endif
+
 static mx_status_t decompress_bootfs_vmo(mx_handle_t vmar,
                                          const uint8_t* data, mx_handle_t* out,
                                          const char** err) {
@@ -136,40 +307,23 @@ static mx_status_t decompress_bootfs_vmo(mx_handle_t vmar,
     dst += sizeof(bootdata_t);
     remaining -= sizeof(bootdata_t);
 
-    // Read each LZ4 block and decompress it. Block sizes are 32 bits.
-    uint32_t blocksize = *(const uint32_t*)data;
-    data += sizeof(uint32_t);
-    while (blocksize) {
-        // If the data is uncompressed, the high bit is 1.
-        if (blocksize >> 31) {
-            uint32_t actual = blocksize & 0x7fffffff;
-            memcpy(dst, data, actual);
-            dst += actual;
-            data += actual;
-            if (remaining - actual > remaining) {
-                // Remaining wrapped around (would be negative if signed)
-                *err = "bootdata outsize too small for lz4 decompression";
-                return MX_ERR_INVALID_ARGS;
-            }
-            remaining -= actual;
-        } else {
-            int dcmp = LZ4_decompress_safe((const char*)data, (char*)dst, blocksize, remaining);
-            if (dcmp < 0) {
-                *err = "lz4 decompression failed";
-                return MX_ERR_BAD_STATE;
-            }
-            dst += dcmp;
-            data += blocksize;
-            if (remaining - dcmp > remaining) {
-                // Remaining wrapped around (would be negative if signed)
-                *err = "bootdata outsize too small for lz4 decompression";
-                return MX_ERR_INVALID_ARGS;
-            }
-            remaining -= dcmp;
+#if BOOTDATA_THREADS
+    status = decompress_lz4_blocks_parallel(data, dst, remaining, &remaining);
+    if (status == MX_ERR_NEXT) {
+        // Not every block filled its 64kB, so the blocks can't be placed
+        // without decompressing the ones before them. Clear whatever the
+        // workers left past the end of the real contents.
+        size_t capacity = remaining;
+        status = decompress_lz4_blocks(data, dst, capacity, &remaining, err);
+        if (status == MX_OK) {
+            memset(dst + capacity - remaining, 0, remaining);
         }
-
-        blocksize = *(uint32_t*)data;
-        data += sizeof(uint32_t);
+    }
+#else
+    status = decompress_lz4_blocks(data, dst, remaining, &remaining, err);
+#endif
+    if (status < 0) {
+        return status;
     }
 
     // Sanity check: verify that we didn't have more than one page leftover.
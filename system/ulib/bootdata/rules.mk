@@ -10,6 +10,9 @@ MODULE_TYPE := userlib
 
 MODULE_SRCS += $(LOCAL_DIR)/decompress.c
 
+# userboot builds decompress.c itself, without threads.
+MODULE_DEFINES := BOOTDATA_THREADS=1
+
 MODULE_LIBS := \
     third_party/ulib/lz4 \
     system/ulib/magenta \
@@ -37,6 +37,13 @@ typedef struct iotxn iotxn_t;
 // opcodes
 #define IOTXN_OP_READ      1
 #define IOTXN_OP_WRITE     2
+// Makes every write which completed before this was queued durable, through
+// any volatile write cache the device has. Carries no data.
+#define IOTXN_OP_FLUSH     3
+// Lets the device free [offset, offset + length), whose contents are no longer
+// needed. Carries no data. Only queued to devices whose block protocol has a
+// discard op.
+#define IOTXN_OP_DISCARD   4
 
 // cache maintenance ops
 #define IOTXN_CACHE_INVALIDATE        MX_VMO_OP_CACHE_INVALIDATE
@@ -53,6 +60,10 @@ typedef struct iotxn iotxn_t;
 // This iotxn should complete before any iotxns queued after it
 // are started.
 #define IOTXN_SYNC_AFTER   2
+//
+// This write should be durable by the time it completes, rather than
+// once the device's write cache is next flushed (Force Unit Access).
+#define IOTXN_FUA          4
 
 typedef uint64_t iotxn_proto_data_t[6];
 typedef uint64_t iotxn_extra_data_t[6];
@@ -158,6 +169,23 @@ mx_status_t iotxn_alloc(iotxn_t** out, uint32_t alloc_flags, uint64_t data_size)
 mx_status_t iotxn_alloc_vmo(iotxn_t** out, uint32_t alloc_flags, mx_handle_t vmo_handle,
                             uint64_t vmo_offset, uint64_t length);
 
+// A pool of iotxns with buffers of data_size bytes (or none, if it is zero),
+// for a driver to create when it binds, sized to the transfers it keeps in
+// flight. The buffers are allocated up front, with their pages committed,
+// pinned, and their physical addresses looked up, and iotxn_release() hands
+// the iotxns back to the pool with all that kept.
+typedef struct iotxn_pool iotxn_pool_t;
+
+mx_status_t iotxn_pool_create(iotxn_pool_t** out, uint32_t alloc_flags, uint64_t data_size,
+                              size_t count);
+
+// takes an iotxn from the pool, or fails with MX_ERR_NO_RESOURCES if every
+// one of them is in use
+mx_status_t iotxn_pool_alloc(iotxn_pool_t* pool, iotxn_t** out);
+
+// frees the pool, once every iotxn taken from it has been released
+void iotxn_pool_destroy(iotxn_pool_t* pool);
+
 // initializes a statically allocated iotxn based on provided VMO.
 // calling iotxn_release() on this iotxn will free any resources allocated by the iotxn
 // but not free the iotxn itself.
@@ -9,6 +9,13 @@
 
 typedef struct block_callbacks {
     void (*complete)(void* cookie, mx_status_t status);
+
+    // Drivers which complete several operations at once, as from a single
+    // interrupt, may call these around the complete() calls, on the thread
+    // making them, so that what they complete is reported together when the
+    // batch ends. Batches may nest. Either may be NULL.
+    void (*batch_begin)(void);
+    void (*batch_end)(void);
 } block_callbacks_t;
 
 typedef struct block_protocol_ops {
@@ -26,6 +33,42 @@ typedef struct block_protocol_ops {
     // Write from the VMO to the block device
     void (*write)(void* ctx, mx_handle_t vmo, uint64_t length, uint64_t vmo_offset,
                   uint64_t dev_offset, void* cookie);
+
+    // Optional: read and write, with the physical address of each page of
+    // the VMO's range already looked up. |phys| starts at the page containing
+    // |vmo_offset|, as iotxn phys lists do, and the caller keeps the pages
+    // pinned until the operation completes.
+    void (*read_phys)(void* ctx, mx_handle_t vmo, uint64_t length, uint64_t vmo_offset,
+                      uint64_t dev_offset, mx_paddr_t* phys, uint64_t phys_count,
+                      void* cookie);
+    void (*write_phys)(void* ctx, mx_handle_t vmo, uint64_t length, uint64_t vmo_offset,
+                       uint64_t dev_offset, mx_paddr_t* phys, uint64_t phys_count,
+                       void* cookie);
+
+    // Optional: makes every write which completed before the flush was issued
+    // durable, through any volatile write cache the device has. Devices
+    // without one may leave this out.
+    void (*flush)(void* ctx, void* cookie);
+
+    // Optional: a write which is durable once it completes. |phys| is as for
+    // write_phys, or NULL if the pages haven't been looked up. Devices which
+    // can't do this natively leave it out, and have such writes followed by
+    // a flush instead.
+    void (*write_fua)(void* ctx, mx_handle_t vmo, uint64_t length, uint64_t vmo_offset,
+                      uint64_t dev_offset, mx_paddr_t* phys, uint64_t phys_count,
+                      void* cookie);
+
+    // Optional: completes, on the calling thread, whatever the device has
+    // finished of the operations issued from that thread, and returns how
+    // many it completed. Devices fast enough that waiting for their
+    // interrupts costs more than their operations offer this, and the caller
+    // may poll for a while before it waits for the interrupts instead.
+    uint32_t (*poll)(void* ctx);
+
+    // Optional: the block-aligned range is no longer needed, and the device
+    // may free what holds it. Reads of it are unspecified until it is
+    // written again.
+    void (*discard)(void* ctx, uint64_t length, uint64_t dev_offset, void* cookie);
 } block_protocol_ops_t;
 
 typedef struct {
@@ -45,6 +45,32 @@ typedef struct display_protocol_ops {
     // The provided callback will be invoked with a value of true if the display
     // has been acquired, false if it has been released.
     void (*set_ownership_change_callback)(void* ctx, mx_display_cb_t callback, void* cookie);
+
+    // flushes just a rectangle of the framebuffer (optional)
+    // Devices that copy the framebuffer to the display implement this so
+    // that small updates do not cost a transfer of the whole frame.
+    void (*flush_region)(void* ctx, uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+
+    // sets the image of the hardware cursor (optional)
+    // |pixels| are width * height 32 bit ARGB pixels, neither more than
+    // MX_DISPLAY_MAX_CURSOR_SIZE.
+    mx_status_t (*set_cursor)(void* ctx, const uint32_t* pixels, uint32_t width, uint32_t height);
+
+    // moves, shows or hides the hardware cursor (optional)
+    mx_status_t (*move_cursor)(void* ctx, int32_t x, int32_t y, bool visible);
+
+    // fills a rectangle of the framebuffer with |color| (optional)
+    // Devices with a blitter implement this and copy_region so that
+    // clearing and scrolling are done without the CPU writing each pixel.
+    // Both return once the framebuffer has been written.
+    mx_status_t (*fill_region)(void* ctx, uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+                               uint32_t color);
+
+    // copies a rectangle of the framebuffer to (dst_x, dst_y) (optional)
+    // Returns MX_ERR_NOT_SUPPORTED for overlaps the device can't copy in
+    // the right order, which the caller then does itself.
+    mx_status_t (*copy_region)(void* ctx, uint32_t src_x, uint32_t src_y,
+                               uint32_t width, uint32_t height, uint32_t dst_x, uint32_t dst_y);
 } display_protocol_ops_t;
 
 typedef struct mx_display_protocol {
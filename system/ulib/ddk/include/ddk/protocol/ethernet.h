@@ -21,22 +21,47 @@ __BEGIN_CDECLS;
 // interface (which is selectable independently for transmit and
 // receive)
 //
-// TODO: Implement zero-copy interface in the ethernet common
-// middle layer driver.  Currently ethermac drivers that request
-// these will not be loaded.
+// With FEATURE_RX_QUEUE, the ethernet layer hands the mac the rx
+// buffers of one of its clients with queue_rx(), so that packets are
+// received straight into them; other clients are given copies. The
+// mac fills them in the order they were queued, calling complete_rx()
+// once for each, and holds at most rx_queue_depth at once. Buffers
+// still queued when stop() returns are given up, and not written to.
+//
+// With FEATURE_TX_QUEUE, clients' tx buffers are handed to the mac
+// with queue_tx(), ETHMAC_TX_OPT_MORE marking all but the last of a
+// batch so that the hardware need only be told of the batch once. The
+// mac sends them in the order they were queued, and reports them sent
+// with complete_tx(), which may count several; it holds at most
+// tx_queue_depth at once. Those still queued when stop() returns are
+// given up, sent or not.
 //
 // The FEATURE_WLAN flag indicates a device that supports wlan operations.
+//
+// The FEATURE_?X_CSUM flags indicate a device which verifies the TCP and
+// UDP checksums of received packets (see ETHMAC_RX_OPT_CSUM_OK) or
+// inserts those of sent ones (see ETHMAC_TX_OPT_CSUM).
+//
+// The FEATURE_TX_FLOW flag indicates a mac which sends over several
+// hardware queues, and would keep each flow to one of them. The ethernet
+// layer then passes a hash of each frame's flow to queue_tx(), in
+// ETHMAC_TX_OPT_FLOW. Completions are still reported in queue_tx() order.
 
 #define ETHMAC_FEATURE_RX_QUEUE (1u)
 #define ETHMAC_FEATURE_TX_QUEUE (2u)
 #define ETHMAC_FEATURE_WLAN     (4u)
+#define ETHMAC_FEATURE_RX_CSUM  (8u)
+#define ETHMAC_FEATURE_TX_CSUM  (16u)
+#define ETHMAC_FEATURE_TX_FLOW  (32u)
 
 typedef struct ethmac_info {
     uint32_t features;
     uint32_t mtu;
     uint8_t mac[ETH_MAC_SIZE];
     uint8_t reserved0[2];
-    uint32_t reserved1[4];
+    uint32_t rx_queue_depth; // With FEATURE_RX_QUEUE; zero is as many as it's given
+    uint32_t tx_queue_depth; // With FEATURE_TX_QUEUE; zero is as many as it's given
+    uint32_t reserved1[2];
 } ethmac_info_t;
 
 #define ETHMAC_STATUS_ONLINE (1u)
@@ -48,6 +73,7 @@ typedef struct ethmac_ifc_virt {
     void (*recv)(void* cookie, void* data, size_t length, uint32_t flags);
 
     // complete_?x() is invoked when FEATURE_?X_QUEUE is present
+    // A complete_rx() length of zero returns the buffer unused.
     void (*complete_rx)(void* cookie, uint32_t length, uint32_t flags);
     void (*complete_tx)(void* cookie, uint32_t count);
 } ethmac_ifc_t;
@@ -56,6 +82,31 @@ typedef struct ethmac_ifc_virt {
 // driver to batch tx to hardware if possible.
 #define ETHMAC_TX_OPT_MORE (1u)
 
+// With FEATURE_TX_CSUM, asks for the ones' complement sum of the frame,
+// from the byte at CSUM_START to its end, to be complemented and stored
+// at CSUM_OFFSET. The checksum field there holds the pseudo-header sum.
+#define ETHMAC_TX_OPT_CSUM (2u)
+#define ETHMAC_TX_OPT_CSUM_START(n) (((n) & 0xFFu) << 16)
+#define ETHMAC_TX_OPT_CSUM_OFFSET(n) (((n) & 0xFFu) << 24)
+#define ETHMAC_TX_CSUM_START(opt) (((opt) >> 16) & 0xFFu)
+#define ETHMAC_TX_CSUM_OFFSET(opt) (((opt) >> 24) & 0xFFu)
+
+// With FEATURE_TX_FLOW, the low bits of the hash of the frame's flow;
+// frames which aren't TCP or UDP over IP are all of flow zero.
+#define ETHMAC_TX_OPT_FLOW(n) (((n) & 0xFFu) << 8)
+#define ETHMAC_TX_FLOW(opt) (((opt) >> 8) & 0xFFu)
+
+// Passed to recv() or complete_rx(), indicates that more packets follow
+// in the same batch, such as those found by one interrupt. The ethernet
+// layer hands packets to its clients a batch at a time, so that a batch
+// costs each of them one fifo write. Drivers which can't tell needn't
+// set it; their packets are each handed over alone.
+#define ETHMAC_RX_OPT_MORE (1u)
+
+// Passed to recv() or complete_rx() by a mac with FEATURE_RX_CSUM, when
+// it has found the packet's TCP or UDP checksum good.
+#define ETHMAC_RX_OPT_CSUM_OK (2u)
+
 // The ethernet midlayer will never call ethermac_protocol
 // methods from multiple threads simultaneously, but it
 // can call send() methods at the same time as non-send
@@ -79,6 +130,8 @@ typedef struct ethmac_protocol_ops {
     void (*send)(void* ctx, uint32_t options, void* data, size_t length);
 
     // queue_?x() is valid if FEATURE_?X_QUEUE is present, otherwise they are no-op
+    // The buffer is at physical address pa0, continuing at pa1 if it crosses
+    // a page boundary; pa1 is zero if it does not.
     void (*queue_tx)(void* ctx, uint32_t options,
                      uintptr_t pa0, uintptr_t pa1, size_t length);
     void (*queue_rx)(void* ctx, uint32_t options,
@@ -41,6 +41,9 @@ typedef struct pci_protocol_ops {
                                        uint32_t* out_max_irqs);
     mx_status_t (*set_irq_mode)(void* ctx, mx_pci_irq_mode_t mode,
                                 uint32_t requested_irq_count);
+    // Steers IRQ |which_irq| to CPU |cpu_num|.  Only MSI-X vectors can be
+    // steered one at a time.
+    mx_status_t (*set_irq_affinity)(void* ctx, uint32_t which_irq, uint32_t cpu_num);
     mx_status_t (*get_device_info)(void* ctx, mx_pcie_device_info_t* out_info);
 } pci_protocol_ops_t;
 
@@ -31,6 +31,10 @@ typedef struct sdhci_protocol_ops {
 // certain way so we shift all the fields back to their proper offsets.
 #define SDHCI_QUIRK_STRIP_RESPONSE_CRC (1 << 0)
 
+// The controller claims ADMA2 but does its transfers with an engine of its
+// own (as the BCM28xx does), so data must be moved by PIO.
+#define SDHCI_QUIRK_NO_DMA             (1 << 1)
+
 typedef struct sdhci_protocol {
     sdhci_protocol_ops_t* ops;
     void* ctx;
@@ -39,6 +39,7 @@ DDK_PROTOCOL_DEF(SDMMC,          'pSDM', "sdmmc", 0)
 DDK_PROTOCOL_DEF(WLANMAC,        'pWMA', "wlanmac", 0)
 DDK_PROTOCOL_DEF(AUDIO2_INPUT,   'pA2I', "audio2-input", 0)
 DDK_PROTOCOL_DEF(AUDIO2_OUTPUT,  'pA2O', "audio2-output", 0)
+DDK_PROTOCOL_DEF(AUDIO2_MIXER,   'pA2M', "audio2-mixer", 0)
 DDK_PROTOCOL_DEF(BATTERY,        'pBAT', "battery", 0)
 DDK_PROTOCOL_DEF(PTY,            'pPTY', "pty", 0)
 DDK_PROTOCOL_DEF(IHDA,           'pHDA', "intel-hda", 0)
@@ -31,6 +31,9 @@ typedef struct sdhci_regs {
 #define SDHCI_HOSTCTRL_LED_ON              (1 << 0)
 #define SDHCI_HOSTCTRL_FOUR_BIT_BUS_WIDTH  (1 << 1)
 #define SDHCI_HOSTCTRL_HIGHSPEED_ENABLE    (1 << 2)
+#define SDHCI_HOSTCTRL_DMA_SELECT_ADMA2    (2 << 3)
+#define SDHCI_HOSTCTRL_DMA_SELECT_ADMA2_64 (3 << 3)
+#define SDHCI_HOSTCTRL_DMA_SELECT_MASK     (3 << 3)
 #define SDHCI_PWRCTRL_SD_BUS_POWER         (1 << 8)
     uint32_t ctrl1;         // 2Ch
 #define SDHCI_INTERNAL_CLOCK_ENABLE        (1 << 0)
@@ -75,11 +78,15 @@ typedef struct sdhci_regs {
 #define SDHCI_IRQ_ERR_VS_4          (1 << 31)
     uint32_t ctrl2;         // 3Ch
     uint32_t caps0;         // 40h
+#define SDHCI_CORECFG_ADMA2_SUPPORT        (1 << 19)
+#define SDHCI_CORECFG_64BIT_SUPPORT        (1 << 28)
     uint32_t caps1;         // 44h
     uint32_t maxcaps0;      // 48h
     uint32_t maxcaps1;      // 4Ch
     uint32_t forceirq;      // 50h
     uint32_t admaerr;       // 54h
+#define SDHCI_ADMAERR_STATE(err)           ((err) & 0x3)
+#define SDHCI_ADMAERR_LENGTH_MISMATCH      (1 << 2)
     uint32_t admaaddr0;     // 58h
     uint32_t admaaddr1;     // 5Ch
     uint32_t preset[4];     // 60h
@@ -93,3 +100,24 @@ typedef struct sdhci_regs {
 #define SDHCI_VERSION_2 0x01
 #define SDHCI_VERSION_3 0x02
 } __PACKED sdhci_regs_t;
+
+// ADMA2 descriptors, which the controller walks to find the pages of a
+// transfer. The 64-bit form is used when the controller can address all
+// of memory.
+typedef struct sdhci_adma2_desc {
+    uint16_t attr;
+    uint16_t length;        // in bytes; zero means 64K
+    uint32_t address;
+} __PACKED sdhci_adma2_desc_t;
+
+typedef struct sdhci_adma2_desc64 {
+    uint16_t attr;
+    uint16_t length;
+    uint64_t address;
+} __PACKED sdhci_adma2_desc64_t;
+
+#define SDHCI_ADMA2_DESC_VALID    (1 << 0)
+#define SDHCI_ADMA2_DESC_END      (1 << 1)
+#define SDHCI_ADMA2_DESC_INT      (1 << 2)
+#define SDHCI_ADMA2_DESC_ACT_TRAN (2 << 4)
+#define SDHCI_ADMA2_DESC_ACT_LINK (3 << 4)
@@ -35,16 +35,47 @@
 #define IOTXN_PFLAG_MMAP       (1 << 3)   // we performed mmap() on this vmo
 #define IOTXN_PFLAG_FREE       (1 << 4)   // this txn has been released
 #define IOTXN_PFLAG_QUEUED     (1 << 5)   // transaction has been queued and not yet released
+#define IOTXN_PFLAG_PINNED     (1 << 6)   // we pinned the pages of this vmo
 
 #define IOTXN_STATE_MASK       (IOTXN_PFLAG_FREE | IOTXN_PFLAG_QUEUED)
 
-static list_node_t free_list = LIST_INITIAL_VALUE(free_list);
+// Released iotxns are kept to be reused. Those with no buffer of their own,
+// which is most of them, go to a small cache per thread, which trades them
+// with the shared list a batch at a time. Those with buffers go to shared
+// lists by size class, so finding one of the right size is a short search.
+#define IOTXN_SIZE_CLASSES 16
+#define THREAD_CACHE_MAX   32
+#define THREAD_CACHE_BATCH 16
+
+static list_node_t free_lists[IOTXN_SIZE_CLASSES];
 static mtx_t free_list_mutex = MTX_INIT;
 #if FREE_LIST_MONITOR_LIMIT
 static size_t free_list_length = 0;
 static size_t free_list_monitor_warned = 0;
 #endif
 
+typedef struct {
+    list_node_t list;
+    size_t count;
+} iotxn_cache_t;
+
+static thread_local iotxn_cache_t thread_cache;
+static once_flag free_lists_once = ONCE_FLAG_INIT;
+static tss_t thread_cache_key;
+
+struct iotxn_pool {
+    mtx_t lock;
+    list_node_t free_list;
+    size_t outstanding;  // taken from the pool and not yet released
+    bool destroyed;
+};
+
+// iotxns from a pool remember which one they go back to
+typedef struct {
+    iotxn_t txn;
+    iotxn_pool_t* pool;
+} pool_iotxn_t;
+
 // This assert will fail if we attempt to access the buffer of a cloned txn after it has been completed
 #define ASSERT_BUFFER_VALID(priv) MX_DEBUG_ASSERT(!(priv->flags & IOTXN_FLAG_DEAD))
 
@@ -60,35 +91,146 @@ static bool do_free_phys(uint32_t pflags) {
     return (pflags & IOTXN_PFLAG_PHYSMAP);
 }
 
-static iotxn_t* find_in_free_list(uint32_t pflags, uint64_t data_size) {
-    bool found = false;
-    iotxn_t* txn = NULL;
-    //xprintf("find_in_free_list pflags 0x%x data_size 0x%" PRIx64 "\n", pflags, data_size);
-    mtx_lock(&free_list_mutex);
-    list_for_every_entry (&free_list, txn, iotxn_t, node) {
-        // txn->pflags has IOTXN_ALLOC_CONTIGUOUS set if the txn has a contiguous VMO we allocated,
-        // or zero otherwise. And the pflags passed into this function is either zero or
-        // IOTXN_ALLOC_CONTIGUOUS. So here we mask txn->pflags with IOTXN_ALLOC_CONTIGUOUS
-        // to compare just this bit and not get confused by IOTXN_PFLAG_FREE or other flags.
-        if ((txn->vmo_length == data_size) && (((txn->pflags & IOTXN_ALLOC_CONTIGUOUS) == pflags) || data_size == 0)) {
-            found = true;
-            break;
-        }
+static void thread_cache_flush(void* arg);
+
+static void free_lists_init(void) {
+    for (size_t i = 0; i < IOTXN_SIZE_CLASSES; i++) {
+        list_initialize(&free_lists[i]);
     }
-    if (found) {
-        txn->pflags &= ~IOTXN_PFLAG_FREE;
-        list_delete(&txn->node);
+    // hand a thread's cache back when it exits
+    tss_create(&thread_cache_key, thread_cache_flush);
+}
+
+// 0 for no buffer, and then by the power of two of the pages it spans
+static size_t size_class(uint64_t data_size) {
+    if (data_size == 0) {
+        return 0;
+    }
+    uint64_t pages = ROUNDUP(data_size, PAGE_SIZE) / PAGE_SIZE;
+    size_t index = (pages == 1) ? 1 : 2 + (63 - __builtin_clzll(pages - 1));
+    return MIN(index, IOTXN_SIZE_CLASSES - 1);
+}
+
+// call with free_list_mutex held
+static void free_list_add_locked(list_node_t* list, iotxn_t* txn) {
+    list_add_head(list, &txn->node);
 #if FREE_LIST_MONITOR_LIMIT
+    free_list_length++;
+    if (free_list_length % FREE_LIST_MONITOR_LIMIT == 0
+        && free_list_length > free_list_monitor_warned) {
+        printf("WARNING: iotxn free_list_length is %zu\n", free_list_length);
+        free_list_monitor_warned = free_list_length;
+    }
+#endif
+}
+
+// call with free_list_mutex held
+static iotxn_t* free_list_remove_locked(list_node_t* list) {
+    iotxn_t* txn = list_remove_head_type(list, iotxn_t, node);
+#if FREE_LIST_MONITOR_LIMIT
+    if (txn != NULL) {
         free_list_length--;
+    }
 #endif
+    return txn;
+}
+
+static iotxn_cache_t* get_thread_cache(void) {
+    iotxn_cache_t* cache = &thread_cache;
+    if (cache->list.next == NULL) {
+        list_initialize(&cache->list);
+        tss_set(thread_cache_key, cache);
     }
+    return cache;
+}
+
+static void thread_cache_flush(void* arg) {
+    iotxn_cache_t* cache = arg;
+    iotxn_t* txn;
+    mtx_lock(&free_list_mutex);
+    while ((txn = list_remove_head_type(&cache->list, iotxn_t, node)) != NULL) {
+        free_list_add_locked(&free_lists[0], txn);
+    }
+    cache->count = 0;
     mtx_unlock(&free_list_mutex);
-    //xprintf("find_in_free_list found %d txn %p\n", found, txn);
-    return found ? txn : NULL;
 }
 
-// return the iotxn into the free list
-static void iotxn_release_free_list(iotxn_t* txn) {
+static iotxn_t* thread_cache_get(void) {
+    iotxn_cache_t* cache = get_thread_cache();
+    if (cache->count == 0) {
+        // refill a batch at a time, so the lock is taken once for many
+        iotxn_t* txn;
+        mtx_lock(&free_list_mutex);
+        while ((cache->count < THREAD_CACHE_BATCH) &&
+               ((txn = free_list_remove_locked(&free_lists[0])) != NULL)) {
+            list_add_tail(&cache->list, &txn->node);
+            cache->count++;
+        }
+        mtx_unlock(&free_list_mutex);
+    }
+    iotxn_t* txn = list_remove_head_type(&cache->list, iotxn_t, node);
+    if (txn != NULL) {
+        cache->count--;
+    }
+    return txn;
+}
+
+static void thread_cache_put(iotxn_t* txn) {
+    iotxn_cache_t* cache = get_thread_cache();
+    list_add_head(&cache->list, &txn->node);
+    if (++cache->count > THREAD_CACHE_MAX) {
+        // threads which release more than they allocate, like completion
+        // threads, pass the surplus on to the ones which allocate
+        mtx_lock(&free_list_mutex);
+        for (size_t i = 0; i < THREAD_CACHE_BATCH; i++) {
+            free_list_add_locked(&free_lists[0],
+                                 list_remove_tail_type(&cache->list, iotxn_t, node));
+        }
+        mtx_unlock(&free_list_mutex);
+        cache->count -= THREAD_CACHE_BATCH;
+    }
+}
+
+static iotxn_t* find_in_free_list(uint32_t pflags, uint64_t data_size) {
+    call_once(&free_lists_once, free_lists_init);
+
+    iotxn_t* txn;
+    if (data_size == 0) {
+        txn = thread_cache_get();
+    } else {
+        bool found = false;
+        list_node_t* list = &free_lists[size_class(data_size)];
+        //xprintf("find_in_free_list pflags 0x%x data_size 0x%" PRIx64 "\n", pflags, data_size);
+        mtx_lock(&free_list_mutex);
+        list_for_every_entry (list, txn, iotxn_t, node) {
+            // txn->pflags has IOTXN_ALLOC_CONTIGUOUS set if the txn has a contiguous VMO we allocated,
+            // or zero otherwise. And the pflags passed into this function is either zero or
+            // IOTXN_ALLOC_CONTIGUOUS. So here we mask txn->pflags with IOTXN_ALLOC_CONTIGUOUS
+            // to compare just this bit and not get confused by IOTXN_PFLAG_FREE or other flags.
+            if ((txn->vmo_length == data_size) && ((txn->pflags & IOTXN_ALLOC_CONTIGUOUS) == pflags)) {
+                found = true;
+                break;
+            }
+        }
+        if (found) {
+            list_delete(&txn->node);
+#if FREE_LIST_MONITOR_LIMIT
+            free_list_length--;
+#endif
+        } else {
+            txn = NULL;
+        }
+        mtx_unlock(&free_list_mutex);
+    }
+    if (txn != NULL) {
+        txn->pflags &= ~IOTXN_PFLAG_FREE;
+    }
+    //xprintf("find_in_free_list found txn %p\n", txn);
+    return txn;
+}
+
+// clear the iotxn for reuse, keeping the buffer if we allocated it
+static void iotxn_reset(iotxn_t* txn) {
     mx_handle_t vmo_handle = txn->vmo_handle;
     uint64_t vmo_offset = txn->vmo_offset;
     uint64_t vmo_length = txn->vmo_length;
@@ -121,21 +263,25 @@ static void iotxn_release_free_list(iotxn_t* txn) {
             }
         }
     }
+}
+
+// return the iotxn into the free list
+static void iotxn_release_free_list(iotxn_t* txn) {
+    // clones of iotxns the caller provides may be released before anything is allocated
+    call_once(&free_lists_once, free_lists_init);
+
+    iotxn_reset(txn);
 
     txn->pflags |= IOTXN_PFLAG_FREE;
     txn->release_cb = iotxn_release_free_list;
 
-    mtx_lock(&free_list_mutex);
-    list_add_head(&free_list, &txn->node);
-#if FREE_LIST_MONITOR_LIMIT
-    free_list_length++;
-    if (free_list_length % FREE_LIST_MONITOR_LIMIT == 0
-        && free_list_length > free_list_monitor_warned) {
-        printf("WARNING: iotxn free_list_length is %zu\n", free_list_length);
-        free_list_monitor_warned = free_list_length;
+    if (!(txn->pflags & IOTXN_PFLAG_ALLOC)) {
+        thread_cache_put(txn);
+    } else {
+        mtx_lock(&free_list_mutex);
+        free_list_add_locked(&free_lists[size_class(txn->vmo_length)], txn);
+        mtx_unlock(&free_list_mutex);
     }
-#endif
-    mtx_unlock(&free_list_mutex);
 
     xprintf("iotxn_release_free_list released txn %p\n", txn);
 }
@@ -152,12 +298,42 @@ static void iotxn_release_free(iotxn_t* txn) {
             mx_vmar_unmap(mx_vmar_root_self(), (uintptr_t)txn->virt, txn->vmo_length);
         }
     }
+    if (txn->pflags & IOTXN_PFLAG_PINNED) {
+        mx_vmo_op_range(txn->vmo_handle, MX_VMO_OP_UNPIN, 0, txn->vmo_length, NULL, 0);
+    }
     if (txn->pflags & IOTXN_PFLAG_ALLOC) {
         mx_handle_close(txn->vmo_handle);
     }
     free(txn);
 }
 
+static void iotxn_pool_free(iotxn_pool_t* pool) {
+    iotxn_t* txn;
+    while ((txn = list_remove_head_type(&pool->free_list, iotxn_t, node)) != NULL) {
+        // the pool_iotxn_t was allocated as a whole, with the txn first
+        iotxn_release_free(txn);
+    }
+    free(pool);
+}
+
+// return the iotxn to the pool it came from
+static void iotxn_release_pool(iotxn_t* txn) {
+    iotxn_pool_t* pool = containerof(txn, pool_iotxn_t, txn)->pool;
+
+    iotxn_reset(txn);
+    txn->pflags |= IOTXN_PFLAG_FREE;
+    txn->release_cb = iotxn_release_pool;
+
+    mtx_lock(&pool->lock);
+    list_add_head(&pool->free_list, &txn->node);
+    bool last = (--pool->outstanding == 0) && pool->destroyed;
+    mtx_unlock(&pool->lock);
+
+    if (last) {
+        iotxn_pool_free(pool);
+    }
+}
+
 // releases data for a statically allocated iotxn
 static void iotxn_release_static(iotxn_t* txn) {
     uint32_t pflags = txn->pflags;
@@ -394,6 +570,25 @@ void iotxn_cacheop(iotxn_t* txn, uint32_t op, size_t offset, size_t length) {
     mx_vmo_op_range(txn->vmo_handle, op, txn->vmo_offset + offset, length, NULL, 0);
 }
 
+static mx_status_t iotxn_alloc_buffer(iotxn_t* txn, uint32_t alloc_flags, uint64_t data_size) {
+    mx_status_t status;
+    if (alloc_flags & IOTXN_ALLOC_CONTIGUOUS) {
+        status = mx_vmo_create_contiguous(get_root_resource(), data_size, 0, &txn->vmo_handle);
+        txn->pflags |= IOTXN_PFLAG_CONTIGUOUS;
+    } else {
+        status = mx_vmo_create(data_size, 0, &txn->vmo_handle);
+    }
+    if (status != MX_OK) {
+        xprintf("iotxn_alloc: error %d in mx_vmo_create, flags 0x%x\n", status, alloc_flags);
+        return status;
+    }
+    mx_object_set_property(txn->vmo_handle, MX_PROP_NAME, "iotxn", 5);
+    txn->vmo_offset = 0;
+    txn->vmo_length = data_size;
+    txn->pflags |= IOTXN_PFLAG_ALLOC;
+    return MX_OK;
+}
+
 mx_status_t iotxn_alloc(iotxn_t** out, uint32_t alloc_flags, uint64_t data_size) {
     //xprintf("iotxn_alloc: alloc_flags 0x%x data_size 0x%" PRIx64 "\n", alloc_flags, data_size);
 
@@ -410,22 +605,11 @@ mx_status_t iotxn_alloc(iotxn_t** out, uint32_t alloc_flags, uint64_t data_size)
         return MX_ERR_NO_MEMORY;
     }
     if (data_size > 0) {
-        mx_status_t status;
-        if (alloc_flags & IOTXN_ALLOC_CONTIGUOUS) {
-            status = mx_vmo_create_contiguous(get_root_resource(), data_size, 0, &txn->vmo_handle);
-            txn->pflags |= IOTXN_PFLAG_CONTIGUOUS;
-        } else {
-            status = mx_vmo_create(data_size, 0, &txn->vmo_handle);
-        }
-        mx_object_set_property(txn->vmo_handle, MX_PROP_NAME, "iotxn", 5);
+        mx_status_t status = iotxn_alloc_buffer(txn, alloc_flags, data_size);
         if (status != MX_OK) {
-            xprintf("iotxn_alloc: error %d in mx_vmo_create, flags 0x%x\n", status, alloc_flags);
             free(txn);
             return status;
         }
-        txn->vmo_offset = 0;
-        txn->vmo_length = data_size;
-        txn->pflags |= IOTXN_PFLAG_ALLOC;
     }
 
 out:
@@ -440,6 +624,82 @@ out:
     return MX_OK;
 }
 
+mx_status_t iotxn_pool_create(iotxn_pool_t** out, uint32_t alloc_flags, uint64_t data_size,
+                              size_t count) {
+    iotxn_pool_t* pool = calloc(1, sizeof(iotxn_pool_t));
+    if (pool == NULL) {
+        return MX_ERR_NO_MEMORY;
+    }
+    mtx_init(&pool->lock, mtx_plain);
+    list_initialize(&pool->free_list);
+
+    for (size_t i = 0; i < count; i++) {
+        pool_iotxn_t* ptxn = calloc(1, sizeof(pool_iotxn_t));
+        if (ptxn == NULL) {
+            iotxn_pool_free(pool);
+            return MX_ERR_NO_MEMORY;
+        }
+        ptxn->pool = pool;
+        iotxn_t* txn = &ptxn->txn;
+        list_add_tail(&pool->free_list, &txn->node);
+
+        if (data_size > 0) {
+            // commit and look up the pages now, rather than on every transfer,
+            // and pin them, since devices are handed their physical addresses
+            // for as long as the pool lasts
+            mx_status_t status;
+            if ((status = iotxn_alloc_buffer(txn, alloc_flags, data_size)) != MX_OK) {
+                iotxn_pool_free(pool);
+                return status;
+            }
+            status = mx_vmo_op_range(txn->vmo_handle, MX_VMO_OP_PIN, 0, data_size, NULL, 0);
+            if (status != MX_OK) {
+                xprintf("iotxn_pool_create: error %d pinning buffer\n", status);
+                iotxn_pool_free(pool);
+                return status;
+            }
+            txn->pflags |= IOTXN_PFLAG_PINNED;
+            if ((status = iotxn_physmap(txn)) != MX_OK) {
+                iotxn_pool_free(pool);
+                return status;
+            }
+        }
+        txn->pflags |= IOTXN_PFLAG_FREE;
+        txn->release_cb = iotxn_release_pool;
+    }
+
+    *out = pool;
+    return MX_OK;
+}
+
+mx_status_t iotxn_pool_alloc(iotxn_pool_t* pool, iotxn_t** out) {
+    mtx_lock(&pool->lock);
+    MX_DEBUG_ASSERT(!pool->destroyed);
+    iotxn_t* txn = list_remove_head_type(&pool->free_list, iotxn_t, node);
+    if (txn != NULL) {
+        pool->outstanding++;
+    }
+    mtx_unlock(&pool->lock);
+
+    if (txn == NULL) {
+        return MX_ERR_NO_RESOURCES;
+    }
+    txn->pflags &= ~IOTXN_PFLAG_FREE;
+    *out = txn;
+    return MX_OK;
+}
+
+void iotxn_pool_destroy(iotxn_pool_t* pool) {
+    mtx_lock(&pool->lock);
+    pool->destroyed = true;
+    bool idle = (pool->outstanding == 0);
+    mtx_unlock(&pool->lock);
+
+    if (idle) {
+        iotxn_pool_free(pool);
+    }
+}
+
 void iotxn_queue(mx_device_t* dev, iotxn_t* txn) {
     // don't assert not queued here, since iotxns are allowed to be requeued
     txn->pflags |= IOTXN_PFLAG_QUEUED;
@@ -12,8 +12,11 @@
 #include <magenta/assert.h>
 #include <magenta/errors.h>
 #include <mxalloc/new.h>
+#include <mxtl/algorithm.h>
 #include <mxtl/unique_ptr.h>
 
+#include "sha256.h"
+
 namespace digest {
 
 Digest::Digest(const Digest& other) {
@@ -60,7 +63,26 @@ void Digest::Update(const void* buf, size_t len) {
 #ifdef USE_LIBCRYPTO
     SHA256_Update(&ctx_, buf, len);
 #else
-    clHASH_update(&ctx_, buf, static_cast<int>(len));
+    // cryptolib works a byte at a time, so whole blocks are hashed here
+    // instead. Only the partial block at the end is left in |ctx_.buf|, just
+    // as cryptolib would have it.
+    const uint8_t* p = static_cast<const uint8_t*>(buf);
+    size_t used = ctx_.count % internal::kSha256BlockSize;
+    ctx_.count += len;
+    if (used != 0) {
+        size_t n = mxtl::min(internal::kSha256BlockSize - used, len);
+        memcpy(&ctx_.buf[used], p, n);
+        p += n;
+        len -= n;
+        if (used + n < internal::kSha256BlockSize) {
+            return;
+        }
+        internal::Sha256Blocks(ctx_.state, ctx_.buf, 1);
+    }
+    size_t blocks = len / internal::kSha256BlockSize;
+    internal::Sha256Blocks(ctx_.state, p, blocks);
+    p += blocks * internal::kSha256BlockSize;
+    memcpy(ctx_.buf, p, len % internal::kSha256BlockSize);
 #endif // USE_LIBCRYPTO
 }
 
@@ -58,6 +58,13 @@ public:
     static mx_status_t Create(const void* data, size_t data_len, void* tree,
                               size_t tree_len, Digest* digest);
 
+    // As |Create|, but hashes each level of the tree across up to |threads|
+    // threads, or one per CPU if |threads| is 0.  The tree and digest are the
+    // same as |Create| gives.  |Create| itself calls this for large data.
+    static mx_status_t CreateParallel(const void* data, size_t data_len,
+                                      void* tree, size_t tree_len,
+                                      Digest* digest, size_t threads);
+
     // Checks the integrity of a the region of data given by the offset and
     // length.  It checks integrity using the given Merkle tree and trusted root
     // digest. |tree_len| must be at least as much as returned by
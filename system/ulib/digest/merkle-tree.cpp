@@ -4,8 +4,10 @@
 
 #include <digest/merkle-tree.h>
 
+#include <pthread.h>
 #include <stdint.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <digest/digest.h>
 #include <magenta/assert.h>
@@ -14,6 +16,8 @@
 #include <mxtl/algorithm.h>
 #include <mxtl/unique_ptr.h>
 
+#include "sha256.h"
+
 namespace digest {
 
 // Size of a node in bytes.  Defined in tree.h.
@@ -24,6 +28,14 @@ constexpr size_t MerkleTree::kNodeSize;
 // the corresponding digest-aligned length in the next level up.
 const size_t kDigestsPerNode = MerkleTree::kNodeSize / Digest::kLength;
 
+// Most threads a tree is built with, and fewest nodes given to each of them.
+// Starting a thread costs about as much as hashing a few nodes.
+const size_t kMaxThreads = 16;
+const size_t kMinNodesPerThread = 64;
+
+// Data at least this long is hashed in parallel by |MerkleTree::Create|.
+const size_t kParallelMinLength = 4 * kMinNodesPerThread * MerkleTree::kNodeSize;
+
 namespace {
 
 // Digest wrapper functions.  These functions implement how a node in the Merkle
@@ -74,6 +86,54 @@ void DigestFinal(Digest* digest, size_t offset) {
     digest->Final();
 }
 
+// Hashes the two whole nodes at |in|, the first of which has the given
+// |locality|, writing their digests to |out|.  This gives the same digests as
+// the functions above, but hashes both nodes together, which is quicker than
+// hashing them one after the other.
+void DigestNodes2(const uint8_t* in, uint64_t locality, uint8_t* out) {
+    constexpr size_t kBlock = internal::kSha256BlockSize;
+    constexpr size_t kPrefix = sizeof(uint64_t) + sizeof(uint32_t);
+    // Each node is hashed as a first block holding the prefix and the start
+    // of the node, the blocks which lie wholly within the node, and a last
+    // block holding the end of the node and the SHA-256 padding.
+    constexpr size_t kHead = kBlock - kPrefix;
+    constexpr size_t kBody = (MerkleTree::kNodeSize - kHead) / kBlock;
+    constexpr size_t kTail = MerkleTree::kNodeSize - kHead - kBody * kBlock;
+    static_assert(kTail + 1 + sizeof(uint64_t) <= kBlock, "Node tail doesn't fit in one block");
+
+    uint32_t state[2][8];
+    uint8_t head[2][kBlock];
+    uint8_t tail[2][kBlock];
+    uint32_t len32 = MerkleTree::kNodeSize;
+    uint64_t bits = (kPrefix + MerkleTree::kNodeSize) * 8;
+    for (size_t n = 0; n < 2; ++n) {
+        const uint8_t* node = in + n * MerkleTree::kNodeSize;
+        uint64_t node_locality = locality + n * MerkleTree::kNodeSize;
+        memcpy(state[n], internal::kSha256Init, sizeof(state[n]));
+        memcpy(&head[n][0], &node_locality, sizeof(node_locality));
+        memcpy(&head[n][sizeof(node_locality)], &len32, sizeof(len32));
+        memcpy(&head[n][kPrefix], node, kHead);
+        memset(tail[n], 0, kBlock);
+        memcpy(tail[n], node + MerkleTree::kNodeSize - kTail, kTail);
+        tail[n][kTail] = 0x80;
+        for (size_t i = 0; i < sizeof(bits); ++i) {
+            tail[n][kBlock - 1 - i] = static_cast<uint8_t>(bits >> (8 * i));
+        }
+    }
+    internal::Sha256Blocks2(state[0], head[0], state[1], head[1], 1);
+    internal::Sha256Blocks2(state[0], in + kHead, state[1], in + MerkleTree::kNodeSize + kHead,
+                            kBody);
+    internal::Sha256Blocks2(state[0], tail[0], state[1], tail[1], 1);
+    for (size_t n = 0; n < 2; ++n) {
+        for (size_t i = 0; i < 8; ++i) {
+            *out++ = static_cast<uint8_t>(state[n][i] >> 24);
+            *out++ = static_cast<uint8_t>(state[n][i] >> 16);
+            *out++ = static_cast<uint8_t>(state[n][i] >> 8);
+            *out++ = static_cast<uint8_t>(state[n][i]);
+        }
+    }
+}
+
 ////////
 // Helper functions for working between levels of the tree.
 
@@ -93,6 +153,80 @@ size_t NextAligned(size_t length) {
     return mxtl::roundup(NextLength(length), MerkleTree::kNodeSize);
 }
 
+////////
+// Helper functions for building a tree a level at a time.
+
+// Hashes nodes [first, last) of a level of the tree holding |len| bytes at
+// height |level|, writing their digests to |out|, which holds the digests of
+// the whole level.
+void HashNodes(const uint8_t* in, size_t len, uint64_t level, size_t first,
+               size_t last, uint8_t* out) {
+    size_t offset = first * MerkleTree::kNodeSize;
+    out += first * Digest::kLength;
+    Digest digest;
+    for (size_t n = first; n < last;) {
+        if (n + 2 <= last && offset + 2 * MerkleTree::kNodeSize <= len) {
+            DigestNodes2(in + offset, offset | level, out);
+            n += 2;
+            offset += 2 * MerkleTree::kNodeSize;
+            out += 2 * Digest::kLength;
+            continue;
+        }
+        DigestInit(&digest, offset | level, len - offset);
+        size_t chunk = DigestUpdate(&digest, in + offset, offset, len - offset);
+        DigestFinal(&digest, offset + chunk);
+        digest.CopyTo(out, Digest::kLength);
+        n++;
+        offset += MerkleTree::kNodeSize;
+        out += Digest::kLength;
+    }
+}
+
+struct HashNodesArgs {
+    const uint8_t* in;
+    size_t len;
+    uint64_t level;
+    size_t first;
+    size_t last;
+    uint8_t* out;
+};
+
+void* HashNodesThread(void* arg) {
+    HashNodesArgs* args = static_cast<HashNodesArgs*>(arg);
+    HashNodes(args->in, args->len, args->level, args->first, args->last, args->out);
+    return nullptr;
+}
+
+// Hashes every node of a level of the tree, as |HashNodes|, splitting them
+// between up to |threads| threads.  The calling thread hashes the first share
+// itself.
+void HashLevel(const uint8_t* in, size_t len, uint64_t level, uint8_t* out,
+               size_t threads) {
+    size_t nodes = mxtl::roundup(len, MerkleTree::kNodeSize) / MerkleTree::kNodeSize;
+    threads = mxtl::max(static_cast<size_t>(1),
+                        mxtl::min(threads, nodes / kMinNodesPerThread));
+    HashNodesArgs args[kMaxThreads];
+    pthread_t tids[kMaxThreads];
+    bool started[kMaxThreads];
+    for (size_t t = 0; t < threads; ++t) {
+        // Keep the shares even, so that nodes stay paired up.
+        args[t] = {in, len, level, (nodes * t / threads) & ~1ul,
+                   (t + 1 == threads) ? nodes : (nodes * (t + 1) / threads) & ~1ul, out};
+        started[t] = (t != 0) &&
+                     (pthread_create(&tids[t], nullptr, HashNodesThread, &args[t]) == 0);
+    }
+    for (size_t t = 0; t < threads; ++t) {
+        if (!started[t]) {
+            HashNodesThread(&args[t]);
+        }
+    }
+    for (size_t t = 1; t < threads; ++t) {
+        if (started[t]) {
+            pthread_join(tids[t], nullptr);
+        }
+    }
+}
+
 } // namespace
 
 ////////
@@ -105,6 +239,9 @@ size_t MerkleTree::GetTreeLength(size_t data_len) {
 
 mx_status_t MerkleTree::Create(const void* data, size_t data_len, void* tree,
                                size_t tree_len, Digest* digest) {
+    if (data_len >= kParallelMinLength) {
+        return CreateParallel(data, data_len, tree, tree_len, digest, 0);
+    }
     mx_status_t rc;
     MerkleTree mt;
     if ((rc = mt.CreateInit(data_len, tree_len)) != MX_OK ||
@@ -115,6 +252,54 @@ mx_status_t MerkleTree::Create(const void* data, size_t data_len, void* tree,
     return MX_OK;
 }
 
+mx_status_t MerkleTree::CreateParallel(const void* data, size_t data_len,
+                                       void* tree, size_t tree_len,
+                                       Digest* digest, size_t threads) {
+    // A single node has no tree to build.
+    if (data_len <= kNodeSize) {
+        mx_status_t rc;
+        MerkleTree mt;
+        if ((rc = mt.CreateInit(data_len, tree_len)) != MX_OK ||
+            (rc = mt.CreateUpdate(data, data_len, tree)) != MX_OK ||
+            (rc = mt.CreateFinal(tree, digest)) != MX_OK) {
+            return rc;
+        }
+        return MX_OK;
+    }
+    if (tree_len < GetTreeLength(data_len)) {
+        return MX_ERR_BUFFER_TOO_SMALL;
+    }
+    if (!data || !tree || !digest) {
+        return MX_ERR_INVALID_ARGS;
+    }
+    if (threads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = (cpus > 0) ? static_cast<size_t>(cpus) : 1;
+    }
+    threads = mxtl::min(threads, kMaxThreads);
+
+    // Hash each level in turn into the next one up, which starts right after
+    // it in the tree, until it fits in a single node.
+    const uint8_t* in = static_cast<const uint8_t*>(data);
+    uint8_t* out = static_cast<uint8_t*>(tree);
+    size_t len = data_len;
+    uint64_t level = 0;
+    while (len > kNodeSize) {
+        size_t digests = (mxtl::roundup(len, kNodeSize) / kNodeSize) * Digest::kLength;
+        size_t next_len = NextAligned(len);
+        memset(out + digests, 0, next_len - digests);
+        HashLevel(in, len, level, out, threads);
+        in = out;
+        out += next_len;
+        len = next_len;
+        ++level;
+    }
+    DigestInit(digest, level, len);
+    DigestUpdate(digest, in, 0, len);
+    DigestFinal(digest, len);
+    return MX_OK;
+}
+
 MerkleTree::MerkleTree()
     : initialized_(false), next_(nullptr), level_(0), offset_(0), length_(0) {}
 
@@ -171,6 +356,20 @@ mx_status_t MerkleTree::CreateUpdate(const void* data, size_t length,
     // Consume the data.
     mx_status_t rc = MX_OK;
     while (length > 0 && rc == MX_OK) {
+        // Hash whole nodes two at a time while there are at least two left.
+        if (offset_ % kNodeSize == 0 && length >= 2 * kNodeSize) {
+            if (tree_off % kNodeSize == 0) {
+                memset(out, 0, kNodeSize);
+            }
+            DigestNodes2(in, offset_ | level_, out);
+            rc = next_->CreateUpdate(out, 2 * Digest::kLength, next);
+            in += 2 * kNodeSize;
+            offset_ += 2 * kNodeSize;
+            length -= 2 * kNodeSize;
+            out += 2 * Digest::kLength;
+            tree_off += 2 * Digest::kLength;
+            continue;
+        }
         // Check if this is the start of a node.
         if (offset_ % kNodeSize == 0) {
             DigestInit(&digest_, offset_ | level_, length_ - offset_);
@@ -307,6 +506,17 @@ mx_status_t MerkleTree::VerifyLevel(const void* data, size_t data_len,
     const uint8_t* expected =
         static_cast<const uint8_t*>(tree) + (offset / kDigestsPerNode);
     // Check the data of this level against the digests.
+    while (length >= 2 * kNodeSize) {
+        uint8_t pair[2 * Digest::kLength];
+        DigestNodes2(in, offset | level, pair);
+        if (memcmp(pair, expected, sizeof(pair)) != 0) {
+            return MX_ERR_IO_DATA_INTEGRITY;
+        }
+        in += 2 * kNodeSize;
+        offset += 2 * kNodeSize;
+        length -= 2 * kNodeSize;
+        expected += sizeof(pair);
+    }
     while (length > 0) {
         DigestInit(&actual, offset | level, data_len - offset);
         size_t chunk = DigestUpdate(&actual, in, offset, length);
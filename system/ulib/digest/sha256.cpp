@@ -0,0 +1,344 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sha256.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#if defined(__linux__)
+#include <sys/auxv.h>
+#endif
+#endif
+
+namespace digest {
+namespace internal {
+
+const uint32_t kSha256Init[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+namespace {
+
+const uint32_t kK[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+////////
+// Portable implementation
+
+inline uint32_t Ror(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+void PortableBlocks(uint32_t state[8], const uint8_t* p, size_t count) {
+    for (; count > 0; --count, p += kSha256BlockSize) {
+        uint32_t w[64];
+        for (int t = 0; t < 16; ++t) {
+            w[t] = (static_cast<uint32_t>(p[4 * t]) << 24) |
+                   (static_cast<uint32_t>(p[4 * t + 1]) << 16) |
+                   (static_cast<uint32_t>(p[4 * t + 2]) << 8) |
+                   static_cast<uint32_t>(p[4 * t + 3]);
+        }
+        for (int t = 16; t < 64; ++t) {
+            uint32_t s0 = Ror(w[t - 15], 7) ^ Ror(w[t - 15], 18) ^ (w[t - 15] >> 3);
+            uint32_t s1 = Ror(w[t - 2], 17) ^ Ror(w[t - 2], 19) ^ (w[t - 2] >> 10);
+            w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+        }
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int t = 0; t < 64; ++t) {
+            uint32_t s1 = Ror(e, 6) ^ Ror(e, 11) ^ Ror(e, 25);
+            uint32_t ch = (e & f) ^ (~e & g);
+            uint32_t t1 = h + s1 + ch + kK[t] + w[t];
+            uint32_t s0 = Ror(a, 2) ^ Ror(a, 13) ^ Ror(a, 22);
+            uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + s0 + maj;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+#if defined(__x86_64__)
+
+////////
+// x86-64 SHA extensions
+
+#define SHA_TARGET __attribute__((target("sha,sse4.1")))
+#define SHA_INLINE inline __attribute__((always_inline))
+
+bool HaveSha() {
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid_max(0, nullptr) < 7) {
+        return false;
+    }
+    __cpuid(1, eax, ebx, ecx, edx);
+    if (!(ecx & bit_SSE4_1) || !(ecx & bit_SSSE3)) {
+        return false;
+    }
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    return ebx & (1u << 29);
+}
+
+// The hardware keeps the state as {A, B, E, F} and {C, D, G, H}.
+struct ShaState {
+    __m128i abef;
+    __m128i cdgh;
+};
+
+SHA_TARGET SHA_INLINE ShaState ShaLoad(const uint32_t state[8]) {
+    __m128i dcba = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0]));
+    __m128i hgfe = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[4]));
+    __m128i cdab = _mm_shuffle_epi32(dcba, 0xb1);
+    __m128i efgh = _mm_shuffle_epi32(hgfe, 0x1b);
+    return ShaState{_mm_alignr_epi8(cdab, efgh, 8), _mm_blend_epi16(efgh, cdab, 0xf0)};
+}
+
+SHA_TARGET SHA_INLINE void ShaStore(const ShaState& s, uint32_t state[8]) {
+    __m128i feba = _mm_shuffle_epi32(s.abef, 0x1b);
+    __m128i dchg = _mm_shuffle_epi32(s.cdgh, 0xb1);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), _mm_blend_epi16(feba, dchg, 0xf0));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), _mm_alignr_epi8(dchg, feba, 8));
+}
+
+// Four rounds, using and extending the message schedule in |m|.  |i| is a
+// constant, so the conditions and indices fold away.
+template <int i>
+SHA_TARGET SHA_INLINE void ShaRounds(ShaState* s, __m128i m[4]) {
+    __m128i wk = _mm_add_epi32(m[i & 3],
+                               _mm_loadu_si128(reinterpret_cast<const __m128i*>(&kK[4 * i])));
+    s->cdgh = _mm_sha256rnds2_epu32(s->cdgh, s->abef, wk);
+    if (i >= 3 && i < 15) {
+        __m128i t = _mm_alignr_epi8(m[i & 3], m[(i - 1) & 3], 4);
+        m[(i + 1) & 3] = _mm_sha256msg2_epu32(_mm_add_epi32(m[(i + 1) & 3], t), m[i & 3]);
+    }
+    s->abef = _mm_sha256rnds2_epu32(s->abef, s->cdgh, _mm_shuffle_epi32(wk, 0x0e));
+    if (i >= 1 && i < 13) {
+        m[(i - 1) & 3] = _mm_sha256msg1_epu32(m[(i - 1) & 3], m[i & 3]);
+    }
+}
+
+SHA_TARGET SHA_INLINE void ShaBlock(ShaState* s, const uint8_t* p) {
+    const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    ShaState saved = *s;
+    __m128i m[4];
+    for (int j = 0; j < 4; ++j) {
+        m[j] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * j)),
+                                bswap);
+    }
+    ShaRounds<0>(s, m);
+    ShaRounds<1>(s, m);
+    ShaRounds<2>(s, m);
+    ShaRounds<3>(s, m);
+    ShaRounds<4>(s, m);
+    ShaRounds<5>(s, m);
+    ShaRounds<6>(s, m);
+    ShaRounds<7>(s, m);
+    ShaRounds<8>(s, m);
+    ShaRounds<9>(s, m);
+    ShaRounds<10>(s, m);
+    ShaRounds<11>(s, m);
+    ShaRounds<12>(s, m);
+    ShaRounds<13>(s, m);
+    ShaRounds<14>(s, m);
+    ShaRounds<15>(s, m);
+    s->abef = _mm_add_epi32(s->abef, saved.abef);
+    s->cdgh = _mm_add_epi32(s->cdgh, saved.cdgh);
+}
+
+SHA_TARGET void AccelBlocks(uint32_t state[8], const uint8_t* p, size_t count) {
+    ShaState s = ShaLoad(state);
+    for (; count > 0; --count, p += kSha256BlockSize) {
+        ShaBlock(&s, p);
+    }
+    ShaStore(s, state);
+}
+
+SHA_TARGET void AccelBlocks2(uint32_t state0[8], const uint8_t* p0,
+                             uint32_t state1[8], const uint8_t* p1, size_t count) {
+    ShaState s0 = ShaLoad(state0);
+    ShaState s1 = ShaLoad(state1);
+    for (; count > 0; --count, p0 += kSha256BlockSize, p1 += kSha256BlockSize) {
+        ShaBlock(&s0, p0);
+        ShaBlock(&s1, p1);
+    }
+    ShaStore(s0, state0);
+    ShaStore(s1, state1);
+}
+
+#undef SHA_INLINE
+#undef SHA_TARGET
+
+#elif defined(__aarch64__)
+
+////////
+// arm64 cryptography extension
+
+#if defined(__clang__)
+#define SHA_TARGET __attribute__((target("crypto")))
+#else
+#define SHA_TARGET __attribute__((target("+crypto")))
+#endif
+#define SHA_INLINE inline __attribute__((always_inline))
+
+bool HaveSha() {
+#if defined(__ARM_FEATURE_CRYPTO)
+    return true;
+#elif defined(__linux__)
+    return getauxval(AT_HWCAP) & HWCAP_SHA2;
+#else
+    // TODO: Magenta doesn't yet tell processes which CPU features it has, so
+    // this is only used when built for CPUs which are known to have it.
+    return false;
+#endif
+}
+
+struct ShaState {
+    uint32x4_t abcd;
+    uint32x4_t efgh;
+};
+
+// Four rounds, using and extending the message schedule in |m|.  |i| is a
+// constant, so the conditions and indices fold away.
+template <int i>
+SHA_TARGET SHA_INLINE void ShaRounds(ShaState* s, uint32x4_t m[4]) {
+    uint32x4_t wk = vaddq_u32(m[i & 3], vld1q_u32(&kK[4 * i]));
+    if (i < 12) {
+        m[i & 3] = vsha256su0q_u32(m[i & 3], m[(i + 1) & 3]);
+    }
+    uint32x4_t abcd = s->abcd;
+    s->abcd = vsha256hq_u32(s->abcd, s->efgh, wk);
+    s->efgh = vsha256h2q_u32(s->efgh, abcd, wk);
+    if (i < 12) {
+        m[i & 3] = vsha256su1q_u32(m[i & 3], m[(i + 2) & 3], m[(i + 3) & 3]);
+    }
+}
+
+SHA_TARGET SHA_INLINE void ShaBlock(ShaState* s, const uint8_t* p) {
+    ShaState saved = *s;
+    uint32x4_t m[4];
+    for (int j = 0; j < 4; ++j) {
+        m[j] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(p + 16 * j)));
+    }
+    ShaRounds<0>(s, m);
+    ShaRounds<1>(s, m);
+    ShaRounds<2>(s, m);
+    ShaRounds<3>(s, m);
+    ShaRounds<4>(s, m);
+    ShaRounds<5>(s, m);
+    ShaRounds<6>(s, m);
+    ShaRounds<7>(s, m);
+    ShaRounds<8>(s, m);
+    ShaRounds<9>(s, m);
+    ShaRounds<10>(s, m);
+    ShaRounds<11>(s, m);
+    ShaRounds<12>(s, m);
+    ShaRounds<13>(s, m);
+    ShaRounds<14>(s, m);
+    ShaRounds<15>(s, m);
+    s->abcd = vaddq_u32(s->abcd, saved.abcd);
+    s->efgh = vaddq_u32(s->efgh, saved.efgh);
+}
+
+SHA_TARGET void AccelBlocks(uint32_t state[8], const uint8_t* p, size_t count) {
+    ShaState s{vld1q_u32(&state[0]), vld1q_u32(&state[4])};
+    for (; count > 0; --count, p += kSha256BlockSize) {
+        ShaBlock(&s, p);
+    }
+    vst1q_u32(&state[0], s.abcd);
+    vst1q_u32(&state[4], s.efgh);
+}
+
+SHA_TARGET void AccelBlocks2(uint32_t state0[8], const uint8_t* p0,
+                             uint32_t state1[8], const uint8_t* p1, size_t count) {
+    ShaState s0{vld1q_u32(&state0[0]), vld1q_u32(&state0[4])};
+    ShaState s1{vld1q_u32(&state1[0]), vld1q_u32(&state1[4])};
+    for (; count > 0; --count, p0 += kSha256BlockSize, p1 += kSha256BlockSize) {
+        ShaBlock(&s0, p0);
+        ShaBlock(&s1, p1);
+    }
+    vst1q_u32(&state0[0], s0.abcd);
+    vst1q_u32(&state0[4], s0.efgh);
+    vst1q_u32(&state1[0], s1.abcd);
+    vst1q_u32(&state1[4], s1.efgh);
+}
+
+#undef SHA_INLINE
+#undef SHA_TARGET
+
+#else
+
+bool HaveSha() {
+    return false;
+}
+
+void AccelBlocks(uint32_t state[8], const uint8_t* p, size_t count) {}
+
+void AccelBlocks2(uint32_t state0[8], const uint8_t* p0,
+                  uint32_t state1[8], const uint8_t* p1, size_t count) {}
+
+#endif
+
+// Whether to use the hardware: 0 if not yet known, 1 if so, and -1 if not.
+// Threads racing to find out all come to the same answer.
+int accel = 0;
+
+bool UseAccel() {
+    int use = __atomic_load_n(&accel, __ATOMIC_RELAXED);
+    if (use == 0) {
+        use = HaveSha() ? 1 : -1;
+        __atomic_store_n(&accel, use, __ATOMIC_RELAXED);
+    }
+    return use > 0;
+}
+
+} // namespace
+
+void Sha256Blocks(uint32_t state[8], const uint8_t* blocks, size_t count) {
+    if (UseAccel()) {
+        AccelBlocks(state, blocks, count);
+    } else {
+        PortableBlocks(state, blocks, count);
+    }
+}
+
+void Sha256Blocks2(uint32_t state0[8], const uint8_t* blocks0,
+                   uint32_t state1[8], const uint8_t* blocks1, size_t count) {
+    if (UseAccel()) {
+        AccelBlocks2(state0, blocks0, state1, blocks1, count);
+    } else {
+        PortableBlocks(state0, blocks0, count);
+        PortableBlocks(state1, blocks1, count);
+    }
+}
+
+} // namespace internal
+} // namespace digest
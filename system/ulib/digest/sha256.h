@@ -0,0 +1,30 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace digest {
+namespace internal {
+
+// The SHA-256 block size, and the initial hash value.
+constexpr size_t kSha256BlockSize = 64;
+extern const uint32_t kSha256Init[8];
+
+// Runs the SHA-256 compression function over |count| consecutive 64-byte
+// |blocks|, updating |state|.  This uses the SHA extensions on x86-64 and the
+// cryptography extension on arm64 when the CPU has them, and portable code
+// otherwise.  |blocks| need not be aligned.
+void Sha256Blocks(uint32_t state[8], const uint8_t* blocks, size_t count);
+
+// As |Sha256Blocks|, for two independent messages of the same number of
+// blocks at once.  Interleaving the two keeps the hashing units busy while
+// each message waits on its previous round.
+void Sha256Blocks2(uint32_t state0[8], const uint8_t* blocks0,
+                   uint32_t state1[8], const uint8_t* blocks1, size_t count);
+
+} // namespace internal
+} // namespace digest
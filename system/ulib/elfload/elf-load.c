@@ -33,6 +33,10 @@
 #define VMO_NAME_PREFIX_BSS "bss:"
 #define VMO_NAME_PREFIX_DATA "data:"
 
+// An executable segment at least this big starts on a boundary this big,
+// so that it can be mapped with large pages where the kernel can do that.
+#define TEXT_ALIGN (1UL << 21)
+
 // NOTE!  All code in this file must maintain the invariants that it's
 // purely position-independent and uses no writable memory other than
 // its own stack.
@@ -72,6 +76,7 @@ mx_status_t elf_load_prepare(mx_handle_t vmo, const void* hdr_buf, size_t buf_sz
     // Cache the few other bits we need from the header, and we're good to go.
     header->e_phnum = ehdr.e_phnum;
     header->e_entry = ehdr.e_entry;
+    header->prefault = false;
     *phoff = ehdr.e_phoff;
     return MX_OK;
 }
@@ -94,12 +99,14 @@ mx_status_t elf_load_read_phdrs(mx_handle_t vmo, elf_phdr_t phdrs[],
 // difference between p_vaddr values in this file and actual runtime
 // addresses.  (Usually the lowest p_vaddr in an ET_DYN file will be 0
 // and so the load bias is also the load base address, but ELF does
-// not require that the lowest p_vaddr be 0.)
+// not require that the lowest p_vaddr be 0.)  The VMAR may start below
+// the image, see TEXT_ALIGN; |image_base| is where the image starts.
 static mx_status_t choose_load_bias(mx_handle_t root_vmar,
                                     const elf_load_header_t* header,
                                     const elf_phdr_t phdrs[],
                                     mx_handle_t* vmar,
                                     uintptr_t* vmar_base,
+                                    uintptr_t* image_base,
                                     uintptr_t* bias) {
     // This file can be loaded anywhere, so the first thing is to
     // figure out the total span it will need and reserve a span
@@ -127,32 +134,58 @@ static mx_status_t choose_load_bias(mx_handle_t root_vmar,
     if (span == 0)
         return MX_OK;
 
+    // Find the biggest executable segment.  If it's big enough, reserve
+    // enough more address space that it can be put on a TEXT_ALIGN
+    // boundary.  The slack is only address space, nothing is mapped there.
+    uintptr_t text = 0;
+    size_t text_size = 0;
+    for (uint_fast16_t i = 0; i < header->e_phnum; ++i) {
+        if (phdrs[i].p_type == PT_LOAD && (phdrs[i].p_flags & PF_X) &&
+            phdrs[i].p_memsz > text_size) {
+            text = phdrs[i].p_vaddr & -PAGE_SIZE;
+            text_size = phdrs[i].p_memsz;
+        }
+    }
+    const size_t slack = text_size >= TEXT_ALIGN ? TEXT_ALIGN - PAGE_SIZE : 0;
+
     // Allocate a VMAR to reserve the whole address range.
-    mx_status_t status = mx_vmar_allocate(root_vmar, 0, span,
+    mx_status_t status = mx_vmar_allocate(root_vmar, 0, span + slack,
                                           MX_VM_FLAG_CAN_MAP_READ |
                                           MX_VM_FLAG_CAN_MAP_WRITE |
                                           MX_VM_FLAG_CAN_MAP_EXECUTE |
                                           MX_VM_FLAG_CAN_MAP_SPECIFIC,
                                           vmar, vmar_base);
-    if (status == MX_OK)
-        *bias = *vmar_base - low;
+    if (status == MX_OK) {
+        *image_base = *vmar_base;
+        if (slack > 0) {
+            uintptr_t text_start = *vmar_base + (text - low);
+            *image_base += ((text_start + TEXT_ALIGN - 1) & -TEXT_ALIGN) - text_start;
+        }
+        *bias = *image_base - low;
+    }
     return status;
 }
 
 static mx_status_t finish_load_segment(
     mx_handle_t vmar, mx_handle_t vmo, const char vmo_name[MX_MAX_NAME_LEN],
     const elf_phdr_t* ph, size_t start_offset, size_t size,
-    uintptr_t file_start, uintptr_t file_end, size_t partial_page) {
+    uintptr_t file_start, uintptr_t file_end, size_t partial_page,
+    bool prefault) {
     const uint32_t flags = MX_VM_FLAG_SPECIFIC |
         ((ph->p_flags & PF_R) ? MX_VM_FLAG_PERM_READ : 0) |
         ((ph->p_flags & PF_W) ? MX_VM_FLAG_PERM_WRITE : 0) |
         ((ph->p_flags & PF_X) ? MX_VM_FLAG_PERM_EXECUTE : 0);
 
+    // Only the file's own pages are worth mapping up front: a clone or a
+    // bss VMO has none of its own yet.
+    const uint32_t file_flags = flags |
+        ((prefault && !(ph->p_flags & PF_W)) ? MX_VM_FLAG_MAP_RANGE : 0);
+
     uintptr_t start;
     if (ph->p_filesz == ph->p_memsz)
         // Straightforward segment, map all the whole pages from the file.
-        return mx_vmar_map(vmar, start_offset, vmo, file_start, size, flags,
-                           &start);
+        return mx_vmar_map(vmar, start_offset, vmo, file_start, size,
+                           file_flags, &start);
 
     const size_t file_size = file_end - file_start;
 
@@ -160,7 +193,7 @@ static mx_status_t finish_load_segment(
     // Only the leading portion is directly mapped in from the file.
     if (file_size > 0) {
         mx_status_t status = mx_vmar_map(vmar, start_offset, vmo, file_start,
-                                         file_size, flags, &start);
+                                         file_size, file_flags, &start);
         if (status != MX_OK)
             return status;
 
@@ -218,7 +251,7 @@ static mx_status_t finish_load_segment(
 
 static mx_status_t load_segment(mx_handle_t vmar, size_t vmar_offset,
                                 mx_handle_t vmo, const char* vmo_name,
-                                const elf_phdr_t* ph) {
+                                const elf_phdr_t* ph, bool prefault) {
     // The p_vaddr can start in the middle of a page, but the
     // semantics are that all the whole pages containing the
     // p_vaddr+p_filesz range are mapped in.
@@ -245,7 +278,8 @@ static mx_status_t load_segment(mx_handle_t vmar, size_t vmar_offset,
     // With no writable data, it's the simple case.
     if (!(ph->p_flags & PF_W) || data_size == 0)
         return finish_load_segment(vmar, vmo, vmo_name, ph, start, size,
-                                   file_start, file_end, partial_page);
+                                   file_start, file_end, partial_page,
+                                   prefault);
 
     // For a writable segment, we need a writable VMO.
     mx_handle_t writable_vmo;
@@ -260,7 +294,7 @@ static mx_status_t load_segment(mx_handle_t vmar, size_t vmar_offset,
         if (status == MX_OK)
             status = finish_load_segment(
                 vmar, writable_vmo, vmo_name, ph, start, size,
-                0, file_end - file_start, partial_page);
+                0, file_end - file_start, partial_page, false);
         mx_handle_close(writable_vmo);
     }
     return status;
@@ -279,15 +313,17 @@ mx_status_t elf_load_map_segments(mx_handle_t root_vmar,
         memcpy(vmo_name, VMO_NAME_UNKNOWN, sizeof(VMO_NAME_UNKNOWN));
 
     uintptr_t vmar_base = 0;
+    uintptr_t image_base = 0;
     uintptr_t bias = 0;
     mx_handle_t vmar = MX_HANDLE_INVALID;
     mx_status_t status = choose_load_bias(root_vmar, header, phdrs,
-                                          &vmar, &vmar_base, &bias);
+                                          &vmar, &vmar_base, &image_base, &bias);
 
     size_t vmar_offset = bias - vmar_base;
     for (uint_fast16_t i = 0; status == MX_OK && i < header->e_phnum; ++i) {
         if (phdrs[i].p_type == PT_LOAD)
-            status = load_segment(vmar, vmar_offset, vmo, vmo_name, &phdrs[i]);
+            status = load_segment(vmar, vmar_offset, vmo, vmo_name, &phdrs[i],
+                                  header->prefault);
     }
 
     if (status == MX_OK && segments_vmar != NULL)
@@ -297,7 +333,7 @@ mx_status_t elf_load_map_segments(mx_handle_t root_vmar,
 
     if (status == MX_OK) {
         if (base != NULL)
-            *base = vmar_base;
+            *base = image_base;
         if (entry != NULL)
             *entry = header->e_entry != 0 ? header->e_entry + bias : 0;
     }
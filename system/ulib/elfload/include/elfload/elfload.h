@@ -31,6 +31,11 @@ typedef Elf32_Phdr elf_phdr_t;
 typedef struct {
     mx_vaddr_t e_entry;
     uint_fast16_t e_phnum;
+    // Cleared by elf_load_prepare.  A caller that knows the file will be
+    // run soon and much, as the dynamic linker is, can set it to have the
+    // read-only segments' pages that are in memory mapped in up front,
+    // rather than each only when it is first touched.
+    bool prefault;
 } elf_load_header_t;
 
 // These routines use this error code to indicate an invalid file format,
@@ -0,0 +1,165 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fidl/coding.h>
+
+#include <assert.h>
+#include <string.h>
+
+static_assert(sizeof(void*) == sizeof(uint64_t), "pointers go on the wire as 64 bit markers");
+
+// Takes the next |size| bytes of out-of-line data, which must be followed by
+// zeroes up to the next 8 byte boundary.
+static mx_status_t decoder_claim(fidl_decoder_t* decoder, uint64_t size, void** body) {
+    uint64_t start = decoder->next_out_of_line;
+    if (size > decoder->num_bytes - start)
+        return MX_ERR_INVALID_ARGS;
+    uint64_t end = start + size;
+    uint64_t aligned = FIDL_ALIGN(end);
+    if (aligned > decoder->num_bytes)
+        return MX_ERR_INVALID_ARGS;
+    for (uint64_t i = end; i < aligned; i++) {
+        if (decoder->bytes[i] != 0)
+            return MX_ERR_INVALID_ARGS;
+    }
+    *body = decoder->bytes + start;
+    decoder->next_out_of_line = (uint32_t)aligned;
+    return MX_OK;
+}
+
+mx_status_t fidl_decoder_init(fidl_decoder_t* decoder, void* bytes, uint32_t num_bytes,
+                              mx_handle_t* handles, uint32_t num_handles,
+                              uint32_t inline_size) {
+    if ((uintptr_t)bytes % FIDL_ALIGNMENT != 0)
+        return MX_ERR_INVALID_ARGS;
+    decoder->bytes = bytes;
+    decoder->num_bytes = num_bytes;
+    decoder->next_out_of_line = 0;
+    decoder->handles = handles;
+    decoder->num_handles = num_handles;
+    decoder->next_handle = 0;
+    void* body;
+    return decoder_claim(decoder, inline_size, &body);
+}
+
+mx_status_t fidl_decoder_finish(const fidl_decoder_t* decoder) {
+    if (decoder->next_out_of_line != decoder->num_bytes)
+        return MX_ERR_INVALID_ARGS;
+    if (decoder->next_handle != decoder->num_handles)
+        return MX_ERR_INVALID_ARGS;
+    return MX_OK;
+}
+
+mx_status_t fidl_decode_string(fidl_decoder_t* decoder, fidl_string_t* string,
+                               uint64_t max_size, bool nullable) {
+    uintptr_t marker = (uintptr_t)string->data;
+    if (marker == FIDL_ALLOC_ABSENT)
+        return (nullable && string->size == 0) ? MX_OK : MX_ERR_INVALID_ARGS;
+    if (marker != FIDL_ALLOC_PRESENT || string->size > max_size)
+        return MX_ERR_INVALID_ARGS;
+    void* body;
+    mx_status_t status = decoder_claim(decoder, string->size, &body);
+    if (status != MX_OK)
+        return status;
+    string->data = body;
+    return MX_OK;
+}
+
+mx_status_t fidl_decode_vector(fidl_decoder_t* decoder, fidl_vector_t* vector,
+                               uint64_t element_size, uint64_t max_count, bool nullable) {
+    uintptr_t marker = (uintptr_t)vector->data;
+    if (marker == FIDL_ALLOC_ABSENT)
+        return (nullable && vector->count == 0) ? MX_OK : MX_ERR_INVALID_ARGS;
+    if (marker != FIDL_ALLOC_PRESENT || vector->count > max_count)
+        return MX_ERR_INVALID_ARGS;
+    // No message is 4GB, so this can't overflow for any that is valid.
+    if (vector->count > UINT32_MAX / element_size)
+        return MX_ERR_INVALID_ARGS;
+    return decoder_claim(decoder, vector->count * element_size, &vector->data);
+}
+
+mx_status_t fidl_decode_pointer(fidl_decoder_t* decoder, void** pointer, uint64_t size) {
+    uintptr_t marker = (uintptr_t)*pointer;
+    if (marker == FIDL_ALLOC_ABSENT)
+        return MX_OK;
+    if (marker != FIDL_ALLOC_PRESENT)
+        return MX_ERR_INVALID_ARGS;
+    return decoder_claim(decoder, size, pointer);
+}
+
+// Copies |size| bytes from |body| to the end of the buffer, zeroing the
+// padding after them.
+static mx_status_t encoder_append(fidl_encoder_t* encoder, const void* body, uint64_t size,
+                                  void** copy) {
+    uint64_t start = encoder->num_bytes;
+    if (size > encoder->capacity - start)
+        return MX_ERR_BUFFER_TOO_SMALL;
+    uint64_t end = start + size;
+    uint64_t aligned = FIDL_ALIGN(end);
+    if (aligned > encoder->capacity)
+        return MX_ERR_BUFFER_TOO_SMALL;
+    memcpy(encoder->bytes + start, body, size);
+    memset(encoder->bytes + end, 0, aligned - end);
+    *copy = encoder->bytes + start;
+    encoder->num_bytes = (uint32_t)aligned;
+    return MX_OK;
+}
+
+mx_status_t fidl_encoder_init(fidl_encoder_t* encoder, void* bytes, uint32_t capacity,
+                              mx_handle_t* handles, uint32_t handle_capacity,
+                              const void* message, uint32_t inline_size, void** copy) {
+    if ((uintptr_t)bytes % FIDL_ALIGNMENT != 0)
+        return MX_ERR_INVALID_ARGS;
+    encoder->bytes = bytes;
+    encoder->capacity = capacity;
+    encoder->num_bytes = 0;
+    encoder->handles = handles;
+    encoder->handle_capacity = handle_capacity;
+    encoder->num_handles = 0;
+    return encoder_append(encoder, message, inline_size, copy);
+}
+
+mx_status_t fidl_encode_string(fidl_encoder_t* encoder, fidl_string_t* string,
+                               uint64_t max_size, bool nullable) {
+    if (string->data == NULL)
+        return (nullable && string->size == 0) ? MX_OK : MX_ERR_INVALID_ARGS;
+    if (string->size > max_size)
+        return MX_ERR_INVALID_ARGS;
+    void* copy;
+    mx_status_t status = encoder_append(encoder, string->data, string->size, &copy);
+    if (status != MX_OK)
+        return status;
+    string->data = (char*)FIDL_ALLOC_PRESENT;
+    return MX_OK;
+}
+
+mx_status_t fidl_encode_vector(fidl_encoder_t* encoder, fidl_vector_t* vector,
+                               uint64_t element_size, uint64_t max_count, bool nullable,
+                               void** copy) {
+    *copy = NULL;
+    if (vector->data == NULL)
+        return (nullable && vector->count == 0) ? MX_OK : MX_ERR_INVALID_ARGS;
+    if (vector->count > max_count)
+        return MX_ERR_INVALID_ARGS;
+    if (vector->count > UINT32_MAX / element_size)
+        return MX_ERR_BUFFER_TOO_SMALL;
+    mx_status_t status = encoder_append(encoder, vector->data, vector->count * element_size,
+                                        copy);
+    if (status != MX_OK)
+        return status;
+    vector->data = (void*)FIDL_ALLOC_PRESENT;
+    return MX_OK;
+}
+
+mx_status_t fidl_encode_pointer(fidl_encoder_t* encoder, void** pointer, uint64_t size,
+                                void** copy) {
+    *copy = NULL;
+    if (*pointer == NULL)
+        return MX_OK;
+    mx_status_t status = encoder_append(encoder, *pointer, size, copy);
+    if (status != MX_OK)
+        return status;
+    *pointer = (void*)FIDL_ALLOC_PRESENT;
+    return MX_OK;
+}
@@ -0,0 +1,153 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <magenta/compiler.h>
+#include <magenta/types.h>
+
+__BEGIN_CDECLS
+
+// Support for the C bindings that fidl2 generates.  The wire format is
+// described in system/host/fidl/wire-format.md; in short, a message is a header
+// followed by its parameters laid out as a C struct would be, followed by
+// the bodies of its strings, vectors and nullable structs, each 8 byte
+// aligned, in the order a depth first walk of the message reaches them.
+// Where those bodies would be pointed to, the wire holds FIDL_ALLOC_PRESENT
+// or FIDL_ALLOC_ABSENT, and where handles would be, FIDL_HANDLE_PRESENT or
+// FIDL_HANDLE_ABSENT, the handles themselves going in the channel message's
+// handle table in the same order.
+//
+// Decoding fixes up a message where it was read, turning those markers back
+// into pointers into the buffer and handles from the table, so the message
+// can be used as a C struct with no copy and no allocation.  Encoding copies
+// the C struct and everything it points to into a buffer that the generated
+// _MAX_BYTES and _MAX_HANDLES constants are enough for.
+
+typedef struct fidl_message_header {
+    uint32_t txid;
+    uint32_t reserved;
+    uint32_t flags;
+    uint32_t ordinal;
+} fidl_message_header_t;
+
+typedef struct fidl_string {
+    // Number of bytes, not counting any terminator: there isn't one.
+    uint64_t size;
+    char* data;
+} fidl_string_t;
+
+typedef struct fidl_vector {
+    uint64_t count;
+    void* data;
+} fidl_vector_t;
+
+#define FIDL_ALLOC_PRESENT ((uintptr_t)UINTPTR_MAX)
+#define FIDL_ALLOC_ABSENT ((uintptr_t)0)
+#define FIDL_HANDLE_PRESENT ((mx_handle_t)UINT32_MAX)
+#define FIDL_HANDLE_ABSENT ((mx_handle_t)MX_HANDLE_INVALID)
+
+#define FIDL_ALIGNMENT ((uint64_t)8)
+#define FIDL_ALIGN(a) (((a) + (FIDL_ALIGNMENT - 1)) & ~(FIDL_ALIGNMENT - 1))
+
+// Where a decode has got to in a message.
+typedef struct fidl_decoder {
+    uint8_t* bytes;
+    uint32_t num_bytes;
+    uint32_t next_out_of_line;
+    mx_handle_t* handles;
+    uint32_t num_handles;
+    uint32_t next_handle;
+} fidl_decoder_t;
+
+// Where an encode has got to in a buffer.
+typedef struct fidl_encoder {
+    uint8_t* bytes;
+    uint32_t capacity;
+    uint32_t num_bytes;
+    mx_handle_t* handles;
+    uint32_t handle_capacity;
+    uint32_t num_handles;
+} fidl_encoder_t;
+
+// Reads the ordinal of the message in |bytes|, to pick which decode to use.
+static inline mx_status_t fidl_message_ordinal(const void* bytes, uint32_t num_bytes,
+                                               uint32_t* ordinal) {
+    if (num_bytes < sizeof(fidl_message_header_t))
+        return MX_ERR_INVALID_ARGS;
+    *ordinal = ((const fidl_message_header_t*)bytes)->ordinal;
+    return MX_OK;
+}
+
+// Starts decoding the message of |num_bytes| at |bytes|, whose inline part
+// takes |inline_size| bytes.  |bytes| must be 8 byte aligned, as the
+// buffers the channel calls are given generally are.
+mx_status_t fidl_decoder_init(fidl_decoder_t* decoder, void* bytes, uint32_t num_bytes,
+                              mx_handle_t* handles, uint32_t num_handles,
+                              uint32_t inline_size);
+
+// Checks that the message had nothing left over once decoded: every byte
+// and every handle must have been accounted for.
+mx_status_t fidl_decoder_finish(const fidl_decoder_t* decoder);
+
+// These each take the next out-of-line body for the object at |string|,
+// |vector| or |pointer|, after checking its presence marker and its size
+// against |max_size| or |max_count|, and point the object at the body.
+mx_status_t fidl_decode_string(fidl_decoder_t* decoder, fidl_string_t* string,
+                               uint64_t max_size, bool nullable);
+mx_status_t fidl_decode_vector(fidl_decoder_t* decoder, fidl_vector_t* vector,
+                               uint64_t element_size, uint64_t max_count, bool nullable);
+mx_status_t fidl_decode_pointer(fidl_decoder_t* decoder, void** pointer, uint64_t size);
+
+static inline mx_status_t fidl_decode_handle(fidl_decoder_t* decoder, mx_handle_t* handle,
+                                             bool nullable) {
+    if (*handle == FIDL_HANDLE_PRESENT) {
+        if (decoder->next_handle >= decoder->num_handles)
+            return MX_ERR_INVALID_ARGS;
+        *handle = decoder->handles[decoder->next_handle++];
+        return MX_OK;
+    }
+    return (nullable && *handle == FIDL_HANDLE_ABSENT) ? MX_OK : MX_ERR_INVALID_ARGS;
+}
+
+static inline mx_status_t fidl_decode_bool(const bool* value) {
+    return (*(const uint8_t*)value > 1) ? MX_ERR_INVALID_ARGS : MX_OK;
+}
+
+// Copies the |inline_size| bytes of the message at |message| to the start of
+// |bytes|, and sets |*copy| to the copy, which the generated code then walks
+// to encode what it points to.
+mx_status_t fidl_encoder_init(fidl_encoder_t* encoder, void* bytes, uint32_t capacity,
+                              mx_handle_t* handles, uint32_t handle_capacity,
+                              const void* message, uint32_t inline_size, void** copy);
+
+// These each copy the body of the object at |string|, |vector| or |pointer|
+// to the end of the buffer and replace the pointer to it with a presence
+// marker.  Where the body may need encoding in turn, |*copy| is set to the
+// copied body, or NULL if there isn't one.
+mx_status_t fidl_encode_string(fidl_encoder_t* encoder, fidl_string_t* string,
+                               uint64_t max_size, bool nullable);
+mx_status_t fidl_encode_vector(fidl_encoder_t* encoder, fidl_vector_t* vector,
+                               uint64_t element_size, uint64_t max_count, bool nullable,
+                               void** copy);
+mx_status_t fidl_encode_pointer(fidl_encoder_t* encoder, void** pointer, uint64_t size,
+                                void** copy);
+
+// Moves the handle at |handle| to the handle table.  The caller gives up
+// the handle only once the message has been written.
+static inline mx_status_t fidl_encode_handle(fidl_encoder_t* encoder, mx_handle_t* handle,
+                                             bool nullable) {
+    if (*handle == MX_HANDLE_INVALID)
+        return nullable ? MX_OK : MX_ERR_INVALID_ARGS;
+    if (encoder->num_handles >= encoder->handle_capacity)
+        return MX_ERR_BUFFER_TOO_SMALL;
+    encoder->handles[encoder->num_handles++] = *handle;
+    *handle = FIDL_HANDLE_PRESENT;
+    return MX_OK;
+}
+
+__END_CDECLS
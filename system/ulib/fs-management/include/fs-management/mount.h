@@ -109,6 +109,34 @@ mx_status_t mkfs(const char* devicepath, disk_format_t df, LaunchCallback cb,
 mx_status_t fsck(const char* devicepath, disk_format_t df,
                  const fsck_options_t* options, LaunchCallback cb);
 
+// One filesystem for mount_all() to check and mount.
+typedef struct mount_request {
+    const char* devicepath;
+    const char* mountpath;
+    disk_format_t df;
+    mount_options_t options;
+    LaunchCallback cb;
+    // If set, the device is checked with 'fsck_cb', which should wait for the
+    // checker to finish (launch_stdio_sync, say), before it is mounted.
+    bool check;
+    fsck_options_t fsck_options;
+    LaunchCallback fsck_cb;
+
+    // Filled in by mount_all(): the result of checking and mounting, and how
+    // long each of the two took.
+    mx_status_t status;
+    mx_time_t fsck_time;
+    mx_time_t mount_time;
+} mount_request_t;
+
+// Checks and mounts every request at once, rather than one after another.
+// A request whose mountpath lies beneath another's is mounted only after that
+// one (though it may be checked at the same time), and is not mounted at all
+// if that one fails. Returns once every request is finished; the outcome of
+// each is in its 'status'. Returns an error only if the requests could not
+// be started.
+mx_status_t mount_all(mount_request_t* requests, size_t count);
+
 // Umount the filesystem process.
 //
 // Returns MX_ERR_BAD_STATE if mountpath could not be opened.
@@ -0,0 +1,161 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fs-management/mount.h>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <unistd.h>
+
+#include <magenta/syscalls.h>
+
+typedef enum {
+    MOUNT_PENDING,
+    MOUNT_DONE,
+    MOUNT_FAILED,
+} mount_state_t;
+
+typedef struct mount_all {
+    mount_request_t* requests;
+    size_t count;
+    mount_state_t* state;
+    mtx_t lock;
+    cnd_t changed;
+} mount_all_t;
+
+typedef struct mount_job {
+    mount_all_t* all;
+    size_t index;
+} mount_job_t;
+
+// True if 'path' names something beneath 'parent' ("/data/x" is beneath
+// "/data", but "/database" is not).
+static bool path_is_beneath(const char* path, const char* parent) {
+    size_t len = strlen(parent);
+    while ((len > 0) && (parent[len - 1] == '/')) {
+        len--;
+    }
+    return (strncmp(path, parent, len) == 0) && (path[len] == '/') && (path[len + 1] != 0);
+}
+
+// Waits for every request whose mountpoint encloses this one's to be mounted.
+// Returns false if any of them failed.
+static bool wait_for_parents(mount_all_t* all, size_t index) {
+    const char* path = all->requests[index].mountpath;
+    bool ok = true;
+    mtx_lock(&all->lock);
+    for (size_t i = 0; i < all->count; i++) {
+        if ((i == index) || !path_is_beneath(path, all->requests[i].mountpath)) {
+            continue;
+        }
+        while (all->state[i] == MOUNT_PENDING) {
+            cnd_wait(&all->changed, &all->lock);
+        }
+        if (all->state[i] == MOUNT_FAILED) {
+            ok = false;
+            break;
+        }
+    }
+    mtx_unlock(&all->lock);
+    return ok;
+}
+
+static mx_status_t mount_one(mount_all_t* all, size_t index) {
+    mount_request_t* req = &all->requests[index];
+    mx_status_t status;
+
+    if (req->check) {
+        mx_time_t start = mx_time_get(MX_CLOCK_MONOTONIC);
+        status = fsck(req->devicepath, req->df, &req->fsck_options, req->fsck_cb);
+        req->fsck_time = mx_time_get(MX_CLOCK_MONOTONIC) - start;
+        if (status != MX_OK) {
+            return status;
+        }
+    }
+
+    if (!wait_for_parents(all, index)) {
+        return MX_ERR_UNAVAILABLE;
+    }
+
+    mx_time_t start = mx_time_get(MX_CLOCK_MONOTONIC);
+    int fd;
+    if ((fd = open(req->devicepath, O_RDWR)) < 0) {
+        return MX_ERR_BAD_STATE;
+    }
+    status = mount(fd, req->mountpath, req->df, &req->options, req->cb);
+    req->mount_time = mx_time_get(MX_CLOCK_MONOTONIC) - start;
+    return status;
+}
+
+static int mount_thread(void* arg) {
+    mount_job_t* job = arg;
+    mount_all_t* all = job->all;
+    mx_status_t status = mount_one(all, job->index);
+
+    mtx_lock(&all->lock);
+    all->requests[job->index].status = status;
+    all->state[job->index] = (status == MX_OK) ? MOUNT_DONE : MOUNT_FAILED;
+    cnd_broadcast(&all->changed);
+    mtx_unlock(&all->lock);
+    return 0;
+}
+
+mx_status_t mount_all(mount_request_t* requests, size_t count) {
+    if (count == 0) {
+        return MX_OK;
+    }
+
+    mount_all_t all = {
+        .requests = requests,
+        .count = count,
+    };
+    all.state = calloc(count, sizeof(mount_state_t));
+    mount_job_t* jobs = calloc(count, sizeof(mount_job_t));
+    thrd_t* threads = calloc(count, sizeof(thrd_t));
+    bool* started = calloc(count, sizeof(bool));
+    mx_status_t status = MX_OK;
+    if ((all.state == NULL) || (jobs == NULL) || (threads == NULL) || (started == NULL)) {
+        status = MX_ERR_NO_MEMORY;
+        goto done;
+    }
+    mtx_init(&all.lock, mtx_plain);
+    cnd_init(&all.changed);
+
+    for (size_t i = 0; i < count; i++) {
+        requests[i].status = MX_ERR_INTERNAL;
+        requests[i].fsck_time = 0;
+        requests[i].mount_time = 0;
+    }
+    for (size_t i = 0; i < count; i++) {
+        jobs[i].all = &all;
+        jobs[i].index = i;
+        if (thrd_create_with_name(&threads[i], mount_thread, &jobs[i],
+                                  "fs-mount") == thrd_success) {
+            started[i] = true;
+        } else {
+            // Anything waiting on this one sees it fail rather than hang.
+            mtx_lock(&all.lock);
+            requests[i].status = MX_ERR_NO_RESOURCES;
+            all.state[i] = MOUNT_FAILED;
+            cnd_broadcast(&all.changed);
+            mtx_unlock(&all.lock);
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (started[i]) {
+            thrd_join(threads[i], NULL);
+        }
+    }
+
+    cnd_destroy(&all.changed);
+    mtx_destroy(&all.lock);
+done:
+    free(all.state);
+    free(jobs);
+    free(threads);
+    free(started);
+    return status;
+}
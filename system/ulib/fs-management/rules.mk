@@ -12,6 +12,7 @@ MODULE_SRCS += \
     $(LOCAL_DIR)/fsck.c \
     $(LOCAL_DIR)/launch.c \
     $(LOCAL_DIR)/mkfs.c \
+    $(LOCAL_DIR)/mount-all.c \
     $(LOCAL_DIR)/mount.c \
     $(LOCAL_DIR)/ramdisk.c \
 
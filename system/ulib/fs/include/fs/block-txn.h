@@ -51,9 +51,11 @@ public:
                 continue;
             }
 
-            if (requests_[i].vmo_offset == relative_block) {
+            if ((requests_[i].vmo_offset == relative_block) &&
+                (requests_[i].dev_offset == absolute_block)) {
                 // Take the longer of the operations (if operating on the same
-                // blocks).
+                // blocks). A buffer reused for another block in the same
+                // transaction needs a request of its own.
                 requests_[i].length = (requests_[i].length > nblocks) ? requests_[i].length : nblocks;
                 return;
             } else if ((requests_[i].vmo_offset + requests_[i].length == relative_block) &&
@@ -66,6 +66,7 @@ private:
     VfsDispatcher(mxio_dispatcher_cb_t cb, uint32_t pool_size);
     mx_status_t AddVFSHandler(mx_handle_t h, void* cb, void* iostate) final;
     mx_status_t Start(const char* name);
+    void HandlePacket(const mx_port_packet_t& packet);
 
     mxio_dispatcher_cb_t cb_;
     uint32_t pool_size_;
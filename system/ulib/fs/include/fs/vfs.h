@@ -87,7 +87,10 @@ public:
     mx_status_t WatchDir(mx_handle_t* out);
     mx_status_t WatchDirV2(const vfs_watch_dir_t* cmd);
     void NotifyAdd(const char* name, size_t len);
+    void NotifyRemove(const char* name, size_t len);
 private:
+    void Notify(uint8_t event, const char* name, size_t len);
+
     mxtl::Mutex lock_;
     mxtl::DoublyLinkedList<mxtl::unique_ptr<VnodeWatcher>> watch_list_ __TA_GUARDED(lock_);
 };
@@ -148,6 +151,7 @@ public:
         return MX_ERR_NOT_SUPPORTED;
     }
     virtual void NotifyAdd(const char* name, size_t len) {}
+    virtual void NotifyRemove(const char* name, size_t len) {}
 
     // Ensure that it is valid to open vn.
     virtual mx_status_t Open(uint32_t flags) = 0;
@@ -160,6 +164,16 @@ public:
         return MX_ERR_NOT_SUPPORTED;
     }
 
+    // Returns true if Read may be called on several threads at once, while
+    // other vnodes of the filesystem are being read. No other operation runs
+    // alongside those reads.
+    virtual bool ConcurrentReads() const { return false; }
+
+    // Returns true if every operation on the vnode may run on several threads
+    // at once, because its filesystem does its own locking. Such vnodes are
+    // opened, read, and listed without holding vfs_lock.
+    virtual bool ConcurrentOps() const { return false; }
+
     // Write data to vn at offset.
     virtual ssize_t Write(const void* data, size_t len, size_t off) {
         return MX_ERR_NOT_SUPPORTED;
@@ -231,10 +245,10 @@ public:
 
     // Acquire a vmo from a vnode.
     //
-    // At the moment, mmap can only map files from read-only filesystems,
-    // since (without paging) there is no mechanism to update either
-    // 1) The file by writing to the mapping, or
-    // 2) The mapping by writing to the underlying file.
+    // Without paging, there is no mechanism to update the file by writing
+    // to the mapping, so only filesystems which keep a VMO of the file's
+    // contents (and write it back themselves) can offer writable shared
+    // mappings. MXIO_MMAP_FLAG_PRIVATE asks for a copy-on-write clone.
     virtual mx_status_t Mmap(int flags, size_t len, size_t* off, mx_handle_t* out) {
         return MX_ERR_NOT_SUPPORTED;
     }
@@ -0,0 +1,94 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stddef.h>
+
+#include <mxtl/intrusive_double_list.h>
+#include <mxtl/macros.h>
+#include <mxtl/ref_ptr.h>
+
+namespace fs {
+
+// Holds a reference to the most recently used vnodes of a filesystem, so that
+// closing and reopening a file finds its vnode, and whatever it has read in,
+// still there. Each vnode counts for some number of bytes as it's touched, and
+// the least recently used are let go once those held add up to more than the
+// cache's limit.
+//
+// |CacheTraits| gives the vnode's list node state, as for a
+// mxtl::DoublyLinkedList, and through cache_bytes() the size_t in which the
+// cache keeps what the vnode counted for:
+//
+//     struct CacheTraits {
+//         static mxtl::DoublyLinkedListNodeState<mxtl::RefPtr<T>>& node_state(T& vn);
+//         static size_t& cache_bytes(T& vn);
+//     };
+//
+// Letting go of a vnode may drop the last reference to it.
+template <typename VnodeType, typename CacheTraits>
+class VnodeCache {
+public:
+    explicit VnodeCache(size_t max_bytes) : max_bytes_(max_bytes) {}
+    DISALLOW_COPY_ASSIGN_AND_MOVE(VnodeCache);
+
+    ~VnodeCache() { Drop(); }
+
+    // Moves |vn| to the front as counting for |bytes|, adding it if it wasn't
+    // held, then lets go of the least recently used until the rest fit. A
+    // vnode which wouldn't fit on its own isn't kept at all.
+    void Touch(VnodeType* vn, size_t bytes) {
+        mxtl::RefPtr<VnodeType> ref;
+        if (CacheTraits::node_state(*vn).InContainer()) {
+            ref = Erase(vn);
+        } else {
+            ref = mxtl::WrapRefPtr(vn);
+        }
+
+        if (bytes > max_bytes_) {
+            return;
+        }
+        CacheTraits::cache_bytes(*vn) = bytes;
+        bytes_ += bytes;
+        list_.push_front(mxtl::move(ref));
+
+        while (bytes_ > max_bytes_) {
+            mxtl::RefPtr<VnodeType> old = list_.pop_back();
+            bytes_ -= CacheTraits::cache_bytes(*old);
+        }
+    }
+
+    // Lets go of |vn|, if it's held.
+    void Remove(VnodeType* vn) {
+        if (CacheTraits::node_state(*vn).InContainer()) {
+            Erase(vn);
+        }
+    }
+
+    // Lets go of every vnode held.
+    void Drop() {
+        while (!list_.is_empty()) {
+            mxtl::RefPtr<VnodeType> vn = list_.pop_front();
+            bytes_ -= CacheTraits::cache_bytes(*vn);
+        }
+    }
+
+    size_t bytes() const { return bytes_; }
+
+private:
+    mxtl::RefPtr<VnodeType> Erase(VnodeType* vn) {
+        mxtl::RefPtr<VnodeType> ref = list_.erase(*vn);
+        bytes_ -= CacheTraits::cache_bytes(*vn);
+        return ref;
+    }
+
+    const size_t max_bytes_;
+
+    // Most recently used first.
+    mxtl::DoublyLinkedList<mxtl::RefPtr<VnodeType>, CacheTraits> list_;
+    size_t bytes_ = 0;
+};
+
+} // namespace fs
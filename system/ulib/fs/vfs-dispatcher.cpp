@@ -98,65 +98,86 @@ void VfsDispatcher::DisconnectHandler(Handler* handler, bool need_close_cb) {
     }
 }
 
-int VfsDispatcher::Loop() {
+void VfsDispatcher::HandlePacket(const mx_port_packet_t& packet) {
     mx_status_t r;
 
     // when draining queue, limit the number of messages you take
     // at once, so you don't dominate the cpu
     constexpr unsigned kMaxMessageBatchSize = 4;
+
+    xprintf("thrd_: port_wait: returns key %p effective:%#x \n",
+            (void*)packet.key, packet.signal.observed);
+
+    Handler* handler = (Handler*)(uintptr_t)packet.key;
+
+    if (packet.signal.observed & MX_CHANNEL_READABLE) {
+        // hit cb multiple times if we know multi packets available
+        for (unsigned ix = 0; ix < mxtl::min(kMaxMessageBatchSize, (unsigned)packet.signal.count); ++ix) {
+            if ((r = handler->ExecuteCallback(cb_)) != MX_OK) {
+                // error or close: invoke callback in case of error
+                DisconnectHandler(handler, r != ERR_DISPATCHER_DONE);
+                goto free_handler;
+            }
+        }
+        // maybe more work to do: re-arm handler to fire again
+        if ((r = handler->SetAsyncCallback(ioport_))!= MX_OK){
+            DisconnectHandler(handler, true);
+            goto free_handler;
+        }
+    } else if (packet.signal.observed & MX_CHANNEL_PEER_CLOSED) {
+        DisconnectHandler(handler, true);
+    free_handler:
+        {
+            mxtl::AutoLock md_lock(&lock_);
+            handlers_.erase(*handler);
+        }
+    }
+}
+
+int VfsDispatcher::Loop() {
+    mx_status_t r;
+
+    // take a few packets per port wait to save on syscalls, but only a
+    // few, so that the rest of the pool has work to share
+    constexpr uint32_t kMaxPacketBatchSize = 4;
     char tname[128];
     GetThreadName(tname, sizeof(tname));
 
     for (;;) {
-        mx_port_packet_t packet;
+        mx_port_packet_t packets[kMaxPacketBatchSize];
+        uint32_t count;
 
-        if ((r = ioport_.wait(MX_TIME_INFINITE, &packet, 0u)) < 0) {
+        if ((r = ioport_.wait_many(MX_TIME_INFINITE, packets, kMaxPacketBatchSize,
+                                   &count)) < 0) {
             xprintf("mxio_dispatcher: port wait failed %d, worker exiting\n", r);
             return MX_OK;
         }
 
-        xprintf("port_wait: thread %s \n", tname);
-
-        if ((packet.signal.observed & MX_EVENT_SIGNALED) != 0) {
-            // reset for the next thread
-            r = shutdown_event_.wait_async(ioport_, 0u, MX_EVENT_SIGNALED,
-                                           MX_WAIT_ASYNC_ONCE);
-            if (r != MX_OK) {
-                FS_TRACE_ERROR("vfs-dispatcher: error, couldn't reset thread event\n");
-            }
-            // exit thread
-            xprintf("%s: suicide\n", tname);
-            return r;
-        }
-
-        xprintf("thrd_: port_wait: returns key %p effective:%#x \n",
-                (void*)packet.key, packet.signal.observed);
-
-        Handler* handler = (Handler*)(uintptr_t)packet.key;
-
-        if (packet.signal.observed & MX_CHANNEL_READABLE) {
-            // hit cb multiple times if we know multi packets available
-            for (unsigned ix = 0; ix < mxtl::min(kMaxMessageBatchSize, (unsigned)packet.signal.count); ++ix) {
-                if ((r = handler->ExecuteCallback(cb_)) != MX_OK) {
-                    // error or close: invoke callback in case of error
-                    DisconnectHandler(handler, r != ERR_DISPATCHER_DONE);
-                    goto free_handler;
+        xprintf("port_wait: thread %s, %u packets\n", tname, count);
+
+        bool exiting = false;
+        mx_status_t exit_status = MX_OK;
+        for (uint32_t i = 0; i < count; i++) {
+            const mx_port_packet_t& packet = packets[i];
+            if ((packet.signal.observed & MX_EVENT_SIGNALED) != 0) {
+                // reset for the next thread
+                exit_status = shutdown_event_.wait_async(ioport_, 0u, MX_EVENT_SIGNALED,
+                                                         MX_WAIT_ASYNC_ONCE);
+                if (exit_status != MX_OK) {
+                    FS_TRACE_ERROR("vfs-dispatcher: error, couldn't reset thread event\n");
                 }
+                // exit thread, once the rest of the batch is taken care of:
+                // the handlers in it have no other packet to rearm them
+                exiting = true;
+                continue;
             }
-            // maybe more work to do: re-arm handler to fire again
-            if ((r = handler->SetAsyncCallback(ioport_))!= MX_OK){
-                DisconnectHandler(handler, true);
-                goto free_handler;
-            }
-        } else if (packet.signal.observed & MX_CHANNEL_PEER_CLOSED) {
-            DisconnectHandler(handler, true);
-        free_handler:
-            {
-                mxtl::AutoLock md_lock(&lock_);
-                handlers_.erase(*handler);
-            }
+            HandlePacket(packet);
         }
 
+        if (exiting) {
+            xprintf("%s: suicide\n", tname);
+            return exit_status;
+        }
     }
 
     // fatal error -- exiting thread
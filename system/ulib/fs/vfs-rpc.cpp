@@ -4,6 +4,7 @@
 
 #include <fcntl.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
@@ -59,9 +60,12 @@ void vfs_rpc_open(mxrio_msg_t* msg, mx_handle_t rh, mxtl::RefPtr<Vnode> vn, cons
     // immediately, rather than describing the VFS object to the caller.
     // We check it early so we can throw away the protocol part of flags.
     bool pipeline = flags & MXRIO_OFLAG_PIPELINE;
+    bool xfer = flags & MXRIO_OFLAG_XFER;
     uint32_t open_flags = flags & (~MXRIO_OFLAG_MASK);
 
-    {
+    if (vn->ConcurrentOps()) {
+        r = Vfs::Open(mxtl::move(vn), &vn, path, &path, open_flags, mode);
+    } else {
         mxtl::AutoLock lock(&vfs_lock);
         r = Vfs::Open(mxtl::move(vn), &vn, path, &path, open_flags, mode);
     }
@@ -83,6 +87,14 @@ void vfs_rpc_open(mxrio_msg_t* msg, mx_handle_t rh, mxtl::RefPtr<Vnode> vn, cons
         goto done;
     }
 
+    // Vnodes served here take VMO transfers, if the client can send them
+    if (xfer && (obj.type == MXIO_PROTOCOL_REMOTE) && (obj.esize == 0)) {
+        mxrio_xfer_info_t info = {};
+        info.max_xfer = MXRIO_XFER_MAX;
+        memcpy(obj.extra, &info, sizeof(info));
+        obj.esize = sizeof(info);
+    }
+
 done:
     // If r >= 0, then we hold a reference to vn from open.
     // Otherwise, vn is closed, and we're simply responding to the client.
@@ -174,6 +186,59 @@ static mx_status_t iostate_get_token(uint64_t vnode_cookie, vfs_iostate* ios, mx
     return sizeof(mx_handle_t);
 }
 
+// Serves a READ_VMO or WRITE_VMO of |len| bytes, staging the data in a local
+// buffer rather than mapping a VMO whose size the client could change under us.
+static ssize_t iostate_xfer_vmo(mxrio_msg_t* msg, Vnode* vn, vfs_iostate* ios, size_t len) {
+    bool write = (MXRIO_OP(msg->op) == MXRIO_OP(MXRIO_WRITE_VMO));
+    mx_handle_t vmo = msg->handle[0];
+    auto close_vmo = mxtl::MakeAutoCall([vmo]() { mx_handle_close(vmo); });
+
+    bool current = (msg->arg2.off == MXRIO_OFF_CURRENT);
+    if ((len > MXRIO_XFER_MAX) || ((msg->arg2.off < 0) && !current)) {
+        return MX_ERR_INVALID_ARGS;
+    }
+    if (len == 0) {
+        return 0;
+    }
+
+    uint8_t* buf = static_cast<uint8_t*>(malloc(len));
+    if (buf == nullptr) {
+        return MX_ERR_NO_MEMORY;
+    }
+    auto free_buf = mxtl::MakeAutoCall([buf]() { free(buf); });
+
+    size_t off = current ? ios->io_off : static_cast<size_t>(msg->arg2.off);
+    size_t actual;
+    ssize_t r;
+    if (write) {
+        if ((r = mx_vmo_read(vmo, buf, 0, len, &actual)) < 0) {
+            return r;
+        } else if (actual != len) {
+            return MX_ERR_IO;
+        }
+        if (current && (ios->io_flags & O_APPEND)) {
+            vnattr_t attr;
+            if ((r = vn->Getattr(&attr)) < 0) {
+                return r;
+            }
+            off = attr.size;
+        }
+        r = vn->Write(buf, len, off);
+    } else if ((r = vn->Read(buf, len, off)) > 0) {
+        mx_status_t status;
+        if ((status = mx_vmo_write(vmo, buf, 0, r, &actual)) < 0) {
+            return status;
+        } else if (actual != static_cast<size_t>(r)) {
+            return MX_ERR_IO;
+        }
+    }
+    if ((r >= 0) && current) {
+        ios->io_off = off + r;
+        msg->arg2.off = ios->io_off;
+    }
+    return r;
+}
+
 mx_status_t vfs_handler_vn(mxrio_msg_t* msg, mxtl::RefPtr<Vnode> vn, vfs_iostate* ios) {
     uint32_t len = msg->datalen;
     int32_t arg = msg->arg;
@@ -271,6 +336,15 @@ mx_status_t vfs_handler_vn(mxrio_msg_t* msg, mxtl::RefPtr<Vnode> vn, vfs_iostate
         ssize_t r = vn->Write(msg->data, len, msg->arg2.off);
         return static_cast<mx_status_t>(r);
     }
+    case MXRIO_READ_VMO:
+    case MXRIO_WRITE_VMO: {
+        if (arg < 0) {
+            mx_handle_close(msg->handle[0]);
+            return MX_ERR_INVALID_ARGS;
+        }
+        ssize_t r = iostate_xfer_vmo(msg, vn.get(), ios, arg);
+        return static_cast<mx_status_t>(r);
+    }
     case MXRIO_SEEK: {
         vnattr_t attr;
         mx_status_t r;
@@ -350,7 +424,9 @@ mx_status_t vfs_handler_vn(mxrio_msg_t* msg, mxtl::RefPtr<Vnode> vn, vfs_iostate
             memset(&ios->dircookie, 0, sizeof(ios->dircookie));
         }
         mx_status_t r;
-        {
+        if (vn->ConcurrentOps()) {
+            r = vn->Readdir(&ios->dircookie, msg->data, arg);
+        } else {
             mxtl::AutoLock lock(&vfs_lock);
             r = vn->Readdir(&ios->dircookie, msg->data, arg);
         }
@@ -512,14 +588,36 @@ mx_status_t vfs_handler_vn(mxrio_msg_t* msg, mxtl::RefPtr<Vnode> vn, vfs_iostate
 
 // TODO(orr): temporary; prevent multithread weirdness while we
 // make locking more fine grained
-static mtx_t vfs_big_lock = MTX_INIT;
+//
+// Reads of vnodes which take them concurrently share the lock, so that they
+// overlap their I/O, as does everything done to vnodes which lock for
+// themselves; every other operation, writes included, holds it alone.
+static pthread_rwlock_t vfs_big_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static bool vfs_op_is_shared(mxrio_msg_t* msg, const Vnode* vn) {
+    if (vn->ConcurrentOps()) {
+        return true;
+    }
+    uint32_t op = MXRIO_OP(msg->op);
+    return ((op == MXRIO_READ) || (op == MXRIO_READ_AT) || (op == MXRIO_READ_VMO)) &&
+           vn->ConcurrentReads();
+}
 
 mx_status_t vfs_handler(mxrio_msg_t* msg, void* cookie) {
     vfs_iostate_t* ios = static_cast<vfs_iostate_t*>(cookie);
 
-    mxtl::AutoLock lock(&vfs_big_lock);
+    // ios->vn is only looked at with the lock held. Which way to hold it
+    // depends on the vnode, so it is read shared first, and read again once
+    // the lock is held alone if the operation can't share it.
+    pthread_rwlock_rdlock(&vfs_big_lock);
     mxtl::RefPtr<Vnode> vn = ios->vn;
+    if (!vfs_op_is_shared(msg, vn.get())) {
+        pthread_rwlock_unlock(&vfs_big_lock);
+        pthread_rwlock_wrlock(&vfs_big_lock);
+        vn = ios->vn;
+    }
     mx_status_t status = vfs_handler_vn(msg, mxtl::move(vn), ios);
+    pthread_rwlock_unlock(&vfs_big_lock);
     return status;
 }
 
@@ -41,7 +41,7 @@ mx_status_t WatcherContainer::WatchDir(mx_handle_t* out) {
     return MX_OK;
 }
 
-constexpr uint32_t kSupportedMasks = VFS_WATCH_MASK_ADDED;
+constexpr uint32_t kSupportedMasks = VFS_WATCH_MASK_ADDED | VFS_WATCH_MASK_REMOVED;
 
 mx_status_t WatcherContainer::WatchDirV2(const vfs_watch_dir_t* cmd) {
     mx::channel c = mx::channel(cmd->channel);
@@ -66,6 +66,14 @@ mx_status_t WatcherContainer::WatchDirV2(const vfs_watch_dir_t* cmd) {
 }
 
 void WatcherContainer::NotifyAdd(const char* name, size_t len) {
+    Notify(VFS_WATCH_EVT_ADDED, name, len);
+}
+
+void WatcherContainer::NotifyRemove(const char* name, size_t len) {
+    Notify(VFS_WATCH_EVT_REMOVED, name, len);
+}
+
+void WatcherContainer::Notify(uint8_t event, const char* name, size_t len) {
     if (len > VFS_WATCH_NAME_MAX) {
         return;
     }
@@ -78,12 +86,13 @@ void WatcherContainer::NotifyAdd(const char* name, size_t len) {
 
     uint8_t msg[sizeof(vfs_watch_msg_t) + len];
     vfs_watch_msg_t* vmsg = reinterpret_cast<vfs_watch_msg_t*>(msg);
-    vmsg->event = VFS_WATCH_EVT_ADDED;
+    vmsg->event = event;
     vmsg->len = static_cast<uint8_t>(len);
     memcpy(vmsg->name, name, len);
 
     for (auto it = watch_list_.begin(); it != watch_list_.end();) {
-        if (!(it->mask & VFS_WATCH_MASK_ADDED)) {
+        if (!(it->mask & (1u << event))) {
+            ++it;
             continue;
         }
 
@@ -172,7 +172,11 @@ mx_status_t Vfs::Unlink(mxtl::RefPtr<Vnode> vndir, const char* path, size_t len)
     if ((r = vfs_name_trim(path, len, &len, &must_be_dir)) != MX_OK) {
         return r;
     }
-    return vndir->Unlink(path, len, must_be_dir);
+    if ((r = vndir->Unlink(path, len, must_be_dir)) != MX_OK) {
+        return r;
+    }
+    vndir->NotifyRemove(path, len);
+    return MX_OK;
 }
 
 mx_status_t Vfs::Link(mxtl::RefPtr<Vnode> oldparent, mxtl::RefPtr<Vnode> newparent,
@@ -227,6 +231,7 @@ mx_status_t Vfs::Rename(mxtl::RefPtr<Vnode> oldparent, mxtl::RefPtr<Vnode> newpa
     if (r != MX_OK) {
         return r;
     }
+    oldparent->NotifyRemove(oldname, oldlen);
     newparent->NotifyAdd(newname, newlen);
     return MX_OK;
 }
@@ -21,6 +21,12 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__x86_64__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 #define TRACE 0
 
 #if TRACE
@@ -214,155 +220,81 @@ void gfx_putchar(gfx_surface* surface, const gfx_font* font, unsigned ch, unsign
     surface->putchar(surface, font, ch, x, y, fg, bg);
 }
 
-static void copyrect8(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height, unsigned x2, unsigned y2) {
-    // copy
-    const uint8_t* src = &((const uint8_t*)surface->ptr)[x + y * surface->stride];
-    uint8_t* dest = &((uint8_t*)surface->ptr)[x2 + y2 * surface->stride];
-    unsigned stride_diff = surface->stride - width;
-
-    if (dest < src) {
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                *dest = *src;
-                dest++;
-                src++;
-            }
-            dest += stride_diff;
-            src += stride_diff;
-        }
-    } else {
-        // copy backwards
-        src += (height-1) * surface->stride + (width-1);
-        dest += (height-1) * surface->stride + (width-1);
-
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                *dest = *src;
-                dest--;
-                src--;
-            }
-            dest -= stride_diff;
-            src -= stride_diff;
-        }
+// Row kernels.  SSE2 and NEON are part of the base x86-64 and arm64
+// architectures, so these need no check of what the CPU has.
+
+// Fills |bytes| at |dest| with |pattern|, which is a whole number of
+// pixels repeated to fill 32 bits, so it doesn't matter where |dest| is.
+static void fill_row(void* dest, uint32_t pattern, size_t bytes) {
+    uint8_t* d = dest;
+#if defined(__x86_64__)
+    __m128i v = _mm_set1_epi32((int)pattern);
+    for (; bytes >= 32; bytes -= 32, d += 32) {
+        _mm_storeu_si128((__m128i*)d, v);
+        _mm_storeu_si128((__m128i*)(d + 16), v);
+    }
+    if (bytes >= 16) {
+        _mm_storeu_si128((__m128i*)d, v);
+        d += 16;
+        bytes -= 16;
+    }
+#elif defined(__aarch64__)
+    uint8x16_t v = vreinterpretq_u8_u32(vdupq_n_u32(pattern));
+    for (; bytes >= 32; bytes -= 32, d += 32) {
+        vst1q_u8(d, v);
+        vst1q_u8(d + 16, v);
+    }
+    if (bytes >= 16) {
+        vst1q_u8(d, v);
+        d += 16;
+        bytes -= 16;
     }
+#endif
+    for (; bytes >= 4; bytes -= 4, d += 4)
+        memcpy(d, &pattern, 4);
+    memcpy(d, &pattern, bytes);
 }
 
-static void fillrect8(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height, unsigned color) {
-    uint8_t* dest = &((uint8_t*)surface->ptr)[x + y * surface->stride];
-    unsigned stride_diff = surface->stride - width;
-
-    uint8_t color8 = (uint8_t)(surface->translate_color(color));
+static void fill_rows(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height, uint32_t pattern) {
+    size_t pitch = surface->stride * surface->pixelsize;
+    uint8_t* dest = (uint8_t*)surface->ptr + y * pitch + x * surface->pixelsize;
+    size_t bytes = width * surface->pixelsize;
 
-    unsigned i, j;
-    for (i = 0; i < height; i++) {
-        for (j = 0; j < width; j++) {
-            *dest = color8;
-            dest++;
-        }
-        dest += stride_diff;
-    }
+    for (unsigned i = 0; i < height; i++, dest += pitch)
+        fill_row(dest, pattern, bytes);
 }
 
-static void copyrect16(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height, unsigned x2, unsigned y2) {
-    // copy
-    const uint16_t* src = &((const uint16_t*)surface->ptr)[x + y * surface->stride];
-    uint16_t* dest = &((uint16_t*)surface->ptr)[x2 + y2 * surface->stride];
-    unsigned stride_diff = surface->stride - width;
+// One for all the formats: each row is moved whole, in the order that
+// doesn't overwrite rows still to be moved.
+static void copyrect(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height, unsigned x2, unsigned y2) {
+    size_t pitch = surface->stride * surface->pixelsize;
+    const uint8_t* src = (const uint8_t*)surface->ptr + y * pitch + x * surface->pixelsize;
+    uint8_t* dest = (uint8_t*)surface->ptr + y2 * pitch + x2 * surface->pixelsize;
+    size_t bytes = width * surface->pixelsize;
 
     if (dest < src) {
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                *dest = *src;
-                dest++;
-                src++;
-            }
-            dest += stride_diff;
-            src += stride_diff;
-        }
+        for (unsigned i = 0; i < height; i++, dest += pitch, src += pitch)
+            memmove(dest, src, bytes);
     } else {
-        // copy backwards
-        src += (height-1) * surface->stride + (width-1);
-        dest += (height-1) * surface->stride + (width-1);
-
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                *dest = *src;
-                dest--;
-                src--;
-            }
-            dest -= stride_diff;
-            src -= stride_diff;
-        }
+        src += (height - 1) * pitch;
+        dest += (height - 1) * pitch;
+        for (unsigned i = 0; i < height; i++, dest -= pitch, src -= pitch)
+            memmove(dest, src, bytes);
     }
 }
 
-static void fillrect16(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height, unsigned color) {
-    uint16_t* dest = &((uint16_t*)surface->ptr)[x + y * surface->stride];
-    unsigned stride_diff = surface->stride - width;
-
-    uint16_t color16 = (uint16_t)(surface->translate_color(color));
-
-    unsigned i, j;
-    for (i = 0; i < height; i++) {
-        for (j = 0; j < width; j++) {
-            *dest = color16;
-            dest++;
-        }
-        dest += stride_diff;
-    }
+static void fillrect8(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height, unsigned color) {
+    uint8_t color8 = (uint8_t)(surface->translate_color(color));
+    fill_rows(surface, x, y, width, height, color8 * 0x01010101u);
 }
 
-static void copyrect32(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height, unsigned x2, unsigned y2) {
-    // copy
-    const uint32_t* src = &((const uint32_t*)surface->ptr)[x + y * surface->stride];
-    uint32_t* dest = &((uint32_t*)surface->ptr)[x2 + y2 * surface->stride];
-    unsigned stride_diff = surface->stride - width;
-
-    if (dest < src) {
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                *dest = *src;
-                dest++;
-                src++;
-            }
-            dest += stride_diff;
-            src += stride_diff;
-        }
-    } else {
-        // copy backwards
-        src += (height-1) * surface->stride + (width-1);
-        dest += (height-1) * surface->stride + (width-1);
-
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                *dest = *src;
-                dest--;
-                src--;
-            }
-            dest -= stride_diff;
-            src -= stride_diff;
-        }
-    }
+static void fillrect16(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height, unsigned color) {
+    uint16_t color16 = (uint16_t)(surface->translate_color(color));
+    fill_rows(surface, x, y, width, height, color16 * 0x00010001u);
 }
 
 static void fillrect32(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height, unsigned color) {
-    uint32_t* dest = &((uint32_t*)surface->ptr)[x + y * surface->stride];
-    unsigned stride_diff = surface->stride - width;
-
-    unsigned i, j;
-    for (i = 0; i < height; i++) {
-        for (j = 0; j < width; j++) {
-            *dest = color;
-            dest++;
-        }
-        dest += stride_diff;
-    }
+    fill_rows(surface, x, y, width, height, color);
 }
 
 void gfx_line(gfx_surface* surface, unsigned x1, unsigned y1, unsigned x2, unsigned y2, unsigned color) {
@@ -452,6 +384,84 @@ uint32_t alpha32_add_ignore_destalpha(uint32_t dest, uint32_t src) {
     return (srca << 24) | (cres[0] << 16) | (cres[1] << 8) | (cres[2]);
 }
 
+// Blends |count| pixels of |src| over |dest| as alpha32_add_ignore_destalpha()
+// does, to the bit, four at a time.
+static void blend_row32(uint32_t* dest, const uint32_t* src, unsigned count) {
+#if defined(__x86_64__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i opaque = _mm_set1_epi32(0xff);
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i rgb = _mm_set1_epi32(0x00ffffff);
+    for (; count >= 4; count -= 4, dest += 4, src += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i*)src);
+        __m128i alpha = _mm_srli_epi32(s, 24);
+        __m128i is_opaque = _mm_cmpeq_epi32(alpha, opaque);
+        __m128i is_clear = _mm_cmpeq_epi32(alpha, zero);
+        int opaque_mask = _mm_movemask_epi8(is_opaque);
+        if (opaque_mask == 0xffff) {
+            _mm_storeu_si128((__m128i*)dest, s);
+            continue;
+        }
+        if (_mm_movemask_epi8(is_clear) == 0xffff)
+            continue;
+        __m128i d = _mm_loadu_si128((const __m128i*)dest);
+
+        // Each pixel's weights, in all four of its 16-bit channels.
+        __m128i a = _mm_add_epi32(alpha, one);
+        __m128i ainv = _mm_sub_epi32(opaque, a);
+        __m128i a2 = _mm_or_si128(a, _mm_slli_epi32(a, 16));
+        __m128i ainv2 = _mm_or_si128(ainv, _mm_slli_epi32(ainv, 16));
+
+        __m128i lo = _mm_add_epi16(
+            _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi32(a2, a2)), 8),
+            _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi32(ainv2, ainv2)), 8));
+        __m128i hi = _mm_add_epi16(
+            _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi32(a2, a2)), 8),
+            _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi32(ainv2, ainv2)), 8));
+        __m128i out = _mm_or_si128(_mm_and_si128(_mm_packus_epi16(lo, hi), rgb), _mm_slli_epi32(a, 24));
+
+        out = _mm_or_si128(_mm_andnot_si128(_mm_or_si128(is_opaque, is_clear), out),
+                           _mm_or_si128(_mm_and_si128(is_opaque, s), _mm_and_si128(is_clear, d)));
+        _mm_storeu_si128((__m128i*)dest, out);
+    }
+#elif defined(__aarch64__)
+    const uint32x4_t opaque = vdupq_n_u32(0xff);
+    const uint32x4_t rgb = vdupq_n_u32(0x00ffffff);
+    for (; count >= 4; count -= 4, dest += 4, src += 4) {
+        uint32x4_t s = vld1q_u32(src);
+        uint32x4_t alpha = vshrq_n_u32(s, 24);
+        uint32x4_t is_opaque = vceqq_u32(alpha, opaque);
+        uint32x4_t is_clear = vceqq_u32(alpha, vdupq_n_u32(0));
+        if (vminvq_u32(is_opaque) != 0) {
+            vst1q_u32(dest, s);
+            continue;
+        }
+        if (vminvq_u32(is_clear) != 0)
+            continue;
+        uint32x4_t d = vld1q_u32(dest);
+
+        // Each pixel's weights, in all four of its bytes.
+        uint32x4_t a = vaddq_u32(alpha, vdupq_n_u32(1));
+        uint8x16_t a8 = vreinterpretq_u8_u32(vmulq_n_u32(a, 0x01010101));
+        uint8x16_t ainv8 = vreinterpretq_u8_u32(vmulq_n_u32(vsubq_u32(opaque, a), 0x01010101));
+        uint8x16_t s8 = vreinterpretq_u8_u32(s);
+        uint8x16_t d8 = vreinterpretq_u8_u32(d);
+
+        uint16x8_t lo = vaddq_u16(vshrq_n_u16(vmull_u8(vget_low_u8(s8), vget_low_u8(a8)), 8),
+                                  vshrq_n_u16(vmull_u8(vget_low_u8(d8), vget_low_u8(ainv8)), 8));
+        uint16x8_t hi = vaddq_u16(vshrq_n_u16(vmull_u8(vget_high_u8(s8), vget_high_u8(a8)), 8),
+                                  vshrq_n_u16(vmull_u8(vget_high_u8(d8), vget_high_u8(ainv8)), 8));
+        uint32x4_t out = vreinterpretq_u32_u8(vcombine_u8(vmovn_u16(lo), vmovn_u16(hi)));
+        out = vorrq_u32(vandq_u32(out, rgb), vshlq_n_u32(a, 24));
+
+        out = vbslq_u32(is_opaque, s, vbslq_u32(is_clear, d, out));
+        vst1q_u32(dest, out);
+    }
+#endif
+    for (; count > 0; count--, dest++, src++)
+        *dest = alpha32_add_ignore_destalpha(*dest, *src);
+}
+
 /**
  * @brief  Copy pixels from source to dest.
  *
@@ -489,84 +499,26 @@ void gfx_blend(gfx_surface* target, gfx_surface* source, unsigned srcx, unsigned
     if (srcy + height > source->height)
         height = source->height - srcy;
 
+    size_t pixelsize = source->pixelsize;
+    const uint8_t* src = (const uint8_t*)source->ptr + (srcx + srcy * source->stride) * pixelsize;
+    uint8_t* dest = (uint8_t*)target->ptr + (destx + desty * target->stride) * pixelsize;
+    size_t source_pitch = source->stride * pixelsize;
+    size_t dest_pitch = target->stride * pixelsize;
+
+    xprintf("w %u h %u dpitch %zu spitch %zu\n", width, height, dest_pitch, source_pitch);
+
     // XXX total hack to deal with various blends
-    if (source->format == MX_PIXEL_FORMAT_RGB_565 && target->format == MX_PIXEL_FORMAT_RGB_565) {
-        // 16 bit to 16 bit
-        const uint16_t* src = &((const uint16_t*)source->ptr)[srcx + srcy * source->stride];
-        uint16_t* dest = &((uint16_t*)target->ptr)[destx + desty * target->stride];
-        unsigned dest_stride_diff = target->stride - width;
-        unsigned source_stride_diff = source->stride - width;
-
-        xprintf("w %u h %u dstride %u sstride %u\n", width, height, dest_stride_diff, source_stride_diff);
-
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                *dest = *src;
-                dest++;
-                src++;
-            }
-            dest += dest_stride_diff;
-            src += source_stride_diff;
-        }
-    } else if (source->format == MX_PIXEL_FORMAT_ARGB_8888 && target->format == MX_PIXEL_FORMAT_ARGB_8888) {
+    if (source->format == MX_PIXEL_FORMAT_ARGB_8888 && target->format == MX_PIXEL_FORMAT_ARGB_8888) {
         // both are 32 bit modes, both alpha
-        const uint32_t* src = &((const uint32_t*)source->ptr)[srcx + srcy * source->stride];
-        uint32_t* dest = &((uint32_t*)target->ptr)[destx + desty * target->stride];
-        unsigned dest_stride_diff = target->stride - width;
-        unsigned source_stride_diff = source->stride - width;
-
-        xprintf("w %u h %u dstride %u sstride %u\n", width, height, dest_stride_diff, source_stride_diff);
-
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                // XXX ignores destination alpha
-                *dest = alpha32_add_ignore_destalpha(*dest, *src);
-                dest++;
-                src++;
-            }
-            dest += dest_stride_diff;
-            src += source_stride_diff;
-        }
-    } else if (source->format == MX_PIXEL_FORMAT_RGB_x888 && target->format == MX_PIXEL_FORMAT_RGB_x888) {
-        // both are 32 bit modes, no alpha
-        const uint32_t* src = &((const uint32_t*)source->ptr)[srcx + srcy * source->stride];
-        uint32_t* dest = &((uint32_t*)target->ptr)[destx + desty * target->stride];
-        unsigned dest_stride_diff = target->stride - width;
-        unsigned source_stride_diff = source->stride - width;
-
-        xprintf("w %u h %u dstride %u sstride %u\n", width, height, dest_stride_diff, source_stride_diff);
-
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                *dest = *src;
-                dest++;
-                src++;
-            }
-            dest += dest_stride_diff;
-            src += source_stride_diff;
-        }
-    } else if (source->format == MX_PIXEL_FORMAT_MONO_1 && target->format == MX_PIXEL_FORMAT_MONO_1) {
-        // both are 8 bit modes, no alpha
-        const uint8_t* src = &((const uint8_t*)source->ptr)[srcx + srcy * source->stride];
-        uint8_t* dest = &((uint8_t*)target->ptr)[destx + desty * target->stride];
-        unsigned dest_stride_diff = target->stride - width;
-        unsigned source_stride_diff = source->stride - width;
-
-        xprintf("w %u h %u dstride %u sstride %u\n", width, height, dest_stride_diff, source_stride_diff);
-
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                *dest = *src;
-                dest++;
-                src++;
-            }
-            dest += dest_stride_diff;
-            src += source_stride_diff;
-        }
+        // XXX ignores destination alpha
+        for (unsigned i = 0; i < height; i++, dest += dest_pitch, src += source_pitch)
+            blend_row32((uint32_t*)dest, (const uint32_t*)src, width);
+    } else if ((source->format == MX_PIXEL_FORMAT_RGB_565 && target->format == MX_PIXEL_FORMAT_RGB_565) ||
+               (source->format == MX_PIXEL_FORMAT_RGB_x888 && target->format == MX_PIXEL_FORMAT_RGB_x888) ||
+               (source->format == MX_PIXEL_FORMAT_MONO_1 && target->format == MX_PIXEL_FORMAT_MONO_1)) {
+        // no alpha, so a plain copy
+        for (unsigned i = 0; i < height; i++, dest += dest_pitch, src += source_pitch)
+            memmove(dest, src, width * pixelsize);
     } else {
         xprintf("gfx_surface_blend: unimplemented colorspace combination (source %d target %d)\n", source->format, target->format);
         assert(0);
@@ -644,7 +596,7 @@ int gfx_init_surface(gfx_surface* surface, void* ptr, unsigned width, unsigned h
     switch (format) {
     case MX_PIXEL_FORMAT_RGB_565:
         surface->translate_color = &ARGB8888_to_RGB565;
-        surface->copyrect = &copyrect16;
+        surface->copyrect = &copyrect;
         surface->fillrect = &fillrect16;
         surface->putpixel = &putpixel16;
         surface->putchar = &putchar16;
@@ -654,7 +606,7 @@ int gfx_init_surface(gfx_surface* surface, void* ptr, unsigned width, unsigned h
     case MX_PIXEL_FORMAT_RGB_x888:
     case MX_PIXEL_FORMAT_ARGB_8888:
         surface->translate_color = NULL;
-        surface->copyrect = &copyrect32;
+        surface->copyrect = &copyrect;
         surface->fillrect = &fillrect32;
         surface->putpixel = &putpixel32;
         surface->putchar = &putchar32;
@@ -663,7 +615,7 @@ int gfx_init_surface(gfx_surface* surface, void* ptr, unsigned width, unsigned h
         break;
     case MX_PIXEL_FORMAT_MONO_1:
         surface->translate_color = &ARGB8888_to_Luma;
-        surface->copyrect = &copyrect8;
+        surface->copyrect = &copyrect;
         surface->fillrect = &fillrect8;
         surface->putpixel = &putpixel8;
         surface->putchar = &putchar8;
@@ -672,7 +624,7 @@ int gfx_init_surface(gfx_surface* surface, void* ptr, unsigned width, unsigned h
         break;
     case MX_PIXEL_FORMAT_RGB_332:
         surface->translate_color = &ARGB8888_to_RGB332;
-        surface->copyrect = &copyrect8;
+        surface->copyrect = &copyrect;
         surface->fillrect = &fillrect8;
         surface->putpixel = &putpixel8;
         surface->putchar = &putchar8;
@@ -681,7 +633,7 @@ int gfx_init_surface(gfx_surface* surface, void* ptr, unsigned width, unsigned h
         break;
     case MX_PIXEL_FORMAT_RGB_2220:
         surface->translate_color = &ARGB8888_to_RGB2220;
-        surface->copyrect = &copyrect8;
+        surface->copyrect = &copyrect;
         surface->fillrect = &fillrect8;
         surface->putpixel = &putpixel8;
         surface->putchar = &putchar8;
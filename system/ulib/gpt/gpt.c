@@ -17,28 +17,6 @@
 
 #include "gpt/gpt.h"
 
-#define GPT_MAGIC (0x5452415020494645ull) // 'EFI PART'
-#define GPT_HEADER_SIZE 0x5c
-#define GPT_ENTRY_SIZE  0x80
-
-typedef struct gpt_header {
-    uint64_t magic;
-    uint32_t revision;
-    uint32_t size;
-    uint32_t crc32;
-    uint32_t reserved0;
-    uint64_t current;
-    uint64_t backup;
-    uint64_t first;
-    uint64_t last;
-    uint8_t guid[GPT_GUID_LEN];
-    uint64_t entries;
-    uint32_t entries_count;
-    uint32_t entries_size;
-    uint32_t entries_crc;
-    uint8_t reserved[420]; // for 512-byte block size
-} gpt_header_t;
-
 typedef struct mbr_partition {
     uint8_t status;
     uint8_t chs_first[3];
@@ -77,6 +55,44 @@ static void cstring_to_utf16(uint16_t* dst, const char* src, size_t maxlen) {
     }
 }
 
+mx_status_t gpt_header_validate(const gpt_header_t* header, uint64_t blocksize,
+                                uint64_t blocks, size_t* ptable_size) {
+    if (header->magic != GPT_MAGIC) {
+        return MX_ERR_NOT_FOUND;
+    }
+    if ((header->size < GPT_HEADER_SIZE) || (header->size > sizeof(gpt_header_t)) ||
+        (header->size > blocksize)) {
+        return MX_ERR_BAD_STATE;
+    }
+    gpt_header_t copy;
+    memcpy(&copy, header, header->size);
+    copy.crc32 = 0;
+    if (crc32(0, (const unsigned char*)&copy, copy.size) != header->crc32) {
+        return MX_ERR_IO_DATA_INTEGRITY;
+    }
+    if ((header->entries_size != GPT_ENTRY_SIZE) ||
+        (header->entries_count > PARTITIONS_COUNT)) {
+        return MX_ERR_NOT_SUPPORTED;
+    }
+    size_t size = header->entries_count * GPT_ENTRY_SIZE;
+    uint64_t ptable_blocks = (size + blocksize - 1) / blocksize;
+    if ((header->last >= blocks) || (header->first > header->last) ||
+        (header->entries < 2) || (header->entries >= blocks) ||
+        (ptable_blocks > blocks - header->entries)) {
+        return MX_ERR_OUT_OF_RANGE;
+    }
+    *ptable_size = size;
+    return MX_OK;
+}
+
+mx_status_t gpt_ptable_validate(const gpt_header_t* header, const void* ptable) {
+    size_t size = header->entries_count * GPT_ENTRY_SIZE;
+    if (crc32(0, (const unsigned char*)ptable, size) != header->entries_crc) {
+        return MX_ERR_IO_DATA_INTEGRITY;
+    }
+    return MX_OK;
+}
+
 static void partition_init(gpt_partition_t* part, const char* name, uint8_t* type, uint8_t* guid,
                            uint64_t first, uint64_t last, uint64_t flags) {
     memcpy(part->type, type, sizeof(part->type));
@@ -119,22 +135,13 @@ int gpt_device_init(int fd, uint64_t blocksize, uint64_t blocks, gpt_device_t**
     }
 
     // is this a valid gpt header?
-    if (header->magic != GPT_MAGIC) {
+    size_t ptable_size;
+    mx_status_t status = gpt_header_validate(header, blocksize, blocks, &ptable_size);
+    if (status == MX_ERR_NOT_FOUND) {
         printf("invalid header magic!\n");
         goto out; // ok to have an invalid header
-    }
-
-    // header checksum
-    uint32_t saved_crc = header->crc32;
-    header->crc32 = 0;
-    uint32_t crc = crc32(0, (const unsigned char*)header, header->size);
-    if (crc != saved_crc) {
-        printf("header crc check failed\n");
-        goto out;
-    }
-
-    if (header->entries_count > PARTITIONS_COUNT) {
-        printf("too many partitions!\n");
+    } else if (status != MX_OK) {
+        printf("invalid gpt header (%d)\n", status);
         goto out;
     }
 
@@ -143,10 +150,6 @@ int gpt_device_init(int fd, uint64_t blocksize, uint64_t blocks, gpt_device_t**
     if (header->entries_count == 0) {
         goto out;
     }
-    if (header->entries_count > PARTITIONS_COUNT) {
-        printf("too many partitions\n");
-        goto out;
-    }
 
     gpt_partition_t* ptable = priv->ptable;
 
@@ -155,19 +158,13 @@ int gpt_device_init(int fd, uint64_t blocksize, uint64_t blocks, gpt_device_t**
     if (rc < 0) {
         goto fail;
     }
-    ssize_t ptable_size = header->entries_size * header->entries_count;
-    if ((size_t)ptable_size > SIZE_MAX) {
-        printf("partition table too big\n");
-        goto out;
-    }
     rc = read(fd, ptable, ptable_size);
-    if (rc != ptable_size) {
+    if (rc < 0 || (size_t)rc != ptable_size) {
         goto fail;
     }
 
     // partition table checksum
-    crc = crc32(0, (const unsigned char*)ptable, ptable_size);
-    if (crc != header->entries_crc) {
+    if (gpt_ptable_validate(header, ptable) != MX_OK) {
         printf("table crc check failed\n");
         goto out;
     }
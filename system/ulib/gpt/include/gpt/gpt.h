@@ -5,9 +5,15 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+#include <magenta/types.h>
+
 #define PARTITIONS_COUNT 128
+#define GPT_MAGIC (0x5452415020494645ull) // 'EFI PART'
+#define GPT_HEADER_SIZE 0x5c
+#define GPT_ENTRY_SIZE  0x80
 #define GPT_GUID_LEN 16
 #define GPT_GUID_STRLEN 37
 #define GPT_NAME_LEN 72
@@ -54,6 +60,24 @@ typedef struct gpt_partition {
     uint8_t name[GPT_NAME_LEN];
 } gpt_partition_t;
 
+typedef struct gpt_header {
+    uint64_t magic;
+    uint32_t revision;
+    uint32_t size;
+    uint32_t crc32;
+    uint32_t reserved0;
+    uint64_t current;
+    uint64_t backup;
+    uint64_t first;
+    uint64_t last;
+    uint8_t guid[GPT_GUID_LEN];
+    uint64_t entries;
+    uint32_t entries_count;
+    uint32_t entries_size;
+    uint32_t entries_crc;
+    uint8_t reserved[420]; // for 512-byte block size
+} gpt_header_t;
+
 typedef struct gpt_device {
     bool valid;
     // true if the partition table on the device is valid
@@ -64,6 +88,17 @@ typedef struct gpt_device {
 int gpt_device_init(int fd, uint64_t blocksize, uint64_t blocks, gpt_device_t** out_dev);
 // read the partition table from the device.
 
+mx_status_t gpt_header_validate(const gpt_header_t* header, uint64_t blocksize,
+                                uint64_t blocks, size_t* ptable_size);
+// checks the magic, size and crc of a primary gpt header read from lba 1 of a
+// device of blocks blocks, and that its partition table fits the device and
+// has at most PARTITIONS_COUNT entries. on success, ptable_size is the size of
+// the partition table in bytes. the gpt driver and gpt_device_init() share this.
+
+mx_status_t gpt_ptable_validate(const gpt_header_t* header, const void* ptable);
+// checks the partition table read from the location header gives against the
+// crc in the header.
+
 void gpt_device_release(gpt_device_t* dev);
 // releases the device
 
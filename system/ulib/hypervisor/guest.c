@@ -208,3 +208,15 @@ mx_status_t guest_create(mx_handle_t hypervisor, mx_handle_t phys_mem, mx_handle
     return mx_hypervisor_op(hypervisor, MX_HYPERVISOR_OP_GUEST_CREATE,
                             create_args, sizeof(create_args), guest, sizeof(*guest));
 }
+
+mx_status_t guest_create_vcpu(mx_handle_t guest, mx_handle_t* ctl_fifo, mx_handle_t* vcpu) {
+    const uint32_t count = PAGE_SIZE / MX_GUEST_MAX_PKT_SIZE;
+    const uint32_t size = sizeof(mx_guest_packet_t);
+    mx_handle_t kernel_ctl_fifo;
+    mx_status_t status = mx_fifo_create(count, size, 0, &kernel_ctl_fifo, ctl_fifo);
+    if (status != MX_OK)
+        return status;
+
+    return mx_hypervisor_op(guest, MX_HYPERVISOR_OP_VCPU_CREATE,
+                            &kernel_ctl_fifo, sizeof(kernel_ctl_fifo), vcpu, sizeof(*vcpu));
+}
@@ -48,6 +48,15 @@ mx_status_t guest_create_bootdata(uintptr_t addr, size_t size, uintptr_t acpi_of
 mx_status_t guest_create(mx_handle_t hypervisor, mx_handle_t phys_mem, mx_handle_t* ctl_fifo,
                          mx_handle_t* guest);
 
+/**
+ * Create another VCPU within a guest.
+ *
+ * @param guest The guest to create the VCPU in.
+ * @param ctl_fifo A handle to the control FIFO for the VCPU.
+ * @param vcpu A handle to the newly created VCPU.
+ */
+mx_status_t guest_create_vcpu(mx_handle_t guest, mx_handle_t* ctl_fifo, mx_handle_t* vcpu);
+
 /**
  * Create an e820 memory map.
  *
@@ -142,16 +142,34 @@ static int resolve_ip6(mac_addr_t* _mac, const ip6_addr_t* _ip) {
     return -1;
 }
 
+// The ones' complement sum is the same whatever size the words are added
+// in, so long as carries wrap around, so it is summed 64 bits at a time
+// and folded down at the end.
 static uint16_t checksum(const void* _data, size_t len, uint16_t _sum) {
-    uint32_t sum = _sum;
-    const uint16_t* data = _data;
+    uint64_t sum = _sum;
+    const uint8_t* data = _data;
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, data, 8);
+        sum += word;
+        sum += (sum < word);
+        data += 8;
+        len -= 8;
+    }
     while (len > 1) {
-        sum += *data++;
+        uint16_t word;
+        memcpy(&word, data, 2);
+        sum += word;
+        sum += (sum < word);
+        data += 2;
         len -= 2;
     }
     if (len) {
-        sum += (*data & 0xFF);
+        sum += *data;
+        sum += (sum < *data);
     }
+    sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+    sum = (sum & 0xFFFFFFFF) + (sum >> 32);
     while (sum > 0xFFFF) {
         sum = (sum & 0xFFFF) + (sum >> 16);
     }
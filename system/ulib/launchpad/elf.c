@@ -66,7 +66,7 @@ mx_status_t elf_load_get_interp(elf_load_info_t* info, mx_handle_t vmo,
     return MX_OK;
 }
 
-mx_status_t elf_load_finish(mx_handle_t vmar, elf_load_info_t* info,
+mx_status_t elf_load_finish(mx_handle_t vmar, const elf_load_info_t* info,
                             mx_handle_t vmo,
                             mx_handle_t* segments_vmar,
                             mx_vaddr_t* base, mx_vaddr_t* entry) {
@@ -74,7 +74,11 @@ mx_status_t elf_load_finish(mx_handle_t vmar, elf_load_info_t* info,
                                  segments_vmar, base, entry);
 }
 
-size_t elf_load_get_stack_size(elf_load_info_t* info) {
+void elf_load_prefault(elf_load_info_t* info) {
+    info->header.prefault = true;
+}
+
+size_t elf_load_get_stack_size(const elf_load_info_t* info) {
     for (uint_fast16_t i = 0; i < info->header.e_phnum; ++i) {
         if (info->phdrs[i].p_type == PT_GNU_STACK)
             return info->phdrs[i].p_memsz;
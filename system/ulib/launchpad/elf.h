@@ -25,14 +25,19 @@ void elf_load_destroy(elf_load_info_t* info);
 mx_status_t elf_load_get_interp(elf_load_info_t* info, mx_handle_t vmo,
                                 char** interp, size_t* interp_len);
 
+// Have the file's read-only pages that are in memory mapped in up front
+// by elf_load_finish, rather than as they're touched.  For files nearly
+// every process runs.
+void elf_load_prefault(elf_load_info_t* info);
+
 // Check if the ELF file has a PT_GNU_STACK header, and return its p_memsz.
 // Returns zero if no header was found.
-size_t elf_load_get_stack_size(elf_load_info_t* info);
+size_t elf_load_get_stack_size(const elf_load_info_t* info);
 
 // Load the file's segments into the process.
 // If this fails, the state of the process address space is unspecified.
 // Regardless of success/failure this does not consume |vmo|.
-mx_status_t elf_load_finish(mx_handle_t vmar, elf_load_info_t* info,
+mx_status_t elf_load_finish(mx_handle_t vmar, const elf_load_info_t* info,
                             mx_handle_t vmo,
                             mx_handle_t* segments_vmar,
                             mx_vaddr_t* base, mx_vaddr_t* entry);
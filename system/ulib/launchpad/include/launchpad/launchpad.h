@@ -17,6 +17,10 @@ __BEGIN_CDECLS
 // Use of this object is not thread-safe.
 typedef struct launchpad launchpad_t;
 
+// Opaque type holding an executable ready to be loaded into any
+// number of launchpads (see PROCESS TEMPLATES below).
+typedef struct launchpad_template launchpad_template_t;
+
 // API OVERVIEW
 // -------------------------------------------------------------
 //
@@ -133,6 +137,35 @@ mx_status_t launchpad_load_from_fd(launchpad_t* lp, int fd);
 // Load an ELF PIE binary from vmo
 mx_status_t launchpad_load_from_vmo(launchpad_t* lp, mx_handle_t vmo);
 
+// Load an ELF PIE binary from a template (see below)
+mx_status_t launchpad_load_from_template(launchpad_t* lp,
+                                         const launchpad_template_t* tmpl);
+
+
+// PROCESS TEMPLATES
+// A template is an ELF file image already looked at: its headers and,
+// if it has a PT_INTERP program header, the dynamic linker the loader
+// service gives for that with its headers too.  Loading one into a
+// launchpad does what launchpad_elf_load would, without reading any
+// headers or asking the loader service again, so a program started
+// over and over need only be looked at once.  A template can be used
+// by any number of launchpads at once, from any thread, until it is
+// destroyed.  Templates don't handle "#!" scripts.
+// -------------------------------------------------------------------
+
+// Create a template for the ELF file image in a VM object.  This
+// consumes the VM object; a negative error code given instead is
+// just returned.  If the file has a PT_INTERP program header, the
+// string is looked up via loader_svc, which is not consumed; if that
+// is MX_HANDLE_INVALID, mxio_loader_service is used for it.
+mx_status_t launchpad_template_create(mx_handle_t vmo,
+                                      mx_handle_t loader_svc,
+                                      launchpad_template_t** result);
+
+// Free a template and close all the handles it holds.  Launchpads
+// already loaded from it are unaffected.
+void launchpad_template_destroy(launchpad_template_t* tmpl);
+
 
 // ADDING ARGUMENTS, ENVIRONMENT, AND HANDLES
 // These functions setup arguments, environment, or handles to be
@@ -252,6 +285,11 @@ mx_status_t launchpad_elf_load_basic(launchpad_t* lp, mx_handle_t vmo);
 // bootstrap message.
 mx_status_t launchpad_elf_load(launchpad_t* lp, mx_handle_t vmo);
 
+// Load the ELF file image of a template, as per launchpad_elf_load.
+// The template is not consumed.
+mx_status_t launchpad_elf_load_template(launchpad_t* lp,
+                                        const launchpad_template_t* tmpl);
+
 // Load an extra ELF file image into the process.  This is similar
 // to launchpad_elf_load_basic, but it does not consume the VM
 // object handle, does affect the state of the launchpad's
@@ -355,7 +355,7 @@ mx_status_t launchpad_add_pipe(launchpad_t* lp, int* fd_out, int target_fd) {
     return MX_OK;
 }
 
-static void check_elf_stack_size(launchpad_t* lp, elf_load_info_t* elf) {
+static void check_elf_stack_size(launchpad_t* lp, const elf_load_info_t* elf) {
     size_t elf_stack_size = elf_load_get_stack_size(elf);
     if (elf_stack_size > 0)
         launchpad_set_stack_size(lp, elf_stack_size);
@@ -520,19 +520,12 @@ static mx_status_t reserve_low_address_space(launchpad_t* lp) {
     return MX_OK;
 }
 
-// Consumes 'vmo' on success, not on failure.
-static mx_status_t handle_interp(launchpad_t* lp, mx_handle_t vmo,
-                                 const char* interp, size_t interp_len) {
-    mx_status_t status = setup_loader_svc(lp);
-    if (status != MX_OK)
-        return status;
-
-    mx_handle_t interp_vmo = loader_svc_rpc(
-        lp->special_handles[HND_LOADER_SVC], LOADER_SVC_OP_LOAD_OBJECT,
-        interp, interp_len);
-    if (interp_vmo < 0)
-        return interp_vmo;
-
+// Maps in the dynamic linker, already looked at, for the executable
+// in 'vmo'.  Consumes 'vmo' on success, not on failure.
+static mx_status_t load_interp(launchpad_t* lp, mx_handle_t vmo,
+                               mx_handle_t interp_vmo,
+                               const elf_load_info_t* interp_elf) {
+    mx_status_t status;
     if (lp->fresh_process) {
         // A fresh process using PT_INTERP might be loading a libc.so that
         // supports sanitizers, so in that case (the most common case)
@@ -542,16 +535,9 @@ static mx_status_t handle_interp(launchpad_t* lp, mx_handle_t vmo,
             return status;
     }
 
-    elf_load_info_t* elf;
     mx_handle_t segments_vmar;
-    status = elf_load_start(interp_vmo, NULL, 0, &elf);
-    if (status == MX_OK) {
-        status = elf_load_finish(lp_vmar(lp), elf, interp_vmo,
-                                 &segments_vmar, &lp->base, &lp->entry);
-        elf_load_destroy(elf);
-    }
-    mx_handle_close(interp_vmo);
-
+    status = elf_load_finish(lp_vmar(lp), interp_elf, interp_vmo,
+                             &segments_vmar, &lp->base, &lp->entry);
     if (status == MX_OK) {
         if (lp->special_handles[HND_EXEC_VMO] != MX_HANDLE_INVALID)
             mx_handle_close(lp->special_handles[HND_EXEC_VMO]);
@@ -565,6 +551,47 @@ static mx_status_t handle_interp(launchpad_t* lp, mx_handle_t vmo,
     return status;
 }
 
+// Consumes 'vmo' on success, not on failure.
+static mx_status_t handle_interp(launchpad_t* lp, mx_handle_t vmo,
+                                 const char* interp, size_t interp_len) {
+    mx_status_t status = setup_loader_svc(lp);
+    if (status != MX_OK)
+        return status;
+
+    mx_handle_t interp_vmo = loader_svc_rpc(
+        lp->special_handles[HND_LOADER_SVC], LOADER_SVC_OP_LOAD_OBJECT,
+        interp, interp_len);
+    if (interp_vmo < 0)
+        return interp_vmo;
+
+    elf_load_info_t* elf;
+    status = elf_load_start(interp_vmo, NULL, 0, &elf);
+    if (status == MX_OK) {
+        elf_load_prefault(elf);
+        status = load_interp(lp, vmo, interp_vmo, elf);
+        elf_load_destroy(elf);
+    }
+    mx_handle_close(interp_vmo);
+    return status;
+}
+
+// Maps in an executable with no PT_INTERP.  Does not consume 'vmo'.
+static mx_status_t load_static(launchpad_t* lp, mx_handle_t vmo,
+                               const elf_load_info_t* elf) {
+    mx_handle_t segments_vmar;
+    mx_status_t status = elf_load_finish(lp_vmar(lp), elf, vmo, &segments_vmar,
+                                         &lp->base, &lp->entry);
+    if (status != MX_OK)
+        return lp_error(lp, status, "elf_load: elf_load_finish() failed");
+
+    // With no PT_INTERP, we obey PT_GNU_STACK.p_memsz for the stack size
+    // setting.  With PT_INTERP, the dynamic linker is responsible for that.
+    check_elf_stack_size(lp, elf);
+    lp->loader_message = false;
+    launchpad_add_handle(lp, segments_vmar, PA_HND(PA_VMAR_LOADED, 0));
+    return MX_OK;
+}
+
 static mx_status_t launchpad_elf_load_body(launchpad_t* lp, const char* hdr_buf,
                                            size_t buf_sz, mx_handle_t vmo) {
     elf_load_info_t* elf;
@@ -582,21 +609,7 @@ static mx_status_t launchpad_elf_load_body(launchpad_t* lp, const char* hdr_buf,
             lp_error(lp, status, "elf_load: get_interp() failed");
         } else {
             if (interp == NULL) {
-                mx_handle_t segments_vmar;
-                status = elf_load_finish(lp_vmar(lp), elf, vmo, &segments_vmar,
-                                         &lp->base, &lp->entry);
-                if (status != MX_OK) {
-                    lp_error(lp, status, "elf_load: elf_load_finish() failed");
-                } else {
-                    // With no PT_INTERP, we obey PT_GNU_STACK.p_memsz for
-                    // the stack size setting.  With PT_INTERP, the dynamic
-                    // linker is responsible for that.
-                    check_elf_stack_size(lp, elf);
-                    lp->loader_message = false;
-                    launchpad_add_handle(
-                        lp, segments_vmar,
-                        PA_HND(PA_VMAR_LOADED, 0));
-                }
+                load_static(lp, vmo, elf);
             } else {
                 if ((status = handle_interp(lp, vmo, interp, interp_len))) {
                     lp_error(lp, status, "elf_load: handle_interp failed");
@@ -770,7 +783,106 @@ mx_status_t launchpad_elf_load(launchpad_t* lp, mx_handle_t vmo) {
     return launchpad_elf_load_body(lp, NULL, 0, vmo);
 }
 
+struct launchpad_template {
+    // the executable, and its headers
+    mx_handle_t vmo;
+    elf_load_info_t* elf;
+    // with PT_INTERP, the dynamic linker for it, and its headers
+    mx_handle_t interp_vmo;
+    elf_load_info_t* interp_elf;
+};
+
+void launchpad_template_destroy(launchpad_template_t* tmpl) {
+    if (tmpl->interp_vmo != MX_HANDLE_INVALID)
+        mx_handle_close(tmpl->interp_vmo);
+    elf_load_destroy(tmpl->interp_elf);
+    mx_handle_close(tmpl->vmo);
+    elf_load_destroy(tmpl->elf);
+    free(tmpl);
+}
+
+static mx_status_t template_load_interp(launchpad_template_t* tmpl,
+                                        mx_handle_t loader_svc,
+                                        const char* interp, size_t interp_len) {
+    mx_handle_t svc = loader_svc;
+    if (svc == MX_HANDLE_INVALID) {
+        svc = mxio_loader_service(NULL, NULL);
+        if (svc < 0)
+            return svc;
+    }
+    mx_handle_t vmo = loader_svc_rpc(svc, LOADER_SVC_OP_LOAD_OBJECT,
+                                     interp, interp_len);
+    if (svc != loader_svc)
+        mx_handle_close(svc);
+    if (vmo < 0)
+        return vmo;
+    tmpl->interp_vmo = vmo;
+    mx_status_t status = elf_load_start(vmo, NULL, 0, &tmpl->interp_elf);
+    if (status == MX_OK)
+        elf_load_prefault(tmpl->interp_elf);
+    return status;
+}
+
+mx_status_t launchpad_template_create(mx_handle_t vmo,
+                                      mx_handle_t loader_svc,
+                                      launchpad_template_t** result) {
+    if (vmo < 0)
+        return vmo;
+    if (vmo == MX_HANDLE_INVALID)
+        return MX_ERR_INVALID_ARGS;
+
+    launchpad_template_t* tmpl = calloc(1, sizeof(*tmpl));
+    if (tmpl == NULL) {
+        mx_handle_close(vmo);
+        return MX_ERR_NO_MEMORY;
+    }
+    tmpl->vmo = vmo;
+    tmpl->interp_vmo = MX_HANDLE_INVALID;
+
+    char* interp = NULL;
+    size_t interp_len;
+    mx_status_t status = elf_load_start(vmo, NULL, 0, &tmpl->elf);
+    if (status == MX_OK)
+        status = elf_load_get_interp(tmpl->elf, vmo, &interp, &interp_len);
+    if (status == MX_OK && interp != NULL)
+        status = template_load_interp(tmpl, loader_svc, interp, interp_len);
+    free(interp);
+
+    if (status != MX_OK) {
+        launchpad_template_destroy(tmpl);
+        return status;
+    }
+    *result = tmpl;
+    return MX_OK;
+}
+
+mx_status_t launchpad_elf_load_template(launchpad_t* lp,
+                                        const launchpad_template_t* tmpl) {
+    if (lp->error)
+        return lp->error;
+    if (tmpl->interp_vmo == MX_HANDLE_INVALID)
+        return load_static(lp, tmpl->vmo, tmpl->elf);
+
+    // The new process still gets a loader service of its own, and the
+    // executable to hand its dynamic linker.
+    mx_status_t status = setup_loader_svc(lp);
+    if (status != MX_OK)
+        return lp_error(lp, status, "elf_load_template: setup_loader_svc() failed");
+    mx_handle_t vmo;
+    status = mx_handle_duplicate(tmpl->vmo, MX_RIGHT_SAME_RIGHTS, &vmo);
+    if (status != MX_OK)
+        return lp_error(lp, status, "elf_load_template: mx_handle_duplicate() failed");
+    status = load_interp(lp, vmo, tmpl->interp_vmo, tmpl->interp_elf);
+    if (status != MX_OK) {
+        mx_handle_close(vmo);
+        return lp_error(lp, status, "elf_load_template: load_interp() failed");
+    }
+    return MX_OK;
+}
+
 static mx_handle_t vdso_vmo = MX_HANDLE_INVALID;
+// the headers of vdso_vmo, once it has been loaded
+static elf_load_info_t* vdso_elf;
 static mtx_t vdso_mutex = MTX_INIT;
 static void vdso_lock(void) {
     mtx_lock(&vdso_mutex);
@@ -801,6 +913,8 @@ mx_handle_t launchpad_set_vdso_vmo(mx_handle_t new_vdso_vmo) {
     vdso_lock();
     mx_handle_t old = vdso_vmo;
     vdso_vmo = new_vdso_vmo;
+    elf_load_destroy(vdso_elf);
+    vdso_elf = NULL;
     vdso_unlock();
     return old;
 }
@@ -821,12 +935,25 @@ mx_status_t launchpad_add_vdso_vmo(launchpad_t* lp) {
 mx_status_t launchpad_load_vdso(launchpad_t* lp, mx_handle_t vmo) {
     if (vmo != MX_HANDLE_INVALID)
         return launchpad_elf_load_extra(lp, vmo, &lp->vdso_base, NULL);
+    if (lp->error)
+        return lp->error;
+
+    // Every process gets the same vDSO, so its headers are only read
+    // the first time.
     vdso_lock();
     vmo = vdso_get_vmo();
-    mx_status_t status = launchpad_elf_load_extra(lp, vmo,
-                                                  &lp->vdso_base, NULL);
+    mx_status_t status = MX_OK;
+    if (vmo < 0)
+        status = vmo;
+    else if (vdso_elf == NULL && (status = elf_load_start(vmo, NULL, 0, &vdso_elf)) == MX_OK)
+        elf_load_prefault(vdso_elf);
+    if (status == MX_OK)
+        status = elf_load_finish(lp_vmar(lp), vdso_elf, vmo, NULL,
+                                 &lp->vdso_base, NULL);
     vdso_unlock();
-    return status;
+    if (status != MX_OK)
+        return lp_error(lp, status, "load_vdso: failed to load the vDSO");
+    return MX_OK;
 }
 
 mx_status_t launchpad_get_entry_address(launchpad_t* lp, mx_vaddr_t* entry) {
@@ -1285,3 +1412,10 @@ mx_status_t launchpad_load_from_fd(launchpad_t* lp, int fd) {
 mx_status_t launchpad_load_from_vmo(launchpad_t* lp, mx_handle_t vmo) {
     return launchpad_file_load_with_vdso(lp, vmo);
 }
+
+mx_status_t launchpad_load_from_template(launchpad_t* lp,
+                                         const launchpad_template_t* tmpl) {
+    launchpad_elf_load_template(lp, tmpl);
+    launchpad_load_vdso(lp, MX_HANDLE_INVALID);
+    return launchpad_add_vdso_vmo(lp);
+}
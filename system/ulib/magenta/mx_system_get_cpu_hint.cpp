@@ -0,0 +1,32 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <magenta/syscalls.h>
+
+#include "private.h"
+
+uint32_t _mx_system_get_cpu_hint(void) {
+#if __aarch64__
+    // Nothing per-cpu is readable from EL0 without a trap.
+    return UINT32_MAX;
+#elif __x86_64__
+    // The kernel puts each cpu's number in its TSC_AUX.
+    uint32_t ticks_low;
+    uint32_t ticks_high;
+    uint32_t aux;
+    __asm__ volatile("rdtscp" : "=a" (ticks_low), "=d" (ticks_high), "=c" (aux));
+    return aux;
+#else
+#error Unsupported architecture
+#endif
+}
+
+VDSO_INTERFACE_FUNCTION(mx_system_get_cpu_hint);
+
+// At boot time the kernel can decide to redirect the
+// {_,}mx_system_get_cpu_hint dynamic symbol table entries to point to
+// this instead.  See VDso::VDso.
+VDSO_KERNEL_EXPORT uint32_t CODE_soft_cpu_hint(void) {
+    return UINT32_MAX;
+}
@@ -0,0 +1,26 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <magenta/syscalls.h>
+
+#include <magenta/compiler.h>
+#include "private.h"
+
+mx_time_t _mx_time_get(uint32_t clock_id) {
+    switch (clock_id) {
+    case MX_CLOCK_MONOTONIC:
+    case MX_CLOCK_UTC:
+        if (likely(DATA_CLOCK.user_clock)) {
+            mx_time_t now = u64_mul_u64_fp32_64(VDSO_mx_ticks_get(),
+                                                DATA_CLOCK.ns_per_tick);
+            if (clock_id == MX_CLOCK_UTC)
+                now += __atomic_load_n(&DATA_CLOCK.utc_offset, __ATOMIC_RELAXED);
+            return now;
+        }
+        break;
+    }
+    return SYSCALL_mx_time_get_via_kernel(clock_id);
+}
+
+VDSO_INTERFACE_FUNCTION(mx_time_get);
@@ -7,11 +7,15 @@
 #include <magenta/compiler.h>
 #include <magenta/syscalls.h>
 
-// This defines the struct shared with the kernel.
+// This defines the structs shared with the kernel.
+#include <lib/vdso-clock.h>
 #include <lib/vdso-constants.h>
 
 extern __LOCAL const struct vdso_constants DATA_CONSTANTS;
 
+// The kernel updates parts of this as the system runs, see vdso-clock.h.
+extern __LOCAL const struct vdso_clock DATA_CLOCK;
+
 extern "C" {
 
 // This declares the VDSO_mx_* aliases for the vDSO entry points.
@@ -20,6 +24,7 @@ extern "C" {
 #include <magenta/syscall-vdso-definitions.h>
 
 __LOCAL decltype(mx_ticks_get) CODE_soft_ticks_get;
+__LOCAL decltype(mx_system_get_cpu_hint) CODE_soft_cpu_hint;
 
 };
 
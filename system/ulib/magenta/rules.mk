@@ -11,7 +11,7 @@ MODULE_TYPE := userlib
 # This library should not depend on libc.
 MODULE_COMPILEFLAGS := -ffreestanding $(NO_SAFESTACK)
 
-MODULE_HEADER_DEPS := kernel/lib/vdso
+MODULE_HEADER_DEPS := kernel/lib/vdso kernel/lib/fixed_point
 
 MODULE_SRCS := \
     $(LOCAL_DIR)/data.S \
@@ -19,11 +19,13 @@ MODULE_SRCS := \
     $(LOCAL_DIR)/mx_channel_call.cpp \
     $(LOCAL_DIR)/mx_deadline_after.cpp \
     $(LOCAL_DIR)/mx_status_get_string.cpp \
+    $(LOCAL_DIR)/mx_system_get_cpu_hint.cpp \
     $(LOCAL_DIR)/mx_system_get_num_cpus.cpp \
     $(LOCAL_DIR)/mx_system_get_physmem.cpp \
     $(LOCAL_DIR)/mx_system_get_version.cpp \
     $(LOCAL_DIR)/mx_ticks_get.cpp \
     $(LOCAL_DIR)/mx_ticks_per_second.cpp \
+    $(LOCAL_DIR)/mx_time_get.cpp \
     $(LOCAL_DIR)/syscall-wrappers.cpp \
 
 ifeq ($(ARCH),arm64)
@@ -78,6 +78,10 @@ public:
         return mx_object_wait_many(wait_items, count, deadline);
     }
 
+    static mx_status_t signal_many(mx_signal_item_t* signal_items, uint32_t count) {
+        return mx_object_signal_many(signal_items, count);
+    }
+
     // TODO(abarth): Not all of these methods apply to every type of object. We
     // should sort out which ones apply where and limit them to the interfaces
     // where they work.
@@ -0,0 +1,347 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <threads.h>
+
+#include <magenta/device/vfs.h>
+#include <magenta/syscalls.h>
+#include <magenta/syscalls/port.h>
+#include <mxio/io.h>
+#include <mxio/private.h>
+
+#include "private.h"
+#include "unistd.h"
+
+// The attribute cache keeps the results of stat()s, including the paths
+// found not to exist, by their cleaned absolute path.
+//
+// An entry lasts at most the lease.  It goes sooner if this process changes
+// the filesystem, which bumps |gen|, or if its parent directory reports a name
+// added or removed, which bumps that directory's |gen|.  Only paths whose
+// parent directory could be watched are kept at all.  The table is direct
+// mapped: an entry simply replaces whatever shared its slot.
+
+#define ATTR_CACHE_ENTRIES 512
+#define ATTR_CACHE_DIRS    64
+
+typedef struct attr_entry {
+    char key[MXIO_ATTR_KEY_MAX];
+    mx_time_t expires;
+    uint32_t gen;
+    uint32_t dir;
+    uint32_t dir_gen;
+    mx_status_t status;
+    struct stat st;
+} attr_entry_t;
+
+typedef struct attr_dir {
+    char path[MXIO_ATTR_KEY_MAX];
+    mx_handle_t watch;
+    uint32_t gen;
+} attr_dir_t;
+
+static mtx_t attr_lock = MTX_INIT;
+static mx_time_t attr_lease;
+static mx_handle_t attr_port = MX_HANDLE_INVALID;
+static attr_entry_t* attr_entries;
+static attr_dir_t attr_dirs[ATTR_CACHE_DIRS];
+
+// Read without the lock by every change this process makes to the filesystem,
+// so that they cost nothing while the cache is off.
+static atomic_bool attr_enabled;
+static atomic_uint attr_gen;
+
+static uint32_t attr_hash(const char* key) {
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    for (; *key; key++) {
+        h = (h ^ (uint8_t)*key) * 16777619u;
+    }
+    return h;
+}
+
+static void attr_dir_close_locked(attr_dir_t* dir) {
+    if (dir->watch != MX_HANDLE_INVALID) {
+        mx_handle_close(dir->watch);
+        dir->watch = MX_HANDLE_INVALID;
+    }
+    dir->path[0] = 0;
+    dir->gen++;
+}
+
+// Applies any watch events which have come in since the last look.
+static void attr_poll_locked(void) {
+    mx_port_packet_t packet;
+    while (mx_port_wait(attr_port, 0, &packet, sizeof(packet)) == MX_OK) {
+        if (packet.key >= ATTR_CACHE_DIRS) {
+            continue;
+        }
+        attr_dir_t* dir = &attr_dirs[packet.key];
+        if (dir->watch == MX_HANDLE_INVALID) {
+            continue;
+        }
+        dir->gen++;
+
+        // Which names changed doesn't matter, only that some did
+        uint8_t msg[VFS_WATCH_MSG_MAX];
+        uint32_t actual;
+        while (mx_channel_read(dir->watch, 0, msg, NULL, sizeof(msg), 0,
+                               &actual, NULL) == MX_OK) {
+        }
+        if ((packet.signal.observed & MX_CHANNEL_PEER_CLOSED) ||
+            (mx_object_wait_async(dir->watch, attr_port, packet.key,
+                                  MX_CHANNEL_READABLE | MX_CHANNEL_PEER_CLOSED,
+                                  MX_WAIT_ASYNC_ONCE) != MX_OK)) {
+            attr_dir_close_locked(dir);
+        }
+    }
+}
+
+// Starts watching |path| for names added and removed, returning the channel
+// the events arrive on.
+static mx_status_t attr_watch(const char* path, mx_handle_t* out) {
+    mxio_t* io;
+    mx_status_t status;
+    if ((status = __mxio_open(&io, path, O_RDONLY | O_DIRECTORY, 0)) < 0) {
+        return status;
+    }
+    mx_handle_t h[2];
+    if ((status = mx_channel_create(0, &h[0], &h[1])) < 0) {
+        mxio_close(io);
+        mxio_release(io);
+        return status;
+    }
+    vfs_watch_dir_t wd = {
+        .channel = h[1],
+        .mask = VFS_WATCH_MASK_ADDED | VFS_WATCH_MASK_REMOVED,
+        .options = 0,
+    };
+    status = io->ops->ioctl(io, IOCTL_VFS_WATCH_DIR_V2, &wd, sizeof(wd), NULL, 0);
+    mxio_close(io);
+    mxio_release(io);
+    if (status < 0) {
+        mx_handle_close(h[0]);
+        return status;
+    }
+    *out = h[0];
+    return MX_OK;
+}
+
+// Finds the directory slot watching |path|, setting one up if there is none.
+// Returns false if the directory can't be watched.  Called with the lock
+// held, which is let go while the watch is set up.
+static bool attr_dir_get_locked(const char* path, uint32_t* out) {
+    for (uint32_t i = 0; i < ATTR_CACHE_DIRS; i++) {
+        if (!strcmp(attr_dirs[i].path, path)) {
+            *out = i;
+            return attr_dirs[i].watch != MX_HANDLE_INVALID;
+        }
+    }
+
+    mtx_unlock(&attr_lock);
+    mx_handle_t watch = MX_HANDLE_INVALID;
+    mx_status_t status = attr_watch(path, &watch);
+    mtx_lock(&attr_lock);
+    if (attr_lease == 0) {
+        // Turned off meanwhile
+        if (watch != MX_HANDLE_INVALID) {
+            mx_handle_close(watch);
+        }
+        return false;
+    }
+
+    // Directories which can't be watched take a slot too, so that they
+    // aren't tried again on every stat.  If every slot is taken, they
+    // make way for one another in turn.
+    uint32_t slot = ATTR_CACHE_DIRS;
+    for (uint32_t i = 0; i < ATTR_CACHE_DIRS; i++) {
+        if (!strcmp(attr_dirs[i].path, path)) {
+            // Another thread got here first
+            if (watch != MX_HANDLE_INVALID) {
+                mx_handle_close(watch);
+            }
+            *out = i;
+            return attr_dirs[i].watch != MX_HANDLE_INVALID;
+        }
+        if ((slot == ATTR_CACHE_DIRS) && (attr_dirs[i].path[0] == 0)) {
+            slot = i;
+        }
+    }
+    if (slot == ATTR_CACHE_DIRS) {
+        static uint32_t next_victim;
+        slot = next_victim++ % ATTR_CACHE_DIRS;
+        attr_dir_close_locked(&attr_dirs[slot]);
+    }
+    attr_dir_t* dir = &attr_dirs[slot];
+    strcpy(dir->path, path);
+    dir->gen++;
+    if ((status == MX_OK) &&
+        (mx_object_wait_async(watch, attr_port, slot,
+                              MX_CHANNEL_READABLE | MX_CHANNEL_PEER_CLOSED,
+                              MX_WAIT_ASYNC_ONCE) == MX_OK)) {
+        dir->watch = watch;
+    } else if (watch != MX_HANDLE_INVALID) {
+        mx_handle_close(watch);
+    }
+    *out = slot;
+    return dir->watch != MX_HANDLE_INVALID;
+}
+
+// Fills in the absolute, cleaned path |path| names, if it's one which can be
+// cached.
+static bool attr_key(int dirfd, const char* path, char* key) {
+    char tmp[PATH_MAX];
+    if ((path == NULL) || (path[0] == 0)) {
+        return false;
+    }
+    size_t len = strlen(path);
+    if (path[0] == '/') {
+        if (len >= sizeof(tmp)) {
+            return false;
+        }
+        memcpy(tmp, path, len + 1);
+    } else if (dirfd == AT_FDCWD) {
+        mtx_lock(&mxio_cwd_lock);
+        size_t cwd_len = strlen(mxio_cwd_path);
+        if (cwd_len + 1 + len >= sizeof(tmp)) {
+            mtx_unlock(&mxio_cwd_lock);
+            return false;
+        }
+        memcpy(tmp, mxio_cwd_path, cwd_len);
+        mtx_unlock(&mxio_cwd_lock);
+        tmp[cwd_len] = '/';
+        memcpy(tmp + cwd_len + 1, path, len + 1);
+    } else {
+        return false;
+    }
+
+    char clean[PATH_MAX];
+    size_t outlen;
+    bool is_dir;
+    // Paths which must name directories ("a/", "a/.") are left to the server
+    if ((__mxio_cleanpath(tmp, clean, &outlen, &is_dir) != MX_OK) || is_dir ||
+        (outlen >= MXIO_ATTR_KEY_MAX) || (outlen < 2) || (clean[0] != '/')) {
+        return false;
+    }
+    memcpy(key, clean, outlen + 1);
+    return true;
+}
+
+mx_status_t mxio_attr_cache_enable(mx_time_t lease) {
+    mtx_lock(&attr_lock);
+    if ((lease != 0) && (attr_entries == NULL)) {
+        mx_status_t status;
+        if ((status = mx_port_create(MX_PORT_OPT_V2, &attr_port)) < 0) {
+            mtx_unlock(&attr_lock);
+            return status;
+        }
+        if ((attr_entries = calloc(ATTR_CACHE_ENTRIES, sizeof(attr_entry_t))) == NULL) {
+            mx_handle_close(attr_port);
+            attr_port = MX_HANDLE_INVALID;
+            mtx_unlock(&attr_lock);
+            return MX_ERR_NO_MEMORY;
+        }
+    } else if ((lease == 0) && (attr_entries != NULL)) {
+        for (uint32_t i = 0; i < ATTR_CACHE_DIRS; i++) {
+            attr_dir_close_locked(&attr_dirs[i]);
+        }
+        mx_handle_close(attr_port);
+        attr_port = MX_HANDLE_INVALID;
+        free(attr_entries);
+        attr_entries = NULL;
+    }
+    attr_lease = lease;
+    atomic_fetch_add(&attr_gen, 1);
+    atomic_store(&attr_enabled, lease != 0);
+    mtx_unlock(&attr_lock);
+    return MX_OK;
+}
+
+bool __mxio_attr_cache_lookup(int dirfd, const char* path, mxio_attr_ticket_t* ticket,
+                              struct stat* s, mx_status_t* status) {
+    ticket->valid = false;
+    if (!atomic_load(&attr_enabled) || !attr_key(dirfd, path, ticket->key)) {
+        return false;
+    }
+
+    mtx_lock(&attr_lock);
+    if (attr_entries == NULL) {
+        mtx_unlock(&attr_lock);
+        return false;
+    }
+    attr_poll_locked();
+
+    attr_entry_t* e = &attr_entries[attr_hash(ticket->key) % ATTR_CACHE_ENTRIES];
+    if (!strcmp(e->key, ticket->key) && (e->gen == atomic_load(&attr_gen)) &&
+        (e->dir_gen == attr_dirs[e->dir].gen) && (mx_time_get(MX_CLOCK_MONOTONIC) < e->expires)) {
+        if (s != NULL) {
+            *s = e->st;
+        }
+        *status = e->status;
+        mtx_unlock(&attr_lock);
+        return true;
+    }
+
+    // Watch the parent before asking the server, so that a change made
+    // between the answer and the insert isn't missed
+    char parent[MXIO_ATTR_KEY_MAX];
+    strcpy(parent, ticket->key);
+    char* slash = strrchr(parent, '/');
+    if (slash == parent) {
+        slash[1] = 0;
+    } else {
+        slash[0] = 0;
+    }
+    ticket->gen = atomic_load(&attr_gen);
+    if (attr_dir_get_locked(parent, &ticket->dir)) {
+        ticket->dir_gen = attr_dirs[ticket->dir].gen;
+        ticket->valid = true;
+    }
+    mtx_unlock(&attr_lock);
+    return false;
+}
+
+void __mxio_attr_cache_insert(const mxio_attr_ticket_t* ticket,
+                              const struct stat* s, mx_status_t status) {
+    if (!ticket->valid || ((status != MX_OK) && (status != MX_ERR_NOT_FOUND))) {
+        return;
+    }
+
+    mtx_lock(&attr_lock);
+    if (attr_entries == NULL) {
+        mtx_unlock(&attr_lock);
+        return;
+    }
+    attr_poll_locked();
+
+    // Anything since the lookup may have made the answer stale
+    if ((ticket->gen == atomic_load(&attr_gen)) &&
+        (ticket->dir_gen == attr_dirs[ticket->dir].gen)) {
+        attr_entry_t* e = &attr_entries[attr_hash(ticket->key) % ATTR_CACHE_ENTRIES];
+        strcpy(e->key, ticket->key);
+        e->expires = mx_time_get(MX_CLOCK_MONOTONIC) + attr_lease;
+        e->gen = ticket->gen;
+        e->dir = ticket->dir;
+        e->dir_gen = ticket->dir_gen;
+        e->status = status;
+        if (status == MX_OK) {
+            e->st = *s;
+        } else {
+            memset(&e->st, 0, sizeof(e->st));
+        }
+    }
+    mtx_unlock(&attr_lock);
+}
+
+void __mxio_attr_cache_invalidate(void) {
+    if (atomic_load(&attr_enabled)) {
+        atomic_fetch_add(&attr_gen, 1);
+    }
+}
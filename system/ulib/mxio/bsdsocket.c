@@ -10,6 +10,7 @@
 #include <string.h>
 #include <sys/epoll.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <threads.h>
 #include <unistd.h>
 
@@ -541,6 +542,72 @@ ssize_t recv(int fd, void* buf, size_t len, int flags) {
     return r;
 }
 
+// Each message goes as if by its own sendmsg(), until one fails. That
+// failure is only reported if it was the first; otherwise the count of
+// those sent is, and the next call finds the error again.
+int sendmmsg(int fd, struct mmsghdr* msgvec, unsigned int vlen, unsigned int flags) {
+    mxio_t* io = fd_to_io(fd);
+    if (io == NULL) {
+        return ERRNO(EBADF);
+    }
+    if (vlen > UIO_MAXIOV) {
+        vlen = UIO_MAXIOV;
+    }
+    unsigned int i;
+    for (i = 0; i < vlen; i++) {
+        ssize_t r = mxio_sendmsg(io, &msgvec[i].msg_hdr, flags);
+        if (r < 0) {
+            break;
+        }
+        msgvec[i].msg_len = r;
+    }
+    mxio_release(io);
+    return (i > 0) ? (int)i : -1;
+}
+
+// As with sendmmsg(), a failure after the first message ends the batch
+// short. With MSG_WAITFORONE only the first may wait. |timeout| is only
+// looked at after each message, as on other systems, so a batch can
+// still wait forever for its first.
+int recvmmsg(int fd, struct mmsghdr* msgvec, unsigned int vlen, unsigned int flags,
+             struct timespec* timeout) {
+    mxio_t* io = fd_to_io(fd);
+    if (io == NULL) {
+        return ERRNO(EBADF);
+    }
+    mx_time_t deadline = 0;
+    if (timeout != NULL) {
+        if (timeout->tv_sec < 0 || timeout->tv_nsec < 0 || timeout->tv_nsec >= 1000000000) {
+            mxio_release(io);
+            return ERRNO(EINVAL);
+        }
+        deadline = mx_time_get(MX_CLOCK_MONOTONIC) +
+                   MX_SEC(timeout->tv_sec) + timeout->tv_nsec;
+    }
+    if (vlen > UIO_MAXIOV) {
+        vlen = UIO_MAXIOV;
+    }
+    bool wait_for_one = flags & MSG_WAITFORONE;
+    flags &= ~MSG_WAITFORONE;
+    unsigned int i;
+    for (i = 0; i < vlen; i++) {
+        ssize_t r = mxio_recvmsg(io, &msgvec[i].msg_hdr, flags);
+        if (r < 0) {
+            break;
+        }
+        msgvec[i].msg_len = r;
+        if (wait_for_one) {
+            flags |= MSG_DONTWAIT;
+        }
+        if (timeout != NULL && mx_time_get(MX_CLOCK_MONOTONIC) >= deadline) {
+            i++;
+            break;
+        }
+    }
+    mxio_release(io);
+    return (i > 0) ? (int)i : -1;
+}
+
 int shutdown(int fd, int how) {
     mxio_t* io;
     if ((io = fd_to_io(fd)) == NULL) {
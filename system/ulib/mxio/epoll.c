@@ -20,52 +20,149 @@
 // TODO: should use a system default
 #define MAX_WAIT_EVENTS 1024
 
+// How many port packets to take at once.
+#define PACKET_BATCH 16
+
+// Readiness is delivered through a v2 port. Every registered fd gets one
+// async wait on the port when it is added, so epoll_wait() only ever looks
+// at the fds that have signaled, however many are registered. A packet only
+// says which fd to look at: its state is read again before it is reported,
+// since it may have changed since the packet was queued.
+
 typedef struct mxio_epoll_cookie {
+    // In mxio_epoll_t.ready while the fd may be ready.
     list_node_t node;
     mxio_t* io;
     struct epoll_event ep_event;
+    mx_handle_t h;
+    mx_signals_t signals;
+    // Tells packets for this registration apart from ones left over from an
+    // earlier registration of the same fd.
+    uint32_t gen;
     int fd;
 } mxio_epoll_cookie_t;
 
 typedef struct mxio_epoll {
     mxio_t io;
     mx_handle_t h;
-    mtx_t cookies_lock;
-    list_node_t cookies;
+    mtx_t lock;
+    uint32_t gen;
+    list_node_t ready;
+    mxio_epoll_cookie_t* cookies[MAX_MXIO_FD];
 } mxio_epoll_t;
 
-static void mxio_epoll_cookie_add(mxio_epoll_t* epio,
-                                  mxio_epoll_cookie_t* cookie) {
-    mtx_lock(&epio->cookies_lock);
-    list_add_head(&epio->cookies, &cookie->node);
-    mtx_unlock(&epio->cookies_lock);
+static uint64_t mxio_epoll_key(const mxio_epoll_cookie_t* cookie) {
+    return ((uint64_t)cookie->gen << 32) | (uint32_t)cookie->fd;
+}
+
+// Called with the lock held.
+static mx_status_t mxio_epoll_add(mxio_epoll_t* epio, mxio_t* io, int fd,
+                                  const struct epoll_event* ep_event) {
+    mxio_epoll_cookie_t* cookie = calloc(1, sizeof(mxio_epoll_cookie_t));
+    if (cookie == NULL) {
+        return MX_ERR_NO_MEMORY;
+    }
+    io->ops->wait_begin(io, ep_event->events, &cookie->h, &cookie->signals);
+    if (cookie->h == MX_HANDLE_INVALID) {
+        // wait operation is not applicable to the handle
+        free(cookie);
+        return MX_ERR_INVALID_ARGS;
+    }
+    cookie->ep_event = *ep_event;
+    cookie->gen = ++epio->gen;
+    cookie->fd = fd;
+
+    // Oneshot fds are armed again by EPOLL_CTL_MOD, everything else stays
+    // armed for as long as it is registered.
+    uint32_t options = (ep_event->events & EPOLLONESHOT) ?
+        MX_WAIT_ASYNC_ONCE : MX_WAIT_ASYNC_REPEATING;
+    mx_status_t r = mx_object_wait_async(cookie->h, epio->h, mxio_epoll_key(cookie),
+                                         cookie->signals, options);
+    if (r < 0) {
+        free(cookie);
+        return r;
+    }
+
+    mxio_acquire(io);
+    cookie->io = io;
+    epio->cookies[fd] = cookie;
+    return MX_OK;
+}
+
+// Called with the lock held.
+static void mxio_epoll_remove(mxio_epoll_t* epio, mxio_epoll_cookie_t* cookie) {
+    // This fails once a oneshot wait has been delivered, which is fine.
+    mx_port_cancel(epio->h, cookie->h, mxio_epoll_key(cookie));
+    if (list_in_list(&cookie->node)) {
+        list_delete(&cookie->node);
+    }
+    epio->cookies[cookie->fd] = NULL;
+    mxio_release(cookie->io);
+    free(cookie);
 }
 
-static mxio_epoll_cookie_t* mxio_epoll_cookie_get(mxio_epoll_t* epio, int fd,
-                                                  bool remove) {
-    mxio_epoll_cookie_t* cookie = NULL;
-    mxio_epoll_cookie_t* entry = NULL;
-    mtx_lock(&epio->cookies_lock);
-    list_for_every_entry(&epio->cookies, entry, mxio_epoll_cookie_t, node) {
-        // doesn't have to be _safe as we break immediately after deletion
-        if (entry->fd == fd) {
-            if (remove) {
-                list_delete(&entry->node);
+// Moves the fds the port has packets for onto the ready list, waiting until
+// |deadline| for the first one.
+static mx_status_t mxio_epoll_drain(mxio_epoll_t* epio, mx_time_t deadline) {
+    mx_port_packet_t packets[PACKET_BATCH];
+    uint32_t count;
+    bool drained = false;
+    for (;;) {
+        mx_status_t r = mx_port_wait_many(epio->h, deadline, packets, PACKET_BATCH, &count);
+        if (r < 0) {
+            return (drained && r == MX_ERR_TIMED_OUT) ? MX_OK : r;
+        }
+        mtx_lock(&epio->lock);
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t fd = (uint32_t)packets[i].key;
+            uint32_t gen = (uint32_t)(packets[i].key >> 32);
+            mxio_epoll_cookie_t* cookie = (fd < MAX_MXIO_FD) ? epio->cookies[fd] : NULL;
+            if (cookie != NULL && cookie->gen == gen && !list_in_list(&cookie->node)) {
+                list_add_tail(&epio->ready, &cookie->node);
             }
-            cookie = entry;
-            break;
         }
+        mtx_unlock(&epio->lock);
+        if (count < PACKET_BATCH) {
+            return MX_OK;
+        }
+        drained = true;
+        deadline = 0;
     }
-    mtx_unlock(&epio->cookies_lock);
-    return cookie;
 }
 
-static mxio_epoll_cookie_t* mxio_epoll_cookie_find(mxio_epoll_t* epio, int fd) {
-    return mxio_epoll_cookie_get(epio, fd, false);
-}
+// Reports up to |maxevents| of the fds on the ready list that are still
+// ready, dropping the ones that are not. Called with the lock held.
+static int mxio_epoll_collect(mxio_epoll_t* epio, struct epoll_event* ep_events,
+                              int maxevents) {
+    list_node_t reported = LIST_INITIAL_VALUE(reported);
+    mxio_epoll_cookie_t* cookie;
+    int n = 0;
+    while (n < maxevents &&
+           (cookie = list_remove_head_type(&epio->ready, mxio_epoll_cookie_t, node))) {
+        mx_signals_t pending = 0;
+        mx_object_wait_one(cookie->h, cookie->signals, 0u, &pending);
 
-static mxio_epoll_cookie_t* mxio_epoll_cookie_remove(mxio_epoll_t* epio, int fd) {
-    return mxio_epoll_cookie_get(epio, fd, true);
+        uint32_t events;
+        cookie->io->ops->wait_end(cookie->io, pending, &events);
+        // mask unrequested events except HUP/ERR
+        events &= cookie->ep_event.events | EPOLLHUP | EPOLLERR;
+        if (events == 0) {
+            continue;
+        }
+        ep_events[n].events = events;
+        ep_events[n].data = cookie->ep_event.data;
+        n++;
+
+        // Level triggered fds are looked at again next time, after the
+        // others. Edge triggered ones wait for another packet.
+        if (!(cookie->ep_event.events & (EPOLLET | EPOLLONESHOT))) {
+            list_add_tail(&reported, &cookie->node);
+        }
+    }
+    while ((cookie = list_remove_head_type(&reported, mxio_epoll_cookie_t, node))) {
+        list_add_tail(&epio->ready, &cookie->node);
+    }
+    return n;
 }
 
 static mx_status_t mxio_epoll_close(mxio_t* io) {
@@ -74,14 +171,17 @@ static mx_status_t mxio_epoll_close(mxio_t* io) {
     epio->h = MX_HANDLE_INVALID;
     mx_handle_close(h);
 
-    mxio_epoll_cookie_t* cookie;
-    mtx_lock(&epio->cookies_lock);
-    while ((cookie = list_remove_head_type(&epio->cookies, mxio_epoll_cookie_t,
-                                           node))) {
-        mxio_release(cookie->io);
-        free(cookie);
+    mtx_lock(&epio->lock);
+    for (int fd = 0; fd < MAX_MXIO_FD; fd++) {
+        mxio_epoll_cookie_t* cookie = epio->cookies[fd];
+        if (cookie != NULL) {
+            epio->cookies[fd] = NULL;
+            mxio_release(cookie->io);
+            free(cookie);
+        }
     }
-    mtx_unlock(&epio->cookies_lock);
+    list_initialize(&epio->ready);
+    mtx_unlock(&epio->lock);
     return MX_OK;
 }
 
@@ -113,15 +213,15 @@ static mxio_t* mxio_epoll_create(mx_handle_t h) {
     atomic_init(&epio->io.refcount, 1);
     epio->io.flags |= MXIO_FLAG_EPOLL;
     epio->h = h;
-    mtx_init(&epio->cookies_lock, mtx_plain);
-    list_initialize(&epio->cookies);
+    mtx_init(&epio->lock, mtx_plain);
+    list_initialize(&epio->ready);
     return &epio->io;
 }
 
 mx_status_t mxio_epoll(mxio_t** out) {
     mx_handle_t h;
     mx_status_t status;
-    if ((status = mx_waitset_create(0, &h)) < 0) {
+    if ((status = mx_port_create(MX_PORT_OPT_V2, &h)) < 0) {
         return status;
     }
     mxio_t* io;
@@ -176,68 +276,37 @@ int epoll_ctl(int epfd, int op, int fd, struct epoll_event* ep_event) {
         goto fail_no_io;
     }
 
-    mxio_epoll_cookie_t* cookie;
+    mtx_lock(&epio->lock);
+    mxio_epoll_cookie_t* cookie = epio->cookies[fd];
     switch (op) {
     case EPOLL_CTL_ADD:
-        if (mxio_epoll_cookie_find(epio, fd) != NULL)  {
+        if (cookie != NULL) {
             r = MX_ERR_ALREADY_EXISTS;
-            goto end;
+            break;
         }
-        // create a new cookie
-        cookie = calloc(1, sizeof(mxio_epoll_cookie_t));
+        r = mxio_epoll_add(epio, io, fd, ep_event);
+        break;
+    case EPOLL_CTL_MOD:
         if (cookie == NULL) {
-            r = MX_ERR_NO_MEMORY;
-            goto end;
+            r = MX_ERR_NOT_FOUND;
+            break;
         }
-        mxio_acquire(io);
-        cookie->io = io;
-        cookie->fd = fd;
+        mxio_epoll_remove(epio, cookie);
+        r = mxio_epoll_add(epio, io, fd, ep_event);
         break;
-    case EPOLL_CTL_MOD:
     case EPOLL_CTL_DEL:
-        // or retrieve an existing cookie and remove the current epoll event
-        cookie = mxio_epoll_cookie_remove(epio, fd);
         if (cookie == NULL) {
             r = MX_ERR_NOT_FOUND;
-            goto end;
-        }
-        if ((r = mx_waitset_remove(epio->h, (uint64_t)(uintptr_t)cookie)) < 0) {
-            mxio_epoll_cookie_add(epio, cookie);
-            goto end;
+            break;
         }
+        mxio_epoll_remove(epio, cookie);
         break;
     default:
         r = MX_ERR_INVALID_ARGS;
-        goto end;
-    }
-
-    if (op == EPOLL_CTL_DEL) {
-        // free the cookie
-        mxio_release(cookie->io);
-        free(cookie);
-    } else {
-        // or add a new epoll event and put the cookie into the list
-        mx_handle_t h = MX_HANDLE_INVALID;
-        mx_signals_t signals = 0;
-        io->ops->wait_begin(io, ep_event->events, &h, &signals);
-        if (h == MX_HANDLE_INVALID) {
-            // wait operation is not applicable to the handle
-            r = MX_ERR_INVALID_ARGS;
-            mxio_release(cookie->io);
-            free(cookie);
-            goto end;
-        }
-
-        cookie->ep_event = *ep_event;
-        if ((r = mx_waitset_add(epio->h, (uint64_t)(uintptr_t)cookie, h, signals)) < 0) {
-            mxio_release(cookie->io);
-            free(cookie);
-            goto end;
-        }
-        mxio_epoll_cookie_add(epio, cookie);
+        break;
     }
+    mtx_unlock(&epio->lock);
 
- end:
     mxio_release(io);
  fail_no_io:
     mxio_release(&epio->io);
@@ -265,29 +334,32 @@ int epoll_wait(int epfd, struct epoll_event* ep_events, int maxevents, int timeo
     }
     mxio_epoll_t* epio = (mxio_epoll_t*)io;
 
-    mx_status_t r;
-    uint32_t num_results = maxevents;
-    mx_waitset_result_t results[maxevents];
-    mx_time_t tmo = (timeout >= 0) ? mx_deadline_after(MX_MSEC(timeout)) : MX_TIME_INFINITE;
-
-    if ((r = mx_waitset_wait(epio->h, tmo, results, &num_results)) < 0) {
-        mxio_release(io);
-        return (r == MX_ERR_TIMED_OUT) ? 0 : ERROR(r);
-    }
+    mx_time_t deadline = (timeout >= 0) ? mx_deadline_after(MX_MSEC(timeout)) : MX_TIME_INFINITE;
+    int n;
+    for (;;) {
+        mtx_lock(&epio->lock);
+        bool idle = list_is_empty(&epio->ready);
+        mtx_unlock(&epio->lock);
+
+        // Only block if none of the fds seen so far can still be ready.
+        mx_status_t r = mxio_epoll_drain(epio, idle ? deadline : 0);
+        if (r < 0 && r != MX_ERR_TIMED_OUT) {
+            mxio_release(io);
+            return ERROR(r);
+        }
 
-    for (uint32_t i = 0; i < num_results; i++) {
-        mxio_epoll_cookie_t* cookie = (mxio_epoll_cookie_t*)(uintptr_t)results[i].cookie;
-        mxio_t* io = cookie->io;
-        uint32_t events;
+        mtx_lock(&epio->lock);
+        n = mxio_epoll_collect(epio, ep_events, maxevents);
+        mtx_unlock(&epio->lock);
 
-        io->ops->wait_end(io, results[i].observed, &events);
-        // mask unrequested events except HUP/ERR
-        ep_events[i].events = events & (cookie->ep_event.events | EPOLLHUP | EPOLLERR);
-
-        ep_events[i].data = cookie->ep_event.data;
+        // If nothing was ready after all the ready list is empty now, and
+        // the next time around waits for the deadline.
+        if (n > 0 || (idle && r == MX_ERR_TIMED_OUT)) {
+            break;
+        }
     }
     mxio_release(io);
-    return (int)num_results;
+    return n;
 }
 
 int epoll_pwait(int epfd, struct epoll_event* events, int maxevents, int timeout, const sigset_t* sigmask) {
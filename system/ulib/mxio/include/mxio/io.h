@@ -68,4 +68,13 @@ mx_status_t mxio_get_exact_vmo(int fd, mx_handle_t* out_vmo);
 // is closed.
 int mxio_vmo_fd(mx_handle_t vmo, uint64_t offset, uint64_t length);
 
+// Answer stat(), access() and opens of missing paths from a cache in this
+// process, rather than asking the filesystem every time.  Entries last at most
+// |lease| nanoseconds, and go sooner when this process changes the filesystem,
+// or when a name is added to or removed from the directory holding them.
+// Other processes' changes to a file's attributes (its size, say) are only
+// seen once the lease runs out, which is why the cache is opt-in. A lease of
+// zero turns it off.
+mx_status_t mxio_attr_cache_enable(mx_time_t lease);
+
 __END_CDECLS
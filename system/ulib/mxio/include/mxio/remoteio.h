@@ -50,7 +50,9 @@ __BEGIN_CDECLS
 #define MXRIO_SYNC         0x00000019
 #define MXRIO_LINK        (0x0000001a | MXRIO_ONE_HANDLE)
 #define MXRIO_MMAP         0x0000001b
-#define MXRIO_NUM_OPS      28
+#define MXRIO_READ_VMO    (0x0000001c | MXRIO_ONE_HANDLE)
+#define MXRIO_WRITE_VMO   (0x0000001d | MXRIO_ONE_HANDLE)
+#define MXRIO_NUM_OPS      30
 
 #define MXRIO_OP(n)        ((n) & 0x3FF) // opcode
 #define MXRIO_HC(n)        (((n) >> 8) & 3) // handle count
@@ -63,7 +65,8 @@ __BEGIN_CDECLS
     "read_at", "write_at", "truncate", "rename", \
     "connect", "bind", "listen", "getsockname", \
     "getpeername", "getsockopt", "setsockopt", "getaddrinfo", \
-    "setattr", "sync", "link", "mmap" }
+    "setattr", "sync", "link", "mmap", \
+    "read_vmo", "write_vmo" }
 
 const char* mxio_opname(uint32_t op);
 
@@ -154,6 +157,19 @@ typedef struct mxrio_mmap_data {
     int32_t flags;
 } mxrio_mmap_data_t;
 
+// Sent as the extra data of an OPEN reply by servers which accept
+// READ_VMO and WRITE_VMO, when the open asked for MXRIO_OFLAG_XFER.
+typedef struct mxrio_xfer_info {
+    uint32_t max_xfer;                 // largest transfer per message
+    uint32_t reserved;
+} mxrio_xfer_info_t;
+
+// The largest transfer a VMO op may carry
+#define MXRIO_XFER_MAX     (256 * 1024)
+
+// The arg2.off of a VMO op which uses, and moves, the seek offset
+#define MXRIO_OFF_CURRENT  (-1)
+
 static_assert(MXIO_CHUNK_SIZE >= PATH_MAX, "MXIO_CHUNK_SIZE must be large enough to contain paths");
 
 #define READDIR_CMD_NONE  0
@@ -164,6 +180,7 @@ static_assert(MXIO_CHUNK_SIZE >= PATH_MAX, "MXIO_CHUNK_SIZE must be large enough
 // in O_* flags
 #define MXRIO_OFLAG_MASK     0xF0000000
 #define MXRIO_OFLAG_PIPELINE 0x10000000
+#define MXRIO_OFLAG_XFER     0x20000000
 
 // - msg.datalen is the size of data sent or received and must be <= MXIO_CHUNK_SIZE
 // - msg.arg is the return code on replies
@@ -197,6 +214,15 @@ static_assert(MXIO_CHUNK_SIZE >= PATH_MAX, "MXIO_CHUNK_SIZE must be large enough
 // SYNC        0          0        0                 0           -               -
 // LINK        0          0        <name1>0<name2>0  0           -               -
 // MMAP        maxreply   0        mmap_data_msg     0           mmap_data_msg   vmohandle
+// READ_VMO    maxread    offset   -                 newoffset   -               -
+// WRITE_VMO   len        offset   -                 newoffset   -               -
+//
+// READ_VMO and WRITE_VMO carry a VMO as their one handle, and move up to
+// MXRIO_XFER_MAX bytes through the start of it in a single message, rather than MXIO_CHUNK_SIZE at a time in the
+// message itself.  An offset of MXRIO_OFF_CURRENT reads or writes at the
+// seek offset, as READ and WRITE do, and otherwise they act as READ_AT and
+// WRITE_AT.  A client asks for them by opening with MXRIO_OFLAG_XFER, and
+// may send them only if the reply to the open carries a mxrio_xfer_info_t.
 //
 // proposed:
 //
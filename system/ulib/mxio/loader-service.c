@@ -49,15 +49,130 @@ static const char* libpaths[] = {
     "/boot/lib",
 };
 
+// Libraries are kept once read, and each load is given a copy-on-write
+// clone, so that every process using one shares its pages and only the
+// first pays to read it. A load still opens the file, so that one which
+// has since changed (by inode, size or modification time) is read afresh.
+#define LOAD_CACHE_SIZE 64
+
+#define LOAD_OBJECT_RIGHTS (MX_RIGHT_READ | MX_RIGHT_EXECUTE | MX_RIGHT_MAP | \
+                            MX_RIGHT_TRANSFER | MX_RIGHT_DUPLICATE | \
+                            MX_RIGHT_GET_PROPERTY | MX_RIGHT_SET_PROPERTY)
+
+typedef struct load_cache_entry {
+    char* path;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    mx_handle_t vmo;
+    uint64_t last_use;
+} load_cache_entry_t;
+
+static mtx_t load_cache_lock = MTX_INIT;
+static load_cache_entry_t load_cache[LOAD_CACHE_SIZE];
+static uint64_t load_cache_clock;
+
+static bool load_cache_match(const load_cache_entry_t* e, const struct stat* st) {
+    return (e->ino == st->st_ino) && (e->size == st->st_size) &&
+           (e->mtime.tv_sec == st->st_mtim.tv_sec) &&
+           (e->mtime.tv_nsec == st->st_mtim.tv_nsec);
+}
+
+static mx_handle_t load_cache_clone(mx_handle_t vmo, size_t size, const char* fn) {
+    mx_handle_t clone;
+    mx_status_t status = mx_vmo_clone(vmo, MX_VMO_CLONE_COPY_ON_WRITE, 0, size, &clone);
+    if (status != MX_OK)
+        return status;
+    mx_object_set_property(clone, MX_PROP_NAME, fn, strlen(fn));
+    mx_handle_t out;
+    if ((status = mx_handle_replace(clone, LOAD_OBJECT_RIGHTS, &out)) != MX_OK) {
+        mx_handle_close(clone);
+        return status;
+    }
+    return out;
+}
+
+// Returns a clone of what's kept of |path|, if it is still |st|.
+static mx_handle_t load_cache_lookup(const char* path, const struct stat* st,
+                                     const char* fn) {
+    mx_handle_t vmo = MX_ERR_NOT_FOUND;
+    mtx_lock(&load_cache_lock);
+    for (unsigned n = 0; n < countof(load_cache); n++) {
+        load_cache_entry_t* e = &load_cache[n];
+        if ((e->path != NULL) && !strcmp(e->path, path)) {
+            if (load_cache_match(e, st)) {
+                e->last_use = ++load_cache_clock;
+                vmo = load_cache_clone(e->vmo, e->size, fn);
+            }
+            break;
+        }
+    }
+    mtx_unlock(&load_cache_lock);
+    return vmo;
+}
+
+// Keeps |vmo| as |path|, in place of an older one or else of the one
+// least recently used.
+static void load_cache_insert(const char* path, const struct stat* st, mx_handle_t vmo) {
+    char* copy = strdup(path);
+    if (copy == NULL) {
+        mx_handle_close(vmo);
+        return;
+    }
+    mtx_lock(&load_cache_lock);
+    load_cache_entry_t* victim = &load_cache[0];
+    for (unsigned n = 0; n < countof(load_cache); n++) {
+        load_cache_entry_t* e = &load_cache[n];
+        if ((e->path != NULL) && !strcmp(e->path, path)) {
+            victim = e;
+            break;
+        }
+        if ((victim->path != NULL) &&
+            ((e->path == NULL) || (e->last_use < victim->last_use))) {
+            victim = e;
+        }
+    }
+    if (victim->path != NULL) {
+        free(victim->path);
+        mx_handle_close(victim->vmo);
+    }
+    victim->path = copy;
+    victim->ino = st->st_ino;
+    victim->size = st->st_size;
+    victim->mtime = st->st_mtim;
+    victim->vmo = vmo;
+    victim->last_use = ++load_cache_clock;
+    mtx_unlock(&load_cache_lock);
+}
+
 // Always consumes the fd.
-static mx_handle_t load_object_fd(int fd, const char* fn) {
+static mx_handle_t load_object_fd(int fd, const char* path, const char* fn) {
+    struct stat st;
+    bool cacheable = (fstat(fd, &st) == 0) && (st.st_size > 0);
+    if (cacheable) {
+        mx_handle_t vmo = load_cache_lookup(path, &st, fn);
+        if (vmo > 0) {
+            close(fd);
+            return vmo;
+        }
+    }
+
     mx_handle_t vmo;
     mx_status_t status = mxio_get_vmo(fd, &vmo);
     close(fd);
     if (status != MX_OK)
         return status;
     mx_object_set_property(vmo, MX_PROP_NAME, fn, strlen(fn));
-    return vmo;
+    if (!cacheable)
+        return vmo;
+
+    // What is kept is never handed out itself, so that no process
+    // writing to its own can change what the rest see.
+    mx_handle_t clone = load_cache_clone(vmo, st.st_size, fn);
+    if (clone < 0)
+        return vmo;
+    load_cache_insert(path, &st, vmo);
+    return clone;
 }
 
 static mx_handle_t default_load_object(void* ignored,
@@ -71,7 +186,7 @@ static mx_handle_t default_load_object(void* ignored,
             snprintf(path, sizeof(path), "%s/%s", libpaths[n], fn);
             int fd = open(path, O_RDONLY);
             if (fd >= 0)
-                return load_object_fd(fd, fn);
+                return load_object_fd(fd, path, fn);
         }
         break;
     case LOADER_SVC_OP_LOAD_SCRIPT_INTERP:
@@ -83,7 +198,7 @@ static mx_handle_t default_load_object(void* ignored,
         }
         int fd = open(fn, O_RDONLY);
         if (fd >= 0)
-            return load_object_fd(fd, fn);
+            return load_object_fd(fd, fn, fn);
         break;
     default:
         __builtin_trap();
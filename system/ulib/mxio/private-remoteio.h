@@ -19,6 +19,14 @@ struct mxrio {
 
     // transaction id used for synchronous remoteio calls
     _Atomic mx_txid_t txid;
+
+    // largest READ_VMO or WRITE_VMO transfer the server accepts,
+    // or 0 if it does not
+    uint32_t xfer_max;
+
+    // held while pipelined requests are outstanding, as their
+    // replies are read from the channel rather than by mx_channel_call
+    mtx_t pipeline_lock;
 };
 
 // These are for the benefit of namespace.c
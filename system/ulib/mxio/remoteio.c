@@ -334,6 +334,76 @@ ssize_t mxrio_ioctl(mxio_t* io, uint32_t op, const void* in_buf,
     return r;
 }
 
+// Transfers of at least this size go through a VMO, if the server takes them
+#define MXRIO_XFER_MIN        (4 * MXIO_CHUNK_SIZE)
+
+// The number of chunked READ_AT requests kept outstanding at once
+#define MXRIO_PIPELINE_DEPTH  8
+
+// Reads or writes |len| bytes through a VMO, in as few transfers as the
+// server's limit allows.  |offset| is MXRIO_OFF_CURRENT to use the seek offset.
+static ssize_t xfer_vmo(mxrio_t* rio, uint32_t op, uint8_t* data, size_t len, off_t offset) {
+    bool write = (op == MXRIO_WRITE_VMO);
+    ssize_t count = 0;
+    mx_status_t r = 0;
+    mxrio_msg_t msg;
+    size_t xfer;
+
+    while (len > 0) {
+        xfer = (len > rio->xfer_max) ? rio->xfer_max : len;
+
+        mx_handle_t vmo;
+        if ((r = mx_vmo_create(xfer, 0, &vmo)) < 0) {
+            break;
+        }
+        size_t actual;
+        if (write && ((r = mx_vmo_write(vmo, data, 0, xfer, &actual)) < 0)) {
+            mx_handle_close(vmo);
+            break;
+        }
+
+        memset(&msg, 0, MXRIO_HDR_SZ);
+        msg.op = op;
+        msg.arg = xfer;
+        msg.arg2.off = offset;
+        msg.hcount = 1;
+        if (write) {
+            msg.handle[0] = vmo;
+            vmo = MX_HANDLE_INVALID;
+        } else if ((r = mx_handle_duplicate(vmo, MX_RIGHT_SAME_RIGHTS, &msg.handle[0])) < 0) {
+            mx_handle_close(vmo);
+            break;
+        }
+
+        if ((r = mxrio_txn(rio, &msg)) >= 0) {
+            discard_handles(msg.handle, msg.hcount);
+            if (r > (ssize_t)xfer) {
+                r = MX_ERR_IO;
+            } else if (!write && (r > 0)) {
+                mx_status_t status = mx_vmo_read(vmo, data, 0, r, &actual);
+                if (status < 0) {
+                    r = status;
+                }
+            }
+        }
+        mx_handle_close(vmo);
+        if (r < 0) {
+            break;
+        }
+
+        count += r;
+        data += r;
+        len -= r;
+        if (offset != MXRIO_OFF_CURRENT)
+            offset += r;
+        // stop at short read or write
+        if ((size_t)r < xfer) {
+            break;
+        }
+    }
+    return count ? count : r;
+}
+
 static ssize_t write_common(uint32_t op, mxio_t* io, const void* _data, size_t len, off_t offset) {
     mxrio_t* rio = (mxrio_t*)io;
     const uint8_t* data = _data;
@@ -342,6 +412,11 @@ static ssize_t write_common(uint32_t op, mxio_t* io, const void* _data, size_t l
     mxrio_msg_t msg;
     ssize_t xfer;
 
+    if (rio->xfer_max && (len >= MXRIO_XFER_MIN)) {
+        return xfer_vmo(rio, MXRIO_WRITE_VMO, (uint8_t*)data, len,
+                        (op == MXRIO_WRITE_AT) ? offset : MXRIO_OFF_CURRENT);
+    }
+
     while (len > 0) {
         xfer = (len > MXIO_CHUNK_SIZE) ? MXIO_CHUNK_SIZE : len;
 
@@ -382,6 +457,85 @@ static ssize_t mxrio_write_at(mxio_t* io, const void* _data, size_t len, mx_off_
     return write_common(MXRIO_WRITE_AT, io, _data, len, offset);
 }
 
+// Reads up to MXRIO_PIPELINE_DEPTH chunks at |offset|, sending every request
+// before waiting on any reply.  Reads at explicit offsets do not depend on one
+// another, so the server may answer them in any order.  Returns the number of
+// bytes read before the first short or failed chunk.
+static ssize_t read_at_pipelined(mxrio_t* rio, uint8_t* data, size_t len, off_t offset) {
+    mx_txid_t txid[MXRIO_PIPELINE_DEPTH];
+    mx_status_t result[MXRIO_PIPELINE_DEPTH];
+    size_t xfer[MXRIO_PIPELINE_DEPTH];
+    mxrio_msg_t msg;
+    mx_status_t r = MX_OK;
+    unsigned sent;
+
+    mtx_lock(&rio->pipeline_lock);
+    for (sent = 0; (sent < MXRIO_PIPELINE_DEPTH) && (len > 0); sent++) {
+        xfer[sent] = (len > MXIO_CHUNK_SIZE) ? MXIO_CHUNK_SIZE : len;
+        txid[sent] = atomic_fetch_add(&rio->txid, 1);
+        result[sent] = MX_ERR_IO;
+
+        memset(&msg, 0, MXRIO_HDR_SZ);
+        msg.txid = txid[sent];
+        msg.op = MXRIO_READ_AT;
+        msg.arg = xfer[sent];
+        msg.arg2.off = offset + sent * MXIO_CHUNK_SIZE;
+        if ((r = mx_channel_write(rio->h, 0, &msg, MXRIO_HDR_SZ, NULL, 0)) < 0) {
+            break;
+        }
+        len -= xfer[sent];
+    }
+
+    // Every request which went out gets its reply read, even after a failure,
+    // so that none is left behind on the channel.
+    for (unsigned pending = sent; pending > 0; pending--) {
+        mx_signals_t observed;
+        uint32_t dsize, hcount;
+        if ((r = mx_object_wait_one(rio->h, MX_CHANNEL_READABLE | MX_CHANNEL_PEER_CLOSED,
+                                    MX_TIME_INFINITE, &observed)) < 0) {
+            break;
+        }
+        if ((r = mx_channel_read(rio->h, 0, &msg, msg.handle, sizeof(msg),
+                                 MXIO_MAX_HANDLES, &dsize, &hcount)) < 0) {
+            break;
+        }
+        discard_handles(msg.handle, hcount);
+
+        unsigned n;
+        for (n = 0; n < sent; n++) {
+            if (txid[n] == msg.txid) {
+                break;
+            }
+        }
+        if ((n == sent) || !is_message_reply_valid(&msg, dsize) ||
+            (MXRIO_OP(msg.op) != MXRIO_STATUS)) {
+            r = MX_ERR_IO;
+            break;
+        }
+        if ((msg.arg >= 0) && (((size_t)msg.arg > xfer[n]) || (msg.arg > (int32_t)msg.datalen))) {
+            msg.arg = MX_ERR_IO;
+        }
+        if (msg.arg > 0) {
+            memcpy(data + n * MXIO_CHUNK_SIZE, msg.data, msg.arg);
+        }
+        result[n] = msg.arg;
+    }
+    mtx_unlock(&rio->pipeline_lock);
+
+    ssize_t count = 0;
+    for (unsigned n = 0; n < sent; n++) {
+        if (result[n] < 0) {
+            r = result[n];
+            break;
+        }
+        count += result[n];
+        if ((size_t)result[n] < xfer[n]) {
+            break;
+        }
+    }
+    return count ? count : r;
+}
+
 static ssize_t read_common(uint32_t op, mxio_t* io, void* _data, size_t len, off_t offset) {
     mxrio_t* rio = (mxrio_t*)io;
     uint8_t* data = _data;
@@ -390,6 +544,30 @@ static ssize_t read_common(uint32_t op, mxio_t* io, void* _data, size_t len, off
     mxrio_msg_t msg;
     ssize_t xfer;
 
+    if (rio->xfer_max && (len >= MXRIO_XFER_MIN)) {
+        return xfer_vmo(rio, MXRIO_READ_VMO, data, len,
+                        (op == MXRIO_READ_AT) ? offset : MXRIO_OFF_CURRENT);
+    }
+
+    if ((op == MXRIO_READ_AT) && (len > MXIO_CHUNK_SIZE)) {
+        while (len > 0) {
+            size_t want = (len > MXRIO_PIPELINE_DEPTH * MXIO_CHUNK_SIZE) ?
+                    MXRIO_PIPELINE_DEPTH * MXIO_CHUNK_SIZE : len;
+            if ((r = read_at_pipelined(rio, data, want, offset)) < 0) {
+                break;
+            }
+            count += r;
+            data += r;
+            len -= r;
+            offset += r;
+            // stop at short read
+            if ((size_t)r < want) {
+                break;
+            }
+        }
+        return count ? count : r;
+    }
+
     while (len > 0) {
         xfer = (len > MXIO_CHUNK_SIZE) ? MXIO_CHUNK_SIZE : len;
 
@@ -693,6 +871,12 @@ mx_status_t mxio_from_handles(uint32_t type, mx_handle_t* handles, int hcount,
         if (io == NULL) {
             return MX_ERR_NO_RESOURCES;
         } else {
+            // The server accepts VMO transfers if it described them
+            if (esize == sizeof(mxrio_xfer_info_t)) {
+                const mxrio_xfer_info_t* xi = extra;
+                uint32_t max_xfer = xi->max_xfer;
+                ((mxrio_t*)io)->xfer_max = (max_xfer > MXRIO_XFER_MAX) ? MXRIO_XFER_MAX : max_xfer;
+            }
             *out = io;
             return MX_OK;
         }
@@ -783,7 +967,7 @@ mx_status_t mxrio_open_handle(mx_handle_t h, const char* path, int32_t flags,
     if (flags & MXRIO_OFLAG_MASK) {
         return MX_ERR_INVALID_ARGS;
     }
-    mx_status_t r = mxrio_getobject(h, MXRIO_OPEN, path, flags, mode, &info);
+    mx_status_t r = mxrio_getobject(h, MXRIO_OPEN, path, flags | MXRIO_OFLAG_XFER, mode, &info);
     if (r < 0) {
         return r;
     }
@@ -819,7 +1003,7 @@ mx_status_t mxrio_open(mxio_t* io, const char* path, int32_t flags, uint32_t mod
     if (flags & MXRIO_OFLAG_MASK) {
         return MX_ERR_INVALID_ARGS;
     }
-    mx_status_t r = mxrio_getobject(rio->h, MXRIO_OPEN, path, flags, mode, &info);
+    mx_status_t r = mxrio_getobject(rio->h, MXRIO_OPEN, path, flags | MXRIO_OFLAG_XFER, mode, &info);
     if (r < 0) {
         return r;
     }
@@ -917,5 +1101,6 @@ mxio_t* mxio_remote_create(mx_handle_t h, mx_handle_t e) {
     atomic_init(&rio->io.refcount, 1);
     rio->h = h;
     rio->h2 = e;
+    mtx_init(&rio->pipeline_lock, mtx_plain);
     return &rio->io;
 }
@@ -18,9 +18,8 @@
 #include "private-remoteio.h"
 
 
-static ssize_t mxsio_read_stream(mxio_t* io, void* data, size_t len) {
+static ssize_t mxsio_rx_stream(mxio_t* io, void* data, size_t len, bool nonblock) {
     mxrio_t* rio = (mxrio_t*)io;
-    int nonblock = rio->io.flags & MXIO_FLAG_NONBLOCK;
 
     // TODO: let the generic read() to do this loop
     for (;;) {
@@ -51,9 +50,12 @@ static ssize_t mxsio_read_stream(mxio_t* io, void* data, size_t len) {
     }
 }
 
-static ssize_t mxsio_write_stream(mxio_t* io, const void* data, size_t len) {
+static ssize_t mxsio_read_stream(mxio_t* io, void* data, size_t len) {
+    return mxsio_rx_stream(io, data, len, io->flags & MXIO_FLAG_NONBLOCK);
+}
+
+static ssize_t mxsio_tx_stream(mxio_t* io, const void* data, size_t len, bool nonblock) {
     mxrio_t* rio = (mxrio_t*)io;
-    int nonblock = rio->io.flags & MXIO_FLAG_NONBLOCK;
 
     // TODO: let the generic write() to do this loop
     for (;;) {
@@ -82,7 +84,13 @@ static ssize_t mxsio_write_stream(mxio_t* io, const void* data, size_t len) {
     }
 }
 
+static ssize_t mxsio_write_stream(mxio_t* io, const void* data, size_t len) {
+    return mxsio_tx_stream(io, data, len, io->flags & MXIO_FLAG_NONBLOCK);
+}
+
 static ssize_t mxsio_recvmsg_stream(mxio_t* io, struct msghdr* msg, int flags) {
+    bool nonblock = (io->flags & MXIO_FLAG_NONBLOCK) || (flags & MSG_DONTWAIT);
+    flags &= ~MSG_DONTWAIT;
     if (flags != 0) {
         // TODO: support MSG_OOB
         return MX_ERR_NOT_SUPPORTED;
@@ -99,9 +107,11 @@ static ssize_t mxsio_recvmsg_stream(mxio_t* io, struct msghdr* msg, int flags) {
     ssize_t total = 0;
     for (int i = 0; i < msg->msg_iovlen; i++) {
         struct iovec *iov = &msg->msg_iov[i];
-        ssize_t n = mxsio_read_stream(io, iov->iov_base, iov->iov_len);
+        ssize_t n = mxsio_rx_stream(io, iov->iov_base, iov->iov_len, nonblock);
         if (n < 0) {
-            return n;
+            // what was read already is the result; the error comes back
+            // from the next call
+            return total > 0 ? total : n;
         }
         total += n;
         if ((size_t)n != iov->iov_len) {
@@ -112,6 +122,8 @@ static ssize_t mxsio_recvmsg_stream(mxio_t* io, struct msghdr* msg, int flags) {
 }
 
 static ssize_t mxsio_sendmsg_stream(mxio_t* io, const struct msghdr* msg, int flags) {
+    bool nonblock = (io->flags & MXIO_FLAG_NONBLOCK) || (flags & MSG_DONTWAIT);
+    flags &= ~MSG_DONTWAIT;
     if (flags != 0) {
         // TODO: support MSG_OOB
         return MX_ERR_NOT_SUPPORTED;
@@ -131,9 +143,9 @@ static ssize_t mxsio_sendmsg_stream(mxio_t* io, const struct msghdr* msg, int fl
         if (iov->iov_len <= 0) {
             return MX_ERR_INVALID_ARGS;
         }
-        ssize_t n = mxsio_write_stream(io, iov->iov_base, iov->iov_len);
+        ssize_t n = mxsio_tx_stream(io, iov->iov_base, iov->iov_len, nonblock);
         if (n < 0) {
-            return n;
+            return total > 0 ? total : n;
         }
         total += n;
         if ((size_t)n != iov->iov_len) {
@@ -280,20 +292,35 @@ static ssize_t mxsio_posix_ioctl_stream(mxio_t* io, int req, va_list va) {
     }
 }
 
-static ssize_t mxsio_rx_dgram(mxio_t* io, void* buf, size_t buflen) {
-    size_t n = 0;
+// Datagrams up to this size, header and all, go through the stack rather
+// than the heap.
+#define MXSIO_DGRAM_STACK_SIZE 2048
+
+typedef union {
+    mxio_socket_msg_t m;
+    char buf[MXSIO_DGRAM_STACK_SIZE];
+} mxsio_dgram_buf_t;
+
+// Reads one datagram into |buf|. If it does not fit, nothing is read and
+// MX_ERR_BUFFER_TOO_SMALL is returned, with the size it needs in |needed|.
+static ssize_t mxsio_rx_dgram(mxio_t* io, void* buf, size_t buflen, bool nonblock,
+                              size_t* needed) {
     for (;;) {
         ssize_t r;
+        uint32_t n = 0;
         mxrio_t* rio = (mxrio_t*)io;
         // TODO: if mx_socket support dgram mode, we'll switch to it
         if ((r = mx_channel_read(rio->h2, 0, buf, NULL, buflen,
-                                 0, (uint32_t*)&n, NULL)) == MX_OK) {
+                                 0, &n, NULL)) == MX_OK) {
             return n;
         }
         if (r == MX_ERR_PEER_CLOSED) {
             return 0;
+        } else if (r == MX_ERR_BUFFER_TOO_SMALL) {
+            *needed = n;
+            return r;
         } else if (r == MX_ERR_SHOULD_WAIT) {
-            if (io->flags & MXIO_FLAG_NONBLOCK) {
+            if (nonblock) {
                 return r;
             }
             mx_signals_t pending;
@@ -312,7 +339,7 @@ static ssize_t mxsio_rx_dgram(mxio_t* io, void* buf, size_t buflen) {
             // impossible
             return MX_ERR_INTERNAL;
         }
-        return (ssize_t)n;
+        return r;
     }
 }
 
@@ -361,6 +388,8 @@ static ssize_t mxsio_write_dgram(mxio_t* io, const void* data, size_t len) {
 }
 
 static ssize_t mxsio_recvmsg_dgram(mxio_t* io, struct msghdr* msg, int flags) {
+    bool nonblock = (io->flags & MXIO_FLAG_NONBLOCK) || (flags & MSG_DONTWAIT);
+    flags &= ~MSG_DONTWAIT;
     if (flags != 0) {
         // TODO: support MSG_OOB
         return MX_ERR_NOT_SUPPORTED;
@@ -372,30 +401,40 @@ static ssize_t mxsio_recvmsg_dgram(mxio_t* io, struct msghdr* msg, int flags) {
             return MX_ERR_ALREADY_EXISTS;
         }
     }
-    size_t mlen = 0;
     for (int i = 0; i < msg->msg_iovlen; i++) {
         struct iovec *iov = &msg->msg_iov[i];
         if (iov->iov_len <= 0) {
             return MX_ERR_INVALID_ARGS;
         }
-        mlen += iov->iov_len;
     }
-    mlen += MXIO_SOCKET_MSG_HEADER_SIZE;
 
-    // TODO: avoid malloc
-    mxio_socket_msg_t* m = malloc(mlen);
-    ssize_t n = mxsio_rx_dgram(io, m, mlen);
+    // Most datagrams fit on the stack; a bigger one is read whole into
+    // the heap, however little of it the caller asked for.
+    mxsio_dgram_buf_t stack;
+    mxio_socket_msg_t* m = &stack.m;
+    size_t needed = 0;
+    ssize_t n = mxsio_rx_dgram(io, m, sizeof(stack), nonblock, &needed);
+    while (n == MX_ERR_BUFFER_TOO_SMALL) {
+        if (m != &stack.m) {
+            free(m);
+        }
+        if ((m = malloc(needed)) == NULL) {
+            return MX_ERR_NO_MEMORY;
+        }
+        n = mxsio_rx_dgram(io, m, needed, nonblock, &needed);
+    }
     if (n < 0) {
-        free(m);
-        return n;
+        goto done;
     }
-    if ((size_t)n < MXIO_SOCKET_MSG_HEADER_SIZE) {
-        free(m);
-        return MX_ERR_INTERNAL;
+    if ((size_t)n < MXIO_SOCKET_MSG_HEADER_SIZE ||
+        m->addrlen > sizeof(m->addr)) {
+        n = MX_ERR_INTERNAL;
+        goto done;
     }
     n -= MXIO_SOCKET_MSG_HEADER_SIZE;
     if (msg->msg_name != NULL) {
-        memcpy(msg->msg_name, &m->addr, m->addrlen);
+        memcpy(msg->msg_name, &m->addr,
+               m->addrlen < msg->msg_namelen ? m->addrlen : msg->msg_namelen);
     }
     msg->msg_namelen = m->addrlen;
     msg->msg_flags = m->flags;
@@ -413,11 +452,21 @@ static ssize_t mxsio_recvmsg_dgram(mxio_t* io, struct msghdr* msg, int flags) {
             resid -= iov->iov_len;
         }
     }
-    free(m);
+    if (resid > 0) {
+        msg->msg_flags |= MSG_TRUNC;
+        n -= resid;
+    }
+
+done:
+    if (m != &stack.m) {
+        free(m);
+    }
     return n;
 }
 
 static ssize_t mxsio_sendmsg_dgram(mxio_t* io, const struct msghdr* msg, int flags) {
+    // channel writes never wait, so MSG_DONTWAIT has nothing to change
+    flags &= ~MSG_DONTWAIT;
     if (flags != 0) {
         // TODO: MSG_OOB
         return MX_ERR_NOT_SUPPORTED;
@@ -429,6 +478,9 @@ static ssize_t mxsio_sendmsg_dgram(mxio_t* io, const struct msghdr* msg, int fla
             return MX_ERR_ALREADY_EXISTS;
         }
     }
+    if (msg->msg_namelen > sizeof(((mxio_socket_msg_t*)0)->addr)) {
+        return MX_ERR_INVALID_ARGS;
+    }
     ssize_t n = 0;
     for (int i = 0; i < msg->msg_iovlen; i++) {
         struct iovec *iov = &msg->msg_iov[i];
@@ -439,8 +491,11 @@ static ssize_t mxsio_sendmsg_dgram(mxio_t* io, const struct msghdr* msg, int fla
     }
     size_t mlen = n + MXIO_SOCKET_MSG_HEADER_SIZE;
 
-    // TODO: avoid malloc m
-    mxio_socket_msg_t* m = malloc(mlen);
+    mxsio_dgram_buf_t stack;
+    mxio_socket_msg_t* m = &stack.m;
+    if (mlen > sizeof(stack) && (m = malloc(mlen)) == NULL) {
+        return MX_ERR_NO_MEMORY;
+    }
     if (msg->msg_name != NULL) {
         memcpy(&m->addr, msg->msg_name, msg->msg_namelen);
     }
@@ -453,7 +508,9 @@ static ssize_t mxsio_sendmsg_dgram(mxio_t* io, const struct msghdr* msg, int fla
         data += iov->iov_len;
     }
     ssize_t r = mxsio_tx_dgram(io, m, mlen);
-    free(m);
+    if (m != &stack.m) {
+        free(m);
+    }
     return r == MX_OK ? n : r;
 }
 
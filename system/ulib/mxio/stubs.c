@@ -155,14 +155,6 @@ int socketpair(int domain, int type, int protocol, int fd[2]) {
 // So far just a bit of plumbing around checking whether the fds are
 // indeed fds, and if so, are indeed sockets.
 
-int sendmmsg(int fd, struct mmsghdr* msgvec, unsigned int vlen, unsigned int flags) {
-    return checksocket(fd, ENOTSOCK, ENOSYS);
-}
-
-int recvmmsg(int fd, struct mmsghdr* msgvec, unsigned int vlen, unsigned int flags, struct timespec* timeout) {
-    return checksocket(fd, ENOTSOCK, ENOSYS);
-}
-
 int sockatmark(int fd) {
     // ENOTTY is sic.
     return checksocket(fd, ENOTTY, ENOSYS);
@@ -717,6 +717,7 @@ int mxio_stat(mxio_t* io, struct stat* s) {
 
 mx_status_t mxio_setattr(mxio_t* io, vnattr_t* vn){
     mx_status_t r = io->ops->misc(io, MXRIO_SETATTR, 0, 0, vn, sizeof(*vn));
+    __mxio_attr_cache_invalidate();
     if (r < 0) {
         return MX_ERR_BAD_HANDLE;
     }
@@ -798,11 +799,6 @@ ssize_t writev(int fd, const struct iovec* iov, int num) {
 mx_status_t _mmap_file(size_t offset, size_t len, uint32_t mx_flags, int flags, int fd,
                        off_t fd_off, uintptr_t* out) {
     // Mapping is backed by a file
-    if (flags & MAP_PRIVATE) {
-        // TODO(smklein): Implement by creating a private
-        // COW clone of the underlying vmo before mapping it.
-        return MX_ERR_INVALID_ARGS;
-    }
     mxio_t* io;
     if ((io = fd_to_io(fd)) == NULL) {
         return MX_ERR_BAD_HANDLE;
@@ -817,6 +813,10 @@ mx_status_t _mmap_file(size_t offset, size_t len, uint32_t mx_flags, int flags,
     data.offset = fd_off;
     data.length = len;
     data.flags = mx_flags;
+    if (flags & MAP_PRIVATE) {
+        // The server hands back a copy-on-write clone of the file
+        data.flags |= MXIO_MMAP_FLAG_PRIVATE;
+    }
 
     mx_status_t r = io->ops->misc(io, MXRIO_MMAP, 0, sizeof(data), &data, sizeof(data));
     mxio_release(io);
@@ -847,6 +847,7 @@ int unlinkat(int dirfd, const char* path, int flags) {
     r = io->ops->misc(io, MXRIO_UNLINK, 0, 0, (void*)name, strlen(name));
     io->ops->close(io);
     mxio_release(io);
+    __mxio_attr_cache_invalidate();
     return STATUS(r);
 }
 
@@ -889,6 +890,7 @@ ssize_t write(int fd, const void* buf, size_t count) {
         mxio_wait_fd(fd, MXIO_EVT_WRITABLE, NULL, MX_TIME_INFINITE);
     }
     mxio_release(io);
+    __mxio_attr_cache_invalidate();
     return STATUS(status);
 }
 
@@ -973,6 +975,7 @@ ssize_t pwrite(int fd, const void* buf, size_t size, off_t ofs) {
         mxio_wait_fd(fd, MXIO_EVT_WRITABLE, NULL, MX_TIME_INFINITE);
     }
     mxio_release(io);
+    __mxio_attr_cache_invalidate();
     return STATUS(status);
 }
 
@@ -1151,6 +1154,7 @@ static int truncateat(int dirfd, const char* path, off_t len) {
     r = io->ops->misc(io, MXRIO_TRUNCATE, len, 0, NULL, 0);
     mxio_close(io);
     mxio_release(io);
+    __mxio_attr_cache_invalidate();
     return STATUS(r);
 }
 
@@ -1165,6 +1169,7 @@ int ftruncate(int fd, off_t len) {
     }
     int r = STATUS(io->ops->misc(io, MXRIO_TRUNCATE, len, 0, NULL, 0));
      mxio_release(io);
+     __mxio_attr_cache_invalidate();
      return r;
 }
 
@@ -1224,6 +1229,7 @@ newparent_open:
 oldparent_open:
     io_oldparent->ops->close(io_oldparent);
     mxio_release(io_oldparent);
+    __mxio_attr_cache_invalidate();
     return STATUS(status);
 }
 
@@ -1258,7 +1264,21 @@ static int vopenat(int dirfd, const char* path, int flags, va_list args) {
         }
         mode = va_arg(args, uint32_t) & 0777;
     }
-    if ((r = __mxio_open_at(&io, dirfd, path, flags, mode)) < 0) {
+    if (flags & (O_CREAT | O_TRUNC)) {
+        r = __mxio_open_at(&io, dirfd, path, flags, mode);
+        __mxio_attr_cache_invalidate();
+    } else {
+        // A path known not to exist needn't be asked about again
+        mxio_attr_ticket_t ticket;
+        if (__mxio_attr_cache_lookup(dirfd, path, &ticket, NULL, &r) &&
+            (r == MX_ERR_NOT_FOUND)) {
+            return ERROR(r);
+        }
+        if ((r = __mxio_open_at(&io, dirfd, path, flags, mode)) == MX_ERR_NOT_FOUND) {
+            __mxio_attr_cache_insert(&ticket, NULL, r);
+        }
+    }
+    if (r < 0) {
         return ERROR(r);
     }
     if (flags & O_NONBLOCK) {
@@ -1298,7 +1318,9 @@ int mkdirat(int dirfd, const char* path, mode_t mode) {
 
     mode = (mode & 0777) | S_IFDIR;
 
-    if ((r = __mxio_open_at(&io, dirfd, path, O_RDONLY | O_CREAT | O_EXCL, mode)) < 0) {
+    r = __mxio_open_at(&io, dirfd, path, O_RDONLY | O_CREAT | O_EXCL, mode);
+    __mxio_attr_cache_invalidate();
+    if (r < 0) {
         return ERROR(r);
     }
     io->ops->close(io);
@@ -1337,12 +1359,18 @@ int fstatat(int dirfd, const char* fn, struct stat* s, int flags) {
     mxio_t* io;
     mx_status_t r;
 
+    mxio_attr_ticket_t ticket;
+    if (__mxio_attr_cache_lookup(dirfd, fn, &ticket, s, &r)) {
+        return STATUS(r);
+    }
     if ((r = __mxio_open_at(&io, dirfd, fn, 0, 0)) < 0) {
+        __mxio_attr_cache_insert(&ticket, NULL, r);
         return ERROR(r);
     }
     r = mxio_stat(io, s);
     mxio_close(io);
     mxio_release(io);
+    __mxio_attr_cache_insert(&ticket, s, r);
     return STATUS(r);
 }
 
@@ -1498,16 +1526,8 @@ int faccessat(int dirfd, const char* filename, int amode, int flag) {
 
     // Since we are not tracking permissions yet, just check that the
     // file exists a la fstatat.
-    mxio_t* io;
-    mx_status_t status;
-    if ((status = __mxio_open_at(&io, dirfd, filename, 0, 0)) < 0) {
-        return ERROR(status);
-    }
     struct stat s;
-    status = mxio_stat(io, &s);
-    mxio_close(io);
-    mxio_release(io);
-    return STATUS(status);
+    return fstatat(dirfd, filename, &s, 0);
 }
 
 char* getcwd(char* buf, size_t size) {
@@ -8,6 +8,7 @@
 #include <mxio/io.h>
 #include <limits.h>
 #include <stdbool.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <threads.h>
 
@@ -21,6 +22,29 @@ mx_status_t __mxio_open(mxio_t** io, const char* path, int flags, uint32_t mode)
 
 int mxio_status_to_errno(mx_status_t status);
 
+// The attribute cache (see mxio_attr_cache_enable)
+#define MXIO_ATTR_KEY_MAX 256
+
+typedef struct mxio_attr_ticket {
+    char key[MXIO_ATTR_KEY_MAX];
+    uint32_t gen;
+    uint32_t dir;
+    uint32_t dir_gen;
+    bool valid;
+} mxio_attr_ticket_t;
+
+// Answers a stat of |path| from the cache, returning true with the result in
+// |s| and |status| if it can.  Otherwise fills in |ticket|, which the result
+// from the server is then passed to __mxio_attr_cache_insert with.  |s| may be
+// NULL where only whether the path exists matters.
+bool __mxio_attr_cache_lookup(int dirfd, const char* path, mxio_attr_ticket_t* ticket,
+                              struct stat* s, mx_status_t* status);
+void __mxio_attr_cache_insert(const mxio_attr_ticket_t* ticket,
+                              const struct stat* s, mx_status_t status);
+
+// Drops everything cached, after this process changes the filesystem.
+void __mxio_attr_cache_invalidate(void);
+
 // set errno to the closest match for error and return -1
 static inline int ERROR(mx_status_t error) {
     errno = mxio_status_to_errno(error);
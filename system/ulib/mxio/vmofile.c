@@ -143,14 +143,20 @@ static mx_status_t vmofile_misc(mxio_t* io, uint32_t op, int64_t off, uint32_t m
         rights |= (data->flags & MXIO_MMAP_FLAG_READ) ? MX_RIGHT_READ : 0;
         rights |= (data->flags & MXIO_MMAP_FLAG_EXEC) ? MX_RIGHT_EXECUTE : 0;
 
-        // Make a tiny clone of the portion of the portion of the VMO representing this file
+        // The server hands out a VMO which is exactly this file (a clone of
+        // its range of the bootfs, say), and since the mapping can't be
+        // written, sharing it is no different from cloning it. Otherwise make
+        // a tiny clone of the portion of the VMO representing this file.
         mx_handle_t h;
-        // TODO(smklein): In the future, "vf->vmo" will already be a cloned vmo
-        // representing this file (logically, making "vf->off" always zero), and
-        // nothing past "vf->end". As a consequence, we will be able to
-        // duplicate "vf->vmo" instead of cloning it.
-        mx_status_t status = mx_vmo_clone(vf->vmo, MX_VMO_CLONE_COPY_ON_WRITE,
-                                          vf->off, vf->end - vf->off, &h);
+        mx_status_t status;
+        uint64_t size;
+        if ((vf->off == 0) && (mx_vmo_get_size(vf->vmo, &size) == MX_OK) &&
+            (size == ((vf->end + PAGE_SIZE - 1) & -PAGE_SIZE))) {
+            status = mx_handle_duplicate(vf->vmo, MX_RIGHT_SAME_RIGHTS, &h);
+        } else {
+            status = mx_vmo_clone(vf->vmo, MX_VMO_CLONE_COPY_ON_WRITE,
+                                  vf->off, vf->end - vf->off, &h);
+        }
         if (status != MX_OK) {
             return status;
         }
@@ -97,6 +97,170 @@ const T* lower_bound(const T* first, const T* last, const U& value, Compare comp
     return last;
 }
 
+namespace internal {
+
+template<class T>
+void sort_swap(T* a, T* b) {
+    T t(mxtl::move(*a));
+    *a = mxtl::move(*b);
+    *b = mxtl::move(t);
+}
+
+template<class T, class Compare>
+void insertion_sort(T* first, T* last, Compare& comp) {
+    for (T* i = first + 1; i < last; i++) {
+        if (!comp(*i, *(i - 1)))
+            continue;
+        T t(mxtl::move(*i));
+        T* j = i;
+        do {
+            *j = mxtl::move(*(j - 1));
+            j--;
+        } while (j > first && comp(t, *(j - 1)));
+        *j = mxtl::move(t);
+    }
+}
+
+// Insertion sorts, unless that takes more than a few moves, in which case it
+// returns false with [first, last) still to be sorted some other way.
+template<class T, class Compare>
+bool partial_insertion_sort(T* first, T* last, Compare& comp) {
+    size_t moves = 0;
+    for (T* i = first + 1; i < last; i++) {
+        if (!comp(*i, *(i - 1)))
+            continue;
+        T t(mxtl::move(*i));
+        T* j = i;
+        do {
+            *j = mxtl::move(*(j - 1));
+            j--;
+            moves++;
+        } while (j > first && comp(t, *(j - 1)));
+        *j = mxtl::move(t);
+        if (moves > 8)
+            return false;
+    }
+    return true;
+}
+
+template<class T, class Compare>
+void sift_down(T* first, size_t root, size_t n, Compare& comp) {
+    for (;;) {
+        size_t child = 2 * root + 1;
+        if (child >= n)
+            break;
+        if (child + 1 < n && comp(first[child], first[child + 1]))
+            child++;
+        if (!comp(first[root], first[child]))
+            break;
+        sort_swap(first + root, first + child);
+        root = child;
+    }
+}
+
+template<class T, class Compare>
+void heap_sort(T* first, T* last, Compare& comp) {
+    size_t n = last - first;
+    for (size_t i = n / 2; i-- > 0;)
+        sift_down(first, i, n, comp);
+    for (size_t i = n - 1; i > 0; i--) {
+        sort_swap(first, first + i);
+        sift_down(first, 0, i, comp);
+    }
+}
+
+template<class T, class Compare>
+T* median_of_three(T* a, T* b, T* c, Compare& comp) {
+    if (comp(*a, *b))
+        return comp(*b, *c) ? b : comp(*a, *c) ? c : a;
+    return comp(*c, *b) ? b : comp(*c, *a) ? c : a;
+}
+
+// The same introsort as libc's qsort(): median-of-three (or of nine)
+// pivots, a partition that splits runs of equal keys evenly, a quick way
+// out for input that is already sorted, and heapsort once |depth| runs out.
+template<class T, class Compare>
+void introsort(T* first, T* last, int depth, Compare& comp) {
+    while (last - first > 12) {
+        if (depth-- == 0) {
+            heap_sort(first, last, comp);
+            return;
+        }
+
+        size_t n = last - first;
+        T* mid = first + n / 2;
+        T* pivot;
+        if (n < 128) {
+            pivot = median_of_three(first, mid, last - 1, comp);
+        } else {
+            size_t s = n / 8;
+            pivot = median_of_three(median_of_three(first, first + s, first + 2 * s, comp),
+                                    median_of_three(mid - s, mid, mid + s, comp),
+                                    median_of_three(last - 1 - 2 * s, last - 1 - s, last - 1,
+                                                    comp),
+                                    comp);
+        }
+        if (pivot != first)
+            sort_swap(first, pivot);
+
+        T* i = first + 1;
+        T* j = last - 1;
+        bool swapped = false;
+        for (;;) {
+            while (i <= j && comp(*i, *first))
+                i++;
+            while (j >= i && comp(*first, *j))
+                j--;
+            if (i >= j)
+                break;
+            sort_swap(i++, j--);
+            swapped = true;
+        }
+        if (j != first)
+            sort_swap(first, j);
+
+        if (!swapped &&
+            partial_insertion_sort(first, j, comp) &&
+            partial_insertion_sort(j + 1, last, comp)) {
+            return;
+        }
+
+        // Recursing on the smaller side keeps the stack to log2(n) frames.
+        if (j - first < last - (j + 1)) {
+            introsort(first, j, depth, comp);
+            first = j + 1;
+        } else {
+            introsort(j + 1, last, depth, comp);
+            last = j;
+        }
+    }
+    insertion_sort(first, last, comp);
+}
+
+}  // namespace internal
+
+// Sorts [first, last) by |comp|, which returns whether its first argument
+// goes before its second.  The sort is not stable.  Unlike qsort() it is
+// inlined into the caller along with |comp|, so it is the one to use for
+// sorting numbers and the like from C++.
+//
+// Similar to <http://en.cppreference.com/w/cpp/algorithm/sort>
+template<class T, class Compare>
+void sort(T* first, T* last, Compare comp) {
+    if (last - first < 2)
+        return;
+    int depth = 0;
+    for (size_t n = last - first; n > 1; n >>= 1)
+        depth += 2;
+    internal::introsort(first, last, depth, comp);
+}
+
+// Sorts [first, last) by operator<.
+template<class T>
+void sort(T* first, T* last) {
+    sort(first, last, [](const T& a, const T& b) { return a < b; });
+}
+
 template <typename T, size_t N>
 constexpr size_t count_of(T const(&)[N]) {
     return N;
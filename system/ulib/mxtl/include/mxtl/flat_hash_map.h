@@ -0,0 +1,424 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <magenta/assert.h>
+#include <mxtl/macros.h>
+#include <mxtl/type_support.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// We don't want to force a dependency on a particular implementation
+// of placement new, and therefore cannot rely on a header providing a
+// declaration of it. So we just forward declare it here.
+void* operator new(size_t, void *ptr);
+
+namespace mxtl {
+
+// DefaultFlatHashMapTraits
+//
+// The traits used by a FlatHashMap to hash and compare its keys.  A traits
+// class must provide...
+//
+// GetHash : A static method which takes a constant reference to a key and
+//           returns a uint64_t hash of it.  The map scrambles the hash before
+//           using it, so simply returning an integer key is fine.
+// EqualTo : A static method which takes two keys and returns true if-and-only-
+//           if they are equal.
+//
+// The defaults handle integer and pointer keys.
+template <typename KeyType, typename Enable = void>
+struct DefaultFlatHashMapTraits;
+
+template <typename KeyType>
+struct DefaultFlatHashMapTraits<KeyType,
+                                typename enable_if<is_integral<KeyType>::value>::type> {
+    static uint64_t GetHash(const KeyType& key) { return static_cast<uint64_t>(key); }
+    static bool EqualTo(const KeyType& key1, const KeyType& key2) { return key1 == key2; }
+};
+
+template <typename T>
+struct DefaultFlatHashMapTraits<T*, void> {
+    static uint64_t GetHash(T* const& key) { return reinterpret_cast<uintptr_t>(key); }
+    static bool EqualTo(T* const& key1, T* const& key2) { return key1 == key2; }
+};
+
+// FlatHashMap<KeyType, ValueType, kInlineSlots, KeyTraits>
+//
+// An open addressed hash map which stores its entries in a flat array of
+// slots, rather than in per-entry nodes, and which keeps the first
+// kInlineSlots slots inside the map itself.  Maps which are usually small
+// (kInlineSlots slots hold up to 3/4 of kInlineSlots entries) never allocate,
+// and a lookup touches only the cache lines of the slots it probes.  Once a
+// map outgrows its slots, they move to a heap array, doubling in size each
+// time the map fills to 3/4.
+//
+// Collisions are resolved by linear probing, and erasing shifts any later
+// entries of the same run back into the hole, so no tombstones are left
+// behind and lookups never slow down as entries come and go.
+//
+// Values need only be move constructible, and the map itself can be moved,
+// but not copied.  Keys are copied into the map.  Operations which might have
+// to grow the map report failure if the allocation fails, leaving the map
+// unchanged.  Inserting or erasing may move other entries, so pointers to
+// values and iterators are only good until the map is next modified.
+//
+template <typename KeyType,
+          typename ValueType,
+          size_t   kInlineSlots = 8,
+          typename KeyTraits    = DefaultFlatHashMapTraits<KeyType>>
+class FlatHashMap {
+public:
+    static_assert((kInlineSlots >= 2) && !(kInlineSlots & (kInlineSlots - 1)),
+                  "FlatHashMaps need a power of two (>= 2) number of inline slots");
+
+    struct Entry {
+        const KeyType key;
+        ValueType value;
+    };
+
+private:
+    template <typename MapType, typename EntryType> class iterator_impl;
+
+public:
+    using iterator       = iterator_impl<FlatHashMap, Entry>;
+    using const_iterator = iterator_impl<const FlatHashMap, const Entry>;
+
+    FlatHashMap()
+        : entries_(inline_entries()),
+          used_(inline_used_),
+          shift_(ShiftFor(kInlineSlots)) {
+        for (size_t i = 0; i < kInlineSlots; ++i)
+            inline_used_[i] = 0;
+    }
+
+    FlatHashMap(FlatHashMap&& other) : FlatHashMap() {
+        MoveFrom(other);
+    }
+
+    FlatHashMap& operator=(FlatHashMap&& other) {
+        if (this != &other) {
+            reset();
+            MoveFrom(other);
+        }
+        return *this;
+    }
+
+    ~FlatHashMap() {
+        reset();
+    }
+
+    // move semantics only
+    DISALLOW_COPY_AND_ASSIGN_ALLOW_MOVE(FlatHashMap);
+
+    size_t size() const { return count_; }
+    size_t capacity() const { return capacity_; }
+    bool is_empty() const { return count_ == 0; }
+
+    // True while the entries are still stored inside the map.
+    bool is_inline() const { return entries_ == inline_entries(); }
+
+    iterator       begin()       { return iterator(this, 0); }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    iterator       end()         { return iterator(this, capacity_); }
+    const_iterator end() const   { return const_iterator(this, capacity_); }
+
+    // find
+    //
+    // Return a pointer to the value stored under |key|, or nullptr if there
+    // is none.
+    ValueType* find(const KeyType& key) {
+        size_t slot = Probe(key);
+        return used_[slot] ? &entries_[slot].value : nullptr;
+    }
+
+    const ValueType* find(const KeyType& key) const {
+        return const_cast<FlatHashMap*>(this)->find(key);
+    }
+
+    // insert
+    //
+    // Add |value| under |key|, which must not already be in the map.  Returns
+    // false if the map had to grow and could not.
+    bool insert(const KeyType& key, const ValueType& value) {
+        return InternalInsert(key, value);
+    }
+
+    bool insert(const KeyType& key, ValueType&& value) {
+        return InternalInsert(key, mxtl::move(value));
+    }
+
+    // insert_or_find
+    //
+    // Add |value| under |key| if |key| is not already in the map, returning
+    // true if it was added.  If |found| is non-null, it is set to point to the
+    // value now stored under |key|, or to nullptr if the map had to grow and
+    // could not.  |value| is left alone unless it was added.
+    bool insert_or_find(const KeyType& key, const ValueType& value, ValueType** found = nullptr) {
+        return InternalInsertOrFind(key, value, found);
+    }
+
+    bool insert_or_find(const KeyType& key, ValueType&& value, ValueType** found = nullptr) {
+        return InternalInsertOrFind(key, mxtl::move(value), found);
+    }
+
+    // erase
+    //
+    // Remove the entry for |key|, moving its value to |*value| first if
+    // |value| is non-null.  Returns false if there was no such entry.
+    bool erase(const KeyType& key, ValueType* value = nullptr) {
+        size_t slot = Probe(key);
+        if (!used_[slot])
+            return false;
+
+        if (value)
+            *value = mxtl::move(entries_[slot].value);
+        RemoveSlot(slot);
+        return true;
+    }
+
+    // reserve
+    //
+    // Make room for at least |count| entries without growing again.  Returns
+    // false if the allocation fails.
+    bool reserve(size_t count) {
+        size_t capacity = capacity_;
+        while (!Fits(count, capacity)) {
+            if (capacity > (SIZE_MAX >> 1))
+                return false;
+            capacity <<= 1;
+        }
+        return (capacity == capacity_) || Resize(capacity);
+    }
+
+    // clear : Remove all of the entries, keeping the storage.
+    void clear() {
+        for (size_t i = 0; (i < capacity_) && count_; ++i) {
+            if (used_[i]) {
+                entries_[i].~Entry();
+                used_[i] = 0;
+                --count_;
+            }
+        }
+    }
+
+    // reset : Remove all of the entries and give back any heap storage.
+    void reset() {
+        clear();
+        if (!is_inline()) {
+            ::free(entries_);
+            entries_  = inline_entries();
+            used_     = inline_used_;
+            capacity_ = kInlineSlots;
+            shift_    = ShiftFor(kInlineSlots);
+        }
+    }
+
+private:
+    static constexpr uint64_t kGoldenRatio = 0x9e3779b97f4a7c15u;
+
+    template <typename MapType, typename EntryType>
+    class iterator_impl {
+    public:
+        iterator_impl() { }
+
+        bool IsValid() const { return map_ && (slot_ < map_->capacity_); }
+        bool operator==(const iterator_impl& other) const { return slot_ == other.slot_; }
+        bool operator!=(const iterator_impl& other) const { return slot_ != other.slot_; }
+
+        iterator_impl& operator++() {
+            if (IsValid()) {
+                ++slot_;
+                SkipUnused();
+            }
+            return *this;
+        }
+
+        EntryType& operator*()  const { MX_DEBUG_ASSERT(IsValid()); return map_->entries_[slot_]; }
+        EntryType* operator->() const { MX_DEBUG_ASSERT(IsValid()); return &map_->entries_[slot_]; }
+
+    private:
+        friend class FlatHashMap;
+
+        iterator_impl(MapType* map, size_t slot) : map_(map), slot_(slot) {
+            SkipUnused();
+        }
+
+        void SkipUnused() {
+            while ((slot_ < map_->capacity_) && !map_->used_[slot_])
+                ++slot_;
+        }
+
+        MapType* map_ = nullptr;
+        size_t   slot_ = 0;
+    };
+
+    Entry* inline_entries() { return reinterpret_cast<Entry*>(inline_storage_); }
+    const Entry* inline_entries() const { return reinterpret_cast<const Entry*>(inline_storage_); }
+
+    static uint32_t ShiftFor(size_t capacity) {
+        return static_cast<uint32_t>(64 - __builtin_ctzll(capacity));
+    }
+
+    // Entries never fill more than 3/4 of the slots, so that runs stay short
+    // and there is always an empty slot to stop a probe.
+    static bool Fits(size_t count, size_t capacity) {
+        return (count * 4) <= (capacity * 3);
+    }
+
+    // The home slot of a key is taken from the top bits of its hash times the
+    // golden ratio, which spreads out keys (such as consecutive integers or
+    // aligned pointers) whose low bits are all alike.
+    size_t HomeSlot(const KeyType& key) const {
+        return static_cast<size_t>((KeyTraits::GetHash(key) * kGoldenRatio) >> shift_);
+    }
+
+    // Find the slot holding |key|, or the empty slot where it belongs.
+    size_t Probe(const KeyType& key) const {
+        size_t mask = capacity_ - 1;
+        size_t slot = HomeSlot(key);
+        while (used_[slot] && !KeyTraits::EqualTo(entries_[slot].key, key))
+            slot = (slot + 1) & mask;
+        return slot;
+    }
+
+    template <typename V>
+    bool InternalInsert(const KeyType& key, V&& value) {
+        ValueType* found;
+        bool inserted = InternalInsertOrFind(key, mxtl::forward<V>(value), &found);
+        MX_DEBUG_ASSERT(inserted || !found);
+        return inserted;
+    }
+
+    template <typename V>
+    bool InternalInsertOrFind(const KeyType& key, V&& value, ValueType** found) {
+        size_t slot = Probe(key);
+        if (!used_[slot]) {
+            if (!Fits(count_ + 1, capacity_)) {
+                if (!Resize(capacity_ << 1)) {
+                    if (found)
+                        *found = nullptr;
+                    return false;
+                }
+                slot = Probe(key);
+            }
+
+            new (&entries_[slot]) Entry{key, mxtl::forward<V>(value)};
+            used_[slot] = 1;
+            ++count_;
+
+            if (found)
+                *found = &entries_[slot].value;
+            return true;
+        }
+
+        if (found)
+            *found = &entries_[slot].value;
+        return false;
+    }
+
+    // Empty |slot|, then walk the rest of its run, moving back into the hole
+    // any entry whose probe from its home slot passes over the hole.
+    void RemoveSlot(size_t slot) {
+        size_t mask = capacity_ - 1;
+
+        entries_[slot].~Entry();
+        used_[slot] = 0;
+        --count_;
+
+        for (size_t next = (slot + 1) & mask; used_[next]; next = (next + 1) & mask) {
+            size_t home = HomeSlot(entries_[next].key);
+            if (((next - home) & mask) < ((next - slot) & mask))
+                continue;
+
+            new (&entries_[slot]) Entry(mxtl::move(entries_[next]));
+            entries_[next].~Entry();
+            used_[slot] = 1;
+            used_[next] = 0;
+            slot = next;
+        }
+    }
+
+    // Move the entries to a heap array of |capacity| slots.
+    bool Resize(size_t capacity) {
+        MX_DEBUG_ASSERT(Fits(count_, capacity));
+
+        if (capacity > SIZE_MAX / (sizeof(Entry) + 1))
+            return false;
+
+        // The entries come first in the allocation to keep them aligned,
+        // followed by a byte per slot saying whether it is in use.
+        uint8_t* mem = static_cast<uint8_t*>(::malloc(capacity * (sizeof(Entry) + 1)));
+        if (!mem)
+            return false;
+
+        Entry*   old_entries  = entries_;
+        uint8_t* old_used     = used_;
+        size_t   old_capacity = capacity_;
+
+        entries_  = reinterpret_cast<Entry*>(mem);
+        used_     = mem + (capacity * sizeof(Entry));
+        capacity_ = capacity;
+        shift_    = ShiftFor(capacity);
+        for (size_t i = 0; i < capacity; ++i)
+            used_[i] = 0;
+
+        for (size_t i = 0; i < old_capacity; ++i) {
+            if (!old_used[i])
+                continue;
+
+            size_t slot = Probe(old_entries[i].key);
+            new (&entries_[slot]) Entry(mxtl::move(old_entries[i]));
+            old_entries[i].~Entry();
+            used_[slot] = 1;
+        }
+
+        if (old_entries != inline_entries())
+            ::free(old_entries);
+        return true;
+    }
+
+    // Take the contents of |other|, leaving it empty.  This map must be empty
+    // and inline.
+    void MoveFrom(FlatHashMap& other) {
+        MX_DEBUG_ASSERT(is_inline() && is_empty());
+
+        if (other.is_inline()) {
+            // Same number of slots, so every entry belongs in the same slot.
+            for (size_t i = 0; i < kInlineSlots; ++i) {
+                if (other.used_[i]) {
+                    new (&entries_[i]) Entry(mxtl::move(other.entries_[i]));
+                    used_[i] = 1;
+                }
+            }
+            count_ = other.count_;
+            other.clear();
+        } else {
+            entries_  = other.entries_;
+            used_     = other.used_;
+            capacity_ = other.capacity_;
+            shift_    = other.shift_;
+            count_    = other.count_;
+
+            other.entries_  = other.inline_entries();
+            other.used_     = other.inline_used_;
+            other.capacity_ = kInlineSlots;
+            other.shift_    = ShiftFor(kInlineSlots);
+            other.count_    = 0;
+        }
+    }
+
+    Entry*   entries_;
+    uint8_t* used_;
+    size_t   capacity_ = kInlineSlots;
+    size_t   count_    = 0;
+    uint32_t shift_;
+
+    alignas(Entry) char inline_storage_[kInlineSlots * sizeof(Entry)];
+    uint8_t inline_used_[kInlineSlots];
+};
+
+}  // namespace mxtl
@@ -0,0 +1,221 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <magenta/assert.h>
+#include <mxtl/macros.h>
+#include <mxtl/type_support.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// We don't want to force a dependency on a particular implementation
+// of placement new, and therefore cannot rely on a header providing a
+// declaration of it. So we just forward declare it here.
+void* operator new(size_t, void *ptr);
+
+namespace mxtl {
+
+// InlineVector<T, N>
+//
+// A growable array which keeps its first N elements inside the object itself,
+// and only moves them out to the heap if more than that are ever added.  It is
+// the growable sibling of InlineArray, meant for collections which are almost
+// always small, such as the observers of an object or the handles of a
+// message.  Those are usually kept in a linked list or a separate heap array,
+// which costs an allocation and a pointer hop (and often a cache miss) per
+// access.  Inline, the elements share the cache lines of the object which
+// holds the vector, so pick N so that N * sizeof(T) fits in the line or two
+// which the rest of that object already occupies.
+//
+// Elements need only be move constructible, and the vector itself can be
+// moved, but not copied.  Operations which might have to grow the vector
+// return false, leaving it unchanged, if the allocation fails.  Growing moves
+// the elements, so pointers to them are only good until the next push_back,
+// emplace_back or reserve.
+//
+//   mxtl::InlineVector<mxtl::unique_ptr<Foo>, 4u> foos;
+//   if (!foos.push_back(mxtl::move(foo)))
+//       return MX_ERR_NO_MEMORY;
+//
+template <typename T, size_t N>
+class InlineVector {
+public:
+    static_assert(N > 0, "InlineVectors must have room for at least one element inline");
+
+    InlineVector() : ptr_(inline_elements()) {}
+
+    InlineVector(InlineVector&& other) : ptr_(inline_elements()) {
+        MoveFrom(other);
+    }
+
+    InlineVector& operator=(InlineVector&& other) {
+        if (this != &other) {
+            reset();
+            MoveFrom(other);
+        }
+        return *this;
+    }
+
+    ~InlineVector() {
+        reset();
+    }
+
+    // move semantics only
+    DISALLOW_COPY_AND_ASSIGN_ALLOW_MOVE(InlineVector);
+
+    size_t size() const { return count_; }
+    size_t capacity() const { return capacity_; }
+    bool is_empty() const { return count_ == 0; }
+
+    // True while the elements are still stored inside the vector.
+    bool is_inline() const { return ptr_ == inline_elements(); }
+
+    T* get() const { return ptr_; }
+    T* begin() const { return ptr_; }
+    T* end() const { return ptr_ + count_; }
+
+    T& operator[](size_t i) const {
+        MX_DEBUG_ASSERT(i < count_);
+        return ptr_[i];
+    }
+
+    T& front() const {
+        MX_DEBUG_ASSERT(count_ > 0);
+        return ptr_[0];
+    }
+
+    T& back() const {
+        MX_DEBUG_ASSERT(count_ > 0);
+        return ptr_[count_ - 1];
+    }
+
+    // reserve
+    //
+    // Make room for at least |capacity| elements.  Returns false if the
+    // allocation fails.
+    bool reserve(size_t capacity) {
+        if (capacity <= capacity_)
+            return true;
+
+        T* elements = Allocate(capacity);
+        if (!elements)
+            return false;
+
+        MoveElementsTo(elements, capacity);
+        return true;
+    }
+
+    bool push_back(const T& value) { return emplace_back(value); }
+    bool push_back(T&& value) { return emplace_back(mxtl::move(value)); }
+
+    // emplace_back
+    //
+    // Construct a new element at the end of the vector from |args|, growing
+    // it if need be.  Returns false if the vector had to grow and could not.
+    template <typename... Args>
+    bool emplace_back(Args&&... args) {
+        if (count_ < capacity_) {
+            new (&ptr_[count_]) T(mxtl::forward<Args>(args)...);
+            ++count_;
+            return true;
+        }
+
+        // Construct the new element in the new storage before moving the old
+        // ones over, in case |args| refers to one of them.
+        size_t capacity = capacity_ * 2;
+        T* elements = Allocate(capacity);
+        if (!elements)
+            return false;
+
+        new (&elements[count_]) T(mxtl::forward<Args>(args)...);
+        MoveElementsTo(elements, capacity);
+        ++count_;
+        return true;
+    }
+
+    void pop_back() {
+        MX_DEBUG_ASSERT(count_ > 0);
+        ptr_[--count_].~T();
+    }
+
+    // erase
+    //
+    // Remove the element at |index|, moving the elements after it down to
+    // fill the gap.
+    void erase(size_t index) {
+        MX_DEBUG_ASSERT(index < count_);
+        for (size_t i = index + 1; i < count_; ++i)
+            ptr_[i - 1] = mxtl::move(ptr_[i]);
+        pop_back();
+    }
+
+    // clear : Destroy all of the elements, keeping the storage.
+    void clear() {
+        while (count_)
+            pop_back();
+    }
+
+    // reset : Destroy all of the elements and give back any heap storage.
+    void reset() {
+        clear();
+        if (!is_inline()) {
+            ::free(ptr_);
+            ptr_ = inline_elements();
+            capacity_ = N;
+        }
+    }
+
+private:
+    T* inline_elements() { return reinterpret_cast<T*>(inline_storage_); }
+    const T* inline_elements() const { return reinterpret_cast<const T*>(inline_storage_); }
+
+    static T* Allocate(size_t capacity) {
+        if (capacity > SIZE_MAX / sizeof(T))
+            return nullptr;
+        return static_cast<T*>(::malloc(capacity * sizeof(T)));
+    }
+
+    // Move the elements into |elements|, which has room for |capacity|, and
+    // make it the vector's storage.
+    void MoveElementsTo(T* elements, size_t capacity) {
+        for (size_t i = 0; i < count_; ++i) {
+            new (&elements[i]) T(mxtl::move(ptr_[i]));
+            ptr_[i].~T();
+        }
+
+        if (!is_inline())
+            ::free(ptr_);
+        ptr_ = elements;
+        capacity_ = capacity;
+    }
+
+    // Take the contents of |other|, leaving it empty.  This vector must be
+    // empty and inline.
+    void MoveFrom(InlineVector& other) {
+        MX_DEBUG_ASSERT(is_inline() && is_empty());
+
+        if (other.is_inline()) {
+            for (size_t i = 0; i < other.count_; ++i)
+                new (&ptr_[i]) T(mxtl::move(other.ptr_[i]));
+            count_ = other.count_;
+            other.clear();
+        } else {
+            ptr_ = other.ptr_;
+            count_ = other.count_;
+            capacity_ = other.capacity_;
+            other.ptr_ = other.inline_elements();
+            other.count_ = 0;
+            other.capacity_ = N;
+        }
+    }
+
+    T* ptr_;
+    size_t count_ = 0;
+    size_t capacity_ = N;
+    alignas(T) char inline_storage_[N * sizeof(T)];
+};
+
+}  // namespace mxtl
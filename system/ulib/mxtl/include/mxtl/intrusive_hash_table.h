@@ -9,6 +9,12 @@
 #include <mxtl/intrusive_pointer_traits.h>
 #include <mxtl/intrusive_single_list.h>
 #include <mxtl/macros.h>
+#include <stdlib.h>
+
+// Demand that the project using us has a definition of the
+// bring-your-own-memory, non-array, placement new operator.  We don't want to
+// demand a specific implementation, just that one exists.
+void* operator new(size_t sz, void *ptr);
 
 namespace mxtl {
 
@@ -19,6 +25,42 @@ class HashTableChecker;
 }  // namespace tests
 }  // namespace intrusive_containers
 
+// Passing kDynamicHashTableBuckets as the NumBuckets parameter of a HashTable
+// makes a hash table which grows its bucket array to keep up with the number
+// of elements in it, instead of having a fixed number of buckets.
+//
+// Dynamic hash tables start with 16 buckets and use linear hashing to grow.
+// Each insert which takes the table past an average of one element per bucket
+// splits a single bucket in two, so the cost of rehashing is spread over the
+// inserts instead of being paid all at once.  Buckets are selected by masking
+// the hash with a power of two, so the hash function must mix its low bits
+// well.  Hash traits of dynamic tables return the full hash of a key, not a
+// bucket index, and the tables never shrink (clear() leaves the buckets in
+// place).
+//
+// Note: Unlike fixed-size hash tables, inserting into a dynamic hash table may
+// move elements between buckets, invalidating all iterators into the table.
+// Erasing an element only invalidates iterators to that element.
+constexpr size_t kDynamicHashTableBuckets = 0;
+
+namespace internal {
+
+// Reduces a hash value to a bucket index for DefaultHashTraits.  Dynamic
+// tables keep the whole hash and select their buckets themselves.
+template <typename HashType, HashType kNumBuckets, bool = (kNumBuckets == 0)>
+struct DefaultHashReducer {
+    template <typename T>
+    static HashType Reduce(const T& hash) { return static_cast<HashType>(hash % kNumBuckets); }
+};
+
+template <typename HashType, HashType kNumBuckets>
+struct DefaultHashReducer<HashType, kNumBuckets, true> {
+    template <typename T>
+    static HashType Reduce(const T& hash) { return static_cast<HashType>(hash); }
+};
+
+}  // namespace internal
+
 // DefaultHashTraits defines a default implementation of traits used to
 // define the hash function for a hash table.
 //
@@ -28,7 +70,8 @@ class HashTableChecker;
 // GetHash : A static method which take a constant reference to an instance of
 //           the container's KeyType and returns an instance of the container's
 //           HashType representing the hashed value of the key.  The value must
-//           be on the range from [0, Container::kNumBuckets - 1]
+//           be on the range from [0, Container::kNumBuckets - 1], or may be
+//           any value at all for dynamic (kDynamicHashTableBuckets) tables.
 //
 // DefaultHashTraits generates a compliant implementation of hash traits taking
 // its KeyType, ObjType, HashType and NumBuckets from template parameters.
@@ -46,10 +89,164 @@ template <typename KeyType,
 struct DefaultHashTraits {
     static_assert(is_unsigned_integer<HashType>::value, "HashTypes must be unsigned integers");
     static HashType GetHash(const KeyType& key) {
-        return static_cast<HashType>(ObjType::GetHash(key) % kNumBuckets);
+        return internal::DefaultHashReducer<HashType, kNumBuckets>::Reduce(ObjType::GetHash(key));
+    }
+};
+
+namespace internal {
+
+// The bucket storage of a HashTable with a fixed number of buckets.
+template <typename BucketType,
+          typename HashType,
+          HashType kNumBuckets,
+          bool = (kNumBuckets == 0)>
+class HashTableBuckets {
+public:
+    constexpr HashTableBuckets() {}
+
+    size_t size() const { return kNumBuckets; }
+
+    BucketType&       operator[](size_t ndx)       { return buckets_[ndx]; }
+    const BucketType& operator[](size_t ndx) const { return buckets_[ndx]; }
+
+    // The hash traits of fixed-size tables return bucket indices directly.
+    HashType IndexOf(HashType hash) const {
+        MX_DEBUG_ASSERT((hash >= 0) && (hash < kNumBuckets));
+        return hash;
+    }
+
+    template <typename GetHashFn>
+    void Grow(size_t count, GetHashFn get_hash) { }
+
+private:
+    BucketType buckets_[kNumBuckets];
+};
+
+// The bucket storage of a dynamic HashTable.
+//
+// The buckets are kept in segments which double in size, so that existing
+// buckets never move.  The first segment is part of the table, and each later
+// one is allocated when the table first needs it.  The table has
+// (kInitialBuckets << level_) + split_ buckets.  Buckets below split_ have
+// already been split during this level and are selected with one more bit of
+// the hash than the rest.
+template <typename BucketType, typename HashType, HashType kNumBuckets>
+class HashTableBuckets<BucketType, HashType, kNumBuckets, true> {
+public:
+    constexpr HashTableBuckets() {}
+
+    ~HashTableBuckets() {
+        for (size_t seg = 1; seg < countof(segments_); ++seg) {
+            if (segments_[seg] == nullptr)
+                break;
+
+            size_t seg_size = SegmentSize(seg);
+            for (size_t i = 0; i < seg_size; ++i)
+                segments_[seg][i].~BucketType();
+            ::free(segments_[seg]);
+        }
+    }
+
+    size_t size() const { return (kInitialBuckets << level_) + split_; }
+
+    BucketType& operator[](size_t ndx) {
+        if (ndx < kInitialBuckets)
+            return first_segment_[ndx];
+
+        size_t seg = SegmentOf(ndx);
+        return segments_[seg][ndx - SegmentSize(seg)];
+    }
+
+    const BucketType& operator[](size_t ndx) const {
+        return const_cast<HashTableBuckets*>(this)->operator[](ndx);
+    }
+
+    HashType IndexOf(HashType hash) const {
+        size_t level_size = kInitialBuckets << level_;
+        size_t ndx = hash & (level_size - 1);
+        if (ndx < split_)
+            ndx = hash & ((level_size << 1) - 1);
+        return static_cast<HashType>(ndx);
+    }
+
+    // Split one bucket if the table has more elements than buckets.
+    template <typename GetHashFn>
+    void Grow(size_t count, GetHashFn get_hash) {
+        if ((count <= size()) || (level_ > kMaxLevel))
+            return;
+
+        // Starting a new level needs the segment its new buckets go in.  If
+        // that can't be had right now, keep the chains a bit longer and try
+        // again on the next insert.
+        size_t seg = level_ + 1;
+        if ((split_ == 0) && (segments_[seg] == nullptr)) {
+            size_t seg_size = SegmentSize(seg);
+            void* mem = ::malloc(seg_size * sizeof(BucketType));
+            if (mem == nullptr)
+                return;
+
+            BucketType* segment = static_cast<BucketType*>(mem);
+            for (size_t i = 0; i < seg_size; ++i)
+                new (&segment[i]) BucketType();
+            segments_[seg] = segment;
+        }
+
+        size_t level_size = kInitialBuckets << level_;
+        HashType mask = static_cast<HashType>((level_size << 1) - 1);
+        BucketType& from = (*this)[split_];
+        BucketType& to = (*this)[level_size + split_];
+
+        BucketType splitting;
+        splitting.swap(from);
+        while (!splitting.is_empty()) {
+            auto ptr = splitting.pop_front();
+            if ((get_hash(*ptr) & mask) == split_)
+                from.push_front(mxtl::move(ptr));
+            else
+                to.push_front(mxtl::move(ptr));
+        }
+
+        if (++split_ == level_size) {
+            split_ = 0;
+            ++level_;
+        }
+    }
+
+private:
+    static constexpr size_t kInitialBucketsShift = 4;
+    static constexpr size_t kInitialBuckets = 1u << kInitialBucketsShift;
+
+    // Stop growing once the table has as many buckets as there are hash values
+    // (or 2^31 buckets, whichever comes first).
+    static constexpr size_t kHashBits = sizeof(HashType) * 8;
+    static constexpr size_t kMaxLevel = ((kHashBits < 32) ? kHashBits : 32)
+                                      - kInitialBucketsShift - 1;
+
+    static_assert(kHashBits > kInitialBucketsShift,
+                  "HashType is too small for a dynamic hash table");
+
+    // Segment 0 holds buckets [0, kInitialBuckets), and segment n (n > 0)
+    // holds buckets [kInitialBuckets << (n - 1), kInitialBuckets << n).
+    static size_t SegmentSize(size_t seg) {
+        return kInitialBuckets << (seg - 1);
     }
+
+    static size_t SegmentOf(size_t ndx) {
+        size_t log2 = (sizeof(unsigned long long) * 8 - 1) -
+                      __builtin_clzll(static_cast<unsigned long long>(ndx));
+        return log2 - kInitialBucketsShift + 1;
+    }
+
+    DISALLOW_COPY_ASSIGN_AND_MOVE(HashTableBuckets);
+
+    size_t      level_ = 0;
+    size_t      split_ = 0;
+    BucketType  first_segment_[kInitialBuckets];
+    BucketType* segments_[kMaxLevel + 2] = { nullptr };
 };
 
+}  // namespace internal
+
 template <typename  _KeyType,
           typename  _PtrType,
           typename  _BucketType = SinglyLinkedList<_PtrType>,
@@ -100,7 +297,10 @@ public:
     // The number of buckets should be a nice prime such as 37, 211, 389 unless
     // The hash function is really good. Lots of cheap hash functions have
     // hidden periods for which the mod with prime above 'mostly' fixes.
+    //
+    // kDynamicHashTableBuckets (0) selects a table which grows as needed.
     static constexpr HashType kNumBuckets = _NumBuckets;
+    static constexpr bool IsDynamic = (kNumBuckets == kDynamicHashTableBuckets);
 
     // Hash tables only support constant order erase if their underlying bucket
     // type does.
@@ -109,7 +309,6 @@ public:
     static constexpr bool IsAssociative = true;
     static constexpr bool IsSequenced = false;
 
-    static_assert(kNumBuckets > 0, "Hash tables must have at least one bucket");
     static_assert(is_unsigned_integer<HashType>::value, "HashTypes must be unsigned integers");
 
     constexpr HashTable() {}
@@ -126,7 +325,7 @@ public:
 
     // make_iterator : construct an iterator out of a reference to an object.
     iterator make_iterator(ValueType& obj) {
-        HashType ndx = GetHash(KeyTraits::GetKey(obj));
+        HashType ndx = GetBucketIndex(KeyTraits::GetKey(obj));
         return iterator(this, ndx, buckets_[ndx].make_iterator(obj));
     }
 
@@ -144,6 +343,7 @@ public:
 
         bucket.push_front(mxtl::move(ptr));
         ++count_;
+        Grow();
     }
 
     // insert_or_find
@@ -165,7 +365,7 @@ public:
     bool insert_or_find(PtrType&& ptr, iterator* iter = nullptr) {
         MX_DEBUG_ASSERT(ptr != nullptr);
         KeyType  key         = KeyTraits::GetKey(*ptr);
-        HashType ndx         = GetHash(key);
+        HashType ndx         = GetBucketIndex(key);
         auto&    bucket      = buckets_[ndx];
         auto     bucket_iter = FindInBucket(bucket, key);
 
@@ -176,12 +376,20 @@ public:
 
         bucket.push_front(mxtl::move(ptr));
         ++count_;
-        if (iter) *iter = iterator(this, ndx, bucket.begin());
+
+        // Growing may move the element we just inserted, so find it again if
+        // the caller wants an iterator to it.
+        if (IsDynamic) {
+            Grow();
+            if (iter) *iter = find(key);
+        } else {
+            if (iter) *iter = iterator(this, ndx, bucket.begin());
+        }
         return true;
     }
 
     iterator find(const KeyType& key) {
-        HashType ndx         = GetHash(key);
+        HashType ndx         = GetBucketIndex(key);
         auto&    bucket      = buckets_[ndx];
         auto     bucket_iter = FindInBucket(bucket, key);
 
@@ -190,7 +398,7 @@ public:
     }
 
     const_iterator find(const KeyType& key) const {
-        HashType    ndx         = GetHash(key);
+        HashType    ndx         = GetBucketIndex(key);
         const auto& bucket      = buckets_[ndx];
         auto        bucket_iter = FindInBucket(bucket, key);
 
@@ -225,8 +433,8 @@ public:
     // this will release all references held by the hashtable to the objects
     // which were in it.
     void clear() {
-        for (auto& e : buckets_)
-            e.clear();
+        for (size_t i = 0; i < buckets_.size(); ++i)
+            buckets_[i].clear();
         count_ = 0;
     }
 
@@ -239,8 +447,8 @@ public:
         static_assert(PtrTraits::IsManaged == false,
                      "clear_unsafe is not allowed for containers of managed pointers");
 
-        for (auto& e : buckets_)
-            e.clear_unsafe();
+        for (size_t i = 0; i < buckets_.size(); ++i)
+            buckets_[i].clear_unsafe();
 
         count_ = 0;
     }
@@ -248,6 +456,10 @@ public:
     size_t size()      const { return count_; }
     bool   is_empty()  const { return count_ == 0; }
 
+    // The number of buckets the table currently has.  Always kNumBuckets for
+    // fixed-size tables.
+    size_t bucket_count() const { return buckets_.size(); }
+
     // erase_if
     //
     // Find the first member of the hash table which satisfies the predicate
@@ -259,7 +471,7 @@ public:
         if (is_empty())
             return PtrType(nullptr);
 
-        for (HashType i = 0; i < kNumBuckets; ++i) {
+        for (size_t i = 0; i < buckets_.size(); ++i) {
             auto& bucket = buckets_[i];
             if (!bucket.is_empty()) {
                 PtrType ret = bucket.erase_if(fn);
@@ -379,7 +591,7 @@ private:
 
             // Looks like we have backed up past the beginning.  Update the
             // bookkeeping to point at the end of the last bucket.
-            bucket_ndx_ = kNumBuckets - 1;
+            bucket_ndx_ = LastBucket();
             iter_ = IterTraits::BucketEnd(GetBucket(bucket_ndx_));
 
             return *this;
@@ -418,8 +630,8 @@ private:
 
         iterator_impl(const ContainerType* hash_table, EndTag)
             : hash_table_(hash_table),
-              bucket_ndx_(kNumBuckets - 1),
-              iter_(IterTraits::BucketEnd(GetBucket(kNumBuckets - 1))) { }
+              bucket_ndx_(LastBucket()),
+              iter_(IterTraits::BucketEnd(GetBucket(bucket_ndx_))) { }
 
         iterator_impl(const ContainerType* hash_table, HashType bucket_ndx, const IterType& iter)
             : hash_table_(hash_table),
@@ -430,11 +642,16 @@ private:
             return const_cast<ContainerType*>(hash_table_)->buckets_[ndx];
         }
 
+        HashType LastBucket() const {
+            return static_cast<HashType>(hash_table_->buckets_.size() - 1);
+        }
+
         void advance_if_invalid_iter() {
             // If the iterator has run off the end of it's current bucket, then
             // check to see if there are nodes in any of the remaining buckets.
             if (!iter_.IsValid()) {
-                while (bucket_ndx_ < (kNumBuckets - 1)) {
+                HashType last = LastBucket();
+                while (bucket_ndx_ < last) {
                     ++bucket_ndx_;
                     auto& bucket = GetBucket(bucket_ndx_);
 
@@ -442,7 +659,7 @@ private:
                         iter_ = IterTraits::BucketBegin(bucket);
                         MX_DEBUG_ASSERT(iter_.IsValid());
                         break;
-                    } else if (bucket_ndx_ == (kNumBuckets - 1)) {
+                    } else if (bucket_ndx_ == last) {
                         iter_ = IterTraits::BucketEnd(bucket);
                     }
                 }
@@ -489,17 +706,21 @@ private:
     // Hash tables may not currently be copied, assigned or moved.
     DISALLOW_COPY_ASSIGN_AND_MOVE(HashTable);
 
-    BucketType& GetBucket(const KeyType& key) { return buckets_[GetHash(key)]; }
+    BucketType& GetBucket(const KeyType& key) { return buckets_[GetBucketIndex(key)]; }
     BucketType& GetBucket(const ValueType& obj) { return GetBucket(KeyTraits::GetKey(obj)); }
 
-    static HashType GetHash(const KeyType& obj) {
-        HashType ret = HashTraits::GetHash(obj);
-        MX_DEBUG_ASSERT((ret >= 0) && (ret < kNumBuckets));
-        return ret;
+    HashType GetBucketIndex(const KeyType& key) const {
+        return buckets_.IndexOf(HashTraits::GetHash(key));
+    }
+
+    void Grow() {
+        buckets_.Grow(count_, [](const ValueType& obj) -> HashType {
+            return HashTraits::GetHash(KeyTraits::GetKey(obj));
+        });
     }
 
     size_t count_ = 0UL;
-    BucketType buckets_[kNumBuckets];
+    internal::HashTableBuckets<BucketType, HashType, kNumBuckets> buckets_;
 };
 
 // Explicit declaration of constexpr storage.  Appologies for the macro, but the
@@ -511,6 +732,7 @@ constexpr _type HashTable<KeyType, PtrType, BucketType, HashType, \
                           NumBuckets, KeyTraits, HashTraits>::_name
 
 HASH_TABLE_PROP(HashType, kNumBuckets);
+HASH_TABLE_PROP(bool, IsDynamic);
 HASH_TABLE_PROP(bool, SupportsConstantOrderErase);
 HASH_TABLE_PROP(bool, SupportsConstantOrderSize);
 HASH_TABLE_PROP(bool, IsAssociative);
@@ -57,6 +57,22 @@
 // (AKA, erase operations where the reference to the element to be erased is
 // already known) run in amortized constant time.
 //
+// A few bulk operations are also supported, each of which links or unlinks
+// many elements while rebalancing the tree only once.
+// build_sorted(count, next) : Fills an empty tree from elements supplied in
+//                             increasing key order, in O(n) time.
+// join(other)               : Moves all of the elements of a tree whose keys
+//                             are entirely above (or below) this tree's into
+//                             this tree, in O(log) time.
+// split(key, upper)         : Moves all of the elements whose keys are >= key
+//                             into another tree, in O(log) time plus the time
+//                             it takes to count the smaller of the two halves.
+// erase_range(first, last)  : Removes the elements in [first, last) in O(log)
+//                             time, plus O(1) for each element removed.
+//
+// Observers which augment the tree using RecordSubtreeChanged (see
+// intrusive_wavl_tree_internal.h) are kept up to date by all of these.
+//
 namespace mxtl {
 
 template <typename PtrType, typename RankType>
@@ -79,6 +95,7 @@ struct WAVLTreeNodeState<PtrType, bool> : public WAVLTreeNodeStateBase<PtrType,
     void double_promote_rank() { }
     void demote_rank()         { this->rank_ = !this->rank_; }
     void double_demote_rank()  { }
+    void set_rank(int32_t rank) { this->rank_ = ((rank & 0x1) != 0); }
 };
 
 template <typename PtrType, typename RankType = bool>
@@ -183,6 +200,11 @@ public:
     // make_iterator : construct an iterator out of a pointer to an object
     iterator make_iterator(ValueType& obj) { return iterator(&obj); }
 
+    // root : the object at the root of the tree, or nullptr if the tree is
+    // empty.  Only useful to code which walks the shape of the tree itself,
+    // such as a search over per-subtree data maintained by an Observer.
+    RawPtrType root() const { return PtrTraits::IsValid(root_) ? PtrTraits::GetRaw(root_) : nullptr; }
+
     // is_empty : True if the tree has at least one element in it, false otherwise.
     bool is_empty() const { return root_ == nullptr; }
 
@@ -450,6 +472,165 @@ public:
         return iterator(citer.node_);
     }
 
+    // build_sorted
+    //
+    // Fill an empty tree with |count| elements, obtained by calling |next|
+    // (which returns a PtrType) once for each, in strictly increasing key
+    // order.  Rather than inserting the elements one at a time, which would
+    // take O(n log) time, the tree is linked together directly in its final,
+    // balanced, shape in O(n) time without comparing any keys.
+    template <typename PtrSource>
+    void build_sorted(size_t count, PtrSource next) {
+        MX_DEBUG_ASSERT(is_empty());
+
+        int32_t rank;
+        RawPtrType prev = nullptr;
+        SetRoot(BuildSubtree(count, next, &rank, &prev), count);
+    }
+
+    // join
+    //
+    // Move all of the elements of |other| into this tree, leaving |other|
+    // empty.  Every key in |other| must be greater than every key in this
+    // tree, or less than all of them.  The two trees are joined at a single
+    // point and rebalanced once, which takes O(log) time, instead of the O(n
+    // log) it would take to move the elements one at a time.
+    void join(WAVLTree& other) {
+        MX_DEBUG_ASSERT(&other != this);
+
+        if (other.is_empty())
+            return;
+
+        if (is_empty()) {
+            swap(other);
+            return;
+        }
+
+        WAVLTree* lo = this;
+        WAVLTree* hi = &other;
+        if (KeyTraits::LessThan(KeyTraits::GetKey(*other.right_most_),
+                                KeyTraits::GetKey(*left_most_))) {
+            lo = &other;
+            hi = this;
+        }
+        MX_DEBUG_ASSERT(KeyTraits::LessThan(KeyTraits::GetKey(*lo->right_most_),
+                                            KeyTraits::GetKey(*hi->left_most_)));
+
+        // The smallest element of the upper tree becomes the node which ties
+        // the two together.
+        PtrType    node  = hi->pop_front();
+        size_t     count = lo->count_ + hi->count_ + 1;
+        RawPtrType hi_most = hi->is_empty() ? PtrTraits::GetRaw(node) : hi->right_most_;
+        MX_DEBUG_ASSERT(!PtrTraits::IsSentinel(hi_most));
+
+        PtrType lo_root = lo->TakeRoot();
+        PtrType hi_root = hi->TakeRoot();
+        int32_t lo_rank = SubtreeRank(PtrTraits::GetRaw(lo_root));
+        int32_t hi_rank = SubtreeRank(PtrTraits::GetRaw(hi_root));
+
+        InternalJoin(mxtl::move(lo_root), lo_rank,
+                     mxtl::move(node),
+                     mxtl::move(hi_root), hi_rank);
+        SetRoot(PtrTraits::Take(root_), count);
+        MX_DEBUG_ASSERT(right_most_ == hi_most);
+    }
+
+    // split
+    //
+    // Move all of the elements whose keys are greater than or equal to |key|
+    // into |upper|, which must be empty.  The tree is cut along the search
+    // path for |key| and both halves are rebalanced in O(log) time.  Keeping
+    // the sizes of the two halves up to date takes time proportional to the
+    // smaller of the two; see erase_range for removing a range without that
+    // cost.
+    void split(const KeyType& key, WAVLTree* upper) {
+        MX_DEBUG_ASSERT(upper && (upper != this) && upper->is_empty());
+
+        size_t  count = count_;
+        PtrType lo, hi;
+        InternalSplit(TakeRoot(), key, &lo, &hi);
+        SetRoot(mxtl::move(lo), 0);
+        upper->SetRoot(mxtl::move(hi), 0);
+
+        // Count the smaller half by walking both halves in step until one of
+        // them runs out.
+        size_t n = 0;
+        auto lo_iter = begin();
+        auto hi_iter = upper->begin();
+        while ((lo_iter != end()) && (hi_iter != upper->end())) {
+            ++lo_iter;
+            ++hi_iter;
+            ++n;
+        }
+
+        count_        = (lo_iter == end()) ? n : count - n;
+        upper->count_ = count - count_;
+    }
+
+    // erase_range
+    //
+    // Remove the elements in the range [first, last) from the tree and return
+    // the number of elements removed.  If |removed| is non-null, it must be an
+    // empty tree, and the elements are moved into it.  Otherwise they are
+    // unlinked as they would be by clear(), releasing any references the tree
+    // held to them.
+    //
+    // The range is cut out of the tree with two splits and what remains is
+    // joined back together, so the tree is rebalanced once in O(log) time
+    // rather than once per element.  Unlinking the removed elements takes
+    // O(k) time, where k is the number of elements removed.
+    size_t erase_range(const iterator& first, const iterator& last,
+                       WAVLTree* removed = nullptr) {
+        MX_DEBUG_ASSERT(!removed || ((removed != this) && removed->is_empty()));
+
+        if (!first.IsValid() || (first == last))
+            return 0;
+
+        size_t  count = count_;
+        PtrType lo, mid, hi;
+        InternalSplit(TakeRoot(), KeyTraits::GetKey(*first), &lo, &mid);
+        if (last.IsValid()) {
+            PtrType rest = mxtl::move(mid);
+            InternalSplit(mxtl::move(rest), KeyTraits::GetKey(*last), &mid, &hi);
+        }
+
+        WAVLTree range;
+        WAVLTree& target = removed ? *removed : range;
+        target.SetRoot(mxtl::move(mid), 0);
+        for (auto iter = target.begin(); iter != target.end(); ++iter)
+            ++target.count_;
+
+        size_t erased = target.count_;
+        range.clear();
+
+        // Put what is left back together, using the smallest of the elements
+        // above the range to join the two halves.
+        if (PtrTraits::IsValid(hi)) {
+            PtrType node;
+            auto& hi_ns = NodeTraits::node_state(*hi);
+            if ((hi_ns.left_ == nullptr) && (hi_ns.right_ == nullptr)) {
+                node = mxtl::move(hi);
+            } else {
+                // There are at least two elements above the range, so giving
+                // this tree a count which is too large will not upset the
+                // bookkeeping in pop_front.
+                SetRoot(mxtl::move(hi), count - erased);
+                node = pop_front();
+                hi   = TakeRoot();
+            }
+
+            int32_t lo_rank = SubtreeRank(PtrTraits::GetRaw(lo));
+            int32_t hi_rank = SubtreeRank(PtrTraits::GetRaw(hi));
+            InternalJoin(mxtl::move(lo), lo_rank,
+                         mxtl::move(node),
+                         mxtl::move(hi), hi_rank);
+            lo = PtrTraits::Take(root_);
+        }
+
+        SetRoot(mxtl::move(lo), count - erased);
+        return erased;
+    }
+
 private:
     // The traits of a non-const iterator
     struct iterator_traits {
@@ -666,6 +847,7 @@ private:
 
             ++count_;
             Observer::RecordInsert();
+            Observer::template RecordSubtreeChanged<ContainerType>(PtrTraits::GetRaw(root_));
             return;
         }
 
@@ -741,6 +923,7 @@ private:
 
         ++count_;
         Observer::RecordInsert();
+        RecordSubtreeChangedToRoot(PtrTraits::GetRaw(*owner));
 
         // Finally, perform post-insert balance operations.
         BalancePostInsert(PtrTraits::GetRaw(*owner));
@@ -881,6 +1064,8 @@ private:
         // Update the count bookkeeping.
         --count_;
         Observer::RecordErase();
+        if (!PtrTraits::IsSentinel(parent))
+            RecordSubtreeChangedToRoot(parent);
 
         // Time to rebalance.  We know that we don't need to rebalance if we
         // just removed the root (IOW - its parent was the sentinel value).
@@ -943,6 +1128,307 @@ private:
         return const_iterator(found);
     }
 
+    // The bulk operations (build_sorted, join, split and erase_range) work on
+    // bare subtrees whose extremes are terminated with nullptr instead of the
+    // sentinel values.  TakeRoot detaches a tree's sentinels and hands back its
+    // root, leaving the tree empty.  SetRoot does the reverse for an empty
+    // tree, finding the new left and right-most nodes in the process.
+    PtrType TakeRoot() {
+        if (is_empty())
+            return PtrType(nullptr);
+
+        PtrTraits::DetachSentinel(NodeTraits::node_state(*left_most_).left_);
+        PtrTraits::DetachSentinel(NodeTraits::node_state(*right_most_).right_);
+        left_most_  = sentinel();
+        right_most_ = sentinel();
+        count_      = 0;
+
+        return PtrTraits::Take(root_);
+    }
+
+    void SetRoot(PtrType root, size_t count) {
+        MX_DEBUG_ASSERT(is_empty());
+
+        count_ = count;
+        if (!PtrTraits::IsValid(root))
+            return;
+
+        RawPtrType left_most = PtrTraits::GetRaw(root);
+        while (PtrTraits::IsValid(NodeTraits::node_state(*left_most).left_))
+            left_most = PtrTraits::GetRaw(NodeTraits::node_state(*left_most).left_);
+
+        RawPtrType right_most = PtrTraits::GetRaw(root);
+        while (PtrTraits::IsValid(NodeTraits::node_state(*right_most).right_))
+            right_most = PtrTraits::GetRaw(NodeTraits::node_state(*right_most).right_);
+
+        NodeTraits::node_state(*root).parent_ = sentinel();
+        root_ = mxtl::move(root);
+
+        left_most_  = left_most;
+        right_most_ = right_most;
+        NodeTraits::node_state(*left_most_).left_   = PtrTraits::MakeSentinel(this);
+        NodeTraits::node_state(*right_most_).right_ = PtrTraits::MakeSentinel(this);
+    }
+
+    // SubtreeRank
+    //
+    // Only the rank parity of a node is stored, but the rank itself can be
+    // recovered by walking down to the bottom of the subtree and back up.  A
+    // null child has rank -1, and every step up from a child adds 1 when the
+    // parities differ and 2 when they match.  Returns -1 for an empty subtree.
+    static int32_t SubtreeRank(RawPtrType root) {
+        if (!PtrTraits::IsValid(root))
+            return -1;
+
+        RawPtrType node = root;
+        while (PtrTraits::IsValid(NodeTraits::node_state(*node).left_))
+            node = PtrTraits::GetRaw(NodeTraits::node_state(*node).left_);
+
+        int32_t rank = NodeTraits::node_state(*node).rank_parity() ? 1 : 0;
+        while (node != root) {
+            RawPtrType parent = NodeTraits::node_state(*node).parent_;
+            rank += (NodeTraits::node_state(*parent).rank_parity() ==
+                     NodeTraits::node_state(*node).rank_parity()) ? 2 : 1;
+            node = parent;
+        }
+
+        return rank;
+    }
+
+    // BuildSubtree
+    //
+    // Link the next |count| elements produced by |next| into a perfectly
+    // balanced subtree and return its root.  The sizes of the left and right
+    // subtrees of every node differ by at most one, so the same goes for their
+    // heights, and using each node's height as its rank gives a valid (AVL
+    // shaped) WAVL tree.
+    template <typename PtrSource>
+    PtrType BuildSubtree(size_t count, PtrSource& next, int32_t* rank, RawPtrType* prev) {
+        if (!count) {
+            *rank = -1;
+            return PtrType(nullptr);
+        }
+
+        int32_t left_rank, right_rank;
+        size_t  left_count = (count - 1) >> 1;
+        PtrType left = BuildSubtree(left_count, next, &left_rank, prev);
+
+        PtrType node = next();
+        MX_DEBUG_ASSERT(PtrTraits::IsValid(node));
+        MX_DEBUG_ASSERT(!*prev || KeyTraits::LessThan(KeyTraits::GetKey(**prev),
+                                                      KeyTraits::GetKey(*node)));
+        *prev = PtrTraits::GetRaw(node);
+
+        PtrType right = BuildSubtree(count - left_count - 1, next, &right_rank, prev);
+
+        auto& ns = NodeTraits::node_state(*node);
+        MX_DEBUG_ASSERT(ns.IsValid() && !ns.InContainer());
+
+        if (PtrTraits::IsValid(left))
+            NodeTraits::node_state(*left).parent_ = PtrTraits::GetRaw(node);
+        if (PtrTraits::IsValid(right))
+            NodeTraits::node_state(*right).parent_ = PtrTraits::GetRaw(node);
+        ns.left_  = mxtl::move(left);
+        ns.right_ = mxtl::move(right);
+
+        *rank = ((left_rank > right_rank) ? left_rank : right_rank) + 1;
+        ns.set_rank(*rank);
+
+        Observer::RecordInsert();
+        Observer::template RecordSubtreeChanged<ContainerType>(PtrTraits::GetRaw(node));
+        return node;
+    }
+
+    // InternalJoin
+    //
+    // Join the bare subtrees lo and hi, whose ranks are lo_rank and hi_rank,
+    // using the unlinked node in between them, leaving the result as the root
+    // of this (otherwise empty, and without sentinels) tree.  Returns the rank
+    // of the joined tree.
+    //
+    // If the ranks of the two subtrees are within one of each other, node
+    // simply becomes their parent.  Otherwise, node is linked into the side of
+    // the taller subtree facing the shorter one, with the shorter subtree as
+    // one of its children, and the tree is rebalanced from there.  This takes
+    // time proportional to the difference between the ranks.
+    int32_t InternalJoin(PtrType lo, int32_t lo_rank, PtrType node, PtrType hi, int32_t hi_rank) {
+        MX_DEBUG_ASSERT(root_ == nullptr);
+        MX_DEBUG_ASSERT(PtrTraits::IsValid(node));
+
+        Observer::RecordInsert();
+
+        if (lo_rank > hi_rank + 1)
+            return JoinLR<ForwardTraits>(mxtl::move(lo), lo_rank, mxtl::move(node), mxtl::move(hi), hi_rank);
+        if (hi_rank > lo_rank + 1)
+            return JoinLR<ReverseTraits>(mxtl::move(hi), hi_rank, mxtl::move(node), mxtl::move(lo), lo_rank);
+
+        RawPtrType raw = PtrTraits::GetRaw(node);
+        auto& ns = NodeTraits::node_state(*raw);
+        int32_t rank = ((lo_rank > hi_rank) ? lo_rank : hi_rank) + 1;
+
+        if (PtrTraits::IsValid(lo)) NodeTraits::node_state(*lo).parent_ = raw;
+        if (PtrTraits::IsValid(hi)) NodeTraits::node_state(*hi).parent_ = raw;
+        ns.left_   = mxtl::move(lo);
+        ns.right_  = mxtl::move(hi);
+        ns.parent_ = sentinel();
+        ns.set_rank(rank);
+        root_ = mxtl::move(node);
+
+        Observer::template RecordSubtreeChanged<ContainerType>(raw);
+        return rank;
+    }
+
+    // JoinLR<LRTraits>
+    //
+    // The unbalanced half of InternalJoin.  The taller subtree is on the LR
+    // side of the join, and is at least two ranks taller than the shorter.
+    //
+    // Walk down the RL-edge of the taller subtree to the first node (C, which
+    // may be null) whose rank is no more than one greater than the shorter
+    // subtree's.  C's parent (P) has a rank at least two greater than the
+    // shorter subtree's, so rank(C) is either rank(shorter) or rank(shorter) +
+    // 1.  Node takes C's place with C as its LR-child and the shorter subtree
+    // as its RL-child, and a rank of rank(C) + 1, which makes it a 1,1 or 1,2
+    // node.  If C was a 2-child, node is now a 1-child and we are done.  If C
+    // was a 1-child, node is now a 0-child of P, which is exactly the problem
+    // the post-insert rebalancing solves.
+    template <typename LRTraits>
+    int32_t JoinLR(PtrType taller, int32_t taller_rank,
+                   PtrType node,
+                   PtrType shorter, int32_t shorter_rank) {
+        root_ = mxtl::move(taller);
+        NodeTraits::node_state(*root_).parent_ = sentinel();
+
+        RawPtrType parent      = PtrTraits::GetRaw(root_);
+        int32_t    parent_rank = taller_rank;
+        int32_t    child_rank;
+        PtrType*   link;
+
+        while (true) {
+            auto& parent_ns = NodeTraits::node_state(*parent);
+            link = &LRTraits::RLChild(parent_ns);
+
+            if (!PtrTraits::IsValid(*link)) {
+                child_rank = -1;
+                break;
+            }
+
+            auto& child_ns = NodeTraits::node_state(**link);
+            child_rank = parent_rank -
+                         ((child_ns.rank_parity() == parent_ns.rank_parity()) ? 2 : 1);
+            if (child_rank <= shorter_rank + 1)
+                break;
+
+            parent      = PtrTraits::GetRaw(*link);
+            parent_rank = child_rank;
+        }
+        MX_DEBUG_ASSERT((child_rank == shorter_rank) || (child_rank == shorter_rank + 1));
+
+        RawPtrType raw = PtrTraits::GetRaw(node);
+        auto& ns = NodeTraits::node_state(*raw);
+
+        PtrType& lr_child = LRTraits::LRChild(ns);
+        PtrType& rl_child = LRTraits::RLChild(ns);
+        lr_child = PtrTraits::Take(*link);
+        rl_child = mxtl::move(shorter);
+        if (PtrTraits::IsValid(lr_child)) NodeTraits::node_state(*lr_child).parent_ = raw;
+        if (PtrTraits::IsValid(rl_child)) NodeTraits::node_state(*rl_child).parent_ = raw;
+        ns.parent_ = parent;
+        ns.set_rank(child_rank + 1);
+        *link = mxtl::move(node);
+
+        RecordSubtreeChangedToRoot(raw);
+        if (parent_rank == child_rank + 1)
+            BalancePostInsert_Fix0Child(raw);
+
+        // Rebalancing can promote the root of the tree at most once, and
+        // rotations preserve the rank of the subtree they are performed on, so
+        // the rank of the result is either taller_rank or one more than that.
+        bool parity = NodeTraits::node_state(*root_).rank_parity();
+        return (parity == ((taller_rank & 0x1) != 0)) ? taller_rank : taller_rank + 1;
+    }
+
+    // InternalSplit
+    //
+    // Split the bare subtree |tree| into the nodes whose keys are less than
+    // |key| (lo) and the rest (hi).  The root of this tree is used as scratch
+    // space while joining, so the tree must be empty.
+    //
+    // Find the bottom of the search path for key, then climb back up it.  Each
+    // node on the path is joined, along with the subtree hanging off the side
+    // of the path opposite the direction the search took, onto the half it
+    // belongs in.  The halves grow in rank as we climb, so the costs of the
+    // joins telescope, and the whole split takes O(log) time.
+    void InternalSplit(PtrType tree, const KeyType& key, PtrType* lo, PtrType* hi) {
+        MX_DEBUG_ASSERT(root_ == nullptr);
+
+        PtrType lo_tree, hi_tree;
+        int32_t lo_rank = -1, hi_rank = -1;
+
+        RawPtrType top  = PtrTraits::GetRaw(tree);
+        RawPtrType node = nullptr;
+        for (RawPtrType next = top; PtrTraits::IsValid(next); ) {
+            node = next;
+            auto& ns = NodeTraits::node_state(*node);
+            next = PtrTraits::GetRaw(KeyTraits::LessThan(KeyTraits::GetKey(*node), key)
+                                     ? ns.right_
+                                     : ns.left_);
+        }
+
+        // The node at the bottom of the path has at most one child, so its
+        // rank can be found the same way SubtreeRank finds it.  Ranks further
+        // up are found from the ones below as we climb, reading each node's
+        // parity before the join changes it.
+        int32_t rank = (node && NodeTraits::node_state(*node).rank_parity()) ? 1 : 0;
+        while (PtrTraits::IsValid(node)) {
+            auto& ns    = NodeTraits::node_state(*node);
+            bool parity = ns.rank_parity();
+            bool is_top = (node == top);
+
+            RawPtrType parent = ns.parent_;
+            PtrType& owner = is_top
+                           ? tree
+                           : ((PtrTraits::GetRaw(NodeTraits::node_state(*parent).left_) == node)
+                             ? NodeTraits::node_state(*parent).left_
+                             : NodeTraits::node_state(*parent).right_);
+            MX_DEBUG_ASSERT(PtrTraits::GetRaw(owner) == node);
+            PtrType ptr = PtrTraits::Take(owner);
+
+            // The child of node which was on the search path (if any) has
+            // already been taken.  Join node and its other child onto the
+            // appropriate half.
+            bool     goes_lo = KeyTraits::LessThan(KeyTraits::GetKey(*node), key);
+            PtrType& child   = goes_lo ? ns.left_ : ns.right_;
+            MX_DEBUG_ASSERT((goes_lo ? ns.right_ : ns.left_) == nullptr);
+
+            int32_t child_rank = PtrTraits::IsValid(child)
+                               ? rank - ((NodeTraits::node_state(*child).rank_parity() == parity) ? 2 : 1)
+                               : -1;
+            PtrType subtree = PtrTraits::Take(child);
+
+            if (goes_lo) {
+                lo_rank = InternalJoin(mxtl::move(subtree), child_rank,
+                                       mxtl::move(ptr),
+                                       mxtl::move(lo_tree), lo_rank);
+                lo_tree = PtrTraits::Take(root_);
+            } else {
+                hi_rank = InternalJoin(mxtl::move(hi_tree), hi_rank,
+                                       mxtl::move(ptr),
+                                       mxtl::move(subtree), child_rank);
+                hi_tree = PtrTraits::Take(root_);
+            }
+
+            if (is_top)
+                break;
+
+            rank += (NodeTraits::node_state(*parent).rank_parity() == parity) ? 2 : 1;
+            node  = parent;
+        }
+
+        *lo = mxtl::move(lo_tree);
+        *hi = mxtl::move(hi_tree);
+    }
+
     constexpr RawPtrType sentinel() const {
         return reinterpret_cast<RawPtrType>(
                 reinterpret_cast<uintptr_t>(this) | internal::kContainerSentinelBit);
@@ -1260,6 +1746,20 @@ private:
         Z_ns.parent_ = X;
         if (Y)
             NodeTraits::node_state(*Y).parent_ = Z;
+
+        // Z is now X's child.  X's subtree holds exactly what Z's used to, so
+        // nothing above X needs to hear about the rotation.
+        Observer::template RecordSubtreeChanged<ContainerType>(Z);
+        Observer::template RecordSubtreeChanged<ContainerType>(X);
+    }
+
+    // Tell the observer that the subtrees rooted at |node| and all of its
+    // ancestors may have changed, bottom up.
+    void RecordSubtreeChangedToRoot(RawPtrType node) {
+        while (PtrTraits::IsValid(node)) {
+            Observer::template RecordSubtreeChanged<ContainerType>(node);
+            node = NodeTraits::node_state(*node).parent_;
+        }
     }
 
     // PostInsertFixupLR<LRTraits>
@@ -1344,8 +1844,7 @@ private:
 
         // If we have a sibling, then our parent just went from being a 1,2
         // unary node into a 1,1 binary node and no action needs to be taken.
-        RawPtrType parent = node_ns->parent_;
-        auto parent_ns = &NodeTraits::node_state(*parent);
+        auto parent_ns = &NodeTraits::node_state(*node_ns->parent_);
         if (PtrTraits::IsValid(parent_ns->left_) && PtrTraits::IsValid(parent_ns->right_))
             return;
 
@@ -1353,37 +1852,36 @@ private:
         // leaf node into a 0,1 unary node.  The WAVL rank rule states that all
         // rank differences are 1 or 2; 0 is not allowed.  Rebalance the tree in
         // order to restore the rule.
-        //
-        // Start with the promotions.  Pseudo code is...
-        //
-        // while (IsValid(parent) && parent is a 0,1 node)
-        //    promote parent
-        //    climb up the tree
-        bool node_parity;
-        bool parent_parity;
-        bool sibling_parity;
-        bool is_left_child;
-        do {
-            // Promote
-            parent_ns->promote_rank();
-            Observer::RecordInsertPromote();
-
-            // Climb
-            node    = parent;
-            node_ns = &NodeTraits::node_state(*node);
-            parent  = node_ns->parent_;
-
-            // If we have run out of room to climb, then we must be done.
-            if (!PtrTraits::IsValid(parent))
-                return;
+        BalancePostInsert_Fix0Child(node);
+    }
 
-            // We have a parent.  Determine the relationship between our rank
-            // parity,  our parent's rank parity, and our sibling's rank parity
-            // (if any).  Note; null children have a rank of -1, therefor the
-            // rank parity of a sibling is always odd (1).  In the process, make
-            // a note of whether we are our parent's left or right child.
-            parent_ns = &NodeTraits::node_state(*parent);
-            is_left_child = (PtrTraits::GetRaw(parent_ns->left_) == node);
+    // BalancePostInsert_Fix0Child
+    //
+    // Restore the rank rule after node has become a 0-child of its parent,
+    // either because it was just inserted below a leaf, or because it was
+    // linked in by a join with the same rank as its new parent.
+    //
+    // Start with the promotions.  Pseudo code is...
+    //
+    // while (IsValid(parent) && parent is a 0,1 node)
+    //    promote parent
+    //    climb up the tree
+    //
+    // If we stop at a 0,2 node instead, perform either one or two rotations.
+    void BalancePostInsert_Fix0Child(RawPtrType node) {
+        while (true) {
+            // Determine the relationship between our rank parity, our parent's
+            // rank parity, and our sibling's rank parity (if any).  Note; null
+            // children have a rank of -1, therefor the rank parity of a sibling
+            // is always odd (1).  In the process, make a note of whether we are
+            // our parent's left or right child.
+            auto node_ns    = &NodeTraits::node_state(*node);
+            RawPtrType parent = node_ns->parent_;
+            MX_DEBUG_ASSERT(PtrTraits::IsValid(parent));
+
+            auto parent_ns     = &NodeTraits::node_state(*parent);
+            bool is_left_child = (PtrTraits::GetRaw(parent_ns->left_) == node);
+            bool sibling_parity;
             if (is_left_child) {
                 sibling_parity = PtrTraits::IsValid(parent_ns->right_)
                                ? NodeTraits::node_state(*parent_ns->right_).rank_parity()
@@ -1395,33 +1893,35 @@ private:
                                : true;
             }
 
-            node_parity   = node_ns->rank_parity();
-            parent_parity = parent_ns->rank_parity();
-
-            // We need to keep promoting and climbing if we just turned our new
-            // parent into a 0,1 node.  Let N, P and S denote the current node,
-            // parent and sibling parities.  Working out the truth tables, our
-            // parent is now a 0,1 node iff (!N * !P * S) + (N * P * !S)
-        } while ((!node_parity && !parent_parity &&  sibling_parity) ||
-                 ( node_parity &&  parent_parity && !sibling_parity));
-
-        // OK.  At this point, we know that we have a parent, and our parent is
-        // not a 0,1 node.  Either our rank rule has been restored and we are
-        // done, or our parent is 0,2 and we need to perform either one or two
-        // rotations.  Start by checking to see if our parent is 0,2.  Using the
-        // notation from above...
-        //
-        // ++ our parent is a 0,2 node iff (!N * !P * !S) + (N * P * S).
-        // ++ which implies that we are finished iff (N != P) + (N != S)
-        //
-        if ((node_parity != parent_parity) || (node_parity != sibling_parity))
-            return;
+            // We are a 0-child, so our parity matches our parent's.  If our
+            // sibling's does too, it is a 2-child and our parent is a 0,2 node.
+            // Perform the post-insert fixup operations, forward if we are our
+            // parent's left child, reverse if we are our parent's right child.
+            MX_DEBUG_ASSERT(node_ns->rank_parity() == parent_ns->rank_parity());
+            if (sibling_parity == parent_ns->rank_parity()) {
+                if (is_left_child) PostInsertFixupLR<ForwardTraits>(node, parent);
+                else               PostInsertFixupLR<ReverseTraits>(node, parent);
+                return;
+            }
 
-        // Looks like our parent is a 0,2 node.  Perform the post-insert fixup
-        // operations, forward if we are our parent's left child, reverse if we
-        // are our parent's right child.
-        if (is_left_child) PostInsertFixupLR<ForwardTraits>(node, parent);
-        else               PostInsertFixupLR<ReverseTraits>(node, parent);
+            // Our parent is a 0,1 node.  Promote
+            parent_ns->promote_rank();
+            Observer::RecordInsertPromote();
+
+            // Climb.  If we have run out of room to climb, then we must be
+            // done.
+            node = parent;
+            parent = parent_ns->parent_;
+            if (!PtrTraits::IsValid(parent))
+                return;
+
+            // The node we just promoted was either a 1-child or a 2-child.  If
+            // it was a 2-child, it is now a 1-child (its parity differs from
+            // its parent's) and the rank rule has been restored.  Otherwise, it
+            // is now a 0-child and we need to keep going.
+            if (parent_ns->rank_parity() != NodeTraits::node_state(*parent).rank_parity())
+                return;
+        }
     }
 
     // BalancePostErase_Fix22Leaf
@@ -37,6 +37,13 @@ struct DefaultWAVLTreeObserver {
     static void RecordEraseRotation()        { }
     static void RecordEraseDoubleRotation()  { }
 
+    // Called, bottom up, for every node whose subtree may have changed after an
+    // insert, erase or rotation.  Observers which keep per-subtree data in the
+    // nodes (an augmented tree) recompute it here from the node and its
+    // children.
+    template <typename TreeType>
+    static void RecordSubtreeChanged(typename TreeType::RawPtrType node) { }
+
     template <typename TreeType>
     static bool VerifyRankRule(const TreeType& tree, typename TreeType::RawPtrType node) {
         return true;
@@ -73,6 +80,7 @@ struct WAVLTreeNodeState<PtrType, int32_t> : public WAVLTreeNodeStateBase<PtrTyp
     void double_promote_rank() { this->rank_ += 2; }
     void demote_rank()         { this->rank_ -= 1; }
     void double_demote_rank()  { this->rank_ -= 2; }
+    void set_rank(int32_t rank) { this->rank_ = rank; }
 };
 
 }  // namespace mxtl
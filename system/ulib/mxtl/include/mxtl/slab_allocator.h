@@ -99,6 +99,31 @@ void* operator new(size_t sz, void *ptr);
 //
 // mxtl::SlabAllocator<UnlockedStaticSlabAllocator<mxtl::unique_ptr<MyObject>> allocator;
 //
+// :: Thread Caches ::
+//
+// A static slab allocator may also keep a small cache of free objects for each
+// thread which uses it, selected by giving the THREAD_CACHE_SIZE parameter of
+// the SlabAllocatorTraits<> struct a non-zero value (the maximum number of
+// objects each thread will hold on to).  Allocations and frees which can be
+// satisfied from the calling thread's cache take no locks at all.  Only when a
+// thread's cache is empty, or full, are objects moved between it and the
+// allocator's shared free list, half a cache at a time under a single
+// acquisition of the allocator's lock.  When a thread exits, whatever it had
+// cached is returned to the shared free list.
+//
+// Objects held in a thread's cache count against the allocator's slab quota,
+// and other threads cannot allocate them, so an allocator using thread caches
+// may fail an allocation while other threads hold free objects.  Size slab
+// limits with this in mind.
+//
+// Thread caches are only available to STATIC allocators, and only in user mode
+// (the kernel has its own per-cpu object caches).
+//
+// ** Example **
+//
+// using MyAllocatorTraits =
+//     mxtl::ThreadCachedStaticSlabAllocatorTraits<mxtl::unique_ptr<MyObject>, 32>;
+//
 // :: Object Requirements ::
 //
 // Objects must be small enough that at least 1 can be allocated from a slab
@@ -287,7 +312,8 @@ enum class SlabAllocatorFlavor {
 template <typename T,
           size_t   SLAB_SIZE,
           typename LockType,
-          SlabAllocatorFlavor AllocatorFlavor> struct SlabAllocatorTraits;
+          SlabAllocatorFlavor AllocatorFlavor,
+          size_t   THREAD_CACHE_SIZE> struct SlabAllocatorTraits;
 template <typename SATraits, typename = void> class SlabAllocator;
 template <typename SATraits, typename = void> class SlabAllocated;
 
@@ -516,6 +542,18 @@ public:
 
     static_assert(AllocsPerSlab > 0, "SLAB_SIZE too small to hold even 1 allocation");
 
+    static constexpr size_t ThreadCacheSize  = SATraits::THREAD_CACHE_SIZE;
+    static constexpr size_t ThreadCacheBatch = (ThreadCacheSize + 1) / 2;
+    static constexpr bool   HasThreadCache   = (ThreadCacheSize > 0);
+
+    // There is only one thread_local cache for each allocator type, so only
+    // allocators of which there is only one instance may use them.
+    static_assert(!HasThreadCache || (SATraits::AllocatorFlavor == SlabAllocatorFlavor::STATIC),
+                  "Only STATIC slab allocators may have thread caches.");
+#if _KERNEL
+    static_assert(!HasThreadCache, "Slab allocator thread caches are not available in the kernel.");
+#endif
+
     // Slab allocated objects must derive from SlabAllocated<SATraits>.
     static_assert(is_base_of<SlabAllocated<SATraits>, ObjType>::value,
                   "Objects which are slab allocated from an allocator of type "
@@ -566,11 +604,64 @@ protected:
     friend class ::mxtl::SlabAllocated<SATraits>;
 
     void* Allocate() {
+        return Allocate(integral_constant<bool, HasThreadCache>());
+    }
+
+    void ReturnToFreeList(void* ptr) {
+        ReturnToFreeList(ptr, integral_constant<bool, HasThreadCache>());
+    }
+
+    typename SATraits::LockType alloc_lock_;
+
+private:
+    // The free objects held by one thread.  Whatever is left in it is
+    // returned to the shared free list when the thread exits.
+    struct ThreadCache {
+        explicit ThreadCache(SlabAllocator* allocator) : allocator_(allocator) { }
+
+        ~ThreadCache() {
+            AutoLock alloc_lock(&allocator_->alloc_lock_);
+            while (count_ > 0)
+                allocator_->ReturnToFreeListLocked(objects_[--count_]);
+        }
+
+        SlabAllocator* const allocator_;
+        size_t               count_ = 0;
+        void*                objects_[HasThreadCache ? ThreadCacheSize : 1];
+    };
+
+    ThreadCache& thread_cache() {
+        static thread_local ThreadCache cache(this);
+        return cache;
+    }
+
+    void* Allocate(false_type) {
         AutoLock alloc_lock(&this->alloc_lock_);
         return AllocateLocked();
     }
 
-    void ReturnToFreeList(void* ptr) {
+    void* Allocate(true_type) {
+        ThreadCache& cache = thread_cache();
+
+        // Refill an empty cache with a batch from the shared free list (or
+        // fresh slabs).
+        if (cache.count_ == 0) {
+            AutoLock alloc_lock(&this->alloc_lock_);
+            while (cache.count_ < ThreadCacheBatch) {
+                void* mem = AllocateLocked();
+                if (mem == nullptr)
+                    break;
+                cache.objects_[cache.count_++] = mem;
+            }
+
+            if (cache.count_ == 0)
+                return nullptr;
+        }
+
+        return cache.objects_[--cache.count_];
+    }
+
+    void ReturnToFreeList(void* ptr, false_type) {
         FreeListEntry* free_obj = new (ptr) FreeListEntry;
         {
             AutoLock alloc_lock(&alloc_lock_);
@@ -578,7 +669,25 @@ protected:
         }
     }
 
-    typename SATraits::LockType alloc_lock_;
+    void ReturnToFreeList(void* ptr, true_type) {
+        ThreadCache& cache = thread_cache();
+
+        // A full cache gives its oldest batch back, keeping the most recently
+        // freed (and so most likely cache hot) objects.
+        if (cache.count_ == ThreadCacheSize) {
+            {
+                AutoLock alloc_lock(&alloc_lock_);
+                for (size_t i = 0; i < ThreadCacheBatch; ++i)
+                    ReturnToFreeListLocked(cache.objects_[i]);
+            }
+
+            for (size_t i = ThreadCacheBatch; i < ThreadCacheSize; ++i)
+                cache.objects_[i - ThreadCacheBatch] = cache.objects_[i];
+            cache.count_ -= ThreadCacheBatch;
+        }
+
+        cache.objects_[cache.count_++] = ptr;
+    }
 };
 }  // namespace internal
 
@@ -620,11 +729,17 @@ protected:
 //     the object to the allocator it came from.  MANUAL_DELETE allocators are
 //     only permitted for unmanaged pointer types.
 //
+// ++ THREAD_CACHE_SIZE
+//  The number of free objects each thread may hold on to without taking the
+//  allocator's lock.  Defaults to 0 (no thread caches).  Only STATIC allocators
+//  may have thread caches.
+//
 ////////////////////////////////////////////////////////////////////////////////
 template <typename T,
           size_t   _SLAB_SIZE = DEFAULT_SLAB_ALLOCATOR_SLAB_SIZE,
           typename _LockType  = ::mxtl::Mutex,
-          SlabAllocatorFlavor _AllocatorFlavor = SlabAllocatorFlavor::INSTANCED>
+          SlabAllocatorFlavor _AllocatorFlavor = SlabAllocatorFlavor::INSTANCED,
+          size_t   _THREAD_CACHE_SIZE = 0>
 struct SlabAllocatorTraits {
     using PtrTraits     = internal::SlabAllocatorPtrTraits<T>;
     using PtrType       = typename PtrTraits::PtrType;
@@ -633,6 +748,7 @@ struct SlabAllocatorTraits {
 
     static constexpr size_t SLAB_SIZE = _SLAB_SIZE;
     static constexpr SlabAllocatorFlavor AllocatorFlavor = _AllocatorFlavor;
+    static constexpr size_t THREAD_CACHE_SIZE = _THREAD_CACHE_SIZE;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -836,6 +952,15 @@ template <typename T,
 using UnlockedStaticSlabAllocatorTraits =
     SlabAllocatorTraits<T, SLAB_SIZE, ::mxtl::NullLock, SlabAllocatorFlavor::STATIC>;
 
+// Shorthand for declaring the properties of a static allocator with per-thread
+// caches of free objects.
+template <typename T,
+          size_t   THREAD_CACHE_SIZE,
+          size_t   SLAB_SIZE = DEFAULT_SLAB_ALLOCATOR_SLAB_SIZE,
+          typename LockType  = ::mxtl::Mutex>
+using ThreadCachedStaticSlabAllocatorTraits =
+    SlabAllocatorTraits<T, SLAB_SIZE, LockType, SlabAllocatorFlavor::STATIC, THREAD_CACHE_SIZE>;
+
 // Shorthand for declaring the global storage required for a static allocator
 #define DECLARE_STATIC_SLAB_ALLOCATOR_STORAGE(ALLOC_TRAITS, ...) \
 template<> ::mxtl::SlabAllocator<ALLOC_TRAITS>::InternalAllocatorType \
@@ -5,6 +5,10 @@
 #pragma once
 #include <stdlib.h>
 
+#ifdef _KERNEL
+#include <lib/heap.h>
+#endif
+
 namespace mxtl {
 namespace internal {
 
@@ -27,7 +31,7 @@ struct SlabMalloc {
     // TODO(johngro): Replace this implementation with a kernel implementation
     // which does not use the heap.
     static void* Allocate(size_t amt, size_t align) {
-        void* mem = ::malloc(amt);
+        void* mem = ::malloc_tagged(amt, HEAP_TAG_SLAB);
         MX_DEBUG_ASSERT((reinterpret_cast<uintptr_t>(mem) % align) == 0);
         return mem;
     }
@@ -483,6 +483,11 @@ private:
                                      uint64_t base,
                                      uint64_t size);
 
+    static bool RegionFits(const Region& region,
+                           uint64_t size,
+                           uint64_t mask,
+                           uint64_t* aligned_base);
+
     static bool IntersectsLocked(const Region::WAVLTreeSortByBase& tree,
                                  const ralloc_region_t& region);
 
@@ -6,6 +6,10 @@
 #include <region-alloc/region-alloc.h>
 #include <string.h>
 
+// How many of the regions which might be too small to hold an aligned
+// allocation to try before skipping to one which is large enough for sure.
+static constexpr size_t kMaxAlignmentProbes = 16;
+
 // Support for Pool allocated bookkeeping
 RegionAllocator::RegionPool::RefPtr RegionAllocator::RegionPool::Create(size_t max_memory) {
     // Sanity check our allocation arguments.
@@ -287,9 +291,8 @@ mx_status_t RegionAllocator::GetRegion(uint64_t size,
     if (!size || !alignment || !mxtl::is_pow2(alignment))
         return MX_ERR_INVALID_ARGS;
 
-    // Compute the things we will need round-up align base addresses.
-    uint64_t mask     = alignment - 1;
-    uint64_t inv_mask = ~mask;
+    // Compute the mask we will need round-up align base addresses.
+    uint64_t mask = alignment - 1;
 
     // Start by using our size index to look up the first available region which
     // is large enough to hold this allocation (if any)
@@ -298,20 +301,30 @@ mx_status_t RegionAllocator::GetRegion(uint64_t size,
     // Consider all of the regions which are large enough to hold our
     // allocation.  Stop as soon as we find one which can satisfy the alignment
     // restrictions.
+    //
+    // Only regions shorter than size + mask can fail the alignment check
+    // (short of aligning their base wrapping the address space), so rather
+    // than walking every one of them, give up on the best fit after a few and
+    // jump straight to the smallest region which is sure to fit.  Only if there
+    // is no such region do the rest of the short ones need to be looked at.
     uint64_t aligned_base;
+    size_t probes = 0;
     while (iter.IsValid()) {
         MX_DEBUG_ASSERT(iter->size >= size);
-        aligned_base = (iter->base + mask) & inv_mask;
-        uint64_t overhead = aligned_base - iter->base;
-        uint64_t leftover = iter->size - size;
-
-        // We have a usable region if the aligned base address has not wrapped
-        // the address space, and if overhead required to align the allocation
-        // is not larger than what is leftover in the region after performing
-        // the allocation.
-        if ((aligned_base >= iter->base) && (overhead <= leftover))
+        if (RegionFits(*iter, size, mask, &aligned_base))
             break;
 
+        if ((++probes == kMaxAlignmentProbes) && ((size + mask) > size)) {
+            auto fits = avail_regions_by_size_.lower_bound({ .base = 0, .size = size + mask });
+            while (fits.IsValid() && !RegionFits(*fits, size, mask, &aligned_base))
+                ++fits;
+
+            if (fits.IsValid()) {
+                iter = fits;
+                break;
+            }
+        }
+
         ++iter;
     }
 
@@ -565,6 +578,22 @@ void RegionAllocator::AddRegionToAvailLocked(Region* region, bool allow_overlap)
     avail_regions_by_size_.insert(region);
 }
 
+bool RegionAllocator::RegionFits(const Region& region,
+                                 uint64_t size,
+                                 uint64_t mask,
+                                 uint64_t* aligned_base) {
+    // We have a usable region if the aligned base address has not wrapped the
+    // address space, and if overhead required to align the allocation is not
+    // larger than what is leftover in the region after performing the
+    // allocation.
+    uint64_t base     = (region.base + mask) & ~mask;
+    uint64_t overhead = base - region.base;
+    uint64_t leftover = region.size - size;
+
+    *aligned_base = base;
+    return (base >= region.base) && (overhead <= leftover);
+}
+
 bool RegionAllocator::IntersectsLocked(const Region::WAVLTreeSortByBase& tree,
                                        const ralloc_region_t& region) {
     // Find the first entry in the tree whose base is >= region.base.  If this
@@ -6,6 +6,7 @@
 
 #include <magenta/syscalls.h>
 #include <stdatomic.h>
+#include <stdbool.h>
 
 // This mutex implementation is based on Ulrich Drepper's paper "Futexes
 // Are Tricky" (dated November 5, 2011; see
@@ -21,6 +22,40 @@ enum {
     LOCKED_WITH_WAITERS = 2
 };
 
+// How many times to look again at a mutex held by another thread before
+// going to sleep on it.  Most critical sections are much shorter than the
+// trip through mx_futex_wait() and mx_futex_wake() that sleeping costs
+// both threads, and this covers those without burning much time on the
+// ones that aren't.
+#define SPIN_COUNT 100
+
+static inline void spin_pause(void) {
+#if defined(__x86_64__)
+    __asm__ volatile("pause" ::: "memory");
+#elif defined(__aarch64__)
+    __asm__ volatile("yield" ::: "memory");
+#else
+    atomic_signal_fence(memory_order_seq_cst);
+#endif
+}
+
+// A mutex held with no waiters is most likely held briefly, so spin on it
+// for a while hoping to claim it without sleeping.  Once others are asleep
+// on it, there is no point: join them.  Returns true if the mutex was
+// claimed, and otherwise leaves the last state seen in |*old_state|.
+static bool spin(mxr_mutex_t* mutex, int* old_state) {
+    for (int i = 0; i < SPIN_COUNT && *old_state != LOCKED_WITH_WAITERS; i++) {
+        if (*old_state == UNLOCKED &&
+            atomic_compare_exchange_strong(&mutex->futex, old_state,
+                                           LOCKED_WITHOUT_WAITERS)) {
+            return true;
+        }
+        spin_pause();
+        *old_state = atomic_load_explicit(&mutex->futex, memory_order_relaxed);
+    }
+    return false;
+}
+
 // On success, this will leave the mutex in the LOCKED_WITH_WAITERS state.
 static mx_status_t lock_slow_path(mxr_mutex_t* mutex, mx_time_t abstime,
                                   int old_state) {
@@ -67,6 +102,9 @@ mx_status_t __mxr_mutex_timedlock(mxr_mutex_t* mutex, mx_time_t abstime) {
                                        LOCKED_WITHOUT_WAITERS)) {
         return MX_OK;
     }
+    if (spin(mutex, &old_state)) {
+        return MX_OK;
+    }
     return lock_slow_path(mutex, abstime, old_state);
 }
 
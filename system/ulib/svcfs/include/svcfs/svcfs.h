@@ -82,6 +82,7 @@ public:
     mx_status_t Getattr(vnattr_t* a) final;
 
     void NotifyAdd(const char* name, size_t len) final;
+    void NotifyRemove(const char* name, size_t len) final;
     mx_status_t WatchDir(mx_handle_t* out) final;
     mx_status_t WatchDirV2(const vfs_watch_dir_t* cmd) final;
 
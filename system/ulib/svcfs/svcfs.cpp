@@ -133,6 +133,7 @@ mx_status_t VnodeDir::Getattr(vnattr_t* attr) {
 }
 
 void VnodeDir::NotifyAdd(const char* name, size_t len) { watcher_.NotifyAdd(name, len); }
+void VnodeDir::NotifyRemove(const char* name, size_t len) { watcher_.NotifyRemove(name, len); }
 mx_status_t VnodeDir::WatchDir(mx_handle_t* out) { return watcher_.WatchDir(out); }
 mx_status_t VnodeDir::WatchDirV2(const vfs_watch_dir_t* cmd) { return watcher_.WatchDirV2(cmd); }
 
@@ -183,6 +184,7 @@ bool VnodeDir::RemoveService(const char* name, size_t len) {
         if (child.NameMatch(name, len)) {
             child.ClearProvider();
             services_.erase(child);
+            NotifyRemove(name, len);
             return true;
         }
     }
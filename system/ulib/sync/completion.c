@@ -5,27 +5,83 @@
 #include <sync/completion.h>
 
 #include <limits.h>
+#include <stdbool.h>
 #include <magenta/syscalls.h>
 #include <stdatomic.h>
 
 enum {
     UNSIGNALED = 0,
     SIGNALED = 1,
+    // unsignaled, and someone may be asleep on it
+    WAITING = 2,
 };
 
+// A signal often follows within a few microseconds, as when a device
+// finishes a transaction, so a waiter spins this long before sleeping.
+#define SPIN_USEC 10
+
+// How long completion_wait_any() sleeps on one of its completions before
+// looking at the rest; it doubles, up to the most.
+#define ANY_SLICE_MIN MX_USEC(50)
+#define ANY_SLICE_MAX MX_MSEC(1)
+
+static inline void spin_pause(void) {
+#if defined(__x86_64__)
+    __asm__ volatile("pause" ::: "memory");
+#elif defined(__aarch64__)
+    __asm__ volatile("yield" ::: "memory");
+#else
+    atomic_signal_fence(memory_order_seq_cst);
+#endif
+}
+
+static bool find_signaled(completion_t* const* completions, size_t count, size_t* index) {
+    for (size_t i = 0; i < count; i++) {
+        if (atomic_load(&completions[i]->futex) == SIGNALED) {
+            if (index) {
+                *index = i;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool spin(completion_t* const* completions, size_t count, size_t* index) {
+    // with one cpu there's nobody to do the signaling meanwhile
+    if (mx_system_get_num_cpus() == 1) {
+        return find_signaled(completions, count, index);
+    }
+    uint64_t end = mx_ticks_get() + mx_ticks_per_second() / (1000000 / SPIN_USEC);
+    do {
+        if (find_signaled(completions, count, index)) {
+            return true;
+        }
+        spin_pause();
+    } while (mx_ticks_get() < end);
+    return false;
+}
+
+// Marks the completion as having a sleeper, so that the signal wakes it,
+// returning false if it is signaled already.
+static bool prepare_to_sleep(atomic_int* futex) {
+    int current_value = UNSIGNALED;
+    return atomic_compare_exchange_strong(futex, &current_value, WAITING) ||
+           current_value == WAITING;
+}
+
 mx_status_t completion_wait(completion_t* completion, mx_time_t timeout) {
-    // TODO(kulakowski): With a little more state (a waiters count),
-    // this could optimistically spin before entering the kernel.
+    if (spin(&completion, 1, NULL)) {
+        return MX_OK;
+    }
 
     atomic_int* futex = &completion->futex;
-
+    mx_time_t deadline = (timeout == MX_TIME_INFINITE) ? timeout : mx_deadline_after(timeout);
     for (;;) {
-        int current_value = atomic_load(futex);
-        if (current_value == SIGNALED) {
+        if (!prepare_to_sleep(futex)) {
             return MX_OK;
         }
-        mx_time_t deadline = (timeout == MX_TIME_INFINITE) ? timeout : mx_deadline_after(timeout);
-        switch (mx_futex_wait(futex, current_value, deadline)) {
+        switch (mx_futex_wait(futex, WAITING, deadline)) {
         case MX_OK:
             continue;
         case MX_ERR_BAD_STATE:
@@ -42,12 +98,61 @@ mx_status_t completion_wait(completion_t* completion, mx_time_t timeout) {
     }
 }
 
+mx_status_t completion_wait_any(completion_t* const* completions, size_t count,
+                                mx_time_t timeout, size_t* index) {
+    if (count == 0) {
+        return MX_ERR_INVALID_ARGS;
+    }
+    if (spin(completions, count, index)) {
+        return MX_OK;
+    }
+
+    // A futex wait is on one address only, so this sleeps on the first
+    // completion and looks at the others now and then.
+    atomic_int* futex = &completions[0]->futex;
+    mx_time_t deadline = (timeout == MX_TIME_INFINITE) ? timeout : mx_deadline_after(timeout);
+    mx_duration_t slice = ANY_SLICE_MIN;
+    for (;;) {
+        if (find_signaled(completions, count, index)) {
+            return MX_OK;
+        }
+        if (!prepare_to_sleep(futex)) {
+            continue;
+        }
+        mx_time_t wake = mx_deadline_after(slice);
+        if (wake > deadline) {
+            wake = deadline;
+        }
+        switch (mx_futex_wait(futex, WAITING, wake)) {
+        case MX_OK:
+        case MX_ERR_BAD_STATE:
+            continue;
+        case MX_ERR_TIMED_OUT:
+            if (wake == deadline) {
+                return find_signaled(completions, count, index) ? MX_OK : MX_ERR_TIMED_OUT;
+            }
+            if (slice < ANY_SLICE_MAX) {
+                slice *= 2;
+            }
+            continue;
+        case MX_ERR_INVALID_ARGS:
+        default:
+            __builtin_trap();
+        }
+    }
+}
+
 void completion_signal(completion_t* completion) {
     atomic_int* futex = &completion->futex;
-    atomic_store(futex, SIGNALED);
-    mx_futex_wake(futex, UINT32_MAX);
+    // Only go to the kernel if someone may be asleep.
+    if (atomic_exchange(futex, SIGNALED) == WAITING) {
+        mx_futex_wake(futex, UINT32_MAX);
+    }
 }
 
 void completion_reset(completion_t* completion) {
-    atomic_store(&completion->futex, UNSIGNALED);
+    // Waiters may have marked it WAITING since the last reset, so leave it
+    // be unless it is signaled.
+    int current_value = SIGNALED;
+    atomic_compare_exchange_strong(&completion->futex, &current_value, UNSIGNALED);
 }
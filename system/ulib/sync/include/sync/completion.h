@@ -8,6 +8,7 @@
 #include <magenta/compiler.h>
 
 #include <stdatomic.h>
+#include <stddef.h>
 
 __BEGIN_CDECLS;
 
@@ -19,11 +20,18 @@ typedef struct {
 
 // Returns MX_ERR_TIMED_OUT if timeout elapses, and MX_OK if woken by
 // a call to completion_wake or if the completion has already been
-// signaled.
+// signaled. It spins for a few microseconds before going to sleep.
 mx_status_t completion_wait(completion_t* completion, mx_time_t timeout);
 
+// Waits for any of |count| completions to be signaled, storing which one
+// in |index| if not NULL. Only the first one wakes the caller straight
+// away; the others may take up to a millisecond to be noticed once the
+// spin is over, so put the likeliest first.
+mx_status_t completion_wait_any(completion_t* const* completions, size_t count,
+                                mx_time_t timeout, size_t* index);
+
 // Awakens all waiters on the completion, and marks the it as
-// signaled. Waits after this call but before a reset of the
+// signaled. Without any waiters asleep it makes no syscall. Waits after this call but before a reset of the
 // completion will also see the signal and immediately return.
 void completion_signal(completion_t* completion);
 
@@ -151,11 +151,14 @@ tftp_status tftp_prepare_data(tftp_session* session,
 
 // If no response from the peer is received before the most recent timeout_ms
 // value, this function should be called to take the next appropriate action
-// (e.g., retransmit or cancel). |outgoing| must point to a scratch buffer the
-// library can use to assemble the next packet to send. |outlen| is the size of
-// the outgoing scratch buffer. |timeout_ms| is set to the next timeout value
-// the user of the library should use when waiting for a response. |cookie| will
-// be passed to the tftp callback functions.
+// (e.g., retransmit or cancel). A sender resends its window from the last
+// acknowledged block; a receiver acknowledges the last block it has. Each
+// consecutive timeout doubles |timeout_ms|, and after too many of them the
+// transfer is abandoned with TFTP_ERR_TIMED_OUT. |outgoing| must point to a
+// scratch buffer the library can use to assemble the next packet to send.
+// |outlen| is the size of the outgoing scratch buffer. |timeout_ms| is set to
+// the next timeout value the user of the library should use when waiting for a
+// response. |cookie| will be passed to the tftp callback functions.
 tftp_status tftp_timeout(tftp_session* session,
                          void* outgoing,
                          size_t* outlen,
@@ -43,6 +43,12 @@ typedef struct tftp_data_msg_t {
 #define DEFAULT_WINDOWSIZE 1
 #define DEFAULT_MODE MODE_OCTET
 
+// Number of consecutive timeouts after which a transfer is abandoned. The
+// retransmit timer doubles with each of them, and is reset by any message
+// from the peer.
+#define DEFAULT_MAX_TIMEOUTS 5
+#define MAX_TIMEOUT_MS (255 * 1000)
+
 typedef struct tftp_options_t {
     // Maximum filename really is 505 including \0
     // max request size (512) - opcode (2) - shortest mode (4) - null (1)
@@ -52,7 +58,7 @@ typedef struct tftp_options_t {
 
     uint16_t block_size;
     uint8_t timeout;
-    uint32_t file_size;
+    size_t file_size;
 
     uint32_t window_size;
 } tftp_options;
@@ -92,15 +98,34 @@ typedef enum {
     COMPLETED,
 } tftp_state;
 
+typedef enum {
+    DIR_NONE = 0,
+    SEND_FILE,
+    RECV_FILE,
+} tftp_file_direction;
+
 // TODO add a state so time out can be handled properly as well as unexpected traffic
 struct tftp_session_t {
     tftp_options options;
     tftp_state state;
+    tftp_file_direction direction;
     size_t offset;
 
+    // Block numbers are kept as a full count of blocks; only their low 16
+    // bits go on the wire, so that files of more than 65535 blocks wrap.
     uint32_t block_number;
     uint32_t window_index;
 
+    // Sender: the last block the receiver acknowledged, where a timed out
+    // window is resent from.
+    uint32_t last_acked;
+    // Receiver: an out-of-order block has been answered with an ACK of the
+    // last good one; further gaps in the same window are not answered again.
+    bool gap_acked;
+
+    uint32_t consecutive_timeouts;
+    uint32_t max_timeouts;
+
     // "Negotiated" values
     size_t file_size;
     tftp_mode mode;
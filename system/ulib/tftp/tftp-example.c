@@ -273,11 +273,12 @@ tftp_status tftp_send_file(tftp_session* session,
             }
             if (errno == EAGAIN) {
                 fprintf(stdout, "Timed out\n");
+                out = SCRATCHSZ;
                 ret = tftp_timeout(session,
                                    outgoing,
                                    &out,
                                    &timeout_ms,
-                                   connection);
+                                   &f);
                 if (out) {
                     n = connection_send(connection, outgoing, out);
                     if (n < 0) {
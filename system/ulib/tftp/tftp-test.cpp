@@ -919,6 +919,154 @@ static bool test_tftp_receive_data_windowsize_skipped_block(void) {
     END_TEST;
 }
 
+static bool test_tftp_receive_data_windowsize_gap_acked_once(void) {
+    BEGIN_TEST;
+
+    test_state ts;
+    ts.reset(1024, 2048, 1500);
+    tftp_session_set_open_cb(ts.session,
+            [](const char* filename, size_t size, void* cookie) -> tftp_status {
+                return 0;
+            });
+
+    uint8_t req_buf[] = {
+        0x00, 0x02,                                   // Opcode (WRQ)
+        'f', 'i', 'l', 'e', 'n', 'a', 'm', 'e', 0x00, // Filename
+        'O', 'C', 'T', 'E', 'T', 0x00,                // Mode
+        'T', 'S', 'I', 'Z', 'E', 0x00,                // Option
+        '2', '0', '4', '8', 0x00,                     // TSIZE value
+        'W', 'I', 'N', 'D', 'O', 'W', 'S', 'I', 'Z', 'E', 0x00,      // Option
+        '3', 0x00,                                              // WINDOWSIZE value
+    };
+    auto status = tftp_handle_msg(ts.session, req_buf, sizeof(req_buf), ts.out, &ts.outlen, &ts.timeout, nullptr);
+    ASSERT_EQ(TFTP_NO_ERROR, status, "receive write request failed");
+
+    tftp_session_set_write_cb(ts.session, mock_write);
+
+    // Block 1 is lost; block 2 is answered with an ACK of block 0.
+    uint8_t data_buf[516] = {
+        0x00, 0x03,  // Opcode (DATA)
+        0x02, 0x00,  // Block
+    };
+    status = tftp_handle_msg(ts.session, data_buf, sizeof(data_buf), ts.out, &ts.outlen, &ts.timeout, nullptr);
+    EXPECT_EQ(TFTP_NO_ERROR, status, "receive data failed");
+    ASSERT_GT(ts.outlen, 0, "outlen must not be zero");
+    auto msg = reinterpret_cast<tftp_data_msg*>(ts.out);
+    EXPECT_EQ(msg->opcode, htons(OPCODE_ACK), "bad opcode");
+    EXPECT_EQ(msg->block, 0, "bad block number");
+
+    // Block 3 is of no more use, and is not answered again.
+    data_buf[2] = 3u;
+    status = tftp_handle_msg(ts.session, data_buf, sizeof(data_buf), ts.out, &ts.outlen, &ts.timeout, nullptr);
+    EXPECT_EQ(TFTP_NO_ERROR, status, "receive data failed");
+    EXPECT_EQ(0, ts.outlen, "no ack expected for a second gap");
+    EXPECT_EQ(0, ts.session->block_number, "tftp session block number mismatch");
+
+    END_TEST;
+}
+
+static bool test_tftp_receive_data_block_wraparound(void) {
+    BEGIN_TEST;
+
+    test_state ts;
+    ts.reset(1024, 1024, 1500);
+    tftp_session_set_open_cb(ts.session,
+            [](const char* filename, size_t size, void* cookie) -> tftp_status {
+                return 0;
+            });
+
+    uint8_t req_buf[] = {
+        0x00, 0x02,                                   // Opcode (WRQ)
+        'f', 'i', 'l', 'e', 'n', 'a', 'm', 'e', 0x00, // Filename
+        'O', 'C', 'T', 'E', 'T', 0x00,                // Mode
+        'T', 'S', 'I', 'Z', 'E', 0x00,                // Option
+        '5', '0', '0', '0', '0', '0', '0', '0', '0', '0', 0x00, // TSIZE value
+    };
+    auto status = tftp_handle_msg(ts.session, req_buf, sizeof(req_buf), ts.out, &ts.outlen, &ts.timeout, nullptr);
+    ASSERT_EQ(TFTP_NO_ERROR, status, "receive write request failed");
+    EXPECT_EQ(5000000000ull, ts.session->file_size, "tftp session bad file size");
+
+    // Pretend the first 65535 blocks have gone by.
+    ts.session->state = TRANSMITTING;
+    ts.session->block_number = 0xffff;
+
+    tftp_session_set_write_cb(ts.session,
+            [](const void* data, size_t* len, off_t offset, void* cookie) -> tftp_status {
+                *static_cast<off_t*>(cookie) = offset;
+                return 0;
+            });
+
+    uint8_t data_buf[516] = {
+        0x00, 0x03,  // Opcode (DATA)
+        0x00, 0x00,  // Block
+    };
+    off_t offset = -1;
+    status = tftp_handle_msg(ts.session, data_buf, sizeof(data_buf), ts.out, &ts.outlen, &ts.timeout, &offset);
+    EXPECT_EQ(TFTP_NO_ERROR, status, "receive data failed");
+    EXPECT_EQ((off_t)0xffff * DEFAULT_BLOCKSIZE, offset, "bad write offset");
+    EXPECT_EQ(0x10000u, ts.session->block_number, "tftp session block number mismatch");
+    auto msg = reinterpret_cast<tftp_data_msg*>(ts.out);
+    EXPECT_EQ(msg->opcode, htons(OPCODE_ACK), "bad opcode");
+    EXPECT_EQ(msg->block, 0, "bad block number");
+
+    END_TEST;
+}
+
+static bool test_tftp_receive_data_timeout(void) {
+    BEGIN_TEST;
+
+    test_state ts;
+    ts.reset(1024, 2048, 1500);
+    tftp_session_set_open_cb(ts.session,
+            [](const char* filename, size_t size, void* cookie) -> tftp_status {
+                return 0;
+            });
+
+    uint8_t req_buf[] = {
+        0x00, 0x02,                                   // Opcode (WRQ)
+        'f', 'i', 'l', 'e', 'n', 'a', 'm', 'e', 0x00, // Filename
+        'O', 'C', 'T', 'E', 'T', 0x00,                // Mode
+        'T', 'S', 'I', 'Z', 'E', 0x00,                // Option
+        '2', '0', '4', '8', 0x00,                     // TSIZE value
+        'W', 'I', 'N', 'D', 'O', 'W', 'S', 'I', 'Z', 'E', 0x00,      // Option
+        '3', 0x00,                                              // WINDOWSIZE value
+    };
+    auto status = tftp_handle_msg(ts.session, req_buf, sizeof(req_buf), ts.out, &ts.outlen, &ts.timeout, nullptr);
+    ASSERT_EQ(TFTP_NO_ERROR, status, "receive write request failed");
+
+    // Without any data the OACK is repeated.
+    ts.outlen = ts.out_size;
+    status = tftp_timeout(ts.session, ts.out, &ts.outlen, &ts.timeout, nullptr);
+    EXPECT_EQ(TFTP_NO_ERROR, status, "timeout failed");
+    EXPECT_TRUE(verify_response_opcode(ts, OPCODE_OACK), "bad response");
+    EXPECT_EQ(2 * DEFAULT_TIMEOUT * 1000, ts.timeout, "timeout should back off");
+
+    tftp_session_set_write_cb(ts.session, mock_write);
+
+    uint8_t data_buf[516] = {
+        0x00, 0x03,  // Opcode (DATA)
+        0x01, 0x00,  // Block
+    };
+    tx_test_data td;
+    ts.outlen = ts.out_size;
+    status = tftp_handle_msg(ts.session, data_buf, sizeof(data_buf), ts.out, &ts.outlen, &ts.timeout, &td);
+    EXPECT_EQ(TFTP_NO_ERROR, status, "receive data failed");
+    EXPECT_EQ(0, ts.outlen, "no ack expected mid-window");
+    EXPECT_EQ(DEFAULT_TIMEOUT * 1000, ts.timeout, "timeout should be reset");
+
+    // The rest of the window is lost; the last good block is acked.
+    ts.outlen = ts.out_size;
+    status = tftp_timeout(ts.session, ts.out, &ts.outlen, &ts.timeout, &td);
+    EXPECT_EQ(TFTP_NO_ERROR, status, "timeout failed");
+    ASSERT_EQ(sizeof(tftp_data_msg), ts.outlen, "bad outlen");
+    auto msg = reinterpret_cast<tftp_data_msg*>(ts.out);
+    EXPECT_EQ(msg->opcode, htons(OPCODE_ACK), "bad opcode");
+    EXPECT_EQ(msg->block, 1, "bad block number");
+    EXPECT_EQ(0, ts.session->window_index, "tftp session window index mismatch");
+
+    END_TEST;
+}
+
 static bool test_tftp_send_data_receive_ack(void) {
     BEGIN_TEST;
 
@@ -1112,6 +1260,102 @@ static bool test_tftp_send_data_receive_ack_window_size(void) {
     END_TEST;
 }
 
+static bool test_tftp_send_write_request_timeout(void) {
+    BEGIN_TEST;
+
+    test_state ts;
+    ts.reset(1024, 1024, 1500);
+
+    auto status = tftp_generate_write_request(ts.session, kFilename, MODE_OCTET,
+        ts.msg_size, 0, 0, 0, ts.out, &ts.outlen, &ts.timeout);
+    EXPECT_EQ(TFTP_NO_ERROR, status, "error generating write request");
+    size_t request_len = ts.outlen;
+
+    for (uint32_t i = 1; i <= DEFAULT_MAX_TIMEOUTS; i++) {
+        ts.outlen = ts.out_size;
+        status = tftp_timeout(ts.session, ts.out, &ts.outlen, &ts.timeout, nullptr);
+        EXPECT_EQ(TFTP_NO_ERROR, status, "timeout failed");
+        EXPECT_EQ(request_len, ts.outlen, "write request should be repeated");
+        EXPECT_TRUE(verify_write_request(ts), "bad write request");
+        EXPECT_EQ((DEFAULT_TIMEOUT * 1000u) << i, ts.timeout, "timeout should back off");
+    }
+
+    ts.outlen = ts.out_size;
+    status = tftp_timeout(ts.session, ts.out, &ts.outlen, &ts.timeout, nullptr);
+    EXPECT_EQ(TFTP_ERR_TIMED_OUT, status, "transfer should be abandoned");
+    EXPECT_EQ(0, ts.outlen, "nothing should be sent");
+    EXPECT_EQ(ERROR, ts.session->state, "session should be in ERROR");
+
+    END_TEST;
+}
+
+static bool test_tftp_send_data_timeout_window_size(void) {
+    constexpr uint8_t kWindowSize = 2;
+    BEGIN_TEST;
+
+    test_state ts;
+    ts.reset(1024, 4096, 1500);
+
+    auto status = tftp_generate_write_request(ts.session, kFilename, MODE_OCTET,
+        ts.msg_size, 0, 0, kWindowSize, ts.out, &ts.outlen, &ts.timeout);
+    EXPECT_EQ(TFTP_NO_ERROR, status, "error generating write request");
+
+    uint8_t oack_buf[] = {
+        0x00, 0x06,                     // Opcode (OACK)
+        'T', 'S', 'I', 'Z', 'E', 0x00,  // Option
+        '4', '0', '9', '6', 0x00,       // TSIZE value
+        'W', 'I', 'N', 'D', 'O', 'W', 'S', 'I', 'Z', 'E', 0x00,      // Option
+        '2', 0x00,                                              // WINDOWSIZE value
+    };
+
+    tftp_session_set_read_cb(ts.session, mock_read);
+
+    tx_test_data td;
+    status = tftp_handle_msg(ts.session, oack_buf, sizeof(oack_buf), ts.out, &ts.outlen, &ts.timeout, &td);
+    ASSERT_EQ(TFTP_NO_ERROR, status, "receive error");
+    td.expected.block++;
+    td.expected.offset += DEFAULT_BLOCKSIZE;
+    status = tftp_prepare_data(ts.session, ts.out, &ts.outlen, &ts.timeout, &td);
+    ASSERT_EQ(TFTP_NO_ERROR, status, "prepare error");
+
+    uint8_t ack_buf[] = {
+        0x00, 0x04,  // Opcode (ACK)
+        0x02, 0x00,  // Block
+    };
+    td.expected.block++;
+    td.expected.offset += DEFAULT_BLOCKSIZE;
+    status = tftp_handle_msg(ts.session, ack_buf, sizeof(ack_buf), ts.out, &ts.outlen, &ts.timeout, &td);
+    ASSERT_EQ(TFTP_NO_ERROR, status, "receive error");
+    td.expected.block++;
+    td.expected.offset += DEFAULT_BLOCKSIZE;
+    status = tftp_prepare_data(ts.session, ts.out, &ts.outlen, &ts.timeout, &td);
+    ASSERT_EQ(TFTP_NO_ERROR, status, "prepare error");
+    ASSERT_EQ(4, ts.session->block_number, "tftp session block number mismatch");
+
+    // The second window goes unacknowledged, and is sent again from block 3.
+    tx_test_data td2;
+    td2.expected.block = 3;
+    td2.expected.offset = 2 * DEFAULT_BLOCKSIZE;
+    ts.outlen = ts.out_size;
+    status = tftp_timeout(ts.session, ts.out, &ts.outlen, &ts.timeout, &td2);
+    EXPECT_EQ(TFTP_NO_ERROR, status, "timeout failed");
+    EXPECT_EQ(2 * DEFAULT_TIMEOUT * 1000, ts.timeout, "timeout should back off");
+    EXPECT_EQ(2, ts.session->block_number, "tftp session block number mismatch");
+    EXPECT_EQ(1, ts.session->window_index, "tftp session window index mismatch");
+    EXPECT_EQ(ts.outlen, sizeof(tftp_data_msg) + DEFAULT_BLOCKSIZE, "bad outlen");
+    EXPECT_TRUE(verify_read_data(ts, td2), "bad test data");
+    EXPECT_TRUE(tftp_session_has_pending(ts.session), "expected pending data to transmit");
+
+    // A late duplicate of the first ACK does not rewind any further.
+    ack_buf[2] = 1u;
+    status = tftp_handle_msg(ts.session, ack_buf, sizeof(ack_buf), ts.out, &ts.outlen, &ts.timeout, &td2);
+    EXPECT_EQ(TFTP_NO_ERROR, status, "receive error");
+    EXPECT_EQ(0, ts.outlen, "stale ack should be ignored");
+    EXPECT_EQ(DEFAULT_TIMEOUT * 1000, ts.timeout, "timeout should be reset");
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(tftp_setup)
 RUN_TEST(test_tftp_init)
 RUN_TEST(test_tftp_session_options)
@@ -1148,6 +1392,9 @@ RUN_TEST(test_tftp_receive_data_blocksize)
 RUN_TEST(test_tftp_receive_data_windowsize)
 RUN_TEST(test_tftp_receive_data_skipped_block)
 RUN_TEST(test_tftp_receive_data_windowsize_skipped_block)
+RUN_TEST(test_tftp_receive_data_windowsize_gap_acked_once)
+RUN_TEST(test_tftp_receive_data_block_wraparound)
+RUN_TEST(test_tftp_receive_data_timeout)
 END_TEST_CASE(tftp_receive_data)
 
 BEGIN_TEST_CASE(tftp_send_data)
@@ -1155,6 +1402,8 @@ RUN_TEST(test_tftp_send_data_receive_ack)
 RUN_TEST(test_tftp_send_data_receive_final_ack)
 RUN_TEST(test_tftp_send_data_receive_ack_skipped_block)
 RUN_TEST(test_tftp_send_data_receive_ack_window_size)
+RUN_TEST(test_tftp_send_write_request_timeout)
+RUN_TEST(test_tftp_send_data_timeout_window_size)
 END_TEST_CASE(tftp_send_data)
 
 int main(int argc, char* argv[]) {
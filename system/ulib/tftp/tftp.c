@@ -33,9 +33,8 @@ static const char* kMail = "MAIL";
 static const size_t kMaxMode = 9;  // strlen(NETASCII) + 1
 
 // TSIZE
-// Limit transfer to less than 10GB
 static const char* kTsize = "TSIZE";
-static const size_t kMaxTsizeOpt = 17;  // strlen(TSIZE) + 1 + strlen(1000000000) + 1
+static const size_t kMaxTsizeOpt = 27;  // strlen(TSIZE) + 1 + strlen(UINT64_MAX) + 1
 
 // BLKSIZE
 // Max size is 65535 (max IP datagram)
@@ -133,8 +132,102 @@ static void set_error(tftp_session* session, uint16_t opcode, tftp_msg* resp, si
     session->state = ERROR;
 }
 
+// Recovers the full block number of the 16 bits received in |block|, taking
+// it to be the one nearest to |reference|.
+static uint32_t block_from_wire(uint32_t reference, uint16_t block) {
+    return reference + (int16_t)(block - (uint16_t)reference);
+}
+
+static size_t block_offset(tftp_session* session, uint32_t block) {
+    return (size_t)block * session->block_size;
+}
+
+static tftp_status build_write_request(tftp_session* session, void* outgoing, size_t* outlen) {
+    if (*outlen < 2) {
+        xprintf("outlen too short: %zd\n", *outlen);
+        return TFTP_ERR_BUFFER_TOO_SMALL;
+    }
+
+    tftp_msg* req = outgoing;
+    OPCODE(req, OPCODE_WRQ);
+    char* body = req->data;
+    memset(body, 0, *outlen - sizeof(*req));
+    size_t left = *outlen - sizeof(*req);
+    const char* filename = session->options.filename;
+    if (strlen(filename) + 1 > left - kMaxMode) {
+        xprintf("filename too long %zd > %zd\n", strlen(filename), left - kMaxMode);
+        return TFTP_ERR_INVALID_ARGS;
+    }
+    memcpy(body, filename, strlen(filename));
+    body += strlen(filename) + 1;
+    left -= strlen(filename) + 1;
+    switch (session->options.mode) {
+    case MODE_NETASCII:
+        append_option_name(&body, &left, kNetascii);
+        break;
+    case MODE_OCTET:
+        append_option_name(&body, &left, kOctet);
+        break;
+    case MODE_MAIL:
+        append_option_name(&body, &left, kMail);
+        break;
+    default:
+        return TFTP_ERR_INVALID_ARGS;
+    }
+
+    if (left < kMaxTsizeOpt) {
+        return TFTP_ERR_BUFFER_TOO_SMALL;
+    }
+    append_option(&body, &left, kTsize, "%zu", session->file_size);
+
+    if (session->options.requested & BLOCKSIZE_OPTION) {
+        if (left < kMaxBlkSizeOpt) {
+            return TFTP_ERR_BUFFER_TOO_SMALL;
+        }
+        append_option(&body, &left, kBlkSize, "%d", session->options.block_size);
+    }
+
+    if (session->options.requested & TIMEOUT_OPTION) {
+        if (left < kMaxTimeoutOpt) {
+            return TFTP_ERR_BUFFER_TOO_SMALL;
+        }
+        append_option(&body, &left, kTimeout, "%d", session->options.timeout);
+    }
+
+    if (session->options.requested & WINDOWSIZE_OPTION) {
+        if (left < kMaxWindowSizeOpt) {
+            return TFTP_ERR_BUFFER_TOO_SMALL;
+        }
+        append_option(&body, &left, kWindowSize, "%d", session->options.window_size);
+    }
+
+    *outlen = *outlen - left;
+    return TFTP_NO_ERROR;
+}
+
+// Fills |resp| with the OACK for the options already accepted from a write
+// request.
+static void build_oack(tftp_session* session, tftp_msg* resp, size_t* resp_len) {
+    char* body = resp->data;
+    memset(body, 0, *resp_len - sizeof(*resp));
+    size_t left = *resp_len - sizeof(*resp);
+
+    OPCODE(resp, OPCODE_OACK);
+    append_option(&body, &left, kTsize, "%zu", session->file_size);
+    if (session->options.requested & BLOCKSIZE_OPTION) {
+        append_option(&body, &left, kBlkSize, "%d", session->block_size);
+    }
+    if (session->options.requested & TIMEOUT_OPTION) {
+        append_option(&body, &left, kTimeout, "%d", session->timeout);
+    }
+    if (session->options.requested & WINDOWSIZE_OPTION) {
+        append_option(&body, &left, kWindowSize, "%d", session->window_size);
+    }
+    *resp_len = *resp_len - left;
+}
+
 tftp_status tx_data(tftp_session* session, tftp_data_msg* resp, size_t* outlen, void* cookie) {
-    session->offset = (session->block_number + session->window_index) * session->block_size;
+    session->offset = block_offset(session, session->block_number + session->window_index);
     *outlen = 0;
     if (session->offset < session->file_size) {
         session->window_index++;
@@ -152,7 +245,13 @@ tftp_status tx_data(tftp_session* session, tftp_data_msg* resp, size_t* outlen,
         }
         *outlen = sizeof(*resp) + len;
 
-        if (session->window_index < session->window_size) {
+        if (session->offset + len >= session->file_size) {
+            // The last block closes the window early; nothing more is pending
+            // until it is acknowledged.
+            xprintf(" -> TRANSMIT_WAIT_ON_ACK(last block)\n");
+            session->block_number += session->window_index;
+            session->window_index = 0;
+        } else if (session->window_index < session->window_size) {
             xprintf(" -> TRANSMIT_MORE(%d < %d)\n", session->window_index, session->window_size);
         } else {
             xprintf(" -> TRANSMIT_WAIT_ON_ACK(%d >= %d)\n", session->window_index,
@@ -187,6 +286,7 @@ int tftp_init(tftp_session** session, void* buffer, size_t size) {
     s->block_size = s->options.block_size = DEFAULT_BLOCKSIZE;
     s->timeout = s->options.timeout = DEFAULT_TIMEOUT;
     s->mode = s->options.mode = DEFAULT_MODE;
+    s->max_timeouts = DEFAULT_MAX_TIMEOUTS;
 
     return TFTP_NO_ERROR;
 }
@@ -229,77 +329,36 @@ tftp_status tftp_generate_write_request(tftp_session* session,
                                         void* outgoing,
                                         size_t* outlen,
                                         uint32_t* timeout_ms) {
-    if (*outlen < 2) {
-        xprintf("outlen too short: %zd\n", *outlen);
-        return TFTP_ERR_BUFFER_TOO_SMALL;
-    }
-
-    tftp_msg* ack = outgoing;
-    OPCODE(ack, OPCODE_WRQ);
-    char* body = ack->data;
-    memset(body, 0, *outlen - sizeof(*ack));
-    size_t left = *outlen - sizeof(*ack);
-    if (strlen(filename) + 1 > left - kMaxMode) {
-        xprintf("filename too long %zd > %zd\n", strlen(filename), left - kMaxMode);
+    if (strlen(filename) >= sizeof(session->options.filename)) {
+        xprintf("filename too long %zd\n", strlen(filename));
         return TFTP_ERR_INVALID_ARGS;
     }
     strncpy(session->options.filename, filename, sizeof(session->options.filename));
-    memcpy(body, filename, strlen(filename));
-    body += strlen(filename) + 1;
-    left -= strlen(filename) + 1;
-    switch (mode) {
-    case MODE_NETASCII:
-        append_option_name(&body, &left, kNetascii);
-        break;
-    case MODE_OCTET:
-        append_option_name(&body, &left, kOctet);
-        break;
-    case MODE_MAIL:
-        append_option_name(&body, &left, kMail);
-        break;
-    default:
-        return TFTP_ERR_INVALID_ARGS;
-    }
     session->options.mode = mode;
-
-    if (left < kMaxTsizeOpt) {
-        return TFTP_ERR_BUFFER_TOO_SMALL;
-    }
-    append_option(&body, &left, kTsize, "%ld", datalen);
     session->file_size = datalen;
 
     if (block_size > 0) {
-        if (left < kMaxBlkSizeOpt) {
-            return TFTP_ERR_BUFFER_TOO_SMALL;
-        }
-        append_option(&body, &left, kBlkSize, "%ld", block_size);
         session->options.block_size = block_size;
         session->options.requested |= BLOCKSIZE_OPTION;
     }
-
     if (timeout > 0) {
-        if (left < kMaxTimeoutOpt) {
-            return TFTP_ERR_BUFFER_TOO_SMALL;
-        }
-        append_option(&body, &left, kTimeout, "%d", timeout);
         session->options.timeout = timeout;
         session->options.requested |= TIMEOUT_OPTION;
     }
-
     if (window_size > 1) {
-        if (left < kMaxWindowSizeOpt) {
-            return TFTP_ERR_BUFFER_TOO_SMALL;
-        }
-        append_option(&body, &left, kWindowSize, "%d", window_size);
         session->options.window_size = window_size;
         session->options.requested |= WINDOWSIZE_OPTION;
     }
 
-    *outlen = *outlen - left;
+    tftp_status ret = build_write_request(session, outgoing, outlen);
+    if (ret < 0) {
+        return ret;
+    }
     // Nothing has been negotiated yet so use default
     *timeout_ms = 1000 * session->timeout;
 
     session->state = WRITE_REQUESTED;
+    session->direction = SEND_FILE;
     xprintf("Generated write request, len=%zu\n", *outlen);
     return TFTP_NO_ERROR;
 }
@@ -323,6 +382,12 @@ tftp_status tftp_handle_wrq(tftp_session* session,
                             size_t* resp_len,
                             uint32_t* timeout_ms,
                             void* cookie) {
+    if (session->state == WRITE_REQUESTED && session->direction == RECV_FILE) {
+        // Our OACK was lost and the request repeated; answer it again.
+        xprintf("Repeated write request\n");
+        build_oack(session, resp, resp_len);
+        return TFTP_NO_ERROR;
+    }
     if (session->state != NONE) {
         xprintf("Invalid state transition %d -> %d\n", session->state, WRITE_REQUESTED);
         set_error(session, OPCODE_ERROR, resp, resp_len);
@@ -397,7 +462,7 @@ tftp_status tftp_handle_wrq(tftp_session* session,
             session->options.timeout = val;
             session->options.requested |= TIMEOUT_OPTION;
         } else if (!strncmp(option, kTsize, strlen(kTsize))) { // RFC 2349
-            long val = atol(value);
+            long long val = atoll(value);
             if (val < 1) {
                 xprintf("invalid file size\n");
                 set_error(session, OPCODE_OERROR, resp, resp_len);
@@ -424,13 +489,7 @@ tftp_status tftp_handle_wrq(tftp_session* session,
         left -= offset;
     }
 
-    char* body = resp->data;
-    memset(body, 0, *resp_len - sizeof(*resp));
-    left = *resp_len - sizeof(*resp);
-
-    OPCODE(resp, OPCODE_OACK);
     if (session->options.requested & FILESIZE_OPTION) {
-        append_option(&body, &left, kTsize, "%d", session->options.file_size);
         session->file_size = session->options.file_size;
     } else {
         xprintf("No TSIZE option specified\n");
@@ -440,18 +499,13 @@ tftp_status tftp_handle_wrq(tftp_session* session,
     if (session->options.requested & BLOCKSIZE_OPTION) {
         // TODO(jpoichet) Make sure this block size is possible. Need API upwards to
         // request allocation of block size * window size memory
-        append_option(&body, &left, kBlkSize, "%d", session->options.block_size);
         session->block_size = session->options.block_size;
     }
     if (session->options.requested & TIMEOUT_OPTION) {
-        // TODO(jpoichet) Make sure this timeout is possible. Need API upwards to
-        // request allocation of block size * window size memory
-        append_option(&body, &left, kTimeout, "%d", session->options.timeout);
         session->timeout = session->options.timeout;
         *timeout_ms = 1000 * session->timeout;
     }
     if (session->options.requested & WINDOWSIZE_OPTION) {
-        append_option(&body, &left, kWindowSize, "%d", session->options.window_size);
         session->window_size = session->options.window_size;
     }
     if (!session->open_fn ||
@@ -460,14 +514,15 @@ tftp_status tftp_handle_wrq(tftp_session* session,
         set_error(session, OPCODE_ERROR, resp, resp_len);
         return TFTP_ERR_BAD_STATE;
     }
-    *resp_len = *resp_len - left;
+    build_oack(session, resp, resp_len);
     session->state = WRITE_REQUESTED;
+    session->direction = RECV_FILE;
 
     xprintf("Read/Write Request Parsed\n");
     xprintf("Options requested: %08x\n", session->options.requested);
     xprintf("    Block Size : %d\n", session->options.block_size);
     xprintf("    Timeout    : %d\n", session->options.timeout);
-    xprintf("    File Size  : %d\n", session->options.file_size);
+    xprintf("    File Size  : %zu\n", session->options.file_size);
     xprintf("    Window Size: %d\n", session->options.window_size);
 
     xprintf("Using options\n");
@@ -502,41 +557,52 @@ tftp_status tftp_handle_data(tftp_session* session,
 
     tftp_data_msg* data = (tftp_data_msg*)msg;
     tftp_data_msg* ack_data = (tftp_data_msg*)resp;
-    xprintf(" <- Block %u (Last = %u, Offset = %d, Size = %ld, Left = %ld)\n", data->block,
-            session->block_number, session->block_number * session->block_size,
-            session->file_size, session->file_size - session->block_number * session->block_size);
-    if (data->block == session->block_number + 1) {
+    uint32_t block = block_from_wire(session->block_number, data->block);
+    xprintf(" <- Block %u (Last = %u, Offset = %zu, Size = %zu, Left = %zu)\n", block,
+            session->block_number, block_offset(session, session->block_number),
+            session->file_size, session->file_size - block_offset(session, session->block_number));
+    if (block == session->block_number + 1) {
         xprintf("Advancing normally + 1\n");
         size_t wr = msg_len - sizeof(tftp_data_msg);
         // TODO(tkilbourn): assert that these function pointers are set
         tftp_status ret = session->write_fn(data->data, &wr,
-                session->block_number * session->block_size, cookie);
+                block_offset(session, session->block_number), cookie);
         if (ret < 0) {
             xprintf("Error writing: %d\n", ret);
             return ret;
         }
         session->block_number++;
         session->window_index++;
-    } else if (data->block > session->block_number + 1) {
+        session->gap_acked = false;
+    } else if (block > session->block_number + 1) {
+        if (session->gap_acked) {
+            // The sender has been told where to resume; the rest of this
+            // window is of no use.
+            *resp_len = 0;
+            return TFTP_NO_ERROR;
+        }
         // Force sending a ACK with the last block_number we received
-        xprintf("Skipped: got %d, expected %d\n", data->block, session->block_number + 1);
+        xprintf("Skipped: got %u, expected %u\n", block, session->block_number + 1);
         session->window_index = session->window_size;
+        session->gap_acked = true;
     } else {
-        xprintf("Resetting to block %d\n", data->block);
+        xprintf("Resetting to block %u\n", block);
         // Skip writing this block; subsequent blocks will get overwritten
         // though.
-        session->block_number = data->block;
+        session->block_number = block;
         session->window_index = 1;
+        session->gap_acked = false;
     }
 
-    if (session->window_index == session->window_size ||
-            session->block_number * session->block_size >= session->file_size) {
-        xprintf(" -> Ack %d\n", session->block_number);
+    bool last = block_offset(session, session->block_number) >= session->file_size;
+    if (session->window_index == session->window_size || last) {
+        xprintf(" -> Ack %u\n", session->block_number);
         session->window_index = 0;
         OPCODE(ack_data, OPCODE_ACK);
         ack_data->block = session->block_number;
         *resp_len = sizeof(*ack_data);
-        if (session->block_number * session->block_size >= session->file_size) {
+        if (last) {
+            session->state = COMPLETED;
             return TFTP_TRANSFER_COMPLETED;
         }
     } else {
@@ -570,12 +636,21 @@ tftp_status tftp_handle_ack(tftp_session* session,
     tftp_data_msg* ack_data = (void*)ack;
     tftp_data_msg* resp_data = (void*)resp;
 
-    xprintf(" <- Ack %d\n", ack_data->block);
-    session->block_number = ack_data->block;
+    uint32_t block = block_from_wire(session->block_number, ack_data->block);
+    xprintf(" <- Ack %u\n", block);
+    if (block < session->last_acked) {
+        // A stale duplicate; acting on it would resend data that has since
+        // been acknowledged.
+        *resp_len = 0;
+        return TFTP_NO_ERROR;
+    }
+    session->block_number = block;
+    session->last_acked = block;
     session->window_index = 0;
 
-    if ((session->block_number + session->window_index) * session->block_size >= session->file_size) {
+    if (block_offset(session, session->block_number) >= session->file_size) {
         *resp_len = 0;
+        session->state = COMPLETED;
         return TFTP_TRANSFER_COMPLETED;
     }
 
@@ -606,11 +681,25 @@ tftp_status tftp_handle_oack(tftp_session* session,
                              uint32_t* timeout_ms,
                              void* cookie) {
     xprintf("Option Ack\n");
+    tftp_data_msg* resp_data = (void*)resp;
     switch (session->state) {
     case WRITE_REQUESTED:
         session->state = TRANSMITTING;
         break;
     case TRANSMITTING:
+        if (session->direction == SEND_FILE && session->last_acked == 0) {
+            // The receiver timed out waiting for the first window and
+            // repeated its OACK; start the window over.
+            session->block_number = 0;
+            session->window_index = 0;
+            tftp_status ret = tx_data(session, resp_data, resp_len, cookie);
+            if (ret < 0) {
+                set_error(session, OPCODE_ERROR, resp, resp_len);
+            }
+            return ret;
+        }
+        set_error(session, OPCODE_ERROR, resp, resp_len);
+        return TFTP_ERR_INTERNAL;
     case NONE:
     case LAST_PACKET:
     case ERROR:
@@ -701,9 +790,9 @@ tftp_status tftp_handle_oack(tftp_session* session,
     xprintf("    File Size  : %zu\n", session->file_size);
     xprintf("    Window Size: %d\n", session->window_size);
 
-    tftp_data_msg* resp_data = (void*)resp;
     session->offset = 0;
     session->block_number = 0;
+    session->last_acked = 0;
 
     tftp_status ret = tx_data(session, resp_data, resp_len, cookie);
     if (ret < 0) {
@@ -738,8 +827,9 @@ tftp_status tftp_handle_msg(tftp_session* session,
     uint16_t opcode = ntohs(msg->opcode);
     xprintf("handle_msg opcode=%u\n", opcode);
 
-    // Set default timeout
+    // Set default timeout; hearing from the peer ends any backoff.
     *timeout_ms = 1000 * session->timeout;
+    session->consecutive_timeouts = 0;
 
     switch (opcode) {
     case OPCODE_RRQ:
@@ -787,6 +877,48 @@ tftp_status tftp_timeout(tftp_session* session,
                          size_t* outlen,
                          uint32_t* timeout_ms,
                          void* cookie) {
-    // TODO: really handle timeouts
-    return TFTP_NO_ERROR;
+    if (session->state != WRITE_REQUESTED && session->state != TRANSMITTING) {
+        *outlen = 0;
+        return TFTP_ERR_BAD_STATE;
+    }
+    if (++session->consecutive_timeouts > session->max_timeouts) {
+        xprintf("Giving up after %u timeouts\n", session->max_timeouts);
+        session->state = ERROR;
+        *outlen = 0;
+        return TFTP_ERR_TIMED_OUT;
+    }
+    uint32_t ms = (1000 * session->timeout) << session->consecutive_timeouts;
+    *timeout_ms = MIN(ms, MAX_TIMEOUT_MS);
+
+    tftp_status ret = TFTP_NO_ERROR;
+    if (session->direction == SEND_FILE) {
+        if (session->state == WRITE_REQUESTED) {
+            xprintf("Timeout: repeating write request\n");
+            ret = build_write_request(session, outgoing, outlen);
+        } else {
+            // Resend the window from the last acknowledged block.
+            xprintf("Timeout: resending from block %u\n", session->last_acked + 1);
+            session->block_number = session->last_acked;
+            session->window_index = 0;
+            ret = tx_data(session, outgoing, outlen, cookie);
+        }
+    } else {
+        if (session->state == WRITE_REQUESTED) {
+            xprintf("Timeout: repeating OACK\n");
+            build_oack(session, outgoing, outlen);
+        } else {
+            // Tell the sender where to resume, and count a fresh window.
+            xprintf("Timeout: acking block %u\n", session->block_number);
+            tftp_data_msg* ack_data = outgoing;
+            OPCODE(ack_data, OPCODE_ACK);
+            ack_data->block = session->block_number;
+            *outlen = sizeof(*ack_data);
+            session->window_index = 0;
+            session->gap_acked = false;
+        }
+    }
+    if (ret < 0) {
+        set_error(session, OPCODE_ERROR, outgoing, outlen);
+    }
+    return ret;
 }
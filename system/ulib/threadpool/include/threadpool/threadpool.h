@@ -0,0 +1,83 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <magenta/compiler.h>
+#include <magenta/types.h>
+
+#include <stdatomic.h>
+
+__BEGIN_CDECLS
+
+// A pool of worker threads running tasks.  Each worker keeps the tasks it
+// posts itself on a deque of its own, running the newest first, and when
+// it runs out takes the oldest from the other workers' deques.  Tasks
+// posted from outside the pool go on a queue all the workers share.  Idle
+// workers sleep on a port, which can also carry handle waits.
+
+typedef struct threadpool threadpool_t;
+typedef struct tp_task tp_task_t;
+typedef struct tp_group tp_group_t;
+typedef struct tp_wait tp_wait_t;
+
+struct tp_task {
+    // Called on a worker.  The task is the pool's no longer, and may be
+    // freed or posted again.
+    void (*func)(tp_task_t* task);
+
+    // for the pool's use while the task is posted
+    tp_task_t* next;
+    tp_group_t* group;
+};
+
+// Tasks posted together, to be waited for together.
+struct tp_group {
+    atomic_int pending;
+};
+
+#define TP_GROUP_INIT ((tp_group_t){0})
+
+struct tp_wait {
+    mx_handle_t handle;
+    mx_signals_t waitfor;
+    // Called on a worker once any of |waitfor| is asserted, with the
+    // signals which were.  The wait is over; threadpool_wait_async()
+    // starts another.
+    void (*func)(tp_wait_t* wait, mx_signals_t observed);
+};
+
+// Starts a pool of |threads| workers, or one per CPU if |threads| is 0,
+// named |name|.
+mx_status_t threadpool_create(uint32_t threads, const char* name, threadpool_t** out);
+
+// Runs every task posted so far, then stops the workers and frees the
+// pool.  Any handle waits still pending must be cancelled first.  Not to
+// be called from a worker.
+void threadpool_destroy(threadpool_t* pool);
+
+// How many workers the pool has.
+uint32_t threadpool_size(threadpool_t* pool);
+
+// Makes |task| run on some worker.  The task must not already be posted.
+void threadpool_post(threadpool_t* pool, tp_task_t* task);
+
+// Makes |task| run on some worker, as one of |group|.
+void threadpool_post_group(threadpool_t* pool, tp_group_t* group, tp_task_t* task);
+
+// Returns once every task of |group| has run.  Meanwhile the caller runs
+// tasks of the pool's itself, so a worker can wait for tasks it posted
+// without holding up the pool.
+void threadpool_group_wait(threadpool_t* pool, tp_group_t* group);
+
+// Calls |wait->func| on a worker once |wait->handle| asserts any of
+// |wait->waitfor|.  It is the next idle worker that does so, so a pool
+// kept busy with tasks answers handles late.
+mx_status_t threadpool_wait_async(threadpool_t* pool, tp_wait_t* wait);
+
+// Cancels a wait started by threadpool_wait_async().  Its function may
+// already be running, or about to.
+mx_status_t threadpool_cancel(threadpool_t* pool, tp_wait_t* wait);
+
+__END_CDECLS
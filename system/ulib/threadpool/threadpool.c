@@ -0,0 +1,372 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+#include <magenta/syscalls.h>
+#include <magenta/syscalls/port.h>
+
+#include <threadpool/threadpool.h>
+
+// make a worker's deque hold this many tasks, before it overflows to the
+// shared queue
+#define DEQUE_SIZE 1024
+
+#define MAX_THREADS 64
+
+// The key of the packets that wake idle workers; every handle wait's key
+// is the tp_wait_t's address.
+#define UNPARK_KEY 0
+
+// A Chase-Lev deque, as given for C11 atomics by Lê et al., "Correct and
+// Efficient Work-Stealing for Weak Memory Models" (PPoPP 2013).  Only its
+// worker pushes and takes, at the bottom; anyone steals, from the top.
+typedef struct {
+    _Atomic(int64_t) top;
+    char pad[64 - sizeof(int64_t)];
+    _Atomic(int64_t) bottom;
+    _Atomic(tp_task_t*) tasks[DEQUE_SIZE];
+} deque_t;
+
+typedef struct {
+    deque_t deque;
+    threadpool_t* pool;
+    thrd_t thread;
+    uint32_t seed;
+} worker_t;
+
+struct threadpool {
+    mx_handle_t port;
+    uint32_t nworkers;
+    worker_t* workers;
+
+    // how many workers are asleep or about to be, less those already
+    // sent a packet to wake up
+    atomic_int idle;
+    atomic_bool stopping;
+
+    // tasks posted from outside, or that wouldn't fit on a deque
+    mtx_t lock;
+    tp_task_t* head;
+    tp_task_t* tail;
+    atomic_int queued;
+};
+
+// the worker this thread is, if any
+static thread_local worker_t* current;
+
+static bool deque_push(deque_t* d, tp_task_t* task) {
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    int64_t t = atomic_load_explicit(&d->top, memory_order_acquire);
+    if (b - t >= DEQUE_SIZE) {
+        return false;
+    }
+    atomic_store_explicit(&d->tasks[b % DEQUE_SIZE], task, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    return true;
+}
+
+static tp_task_t* deque_take(deque_t* d) {
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t t = atomic_load_explicit(&d->top, memory_order_relaxed);
+    tp_task_t* task = NULL;
+    if (t <= b) {
+        task = atomic_load_explicit(&d->tasks[b % DEQUE_SIZE], memory_order_relaxed);
+        if (t == b) {
+            // the last one: race the thieves for it
+            if (!atomic_compare_exchange_strong_explicit(
+                    &d->top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed)) {
+                task = NULL;
+            }
+            atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+        }
+    } else {
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    }
+    return task;
+}
+
+static tp_task_t* deque_steal(deque_t* d) {
+    int64_t t = atomic_load_explicit(&d->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+    if (t >= b) {
+        return NULL;
+    }
+    tp_task_t* task = atomic_load_explicit(&d->tasks[t % DEQUE_SIZE], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(
+            &d->top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed)) {
+        // another thief got it; let the caller look elsewhere
+        return NULL;
+    }
+    return task;
+}
+
+static void enqueue(threadpool_t* pool, tp_task_t* task) {
+    task->next = NULL;
+    mtx_lock(&pool->lock);
+    if (pool->tail) {
+        pool->tail->next = task;
+    } else {
+        pool->head = task;
+    }
+    pool->tail = task;
+    atomic_fetch_add(&pool->queued, 1);
+    mtx_unlock(&pool->lock);
+}
+
+static tp_task_t* dequeue(threadpool_t* pool) {
+    if (atomic_load(&pool->queued) == 0) {
+        return NULL;
+    }
+    mtx_lock(&pool->lock);
+    tp_task_t* task = pool->head;
+    if (task) {
+        pool->head = task->next;
+        if (!pool->head) {
+            pool->tail = NULL;
+        }
+        atomic_fetch_sub(&pool->queued, 1);
+    }
+    mtx_unlock(&pool->lock);
+    return task;
+}
+
+static tp_task_t* steal(threadpool_t* pool, worker_t* self) {
+    uint32_t start = 0;
+    if (self) {
+        // xorshift, so thieves don't all pick on the same victim
+        self->seed ^= self->seed << 13;
+        self->seed ^= self->seed >> 17;
+        self->seed ^= self->seed << 5;
+        start = self->seed;
+    }
+    for (uint32_t i = 0; i < pool->nworkers; i++) {
+        worker_t* victim = &pool->workers[(start + i) % pool->nworkers];
+        if (victim == self) {
+            continue;
+        }
+        tp_task_t* task = deque_steal(&victim->deque);
+        if (task) {
+            return task;
+        }
+    }
+    return NULL;
+}
+
+static tp_task_t* find_task(threadpool_t* pool, worker_t* self) {
+    tp_task_t* task = NULL;
+    if (self) {
+        task = deque_take(&self->deque);
+    }
+    if (!task) {
+        task = dequeue(pool);
+    }
+    if (!task) {
+        task = steal(pool, self);
+    }
+    return task;
+}
+
+static void run(tp_task_t* task) {
+    // the task may be gone once it has run
+    tp_group_t* group = task->group;
+    task->func(task);
+    if (group && atomic_fetch_sub(&group->pending, 1) == 1) {
+        mx_futex_wake(&group->pending, UINT32_MAX);
+    }
+}
+
+// Wakes a worker, if any is asleep.  This follows making a task findable,
+// and a worker going to sleep looks for tasks after counting itself idle,
+// so either it finds the task or this finds it idle.
+static void unpark(threadpool_t* pool) {
+    int idle = atomic_load(&pool->idle);
+    while (idle > 0) {
+        if (atomic_compare_exchange_weak(&pool->idle, &idle, idle - 1)) {
+            mx_port_packet_t pkt = {
+                .key = UNPARK_KEY,
+                .type = MX_PKT_TYPE_USER,
+            };
+            mx_port_queue(pool->port, &pkt, 0);
+            return;
+        }
+    }
+}
+
+// Takes this worker back out of the idle count, unless someone already
+// has, in which case they have sent it a packet it will find later.
+static void unidle(threadpool_t* pool) {
+    int idle = atomic_load(&pool->idle);
+    while (idle > 0 && !atomic_compare_exchange_weak(&pool->idle, &idle, idle - 1))
+        ;
+}
+
+// Sleeps until there is something to do.  Returns false if the pool is
+// stopping and there is nothing left.
+static bool park(threadpool_t* pool, worker_t* self) {
+    atomic_fetch_add(&pool->idle, 1);
+
+    tp_task_t* task = find_task(pool, self);
+    if (task) {
+        unidle(pool);
+        run(task);
+        return true;
+    }
+    if (atomic_load(&pool->stopping)) {
+        unidle(pool);
+        return false;
+    }
+
+    mx_port_packet_t pkt;
+    if (mx_port_wait(pool->port, MX_TIME_INFINITE, &pkt, 0) != MX_OK) {
+        unidle(pool);
+        return false;
+    }
+    if (pkt.key != UNPARK_KEY) {
+        unidle(pool);
+        tp_wait_t* wait = (tp_wait_t*)(uintptr_t)pkt.key;
+        wait->func(wait, pkt.signal.observed);
+    }
+    return true;
+}
+
+static int worker_main(void* arg) {
+    worker_t* self = arg;
+    threadpool_t* pool = self->pool;
+    current = self;
+    for (;;) {
+        tp_task_t* task = find_task(pool, self);
+        if (task) {
+            run(task);
+        } else if (!park(pool, self)) {
+            break;
+        }
+    }
+    return 0;
+}
+
+mx_status_t threadpool_create(uint32_t threads, const char* name, threadpool_t** out) {
+    if (threads == 0) {
+        threads = mx_system_get_num_cpus();
+    }
+    if (threads > MAX_THREADS) {
+        threads = MAX_THREADS;
+    }
+
+    threadpool_t* pool = calloc(1, sizeof(*pool));
+    if (pool == NULL) {
+        return MX_ERR_NO_MEMORY;
+    }
+    // aligned_alloc, so each deque starts on a cache line of its own
+    size_t size = (sizeof(worker_t) * threads + 63) & ~(size_t)63;
+    if ((pool->workers = aligned_alloc(64, size)) == NULL) {
+        free(pool);
+        return MX_ERR_NO_MEMORY;
+    }
+    memset(pool->workers, 0, size);
+    mx_status_t status = mx_port_create(MX_PORT_OPT_V2, &pool->port);
+    if (status != MX_OK) {
+        free(pool->workers);
+        free(pool);
+        return status;
+    }
+    mtx_init(&pool->lock, mtx_plain);
+
+    for (uint32_t i = 0; i < threads; i++) {
+        worker_t* w = &pool->workers[i];
+        w->pool = pool;
+        w->seed = 0x9e3779b9u * (i + 1);
+        char tname[MX_MAX_NAME_LEN];
+        snprintf(tname, sizeof(tname), "%s-%u", name, i);
+        if (thrd_create_with_name(&w->thread, worker_main, w, tname) != thrd_success) {
+            status = MX_ERR_NO_RESOURCES;
+            break;
+        }
+        pool->nworkers++;
+    }
+    if (status != MX_OK) {
+        threadpool_destroy(pool);
+        return status;
+    }
+
+    *out = pool;
+    return MX_OK;
+}
+
+void threadpool_destroy(threadpool_t* pool) {
+    atomic_store(&pool->stopping, true);
+    for (uint32_t i = 0; i < pool->nworkers; i++) {
+        mx_port_packet_t pkt = {
+            .key = UNPARK_KEY,
+            .type = MX_PKT_TYPE_USER,
+        };
+        mx_port_queue(pool->port, &pkt, 0);
+    }
+    for (uint32_t i = 0; i < pool->nworkers; i++) {
+        thrd_join(pool->workers[i].thread, NULL);
+    }
+    mx_handle_close(pool->port);
+    mtx_destroy(&pool->lock);
+    free(pool->workers);
+    free(pool);
+}
+
+uint32_t threadpool_size(threadpool_t* pool) {
+    return pool->nworkers;
+}
+
+static void post(threadpool_t* pool, tp_task_t* task) {
+    worker_t* self = current;
+    if (self == NULL || self->pool != pool || !deque_push(&self->deque, task)) {
+        enqueue(pool, task);
+    }
+    unpark(pool);
+}
+
+void threadpool_post(threadpool_t* pool, tp_task_t* task) {
+    task->group = NULL;
+    post(pool, task);
+}
+
+void threadpool_post_group(threadpool_t* pool, tp_group_t* group, tp_task_t* task) {
+    task->group = group;
+    atomic_fetch_add(&group->pending, 1);
+    post(pool, task);
+}
+
+void threadpool_group_wait(threadpool_t* pool, tp_group_t* group) {
+    worker_t* self = current;
+    if (self != NULL && self->pool != pool) {
+        self = NULL;
+    }
+    int pending;
+    while ((pending = atomic_load(&group->pending)) != 0) {
+        tp_task_t* task = find_task(pool, self);
+        if (task) {
+            run(task);
+            continue;
+        }
+        // The rest are running elsewhere.  Look again now and then, in
+        // case one of them posts more of the group to the shared queue.
+        mx_futex_wait(&group->pending, pending, mx_deadline_after(MX_MSEC(1)));
+    }
+}
+
+mx_status_t threadpool_wait_async(threadpool_t* pool, tp_wait_t* wait) {
+    return mx_object_wait_async(wait->handle, pool->port, (uintptr_t)wait,
+                                wait->waitfor, MX_WAIT_ASYNC_ONCE);
+}
+
+mx_status_t threadpool_cancel(threadpool_t* pool, tp_wait_t* wait) {
+    return mx_port_cancel(pool->port, wait->handle, (uintptr_t)wait);
+}
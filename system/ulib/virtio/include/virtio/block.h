@@ -17,10 +17,13 @@
 #define VIRTIO_BLK_F_FLUSH      (1u << 9)
 #define VIRTIO_BLK_F_TOPOLOGY   (1u << 10)
 #define VIRTIO_BLK_F_CONFIG_WCE (1u << 11)
+#define VIRTIO_BLK_F_MQ         (1u << 12)
+#define VIRTIO_BLK_F_DISCARD    (1u << 13)
 
 #define VIRTIO_BLK_T_IN         0
 #define VIRTIO_BLK_T_OUT        1
 #define VIRTIO_BLK_T_FLUSH      4
+#define VIRTIO_BLK_T_DISCARD    11
 
 #define VIRTIO_BLK_S_OK         0
 #define VIRTIO_BLK_S_IOERR      1
@@ -35,12 +38,27 @@ typedef struct virtio_blk_geometry {
     uint8_t sectors;
 } __PACKED virtio_blk_geometry_t;
 
+typedef struct virtio_blk_topology {
+    uint8_t physical_block_exp;
+    uint8_t alignment_offset;
+    uint16_t min_io_size;
+    uint32_t opt_io_size;
+} __PACKED virtio_blk_topology_t;
+
 typedef struct virtio_blk_config {
     uint64_t capacity;
     uint32_t size_max;
     uint32_t seg_max;
     virtio_blk_geometry_t geometry;
     uint32_t blk_size;
+    virtio_blk_topology_t topology;
+    uint8_t writeback;
+    uint8_t unused0;
+    uint16_t num_queues; // with VIRTIO_BLK_F_MQ
+    // with VIRTIO_BLK_F_DISCARD
+    uint32_t max_discard_sectors;
+    uint32_t max_discard_seg;
+    uint32_t discard_sector_alignment;
 } __PACKED virtio_blk_config_t;
 
 typedef struct virtio_blk_req {
@@ -49,4 +67,11 @@ typedef struct virtio_blk_req {
     uint64_t sector;
 } __PACKED virtio_blk_req_t;
 
+// The data of a VIRTIO_BLK_T_DISCARD, one for each range.
+typedef struct virtio_blk_discard {
+    uint64_t sector;
+    uint32_t num_sectors;
+    uint32_t flags;
+} __PACKED virtio_blk_discard_t;
+
 __END_CDECLS
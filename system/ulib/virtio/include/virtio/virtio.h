@@ -25,3 +25,7 @@
 
 #define VIRTIO_PCI_CONFIG_OFFSET_NOMSI      0x14    // uint16_t
 #define VIRTIO_PCI_CONFIG_OFFSET_MSI        0x18    // uint16_t
+
+// Feature bits common to all device types, by number, like the
+// VIRTIO_RING_F_* ones
+#define VIRTIO_F_ANY_LAYOUT                 27
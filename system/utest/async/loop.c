@@ -0,0 +1,248 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string.h>
+#include <threads.h>
+
+#include <async/loop.h>
+#include <magenta/threads.h>
+#include <magenta/syscalls.h>
+#include <unittest/unittest.h>
+
+typedef struct {
+    async_timer_t timer;
+    int id;
+    int* order;
+    int* count;
+} order_timer_t;
+
+static void on_order_timer(async_loop_t* loop, async_timer_t* timer, mx_status_t status) {
+    order_timer_t* t = (order_timer_t*)timer;
+    if (status == MX_OK) {
+        t->order[(*t->count)++] = t->id;
+    }
+}
+
+static bool timer_order_test(void) {
+    BEGIN_TEST;
+    async_loop_t* loop;
+    ASSERT_EQ(async_loop_create(&loop), MX_OK, "");
+
+    // Started out of order, one of them cancelled again.
+    enum { N = 8 };
+    static const int delays[N] = {5, 1, 7, 3, 2, 8, 4, 6};
+    order_timer_t timers[N];
+    int order[N];
+    int count = 0;
+    mx_time_t now = mx_time_get(MX_CLOCK_MONOTONIC);
+    for (int i = 0; i < N; i++) {
+        memset(&timers[i], 0, sizeof(timers[i]));
+        timers[i].timer.handler = on_order_timer;
+        timers[i].timer.deadline = now + MX_MSEC(delays[i]);
+        timers[i].id = delays[i];
+        timers[i].order = order;
+        timers[i].count = &count;
+        ASSERT_EQ(async_timer_start(loop, &timers[i].timer), MX_OK, "");
+    }
+    EXPECT_EQ(async_timer_start(loop, &timers[0].timer), MX_ERR_ALREADY_EXISTS, "");
+    EXPECT_EQ(async_timer_cancel(loop, &timers[3].timer), MX_OK, "");
+    EXPECT_EQ(async_timer_cancel(loop, &timers[3].timer), MX_ERR_NOT_FOUND, "");
+
+    EXPECT_EQ(async_loop_run(loop, now + MX_MSEC(50), false), MX_ERR_TIMED_OUT, "");
+    ASSERT_EQ(count, N - 1, "");
+    static const int expected[N - 1] = {1, 2, 4, 5, 6, 7, 8};
+    for (int i = 0; i < N - 1; i++) {
+        EXPECT_EQ(order[i], expected[i], "timers fire by deadline");
+    }
+    async_loop_destroy(loop);
+    END_TEST;
+}
+
+typedef struct {
+    async_wait_t wait;
+    int calls;
+    mx_status_t status;
+    mx_signals_t observed;
+} count_wait_t;
+
+static async_wait_result_t on_signal(async_loop_t* loop, async_wait_t* wait,
+                                     mx_status_t status, const mx_packet_signal_t* signal) {
+    count_wait_t* w = (count_wait_t*)wait;
+    w->calls++;
+    w->status = status;
+    if (status != MX_OK) {
+        return ASYNC_WAIT_FINISHED;
+    }
+    w->observed = signal->observed;
+    mx_object_signal(w->wait.object, MX_USER_SIGNAL_0, 0);
+    return w->calls < 3 ? ASYNC_WAIT_AGAIN : ASYNC_WAIT_FINISHED;
+}
+
+static bool wait_test(void) {
+    BEGIN_TEST;
+    async_loop_t* loop;
+    ASSERT_EQ(async_loop_create(&loop), MX_OK, "");
+    mx_handle_t event;
+    ASSERT_EQ(mx_event_create(0, &event), MX_OK, "");
+
+    count_wait_t w = {
+        .wait = {.object = event, .trigger = MX_USER_SIGNAL_0, .handler = on_signal},
+    };
+    ASSERT_EQ(async_wait_begin(loop, &w.wait), MX_OK, "");
+    for (int i = 0; i < 4; i++) {
+        ASSERT_EQ(mx_object_signal(event, 0, MX_USER_SIGNAL_0), MX_OK, "");
+        async_loop_run(loop, mx_deadline_after(MX_MSEC(10)), true);
+    }
+    EXPECT_EQ(w.calls, 3, "waits again until the handler is done");
+    EXPECT_EQ(w.observed & MX_USER_SIGNAL_0, MX_USER_SIGNAL_0, "");
+    EXPECT_EQ(async_wait_cancel(loop, &w.wait), MX_ERR_NOT_FOUND, "");
+
+    // A packet already queued goes when the wait is cancelled.
+    w.calls = 0;
+    ASSERT_EQ(async_wait_begin(loop, &w.wait), MX_OK, "");
+    ASSERT_EQ(mx_object_signal(event, 0, MX_USER_SIGNAL_0), MX_OK, "");
+    EXPECT_EQ(async_wait_cancel(loop, &w.wait), MX_OK, "");
+    EXPECT_EQ(async_loop_run(loop, mx_deadline_after(MX_MSEC(10)), false), MX_ERR_TIMED_OUT, "");
+    EXPECT_EQ(w.calls, 0, "");
+
+    // Destroying the loop cancels whatever is pending.
+    ASSERT_EQ(mx_object_signal(event, MX_USER_SIGNAL_0, 0), MX_OK, "");
+    ASSERT_EQ(async_wait_begin(loop, &w.wait), MX_OK, "");
+    async_loop_destroy(loop);
+    EXPECT_EQ(w.calls, 1, "");
+    EXPECT_EQ(w.status, MX_ERR_CANCELED, "");
+
+    mx_handle_close(event);
+    END_TEST;
+}
+
+typedef struct {
+    async_task_t task;
+    int id;
+    int* last;
+    bool in_order;
+} order_task_t;
+
+static void on_task(async_loop_t* loop, async_task_t* task, mx_status_t status) {
+    order_task_t* t = (order_task_t*)task;
+    t->in_order = (*t->last == t->id - 1);
+    *t->last = t->id;
+}
+
+enum { NUM_TASKS = 1000 };
+
+typedef struct {
+    async_loop_t* loop;
+    order_task_t* tasks;
+} poster_t;
+
+static int post_tasks(void* arg) {
+    poster_t* p = arg;
+    for (int i = 0; i < NUM_TASKS; i++) {
+        async_task_post(p->loop, &p->tasks[i].task);
+    }
+    return 0;
+}
+
+static async_wait_result_t on_quit(async_loop_t* loop, async_wait_t* wait,
+                                   mx_status_t status, const mx_packet_signal_t* signal) {
+    if (status == MX_OK)
+        async_loop_quit(loop);
+    return ASYNC_WAIT_FINISHED;
+}
+
+static bool task_test(void) {
+    BEGIN_TEST;
+    async_loop_t* loop;
+    ASSERT_EQ(async_loop_create(&loop), MX_OK, "");
+
+    static order_task_t tasks[NUM_TASKS];
+    int last = -1;
+    for (int i = 0; i < NUM_TASKS; i++) {
+        memset(&tasks[i], 0, sizeof(tasks[i]));
+        tasks[i].task.handler = on_task;
+        tasks[i].id = i;
+        tasks[i].last = &last;
+    }
+
+    // Quit once the poster thread is gone, which is after its last post.
+    poster_t p = {.loop = loop, .tasks = tasks};
+    thrd_t thread;
+    ASSERT_EQ(thrd_create(&thread, post_tasks, &p), thrd_success, "");
+    async_wait_t quit = {
+        .object = thrd_get_mx_handle(thread),
+        .trigger = MX_THREAD_TERMINATED,
+        .handler = on_quit,
+    };
+    ASSERT_EQ(async_wait_begin(loop, &quit), MX_OK, "");
+    EXPECT_EQ(async_loop_run(loop, MX_TIME_INFINITE, false), MX_ERR_CANCELED, "");
+    thrd_join(thread, NULL);
+
+    // The last few may have come after the quit.
+    async_loop_destroy(loop);
+    EXPECT_EQ(last, NUM_TASKS - 1, "");
+    for (int i = 0; i < NUM_TASKS; i++) {
+        EXPECT_TRUE(tasks[i].in_order, "tasks run in the order posted");
+    }
+    END_TEST;
+}
+
+typedef struct {
+    async_reader_t reader;
+    uint32_t buf[4];
+    uint32_t next;
+    bool closed;
+} count_reader_t;
+
+static async_wait_result_t on_message(async_loop_t* loop, async_reader_t* reader,
+                                      mx_status_t status, uint32_t actual_bytes,
+                                      uint32_t actual_handles) {
+    count_reader_t* r = (count_reader_t*)reader;
+    if (status == MX_ERR_PEER_CLOSED) {
+        r->closed = true;
+        async_loop_quit(loop);
+        return ASYNC_WAIT_FINISHED;
+    }
+    if (status != MX_OK || actual_bytes != sizeof(uint32_t) || r->buf[0] != r->next) {
+        return ASYNC_WAIT_FINISHED;
+    }
+    r->next++;
+    return ASYNC_WAIT_AGAIN;
+}
+
+static bool reader_test(void) {
+    BEGIN_TEST;
+    async_loop_t* loop;
+    ASSERT_EQ(async_loop_create(&loop), MX_OK, "");
+    mx_handle_t h[2];
+    ASSERT_EQ(mx_channel_create(0, &h[0], &h[1]), MX_OK, "");
+
+    count_reader_t r = {
+        .reader = {.channel = h[0], .handler = on_message},
+    };
+    r.reader.bytes = r.buf;
+    r.reader.num_bytes = sizeof(r.buf);
+    ASSERT_EQ(async_reader_begin(loop, &r.reader), MX_OK, "");
+
+    // More than are read for one packet, so it takes a few.
+    enum { N = 100 };
+    for (uint32_t i = 0; i < N; i++) {
+        ASSERT_EQ(mx_channel_write(h[1], 0, &i, sizeof(i), NULL, 0), MX_OK, "");
+    }
+    mx_handle_close(h[1]);
+    EXPECT_EQ(async_loop_run(loop, mx_deadline_after(MX_SEC(5)), false), MX_ERR_CANCELED, "");
+    EXPECT_EQ(r.next, (uint32_t)N, "every message read, in order");
+    EXPECT_TRUE(r.closed, "");
+
+    async_loop_destroy(loop);
+    mx_handle_close(h[0]);
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(async_loop_tests)
+RUN_TEST(timer_order_test)
+RUN_TEST(wait_test)
+RUN_TEST(task_test)
+RUN_TEST(reader_test)
+END_TEST_CASE(async_loop_tests)
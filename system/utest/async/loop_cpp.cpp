@@ -0,0 +1,75 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <async/cpp/loop.h>
+#include <magenta/syscalls.h>
+#include <unittest/unittest.h>
+
+namespace {
+
+// Waits for an event, then a little longer, then hands off to a task,
+// each step naming the next.
+class Steps {
+public:
+    explicit Steps(mx_handle_t event) : event_(event), wait_(this), timer_(this), task_(this) {}
+
+    mx_status_t Start(async_loop_t* loop) {
+        return wait_.Begin(loop, event_, MX_USER_SIGNAL_0, &Steps::OnSignal);
+    }
+
+    int step() const { return step_; }
+
+private:
+    async_wait_result_t OnSignal(async_loop_t* loop, mx_status_t status,
+                                 const mx_packet_signal_t* signal) {
+        if (status != MX_OK)
+            return ASYNC_WAIT_FINISHED;
+        step_ = 1;
+        timer_.Start(loop, mx_deadline_after(MX_MSEC(1)), &Steps::OnTimer);
+        return ASYNC_WAIT_FINISHED;
+    }
+
+    void OnTimer(async_loop_t* loop, mx_status_t status) {
+        if (status != MX_OK)
+            return;
+        step_ = 2;
+        task_.Post(loop, &Steps::OnTask);
+    }
+
+    void OnTask(async_loop_t* loop, mx_status_t status) {
+        if (status != MX_OK)
+            return;
+        step_ = 3;
+        async_loop_quit(loop);
+    }
+
+    mx_handle_t event_;
+    async::Wait<Steps> wait_;
+    async::Timer<Steps> timer_;
+    async::Task<Steps> task_;
+    int step_ = 0;
+};
+
+bool steps_test() {
+    BEGIN_TEST;
+    async::Loop loop;
+    ASSERT_EQ(loop.Create(), MX_OK, "");
+    mx_handle_t event;
+    ASSERT_EQ(mx_event_create(0, &event), MX_OK, "");
+
+    Steps steps(event);
+    ASSERT_EQ(steps.Start(loop.get()), MX_OK, "");
+    ASSERT_EQ(mx_object_signal(event, 0, MX_USER_SIGNAL_0), MX_OK, "");
+    EXPECT_EQ(loop.Run(mx_deadline_after(MX_SEC(5))), MX_ERR_CANCELED, "");
+    EXPECT_EQ(steps.step(), 3, "");
+
+    mx_handle_close(event);
+    END_TEST;
+}
+
+} // namespace
+
+BEGIN_TEST_CASE(async_cpp_tests)
+RUN_TEST(steps_test)
+END_TEST_CASE(async_cpp_tests)
@@ -0,0 +1,22 @@
+# Copyright 2017 The Fuchsia Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+LOCAL_DIR := $(GET_LOCAL_DIR)
+
+MODULE := $(LOCAL_DIR)
+
+MODULE_TYPE := usertest
+
+MODULE_SRCS += \
+    $(LOCAL_DIR)/loop.c \
+    $(LOCAL_DIR)/loop_cpp.cpp \
+    $(LOCAL_DIR)/main.c
+
+MODULE_NAME := async-test
+
+MODULE_STATIC_LIBS := system/ulib/async system/ulib/mxcpp system/ulib/mxtl
+
+MODULE_LIBS := system/ulib/unittest system/ulib/mxio system/ulib/magenta system/ulib/c
+
+include make/module.mk
@@ -0,0 +1,117 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <magenta/syscalls.h>
+#include <magenta/syscalls/batch.h>
+#include <magenta/syscalls/port.h>
+#include <unittest/unittest.h>
+#include <stdbool.h>
+#include <string.h>
+
+static bool batch_signal_and_close(void) {
+    BEGIN_TEST;
+
+    mx_handle_t events[4];
+    for (int i = 0; i < 4; i++)
+        ASSERT_EQ(mx_event_create(0u, &events[i]), MX_OK, "");
+
+    mx_batch_op_t ops[8];
+    memset(ops, 0, sizeof(ops));
+    for (int i = 0; i < 4; i++) {
+        ops[i].op = MX_BATCH_OP_OBJECT_SIGNAL;
+        ops[i].handle = events[i];
+        ops[i].args[0] = 0u;
+        ops[i].args[1] = MX_USER_SIGNAL_0;
+        ops[i].status = 1;
+    }
+    // A failure doesn't stop the operations after it.
+    ops[4].op = MX_BATCH_OP_HANDLE_CLOSE;
+    ops[4].handle = MX_HANDLE_INVALID;
+    ops[5].op = 0xffffu;
+    ops[6].op = MX_BATCH_OP_HANDLE_CLOSE;
+    ops[6].handle = events[0];
+    ops[7].op = MX_BATCH_OP_HANDLE_CLOSE;
+    ops[7].handle = events[1];
+
+    ASSERT_EQ(mx_batch_submit(ops, 8u), MX_OK, "");
+    for (int i = 0; i < 4; i++)
+        EXPECT_EQ(ops[i].status, MX_OK, "");
+    EXPECT_EQ(ops[4].status, MX_ERR_BAD_HANDLE, "");
+    EXPECT_EQ(ops[5].status, MX_ERR_NOT_SUPPORTED, "");
+    EXPECT_EQ(ops[6].status, MX_OK, "");
+    EXPECT_EQ(ops[7].status, MX_OK, "");
+
+    for (int i = 2; i < 4; i++) {
+        mx_signals_t pending = 0;
+        EXPECT_EQ(mx_object_wait_one(events[i], MX_USER_SIGNAL_0, 0u, &pending), MX_OK, "");
+        EXPECT_EQ(pending & MX_USER_SIGNAL_0, MX_USER_SIGNAL_0, "");
+    }
+    EXPECT_EQ(mx_handle_close(events[0]), MX_ERR_BAD_HANDLE, "");
+    EXPECT_EQ(mx_handle_close(events[1]), MX_ERR_BAD_HANDLE, "");
+
+    mx_handle_close(events[2]);
+    mx_handle_close(events[3]);
+
+    END_TEST;
+}
+
+static bool batch_port_queue(void) {
+    BEGIN_TEST;
+
+    mx_handle_t port;
+    ASSERT_EQ(mx_port_create(MX_PORT_OPT_V2, &port), MX_OK, "");
+
+    mx_port_packet_t packets[3];
+    mx_batch_op_t ops[3];
+    memset(packets, 0, sizeof(packets));
+    memset(ops, 0, sizeof(ops));
+    for (int i = 0; i < 3; i++) {
+        packets[i].key = 100u + i;
+        packets[i].type = MX_PKT_TYPE_USER;
+        ops[i].op = MX_BATCH_OP_PORT_QUEUE;
+        ops[i].handle = port;
+        ops[i].args[0] = (uintptr_t)&packets[i];
+        ops[i].args[1] = 0u;
+    }
+
+    ASSERT_EQ(mx_batch_submit(ops, 3u), MX_OK, "");
+    uint32_t seen = 0u;
+    for (int i = 0; i < 3; i++) {
+        EXPECT_EQ(ops[i].status, MX_OK, "");
+        mx_port_packet_t out;
+        ASSERT_EQ(mx_port_wait(port, 0u, &out, 0u), MX_OK, "");
+        ASSERT_GE(out.key, 100u, "");
+        ASSERT_LT(out.key, 103u, "");
+        seen |= 1u << (out.key - 100u);
+    }
+    EXPECT_EQ(seen, 7u, "");
+
+    mx_handle_close(port);
+
+    END_TEST;
+}
+
+static bool batch_bad_args(void) {
+    BEGIN_TEST;
+
+    mx_batch_op_t ops[65];
+    memset(ops, 0, sizeof(ops));
+    EXPECT_EQ(mx_batch_submit(ops, 0u), MX_ERR_INVALID_ARGS, "");
+    EXPECT_EQ(mx_batch_submit(ops, 65u), MX_ERR_INVALID_ARGS, "");
+    EXPECT_EQ(mx_batch_submit(NULL, 1u), MX_ERR_INVALID_ARGS, "");
+
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(batch_tests)
+RUN_TEST(batch_signal_and_close)
+RUN_TEST(batch_port_queue)
+RUN_TEST(batch_bad_args)
+END_TEST_CASE(batch_tests)
+
+#ifndef BUILD_COMBINED_TESTS
+int main(int argc, char** argv) {
+    return unittest_run_all_tests(argc, argv) ? 0 : -1;
+}
+#endif
@@ -861,6 +861,63 @@ static bool channel_disallow_write_to_self(void) {
     END_TEST;
 }
 
+static bool channel_read_write_many(void) {
+    BEGIN_TEST;
+
+    mx_handle_t a[2], b[2];
+    ASSERT_EQ(mx_channel_create(0, &a[0], &a[1]), MX_OK, "");
+    ASSERT_EQ(mx_channel_create(0, &b[0], &b[1]), MX_OK, "");
+
+    mx_handle_t event;
+    ASSERT_EQ(mx_event_create(0u, &event), MX_OK, "");
+
+    // Two messages to the first channel, one carrying a handle, and one
+    // to the second.
+    uint32_t out[3] = {1u, 2u, 3u};
+    mx_channel_msg_t writes[3] = {
+        {.bytes = &out[0], .handles = &event, .channel = a[0], .num_bytes = 4u, .num_handles = 1u},
+        {.bytes = &out[1], .handles = NULL, .channel = a[0], .num_bytes = 4u, .num_handles = 0u},
+        {.bytes = &out[2], .handles = NULL, .channel = b[0], .num_bytes = 4u, .num_handles = 0u},
+    };
+    uint32_t actual = 0u;
+    EXPECT_EQ(mx_channel_write_many(0u, writes, 3u, &actual), MX_OK, "");
+    EXPECT_EQ(actual, 3u, "");
+    for (int i = 0; i < 3; i++)
+        EXPECT_EQ(writes[i].status, MX_OK, "");
+
+    uint32_t in[4] = {};
+    mx_handle_t handle = MX_HANDLE_INVALID;
+    mx_channel_msg_t reads[4] = {
+        {.bytes = &in[0], .handles = &handle, .channel = a[1], .num_bytes = 4u, .num_handles = 1u},
+        {.bytes = &in[1], .handles = NULL, .channel = a[1], .num_bytes = 4u, .num_handles = 0u},
+        {.bytes = &in[2], .handles = NULL, .channel = b[1], .num_bytes = 4u, .num_handles = 0u},
+        {.bytes = &in[3], .handles = NULL, .channel = b[1], .num_bytes = 4u, .num_handles = 0u},
+    };
+    actual = 0u;
+    EXPECT_EQ(mx_channel_read_many(0u, reads, 4u, &actual), MX_OK, "");
+    EXPECT_EQ(actual, 3u, "the second channel only had one message");
+    EXPECT_EQ(in[0], 1u, "");
+    EXPECT_EQ(in[1], 2u, "");
+    EXPECT_EQ(in[2], 3u, "");
+    EXPECT_EQ(reads[0].num_handles, 1u, "");
+    EXPECT_NEQ(handle, MX_HANDLE_INVALID, "");
+    EXPECT_EQ(reads[3].status, MX_ERR_SHOULD_WAIT, "");
+
+    // Nothing is left to read, so the batch fails outright.
+    EXPECT_EQ(mx_channel_read_many(0u, reads, 1u, &actual), MX_ERR_SHOULD_WAIT, "");
+    EXPECT_EQ(actual, 0u, "");
+
+    EXPECT_EQ(mx_channel_read_many(0u, reads, 0u, &actual), MX_ERR_INVALID_ARGS, "");
+
+    EXPECT_EQ(mx_handle_close(handle), MX_OK, "");
+    EXPECT_EQ(mx_handle_close(a[0]), MX_OK, "");
+    EXPECT_EQ(mx_handle_close(a[1]), MX_OK, "");
+    EXPECT_EQ(mx_handle_close(b[0]), MX_OK, "");
+    EXPECT_EQ(mx_handle_close(b[1]), MX_OK, "");
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(channel_tests)
 RUN_TEST(channel_test)
 RUN_TEST(channel_read_error_test)
@@ -874,6 +931,7 @@ RUN_TEST(channel_call2)
 RUN_TEST(bad_channel_call_finish)
 RUN_TEST(channel_nest)
 RUN_TEST(channel_disallow_write_to_self)
+RUN_TEST(channel_read_write_many)
 END_TEST_CASE(channel_tests)
 
 #ifndef BUILD_COMBINED_TESTS
@@ -75,10 +75,41 @@ static bool test_timeout(void) {
     END_TEST;
 }
 
+static int completion_thread_signal_later(void* arg) {
+    mx_nanosleep(mx_deadline_after(MX_MSEC(5)));
+    completion_signal(arg);
+    return 0;
+}
+
+static bool test_wait_any(void) {
+    BEGIN_TEST;
+    completion_t a = COMPLETION_INIT;
+    completion_t b = COMPLETION_INIT;
+    completion_t* both[] = {&a, &b};
+    size_t index = 0;
+    mx_status_t status = completion_wait_any(both, 2, MX_MSEC(1), &index);
+    EXPECT_EQ(status, MX_ERR_TIMED_OUT, "");
+
+    // The second wakes the waiter too, if not straight away.
+    thrd_t thread;
+    thrd_create_with_name(&thread, completion_thread_signal_later, &b, "completion signal");
+    status = completion_wait_any(both, 2, MX_TIME_INFINITE, &index);
+    EXPECT_EQ(status, MX_OK, "");
+    EXPECT_EQ(index, 1u, "");
+    thrd_join(thread, NULL);
+
+    completion_signal(&a);
+    status = completion_wait_any(both, 2, 0, &index);
+    EXPECT_EQ(status, MX_OK, "");
+    EXPECT_EQ(index, 0u, "");
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(completion_tests)
 RUN_TEST(test_initializer)
 RUN_TEST(test_completions)
 RUN_TEST(test_timeout)
+RUN_TEST(test_wait_any)
 END_TEST_CASE(completion_tests)
 
 #ifndef BUILD_COMBINED_TESTS
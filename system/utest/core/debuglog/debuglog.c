@@ -0,0 +1,142 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <magenta/syscalls.h>
+#include <magenta/syscalls/log.h>
+#include <unittest/unittest.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static bool map_ring(mx_handle_t log, const mx_log_ring_t** ring, uint64_t* size) {
+    BEGIN_HELPER;
+
+    mx_handle_t vmo;
+    ASSERT_EQ(mx_log_get_vmo(log, &vmo), MX_OK, "");
+    ASSERT_EQ(mx_vmo_get_size(vmo, size), MX_OK, "");
+
+    uintptr_t addr;
+    ASSERT_EQ(mx_vmar_map(mx_vmar_root_self(), 0, vmo, 0, *size, MX_VM_FLAG_PERM_READ, &addr),
+              MX_OK, "");
+
+    // The ring can only ever be read.
+    char c = 0;
+    size_t actual;
+    EXPECT_EQ(mx_vmo_write(vmo, &c, 0, 1, &actual), MX_ERR_ACCESS_DENIED, "");
+    EXPECT_NE(mx_vmar_map(mx_vmar_root_self(), 0, vmo, 0, *size,
+                          MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE, &addr),
+              MX_OK, "");
+
+    mx_handle_close(vmo);
+    *ring = (const mx_log_ring_t*)addr;
+
+    END_HELPER;
+}
+
+static bool debuglog_ring_layout(void) {
+    BEGIN_TEST;
+
+    mx_handle_t log;
+    ASSERT_EQ(mx_log_create(MX_LOG_FLAG_READABLE, &log), MX_OK, "");
+
+    const mx_log_ring_t* ring;
+    uint64_t size;
+    ASSERT_TRUE(map_ring(log, &ring, &size), "");
+
+    EXPECT_NE(ring->size, 0u, "");
+    EXPECT_EQ(ring->size & (ring->size - 1), 0u, "size is a power of two");
+    EXPECT_GE(ring->data_offset, sizeof(mx_log_ring_t), "");
+    EXPECT_LE(ring->data_offset + ring->size, size, "");
+
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    EXPECT_LE(tail, head, "");
+    EXPECT_LE(head - tail, ring->size, "");
+
+    mx_vmar_unmap(mx_vmar_root_self(), (uintptr_t)ring, size);
+    mx_handle_close(log);
+
+    END_TEST;
+}
+
+static bool debuglog_ring_has_writes(void) {
+    BEGIN_TEST;
+
+    mx_handle_t log;
+    ASSERT_EQ(mx_log_create(MX_LOG_FLAG_READABLE, &log), MX_OK, "");
+
+    const mx_log_ring_t* ring;
+    uint64_t size;
+    ASSERT_TRUE(map_ring(log, &ring, &size), "");
+    const char* data = (const char*)ring + ring->data_offset;
+    uint64_t mask = ring->size - 1;
+
+    char msg[64];
+    snprintf(msg, sizeof(msg), "debuglog ring test %p", &msg);
+    ASSERT_EQ(mx_log_write(log, strlen(msg), msg, 0), MX_OK, "");
+
+    // The record is in the ring as soon as the write returns.
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    ASSERT_LE(head - tail, ring->size, "");
+
+    char* copy = malloc(head - tail);
+    ASSERT_NONNULL(copy, "");
+    for (uint64_t i = 0; i < head - tail; i++)
+        copy[i] = data[(tail + i) & mask];
+
+    bool found = false;
+    uint64_t p = tail;
+    while (p < head) {
+        mx_log_record_t rec;
+        memcpy(&rec, copy + (p - tail), sizeof(rec));
+        size_t recsize = MX_LOG_RING_RECORD_SIZE(rec.reserved);
+        ASSERT_GE(recsize, sizeof(rec), "");
+        ASSERT_LE(recsize, head - p, "");
+        if (rec.datalen == strlen(msg) &&
+            !memcmp(copy + (p - tail) + sizeof(rec), msg, rec.datalen))
+            found = true;
+        p += recsize;
+    }
+    EXPECT_TRUE(found, "");
+    free(copy);
+
+    // Skipping leaves nothing to read.
+    char buf[MX_LOG_RECORD_MAX];
+    EXPECT_EQ(mx_log_read(log, 0, NULL, MX_LOG_READ_SKIP), MX_OK, "");
+    EXPECT_EQ(mx_log_read(log, sizeof(buf), buf, 0), MX_ERR_SHOULD_WAIT, "");
+
+    mx_vmar_unmap(mx_vmar_root_self(), (uintptr_t)ring, size);
+    mx_handle_close(log);
+
+    END_TEST;
+}
+
+static bool debuglog_write_only(void) {
+    BEGIN_TEST;
+
+    mx_handle_t log;
+    ASSERT_EQ(mx_log_create(0, &log), MX_OK, "");
+
+    mx_handle_t vmo;
+    EXPECT_NE(mx_log_get_vmo(log, &vmo), MX_OK, "");
+    EXPECT_NE(mx_log_read(log, 0, NULL, MX_LOG_READ_SKIP), MX_OK, "");
+
+    mx_handle_close(log);
+
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(debuglog_tests)
+RUN_TEST(debuglog_ring_layout)
+RUN_TEST(debuglog_ring_has_writes)
+RUN_TEST(debuglog_write_only)
+END_TEST_CASE(debuglog_tests)
+
+#ifndef BUILD_COMBINED_TESTS
+int main(int argc, char** argv) {
+    return unittest_run_all_tests(argc, argv) ? 0 : -1;
+}
+#endif
@@ -8,6 +8,7 @@
 #include <magenta/process.h>
 #include <magenta/syscalls.h>
 #include <magenta/syscalls/object.h>
+#include <threads.h>
 #include <unittest/unittest.h>
 
 static bool handle_info_test(void) {
@@ -144,10 +145,52 @@ static bool handle_rights_test(void) {
     END_TEST;
 }
 
+static mx_koid_t get_koid(mx_handle_t handle) {
+    mx_info_handle_basic_t info;
+    if (mx_object_get_info(handle, MX_INFO_HANDLE_BASIC, &info, sizeof(info),
+                           NULL, NULL) != MX_OK) {
+        return MX_KOID_INVALID;
+    }
+    return info.koid;
+}
+
+static int thread_koid(void* arg) {
+    mx_koid_t* koids = arg;
+    koids[0] = mx_thread_self_koid();
+    koids[1] = get_koid(mx_thread_self());
+    return 0;
+}
+
+static bool self_koid_test(void) {
+    BEGIN_TEST;
+
+    mx_koid_t process = get_koid(mx_process_self());
+    ASSERT_NE(process, MX_KOID_INVALID, "");
+    EXPECT_EQ(mx_process_self_koid(), process, "wrong process koid");
+    EXPECT_EQ(mx_process_self_koid(), process, "process koid changed");
+
+    mx_koid_t thread = get_koid(mx_thread_self());
+    ASSERT_NE(thread, MX_KOID_INVALID, "");
+    EXPECT_EQ(mx_thread_self_koid(), thread, "wrong thread koid");
+    EXPECT_EQ(mx_thread_self_koid(), thread, "thread koid changed");
+
+    // another thread gets its own
+    mx_koid_t koids[2] = {};
+    thrd_t t;
+    ASSERT_EQ(thrd_create(&t, thread_koid, koids), thrd_success, "");
+    ASSERT_EQ(thrd_join(t, NULL), thrd_success, "");
+    EXPECT_NE(koids[0], MX_KOID_INVALID, "");
+    EXPECT_EQ(koids[0], koids[1], "wrong koid on another thread");
+    EXPECT_NE(koids[0], thread, "threads share a koid");
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(handle_info_tests)
 RUN_TEST(handle_info_test)
 RUN_TEST(handle_related_koid_test)
 RUN_TEST(handle_rights_test)
+RUN_TEST(self_koid_test)
 END_TEST_CASE(handle_info_tests)
 
 #ifndef BUILD_COMBINED_TESTS
@@ -3,8 +3,10 @@
 // found in the LICENSE file.
 
 #include <errno.h>
+#include <stdlib.h>
 #include <unistd.h>
 
+#include <magenta/malloc.h>
 #include <magenta/process.h>
 #include <magenta/syscalls.h>
 #include <magenta/syscalls/object.h>
@@ -197,6 +199,34 @@ bool mprotect_test() {
     END_TEST;
 }
 
+bool malloc_get_info_test() {
+    BEGIN_TEST;
+
+    malloc_info_stats_t before, after;
+    size_t actual, avail;
+    ASSERT_EQ(malloc_get_info(MALLOC_INFO_STATS, &before, sizeof(before), &actual, &avail),
+              MX_OK, "");
+    EXPECT_EQ(actual, 1u, "");
+    EXPECT_EQ(avail, 1u, "");
+    EXPECT_GE(before.narenas, 1u, "");
+
+    void* p = malloc(1 << 20);
+    ASSERT_NONNULL(p, "");
+    ASSERT_EQ(malloc_get_info(MALLOC_INFO_STATS, &after, sizeof(after), &actual, &avail),
+              MX_OK, "");
+    EXPECT_GE(after.allocated, before.allocated + (1 << 20), "");
+    EXPECT_GE(after.resident, after.active, "");
+    free(p);
+
+    EXPECT_EQ(malloc_get_info(MALLOC_INFO_STATS, &after, sizeof(after) - 1, &actual, &avail),
+              MX_ERR_BUFFER_TOO_SMALL, "");
+    EXPECT_EQ(avail, 1u, "");
+    EXPECT_EQ(malloc_get_info(0, &after, sizeof(after), &actual, &avail),
+              MX_ERR_INVALID_ARGS, "");
+
+    END_TEST;
+}
+
 }
 
 BEGIN_TEST_CASE(memory_mapping_tests)
@@ -206,6 +236,7 @@ RUN_TEST(mmap_offset_test);
 RUN_TEST(mmap_prot_test);
 RUN_TEST(mmap_flags_test);
 RUN_TEST(mprotect_test);
+RUN_TEST(malloc_get_info_test);
 END_TEST_CASE(memory_mapping_tests)
 
 #ifndef BUILD_COMBINED_TESTS
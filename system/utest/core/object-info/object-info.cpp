@@ -861,6 +861,39 @@ bool job_children_smoke() {
     return jobch_helper_smoke(MX_INFO_JOB_CHILDREN, kTestJobChildJobs);
 }
 
+// Tests that MX_INFO_TASK_HANDLES follows handles being made and closed.
+bool task_handles_smoke() {
+    BEGIN_TEST;
+    mx_info_task_handles_t before;
+    ASSERT_EQ(mx_object_get_info(mx_process_self(), MX_INFO_TASK_HANDLES,
+                                 &before, sizeof(before), nullptr, nullptr),
+              MX_OK, "");
+    EXPECT_GT(before.handles, 0u, "");
+
+    mx_handle_t event;
+    ASSERT_EQ(mx_event_create(0u, &event), MX_OK, "");
+    mx_info_task_handles_t during;
+    ASSERT_EQ(mx_object_get_info(mx_process_self(), MX_INFO_TASK_HANDLES,
+                                 &during, sizeof(during), nullptr, nullptr),
+              MX_OK, "");
+    EXPECT_EQ(during.handles, before.handles + 1, "");
+
+    mx_handle_close(event);
+    mx_info_task_handles_t after;
+    ASSERT_EQ(mx_object_get_info(mx_process_self(), MX_INFO_TASK_HANDLES,
+                                 &after, sizeof(after), nullptr, nullptr),
+              MX_OK, "");
+    EXPECT_EQ(after.handles, before.handles, "");
+
+    // Our job counts our handles along with those of its other processes.
+    mx_info_task_handles_t job;
+    ASSERT_EQ(mx_object_get_info(mx_job_default(), MX_INFO_TASK_HANDLES,
+                                 &job, sizeof(job), nullptr, nullptr),
+              MX_OK, "");
+    EXPECT_GE(job.handles, after.handles, "");
+    END_TEST;
+}
+
 } // namespace
 
 // Tests that should pass for any topic. Use the wrappers below instead of
@@ -965,6 +998,11 @@ RUN_TEST((bad_actual_fails<MX_INFO_PROCESS_THREADS, mx_koid_t, get_test_process>
 RUN_TEST((bad_avail_fails<MX_INFO_PROCESS_THREADS, mx_koid_t, get_test_process>))
 RUN_TEST((multi_zero_buffer_succeeds<MX_INFO_PROCESS_THREADS, get_test_process>));
 
+RUN_TEST(task_handles_smoke);
+RUN_SINGLE_ENTRY_TESTS(MX_INFO_TASK_HANDLES, mx_info_task_handles_t, get_test_process);
+RUN_SINGLE_ENTRY_TESTS(MX_INFO_TASK_HANDLES, mx_info_task_handles_t, get_test_job);
+RUN_TEST((wrong_handle_type_fails<MX_INFO_TASK_HANDLES, mx_info_task_handles_t, mx_thread_self>));
+
 // Skip most tests for MX_INFO_THREAD_EXCEPTION_REPORT, which is tested
 // elsewhere and requires the target thread to be in a certain state.
 RUN_TEST((invalid_handle_fails<MX_INFO_THREAD_EXCEPTION_REPORT, mx_exception_report_t>));
@@ -974,6 +1012,9 @@ RUN_TEST((invalid_handle_fails<MX_INFO_THREAD_EXCEPTION_REPORT, mx_exception_rep
 // RUN_MULTI_ENTRY_TESTS(MX_INFO_RESOURCE_RECORDS, mx_rrec_t, get_root_resource);
 // RUN_MULTI_ENTRY_TESTS(MX_INFO_CPU_STATS, mx_info_cpu_stats_t, get_root_resource);
 // RUN_SINGLE_ENTRY_TESTS(MX_INFO_KMEM_STATS, mx_info_kmem_stats_t, get_root_resource);
+// RUN_MULTI_ENTRY_TESTS(MX_INFO_SYSCALL_STATS, mx_info_syscall_stats_t, get_root_resource);
+// RUN_MULTI_ENTRY_TESTS(MX_INFO_KMEM_HEAP_TAGS, mx_info_heap_tag_t, get_root_resource);
+// RUN_MULTI_ENTRY_TESTS(MX_INFO_KERNEL_OBJECTS, mx_info_kernel_objects_t, get_root_resource);
 
 END_TEST_CASE(object_info_tests)
 
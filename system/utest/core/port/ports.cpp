@@ -542,6 +542,112 @@ static bool threads_event_repeat() {
     return threads_event(MX_WAIT_ASYNC_REPEATING);
 }
 
+constexpr uint32_t kPacketsPerWriter = 500u;
+
+struct user_packet_context {
+    mx_handle_t port;
+    uint64_t key;
+};
+
+static int port_writer_thread(void* arg) {
+    auto ctx = reinterpret_cast<user_packet_context*>(arg);
+    for (uint32_t ix = 0; ix != kPacketsPerWriter; ++ix) {
+        mx_port_packet_t in = {};
+        in.key = ctx->key;
+        in.user.u32[0] = ix;
+        auto st = mx_port_queue(ctx->port, &in, 0u);
+        if (st < 0)
+            return st;
+    }
+    return 0;
+}
+
+static bool threads_user_packets() {
+    BEGIN_TEST;
+
+    mx_handle_t port;
+    EXPECT_EQ(mx_port_create(MX_PORT_OPT_V2, &port), MX_OK, "");
+
+    // Several writers feeding several readers, every packet has to come out
+    // exactly once whichever cpus they end up on.
+    thrd_t writers[4];
+    user_packet_context wctx[4];
+    thrd_t readers[4];
+    test_context rctx[4];
+    for (size_t ix = 0; ix != countof(readers); ++ix) {
+        rctx[ix] = { port, kPacketsPerWriter };
+        EXPECT_EQ(thrd_create(&readers[ix], port_reader_thread, &rctx[ix]),
+                  thrd_success, "");
+    }
+    for (size_t ix = 0; ix != countof(writers); ++ix) {
+        wctx[ix] = { port, 700u + ix };
+        EXPECT_EQ(thrd_create(&writers[ix], port_writer_thread, &wctx[ix]),
+                  thrd_success, "");
+    }
+
+    for (size_t ix = 0; ix != countof(writers); ++ix) {
+        int res;
+        EXPECT_EQ(thrd_join(writers[ix], &res), thrd_success, "");
+        EXPECT_EQ(res, 0, "");
+    }
+    for (size_t ix = 0; ix != countof(readers); ++ix) {
+        int res;
+        EXPECT_EQ(thrd_join(readers[ix], &res), thrd_success, "");
+        EXPECT_EQ(res, 0, "");
+    }
+
+    mx_port_packet_t out = {};
+    EXPECT_EQ(mx_port_wait(port, 0ull, &out, 0u), MX_ERR_TIMED_OUT, "");
+
+    EXPECT_EQ(mx_handle_close(port), MX_OK, "");
+
+    END_TEST;
+}
+
+static bool wait_many_test() {
+    BEGIN_TEST;
+
+    mx_handle_t port;
+    EXPECT_EQ(mx_port_create(MX_PORT_OPT_V2, &port), MX_OK, "");
+
+    mx_port_packet_t out[8] = {};
+    uint32_t actual = 99u;
+
+    EXPECT_EQ(mx_port_wait_many(port, 0ull, out, 0u, &actual), MX_ERR_INVALID_ARGS, "");
+    EXPECT_EQ(mx_port_wait_many(port, 0ull, out, 65u, &actual), MX_ERR_INVALID_ARGS, "");
+    EXPECT_EQ(mx_port_wait_many(port, mx_deadline_after(MX_USEC(200)), out, 8u, &actual),
+              MX_ERR_TIMED_OUT, "");
+
+    for (uint32_t ix = 0; ix != 5u; ++ix) {
+        mx_port_packet_t in = {};
+        in.key = 800u + ix;
+        EXPECT_EQ(mx_port_queue(port, &in, 0u), MX_OK, "");
+    }
+
+    // No more than asked for comes out, and everything does eventually, in
+    // the order it was queued even if the thread moved cpus while queueing.
+    EXPECT_EQ(mx_port_wait_many(port, 0ull, out, 3u, &actual), MX_OK, "");
+    EXPECT_EQ(actual, 3u, "");
+    EXPECT_EQ(mx_port_wait_many(port, MX_TIME_INFINITE, &out[3], 8u - 3u, &actual), MX_OK, "");
+    EXPECT_EQ(actual, 2u, "");
+    for (uint32_t ix = 0; ix != 5u; ++ix) {
+        EXPECT_EQ(out[ix].type, MX_PKT_TYPE_USER, "");
+        EXPECT_EQ(out[ix].key, 800u + ix, "");
+    }
+
+    EXPECT_EQ(mx_port_wait_many(port, 0ull, out, 8u, &actual), MX_ERR_TIMED_OUT, "");
+
+    // Only v2 ports can be waited on this way.
+    mx_handle_t port1;
+    EXPECT_EQ(mx_port_create(0u, &port1), MX_OK, "");
+    EXPECT_EQ(mx_port_wait_many(port1, 0ull, out, 8u, &actual), MX_ERR_WRONG_TYPE, "");
+
+    EXPECT_EQ(mx_handle_close(port), MX_OK, "");
+    EXPECT_EQ(mx_handle_close(port1), MX_OK, "");
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(port_tests)
 RUN_TEST(basic_test)
 RUN_TEST(queue_and_close_test)
@@ -562,6 +668,8 @@ RUN_TEST(cancel_event_key_once_after)
 RUN_TEST(cancel_event_key_repeat_after)
 RUN_TEST(threads_event_once)
 RUN_TEST(threads_event_repeat)
+RUN_TEST(threads_user_packets)
+RUN_TEST(wait_many_test)
 END_TEST_CASE(port_tests)
 
 #ifndef BUILD_COMBINED_TESTS
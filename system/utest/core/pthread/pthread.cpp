@@ -320,12 +320,127 @@ static bool pthread_getstack_other_thread_explicit_size() {
     END_TEST;
 }
 
+// Readers take the lock through the reader table until a writer turns
+// the bias off; both kinds together must still exclude writers.
+static pthread_rwlock_t rwlock = PTHREAD_RWLOCK_INITIALIZER;
+static volatile uint64_t rw_a, rw_b;
+static volatile bool rw_torn;
+
+static void* rwlock_reader(void* arg) {
+    for (int i = 0; i < 20000; i++) {
+        pthread_rwlock_rdlock(&rwlock);
+        if (rw_a != rw_b)
+            rw_torn = true;
+        pthread_rwlock_unlock(&rwlock);
+    }
+    return NULL;
+}
+
+static void* rwlock_writer(void* arg) {
+    for (int i = 0; i < 2000; i++) {
+        pthread_rwlock_wrlock(&rwlock);
+        rw_a++;
+        mx_nanosleep(0);
+        rw_b++;
+        pthread_rwlock_unlock(&rwlock);
+    }
+    return NULL;
+}
+
+static void* rwlock_trywrlock(void* arg) {
+    *(int*)arg = pthread_rwlock_trywrlock(&rwlock);
+    return NULL;
+}
+
+// A writer that takes the lock word while a biased reader holds its slot
+// waits in the revoke for the reader to unlock.
+struct rwlock_revoke_args {
+    pthread_rwlock_t rw;
+    volatile int locked;
+    volatile int checked;
+};
+
+static void* rwlock_revoke_writer(void* arg) {
+    auto args = static_cast<rwlock_revoke_args*>(arg);
+    pthread_rwlock_wrlock(&args->rw);
+    args->locked = 1;
+    while (!args->checked)
+        mx_nanosleep(mx_deadline_after(MX_MSEC(1)));
+    pthread_rwlock_unlock(&args->rw);
+    return NULL;
+}
+
+static bool pthread_rwlock_test() {
+    BEGIN_TEST;
+
+    // A read lock held on this thread, biased or not, keeps out writers.
+    for (int depth = 1; depth <= 2; depth++) {
+        for (int i = 0; i < depth; i++)
+            ASSERT_EQ(pthread_rwlock_rdlock(&rwlock), 0, "");
+        pthread_t thread;
+        int result = -1;
+        ASSERT_EQ(pthread_create(&thread, NULL, rwlock_trywrlock, &result), 0, "");
+        ASSERT_EQ(pthread_join(thread, NULL), 0, "");
+        EXPECT_EQ(result, EBUSY, "trywrlock with readers");
+        for (int i = 0; i < depth; i++)
+            ASSERT_EQ(pthread_rwlock_unlock(&rwlock), 0, "");
+    }
+    ASSERT_EQ(pthread_rwlock_trywrlock(&rwlock), 0, "trywrlock with no readers");
+    ASSERT_EQ(pthread_rwlock_unlock(&rwlock), 0, "");
+
+    // More read locks held at once than a thread has reader slots.
+    pthread_rwlock_t many[8];
+    for (auto& rw : many) {
+        ASSERT_EQ(pthread_rwlock_init(&rw, NULL), 0, "");
+        ASSERT_EQ(pthread_rwlock_rdlock(&rw), 0, "");
+    }
+    for (auto& rw : many) {
+        ASSERT_EQ(pthread_rwlock_unlock(&rw), 0, "");
+        ASSERT_EQ(pthread_rwlock_trywrlock(&rw), 0, "");
+        ASSERT_EQ(pthread_rwlock_unlock(&rw), 0, "");
+    }
+
+    // The biased reader's unlock must release its slot, not the writer's
+    // hold on the lock word.
+    rwlock_revoke_args revoke = {};
+    ASSERT_EQ(pthread_rwlock_init(&revoke.rw, NULL), 0, "");
+    ASSERT_EQ(pthread_rwlock_rdlock(&revoke.rw), 0, "");
+    pthread_t revoker;
+    ASSERT_EQ(pthread_create(&revoker, NULL, rwlock_revoke_writer, &revoke), 0, "");
+    mx_nanosleep(mx_deadline_after(MX_MSEC(20)));
+    EXPECT_EQ(revoke.locked, 0, "writer got in past a biased reader");
+    ASSERT_EQ(pthread_rwlock_unlock(&revoke.rw), 0, "");
+    for (int i = 0; i < 1000 && !revoke.locked; i++)
+        mx_nanosleep(mx_deadline_after(MX_MSEC(1)));
+    EXPECT_EQ(revoke.locked, 1, "writer still waiting after the reader unlocked");
+    EXPECT_EQ(pthread_rwlock_tryrdlock(&revoke.rw), EBUSY, "reader got in past the writer");
+    revoke.checked = 1;
+    ASSERT_EQ(pthread_join(revoker, NULL), 0, "");
+    ASSERT_EQ(pthread_rwlock_trywrlock(&revoke.rw), 0, "");
+    ASSERT_EQ(pthread_rwlock_unlock(&revoke.rw), 0, "");
+
+    pthread_t readers[4], writers[2];
+    for (auto& t : readers)
+        ASSERT_EQ(pthread_create(&t, NULL, rwlock_reader, NULL), 0, "");
+    for (auto& t : writers)
+        ASSERT_EQ(pthread_create(&t, NULL, rwlock_writer, NULL), 0, "");
+    for (auto& t : readers)
+        ASSERT_EQ(pthread_join(t, NULL), 0, "");
+    for (auto& t : writers)
+        ASSERT_EQ(pthread_join(t, NULL), 0, "");
+    EXPECT_FALSE(rw_torn, "reader saw a write in progress");
+    EXPECT_EQ(rw_a, 4000u, "");
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(pthread_tests)
 RUN_TEST(pthread_test)
 RUN_TEST(pthread_self_main_thread_test)
 RUN_TEST(pthread_big_stack_size)
 RUN_TEST(pthread_getstack_main_thread)
 RUN_TEST(pthread_getstack_other_thread)
+RUN_TEST(pthread_rwlock_test)
 END_TEST_CASE(pthread_tests)
 
 #ifndef BUILD_COMBINED_TESTS
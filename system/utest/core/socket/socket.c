@@ -427,6 +427,69 @@ static bool socket_datagram_no_short_write(void) {
     END_TEST;
 }
 
+static bool socket_ring(void) {
+    BEGIN_TEST;
+
+    mx_status_t status;
+    size_t count;
+    mx_handle_t h0, h1;
+
+    status = mx_socket_create(MX_SOCKET_RING | MX_SOCKET_RING_ORDER(11), &h0, &h1);
+    ASSERT_EQ(status, MX_ERR_INVALID_ARGS, "");
+    status = mx_socket_create(MX_SOCKET_RING | MX_SOCKET_DATAGRAM | MX_SOCKET_RING_ORDER(12),
+                              &h0, &h1);
+    ASSERT_EQ(status, MX_ERR_INVALID_ARGS, "");
+
+    status = mx_socket_create(MX_SOCKET_RING | MX_SOCKET_RING_ORDER(12), &h0, &h1);
+    ASSERT_EQ(status, MX_OK, "");
+
+    const size_t ring_size = 4096u;
+    unsigned char* wbuf = malloc(ring_size + 1);
+    unsigned char* rbuf = malloc(ring_size);
+    for (size_t i = 0; i < ring_size + 1; i++)
+        wbuf[i] = (unsigned char)(i * 7);
+
+    // The ring holds exactly 2^order bytes.
+    status = mx_socket_write(h0, 0u, wbuf, ring_size + 1, &count);
+    ASSERT_EQ(status, MX_OK, "");
+    ASSERT_EQ(count, ring_size, "");
+    EXPECT_FALSE(get_satisfied_signals(h0) & MX_SOCKET_WRITABLE, "");
+    status = mx_socket_write(h0, 0u, wbuf, 1u, &count);
+    ASSERT_EQ(status, MX_ERR_SHOULD_WAIT, "");
+
+    status = mx_socket_read(h1, 0u, rbuf, 1000u, &count);
+    ASSERT_EQ(status, MX_OK, "");
+    ASSERT_EQ(count, 1000u, "");
+    ASSERT_EQ(memcmp(rbuf, wbuf, 1000u), 0, "");
+    EXPECT_TRUE(get_satisfied_signals(h0) & MX_SOCKET_WRITABLE, "");
+
+    // This write wraps around the end of the ring.
+    status = mx_socket_write(h0, 0u, wbuf, 1000u, &count);
+    ASSERT_EQ(status, MX_OK, "");
+    ASSERT_EQ(count, 1000u, "");
+
+    status = mx_socket_read(h1, 0u, NULL, 0, &count);
+    ASSERT_EQ(status, MX_OK, "");
+    ASSERT_EQ(count, ring_size, "");
+
+    // And so does this read.
+    status = mx_socket_read(h1, 0u, rbuf, ring_size, &count);
+    ASSERT_EQ(status, MX_OK, "");
+    ASSERT_EQ(count, ring_size, "");
+    ASSERT_EQ(memcmp(rbuf, wbuf + 1000u, ring_size - 1000u), 0, "");
+    ASSERT_EQ(memcmp(rbuf + ring_size - 1000u, wbuf, 1000u), 0, "");
+
+    status = mx_socket_read(h1, 0u, rbuf, ring_size, &count);
+    ASSERT_EQ(status, MX_ERR_SHOULD_WAIT, "");
+
+    free(wbuf);
+    free(rbuf);
+    mx_handle_close(h0);
+    mx_handle_close(h1);
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(socket_tests)
 RUN_TEST(socket_basic)
 RUN_TEST(socket_signals)
@@ -436,6 +499,7 @@ RUN_TEST(socket_bytes_outstanding_half_close)
 RUN_TEST(socket_short_write)
 RUN_TEST(socket_datagram)
 RUN_TEST(socket_datagram_no_short_write)
+RUN_TEST(socket_ring)
 END_TEST_CASE(socket_tests)
 
 #ifndef BUILD_COMBINED_TESTS
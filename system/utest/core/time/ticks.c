@@ -25,8 +25,31 @@ static bool elapsed_time_using_ticks(void) {
     END_TEST;
 }
 
+// mx_time_get is usually answered by the vDSO, check that it keeps time
+// with the kernel.
+static bool monotonic_time_matches_kernel(void) {
+    BEGIN_TEST;
+
+    mx_time_t last = mx_time_get(MX_CLOCK_MONOTONIC);
+    for (int i = 0; i < 1000; i++) {
+        mx_time_t now = mx_time_get(MX_CLOCK_MONOTONIC);
+        ASSERT_GE(now, last, "Time went backwards");
+        last = now;
+    }
+
+    // The kernel only wakes us once its own clock has passed the deadline.
+    for (int i = 0; i < 10; i++) {
+        mx_time_t deadline = mx_deadline_after(MX_USEC(100));
+        ASSERT_EQ(mx_nanosleep(deadline), MX_OK, "");
+        ASSERT_GE(mx_time_get(MX_CLOCK_MONOTONIC), deadline, "Woke up early");
+    }
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(ticks_tests)
 RUN_TEST(elapsed_time_using_ticks)
+RUN_TEST(monotonic_time_matches_kernel)
 END_TEST_CASE(ticks_tests)
 
 #ifndef BUILD_COMBINED_TESTS
@@ -0,0 +1,93 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <digest/digest.h>
+#include <digest/merkle-tree.h>
+#include <magenta/syscalls.h>
+#include <mxtl/algorithm.h>
+
+#include "bench.h"
+
+using digest::Digest;
+using digest::MerkleTree;
+
+namespace {
+
+// Blob sizes from a small library up to a large package.
+constexpr size_t kSizes[] = {
+    64u << 10, 256u << 10, 1u << 20, 4u << 20, 16u << 20, 64u << 20,
+};
+
+constexpr int kRuns = 4;
+
+template <typename T>
+inline mx_time_t time_it(T func) {
+    mx_time_t t = mx_time_get(MX_CLOCK_MONOTONIC);
+    func();
+    return mx_time_get(MX_CLOCK_MONOTONIC) - t;
+}
+
+void report(const char* what, size_t len, mx_time_t t) {
+    printf("\t%-24s %10zu bytes %10" PRIu64 " nsecs, %8" PRIu64 " MB/s\n", what, len,
+           t, t ? (len * 1000) / t : 0);
+}
+
+} // namespace
+
+int merkle_tree_run_benchmark() {
+    size_t max_len = kSizes[(sizeof(kSizes) / sizeof(kSizes[0])) - 1];
+    size_t max_tree_len = MerkleTree::GetTreeLength(max_len);
+    uint8_t* data = static_cast<uint8_t*>(malloc(max_len));
+    uint8_t* tree = static_cast<uint8_t*>(malloc(max_tree_len));
+    uint8_t* check = static_cast<uint8_t*>(malloc(max_tree_len));
+    if (!data || !tree || !check) {
+        printf("merkle tree benchmark: out of memory\n");
+        free(data);
+        free(tree);
+        free(check);
+        return -1;
+    }
+    for (size_t i = 0; i < max_len; ++i) {
+        data[i] = static_cast<uint8_t>(rand());
+    }
+
+    printf("starting merkle tree benchmark, %u cpus\n", mx_system_get_num_cpus());
+    int rc = 0;
+    for (size_t len : kSizes) {
+        size_t tree_len = MerkleTree::GetTreeLength(len);
+        Digest serial, parallel;
+        mx_time_t best_serial = UINT64_MAX, best_parallel = UINT64_MAX;
+        for (int run = 0; run < kRuns; ++run) {
+            best_serial = mxtl::min(best_serial, time_it([&]() {
+                MerkleTree::CreateParallel(data, len, check, tree_len, &serial, 1);
+            }));
+            best_parallel = mxtl::min(best_parallel, time_it([&]() {
+                MerkleTree::CreateParallel(data, len, tree, tree_len, &parallel, 0);
+            }));
+        }
+        report("one thread", len, best_serial);
+        report("one thread per cpu", len, best_parallel);
+        best_parallel = UINT64_MAX;
+        for (int run = 0; run < kRuns; ++run) {
+            best_parallel = mxtl::min(best_parallel, time_it([&]() {
+                MerkleTree::Verify(data, len, tree, tree_len, 0, len, parallel);
+            }));
+        }
+        report("verify", len, best_parallel);
+        if (serial != parallel || memcmp(tree, check, tree_len) != 0) {
+            printf("\tparallel tree differs from the serial one!\n");
+            rc = -1;
+        }
+    }
+
+    free(data);
+    free(tree);
+    free(check);
+    return rc;
+}
@@ -0,0 +1,13 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <magenta/compiler.h>
+
+__BEGIN_CDECLS
+
+int merkle_tree_run_benchmark(void);
+
+__END_CDECLS
@@ -68,6 +68,7 @@ const size_t kNumCases = sizeof(kCases) / sizeof(struct Case);
 // test setup.
 uint8_t gData[kUnalignedLarge];
 uint8_t gTree[kNodeSize * 3];
+uint8_t gSerialTree[kNodeSize * 3];
 
 ////////////////
 // Test cases
@@ -300,6 +301,49 @@ bool CreateAll(void) {
     END_TEST;
 }
 
+// Used by CreateParallelAll below.
+bool CreateParallel(size_t data_len, const char* digest, size_t threads) {
+    mx_status_t rc;
+    size_t tree_len = MerkleTree::GetTreeLength(data_len);
+    Digest actual;
+    ASSERT_OK(MerkleTree::CreateParallel(gData, data_len, gTree, tree_len,
+                                         &actual, threads));
+    Digest expected;
+    ASSERT_OK(expected.Parse(digest, strlen(digest)));
+    ASSERT_TRUE(actual == expected, "Incorrect root digest");
+    // The tree itself has to match the serial one, not just its root.
+    Digest serial;
+    ASSERT_OK(MerkleTree::Create(gData, data_len, gSerialTree, tree_len, &serial));
+    ASSERT_BYTES_EQ(gSerialTree, gTree, tree_len, "Tree differs from the serial one");
+    return true;
+}
+
+bool CreateParallelAll(void) {
+    BEGIN_TEST;
+    for (size_t threads = 0; threads <= 4; ++threads) {
+        for (size_t i = 0; i < kNumCases; ++i) {
+            bool ok = CreateParallel(kCases[i].data_len, kCases[i].digest, threads);
+            EXPECT_TRUE(ok, "CreateParallel failed");
+            if (!ok) {
+                unittest_printf_critical(
+                    "CreateParallelAll failed with data length of %zu and %zu threads\n",
+                    kCases[i].data_len, threads);
+            }
+        }
+    }
+    END_TEST;
+}
+
+bool CreateParallelTreeTooSmall(void) {
+    BEGIN_TEST_WITH_RC;
+    size_t tree_len = MerkleTree::GetTreeLength(kLarge);
+    Digest digest;
+    ASSERT_ERR(MX_ERR_BUFFER_TOO_SMALL,
+               MerkleTree::CreateParallel(gData, kLarge, gTree, tree_len - 1,
+                                          &digest, 2));
+    END_TEST;
+}
+
 // Used by CreateFinalCAll below.
 bool CreateFinalC(size_t data_len, const char* digest) {
     mx_status_t rc;
@@ -716,6 +760,8 @@ RUN_TEST(CreateFinalWithoutTree)
 RUN_TEST(CreateFinalMissingDigest)
 RUN_TEST(CreateFinalIncompleteData)
 RUN_TEST(CreateAll)
+RUN_TEST(CreateParallelAll)
+RUN_TEST(CreateParallelTreeTooSmall)
 RUN_TEST(CreateFinalCAll)
 RUN_TEST(CreateCAll)
 RUN_TEST(CreateByteByByte)
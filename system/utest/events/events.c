@@ -279,12 +279,53 @@ static bool wait_many_failures_test(void) {
     END_TEST;
 }
 
+static bool signal_many_test(void) {
+    BEGIN_TEST;
+
+    mx_handle_t events[3];
+    for (int i = 0; i < 3; i++)
+        ASSERT_EQ(mx_event_create(0u, &events[i]), MX_OK, "Error during event creation");
+    ASSERT_EQ(mx_object_signal(events[2], 0u, MX_USER_SIGNAL_1), MX_OK, "Error during event signal");
+
+    // A failure doesn't stop the items after it.
+    mx_signal_item_t items[5] = {
+        { events[0], 0u, MX_EVENT_SIGNALED, 1 },
+        { MX_HANDLE_INVALID, 0u, MX_EVENT_SIGNALED, 1 },
+        { events[1], 0u, MX_EVENT_SIGNALED | MX_USER_SIGNAL_0, 1 },
+        { events[1], 0u, 1u << 5, 1 },
+        { events[2], MX_USER_SIGNAL_1, 0u, 1 },
+    };
+    ASSERT_EQ(mx_object_signal_many(items, 5u), MX_OK, "Error during signal many");
+    EXPECT_EQ(items[0].status, MX_OK, "");
+    EXPECT_EQ(items[1].status, MX_ERR_BAD_HANDLE, "");
+    EXPECT_EQ(items[2].status, MX_OK, "");
+    EXPECT_EQ(items[3].status, MX_ERR_INVALID_ARGS, "");
+    EXPECT_EQ(items[4].status, MX_OK, "");
+
+    mx_signals_t pending;
+    EXPECT_EQ(mx_object_wait_one(events[0], MX_EVENT_SIGNALED, 0u, &pending), MX_OK, "");
+    EXPECT_EQ(mx_object_wait_one(events[1], MX_EVENT_SIGNALED | MX_USER_SIGNAL_0, 0u, &pending),
+              MX_OK, "");
+    EXPECT_EQ(pending & (MX_EVENT_SIGNALED | MX_USER_SIGNAL_0),
+              MX_EVENT_SIGNALED | MX_USER_SIGNAL_0, "");
+    EXPECT_EQ(mx_object_wait_one(events[2], MX_USER_SIGNAL_1, 0u, NULL), MX_ERR_TIMED_OUT, "");
+
+    EXPECT_EQ(mx_object_signal_many(NULL, 1u), MX_ERR_INVALID_ARGS, "");
+    EXPECT_EQ(mx_object_signal_many(items, 0u), MX_ERR_INVALID_ARGS, "");
+
+    for (int i = 0; i < 3; i++)
+        ASSERT_EQ(mx_handle_close(events[i]), MX_OK, "Error during handle close");
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(event_tests)
 RUN_TEST(basic_test)
 RUN_TEST(user_signals_test)
 RUN_TEST(wait_signals_test)
 RUN_TEST(reset_test)
 RUN_TEST(wait_many_failures_test)
+RUN_TEST(signal_many_test)
 END_TEST_CASE(event_tests)
 
 int main(int argc, char** argv) {
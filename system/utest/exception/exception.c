@@ -832,6 +832,58 @@ static bool process_start_test(void)
     END_TEST;
 }
 
+// With MX_EXCEPTION_PORT_ASYNC_THREAD_EVENTS the debugger still sees the
+// thread start and exit reports, but the threads don't wait for a reply.
+
+static bool process_start_async_test(void)
+{
+    BEGIN_TEST;
+    unittest_printf("process start async test\n");
+
+    mx_handle_t child, our_channel;
+    launchpad_t* lp = setup_test_child(NULL, &our_channel);
+    mx_handle_t eport = tu_io_port_create(0);
+    // Note: child is a borrowed handle, launchpad still owns it at this point.
+    child = launchpad_get_process_handle(lp);
+    tu_set_exception_port(child, eport, 0,
+                          MX_EXCEPTION_PORT_DEBUGGER | MX_EXCEPTION_PORT_ASYNC_THREAD_EVENTS);
+    child = tu_launch_mxio_fini(lp);
+    // Now we own the child handle, and lp is destroyed.
+
+    mx_koid_t tid;
+    if (read_and_verify_exception(eport, "process start", child, MX_EXCP_THREAD_STARTING, false, &tid)) {
+        // The child gets here without being resumed, and there is nothing
+        // to resume it from.
+        EXPECT_TRUE(ensure_child_running(our_channel), "");
+        mx_handle_t thread;
+        ASSERT_EQ(mx_object_get_child(child, tid, MX_RIGHT_SAME_RIGHTS, &thread), MX_OK, "");
+        EXPECT_EQ(mx_task_resume(thread, MX_RESUME_EXCEPTION), MX_ERR_BAD_STATE, "");
+        tu_handle_close(thread);
+
+        send_msg(our_channel, MSG_DONE);
+        wait_process_exit_from_debugger(eport, child, tid);
+    }
+
+    tu_handle_close(child);
+    tu_handle_close(eport);
+    tu_handle_close(our_channel);
+
+    END_TEST;
+}
+
+static bool async_thread_events_needs_debugger_test(void)
+{
+    BEGIN_TEST;
+
+    mx_handle_t eport = tu_io_port_create(0);
+    EXPECT_EQ(mx_task_bind_exception_port(mx_process_self(), eport, 0,
+                                          MX_EXCEPTION_PORT_ASYNC_THREAD_EVENTS),
+              MX_ERR_INVALID_ARGS, "");
+    tu_handle_close(eport);
+
+    END_TEST;
+}
+
 static bool process_gone_notification_test(void)
 {
     BEGIN_TEST;
@@ -1204,6 +1256,8 @@ RUN_TEST(dead_thread_mismatched_unbind_fails_test);
 RUN_TEST(process_handler_test);
 RUN_TEST(thread_handler_test);
 RUN_TEST(process_start_test);
+RUN_TEST(process_start_async_test);
+RUN_TEST(async_thread_events_needs_debugger_test);
 RUN_TEST(process_gone_notification_test);
 RUN_TEST(thread_gone_notification_test);
 RUN_TEST(trigger_test);
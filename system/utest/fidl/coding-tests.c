@@ -0,0 +1,256 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <magenta/compiler.h>
+#include <magenta/syscalls.h>
+#include <unittest/unittest.h>
+
+// Generated from coding.fidl2 by fidl2 c-header.
+#include "coding.fidl.h"
+
+static bool points_round_trip(void) {
+    BEGIN_TEST;
+
+    fidl_test_Point_t points[3] = {{1, 2}, {3, 4}, {-5, -6}};
+    fidl_test_Coding_Points_request_t request;
+    memset(&request, 0, sizeof(request));
+    request.points.count = 3;
+    request.points.data = points;
+    request.color = fidl_test_Color_blue;
+    EXPECT_EQ(fidl_test_Color_blue, 3, "enum members count on from the last value");
+
+    uint8_t bytes[fidl_test_Coding_Points_request_MAX_BYTES] __ALIGNED(8);
+    uint32_t actual_bytes, actual_handles;
+    ASSERT_EQ(fidl_test_Coding_Points_request_encode(&request, bytes, sizeof(bytes), NULL, 0,
+                                                     &actual_bytes, &actual_handles),
+              MX_OK, "");
+    EXPECT_EQ(actual_bytes, sizeof(request) + sizeof(points), "");
+    EXPECT_EQ(actual_handles, 0u, "");
+    EXPECT_EQ(request.points.data, (void*)points, "encoding leaves the message alone");
+
+    fidl_test_Coding_Points_request_t* decoded;
+    ASSERT_EQ(fidl_test_Coding_Points_request_decode(bytes, actual_bytes, NULL, 0, &decoded),
+              MX_OK, "");
+    EXPECT_EQ((void*)decoded, (void*)bytes, "decoded in place");
+    EXPECT_EQ(decoded->hdr.ordinal, fidl_test_Coding_Points_ORDINAL, "");
+    ASSERT_EQ(decoded->points.count, 3u, "");
+    EXPECT_EQ(decoded->points.data, (void*)(bytes + sizeof(request)), "");
+    EXPECT_BYTES_EQ((const uint8_t*)decoded->points.data, (const uint8_t*)points,
+                    sizeof(points), "");
+    EXPECT_EQ(decoded->color, fidl_test_Color_blue, "");
+
+    END_TEST;
+}
+
+static bool handles_and_strings(void) {
+    BEGIN_TEST;
+
+    mx_handle_t event;
+    ASSERT_EQ(mx_event_create(0, &event), MX_OK, "");
+    fidl_string_t names[2] = {{5, (char*)"hello"}, {0, (char*)""}};
+    fidl_test_Coding_Names_request_t request;
+    memset(&request, 0, sizeof(request));
+    request.names.count = 2;
+    request.names.data = names;
+    request.events[1] = event;
+
+    uint8_t bytes[fidl_test_Coding_Names_request_MAX_BYTES] __ALIGNED(8);
+    mx_handle_t handles[fidl_test_Coding_Names_request_MAX_HANDLES];
+    uint32_t actual_bytes, actual_handles;
+    ASSERT_EQ(fidl_test_Coding_Names_request_encode(&request, bytes, sizeof(bytes),
+                                                    handles, countof(handles),
+                                                    &actual_bytes, &actual_handles),
+              MX_OK, "");
+    ASSERT_EQ(actual_handles, 1u, "");
+    EXPECT_EQ(handles[0], event, "");
+
+    // Through a channel, to read it as a server would.
+    mx_handle_t channel[2];
+    ASSERT_EQ(mx_channel_create(0, &channel[0], &channel[1]), MX_OK, "");
+    ASSERT_EQ(mx_channel_write(channel[0], 0, bytes, actual_bytes, handles, actual_handles),
+              MX_OK, "");
+
+    uint8_t read_bytes[fidl_test_Coding_Names_request_MAX_BYTES] __ALIGNED(8);
+    mx_handle_t read_handles[fidl_test_Coding_Names_request_MAX_HANDLES];
+    mx_channel_msg_t msg = {
+        .bytes = read_bytes,
+        .handles = read_handles,
+        .channel = channel[1],
+        .num_bytes = sizeof(read_bytes),
+        .num_handles = countof(read_handles),
+    };
+    uint32_t actual;
+    ASSERT_EQ(mx_channel_read_many(0, &msg, 1, &actual), MX_OK, "");
+
+    fidl_test_Coding_Names_request_t* decoded;
+    ASSERT_EQ(fidl_test_Coding_Names_request_decode_msg(&msg, &decoded), MX_OK, "");
+    ASSERT_EQ(decoded->names.count, 2u, "");
+    const fidl_string_t* decoded_names = decoded->names.data;
+    ASSERT_EQ(decoded_names[0].size, 5u, "");
+    EXPECT_BYTES_EQ((const uint8_t*)decoded_names[0].data, (const uint8_t*)"hello", 5, "");
+    EXPECT_EQ(decoded_names[1].size, 0u, "");
+    EXPECT_EQ(decoded->events[0], MX_HANDLE_INVALID, "");
+    EXPECT_NEQ(decoded->events[1], MX_HANDLE_INVALID, "");
+    EXPECT_EQ(decoded->events[1], read_handles[0], "");
+
+    mx_handle_close(decoded->events[1]);
+    mx_handle_close(channel[0]);
+    mx_handle_close(channel[1]);
+
+    END_TEST;
+}
+
+static bool nullable_list(void) {
+    BEGIN_TEST;
+
+    fidl_test_Node_t third = {{5, (char*)"third"}, NULL};
+    fidl_test_Node_t second = {{6, (char*)"second"}, &third};
+    fidl_test_Node_t first = {{5, (char*)"first"}, &second};
+    fidl_test_Coding_List_request_t request;
+    memset(&request, 0, sizeof(request));
+    request.head = &first;
+
+    // A list can be as long as fits in a message.
+    EXPECT_EQ(fidl_test_Coding_List_request_MAX_BYTES, MX_CHANNEL_MAX_MSG_BYTES, "");
+
+    static uint8_t bytes[fidl_test_Coding_List_request_MAX_BYTES] __ALIGNED(8);
+    uint32_t actual_bytes, actual_handles;
+    ASSERT_EQ(fidl_test_Coding_List_request_encode(&request, bytes, sizeof(bytes), NULL, 0,
+                                                   &actual_bytes, &actual_handles),
+              MX_OK, "");
+    // Each node and then its name.
+    EXPECT_EQ(actual_bytes, sizeof(request) + 3 * (sizeof(fidl_test_Node_t) + 8), "");
+
+    fidl_test_Coding_List_request_t* decoded;
+    ASSERT_EQ(fidl_test_Coding_List_request_decode(bytes, actual_bytes, NULL, 0, &decoded),
+              MX_OK, "");
+    const char* expected[] = {"first", "second", "third"};
+    const fidl_test_Node_t* node = decoded->head;
+    for (size_t i = 0; i < countof(expected); i++) {
+        ASSERT_NEQ(node, NULL, "");
+        ASSERT_EQ(node->name.size, strlen(expected[i]), "");
+        EXPECT_BYTES_EQ((const uint8_t*)node->name.data, (const uint8_t*)expected[i],
+                        node->name.size, "");
+        node = node->next;
+    }
+    EXPECT_NULL(node, "");
+
+    // Too small a buffer is caught.
+    uint8_t small[64] __ALIGNED(8);
+    EXPECT_EQ(fidl_test_Coding_List_request_encode(&request, small, sizeof(small), NULL, 0,
+                                                   &actual_bytes, &actual_handles),
+              MX_ERR_BUFFER_TOO_SMALL, "");
+
+    END_TEST;
+}
+
+// Encodes a Set request holding |text|, for the tests below to spoil.
+static uint32_t encode_set(uint8_t* bytes, uint32_t capacity, const char* text) {
+    fidl_test_Coding_Set_request_t request;
+    memset(&request, 0, sizeof(request));
+    request.value.tag = fidl_test_Value_tag_text;
+    request.value.text.size = strlen(text);
+    request.value.text.data = (char*)text;
+    uint32_t actual_bytes, actual_handles;
+    if (fidl_test_Coding_Set_request_encode(&request, bytes, capacity, NULL, 0,
+                                            &actual_bytes, &actual_handles) != MX_OK)
+        return 0;
+    return actual_bytes;
+}
+
+static bool bad_messages(void) {
+    BEGIN_TEST;
+
+    uint8_t bytes[128] __ALIGNED(8);
+    fidl_test_Coding_Set_request_t* decoded;
+    fidl_test_Coding_Set_request_t* request = (fidl_test_Coding_Set_request_t*)bytes;
+    uint32_t num_bytes = encode_set(bytes, sizeof(bytes), "abc");
+    ASSERT_EQ(num_bytes, sizeof(*request) + 8, "");
+
+    EXPECT_EQ(fidl_test_Coding_Set_request_decode(bytes, num_bytes - 8, NULL, 0, &decoded),
+              MX_ERR_INVALID_ARGS, "truncated");
+
+    num_bytes = encode_set(bytes, sizeof(bytes), "abc");
+    mx_handle_t extra = 1;
+    EXPECT_EQ(fidl_test_Coding_Set_request_decode(bytes, num_bytes, &extra, 1, &decoded),
+              MX_ERR_INVALID_ARGS, "handle left over");
+
+    num_bytes = encode_set(bytes, sizeof(bytes), "abc");
+    request->hdr.ordinal = fidl_test_Coding_List_ORDINAL;
+    EXPECT_EQ(fidl_test_Coding_Set_request_decode(bytes, num_bytes, NULL, 0, &decoded),
+              MX_ERR_INVALID_ARGS, "wrong ordinal");
+
+    num_bytes = encode_set(bytes, sizeof(bytes), "abc");
+    request->value.tag = 3;
+    EXPECT_EQ(fidl_test_Coding_Set_request_decode(bytes, num_bytes, NULL, 0, &decoded),
+              MX_ERR_INVALID_ARGS, "unknown tag");
+
+    num_bytes = encode_set(bytes, sizeof(bytes), "abc");
+    request->value.text.data = (char*)1;
+    EXPECT_EQ(fidl_test_Coding_Set_request_decode(bytes, num_bytes, NULL, 0, &decoded),
+              MX_ERR_INVALID_ARGS, "bad presence marker");
+
+    num_bytes = encode_set(bytes, sizeof(bytes), "abc");
+    request->value.text.size = 9;
+    EXPECT_EQ(fidl_test_Coding_Set_request_decode(bytes, num_bytes, NULL, 0, &decoded),
+              MX_ERR_INVALID_ARGS, "string runs past the end");
+
+    num_bytes = encode_set(bytes, sizeof(bytes), "abc");
+    bytes[sizeof(*request) + 3] = 'd';
+    EXPECT_EQ(fidl_test_Coding_Set_request_decode(bytes, num_bytes, NULL, 0, &decoded),
+              MX_ERR_INVALID_ARGS, "padding isn't zero");
+
+    num_bytes = encode_set(bytes, sizeof(bytes), "abc");
+    request->value.tag = fidl_test_Value_tag_signal;
+    request->value.signal = FIDL_HANDLE_PRESENT;
+    EXPECT_EQ(fidl_test_Coding_Set_request_decode(bytes, sizeof(*request), NULL, 0, &decoded),
+              MX_ERR_INVALID_ARGS, "handle missing");
+
+    num_bytes = encode_set(bytes, sizeof(bytes), "abc");
+    ASSERT_EQ(fidl_test_Coding_Set_request_decode(bytes, num_bytes, NULL, 0, &decoded), MX_OK, "");
+    EXPECT_EQ(decoded->value.text.size, 3u, "");
+    EXPECT_BYTES_EQ((const uint8_t*)decoded->value.text.data, (const uint8_t*)"abc", 3, "");
+
+    END_TEST;
+}
+
+static bool bad_bool(void) {
+    BEGIN_TEST;
+
+    fidl_test_Coding_Points_response_t response;
+    memset(&response, 0, sizeof(response));
+    response.ok = true;
+    uint8_t bytes[fidl_test_Coding_Points_response_MAX_BYTES] __ALIGNED(8);
+    uint32_t actual_bytes, actual_handles;
+    ASSERT_EQ(fidl_test_Coding_Points_response_encode(&response, bytes, sizeof(bytes), NULL, 0,
+                                                      &actual_bytes, &actual_handles),
+              MX_OK, "");
+
+    fidl_test_Coding_Points_response_t* decoded;
+    bytes[offsetof(fidl_test_Coding_Points_response_t, ok)] = 2;
+    EXPECT_EQ(fidl_test_Coding_Points_response_decode(bytes, actual_bytes, NULL, 0, &decoded),
+              MX_ERR_INVALID_ARGS, "");
+    bytes[offsetof(fidl_test_Coding_Points_response_t, ok)] = 1;
+    ASSERT_EQ(fidl_test_Coding_Points_response_decode(bytes, actual_bytes, NULL, 0, &decoded),
+              MX_OK, "");
+    EXPECT_TRUE(decoded->ok, "");
+
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(fidl_coding_tests)
+RUN_TEST(points_round_trip)
+RUN_TEST(handles_and_strings)
+RUN_TEST(nullable_list)
+RUN_TEST(bad_messages)
+RUN_TEST(bad_bool)
+END_TEST_CASE(fidl_coding_tests)
+
+int main(int argc, char** argv) {
+    return unittest_run_all_tests(argc, argv) ? 0 : -1;
+}
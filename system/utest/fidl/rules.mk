@@ -0,0 +1,38 @@
+# Copyright 2017 The Fuchsia Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+LOCAL_DIR := $(GET_LOCAL_DIR)
+
+MODULE := $(LOCAL_DIR)
+
+MODULE_TYPE := usertest
+
+MODULE_SRCS += \
+    $(LOCAL_DIR)/coding-tests.c \
+
+MODULE_NAME := fidl-test
+
+MODULE_STATIC_LIBS := system/ulib/fidl
+
+MODULE_LIBS := system/ulib/unittest system/ulib/mxio system/ulib/magenta system/ulib/c
+
+# for including FIDL_TEST_HEADER
+MODULE_COMPILEFLAGS := -I$(BUILDDIR)/utest/fidl
+
+FIDL_TOOL := $(BUILDDIR)/tools/fidl
+FIDL_TEST_SRC := $(LOCAL_DIR)/coding.fidl2
+FIDL_TEST_HEADER := $(BUILDDIR)/utest/fidl/coding.fidl.h
+
+# to force running fidl before compiling the test
+MODULE_SRCDEPS := $(FIDL_TEST_HEADER)
+
+include make/module.mk
+
+$(FIDL_TEST_HEADER): $(FIDL_TOOL) $(FIDL_TEST_SRC)
+	$(call BUILDECHO,generating $@)
+	@$(MKDIR)
+	$(NOECHO)$(FIDL_TOOL) c-header $@ $(FIDL_TEST_SRC)
+
+GENERATED += $(FIDL_TEST_HEADER)
+EXTRA_BUILDDEPS += $(FIDL_TEST_HEADER)
@@ -11,6 +11,7 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <threads.h>
 #include <unistd.h>
 
 #include <magenta/device/vfs.h>
@@ -102,6 +103,81 @@ bool benchmark_write_read(void) {
     END_TEST;
 }
 
+constexpr int kConcurrentReaders = 4;
+
+struct ReaderArgs {
+    int fd;
+    size_t data_size;
+    size_t num_ops;
+    bool ok;
+};
+
+int read_file(void* arg) {
+    ReaderArgs* args = static_cast<ReaderArgs*>(arg);
+    AllocChecker ac;
+    mxtl::unique_ptr<uint8_t[]> data(new (&ac) uint8_t[args->data_size]);
+    args->ok = ac.check() && (lseek(args->fd, 0, SEEK_SET) == 0);
+    for (size_t i = 0; args->ok && (i < args->num_ops); i++) {
+        args->ok = (read(args->fd, data.get(), args->data_size) ==
+                    static_cast<ssize_t>(args->data_size)) && (data[0] == kMagicByte);
+    }
+    return 0;
+}
+
+// The goal of this benchmark is to see how well reads of separate files by
+// separate clients overlap, compared to the same reads one client at a time.
+template <size_t DataSize, size_t NumOps>
+bool benchmark_concurrent_read(void) {
+    BEGIN_TEST;
+    printf("\nBenchmarking Concurrent Read (%d files of %lu MB)\n", kConcurrentReaders,
+           (DataSize * NumOps) / MB);
+
+    AllocChecker ac;
+    mxtl::unique_ptr<uint8_t[]> data(new (&ac) uint8_t[DataSize]);
+    ASSERT_EQ(ac.check(), true, "");
+    memset(data.get(), kMagicByte, DataSize);
+
+    ReaderArgs args[kConcurrentReaders];
+    for (int i = 0; i < kConcurrentReaders; i++) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), MOUNT_POINT "/reader-%d", i);
+        args[i].fd = open(path, O_CREAT | O_RDWR, 0644);
+        ASSERT_GT(args[i].fd, 0, "Cannot create file");
+        args[i].data_size = DataSize;
+        args[i].num_ops = NumOps;
+        for (size_t n = 0; n < NumOps; n++) {
+            ASSERT_EQ(write(args[i].fd, data.get(), DataSize), DataSize, "");
+        }
+    }
+
+    uint64_t start = mx_ticks_get();
+    for (int i = 0; i < kConcurrentReaders; i++) {
+        read_file(&args[i]);
+        ASSERT_TRUE(args[i].ok, "Read failed");
+    }
+    time_end("read serial", start);
+
+    thrd_t threads[kConcurrentReaders];
+    start = mx_ticks_get();
+    for (int i = 0; i < kConcurrentReaders; i++) {
+        ASSERT_EQ(thrd_create(&threads[i], read_file, &args[i]), thrd_success, "");
+    }
+    for (int i = 0; i < kConcurrentReaders; i++) {
+        ASSERT_EQ(thrd_join(threads[i], nullptr), thrd_success, "");
+    }
+    time_end("read concurrent", start);
+
+    for (int i = 0; i < kConcurrentReaders; i++) {
+        ASSERT_TRUE(args[i].ok, "Read failed");
+        ASSERT_EQ(close(args[i].fd), 0, "");
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), MOUNT_POINT "/reader-%d", i);
+        ASSERT_EQ(unlink(path), 0, "");
+    }
+
+    END_TEST;
+}
+
 #define START_STRING "/aaa"
 
 size_t constexpr kComponentLength = mxtl::constexpr_strlen(START_STRING);
@@ -194,6 +270,8 @@ RUN_TEST_PERFORMANCE((benchmark_write_read<16 * KB, 2048>))
 RUN_TEST_PERFORMANCE((benchmark_write_read<16 * KB, 4096>))
 RUN_TEST_PERFORMANCE((benchmark_write_read<16 * KB, 8192>))
 RUN_TEST_PERFORMANCE((benchmark_write_read<16 * KB, 16384>))
+RUN_TEST_PERFORMANCE((benchmark_concurrent_read<16 * KB, 1024>))
+RUN_TEST_PERFORMANCE((benchmark_concurrent_read<16 * KB, 4096>))
 RUN_TEST_PERFORMANCE((benchmark_path_walk<125>))
 RUN_TEST_PERFORMANCE((benchmark_path_walk<250>))
 RUN_TEST_PERFORMANCE((benchmark_path_walk<500>))
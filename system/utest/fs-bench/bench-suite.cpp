@@ -0,0 +1,610 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <threads.h>
+#include <unistd.h>
+
+#include <digest/digest.h>
+#include <digest/merkle-tree.h>
+#include <magenta/device/vfs.h>
+#include <magenta/syscalls.h>
+#include <mxalloc/new.h>
+#include <mxtl/algorithm.h>
+#include <mxtl/unique_ptr.h>
+#include <unittest/unittest.h>
+
+#include "bench.h"
+
+using digest::Digest;
+using digest::MerkleTree;
+using namespace fsbench;
+
+// Benchmarks of metadata, data, and concurrent operations.  Each runs against
+// memfs, minfs and blobstore in turn; blobs must be named by their contents
+// and written exactly once, so some of what follows differs for blobstore,
+// and a few benchmarks can't be run there at all.
+
+namespace {
+
+constexpr size_t KB = (1 << 10);
+constexpr size_t MB = (1 << 20);
+
+constexpr size_t kSmallFileSize = 1 * KB;
+constexpr size_t kLargeFileSize = 16 * MB;
+
+// Fills |data| with contents which differ from those of every other |index|,
+// so that no two blobs have the same name.
+void fill_data(uint8_t* data, size_t len, uint64_t index) {
+    unsigned int seed = static_cast<unsigned int>(index);
+    for (size_t i = 0; i < len; i++) {
+        data[i] = static_cast<uint8_t>(rand_r(&seed));
+    }
+    memcpy(data, &index, mxtl::min(len, sizeof(index)));
+}
+
+// Names the |index|th file of a benchmark.  On blobstore, the name is the
+// Merkle root of |data|.
+bool file_name(size_t index, const uint8_t* data, size_t len, char* out) {
+    if (!is_blobstore()) {
+        snprintf(out, PATH_MAX, BENCH_ROOT "/file-%zu", index);
+        return true;
+    }
+
+    AllocChecker ac;
+    size_t tree_len = MerkleTree::GetTreeLength(len);
+    mxtl::unique_ptr<uint8_t[]> tree(new (&ac) uint8_t[tree_len]);
+    if (!ac.check()) {
+        return false;
+    }
+    Digest digest;
+    if (MerkleTree::Create(data, len, tree.get(), tree_len, &digest) != MX_OK) {
+        return false;
+    }
+    strcpy(out, BENCH_ROOT "/");
+    size_t prefix = strlen(out);
+    return digest.ToString(out + prefix, PATH_MAX - prefix) == MX_OK;
+}
+
+// Creates a file holding |data|, written |op_size| bytes at a time.  If
+// |samples| is non-null, the time each write takes goes there.
+bool create_file(const char* path, const uint8_t* data, size_t len, size_t op_size,
+                 uint64_t* samples) {
+    int fd = open(path, O_CREAT | O_EXCL | O_RDWR, 0644);
+    ASSERT_GT(fd, 0, "Cannot create file");
+    if (is_blobstore()) {
+        ASSERT_EQ(ftruncate(fd, len), 0, "");
+    }
+    for (size_t off = 0; off < len; off += op_size) {
+        size_t n = mxtl::min(op_size, len - off);
+        uint64_t start = bench_now();
+        ASSERT_EQ(write(fd, data + off, n), static_cast<ssize_t>(n), "");
+        if (samples != nullptr) {
+            *samples++ = bench_now() - start;
+        }
+    }
+    ASSERT_EQ(close(fd), 0, "");
+    return true;
+}
+
+// Makes the name and contents of a large file, and allocates room for
+// |count| samples.
+bool make_large_file(char* path, mxtl::unique_ptr<uint8_t[]>* data,
+                     mxtl::unique_ptr<uint64_t[]>* samples, size_t count) {
+    AllocChecker ac;
+    data->reset(new (&ac) uint8_t[kLargeFileSize]);
+    ASSERT_TRUE(ac.check(), "");
+    samples->reset(new (&ac) uint64_t[count]);
+    ASSERT_TRUE(ac.check(), "");
+    fill_data(data->get(), kLargeFileSize, 0);
+    ASSERT_TRUE(file_name(0, data->get(), kLargeFileSize, path), "");
+    return true;
+}
+
+// Small-file creation and removal: the cost of metadata updates, with as
+// little data as possible.
+template <size_t Count>
+bool bench_small_files(void) {
+    BEGIN_TEST;
+    ASSERT_TRUE(bench_has_nodes(Count), "");
+
+    AllocChecker ac;
+    mxtl::unique_ptr<char[]> paths(new (&ac) char[Count * PATH_MAX]);
+    ASSERT_TRUE(ac.check(), "");
+    mxtl::unique_ptr<uint8_t[]> data(new (&ac) uint8_t[Count * kSmallFileSize]);
+    ASSERT_TRUE(ac.check(), "");
+    mxtl::unique_ptr<uint64_t[]> samples(new (&ac) uint64_t[Count]);
+    ASSERT_TRUE(ac.check(), "");
+
+    // Naming blobs is not what's being measured, so it happens up front
+    for (size_t i = 0; i < Count; i++) {
+        uint8_t* d = &data[i * kSmallFileSize];
+        fill_data(d, kSmallFileSize, i);
+        ASSERT_TRUE(file_name(i, d, kSmallFileSize, &paths[i * PATH_MAX]), "");
+    }
+
+    uint64_t start = bench_now();
+    for (size_t i = 0; i < Count; i++) {
+        uint64_t t = bench_now();
+        ASSERT_TRUE(create_file(&paths[i * PATH_MAX], &data[i * kSmallFileSize],
+                                kSmallFileSize, kSmallFileSize, nullptr), "");
+        samples[i] = bench_now() - t;
+    }
+    bench_record("create_small", samples.get(), Count, Count * kSmallFileSize,
+                 bench_now() - start);
+
+    for (size_t i = 0; i < Count; i++) {
+        uint64_t t = bench_now();
+        ASSERT_EQ(unlink(&paths[i * PATH_MAX]), 0, "");
+        samples[i] = bench_now() - t;
+    }
+    bench_record("unlink_small", samples.get(), Count, 0, 0);
+    END_TEST;
+}
+
+constexpr size_t kReaddirRuns = 5;
+
+// Listing a directory holding |Entries| empty files.
+template <size_t Entries>
+bool bench_readdir(void) {
+    BEGIN_TEST;
+    char metric[32];
+    snprintf(metric, sizeof(metric), "readdir.%zu", Entries);
+    if (!bench_has_nodes(Entries)) {
+        bench_skip(metric, "more entries than the filesystem has inodes");
+        return true;
+    }
+
+    // Blobstore's one directory is its root, so that's the one listed
+    // everywhere.  Empty blobs all share a name, so blobs get a few bytes.
+    const size_t len = is_blobstore() ? sizeof(uint64_t) : 0;
+    uint8_t data[sizeof(uint64_t)];
+    char path[PATH_MAX];
+    for (size_t i = 0; i < Entries; i++) {
+        fill_data(data, len, i);
+        ASSERT_TRUE(file_name(i, data, len, path), "");
+        ASSERT_TRUE(create_file(path, data, len, sizeof(data), nullptr), "");
+    }
+
+    uint64_t samples[kReaddirRuns];
+    for (size_t run = 0; run < kReaddirRuns; run++) {
+        uint64_t start = bench_now();
+        DIR* dir = opendir(BENCH_ROOT);
+        ASSERT_NONNULL(dir, "");
+        size_t count = 0;
+        struct dirent* de;
+        while ((de = readdir(dir)) != NULL) {
+            if (strcmp(de->d_name, ".") && strcmp(de->d_name, "..")) {
+                count++;
+            }
+        }
+        ASSERT_EQ(closedir(dir), 0, "");
+        samples[run] = bench_now() - start;
+        ASSERT_EQ(count, Entries, "Directory listing missed entries");
+    }
+    bench_record(metric, samples, kReaddirRuns, 0, 0);
+
+    for (size_t i = 0; i < Entries; i++) {
+        fill_data(data, len, i);
+        ASSERT_TRUE(file_name(i, data, len, path), "");
+        ASSERT_EQ(unlink(path), 0, "");
+    }
+    END_TEST;
+}
+
+// Writing, then reading, a large file from start to end, |OpSize| bytes at a
+// time.
+template <size_t OpSize>
+bool bench_sequential(void) {
+    BEGIN_TEST;
+    constexpr size_t kOps = kLargeFileSize / OpSize;
+    char path[PATH_MAX];
+    mxtl::unique_ptr<uint8_t[]> data;
+    mxtl::unique_ptr<uint64_t[]> samples;
+    ASSERT_TRUE(make_large_file(path, &data, &samples, kOps), "");
+    char metric[32];
+
+    uint64_t start = bench_now();
+    ASSERT_TRUE(create_file(path, data.get(), kLargeFileSize, OpSize, samples.get()), "");
+    snprintf(metric, sizeof(metric), "seq_write.%zu", OpSize);
+    bench_record(metric, samples.get(), kOps, kLargeFileSize, bench_now() - start);
+
+    AllocChecker ac;
+    mxtl::unique_ptr<uint8_t[]> buf(new (&ac) uint8_t[OpSize]);
+    ASSERT_TRUE(ac.check(), "");
+    int fd = open(path, O_RDONLY);
+    ASSERT_GT(fd, 0, "");
+    start = bench_now();
+    for (size_t i = 0; i < kOps; i++) {
+        uint64_t t = bench_now();
+        ASSERT_EQ(read(fd, buf.get(), OpSize), static_cast<ssize_t>(OpSize), "");
+        samples[i] = bench_now() - t;
+        ASSERT_EQ(memcmp(buf.get(), &data[i * OpSize], OpSize), 0, "");
+    }
+    uint64_t elapsed = bench_now() - start;
+    snprintf(metric, sizeof(metric), "seq_read.%zu", OpSize);
+    bench_record(metric, samples.get(), kOps, kLargeFileSize, elapsed);
+
+    ASSERT_EQ(close(fd), 0, "");
+    ASSERT_EQ(unlink(path), 0, "");
+    END_TEST;
+}
+
+constexpr size_t kRandomOps = 1024;
+
+// Positional reads, then writes, of |OpSize| bytes at random aligned offsets
+// in a large file.  The offsets are the same from run to run.
+template <size_t OpSize>
+bool bench_random(void) {
+    BEGIN_TEST;
+    constexpr size_t kSlots = kLargeFileSize / OpSize;
+    char path[PATH_MAX];
+    mxtl::unique_ptr<uint8_t[]> data;
+    mxtl::unique_ptr<uint64_t[]> samples;
+    ASSERT_TRUE(make_large_file(path, &data, &samples, kRandomOps), "");
+    ASSERT_TRUE(create_file(path, data.get(), kLargeFileSize, 64 * KB, nullptr), "");
+
+    AllocChecker ac;
+    mxtl::unique_ptr<uint8_t[]> buf(new (&ac) uint8_t[OpSize]);
+    ASSERT_TRUE(ac.check(), "");
+    int fd = open(path, is_blobstore() ? O_RDONLY : O_RDWR);
+    ASSERT_GT(fd, 0, "");
+    char metric[32];
+
+    unsigned int seed = 1;
+    uint64_t start = bench_now();
+    for (size_t i = 0; i < kRandomOps; i++) {
+        off_t off = static_cast<off_t>((rand_r(&seed) % kSlots) * OpSize);
+        uint64_t t = bench_now();
+        ASSERT_EQ(pread(fd, buf.get(), OpSize, off), static_cast<ssize_t>(OpSize), "");
+        samples[i] = bench_now() - t;
+        ASSERT_EQ(memcmp(buf.get(), &data[off], OpSize), 0, "");
+    }
+    uint64_t elapsed = bench_now() - start;
+    snprintf(metric, sizeof(metric), "rand_read.%zu", OpSize);
+    bench_record(metric, samples.get(), kRandomOps, kRandomOps * OpSize, elapsed);
+
+    snprintf(metric, sizeof(metric), "rand_write.%zu", OpSize);
+    if (is_blobstore()) {
+        bench_skip(metric, "blobs cannot be rewritten");
+    } else {
+        start = bench_now();
+        for (size_t i = 0; i < kRandomOps; i++) {
+            off_t off = static_cast<off_t>((rand_r(&seed) % kSlots) * OpSize);
+            uint64_t t = bench_now();
+            ASSERT_EQ(pwrite(fd, buf.get(), OpSize, off), static_cast<ssize_t>(OpSize), "");
+            samples[i] = bench_now() - t;
+        }
+        elapsed = bench_now() - start;
+        bench_record(metric, samples.get(), kRandomOps, kRandomOps * OpSize, elapsed);
+    }
+
+    ASSERT_EQ(close(fd), 0, "");
+    ASSERT_EQ(unlink(path), 0, "");
+    END_TEST;
+}
+
+constexpr size_t kFsyncOps = 128;
+
+// How long fsync takes after each small append, as a log or database would.
+template <size_t OpSize>
+bool bench_fsync(void) {
+    BEGIN_TEST;
+    char metric[32];
+    snprintf(metric, sizeof(metric), "fsync.%zu", OpSize);
+    if (is_blobstore()) {
+        bench_skip(metric, "blobs cannot be appended to");
+        return true;
+    }
+
+    uint8_t buf[OpSize];
+    fill_data(buf, OpSize, 0);
+    int fd = open(BENCH_ROOT "/fsync", O_CREAT | O_EXCL | O_RDWR, 0644);
+    ASSERT_GT(fd, 0, "");
+    uint64_t samples[kFsyncOps];
+    for (size_t i = 0; i < kFsyncOps; i++) {
+        ASSERT_EQ(write(fd, buf, OpSize), static_cast<ssize_t>(OpSize), "");
+        uint64_t t = bench_now();
+        ASSERT_EQ(fsync(fd), 0, "");
+        samples[i] = bench_now() - t;
+    }
+    bench_record(metric, samples, kFsyncOps, 0, 0);
+    ASSERT_EQ(close(fd), 0, "");
+    ASSERT_EQ(unlink(BENCH_ROOT "/fsync"), 0, "");
+    END_TEST;
+}
+
+constexpr size_t kMaxClients = 8;
+constexpr size_t kClientFileSize = 4 * MB;
+constexpr size_t kClientOpSize = 64 * KB;
+constexpr size_t kClientOps = kClientFileSize / kClientOpSize;
+constexpr size_t kClientSmallFiles = 128;
+
+struct Client {
+    size_t id;
+    char path[PATH_MAX];
+    mxtl::unique_ptr<uint8_t[]> data;
+    uint64_t* samples;
+    bool ok;
+};
+
+// Each client reads its own file end to end.
+int client_read(void* arg) {
+    Client* c = static_cast<Client*>(arg);
+    AllocChecker ac;
+    mxtl::unique_ptr<uint8_t[]> buf(new (&ac) uint8_t[kClientOpSize]);
+    int fd = open(c->path, O_RDONLY);
+    c->ok = ac.check() && (fd >= 0);
+    for (size_t i = 0; c->ok && (i < kClientOps); i++) {
+        uint64_t t = bench_now();
+        c->ok = (read(fd, buf.get(), kClientOpSize) == static_cast<ssize_t>(kClientOpSize));
+        c->samples[i] = bench_now() - t;
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    return 0;
+}
+
+// Each client creates, then removes, small files of its own.
+int client_create(void* arg) {
+    Client* c = static_cast<Client*>(arg);
+    uint8_t data[kSmallFileSize];
+    char path[PATH_MAX];
+    c->ok = true;
+    for (size_t i = 0; c->ok && (i < kClientSmallFiles); i++) {
+        fill_data(data, sizeof(data), (c->id + 1) * kClientSmallFiles + i);
+        if (!file_name((c->id + 1) * kClientSmallFiles + i, data, sizeof(data), path)) {
+            c->ok = false;
+            break;
+        }
+        uint64_t t = bench_now();
+        int fd = open(path, O_CREAT | O_EXCL | O_RDWR, 0644);
+        c->ok = (fd >= 0) && (!is_blobstore() || (ftruncate(fd, sizeof(data)) == 0)) &&
+                (write(fd, data, sizeof(data)) == static_cast<ssize_t>(sizeof(data)));
+        if (fd >= 0) {
+            c->ok &= (close(fd) == 0);
+        }
+        c->ok &= (unlink(path) == 0);
+        c->samples[i] = bench_now() - t;
+    }
+    return 0;
+}
+
+// Runs |work| on |Clients| threads at once, recording every client's samples
+// together.
+template <size_t Clients>
+bool run_clients(const char* name, thrd_start_t work, size_t ops, size_t bytes,
+                 Client* clients) {
+    static_assert(Clients <= kMaxClients, "Too many clients");
+    AllocChecker ac;
+    mxtl::unique_ptr<uint64_t[]> samples(new (&ac) uint64_t[Clients * ops]);
+    ASSERT_TRUE(ac.check(), "");
+    for (size_t i = 0; i < Clients; i++) {
+        clients[i].samples = &samples[i * ops];
+    }
+
+    thrd_t threads[Clients];
+    uint64_t start = bench_now();
+    for (size_t i = 0; i < Clients; i++) {
+        ASSERT_EQ(thrd_create(&threads[i], work, &clients[i]), thrd_success, "");
+    }
+    for (size_t i = 0; i < Clients; i++) {
+        ASSERT_EQ(thrd_join(threads[i], nullptr), thrd_success, "");
+    }
+    uint64_t elapsed = bench_now() - start;
+    for (size_t i = 0; i < Clients; i++) {
+        ASSERT_TRUE(clients[i].ok, "Client failed");
+    }
+
+    char metric[32];
+    snprintf(metric, sizeof(metric), "%s.%zu", name, Clients);
+    bench_record(metric, samples.get(), Clients * ops, Clients * bytes, elapsed);
+    return true;
+}
+
+// How well |Clients| clients of the same filesystem overlap, reading separate
+// files and then creating separate files.  Comparing against a single client
+// shows how much the filesystem serializes them.
+template <size_t Clients>
+bool bench_concurrent(void) {
+    BEGIN_TEST;
+    ASSERT_TRUE(bench_has_nodes(Clients * 2), "");
+    Client clients[Clients];
+    for (size_t i = 0; i < Clients; i++) {
+        AllocChecker ac;
+        clients[i].id = i;
+        clients[i].data.reset(new (&ac) uint8_t[kClientFileSize]);
+        ASSERT_TRUE(ac.check(), "");
+        fill_data(clients[i].data.get(), kClientFileSize, i);
+        ASSERT_TRUE(file_name(i, clients[i].data.get(), kClientFileSize, clients[i].path), "");
+        ASSERT_TRUE(create_file(clients[i].path, clients[i].data.get(), kClientFileSize,
+                                kClientOpSize, nullptr), "");
+    }
+
+    ASSERT_TRUE(run_clients<Clients>("concurrent_read", client_read, kClientOps,
+                                     kClientFileSize, clients), "");
+    ASSERT_TRUE(run_clients<Clients>("concurrent_create", client_create, kClientSmallFiles,
+                                     0, clients), "");
+
+    for (size_t i = 0; i < Clients; i++) {
+        ASSERT_EQ(unlink(clients[i].path), 0, "");
+    }
+    END_TEST;
+}
+
+constexpr size_t kFillBlockSize = 8 * KB;
+constexpr size_t kFillFileBlocks = 23;
+constexpr size_t kMaxFillFiles = 4096;
+constexpr size_t kFullSmallFiles = 256;
+constexpr size_t kFullOpSize = 64 * KB;
+
+// The |index|th of the files which fill the disk, from 8KB to 184KB long.
+size_t fill_size(size_t index) {
+    return (index % kFillFileBlocks + 1) * kFillBlockSize;
+}
+
+bool fill_file(size_t index, uint8_t* data, char* path) {
+    fill_data(data, fill_size(index), index);
+    return file_name(index, data, fill_size(index), path);
+}
+
+// Allocating on a disk which is |Percent| percent full, its free space left
+// in holes of all sizes by deleting pairs of the files which filled it:
+// creating small files, then writing a file of up to half the space that's
+// left, and reading it back once it's out of the cache, which shows how well
+// its blocks were kept together.
+template <size_t Percent>
+bool bench_nearly_full(void) {
+    BEGIN_TEST;
+    static_assert(Percent < 96, "The disk is filled a few percent past Percent");
+    // Filled to |Percent| + 4, a pair in every |kStride| files is deleted to
+    // take it back down.
+    constexpr size_t kStride = 2 * (Percent + 4) / 4;
+    char create_metric[32], write_metric[32], read_metric[32];
+    snprintf(create_metric, sizeof(create_metric), "full_%zu.create_small", Percent);
+    snprintf(write_metric, sizeof(write_metric), "full_%zu.seq_write.%zu", Percent, kFullOpSize);
+    snprintf(read_metric, sizeof(read_metric), "full_%zu.seq_read.%zu", Percent, kFullOpSize);
+    size_t total, used;
+    const char* skipped = nullptr;
+    if (!bench_space(&total, &used)) {
+        skipped = "the filesystem has no fixed size";
+    } else if (!bench_has_nodes(kMaxFillFiles + kFullSmallFiles + 1)) {
+        skipped = "more files than the filesystem has inodes";
+    }
+    if (skipped != nullptr) {
+        bench_skip(create_metric, skipped);
+        bench_skip(write_metric, skipped);
+        bench_skip(read_metric, skipped);
+        return true;
+    }
+
+    AllocChecker ac;
+    mxtl::unique_ptr<uint8_t[]> buf(new (&ac) uint8_t[kFillFileBlocks * kFillBlockSize]);
+    ASSERT_TRUE(ac.check(), "");
+    char path[PATH_MAX];
+    size_t files = 0;
+    while (used < total / 100 * (Percent + 4)) {
+        ASSERT_LT(files, kMaxFillFiles, "");
+        ASSERT_TRUE(fill_file(files, buf.get(), path), "");
+        ASSERT_TRUE(create_file(path, buf.get(), fill_size(files), fill_size(files), nullptr),
+                    "");
+        files++;
+        ASSERT_TRUE(bench_space(&total, &used), "");
+    }
+    size_t holes_end = 0;
+    while ((holes_end < files) && (used > total / 100 * Percent)) {
+        for (size_t i = holes_end; i < mxtl::min(holes_end + 2, files); i++) {
+            ASSERT_TRUE(fill_file(i, buf.get(), path), "");
+            ASSERT_EQ(unlink(path), 0, "");
+        }
+        holes_end += kStride;
+        ASSERT_TRUE(bench_space(&total, &used), "");
+    }
+
+    mxtl::unique_ptr<char[]> paths(new (&ac) char[kFullSmallFiles * PATH_MAX]);
+    ASSERT_TRUE(ac.check(), "");
+    mxtl::unique_ptr<uint8_t[]> data(new (&ac) uint8_t[kFullSmallFiles * kSmallFileSize]);
+    ASSERT_TRUE(ac.check(), "");
+    uint64_t samples[kFullSmallFiles];
+    for (size_t i = 0; i < kFullSmallFiles; i++) {
+        uint8_t* d = &data[i * kSmallFileSize];
+        fill_data(d, kSmallFileSize, kMaxFillFiles + i);
+        ASSERT_TRUE(file_name(kMaxFillFiles + i, d, kSmallFileSize, &paths[i * PATH_MAX]), "");
+    }
+    uint64_t start = bench_now();
+    for (size_t i = 0; i < kFullSmallFiles; i++) {
+        uint64_t t = bench_now();
+        ASSERT_TRUE(create_file(&paths[i * PATH_MAX], &data[i * kSmallFileSize],
+                                kSmallFileSize, kSmallFileSize, nullptr), "");
+        samples[i] = bench_now() - t;
+    }
+    bench_record(create_metric, samples, kFullSmallFiles, kFullSmallFiles * kSmallFileSize,
+                 bench_now() - start);
+
+    ASSERT_TRUE(bench_space(&total, &used), "");
+    size_t len = mxtl::min(kLargeFileSize, (total - used) / 2 / kFullOpSize * kFullOpSize);
+    ASSERT_GT(len, 0u, "No room left for the large file");
+    size_t ops = len / kFullOpSize;
+    mxtl::unique_ptr<uint8_t[]> large(new (&ac) uint8_t[len]);
+    ASSERT_TRUE(ac.check(), "");
+    mxtl::unique_ptr<uint64_t[]> op_samples(new (&ac) uint64_t[ops]);
+    ASSERT_TRUE(ac.check(), "");
+    char large_path[PATH_MAX];
+    fill_data(large.get(), len, kMaxFillFiles + kFullSmallFiles);
+    ASSERT_TRUE(file_name(kMaxFillFiles + kFullSmallFiles, large.get(), len, large_path), "");
+    start = bench_now();
+    ASSERT_TRUE(create_file(large_path, large.get(), len, kFullOpSize, op_samples.get()), "");
+    bench_record(write_metric, op_samples.get(), ops, len, bench_now() - start);
+
+    // Only filesystems with a cache to drop support this.
+    int dirfd = open(BENCH_ROOT, O_RDONLY | O_DIRECTORY);
+    ASSERT_GE(dirfd, 0, "");
+    ioctl_vfs_drop_cache(dirfd);
+    ASSERT_EQ(close(dirfd), 0, "");
+
+    mxtl::unique_ptr<uint8_t[]> op_buf(new (&ac) uint8_t[kFullOpSize]);
+    ASSERT_TRUE(ac.check(), "");
+    int fd = open(large_path, O_RDONLY);
+    ASSERT_GT(fd, 0, "");
+    start = bench_now();
+    for (size_t i = 0; i < ops; i++) {
+        uint64_t t = bench_now();
+        ASSERT_EQ(read(fd, op_buf.get(), kFullOpSize), static_cast<ssize_t>(kFullOpSize), "");
+        op_samples[i] = bench_now() - t;
+        ASSERT_EQ(memcmp(op_buf.get(), &large[i * kFullOpSize], kFullOpSize), 0, "");
+    }
+    bench_record(read_metric, op_samples.get(), ops, len, bench_now() - start);
+    ASSERT_EQ(close(fd), 0, "");
+
+    ASSERT_EQ(unlink(large_path), 0, "");
+    for (size_t i = 0; i < kFullSmallFiles; i++) {
+        ASSERT_EQ(unlink(&paths[i * PATH_MAX]), 0, "");
+    }
+    for (size_t i = 0; i < files; i++) {
+        if ((i < holes_end) && (i % kStride < 2)) {
+            continue;
+        }
+        ASSERT_TRUE(fill_file(i, buf.get(), path), "");
+        ASSERT_EQ(unlink(path), 0, "");
+    }
+    END_TEST;
+}
+
+} // namespace
+
+#define RUN_BENCHMARKS                                      \
+    RUN_TEST_PERFORMANCE((bench_small_files<1000>))         \
+    RUN_TEST_PERFORMANCE((bench_readdir<10000>))            \
+    RUN_TEST_PERFORMANCE((bench_readdir<100000>))           \
+    RUN_TEST_PERFORMANCE((bench_sequential<4 * KB>))        \
+    RUN_TEST_PERFORMANCE((bench_sequential<64 * KB>))       \
+    RUN_TEST_PERFORMANCE((bench_sequential<1 * MB>))        \
+    RUN_TEST_PERFORMANCE((bench_random<4 * KB>))            \
+    RUN_TEST_PERFORMANCE((bench_random<64 * KB>))           \
+    RUN_TEST_PERFORMANCE((bench_fsync<4 * KB>))             \
+    RUN_TEST_PERFORMANCE((bench_concurrent<1>))             \
+    RUN_TEST_PERFORMANCE((bench_concurrent<2>))             \
+    RUN_TEST_PERFORMANCE((bench_concurrent<4>))             \
+    RUN_TEST_PERFORMANCE((bench_concurrent<8>))             \
+    RUN_TEST_PERFORMANCE((bench_nearly_full<95>))
+
+BEGIN_BENCH_CASE(suite_benchmarks_memfs, &kMemfs)
+RUN_BENCHMARKS
+END_BENCH_CASE(suite_benchmarks_memfs)
+
+BEGIN_BENCH_CASE(suite_benchmarks_minfs, &kMinfs)
+RUN_BENCHMARKS
+END_BENCH_CASE(suite_benchmarks_minfs)
+
+BEGIN_BENCH_CASE(suite_benchmarks_blobstore, &kBlobstore)
+RUN_BENCHMARKS
+END_BENCH_CASE(suite_benchmarks_blobstore)
@@ -0,0 +1,235 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fs-management/mount.h>
+#include <fs-management/ramdisk.h>
+#include <magenta/device/vfs.h>
+#include <mxalloc/new.h>
+#include <mxtl/intrusive_double_list.h>
+#include <mxtl/unique_ptr.h>
+
+#include "bench.h"
+
+namespace fsbench {
+
+const Filesystem kMemfs = {"memfs", DISK_FORMAT_UNKNOWN};
+const Filesystem kMinfs = {"minfs", DISK_FORMAT_MINFS};
+const Filesystem kBlobstore = {"blobstore", DISK_FORMAT_BLOBFS};
+
+const Filesystem* bench_fs;
+
+namespace {
+
+// Large enough for a few 16 MiB files, or tens of thousands of small blobs.
+constexpr uint64_t kRamdiskBlockSize = 512;
+constexpr uint64_t kRamdiskBlockCount = 1 << 19;
+
+char ramdisk_path[PATH_MAX];
+
+struct Result : public mxtl::DoublyLinkedListable<mxtl::unique_ptr<Result>> {
+    const char* fs;
+    char metric[64];
+    const char* skipped;
+    size_t count;
+    uint64_t min;
+    uint64_t median;
+    uint64_t p90;
+    uint64_t p99;
+    uint64_t max;
+    uint64_t mean;
+    uint64_t bytes_per_sec;
+};
+
+mxtl::DoublyLinkedList<mxtl::unique_ptr<Result>> results;
+
+int compare_samples(const void* a, const void* b) {
+    uint64_t x = *static_cast<const uint64_t*>(a);
+    uint64_t y = *static_cast<const uint64_t*>(b);
+    return (x < y) ? -1 : (x > y);
+}
+
+mxtl::unique_ptr<Result> new_result(const char* metric) {
+    AllocChecker ac;
+    mxtl::unique_ptr<Result> r(new (&ac) Result());
+    if (!ac.check()) {
+        return nullptr;
+    }
+    r->fs = bench_fs->name;
+    snprintf(r->metric, sizeof(r->metric), "%s", metric);
+    return r;
+}
+
+} // namespace
+
+bool bench_setup(const Filesystem* fs) {
+    bench_fs = fs;
+    if ((mkdir(BENCH_ROOT, 0755) < 0) && (errno != EEXIST)) {
+        fprintf(stderr, "fs-bench: Could not create %s\n", BENCH_ROOT);
+        return false;
+    }
+    if (fs->format == DISK_FORMAT_UNKNOWN) {
+        return true;
+    }
+
+    if (create_ramdisk(kRamdiskBlockSize, kRamdiskBlockCount, ramdisk_path)) {
+        fprintf(stderr, "fs-bench: Could not create ramdisk\n");
+        return false;
+    }
+    mx_status_t status;
+    if ((status = mkfs(ramdisk_path, fs->format, launch_stdio_sync,
+                       &default_mkfs_options)) != MX_OK) {
+        fprintf(stderr, "fs-bench: Could not format %s: %d\n", fs->name, status);
+        destroy_ramdisk(ramdisk_path);
+        return false;
+    }
+    int fd = open(ramdisk_path, O_RDWR);
+    if (fd < 0) {
+        fprintf(stderr, "fs-bench: Could not open ramdisk\n");
+        destroy_ramdisk(ramdisk_path);
+        return false;
+    }
+    // fd consumed by mount.
+    if ((status = mount(fd, BENCH_ROOT, fs->format, &default_mount_options,
+                        launch_stdio_async)) != MX_OK) {
+        fprintf(stderr, "fs-bench: Could not mount %s: %d\n", fs->name, status);
+        destroy_ramdisk(ramdisk_path);
+        return false;
+    }
+    return true;
+}
+
+bool bench_teardown() {
+    bool ok = true;
+    if (bench_fs->format != DISK_FORMAT_UNKNOWN) {
+        if (umount(BENCH_ROOT) != MX_OK) {
+            fprintf(stderr, "fs-bench: Could not unmount %s\n", bench_fs->name);
+            ok = false;
+        }
+        if (destroy_ramdisk(ramdisk_path)) {
+            fprintf(stderr, "fs-bench: Could not destroy ramdisk\n");
+            ok = false;
+        }
+    }
+    // Every benchmark cleans up after itself, so this fails if one of
+    // them left a file behind.
+    if (rmdir(BENCH_ROOT) < 0) {
+        fprintf(stderr, "fs-bench: Could not remove %s\n", BENCH_ROOT);
+        ok = false;
+    }
+    return ok;
+}
+
+bool bench_has_nodes(size_t count) {
+    int fd = open(BENCH_ROOT, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        return false;
+    }
+    vfs_query_info_t info;
+    ssize_t r = ioctl_vfs_query_fs(fd, &info, sizeof(info));
+    close(fd);
+    // Filesystems without a fixed number of nodes report none at all
+    return (r < 0) || (info.total_nodes == 0) || (info.total_nodes - info.used_nodes >= count);
+}
+
+bool bench_space(size_t* total, size_t* used) {
+    int fd = open(BENCH_ROOT, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        return false;
+    }
+    vfs_query_info_t info;
+    ssize_t r = ioctl_vfs_query_fs(fd, &info, sizeof(info));
+    close(fd);
+    if ((r < 0) || (info.total_bytes == 0)) {
+        return false;
+    }
+    *total = info.total_bytes;
+    *used = info.used_bytes;
+    return true;
+}
+
+void bench_record(const char* metric, uint64_t* samples, size_t count,
+                  size_t bytes, uint64_t elapsed) {
+    mxtl::unique_ptr<Result> r = new_result(metric);
+    if ((r == nullptr) || (count == 0)) {
+        return;
+    }
+    qsort(samples, count, sizeof(uint64_t), compare_samples);
+    uint64_t sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        sum += samples[i];
+    }
+    r->count = count;
+    r->min = samples[0];
+    r->median = samples[count / 2];
+    r->p90 = samples[(count * 9) / 10];
+    r->p99 = samples[(count * 99) / 100];
+    r->max = samples[count - 1];
+    r->mean = sum / count;
+    if ((bytes != 0) && (elapsed != 0)) {
+        r->bytes_per_sec = static_cast<uint64_t>(static_cast<double>(bytes) *
+                                                 MX_SEC(1) / static_cast<double>(elapsed));
+    }
+
+    printf("Benchmark %-9s %-28s: median [%10lu] nsec, p99 [%10lu] nsec", r->fs, r->metric,
+           r->median, r->p99);
+    if (r->bytes_per_sec != 0) {
+        printf(", [%6lu] MB/s", r->bytes_per_sec / (1 << 20));
+    }
+    printf("\n");
+    results.push_back(mxtl::move(r));
+}
+
+void bench_skip(const char* metric, const char* reason) {
+    mxtl::unique_ptr<Result> r = new_result(metric);
+    if (r == nullptr) {
+        return;
+    }
+    r->skipped = reason;
+    printf("Benchmark %-9s %-28s: skipped (%s)\n", r->fs, r->metric, reason);
+    results.push_back(mxtl::move(r));
+}
+
+// The report looks like:
+//
+//   {"results": [
+//     {"fs": "minfs", "metric": "seq_read.65536", "unit": "ns", "count": 256,
+//      "min": ..., "median": ..., "p90": ..., "p99": ..., "max": ..., "mean": ...,
+//      "bytes_per_sec": ...},
+//     {"fs": "minfs", "metric": "readdir.100000", "skipped": "..."},
+//     ...
+//   ]}
+//
+// "bytes_per_sec" only appears for metrics which move data.
+bool bench_write_report(FILE* out) {
+    fprintf(out, "{\"results\": [");
+    const char* sep = "\n";
+    for (const Result& r : results) {
+        fprintf(out, "%s  {\"fs\": \"%s\", \"metric\": \"%s\"", sep, r.fs, r.metric);
+        if (r.skipped != nullptr) {
+            fprintf(out, ", \"skipped\": \"%s\"}", r.skipped);
+        } else {
+            fprintf(out, ", \"unit\": \"ns\", \"count\": %zu, \"min\": %lu, \"median\": %lu, "
+                    "\"p90\": %lu, \"p99\": %lu, \"max\": %lu, \"mean\": %lu",
+                    r.count, r.min, r.median, r.p90, r.p99, r.max, r.mean);
+            if (r.bytes_per_sec != 0) {
+                fprintf(out, ", \"bytes_per_sec\": %lu", r.bytes_per_sec);
+            }
+            fprintf(out, "}");
+        }
+        sep = ",\n";
+    }
+    fprintf(out, "\n]}\n");
+    return ferror(out) == 0;
+}
+
+} // namespace fsbench
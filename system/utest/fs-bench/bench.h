@@ -0,0 +1,80 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <fs-management/mount.h>
+#include <magenta/syscalls.h>
+#include <unittest/unittest.h>
+
+namespace fsbench {
+
+// Where the filesystem under test is mounted (or, for memfs, where the
+// benchmarks make their files).
+#define BENCH_ROOT "/tmp/fs-bench"
+
+struct Filesystem {
+    const char* name;
+    // DISK_FORMAT_UNKNOWN for memfs, which has no backing disk.
+    disk_format_t format;
+};
+
+extern const Filesystem kMemfs;
+extern const Filesystem kMinfs;
+extern const Filesystem kBlobstore;
+
+// The filesystem the running benchmark case is against.
+extern const Filesystem* bench_fs;
+
+inline bool is_blobstore() {
+    return bench_fs->format == DISK_FORMAT_BLOBFS;
+}
+
+// Makes an empty |fs| at BENCH_ROOT, and takes it down again.
+bool bench_setup(const Filesystem* fs);
+bool bench_teardown();
+
+// Returns whether the filesystem under test has room for |count| more files.
+bool bench_has_nodes(size_t count);
+
+// Finds how many bytes the filesystem under test holds, and how many of those
+// are in use.  Returns false for filesystems with no fixed size.
+bool bench_space(size_t* total, size_t* used);
+
+inline uint64_t bench_now() {
+    return mx_time_get(MX_CLOCK_MONOTONIC);
+}
+
+// Records |count| |samples| of |metric|, each the nanoseconds one operation
+// took.  |samples| is sorted in place.  If |bytes| is nonzero, it is the
+// amount of data moved across all the samples in |elapsed| nanoseconds of
+// wall time, from which the throughput is reported.
+void bench_record(const char* metric, uint64_t* samples, size_t count,
+                  size_t bytes, uint64_t elapsed);
+
+// Records that |metric| could not be measured on this filesystem.
+void bench_skip(const char* metric, const char* reason);
+
+// Writes every result recorded so far to |out| as a single JSON object.
+bool bench_write_report(FILE* out);
+
+} // namespace fsbench
+
+// Each case of benchmarks runs against a filesystem of its own.
+#define BEGIN_BENCH_CASE(case_name, fs)                 \
+        BEGIN_TEST_CASE(case_name)                      \
+        if (!fsbench::bench_setup(fs)) {                \
+            all_success = false;                        \
+        } else {
+
+#define END_BENCH_CASE(case_name)                       \
+            if (!fsbench::bench_teardown()) {           \
+                all_success = false;                    \
+            }                                           \
+        }                                               \
+        END_TEST_CASE(case_name)
@@ -2,8 +2,37 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <stdio.h>
+#include <string.h>
+
 #include <unittest/unittest.h>
 
+#include "bench.h"
+
+// fs-bench-test [--json <path>] [unittest options]
+//
+// With --json, the results of the benchmark suite are written to |path| once
+// every benchmark has run ("-" for stdout).
 int main(int argc, char** argv) {
-    return unittest_run_all_tests(argc, argv) ? 0 : -1;
+    const char* json_path = nullptr;
+    for (int i = 1; i < argc - 1; i++) {
+        if (!strcmp(argv[i], "--json")) {
+            json_path = argv[i + 1];
+        }
+    }
+
+    bool ok = unittest_run_all_tests(argc, argv);
+
+    if (json_path != nullptr) {
+        FILE* out = strcmp(json_path, "-") ? fopen(json_path, "w") : stdout;
+        if (out == nullptr) {
+            fprintf(stderr, "fs-bench: Could not open %s\n", json_path);
+            return -1;
+        }
+        ok &= fsbench::bench_write_report(out);
+        if (out != stdout) {
+            ok &= (fclose(out) == 0);
+        }
+    }
+    return ok ? 0 : -1;
 }
@@ -15,8 +15,12 @@ MODULE_NAME := fs-bench-test
 MODULE_SRCS := \
     $(LOCAL_DIR)/main.cpp \
     $(LOCAL_DIR)/bench-basic.cpp \
+    $(LOCAL_DIR)/bench-suite.cpp \
+    $(LOCAL_DIR)/bench-util.cpp \
 
 MODULE_STATIC_LIBS := \
+    system/ulib/digest \
+    third_party/ulib/cryptolib \
     system/ulib/mxalloc \
     system/ulib/mxcpp \
     system/ulib/mxtl \
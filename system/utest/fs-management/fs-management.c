@@ -245,6 +245,42 @@ static bool mount_fsck(void) {
     END_TEST;
 }
 
+static bool mount_all_parallel(void) {
+    char ramdisk_paths[2][PATH_MAX];
+    const char* mount_paths[2] = { "/tmp/mount_all_a", "/tmp/mount_all_b" };
+    mount_request_t requests[2];
+
+    BEGIN_TEST;
+    for (size_t i = 0; i < 2; i++) {
+        ASSERT_EQ(create_ramdisk(512, 1 << 16, ramdisk_paths[i]), 0, "");
+        ASSERT_EQ(mkfs(ramdisk_paths[i], DISK_FORMAT_MINFS, launch_stdio_sync,
+                       &default_mkfs_options), MX_OK, "");
+        ASSERT_EQ(mkdir(mount_paths[i], 0666), 0, "");
+        requests[i] = (mount_request_t) {
+            .devicepath = ramdisk_paths[i],
+            .mountpath = mount_paths[i],
+            .df = DISK_FORMAT_MINFS,
+            .options = default_mount_options,
+            .cb = launch_stdio_async,
+            .check = true,
+            .fsck_options = default_fsck_options,
+            .fsck_cb = launch_stdio_sync,
+        };
+    }
+    ASSERT_EQ(mount_all(requests, 2), MX_OK, "");
+    for (size_t i = 0; i < 2; i++) {
+        ASSERT_EQ(requests[i].status, MX_OK, "");
+        ASSERT_GT(requests[i].fsck_time, 0, "fsck should have been timed");
+        ASSERT_TRUE(check_mounted_fs(mount_paths[i], "minfs", strlen("minfs")), "");
+    }
+    for (size_t i = 0; i < 2; i++) {
+        ASSERT_EQ(umount(mount_paths[i]), MX_OK, "");
+        ASSERT_EQ(destroy_ramdisk(ramdisk_paths[i]), 0, "");
+        ASSERT_EQ(unlink(mount_paths[i]), 0, "");
+    }
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(fs_management_tests)
 RUN_TEST_MEDIUM(mount_unmount)
 RUN_TEST_MEDIUM(mount_mkdir_unmount)
@@ -253,6 +289,7 @@ RUN_TEST_MEDIUM(mount_evil_memfs)
 RUN_TEST_MEDIUM(mount_evil_minfs)
 RUN_TEST_MEDIUM(mount_remount)
 RUN_TEST_MEDIUM(mount_fsck)
+RUN_TEST_MEDIUM(mount_all_parallel)
 END_TEST_CASE(fs_management_tests)
 
 int main(int argc, char** argv) {
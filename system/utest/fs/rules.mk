@@ -18,12 +18,15 @@ MODULE_SRCS := \
     $(LOCAL_DIR)/misc.c \
     $(LOCAL_DIR)/wrap.c \
     $(LOCAL_DIR)/test-attr.c \
+    $(LOCAL_DIR)/test-attr-cache.c \
     $(LOCAL_DIR)/test-append.c \
     $(LOCAL_DIR)/test-basic.c \
     $(LOCAL_DIR)/test-directory.c \
     $(LOCAL_DIR)/test-dot-dot.c \
+    $(LOCAL_DIR)/test-large-io.c \
     $(LOCAL_DIR)/test-link.c \
     $(LOCAL_DIR)/test-maxfile.c \
+    $(LOCAL_DIR)/test-mmap.c \
     $(LOCAL_DIR)/test-overflow.c \
     $(LOCAL_DIR)/test-persist.cpp \
     $(LOCAL_DIR)/test-realpath.cpp \
@@ -0,0 +1,58 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <magenta/types.h>
+#include <mxio/io.h>
+
+#include "filesystems.h"
+#include "misc.h"
+
+bool test_attr_cache_consistent(void) {
+    BEGIN_TEST;
+
+    ASSERT_EQ(mxio_attr_cache_enable(MX_SEC(60)), MX_OK, "");
+    ASSERT_EQ(mkdir("::dir", 0755), 0, "");
+
+    // Missing paths stay missing until they are created
+    struct stat s;
+    ASSERT_EQ(stat("::dir/alpha", &s), -1, "");
+    ASSERT_EQ(errno, ENOENT, "");
+    ASSERT_EQ(open("::dir/alpha", O_RDWR, 0644), -1, "");
+    ASSERT_EQ(errno, ENOENT, "");
+    int fd = open("::dir/alpha", O_RDWR | O_CREAT, 0644);
+    ASSERT_GT(fd, 0, "");
+    ASSERT_EQ(stat("::dir/alpha", &s), 0, "");
+    ASSERT_EQ(s.st_size, 0, "");
+
+    // Writes, truncates and renames are seen straight away
+    const char* hello = "hello";
+    ASSERT_EQ(write(fd, hello, strlen(hello)), (ssize_t) strlen(hello), "");
+    ASSERT_EQ(stat("::dir/alpha", &s), 0, "");
+    ASSERT_EQ(s.st_size, (off_t) strlen(hello), "");
+    ASSERT_EQ(ftruncate(fd, 2), 0, "");
+    ASSERT_EQ(stat("::dir/alpha", &s), 0, "");
+    ASSERT_EQ(s.st_size, 2, "");
+    ASSERT_EQ(close(fd), 0, "");
+    ASSERT_EQ(rename("::dir/alpha", "::dir/beta"), 0, "");
+    ASSERT_EQ(access("::dir/alpha", F_OK), -1, "");
+    ASSERT_EQ(access("::dir/beta", F_OK), 0, "");
+
+    ASSERT_EQ(unlink("::dir/beta"), 0, "");
+    ASSERT_EQ(stat("::dir/beta", &s), -1, "");
+    ASSERT_EQ(errno, ENOENT, "");
+    ASSERT_EQ(rmdir("::dir"), 0, "");
+    ASSERT_EQ(mxio_attr_cache_enable(0), MX_OK, "");
+    END_TEST;
+}
+
+RUN_FOR_ALL_FILESYSTEMS(attr_cache_tests,
+    RUN_TEST_MEDIUM(test_attr_cache_consistent)
+)
@@ -0,0 +1,113 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "filesystems.h"
+#include "misc.h"
+
+// Sizes either side of the chunked, pipelined, and VMO transfer paths
+static const size_t kSizes[] = {
+    8191, 8192, 8193, 40000, 65536, 65537, 262144, 300000, 1 << 20,
+};
+
+static void fill(uint8_t* buf, size_t len, unsigned seed) {
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = (uint8_t)((i * 7 + seed) ^ (i >> 9));
+    }
+}
+
+bool test_large_io_stream(void) {
+    BEGIN_TEST;
+
+    const size_t max = 1 << 20;
+    uint8_t* out = malloc(max);
+    uint8_t* in = malloc(max);
+    ASSERT_NONNULL(out, "");
+    ASSERT_NONNULL(in, "");
+
+    for (size_t i = 0; i < countof(kSizes); i++) {
+        size_t len = kSizes[i];
+        fill(out, len, (unsigned)i);
+
+        int fd = open("::alpha", O_RDWR | O_CREAT | O_TRUNC, 0644);
+        ASSERT_GT(fd, 0, "");
+        ASSERT_EQ(write(fd, out, len), (ssize_t)len, "");
+        ASSERT_EQ(lseek(fd, 0, SEEK_CUR), (off_t)len, "");
+        ASSERT_EQ(lseek(fd, 0, SEEK_SET), 0, "");
+
+        // Reading past the end returns only what is there, and
+        // leaves the seek offset at the end
+        memset(in, 0, max);
+        ASSERT_EQ(read(fd, in, max), (ssize_t)len, "");
+        ASSERT_EQ(memcmp(in, out, len), 0, "");
+        ASSERT_EQ(lseek(fd, 0, SEEK_CUR), (off_t)len, "");
+        ASSERT_EQ(read(fd, in, max), 0, "");
+        ASSERT_EQ(close(fd), 0, "");
+    }
+
+    ASSERT_EQ(unlink("::alpha"), 0, "");
+    free(out);
+    free(in);
+    END_TEST;
+}
+
+bool test_large_io_positional(void) {
+    BEGIN_TEST;
+
+    const size_t max = 1 << 20;
+    uint8_t* out = malloc(max);
+    uint8_t* in = malloc(max);
+    ASSERT_NONNULL(out, "");
+    ASSERT_NONNULL(in, "");
+    fill(out, max, 3);
+
+    int fd = open("::alpha", O_RDWR | O_CREAT, 0644);
+    ASSERT_GT(fd, 0, "");
+    ASSERT_EQ(pwrite(fd, out, max, 0), (ssize_t)max, "");
+    for (size_t i = 0; i < countof(kSizes); i++) {
+        // Unaligned offsets, and writes which overlap what came before
+        size_t len = kSizes[i] / 2;
+        off_t off = (off_t)(kSizes[i] / 3);
+        ASSERT_EQ(pwrite(fd, out + off, len, off), (ssize_t)len, "");
+        ASSERT_EQ(pread(fd, in, len, off), (ssize_t)len, "");
+        ASSERT_EQ(memcmp(in, out + off, len), 0, "");
+    }
+    // The seek offset is untouched by positional transfers
+    ASSERT_EQ(lseek(fd, 0, SEEK_CUR), 0, "");
+
+    struct stat st;
+    ASSERT_EQ(fstat(fd, &st), 0, "");
+    size_t size = (size_t)st.st_size;
+    ASSERT_EQ(size, max, "");
+    ASSERT_EQ(pread(fd, in, max, 1), (ssize_t)(size - 1), "");
+    ASSERT_EQ(memcmp(in, out + 1, size - 1), 0, "");
+    ASSERT_EQ(close(fd), 0, "");
+
+    // Large appends land at the end, whatever the seek offset
+    fd = open("::alpha", O_RDWR | O_APPEND, 0644);
+    ASSERT_GT(fd, 0, "");
+    ASSERT_EQ(lseek(fd, 0, SEEK_SET), 0, "");
+    ASSERT_EQ(write(fd, out, max / 2), (ssize_t)(max / 2), "");
+    ASSERT_EQ(lseek(fd, 0, SEEK_CUR), (off_t)(size + max / 2), "");
+    ASSERT_EQ(pread(fd, in, max / 2, size), (ssize_t)(max / 2), "");
+    ASSERT_EQ(memcmp(in, out, max / 2), 0, "");
+    ASSERT_EQ(close(fd), 0, "");
+
+    ASSERT_EQ(unlink("::alpha"), 0, "");
+    free(out);
+    free(in);
+    END_TEST;
+}
+
+RUN_FOR_ALL_FILESYSTEMS(large_io_tests,
+    RUN_TEST_MEDIUM(test_large_io_stream)
+    RUN_TEST_MEDIUM(test_large_io_positional)
+)
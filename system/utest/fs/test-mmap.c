@@ -0,0 +1,119 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "filesystems.h"
+#include "misc.h"
+
+#define MMAP_FILE_SIZE (64 * 1024)
+
+static bool make_file(const char* path, uint8_t* data, size_t len, int* out) {
+    BEGIN_HELPER;
+    for (size_t i = 0; i < len; i++) {
+        data[i] = (uint8_t) rand();
+    }
+    int fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+    ASSERT_GT(fd, 0, "");
+    ASSERT_EQ(write(fd, data, len), (ssize_t) len, "");
+    *out = fd;
+    END_HELPER;
+}
+
+bool test_mmap_shared_read(void) {
+    BEGIN_TEST;
+
+    if (!test_info->supports_mmap) {
+        return true;
+    }
+
+    static uint8_t data[MMAP_FILE_SIZE];
+    int fd;
+    ASSERT_TRUE(make_file("::alpha", data, sizeof(data), &fd), "");
+
+    void* addr = mmap(NULL, sizeof(data), PROT_READ, MAP_SHARED, fd, 0);
+    ASSERT_NEQ(addr, MAP_FAILED, "");
+    ASSERT_EQ(memcmp(addr, data, sizeof(data)), 0, "");
+
+    // Writes to the file show up in the mapping
+    const char* hello = "hello";
+    ASSERT_EQ(pwrite(fd, hello, strlen(hello), 5000), (ssize_t) strlen(hello), "");
+    ASSERT_EQ(memcmp((uint8_t*) addr + 5000, hello, strlen(hello)), 0, "");
+
+    ASSERT_EQ(munmap(addr, sizeof(data)), 0, "");
+    ASSERT_EQ(close(fd), 0, "");
+    ASSERT_EQ(unlink("::alpha"), 0, "");
+    END_TEST;
+}
+
+bool test_mmap_shared_write(void) {
+    BEGIN_TEST;
+
+    if (!test_info->supports_mmap) {
+        return true;
+    }
+
+    static uint8_t data[MMAP_FILE_SIZE];
+    int fd;
+    ASSERT_TRUE(make_file("::alpha", data, sizeof(data), &fd), "");
+
+    uint8_t* addr = mmap(NULL, sizeof(data), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ASSERT_NEQ((void*) addr, MAP_FAILED, "");
+
+    // Writes to the mapping show up in the file, and last once synced
+    for (size_t i = 0; i < sizeof(data); i += 3000) {
+        addr[i] = data[i] = (uint8_t) ~data[i];
+    }
+    ASSERT_EQ(fsync(fd), 0, "");
+    ASSERT_EQ(munmap(addr, sizeof(data)), 0, "");
+    ASSERT_EQ(close(fd), 0, "");
+
+    uint8_t buf[MMAP_FILE_SIZE];
+    fd = open("::alpha", O_RDONLY, 0644);
+    ASSERT_GT(fd, 0, "");
+    ASSERT_EQ(read(fd, buf, sizeof(buf)), (ssize_t) sizeof(buf), "");
+    ASSERT_EQ(memcmp(buf, data, sizeof(data)), 0, "");
+    ASSERT_EQ(close(fd), 0, "");
+    ASSERT_EQ(unlink("::alpha"), 0, "");
+    END_TEST;
+}
+
+bool test_mmap_private(void) {
+    BEGIN_TEST;
+
+    if (!test_info->supports_mmap) {
+        return true;
+    }
+
+    static uint8_t data[MMAP_FILE_SIZE];
+    int fd;
+    ASSERT_TRUE(make_file("::alpha", data, sizeof(data), &fd), "");
+
+    uint8_t* addr = mmap(NULL, sizeof(data), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ASSERT_NEQ((void*) addr, MAP_FAILED, "");
+    ASSERT_EQ(memcmp(addr, data, sizeof(data)), 0, "");
+
+    // Writes to a private mapping stay there
+    memset(addr, 0xee, 8192);
+    uint8_t buf[MMAP_FILE_SIZE];
+    ASSERT_EQ(pread(fd, buf, sizeof(buf), 0), (ssize_t) sizeof(buf), "");
+    ASSERT_EQ(memcmp(buf, data, sizeof(data)), 0, "");
+
+    ASSERT_EQ(munmap(addr, sizeof(data)), 0, "");
+    ASSERT_EQ(close(fd), 0, "");
+    ASSERT_EQ(unlink("::alpha"), 0, "");
+    END_TEST;
+}
+
+RUN_FOR_ALL_FILESYSTEMS(mmap_tests,
+    RUN_TEST_MEDIUM(test_mmap_shared_read)
+    RUN_TEST_MEDIUM(test_mmap_shared_write)
+    RUN_TEST_MEDIUM(test_mmap_private)
+)
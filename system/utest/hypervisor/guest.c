@@ -11,6 +11,10 @@
 
 static const uint64_t kVmoSize = 2 << 20;
 
+#if __x86_64__
+static const uint16_t kUartIoPort = 0x3f8;
+#endif // __x86_64__
+
 extern const char guest_start[];
 extern const char guest_end[];
 
@@ -24,6 +28,7 @@ typedef struct test {
     mx_handle_t guest_phys_mem;
     mx_handle_t guest_ctl_fifo;
     mx_handle_t guest;
+    uintptr_t guest_ip;
 
 #if __x86_64__
     mx_handle_t guest_apic_mem;
@@ -48,12 +53,12 @@ static bool setup(test_t *test, const char *start, const char *end) {
                            &test->guest_ctl_fifo, &test->guest), MX_OK, "");
 
     // Setup the guest.
-    uintptr_t guest_ip = 0;
-    ASSERT_EQ(guest_create_page_table(addr, kVmoSize, &guest_ip),
+    test->guest_ip = 0;
+    ASSERT_EQ(guest_create_page_table(addr, kVmoSize, &test->guest_ip),
               MX_OK, "");
 
 #if __x86_64__
-    memcpy((void*)(addr + guest_ip), start, end - start);
+    memcpy((void*)(addr + test->guest_ip), start, end - start);
     uintptr_t guest_cr3 = 0;
     ASSERT_EQ(mx_hypervisor_op(test->guest, MX_HYPERVISOR_OP_GUEST_SET_ENTRY_CR3,
                                &guest_cr3, sizeof(guest_cr3), NULL, 0),
@@ -67,7 +72,7 @@ static bool setup(test_t *test, const char *start, const char *end) {
 #endif // __x86_64__
 
     ASSERT_EQ(mx_hypervisor_op(test->guest, MX_HYPERVISOR_OP_GUEST_SET_ENTRY_IP,
-                               &guest_ip, sizeof(guest_ip), NULL, 0),
+                               &test->guest_ip, sizeof(test->guest_ip), NULL, 0),
               MX_OK, "");
 
     return true;
@@ -188,9 +193,141 @@ static bool guest_get_set_gpr(void) {
     END_TEST;
 }
 
+#if __x86_64__
+static bool guest_bell(void) {
+    BEGIN_TEST;
+
+    test_t test;
+    ASSERT_TRUE(setup(&test, guest_start, guest_end), "");
+    if (!test.supported) {
+        // The hypervisor isn't supported, so don't run the test.
+        return true;
+    }
+
+    mx_handle_t event;
+    ASSERT_EQ(mx_event_create(0, &event), MX_OK, "");
+    mx_guest_bell_t bell = {
+        .event = event,
+        .kind = MX_GUEST_BELL_PORT_OUT,
+        .addr = kUartIoPort,
+        .len = 1,
+    };
+    ASSERT_EQ(mx_hypervisor_op(test.guest, MX_HYPERVISOR_OP_GUEST_SET_BELL,
+                               &bell, sizeof(bell), NULL, 0),
+              MX_OK, "");
+
+    // Enter the guest.
+    ASSERT_EQ(mx_hypervisor_op(test.guest, MX_HYPERVISOR_OP_GUEST_ENTER,
+                               NULL, 0, NULL, 0),
+              MX_ERR_STOP, "");
+
+    // Both writes to the port rang the bell, and neither made a packet.
+    mx_signals_t observed;
+    ASSERT_EQ(mx_object_wait_one(event, MX_EVENT_SIGNALED, 0, &observed), MX_OK, "");
+    mx_guest_packet_t packet;
+    uint32_t num_packets;
+    ASSERT_EQ(mx_fifo_read(test.guest_ctl_fifo, &packet, sizeof(packet), &num_packets),
+              MX_ERR_SHOULD_WAIT, "");
+
+    ASSERT_EQ(mx_handle_close(event), MX_OK, "");
+    ASSERT_TRUE(teardown(&test), "");
+
+    END_TEST;
+}
+
+static bool guest_vcpu(void) {
+    BEGIN_TEST;
+
+    test_t test;
+    ASSERT_TRUE(setup(&test, guest_start, guest_end), "");
+    if (!test.supported) {
+        // The hypervisor isn't supported, so don't run the test.
+        return true;
+    }
+
+    mx_handle_t vcpu_ctl_fifo;
+    mx_handle_t vcpu;
+    mx_status_t status = guest_create_vcpu(test.guest, &vcpu_ctl_fifo, &vcpu);
+    if (status == MX_ERR_NO_RESOURCES) {
+        // There is only the one CPU, so there can only be the one VCPU.
+        ASSERT_TRUE(teardown(&test), "");
+        return true;
+    }
+    ASSERT_EQ(status, MX_OK, "");
+
+    // The second VCPU runs the same code as the first.
+    uintptr_t guest_cr3 = 0;
+    ASSERT_EQ(mx_hypervisor_op(vcpu, MX_HYPERVISOR_OP_GUEST_SET_ENTRY_CR3,
+                               &guest_cr3, sizeof(guest_cr3), NULL, 0),
+              MX_OK, "");
+    mx_handle_t vcpu_apic_mem;
+    ASSERT_EQ(mx_vmo_create(PAGE_SIZE, 0, &vcpu_apic_mem), MX_OK, "");
+    ASSERT_EQ(mx_hypervisor_op(vcpu, MX_HYPERVISOR_OP_GUEST_SET_APIC_MEM,
+                               &vcpu_apic_mem, sizeof(vcpu_apic_mem), NULL, 0),
+              MX_OK, "");
+    ASSERT_EQ(mx_hypervisor_op(vcpu, MX_HYPERVISOR_OP_GUEST_SET_ENTRY_IP,
+                               &test.guest_ip, sizeof(test.guest_ip), NULL, 0),
+              MX_OK, "");
+
+    // Enter the second VCPU.
+    ASSERT_EQ(mx_hypervisor_op(vcpu, MX_HYPERVISOR_OP_GUEST_ENTER, NULL, 0, NULL, 0),
+              MX_ERR_STOP, "");
+
+    // Its packets arrive on its own control FIFO.
+    mx_guest_packet_t packet[2];
+    uint32_t num_packets;
+    ASSERT_EQ(mx_fifo_read(vcpu_ctl_fifo, packet, sizeof(packet), &num_packets), MX_OK, "");
+    ASSERT_EQ(num_packets, 2u, "");
+    ASSERT_EQ(packet[0].port_out.data[0], 'm', "");
+    ASSERT_EQ(packet[1].port_out.data[0], 'x', "");
+    ASSERT_EQ(mx_fifo_read(test.guest_ctl_fifo, packet, sizeof(packet), &num_packets),
+              MX_ERR_SHOULD_WAIT, "");
+
+    ASSERT_EQ(mx_handle_close(vcpu_apic_mem), MX_OK, "");
+    ASSERT_EQ(mx_handle_close(vcpu), MX_OK, "");
+    ASSERT_EQ(mx_handle_close(vcpu_ctl_fifo), MX_OK, "");
+    ASSERT_TRUE(teardown(&test), "");
+
+    END_TEST;
+}
+
+static bool guest_exit_stats(void) {
+    BEGIN_TEST;
+
+    test_t test;
+    ASSERT_TRUE(setup(&test, guest_start, guest_end), "");
+    if (!test.supported) {
+        // The hypervisor isn't supported, so don't run the test.
+        return true;
+    }
+
+    ASSERT_EQ(mx_hypervisor_op(test.guest, MX_HYPERVISOR_OP_GUEST_ENTER,
+                               NULL, 0, NULL, 0),
+              MX_ERR_STOP, "");
+
+    // One exit for each port write, and one for the VMCALL that stops the
+    // guest.
+    mx_guest_exit_stats_t exit_stats;
+    ASSERT_EQ(mx_hypervisor_op(test.guest, MX_HYPERVISOR_OP_GUEST_GET_EXIT_STATS,
+                               NULL, 0, &exit_stats, sizeof(exit_stats)),
+              MX_OK, "");
+    ASSERT_EQ(exit_stats.exits[MX_GUEST_EXIT_IO].count, 2u, "");
+    ASSERT_GE(exit_stats.exits[MX_GUEST_EXIT_OTHER].count, 1u, "");
+
+    ASSERT_TRUE(teardown(&test), "");
+
+    END_TEST;
+}
+#endif // __x86_64__
+
 BEGIN_TEST_CASE(guest)
 RUN_TEST(guest_enter)
 RUN_TEST(guest_get_set_gpr)
+#if __x86_64__
+RUN_TEST(guest_bell)
+RUN_TEST(guest_vcpu)
+RUN_TEST(guest_exit_stats)
+#endif // __x86_64__
 END_TEST_CASE(guest)
 
 #ifndef BUILD_COMBINED_TESTS
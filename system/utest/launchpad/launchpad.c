@@ -69,8 +69,52 @@ static bool launchpad_test(void)
     END_TEST;
 }
 
+static bool launchpad_template_test(void)
+{
+    BEGIN_TEST;
+
+    launchpad_template_t* tmpl = NULL;
+    mx_status_t status = launchpad_template_create(
+        launchpad_vmo_from_file(program_path), MX_HANDLE_INVALID, &tmpl);
+    ASSERT_EQ(status, MX_OK, "launchpad_template_create");
+
+    mx_handle_t dynld_vmo = launchpad_vmo_from_file(dynld_path);
+    ASSERT_GT(dynld_vmo, 0, "launchpad_vmo_from_file");
+    elf_load_header_t header;
+    uintptr_t phoff;
+    status = elf_load_prepare(dynld_vmo, NULL, 0, &header, &phoff);
+    ASSERT_EQ(status, MX_OK, "elf_load_prepare");
+    mx_handle_close(dynld_vmo);
+
+    // Each launchpad gets a mapping of its own from the one template.
+    for (int i = 0; i < 2; ++i) {
+        launchpad_t* lp = NULL;
+        status = launchpad_create(MX_HANDLE_INVALID, test_inferior_child_name, &lp);
+        ASSERT_EQ(status, MX_OK, "launchpad_create");
+
+        status = launchpad_elf_load_template(lp, tmpl);
+        ASSERT_EQ(status, MX_OK, "launchpad_elf_load_template");
+        EXPECT_TRUE(launchpad_send_loader_message(lp, true),
+                    "PT_INTERP wants the loader message");
+
+        mx_vaddr_t base, entry;
+        status = launchpad_get_base_address(lp, &base);
+        ASSERT_EQ(status, MX_OK, "launchpad_get_base_address");
+        status = launchpad_get_entry_address(lp, &entry);
+        ASSERT_EQ(status, MX_OK, "launchpad_get_entry_address");
+        ASSERT_EQ(entry, base + header.e_entry, "bad value for base or entry");
+
+        launchpad_destroy(lp);
+    }
+
+    launchpad_template_destroy(tmpl);
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(launchpad_tests)
 RUN_TEST(launchpad_test);
+RUN_TEST(launchpad_template_test);
 END_TEST_CASE(launchpad_tests)
 
 int main(int argc, char **argv)
@@ -60,6 +60,52 @@ bool epoll_test(void) {
     END_TEST;
 }
 
+bool epoll_edge_test(void) {
+    BEGIN_TEST;
+
+    mx_handle_t h = MX_HANDLE_INVALID;
+    ASSERT_EQ(MX_OK, mx_event_create(0u, &h), "mx_event_create() failed");
+
+    int fd = mxio_handle_fd(h, MX_USER_SIGNAL_0, MX_USER_SIGNAL_1, false);
+    ASSERT_GT(fd, 0, "mxio_handle_fd() failed");
+
+    int epollfd = epoll_create(0);
+    ASSERT_GT(epollfd, 0, "epoll_create() failed");
+
+    struct epoll_event ev, events[1];
+    ev.events = EPOLLIN | EPOLLET;
+    ASSERT_EQ(0, epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &ev),
+              "epoll_ctl() failed");
+
+    ASSERT_EQ(MX_OK, mx_object_signal(h, 0u, MX_USER_SIGNAL_0),
+              "mx_object_signal() failed");
+
+    // An edge triggered fd is reported once per change.
+    EXPECT_EQ(epoll_wait(epollfd, events, 1, 0), 1, "");
+    EXPECT_EQ(events[0].events, (uint32_t)EPOLLIN, "");
+    EXPECT_EQ(epoll_wait(epollfd, events, 1, 0), 0, "");
+
+    ASSERT_EQ(MX_OK, mx_object_signal(h, MX_USER_SIGNAL_0, 0u),
+              "mx_object_signal() failed");
+    ASSERT_EQ(MX_OK, mx_object_signal(h, 0u, MX_USER_SIGNAL_0),
+              "mx_object_signal() failed");
+    EXPECT_EQ(epoll_wait(epollfd, events, 1, 0), 1, "");
+
+    // Nothing is reported once the fd is removed.
+    ASSERT_EQ(0, epoll_ctl(epollfd, EPOLL_CTL_DEL, fd, NULL),
+              "epoll_ctl() failed");
+    ASSERT_EQ(MX_OK, mx_object_signal(h, MX_USER_SIGNAL_0, 0u),
+              "mx_object_signal() failed");
+    ASSERT_EQ(MX_OK, mx_object_signal(h, 0u, MX_USER_SIGNAL_0),
+              "mx_object_signal() failed");
+    EXPECT_EQ(epoll_wait(epollfd, events, 1, 0), 0, "");
+
+    close(epollfd);
+    close(fd);
+
+    END_TEST;
+}
+
 bool close_test(void) {
     BEGIN_TEST;
 
@@ -130,6 +176,7 @@ bool pipe_test(void) {
 
 BEGIN_TEST_CASE(mxio_handle_fd_test)
 RUN_TEST(epoll_test);
+RUN_TEST(epoll_edge_test);
 RUN_TEST(close_test);
 RUN_TEST(pipe_test);
 END_TEST_CASE(mxio_handle_fd_test)
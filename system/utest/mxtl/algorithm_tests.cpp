@@ -171,6 +171,57 @@ bool lower_bound_compare_test() {
     END_TEST;
 }
 
+bool sort_test() {
+    BEGIN_TEST;
+
+    int* null = nullptr;
+    mxtl::sort(null, null);
+
+    // Enough of each pattern to get past the insertion sort and the
+    // median-of-three pivots.
+    constexpr int count = 1000;
+    int values[count];
+    for (int pattern = 0; pattern < 4; pattern++) {
+        uint32_t seed = 1;
+        for (int i = 0; i < count; i++) {
+            seed = seed * 1103515245 + 12345;
+            switch (pattern) {
+            case 0: values[i] = static_cast<int>(seed >> 8); break;
+            case 1: values[i] = i; break;
+            case 2: values[i] = count - i; break;
+            default: values[i] = (seed >> 16) % 3; break;
+            }
+        }
+        mxtl::sort(values, values + count);
+        for (int i = 1; i < count; i++) {
+            EXPECT_LE(values[i - 1], values[i], "not sorted");
+        }
+    }
+
+    END_TEST;
+}
+
+bool sort_compare_test() {
+    BEGIN_TEST;
+
+    constexpr size_t count = 100;
+    int values[count];
+    for (size_t i = 0; i < count; i++) {
+        values[i] = static_cast<int>((i * 37) % count);
+    }
+    LessThan lessThan;
+    mxtl::sort(values, values + count, lessThan);
+    for (size_t i = 0; i < count; i++) {
+        EXPECT_EQ(values[i], static_cast<int>(i), "");
+    }
+    mxtl::sort(values, values + count, [](int lhs, int rhs) { return lhs > rhs; });
+    for (size_t i = 0; i < count; i++) {
+        EXPECT_EQ(values[i], static_cast<int>(count - 1 - i), "");
+    }
+
+    END_TEST;
+}
+
 }  // namespace
 
 BEGIN_TEST_CASE(algorithm_tests)
@@ -185,4 +236,6 @@ RUN_NAMED_TEST("is_pow2<uint64_t>", is_pow2_test<uint64_t>)
 RUN_NAMED_TEST("is_pow2<size_t>",   is_pow2_test<size_t>)
 RUN_NAMED_TEST("lower_bound test", lower_bound_test)
 RUN_NAMED_TEST("lower_bound_compare test", lower_bound_compare_test)
+RUN_NAMED_TEST("sort test", sort_test)
+RUN_NAMED_TEST("sort_compare test", sort_compare_test)
 END_TEST_CASE(algorithm_tests);
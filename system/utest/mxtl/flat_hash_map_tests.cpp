@@ -0,0 +1,227 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <mxtl/flat_hash_map.h>
+
+#include <mxalloc/new.h>
+#include <mxtl/type_support.h>
+#include <mxtl/unique_ptr.h>
+#include <unittest/unittest.h>
+
+namespace {
+
+using Map = mxtl::FlatHashMap<uint32_t, uint32_t>;
+
+bool inline_test() {
+    BEGIN_TEST;
+
+    Map map;
+    EXPECT_TRUE(map.is_empty(), "");
+    EXPECT_TRUE(map.is_inline(), "");
+    EXPECT_EQ(8u, map.capacity(), "");
+
+    // Up to 3/4 of the inline slots are used before the map goes to the heap.
+    for (uint32_t i = 0; i < 6u; ++i)
+        ASSERT_TRUE(map.insert(i, i * 10u), "");
+    EXPECT_TRUE(map.is_inline(), "");
+    EXPECT_EQ(6u, map.size(), "");
+
+    for (uint32_t i = 0; i < 6u; ++i) {
+        uint32_t* value = map.find(i);
+        ASSERT_NONNULL(value, "");
+        EXPECT_EQ(i * 10u, *value, "");
+    }
+    EXPECT_NULL(map.find(6u), "");
+
+    ASSERT_TRUE(map.insert(6u, 60u), "");
+    EXPECT_FALSE(map.is_inline(), "");
+    EXPECT_EQ(16u, map.capacity(), "");
+    for (uint32_t i = 0; i < 7u; ++i) {
+        ASSERT_NONNULL(map.find(i), "");
+        EXPECT_EQ(i * 10u, *map.find(i), "");
+    }
+
+    map.reset();
+    EXPECT_TRUE(map.is_empty(), "");
+    EXPECT_TRUE(map.is_inline(), "");
+
+    END_TEST;
+}
+
+bool insert_or_find_test() {
+    BEGIN_TEST;
+
+    Map map;
+    uint32_t* found = nullptr;
+    EXPECT_TRUE(map.insert_or_find(1u, 100u, &found), "");
+    ASSERT_NONNULL(found, "");
+    EXPECT_EQ(100u, *found, "");
+
+    found = nullptr;
+    EXPECT_FALSE(map.insert_or_find(1u, 200u, &found), "");
+    ASSERT_NONNULL(found, "");
+    EXPECT_EQ(100u, *found, "");
+    EXPECT_EQ(1u, map.size(), "");
+
+    *found = 300u;
+    EXPECT_EQ(300u, *map.find(1u), "");
+
+    END_TEST;
+}
+
+// Insert and erase a few thousand keys in an order which produces plenty of
+// collisions, checking the contents of the map against a plain array as we
+// go.
+bool erase_test() {
+    BEGIN_TEST;
+
+    constexpr uint32_t kKeys = 4096u;
+    static bool present[kKeys];
+    for (uint32_t i = 0; i < kKeys; ++i)
+        present[i] = false;
+
+    Map map;
+    uint32_t state = 1u;
+    for (uint32_t pass = 0; pass < 8u * kKeys; ++pass) {
+        state = state * 1664525u + 1013904223u;
+        uint32_t key = (state >> 8) % kKeys;
+
+        if (present[key]) {
+            uint32_t value = 0u;
+            ASSERT_TRUE(map.erase(key, &value), "");
+            EXPECT_EQ(key + 1u, value, "");
+            present[key] = false;
+        } else {
+            ASSERT_TRUE(map.insert(key, key + 1u), "");
+            present[key] = true;
+        }
+
+        if ((pass % 1024u) == 0u) {
+            size_t count = 0;
+            for (uint32_t i = 0; i < kKeys; ++i) {
+                const uint32_t* value = map.find(i);
+                EXPECT_EQ(present[i], value != nullptr, "");
+                if (value) {
+                    EXPECT_EQ(i + 1u, *value, "");
+                    ++count;
+                }
+            }
+            EXPECT_EQ(count, map.size(), "");
+        }
+    }
+
+    EXPECT_FALSE(map.erase(kKeys), "");
+
+    END_TEST;
+}
+
+bool iterate_test() {
+    BEGIN_TEST;
+
+    Map map;
+    for (uint32_t i = 0; i < 100u; ++i)
+        ASSERT_TRUE(map.insert(i * 3u, i), "");
+
+    static bool seen[100];
+    for (uint32_t i = 0; i < 100u; ++i)
+        seen[i] = false;
+
+    size_t count = 0;
+    for (auto& entry : map) {
+        ASSERT_EQ(entry.key, entry.value * 3u, "");
+        ASSERT_LT(entry.value, 100u, "");
+        EXPECT_FALSE(seen[entry.value], "");
+        seen[entry.value] = true;
+        entry.value += 1000u;
+        ++count;
+    }
+    EXPECT_EQ(100u, count, "");
+
+    const Map& const_map = map;
+    for (const auto& entry : const_map)
+        EXPECT_LE(1000u, entry.value, "");
+
+    map.clear();
+    EXPECT_TRUE(map.begin() == map.end(), "");
+
+    END_TEST;
+}
+
+struct Tracked {
+    explicit Tracked(int value) : value(value) { ++live_count; }
+    ~Tracked() { --live_count; }
+
+    int value;
+    static int live_count;
+};
+
+int Tracked::live_count = 0;
+
+bool move_only_test() {
+    BEGIN_TEST;
+
+    using PtrMap = mxtl::FlatHashMap<int*, mxtl::unique_ptr<Tracked>, 4u>;
+
+    static int keys[64];
+    Tracked::live_count = 0;
+    {
+        PtrMap map;
+        for (int i = 0; i < 64; ++i) {
+            AllocChecker ac;
+            mxtl::unique_ptr<Tracked> tracked(new (&ac) Tracked(i));
+            ASSERT_TRUE(ac.check(), "");
+            ASSERT_TRUE(map.insert(&keys[i], mxtl::move(tracked)), "");
+        }
+        EXPECT_EQ(64, Tracked::live_count, "");
+
+        // A collision leaves the value with the caller.
+        AllocChecker ac;
+        mxtl::unique_ptr<Tracked> extra(new (&ac) Tracked(100));
+        ASSERT_TRUE(ac.check(), "");
+        EXPECT_FALSE(map.insert_or_find(&keys[0], mxtl::move(extra)), "");
+        ASSERT_TRUE(extra != nullptr, "");
+        EXPECT_EQ(100, extra->value, "");
+
+        mxtl::unique_ptr<Tracked> taken;
+        ASSERT_TRUE(map.erase(&keys[10], &taken), "");
+        ASSERT_TRUE(taken != nullptr, "");
+        EXPECT_EQ(10, taken->value, "");
+
+        // Moving a map which has gone to the heap hands its storage over.
+        PtrMap moved(mxtl::move(map));
+        EXPECT_TRUE(map.is_empty(), "");
+        EXPECT_TRUE(map.is_inline(), "");
+        EXPECT_EQ(63u, moved.size(), "");
+        for (int i = 0; i < 64; ++i) {
+            mxtl::unique_ptr<Tracked>* value = moved.find(&keys[i]);
+            EXPECT_EQ(i != 10, value != nullptr, "");
+            if (value)
+                EXPECT_EQ(i, (*value)->value, "");
+        }
+
+        // So does moving one which is still inline.
+        PtrMap small;
+        ASSERT_TRUE(small.insert(&keys[0], mxtl::move(extra)), "");
+        PtrMap small_moved;
+        small_moved = mxtl::move(small);
+        EXPECT_TRUE(small.is_empty(), "");
+        ASSERT_NONNULL(small_moved.find(&keys[0]), "");
+        EXPECT_EQ(100, (*small_moved.find(&keys[0]))->value, "");
+
+        EXPECT_EQ(65, Tracked::live_count, "");
+    }
+    EXPECT_EQ(0, Tracked::live_count, "");
+
+    END_TEST;
+}
+
+}  // namespace
+
+BEGIN_TEST_CASE(flat_hash_map_tests)
+RUN_NAMED_TEST("inline test", inline_test)
+RUN_NAMED_TEST("insert or find test", insert_or_find_test)
+RUN_NAMED_TEST("erase test", erase_test)
+RUN_NAMED_TEST("iterate test", iterate_test)
+RUN_NAMED_TEST("move only test", move_only_test)
+END_TEST_CASE(flat_hash_map_tests);
@@ -5,6 +5,7 @@
 #pragma once
 
 #include <mxalloc/new.h>
+#include <mxtl/intrusive_hash_table.h>
 #include <mxtl/ref_counted.h>
 #include <mxtl/ref_ptr.h>
 #include <mxtl/unique_ptr.h>
@@ -52,8 +53,9 @@ public:
 
     static HashType GetHash(const KeyType& key) {
         // Our simple hash function just multiplies by a big prime and mods by
-        // the number of buckets.
-        return (static_cast<HashType>(key) * 0xcf2fd713) % kNumBuckets;
+        // the number of buckets (if the table has a fixed number of them).
+        return ::mxtl::internal::DefaultHashReducer<HashType, kNumBuckets>::Reduce(
+                static_cast<HashType>(key) * 0xcf2fd713);
     }
 };
 
@@ -0,0 +1,200 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <mxtl/inline_vector.h>
+
+#include <mxtl/macros.h>
+#include <mxtl/type_support.h>
+#include <unittest/unittest.h>
+
+namespace {
+
+// A move-only element which counts how many of its kind are alive.
+class Counted {
+public:
+    explicit Counted(int value) : value_(value) { ++live_count; }
+    Counted(Counted&& other) : value_(other.value_) {
+        other.value_ = -1;
+        ++live_count;
+    }
+    Counted& operator=(Counted&& other) {
+        value_ = other.value_;
+        other.value_ = -1;
+        return *this;
+    }
+    ~Counted() { --live_count; }
+
+    DISALLOW_COPY_AND_ASSIGN_ALLOW_MOVE(Counted);
+
+    int value() const { return value_; }
+
+    static int live_count;
+
+private:
+    int value_;
+};
+
+int Counted::live_count = 0;
+
+using Vector = mxtl::InlineVector<Counted, 4u>;
+
+bool check_values(const Vector& vector, int first, size_t count) {
+    BEGIN_HELPER;
+
+    ASSERT_EQ(count, vector.size(), "");
+    for (size_t i = 0; i < count; ++i)
+        EXPECT_EQ(first + static_cast<int>(i), vector[i].value(), "");
+
+    END_HELPER;
+}
+
+bool inline_test() {
+    BEGIN_TEST;
+
+    Counted::live_count = 0;
+    {
+        Vector vector;
+        EXPECT_TRUE(vector.is_empty(), "");
+        EXPECT_TRUE(vector.is_inline(), "");
+        EXPECT_EQ(4u, vector.capacity(), "");
+
+        for (int i = 0; i < 4; ++i)
+            ASSERT_TRUE(vector.push_back(Counted(i)), "");
+
+        EXPECT_TRUE(vector.is_inline(), "");
+        EXPECT_TRUE(check_values(vector, 0, 4u), "");
+        EXPECT_EQ(4, Counted::live_count, "");
+
+        // The storage is the vector itself.
+        EXPECT_TRUE(static_cast<void*>(vector.get()) >= static_cast<void*>(&vector), "");
+        EXPECT_TRUE(static_cast<void*>(vector.end()) <= static_cast<void*>(&vector + 1), "");
+
+        vector.pop_back();
+        EXPECT_EQ(3, Counted::live_count, "");
+        EXPECT_EQ(2, vector.back().value(), "");
+    }
+    EXPECT_EQ(0, Counted::live_count, "");
+
+    END_TEST;
+}
+
+bool grow_test() {
+    BEGIN_TEST;
+
+    Counted::live_count = 0;
+    {
+        Vector vector;
+        for (int i = 0; i < 100; ++i)
+            ASSERT_TRUE(vector.emplace_back(i), "");
+
+        EXPECT_FALSE(vector.is_inline(), "");
+        EXPECT_LE(100u, vector.capacity(), "");
+        EXPECT_TRUE(check_values(vector, 0, 100u), "");
+        EXPECT_EQ(100, Counted::live_count, "");
+
+        // Clearing keeps the storage, resetting gives it back.
+        vector.clear();
+        EXPECT_EQ(0, Counted::live_count, "");
+        EXPECT_FALSE(vector.is_inline(), "");
+
+        ASSERT_TRUE(vector.emplace_back(7), "");
+        vector.reset();
+        EXPECT_TRUE(vector.is_inline(), "");
+        EXPECT_TRUE(vector.is_empty(), "");
+        EXPECT_EQ(0, Counted::live_count, "");
+
+        ASSERT_TRUE(vector.reserve(10u), "");
+        EXPECT_FALSE(vector.is_inline(), "");
+        EXPECT_EQ(10u, vector.capacity(), "");
+    }
+    EXPECT_EQ(0, Counted::live_count, "");
+
+    END_TEST;
+}
+
+bool push_back_self_test() {
+    BEGIN_TEST;
+
+    // Pushing a copy of an element has to work even when the push makes the
+    // vector grow.
+    mxtl::InlineVector<int, 2u> vector;
+    ASSERT_TRUE(vector.push_back(5), "");
+    ASSERT_TRUE(vector.push_back(6), "");
+    ASSERT_TRUE(vector.push_back(vector[0]), "");
+    ASSERT_TRUE(vector.push_back(vector[2]), "");
+
+    ASSERT_EQ(4u, vector.size(), "");
+    EXPECT_EQ(5, vector[2], "");
+    EXPECT_EQ(5, vector[3], "");
+
+    END_TEST;
+}
+
+bool erase_test() {
+    BEGIN_TEST;
+
+    Counted::live_count = 0;
+    {
+        Vector vector;
+        for (int i = 0; i < 6; ++i)
+            ASSERT_TRUE(vector.emplace_back(i), "");
+
+        vector.erase(0u);
+        EXPECT_TRUE(check_values(vector, 1, 5u), "");
+        vector.erase(4u);
+        EXPECT_TRUE(check_values(vector, 1, 4u), "");
+        vector.erase(1u);
+        ASSERT_EQ(3u, vector.size(), "");
+        EXPECT_EQ(1, vector[0].value(), "");
+        EXPECT_EQ(3, vector[1].value(), "");
+        EXPECT_EQ(4, vector[2].value(), "");
+        EXPECT_EQ(3, Counted::live_count, "");
+    }
+    EXPECT_EQ(0, Counted::live_count, "");
+
+    END_TEST;
+}
+
+bool move_test() {
+    BEGIN_TEST;
+
+    Counted::live_count = 0;
+    for (size_t count = 0; count <= 8u; ++count) {
+        Vector vector;
+        for (size_t i = 0; i < count; ++i)
+            ASSERT_TRUE(vector.emplace_back(static_cast<int>(i)), "");
+        bool was_inline = vector.is_inline();
+        const Counted* elements = vector.get();
+
+        Vector moved(mxtl::move(vector));
+        EXPECT_TRUE(vector.is_empty(), "");
+        EXPECT_TRUE(vector.is_inline(), "");
+        EXPECT_TRUE(check_values(moved, 0, count), "");
+
+        // Heap storage changes hands rather than being copied.
+        EXPECT_EQ(was_inline, moved.is_inline(), "");
+        if (!was_inline)
+            EXPECT_EQ(elements, moved.get(), "");
+
+        Vector assigned;
+        ASSERT_TRUE(assigned.emplace_back(100), "");
+        assigned = mxtl::move(moved);
+        EXPECT_TRUE(moved.is_empty(), "");
+        EXPECT_TRUE(check_values(assigned, 0, count), "");
+        EXPECT_EQ(static_cast<int>(count), Counted::live_count, "");
+    }
+    EXPECT_EQ(0, Counted::live_count, "");
+
+    END_TEST;
+}
+
+}  // namespace
+
+BEGIN_TEST_CASE(inline_vector_tests)
+RUN_NAMED_TEST("inline test", inline_test)
+RUN_NAMED_TEST("grow test", grow_test)
+RUN_NAMED_TEST("push_back self test", push_back_self_test)
+RUN_NAMED_TEST("erase test", erase_test)
+RUN_NAMED_TEST("move test", move_test)
+END_TEST_CASE(inline_vector_tests);
@@ -0,0 +1,265 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <unittest/unittest.h>
+#include <mxtl/algorithm.h>
+#include <mxtl/intrusive_double_list.h>
+#include <mxtl/intrusive_hash_table.h>
+#include <mxtl/tests/intrusive_containers/associative_container_test_environment.h>
+#include <mxtl/tests/intrusive_containers/intrusive_hash_table_checker.h>
+#include <mxtl/tests/intrusive_containers/test_thunks.h>
+
+namespace mxtl {
+namespace tests {
+namespace intrusive_containers {
+
+using OtherKeyType  = uint16_t;
+using OtherHashType = uint32_t;
+static constexpr OtherHashType kOtherNumBuckets = 23;
+
+template <typename PtrType>
+struct OtherHashTraits {
+    using ObjType = typename ::mxtl::internal::ContainerPtrTraits<PtrType>::ValueType;
+    using BucketStateType = DoublyLinkedListNodeState<PtrType>;
+
+    // Linked List Traits
+    static BucketStateType& node_state(ObjType& obj) {
+        return obj.other_container_state_.bucket_state_;
+    }
+
+    // Keyed Object Traits
+    static OtherKeyType GetKey(const ObjType& obj) {
+        return obj.other_container_state_.key_;
+    }
+
+    static bool LessThan(const OtherKeyType& key1, const OtherKeyType& key2) {
+        return key1 <  key2;
+    }
+
+    static bool EqualTo(const OtherKeyType& key1, const OtherKeyType& key2) {
+        return key1 == key2;
+    }
+
+    // Hash Traits
+    static OtherHashType GetHash(const OtherKeyType& key) {
+        return static_cast<OtherHashType>((key * 0xaee58187) % kOtherNumBuckets);
+    }
+
+    // Set key is a trait which is only used by the tests, not by the containers
+    // themselves.
+    static void SetKey(ObjType& obj, OtherKeyType key) {
+        obj.other_container_state_.key_ = key;
+    }
+};
+
+template <typename PtrType>
+struct OtherHashState {
+private:
+    friend struct OtherHashTraits<PtrType>;
+    OtherKeyType key_;
+    typename OtherHashTraits<PtrType>::BucketStateType bucket_state_;
+};
+
+template <typename PtrType>
+class HTDYNTraits {
+public:
+    using ObjType = typename ::mxtl::internal::ContainerPtrTraits<PtrType>::ValueType;
+
+    using ContainerType           = HashTable<size_t,
+                                              PtrType,
+                                              DoublyLinkedList<PtrType>,
+                                              size_t,
+                                              kDynamicHashTableBuckets>;
+    using ContainableBaseClass    = DoublyLinkedListable<PtrType>;
+    using ContainerStateType      = DoublyLinkedListNodeState<PtrType>;
+    using KeyType                 = typename ContainerType::KeyType;
+    using HashType                = typename ContainerType::HashType;
+
+    using OtherContainerTraits    = OtherHashTraits<PtrType>;
+    using OtherContainerStateType = OtherHashState<PtrType>;
+    using OtherBucketType         = DoublyLinkedList<PtrType, OtherContainerTraits>;
+    using OtherContainerType      = HashTable<OtherKeyType,
+                                              PtrType,
+                                              OtherBucketType,
+                                              OtherHashType,
+                                              kOtherNumBuckets,
+                                              OtherContainerTraits,
+                                              OtherContainerTraits>;
+
+    using TestObjBaseType  = HashedTestObjBase<typename ContainerType::KeyType,
+                                               typename ContainerType::HashType,
+                                               ContainerType::kNumBuckets>;
+};
+
+DEFINE_TEST_OBJECTS(HTDYN);
+
+// Fill a dynamic table well past its initial size, checking that it grows a
+// bucket at a time and keeps finding everything in it.
+static bool GrowTest() {
+    BEGIN_TEST;
+
+    using ObjType       = UnmanagedHTDYNTestObj;
+    using ContainerType = HTDYNTraits<ObjType*>::ContainerType;
+    using CheckerType   = ContainerType::CheckerType;
+    static constexpr size_t kObjCount = 1000;
+
+    ContainerType container;
+    const size_t initial_buckets = container.bucket_count();
+    ObjType* objs[kObjCount];
+
+    for (size_t i = 0; i < kObjCount; ++i) {
+        AllocChecker ac;
+        objs[i] = new (&ac) ObjType(i);
+        ASSERT_TRUE(ac.check(), "");
+
+        size_t buckets = container.bucket_count();
+        container.insert(objs[i]);
+        EXPECT_LE(container.bucket_count(), buckets + 1, "");
+        EXPECT_LE(container.bucket_count(), mxtl::max(initial_buckets, container.size()), "");
+    }
+
+    EXPECT_EQ(kObjCount, container.size(), "");
+    EXPECT_EQ(kObjCount, container.bucket_count(), "");
+    EXPECT_TRUE(CheckerType::SanityCheck(container), "");
+
+    for (size_t i = 0; i < kObjCount; ++i) {
+        auto iter = container.find(i);
+        ASSERT_TRUE(iter.IsValid(), "");
+        EXPECT_EQ(objs[i], &(*iter), "");
+    }
+
+    size_t visited = 0;
+    for (auto& obj : container) {
+        EXPECT_EQ(objs[obj.value()], &obj, "");
+        ++visited;
+    }
+    EXPECT_EQ(kObjCount, visited, "");
+
+    // Erasing leaves the buckets alone.
+    for (size_t i = 0; i < kObjCount; i += 2)
+        delete container.erase(i);
+    EXPECT_EQ(kObjCount / 2, container.size(), "");
+    EXPECT_EQ(kObjCount, container.bucket_count(), "");
+    EXPECT_TRUE(CheckerType::SanityCheck(container), "");
+
+    while (!container.is_empty())
+        delete container.erase(container.begin());
+
+    END_TEST;
+}
+
+using UMTE = DEFINE_TEST_THUNK(Associative, HTDYN, Unmanaged);
+using UPTE = DEFINE_TEST_THUNK(Associative, HTDYN, UniquePtr);
+using RPTE = DEFINE_TEST_THUNK(Associative, HTDYN, RefPtr);
+
+BEGIN_TEST_CASE(hashtable_dynamic_tests)
+//////////////////////////////////////////
+// General container specific tests.
+//////////////////////////////////////////
+RUN_NAMED_TEST("Clear (unmanaged)",            UMTE::ClearTest)
+RUN_NAMED_TEST("Clear (unique)",               UPTE::ClearTest)
+RUN_NAMED_TEST("Clear (RefPtr)",               RPTE::ClearTest)
+
+RUN_NAMED_TEST("ClearUnsafe (unmanaged)",      UMTE::ClearUnsafeTest)
+#if TEST_WILL_NOT_COMPILE || 0
+RUN_NAMED_TEST("ClearUnsafe (unique)",         UPTE::ClearUnsafeTest)
+RUN_NAMED_TEST("ClearUnsafe (RefPtr)",         RPTE::ClearUnsafeTest)
+#endif
+
+RUN_NAMED_TEST("IsEmpty (unmanaged)",          UMTE::IsEmptyTest)
+RUN_NAMED_TEST("IsEmpty (unique)",             UPTE::IsEmptyTest)
+RUN_NAMED_TEST("IsEmpty (RefPtr)",             RPTE::IsEmptyTest)
+
+RUN_NAMED_TEST("Iterate (unmanaged)",          UMTE::IterateTest)
+RUN_NAMED_TEST("Iterate (unique)",             UPTE::IterateTest)
+RUN_NAMED_TEST("Iterate (RefPtr)",             RPTE::IterateTest)
+
+RUN_NAMED_TEST("IterErase (unmanaged)",        UMTE::IterEraseTest)
+RUN_NAMED_TEST("IterErase (unique)",           UPTE::IterEraseTest)
+RUN_NAMED_TEST("IterErase (RefPtr)",           RPTE::IterEraseTest)
+
+RUN_NAMED_TEST("DirectErase (unmanaged)",      UMTE::DirectEraseTest)
+#if TEST_WILL_NOT_COMPILE || 0
+RUN_NAMED_TEST("DirectErase (unique)",         UPTE::DirectEraseTest)
+#endif
+RUN_NAMED_TEST("DirectErase (RefPtr)",         RPTE::DirectEraseTest)
+
+RUN_NAMED_TEST("MakeIterator (unmanaged)",     UMTE::MakeIteratorTest)
+#if TEST_WILL_NOT_COMPILE || 0
+RUN_NAMED_TEST("MakeIterator (unique)",        UPTE::MakeIteratorTest)
+#endif
+RUN_NAMED_TEST("MakeIterator (RefPtr)",        RPTE::MakeIteratorTest)
+
+RUN_NAMED_TEST("ReverseIterErase (unmanaged)", UMTE::ReverseIterEraseTest)
+RUN_NAMED_TEST("ReverseIterErase (unique)",    UPTE::ReverseIterEraseTest)
+RUN_NAMED_TEST("ReverseIterErase (RefPtr)",    RPTE::ReverseIterEraseTest)
+
+RUN_NAMED_TEST("ReverseIterate (unmanaged)",   UMTE::ReverseIterateTest)
+RUN_NAMED_TEST("ReverseIterate (unique)",      UPTE::ReverseIterateTest)
+RUN_NAMED_TEST("ReverseIterate (RefPtr)",      RPTE::ReverseIterateTest)
+
+// Hash tables do not support swapping or Rvalue operations (Assignment or
+// construction) as doing so would be an O(n) operation (With 'n' == to the
+// number of buckets in the hashtable)
+#if TEST_WILL_NOT_COMPILE || 0
+RUN_NAMED_TEST("Swap (unmanaged)",             UMTE::SwapTest)
+RUN_NAMED_TEST("Swap (unique)",                UPTE::SwapTest)
+RUN_NAMED_TEST("Swap (RefPtr)",                RPTE::SwapTest)
+
+RUN_NAMED_TEST("Rvalue Ops (unmanaged)",       UMTE::RvalueOpsTest)
+RUN_NAMED_TEST("Rvalue Ops (unique)",          UPTE::RvalueOpsTest)
+RUN_NAMED_TEST("Rvalue Ops (RefPtr)",          RPTE::RvalueOpsTest)
+#endif
+
+RUN_NAMED_TEST("Scope (unique)",               UPTE::ScopeTest)
+RUN_NAMED_TEST("Scope (RefPtr)",               RPTE::ScopeTest)
+
+RUN_NAMED_TEST("TwoContainer (unmanaged)",     UMTE::TwoContainerTest)
+#if TEST_WILL_NOT_COMPILE || 0
+RUN_NAMED_TEST("TwoContainer (unique)",        UPTE::TwoContainerTest)
+#endif
+RUN_NAMED_TEST("TwoContainer (RefPtr)",        RPTE::TwoContainerTest)
+
+RUN_NAMED_TEST("IterCopyPointer (unmanaged)",  UMTE::IterCopyPointerTest)
+#if TEST_WILL_NOT_COMPILE || 0
+RUN_NAMED_TEST("IterCopyPointer (unique)",     UPTE::IterCopyPointerTest)
+#endif
+RUN_NAMED_TEST("IterCopyPointer (RefPtr)",     RPTE::IterCopyPointerTest)
+
+RUN_NAMED_TEST("EraseIf (unmanaged)",          UMTE::EraseIfTest)
+RUN_NAMED_TEST("EraseIf (unique)",             UPTE::EraseIfTest)
+RUN_NAMED_TEST("EraseIf (RefPtr)",             RPTE::EraseIfTest)
+
+RUN_NAMED_TEST("FindIf (unmanaged)",           UMTE::FindIfTest)
+RUN_NAMED_TEST("FindIf (unique)",              UPTE::FindIfTest)
+RUN_NAMED_TEST("FindIf (RefPtr)",              RPTE::FindIfTest)
+
+//////////////////////////////////////////
+// Associative container specific tests.
+//////////////////////////////////////////
+RUN_NAMED_TEST("InsertByKey (unmanaged)",      UMTE::InsertByKeyTest)
+RUN_NAMED_TEST("InsertByKey (unique)",         UPTE::InsertByKeyTest)
+RUN_NAMED_TEST("InsertByKey (RefPtr)",         RPTE::InsertByKeyTest)
+
+RUN_NAMED_TEST("FindByKey (unmanaged)",        UMTE::FindByKeyTest)
+RUN_NAMED_TEST("FindByKey (unique)",           UPTE::FindByKeyTest)
+RUN_NAMED_TEST("FindByKey (RefPtr)",           RPTE::FindByKeyTest)
+
+RUN_NAMED_TEST("EraseByKey (unmanaged)",       UMTE::EraseByKeyTest)
+RUN_NAMED_TEST("EraseByKey (unique)",          UPTE::EraseByKeyTest)
+RUN_NAMED_TEST("EraseByKey (RefPtr)",          RPTE::EraseByKeyTest)
+
+RUN_NAMED_TEST("InsertOrFind (unmanaged)",     UMTE::InsertOrFindTest)
+RUN_NAMED_TEST("InsertOrFind (unique)",        UPTE::InsertOrFindTest)
+RUN_NAMED_TEST("InsertOrFind (RefPtr)",        RPTE::InsertOrFindTest)
+
+//////////////////////////////////////////
+// Dynamic hash table specific tests.
+//////////////////////////////////////////
+RUN_NAMED_TEST("Grow (unmanaged)",             GrowTest)
+END_TEST_CASE(hashtable_dynamic_tests);
+
+}  // namespace intrusive_containers
+}  // namespace tests
+}  // namespace mxtl
@@ -138,6 +138,9 @@ public:
     static void RecordEraseRotation()           { ++op_counts_.erase_rotations_; }
     static void RecordEraseDoubleRotation()     { ++op_counts_.erase_double_rotations_; }
 
+    template <typename TreeType>
+    static void RecordSubtreeChanged(typename TreeType::RawPtrType node) { }
+
     template <typename TreeType>
     static bool VerifyRankRule(const TreeType& tree, typename TreeType::RawPtrType node) {
         BEGIN_TEST;
@@ -421,6 +424,116 @@ static bool WAVLBalanceTest() {
     END_TEST;
 }
 
+// Check that every element of |tree| has a key in [lo, hi), that the keys
+// ascend one step at a time from lo, and that the tree passes a full sanity
+// check.
+static bool CheckBulkTestRange(BalanceTestTree& tree,
+                               BalanceTestKeyType lo,
+                               BalanceTestKeyType hi) {
+    BEGIN_TEST;
+
+    ASSERT_TRUE(WAVLTreeChecker::SanityCheck(tree), "");
+    ASSERT_EQ(hi - lo, tree.size(), "");
+
+    BalanceTestKeyType expected = lo;
+    for (const auto& obj : tree) {
+        ASSERT_EQ(expected, obj.GetKey(), "");
+        ++expected;
+    }
+    EXPECT_EQ(hi, expected, "");
+
+    END_TEST;
+}
+
+static bool WAVLBulkOpsTest() {
+    BEGIN_TEST;
+
+    // See WAVLBalanceTest for the reasoning behind the order of declaration.
+    unique_ptr<BalanceTestObj[]> objects;
+    BalanceTestTree tree;
+    BalanceTestTree upper;
+    BalanceTestTree removed;
+
+    {
+        AllocChecker ac;
+        objects.reset(new (&ac) BalanceTestObj[kBalanceTestSize]);
+        ASSERT_TRUE(ac.check(), "Failed to allocate test objects!");
+    }
+
+    for (size_t i = 0; i < kBalanceTestSize; ++i)
+        objects[i].Init(i);
+
+    WAVLBalanceTestObserver::ResetObserverOpCounts();
+
+    // Build trees of every size up to a few levels deep from sorted input, then
+    // build one with all of the objects.
+    for (size_t count = 0; count <= 64; ++count) {
+        size_t next = 0;
+        tree.build_sorted(count, [&]() { return BalanceTestObjPtr(&objects[next++]); });
+        ASSERT_EQ(count, next, "");
+        ASSERT_TRUE(CheckBulkTestRange(tree, 0, count), "");
+        tree.clear();
+    }
+
+    size_t next = 0;
+    tree.build_sorted(kBalanceTestSize, [&]() { return BalanceTestObjPtr(&objects[next++]); });
+    ASSERT_TRUE(CheckBulkTestRange(tree, 0, kBalanceTestSize), "");
+
+    Lfsr<BalanceTestKeyType> rng(0x6c3b1a2f9d05e471u);
+    for (size_t pass = 0; pass < 256; ++pass) {
+        BalanceTestKeyType a = rng.GetNext() % (kBalanceTestSize + 1);
+        BalanceTestKeyType b = rng.GetNext() % (kBalanceTestSize + 1);
+        if (a > b) {
+            BalanceTestKeyType tmp = a;
+            a = b;
+            b = tmp;
+        }
+
+        // Split the tree in two and join it back together, alternating which
+        // of the two trees the elements end up in.
+        tree.split(a, &upper);
+        ASSERT_TRUE(CheckBulkTestRange(tree, 0, a), "");
+        ASSERT_TRUE(CheckBulkTestRange(upper, a, kBalanceTestSize), "");
+
+        if (pass & 1) {
+            tree.join(upper);
+        } else {
+            upper.join(tree);
+            tree.swap(upper);
+        }
+        ASSERT_TRUE(upper.is_empty(), "");
+        ASSERT_TRUE(CheckBulkTestRange(tree, 0, kBalanceTestSize), "");
+
+        // Cut [a, b) out of the tree, then put it back by splitting the tree at
+        // a and joining all three pieces.
+        size_t erased = tree.erase_range(tree.lower_bound(a), tree.lower_bound(b), &removed);
+        ASSERT_EQ(b - a, erased, "");
+        ASSERT_TRUE(CheckBulkTestRange(removed, a, b), "");
+        ASSERT_TRUE(WAVLTreeChecker::SanityCheck(tree), "");
+        ASSERT_EQ(kBalanceTestSize - erased, tree.size(), "");
+        for (const auto& obj : tree)
+            ASSERT_TRUE((obj.GetKey() < a) || (obj.GetKey() >= b), "");
+
+        tree.split(a, &upper);
+        tree.join(removed);
+        tree.join(upper);
+        ASSERT_TRUE(removed.is_empty(), "");
+        ASSERT_TRUE(upper.is_empty(), "");
+        ASSERT_TRUE(CheckBulkTestRange(tree, 0, kBalanceTestSize), "");
+    }
+
+    // Erase everything after the first element without keeping it, then the
+    // rest of the tree.
+    EXPECT_EQ(kBalanceTestSize - 1, tree.erase_range(++tree.begin(), tree.end()), "");
+    ASSERT_TRUE(CheckBulkTestRange(tree, 0, 1), "");
+    EXPECT_EQ(1u, tree.erase_range(tree.begin(), tree.end()), "");
+    ASSERT_TRUE(tree.is_empty(), "");
+    for (size_t i = 0; i < kBalanceTestSize; ++i)
+        EXPECT_FALSE(objects[i].InContainer(), "");
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(wavl_tree_tests)
 //////////////////////////////////////////
 // General container specific tests.
@@ -540,6 +653,7 @@ RUN_NAMED_TEST("LowerBound (RefPtr)",            RPTE::LowerBoundTest)
 // WAVLTree specific tests.
 ////////////////////////////
 RUN_NAMED_TEST("BalanceTest", WAVLBalanceTest)
+RUN_NAMED_TEST("BulkOpsTest", WAVLBulkOpsTest)
 
 END_TEST_CASE(wavl_tree_tests);
 
@@ -8,6 +8,7 @@
 #include <mxtl/ref_counted.h>
 #include <mxtl/ref_ptr.h>
 #include <mxtl/unique_ptr.h>
+#include <threads.h>
 #include <unittest/unittest.h>
 
 namespace {
@@ -346,6 +347,30 @@ struct StaticRefPtrTestTraits {
     }
 };
 
+template <typename LockType>
+struct StaticThreadCachedTestTraits {
+    class ObjType;
+    using PtrType       = ObjType*;
+    using AllocTraits   = mxtl::ThreadCachedStaticSlabAllocatorTraits<PtrType, 8, 1024, LockType>;
+    using AllocatorType = mxtl::SlabAllocator<AllocTraits>;
+    using RefList       = mxtl::DoublyLinkedList<PtrType>;
+
+    class ObjType : public TestBase,
+                    public mxtl::SlabAllocated<AllocTraits>,
+                    public mxtl::DoublyLinkedListable<PtrType> {
+    public:
+        ObjType()                                     : TestBase() { }
+        explicit ObjType(const size_t& val)           : TestBase(val) { }
+        explicit ObjType(size_t&& val)                : TestBase(mxtl::move(val)) { }
+        explicit ObjType(const size_t& a, size_t&& b) : TestBase(a, mxtl::move(b)) { }
+    };
+
+    static size_t MaxAllocs() { return AllocatorType::AllocsPerSlab * AllocatorType::max_slabs(); }
+
+    static constexpr size_t MaxSlabs  = 4;
+    static constexpr bool   IsManaged = false;
+};
+
 template <typename Traits>
 bool do_static_slab_test(size_t test_allocs) {
     BEGIN_TEST;
@@ -428,6 +453,55 @@ bool static_slab_test() {
 
     END_TEST;
 }
+
+template <typename Traits>
+int thread_cache_worker(void*) {
+    using AllocatorType = typename Traits::AllocatorType;
+
+    // Free objects in an order other than the one they were allocated in so
+    // that the thread cache both fills and drains.
+    for (size_t i = 0; i < 1000; ++i) {
+        typename Traits::PtrType ptrs[13];
+        for (auto& ptr : ptrs) {
+            ptr = AllocatorType::New();
+            if (ptr == nullptr)
+                return -1;
+        }
+        for (size_t j = 0; j < mxtl::count_of(ptrs); j += 2)
+            delete ptrs[j];
+        for (size_t j = 1; j < mxtl::count_of(ptrs); j += 2)
+            delete ptrs[j];
+    }
+
+    // Leave some objects in our cache for our exit to return.
+    auto ptr = AllocatorType::New();
+    if (ptr == nullptr)
+        return -1;
+    delete ptr;
+
+    return 0;
+}
+
+template <typename Traits>
+bool thread_cache_test() {
+    BEGIN_TEST;
+
+    thrd_t threads[4];
+    for (auto& thread : threads)
+        ASSERT_EQ(thrd_create(&thread, thread_cache_worker<Traits>, nullptr), thrd_success, "");
+    for (auto& thread : threads) {
+        int result;
+        ASSERT_EQ(thrd_join(thread, &result), thrd_success, "");
+        EXPECT_EQ(result, 0, "");
+    }
+
+    // Everything the threads cached went back to the allocator when they
+    // exited, so the whole quota is available to us.
+    TestBase::Reset();
+    EXPECT_TRUE(do_static_slab_test<Traits>(Traits::MaxAllocs() + 4), "");
+
+    END_TEST;
+}
 }  // anon namespace
 
 using MutexLock = ::mxtl::Mutex;
@@ -441,6 +515,8 @@ DECLARE_STATIC_SLAB_ALLOCATOR_STORAGE(StaticUnmanagedTestTraits<NullLock>::Alloc
 DECLARE_STATIC_SLAB_ALLOCATOR_STORAGE(StaticUniquePtrTestTraits<NullLock>::AllocTraits, 1);
 DECLARE_STATIC_SLAB_ALLOCATOR_STORAGE(StaticRefPtrTestTraits<NullLock>::AllocTraits, 1);
 
+DECLARE_STATIC_SLAB_ALLOCATOR_STORAGE(StaticThreadCachedTestTraits<MutexLock>::AllocTraits, 8);
+
 BEGIN_TEST_CASE(slab_allocator_tests)
 RUN_NAMED_TEST("Unmanaged Single Slab (mutex)", (slab_test<UnmanagedTestTraits<MutexLock>, 1>))
 RUN_NAMED_TEST("Unmanaged Multi Slab  (mutex)", (slab_test<UnmanagedTestTraits<MutexLock>>))
@@ -472,4 +548,9 @@ RUN_NAMED_TEST("Static RefPtr    (mutex)", (static_slab_test<StaticRefPtrTestTra
 RUN_NAMED_TEST("Static Unmanaged (unlock)", (static_slab_test<StaticUnmanagedTestTraits<NullLock>>))
 RUN_NAMED_TEST("Static UniquePtr (unlock)", (static_slab_test<StaticUniquePtrTestTraits<NullLock>>))
 RUN_NAMED_TEST("Static RefPtr    (unlock)", (static_slab_test<StaticRefPtrTestTraits<NullLock>>))
+
+RUN_NAMED_TEST("Static Thread Cached (mutex)",
+              (static_slab_test<StaticThreadCachedTestTraits<MutexLock>>))
+RUN_NAMED_TEST("Static Thread Cached Threads (mutex)",
+              (thread_cache_test<StaticThreadCachedTestTraits<MutexLock>>))
 END_TEST_CASE(slab_allocator_tests);
@@ -4,7 +4,11 @@
 
 #include <assert.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include <magenta/syscalls.h>
 #include <unittest/unittest.h>
 
 static int uint32_t_cmp(const void* void_left, const void* void_right) {
@@ -54,10 +58,151 @@ static bool qsort_test(void) {
     END_TEST;
 }
 
+enum { RANDOM, SORTED, REVERSED, FEW_KEYS, ORGAN_PIPE, NUM_PATTERNS };
+static const char* const pattern_names[NUM_PATTERNS] = {
+    "random", "sorted", "reversed", "few keys", "organ pipe",
+};
+
+static uint32_t pattern_value(int pattern, size_t i, size_t n, uint32_t* seed) {
+    *seed = *seed * 1103515245 + 12345;
+    switch (pattern) {
+    case SORTED:
+        return (uint32_t)i;
+    case REVERSED:
+        return (uint32_t)(n - i);
+    case FEW_KEYS:
+        return (*seed >> 16) % 4;
+    case ORGAN_PIPE:
+        return (uint32_t)(i < n / 2 ? i : n - i);
+    default:
+        return *seed;
+    }
+}
+
+// The elements of width 3 and 24 take the byte and word swapping paths,
+// and another 4 past the start leaves the 8-byte ones misaligned.
+typedef struct {
+    uint8_t bytes[3];
+} key3_t;
+
+typedef struct {
+    uint64_t key;
+    uint64_t payload[2];
+} key24_t;
+
+static int key3_cmp(const void* left, const void* right) {
+    return memcmp(left, right, sizeof(key3_t));
+}
+
+static int key24_cmp(const void* left, const void* right) {
+    uint64_t l = ((const key24_t*)left)->key;
+    uint64_t r = ((const key24_t*)right)->key;
+    return (l > r) - (l < r);
+}
+
+static int uint64_t_cmp(const void* left, const void* right) {
+    uint64_t l, r;
+    memcpy(&l, left, sizeof(l));
+    memcpy(&r, right, sizeof(r));
+    return (l > r) - (l < r);
+}
+
+#define PATTERN_COUNT 5000
+
+static bool pattern_test(void) {
+    BEGIN_TEST;
+
+    static uint32_t u32[PATTERN_COUNT];
+    static key3_t k3[PATTERN_COUNT];
+    static key24_t k24[PATTERN_COUNT];
+    static uint64_t u64[PATTERN_COUNT + 1];
+    char* u64_misaligned = (char*)u64 + sizeof(uint32_t);
+
+    for (int pattern = 0; pattern < NUM_PATTERNS; pattern++) {
+        uint32_t seed = 1;
+        for (size_t i = 0; i < PATTERN_COUNT; i++) {
+            uint32_t v = pattern_value(pattern, i, PATTERN_COUNT, &seed);
+            u32[i] = v;
+            k3[i].bytes[0] = (uint8_t)(v >> 16);
+            k3[i].bytes[1] = (uint8_t)(v >> 8);
+            k3[i].bytes[2] = (uint8_t)v;
+            k24[i].key = v;
+            k24[i].payload[0] = k24[i].payload[1] = v;
+            uint64_t w = (uint64_t)v << 32 | i;
+            memcpy(u64_misaligned + i * sizeof(w), &w, sizeof(w));
+        }
+
+        qsort(u32, PATTERN_COUNT, sizeof(u32[0]), uint32_t_cmp);
+        qsort(k3, PATTERN_COUNT, sizeof(k3[0]), key3_cmp);
+        qsort(k24, PATTERN_COUNT, sizeof(k24[0]), key24_cmp);
+        qsort(u64_misaligned, PATTERN_COUNT, sizeof(uint64_t), uint64_t_cmp);
+        for (size_t i = 1; i < PATTERN_COUNT; i++) {
+            EXPECT_LE(uint32_t_cmp(&u32[i - 1], &u32[i]), 0, pattern_names[pattern]);
+            EXPECT_LE(key3_cmp(&k3[i - 1], &k3[i]), 0, pattern_names[pattern]);
+            EXPECT_LE(key24_cmp(&k24[i - 1], &k24[i]), 0, pattern_names[pattern]);
+            EXPECT_EQ(k24[i].payload[0], k24[i].key, "elements move whole");
+            EXPECT_LT(uint64_t_cmp(u64_misaligned + (i - 1) * sizeof(uint64_t),
+                                   u64_misaligned + i * sizeof(uint64_t)), 0,
+                      pattern_names[pattern]);
+        }
+    }
+
+    END_TEST;
+}
+
+static bool bsearch_test(void) {
+    BEGIN_TEST;
+
+    static uint32_t keys[100];
+    for (uint32_t i = 0; i < countof(keys); i++)
+        keys[i] = 2 * i;
+    for (size_t n = 0; n <= countof(keys); n++) {
+        for (uint32_t k = 0; k < 2 * n + 1; k++) {
+            uint32_t* found = bsearch(&k, keys, n, sizeof(keys[0]), uint32_t_cmp);
+            if (k % 2 == 0 && k < 2 * n) {
+                EXPECT_EQ(found, &keys[k / 2], "");
+            } else {
+                EXPECT_NULL(found, "");
+            }
+        }
+    }
+
+    END_TEST;
+}
+
+#define BENCH_COUNT 1000000
+
+static bool bench_test(void) {
+    BEGIN_TEST;
+
+    uint32_t* data = malloc(BENCH_COUNT * sizeof(*data));
+    ASSERT_NONNULL(data, "");
+    unittest_printf_critical("\n");
+    for (int pattern = 0; pattern < NUM_PATTERNS; pattern++) {
+        uint32_t seed = 1;
+        for (size_t i = 0; i < BENCH_COUNT; i++)
+            data[i] = pattern_value(pattern, i, BENCH_COUNT, &seed);
+        uint64_t start = mx_ticks_get();
+        qsort(data, BENCH_COUNT, sizeof(*data), uint32_t_cmp);
+        uint64_t ticks = mx_ticks_get() - start;
+        printf("    qsort %d x uint32_t, %-10s: %8.2f ms\n", BENCH_COUNT,
+               pattern_names[pattern], (double)ticks * 1000.0 / (double)mx_ticks_per_second());
+    }
+    free(data);
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(qsort_tests)
 RUN_TEST(qsort_test)
+RUN_TEST(pattern_test)
+RUN_TEST(bsearch_test)
 END_TEST_CASE(qsort_tests)
 
+BEGIN_TEST_CASE(qsort_bench)
+RUN_TEST_PERFORMANCE(bench_test)
+END_TEST_CASE(qsort_bench)
+
 int main(int argc, char** argv) {
     return unittest_run_all_tests(argc, argv) ? 0 : -1;
 }
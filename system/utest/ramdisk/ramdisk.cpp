@@ -649,6 +649,338 @@ bool ramdisk_test_fifo_multiple_vmo_multithreaded(void) {
     END_TEST;
 }
 
+bool ramdisk_test_fifo_multiple_fifos(void) {
+    BEGIN_TEST;
+    const size_t kBlockSize = 512;
+    int fd = get_ramdisk(kBlockSize, 1 << 18);
+    mx_handle_t fifos[BLOCK_MAX_FIFOS];
+    ssize_t expected = sizeof(mx_handle_t);
+    ASSERT_EQ(ioctl_block_add_fifo(fd, &fifos[0]), MX_ERR_BAD_STATE,
+              "Added a FIFO without a server");
+    ASSERT_EQ(ioctl_block_get_fifos(fd, &fifos[0]), expected, "Failed to get FIFO");
+    for (size_t i = 1; i < countof(fifos); i++) {
+        ASSERT_EQ(ioctl_block_add_fifo(fd, &fifos[i]), expected, "Failed to add FIFO");
+    }
+    mx_handle_t extra;
+    ASSERT_EQ(ioctl_block_add_fifo(fd, &extra), MX_ERR_NO_RESOURCES, "Added too many FIFOs");
+
+    // Each thread uses a FIFO of its own, but the VMOs and txns are shared.
+    size_t num_threads = countof(fifos);
+    AllocChecker ac;
+    mxtl::Array<test_vmo_object_t> objs(new (&ac) test_vmo_object_t[num_threads](), num_threads);
+    ASSERT_TRUE(ac.check(), "");
+    mxtl::Array<thrd_t> threads(new (&ac) thrd_t[num_threads](), num_threads);
+    ASSERT_TRUE(ac.check(), "");
+    mxtl::Array<test_thread_arg_t> thread_args(new (&ac) test_thread_arg_t[num_threads](),
+                                               num_threads);
+    ASSERT_TRUE(ac.check(), "");
+
+    for (size_t i = 0; i < num_threads; i++) {
+        thread_args[i].obj = &objs[i];
+        thread_args[i].i = i;
+        thread_args[i].objs = objs.size();
+        thread_args[i].fd = fd;
+        ASSERT_EQ(block_fifo_create_client(fifos[i], &thread_args[i].client), MX_OK, "");
+        thread_args[i].kBlockSize = kBlockSize;
+        ASSERT_EQ(thrd_create(&threads[i], fifo_vmo_thread, &thread_args[i]),
+                  thrd_success, "");
+    }
+
+    for (size_t i = 0; i < num_threads; i++) {
+        int res;
+        ASSERT_EQ(thrd_join(threads[i], &res), thrd_success, "");
+        ASSERT_EQ(res, 0, "");
+    }
+
+    // Closing an added FIFO leaves the rest of the server running...
+    block_fifo_release_client(thread_args[1].client);
+    txnid_t txnid;
+    expected = sizeof(txnid_t);
+    ASSERT_EQ(ioctl_block_alloc_txn(fd, &txnid), expected, "Failed to allocate txn");
+    ASSERT_TRUE(create_vmo_helper(fd, &objs[0], kBlockSize), "");
+    ASSERT_TRUE(close_vmo_helper(thread_args[0].client, &objs[0], txnid), "");
+
+    // ... while closing the first one shuts it all down.
+    for (size_t i = 0; i < num_threads; i++) {
+        if (i != 1) {
+            block_fifo_release_client(thread_args[i].client);
+        }
+    }
+    ASSERT_GE(ioctl_ramdisk_unlink(fd), 0, "Could not unlink ramdisk device");
+    ASSERT_EQ(close(fd), 0, "");
+    END_TEST;
+}
+
+bool ramdisk_test_fifo_weighted_fifos(void) {
+    BEGIN_TEST;
+    const size_t kBlockSize = 512;
+    int fd = get_ramdisk(kBlockSize, 1 << 18);
+    const uint32_t weights[] = { BLOCK_FIFO_WEIGHT_DEFAULT, 1, BLOCK_FIFO_WEIGHT_MAX };
+    mx_handle_t fifos[countof(weights)];
+    ssize_t expected = sizeof(mx_handle_t);
+    ASSERT_EQ(ioctl_block_get_fifos(fd, &fifos[0]), expected, "Failed to get FIFO");
+    mx_handle_t extra;
+    uint32_t bad_weight = 0;
+    ASSERT_EQ(ioctl_block_add_weighted_fifo(fd, &bad_weight, &extra), MX_ERR_INVALID_ARGS, "");
+    bad_weight = BLOCK_FIFO_WEIGHT_MAX + 1;
+    ASSERT_EQ(ioctl_block_add_weighted_fifo(fd, &bad_weight, &extra), MX_ERR_INVALID_ARGS, "");
+    for (size_t i = 1; i < countof(fifos); i++) {
+        ASSERT_EQ(ioctl_block_add_weighted_fifo(fd, &weights[i], &fifos[i]), expected,
+                  "Failed to add FIFO");
+    }
+
+    // However small its share, every FIFO's requests complete.
+    size_t num_threads = countof(fifos);
+    AllocChecker ac;
+    mxtl::Array<test_vmo_object_t> objs(new (&ac) test_vmo_object_t[num_threads](), num_threads);
+    ASSERT_TRUE(ac.check(), "");
+    mxtl::Array<thrd_t> threads(new (&ac) thrd_t[num_threads](), num_threads);
+    ASSERT_TRUE(ac.check(), "");
+    mxtl::Array<test_thread_arg_t> thread_args(new (&ac) test_thread_arg_t[num_threads](),
+                                               num_threads);
+    ASSERT_TRUE(ac.check(), "");
+
+    for (size_t i = 0; i < num_threads; i++) {
+        thread_args[i].obj = &objs[i];
+        thread_args[i].i = i;
+        thread_args[i].objs = objs.size();
+        thread_args[i].fd = fd;
+        ASSERT_EQ(block_fifo_create_client(fifos[i], &thread_args[i].client), MX_OK, "");
+        thread_args[i].kBlockSize = kBlockSize;
+        ASSERT_EQ(thrd_create(&threads[i], fifo_vmo_thread, &thread_args[i]),
+                  thrd_success, "");
+    }
+
+    for (size_t i = 0; i < num_threads; i++) {
+        int res;
+        ASSERT_EQ(thrd_join(threads[i], &res), thrd_success, "");
+        ASSERT_EQ(res, 0, "");
+    }
+
+    for (size_t i = 0; i < num_threads; i++) {
+        block_fifo_release_client(thread_args[i].client);
+    }
+    ASSERT_GE(ioctl_ramdisk_unlink(fd), 0, "Could not unlink ramdisk device");
+    ASSERT_EQ(close(fd), 0, "");
+    END_TEST;
+}
+
+bool ramdisk_test_fifo_adjacent_requests(void) {
+    BEGIN_TEST;
+    const size_t kBlockSize = 512;
+    int fd = get_ramdisk(kBlockSize, 1 << 18);
+    mx_handle_t fifo;
+    ssize_t expected = sizeof(fifo);
+    ASSERT_EQ(ioctl_block_get_fifos(fd, &fifo), expected, "Failed to get FIFO");
+    txnid_t txnid;
+    expected = sizeof(txnid_t);
+    ASSERT_EQ(ioctl_block_alloc_txn(fd, &txnid), expected, "Failed to allocate txn");
+    fifo_client_t* client;
+    ASSERT_EQ(block_fifo_create_client(fifo, &client), MX_OK, "");
+
+    // A request for each block, one after the other on disk, which the
+    // server is free to merge.
+    test_vmo_object_t obj;
+    ASSERT_TRUE(create_vmo_helper(fd, &obj, kBlockSize), "");
+    ASSERT_TRUE(write_striped_vmo_helper(client, &obj, 0, 1, txnid, kBlockSize), "");
+    ASSERT_TRUE(read_striped_vmo_helper(client, &obj, 0, 1, txnid, kBlockSize), "");
+    ASSERT_TRUE(close_vmo_helper(client, &obj, txnid), "");
+
+    block_fifo_release_client(client);
+    ASSERT_GE(ioctl_ramdisk_unlink(fd), 0, "Could not unlink ramdisk device");
+    ASSERT_EQ(close(fd), 0, "");
+    END_TEST;
+}
+
+bool ramdisk_test_fifo_sync_and_fua(void) {
+    BEGIN_TEST;
+    const size_t kBlockSize = PAGE_SIZE;
+    int fd = get_ramdisk(kBlockSize, 1 << 10);
+    mx_handle_t fifo;
+    ssize_t expected = sizeof(fifo);
+    ASSERT_EQ(ioctl_block_get_fifos(fd, &fifo), expected, "Failed to get FIFO");
+    txnid_t txnid;
+    expected = sizeof(txnid_t);
+    ASSERT_EQ(ioctl_block_alloc_txn(fd, &txnid), expected, "Failed to allocate txn");
+    fifo_client_t* client;
+    ASSERT_EQ(block_fifo_create_client(fifo, &client), MX_OK, "");
+
+    test_vmo_object_t obj;
+    ASSERT_TRUE(create_vmo_helper(fd, &obj, kBlockSize), "");
+
+    // A sync needs no vmo
+    block_fifo_request_t request;
+    request.txnid = txnid;
+    request.vmoid = 0;
+    request.opcode = BLOCKIO_SYNC;
+    request.length = 0;
+    request.vmo_offset = 0;
+    request.dev_offset = 0;
+    ASSERT_EQ(block_fifo_txn(client, &request, 1), MX_OK, "");
+
+    // FUA writes read back like any others
+    request.vmoid = obj.vmoid;
+    request.opcode = BLOCKIO_WRITE | BLOCKIO_FUA;
+    request.length = static_cast<uint32_t>(obj.vmo_size);
+    ASSERT_EQ(block_fifo_txn(client, &request, 1), MX_OK, "");
+    request.opcode = BLOCKIO_SYNC;
+    ASSERT_EQ(block_fifo_txn(client, &request, 1), MX_OK, "");
+    ASSERT_TRUE(read_striped_vmo_helper(client, &obj, 0, 1, txnid, kBlockSize), "");
+
+    ASSERT_TRUE(close_vmo_helper(client, &obj, txnid), "");
+    block_fifo_release_client(client);
+    ASSERT_GE(ioctl_ramdisk_unlink(fd), 0, "Could not unlink ramdisk device");
+    ASSERT_EQ(close(fd), 0, "");
+    END_TEST;
+}
+
+bool ramdisk_test_fifo_discard(void) {
+    BEGIN_TEST;
+    // Blocks smaller than a page, so a discard may cover part of one
+    const size_t kBlockSize = 512;
+    int fd = get_ramdisk(kBlockSize, 1 << 10);
+    block_info_t info;
+    ssize_t expected = sizeof(info);
+    ASSERT_EQ(ioctl_block_get_info(fd, &info), expected, "");
+    ASSERT_NEQ(info.flags & BLOCK_FLAG_DISCARD, 0u, "Ramdisk should offer discard");
+    mx_handle_t fifo;
+    expected = sizeof(fifo);
+    ASSERT_EQ(ioctl_block_get_fifos(fd, &fifo), expected, "Failed to get FIFO");
+    txnid_t txnid;
+    expected = sizeof(txnid_t);
+    ASSERT_EQ(ioctl_block_alloc_txn(fd, &txnid), expected, "Failed to allocate txn");
+    fifo_client_t* client;
+    ASSERT_EQ(block_fifo_create_client(fifo, &client), MX_OK, "");
+
+    const size_t kLength = 4 * PAGE_SIZE;
+    mx_handle_t vmo;
+    ASSERT_EQ(mx_vmo_create(kLength, 0, &vmo), MX_OK, "");
+    AllocChecker ac;
+    mxtl::unique_ptr<uint8_t[]> buf(new (&ac) uint8_t[kLength]);
+    ASSERT_TRUE(ac.check(), "");
+    mxtl::unique_ptr<uint8_t[]> out(new (&ac) uint8_t[kLength]);
+    ASSERT_TRUE(ac.check(), "");
+    fill_random(buf.get(), kLength);
+    size_t actual;
+    ASSERT_EQ(mx_vmo_write(vmo, buf.get(), 0, kLength, &actual), MX_OK, "");
+    mx_handle_t xfer_vmo;
+    ASSERT_EQ(mx_handle_duplicate(vmo, MX_RIGHT_SAME_RIGHTS, &xfer_vmo), MX_OK, "");
+    vmoid_t vmoid;
+    expected = sizeof(vmoid_t);
+    ASSERT_EQ(ioctl_block_attach_vmo(fd, &xfer_vmo, &vmoid), expected, "");
+
+    block_fifo_request_t request;
+    request.txnid = txnid;
+    request.vmoid = vmoid;
+    request.opcode = BLOCKIO_WRITE;
+    request.length = kLength;
+    request.vmo_offset = 0;
+    request.dev_offset = 0;
+    ASSERT_EQ(block_fifo_txn(client, &request, 1), MX_OK, "");
+
+    // Discard from a block into the first page to the middle of the last,
+    // which needs no vmo.
+    const size_t kStart = kBlockSize;
+    const size_t kEnd = 3 * PAGE_SIZE + 2 * kBlockSize;
+    request.vmoid = 0;
+    request.opcode = BLOCKIO_DISCARD;
+    request.length = kEnd - kStart;
+    request.dev_offset = kStart;
+    ASSERT_EQ(block_fifo_txn(client, &request, 1), MX_OK, "");
+
+    // The ramdisk reads back what was discarded as zeros, and the rest as
+    // it was written.
+    memset(buf.get() + kStart, 0, kEnd - kStart);
+    request.vmoid = vmoid;
+    request.opcode = BLOCKIO_READ;
+    request.length = kLength;
+    request.dev_offset = 0;
+    ASSERT_EQ(block_fifo_txn(client, &request, 1), MX_OK, "");
+    ASSERT_EQ(mx_vmo_read(vmo, out.get(), 0, kLength, &actual), MX_OK, "");
+    ASSERT_EQ(memcmp(buf.get(), out.get(), kLength), 0, "Unexpected data after discard");
+
+    // Blocks never written read as zeros too.
+    request.dev_offset = kLength;
+    ASSERT_EQ(block_fifo_txn(client, &request, 1), MX_OK, "");
+    ASSERT_EQ(mx_vmo_read(vmo, out.get(), 0, kLength, &actual), MX_OK, "");
+    memset(buf.get(), 0, kLength);
+    ASSERT_EQ(memcmp(buf.get(), out.get(), kLength), 0, "Unwritten blocks are not zero");
+
+    request.opcode = BLOCKIO_CLOSE_VMO;
+    ASSERT_EQ(block_fifo_txn(client, &request, 1), MX_OK, "");
+    ASSERT_EQ(mx_handle_close(vmo), MX_OK, "");
+    block_fifo_release_client(client);
+    ASSERT_GE(ioctl_ramdisk_unlink(fd), 0, "Could not unlink ramdisk device");
+    ASSERT_EQ(close(fd), 0, "");
+    END_TEST;
+}
+
+bool ramdisk_test_fifo_stats(void) {
+    BEGIN_TEST;
+    const size_t kBlockSize = 512;
+    int fd = get_ramdisk(kBlockSize, 1 << 10);
+    mx_handle_t fifo;
+    ssize_t expected = sizeof(fifo);
+    ASSERT_EQ(ioctl_block_get_fifos(fd, &fifo), expected, "Failed to get FIFO");
+    txnid_t txnid;
+    expected = sizeof(txnid_t);
+    ASSERT_EQ(ioctl_block_alloc_txn(fd, &txnid), expected, "Failed to allocate txn");
+    fifo_client_t* client;
+    ASSERT_EQ(block_fifo_create_client(fifo, &client), MX_OK, "");
+
+    const size_t kLength = PAGE_SIZE;
+    mx_handle_t vmo;
+    ASSERT_EQ(mx_vmo_create(kLength, 0, &vmo), MX_OK, "");
+    mx_handle_t xfer_vmo;
+    ASSERT_EQ(mx_handle_duplicate(vmo, MX_RIGHT_SAME_RIGHTS, &xfer_vmo), MX_OK, "");
+    vmoid_t vmoid;
+    expected = sizeof(vmoid_t);
+    ASSERT_EQ(ioctl_block_attach_vmo(fd, &xfer_vmo, &vmoid), expected, "");
+
+    // Two writes, a read and a flush, with every request counted once.
+    block_fifo_request_t requests[2];
+    for (size_t i = 0; i < countof(requests); i++) {
+        requests[i].txnid = txnid;
+        requests[i].vmoid = vmoid;
+        requests[i].opcode = BLOCKIO_WRITE;
+        requests[i].length = kLength;
+        requests[i].vmo_offset = 0;
+        requests[i].dev_offset = i * kLength;
+    }
+    ASSERT_EQ(block_fifo_txn(client, requests, countof(requests)), MX_OK, "");
+    requests[0].opcode = BLOCKIO_READ;
+    ASSERT_EQ(block_fifo_txn(client, requests, 1), MX_OK, "");
+    requests[0].opcode = BLOCKIO_SYNC;
+    ASSERT_EQ(block_fifo_txn(client, requests, 1), MX_OK, "");
+
+    block_stats_t stats;
+    expected = sizeof(stats);
+    ASSERT_EQ(ioctl_block_get_stats(fd, &stats), expected, "");
+    ASSERT_EQ(stats.ops[BLOCK_STAT_WRITE].counts.ops, 2u, "");
+    ASSERT_EQ(stats.ops[BLOCK_STAT_WRITE].counts.bytes, 2 * kLength, "");
+    ASSERT_EQ(stats.ops[BLOCK_STAT_READ].counts.ops, 1u, "");
+    ASSERT_EQ(stats.ops[BLOCK_STAT_READ].counts.bytes, kLength, "");
+    ASSERT_EQ(stats.ops[BLOCK_STAT_FLUSH].counts.ops, 1u, "");
+    ASSERT_EQ(stats.ops[BLOCK_STAT_READ].counts.errors, 0u, "");
+    uint64_t histogram = 0;
+    for (size_t b = 0; b < BLOCK_LATENCY_BUCKETS; b++) {
+        histogram += stats.ops[BLOCK_STAT_WRITE].latency[b];
+    }
+    ASSERT_EQ(histogram, 2u, "Each write should be in the histogram once");
+    ASSERT_EQ(stats.queue_depth, 0u, "");
+    ASSERT_GE(stats.max_queue_depth, 1u, "");
+    ASSERT_EQ(stats.client_count, 1u, "");
+    ASSERT_EQ(stats.clients[0].ops[BLOCK_STAT_WRITE].ops, 2u, "");
+
+    requests[0].opcode = BLOCKIO_CLOSE_VMO;
+    ASSERT_EQ(block_fifo_txn(client, requests, 1), MX_OK, "");
+    ASSERT_EQ(mx_handle_close(vmo), MX_OK, "");
+    block_fifo_release_client(client);
+    ASSERT_GE(ioctl_ramdisk_unlink(fd), 0, "Could not unlink ramdisk device");
+    ASSERT_EQ(close(fd), 0, "");
+    END_TEST;
+}
+
 bool ramdisk_test_fifo_unclean_shutdown(void) {
     BEGIN_TEST;
     // Set up the ramdisk
@@ -1037,6 +1369,12 @@ RUN_TEST_SMALL(ramdisk_test_fifo_no_op)
 RUN_TEST_SMALL(ramdisk_test_fifo_basic)
 RUN_TEST_SMALL(ramdisk_test_fifo_multiple_vmo)
 RUN_TEST_SMALL(ramdisk_test_fifo_multiple_vmo_multithreaded)
+RUN_TEST_SMALL(ramdisk_test_fifo_multiple_fifos)
+RUN_TEST_SMALL(ramdisk_test_fifo_weighted_fifos)
+RUN_TEST_SMALL(ramdisk_test_fifo_adjacent_requests)
+RUN_TEST_SMALL(ramdisk_test_fifo_sync_and_fua)
+RUN_TEST_SMALL(ramdisk_test_fifo_discard)
+RUN_TEST_SMALL(ramdisk_test_fifo_stats)
 // TODO(smklein): Test ops across different vmos
 RUN_TEST_SMALL(ramdisk_test_fifo_unclean_shutdown)
 RUN_TEST_SMALL(ramdisk_test_fifo_large_ops_count)
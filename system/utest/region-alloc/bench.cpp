@@ -0,0 +1,124 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <inttypes.h>
+#include <region-alloc/region-alloc.h>
+#include <stdio.h>
+
+#include <magenta/syscalls.h>
+
+#include "bench.h"
+
+namespace {
+
+constexpr size_t kRegions = 100000;
+
+// Plenty for the bookkeeping of every region, allocated or not.
+constexpr size_t kPoolSize = 64u << 20;
+
+// Far enough apart that neighbouring regions never merge.
+constexpr uint64_t kStride = 0x10000;
+
+template <typename T>
+inline mx_time_t time_it(T func) {
+    mx_time_t t = mx_time_get(MX_CLOCK_MONOTONIC);
+    func();
+    return mx_time_get(MX_CLOCK_MONOTONIC) - t;
+}
+
+void report(const char* what, size_t ops, mx_time_t t) {
+    printf("\t%-48s %8" PRIu64 " nsecs, %6" PRIu64 " nsecs/op\n", what, t,
+           t / (ops ? ops : 1));
+}
+
+// A simple LCG, so that runs are repeatable.
+uint32_t next_rand(uint32_t* state) {
+    *state = *state * 1664525u + 1013904223u;
+    return *state >> 8;
+}
+
+}  // namespace
+
+int region_alloc_run_benchmark() {
+    printf("starting region allocator benchmark, %zu regions\n", kRegions);
+
+    auto regions = new RegionAllocator::Region::UPtr[kRegions];
+    RegionAllocator alloc(RegionAllocator::RegionPool::Create(kPoolSize));
+    mx_time_t t;
+
+    // Add a set of separate regions, then allocate all of them by size and
+    // give them back.
+    t = time_it([&]() {
+        for (size_t i = 0; i < kRegions; ++i)
+            alloc.AddRegion({ .base = i * kStride, .size = kStride / 2 });
+    });
+    report("add separate regions", kRegions, t);
+
+    t = time_it([&]() {
+        for (size_t i = 0; i < kRegions; ++i)
+            regions[i] = alloc.GetRegion(kStride / 2, 1);
+    });
+    report("allocate whole regions by size", kRegions, t);
+
+    t = time_it([&]() {
+        for (size_t i = 0; i < kRegions; ++i)
+            regions[i].reset();
+    });
+    report("free whole regions", kRegions, t);
+
+    // Carve small pieces of random sizes and alignments out of one big region,
+    // then give them back in a different order than they were taken.
+    alloc.Reset();
+    alloc.AddRegion({ .base = 0, .size = kRegions * kStride });
+
+    uint32_t seed = 1;
+    size_t allocated = 0;
+    t = time_it([&]() {
+        for (size_t i = 0; i < kRegions; ++i) {
+            uint64_t size = (next_rand(&seed) % 0x2000) + 1;
+            uint64_t align = 1ull << (next_rand(&seed) % 13);
+            regions[i] = alloc.GetRegion(size, align);
+            allocated += (regions[i] != nullptr);
+        }
+    });
+    report("allocate by size and alignment from one region", kRegions, t);
+
+    t = time_it([&]() {
+        for (size_t i = 0; i < kRegions; i += 2)
+            regions[i].reset();
+        for (size_t i = 1; i < kRegions; i += 2)
+            regions[i].reset();
+    });
+    report("free, every other region first", kRegions, t);
+
+    // Leave many free regions which are just too big to use before alignment
+    // but too small after it, with one usable region at the end.  Every
+    // aligned allocation has to look past the unusable ones.
+    alloc.Reset();
+    for (size_t i = 0; i < kRegions; ++i)
+        alloc.AddRegion({ .base = i * kStride + 0x800, .size = 0x1400 });
+    alloc.AddRegion({ .base = kRegions * kStride, .size = kRegions * 0x1000 });
+
+    t = time_it([&]() {
+        for (size_t i = 0; i < kRegions; ++i)
+            regions[i] = alloc.GetRegion(0x1000, 0x1000);
+    });
+    report("aligned allocations past misaligned regions", kRegions, t);
+
+    for (size_t i = 0; i < kRegions; ++i) {
+        if (regions[i] == nullptr) {
+            printf("aligned allocation %zu failed\n", i);
+            break;
+        }
+        regions[i].reset();
+    }
+
+    printf("\t%zu of %zu random allocations succeeded\n", allocated, kRegions);
+    alloc.Reset();
+    delete[] regions;
+
+    printf("done with benchmark\n");
+
+    return 0;
+}
@@ -235,12 +235,57 @@ static bool ralloc_subtract_test() {
     END_TEST;
 }
 
+static bool ralloc_alignment_search_test() {
+    BEGIN_TEST;
+
+    // Make a pool and attach it to an allocator.  Then add a run of regions
+    // which are large enough for a page before alignment, but not after.
+    RegionAllocator alloc(RegionAllocator::RegionPool::Create(REGION_POOL_MAX_SIZE << 2));
+
+    static constexpr size_t   kMisaligned = 64;
+    static constexpr uint64_t kStride     = 0x10000;
+    for (size_t i = 0; i < kMisaligned; ++i)
+        ASSERT_EQ(MX_OK, alloc.AddRegion({ .base = (i * kStride) + 0x800, .size = 0x1400 }), "");
+
+    // With nothing else available, a page aligned page cannot be found.
+    RegionAllocator::Region::UPtr region;
+    EXPECT_EQ(MX_ERR_NOT_FOUND, alloc.GetRegion(0x1000, 0x1000, region), "");
+    EXPECT_NULL(region, "");
+
+    // Add one short region which fits, sorting after all of the misaligned
+    // ones.  It must still be found, however many regions precede it.
+    const ralloc_region_t last_short = { .base = kMisaligned * kStride, .size = 0x1400 };
+    ASSERT_EQ(MX_OK, alloc.AddRegion(last_short), "");
+    EXPECT_EQ(MX_OK, alloc.GetRegion(0x1000, 0x1000, region), "");
+    ASSERT_NONNULL(region, "");
+    EXPECT_EQ(last_short.base, region->base, "");
+    region.reset();
+
+    // Add a region which fits wherever it starts.  The allocation should come
+    // from one of the two usable regions, and be properly aligned.
+    const ralloc_region_t large = { .base = (kMisaligned + 1) * kStride + 0x800,
+                                    .size = 0x4000 };
+    ASSERT_EQ(MX_OK, alloc.AddRegion(large), "");
+
+    RegionAllocator::Region::UPtr regions[2];
+    for (auto& r : regions) {
+        EXPECT_EQ(MX_OK, alloc.GetRegion(0x1000, 0x1000, r), "");
+        ASSERT_NONNULL(r, "");
+        EXPECT_EQ(0u, r->base & 0xFFF, "");
+        EXPECT_TRUE(region_contains_region(&last_short, r.get()) ||
+                    region_contains_region(&large, r.get()), "");
+    }
+
+    END_TEST;
+}
+
 } //namespace
 
 BEGIN_TEST_CASE(ralloc_tests)
 RUN_NAMED_TEST("Region Pools",   ralloc_region_pools_test)
 RUN_NAMED_TEST("Alloc by size",  ralloc_by_size_test)
 RUN_NAMED_TEST("Alloc specific", ralloc_specific_test)
+RUN_NAMED_TEST("Alloc aligned",  ralloc_alignment_search_test)
 RUN_NAMED_TEST("Add/Overlap",    ralloc_add_overlap_test)
 RUN_NAMED_TEST("Subtract",       ralloc_subtract_test)
 END_TEST_CASE(ralloc_tests)
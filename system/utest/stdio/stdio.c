@@ -8,7 +8,10 @@
 
 #include <unistd.h>
 #include <errno.h>
+#include <stdio.h>
+#include <stdio_ext.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <elfload/elfload.h>
 
@@ -136,9 +139,42 @@ static bool stdio_launchpad_pipe_test(void)
     END_TEST;
 }
 
+static bool stdio_fsetlocking_test(void)
+{
+    BEGIN_TEST;
+
+    char* buf = NULL;
+    size_t len = 0;
+    FILE* f = open_memstream(&buf, &len);
+    ASSERT_NONNULL(f, "open_memstream");
+
+    EXPECT_EQ(__fsetlocking(f, FSETLOCKING_QUERY), FSETLOCKING_INTERNAL, "");
+    EXPECT_EQ(__fsetlocking(f, FSETLOCKING_BYCALLER), FSETLOCKING_INTERNAL, "");
+    EXPECT_EQ(__fsetlocking(f, FSETLOCKING_QUERY), FSETLOCKING_BYCALLER, "");
+
+    // A stream locked by its caller works as any other.
+    for (int i = 0; i < 1000; i++) {
+        ASSERT_GT(fprintf(f, "%d ", i % 10), 0, "");
+    }
+    ASSERT_EQ(fputc('x', f), 'x', "");
+    ASSERT_EQ(fflush(f), 0, "");
+    ASSERT_EQ(len, (size_t)2001, "");
+    EXPECT_EQ(memcmp(buf, "0 1 2 ", 6), 0, "");
+    EXPECT_EQ(buf[2000], 'x', "");
+
+    EXPECT_EQ(__fsetlocking(f, FSETLOCKING_INTERNAL), FSETLOCKING_BYCALLER, "");
+    EXPECT_EQ(__fsetlocking(f, FSETLOCKING_QUERY), FSETLOCKING_INTERNAL, "");
+
+    ASSERT_EQ(fclose(f), 0, "");
+    free(buf);
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(launchpad_tests)
 RUN_TEST(stdio_pipe_test);
 RUN_TEST(stdio_launchpad_pipe_test);
+RUN_TEST(stdio_fsetlocking_test);
 END_TEST_CASE(launchpad_tests)
 
 int main(int argc, char **argv)
@@ -0,0 +1,207 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <magenta/process.h>
+#include <magenta/syscalls.h>
+#include <unittest/unittest.h>
+
+// The vectorized routines read whole aligned blocks, some of which lie past
+// the end of what they were given.  These tests put that end just before an
+// unmapped page, at every alignment, so that reading a block too far faults.
+
+#define MAX_LEN 200
+#define MAX_SHIFT 64
+
+static char* map_guarded_page(void) {
+    mx_handle_t vmo;
+    uintptr_t addr;
+    if (mx_vmo_create(2 * PAGE_SIZE, 0, &vmo) != MX_OK)
+        return NULL;
+    mx_status_t status = mx_vmar_map(mx_vmar_root_self(), 0, vmo, 0, 2 * PAGE_SIZE,
+                                     MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE, &addr);
+    mx_handle_close(vmo);
+    if (status != MX_OK)
+        return NULL;
+    if (mx_vmar_unmap(mx_vmar_root_self(), addr + PAGE_SIZE, PAGE_SIZE) != MX_OK) {
+        mx_vmar_unmap(mx_vmar_root_self(), addr, 2 * PAGE_SIZE);
+        return NULL;
+    }
+    return (char*)addr;
+}
+
+static void unmap_guarded_page(char* page) {
+    mx_vmar_unmap(mx_vmar_root_self(), (uintptr_t)page, PAGE_SIZE);
+}
+
+// A string of |len| bytes and its terminator, ending |shift| bytes before
+// the guard page.
+static char* fill(char* page, size_t len, size_t shift) {
+    char* s = page + PAGE_SIZE - 1 - len - shift;
+    for (size_t i = 0; i < len; i++)
+        s[i] = (char)('a' + i % 7);
+    s[len] = '\0';
+    return s;
+}
+
+// Where |c| first appears in what fill() wrote, or |len| if it doesn't.
+static size_t first(int c, size_t len) {
+    size_t at = c - 'a';
+    return at < 7 && at < len ? at : len;
+}
+
+static int sign(int x) {
+    return (x > 0) - (x < 0);
+}
+
+static bool strlen_test(void) {
+    BEGIN_TEST;
+    char* page = map_guarded_page();
+    ASSERT_NONNULL(page, "");
+    for (size_t shift = 0; shift < MAX_SHIFT; shift++) {
+        for (size_t len = 0; len < MAX_LEN; len++) {
+            char* s = fill(page, len, shift);
+            ASSERT_EQ(strlen(s), len, "");
+        }
+    }
+    unmap_guarded_page(page);
+    END_TEST;
+}
+
+static bool strchr_test(void) {
+    BEGIN_TEST;
+    char* page = map_guarded_page();
+    ASSERT_NONNULL(page, "");
+    for (size_t shift = 0; shift < MAX_SHIFT; shift++) {
+        for (size_t len = 0; len < MAX_LEN; len++) {
+            char* s = fill(page, len, shift);
+            for (int c = 'a'; c <= 'h'; c++) {
+                size_t want = first(c, len);
+                ASSERT_EQ(strchrnul(s, c), s + want, "");
+                ASSERT_EQ(strchr(s, c), want < len ? s + want : NULL, "");
+            }
+            ASSERT_EQ(strchr(s, '\0'), s + len, "");
+        }
+    }
+    unmap_guarded_page(page);
+    END_TEST;
+}
+
+static bool memchr_test(void) {
+    BEGIN_TEST;
+    char* page = map_guarded_page();
+    ASSERT_NONNULL(page, "");
+    for (size_t shift = 0; shift < MAX_SHIFT; shift++) {
+        for (size_t len = 0; len < MAX_LEN; len++) {
+            // With no terminator, so the last byte is the last of the page.
+            char* s = fill(page, len, shift) + 1;
+            memmove(s, s - 1, len);
+            for (size_t n = 0; n <= len; n++) {
+                for (int c = 'a'; c <= 'h'; c++) {
+                    size_t at = first(c, n);
+                    ASSERT_EQ(memchr(s, c, n), at < n ? s + at : NULL, "");
+                }
+            }
+        }
+    }
+    unmap_guarded_page(page);
+    END_TEST;
+}
+
+static bool memcmp_test(void) {
+    BEGIN_TEST;
+    char* page = map_guarded_page();
+    ASSERT_NONNULL(page, "");
+    char other[MAX_LEN];
+    for (size_t shift = 0; shift < MAX_SHIFT; shift++) {
+        for (size_t len = 0; len < MAX_LEN; len++) {
+            char* s = fill(page, len, shift);
+            memcpy(other, s, len);
+            ASSERT_EQ(memcmp(s, other, len), 0, "");
+            for (size_t i = 0; i < len; i++) {
+                // The difference is unsigned, whichever way char goes.
+                other[i] ^= 0x80;
+                ASSERT_EQ(memcmp(s, other, i), 0, "");
+                ASSERT_EQ(sign(memcmp(s, other, len)), -1, "");
+                ASSERT_EQ(sign(memcmp(other, s, len)), 1, "");
+                other[i] ^= 0x80;
+            }
+        }
+    }
+    unmap_guarded_page(page);
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(string_tests)
+RUN_TEST(strlen_test)
+RUN_TEST(strchr_test)
+RUN_TEST(memchr_test)
+RUN_TEST(memcmp_test)
+END_TEST_CASE(string_tests)
+
+// The benchmarks check nothing; they report the rate each routine scans at
+// for a few sizes, from short tokens to whole buffers.
+
+static const size_t bench_sizes[] = {16, 64, 256, 4096, 65536};
+#define BENCH_BYTES (64u << 20)
+
+static char bench_buf[65536 + 1];
+
+static void report(const char* name, size_t size, uint64_t ticks) {
+    double secs = (double)ticks / (double)mx_ticks_per_second();
+    printf("    %-8s %6zu bytes: %8.1f MB/s\n", name, size,
+           (double)BENCH_BYTES / (1024.0 * 1024.0) / secs);
+}
+
+// Keeps the compiler from hoisting the call out of the loop.
+static volatile size_t bench_sink;
+
+static bool bench_test(void) {
+    BEGIN_TEST;
+    memset(bench_buf, 'x', sizeof(bench_buf));
+    unittest_printf_critical("\n");
+    for (size_t i = 0; i < countof(bench_sizes); i++) {
+        size_t size = bench_sizes[i];
+        size_t reps = BENCH_BYTES / size;
+        bench_buf[size] = '\0';
+        char* volatile s = bench_buf;
+
+        uint64_t start = mx_ticks_get();
+        for (size_t r = 0; r < reps; r++)
+            bench_sink = strlen(s);
+        report("strlen", size, mx_ticks_get() - start);
+
+        start = mx_ticks_get();
+        for (size_t r = 0; r < reps; r++)
+            bench_sink = (size_t)strchr(s, 'y');
+        report("strchr", size, mx_ticks_get() - start);
+
+        start = mx_ticks_get();
+        for (size_t r = 0; r < reps; r++)
+            bench_sink = (size_t)memchr(s, 'y', size);
+        report("memchr", size, mx_ticks_get() - start);
+
+        start = mx_ticks_get();
+        for (size_t r = 0; r < reps; r++)
+            bench_sink = memcmp(s, bench_buf + sizeof(bench_buf) - 1 - size, size);
+        report("memcmp", size, mx_ticks_get() - start);
+
+        bench_buf[size] = 'x';
+        EXPECT_EQ(bench_sink, 0u, "");
+    }
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(string_bench)
+RUN_TEST_PERFORMANCE(bench_test)
+END_TEST_CASE(string_bench)
+
+int main(int argc, char** argv) {
+    return unittest_run_all_tests(argc, argv) ? 0 : -1;
+}
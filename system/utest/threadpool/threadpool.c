@@ -0,0 +1,141 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#include <magenta/syscalls.h>
+#include <threadpool/threadpool.h>
+#include <unittest/unittest.h>
+
+typedef struct {
+    tp_task_t task;
+    atomic_int* count;
+} count_task_t;
+
+static void count(tp_task_t* task) {
+    count_task_t* t = (count_task_t*)task;
+    atomic_fetch_add(t->count, 1);
+}
+
+static bool post_test(void) {
+    BEGIN_TEST;
+    threadpool_t* pool;
+    ASSERT_EQ(threadpool_create(0, "tp-test", &pool), MX_OK, "");
+    EXPECT_EQ(threadpool_size(pool), mx_system_get_num_cpus(), "one worker per cpu");
+
+    enum { N = 5000 };
+    static count_task_t tasks[N];
+    atomic_int n = ATOMIC_VAR_INIT(0);
+    for (int i = 0; i < N; i++) {
+        tasks[i].task.func = count;
+        tasks[i].count = &n;
+        threadpool_post(pool, &tasks[i].task);
+    }
+    // Destroying the pool runs whatever is left.
+    threadpool_destroy(pool);
+    EXPECT_EQ(atomic_load(&n), N, "");
+    END_TEST;
+}
+
+// Sums [lo, hi) by splitting it in two until it is small, each half a task
+// of its own, as fork/join code on the pool would.
+typedef struct {
+    tp_task_t task;
+    threadpool_t* pool;
+    const uint32_t* data;
+    size_t lo, hi;
+    uint64_t sum;
+} sum_task_t;
+
+static void sum(tp_task_t* task) {
+    sum_task_t* t = (sum_task_t*)task;
+    if (t->hi - t->lo <= 64) {
+        t->sum = 0;
+        for (size_t i = t->lo; i < t->hi; i++)
+            t->sum += t->data[i];
+        return;
+    }
+    size_t mid = t->lo + (t->hi - t->lo) / 2;
+    sum_task_t halves[2] = {
+        {.task.func = sum, .pool = t->pool, .data = t->data, .lo = t->lo, .hi = mid},
+        {.task.func = sum, .pool = t->pool, .data = t->data, .lo = mid, .hi = t->hi},
+    };
+    tp_group_t group = TP_GROUP_INIT;
+    threadpool_post_group(t->pool, &group, &halves[0].task);
+    threadpool_post_group(t->pool, &group, &halves[1].task);
+    threadpool_group_wait(t->pool, &group);
+    t->sum = halves[0].sum + halves[1].sum;
+}
+
+static bool fork_join_test(void) {
+    BEGIN_TEST;
+    threadpool_t* pool;
+    ASSERT_EQ(threadpool_create(4, "tp-test", &pool), MX_OK, "");
+    EXPECT_EQ(threadpool_size(pool), 4u, "");
+
+    enum { N = 1 << 16 };
+    uint32_t* data = malloc(N * sizeof(uint32_t));
+    ASSERT_NONNULL(data, "");
+    uint64_t want = 0;
+    for (uint32_t i = 0; i < N; i++) {
+        data[i] = i * 2654435761u;
+        want += data[i];
+    }
+
+    sum_task_t root = {.task.func = sum, .pool = pool, .data = data, .lo = 0, .hi = N};
+    tp_group_t group = TP_GROUP_INIT;
+    threadpool_post_group(pool, &group, &root.task);
+    threadpool_group_wait(pool, &group);
+    EXPECT_EQ(root.sum, want, "");
+
+    threadpool_destroy(pool);
+    free(data);
+    END_TEST;
+}
+
+typedef struct {
+    tp_wait_t wait;
+    mx_signals_t observed;
+    mx_handle_t done;
+} signal_wait_t;
+
+static void on_signal(tp_wait_t* wait, mx_signals_t observed) {
+    signal_wait_t* w = (signal_wait_t*)wait;
+    w->observed = observed;
+    mx_object_signal(w->done, 0, MX_USER_SIGNAL_0);
+}
+
+static bool wait_async_test(void) {
+    BEGIN_TEST;
+    threadpool_t* pool;
+    ASSERT_EQ(threadpool_create(2, "tp-test", &pool), MX_OK, "");
+
+    mx_handle_t event, done;
+    ASSERT_EQ(mx_event_create(0, &event), MX_OK, "");
+    ASSERT_EQ(mx_event_create(0, &done), MX_OK, "");
+    signal_wait_t w = {
+        .wait = {.handle = event, .waitfor = MX_USER_SIGNAL_1, .func = on_signal},
+        .done = done,
+    };
+    ASSERT_EQ(threadpool_wait_async(pool, &w.wait), MX_OK, "");
+    ASSERT_EQ(mx_object_signal(event, 0, MX_USER_SIGNAL_1), MX_OK, "");
+    ASSERT_EQ(mx_object_wait_one(done, MX_USER_SIGNAL_0, MX_TIME_INFINITE, NULL), MX_OK, "");
+    EXPECT_TRUE(w.observed & MX_USER_SIGNAL_1, "");
+
+    threadpool_destroy(pool);
+    mx_handle_close(event);
+    mx_handle_close(done);
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(threadpool_tests)
+RUN_TEST(post_test)
+RUN_TEST(fork_join_test)
+RUN_TEST(wait_async_test)
+END_TEST_CASE(threadpool_tests)
+
+int main(int argc, char** argv) {
+    return unittest_run_all_tests(argc, argv) ? 0 : -1;
+}
@@ -179,10 +179,25 @@ bool vdso_map_code_wrong_test() {
     END_TEST;
 }
 
+bool vdso_cpu_hint_test() {
+    BEGIN_TEST;
+
+    uint32_t cpus = mx_system_get_num_cpus();
+    for (int i = 0; i < 1000; i++) {
+        uint32_t cpu = mx_system_get_cpu_hint();
+        if (cpu == UINT32_MAX)
+            break;
+        EXPECT_LT(cpu, cpus, "cpu hint out of range");
+    }
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(vdso_tests)
 RUN_TEST(vdso_map_twice_test);
 RUN_TEST(vdso_map_code_wrong_test);
 RUN_TEST(vdso_map_change_test);
+RUN_TEST(vdso_cpu_hint_test);
 END_TEST_CASE(vdso_tests)
 
 int main(int argc, char** argv) {
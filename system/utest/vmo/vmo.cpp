@@ -448,6 +448,76 @@ bool vmo_lookup_test() {
     END_TEST;
 }
 
+bool vmo_pin_test() {
+    BEGIN_TEST;
+
+    mx_handle_t vmo;
+    const size_t size = PAGE_SIZE * 4;
+    mx_paddr_t buf[size / PAGE_SIZE];
+    mx_paddr_t lookup[size / PAGE_SIZE];
+
+    EXPECT_EQ(MX_OK, mx_vmo_create(size, 0, &vmo), "vm_object_create");
+
+    // pinning commits the pages, and hands back where they are
+    memset(buf, 0, sizeof(buf));
+    EXPECT_EQ(MX_OK, mx_vmo_op_range(vmo, MX_VMO_OP_PIN, 0, size, buf, sizeof(buf)), "pin");
+    EXPECT_EQ(MX_OK, mx_vmo_op_range(vmo, MX_VMO_OP_LOOKUP, 0, size, lookup, sizeof(lookup)),
+              "lookup on pinned vmo");
+    for (size_t i = 0; i < countof(buf); i++) {
+        EXPECT_NEQ(0u, buf[i], "pinned address");
+        EXPECT_EQ(lookup[i], buf[i], "pinned address matches lookup");
+    }
+
+    // pinned pages can't be taken away
+    EXPECT_EQ(MX_ERR_BAD_STATE, mx_vmo_op_range(vmo, MX_VMO_OP_DECOMMIT, 0, PAGE_SIZE, nullptr, 0),
+              "decommit of pinned page");
+    EXPECT_EQ(MX_ERR_BAD_STATE, mx_vmo_set_size(vmo, PAGE_SIZE), "shrink over pinned pages");
+
+    // pins nest
+    EXPECT_EQ(MX_OK, mx_vmo_op_range(vmo, MX_VMO_OP_PIN, PAGE_SIZE, PAGE_SIZE, nullptr, 0), "pin");
+    EXPECT_EQ(MX_OK, mx_vmo_op_range(vmo, MX_VMO_OP_UNPIN, 0, size, nullptr, 0), "unpin");
+    EXPECT_EQ(MX_ERR_BAD_STATE, mx_vmo_op_range(vmo, MX_VMO_OP_DECOMMIT, PAGE_SIZE, PAGE_SIZE,
+                                                nullptr, 0), "decommit of page pinned twice");
+    EXPECT_EQ(MX_OK, mx_vmo_op_range(vmo, MX_VMO_OP_DECOMMIT, 0, PAGE_SIZE, nullptr, 0),
+              "decommit of unpinned page");
+
+    // only a pin that was made can be unpinned, and only by its exact range
+    EXPECT_EQ(MX_ERR_NOT_FOUND, mx_vmo_op_range(vmo, MX_VMO_OP_UNPIN, 0, size, nullptr, 0),
+              "unpin of unpinned pages");
+    EXPECT_EQ(MX_ERR_NOT_FOUND, mx_vmo_op_range(vmo, MX_VMO_OP_UNPIN, PAGE_SIZE, 1, nullptr, 0),
+              "unpin of part of a pin");
+    EXPECT_EQ(MX_OK, mx_vmo_op_range(vmo, MX_VMO_OP_UNPIN, PAGE_SIZE, PAGE_SIZE, nullptr, 0),
+              "unpin");
+    EXPECT_EQ(MX_OK, mx_vmo_op_range(vmo, MX_VMO_OP_DECOMMIT, 0, size, nullptr, 0), "decommit");
+
+    // pinning and unpinning need the write right
+    mx_handle_t ro_vmo;
+    EXPECT_EQ(MX_OK, mx_handle_duplicate(vmo, MX_RIGHT_READ | MX_RIGHT_MAP, &ro_vmo), "duplicate");
+    EXPECT_EQ(MX_ERR_ACCESS_DENIED, mx_vmo_op_range(ro_vmo, MX_VMO_OP_PIN, 0, size, nullptr, 0),
+              "pin without write right");
+    EXPECT_EQ(MX_OK, mx_vmo_op_range(vmo, MX_VMO_OP_PIN, 0, size, nullptr, 0), "pin");
+    EXPECT_EQ(MX_ERR_ACCESS_DENIED, mx_vmo_op_range(ro_vmo, MX_VMO_OP_UNPIN, 0, size, nullptr, 0),
+              "unpin without write right");
+    EXPECT_EQ(MX_OK, mx_vmo_op_range(vmo, MX_VMO_OP_UNPIN, 0, size, nullptr, 0), "unpin");
+    EXPECT_EQ(MX_OK, mx_handle_close(ro_vmo), "handle_close");
+
+    // invalid args
+    EXPECT_EQ(MX_ERR_INVALID_ARGS, mx_vmo_op_range(vmo, MX_VMO_OP_PIN, 0, 0, nullptr, 0),
+              "zero size pin");
+    EXPECT_EQ(MX_ERR_OUT_OF_RANGE, mx_vmo_op_range(vmo, MX_VMO_OP_PIN, 0, size + 1, nullptr, 0),
+              "pin out of range");
+    EXPECT_EQ(MX_ERR_BUFFER_TOO_SMALL, mx_vmo_op_range(vmo, MX_VMO_OP_PIN, 0, size, buf,
+                                                       sizeof(buf[0])), "buffer too small");
+    // a failed pin leaves nothing pinned
+    EXPECT_EQ(MX_OK, mx_vmo_op_range(vmo, MX_VMO_OP_DECOMMIT, 0, size, nullptr, 0), "decommit");
+
+    // pins still held when the last handle goes are dropped with it
+    EXPECT_EQ(MX_OK, mx_vmo_op_range(vmo, MX_VMO_OP_PIN, 0, size, nullptr, 0), "pin");
+    EXPECT_EQ(MX_OK, mx_handle_close(vmo), "handle_close");
+
+    END_TEST;
+}
+
 bool vmo_commit_test() {
     BEGIN_TEST;
 
@@ -536,6 +606,69 @@ bool vmo_commit_test() {
     END_TEST;
 }
 
+bool vmo_hint_test() {
+    BEGIN_TEST;
+
+    mx_handle_t vmo;
+    const size_t size = PAGE_SIZE * 4;
+    mx_paddr_t buf[size / PAGE_SIZE];
+    mx_signals_t pending;
+
+    EXPECT_EQ(MX_OK, mx_vmo_create(size, 0, &vmo), "vm_object_create");
+
+    // nothing is being prefetched yet
+    EXPECT_EQ(MX_OK, mx_object_wait_one(vmo, MX_VMO_PREFETCHED, 0u, &pending), "wait");
+    EXPECT_TRUE(pending & MX_VMO_PREFETCHED, "prefetched");
+
+    // a prefetch commits the pages behind our back
+    EXPECT_EQ(MX_OK, mx_vmo_op_range(vmo, MX_VMO_OP_WILLNEED, 0, size, nullptr, 0), "willneed");
+    EXPECT_EQ(MX_OK, mx_object_wait_one(vmo, MX_VMO_PREFETCHED, MX_TIME_INFINITE, &pending),
+              "wait for prefetch");
+
+    // access pattern and reclaim hints take any range within the vmo
+    EXPECT_EQ(MX_OK, mx_vmo_op_range(vmo, MX_VMO_OP_SEQUENTIAL, 0, size, nullptr, 0), "sequential");
+    EXPECT_EQ(MX_OK, mx_vmo_op_range(vmo, MX_VMO_OP_RANDOM, 0, size, nullptr, 0), "random");
+    EXPECT_EQ(MX_OK, mx_vmo_op_range(vmo, MX_VMO_OP_NORMAL, 0, size, nullptr, 0), "normal");
+    EXPECT_EQ(MX_OK, mx_vmo_op_range(vmo, MX_VMO_OP_DONTNEED, 0, size, nullptr, 0), "dontneed");
+
+    EXPECT_EQ(MX_OK, mx_vmo_op_range(vmo, MX_VMO_OP_LOOKUP, 0, size, buf, sizeof(buf)),
+              "lookup on prefetched vmo");
+    for (auto addr: buf)
+        EXPECT_NEQ(0u, addr, "looked up address");
+
+    // invalid args
+    EXPECT_EQ(MX_ERR_OUT_OF_RANGE, mx_vmo_op_range(vmo, MX_VMO_OP_WILLNEED, 0, size + 1,
+                                                   nullptr, 0), "willneed out of range");
+    EXPECT_EQ(MX_ERR_OUT_OF_RANGE, mx_vmo_op_range(vmo, MX_VMO_OP_DONTNEED, size + 1, 1,
+                                                   nullptr, 0), "dontneed out of range");
+
+    // hints that change what is resident need the right to write
+    mx_handle_t ro_vmo;
+    EXPECT_EQ(MX_OK, mx_handle_duplicate(vmo, MX_RIGHT_READ | MX_RIGHT_DUPLICATE, &ro_vmo),
+              "duplicate");
+    EXPECT_EQ(MX_ERR_ACCESS_DENIED, mx_vmo_op_range(ro_vmo, MX_VMO_OP_WILLNEED, 0, size,
+                                                    nullptr, 0), "willneed without write");
+    EXPECT_EQ(MX_ERR_ACCESS_DENIED, mx_vmo_op_range(ro_vmo, MX_VMO_OP_DONTNEED, 0, size,
+                                                    nullptr, 0), "dontneed without write");
+    EXPECT_EQ(MX_OK, mx_handle_close(ro_vmo), "handle_close");
+
+    EXPECT_EQ(MX_OK, mx_handle_close(vmo), "handle_close");
+
+    // a range too big to commit right away is left to the prefetch threads
+    const size_t big_size = PAGE_SIZE * 256;
+    mx_paddr_t big_buf[big_size / PAGE_SIZE];
+    EXPECT_EQ(MX_OK, mx_vmo_create(big_size, 0, &vmo), "vm_object_create");
+    EXPECT_EQ(MX_OK, mx_vmo_op_range(vmo, MX_VMO_OP_WILLNEED, 0, big_size, nullptr, 0),
+              "willneed");
+    EXPECT_EQ(MX_OK, mx_object_wait_one(vmo, MX_VMO_PREFETCHED, MX_TIME_INFINITE, &pending),
+              "wait for prefetch");
+    EXPECT_EQ(MX_OK, mx_vmo_op_range(vmo, MX_VMO_OP_LOOKUP, 0, big_size, big_buf,
+                                     sizeof(big_buf)), "lookup on prefetched vmo");
+    EXPECT_EQ(MX_OK, mx_handle_close(vmo), "handle_close");
+
+    END_TEST;
+}
+
 bool vmo_zero_page_test() {
     BEGIN_TEST;
 
@@ -1004,6 +1137,8 @@ RUN_TEST(vmo_resize_test);
 RUN_TEST(vmo_rights_test);
 RUN_TEST(vmo_lookup_test);
 RUN_TEST(vmo_commit_test);
+RUN_TEST(vmo_pin_test);
+RUN_TEST(vmo_hint_test);
 RUN_TEST(vmo_decommit_misaligned_test);
 RUN_TEST(vmo_cache_test);
 RUN_TEST(vmo_zero_page_test);
@@ -34,9 +34,28 @@
 
 /* Definitions for doing the crc four data bytes at a time. */
 #if !defined(NOBYFOUR) && defined(Z_U4)
-#error
 #  define BYFOUR
 #endif
+
+/* ARMv8 has instructions for this very polynomial. */
+#if defined(__ARM_FEATURE_CRC32)
+#  include <arm_acle.h>
+   local unsigned long crc32_arm OF((unsigned long,
+                        const unsigned char FAR *, unsigned));
+#endif
+
+/* On x86-64, fold 64 bytes at a time with carry-less multiplies, if the CPU
+   has them.  The kernel doesn't touch vector registers, so only user space
+   gets this. */
+#if defined(__x86_64__) && !defined(_KERNEL)
+#  define CRC32_PCLMUL
+#  include <cpuid.h>
+#  include <immintrin.h>
+#  define PCLMUL_MIN_LEN 64
+   local int have_pclmul OF((void));
+   local uint32_t crc32_pclmul OF((uint32_t, const unsigned char FAR *,
+                        unsigned));
+#endif
 #ifdef BYFOUR
    local unsigned long crc32_little OF((unsigned long,
                         const unsigned char FAR *, unsigned));
@@ -214,6 +233,22 @@ unsigned long ZEXPORT crc32(crc, buf, len)
         make_crc_table();
 #endif /* DYNAMIC_CRC_TABLE */
 
+#if defined(__ARM_FEATURE_CRC32)
+    return crc32_arm(crc, buf, len);
+#endif
+
+#ifdef CRC32_PCLMUL
+    if (len >= PCLMUL_MIN_LEN && have_pclmul()) {
+        unsigned chunk = len & ~15U;
+        crc = ~crc32_pclmul(~(uint32_t)crc, buf, chunk);
+        crc &= 0xffffffffUL;
+        buf += chunk;
+        len -= chunk;
+        if (len == 0)
+            return crc;
+    }
+#endif
+
 #ifdef BYFOUR
     if (sizeof(void *) == sizeof(ptrdiff_t)) {
         z_crc_t endian;
@@ -236,6 +271,150 @@ unsigned long ZEXPORT crc32(crc, buf, len)
     return crc ^ 0xffffffffUL;
 }
 
+#if defined(__ARM_FEATURE_CRC32)
+
+/* ========================================================================= */
+local unsigned long crc32_arm(crc, buf, len)
+    unsigned long crc;
+    const unsigned char FAR *buf;
+    unsigned len;
+{
+    uint32_t c = ~(uint32_t)crc;
+    while (len && ((uintptr_t)buf & 7)) {
+        c = __crc32b(c, *buf++);
+        len--;
+    }
+    while (len >= 8) {
+        c = __crc32d(c, *(const uint64_t*)(const void*)buf);
+        buf += 8;
+        len -= 8;
+    }
+    while (len--) {
+        c = __crc32b(c, *buf++);
+    }
+    return (unsigned long)~c;
+}
+
+#endif /* __ARM_FEATURE_CRC32 */
+
+#ifdef CRC32_PCLMUL
+
+/* ========================================================================= */
+/* Whether the CPU has PCLMULQDQ and SSE4.1: 0 if not yet known, 1 if so, and
+   -1 if not.  Threads racing to find out all come to the same answer. */
+local int pclmul = 0;
+
+local int have_pclmul()
+{
+    int use = __atomic_load_n(&pclmul, __ATOMIC_RELAXED);
+    if (use == 0) {
+        unsigned int eax, ebx, ecx, edx;
+        use = -1;
+        if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) &&
+            (ecx & bit_PCLMUL) && (ecx & bit_SSE4_1))
+            use = 1;
+        __atomic_store_n(&pclmul, use, __ATOMIC_RELAXED);
+    }
+    return use > 0;
+}
+
+/* ========================================================================= */
+/* The folding and Barrett reduction from Intel's "Fast CRC Computation for
+   Generic Polynomials Using PCLMULQDQ Instruction", with the constants for
+   the bit-reflected polynomial above.  |len| is at least 64 and a multiple
+   of 16, and |crc| is neither pre- nor post-conditioned here. */
+__attribute__((target("pclmul,sse4.1")))
+local uint32_t crc32_pclmul(crc, buf, len)
+    uint32_t crc;
+    const unsigned char FAR *buf;
+    unsigned len;
+{
+    static const uint64_t k1k2[2] __attribute__((aligned(16))) =
+        { 0x0154442bd4, 0x01c6e41596 };
+    static const uint64_t k3k4[2] __attribute__((aligned(16))) =
+        { 0x01751997d0, 0x00ccaa009e };
+    static const uint64_t k5k0[2] __attribute__((aligned(16))) =
+        { 0x0163cd6124, 0x0000000000 };
+    static const uint64_t poly[2] __attribute__((aligned(16))) =
+        { 0x01db710641, 0x01f7011641 };
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+    x1 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+    x2 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+    x3 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+    x4 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+    x0 = _mm_load_si128((const __m128i *)k1k2);
+    buf += 64;
+    len -= 64;
+
+    /* Fold four lanes of 128 bits in parallel. */
+    while (len >= 64) {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+                           _mm_loadu_si128((const __m128i *)(buf + 0x00)));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6),
+                           _mm_loadu_si128((const __m128i *)(buf + 0x10)));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7),
+                           _mm_loadu_si128((const __m128i *)(buf + 0x20)));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8),
+                           _mm_loadu_si128((const __m128i *)(buf + 0x30)));
+        buf += 64;
+        len -= 64;
+    }
+
+    /* Fold the four lanes into one. */
+    x0 = _mm_load_si128((const __m128i *)k3k4);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    /* Then the rest, 16 bytes at a time. */
+    while (len >= 16) {
+        x2 = _mm_loadu_si128((const __m128i *)buf);
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+        buf += 16;
+        len -= 16;
+    }
+
+    /* 128 bits down to 64. */
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+    x0 = _mm_loadl_epi64((const __m128i *)k5k0);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    /* Barrett reduction down to 32. */
+    x0 = _mm_load_si128((const __m128i *)poly);
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return (uint32_t)_mm_extract_epi32(x1, 1);
+}
+
+#endif /* CRC32_PCLMUL */
+
 #ifdef BYFOUR
 
 /* ========================================================================= */
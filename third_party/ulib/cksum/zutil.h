@@ -12,9 +12,13 @@ typedef uint8_t Byte;
 typedef Byte Bytef;
 typedef off_t z_off_t;
 typedef int64_t z_off64_t;
-typedef unsigned long z_crc_t;
+typedef uint32_t z_crc_t;
 
-//#define Z_U4 uint32_t
+// A 32-bit type, so that crc32() can use the four-byte-at-a-time tables.
+#define Z_U4 uint32_t
+
+#define ZSWAP32(q) ((((q) >> 24) & 0xff) + (((q) >> 8) & 0xff00) + \
+                    (((q) & 0xff00) << 8) + (((q) & 0xff) << 24))
 
 
 #define Z_NULL NULL
@@ -444,6 +444,11 @@ extern unsigned	opt_narenas;
 /* Number of CPUs. */
 extern unsigned	ncpus;
 
+#ifdef __Fuchsia__
+/* Whether threads use the arena of whichever CPU they are running on. */
+extern bool	percpu_arenas;
+#endif
+
 /* Number of arenas used for automatic multiplexing of threads and arenas. */
 extern unsigned	narenas_auto;
 
@@ -480,6 +485,9 @@ unsigned	narenas_total_get(void);
 arena_t	*arena_init(tsdn_t *tsdn, unsigned ind, extent_hooks_t *extent_hooks);
 arena_tdata_t	*arena_tdata_get_hard(tsd_t *tsd, unsigned ind);
 arena_t	*arena_choose_hard(tsd_t *tsd, bool internal);
+#ifdef __Fuchsia__
+arena_t	*arena_choose_percpu(tsd_t *tsd, arena_t *arena);
+#endif
 void	arena_migrate(tsd_t *tsd, unsigned oldind, unsigned newind);
 void	iarena_cleanup(tsd_t *tsd);
 void	arena_cleanup(tsd_t *tsd);
@@ -835,6 +843,11 @@ arena_choose_impl(tsd_t *tsd, arena_t *arena, bool internal)
 	ret = internal ? tsd_iarena_get(tsd) : tsd_arena_get(tsd);
 	if (unlikely(ret == NULL))
 		ret = arena_choose_hard(tsd, internal);
+#ifdef __Fuchsia__
+	if (percpu_arenas && !internal && likely(ret != NULL) &&
+	    tsd_nominal(tsd))
+		ret = arena_choose_percpu(tsd, ret);
+#endif
 
 	return (ret);
 }
@@ -19,6 +19,10 @@ static const bool pages_can_purge_forced =
     ;
 
 void	*pages_map(void *addr, size_t size, bool *commit);
+#ifdef __Fuchsia__
+void	*pages_map_aligned(void *addr, size_t size, size_t alignment,
+    bool *commit);
+#endif
 void	pages_unmap(void *addr, size_t size);
 void	*pages_trim(void *addr, size_t alloc_size, size_t leadsize,
     size_t size, bool *commit);
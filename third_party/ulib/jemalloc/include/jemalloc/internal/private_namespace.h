@@ -9,6 +9,7 @@
 #define	arena_choose JEMALLOC_N(arena_choose)
 #define	arena_choose_hard JEMALLOC_N(arena_choose_hard)
 #define	arena_choose_impl JEMALLOC_N(arena_choose_impl)
+#define	arena_choose_percpu JEMALLOC_N(arena_choose_percpu)
 #define	arena_cleanup JEMALLOC_N(arena_cleanup)
 #define	arena_dalloc JEMALLOC_N(arena_dalloc)
 #define	arena_dalloc_bin_junked_locked JEMALLOC_N(arena_dalloc_bin_junked_locked)
@@ -337,11 +338,13 @@
 #define	pages_decommit JEMALLOC_N(pages_decommit)
 #define	pages_huge JEMALLOC_N(pages_huge)
 #define	pages_map JEMALLOC_N(pages_map)
+#define	pages_map_aligned JEMALLOC_N(pages_map_aligned)
 #define	pages_nohuge JEMALLOC_N(pages_nohuge)
 #define	pages_purge_forced JEMALLOC_N(pages_purge_forced)
 #define	pages_purge_lazy JEMALLOC_N(pages_purge_lazy)
 #define	pages_trim JEMALLOC_N(pages_trim)
 #define	pages_unmap JEMALLOC_N(pages_unmap)
+#define	percpu_arenas JEMALLOC_N(percpu_arenas)
 #define	pind2sz JEMALLOC_N(pind2sz)
 #define	pind2sz_compute JEMALLOC_N(pind2sz_compute)
 #define	pind2sz_lookup JEMALLOC_N(pind2sz_lookup)
@@ -9,6 +9,7 @@
 #undef arena_choose
 #undef arena_choose_hard
 #undef arena_choose_impl
+#undef arena_choose_percpu
 #undef arena_cleanup
 #undef arena_dalloc
 #undef arena_dalloc_bin_junked_locked
@@ -337,11 +338,13 @@
 #undef pages_decommit
 #undef pages_huge
 #undef pages_map
+#undef pages_map_aligned
 #undef pages_nohuge
 #undef pages_purge_forced
 #undef pages_purge_lazy
 #undef pages_trim
 #undef pages_unmap
+#undef percpu_arenas
 #undef pind2sz
 #undef pind2sz_compute
 #undef pind2sz_lookup
@@ -28,7 +28,15 @@ typedef struct tcaches_s tcaches_t;
  *
  * This constant must be an even number.
  */
+#ifdef __Fuchsia__
+/*
+ * Magenta processes tend to have many threads that each allocate little, so
+ * cap what each thread can keep hold of lower.
+ */
+#define	TCACHE_NSLOTS_SMALL_MAX		64
+#else
 #define	TCACHE_NSLOTS_SMALL_MAX		200
+#endif
 
 /* Number of cache slots for large size classes. */
 #define	TCACHE_NSLOTS_LARGE		20
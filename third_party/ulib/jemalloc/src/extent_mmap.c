@@ -51,6 +51,18 @@ extent_alloc_mmap(void *new_addr, size_t size, size_t alignment, bool *zero,
 
 	assert(alignment != 0);
 
+#ifdef __Fuchsia__
+	/*
+	 * The heap reservation can hand out aligned memory directly, and
+	 * never needs trimming.
+	 */
+	ret = pages_map_aligned(new_addr, size, alignment, commit);
+	if (ret != NULL) {
+		*zero = true;
+		return (ret);
+	}
+#endif
+
 	ret = pages_map(new_addr, size, commit);
 	if (ret == NULL || ret == new_addr)
 		return (ret);
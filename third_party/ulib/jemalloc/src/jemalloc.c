@@ -1,6 +1,11 @@
 #define	JEMALLOC_C_
 #include "jemalloc/internal/jemalloc_internal.h"
 
+#ifdef __Fuchsia__
+#include <magenta/malloc.h>
+#include <magenta/syscalls.h>
+#endif
+
 /******************************************************************************/
 /* Data. */
 
@@ -46,6 +51,10 @@ unsigned	opt_narenas = 0;
 
 unsigned	ncpus;
 
+#ifdef __Fuchsia__
+bool	percpu_arenas;
+#endif
+
 /* Protects arenas initialization. */
 static malloc_mutex_t	arenas_lock;
 /*
@@ -546,6 +555,38 @@ label_return:
 	return (tdata);
 }
 
+#ifdef __Fuchsia__
+/*
+ * Called by arena_choose(), moving the thread to the arena of the CPU it is
+ * on, along with its tcache.
+ */
+arena_t *
+arena_choose_percpu(tsd_t *tsd, arena_t *arena)
+{
+	unsigned oldind, newind;
+	arena_t *newarena;
+
+	oldind = arena_ind_get(arena);
+	newind = mx_system_get_cpu_hint() % narenas_auto;
+	/* Leave alone threads that were bound to a manual arena. */
+	if (likely(oldind == newind) || oldind >= narenas_auto)
+		return (arena);
+
+	newarena = arena_get(tsd_tsdn(tsd), newind, true);
+	if (newarena == NULL)
+		return (arena);
+	arena_migrate(tsd, oldind, newind);
+	if (config_tcache) {
+		tcache_t *tcache = tsd_tcache_get(tsd);
+		if (tcache != NULL) {
+			tcache_arena_reassociate(tsd_tsdn(tsd), tcache, arena,
+			    newarena);
+		}
+	}
+	return (newarena);
+}
+#endif
+
 /* Slow path, called only by arena_choose(). */
 arena_t *
 arena_choose_hard(tsd_t *tsd, bool internal)
@@ -1268,6 +1309,19 @@ malloc_init_hard_finish(tsdn_t *tsdn)
 	if (malloc_mutex_boot())
 		return (true);
 
+#ifdef __Fuchsia__
+	/*
+	 * Rather than spread threads over several arenas per CPU, which with
+	 * many threads leaves much of each arena idle, give each CPU one arena
+	 * for whichever thread is running there.  That needs the vDSO to tell
+	 * which CPU that is.
+	 */
+	if (opt_narenas == 0 && ncpus > 1 &&
+	    mx_system_get_cpu_hint() != UINT32_MAX) {
+		opt_narenas = ncpus;
+		percpu_arenas = true;
+	}
+#endif
 	if (opt_narenas == 0) {
 		/*
 		 * For SMP systems, create more than one arena per CPU by
@@ -2701,6 +2755,55 @@ je_malloc_usable_size(JEMALLOC_USABLE_SIZE_CONST void *ptr)
 	return (ret);
 }
 
+#ifdef __Fuchsia__
+static bool
+malloc_stat_read(const char *name, size_t *value)
+{
+	size_t sz = sizeof(*value);
+
+	return (je_mallctl(name, value, &sz, NULL, 0) != 0);
+}
+
+JEMALLOC_EXPORT mx_status_t JEMALLOC_NOTHROW
+malloc_get_info(uint32_t topic, void *buffer, size_t buffer_size,
+    size_t *actual, size_t *avail)
+{
+	malloc_info_stats_t stats;
+	uint64_t epoch = 1;
+	size_t sz = sizeof(epoch);
+
+	if (topic != MALLOC_INFO_STATS)
+		return (MX_ERR_INVALID_ARGS);
+	if (!config_stats)
+		return (MX_ERR_NOT_SUPPORTED);
+	if (actual != NULL)
+		*actual = 0;
+	if (avail != NULL)
+		*avail = 1;
+	if (buffer_size < sizeof(stats))
+		return (MX_ERR_BUFFER_TOO_SMALL);
+
+	/* The totals are only gathered up when the epoch is advanced. */
+	if (je_mallctl("epoch", &epoch, &sz, &epoch, sz) != 0)
+		return (MX_ERR_INTERNAL);
+	memset(&stats, 0, sizeof(stats));
+	if (malloc_stat_read("stats.allocated", &stats.allocated) ||
+	    malloc_stat_read("stats.active", &stats.active) ||
+	    malloc_stat_read("stats.metadata", &stats.metadata) ||
+	    malloc_stat_read("stats.resident", &stats.resident) ||
+	    malloc_stat_read("stats.mapped", &stats.mapped) ||
+	    malloc_stat_read("stats.retained", &stats.retained))
+		return (MX_ERR_INTERNAL);
+	stats.narenas = narenas_auto;
+	stats.percpu_arenas = percpu_arenas;
+
+	memcpy(buffer, &stats, sizeof(stats));
+	if (actual != NULL)
+		*actual = 1;
+	return (MX_OK);
+}
+#endif
+
 /*
  * End non-standard functions.
  */
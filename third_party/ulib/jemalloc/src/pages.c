@@ -24,6 +24,104 @@ static bool	os_overcommits;
 
 static const char mmap_vmo_name[] = "jemalloc-heap";
 
+/*
+ * The heap lives in one large sub-VMAR with a single VMO mapped across all of
+ * it, so that growing the heap is a matter of handing out the next piece of
+ * the reservation, and commit and decommit only add or drop the VMO's pages
+ * instead of cycling mappings.  Since jemalloc retains the virtual memory of
+ * extents it's done with, pieces are never given back, and once the
+ * reservation is used up the heap continues with a VMO per mapping.
+ */
+#if (LG_SIZEOF_PTR == 3)
+#  define HEAP_RESERVE_SIZE	((size_t)1 << 36)
+#else
+#  define HEAP_RESERVE_SIZE	((size_t)0)
+#endif
+
+static mx_handle_t	heap_vmo = MX_HANDLE_INVALID;
+static uintptr_t	heap_base;
+static size_t		heap_size;
+/* Offset of the first byte of the reservation not yet handed out. */
+static size_t		heap_next;
+
+static void fuchsia_heap_reserve(void) {
+	if (HEAP_RESERVE_SIZE == 0)
+		return;
+
+	mx_handle_t vmar;
+	uintptr_t base;
+	if (_mx_vmar_allocate(_mx_vmar_root_self(), 0, HEAP_RESERVE_SIZE,
+	    MX_VM_FLAG_CAN_MAP_READ | MX_VM_FLAG_CAN_MAP_WRITE |
+	    MX_VM_FLAG_CAN_MAP_SPECIFIC, &vmar, &base) < 0)
+		return;
+
+	mx_handle_t vmo;
+	uintptr_t ptr;
+	if (_mx_vmo_create(HEAP_RESERVE_SIZE, 0, &vmo) < 0)
+		goto fail;
+	_mx_object_set_property(vmo, MX_PROP_NAME, mmap_vmo_name, strlen(mmap_vmo_name));
+
+	if (_mx_vmar_map(vmar, 0, vmo, 0, HEAP_RESERVE_SIZE,
+	    MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE | MX_VM_FLAG_SPECIFIC,
+	    &ptr) < 0) {
+		_mx_handle_close(vmo);
+		goto fail;
+	}
+
+	/* The mapping keeps the region alive without the VMAR handle. */
+	_mx_handle_close(vmar);
+	heap_vmo = vmo;
+	heap_base = base;
+	heap_size = HEAP_RESERVE_SIZE;
+	return;
+
+fail:
+	_mx_vmar_destroy(vmar);
+	_mx_handle_close(vmar);
+}
+
+static bool fuchsia_heap_contains(void* addr, size_t size) {
+	uintptr_t ptr = (uintptr_t)addr;
+	return (heap_size != 0 && ptr >= heap_base &&
+	    ptr - heap_base + size <= heap_size);
+}
+
+/*
+ * Carve |size| bytes aligned to |alignment| from the reservation, or at |addr|
+ * if given, which works only when |addr| is where the reservation continues.
+ * Huge allocations are placed on huge page boundaries, so that they can be
+ * backed by large mappings.
+ */
+static void* fuchsia_heap_alloc(void* addr, size_t size, size_t alignment) {
+	if (heap_size == 0)
+		return NULL;
+	if (size >= HUGEPAGE && alignment < HUGEPAGE)
+		alignment = HUGEPAGE;
+
+	size_t next, offset;
+	do {
+		next = atomic_read_zu(&heap_next);
+		if (addr != NULL) {
+			if ((uintptr_t)addr != heap_base + next)
+				return NULL;
+			offset = next;
+		} else {
+			offset = ALIGNMENT_CEILING(heap_base + next, alignment) -
+			    heap_base;
+		}
+		if (offset < next || offset > heap_size ||
+		    size > heap_size - offset)
+			return NULL;
+	} while (atomic_cas_zu(&heap_next, next, offset + size));
+
+	return (void*)(heap_base + offset);
+}
+
+static bool fuchsia_heap_op(void* addr, size_t size, uint32_t op) {
+	uint64_t offset = (uintptr_t)addr - heap_base;
+	return (_mx_vmo_op_range(heap_vmo, op, offset, size, NULL, 0) != MX_OK);
+}
+
 void* fuchsia_pages_map(void* start, size_t len, bool commit, bool fixed) {
 	uint32_t mx_flags = 0u;
 	if (commit)
@@ -93,12 +191,19 @@ fail:
 	return NULL;
 }
 
-static void* fuchsia_pages_alloc(void* addr, size_t size, bool commit) {
+static void* fuchsia_pages_alloc(void* addr, size_t size, bool* commit) {
+	void* ret = fuchsia_heap_alloc(addr, size, PAGE);
+	if (ret != NULL) {
+		/* Reservation pages are faulted in on first touch. */
+		*commit = true;
+		return ret;
+	}
+
 	/*
 	 * We don't use fixed=false here, because it can cause the *replacement*
 	 * of existing mappings, and we only want to create new mappings.
 	 */
-	void* ret = fuchsia_pages_map(addr, size, commit, /* fixed */ false);
+	ret = fuchsia_pages_map(addr, size, *commit, /* fixed */ false);
 	if (addr != NULL && ret != addr && ret != NULL) {
 		/*
 		 * We succeeded in mapping memory, but not in the right place.
@@ -111,6 +216,14 @@ static void* fuchsia_pages_alloc(void* addr, size_t size, bool commit) {
 
 static int fuchsia_pages_free(void* addr, size_t size) {
 	uintptr_t ptr = (uintptr_t)addr;
+	if (fuchsia_heap_contains(addr, size)) {
+		/*
+		 * The reservation's addresses are never reused, so all that
+		 * is left to give back is the memory.
+		 */
+		fuchsia_heap_op(addr, size, MX_VMO_OP_DECOMMIT);
+		return 0;
+	}
 	mx_status_t status = _mx_vmar_unmap(_mx_vmar_root_self(), ptr, size);
 	if (status < 0) {
 		errno = EINVAL;
@@ -130,6 +243,11 @@ static void* fuchsia_pages_trim(void* ret, void* addr, size_t size, size_t alloc
 }
 
 static bool fuchsia_pages_commit(void* addr, size_t size, bool commit) {
+	if (fuchsia_heap_contains(addr, size)) {
+		return fuchsia_heap_op(addr, size,
+		    commit ? MX_VMO_OP_COMMIT : MX_VMO_OP_DECOMMIT);
+	}
+
 	void *result = fuchsia_pages_map(addr, size, commit, /* fixed */ true);
 	if (result == NULL)
 		return (true);
@@ -144,6 +262,15 @@ static bool fuchsia_pages_commit(void* addr, size_t size, bool commit) {
 	return (false);
 }
 
+void *
+pages_map_aligned(void *addr, size_t size, size_t alignment, bool *commit)
+{
+	void *ret = fuchsia_heap_alloc(addr, size, alignment);
+	if (ret != NULL)
+		*commit = true;
+	return (ret);
+}
+
 #endif
 
 void *
@@ -164,7 +291,7 @@ pages_map(void *addr, size_t size, bool *commit)
 	ret = VirtualAlloc(addr, size, MEM_RESERVE | (*commit ? MEM_COMMIT : 0),
 	    PAGE_READWRITE);
 #elif __Fuchsia__
-	ret = fuchsia_pages_alloc(addr, size, *commit);
+	ret = fuchsia_pages_alloc(addr, size, commit);
 #else
 	/*
 	 * We don't use MAP_FIXED here, because it can cause the *replacement*
@@ -418,6 +545,9 @@ pages_boot(void)
 #if !defined(_WIN32) && !defined(__Fuchsia__)
 	mmap_flags = MAP_PRIVATE | MAP_ANON;
 #endif
+#ifdef __Fuchsia__
+	fuchsia_heap_reserve();
+#endif
 
 #ifdef JEMALLOC_SYSCTL_VM_OVERCOMMIT
 	os_overcommits = os_overcommits_sysctl();
@@ -8,7 +8,9 @@ extern "C" {
 
 #include <bits/errno.h>
 
-int* __errno_location(void);
+// The same for the life of the thread, so the compiler may reuse it
+// across any number of errno accesses in a function.
+__attribute__((__const__)) int* __errno_location(void);
 #define errno (*__errno_location())
 
 #ifdef _GNU_SOURCE
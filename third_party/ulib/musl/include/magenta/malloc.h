@@ -0,0 +1,44 @@
+#pragma once
+
+#include <magenta/types.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The topics of malloc_get_info().
+#define MALLOC_INFO_STATS 1 // malloc_info_stats_t[1]
+
+// The whole heap's totals, in bytes, as of the call.
+typedef struct malloc_info_stats {
+    // held by the program
+    size_t allocated;
+    // in pages holding any allocation
+    size_t active;
+    // used by the allocator itself
+    size_t metadata;
+    // in physical pages the heap has touched, which is at least active
+    size_t resident;
+    // in mappings the allocator uses
+    size_t mapped;
+    // of address space kept for reuse, not counted in mapped
+    size_t retained;
+    // how many arenas the heap is spread over
+    uint32_t narenas;
+    // whether each cpu has an arena of its own, shared by the threads
+    // running there, instead of each thread being given one
+    uint32_t percpu_arenas;
+} malloc_info_stats_t;
+
+// Reads out information about the heap the way mx_object_get_info() does
+// about a kernel object: |topic| says what, written to |buffer| as an
+// array of records, with how many written in |actual| and how many there
+// are in |avail|.
+mx_status_t malloc_get_info(uint32_t topic, void* buffer, size_t buffer_size,
+                            size_t* actual, size_t* avail);
+
+#ifdef __cplusplus
+}
+#endif
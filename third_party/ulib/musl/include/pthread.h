@@ -78,7 +78,7 @@ int pthread_detach(pthread_t);
 _Noreturn void pthread_exit(void*);
 int pthread_join(pthread_t, void**);
 
-pthread_t pthread_self(void);
+__attribute__((__const__)) pthread_t pthread_self(void);
 
 int pthread_equal(pthread_t, pthread_t);
 #ifndef __cplusplus
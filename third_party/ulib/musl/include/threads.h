@@ -59,7 +59,7 @@ int thrd_join(thrd_t, int*);
 int thrd_sleep(const struct timespec*, struct timespec*);
 void thrd_yield(void);
 
-thrd_t thrd_current(void);
+__attribute__((__const__)) thrd_t thrd_current(void);
 int thrd_equal(thrd_t, thrd_t);
 #ifndef __cplusplus
 #define thrd_equal(A, B) ((A) == (B))
@@ -95,6 +95,9 @@ struct dso {
         size_t* got;
     } * funcdescs;
     size_t* got;
+    // With lazy binding, the PLT relocations the resolver looks up.
+    size_t* lazy_rel;
+    size_t lazy_rel_stride;
     struct dso* buf[];
 };
 
@@ -113,6 +116,8 @@ static struct dso *head, *tail, *fini_head;
 static unsigned long long gencnt;
 static int runtime;
 static int ldd_mode;
+static int bind_now;
+static int lazy_binding;
 static int ldso_fail;
 static jmp_buf* rtld_fail;
 static pthread_rwlock_t lock;
@@ -372,7 +377,49 @@ static struct symdef find_sym(struct dso* dso, const char* s, int need_def) {
     return def;
 }
 
+/* While the startup relocations are done, every module is in place and
+ * none has run, so a name resolves the same way from wherever it is
+ * referenced. Each is then looked up through the modules only once,
+ * however many of them refer to it. */
+#define SYM_CACHE_SIZE 2048
+#define SYM_CACHE_PROBES 8
+
+struct sym_cache_entry {
+    const char* name;
+    uint32_t hash;
+    int need_def;
+    struct symdef def;
+};
+
+static struct sym_cache_entry sym_cache[SYM_CACHE_SIZE];
+static int sym_cache_enabled;
+
+__NO_SAFESTACK NO_ASAN
+static struct symdef find_sym_cached(const char* s, int need_def) {
+    if (!sym_cache_enabled)
+        return find_sym(head, s, need_def);
+    uint32_t h = gnu_hash(s);
+    size_t i = (h * 2 + need_def) % SYM_CACHE_SIZE;
+    for (int n = 0; n < SYM_CACHE_PROBES; n++, i = (i + 1) % SYM_CACHE_SIZE) {
+        struct sym_cache_entry* e = &sym_cache[i];
+        if (!e->name) {
+            struct symdef def = find_sym(head, s, need_def);
+            if (def.sym) {
+                e->name = s;
+                e->hash = h;
+                e->need_def = need_def;
+                e->def = def;
+            }
+            return def;
+        }
+        if (e->hash == h && e->need_def == need_def && !strcmp(e->name, s))
+            return e->def;
+    }
+    return find_sym(head, s, need_def);
+}
+
 __attribute__((__visibility__("hidden"))) ptrdiff_t __tlsdesc_static(void), __tlsdesc_dynamic(void);
+__attribute__((__visibility__("hidden"))) void __dl_runtime_resolve(void);
 
 __NO_SAFESTACK NO_ASAN static void do_relocs(struct dso* dso, size_t* rel,
                                              size_t rel_size, size_t stride) {
@@ -390,6 +437,10 @@ __NO_SAFESTACK NO_ASAN static void do_relocs(struct dso* dso, size_t* rel,
     size_t tls_val;
     size_t addend;
     int skip_relative = 0, reuse_addends = 0, save_slot = 0;
+    /* Tables are mostly sorted by symbol, so the same one often comes
+     * several times in a row. */
+    int last_sym_index = 0, last_lookup = -1;
+    struct symdef last_def = {};
 
     if (dso == &ldso) {
         /* Only ldso's REL table needs addend saving/reuse. */
@@ -410,14 +461,24 @@ __NO_SAFESTACK NO_ASAN static void do_relocs(struct dso* dso, size_t* rel,
             sym = syms + sym_index;
             name = strings + sym->st_name;
             ctx = type == REL_COPY ? head->next : head;
-            def = (sym->st_info & 0xf) == STT_SECTION ? (struct symdef){.dso = dso, .sym = sym}
-                                                      : find_sym(ctx, name, type == REL_PLT);
+            int lookup = type == REL_COPY ? 2 : type == REL_PLT;
+            if ((sym->st_info & 0xf) == STT_SECTION)
+                def = (struct symdef){.dso = dso, .sym = sym};
+            else if (sym_index == last_sym_index && lookup == last_lookup)
+                def = last_def;
+            else if (ctx == head)
+                def = find_sym_cached(name, type == REL_PLT);
+            else
+                def = find_sym(ctx, name, type == REL_PLT);
             if (!def.sym && (sym->st_shndx != SHN_UNDEF || sym->st_info >> 4 != STB_WEAK)) {
                 error("Error relocating %s: %s: symbol not found", dso->name, name);
                 if (runtime)
                     longjmp(*rtld_fail, 1);
                 continue;
             }
+            last_sym_index = sym_index;
+            last_lookup = lookup;
+            last_def = def;
         } else {
             sym = 0;
             def.sym = 0;
@@ -1152,6 +1213,60 @@ __NO_SAFESTACK NO_ASAN static void do_mips_relocs(struct dso* p, size_t* got) {
     }
 }
 
+/* Whether the PLT slots of |p| can be left for the first call to fill
+ * in. Those of a module linked with -z now are in RELRO. */
+__NO_SAFESTACK NO_ASAN static int can_bind_lazily(struct dso* p, size_t* dyn) {
+    size_t flags_1 = 0;
+    if (!lazy_binding || NEED_MIPS_GOT_RELOCS)
+        return 0;
+    if (!dyn[DT_PLTGOT] || !dyn[DT_PLTRELSZ])
+        return 0;
+    if ((dyn[0] & (1UL << DT_BIND_NOW)) || (dyn[DT_FLAGS] & DF_BIND_NOW))
+        return 0;
+    search_vec(p->dynv, &flags_1, DT_FLAGS_1);
+    return !(flags_1 & DF_1_NOW);
+}
+
+/* Points each PLT slot at the PLT code that calls __dl_runtime_resolve,
+ * which the linker left it holding relative to the load address. The
+ * other relocations in the table are done now. */
+__NO_SAFESTACK NO_ASAN static void do_lazy_relocs(struct dso* p, size_t* got, size_t* rel,
+                                                  size_t rel_size, size_t stride) {
+    p->lazy_rel = rel;
+    p->lazy_rel_stride = stride;
+    got[1] = (size_t)p;
+    got[2] = (size_t)&__dl_runtime_resolve;
+    for (; rel_size; rel += stride, rel_size -= stride * sizeof(size_t)) {
+        if (R_TYPE(rel[1]) == REL_PLT)
+            *(size_t*)laddr(p, rel[0]) += (size_t)p->base;
+        else
+            do_relocs(p, rel, stride * sizeof(size_t), stride);
+    }
+}
+
+/* Called from __dl_runtime_resolve: binds the |index|th PLT relocation
+ * of |p| and returns where the call goes. Threads may race to bind the
+ * same slot, but they all find the same definition. */
+__attribute__((__visibility__("hidden")))
+void* __dl_lazy_resolve(struct dso* p, size_t index) {
+    size_t* rel = p->lazy_rel + index * p->lazy_rel_stride;
+    Sym* sym = p->syms + R_SYM(rel[1]);
+    const char* name = p->strings + sym->st_name;
+
+    pthread_rwlock_rdlock(&lock);
+    struct symdef def = find_sym(head, name, 1);
+    pthread_rwlock_unlock(&lock);
+    if (!def.sym) {
+        debugmsg("Error relocating %s: %s: symbol not found\n", p->name, name);
+        __builtin_trap();
+    }
+
+    size_t addend = p->lazy_rel_stride > 2 ? rel[2] : 0;
+    void* target = laddr(def.dso, def.sym->st_value + addend);
+    atomic_store_explicit((_Atomic(void*)*)laddr(p, rel[0]), target, memory_order_relaxed);
+    return target;
+}
+
 __NO_SAFESTACK NO_ASAN static void reloc_all(struct dso* p) {
     size_t dyn[DYN_CNT];
     for (; p; p = p->next) {
@@ -1160,7 +1275,12 @@ __NO_SAFESTACK NO_ASAN static void reloc_all(struct dso* p) {
         decode_vec(p->dynv, dyn, DYN_CNT);
         if (NEED_MIPS_GOT_RELOCS)
             do_mips_relocs(p, laddr(p, dyn[DT_PLTGOT]));
-        do_relocs(p, laddr(p, dyn[DT_JMPREL]), dyn[DT_PLTRELSZ], 2 + (dyn[DT_PLTREL] == DT_RELA));
+        if (can_bind_lazily(p, dyn))
+            do_lazy_relocs(p, laddr(p, dyn[DT_PLTGOT]), laddr(p, dyn[DT_JMPREL]),
+                           dyn[DT_PLTRELSZ], 2 + (dyn[DT_PLTREL] == DT_RELA));
+        else
+            do_relocs(p, laddr(p, dyn[DT_JMPREL]), dyn[DT_PLTRELSZ],
+                      2 + (dyn[DT_PLTREL] == DT_RELA));
         do_relocs(p, laddr(p, dyn[DT_REL]), dyn[DT_RELSZ], 2);
         do_relocs(p, laddr(p, dyn[DT_RELA]), dyn[DT_RELASZ], 3);
 
@@ -1448,6 +1568,12 @@ __NO_SAFESTACK static void* dls3(mx_handle_t exec_vmo, int argc, char** argv) {
     if (ld_debug != NULL && ld_debug[0] != '\0')
         log_libs = true;
 
+    {
+        const char* ld_bind_now = getenv("LD_BIND_NOW");
+        if (ld_bind_now != NULL && ld_bind_now[0] != '\0')
+            bind_now = 1;
+    }
+
     {
         // Features like Intel Processor Trace require specific output in a
         // specific format. Thus this output has its own env var.
@@ -1554,10 +1680,17 @@ __NO_SAFESTACK static void* dls3(mx_handle_t exec_vmo, int argc, char** argv) {
         }
     }
 
+    /* Unless told otherwise, leave calls through the PLT to be bound the
+     * first time they are made; ldd wants every missing symbol now. */
+    lazy_binding = !bind_now && !ldd_mode;
+
     /* The main program must be relocated LAST since it may contin
      * copy relocations which depend on libraries' relocations. */
+    sym_cache_enabled = 1;
     reloc_all(app.next);
     reloc_all(&app);
+    sym_cache_enabled = 0;
+    lazy_binding = 0;
 
     update_tls_size();
     static_tls_cnt = tls_cnt;
@@ -1805,6 +1938,7 @@ static void* dlopen_internal(mx_handle_t vmo, const char* file, int mode) {
     rtld_fail = &jb;
     if (setjmp(*rtld_fail)) {
         /* Clean up anything new that was (partially) loaded */
+        lazy_binding = 0;
         if (p && p->deps)
             for (i = 0; p->deps[i]; i++)
                 if (p->deps[i]->global < 0)
@@ -1832,7 +1966,11 @@ static void* dlopen_internal(mx_handle_t vmo, const char* file, int mode) {
                     p->deps[i]->global = -1;
         if (!p->global)
             p->global = -1;
+        /* The resolver only searches the global namespace, so a library
+         * kept out of it is bound now. */
+        lazy_binding = !bind_now && !(mode & RTLD_NOW) && (mode & RTLD_GLOBAL);
         reloc_all(p);
+        lazy_binding = 0;
         if (p->deps)
             for (i = 0; p->deps[i]; i++)
                 if (p->deps[i]->global < 0)
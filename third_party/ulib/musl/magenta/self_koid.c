@@ -0,0 +1,39 @@
+#include <magenta/process.h>
+#include <magenta/syscalls.h>
+#include <magenta/syscalls/object.h>
+#include <stdatomic.h>
+
+#include "magenta_impl.h"
+#include "pthread_impl.h"
+
+static mx_koid_t get_koid(mx_handle_t handle) {
+    mx_info_handle_basic_t info;
+    if (_mx_object_get_info(handle, MX_INFO_HANDLE_BASIC, &info, sizeof(info),
+                            NULL, NULL) != MX_OK)
+        return MX_KOID_INVALID;
+    return info.koid;
+}
+
+// Neither koid can change, so each is only asked of the kernel the first
+// time it's wanted.  Threads racing to ask first all get the same answer.
+static atomic_uint_fast64_t process_koid;
+
+mx_koid_t _mx_process_self_koid(void) {
+    mx_koid_t koid = atomic_load_explicit(&process_koid, memory_order_relaxed);
+    if (koid == MX_KOID_INVALID) {
+        koid = get_koid(_mx_process_self());
+        atomic_store_explicit(&process_koid, koid, memory_order_relaxed);
+    }
+    return koid;
+}
+__typeof(mx_process_self_koid) mx_process_self_koid
+    __attribute__((weak, alias("_mx_process_self_koid")));
+
+mx_koid_t _mx_thread_self_koid(void) {
+    struct pthread* self = __pthread_self();
+    if (self->koid == MX_KOID_INVALID)
+        self->koid = get_koid(mxr_thread_get_handle(&self->mxr_thread));
+    return self->koid;
+}
+__typeof(mx_thread_self_koid) mx_thread_self_koid
+    __attribute__((weak, alias("_mx_thread_self_koid")));
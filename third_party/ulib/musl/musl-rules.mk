@@ -55,6 +55,7 @@ LOCAL_CFLAGS += -ffreestanding
 LOCAL_SRCS := \
     $(LOCAL_DIR)/magenta/get_startup_handle.c \
     $(LOCAL_DIR)/magenta/internal.c \
+    $(LOCAL_DIR)/magenta/self_koid.c \
     $(LOCAL_DIR)/magenta/thrd_get_mx_handle.c \
     $(LOCAL_DIR)/pthread/allocate.c \
     $(LOCAL_DIR)/pthread/pthread_atfork.c \
@@ -109,6 +110,7 @@ LOCAL_SRCS := \
     $(LOCAL_DIR)/pthread/pthread_mutexattr_setrobust.c \
     $(LOCAL_DIR)/pthread/pthread_mutexattr_settype.c \
     $(LOCAL_DIR)/pthread/pthread_once.c \
+    $(LOCAL_DIR)/pthread/pthread_rwlock_bias.c \
     $(LOCAL_DIR)/pthread/pthread_rwlock_destroy.c \
     $(LOCAL_DIR)/pthread/pthread_rwlock_init.c \
     $(LOCAL_DIR)/pthread/pthread_rwlock_rdlock.c \
@@ -813,6 +815,7 @@ LOCAL_SRCS := \
     $(LOCAL_DIR)/src/stdlib/ldiv.c \
     $(LOCAL_DIR)/src/stdlib/llabs.c \
     $(LOCAL_DIR)/src/stdlib/lldiv.c \
+    $(LOCAL_DIR)/src/stdlib/qsort.c \
     $(LOCAL_DIR)/src/stdlib/strtod.c \
     $(LOCAL_DIR)/src/stdlib/strtol.c \
     $(LOCAL_DIR)/src/stdlib/wcstod.c \
@@ -996,7 +999,6 @@ LOCAL_SRCS := \
     $(LOCAL_DIR)/third_party/math/tan.c \
     $(LOCAL_DIR)/third_party/math/tanf.c \
     $(LOCAL_DIR)/third_party/math/tgammal.c \
-    $(LOCAL_DIR)/third_party/smoothsort/qsort.c \
 
 # These refer to access.
 #    $(LOCAL_DIR)/pthread/sem_open.c \
@@ -1011,6 +1013,7 @@ LOCAL_SRCS := \
 ifeq ($(ARCH),arm64)
 LOCAL_SRCS += \
     $(LOCAL_DIR)/src/fenv/aarch64/fenv.S \
+    $(LOCAL_DIR)/src/ldso/aarch64/dlresolve.S \
     $(LOCAL_DIR)/src/ldso/aarch64/tlsdesc.S \
     $(LOCAL_DIR)/src/math/aarch64/fabs.S \
     $(LOCAL_DIR)/src/math/aarch64/fabsf.S \
@@ -1048,6 +1051,7 @@ LOCAL_SRCS += \
 else ifeq ($(SUBARCH),x86-64)
 LOCAL_SRCS += \
     $(LOCAL_DIR)/src/fenv/x86_64/fenv.S \
+    $(LOCAL_DIR)/src/ldso/x86_64/dlresolve.S \
     $(LOCAL_DIR)/src/ldso/x86_64/tlsdesc.S \
     $(LOCAL_DIR)/src/math/x86_64/__invtrigl.S \
     $(LOCAL_DIR)/src/math/x86_64/acosl.S \
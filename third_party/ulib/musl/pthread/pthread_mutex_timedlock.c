@@ -11,9 +11,16 @@ int pthread_mutex_timedlock(pthread_mutex_t* restrict m, const struct timespec*
     if (r != EBUSY)
         return r;
 
+    // Spin while nobody is asleep on the mutex, taking it if it comes
+    // free, rather than giving up the first time another thread beats us
+    // to it.
     int spins = 100;
-    while (spins-- && atomic_load(&m->_m_lock) && !atomic_load(&m->_m_waiters))
+    while (spins-- && !atomic_load(&m->_m_waiters)) {
+        if (!atomic_load_explicit(&m->_m_lock, memory_order_relaxed) &&
+            (r = pthread_mutex_trylock(m)) != EBUSY)
+            return r;
         a_spin();
+    }
 
     while ((r = pthread_mutex_trylock(m)) == EBUSY) {
         if (!(r = atomic_load(&m->_m_lock)))
@@ -0,0 +1,108 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "pthread_impl.h"
+
+#include <magenta/syscalls.h>
+
+// This follows BRAVO (Dice and Kogan, "BRAVO: Biased Locking for
+// Reader-Writer Locks", USENIX ATC 2019).  A biased reader touches only
+// its own slot, picked by hashing the lock and the thread, so readers of
+// one lock on different CPUs don't all bounce its cache line around.
+
+#define READER_SLOTS 1024
+#define INHIBIT_SLOTS 64
+
+// How much longer than a revocation took to keep the bias off after it.
+#define INHIBIT_FACTOR 9
+
+static _Atomic(pthread_rwlock_t*) reader_slots[READER_SLOTS];
+
+// When the bias may go back on, in ticks, for the locks hashing to each
+// slot.  Colliding locks only keep each other unbiased for longer.
+static _Atomic(uint64_t) inhibit_until[INHIBIT_SLOTS];
+
+static inline uintptr_t mix(uintptr_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    return x;
+}
+
+static inline bool biased(pthread_rwlock_t* rw) {
+    return !(atomic_load(&rw->_rw_waiters) & PTHREAD_RWLOCK_BIAS_OFF);
+}
+
+bool __pthread_rwlock_rdlock_biased(pthread_rwlock_t* rw) {
+    if (!biased(rw))
+        return false;
+
+    struct pthread* self = __pthread_self();
+    int i;
+    for (i = 0; i < PTHREAD_RWLOCK_SLOTS_HELD && self->rwlock_slots[i]; i++)
+        ;
+    if (i == PTHREAD_RWLOCK_SLOTS_HELD)
+        return false;
+
+    size_t slot = mix((uintptr_t)rw ^ ((uintptr_t)self << 16)) % READER_SLOTS;
+    pthread_rwlock_t* expected = NULL;
+    if (!atomic_compare_exchange_strong(&reader_slots[slot], &expected, rw))
+        return false;
+
+    // Either this sees the bias turned off, or the writer turning it off
+    // sees this slot taken.
+    if (!biased(rw)) {
+        atomic_store(&reader_slots[slot], NULL);
+        return false;
+    }
+    self->rwlock_slots[i] = slot + 1;
+    return true;
+}
+
+bool __pthread_rwlock_unlock_biased(pthread_rwlock_t* rw) {
+    struct pthread* self = __pthread_self();
+    for (int i = 0; i < PTHREAD_RWLOCK_SLOTS_HELD; i++) {
+        size_t slot = self->rwlock_slots[i];
+        if (slot && atomic_load_explicit(&reader_slots[slot - 1],
+                                         memory_order_relaxed) == rw) {
+            atomic_store(&reader_slots[slot - 1], NULL);
+            self->rwlock_slots[i] = 0;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool __pthread_rwlock_revoke(pthread_rwlock_t* rw, bool wait) {
+    if (!biased(rw))
+        return true;
+    atomic_fetch_or(&rw->_rw_waiters, PTHREAD_RWLOCK_BIAS_OFF);
+
+    uint64_t start = _mx_ticks_get();
+    for (size_t slot = 0; slot < READER_SLOTS; slot++) {
+        for (int spins = 0; atomic_load(&reader_slots[slot]) == rw; spins++) {
+            if (!wait)
+                return false;
+            if (spins < 100)
+                a_spin();
+            else
+                _mx_nanosleep(0);
+        }
+    }
+
+    uint64_t now = _mx_ticks_get();
+    atomic_store_explicit(&inhibit_until[mix((uintptr_t)rw) % INHIBIT_SLOTS],
+                          now + (now - start) * INHIBIT_FACTOR,
+                          memory_order_relaxed);
+    return true;
+}
+
+void __pthread_rwlock_rebias(pthread_rwlock_t* rw) {
+    if (biased(rw))
+        return;
+    uint64_t until = atomic_load_explicit(
+        &inhibit_until[mix((uintptr_t)rw) % INHIBIT_SLOTS], memory_order_relaxed);
+    if (_mx_ticks_get() >= until)
+        atomic_fetch_and(&rw->_rw_waiters, PTHREAD_RWLOCK_WAITERS_MASK);
+}
@@ -8,7 +8,8 @@ int pthread_rwlock_timedrdlock(pthread_rwlock_t* restrict rw, const struct times
         return r;
 
     int spins = 100;
-    while (spins-- && atomic_load(&rw->_rw_lock) && !atomic_load(&rw->_rw_waiters))
+    while (spins-- && atomic_load(&rw->_rw_lock) &&
+           !(atomic_load(&rw->_rw_waiters) & PTHREAD_RWLOCK_WAITERS_MASK))
         a_spin();
 
     while ((r = pthread_rwlock_tryrdlock(rw)) == EBUSY) {
@@ -1,17 +1,24 @@
 #include "pthread_impl.h"
 
+static int trywrlock_word(pthread_rwlock_t* rw) {
+    return a_cas_shim(&rw->_rw_lock, 0, 0x7fffffff) ? EBUSY : 0;
+}
+
 int pthread_rwlock_timedwrlock(pthread_rwlock_t* restrict rw, const struct timespec* restrict at) {
     int r, t;
 
-    r = pthread_rwlock_trywrlock(rw);
+    // Biased readers don't show in the lock word, so once it is ours wait
+    // for them to leave rather than failing as trylock does.
+    r = trywrlock_word(rw);
     if (r != EBUSY)
-        return r;
+        goto done;
 
     int spins = 100;
-    while (spins-- && atomic_load(&rw->_rw_lock) && !atomic_load(&rw->_rw_waiters))
+    while (spins-- && atomic_load(&rw->_rw_lock) &&
+           !(atomic_load(&rw->_rw_waiters) & PTHREAD_RWLOCK_WAITERS_MASK))
         a_spin();
 
-    while ((r = pthread_rwlock_trywrlock(rw)) == EBUSY) {
+    while ((r = trywrlock_word(rw)) == EBUSY) {
         if (!(r = atomic_load(&rw->_rw_lock)))
             continue;
         t = r | PTHREAD_MUTEX_OWNED_LOCK_BIT;
@@ -22,5 +29,7 @@ int pthread_rwlock_timedwrlock(pthread_rwlock_t* restrict rw, const struct times
         if (r)
             return r;
     }
+done:
+    __pthread_rwlock_revoke(rw, true);
     return r;
 }
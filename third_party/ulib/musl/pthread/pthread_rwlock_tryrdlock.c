@@ -2,6 +2,8 @@
 
 int pthread_rwlock_tryrdlock(pthread_rwlock_t* rw) {
     int val, cnt;
+    if (__pthread_rwlock_rdlock_biased(rw))
+        return 0;
     do {
         val = atomic_load(&rw->_rw_lock);
         cnt = val & 0x7fffffff;
@@ -10,5 +12,6 @@ int pthread_rwlock_tryrdlock(pthread_rwlock_t* rw) {
         if (cnt == 0x7ffffffe)
             return EAGAIN;
     } while (a_cas_shim(&rw->_rw_lock, val, val + 1) != val);
+    __pthread_rwlock_rebias(rw);
     return 0;
 }
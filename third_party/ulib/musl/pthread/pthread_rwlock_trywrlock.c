@@ -1,7 +1,16 @@
+#include "futex_impl.h"
 #include "pthread_impl.h"
 
 int pthread_rwlock_trywrlock(pthread_rwlock_t* rw) {
     if (a_cas_shim(&rw->_rw_lock, 0, 0x7fffffff))
         return EBUSY;
+    if (!__pthread_rwlock_revoke(rw, false)) {
+        // A biased reader still holds it; let go again, waking anyone who
+        // started waiting in the meantime.
+        int waiters = atomic_load(&rw->_rw_waiters) & PTHREAD_RWLOCK_WAITERS_MASK;
+        if (atomic_exchange(&rw->_rw_lock, 0) < 0 || waiters)
+            __wake(&rw->_rw_lock, -1);
+        return EBUSY;
+    }
     return 0;
 }
@@ -4,10 +4,15 @@
 int pthread_rwlock_unlock(pthread_rwlock_t* rw) {
     int val, cnt, waiters, new;
 
+    // Go by the reader slots, not the lock word: a writer may hold the
+    // word while it waits in __pthread_rwlock_revoke() for this very slot.
+    if (__pthread_rwlock_unlock_biased(rw))
+        return 0;
+
     do {
         val = atomic_load(&rw->_rw_lock);
         cnt = val & 0x7fffffff;
-        waiters = atomic_load(&rw->_rw_waiters);
+        waiters = atomic_load(&rw->_rw_waiters) & PTHREAD_RWLOCK_WAITERS_MASK;
         new = (cnt == 0x7fffffff || cnt == 1) ? 0 : val - 1;
     } while (a_cas_shim(&rw->_rw_lock, val, new) != val);
 
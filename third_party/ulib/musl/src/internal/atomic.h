@@ -18,6 +18,13 @@ static inline void a_spin(void) {
                          :
                          : "memory");
 }
+#elif defined(__aarch64__)
+static inline void a_spin(void) {
+    __asm__ __volatile__("yield"
+                         :
+                         :
+                         : "memory");
+}
 #else
 #define a_spin() atomic_thread_fence(memory_order_seq_cst)
 #endif
@@ -38,6 +38,8 @@ typedef struct {
 
 struct tls_dtor;
 
+#define PTHREAD_RWLOCK_SLOTS_HELD 4
+
 struct pthread {
 #ifndef TLS_ABOVE_TP
     // These must be the very first members.
@@ -60,6 +62,12 @@ struct pthread {
     int tsd_used;
     int errno_value;
 
+    // the thread's koid, once it has been asked for
+    mx_koid_t koid;
+
+    // the reader table slots held, plus one, for biased read locks
+    uint16_t rwlock_slots[PTHREAD_RWLOCK_SLOTS_HELD];
+
     void* start_arg;
     void* (*start)(void*);
     void* result;
@@ -150,6 +158,26 @@ void __private_cond_signal(void* condvar, int n);
 int __libc_sigaction(int, const struct sigaction*, struct sigaction*);
 int __libc_sigprocmask(int, const sigset_t*, sigset_t*);
 
+// A pthread_rwlock_t is read-biased until a writer takes it: readers then
+// each claim a slot in a table of their own rather than all writing the
+// lock word, and a writer turns the bias off and waits for the slots
+// naming the lock to empty.  The bias stays off, and readers use the lock
+// word, for a while after each writer.  The off bit is kept in
+// _rw_waiters, the rest of which counts the threads waiting.
+#define PTHREAD_RWLOCK_BIAS_OFF 0x80000000
+#define PTHREAD_RWLOCK_WAITERS_MASK 0x7fffffff
+
+// Takes a read lock through the reader table, returning whether it did.
+bool __pthread_rwlock_rdlock_biased(pthread_rwlock_t*) ATTR_LIBC_VISIBILITY;
+// Releases a read lock taken that way, returning whether it was one.
+bool __pthread_rwlock_unlock_biased(pthread_rwlock_t*) ATTR_LIBC_VISIBILITY;
+// Turns the bias off, and returns whether no reader holds a slot.  With
+// |wait|, first waits until none does.
+bool __pthread_rwlock_revoke(pthread_rwlock_t*, bool wait) ATTR_LIBC_VISIBILITY;
+// Turns the bias back on if it has been off long enough.  Called with the
+// lock read-held through the lock word.
+void __pthread_rwlock_rebias(pthread_rwlock_t*) ATTR_LIBC_VISIBILITY;
+
 // This is guaranteed to only return 0, EINVAL, or ETIMEDOUT.
 int __timedwait(atomic_int*, int, clockid_t, const struct timespec*)
     ATTR_LIBC_VISIBILITY;
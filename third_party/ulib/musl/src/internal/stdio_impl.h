@@ -6,8 +6,8 @@
 
 #define UNGET 8
 
-#define FFINALLOCK(f) ((f)->lock >= 0 ? __lockfile((f)) : 0)
-#define FLOCK(f) int __need_unlock = ((f)->lock >= 0 ? __lockfile((f)) : 0)
+#define FFINALLOCK(f) (__stdio_need_lock((f)) ? __lockfile((f)) : 0)
+#define FLOCK(f) int __need_unlock = (__stdio_need_lock((f)) ? __lockfile((f)) : 0)
 #define FUNLOCK(f)     \
     if (__need_unlock) \
     __unlockfile((f))
@@ -50,6 +50,16 @@ struct _IO_FILE {
     struct __locale_struct* locale;
 };
 
+// A FILE needs locking unless its user has said it will do any locking
+// itself (a negative lock), or the process has only the one thread.  Only
+// that thread can start another, and never in the middle of a stdio call;
+// the acquire pairs with a thread's exit, so whatever it did last under
+// the lock is seen once it no longer counts.
+static inline int __stdio_need_lock(FILE* f) {
+    return f->lock >= 0 &&
+           atomic_load_explicit(&libc.thread_count, memory_order_acquire) > 1;
+}
+
 size_t __stdio_read(FILE*, unsigned char*, size_t) ATTR_LIBC_VISIBILITY;
 size_t __stdio_write(FILE*, const unsigned char*, size_t) ATTR_LIBC_VISIBILITY;
 size_t __stdout_write(FILE*, const unsigned char*, size_t) ATTR_LIBC_VISIBILITY;
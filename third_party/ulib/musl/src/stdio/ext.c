@@ -6,8 +6,17 @@ void _flushlbf(void) {
     fflush(0);
 }
 
+// With FSETLOCKING_BYCALLER, no stdio call on |f| locks it; the caller
+// promises only one thread uses it at a time.  A stream private to a
+// thread, with a large buffer from setvbuf(), then costs no atomics to
+// write and makes few, large writes.
 int __fsetlocking(FILE* f, int type) {
-    return 0;
+    int old = f->lock < 0 ? FSETLOCKING_BYCALLER : FSETLOCKING_INTERNAL;
+    if (type == FSETLOCKING_BYCALLER)
+        atomic_store(&f->lock, -1);
+    else if (type == FSETLOCKING_INTERNAL && f->lock < 0)
+        atomic_store(&f->lock, 0);
+    return old;
 }
 
 int __fwriting(FILE* f) {
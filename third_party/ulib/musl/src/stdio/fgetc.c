@@ -2,7 +2,7 @@
 
 int fgetc(FILE* f) {
     int c;
-    if (f->lock < 0 || !__lockfile(f))
+    if (!__stdio_need_lock(f) || !__lockfile(f))
         return getc_unlocked(f);
     c = getc_unlocked(f);
     __unlockfile(f);
@@ -1,7 +1,7 @@
 #include "stdio_impl.h"
 
 int putc(int c, FILE* f) {
-    if (f->lock < 0 || !__lockfile(f))
+    if (!__stdio_need_lock(f) || !__lockfile(f))
         return putc_unlocked(c, f);
     c = putc_unlocked(c, f);
     __unlockfile(f);
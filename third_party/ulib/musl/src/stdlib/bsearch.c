@@ -2,24 +2,17 @@
 
 void* bsearch(const void* key, const void* base, size_t nel, size_t width,
               int (*cmp)(const void*, const void*)) {
-    void* try
-        ;
-    int sign;
+    const char* lo = base;
     while (nel > 0) {
-        try
-            = (char*)base + width * (nel / 2);
-        sign = cmp(key, try);
-        if (!sign)
-            return try
-                ;
-        else if (nel == 1)
-            break;
-        else if (sign < 0)
+        const char* try = lo + width * (nel / 2);
+        int sign = cmp(key, try);
+        if (sign == 0)
+            return (void*)try;
+        if (sign > 0) {
+            lo = try + width;
+            nel -= nel / 2 + 1;
+        } else {
             nel /= 2;
-        else {
-            base = try
-                ;
-            nel -= nel / 2;
         }
     }
     return NULL;
@@ -0,0 +1,223 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// An introsort, with the parts of pattern-defeating quicksort (Orson
+// Peters, 2016) that pay for themselves: a partition that leaves runs of
+// equal keys balanced, a cheap check for input that is already sorted, and
+// heapsort when too many partitions come out lopsided, so the worst case
+// stays O(n log n).  Every helper is inlined into one copy of the sort per
+// way of swapping elements, so the usual 4- and 8-byte keys are moved as
+// words rather than byte by byte.
+
+typedef int (*cmpfun)(const void*, const void*);
+
+enum { SWAP_BYTES, SWAP_LONGS, SWAP_U32, SWAP_U64 };
+
+// Partitions this small are insertion sorted.
+#define INSERTION_MAX 12
+
+// Past this many elements the pivot is the median of three medians.
+#define NINTHER_MIN 128
+
+// How far a partial insertion sort may move elements before giving up.
+#define PARTIAL_MOVES_MAX 8
+
+#define INLINE static inline __attribute__((always_inline))
+
+INLINE void swap(char* a, char* b, size_t width, int kind) {
+    switch (kind) {
+    case SWAP_U32: {
+        uint32_t t = *(uint32_t*)a;
+        *(uint32_t*)a = *(uint32_t*)b;
+        *(uint32_t*)b = t;
+        break;
+    }
+    case SWAP_U64: {
+        uint64_t t = *(uint64_t*)a;
+        *(uint64_t*)a = *(uint64_t*)b;
+        *(uint64_t*)b = t;
+        break;
+    }
+    case SWAP_LONGS:
+        for (size_t i = 0; i < width; i += sizeof(long)) {
+            long t = *(long*)(a + i);
+            *(long*)(a + i) = *(long*)(b + i);
+            *(long*)(b + i) = t;
+        }
+        break;
+    default:
+        for (size_t i = 0; i < width; i++) {
+            char t = a[i];
+            a[i] = b[i];
+            b[i] = t;
+        }
+        break;
+    }
+}
+
+INLINE void insertion_sort(char* base, size_t nel, size_t width, cmpfun cmp, int kind) {
+    char* end = base + nel * width;
+    for (char* i = base + width; i < end; i += width) {
+        for (char* j = i; j > base && cmp(j - width, j) > 0; j -= width)
+            swap(j - width, j, width, kind);
+    }
+}
+
+// Insertion sorts, unless that takes more than a few moves, in which case
+// it returns false with the elements still to be sorted some other way.
+INLINE bool partial_insertion_sort(char* base, size_t nel, size_t width, cmpfun cmp,
+                                   int kind) {
+    char* end = base + nel * width;
+    size_t moves = 0;
+    for (char* i = base + width; i < end; i += width) {
+        for (char* j = i; j > base && cmp(j - width, j) > 0; j -= width) {
+            if (++moves > PARTIAL_MOVES_MAX)
+                return false;
+            swap(j - width, j, width, kind);
+        }
+    }
+    return true;
+}
+
+INLINE void sift_down(char* base, size_t root, size_t nel, size_t width, cmpfun cmp,
+                      int kind) {
+    for (;;) {
+        size_t child = 2 * root + 1;
+        if (child >= nel)
+            break;
+        if (child + 1 < nel && cmp(base + child * width, base + (child + 1) * width) < 0)
+            child++;
+        if (cmp(base + root * width, base + child * width) >= 0)
+            break;
+        swap(base + root * width, base + child * width, width, kind);
+        root = child;
+    }
+}
+
+INLINE void heap_sort(char* base, size_t nel, size_t width, cmpfun cmp, int kind) {
+    for (size_t i = nel / 2; i-- > 0;)
+        sift_down(base, i, nel, width, cmp, kind);
+    for (size_t i = nel - 1; i > 0; i--) {
+        swap(base, base + i * width, width, kind);
+        sift_down(base, 0, i, width, cmp, kind);
+    }
+}
+
+INLINE char* med3(char* a, char* b, char* c, cmpfun cmp) {
+    if (cmp(a, b) < 0)
+        return cmp(b, c) < 0 ? b : cmp(a, c) < 0 ? c : a;
+    return cmp(b, c) > 0 ? b : cmp(a, c) > 0 ? c : a;
+}
+
+INLINE void sort(char* base, size_t nel, size_t width, cmpfun cmp, int kind) {
+    // The smaller side of each partition is sorted first and the larger
+    // pushed, so this never holds more than log2(nel) of them.
+    struct {
+        char* base;
+        size_t nel;
+        int depth;
+    } stack[8 * sizeof(size_t)];
+    int sp = 0;
+
+    int depth = 0;
+    for (size_t n = nel; n > 1; n >>= 1)
+        depth += 2;
+
+    for (;;) {
+        if (nel <= INSERTION_MAX) {
+            insertion_sort(base, nel, width, cmp, kind);
+        } else if (depth == 0) {
+            heap_sort(base, nel, width, cmp, kind);
+        } else {
+            depth--;
+
+            // Bring the pivot to the front.
+            char* mid = base + (nel / 2) * width;
+            char* last = base + (nel - 1) * width;
+            char* pivot;
+            if (nel < NINTHER_MIN) {
+                pivot = med3(base, mid, last, cmp);
+            } else {
+                size_t s = (nel / 8) * width;
+                pivot = med3(med3(base, base + s, base + 2 * s, cmp),
+                             med3(mid - s, mid, mid + s, cmp),
+                             med3(last - 2 * s, last - s, last, cmp), cmp);
+            }
+            if (pivot != base)
+                swap(base, pivot, width, kind);
+
+            // Hoare's partition, which stops on keys equal to the pivot
+            // from both ends so that they split evenly.  Afterwards
+            // everything before |j| is no greater than the pivot and
+            // everything after it no less.
+            size_t i = 1, j = nel - 1;
+            bool swapped = false;
+            for (;;) {
+                while (i <= j && cmp(base + i * width, base) < 0)
+                    i++;
+                while (j >= i && cmp(base + j * width, base) > 0)
+                    j--;
+                if (i >= j)
+                    break;
+                swap(base + i * width, base + j * width, width, kind);
+                swapped = true;
+                i++;
+                j--;
+            }
+            if (j != 0)
+                swap(base, base + j * width, width, kind);
+
+            char* left = base;
+            size_t left_nel = j;
+            char* right = base + (j + 1) * width;
+            size_t right_nel = nel - j - 1;
+
+            // Nothing moved, so the input may well have been sorted
+            // already; if so both sides are done with a few compares.
+            if (!swapped &&
+                partial_insertion_sort(left, left_nel, width, cmp, kind) &&
+                partial_insertion_sort(right, right_nel, width, cmp, kind)) {
+                left_nel = right_nel = 0;
+            }
+
+            if (left_nel < right_nel) {
+                stack[sp].base = right;
+                stack[sp].nel = right_nel;
+                stack[sp].depth = depth;
+                sp++;
+                base = left;
+                nel = left_nel;
+            } else {
+                stack[sp].base = left;
+                stack[sp].nel = left_nel;
+                stack[sp].depth = depth;
+                sp++;
+                base = right;
+                nel = right_nel;
+            }
+            continue;
+        }
+
+        if (sp == 0)
+            break;
+        sp--;
+        base = stack[sp].base;
+        nel = stack[sp].nel;
+        depth = stack[sp].depth;
+    }
+}
+
+void qsort(void* base, size_t nel, size_t width, cmpfun cmp) {
+    if (nel < 2 || width == 0)
+        return;
+    uintptr_t align = (uintptr_t)base | width;
+    if (width == sizeof(uint32_t) && align % sizeof(uint32_t) == 0)
+        sort(base, nel, width, cmp, SWAP_U32);
+    else if (width == sizeof(uint64_t) && align % sizeof(uint64_t) == 0)
+        sort(base, nel, width, cmp, SWAP_U64);
+    else if (align % sizeof(long) == 0)
+        sort(base, nel, width, cmp, SWAP_LONGS);
+    else
+        sort(base, nel, width, cmp, SWAP_BYTES);
+}
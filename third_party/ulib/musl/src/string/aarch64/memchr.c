@@ -0,0 +1,39 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "neon.h"
+
+#include <string.h>
+
+// Each vector read is aligned, starting with the one holding |src|, and
+// none is read once |n| bytes are covered; a match at or past |n| is no
+// match.
+NO_ASAN void* memchr(const void* src, int c, size_t n) {
+    const unsigned char* s = src;
+    if (!n)
+        return 0;
+
+    uintptr_t off = (uintptr_t)s & 15;
+    const uint8_t* p = s - off;
+    const uint8x16_t vc = vdupq_n_u8((uint8_t)c);
+    uint64_t mask = __neon_mask(vceqq_u8(vld1q_u8(p), vc)) >> (off * 4);
+    if (mask) {
+        size_t i = __builtin_ctzll(mask) / 4;
+        return i < n ? (void*)(s + i) : 0;
+    }
+    if (n <= 16 - off)
+        return 0;
+    n -= 16 - off;
+    for (;;) {
+        p += 16;
+        mask = __neon_mask(vceqq_u8(vld1q_u8(p), vc));
+        if (mask) {
+            size_t i = __builtin_ctzll(mask) / 4;
+            return i < n ? (void*)(p + i) : 0;
+        }
+        if (n <= 16)
+            return 0;
+        n -= 16;
+    }
+}
@@ -0,0 +1,27 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include "libc.h"
+
+#include <arm_neon.h>
+#include <stdint.h>
+
+// NEON is part of ARMv8-A itself, so there is nothing to choose between at
+// runtime here.
+//
+// The routines below read whole aligned vectors, some of whose bytes may be
+// past the end of the string.  An aligned vector never spans a page, so
+// this never faults; but it does touch bytes ASan would call out of bounds,
+// so they are all NO_ASAN.
+
+// Four bits for each byte of |eq|, which is all ones or all zeros, in
+// order; the index of the first set byte is the count of trailing zeros
+// over four.  There is no movemask on arm64, but narrowing each halfword
+// by four bits gets this in one instruction.
+static inline uint64_t __neon_mask(uint8x16_t eq) {
+    uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(eq), 4);
+    return vget_lane_u64(vreinterpret_u64_u8(nibbles), 0);
+}
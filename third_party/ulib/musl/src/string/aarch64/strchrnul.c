@@ -0,0 +1,30 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "neon.h"
+
+#include <string.h>
+
+NO_ASAN char* __strchrnul(const char* s, int c) {
+    c = (unsigned char)c;
+    if (!c)
+        return (char*)s + strlen(s);
+
+    uintptr_t off = (uintptr_t)s & 15;
+    const uint8_t* p = (const uint8_t*)s - off;
+    const uint8x16_t vc = vdupq_n_u8((uint8_t)c);
+    uint8x16_t v = vld1q_u8(p);
+    uint64_t mask = __neon_mask(vorrq_u8(vceqzq_u8(v), vceqq_u8(v, vc))) >> (off * 4);
+    if (mask)
+        return (char*)s + __builtin_ctzll(mask) / 4;
+    for (;;) {
+        p += 16;
+        v = vld1q_u8(p);
+        mask = __neon_mask(vorrq_u8(vceqzq_u8(v), vceqq_u8(v, vc)));
+        if (mask)
+            return (char*)p + __builtin_ctzll(mask) / 4;
+    }
+}
+
+weak_alias(__strchrnul, strchrnul);
@@ -0,0 +1,21 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "neon.h"
+
+#include <string.h>
+
+NO_ASAN size_t strlen(const char* s) {
+    uintptr_t off = (uintptr_t)s & 15;
+    const uint8_t* p = (const uint8_t*)s - off;
+    uint64_t mask = __neon_mask(vceqzq_u8(vld1q_u8(p))) >> (off * 4);
+    if (mask)
+        return __builtin_ctzll(mask) / 4;
+    for (;;) {
+        p += 16;
+        mask = __neon_mask(vceqzq_u8(vld1q_u8(p)));
+        if (mask)
+            return (const char*)p + __builtin_ctzll(mask) / 4 - s;
+    }
+}
@@ -0,0 +1,27 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "simd.h"
+
+#include <cpuid.h>
+
+int __x86_64_avx2;
+
+// Races between threads calling this at once are harmless: they all find
+// the same answer.
+int __x86_64_avx2_probe(void) {
+    unsigned int a, b, c, d;
+    int v = 1;
+    // AVX2 needs the CPU to have it, and the OS to save the ymm registers.
+    if (__get_cpuid(1, &a, &b, &c, &d) &&
+        (c & bit_OSXSAVE) && (c & bit_AVX) && __get_cpuid_max(0, 0) >= 7) {
+        unsigned int xcr0_lo, xcr0_hi;
+        __asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+        __cpuid_count(7, 0, a, b, c, d);
+        if ((xcr0_lo & 6) == 6 && (b & bit_AVX2))
+            v = 2;
+    }
+    __x86_64_avx2 = v;
+    return v;
+}
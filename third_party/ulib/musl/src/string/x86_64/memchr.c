@@ -0,0 +1,70 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "simd.h"
+
+#include <immintrin.h>
+#include <string.h>
+
+// Each vector read is aligned, starting with the one holding |src|, and
+// none is read once |n| bytes are covered; a match at or past |n| is no
+// match.
+
+static NO_ASAN AVX2 void* memchr_avx2(const unsigned char* s, int c, size_t n) {
+    uintptr_t off = (uintptr_t)s & 31;
+    const __m256i* p = (const __m256i*)(s - off);
+    const __m256i vc = _mm256_set1_epi8((char)c);
+    uint32_t mask = (uint32_t)_mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(_mm256_load_si256(p), vc)) >> off;
+    if (mask) {
+        size_t i = __builtin_ctz(mask);
+        return i < n ? (void*)(s + i) : 0;
+    }
+    if (n <= 32 - off)
+        return 0;
+    n -= 32 - off;
+    for (;;) {
+        p++;
+        mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256(p), vc));
+        if (mask) {
+            size_t i = __builtin_ctz(mask);
+            return i < n ? (void*)((const char*)p + i) : 0;
+        }
+        if (n <= 32)
+            return 0;
+        n -= 32;
+    }
+}
+
+NO_ASAN void* memchr(const void* src, int c, size_t n) {
+    const unsigned char* s = src;
+    if (!n)
+        return 0;
+    if (__have_avx2())
+        return memchr_avx2(s, c, n);
+
+    uintptr_t off = (uintptr_t)s & 15;
+    const __m128i* p = (const __m128i*)(s - off);
+    const __m128i vc = _mm_set1_epi8((char)c);
+    uint32_t mask = (uint32_t)_mm_movemask_epi8(
+        _mm_cmpeq_epi8(_mm_load_si128(p), vc)) >> off;
+    if (mask) {
+        size_t i = __builtin_ctz(mask);
+        return i < n ? (void*)(s + i) : 0;
+    }
+    if (n <= 16 - off)
+        return 0;
+    n -= 16 - off;
+    for (;;) {
+        p++;
+        mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(p), vc));
+        if (mask) {
+            size_t i = __builtin_ctz(mask);
+            return i < n ? (void*)((const char*)p + i) : 0;
+        }
+        if (n <= 16)
+            return 0;
+        n -= 16;
+    }
+}
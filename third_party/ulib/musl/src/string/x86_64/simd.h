@@ -0,0 +1,32 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include "libc.h"
+
+#include <emmintrin.h>
+#include <stdint.h>
+
+// SSE2 is part of x86-64 itself, so the routines here use it without
+// asking.  Whether AVX2 can be used as well is worked out by the first call
+// to need it, and then kept: 0 if not yet known, 1 if not, 2 if so.  This
+// is a hidden variable with no relocation, so it works in the dynamic
+// linker before it has relocated itself.
+extern int __x86_64_avx2 ATTR_LIBC_VISIBILITY;
+int __x86_64_avx2_probe(void) ATTR_LIBC_VISIBILITY;
+
+static inline int __have_avx2(void) {
+    int v = __x86_64_avx2;
+    if (__builtin_expect(v == 0, 0))
+        v = __x86_64_avx2_probe();
+    return v == 2;
+}
+
+#define AVX2 __attribute__((target("avx2")))
+
+// The routines below read whole aligned vectors, some of whose bytes may be
+// past the end of the string.  An aligned vector never spans a page, so
+// this never faults; but it does touch bytes ASan would call out of bounds,
+// so they are all NO_ASAN.
@@ -0,0 +1,55 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "simd.h"
+
+#include <immintrin.h>
+#include <string.h>
+
+static NO_ASAN AVX2 char* strchrnul_avx2(const char* s, int c) {
+    uintptr_t off = (uintptr_t)s & 31;
+    const __m256i* p = (const __m256i*)(s - off);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i vc = _mm256_set1_epi8((char)c);
+    __m256i v = _mm256_load_si256(p);
+    uint32_t mask = (uint32_t)_mm256_movemask_epi8(
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, zero), _mm256_cmpeq_epi8(v, vc))) >> off;
+    if (mask)
+        return (char*)s + __builtin_ctz(mask);
+    for (;;) {
+        p++;
+        v = _mm256_load_si256(p);
+        mask = _mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, zero), _mm256_cmpeq_epi8(v, vc)));
+        if (mask)
+            return (char*)p + __builtin_ctz(mask);
+    }
+}
+
+NO_ASAN char* __strchrnul(const char* s, int c) {
+    c = (unsigned char)c;
+    if (!c)
+        return (char*)s + strlen(s);
+    if (__have_avx2())
+        return strchrnul_avx2(s, c);
+
+    uintptr_t off = (uintptr_t)s & 15;
+    const __m128i* p = (const __m128i*)(s - off);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i vc = _mm_set1_epi8((char)c);
+    __m128i v = _mm_load_si128(p);
+    uint32_t mask = (uint32_t)_mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi8(v, zero), _mm_cmpeq_epi8(v, vc))) >> off;
+    if (mask)
+        return (char*)s + __builtin_ctz(mask);
+    for (;;) {
+        p++;
+        v = _mm_load_si128(p);
+        mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, zero), _mm_cmpeq_epi8(v, vc)));
+        if (mask)
+            return (char*)p + __builtin_ctz(mask);
+    }
+}
+
+weak_alias(__strchrnul, strchrnul);
@@ -0,0 +1,43 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "simd.h"
+
+#include <immintrin.h>
+#include <string.h>
+
+static NO_ASAN AVX2 size_t strlen_avx2(const char* s) {
+    uintptr_t off = (uintptr_t)s & 31;
+    const __m256i* p = (const __m256i*)(s - off);
+    const __m256i zero = _mm256_setzero_si256();
+    uint32_t mask = (uint32_t)_mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(_mm256_load_si256(p), zero)) >> off;
+    if (mask)
+        return __builtin_ctz(mask);
+    for (;;) {
+        p++;
+        mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256(p), zero));
+        if (mask)
+            return (const char*)p + __builtin_ctz(mask) - s;
+    }
+}
+
+NO_ASAN size_t strlen(const char* s) {
+    if (__have_avx2())
+        return strlen_avx2(s);
+
+    uintptr_t off = (uintptr_t)s & 15;
+    const __m128i* p = (const __m128i*)(s - off);
+    const __m128i zero = _mm_setzero_si128();
+    uint32_t mask = (uint32_t)_mm_movemask_epi8(
+        _mm_cmpeq_epi8(_mm_load_si128(p), zero)) >> off;
+    if (mask)
+        return __builtin_ctz(mask);
+    for (;;) {
+        p++;
+        mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(p), zero));
+        if (mask)
+            return (const char*)p + __builtin_ctz(mask) - s;
+    }
+}